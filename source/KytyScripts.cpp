@@ -143,6 +143,9 @@ int main(int argc, char* argv[])
 				}
 				args.Add(str);
 			}
+#if KYTY_PROJECT != KYTY_PROJECT_BUILD_TOOLS
+			SetBytecodeCacheFolder(U"_Cache/lua");
+#endif
 			run_script(args.At(1), args);
 		} else
 		{
@@ -42,8 +42,25 @@ int KYTY_SYSV_ABI VoiceQoSInit(void* mem_block, uint32_t mem_size, int32_t app_t
 
 namespace Ajm {
 
-int KYTY_SYSV_ABI AjmInitialize(int64_t reserved, uint32_t* context);
-int KYTY_SYSV_ABI AjmModuleRegister(uint32_t context, uint32_t codec, int64_t reserved);
+struct AjmBuffer;
+struct AjmBatchError;
+
+int KYTY_SYSV_ABI   AjmInitialize(int64_t reserved, uint32_t* context);
+int KYTY_SYSV_ABI   AjmModuleRegister(uint32_t context, uint32_t codec, int64_t reserved);
+int KYTY_SYSV_ABI   AjmInstanceCreate(uint32_t context, uint32_t codec, uint64_t flags, uint32_t* instance);
+int KYTY_SYSV_ABI   AjmInstanceDestroy(uint32_t context, uint32_t instance);
+void* KYTY_SYSV_ABI AjmBatchJobControlBufferRa(void* buffer, uint32_t instance, uint64_t flags, const void* sideband_input,
+                                               size_t sideband_input_size, void* sideband_output, size_t sideband_output_size,
+                                               void* return_address);
+void* KYTY_SYSV_ABI AjmBatchJobRunBufferRa(void* buffer, uint32_t instance, uint64_t flags, const void* input, size_t input_size,
+                                           void* output, size_t output_size, void* sideband_output, size_t sideband_output_size,
+                                           void* return_address);
+void* KYTY_SYSV_ABI AjmBatchJobRunSplitBufferRa(void* buffer, uint32_t instance, uint64_t flags, const AjmBuffer* inputs, size_t inputs_num,
+                                                const AjmBuffer* outputs, size_t outputs_num, void* sideband_output,
+                                                size_t sideband_output_size, void* return_address);
+int KYTY_SYSV_ABI   AjmBatchStartBuffer(uint32_t context, const void* batch, size_t batch_size, int priority, AjmBatchError* error,
+                                        uint32_t* batch_id);
+int KYTY_SYSV_ABI   AjmBatchWait(uint32_t context, uint32_t batch_id, uint32_t timeout, AjmBatchError* error);
 
 } // namespace Ajm
 
@@ -0,0 +1,37 @@
+#ifndef EMULATOR_INCLUDE_EMULATOR_BENCHMARK_H_
+#define EMULATOR_INCLUDE_EMULATOR_BENCHMARK_H_
+
+#include "Kyty/Core/Common.h"
+#include "Kyty/Core/String.h"
+
+#include "Emulator/Common.h"
+
+#ifdef KYTY_EMU_ENABLED
+
+namespace Kyty::Profiler {
+
+// Benchmark mode, Config::BenchmarkEnabled(). Flips don't wait for the display or a 60 Hz pace, and the guest time advances by one
+// frame period per flip (see Loader::Timer::FrameDone()), so the guest does the same work per frame on any host. On exit the number
+// of frames, the wall time, the host frame time percentiles and the CPU time of each group of threads are printed.
+
+void BenchmarkInit();
+void BenchmarkPrint();
+
+// Called by the present thread after each flip
+void BenchmarkFrame();
+
+// Called by a thread when it starts and before it finishes, its CPU time is counted to the group
+void BenchmarkThreadStart(const String& group);
+void BenchmarkThreadStop();
+
+// Regression run. After the given number of frames the metrics (frame time percentiles, CPU time of each group, GPU counters per
+// frame) are saved to the results file, one "name value" line each, and the per-frame values to "<results>.frames.csv". If the
+// baseline file is set, a metric which exceeds its baseline value by more than the tolerance (in percent) is a regression. Then the
+// emulator exits with EXIT_FAILURE if there was a regression and EXIT_SUCCESS otherwise.
+void BenchmarkSetRun(uint32_t frames, const String& results_file, const String& baseline_file, double tolerance);
+
+} // namespace Kyty::Profiler
+
+#endif // KYTY_EMU_ENABLED
+
+#endif /* EMULATOR_INCLUDE_EMULATOR_BENCHMARK_H_ */
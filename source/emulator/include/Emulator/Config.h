@@ -39,6 +39,14 @@ enum class ProfilerDirection
 	FileAndNetwork
 };
 
+enum class PresentMode
+{
+	Fifo,
+	FifoRelaxed,
+	Mailbox,
+	Immediate
+};
+
 void Load(const Scripts::ScriptVar& cfg);
 
 void SetNextGen(bool mode);
@@ -60,15 +68,100 @@ String GetCommandBufferDumpFolder();
 Log::Direction GetPrintfDirection();
 String         GetPrintfOutputFile();
 String         GetPrintfOutputFolder();
+bool           PrintfAsyncEnabled(); // console and file output is written by a separate thread
+Log::Overflow  GetPrintfAsyncOverflow();
 
 ProfilerDirection GetProfilerDirection();
 String            GetProfilerOutputFile();
+String            GetProfilerTraceFile(); // empty - no Chrome trace of the blocks saved to the output file and the GPU events
+uint32_t          GetSamplerPeriod();     // microseconds between stack samples of the guest threads, 0 - off
+String            GetSamplerOutputFile();
+bool              HleStatsEnabled(); // calls and host time of every imported HLE function, printed on exit and by F9
 
 bool SpirvDebugPrintfEnabled();
 
 bool   PipelineDumpEnabled();
 String GetPipelineDumpFolder();
 
+bool     DumpsCompressed();  // shader logs, pipeline and command buffer dumps are zstd-compressed (.zst)
+uint32_t GetDumpQueueSize(); // MB of dumps waiting to be written, a thread which dumps more waits for the writer
+
+bool   PipelineCacheEnabled();
+bool   PipelinePrewarmEnabled();
+bool   ShaderCacheEnabled();
+bool   RelocationCacheEnabled(); // resolved relocations are reused while the loaded modules and HLE symbols are unchanged
+bool   BootSnapshotEnabled();    // loaded and patched segments are saved, and mapped from the snapshot on the next boot
+String GetCacheFolder();
+
+String   GetRemoteCacheUrl();     // http://host[:port][/prefix] of a shared cache server, the cache is local only if empty
+uint32_t GetRemoteCacheTimeout(); // ms
+
+bool     AsyncPipelinesEnabled();
+uint32_t GetPipelineEvictMinFrames(); // a pipeline is only evicted this many frames after its last use
+
+bool     GpuMemoryWatcherEnabled();
+bool     GpuDetileEnabled();
+bool     GpuMipGenerationEnabled();
+bool     GpuMemoryBudgetEnabled();
+uint32_t GetGpuMemoryBudgetUsage(); // percent of the budget, objects are evicted above it
+uint32_t GetGpuFramesInFlight();
+bool     GpuSubmitThreadEnabled();     // command buffers of a queue are submitted in batches by one thread
+bool     FastClearEnabled();           // full-screen clear draws are replaced by render pass load operations
+uint32_t GetCommandBufferSplitDraws(); // 0 - a submission is recorded into one command buffer
+uint32_t GetRenderScale();             // percent of the guest resolution, 50 - 200
+uint32_t GetSampledHashInterval();     // 0 - large objects are always fully hashed
+uint32_t GetAsyncUploadThreshold();    // KB, larger texture uploads don't wait for the transfer queue, 0 - all uploads wait
+uint32_t GetMutexSpinCount();          // 0 - a contended guest mutex blocks at once
+uint32_t GetJobWorkers();              // threads of the shared job pool, 0 - one less than the host cores
+uint32_t GetTraceLevel();              // 0 - off, 1 - HLE function names, 2 - and their arguments
+String   GetTraceBinaryFile();         // empty - traces are printed as text, otherwise written in binary form, see kyty_trace_decode
+bool     FileMappingEnabled();         // read-only files of /app0 and executable segments are memory-mapped
+bool     FilePrefetchEnabled();        // files of /app0 are read ahead in the background in the order of their PlayGo chunks
+bool     SaveDataWriteBehind();        // save data is kept in memory while mounted and written to the host on a worker at unmount
+bool     SaveDataCompressed();         // write-behind save data files are zstd-compressed on the host
+bool     TlsDirectAccess();            // guest TLS accesses are patched to load from a host thread slot
+bool     HleDirectCallsEnabled();      // PLT entries of imports bound to HLE functions jump to them without the GOT
+bool     HostLibcEnabled();            // memory and string functions of the guest libc are replaced by the host ones
+bool     ThreadAffinityEnabled();      // guest cores and emulator threads are pinned to separate host cores
+uint32_t GetThreadAffinityEmulatorCores();
+bool     ThreadPriorityEnabled(); // Linux: guest priorities are applied as nice values
+bool     RawTscEnabled();         // time counters read rdtsc if the host has an invariant TSC
+bool     LargePagesEnabled();     // large aligned guest mappings are backed by host huge pages if possible
+bool     FlexibleMemoryLazy();    // flexible memory takes host memory for the touched pages only, without large pages
+bool     PushDescriptorsEnabled();
+bool     AsyncWriteBackEnabled();
+
+PresentMode GetPresentMode();
+uint32_t    GetSwapchainImageCount();
+bool        FramePacingEnabled();
+bool        VblankTimerEnabled(); // vblank is signaled by a timer thread at 60 Hz instead of after each flip by the present thread
+bool        HeadlessEnabled();  // no window: flipped buffers are blitted to offscreen images and vblank runs on a timer
+bool        HeadlessUncapped(); // headless: flips and vblank aren't paced to 60 Hz, for frame throughput measurements
+bool        BenchmarkEnabled(); // unpaced flips, guest time advances by a frame per flip, a frame time report on exit
+
+bool HostMemoryImportEnabled();
+
+bool   GpuProfilerEnabled();
+String GetGpuProfilerOutputFile();
+
+String GetStartupReportFile(); // empty - the startup timeline is only printed
+
+bool     AudioOutputEnabled(); // AudioOut ports are played on the host device, an output blocks until the port buffer has room
+uint32_t GetAudioLatencyMs();  // buffered audio per port
+
+bool GpuCountersEnabled(); // per frame counters in the log and the window title
+
+bool     CommandBufferCaptureEnabled();
+String   GetCommandBufferCaptureFile();
+uint32_t GetCommandBufferCaptureStartFrame();
+uint32_t GetCommandBufferCaptureFrames();
+
+bool SpirvTextAssemblerEnabled();
+
+bool ShaderPrefetchEnabled();
+
+bool ShaderCodeOptimizationEnabled();
+
 } // namespace Kyty::Config
 
 #endif
@@ -2,6 +2,7 @@
 #define EMULATOR_INCLUDE_EMULATOR_CONTROLLER_H_
 
 #include "Kyty/Core/Common.h"
+#include "Kyty/Core/String.h"
 #include "Kyty/Core/Subsystems.h"
 
 #include "Emulator/Common.h"
@@ -54,8 +55,15 @@ inline int controller_get_axis(int min, int max, int value)
 
 void ControllerConnect(int id);
 void ControllerDisconnect(int id);
-void ControllerButton(int id, uint32_t button, bool down);
-void ControllerAxis(int id, Axis axis, int value);
+void ControllerButton(int id, uint32_t button, bool down, uint64_t time); // time - process time of the event, in microseconds
+void ControllerAxis(int id, Axis axis, int value, uint64_t time);
+
+// Recorded input. The states of the active controller are saved with the number of flips done before them, and replayed at the same
+// flips by a controller which is connected first. Start functions and ControllerReplayUpdate() are called from the event thread.
+void ControllerRecordStart(const String& file_name);
+void ControllerReplayStart(const String& file_name);
+void ControllerReplayUpdate();
+void ControllerFrameDone(); // called after each flip
 
 int KYTY_SYSV_ABI PadInit();
 int KYTY_SYSV_ABI PadOpen(int user_id, int type, int index, const void* param);
@@ -0,0 +1,28 @@
+#ifndef EMULATOR_INCLUDE_EMULATOR_GRAPHICS_CAPTURE_H_
+#define EMULATOR_INCLUDE_EMULATOR_GRAPHICS_CAPTURE_H_
+
+#include "Kyty/Core/Common.h"
+#include "Kyty/Core/String.h"
+
+#include "Emulator/Common.h"
+
+#ifdef KYTY_EMU_ENABLED
+
+namespace Kyty::Libs::Graphics {
+
+// Binary capture of the graphics ring. The first captured submit snapshots all GPU-visible memory, later submits record the pages
+// changed by the CPU since the previous one. Replay feeds the recorded submits through the command processor and measures frame times.
+
+void CaptureInit();
+
+void CaptureSubmit(const uint32_t* cmd_draw_buffer, uint32_t num_draw_dw, const uint32_t* cmd_const_buffer, uint32_t num_const_dw,
+                   bool flip, int handle, int index, int flip_mode, int64_t flip_arg);
+void CaptureDone();
+
+void CaptureReplay(const String& file_name, uint32_t loops);
+
+} // namespace Kyty::Libs::Graphics
+
+#endif // KYTY_EMU_ENABLED
+
+#endif /* EMULATOR_INCLUDE_EMULATOR_GRAPHICS_CAPTURE_H_ */
@@ -0,0 +1,31 @@
+#ifndef EMULATOR_INCLUDE_EMULATOR_GRAPHICS_DUMPWRITER_H_
+#define EMULATOR_INCLUDE_EMULATOR_GRAPHICS_DUMPWRITER_H_
+
+#include "Kyty/Core/Common.h"
+#include "Kyty/Core/File.h"
+#include "Kyty/Core/String.h"
+
+#include "Emulator/Common.h"
+
+#ifdef KYTY_EMU_ENABLED
+
+namespace Kyty::Libs::Graphics {
+
+// Shader logs, pipeline and command buffer dumps are printed into a file created with Core::File::CreateInMem() and written to the
+// host by a separate thread, so the draw and translation threads don't wait for the disk. At most Config::GetDumpQueueSize() MB
+// wait in the queue, a thread which dumps more waits for the writer. With Config::DumpsCompressed() the files are zstd-compressed
+// and get the ".zst" suffix.
+
+void DumpWriterInit();
+
+// Takes the contents of the in-memory file and closes it
+void DumpWriterPush(const String& file_name, Core::File* f);
+
+// Waits until the queued dumps are written
+void DumpWriterFlush();
+
+} // namespace Kyty::Libs::Graphics
+
+#endif // KYTY_EMU_ENABLED
+
+#endif /* EMULATOR_INCLUDE_EMULATOR_GRAPHICS_DUMPWRITER_H_ */
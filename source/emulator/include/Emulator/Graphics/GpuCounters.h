@@ -0,0 +1,43 @@
+#ifndef EMULATOR_INCLUDE_EMULATOR_GRAPHICS_GPUCOUNTERS_H_
+#define EMULATOR_INCLUDE_EMULATOR_GRAPHICS_GPUCOUNTERS_H_
+
+#include "Kyty/Core/Common.h"
+#include "Kyty/Core/String.h"
+
+#include "Emulator/Common.h"
+
+#ifdef KYTY_EMU_ENABLED
+
+namespace Kyty::Libs::Graphics {
+
+enum class GpuCounter
+{
+	Draws,
+	Dispatches,
+	PipelineCacheHits,
+	PipelineCacheMisses,
+	ShaderTranslations,
+	DescriptorSets,
+	BytesUploaded,
+	BytesHashed,
+	DetileTimeUs,
+	Vblanks,
+	VblankJitterUs, // how late the vblank timer woke up, in total
+
+	Max
+};
+
+// Per frame counters of the graphics hot paths. They are lock-free and cost nothing but a branch if GpuCountersEnabled is off.
+
+void GpuCounterAdd(GpuCounter counter, uint64_t value = 1);
+
+// Closes the frame, the counters are printed and kept for GpuCountersGetText()
+void     GpuCountersFrameDone();
+uint64_t GpuCountersGetLastFrame(GpuCounter counter);
+String   GpuCountersGetText();
+
+} // namespace Kyty::Libs::Graphics
+
+#endif // KYTY_EMU_ENABLED
+
+#endif /* EMULATOR_INCLUDE_EMULATOR_GRAPHICS_GPUCOUNTERS_H_ */
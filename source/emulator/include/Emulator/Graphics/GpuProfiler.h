@@ -0,0 +1,46 @@
+#ifndef EMULATOR_INCLUDE_EMULATOR_GRAPHICS_GPUPROFILER_H_
+#define EMULATOR_INCLUDE_EMULATOR_GRAPHICS_GPUPROFILER_H_
+
+#include "Kyty/Core/Common.h"
+
+#include "Emulator/Common.h"
+
+#include <vulkan/vulkan_core.h>
+
+#ifdef KYTY_EMU_ENABLED
+
+namespace Kyty::Core {
+class File;
+} // namespace Kyty::Core
+
+namespace Kyty::Libs::Graphics {
+
+struct GraphicContext;
+struct GpuProfilerQueries;
+
+// Timestamps written around the commands of a command buffer. They are read back when the fence of the buffer is signaled, collated
+// per frame and saved as a Chrome trace (chrome://tracing, Perfetto).
+
+void GpuProfilerInit();
+void GpuProfilerSave();
+// Appends the events to a Chrome trace written by the CPU profiler. Every event line ends with a comma.
+void GpuProfilerWriteTraceEvents(Core::File* f, int pid);
+
+// Returns nullptr if the profiler is disabled or the queue can't write timestamps
+GpuProfilerQueries* GpuProfilerAcquire(GraphicContext* ctx, int queue);
+void                GpuProfilerRelease(GpuProfilerQueries* queries);
+
+void GpuProfilerBegin(GpuProfilerQueries* queries, VkCommandBuffer vk_buffer);
+void GpuProfilerEnd(GpuProfilerQueries* queries, VkCommandBuffer vk_buffer);
+void GpuProfilerSubmit(GpuProfilerQueries* queries);
+void GpuProfilerCollect(GraphicContext* ctx, GpuProfilerQueries* queries);
+
+// Scopes can be nested. Category and name must be string literals.
+void GpuProfilerBeginScope(GpuProfilerQueries* queries, VkCommandBuffer vk_buffer, const char* category, const char* name);
+void GpuProfilerEndScope(GpuProfilerQueries* queries, VkCommandBuffer vk_buffer);
+
+} // namespace Kyty::Libs::Graphics
+
+#endif // KYTY_EMU_ENABLED
+
+#endif /* EMULATOR_INCLUDE_EMULATOR_GRAPHICS_GPUPROFILER_H_ */
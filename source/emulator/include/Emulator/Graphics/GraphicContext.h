@@ -13,6 +13,8 @@
 namespace Kyty::Libs::Graphics {
 
 class CommandProcessor;
+struct VulkanMemoryBlock;
+struct DepthColorCopy;
 
 struct VulkanSwapchain
 {
@@ -27,23 +29,36 @@ struct VulkanSwapchain
 	uint32_t       current_index              = 0;
 };
 
+// Timeline semaphore values the next submit of a command buffer has to wait for
+struct VulkanCommandBufferWaits
+{
+	static constexpr uint32_t WAITS_MAX = 4;
+
+	VkSemaphore semaphores[WAITS_MAX] = {};
+	uint64_t    values[WAITS_MAX]     = {};
+	uint32_t    num                   = 0;
+};
+
 struct VulkanCommandPool
 {
-	Core::Mutex      mutex;
-	VkCommandPool    pool          = nullptr;
-	VkCommandBuffer* buffers       = nullptr;
-	VkFence*         fences        = nullptr;
-	VkSemaphore*     semaphores    = nullptr;
-	bool*            busy          = nullptr;
-	uint32_t         buffers_count = 0;
+	Core::Mutex               mutex;
+	VkCommandPool*            pools           = nullptr;
+	VkCommandBuffer*          buffers         = nullptr;
+	VkSemaphore*              semaphores      = nullptr;
+	VkSemaphore*              timelines       = nullptr;
+	uint64_t*                 timeline_values = nullptr;
+	VulkanCommandBufferWaits* waits           = nullptr;
+	bool*                     busy            = nullptr;
+	uint32_t                  buffers_count   = 0;
 };
 
 struct VulkanQueueInfo
 {
-	Core::Mutex* mutex    = nullptr;
-	uint32_t     family   = static_cast<uint32_t>(-1);
-	uint32_t     index    = static_cast<uint32_t>(-1);
-	VkQueue      vk_queue = nullptr;
+	Core::Mutex* mutex      = nullptr;
+	uint32_t     family     = static_cast<uint32_t>(-1);
+	uint32_t     index      = static_cast<uint32_t>(-1);
+	VkQueue      vk_queue   = nullptr;
+	bool         timestamps = false;
 };
 
 struct GraphicContext
@@ -58,12 +73,19 @@ struct GraphicContext
 	static constexpr int QUEUE_COMPUTE_START = 0;
 	static constexpr int QUEUE_COMPUTE_NUM   = 8;
 
-	uint32_t                 screen_width    = 0;
-	uint32_t                 screen_height   = 0;
-	VkInstance               instance        = nullptr;
-	VkDebugUtilsMessengerEXT debug_messenger = nullptr;
-	VkPhysicalDevice         physical_device = nullptr;
-	VkDevice                 device          = nullptr;
+	uint32_t                 screen_width           = 0;
+	uint32_t                 screen_height          = 0;
+	VkInstance               instance               = nullptr;
+	VkDebugUtilsMessengerEXT debug_messenger        = nullptr;
+	VkPhysicalDevice         physical_device        = nullptr;
+	VkDevice                 device                 = nullptr;
+	bool                     extended_dynamic_state = false; // VK_EXT_extended_dynamic_state is enabled
+	uint32_t                 max_push_descriptors   = 0;     // VK_KHR_push_descriptor is enabled if not 0
+	uint64_t                 host_import_alignment  = 0;     // VK_EXT_external_memory_host is enabled if not 0
+	bool                     memory_budget          = false; // VK_EXT_memory_budget is enabled
+	float                    timestamp_period       = 0.0f;  // Nanoseconds per timestamp tick
+	uint32_t                 push_constants_max     = 128;   // Bytes, maxPushConstantsSize
+	uint64_t                 uniform_alignment      = 256;   // minUniformBufferOffsetAlignment
 	VulkanQueueInfo          queues[QUEUES_NUM];
 };
 
@@ -75,6 +97,8 @@ struct VulkanMemory
 	VkDeviceSize          offset       = 0;
 	uint32_t              type         = 0;
 	uint64_t              unique_id    = 0;
+	VulkanMemoryBlock*    block        = nullptr;
+	uint32_t              block_range  = 0;
 };
 
 enum class VulkanImageType
@@ -89,16 +113,22 @@ enum class VulkanImageType
 
 struct VulkanImage
 {
-	static constexpr int VIEW_MAX           = 4;
+	static constexpr int VIEW_MAX           = 5;
 	static constexpr int VIEW_DEFAULT       = 0;
 	static constexpr int VIEW_BGRA          = 1;
 	static constexpr int VIEW_DEPTH_TEXTURE = 2;
+	static constexpr int VIEW_ALIAS         = 3; // render textures only: the format of the other color space (UNORM <-> SRGB)
+	static constexpr int VIEW_ALIAS_BGRA    = 4;
 
 	explicit VulkanImage(VulkanImageType type): type(type) {}
 
+	// Size of the image as the guest sees it
+	[[nodiscard]] VkExtent2D GetGuestExtent() const { return (guest_extent.width != 0 ? guest_extent : extent); }
+
 	VulkanImageType        type                 = VulkanImageType::Unknown;
 	VkFormat               format               = VK_FORMAT_UNDEFINED;
 	VkExtent2D             extent               = {};
+	VkExtent2D             guest_extent         = {}; // Zero unless the resolution is scaled, see UtilApplyRenderScale()
 	VkImage                image                = nullptr;
 	VkImageView            image_view[VIEW_MAX] = {};
 	VkImageLayout          layout               = VK_IMAGE_LAYOUT_UNDEFINED;
@@ -114,6 +144,12 @@ struct DepthStencilVulkanImage: public VulkanImage
 {
 	DepthStencilVulkanImage(): VulkanImage(VulkanImageType::DepthStencil) {}
 	bool compressed = false;
+	bool sampled    = false;
+
+	// Color copy of the depth aspect for the shaders which can't read the image itself, see UtilDepthToColor()
+	DepthColorCopy* color_copy       = nullptr;
+	uint64_t        generation       = 0; // Incremented by every draw which renders to the image
+	uint64_t        color_generation = static_cast<uint64_t>(-1);
 };
 
 struct TextureVulkanImage: public VulkanImage
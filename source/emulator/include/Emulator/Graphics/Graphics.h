@@ -2,6 +2,7 @@
 #define EMULATOR_INCLUDE_EMULATOR_GRAPHICS_GRAPHICS_H_
 
 #include "Kyty/Core/Common.h"
+#include "Kyty/Core/String.h"
 #include "Kyty/Core/Subsystems.h"
 
 #include "Emulator/Common.h"
@@ -18,6 +19,9 @@ KYTY_SUBSYSTEM_DEFINE(Graphics);
 
 void GraphicsDbgDumpDcb(const char* type, uint32_t num_dw, uint32_t* cmd_buffer);
 
+// Per-title folder for persistent caches: <CacheFolder>/<TITLE_ID>/
+String GraphicsGetCacheFolder();
+
 namespace Gen4 {
 
 int KYTY_SYSV_ABI      GraphicsSetVsShader(uint32_t* cmd, uint64_t size, const uint32_t* vs_regs, uint32_t shader_modifier);
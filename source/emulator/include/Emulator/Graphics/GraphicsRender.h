@@ -25,6 +25,10 @@ struct RenderTextureVulkanImage;
 struct VulkanCommandPool;
 struct VulkanBuffer;
 struct VulkanFramebuffer;
+struct VulkanPipeline;
+struct CommandBufferBarriers;
+struct CommandBufferUniforms;
+struct GpuProfilerQueries;
 struct RenderDepthInfo;
 struct RenderColorInfo;
 
@@ -44,11 +48,12 @@ public:
 	void Allocate();
 	void Free();
 	void Begin() const;
-	void End() const;
+	void End();
 	void Execute();
 	void ExecuteWithSemaphore();
-	void BeginRenderPass(VulkanFramebuffer* framebuffer, RenderColorInfo* color, RenderDepthInfo* depth) const;
-	void EndRenderPass() const;
+	void BeginRenderPass(VulkanFramebuffer* framebuffer, RenderColorInfo* color, RenderDepthInfo* depth);
+	void EndRenderPass();
+	void FlushBarriers();
 	void WaitForFence();
 	void WaitForFenceAndReset();
 
@@ -56,16 +61,62 @@ public:
 	VulkanCommandPool*     GetPool() { return m_pool; }
 	[[nodiscard]] bool     IsExecute() const { return m_execute; }
 
+	// What the previous draw recorded into this buffer resolved and bound
+	struct DrawState
+	{
+		static constexpr int VERTEX_BUFFERS_MAX = 16;
+
+		VulkanFramebuffer* framebuffer                        = nullptr;
+		VulkanPipeline*    pipeline                           = nullptr;
+		int                topology                           = -1;
+		int                frame                              = -1;
+		uint64_t           generation                         = 0;
+		VulkanBuffer*      vertex_buffers[VERTEX_BUFFERS_MAX] = {};
+		uint64_t           vertex_offsets[VERTEX_BUFFERS_MAX] = {};
+		VulkanBuffer*      index_buffer                       = nullptr;
+		int                index_type                         = -1;
+	};
+
+	DrawState* GetDrawState() { return &m_draw_state; }
+
+	// Barriers which are recorded by FlushBarriers() before the next command that depends on them
+	CommandBufferBarriers* GetBarriers() { return m_barriers; }
+
+	// Uniform memory written by the draws and dispatches of this buffer, given back when the buffer has completed
+	CommandBufferUniforms* GetUniforms() { return m_uniforms; }
+
+	// GPU timestamps around the recorded commands, no-op if the GPU profiler is disabled
+	void BeginProfilerScope(const char* category, const char* name);
+	void EndProfilerScope();
+
 private:
-	VulkanCommandPool* m_pool    = nullptr;
-	uint32_t           m_index   = static_cast<uint32_t>(-1);
-	int                m_queue   = -1;
-	bool               m_execute = false;
-	CommandProcessor*  m_parent  = nullptr;
+	// Render pass stays open after EndRenderPass() and is continued by the next draw to the same framebuffer
+	struct OpenRenderPass
+	{
+		bool               open        = false;
+		bool               can_merge   = false;
+		VulkanFramebuffer* framebuffer = nullptr;
+		uint64_t           generation  = 0;
+	};
+
+	void BreakRenderPass();
+
+	VulkanCommandPool*     m_pool     = nullptr;
+	uint32_t               m_index    = static_cast<uint32_t>(-1);
+	int                    m_queue    = -1;
+	bool                   m_execute  = false;
+	CommandProcessor*      m_parent   = nullptr;
+	CommandBufferBarriers* m_barriers = nullptr;
+	CommandBufferUniforms* m_uniforms = nullptr;
+	GpuProfilerQueries*    m_queries  = nullptr;
+	DrawState              m_draw_state;
+	OpenRenderPass         m_render_pass;
 };
 
 void GraphicsRenderInit();
 void GraphicsRenderCreateContext();
+void GraphicsRenderPrebuildCaches();
+void GraphicsRenderDestroy();
 
 void GraphicsRenderDrawIndex(uint64_t submit_id, CommandBuffer* buffer, HW::Context* ctx, HW::UserConfig* ucfg, HW::Shader* sh_ctx,
                              uint32_t index_type_and_size, uint32_t index_count, const void* index_addr, uint32_t flags, uint32_t type);
@@ -88,6 +139,7 @@ void GraphicsRenderWriteAtEndOfPipeWithInterruptWriteBack64(uint64_t submit_id,
 void GraphicsRenderWriteAtEndOfPipeWithInterrupt64(uint64_t submit_id, CommandBuffer* buffer, uint64_t* dst_gpu_addr, uint64_t value);
 void GraphicsRenderWriteAtEndOfPipeWithInterrupt32(uint64_t submit_id, CommandBuffer* buffer, uint32_t* dst_gpu_addr, uint32_t value);
 void GraphicsRenderWriteBack(CommandProcessor* cp);
+void GraphicsRenderWriteBackPending(CommandProcessor* cp);
 void GraphicsRenderDispatchDirect(uint64_t submit_id, CommandBuffer* buffer, HW::Context* ctx, HW::Shader* sh_ctx, uint32_t thread_group_x,
                                   uint32_t thread_group_y, uint32_t thread_group_z, uint32_t mode);
 void GraphicsRenderMemoryBarrier(CommandBuffer* buffer);
@@ -108,8 +160,7 @@ void DeleteDescriptor(RenderTextureVulkanImage* image);
 int GraphicsRenderAddEqEvent(LibKernel::EventQueue::KernelEqueue eq, int id, void* udata);
 int GraphicsRenderDeleteEqEvent(LibKernel::EventQueue::KernelEqueue eq, int id);
 
-void GraphicsRenderClearGds(uint64_t dw_offset, uint32_t dw_num, uint32_t clear_value);
-void GraphicsRenderReadGds(uint32_t* dst, uint32_t dw_offset, uint32_t dw_size);
+void GraphicsRenderClearGds(CommandBuffer* buffer, uint64_t dw_offset, uint32_t dw_num, uint32_t clear_value);
 
 } // namespace Kyty::Libs::Graphics
 
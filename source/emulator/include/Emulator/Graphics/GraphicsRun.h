@@ -11,6 +11,9 @@ namespace Kyty::Libs::Graphics {
 
 class CommandProcessor;
 
+// Flip packets submitted with this handle only write their labels, used when there is no video out
+constexpr int GRAPHICS_RUN_FLIP_HANDLE_NONE = -1;
+
 void GraphicsRunInit();
 
 void     GraphicsRunSubmit(uint32_t* cmd_draw_buffer, uint32_t num_draw_dw, uint32_t* cmd_const_buffer, uint32_t num_const_dw);
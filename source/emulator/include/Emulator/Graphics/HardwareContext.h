@@ -640,59 +640,157 @@ public:
 
 	KYTY_CLASS_DEFAULT_COPY(Context);
 
+	// Register groups written since the last draw consumed them
+	static constexpr uint32_t DIRTY_COLOR_TARGETS = 1u << 0u;
+	static constexpr uint32_t DIRTY_DEPTH_TARGET  = 1u << 1u;
+	static constexpr uint32_t DIRTY_VIEWPORT      = 1u << 2u;
+	static constexpr uint32_t DIRTY_RASTER        = 1u << 3u;
+	static constexpr uint32_t DIRTY_DEPTH_STENCIL = 1u << 4u;
+	static constexpr uint32_t DIRTY_BLEND         = 1u << 5u;
+	static constexpr uint32_t DIRTY_SHADER_REGS   = 1u << 6u;
+	static constexpr uint32_t DIRTY_ALL           = 0x7fu;
+
 	void Reset() { *this = Context(); }
 
-	void SetColorBase(uint32_t slot, const ColorBase& base) { m_render_targets[slot].base = base; }
-	void SetColorPitch(uint32_t slot, const ColorPitch& pitch) { m_render_targets[slot].pitch = pitch; }
-	void SetColorSlice(uint32_t slot, const ColorSlice& slice) { m_render_targets[slot].slice = slice; }
-	void SetColorView(uint32_t slot, const ColorView& view) { m_render_targets[slot].view = view; }
-	void SetColorInfo(uint32_t slot, const ColorInfo& info) { m_render_targets[slot].info = info; }
-	void SetColorAttrib(uint32_t slot, const ColorAttrib& attrib) { m_render_targets[slot].attrib = attrib; }
-	void SetColorAttrib2(uint32_t slot, const ColorAttrib2& attrib2) { m_render_targets[slot].attrib2 = attrib2; }
-	void SetColorAttrib3(uint32_t slot, const ColorAttrib3& attrib3) { m_render_targets[slot].attrib3 = attrib3; }
-	void SetColorDccControl(uint32_t slot, const ColorDccControl& dcc) { m_render_targets[slot].dcc = dcc; }
-	void SetColorCmask(uint32_t slot, const ColorCmask& cmask) { m_render_targets[slot].cmask = cmask; }
-	void SetColorCmaskSlice(uint32_t slot, const ColorCmaskSlice& cmask_slice) { m_render_targets[slot].cmask_slice = cmask_slice; }
-	void SetColorFmask(uint32_t slot, const ColorFmask& fmask) { m_render_targets[slot].fmask = fmask; }
-	void SetColorFmaskSlice(uint32_t slot, const ColorFmaskSlice& fmask_slice) { m_render_targets[slot].fmask_slice = fmask_slice; }
-	void SetColorClearWord0(uint32_t slot, const ColorClearWord0& clear_word0) { m_render_targets[slot].clear_word0 = clear_word0; }
-	void SetColorClearWord1(uint32_t slot, const ColorClearWord1& clear_word1) { m_render_targets[slot].clear_word1 = clear_word1; }
-	void SetColorDccAddr(uint32_t slot, const ColorDccAddr& dcc_addr) { m_render_targets[slot].dcc_addr = dcc_addr; }
-	void SetColorSize(uint32_t slot, const ColorSize& size) { m_render_targets[slot].size = size; }
+	[[nodiscard]] uint32_t GetDirty() const { return m_dirty; }
+	void                   ClearDirty() { m_dirty = 0; }
+
+	void SetColorBase(uint32_t slot, const ColorBase& base) { m_render_targets[slot].base = base; m_dirty |= DIRTY_COLOR_TARGETS; }
+	void SetColorPitch(uint32_t slot, const ColorPitch& pitch) { m_render_targets[slot].pitch = pitch; m_dirty |= DIRTY_COLOR_TARGETS; }
+	void SetColorSlice(uint32_t slot, const ColorSlice& slice) { m_render_targets[slot].slice = slice; m_dirty |= DIRTY_COLOR_TARGETS; }
+	void SetColorView(uint32_t slot, const ColorView& view) { m_render_targets[slot].view = view; m_dirty |= DIRTY_COLOR_TARGETS; }
+	void SetColorInfo(uint32_t slot, const ColorInfo& info) { m_render_targets[slot].info = info; m_dirty |= DIRTY_COLOR_TARGETS; }
+	void SetColorAttrib(uint32_t slot, const ColorAttrib& attrib)
+	{
+		m_render_targets[slot].attrib = attrib;
+		m_dirty |= DIRTY_COLOR_TARGETS;
+	}
+	void SetColorAttrib2(uint32_t slot, const ColorAttrib2& attrib2)
+	{
+		m_render_targets[slot].attrib2 = attrib2;
+		m_dirty |= DIRTY_COLOR_TARGETS;
+	}
+	void SetColorAttrib3(uint32_t slot, const ColorAttrib3& attrib3)
+	{
+		m_render_targets[slot].attrib3 = attrib3;
+		m_dirty |= DIRTY_COLOR_TARGETS;
+	}
+	void SetColorDccControl(uint32_t slot, const ColorDccControl& dcc) { m_render_targets[slot].dcc = dcc; m_dirty |= DIRTY_COLOR_TARGETS; }
+	void SetColorCmask(uint32_t slot, const ColorCmask& cmask) { m_render_targets[slot].cmask = cmask; m_dirty |= DIRTY_COLOR_TARGETS; }
+	void SetColorCmaskSlice(uint32_t slot, const ColorCmaskSlice& cmask_slice)
+	{
+		m_render_targets[slot].cmask_slice = cmask_slice;
+		m_dirty |= DIRTY_COLOR_TARGETS;
+	}
+	void SetColorFmask(uint32_t slot, const ColorFmask& fmask) { m_render_targets[slot].fmask = fmask; m_dirty |= DIRTY_COLOR_TARGETS; }
+	void SetColorFmaskSlice(uint32_t slot, const ColorFmaskSlice& fmask_slice)
+	{
+		m_render_targets[slot].fmask_slice = fmask_slice;
+		m_dirty |= DIRTY_COLOR_TARGETS;
+	}
+	void SetColorClearWord0(uint32_t slot, const ColorClearWord0& clear_word0)
+	{
+		m_render_targets[slot].clear_word0 = clear_word0;
+		m_dirty |= DIRTY_COLOR_TARGETS;
+	}
+	void SetColorClearWord1(uint32_t slot, const ColorClearWord1& clear_word1)
+	{
+		m_render_targets[slot].clear_word1 = clear_word1;
+		m_dirty |= DIRTY_COLOR_TARGETS;
+	}
+	void SetColorDccAddr(uint32_t slot, const ColorDccAddr& dcc_addr)
+	{
+		m_render_targets[slot].dcc_addr = dcc_addr;
+		m_dirty |= DIRTY_COLOR_TARGETS;
+	}
+	void SetColorSize(uint32_t slot, const ColorSize& size) { m_render_targets[slot].size = size; m_dirty |= DIRTY_COLOR_TARGETS; }
 	[[nodiscard]] const RenderTarget& GetRenderTarget(uint32_t slot) const { return m_render_targets[slot]; }
 
-	void                              SetBlendControl(uint32_t slot, const BlendControl& control) { m_blend_control[slot] = control; }
+	void                              SetBlendControl(uint32_t slot, const BlendControl& control)
+	{
+		m_blend_control[slot] = control;
+		m_dirty |= DIRTY_BLEND;
+	}
 	[[nodiscard]] const BlendControl& GetBlendControl(uint32_t slot) const { return m_blend_control[slot]; }
 
-	void                   SetRenderTargetMask(uint32_t mask) { m_render_target_mask = mask; }
+	void                   SetRenderTargetMask(uint32_t mask) { m_render_target_mask = mask; m_dirty |= DIRTY_COLOR_TARGETS; }
 	[[nodiscard]] uint32_t GetRenderTargetMask() const { return m_render_target_mask; }
 
-	void                   SetShaderStages(uint32_t flags) { m_shader_stages = flags; }
+	void                   SetShaderStages(uint32_t flags) { m_shader_stages = flags; m_dirty |= DIRTY_RASTER; }
 	[[nodiscard]] uint32_t GetShaderStages() const { return m_shader_stages; }
 
-	void                                   SetDepthRenderTarget(const DepthRenderTarget& target) { m_depth_render_target = target; }
+	void                                   SetDepthRenderTarget(const DepthRenderTarget& target)
+	{
+		m_depth_render_target = target;
+		m_dirty |= DIRTY_DEPTH_TARGET;
+	}
 	[[nodiscard]] const DepthRenderTarget& GetDepthRenderTarget() const { return m_depth_render_target; }
-	void                                   SetDepthZInfo(const DepthZInfo& info) { m_depth_render_target.z_info = info; }
+	void                                   SetDepthZInfo(const DepthZInfo& info)
+	{
+		m_depth_render_target.z_info = info;
+		m_dirty |= DIRTY_DEPTH_TARGET;
+	}
 	[[nodiscard]] const DepthZInfo&        GetDepthZInfo() const { return m_depth_render_target.z_info; }
-	void                                   SetDepthStencilInfo(const DepthStencilInfo& info) { m_depth_render_target.stencil_info = info; }
+	void                                   SetDepthStencilInfo(const DepthStencilInfo& info)
+	{
+		m_depth_render_target.stencil_info = info;
+		m_dirty |= DIRTY_DEPTH_TARGET;
+	}
 	[[nodiscard]] const DepthStencilInfo&  GetDepthStencilInfo() const { return m_depth_render_target.stencil_info; }
-	void                                   SetDepthZReadBase(uint64_t addr) { m_depth_render_target.z_read_base_addr = addr; }
-	void                                   SetDepthStencilReadBase(uint64_t addr) { m_depth_render_target.stencil_read_base_addr = addr; }
-	void                                   SetDepthZWriteBase(uint64_t addr) { m_depth_render_target.z_write_base_addr = addr; }
-	void                                   SetDepthStencilWriteBase(uint64_t addr) { m_depth_render_target.stencil_write_base_addr = addr; }
-	void                                   SetDepthHTileDataBase(uint64_t addr) { m_depth_render_target.htile_data_base_addr = addr; }
-	void                                   SetDepthDepthView(const DepthDepthView& view) { m_depth_render_target.depth_view = view; }
+	void                                   SetDepthZReadBase(uint64_t addr)
+	{
+		m_depth_render_target.z_read_base_addr = addr;
+		m_dirty |= DIRTY_DEPTH_TARGET;
+	}
+	void                                   SetDepthStencilReadBase(uint64_t addr)
+	{
+		m_depth_render_target.stencil_read_base_addr = addr;
+		m_dirty |= DIRTY_DEPTH_TARGET;
+	}
+	void                                   SetDepthZWriteBase(uint64_t addr)
+	{
+		m_depth_render_target.z_write_base_addr = addr;
+		m_dirty |= DIRTY_DEPTH_TARGET;
+	}
+	void                                   SetDepthStencilWriteBase(uint64_t addr)
+	{
+		m_depth_render_target.stencil_write_base_addr = addr;
+		m_dirty |= DIRTY_DEPTH_TARGET;
+	}
+	void                                   SetDepthHTileDataBase(uint64_t addr)
+	{
+		m_depth_render_target.htile_data_base_addr = addr;
+		m_dirty |= DIRTY_DEPTH_TARGET;
+	}
+	void                                   SetDepthDepthView(const DepthDepthView& view)
+	{
+		m_depth_render_target.depth_view = view;
+		m_dirty |= DIRTY_DEPTH_TARGET;
+	}
 	[[nodiscard]] const DepthDepthView&    GetDepthDepthView() const { return m_depth_render_target.depth_view; }
-	void                                   SetDepthDepthSizeXY(const DepthDepthSizeXY& size) { m_depth_render_target.size = size; }
+	void                                   SetDepthDepthSizeXY(const DepthDepthSizeXY& size)
+	{
+		m_depth_render_target.size = size;
+		m_dirty |= DIRTY_DEPTH_TARGET;
+	}
 	[[nodiscard]] const DepthDepthSizeXY&  GetDepthDepthSizeXY() const { return m_depth_render_target.size; }
 
 	void SetViewportZ(uint32_t viewport_id, float zmin, float zmax)
 	{
 		m_screen_viewport.viewports[viewport_id].zmin = zmin;
 		m_screen_viewport.viewports[viewport_id].zmax = zmax;
+		m_dirty |= DIRTY_VIEWPORT;
+	}
+	void SetViewportZMin(uint32_t viewport_id, float zmin)
+	{
+		m_screen_viewport.viewports[viewport_id].zmin = zmin;
+		m_dirty |= DIRTY_VIEWPORT;
+	}
+	void SetViewportZMax(uint32_t viewport_id, float zmax)
+	{
+		m_screen_viewport.viewports[viewport_id].zmax = zmax;
+		m_dirty |= DIRTY_VIEWPORT;
 	}
-	void SetViewportZMin(uint32_t viewport_id, float zmin) { m_screen_viewport.viewports[viewport_id].zmin = zmin; }
-	void SetViewportZMax(uint32_t viewport_id, float zmax) { m_screen_viewport.viewports[viewport_id].zmax = zmax; }
 	void SetViewportScaleOffset(uint32_t viewport_id, float xscale, float xoffset, float yscale, float yoffset, float zscale, float zoffset)
 	{
 		m_screen_viewport.viewports[viewport_id].xscale  = xscale;
@@ -701,13 +799,38 @@ public:
 		m_screen_viewport.viewports[viewport_id].yoffset = yoffset;
 		m_screen_viewport.viewports[viewport_id].zscale  = zscale;
 		m_screen_viewport.viewports[viewport_id].zoffset = zoffset;
+		m_dirty |= DIRTY_VIEWPORT;
+	}
+	void SetViewportXScale(uint32_t viewport_id, float xscale)
+	{
+		m_screen_viewport.viewports[viewport_id].xscale = xscale;
+		m_dirty |= DIRTY_VIEWPORT;
+	}
+	void SetViewportXOffset(uint32_t viewport_id, float xoffset)
+	{
+		m_screen_viewport.viewports[viewport_id].xoffset = xoffset;
+		m_dirty |= DIRTY_VIEWPORT;
+	}
+	void SetViewportYScale(uint32_t viewport_id, float yscale)
+	{
+		m_screen_viewport.viewports[viewport_id].yscale = yscale;
+		m_dirty |= DIRTY_VIEWPORT;
+	}
+	void SetViewportYOffset(uint32_t viewport_id, float yoffset)
+	{
+		m_screen_viewport.viewports[viewport_id].yoffset = yoffset;
+		m_dirty |= DIRTY_VIEWPORT;
+	}
+	void SetViewportZScale(uint32_t viewport_id, float zscale)
+	{
+		m_screen_viewport.viewports[viewport_id].zscale = zscale;
+		m_dirty |= DIRTY_VIEWPORT;
+	}
+	void SetViewportZOffset(uint32_t viewport_id, float zoffset)
+	{
+		m_screen_viewport.viewports[viewport_id].zoffset = zoffset;
+		m_dirty |= DIRTY_VIEWPORT;
 	}
-	void SetViewportXScale(uint32_t viewport_id, float xscale) { m_screen_viewport.viewports[viewport_id].xscale = xscale; }
-	void SetViewportXOffset(uint32_t viewport_id, float xoffset) { m_screen_viewport.viewports[viewport_id].xoffset = xoffset; }
-	void SetViewportYScale(uint32_t viewport_id, float yscale) { m_screen_viewport.viewports[viewport_id].yscale = yscale; }
-	void SetViewportYOffset(uint32_t viewport_id, float yoffset) { m_screen_viewport.viewports[viewport_id].yoffset = yoffset; }
-	void SetViewportZScale(uint32_t viewport_id, float zscale) { m_screen_viewport.viewports[viewport_id].zscale = zscale; }
-	void SetViewportZOffset(uint32_t viewport_id, float zoffset) { m_screen_viewport.viewports[viewport_id].zoffset = zoffset; }
 	void SetViewportScissor(uint32_t viewport_id, int left, int top, int right, int bottom, bool window_offset_enable)
 	{
 		m_screen_viewport.viewports[viewport_id].viewport_scissor_left                 = left;
@@ -715,25 +838,29 @@ public:
 		m_screen_viewport.viewports[viewport_id].viewport_scissor_right                = right;
 		m_screen_viewport.viewports[viewport_id].viewport_scissor_bottom               = bottom;
 		m_screen_viewport.viewports[viewport_id].viewport_scissor_window_offset_enable = window_offset_enable;
+		m_dirty |= DIRTY_VIEWPORT;
 	}
 	void SetViewportScissorTL(uint32_t viewport_id, int left, int top, bool window_offset_enable)
 	{
 		m_screen_viewport.viewports[viewport_id].viewport_scissor_left                 = left;
 		m_screen_viewport.viewports[viewport_id].viewport_scissor_top                  = top;
 		m_screen_viewport.viewports[viewport_id].viewport_scissor_window_offset_enable = window_offset_enable;
+		m_dirty |= DIRTY_VIEWPORT;
 	}
 	void SetViewportScissorBR(uint32_t viewport_id, int right, int bottom)
 	{
 		m_screen_viewport.viewports[viewport_id].viewport_scissor_right  = right;
 		m_screen_viewport.viewports[viewport_id].viewport_scissor_bottom = bottom;
+		m_dirty |= DIRTY_VIEWPORT;
 	}
-	void SetViewportTransformControl(uint32_t control) { m_screen_viewport.transform_control = control; }
+	void SetViewportTransformControl(uint32_t control) { m_screen_viewport.transform_control = control; m_dirty |= DIRTY_VIEWPORT; }
 	void SetScreenScissor(int left, int top, int right, int bottom)
 	{
 		m_screen_viewport.screen_scissor_left   = left;
 		m_screen_viewport.screen_scissor_top    = top;
 		m_screen_viewport.screen_scissor_right  = right;
 		m_screen_viewport.screen_scissor_bottom = bottom;
+		m_dirty |= DIRTY_VIEWPORT;
 	}
 	void SetGenericScissor(int left, int top, int right, int bottom, bool window_offset_enable)
 	{
@@ -742,11 +869,13 @@ public:
 		m_screen_viewport.generic_scissor_right                = right;
 		m_screen_viewport.generic_scissor_bottom               = bottom;
 		m_screen_viewport.generic_scissor_window_offset_enable = window_offset_enable;
+		m_dirty |= DIRTY_VIEWPORT;
 	}
 	void SetHardwareScreenOffset(uint32_t offset_x, uint32_t offset_y)
 	{
 		m_screen_viewport.hw_offset_x = offset_x;
 		m_screen_viewport.hw_offset_y = offset_y;
+		m_dirty |= DIRTY_VIEWPORT;
 	}
 	void SetGuardBands(float horz_clip, float vert_clip, float horz_discard, float vert_discard)
 	{
@@ -754,72 +883,94 @@ public:
 		m_screen_viewport.guard_band_vert_clip    = vert_clip;
 		m_screen_viewport.guard_band_horz_discard = horz_discard;
 		m_screen_viewport.guard_band_vert_discard = vert_discard;
+		m_dirty |= DIRTY_VIEWPORT;
 	}
 	[[nodiscard]] const ScreenViewport& GetScreenViewport() const { return m_screen_viewport; }
 
 	[[nodiscard]] const BlendColor&      GetBlendColor() const { return m_blend_color; }
-	void                                 SetBlendColor(const BlendColor& color) { m_blend_color = color; }
+	void                                 SetBlendColor(const BlendColor& color) { m_blend_color = color; m_dirty |= DIRTY_BLEND; }
 	[[nodiscard]] const ClipControl&     GetClipControl() const { return m_clip_control; }
-	void                                 SetClipControl(const ClipControl& control) { m_clip_control = control; }
+	void                                 SetClipControl(const ClipControl& control) { m_clip_control = control; m_dirty |= DIRTY_RASTER; }
 	[[nodiscard]] const RenderControl&   GetRenderControl() const { return m_render_control; }
-	void                                 SetRenderControl(const RenderControl& control) { m_render_control = control; }
+	void                                 SetRenderControl(const RenderControl& control)
+	{
+		m_render_control = control;
+		m_dirty |= DIRTY_DEPTH_STENCIL;
+	}
 	[[nodiscard]] const DepthControl&    GetDepthControl() const { return m_depth_control; }
-	void                                 SetDepthControl(const DepthControl& control) { m_depth_control = control; }
+	void                                 SetDepthControl(const DepthControl& control)
+	{
+		m_depth_control = control;
+		m_dirty |= DIRTY_DEPTH_STENCIL;
+	}
 	[[nodiscard]] const ModeControl&     GetModeControl() const { return m_mode_control; }
-	void                                 SetModeControl(const ModeControl& control) { m_mode_control = control; }
+	void                                 SetModeControl(const ModeControl& control) { m_mode_control = control; m_dirty |= DIRTY_RASTER; }
 	[[nodiscard]] const EqaaControl&     GetEqaaControl() const { return m_eqaa_control; }
-	void                                 SetEqaaControl(const EqaaControl& control) { m_eqaa_control = control; }
+	void                                 SetEqaaControl(const EqaaControl& control) { m_eqaa_control = control; m_dirty |= DIRTY_RASTER; }
 	[[nodiscard]] const StencilControl&  GetStencilControl() const { return m_stencil_control; }
-	void                                 SetStencilControl(const StencilControl& control) { m_stencil_control = control; }
+	void                                 SetStencilControl(const StencilControl& control)
+	{
+		m_stencil_control = control;
+		m_dirty |= DIRTY_DEPTH_STENCIL;
+	}
 	[[nodiscard]] const StencilMask&     GetStencilMask() const { return m_stencil_mask; }
-	void                                 SetStencilMask(const StencilMask& mask) { m_stencil_mask = mask; }
+	void                                 SetStencilMask(const StencilMask& mask) { m_stencil_mask = mask; m_dirty |= DIRTY_DEPTH_STENCIL; }
 	[[nodiscard]] const ColorControl&    GetColorControl() const { return m_color_control; }
-	void                                 SetColorControl(const ColorControl& control) { m_color_control = control; }
+	void                                 SetColorControl(const ColorControl& control) { m_color_control = control; m_dirty |= DIRTY_BLEND; }
 	[[nodiscard]] const ScanModeControl& GetScanModeControl() const { return m_scan_mode_control; }
-	void                                 SetScanModeControl(const ScanModeControl& control) { m_scan_mode_control = control; }
+	void                                 SetScanModeControl(const ScanModeControl& control)
+	{
+		m_scan_mode_control = control;
+		m_dirty |= DIRTY_VIEWPORT;
+	}
 	[[nodiscard]] const AaSampleControl& GetAaSampleControl() const { return m_aa_sample_control; }
-	void                                 SetAaSampleControl(const AaSampleControl& control) { m_aa_sample_control = control; }
+	void                                 SetAaSampleControl(const AaSampleControl& control)
+	{
+		m_aa_sample_control = control;
+		m_dirty |= DIRTY_RASTER;
+	}
 	[[nodiscard]] const AaConfig&        GetAaConfig() const { return m_aa_config; }
-	void                                 SetAaConfig(const AaConfig& config) { m_aa_config = config; }
+	void                                 SetAaConfig(const AaConfig& config) { m_aa_config = config; m_dirty |= DIRTY_RASTER; }
 
 	[[nodiscard]] float   GetDepthClearValue() const { return m_depth_clear_value; }
-	void                  SetDepthClearValue(float clear_value) { m_depth_clear_value = clear_value; }
+	void                  SetDepthClearValue(float clear_value) { m_depth_clear_value = clear_value; m_dirty |= DIRTY_DEPTH_TARGET; }
 	[[nodiscard]] uint8_t GetStencilClearValue() const { return m_stencil_clear_value; }
-	void                  SetStencilClearValue(uint8_t clear_value) { m_stencil_clear_value = clear_value; }
+	void                  SetStencilClearValue(uint8_t clear_value) { m_stencil_clear_value = clear_value; m_dirty |= DIRTY_DEPTH_TARGET; }
 
 	[[nodiscard]] float GetLineWidth() const { return m_line_width; }
-	void                SetLineWidth(float width) { m_line_width = width; }
+	void                SetLineWidth(float width) { m_line_width = width; m_dirty |= DIRTY_RASTER; }
 
 	[[nodiscard]] const ShaderRegisters& GetShaderRegisters() const { return m_sh_regs; }
 
-	void SetVsOutConfig(uint32_t value) { m_sh_regs.m_spiVsOutConfig = value; }
-	void SetShaderPosFormat(uint32_t value) { m_sh_regs.m_spiShaderPosFormat = value; }
-	void SetClVsOutCntl(uint32_t value) { m_sh_regs.m_paClVsOutCntl = value; }
-	void SetShaderIdxFormat(uint32_t value) { m_sh_regs.m_spiShaderIdxFormat = value; }
-	void SetNggSubgrpCntl(uint32_t value) { m_sh_regs.m_geNggSubgrpCntl = value; }
-	void SetGsInstanceCnt(uint32_t value) { m_sh_regs.m_vgtGsInstanceCnt = value; }
-	void SetGsOnchipCntl(uint32_t value) { m_sh_regs.m_vgtGsOnchipCntl = value; }
-	void SetMaxOutputPerSubgroup(uint32_t value) { m_sh_regs.m_geMaxOutputPerSubgroup = value; }
-	void SetEsgsRingItemsize(uint32_t value) { m_sh_regs.m_vgtEsgsRingItemsize = value; }
-	void SetGsMaxVertOut(uint32_t value) { m_sh_regs.m_vgtGsMaxVertOut = value; }
-	void SetGsOutPrimType(uint32_t value) { m_sh_regs.m_vgtGsOutPrimType = value; }
+	void SetVsOutConfig(uint32_t value) { m_sh_regs.m_spiVsOutConfig = value; m_dirty |= DIRTY_SHADER_REGS; }
+	void SetShaderPosFormat(uint32_t value) { m_sh_regs.m_spiShaderPosFormat = value; m_dirty |= DIRTY_SHADER_REGS; }
+	void SetClVsOutCntl(uint32_t value) { m_sh_regs.m_paClVsOutCntl = value; m_dirty |= DIRTY_SHADER_REGS; }
+	void SetShaderIdxFormat(uint32_t value) { m_sh_regs.m_spiShaderIdxFormat = value; m_dirty |= DIRTY_SHADER_REGS; }
+	void SetNggSubgrpCntl(uint32_t value) { m_sh_regs.m_geNggSubgrpCntl = value; m_dirty |= DIRTY_SHADER_REGS; }
+	void SetGsInstanceCnt(uint32_t value) { m_sh_regs.m_vgtGsInstanceCnt = value; m_dirty |= DIRTY_SHADER_REGS; }
+	void SetGsOnchipCntl(uint32_t value) { m_sh_regs.m_vgtGsOnchipCntl = value; m_dirty |= DIRTY_SHADER_REGS; }
+	void SetMaxOutputPerSubgroup(uint32_t value) { m_sh_regs.m_geMaxOutputPerSubgroup = value; m_dirty |= DIRTY_SHADER_REGS; }
+	void SetEsgsRingItemsize(uint32_t value) { m_sh_regs.m_vgtEsgsRingItemsize = value; m_dirty |= DIRTY_SHADER_REGS; }
+	void SetGsMaxVertOut(uint32_t value) { m_sh_regs.m_vgtGsMaxVertOut = value; m_dirty |= DIRTY_SHADER_REGS; }
+	void SetGsOutPrimType(uint32_t value) { m_sh_regs.m_vgtGsOutPrimType = value; m_dirty |= DIRTY_SHADER_REGS; }
 
 	void SetPsInputSettings(uint32_t id, uint32_t value)
 	{
 		m_sh_regs.ps_interpolator_settings[id] = value;
 		// m_sh_regs.ps_input_num                 = ((id + 1) > m_sh_regs.ps_input_num ? (id + 1) : m_sh_regs.ps_input_num);
+		m_dirty |= DIRTY_SHADER_REGS;
 	}
 
-	void SetShaderZFormat(uint32_t value) { m_sh_regs.shader_z_format = value; }
-	void SetTargetOutputMode(uint32_t slot, uint8_t value) { m_sh_regs.target_output_mode[slot] = value; }
-	void SetPsInputEna(uint32_t value) { m_sh_regs.ps_input_ena = value; }
-	void SetPsInputAddr(uint32_t value) { m_sh_regs.ps_input_addr = value; }
-	void SetPsInControl(uint32_t value) { m_sh_regs.ps_in_control = value; }
-	void SetBarycCntl(uint32_t value) { m_sh_regs.baryc_cntl = value; }
-	void SetShaderMask(uint32_t value) { m_sh_regs.m_cbShaderMask = value; }
-	void SetDepthShaderControl(const DepthShaderControl& value) { m_sh_regs.db_shader_control = value; }
+	void SetShaderZFormat(uint32_t value) { m_sh_regs.shader_z_format = value; m_dirty |= DIRTY_SHADER_REGS; }
+	void SetTargetOutputMode(uint32_t slot, uint8_t value) { m_sh_regs.target_output_mode[slot] = value; m_dirty |= DIRTY_SHADER_REGS; }
+	void SetPsInputEna(uint32_t value) { m_sh_regs.ps_input_ena = value; m_dirty |= DIRTY_SHADER_REGS; }
+	void SetPsInputAddr(uint32_t value) { m_sh_regs.ps_input_addr = value; m_dirty |= DIRTY_SHADER_REGS; }
+	void SetPsInControl(uint32_t value) { m_sh_regs.ps_in_control = value; m_dirty |= DIRTY_SHADER_REGS; }
+	void SetBarycCntl(uint32_t value) { m_sh_regs.baryc_cntl = value; m_dirty |= DIRTY_SHADER_REGS; }
+	void SetShaderMask(uint32_t value) { m_sh_regs.m_cbShaderMask = value; m_dirty |= DIRTY_SHADER_REGS; }
+	void SetDepthShaderControl(const DepthShaderControl& value) { m_sh_regs.db_shader_control = value; m_dirty |= DIRTY_SHADER_REGS; }
 
-	void SetScShaderControl(uint32_t value) { m_sh_regs.m_paScShaderControl = value; }
+	void SetScShaderControl(uint32_t value) { m_sh_regs.m_paScShaderControl = value; m_dirty |= DIRTY_SHADER_REGS; }
 
 private:
 	float m_line_width = 1.0f;
@@ -850,6 +1001,8 @@ private:
 	EqaaControl m_eqaa_control;
 
 	ShaderRegisters m_sh_regs;
+
+	uint32_t m_dirty = DIRTY_ALL;
 };
 
 class UserConfig
@@ -860,21 +1013,28 @@ public:
 
 	KYTY_CLASS_DEFAULT_COPY(UserConfig);
 
+	static constexpr uint32_t DIRTY_ALL = 1u;
+
 	void Reset() { *this = UserConfig(); }
 
-	void                   SetPrimitiveType(uint32_t prim_type) { m_prim_type = prim_type; }
+	[[nodiscard]] uint32_t GetDirty() const { return m_dirty; }
+	void                   ClearDirty() { m_dirty = 0; }
+
+	void                   SetPrimitiveType(uint32_t prim_type) { m_prim_type = prim_type; m_dirty |= DIRTY_ALL; }
 	[[nodiscard]] uint32_t GetPrimType() const { return m_prim_type; }
 
 	[[nodiscard]] const GeControl&    GetGeControl() const { return m_ge_cntl; }
-	void                              SetGeControl(const GeControl& control) { m_ge_cntl = control; }
+	void                              SetGeControl(const GeControl& control) { m_ge_cntl = control; m_dirty |= DIRTY_ALL; }
 	[[nodiscard]] const GeUserVgprEn& GetGeUserVgprEn() const { return m_ge_user_vgpr_en; }
-	void                              SetGeUserVgprEn(const GeUserVgprEn& en) { m_ge_user_vgpr_en = en; }
+	void                              SetGeUserVgprEn(const GeUserVgprEn& en) { m_ge_user_vgpr_en = en; m_dirty |= DIRTY_ALL; }
 
 private:
 	uint32_t m_prim_type = 0;
 
 	GeControl    m_ge_cntl;
 	GeUserVgprEn m_ge_user_vgpr_en;
+
+	uint32_t m_dirty = DIRTY_ALL;
 };
 
 class Shader
@@ -885,23 +1045,42 @@ public:
 
 	KYTY_CLASS_DEFAULT_COPY(Shader);
 
+	// Programs and user data written since the last draw or dispatch consumed them. User data is also marked dirty when the memory it
+	// may point to is written by the command processor.
+	static constexpr uint32_t DIRTY_VS           = 1u << 0u;
+	static constexpr uint32_t DIRTY_VS_USER_DATA = 1u << 1u;
+	static constexpr uint32_t DIRTY_PS           = 1u << 2u;
+	static constexpr uint32_t DIRTY_PS_USER_DATA = 1u << 3u;
+	static constexpr uint32_t DIRTY_CS           = 1u << 4u;
+	static constexpr uint32_t DIRTY_CS_USER_DATA = 1u << 5u;
+	static constexpr uint32_t DIRTY_GRAPHICS     = DIRTY_VS | DIRTY_VS_USER_DATA | DIRTY_PS | DIRTY_PS_USER_DATA;
+	static constexpr uint32_t DIRTY_USER_DATA    = DIRTY_VS_USER_DATA | DIRTY_PS_USER_DATA | DIRTY_CS_USER_DATA;
+	static constexpr uint32_t DIRTY_ALL          = 0x3fu;
+
 	void Reset() { *this = Shader(); }
 
-	void SetVsShaderModifier(uint32_t shader_modifier) { m_vs.vs_shader_modifier = shader_modifier; }
+	[[nodiscard]] uint32_t GetDirty() const { return m_dirty; }
+	void                   MarkDirty(uint32_t flags) { m_dirty |= flags; }
+	void                   ClearDirty(uint32_t flags) { m_dirty &= ~flags; }
+
+	void SetVsShaderModifier(uint32_t shader_modifier) { m_vs.vs_shader_modifier = shader_modifier; m_dirty |= DIRTY_VS; }
 	void SetVsShaderBase(uint64_t addr)
 	{
 		m_vs.vs_regs.data_addr = addr;
 		m_vs.vs_embedded       = false;
+		m_dirty |= DIRTY_VS;
 	}
 	void SetVsShaderResource1(const VsShaderResource1& rsrc1)
 	{
 		m_vs.vs_regs.rsrc1 = rsrc1;
 		m_vs.vs_embedded   = false;
+		m_dirty |= DIRTY_VS;
 	}
 	void SetVsShaderResource2(const VsShaderResource2& rsrc2)
 	{
 		m_vs.vs_regs.rsrc2 = rsrc2;
 		m_vs.vs_embedded   = false;
+		m_dirty |= DIRTY_VS;
 	}
 
 	void SetVsEmbedded(uint32_t id, uint32_t shader_modifier)
@@ -909,58 +1088,69 @@ public:
 		m_vs.vs_embedded_id     = id;
 		m_vs.vs_shader_modifier = shader_modifier;
 		m_vs.vs_embedded        = true;
+		m_dirty |= DIRTY_VS;
 	}
 	void SetEsShaderBase(uint64_t addr)
 	{
 		m_vs.es_regs.data_addr = addr;
 		m_vs.vs_embedded       = false;
+		m_dirty |= DIRTY_VS;
 	}
 	void SetGsShaderResource1(const GsShaderResource1& rsrc1)
 	{
 		m_vs.gs_regs.rsrc1 = rsrc1;
 		m_vs.vs_embedded   = false;
+		m_dirty |= DIRTY_VS;
 	}
 	void SetGsShaderResource2(const GsShaderResource2& rsrc2)
 	{
 		m_vs.gs_regs.rsrc2 = rsrc2;
 		m_vs.vs_embedded   = false;
+		m_dirty |= DIRTY_VS;
 	}
 	void SetGsShaderChksum(uint32_t value)
 	{
 		m_vs.gs_regs.chksum <<= 32u;
 		m_vs.gs_regs.chksum |= value;
+		m_dirty |= DIRTY_VS;
 	}
 
 	void SetPsShaderBase(uint64_t addr)
 	{
 		m_ps.ps_regs.data_addr = addr;
 		m_ps.ps_embedded       = false;
+		m_dirty |= DIRTY_PS;
 	}
 	void SetPsShaderResource1(const PsShaderResource1& rsrc1)
 	{
 		m_ps.ps_regs.rsrc1 = rsrc1;
 		m_ps.ps_embedded   = false;
+		m_dirty |= DIRTY_PS;
 	}
 	void SetPsShaderResource2(const PsShaderResource2& rsrc2)
 	{
 		m_ps.ps_regs.rsrc2 = rsrc2;
 		m_ps.ps_embedded   = false;
+		m_dirty |= DIRTY_PS;
 	}
 	void SetPsEmbedded(uint32_t id)
 	{
 		m_ps.ps_embedded_id = id;
 		m_ps.ps_embedded    = true;
+		m_dirty |= DIRTY_PS;
 	}
 	void SetPsShaderChksum(uint32_t value)
 	{
 		m_ps.ps_regs.chksum <<= 32u;
 		m_ps.ps_regs.chksum |= value;
+		m_dirty |= DIRTY_PS;
 	}
 
 	void SetCsShader(const CsStageRegisters& cs_regs, uint32_t shader_modifier)
 	{
 		m_cs.cs_regs            = cs_regs;
 		m_cs.cs_shader_modifier = shader_modifier;
+		m_dirty |= DIRTY_CS;
 	}
 
 	void SetVsUserSgpr(uint32_t id, uint32_t value, UserSgprType type)
@@ -968,24 +1158,28 @@ public:
 		m_vs.vs_user_sgpr.value[id] = value;
 		m_vs.vs_user_sgpr.type[id]  = type;
 		m_vs.vs_user_sgpr.count     = ((id + 1) > m_vs.vs_user_sgpr.count ? (id + 1) : m_vs.vs_user_sgpr.count);
+		m_dirty |= DIRTY_VS_USER_DATA;
 	}
 	void SetPsUserSgpr(uint32_t id, uint32_t value, UserSgprType type)
 	{
 		m_ps.ps_user_sgpr.value[id] = value;
 		m_ps.ps_user_sgpr.type[id]  = type;
 		m_ps.ps_user_sgpr.count     = ((id + 1) > m_ps.ps_user_sgpr.count ? (id + 1) : m_ps.ps_user_sgpr.count);
+		m_dirty |= DIRTY_PS_USER_DATA;
 	}
 	void SetCsUserSgpr(uint32_t id, uint32_t value, UserSgprType type)
 	{
 		m_cs.cs_user_sgpr.value[id] = value;
 		m_cs.cs_user_sgpr.type[id]  = type;
 		m_cs.cs_user_sgpr.count     = ((id + 1) > m_cs.cs_user_sgpr.count ? (id + 1) : m_cs.cs_user_sgpr.count);
+		m_dirty |= DIRTY_CS_USER_DATA;
 	}
 	void SetGsUserSgpr(uint32_t id, uint32_t value, UserSgprType type)
 	{
 		m_vs.gs_user_sgpr.value[id] = value;
 		m_vs.gs_user_sgpr.type[id]  = type;
 		m_vs.gs_user_sgpr.count     = ((id + 1) > m_vs.gs_user_sgpr.count ? (id + 1) : m_vs.gs_user_sgpr.count);
+		m_dirty |= DIRTY_VS_USER_DATA;
 	}
 
 	[[nodiscard]] const PixelShaderInfo&   GetPs() const { return m_ps; }
@@ -996,6 +1190,8 @@ private:
 	VertexShaderInfo  m_vs;
 	PixelShaderInfo   m_ps;
 	ComputeShaderInfo m_cs;
+
+	uint32_t m_dirty = DIRTY_ALL;
 };
 
 } // namespace Kyty::Libs::Graphics::HW
@@ -3,6 +3,7 @@
 
 #include "Kyty/Core/Common.h"
 #include "Kyty/Core/Vector.h"
+#include "Kyty/Core/VirtualMemory.h"
 
 #include "Emulator/Common.h"
 
@@ -89,10 +90,19 @@ public:
 	GpuMemoryObjectType type               = GpuMemoryObjectType::Invalid;
 };
 
+struct GpuMemoryRange
+{
+	uint64_t vaddr = 0;
+	uint64_t size  = 0;
+};
+
 void GpuMemoryInit();
 
+Vector<GpuMemoryRange> GpuMemoryGetAllocatedRanges();
+
 void  GpuMemorySetAllocatedRange(uint64_t vaddr, uint64_t size);
 void  GpuMemoryFree(GraphicContext* ctx, uint64_t vaddr, uint64_t size, bool unmap);
+void  GpuMemoryProtect(uint64_t vaddr, uint64_t size, Core::VirtualMemory::Mode mode, Core::VirtualMemory::Mode* old_mode);
 void* GpuMemoryCreateObject(uint64_t submit_id, GraphicContext* ctx, CommandBuffer* buffer, uint64_t vaddr, uint64_t size,
                             const GpuObject& info);
 void* GpuMemoryCreateObject(uint64_t submit_id, GraphicContext* ctx, CommandBuffer* buffer, const uint64_t* vaddr, const uint64_t* size,
@@ -101,15 +111,23 @@ void  GpuMemoryResetHash(const uint64_t* vaddr, const uint64_t* size, int vaddr_
 void  GpuMemoryDbgDump();
 void  GpuMemoryFlush(GraphicContext* ctx, uint64_t vaddr, uint64_t size);
 void  GpuMemoryFlushAll(GraphicContext* ctx);
-void  GpuMemoryFrameDone();
+void  GpuMemoryFrameDone(GraphicContext* ctx);
 void  GpuMemoryWriteBack(GraphicContext* ctx, CommandProcessor* cp);
+void  GpuMemoryDeferWriteBack(CommandProcessor* cp);
+void  GpuMemoryWriteBackPending(GraphicContext* ctx, CommandProcessor* cp);
 bool  GpuMemoryCheckAccessViolation(uint64_t vaddr, uint64_t size);
+bool  GpuMemoryWriteFault(uint64_t vaddr); // fast path of the exception handler, true if the write can be retried
 bool  GpuMemoryWatcherEnabled();
 
 Vector<GpuMemoryObject> GpuMemoryFindObjects(uint64_t vaddr, uint64_t size, GpuMemoryObjectType type, bool exact, bool only_first);
 
 bool VulkanAllocate(GraphicContext* ctx, VulkanMemory* mem);
+bool VulkanAllocateHost(GraphicContext* ctx, VulkanMemory* mem, void* host_ptr);
+bool VulkanCanImportHost(GraphicContext* ctx, uint64_t vaddr);
 void VulkanFree(GraphicContext* ctx, VulkanMemory* mem);
+bool VulkanGetMemoryBudget(GraphicContext* ctx, uint64_t* usage, uint64_t* budget);
+void VulkanMemoryTrim(GraphicContext* ctx);
+void VulkanMemoryDbgPrint();
 void VulkanMapMemory(GraphicContext* ctx, VulkanMemory* mem, void** data);
 void VulkanUnmapMemory(GraphicContext* ctx, VulkanMemory* mem);
 void VulkanBindImageMemory(GraphicContext* ctx, VulkanImage* image, VulkanMemory* mem);
@@ -11,17 +11,37 @@
 namespace Kyty::Libs::Graphics {
 
 struct GraphicContext;
+struct VulkanBuffer;
+
+// Guest index streams which can't be fed to Vulkan as is are converted once, when the buffer is uploaded
+enum class IndexBufferConversion : uint64_t
+{
+	None,
+	QuadList, // every 4 indices become 2 triangles of a triangle list
+};
 
 void IndexBufferInit();
 void IndexBufferDeleteAll(GraphicContext* ctx);
 
+// 8-bit guest indices are widened to 16-bit
+uint32_t IndexBufferGetHostIndexSize(uint32_t guest_index_size);
+uint32_t IndexBufferGetHostIndexCount(uint32_t guest_index_count, IndexBufferConversion conversion);
+
+// Shared 32-bit triangle list indices for non-indexed quad list draws
+VulkanBuffer* IndexBufferGetQuadList(GraphicContext* ctx, uint32_t vertex_count);
+
 class IndexBufferGpuObject: public GpuObject
 {
 public:
-	IndexBufferGpuObject()
+	static constexpr int PARAM_INDEX_SIZE = 0;
+	static constexpr int PARAM_CONVERSION = 1;
+
+	IndexBufferGpuObject(uint32_t guest_index_size, IndexBufferConversion conversion)
 	{
-		check_hash = true;
-		type       = Graphics::GpuMemoryObjectType::IndexBuffer;
+		params[PARAM_INDEX_SIZE] = guest_index_size;
+		params[PARAM_CONVERSION] = static_cast<uint64_t>(conversion);
+		check_hash               = true;
+		type                     = Graphics::GpuMemoryObjectType::IndexBuffer;
 	}
 
 	bool Equal(const uint64_t* other) const override;
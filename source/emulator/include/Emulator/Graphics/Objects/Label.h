@@ -63,7 +63,7 @@ Label* LabelCreate64(GraphicContext* ctx, uint64_t* dst_gpu_addr, uint64_t value
 Label* LabelCreate32(GraphicContext* ctx, uint32_t* dst_gpu_addr, uint32_t value, LabelGpuObject::callback_t callback_1,
                      LabelGpuObject::callback_t callback_2, const uint64_t* args);
 void   LabelDelete(Label* label);
-void   LabelSet(CommandBuffer* buffer, Label* label);
+void   LabelSet(uint64_t submit_id, CommandBuffer* buffer, Label* label);
 
 } // namespace Kyty::Libs::Graphics
 
@@ -16,13 +16,19 @@ class CommandBuffer;
 class StorageBufferGpuObject: public GpuObject
 {
 public:
-	StorageBufferGpuObject(uint64_t stride, uint64_t num_records, bool ronly)
+	static constexpr int PARAM_STRIDE      = 0;
+	static constexpr int PARAM_NUM_RECORDS = 1;
+	static constexpr int PARAM_HOST        = 2;
+
+	// host: the guest memory is imported, so the GPU accesses it in place and there is nothing to hash
+	StorageBufferGpuObject(uint64_t stride, uint64_t num_records, bool ronly, bool host)
 	{
-		params[0]  = stride;
-		params[1]  = num_records;
-		check_hash = true;
-		read_only  = ronly;
-		type       = Graphics::GpuMemoryObjectType::StorageBuffer;
+		params[PARAM_STRIDE]      = stride;
+		params[PARAM_NUM_RECORDS] = num_records;
+		params[PARAM_HOST]        = (host ? 1 : 0);
+		check_hash                = !host;
+		read_only                 = ronly;
+		type                      = Graphics::GpuMemoryObjectType::StorageBuffer;
 	}
 
 	bool Equal(const uint64_t* other) const override;
@@ -13,10 +13,14 @@ namespace Kyty::Libs::Graphics {
 class VertexBufferGpuObject: public GpuObject
 {
 public:
-	VertexBufferGpuObject()
+	static constexpr int PARAM_HOST = 0;
+
+	// host: the guest memory is imported, so the GPU reads it in place and there is nothing to hash
+	explicit VertexBufferGpuObject(bool host)
 	{
-		check_hash = true;
-		type       = Graphics::GpuMemoryObjectType::VertexBuffer;
+		params[PARAM_HOST] = (host ? 1 : 0);
+		check_hash         = !host;
+		type               = Graphics::GpuMemoryObjectType::VertexBuffer;
 	}
 
 	bool Equal(const uint64_t* other) const override;
@@ -0,0 +1,34 @@
+#ifndef EMULATOR_INCLUDE_EMULATOR_GRAPHICS_PIXELCONVERT_H_
+#define EMULATOR_INCLUDE_EMULATOR_GRAPHICS_PIXELCONVERT_H_
+
+#include "Kyty/Core/Common.h"
+
+#include "Emulator/Common.h"
+
+#ifdef KYTY_EMU_ENABLED
+
+namespace Kyty::Libs::Graphics {
+
+// Guest texels which the host image format can't take as is are converted once, when the image is uploaded
+enum class PixelConversion
+{
+	None,
+	SrgbToLinear, // 8-bit RGBA/BGRA, the sRGB format was replaced by the UNORM one
+};
+
+void PixelConvertInit();
+
+// Formats are VkFormat values, requested by the guest and used by the image
+PixelConversion PixelGetConversion(uint64_t requested_format, uint64_t image_format);
+
+// Converts size bytes of densely packed texels, dst may be equal to src
+void PixelConvert(PixelConversion conversion, void* dst, const void* src, uint64_t size);
+
+// Same on the calling thread, for small runs of texels converted while they are still in the cache (see TileConvertTiledToLinear())
+void PixelConvertRun(PixelConversion conversion, void* dst, const void* src, uint64_t size);
+
+} // namespace Kyty::Libs::Graphics
+
+#endif // KYTY_EMU_ENABLED
+
+#endif /* EMULATOR_INCLUDE_EMULATOR_GRAPHICS_PIXELCONVERT_H_ */
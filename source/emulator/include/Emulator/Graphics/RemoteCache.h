@@ -0,0 +1,43 @@
+#ifndef EMULATOR_INCLUDE_EMULATOR_GRAPHICS_REMOTECACHE_H_
+#define EMULATOR_INCLUDE_EMULATOR_GRAPHICS_REMOTECACHE_H_
+
+#include "Kyty/Core/ByteBuffer.h"
+#include "Kyty/Core/Common.h"
+
+#include "Emulator/Common.h"
+
+#include <functional>
+
+#ifdef KYTY_EMU_ENABLED
+
+namespace Kyty::Libs::Graphics {
+
+// Shared tier behind the local shader and pipeline caches: a plain HTTP server at Config::GetRemoteCacheUrl() which answers
+// GET <url>/<kind>/<key> with the stored value (or 404) and stores the body of PUT <url>/<kind>/<key>. The keys are content hashes
+// which already cover everything that makes a value incompatible, so the server doesn't interpret them. The stored value starts with
+// the key and a hash of the value seeded with it, a value which doesn't match is a miss. Uploads and fetches run on a separate
+// thread.
+
+using RemoteCacheFetchFunc = std::function<void(const Core::ByteBuffer& value)>;
+
+void RemoteCacheInit();
+bool RemoteCacheEnabled();
+
+// Blocks for at most a few Config::GetRemoteCacheTimeout(), for the loads which can wait. After several failed or slow requests the
+// server isn't asked again in this session, so an unreachable server doesn't slow down every miss.
+bool RemoteCacheGet(const char* kind, uint64_t key, uint32_t size_max, Core::ByteBuffer* value);
+
+// Doesn't wait. func is called on the cache thread if the server has a valid value. Fetches are dropped when too many are waiting.
+void RemoteCacheFetch(const char* kind, uint64_t key, uint32_t size_max, RemoteCacheFetchFunc func);
+
+// Copies the value. Uploads are dropped when too many are waiting.
+void RemoteCachePut(const char* kind, uint64_t key, const Core::ByteBuffer& value);
+
+// Waits until the queued uploads and fetches are done
+void RemoteCacheFlush();
+
+} // namespace Kyty::Libs::Graphics
+
+#endif // KYTY_EMU_ENABLED
+
+#endif /* EMULATOR_INCLUDE_EMULATOR_GRAPHICS_REMOTECACHE_H_ */
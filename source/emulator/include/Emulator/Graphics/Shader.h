@@ -10,6 +10,7 @@
 #include "Emulator/Graphics/Shader.h"
 
 #include <algorithm>
+#include <functional>
 #ifdef KYTY_EMU_ENABLED
 
 namespace Kyty::Libs::Graphics {
@@ -534,8 +535,16 @@ struct ShaderId
 	uint32_t         hash0 = 0;
 	uint32_t         crc32 = 0;
 	Vector<uint32_t> ids;
+	// Only the pipeline depends on these (vertex input state, specialization constants), so one translated module and one shader
+	// cache entry serve all the variants
+	Vector<uint32_t> variant_ids;
 
-	bool operator==(const ShaderId& other) const { return hash0 == other.hash0 && crc32 == other.crc32 && ids == other.ids; }
+	[[nodiscard]] bool IsSameModule(const ShaderId& other) const
+	{
+		return hash0 == other.hash0 && crc32 == other.crc32 && ids == other.ids;
+	}
+
+	bool operator==(const ShaderId& other) const { return IsSameModule(other) && variant_ids == other.variant_ids; }
 	bool operator!=(const ShaderId& other) const { return !(*this == other); }
 };
 
@@ -853,6 +862,8 @@ struct ShaderBindResources
 	uint32_t                   push_constant_offset = 0;
 	uint32_t                   push_constant_size   = 0;
 	uint32_t                   descriptor_set_slot  = 0;
+	uint32_t                   uniform_buffer_slot  = 0;
+	bool                       uniform_buffer       = false; // Doesn't fit into the push constants, read from a uniform buffer
 	ShaderStorageResources     storage_buffers;
 	ShaderTextureResources     textures2D;
 	ShaderSamplerResources     samplers;
@@ -1004,6 +1015,8 @@ struct ShaderMappedData
 
 void ShaderInit();
 void ShaderMapUserData(uint64_t addr, const ShaderMappedData& data);
+// Push constant space of the device, the data of a stage past it goes to a uniform buffer
+void ShaderSetPushConstantsMax(uint32_t size);
 
 void             ShaderCalcBindingIndices(ShaderBindResources* bind);
 void             ShaderGetInputInfoVS(const HW::VertexShaderInfo* regs, const HW::ShaderRegisters* sh, ShaderVertexInputInfo* info);
@@ -1022,11 +1035,20 @@ ShaderCode       ShaderParseCS(const HW::ComputeShaderInfo* regs, const HW::Shad
 Vector<uint32_t> ShaderRecompileVS(const ShaderCode& code, const ShaderVertexInputInfo* input_info);
 Vector<uint32_t> ShaderRecompilePS(const ShaderCode& code, const ShaderPixelInputInfo* input_info);
 Vector<uint32_t> ShaderRecompileCS(const ShaderCode& code, const ShaderComputeInputInfo* input_info);
+Vector<uint32_t> ShaderRecompileEmbeddedCS(uint32_t id);
+bool             ShaderCacheLoad(ShaderType type, const ShaderId& id, Vector<uint32_t>* spirv);
+void             ShaderCachePrefetch(ShaderType type, const ShaderId& id);
+void             ShaderCacheStore(ShaderType type, const ShaderId& id, const Vector<uint32_t>& spirv);
 bool             ShaderIsDisabled(uint64_t addr);
 bool             ShaderIsDisabled2(uint64_t addr, uint64_t chksum);
 void             ShaderDisable(uint64_t id);
 void             ShaderInjectDebugPrintf(uint64_t id, const ShaderDebugPrintf& cmd);
 
+// Runs the tasks on the bounded translation pool and returns when all of them are finished. The caller takes part in the work.
+void ShaderRunTranslations(std::function<void()>* tasks, uint32_t num);
+// Queues the decoding of the guest code at addr, so ShaderParseVS/PS/CS of the next draw can skip it
+void ShaderPrefetch(ShaderType type, uint64_t addr);
+
 } // namespace Kyty::Libs::Graphics
 
 #endif // KYTY_EMU_ENABLED
@@ -0,0 +1,23 @@
+#ifndef EMULATOR_INCLUDE_EMULATOR_GRAPHICS_SHADEROPTIMIZE_H_
+#define EMULATOR_INCLUDE_EMULATOR_GRAPHICS_SHADEROPTIMIZE_H_
+
+#include "Kyty/Core/Common.h"
+
+#include "Emulator/Common.h"
+
+#ifdef KYTY_EMU_ENABLED
+
+namespace Kyty::Libs::Graphics {
+
+class ShaderCode;
+
+// Shrinks the decoded code before it is recompiled: propagates s_mov constants into vector ALU sources, drops scalar loads which
+// are repeated inside a block and removes moves whose result is never read. The control flow and the instruction patterns the
+// recompiler looks for are left untouched.
+void ShaderOptimize(ShaderCode* code);
+
+} // namespace Kyty::Libs::Graphics
+
+#endif // KYTY_EMU_ENABLED
+
+#endif /* EMULATOR_INCLUDE_EMULATOR_GRAPHICS_SHADEROPTIMIZE_H_ */
@@ -13,6 +13,7 @@ namespace Kyty::Libs::Graphics {
 class ShaderCode;
 
 void ShaderParse(const uint32_t* src, ShaderCode* dst);
+void ShaderParse(const uint32_t* src, ShaderCode* dst, bool next_gen);
 
 } // namespace Kyty::Libs::Graphics
 
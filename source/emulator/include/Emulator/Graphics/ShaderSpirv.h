@@ -3,6 +3,7 @@
 
 #include "Kyty/Core/Common.h"
 #include "Kyty/Core/String8.h"
+#include "Kyty/Core/Vector.h"
 
 #include "Emulator/Common.h"
 
@@ -11,14 +12,22 @@
 namespace Kyty::Libs::Graphics {
 
 class ShaderCode;
+struct ShaderInstruction;
 struct ShaderVertexInputInfo;
 struct ShaderPixelInputInfo;
 struct ShaderComputeInputInfo;
 
 String8 SpirvGenerateSource(const ShaderCode& code, const ShaderVertexInputInfo* vs_input_info, const ShaderPixelInputInfo* ps_input_info,
                             const ShaderComputeInputInfo* cs_input_info);
-String8 SpirvGetEmbeddedVs(uint32_t id);
-String8 SpirvGetEmbeddedPs(uint32_t id);
+
+// Built-in shaders, compiled from shaders/*.spvasm at build time
+Vector<uint32_t> SpirvGetEmbeddedVs(uint32_t id);
+Vector<uint32_t> SpirvGetEmbeddedPs(uint32_t id);
+Vector<uint32_t> SpirvGetEmbeddedCs(uint32_t id);
+
+// True if the recompiler function loads every source of the instruction through the common operand loaders, so an SGPR source can be
+// replaced with a constant
+bool SpirvAcceptsConstantSources(const ShaderInstruction& inst);
 
 } // namespace Kyty::Libs::Graphics
 
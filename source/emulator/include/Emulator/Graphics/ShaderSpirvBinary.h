@@ -0,0 +1,23 @@
+#ifndef EMULATOR_INCLUDE_EMULATOR_GRAPHICS_SHADERSPIRVBINARY_H_
+#define EMULATOR_INCLUDE_EMULATOR_GRAPHICS_SHADERSPIRVBINARY_H_
+
+#include "Kyty/Core/Common.h"
+#include "Kyty/Core/String8.h"
+#include "Kyty/Core/Vector.h"
+
+#include "Emulator/Common.h"
+
+#ifdef KYTY_EMU_ENABLED
+
+namespace Kyty::Libs::Graphics {
+
+// Single pass encoder of the SPIR-V assembly produced by the recompiler. Words are written directly into the module, without the
+// generic grammar driven assembler. Only the subset of instructions and enumerants used by the recompiler is known, returns false for
+// everything else so the caller can fall back to spirv-tools.
+bool SpirvEncodeBinary(const String8& src, Vector<uint32_t>* dst);
+
+} // namespace Kyty::Libs::Graphics
+
+#endif // KYTY_EMU_ENABLED
+
+#endif /* EMULATOR_INCLUDE_EMULATOR_GRAPHICS_SHADERSPIRVBINARY_H_ */
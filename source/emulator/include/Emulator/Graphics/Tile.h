@@ -4,6 +4,7 @@
 #include "Kyty/Core/Common.h"
 
 #include "Emulator/Common.h"
+#include "Emulator/Graphics/PixelConvert.h"
 
 #ifdef KYTY_EMU_ENABLED
 
@@ -37,10 +38,27 @@ struct TilePaddedSize
 	uint32_t height = 0;
 };
 
+// Push constants of the video out detiling compute shader
+struct TileVideoOutDetileParams
+{
+	uint32_t width               = 0;
+	uint32_t height              = 0;
+	uint32_t macro_tiles_per_row = 0;
+	uint32_t macro_tile_height   = 0;
+	uint32_t macro_tile_bytes    = 0;
+	uint32_t bank_height_mask    = 0;
+	uint32_t bank_height_shift   = 0;
+	uint32_t pipe_bits           = 0;
+	uint32_t bank_bits           = 0;
+};
+
 void TileInit();
+bool TileIsInitialized();
 void TileConvertTiledToLinear(void* dst, const void* src, TileMode mode, uint32_t width, uint32_t height, bool neo);
+// The conversion is applied to each row of micro-tiles right after it is detiled, so the texels are read and written once
 void TileConvertTiledToLinear(void* dst, const void* src, TileMode mode, uint32_t dfmt, uint32_t nfmt, uint32_t width, uint32_t height,
-                              uint32_t pitch, uint32_t levels, bool neo);
+                              uint32_t pitch, uint32_t levels, bool neo, PixelConversion conversion);
+void TileGetVideoOutDetileParams(uint32_t width, uint32_t height, bool neo, TileVideoOutDetileParams* params);
 
 bool TileGetDepthSize(uint32_t width, uint32_t height, uint32_t pitch, uint32_t z_format, uint32_t stencil_format, bool htile, bool neo,
                       bool next_gen, TileSizeAlign* stencil_size, TileSizeAlign* htile_size, TileSizeAlign* depth_size);
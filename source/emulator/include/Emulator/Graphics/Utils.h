@@ -5,6 +5,7 @@
 
 #include "Emulator/Common.h"
 
+#include <functional>
 #include <utility>
 
 #ifdef KYTY_EMU_ENABLED
@@ -18,6 +19,7 @@ namespace Kyty::Libs::Graphics {
 
 class CommandBuffer;
 struct GraphicContext;
+struct VulkanCommandBufferWaits;
 struct VulkanBuffer;
 struct VulkanImage;
 struct DepthStencilVulkanImage;
@@ -47,23 +49,70 @@ struct ImageImageCopy
 	int          dst_y;
 };
 
-void UtilBufferToImage(CommandBuffer* buffer, VulkanBuffer* src_buffer, uint32_t src_pitch, VulkanImage* dst_image, uint64_t dst_layout);
-void UtilBufferToImage(CommandBuffer* buffer, VulkanBuffer* src_buffer, VulkanImage* dst_image, const Vector<BufferImageCopy>& regions,
+using UtilFillFunc = std::function<void(void* dst)>;
+
+void UtilBufferToImage(CommandBuffer* buffer, VulkanBuffer* src_buffer, uint64_t src_offset, uint32_t src_pitch, VulkanImage* dst_image,
                        uint64_t dst_layout);
-void UtilImageToBuffer(CommandBuffer* buffer, VulkanImage* src_image, VulkanBuffer* dst_buffer, uint32_t dst_pitch, uint64_t src_layout);
+void UtilBufferToImage(CommandBuffer* buffer, VulkanBuffer* src_buffer, uint64_t src_offset, VulkanImage* dst_image,
+                       const Vector<BufferImageCopy>& regions, uint64_t dst_layout);
+void UtilImageToBuffer(CommandBuffer* buffer, VulkanImage* src_image, VulkanBuffer* dst_buffer, uint64_t dst_offset, uint32_t dst_pitch,
+                       uint64_t src_layout);
 void UtilImageToImage(CommandBuffer* buffer, const Vector<ImageImageCopy>& regions, VulkanImage* dst_image, uint64_t dst_layout);
 void UtilBlitImage(CommandBuffer* buffer, VulkanImage* src_image, VulkanSwapchain* dst_swapchain);
+void UtilGenerateMips(CommandBuffer* buffer, VulkanImage* image, uint32_t levels, uint64_t layout);
+bool UtilCanGenerateMips(GraphicContext* ctx, VulkanImage* image);
 void UtilFillImage(GraphicContext* ctx, VulkanImage* dst_image, const void* src_data, uint64_t size, uint32_t src_pitch,
                    uint64_t dst_layout);
 void UtilFillImage(GraphicContext* ctx, VulkanImage* dst_image, const void* src_data, uint64_t size, const Vector<BufferImageCopy>& regions,
                    uint64_t dst_layout);
+// The fill function writes size bytes straight into the staging memory, so the texels can be detiled and converted there in one pass
+// instead of going through a temporary buffer
+void UtilFillImage(GraphicContext* ctx, VulkanImage* dst_image, const UtilFillFunc& fill, uint64_t size, uint32_t src_pitch,
+                   uint64_t dst_layout);
+void UtilFillImage(GraphicContext* ctx, VulkanImage* dst_image, const UtilFillFunc& fill, uint64_t size,
+                   const Vector<BufferImageCopy>& regions, uint64_t dst_layout);
 void UtilFillImage(GraphicContext* ctx, const Vector<ImageImageCopy>& regions, VulkanImage* dst_image, uint64_t dst_layout);
+void UtilFillImageGenerateMips(GraphicContext* ctx, const Vector<ImageImageCopy>& regions, VulkanImage* dst_image, uint32_t levels,
+                               uint64_t dst_layout);
+// Decodes BC1 (bc = 1), BC2 (2) or BC3 (3) blocks into an RGBA8 image on the GPU, for devices which can't sample BC formats
+void UtilDecodeBcImage(GraphicContext* ctx, VulkanImage* dst_image, const UtilFillFunc& fill, uint64_t size, uint32_t bc,
+                       const Vector<BufferImageCopy>& regions, uint64_t dst_layout);
+void UtilDetileVideoOutImage(GraphicContext* ctx, VulkanImage* dst_image, const void* src_data, uint64_t size, uint32_t width,
+                             uint32_t height, bool neo, uint64_t dst_layout);
 void UtilFillBuffer(GraphicContext* ctx, void* dst_data, uint64_t size, uint32_t dst_pitch, VulkanImage* src_image, uint64_t src_layout);
 void UtilCopyBuffer(VulkanBuffer* src_buffer, VulkanBuffer* dst_buffer, uint64_t size);
+void UtilUploadBuffer(GraphicContext* ctx, VulkanBuffer* dst_buffer, const void* src_data, uint64_t size);
 void UtilSetDepthLayoutOptimal(DepthStencilVulkanImage* image);
 void UtilSetImageLayoutOptimal(VulkanImage* image);
+uint32_t UtilGetRenderScale();
+void     UtilApplyRenderScale(VulkanImage* image);
+
+// Large texture uploads are submitted without waiting, the following submits wait for them on the GPU
+void UtilAddUploadWaits(VulkanCommandBufferWaits* waits);
+void UtilWaitForUploads();
+
+// Texture uploads of the calling thread between these calls are recorded into one command buffer, which is submitted without
+// waiting when the outermost batch ends or when the thread submits another buffer
+void UtilBeginUploadBatch(GraphicContext* ctx);
+void UtilEndUploadBatch();
+
+class UtilUploadBatch
+{
+public:
+	explicit UtilUploadBatch(GraphicContext* ctx) { UtilBeginUploadBatch(ctx); }
+	~UtilUploadBatch() { UtilEndUploadBatch(); }
+
+	KYTY_CLASS_NO_COPY(UtilUploadBatch);
+};
+
+// Color copy of a depth image (R32F, or R16 for D16) which is created on first use and destroyed with the depth image. The conversion
+// is recorded into the buffer, the depth image must be in TRANSFER_SRC_OPTIMAL layout and the copy in TRANSFER_DST_OPTIMAL.
+VulkanImage* UtilGetDepthColor(GraphicContext* ctx, DepthStencilVulkanImage* image);
+void         UtilDepthToColor(CommandBuffer* buffer, DepthStencilVulkanImage* image);
+void         UtilDeleteDepthColor(GraphicContext* ctx, DepthStencilVulkanImage* image);
 
 void VulkanCreateBuffer(GraphicContext* gctx, uint64_t size, VulkanBuffer* buffer);
+void VulkanCreateHostBuffer(GraphicContext* gctx, void* host_ptr, uint64_t size, VulkanBuffer* buffer);
 void VulkanDeleteBuffer(GraphicContext* gctx, VulkanBuffer* buffer);
 
 inline std::pair<int, int> UtilCalcMipmapOffset(uint32_t lod, uint32_t width, uint32_t height)
@@ -55,6 +55,7 @@ KYTY_SYSV_ABI int  VideoOutGetFlipStatus(int handle, VideoOutFlipStatus* status)
 KYTY_SYSV_ABI int  VideoOutGetVblankStatus(int handle, VideoOutVblankStatus* status);
 KYTY_SYSV_ABI int  VideoOutSetWindowModeMargins(int handle, int top, int bottom);
 
+// Called by the present thread around a flip. They do nothing if vblank is signaled by the timer, see Config::VblankTimerEnabled().
 void VideoOutBeginVblank();
 void VideoOutEndVblank();
 bool VideoOutFlipWindow(uint32_t micros);
@@ -0,0 +1,32 @@
+#ifndef EMULATOR_INCLUDE_EMULATOR_HLESTATS_H_
+#define EMULATOR_INCLUDE_EMULATOR_HLESTATS_H_
+
+#include "Kyty/Core/Common.h"
+
+#include "Emulator/Common.h"
+
+#ifdef KYTY_EMU_ENABLED
+
+namespace Kyty::Profiler {
+
+// Call counts and host time of the HLE functions. If Config::HleStatsEnabled() is set, every HLE function gets a thunk when its
+// library is added to the symbol database, and the guest calls the thunk instead. Otherwise the functions are added as they are and
+// nothing is measured.
+//
+// The thunk replaces the return address with a common return stub and keeps the original one on a per-thread stack, so the
+// arguments are passed unchanged, including the stack ones and varargs. The time is inclusive: a guest callback made by the
+// function is counted too.
+
+void HleStatsInit();
+
+// Returns the address the function is registered with
+uint64_t HleStatsWrap(uint64_t func, const char* library, const char* name, const char32_t* dbg_name);
+
+// The functions which were called, sorted by the total time
+void HleStatsPrint();
+
+} // namespace Kyty::Profiler
+
+#endif // KYTY_EMU_ENABLED
+
+#endif /* EMULATOR_INCLUDE_EMULATOR_HLESTATS_H_ */
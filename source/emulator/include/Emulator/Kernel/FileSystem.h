@@ -38,9 +38,15 @@ struct FileStat
 KYTY_SUBSYSTEM_DEFINE(FileSystem);
 
 void   Mount(const String& folder, const String& point);
-void   Umount(const String& folder_or_point);
+int    Umount(const String& folder_or_point); // KERNEL_ERROR_EBUSY if a file of a write-behind mount is open
 String GetRealFilename(const String& mounted_file_name);
 
+// The files are kept in memory while mounted and written back in the background by Umount(), see Config::SaveDataWriteBehind()
+void MountWriteBehind(const String& folder, const String& point);
+
+// The files of the chunk are read ahead before the others, called for the chunks the title asks about with PlayGo
+void PrefetchChunk(uint16_t chunk_id);
+
 int KYTY_SYSV_ABI     KernelOpen(const char* path, int flags, uint16_t mode);
 int KYTY_SYSV_ABI     KernelClose(int d);
 int64_t KYTY_SYSV_ABI KernelRead(int d, void* buf, size_t nbytes);
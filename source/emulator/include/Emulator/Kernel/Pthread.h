@@ -33,6 +33,14 @@ struct PthreadRwlockattrPrivate;
 struct PthreadCondattrPrivate;
 struct PthreadCondPrivate;
 
+// Emulator threads that get host cores of their own when ThreadAffinityEnabled is set
+enum class EmulatorThread
+{
+	GfxDraw,
+	Compute,
+	Label
+};
+
 struct KernelTimespec
 {
 	int64_t tv_sec;
@@ -63,8 +71,10 @@ using pthread_entry_func_t          = KYTY_SYSV_ABI void* (*)(void*);
 using thread_dtors_func_t           = KYTY_SYSV_ABI void (*)();
 using pthread_key_destructor_func_t = KYTY_SYSV_ABI void (*)(void*);
 
+bool PthreadIsInitialized(); // false until kyty_init() has initialized the subsystem
 void PthreadInitSelfForMainThread();
 void PthreadDeleteStaticObjects(Loader::Program* program);
+void PthreadSetEmulatorThreadAffinity(EmulatorThread thread);
 
 int KYTY_SYSV_ABI PthreadMutexattrInit(PthreadMutexattr* attr);
 int KYTY_SYSV_ABI PthreadMutexattrDestroy(PthreadMutexattr* attr);
@@ -373,6 +373,16 @@ constexpr int AUDIO_IN_ERROR_BUSY            = -2144993014; /* 0x8026010A */
 constexpr int AUDIO_IN_ERROR_SYSTEM_MEMORY   = -2144993013; /* 0x8026010B */
 constexpr int AUDIO_IN_ERROR_SYSTEM_IPC      = -2144993012; /* 0x8026010C */
 
+constexpr int AJM_ERROR_INVALID_CONTEXT      = -2137849854; /* 0x80930002 */
+constexpr int AJM_ERROR_INVALID_INSTANCE     = -2137849853; /* 0x80930003 */
+constexpr int AJM_ERROR_INVALID_BATCH        = -2137849852; /* 0x80930004 */
+constexpr int AJM_ERROR_INVALID_PARAMETER    = -2137849851; /* 0x80930005 */
+constexpr int AJM_ERROR_OUT_OF_RESOURCES     = -2137849849; /* 0x80930007 */
+constexpr int AJM_ERROR_CODEC_NOT_SUPPORTED  = -2137849848; /* 0x80930008 */
+constexpr int AJM_ERROR_CODEC_NOT_REGISTERED = -2137849846; /* 0x8093000A */
+constexpr int AJM_ERROR_BUSY                 = -2137849839; /* 0x80930011 */
+constexpr int AJM_ERROR_MALFORMED_BATCH      = -2137849836; /* 0x80930014 */
+
 } // namespace Audio
 
 namespace SystemService {
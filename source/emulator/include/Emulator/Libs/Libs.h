@@ -45,19 +45,8 @@
 	}
 // NOLINTNEXTLINE(cppcoreguidelines-macro-usage)
 #define LIB_ADD(n, f, t)                                                                                                                   \
-	{                                                                                                                                      \
-		Loader::SymbolResolve sr {};                                                                                                       \
-		sr.name                  = n;                                                                                                      \
-		sr.library               = g_library;                                                                                              \
-		sr.library_version       = g_library_version;                                                                                      \
-		sr.module                = g_module;                                                                                               \
-		sr.module_version_major  = g_module_version_major;                                                                                 \
-		sr.module_version_minor  = g_module_version_minor;                                                                                 \
-		sr.type                  = t;                                                                                                      \
-		auto            func     = reinterpret_cast<uint64_t>(f);                                                                          \
-		const char32_t* dbg_name = U"" #f;                                                                                                 \
-		s->Add(sr, func, dbg_name);                                                                                                        \
-	}
+	s->AddLazy({n, g_library, g_library_version, g_module, g_module_version_major, g_module_version_minor, t,                              \
+	            reinterpret_cast<uint64_t>(f), U"" #f})
 // NOLINTNEXTLINE(cppcoreguidelines-macro-usage)
 #define LIB_OBJECT(n, f) LIB_ADD(n, f, Loader::SymbolType::Object)
 // NOLINTNEXTLINE(cppcoreguidelines-macro-usage)
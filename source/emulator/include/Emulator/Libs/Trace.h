@@ -0,0 +1,216 @@
+#ifndef EMULATOR_INCLUDE_EMULATOR_LIBS_TRACE_H_
+#define EMULATOR_INCLUDE_EMULATOR_LIBS_TRACE_H_
+
+#include "Kyty/Core/Common.h"
+
+#include "Emulator/Common.h"
+#include "Emulator/Libs/Libs.h"
+#include "Emulator/Log.h"
+
+#include <atomic>
+#include <cstring>
+#include <type_traits>
+
+#ifdef KYTY_EMU_ENABLED
+
+// Tracing of the HLE hot paths. A trace is compiled out if its level is above the compile-time level of the subsystem,
+// otherwise it costs one branch on the runtime level. Nothing is formatted unless the trace is printed.
+// With TraceBinaryFile set a trace records the id of its format and the raw arguments instead, kyty_trace_decode prints
+// the file as text later.
+
+// NOLINTNEXTLINE(cppcoreguidelines-macro-usage)
+#define KYTY_TRACE_OFF     0
+// NOLINTNEXTLINE(cppcoreguidelines-macro-usage)
+#define KYTY_TRACE_INFO    1 // Function names
+// NOLINTNEXTLINE(cppcoreguidelines-macro-usage)
+#define KYTY_TRACE_VERBOSE 2 // Function arguments and results
+
+#ifndef KYTY_TRACE_LEVEL
+#ifdef KYTY_FINAL
+#define KYTY_TRACE_LEVEL KYTY_TRACE_OFF
+#else
+#define KYTY_TRACE_LEVEL KYTY_TRACE_VERBOSE
+#endif
+#endif
+
+#ifndef KYTY_TRACE_LEVEL_Pthread
+#define KYTY_TRACE_LEVEL_Pthread KYTY_TRACE_LEVEL
+#endif
+#ifndef KYTY_TRACE_LEVEL_FileSystem
+#define KYTY_TRACE_LEVEL_FileSystem KYTY_TRACE_LEVEL
+#endif
+#ifndef KYTY_TRACE_LEVEL_EventQueue
+#define KYTY_TRACE_LEVEL_EventQueue KYTY_TRACE_LEVEL
+#endif
+#ifndef KYTY_TRACE_LEVEL_Semaphore
+#define KYTY_TRACE_LEVEL_Semaphore KYTY_TRACE_LEVEL
+#endif
+
+// NOLINTNEXTLINE(cppcoreguidelines-macro-usage)
+#define KYTY_TRACE_ENABLED(sub, level)                                                                                                     \
+	(Kyty::Libs::g_trace_levels[static_cast<int>(Kyty::Libs::TraceSubsystem::sub)] >= (level) && PRINT_NAME_ENABLED)
+
+// NOLINTNEXTLINE(cppcoreguidelines-macro-usage)
+#define KYTY_TRACE_OUTPUT(sub, level, limited, text, binary)                                                                               \
+	do                                                                                                                                     \
+	{                                                                                                                                      \
+		if constexpr ((level) <= KYTY_TRACE_LEVEL_##sub)                                                                                   \
+		{                                                                                                                                  \
+			if (KYTY_TRACE_ENABLED(sub, level))                                                                                            \
+			{                                                                                                                              \
+				static std::atomic_uint32_t trace_calls(0);                                                                                \
+				if (!(limited) || Kyty::Libs::TraceRateCheck(&trace_calls))                                                                \
+				{                                                                                                                          \
+					if (Kyty::Libs::g_trace_binary)                                                                                        \
+					{                                                                                                                      \
+						static std::atomic_uint32_t trace_id(0);                                                                           \
+						binary;                                                                                                            \
+					} else                                                                                                                 \
+					{                                                                                                                      \
+						text;                                                                                                              \
+					}                                                                                                                      \
+				}                                                                                                                          \
+			}                                                                                                                              \
+		}                                                                                                                                  \
+	} while (false)
+
+// NOLINTNEXTLINE(cppcoreguidelines-macro-usage)
+#define KYTY_TRACE_PRINT(sub, level, limited, ...)                                                                                         \
+	KYTY_TRACE_OUTPUT(sub, level, limited, Kyty::printf(__VA_ARGS__), Kyty::Libs::TraceBinaryPrint(&trace_id, __VA_ARGS__))
+
+// NOLINTNEXTLINE(cppcoreguidelines-macro-usage)
+#define KYTY_TRACE_NAME_FORMAT FG_CYAN "[%d][%s] %s::%s::%s()" DEFAULT "\n"
+// NOLINTNEXTLINE(cppcoreguidelines-macro-usage)
+#define KYTY_TRACE_NAME_ARGS                                                                                                               \
+	Core::Thread::GetThreadIdUnique(), Loader::Timer::GetTime().ToString("HH24:MI:SS.FFF").C_Str(), g_library, g_module, __func__
+
+// NOLINTNEXTLINE(cppcoreguidelines-macro-usage)
+#define KYTY_TRACE_PRINT_NAME(sub, limited)                                                                                                \
+	KYTY_TRACE_OUTPUT(sub, KYTY_TRACE_INFO, limited, Kyty::printf(KYTY_TRACE_NAME_FORMAT, KYTY_TRACE_NAME_ARGS),                          \
+	                  Kyty::Libs::TraceBinaryName(&trace_id, g_library, g_module, __func__))
+
+// Same output as PRINT_NAME()
+// NOLINTNEXTLINE(cppcoreguidelines-macro-usage)
+#define TRACE_NAME(sub)         KYTY_TRACE_PRINT_NAME(sub, false)
+// NOLINTNEXTLINE(cppcoreguidelines-macro-usage)
+#define TRACE_NAME_LIMITED(sub) KYTY_TRACE_PRINT_NAME(sub, true)
+// NOLINTNEXTLINE(cppcoreguidelines-macro-usage)
+#define TRACE(sub, ...)         KYTY_TRACE_PRINT(sub, KYTY_TRACE_VERBOSE, false, __VA_ARGS__)
+// The first calls are printed, then one call of every TRACE_RATE_PERIOD. Meant for functions a game calls every frame.
+// NOLINTNEXTLINE(cppcoreguidelines-macro-usage)
+#define TRACE_LIMITED(sub, ...) KYTY_TRACE_PRINT(sub, KYTY_TRACE_VERBOSE, true, __VA_ARGS__)
+
+namespace Kyty::Libs {
+
+enum class TraceSubsystem
+{
+	Pthread,
+	FileSystem,
+	EventQueue,
+	Semaphore,
+
+	Max
+};
+
+constexpr uint32_t TRACE_RATE_BURST  = 32;
+constexpr uint32_t TRACE_RATE_PERIOD = 1024;
+
+// Written only by TraceInit() and TraceSetLevel()
+extern int  g_trace_levels[static_cast<int>(TraceSubsystem::Max)];
+extern bool g_trace_binary;
+
+// Runtime levels are taken from the config, everything is off if the log is silent
+void TraceInit();
+void TraceSetLevel(TraceSubsystem sub, int level);
+
+inline bool TraceRateCheck(std::atomic_uint32_t* calls)
+{
+	auto n = calls->fetch_add(1, std::memory_order_relaxed);
+	return (n < TRACE_RATE_BURST || (n % TRACE_RATE_PERIOD) == 0);
+}
+
+constexpr uint32_t TRACE_BINARY_RECORD_MAX = 1024;
+
+enum class TraceBinaryArg : uint8_t
+{
+	Int,
+	Uint,
+	Double,
+	Str,
+};
+
+// One record, arguments are stored as a type byte and a value. Long strings are cut to fit.
+struct TraceBinaryRecord
+{
+	uint8_t  data[TRACE_BINARY_RECORD_MAX];
+	uint32_t size = 0;
+
+	void Add(const void* src, uint32_t num)
+	{
+		if (size + num <= TRACE_BINARY_RECORD_MAX)
+		{
+			memcpy(data + size, src, num);
+			size += num;
+		}
+	}
+
+	template <class T>
+	void Add(TraceBinaryArg type, T value)
+	{
+		Add(&type, 1);
+		Add(&value, sizeof(value));
+	}
+};
+
+// The id is taken on the first call from the call site
+uint32_t TraceBinaryId(std::atomic_uint32_t* id, const char* format);
+uint32_t TraceBinaryNameId(std::atomic_uint32_t* id, const char* library, const char* module, const char* func);
+void     TraceBinaryBegin(TraceBinaryRecord* r, uint32_t id);
+void     TraceBinaryEnd(TraceBinaryRecord* r);
+void     TraceBinaryAddStr(TraceBinaryRecord* r, const char* str);
+
+template <class T>
+void TraceBinaryAdd(TraceBinaryRecord* r, T value)
+{
+	if constexpr (std::is_same_v<T, const char*> || std::is_same_v<T, char*>)
+	{
+		TraceBinaryAddStr(r, value);
+	} else if constexpr (std::is_floating_point_v<T>)
+	{
+		r->Add(TraceBinaryArg::Double, static_cast<double>(value));
+	} else if constexpr (std::is_pointer_v<T>)
+	{
+		r->Add(TraceBinaryArg::Uint, static_cast<uint64_t>(reinterpret_cast<uintptr_t>(value)));
+	} else if constexpr (std::is_signed_v<T> || std::is_enum_v<T>)
+	{
+		r->Add(TraceBinaryArg::Int, static_cast<int64_t>(value));
+	} else
+	{
+		r->Add(TraceBinaryArg::Uint, static_cast<uint64_t>(value));
+	}
+}
+
+template <class... Args>
+void TraceBinaryPrint(std::atomic_uint32_t* id, const char* format, Args... args)
+{
+	TraceBinaryRecord r;
+	TraceBinaryBegin(&r, TraceBinaryId(id, format));
+	(TraceBinaryAdd(&r, args), ...);
+	TraceBinaryEnd(&r);
+}
+
+inline void TraceBinaryName(std::atomic_uint32_t* id, const char* library, const char* module, const char* func)
+{
+	TraceBinaryRecord r;
+	TraceBinaryBegin(&r, TraceBinaryNameId(id, library, module, func));
+	TraceBinaryEnd(&r);
+}
+
+// Prints a binary trace file as text
+bool TraceBinaryDecode(const String& file_name, const String& out_file_name);
+
+} // namespace Kyty::Libs
+
+#endif // KYTY_EMU_ENABLED
+
+#endif /* EMULATOR_INCLUDE_EMULATOR_LIBS_TRACE_H_ */
@@ -265,7 +265,8 @@ public:
 	[[nodiscard]] bool IsShared() const;
 	[[nodiscard]] bool IsNextGen() const;
 
-	void LoadSegment(uint64_t vaddr, uint64_t file_offset, uint64_t size);
+	// 'map' - vaddr is guest memory allocated for the image, pages of uncompressed segments may be mapped from the file
+	void LoadSegment(uint64_t vaddr, uint64_t file_offset, uint64_t size, bool map = false);
 
 	uint64_t GetEntry();
 
@@ -69,6 +69,39 @@ struct JmpRax
 	uint8_t code[16] = {0x48, 0xB8, 0x88, 0x77, 0x66, 0x55, 0x44, 0x33, 0x22, 0x11, 0xFF, 0xE0};
 };
 
+struct JmpR11
+{
+	void SetFunc(uint64_t func) { *reinterpret_cast<uint64_t*>(&code[2]) = func; }
+
+	static uint64_t GetSize() { return 13; }
+
+	// movabs r11, 0x1122334455667788
+	// jmp r11
+	uint8_t code[13] = {0x49, 0xBB, 0x88, 0x77, 0x66, 0x55, 0x44, 0x33, 0x22, 0x11, 0x41, 0xFF, 0xE3};
+};
+
+struct Jmp5
+{
+	static bool InRange(uint64_t from, uint64_t func)
+	{
+		auto offset64 = static_cast<int64_t>(func - (from + 5));
+		return offset64 == static_cast<int32_t>(offset64);
+	}
+
+	void SetFunc(uint64_t func)
+	{
+		auto rip_addr = reinterpret_cast<uint64_t>(&code[5]);
+		auto offset32 = static_cast<uint32_t>((func - rip_addr) & 0xffffffffu);
+
+		*reinterpret_cast<uint32_t*>(&code[1]) = offset32;
+	}
+
+	static uint64_t GetSize() { return 5; }
+
+	// jmp func
+	uint8_t code[5] = {0xE9, 0x00, 0x00, 0x00, 0x00};
+};
+
 struct Call9
 {
 	template <class Handler>
@@ -90,6 +123,20 @@ struct Call9
 	uint8_t code[9] = {0xE8, 0x00, 0x00, 0x00, 0x00, 0x48, 0x89, 0xC0, 0x90};
 };
 
+struct SegmentLoad9
+{
+	void SetAddress(uint8_t segment_prefix, uint32_t offset)
+	{
+		code[0]                                = segment_prefix;
+		*reinterpret_cast<uint32_t*>(&code[5]) = offset;
+	}
+
+	static uint64_t GetSize() { return 9; }
+
+	// mov rax, qword ptr gs:[offset]
+	uint8_t code[9] = {0x65, 0x48, 0x8B, 0x04, 0x25, 0x00, 0x00, 0x00, 0x00};
+};
+
 struct SafeCall
 {
 	using func_t = KYTY_MS_ABI uint8_t* (*)();
@@ -141,6 +188,89 @@ struct SafeCall
 	};
 };
 
+// Counts a call of an HLE function, see Profiler::HleStatsWrap(). 'enter' gets the slot of the return address and replaces it
+// with CallStatsReturn.
+struct CallStats
+{
+	using enter_t = KYTY_SYSV_ABI void (*)(void*, uint64_t*);
+
+	void SetEntry(void* entry) { *reinterpret_cast<void**>(&code[0x4a]) = entry; }
+	void SetEnter(enter_t enter) { *reinterpret_cast<enter_t*>(&code[0x54]) = enter; }
+	void SetFunc(uint64_t func) { *reinterpret_cast<uint64_t*>(&code[0xa0]) = func; }
+
+	static uint64_t GetSize() { return 0xb0; }
+
+	uint8_t code[0xb0] = {
+	    /*00*/ 0x57,                                                       // push   rdi  /* Save the arguments */
+	    /*01*/ 0x56,                                                       // push   rsi
+	    /*02*/ 0x52,                                                       // push   rdx
+	    /*03*/ 0x51,                                                       // push   rcx
+	    /*04*/ 0x41, 0x50,                                                 // push   r8
+	    /*06*/ 0x41, 0x51,                                                 // push   r9
+	    /*08*/ 0x50,                                                       // push   rax  /* al is the vector count of a vararg call */
+	    /*09*/ 0x48, 0x81, 0xec, 0x80, 0x00, 0x00, 0x00,                   // sub    rsp,0x80
+	    /*10*/ 0xf3, 0x0f, 0x7f, 0x44, 0x24, 0x00,                         // movdqu [rsp+0x00],xmm0
+	    /*16*/ 0xf3, 0x0f, 0x7f, 0x4c, 0x24, 0x10,                         // movdqu [rsp+0x10],xmm1
+	    /*1c*/ 0xf3, 0x0f, 0x7f, 0x54, 0x24, 0x20,                         // movdqu [rsp+0x20],xmm2
+	    /*22*/ 0xf3, 0x0f, 0x7f, 0x5c, 0x24, 0x30,                         // movdqu [rsp+0x30],xmm3
+	    /*28*/ 0xf3, 0x0f, 0x7f, 0x64, 0x24, 0x40,                         // movdqu [rsp+0x40],xmm4
+	    /*2e*/ 0xf3, 0x0f, 0x7f, 0x6c, 0x24, 0x50,                         // movdqu [rsp+0x50],xmm5
+	    /*34*/ 0xf3, 0x0f, 0x7f, 0x74, 0x24, 0x60,                         // movdqu [rsp+0x60],xmm6
+	    /*3a*/ 0xf3, 0x0f, 0x7f, 0x7c, 0x24, 0x70,                         // movdqu [rsp+0x70],xmm7
+	    /*40*/ 0x48, 0x8d, 0xb4, 0x24, 0xb8, 0x00, 0x00, 0x00,             // lea    rsi,[rsp+0xb8]  /* The return address */
+	    /*48*/ 0x48, 0xbf, 0x88, 0x77, 0x66, 0x55, 0x44, 0x33, 0x22, 0x11, // movabs rdi,0x1122334455667788
+	    /*52*/ 0x48, 0xb8, 0x88, 0x77, 0x66, 0x55, 0x44, 0x33, 0x22, 0x11, // movabs rax,0x1122334455667788
+	    /*5c*/ 0xff, 0xd0,                                                 // call   rax
+	    /*5e*/ 0xf3, 0x0f, 0x6f, 0x44, 0x24, 0x00,                         // movdqu xmm0,[rsp+0x00]  /* Restore the arguments */
+	    /*64*/ 0xf3, 0x0f, 0x6f, 0x4c, 0x24, 0x10,                         // movdqu xmm1,[rsp+0x10]
+	    /*6a*/ 0xf3, 0x0f, 0x6f, 0x54, 0x24, 0x20,                         // movdqu xmm2,[rsp+0x20]
+	    /*70*/ 0xf3, 0x0f, 0x6f, 0x5c, 0x24, 0x30,                         // movdqu xmm3,[rsp+0x30]
+	    /*76*/ 0xf3, 0x0f, 0x6f, 0x64, 0x24, 0x40,                         // movdqu xmm4,[rsp+0x40]
+	    /*7c*/ 0xf3, 0x0f, 0x6f, 0x6c, 0x24, 0x50,                         // movdqu xmm5,[rsp+0x50]
+	    /*82*/ 0xf3, 0x0f, 0x6f, 0x74, 0x24, 0x60,                         // movdqu xmm6,[rsp+0x60]
+	    /*88*/ 0xf3, 0x0f, 0x6f, 0x7c, 0x24, 0x70,                         // movdqu xmm7,[rsp+0x70]
+	    /*8e*/ 0x48, 0x81, 0xc4, 0x80, 0x00, 0x00, 0x00,                   // add    rsp,0x80
+	    /*95*/ 0x58,                                                       // pop    rax
+	    /*96*/ 0x41, 0x59,                                                 // pop    r9
+	    /*98*/ 0x41, 0x58,                                                 // pop    r8
+	    /*9a*/ 0x59,                                                       // pop    rcx
+	    /*9b*/ 0x5a,                                                       // pop    rdx
+	    /*9c*/ 0x5e,                                                       // pop    rsi
+	    /*9d*/ 0x5f,                                                       // pop    rdi
+	    /*9e*/ 0x49, 0xbb, 0x88, 0x77, 0x66, 0x55, 0x44, 0x33, 0x22, 0x11, // movabs r11,0x1122334455667788
+	    /*a8*/ 0x41, 0xff, 0xe3,                                           // jmp    r11
+	    /*ab*/ 0x90, 0x90, 0x90, 0x90, 0x90,                               // nop
+	};
+};
+
+// The HLE function returns here. 'leave' gets the slot of the replaced return address and returns the original one.
+struct CallStatsReturn
+{
+	using leave_t = KYTY_SYSV_ABI uint64_t (*)(uint64_t*);
+
+	void SetLeave(leave_t leave) { *reinterpret_cast<leave_t*>(&code[0x19]) = leave; }
+
+	static uint64_t GetSize() { return 0x40; }
+
+	uint8_t code[0x40] = {
+	    /*00*/ 0x50,                                                       // push   rax  /* Save the return value */
+	    /*01*/ 0x52,                                                       // push   rdx
+	    /*02*/ 0x48, 0x83, 0xec, 0x20,                                     // sub    rsp,0x20
+	    /*06*/ 0xf3, 0x0f, 0x7f, 0x44, 0x24, 0x00,                         // movdqu [rsp+0x00],xmm0
+	    /*0c*/ 0xf3, 0x0f, 0x7f, 0x4c, 0x24, 0x10,                         // movdqu [rsp+0x10],xmm1
+	    /*12*/ 0x48, 0x8d, 0x7c, 0x24, 0x28,                               // lea    rdi,[rsp+0x28]  /* The return address slot */
+	    /*17*/ 0x48, 0xb8, 0x88, 0x77, 0x66, 0x55, 0x44, 0x33, 0x22, 0x11, // movabs rax,0x1122334455667788
+	    /*21*/ 0xff, 0xd0,                                                 // call   rax
+	    /*23*/ 0x49, 0x89, 0xc3,                                           // mov    r11,rax
+	    /*26*/ 0xf3, 0x0f, 0x6f, 0x44, 0x24, 0x00,                         // movdqu xmm0,[rsp+0x00]  /* Restore the return value */
+	    /*2c*/ 0xf3, 0x0f, 0x6f, 0x4c, 0x24, 0x10,                         // movdqu xmm1,[rsp+0x10]
+	    /*32*/ 0x48, 0x83, 0xc4, 0x20,                                     // add    rsp,0x20
+	    /*36*/ 0x5a,                                                       // pop    rdx
+	    /*37*/ 0x58,                                                       // pop    rax
+	    /*38*/ 0x41, 0xff, 0xe3,                                           // jmp    r11
+	};
+};
+
 #pragma pack()
 
 } // namespace Kyty::Loader::Jit
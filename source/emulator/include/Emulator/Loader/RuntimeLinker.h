@@ -2,7 +2,7 @@
 #define EMULATOR_INCLUDE_EMULATOR_LOADER_RUNTIMELINKER_H_
 
 #include "Kyty/Core/Common.h"
-#include "Kyty/Core/Hashmap.h"
+#include "Kyty/Core/FlatHashmap.h"
 #include "Kyty/Core/String.h"
 #include "Kyty/Core/Threads.h"
 #include "Kyty/Core/Vector.h"
@@ -19,6 +19,7 @@ class ExceptionHandler;
 namespace Kyty::Loader {
 
 class Elf64;
+struct BootSnapshot;
 struct Elf64_Sym;
 struct Elf64_Rela;
 class RuntimeLinker;
@@ -32,19 +33,23 @@ struct ModuleId
 		return version_major == other.version_major && version_minor == other.version_minor && name == other.name;
 	}
 
-	String id;
-	int    version_major;
-	int    version_minor;
-	String name;
+	String   id;
+	uint16_t id_num;
+	int      version_major;
+	int      version_minor;
+	String   name;
+	uint32_t key; // SymbolDatabase::ModuleKey()
 };
 
 struct LibraryId
 {
 	bool operator==(const LibraryId& other) const { return version == other.version && name == other.name; }
 
-	String id;
-	int    version;
-	String name;
+	String   id;
+	uint16_t id_num;
+	int      version;
+	String   name;
+	uint32_t key; // SymbolDatabase::LibraryKey()
 };
 
 struct ThreadLocalStorage
@@ -53,8 +58,8 @@ struct ThreadLocalStorage
 	uint64_t image_size    = 0;
 	uint64_t handler_vaddr = 0;
 
-	Core::Hashmap<int, uint8_t*> tlss;
-	Core::Mutex                  mutex;
+	Core::FlatHashmap<int, uint8_t*> tlss;
+	Core::Mutex                      mutex;
 };
 
 struct DynamicInfo
@@ -150,7 +155,9 @@ public:
 	void StopAllModules();
 	void DeleteTlss(int thread_id);
 
-	void Resolve(const String& name, SymbolType type, Program* program, SymbolRecord* out_info, bool* bind_self);
+	// 'name' is 'nid#library#module' from the string table. Returns 0 if the symbol is not found.
+	uint64_t     Resolve(const char* name, SymbolType type, Program* program, bool* bind_self, bool lock_linker = true);
+	SymbolRecord ResolveRecord(const String& name, SymbolType type, Program* program);
 
 	SymbolDatabase* Symbols() { return m_symbols; }
 
@@ -160,14 +167,24 @@ public:
 
 	static uint8_t* TlsGetAddr(Program* program);
 	static void     DeleteTls(Program* program, int thread_id);
+	static void     TlsInitThread();
 
 	void StackTrace(uint64_t frame_ptr);
 
+	// "module!export+offset" or "module+offset" for guest code, "function+offset" for the host code found in the debug map.
+	// Guest exports are looked up in a sorted index built when the program is loaded.
+	bool Symbolize(uint64_t vaddr, String* name);
+
+	// Guest return addresses of the frames inside [stack_addr, stack_addr + stack_size). Can be called from a signal handler.
+	static void StackWalk(uint64_t frame_ptr, uint64_t stack_addr, uint64_t stack_size, void** stack, int* depth);
+
 private:
-	static void LoadProgramToMemory(Program* program);
+	static void ReserveProgramMemory(Program* program);
+	static void LoadProgramToMemory(Program* program, BootSnapshot* snapshot);
 	static void ParseProgramDynamicInfo(Program* program);
 	static void CreateSymbolDatabase(Program* program);
-	static void Relocate(Program* program);
+	void        Relocate(const Vector<Program*>& programs);
+	static void PrepareRelocation(Program* program);
 	static void DeleteProgram(Program* program);
 	static void SetupTlsHandler(Program* program);
 
@@ -175,8 +192,13 @@ private:
 
 	static const ModuleId*  FindModule(const Program& program, const String& id);
 	static const LibraryId* FindLibrary(const Program& program, const String& id);
+	static const ModuleId*  FindModule(const Program& program, uint16_t id);
+	static const LibraryId* FindLibrary(const Program& program, uint16_t id);
+
+	void LoadPendingPrograms();
 
 	Vector<Program*> m_programs;
+	Vector<Program*> m_pending; // queued by LoadProgram(), loaded before they are used
 	SymbolDatabase*  m_symbols   = nullptr;
 	bool             m_relocated = false;
 	Core::Mutex      m_mutex;
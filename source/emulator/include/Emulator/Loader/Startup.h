@@ -0,0 +1,32 @@
+#ifndef EMULATOR_INCLUDE_EMULATOR_LOADER_STARTUP_H_
+#define EMULATOR_INCLUDE_EMULATOR_LOADER_STARTUP_H_
+
+#include "Kyty/Core/Common.h"
+
+#include "Emulator/Common.h"
+
+#ifdef KYTY_EMU_ENABLED
+
+namespace Kyty::Loader {
+
+// Phases of the startup are timed until the first flip, then printed and saved as JSON (see Config::GetStartupReportFile()). Bytes
+// read and allocations are process-wide counters, so a phase also counts the work of other threads running at the same time.
+class StartupPhase
+{
+public:
+	explicit StartupPhase(const char* name); // must be a string literal
+	~StartupPhase();
+
+	KYTY_CLASS_NO_COPY(StartupPhase);
+
+private:
+	int m_index = -1;
+};
+
+void StartupFirstFlip();
+
+} // namespace Kyty::Loader
+
+#endif // KYTY_EMU_ENABLED
+
+#endif /* EMULATOR_INCLUDE_EMULATOR_LOADER_STARTUP_H_ */
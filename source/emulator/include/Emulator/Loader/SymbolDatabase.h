@@ -2,12 +2,13 @@
 #define EMULATOR_INCLUDE_EMULATOR_LOADER_SYMBOLDATABASE_H_
 
 #include "Kyty/Core/Common.h"
-#include "Kyty/Core/Hashmap.h"
 #include "Kyty/Core/String.h"
 #include "Kyty/Core/Vector.h"
 
 #include "Emulator/Common.h"
 
+#include <vector>
+
 #ifdef KYTY_EMU_ENABLED
 
 namespace Kyty::Loader {
@@ -39,6 +40,36 @@ struct SymbolResolve
 	SymbolType type;
 };
 
+// An HLE symbol registered at startup, the strings are literals. It is added to the database when its library is imported.
+struct SymbolEntry
+{
+	const char*     name;
+	const char*     library;
+	int             library_version;
+	const char*     module;
+	int             module_version_major;
+	int             module_version_minor;
+	SymbolType      type;
+	uint64_t        vaddr;
+	const char32_t* dbg_name;
+};
+
+// The NID decoded from its base64 string, and the interned library and module. A name which is not a NID is interned too.
+struct SymbolKey
+{
+	bool operator==(const SymbolKey& other) const
+	{
+		return nid == other.nid && library == other.library && module == other.module && type == other.type &&
+		       interned_name == other.interned_name;
+	}
+
+	uint64_t   nid           = 0;
+	uint32_t   library       = 0;
+	uint32_t   module        = 0;
+	SymbolType type          = SymbolType::Unknown;
+	bool       interned_name = false;
+};
+
 class SymbolDatabase
 {
 public:
@@ -47,18 +78,56 @@ public:
 
 	void Add(const SymbolResolve& s, uint64_t vaddr);
 	void Add(const SymbolResolve& s, uint64_t vaddr, const String& dbg_name);
+	void AddLazy(const SymbolEntry& e);
+
+	// Adds the lazy symbols of the library, the database must not be read by other threads
+	void Materialize(uint32_t library);
 
 	[[nodiscard]] const SymbolRecord* Find(const SymbolResolve& s) const;
+	[[nodiscard]] const SymbolRecord* Find(const SymbolKey& key) const;
+
+	[[nodiscard]] const Vector<SymbolRecord>& GetRecords() const { return m_symbols; }
+
+	// Sorts the records by address for FindByAddr(), the index is valid until the next Add()
+	void BuildAddrIndex();
+
+	// The record with the greatest address <= vaddr, nullptr if there is none
+	[[nodiscard]] const SymbolRecord* FindByAddr(uint64_t vaddr) const;
 
 	void DbgDump(const String& folder, const String& file_name);
 
 	KYTY_CLASS_NO_COPY(SymbolDatabase);
 
-	static String GenerateName(const SymbolResolve& s);
+	static String    GenerateName(const SymbolResolve& s);
+	static SymbolKey GenerateKey(const SymbolResolve& s);
+
+	// Interned ids, the same for equal names after the library name fixups
+	static uint32_t LibraryKey(const String& name, int version);
+	static uint32_t ModuleKey(const String& name, int version_major, int version_minor);
+
+	// Sets the name part of the key, 'str' is not null-terminated. Returns false for a name which can't be in any database.
+	static bool DecodeName(const char* str, uint32_t len, SymbolKey* key);
 
 private:
-	Vector<SymbolRecord>            m_symbols;
-	Core::Hashmap<String, uint32_t> m_map;
+	struct LazySymbol
+	{
+		uint32_t    library;
+		SymbolEntry entry;
+	};
+
+	void Put(const SymbolKey& key, uint32_t index);
+	void Grow();
+
+	std::vector<LazySymbol> m_lazy;
+	const char*             m_lazy_library         = nullptr; // the last library key, one registration function adds many symbols
+	int                     m_lazy_library_version = 0;
+	uint32_t                m_lazy_library_key     = 0;
+
+	Vector<SymbolRecord>  m_symbols;
+	Vector<SymbolKey>     m_keys;
+	std::vector<uint32_t> m_table;   // linear probing, index + 1 into m_symbols, 0 is empty
+	std::vector<uint32_t> m_by_addr; // indices into m_symbols sorted by address
+	uint32_t              m_used = 0;
 };
 
 } // namespace Kyty::Loader
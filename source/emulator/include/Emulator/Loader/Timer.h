@@ -15,9 +15,16 @@ KYTY_SUBSYSTEM_DEFINE(Timer);
 
 void       Start();
 double     GetTimeMs();
+uint64_t   GetTimeUs();
+uint64_t   GetMonotonicNs();
 Core::Time GetTime();
 uint64_t   GetCounter();
 uint64_t   GetFrequency();
+uint64_t   GetTsc(); // raw rdtsc if the host has an invariant TSC
+uint64_t   GetTscFrequency();
+
+// Benchmark mode: moves the guest time to the start of the next frame period, see Profiler::BenchmarkFrame()
+void FrameDone();
 
 } // namespace Kyty::Loader::Timer
 
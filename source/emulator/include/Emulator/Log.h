@@ -69,10 +69,30 @@ enum class Direction
 	Directory
 };
 
+// What a thread does if its async log buffer is full
+enum class Overflow
+{
+	Block,
+	Drop
+};
+
 Direction GetDirection();
 void      SetDirection(Direction dir);
 void      SetOutputFile(const String& file_name, Core::File::Encoding enc = Core::File::Encoding::Utf8);
 
+// Outputs UTF-8 text as is, like printf("%s") but without the formatting and the conversion to String
+void Write(const char* str, uint32_t size);
+
+// Binary records of Libs/Trace.h. They are queued like the text if the log is asynchronous.
+void SetTraceFile(const String& file_name);
+bool IsTraceFile();
+void WriteTrace(const void* data, uint32_t size);
+
+// Console and file output is queued to per-thread buffers and written by a separate thread. Flush() waits until the records
+// queued so far are written.
+void StartAsync(Overflow overflow);
+void Flush();
+
 bool   IsColoredPrintf();
 String RemoveColors(const String& str);
 
@@ -0,0 +1,31 @@
+#ifndef EMULATOR_INCLUDE_EMULATOR_SAMPLER_H_
+#define EMULATOR_INCLUDE_EMULATOR_SAMPLER_H_
+
+#include "Kyty/Core/Common.h"
+#include "Kyty/Core/String.h"
+
+#include "Emulator/Common.h"
+
+#ifdef KYTY_EMU_ENABLED
+
+namespace Kyty::Profiler {
+
+// Sampling profiler. Every Config::GetSamplerPeriod() microseconds the guest threads are interrupted and their instruction pointer
+// and the guest frames reachable by the frame pointer are recorded. Stacks are saved as folded stacks ("thread;frame;frame count",
+// the input of flamegraph.pl and speedscope) to Config::GetSamplerOutputFile() when the profiler is closed.
+//
+// Guest frames are found only while rbp holds a guest frame pointer. It is usually so inside HLE functions, the host code is built
+// without frame pointers and doesn't touch rbp.
+
+void SamplerInit();
+void SamplerSave();
+
+// Called by a guest thread when it starts and before it finishes
+void SamplerThreadStart(const String& name);
+void SamplerThreadStop();
+
+} // namespace Kyty::Profiler
+
+#endif // KYTY_EMU_ENABLED
+
+#endif /* EMULATOR_INCLUDE_EMULATOR_SAMPLER_H_ */
@@ -2,21 +2,262 @@
 
 #include "Kyty/Core/Common.h"
 #include "Kyty/Core/DbgAssert.h"
+#include "Kyty/Core/JobSystem.h"
 #include "Kyty/Core/MagicEnum.h"
 #include "Kyty/Core/String.h"
 #include "Kyty/Core/Threads.h"
 
+#include "Emulator/Config.h"
 #include "Emulator/Kernel/Pthread.h"
-#include "Emulator/Kernel/Semaphore.h"
 #include "Emulator/Libs/Errno.h"
 #include "Emulator/Libs/Libs.h"
+#include "Emulator/Loader/Timer.h"
 
+#include "SDL.h"
+#include "SDL_audio.h"
+#include "cpuinfo.h"
+
+#include <algorithm>
 #include <atomic>
+#include <cstring>
+#include <immintrin.h>
+#include <vector>
 
 #ifdef KYTY_EMU_ENABLED
 
+#if KYTY_COMPILER == KYTY_COMPILER_MSVC
+#define KYTY_AUDIO_AVX2
+#else
+#define KYTY_AUDIO_AVX2 __attribute__((target("avx2")))
+#endif
+
 namespace Kyty::Libs::Audio {
 
+// Adds frames of a port to the stereo float mix: L += sum(l[c] * s[c]), R += sum(r[c] * s[c]). The matrix holds the port volumes,
+// the downmix and the scale of 16-bit samples, so the samples are converted, mixed and added in one pass.
+struct AudioMixMatrix
+{
+	float l[8] = {};
+	float r[8] = {};
+};
+
+using AudioMixFunc = void (*)(float* dst, const void* src, uint32_t frames, const AudioMixMatrix& m);
+
+template <bool F>
+static const void* audio_offset(const void* src, uint32_t index)
+{
+	if constexpr (F)
+	{
+		return static_cast<const float*>(src) + index;
+	} else
+	{
+		return static_cast<const int16_t*>(src) + index;
+	}
+}
+
+template <bool F>
+static float audio_load1(const void* src, uint32_t index)
+{
+	if constexpr (F)
+	{
+		return static_cast<const float*>(src)[index];
+	} else
+	{
+		return static_cast<float>(static_cast<const int16_t*>(src)[index]);
+	}
+}
+
+template <bool F>
+static __m128 audio_load4(const void* src, uint32_t index)
+{
+	if constexpr (F)
+	{
+		return _mm_loadu_ps(static_cast<const float*>(src) + index);
+	} else
+	{
+		__m128i v = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(static_cast<const int16_t*>(src) + index));
+		return _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16));
+	}
+}
+
+template <bool F, int C>
+static void audio_mix_scalar(float* dst, const void* src, uint32_t frames, const AudioMixMatrix& m)
+{
+	for (uint32_t i = 0; i < frames; i++)
+	{
+		float l = 0.0f;
+		float r = 0.0f;
+		for (int c = 0; c < C; c++)
+		{
+			float s = audio_load1<F>(src, i * C + c);
+			l += m.l[c] * s;
+			r += m.r[c] * s;
+		}
+		dst[i * 2] += l;
+		dst[i * 2 + 1] += r;
+	}
+}
+
+template <bool F>
+static void audio_mix_mono(float* dst, const void* src, uint32_t frames, const AudioMixMatrix& m)
+{
+	__m128 g = _mm_setr_ps(m.l[0], m.r[0], m.l[0], m.r[0]);
+
+	uint32_t i = 0;
+	for (; i + 4 <= frames; i += 4)
+	{
+		__m128 s = audio_load4<F>(src, i);
+		_mm_storeu_ps(dst + i * 2, _mm_add_ps(_mm_loadu_ps(dst + i * 2), _mm_mul_ps(_mm_unpacklo_ps(s, s), g)));
+		_mm_storeu_ps(dst + i * 2 + 4, _mm_add_ps(_mm_loadu_ps(dst + i * 2 + 4), _mm_mul_ps(_mm_unpackhi_ps(s, s), g)));
+	}
+
+	audio_mix_scalar<F, 1>(dst + i * 2, audio_offset<F>(src, i), frames - i, m);
+}
+
+template <bool F>
+static void audio_mix_stereo(float* dst, const void* src, uint32_t frames, const AudioMixMatrix& m)
+{
+	__m128 gl = _mm_setr_ps(m.l[0], m.r[0], m.l[0], m.r[0]);
+	__m128 gr = _mm_setr_ps(m.l[1], m.r[1], m.l[1], m.r[1]);
+
+	uint32_t i = 0;
+	for (; i + 2 <= frames; i += 2)
+	{
+		__m128 s   = audio_load4<F>(src, i * 2);
+		__m128 sl  = _mm_shuffle_ps(s, s, _MM_SHUFFLE(2, 2, 0, 0));
+		__m128 sr  = _mm_shuffle_ps(s, s, _MM_SHUFFLE(3, 3, 1, 1));
+		__m128 out = _mm_add_ps(_mm_mul_ps(sl, gl), _mm_mul_ps(sr, gr));
+		_mm_storeu_ps(dst + i * 2, _mm_add_ps(_mm_loadu_ps(dst + i * 2), out));
+	}
+
+	audio_mix_scalar<F, 2>(dst + i * 2, audio_offset<F>(src, i * 2), frames - i, m);
+}
+
+// Returns [L R x x] of one 8-channel frame
+template <bool F>
+static __m128 audio_mix_frame_8ch(const void* src, uint32_t index, const __m128* g)
+{
+	__m128 s0 = audio_load4<F>(src, index);
+	__m128 s1 = audio_load4<F>(src, index + 4);
+	__m128 l  = _mm_add_ps(_mm_mul_ps(s0, g[0]), _mm_mul_ps(s1, g[1]));
+	__m128 r  = _mm_add_ps(_mm_mul_ps(s0, g[2]), _mm_mul_ps(s1, g[3]));
+	__m128 t  = _mm_add_ps(_mm_unpacklo_ps(l, r), _mm_unpackhi_ps(l, r));
+	return _mm_add_ps(t, _mm_movehl_ps(t, t));
+}
+
+template <bool F>
+static void audio_mix_8ch(float* dst, const void* src, uint32_t frames, const AudioMixMatrix& m)
+{
+	__m128 g[4] = {_mm_loadu_ps(m.l), _mm_loadu_ps(m.l + 4), _mm_loadu_ps(m.r), _mm_loadu_ps(m.r + 4)};
+
+	uint32_t i = 0;
+	for (; i + 2 <= frames; i += 2)
+	{
+		__m128 out = _mm_movelh_ps(audio_mix_frame_8ch<F>(src, i * 8, g), audio_mix_frame_8ch<F>(src, i * 8 + 8, g));
+		_mm_storeu_ps(dst + i * 2, _mm_add_ps(_mm_loadu_ps(dst + i * 2), out));
+	}
+
+	audio_mix_scalar<F, 8>(dst + i * 2, audio_offset<F>(src, i * 8), frames - i, m);
+}
+
+template <bool F>
+KYTY_AUDIO_AVX2 static __m256 audio_load8_avx2(const void* src, uint32_t index)
+{
+	if constexpr (F)
+	{
+		return _mm256_loadu_ps(static_cast<const float*>(src) + index);
+	} else
+	{
+		__m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(static_cast<const int16_t*>(src) + index));
+		return _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(v));
+	}
+}
+
+// Two frames per iteration, the horizontal adds leave [La Ra Lb Rb] in the two halves
+template <bool F>
+KYTY_AUDIO_AVX2 static void audio_mix_8ch_avx2(float* dst, const void* src, uint32_t frames, const AudioMixMatrix& m)
+{
+	__m256 gl = _mm256_loadu_ps(m.l);
+	__m256 gr = _mm256_loadu_ps(m.r);
+
+	uint32_t i = 0;
+	for (; i + 2 <= frames; i += 2)
+	{
+		__m256 sa  = audio_load8_avx2<F>(src, i * 8);
+		__m256 sb  = audio_load8_avx2<F>(src, i * 8 + 8);
+		__m256 ha  = _mm256_hadd_ps(_mm256_mul_ps(sa, gl), _mm256_mul_ps(sa, gr));
+		__m256 hb  = _mm256_hadd_ps(_mm256_mul_ps(sb, gl), _mm256_mul_ps(sb, gr));
+		__m256 h   = _mm256_hadd_ps(ha, hb);
+		__m128 out = _mm_add_ps(_mm256_castps256_ps128(h), _mm256_extractf128_ps(h, 1));
+		_mm_storeu_ps(dst + i * 2, _mm_add_ps(_mm_loadu_ps(dst + i * 2), out));
+	}
+
+	audio_mix_scalar<F, 8>(dst + i * 2, audio_offset<F>(src, i * 8), frames - i, m);
+}
+
+static AudioMixFunc audio_mix_func(int channels, bool is_float)
+{
+	switch (channels)
+	{
+		case 1: return (is_float ? audio_mix_mono<true> : audio_mix_mono<false>);
+		case 2: return (is_float ? audio_mix_stereo<true> : audio_mix_stereo<false>);
+		default:
+			if (cpuinfo_initialize() && cpuinfo_has_x86_avx2())
+			{
+				return (is_float ? audio_mix_8ch_avx2<true> : audio_mix_8ch_avx2<false>);
+			}
+			return (is_float ? audio_mix_8ch<true> : audio_mix_8ch<false>);
+	}
+}
+
+// Frames in the format of the port. Written by the guest thread of the port and read by the device callback, without locks.
+class AudioRing
+{
+public:
+	AudioRing(uint32_t frames, uint32_t frame_size)
+	    : m_frames(frames), m_frame_size(frame_size), m_buf(static_cast<size_t>(frames) * frame_size)
+	{
+	}
+
+	KYTY_CLASS_NO_COPY(AudioRing);
+
+	[[nodiscard]] uint32_t Free() const { return m_frames - static_cast<uint32_t>(m_write.load() - m_read.load()); }
+
+	void Write(const void* src, uint32_t frames)
+	{
+		uint64_t pos   = m_write.load(std::memory_order_relaxed);
+		auto     index = static_cast<uint32_t>(pos % m_frames);
+		uint32_t first = std::min(frames, m_frames - index);
+
+		memcpy(m_buf.data() + static_cast<size_t>(index) * m_frame_size, src, static_cast<size_t>(first) * m_frame_size);
+		memcpy(m_buf.data(), static_cast<const uint8_t*>(src) + static_cast<size_t>(first) * m_frame_size,
+		       static_cast<size_t>(frames - first) * m_frame_size);
+
+		m_write.store(pos + frames, std::memory_order_release);
+	}
+
+	// Missing frames are silent
+	void ReadMix(float* dst, uint32_t frames, AudioMixFunc func, const AudioMixMatrix& m)
+	{
+		uint64_t pos       = m_read.load(std::memory_order_relaxed);
+		auto     available = static_cast<uint32_t>(std::min(m_write.load(std::memory_order_acquire) - pos, static_cast<uint64_t>(frames)));
+		auto     index     = static_cast<uint32_t>(pos % m_frames);
+		uint32_t first     = std::min(available, m_frames - index);
+
+		func(dst, m_buf.data() + static_cast<size_t>(index) * m_frame_size, first, m);
+		func(dst + static_cast<size_t>(first) * 2, m_buf.data(), available - first, m);
+
+		m_read.store(pos + available, std::memory_order_release);
+	}
+
+private:
+	uint32_t             m_frames;
+	uint32_t             m_frame_size;
+	std::vector<uint8_t> m_buf;
+	std::atomic_uint64_t m_write = 0;
+	std::atomic_uint64_t m_read  = 0;
+};
+
 class Audio
 {
 public:
@@ -62,8 +303,8 @@ public:
 		const void* data = nullptr;
 	};
 
-	Audio()          = default;
-	virtual ~Audio() = default;
+	Audio() = default;
+	virtual ~Audio();
 
 	KYTY_CLASS_NO_COPY(Audio);
 
@@ -78,20 +319,24 @@ public:
 	bool     AudioInValid(Id handle);
 	uint32_t AudioInInput(Id handle, void* dest);
 
-	static constexpr int OUT_PORTS_MAX = 32;
-	static constexpr int IN_PORTS_MAX  = 8;
+	static constexpr int      OUT_PORTS_MAX = 32;
+	static constexpr int      IN_PORTS_MAX  = 8;
+	static constexpr uint32_t DEVICE_FREQ   = 48000;
 
 private:
 	struct PortOut
 	{
-		bool     used             = false;
-		int      type             = 0;
-		uint32_t samples_num      = 0;
-		uint32_t freq             = 0;
-		Format   format           = Format::Unknown;
-		uint64_t last_output_time = 0;
-		int      channels_num     = 0;
-		int      volume[8]        = {};
+		bool               used             = false;
+		int                type             = 0;
+		uint32_t           samples_num      = 0;
+		uint32_t           freq             = 0;
+		Format             format           = Format::Unknown;
+		uint64_t           last_output_time = 0;
+		int                channels_num     = 0;
+		int                volume[8]        = {};
+		AudioRing*         ring             = nullptr; // nullptr - the output is simulated
+		AudioMixFunc       mix_func         = nullptr;
+		AudioMixMatrix     mix;
 	};
 
 	struct PortIn
@@ -104,9 +349,21 @@ private:
 		uint64_t last_input_time = 0;
 	};
 
+	bool DeviceInit();
+	void DeviceOutput(PortOut* port, const void* data);
+	void UpdateMix(PortOut* port);
+
+	static void SDLCALL DeviceCallback(void* userdata, Uint8* stream, int len);
+
 	Core::Mutex m_mutex;
 	PortOut     m_out_ports[OUT_PORTS_MAX];
 	PortIn      m_in_ports[IN_PORTS_MAX];
+
+	// The callback signals m_device_cond after it has read the rings
+	SDL_AudioDeviceID m_device           = 0;
+	bool              m_device_init_done = false;
+	Core::Mutex       m_device_mutex;
+	Core::CondVar     m_device_cond;
 };
 
 static Audio* g_audio = nullptr;
@@ -122,10 +379,168 @@ KYTY_SUBSYSTEM_UNEXPECTED_SHUTDOWN(Audio) {}
 
 KYTY_SUBSYSTEM_DESTROY(Audio) {}
 
+Audio::~Audio()
+{
+	if (m_device != 0)
+	{
+		SDL_CloseAudioDevice(m_device);
+	}
+
+	for (auto& port: m_out_ports)
+	{
+		delete port.ring;
+	}
+}
+
+// Called with m_mutex held
+bool Audio::DeviceInit()
+{
+	if (!m_device_init_done)
+	{
+		m_device_init_done = true;
+
+		if (!Config::AudioOutputEnabled())
+		{
+			return false;
+		}
+
+		if (SDL_InitSubSystem(SDL_INIT_AUDIO) < 0)
+		{
+			printf(FG_BRIGHT_RED "Can't init audio: %s\n" FG_DEFAULT, SDL_GetError());
+			return false;
+		}
+
+		SDL_AudioSpec desired {};
+		SDL_AudioSpec obtained {};
+		desired.freq     = static_cast<int>(DEVICE_FREQ);
+		desired.format   = AUDIO_F32SYS;
+		desired.channels = 2;
+		desired.samples  = 256;
+		desired.callback = DeviceCallback;
+		desired.userdata = this;
+
+		m_device = SDL_OpenAudioDevice(nullptr, 0, &desired, &obtained, 0);
+
+		if (m_device == 0)
+		{
+			printf(FG_BRIGHT_RED "Can't open audio device: %s\n" FG_DEFAULT, SDL_GetError());
+			return false;
+		}
+
+		printf("Audio device: freq = %d, samples = %u\n", obtained.freq, static_cast<uint32_t>(obtained.samples));
+
+		SDL_PauseAudioDevice(m_device, 0);
+	}
+
+	return m_device != 0;
+}
+
+void SDLCALL Audio::DeviceCallback(void* userdata, Uint8* stream, int len)
+{
+	auto*    audio  = static_cast<Audio*>(userdata);
+	auto*    dst    = reinterpret_cast<float*>(stream);
+	uint32_t frames = static_cast<uint32_t>(len) / (sizeof(float) * 2);
+
+	std::fill(dst, dst + static_cast<size_t>(frames) * 2, 0.0f);
+
+	// Ports are opened and closed with the device locked
+	for (auto& port: audio->m_out_ports)
+	{
+		if (port.ring != nullptr)
+		{
+			port.ring->ReadMix(dst, frames, port.mix_func, port.mix);
+		}
+	}
+
+	for (uint32_t i = 0; i < frames * 2; i++)
+	{
+		dst[i] = std::clamp(dst[i], -1.0f, 1.0f);
+	}
+
+	Core::LockGuard lock(audio->m_device_mutex);
+	audio->m_device_cond.SignalAll();
+}
+
+static bool audio_is_float(Audio::Format format)
+{
+	return (format == Audio::Format::FloatMono || format == Audio::Format::FloatStereo || format == Audio::Format::Float8Ch ||
+	        format == Audio::Format::Float8ChStd);
+}
+
+// Blocks until the ring of the port has room for a block. A block is dropped if the device doesn't read the ring.
+void Audio::DeviceOutput(PortOut* port, const void* data)
+{
+	uint32_t frames  = port->samples_num;
+	uint32_t timeout = static_cast<uint32_t>((static_cast<uint64_t>(4000000) * frames) / DEVICE_FREQ);
+
+	{
+		Core::LockGuard lock(m_device_mutex);
+
+		while (port->ring->Free() < frames)
+		{
+			if (!m_device_cond.WaitFor(&m_device_mutex, timeout))
+			{
+				break;
+			}
+		}
+	}
+
+	if (data != nullptr && port->ring->Free() >= frames)
+	{
+		port->ring->Write(data, frames);
+	}
+}
+
+// Called with m_mutex held
+void Audio::UpdateMix(PortOut* port)
+{
+	// Downmix of FL FR C LFE SL SR BL BR, LFE is dropped
+	static constexpr float DOWNMIX_L[8] = {1.0f, 0.0f, 0.707f, 0.0f, 0.5f, 0.0f, 0.5f, 0.0f};
+	static constexpr float DOWNMIX_R[8] = {0.0f, 1.0f, 0.707f, 0.0f, 0.0f, 0.5f, 0.0f, 0.5f};
+
+	// Volumes are 0 - 32768
+	float scale  = (audio_is_float(port->format) ? 1.0f : 1.0f / 32768.0f) / 32768.0f;
+	bool  is_std = (port->format == Format::Signed16bit8ChStd || port->format == Format::Float8ChStd);
+
+	AudioMixMatrix m;
+
+	if (port->channels_num == 1)
+	{
+		m.l[0] = static_cast<float>(port->volume[0]) * scale;
+		m.r[0] = m.l[0];
+	} else if (port->channels_num == 2)
+	{
+		m.l[0] = static_cast<float>(port->volume[0]) * scale;
+		m.r[1] = static_cast<float>(port->volume[1]) * scale;
+	} else
+	{
+		for (int c = 0; c < 8; c++)
+		{
+			// The Std layout has the side and back pairs swapped
+			int src = (is_std && c >= 4 ? (c < 6 ? c + 2 : c - 2) : c);
+
+			m.l[src] = DOWNMIX_L[c] * static_cast<float>(port->volume[c]) * scale;
+			m.r[src] = DOWNMIX_R[c] * static_cast<float>(port->volume[c]) * scale;
+		}
+	}
+
+	if (port->ring != nullptr)
+	{
+		SDL_LockAudioDevice(m_device);
+		port->mix = m;
+		SDL_UnlockAudioDevice(m_device);
+	} else
+	{
+		port->mix = m;
+	}
+}
+
 Audio::Id Audio::AudioOutOpen(int type, uint32_t samples_num, uint32_t freq, Format format)
 {
 	Core::LockGuard lock(m_mutex);
 
+	bool device = DeviceInit();
+
 	for (int id = 0; id < OUT_PORTS_MAX; id++)
 	{
 		if (!m_out_ports[id].used)
@@ -157,6 +572,21 @@ Audio::Id Audio::AudioOutOpen(int type, uint32_t samples_num, uint32_t freq, For
 				port.volume[i] = 32768;
 			}
 
+			port.mix_func = audio_mix_func(port.channels_num, audio_is_float(format));
+			UpdateMix(&port);
+
+			if (device && freq == DEVICE_FREQ && samples_num != 0)
+			{
+				// At least two blocks, so that the guest writes one while the device reads the other
+				uint32_t latency    = (Config::GetAudioLatencyMs() * DEVICE_FREQ) / 1000;
+				uint32_t blocks     = std::max((latency + samples_num - 1) / samples_num, 2u);
+				uint32_t frame_size = port.channels_num * (audio_is_float(format) ? sizeof(float) : sizeof(int16_t));
+
+				SDL_LockAudioDevice(m_device);
+				port.ring = new AudioRing(blocks * samples_num, frame_size);
+				SDL_UnlockAudioDevice(m_device);
+			}
+
 			return Id::Create(id);
 		}
 	}
@@ -170,7 +600,17 @@ bool Audio::AudioOutClose(Id handle)
 
 	if (AudioOutValid(handle))
 	{
-		m_out_ports[handle.GetId()].used = false;
+		auto& port = m_out_ports[handle.GetId()];
+
+		if (port.ring != nullptr)
+		{
+			SDL_LockAudioDevice(m_device);
+			delete port.ring;
+			port.ring = nullptr;
+			SDL_UnlockAudioDevice(m_device);
+		}
+
+		port.used = false;
 		return true;
 	}
 
@@ -233,6 +673,8 @@ bool Audio::AudioOutSetVolume(Id handle, uint32_t bitflag, const int* volume)
 			}
 		}
 
+		UpdateMix(&port);
+
 		return true;
 	}
 
@@ -246,24 +688,46 @@ uint32_t Audio::AudioOutOutputs(OutputParam* params, uint32_t num)
 
 	const auto& first_port = m_out_ports[params[0].handle.GetId()];
 
-	uint64_t block_time   = (params->data != nullptr ? (1000000 * first_port.samples_num) / first_port.freq : 0);
-	uint64_t current_time = LibKernel::KernelGetProcessTime();
-
-	uint64_t max_wait_time = 0;
+	bool simulated = false;
 
 	for (uint32_t i = 0; i < num; i++)
 	{
-		uint64_t next_time = m_out_ports[params[i].handle.GetId()].last_output_time + block_time;
-		uint64_t wait_time = (next_time > current_time ? next_time - current_time : 0);
-		max_wait_time      = (wait_time > max_wait_time ? wait_time : max_wait_time);
-	}
+		auto& port = m_out_ports[params[i].handle.GetId()];
 
-	// TODO(): Audio output is not yet implemented, so simulate audio delay
-	Core::Thread::SleepMicro(max_wait_time);
+		if (port.ring != nullptr)
+		{
+			DeviceOutput(&port, params[i].data);
+		} else
+		{
+			simulated = true;
+		}
+	}
 
-	for (uint32_t i = 0; i < num; i++)
+	if (simulated)
 	{
-		m_out_ports[params[i].handle.GetId()].last_output_time = LibKernel::KernelGetProcessTime();
+		uint64_t block_time   = (params->data != nullptr ? (1000000 * first_port.samples_num) / first_port.freq : 0);
+		uint64_t current_time = LibKernel::KernelGetProcessTime();
+
+		uint64_t max_wait_time = 0;
+
+		for (uint32_t i = 0; i < num; i++)
+		{
+			const auto& port = m_out_ports[params[i].handle.GetId()];
+			if (port.ring == nullptr)
+			{
+				uint64_t next_time = port.last_output_time + block_time;
+				uint64_t wait_time = (next_time > current_time ? next_time - current_time : 0);
+				max_wait_time      = (wait_time > max_wait_time ? wait_time : max_wait_time);
+			}
+		}
+
+		// Without the host device the audio delay is simulated
+		Core::Thread::SleepMicro(max_wait_time);
+
+		for (uint32_t i = 0; i < num; i++)
+		{
+			m_out_ports[params[i].handle.GetId()].last_output_time = LibKernel::KernelGetProcessTime();
+		}
 	}
 
 	return first_port.samples_num;
@@ -609,45 +1073,468 @@ namespace Ajm {
 
 LIB_NAME("Ajm", "Ajm");
 
-int KYTY_SYSV_ABI AjmInitialize(int64_t reserved, uint32_t* context)
+constexpr uint32_t AJM_CODECS_MAX    = 16;
+constexpr uint32_t AJM_INSTANCES_MAX = 256;
+constexpr uint32_t AJM_BATCHES_MAX   = 64;
+constexpr uint32_t AJM_WAIT_INFINITE = 0xffffffff;
+
+enum class AjmJobType : uint32_t
 {
-	PRINT_NAME();
+	Control  = 1,
+	Run      = 2,
+	RunSplit = 3,
+};
 
-	EXIT_NOT_IMPLEMENTED(context == nullptr);
-	EXIT_NOT_IMPLEMENTED(reserved != 0);
+struct AjmBuffer
+{
+	void*  addr = nullptr;
+	size_t size = 0;
+};
 
-	*context = 1;
+struct AjmBatchError
+{
+	int         error_code     = 0;
+	const void* job_address    = nullptr;
+	uint32_t    command_offset = 0;
+	const void* job_ra         = nullptr;
+};
 
-	return OK;
-}
+struct AjmSidebandResult
+{
+	int32_t result          = 0;
+	int32_t internal_result = 0;
+};
 
-int KYTY_SYSV_ABI AjmModuleRegister(uint32_t context, uint32_t codec, int64_t reserved)
+struct AjmSidebandStream
 {
-	PRINT_NAME();
+	int32_t  input_consumed        = 0;
+	int32_t  output_written        = 0;
+	uint64_t total_decoded_samples = 0;
+};
 
-	EXIT_NOT_IMPLEMENTED(context != 1);
-	EXIT_NOT_IMPLEMENTED(reserved != 0);
+// Jobs are written to the batch buffer by the AjmBatchJob*() functions, so the layout is private. It is not larger than the space the
+// guest reserves for a job. A split job is followed by its input buffers, then its output buffers.
+struct AjmJob
+{
+	AjmJobType  type          = AjmJobType::Control;
+	uint32_t    instance      = 0;
+	uint64_t    flags         = 0;
+	const void* input         = nullptr;
+	void*       output        = nullptr;
+	void*       sideband      = nullptr;
+	uint32_t    input_size    = 0; // number of input buffers for a split job
+	uint32_t    output_size   = 0; // number of output buffers for a split job
+	uint32_t    sideband_size = 0;
+	uint32_t    reserved      = 0;
+};
 
-	printf("\t codec = %u\n", codec);
+struct AjmTask
+{
+	const AjmJob* job   = nullptr;
+	uint32_t      batch = 0;
+};
 
-	switch (codec)
+// The jobs of an instance run in order on one worker at a time, different instances run in parallel
+struct AjmInstance
+{
+	uint32_t        codec   = 0;
+	bool            used    = false;
+	bool            running = false;
+	Vector<AjmTask> queue;
+};
+
+struct AjmBatch
+{
+	uint32_t      jobs_left = 0;
+	bool          used      = false;
+	int           error     = OK;
+	const AjmJob* error_job = nullptr;
+};
+
+struct AjmContext
+{
+	Core::Mutex   mutex;
+	Core::CondVar batch_done;
+	bool          codecs[AJM_CODECS_MAX] = {};
+	AjmInstance   instances[AJM_INSTANCES_MAX];
+	AjmBatch      batches[AJM_BATCHES_MAX];
+};
+
+static AjmContext* g_ajm = nullptr;
+
+static size_t ajm_job_size(const AjmJob* job)
+{
+	return sizeof(AjmJob) +
+	       (job->type == AjmJobType::RunSplit ? (static_cast<size_t>(job->input_size) + job->output_size) * sizeof(AjmBuffer) : 0);
+}
+
+static AjmInstance* ajm_get_instance(uint32_t instance)
+{
+	if (instance == 0 || instance > AJM_INSTANCES_MAX || !g_ajm->instances[instance - 1].used)
 	{
-		case 1: printf("\t %s\n", "ATRAC9 decoder"); break;
-		case 2: printf("\t %s\n", "MPEG4-AAC decoder"); break;
-		case 0: printf("\t %s\n", "MP3 decoder"); break;
-		case 4: printf("\t %s\n", "CELP8 encoder"); break;
-		case 3: printf("\t %s\n", "CELP8 decoder"); break;
-		case 13: printf("\t %s\n", "CELP16 encoder"); break;
-		case 12: printf("\t %s\n", "CELP16 decoder"); break;
-		default: EXIT("unknown codec\n");
+		return nullptr;
 	}
-
-	return OK;
+	return &g_ajm->instances[instance - 1];
 }
 
-} // namespace Ajm
+// No codec is linked in. Control jobs succeed, a run job fails with AJM_ERROR_CODEC_NOT_SUPPORTED without consuming any input, so
+// the guest sees that nothing was decoded.
+static int ajm_job_run(const AjmJob* job)
+{
+	int ret = (job->type == AjmJobType::Control ? OK : AJM_ERROR_CODEC_NOT_SUPPORTED);
 
-namespace AvPlayer {
+	if (ret != OK)
+	{
+		printf(FG_BRIGHT_RED "AJM: codec %u is not supported, run job failed\n" FG_DEFAULT, g_ajm->instances[job->instance - 1].codec);
+	}
+
+	if (job->sideband != nullptr && job->sideband_size >= sizeof(AjmSidebandResult))
+	{
+		auto* result   = static_cast<AjmSidebandResult*>(job->sideband);
+		*result        = AjmSidebandResult();
+		result->result = ret;
+
+		if (job->type != AjmJobType::Control && job->sideband_size >= sizeof(AjmSidebandResult) + sizeof(AjmSidebandStream))
+		{
+			*reinterpret_cast<AjmSidebandStream*>(result + 1) = AjmSidebandStream();
+		}
+	}
+
+	return ret;
+}
+
+// Runs on the shared job pool, the jobs of one instance are decoded in order
+static void ajm_instance_run(AjmInstance* instance)
+{
+	Core::LockGuard lock(g_ajm->mutex);
+
+	while (!instance->queue.IsEmpty())
+	{
+		AjmTask task = instance->queue.At(0);
+		instance->queue.RemoveAt(0);
+
+		g_ajm->mutex.Unlock();
+		int result = ajm_job_run(task.job);
+		g_ajm->mutex.Lock();
+
+		auto& batch = g_ajm->batches[task.batch];
+		if (result != OK && batch.error == OK)
+		{
+			batch.error     = result;
+			batch.error_job = task.job;
+		}
+		if (--batch.jobs_left == 0)
+		{
+			g_ajm->batch_done.SignalAll();
+		}
+	}
+
+	instance->running = false;
+}
+
+static void* ajm_job_write(void* buffer, const AjmJob& job)
+{
+	EXIT_NOT_IMPLEMENTED(buffer == nullptr);
+
+	memcpy(buffer, &job, sizeof(AjmJob));
+
+	return static_cast<uint8_t*>(buffer) + sizeof(AjmJob);
+}
+
+int KYTY_SYSV_ABI AjmInitialize(int64_t reserved, uint32_t* context)
+{
+	PRINT_NAME();
+
+	EXIT_NOT_IMPLEMENTED(context == nullptr);
+	EXIT_NOT_IMPLEMENTED(reserved != 0);
+
+	if (g_ajm == nullptr)
+	{
+		g_ajm = new AjmContext;
+	}
+
+	*context = 1;
+
+	return OK;
+}
+
+int KYTY_SYSV_ABI AjmModuleRegister(uint32_t context, uint32_t codec, int64_t reserved)
+{
+	PRINT_NAME();
+
+	EXIT_NOT_IMPLEMENTED(context != 1);
+	EXIT_NOT_IMPLEMENTED(reserved != 0);
+	EXIT_NOT_IMPLEMENTED(g_ajm == nullptr);
+
+	printf("\t codec = %u\n", codec);
+
+	switch (codec)
+	{
+		case 1: printf("\t %s\n", "ATRAC9 decoder"); break;
+		case 2: printf("\t %s\n", "MPEG4-AAC decoder"); break;
+		case 0: printf("\t %s\n", "MP3 decoder"); break;
+		case 4: printf("\t %s\n", "CELP8 encoder"); break;
+		case 3: printf("\t %s\n", "CELP8 decoder"); break;
+		case 13: printf("\t %s\n", "CELP16 encoder"); break;
+		case 12: printf("\t %s\n", "CELP16 decoder"); break;
+		default: EXIT("unknown codec\n");
+	}
+
+	Core::LockGuard lock(g_ajm->mutex);
+
+	g_ajm->codecs[codec] = true;
+
+	return OK;
+}
+
+int KYTY_SYSV_ABI AjmInstanceCreate(uint32_t context, uint32_t codec, uint64_t flags, uint32_t* instance)
+{
+	PRINT_NAME();
+
+	EXIT_NOT_IMPLEMENTED(context != 1);
+	EXIT_NOT_IMPLEMENTED(g_ajm == nullptr);
+
+	printf("\t codec = %u\n", codec);
+	printf("\t flags = 0x%016" PRIx64 "\n", flags);
+
+	if (instance == nullptr)
+	{
+		return AJM_ERROR_INVALID_PARAMETER;
+	}
+
+	Core::LockGuard lock(g_ajm->mutex);
+
+	if (codec >= AJM_CODECS_MAX || !g_ajm->codecs[codec])
+	{
+		return AJM_ERROR_CODEC_NOT_REGISTERED;
+	}
+
+	for (uint32_t i = 0; i < AJM_INSTANCES_MAX; i++)
+	{
+		auto& inst = g_ajm->instances[i];
+		if (!inst.used)
+		{
+			inst.used  = true;
+			inst.codec = codec;
+			*instance  = i + 1;
+			return OK;
+		}
+	}
+
+	return AJM_ERROR_OUT_OF_RESOURCES;
+}
+
+int KYTY_SYSV_ABI AjmInstanceDestroy(uint32_t context, uint32_t instance)
+{
+	PRINT_NAME();
+
+	EXIT_NOT_IMPLEMENTED(context != 1);
+	EXIT_NOT_IMPLEMENTED(g_ajm == nullptr);
+
+	Core::LockGuard lock(g_ajm->mutex);
+
+	auto* inst = ajm_get_instance(instance);
+
+	if (inst == nullptr)
+	{
+		return AJM_ERROR_INVALID_INSTANCE;
+	}
+
+	EXIT_NOT_IMPLEMENTED(inst->running);
+
+	inst->used = false;
+
+	return OK;
+}
+
+void* KYTY_SYSV_ABI AjmBatchJobControlBufferRa(void* buffer, uint32_t instance, uint64_t flags, const void* sideband_input,
+                                               size_t sideband_input_size, void* sideband_output, size_t sideband_output_size,
+                                               void* /*return_address*/)
+{
+	PRINT_NAME();
+
+	AjmJob job;
+	job.type          = AjmJobType::Control;
+	job.instance      = instance;
+	job.flags         = flags;
+	job.input         = sideband_input;
+	job.input_size    = static_cast<uint32_t>(sideband_input_size);
+	job.sideband      = sideband_output;
+	job.sideband_size = static_cast<uint32_t>(sideband_output_size);
+
+	return ajm_job_write(buffer, job);
+}
+
+void* KYTY_SYSV_ABI AjmBatchJobRunBufferRa(void* buffer, uint32_t instance, uint64_t flags, const void* input, size_t input_size,
+                                           void* output, size_t output_size, void* sideband_output, size_t sideband_output_size,
+                                           void* /*return_address*/)
+{
+	PRINT_NAME();
+
+	AjmJob job;
+	job.type          = AjmJobType::Run;
+	job.instance      = instance;
+	job.flags         = flags;
+	job.input         = input;
+	job.input_size    = static_cast<uint32_t>(input_size);
+	job.output        = output;
+	job.output_size   = static_cast<uint32_t>(output_size);
+	job.sideband      = sideband_output;
+	job.sideband_size = static_cast<uint32_t>(sideband_output_size);
+
+	return ajm_job_write(buffer, job);
+}
+
+void* KYTY_SYSV_ABI AjmBatchJobRunSplitBufferRa(void* buffer, uint32_t instance, uint64_t flags, const AjmBuffer* inputs, size_t inputs_num,
+                                                const AjmBuffer* outputs, size_t outputs_num, void* sideband_output,
+                                                size_t sideband_output_size, void* /*return_address*/)
+{
+	PRINT_NAME();
+
+	EXIT_NOT_IMPLEMENTED(inputs_num != 0 && inputs == nullptr);
+	EXIT_NOT_IMPLEMENTED(outputs_num != 0 && outputs == nullptr);
+
+	AjmJob job;
+	job.type          = AjmJobType::RunSplit;
+	job.instance      = instance;
+	job.flags         = flags;
+	job.input_size    = static_cast<uint32_t>(inputs_num);
+	job.output_size   = static_cast<uint32_t>(outputs_num);
+	job.sideband      = sideband_output;
+	job.sideband_size = static_cast<uint32_t>(sideband_output_size);
+
+	// The guest may free the descriptors before the batch runs
+	auto* dst = static_cast<AjmBuffer*>(ajm_job_write(buffer, job));
+	for (size_t i = 0; i < inputs_num; i++)
+	{
+		*dst++ = inputs[i];
+	}
+	for (size_t i = 0; i < outputs_num; i++)
+	{
+		*dst++ = outputs[i];
+	}
+
+	return dst;
+}
+
+// The batch buffer must be valid until the batch is waited for. The jobs are queued to the pool, the call doesn't decode.
+int KYTY_SYSV_ABI AjmBatchStartBuffer(uint32_t context, const void* batch, size_t batch_size, int priority, AjmBatchError* error,
+                                      uint32_t* batch_id)
+{
+	PRINT_NAME();
+
+	EXIT_NOT_IMPLEMENTED(context != 1);
+	EXIT_NOT_IMPLEMENTED(g_ajm == nullptr);
+
+	printf("\t batch_size = %" PRIu64 "\n", static_cast<uint64_t>(batch_size));
+	printf("\t priority   = %d\n", priority);
+
+	if (batch == nullptr || batch_id == nullptr)
+	{
+		return AJM_ERROR_INVALID_PARAMETER;
+	}
+
+	Core::LockGuard lock(g_ajm->mutex);
+
+	uint32_t id = 0;
+	for (; id < AJM_BATCHES_MAX && g_ajm->batches[id].used; id++)
+	{
+	}
+	if (id >= AJM_BATCHES_MAX)
+	{
+		return AJM_ERROR_OUT_OF_RESOURCES;
+	}
+
+	Vector<AjmTask> tasks;
+
+	for (size_t offset = 0; offset < batch_size;)
+	{
+		const auto* job = reinterpret_cast<const AjmJob*>(static_cast<const uint8_t*>(batch) + offset);
+
+		if (batch_size - offset < sizeof(AjmJob) || batch_size - offset < ajm_job_size(job) || ajm_get_instance(job->instance) == nullptr)
+		{
+			if (error != nullptr)
+			{
+				error->error_code     = AJM_ERROR_MALFORMED_BATCH;
+				error->job_address    = job;
+				error->command_offset = static_cast<uint32_t>(offset);
+			}
+			return AJM_ERROR_MALFORMED_BATCH;
+		}
+
+		tasks.Add({job, id});
+		offset += ajm_job_size(job);
+	}
+
+	auto& b     = g_ajm->batches[id];
+	b.used      = true;
+	b.jobs_left = tasks.Size();
+	b.error     = OK;
+	b.error_job = nullptr;
+
+	for (const auto& task: tasks)
+	{
+		auto* instance = ajm_get_instance(task.job->instance);
+		instance->queue.Add(task);
+		if (!instance->running)
+		{
+			instance->running = true;
+			Core::JobSystem::Submit([instance]() { ajm_instance_run(instance); });
+		}
+	}
+
+	*batch_id = id;
+
+	return OK;
+}
+
+int KYTY_SYSV_ABI AjmBatchWait(uint32_t context, uint32_t batch_id, uint32_t timeout, AjmBatchError* error)
+{
+	PRINT_NAME();
+
+	EXIT_NOT_IMPLEMENTED(context != 1);
+	EXIT_NOT_IMPLEMENTED(g_ajm == nullptr);
+
+	Core::LockGuard lock(g_ajm->mutex);
+
+	if (batch_id >= AJM_BATCHES_MAX || !g_ajm->batches[batch_id].used)
+	{
+		return AJM_ERROR_INVALID_BATCH;
+	}
+
+	auto& batch = g_ajm->batches[batch_id];
+
+	// The timeout is in milliseconds
+	while (batch.jobs_left != 0 && timeout != 0)
+	{
+		if (timeout == AJM_WAIT_INFINITE)
+		{
+			g_ajm->batch_done.Wait(&g_ajm->mutex);
+		} else if (!g_ajm->batch_done.WaitFor(&g_ajm->mutex, std::min(timeout, 1000000u) * 1000))
+		{
+			break;
+		}
+	}
+
+	if (batch.jobs_left != 0)
+	{
+		return AJM_ERROR_BUSY;
+	}
+
+	batch.used = false;
+
+	if (batch.error != OK && error != nullptr)
+	{
+		error->error_code  = batch.error;
+		error->job_address = batch.error_job;
+	}
+
+	return batch.error;
+}
+
+} // namespace Ajm
+
+namespace AvPlayer {
 
 LIB_NAME("AvPlayer", "AvPlayer");
 
@@ -757,18 +1644,27 @@ struct AvPlayerFrameInfoEx
 	AvPlayerStreamDetailsEx details;
 };
 
+// Frames are decoded ahead on a background thread into a pool of textures allocated by the title, and handed out without copies. The
+// title owns the last returned frame until the next call, so the decoder runs at most AV_PLAYER_FRAMES - 1 frames ahead.
+constexpr uint32_t AV_PLAYER_FRAMES = 4;
+
 struct AvPlayerInternal
 {
 	String               filename;
 	bool                 loop = false;
 	AvPlayerMemAllocator mem;
 	Core::Mutex          mutex;
-	void*                fake_frame        = nullptr;
-	uint32_t             fake_width        = 0;
-	uint32_t             fake_height       = 0;
-	float                fake_frame_rate   = 0.0f;
-	uint32_t             fake_frame_num    = 0;
-	uint32_t             fake_obtained_num = 0;
+	Core::CondVar        frame_cond;
+	Core::Thread*        decoder                       = nullptr;
+	bool                 decoder_exit                  = false;
+	void*                frames[AV_PLAYER_FRAMES]      = {};
+	uint64_t             time_stamps[AV_PLAYER_FRAMES] = {};
+	uint32_t             decoded_num                   = 0;
+	uint32_t             obtained_num                  = 0;
+	uint32_t             fake_width                    = 0;
+	uint32_t             fake_height                   = 0;
+	float                fake_frame_rate               = 0.0f;
+	uint32_t             fake_frame_num                = 0;
 };
 
 static void rgb_to_yuv(float r, float g, float b, uint8_t* y, uint8_t* u, uint8_t* v)
@@ -781,6 +1677,7 @@ static void rgb_to_yuv(float r, float g, float b, uint8_t* y, uint8_t* u, uint8_
 	*v     = (vf < 0 ? 0 : (vf > 255 ? 255 : vf));
 }
 
+// NV12, the strips are filled a row at a time
 static void draw_fake_frame(uint32_t width, uint32_t height, void* data, float l)
 {
 	constexpr int STRIPS_NUM = 5;
@@ -803,26 +1700,59 @@ static void draw_fake_frame(uint32_t width, uint32_t height, void* data, float l
 	rgb_to_yuv(0, 0, 0, &color[3][0], &color[3][1], &color[3][2]);
 	rgb_to_yuv(l, l, l, &color[4][0], &color[4][1], &color[4][2]);
 
-	for (size_t y = 0; y < luma_strip_size; y++)
+	for (int si = 0; si < STRIPS_NUM; si++)
 	{
-		for (size_t x = 0; x < luma_width; x++)
+		memset(luma + luma_strip_size * si * luma_width, color[si][0], luma_strip_size * luma_width);
+
+		auto* row = chroma + chroma_strip_size * si * chroma_width * 2;
+		for (size_t x = 0; x < chroma_width; x++)
 		{
-			for (int si = 0; si < STRIPS_NUM; si++)
-			{
-				luma[(y + luma_strip_size * si) * luma_width + x] = color[si][0];
-			}
+			row[x * 2 + 0] = color[si][1];
+			row[x * 2 + 1] = color[si][2];
+		}
+		for (size_t y = 1; y < chroma_strip_size; y++)
+		{
+			memcpy(row + y * chroma_width * 2, row, chroma_width * 2);
 		}
 	}
-	for (size_t y = 0; y < chroma_strip_size; y++)
+}
+
+static void fake_video_decode(void* arg)
+{
+	auto* r = static_cast<AvPlayerInternal*>(arg);
+
+	Core::LockGuard lock(r->mutex);
+
+	while (!r->decoder_exit && r->decoded_num < r->fake_frame_num)
 	{
-		for (size_t x = 0; x < chroma_width; x++)
+		// The slot of the frame held by the title is not reused
+		if (r->decoded_num + 1 >= r->obtained_num + AV_PLAYER_FRAMES)
 		{
-			for (int si = 0; si < STRIPS_NUM; si++)
-			{
-				chroma[(y + chroma_strip_size * si) * chroma_width * 2 + x * 2 + 0] = color[si][1];
-				chroma[(y + chroma_strip_size * si) * chroma_width * 2 + x * 2 + 1] = color[si][2];
-			}
+			r->frame_cond.Wait(&r->mutex);
+			continue;
+		}
+
+		uint32_t index = r->decoded_num;
+		uint32_t slot  = index % AV_PLAYER_FRAMES;
+
+		float pos   = static_cast<float>(index) / static_cast<float>(r->fake_frame_num);
+		float level = 1.0f;
+
+		if (pos < 0.2f)
+		{
+			level = pos * pos * ((1.0f / 0.2f) * (1.0f / 0.2f));
+		} else if (pos > 0.5f)
+		{
+			level = 1.0f - (1.0f - pos * (1.0f / 0.5f)) * (1.0f - pos * (1.0f / 0.5f));
 		}
+
+		r->mutex.Unlock();
+		draw_fake_frame(r->fake_width, r->fake_height, r->frames[slot], level * 0.7f);
+		r->mutex.Lock();
+
+		r->time_stamps[slot] = static_cast<uint64_t>(1000.0f * (static_cast<float>(index) / r->fake_frame_rate));
+		r->decoded_num++;
+		r->frame_cond.SignalAll();
 	}
 }
 
@@ -833,33 +1763,57 @@ static void create_fake_video(AvPlayerInternal* r)
 	uint32_t chroma_width  = luma_width / 2;
 	uint32_t chroma_height = luma_height / 2;
 	uint32_t size          = luma_width * luma_height + chroma_width * chroma_height * 2;
-	auto*    buffer        = static_cast<uint8_t*>(r->mem.allocate_texture(r->mem.object_pointer, 256, size));
 
-	r->fake_frame        = buffer;
-	r->fake_width        = luma_width;
-	r->fake_height       = luma_height;
-	r->fake_frame_rate   = 59.94f;
-	r->fake_frame_num    = 90;
-	r->fake_obtained_num = 0;
+	for (auto& frame: r->frames)
+	{
+		frame = r->mem.allocate_texture(r->mem.object_pointer, 256, size);
+	}
+
+	r->fake_width      = luma_width;
+	r->fake_height     = luma_height;
+	r->fake_frame_rate = 59.94f;
+	r->fake_frame_num  = 90;
+	r->decoded_num     = 0;
+	r->obtained_num    = 0;
+	r->decoder_exit    = false;
+	r->decoder         = new Core::Thread(fake_video_decode, r);
 }
 
 static void delete_fake_video(AvPlayerInternal* r)
 {
-	r->mem.deallocate_texture(r->mem.object_pointer, r->fake_frame);
-	r->fake_frame        = nullptr;
-	r->fake_width        = 0;
-	r->fake_height       = 0;
-	r->fake_frame_rate   = 0.0f;
-	r->fake_frame_num    = 0;
-	r->fake_obtained_num = 0;
+	{
+		Core::LockGuard lock(r->mutex);
+		r->decoder_exit = true;
+		r->frame_cond.SignalAll();
+	}
+
+	r->decoder->Join();
+	delete r->decoder;
+	r->decoder = nullptr;
+
+	for (auto& frame: r->frames)
+	{
+		r->mem.deallocate_texture(r->mem.object_pointer, frame);
+		frame = nullptr;
+	}
+
+	r->fake_width      = 0;
+	r->fake_height     = 0;
+	r->fake_frame_rate = 0.0f;
+	r->fake_frame_num  = 0;
+	r->decoded_num     = 0;
+	r->obtained_num    = 0;
 }
 
+// Doesn't wait for the decoder, the title polls again on the next frame
 static bool get_fake_video(AvPlayerInternal* r, AvPlayerFrameInfoEx* info)
 {
-	if (r->fake_obtained_num < r->fake_frame_num)
+	if (r->obtained_num < r->decoded_num)
 	{
-		info->data       = r->fake_frame;
-		info->time_stamp = static_cast<uint64_t>(1000.0f * (static_cast<float>(r->fake_obtained_num) / r->fake_frame_rate));
+		uint32_t slot = r->obtained_num % AV_PLAYER_FRAMES;
+
+		info->data       = r->frames[slot];
+		info->time_stamp = r->time_stamps[slot];
 
 		info->details.video.width                 = r->fake_width;
 		info->details.video.height                = r->fake_height;
@@ -878,20 +1832,8 @@ static bool get_fake_video(AvPlayerInternal* r, AvPlayerFrameInfoEx* info)
 		info->details.video.chroma_bit_depth      = 8;
 		info->details.video.video_full_tange_flag = 0;
 
-		float pos   = static_cast<float>(r->fake_obtained_num) / static_cast<float>(r->fake_frame_num);
-		float level = 1.0f;
-
-		if (pos < 0.2f)
-		{
-			level = pos * pos * ((1.0f / 0.2f) * (1.0f / 0.2f));
-		} else if (pos > 0.5f)
-		{
-			level = 1.0f - (1.0f - pos * (1.0f / 0.5f)) * (1.0f - pos * (1.0f / 0.5f));
-		}
-
-		draw_fake_frame(r->fake_width, r->fake_height, r->fake_frame, level * 0.7f);
-
-		r->fake_obtained_num++;
+		r->obtained_num++;
+		r->frame_cond.SignalAll();
 		return true;
 	}
 	return false;
@@ -899,7 +1841,7 @@ static bool get_fake_video(AvPlayerInternal* r, AvPlayerFrameInfoEx* info)
 
 static bool fake_is_playing(AvPlayerInternal* r)
 {
-	return r->fake_obtained_num < r->fake_frame_num;
+	return r->obtained_num < r->fake_frame_num;
 }
 
 AvPlayerInternal* KYTY_SYSV_ABI AvPlayerInit(AvPlayerInitData* init)
@@ -1047,8 +1989,6 @@ namespace Audio3d {
 
 LIB_NAME("Audio3d", "Audio3d");
 
-namespace Semaphore = LibKernel::Semaphore;
-
 struct Audio3dOpenParameters
 {
 	size_t   size        = 0x20;
@@ -1061,82 +2001,107 @@ struct Audio3dOpenParameters
 	// uint32_t num_beds;
 };
 
-struct Audio3dData
-{
-	enum class State
-	{
-		Empty,
-		Ready,
-		Play
-	};
-
-	std::atomic<State> state = State::Empty;
-};
-
+// The queue is a ring of queue_depth buffers described by three counters. The guest fills buffers in [played, advanced), pushes them
+// to [played, pushed), and the scheduler plays them by incrementing 'played'.
 struct Audio3dInternal
 {
-	Audio3dData*          data                        = nullptr;
-	Core::Mutex*          data_mutex                  = nullptr;
+	std::atomic_uint32_t  advanced                    = 0;
+	std::atomic_uint32_t  pushed                      = 0;
+	std::atomic_uint32_t  played                      = 0;
 	uint64_t              data_delay                  = 0;
-	Semaphore::KernelSema playback_sema               = nullptr;
+	uint64_t              play_end                    = 0; // scheduler-owned, 0 - idle
 	Audio3dOpenParameters params                      = {};
 	int                   user_id                     = 0;
 	float                 late_reverb_level           = 0.0f;
 	float                 downmix_spread_radius       = 2.0f;
 	int                   downmix_spread_height_aware = 0;
-	uint32_t              data_index                  = 0;
-	bool                  used                        = false;
-	std::atomic_bool      playback_finished           = false;
+	std::atomic_bool      used                        = false;
 };
 
 constexpr uint32_t MAX_PORTS = 4;
 
 static Audio3dInternal g_ports[MAX_PORTS] = {};
 
-static void playback_simulate(void* arg)
+// One thread plays the buffers of all ports on the audio clock
+struct Audio3dScheduler
+{
+	Core::Mutex          mutex;
+	Core::CondVar        push_cond;
+	Core::CondVar        played_cond;
+	std::atomic_uint64_t push_num = 0;
+	bool                 started  = false;
+};
+
+static Audio3dScheduler* g_scheduler = nullptr;
+
+static void playback_schedule(void* /*arg*/)
 {
-	auto* port = static_cast<Audio3dInternal*>(arg);
-	EXIT_IF(port == nullptr);
-	EXIT_IF(port->data_mutex == nullptr);
-	EXIT_IF(port->data == nullptr);
+	SDL_SetThreadPriority(SDL_THREAD_PRIORITY_HIGH);
 
 	for (;;)
 	{
-		int result = Semaphore::KernelWaitSema(port->playback_sema, 1, nullptr);
+		uint64_t push_num = g_scheduler->push_num.load(std::memory_order_acquire);
+		uint64_t now      = Loader::Timer::GetTimeUs();
+		uint64_t next     = UINT64_MAX;
+		bool     done     = false;
 
-		if (result != OK)
+		for (auto& port: g_ports)
 		{
-			break;
-		}
+			if (!port.used.load(std::memory_order_acquire))
+			{
+				continue;
+			}
 
-		Audio3dData* play_data = nullptr;
+			if (port.play_end != 0 && now >= port.play_end)
+			{
+				port.played.fetch_add(1, std::memory_order_release);
+				done = true;
 
-		port->data_mutex->Lock();
-		{
-			for (uint32_t i = 0; i < port->params.queue_depth; i++)
-			{
-				uint32_t index = (port->data_index + i) % port->params.queue_depth;
-
-				if (port->data[index].state == Audio3dData::State::Play)
+				// Keep the clock of a continuous stream, unless the scheduler is late by a buffer
+				port.play_end = (now - port.play_end < port.data_delay ? port.play_end : now);
+				if (port.played.load(std::memory_order_relaxed) == port.pushed.load(std::memory_order_acquire))
 				{
-					play_data = &port->data[index];
-					break;
+					port.play_end = 0;
+				} else
+				{
+					port.play_end += port.data_delay;
 				}
+			} else if (port.play_end == 0 && port.played.load(std::memory_order_relaxed) != port.pushed.load(std::memory_order_acquire))
+			{
+				port.play_end = now + port.data_delay;
+			}
+
+			if (port.play_end != 0)
+			{
+				next = std::min(next, port.play_end);
 			}
 		}
-		port->data_mutex->Unlock();
 
-		EXIT_IF(play_data == nullptr);
+		Core::LockGuard lock(g_scheduler->mutex);
 
-		if (play_data != nullptr)
+		if (done)
 		{
-			// TODO(): Audio output is not yet implemented, so simulate audio delay
-			Core::Thread::SleepMicro(port->data_delay);
-			play_data->state = Audio3dData::State::Empty;
+			g_scheduler->played_cond.SignalAll();
 		}
-	}
 
-	port->playback_finished = true;
+		// A push after the scan is not waited for
+		if (push_num != g_scheduler->push_num.load(std::memory_order_relaxed))
+		{
+			continue;
+		}
+
+		if (next == UINT64_MAX)
+		{
+			g_scheduler->push_cond.WaitFor(&g_scheduler->mutex, 100000);
+		} else
+		{
+			now = Loader::Timer::GetTimeUs();
+			if (next > now)
+			{
+				g_scheduler->push_cond.WaitFor(&g_scheduler->mutex, static_cast<uint32_t>(next - now));
+			}
+		}
+	}
 }
 
 int KYTY_SYSV_ABI Audio3dInitialize(int64_t reserved)
@@ -1186,31 +2151,30 @@ int KYTY_SYSV_ABI Audio3dPortOpen(int user_id, const Audio3dOpenParameters* para
 
 	EXIT_NOT_IMPLEMENTED(port >= MAX_PORTS);
 
-	g_ports[port].user_id = user_id;
-	g_ports[port].params  = *parameters;
-	g_ports[port].used    = true;
-
-	EXIT_IF(g_ports[port].data != nullptr);
-	EXIT_IF(g_ports[port].data_mutex != nullptr);
-	EXIT_IF(g_ports[port].playback_sema != nullptr);
-
-	g_ports[port].data       = new Audio3dData[parameters->queue_depth];
-	g_ports[port].data_index = 0;
-	g_ports[port].data_mutex = new Core::Mutex;
+	g_ports[port].user_id    = user_id;
+	g_ports[port].params     = *parameters;
+	g_ports[port].advanced   = 0;
+	g_ports[port].pushed     = 0;
+	g_ports[port].played     = 0;
+	g_ports[port].play_end   = 0;
 	g_ports[port].data_delay = (1000000 * static_cast<uint64_t>(parameters->granularity)) / 48000;
+	g_ports[port].used.store(true, std::memory_order_release);
 
-	for (uint32_t d = 0; d < parameters->queue_depth; d++)
+	if (g_scheduler == nullptr)
 	{
-		g_ports[port].data[d].state = Audio3dData::State::Empty;
+		g_scheduler = new Audio3dScheduler;
 	}
 
-	int result = Semaphore::KernelCreateSema(&g_ports[port].playback_sema, "audio3d_play", 0x01, 0,
-	                                         static_cast<int>(parameters->queue_depth), nullptr);
-	EXIT_NOT_IMPLEMENTED(result != OK);
+	{
+		Core::LockGuard lock(g_scheduler->mutex);
 
-	g_ports[port].playback_finished = false;
-	Core::Thread playback_thread(playback_simulate, &g_ports[port]);
-	playback_thread.Detach();
+		if (!g_scheduler->started)
+		{
+			Core::Thread playback_thread(playback_schedule, nullptr);
+			playback_thread.Detach();
+			g_scheduler->started = true;
+		}
+	}
 
 	*id = port;
 
@@ -1260,24 +2224,8 @@ int KYTY_SYSV_ABI Audio3dPortGetQueueLevel(uint32_t port_id, uint32_t* queue_lev
 
 	auto* port = &g_ports[port_id];
 
-	uint32_t empty_num = 0;
-
-	port->data_mutex->Lock();
-	{
-		for (uint32_t i = 0; i < port->params.queue_depth; i++)
-		{
-			uint32_t index = (port->data_index + i) % port->params.queue_depth;
-
-			if (port->data[index].state == Audio3dData::State::Empty)
-			{
-				empty_num++;
-			} else
-			{
-				break;
-			}
-		}
-	}
-	port->data_mutex->Unlock();
+	uint32_t empty_num = port->params.queue_depth - (port->advanced.load(std::memory_order_relaxed) -
+	                                                 port->played.load(std::memory_order_acquire));
 
 	EXIT_IF(empty_num > port->params.queue_depth);
 
@@ -1304,23 +2252,13 @@ int KYTY_SYSV_ABI Audio3dPortAdvance(uint32_t port_id)
 
 	auto* port = &g_ports[port_id];
 
-	port->data_mutex->Lock();
-	{
-		uint32_t current_index = port->data_index;
-		uint32_t next_index    = (current_index + 1) % port->params.queue_depth;
-
-		if (port->data[current_index].state == Audio3dData::State::Empty)
-		{
-			port->data[current_index].state = Audio3dData::State::Ready;
-		}
+	uint32_t advanced = port->advanced.load(std::memory_order_relaxed);
 
-		EXIT_NOT_IMPLEMENTED(port->data[current_index].state != Audio3dData::State::Ready);
+	EXIT_NOT_IMPLEMENTED(advanced - port->played.load(std::memory_order_acquire) >= port->params.queue_depth);
 
-		port->data_index = next_index;
+	port->advanced.store(advanced + 1, std::memory_order_release);
 
-		printf("\t %u -> %u\n", current_index, next_index);
-	}
-	port->data_mutex->Unlock();
+	printf("\t %u -> %u\n", advanced % port->params.queue_depth, (advanced + 1) % port->params.queue_depth);
 
 	return OK;
 }
@@ -1338,39 +2276,22 @@ int KYTY_SYSV_ABI Audio3dPortPush(uint32_t port_id, uint32_t blocking)
 
 	printf("\t blocking = %u\n", blocking);
 
-	int          data_num   = 0;
-	Audio3dData* first_data = nullptr;
-
-	port->data_mutex->Lock();
-	{
-		first_data = port->data + port->data_index;
+	uint32_t advanced = port->advanced.load(std::memory_order_relaxed);
+	uint32_t data_num = advanced - port->pushed.exchange(advanced, std::memory_order_acq_rel);
 
-		for (uint32_t i = 0; i < port->params.queue_depth; i++)
-		{
-			uint32_t index = (port->data_index + i) % port->params.queue_depth;
-
-			if (port->data[index].state == Audio3dData::State::Ready)
-			{
-				port->data[index].state = Audio3dData::State::Play;
-				data_num++;
-			}
-		}
-	}
-	port->data_mutex->Unlock();
-
-	printf("\t push num = %d\n", data_num);
+	printf("\t push num = %u\n", data_num);
 
 	if (data_num > 0)
 	{
-		Semaphore::KernelSignalSema(port->playback_sema, data_num);
+		Core::LockGuard lock(g_scheduler->mutex);
+
+		g_scheduler->push_num++;
+		g_scheduler->push_cond.Signal();
 
-		if (blocking == 1)
+		// Blocks until the next buffer to fill is free
+		while (advanced - port->played.load(std::memory_order_acquire) >= port->params.queue_depth)
 		{
-			auto wait_time = port->data_delay / 8;
-			while (first_data->state != Audio3dData::State::Empty)
-			{
-				Core::Thread::SleepMicro(wait_time);
-			}
+			g_scheduler->played_cond.Wait(&g_scheduler->mutex);
 		}
 	}
 
@@ -1515,12 +2436,52 @@ struct Ngs2BufferAllocator
 	uintptr_t              user_data     = 0;
 };
 
+struct Ngs2RenderBufferInfo
+{
+	void*    buffer        = nullptr;
+	size_t   buffer_size   = 0;
+	uint32_t waveform_type = 0;
+	uint32_t num_channels  = 0;
+};
+
+struct Ngs2WaveformFormat
+{
+	uint32_t waveform_type = 0;
+	uint32_t num_channels  = 0;
+	uint32_t sample_rate   = 0;
+	uint32_t config_data   = 0;
+	uint32_t frame_offset  = 0;
+	uint32_t frame_margin  = 0;
+};
+
+struct Ngs2WaveformBlock
+{
+	uint32_t  data_offset      = 0;
+	uint32_t  data_size        = 0;
+	uint32_t  num_repeats      = 0;
+	uint32_t  num_skip_samples = 0;
+	uint32_t  num_samples      = 0;
+	uint32_t  reserved         = 0;
+	uintptr_t user_data        = 0;
+};
+
+constexpr uint32_t NGS2_WAVEFORM_TYPE_PCM_I16L = 0x12;
+constexpr uint32_t NGS2_WAVEFORM_TYPE_PCM_F32L = 0x18;
+
+constexpr uint32_t NGS2_MAX_WAVEFORM_BLOCKS = 8;
+constexpr uint32_t NGS2_DEFAULT_GRAIN       = 256;
+constexpr uint32_t NGS2_DEFAULT_RATE        = 48000;
+
+// Sampler voices are rendered on the pool in batches of this size when there is more than one batch
+constexpr uint32_t NGS2_VOICES_PER_JOB = 32;
+
 struct Ngs2Internal
 {
 	Ngs2SystemOption    option;
 	Ngs2BufferAllocator allocator;
 	Ngs2Internal*       next = nullptr;
 	Core::Mutex         mutex;
+	float*              mix  = nullptr; // stereo mastering mix, host memory
 };
 
 enum class Ngs2RackType
@@ -1560,11 +2521,35 @@ enum class Ngs2VoicePlayEvent
 	Kill
 };
 
+using Ngs2ResampleFunc = void (*)(float* dst, const void* src, uint32_t src_frames, uint64_t pos, uint64_t step, uint32_t frames,
+                                   const AudioMixMatrix& m);
+
+// Every voice renders a grain of stereo frames into 'buffer'. Sampler voices play their waveform blocks there, submixer and mastering
+// voices sum the voices patched to them.
 struct Ngs2VoiceInternal
 {
-	Ngs2VoicePlayEvent event = Ngs2VoicePlayEvent::None;
-	Ngs2VoicePlayState state = Ngs2VoicePlayState::Empty;
-	Ngs2RackInternal*  rack  = nullptr;
+	Ngs2VoicePlayEvent event  = Ngs2VoicePlayEvent::None;
+	Ngs2VoicePlayState state  = Ngs2VoicePlayState::Empty;
+	Ngs2RackInternal*  rack   = nullptr;
+	Ngs2VoiceInternal* dest   = nullptr;
+	float*             buffer = nullptr; // host memory
+	float              volume = 1.0f;
+	float              gain   = 0.0f; // envelope at the end of the last grain
+
+	// Sampler
+	const uint8_t*     waveform                         = nullptr;
+	Ngs2WaveformFormat format                           = {};
+	Ngs2WaveformBlock  blocks[NGS2_MAX_WAVEFORM_BLOCKS] = {};
+	uint32_t           blocks_num                       = 0;
+	uint32_t           block_index                      = 0;
+	uint32_t           block_repeat                     = 0;
+	uint64_t           position                         = 0; // 32.32 frames in the block
+	uint64_t           decoded                          = 0;
+	float              pitch                            = 1.0f;
+	uint32_t           frame_size                       = 0;
+	AudioMixFunc       mix_func                         = nullptr; // nullptr - unsupported waveform
+	Ngs2ResampleFunc   resample_func                    = nullptr;
+	AudioMixMatrix     matrix;
 };
 
 struct Ngs2VoiceParamHeader
@@ -1588,6 +2573,35 @@ struct Ngs2VoicePatchParam
 	uintptr_t            dest_handle;
 };
 
+struct Ngs2VoicePortVolumeParam
+{
+	Ngs2VoiceParamHeader header;
+	uint32_t             port;
+	float                level;
+};
+
+struct Ngs2SamplerVoiceSetupParam
+{
+	Ngs2VoiceParamHeader header;
+	Ngs2WaveformFormat   format;
+	uint32_t             flags;
+};
+
+struct Ngs2SamplerVoiceWaveformBlocksParam
+{
+	Ngs2VoiceParamHeader     header;
+	const void*              data;
+	uint32_t                 flags;
+	uint32_t                 num_blocks;
+	const Ngs2WaveformBlock* blocks;
+};
+
+struct Ngs2SamplerVoicePitchParam
+{
+	Ngs2VoiceParamHeader header;
+	float                ratio;
+};
+
 struct Ngs2VoicePortMatrixParam
 {
 	Ngs2VoiceParamHeader header;
@@ -1615,6 +2629,431 @@ struct Ngs2SamplerVoiceState
 static Ngs2Internal*     g_ngs_list   = nullptr;
 static Ngs2RackInternal* g_racks_list = nullptr;
 
+static uint32_t ngs2_grain(const Ngs2Internal* ngs)
+{
+	return std::max({ngs->option.max_grain_samples, ngs->option.num_grain_samples, NGS2_DEFAULT_GRAIN});
+}
+
+static uint32_t ngs2_rate(const Ngs2Internal* ngs)
+{
+	return (ngs->option.sample_rate != 0 ? ngs->option.sample_rate : NGS2_DEFAULT_RATE);
+}
+
+static Ngs2VoiceInternal* ngs2_rack_voices(Ngs2RackInternal* rack)
+{
+	return reinterpret_cast<Ngs2VoiceInternal*>(rack + 1);
+}
+
+static float* ngs2_voice_buffer(Ngs2VoiceInternal* voice)
+{
+	if (voice->buffer == nullptr)
+	{
+		voice->buffer = new float[static_cast<size_t>(ngs2_grain(voice->rack->ngs)) * 2];
+	}
+	return voice->buffer;
+}
+
+// Linear interpolation of frames at the 32.32 positions pos, pos + step, ... of a mono or stereo waveform, four output samples per
+// iteration. The last frame of the block is repeated as the second point.
+template <bool F, int C>
+static void ngs2_resample(float* dst, const void* src, uint32_t src_frames, uint64_t pos, uint64_t step, uint32_t frames,
+                          const AudioMixMatrix& m)
+{
+	static_assert(C == 1 || C == 2);
+
+	constexpr uint32_t N = 4 / C;
+
+	__m128 gl = _mm_setr_ps(m.l[0], m.r[0], m.l[0], m.r[0]);
+	__m128 gr = (C == 1 ? _mm_setzero_ps() : _mm_setr_ps(m.l[1], m.r[1], m.l[1], m.r[1]));
+
+	float a[4];
+	float b[4];
+	float f[4];
+
+	uint32_t i = 0;
+	for (; i + N <= frames; i += N)
+	{
+		for (uint32_t k = 0; k < N; k++, pos += step)
+		{
+			auto index = static_cast<uint32_t>(pos >> 32u);
+			auto next  = std::min(index + 1, src_frames - 1);
+			auto frac  = static_cast<float>(static_cast<uint32_t>(pos) >> 8u) * (1.0f / 16777216.0f);
+			for (int c = 0; c < C; c++)
+			{
+				a[k * C + c] = audio_load1<F>(src, index * C + c);
+				b[k * C + c] = audio_load1<F>(src, next * C + c);
+				f[k * C + c] = frac;
+			}
+		}
+
+		__m128 va = _mm_loadu_ps(a);
+		__m128 v  = _mm_add_ps(va, _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(b), va), _mm_loadu_ps(f)));
+
+		if constexpr (C == 1)
+		{
+			_mm_storeu_ps(dst + i * 2, _mm_add_ps(_mm_loadu_ps(dst + i * 2), _mm_mul_ps(_mm_unpacklo_ps(v, v), gl)));
+			_mm_storeu_ps(dst + i * 2 + 4, _mm_add_ps(_mm_loadu_ps(dst + i * 2 + 4), _mm_mul_ps(_mm_unpackhi_ps(v, v), gl)));
+		} else
+		{
+			__m128 sl  = _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 2, 0, 0));
+			__m128 sr  = _mm_shuffle_ps(v, v, _MM_SHUFFLE(3, 3, 1, 1));
+			__m128 out = _mm_add_ps(_mm_mul_ps(sl, gl), _mm_mul_ps(sr, gr));
+			_mm_storeu_ps(dst + i * 2, _mm_add_ps(_mm_loadu_ps(dst + i * 2), out));
+		}
+	}
+
+	for (; i < frames; i++, pos += step)
+	{
+		auto index = static_cast<uint32_t>(pos >> 32u);
+		auto next  = std::min(index + 1, src_frames - 1);
+		auto frac  = static_cast<float>(static_cast<uint32_t>(pos) >> 8u) * (1.0f / 16777216.0f);
+		for (int c = 0; c < C; c++)
+		{
+			float sa = audio_load1<F>(src, index * C + c);
+			float sb = audio_load1<F>(src, next * C + c);
+			float s  = sa + (sb - sa) * frac;
+			dst[i * 2] += m.l[c] * s;
+			dst[i * 2 + 1] += m.r[c] * s;
+		}
+	}
+}
+
+// Multiplies stereo frames by a gain going linearly from 'from' to 'to'
+static void ngs2_ramp(float* buf, uint32_t frames, float from, float to)
+{
+	if (frames == 0 || (from == to && from == 1.0f))
+	{
+		return;
+	}
+
+	float  step = (to - from) / static_cast<float>(frames);
+	__m128 g    = _mm_setr_ps(from, from, from + step, from + step);
+	__m128 d    = _mm_set1_ps(step * 2.0f);
+
+	uint32_t i = 0;
+	for (; i + 2 <= frames; i += 2)
+	{
+		_mm_storeu_ps(buf + i * 2, _mm_mul_ps(_mm_loadu_ps(buf + i * 2), g));
+		g = _mm_add_ps(g, d);
+	}
+	if (i < frames)
+	{
+		buf[i * 2] *= to;
+		buf[i * 2 + 1] *= to;
+	}
+}
+
+static void ngs2_add(float* dst, const float* src, uint32_t frames, float gain)
+{
+	__m128 g = _mm_set1_ps(gain);
+
+	uint32_t i = 0;
+	for (; i + 2 <= frames; i += 2)
+	{
+		_mm_storeu_ps(dst + i * 2, _mm_add_ps(_mm_loadu_ps(dst + i * 2), _mm_mul_ps(_mm_loadu_ps(src + i * 2), g)));
+	}
+	if (i < frames)
+	{
+		dst[i * 2] += src[i * 2] * gain;
+		dst[i * 2 + 1] += src[i * 2 + 1] * gain;
+	}
+}
+
+static void ngs2_sampler_setup(Ngs2VoiceInternal* voice, const Ngs2WaveformFormat& format)
+{
+	bool is_float = (format.waveform_type == NGS2_WAVEFORM_TYPE_PCM_F32L);
+
+	voice->format        = format;
+	voice->mix_func      = nullptr;
+	voice->resample_func = nullptr;
+	voice->matrix        = AudioMixMatrix();
+
+	if ((format.waveform_type != NGS2_WAVEFORM_TYPE_PCM_I16L && !is_float) || (format.num_channels != 1 && format.num_channels != 2))
+	{
+		printf(FG_BRIGHT_YELLOW "Ngs2: unsupported waveform 0x%" PRIx32 ", %u channels, voice is silent\n" FG_DEFAULT, format.waveform_type,
+		       format.num_channels);
+		return;
+	}
+
+	float scale = (is_float ? 1.0f : 1.0f / 32768.0f);
+
+	voice->frame_size = format.num_channels * (is_float ? sizeof(float) : sizeof(int16_t));
+	voice->mix_func   = audio_mix_func(static_cast<int>(format.num_channels), is_float);
+
+	if (format.num_channels == 1)
+	{
+		voice->resample_func = (is_float ? ngs2_resample<true, 1> : ngs2_resample<false, 1>);
+		voice->matrix.l[0]   = scale;
+		voice->matrix.r[0]   = scale;
+	} else
+	{
+		voice->resample_func = (is_float ? ngs2_resample<true, 2> : ngs2_resample<false, 2>);
+		voice->matrix.l[0]   = scale;
+		voice->matrix.r[1]   = scale;
+	}
+}
+
+static void ngs2_sampler_start(Ngs2VoiceInternal* voice)
+{
+	voice->block_index  = 0;
+	voice->block_repeat = 0;
+	voice->position     = 0;
+	voice->decoded      = 0;
+	voice->gain         = voice->volume;
+}
+
+// Renders a grain of a playing or stopped sampler voice. A stopped voice fades out, a voice past its last block becomes empty.
+static void ngs2_sampler_render(Ngs2VoiceInternal* voice, uint32_t frames)
+{
+	auto* ngs = voice->rack->ngs;
+	auto* out = ngs2_voice_buffer(voice);
+
+	memset(out, 0, static_cast<size_t>(frames) * 2 * sizeof(float));
+
+	if (voice->mix_func == nullptr || voice->format.sample_rate == 0)
+	{
+		voice->state = Ngs2VoicePlayState::Empty;
+		return;
+	}
+
+	auto step = static_cast<uint64_t>(static_cast<double>(voice->pitch) * static_cast<double>(voice->format.sample_rate) /
+	                                  static_cast<double>(ngs2_rate(ngs)) * 4294967296.0);
+
+	uint32_t i = 0;
+	while (i < frames && voice->block_index < voice->blocks_num && step != 0)
+	{
+		const auto& block        = voice->blocks[voice->block_index];
+		uint32_t    block_frames = (block.num_samples != 0 ? block.num_samples : block.data_size / voice->frame_size);
+		auto        index        = static_cast<uint32_t>(voice->position >> 32u);
+
+		if (index >= block_frames)
+		{
+			voice->position -= static_cast<uint64_t>(block_frames) << 32u;
+			if (voice->block_repeat < block.num_repeats)
+			{
+				voice->block_repeat++;
+			} else
+			{
+				voice->block_index++;
+				voice->block_repeat = 0;
+			}
+			if (block_frames == 0)
+			{
+				voice->position = 0;
+			}
+			continue;
+		}
+
+		const uint8_t* data = voice->waveform + block.data_offset;
+
+		uint64_t left = (static_cast<uint64_t>(block_frames) << 32u) - voice->position;
+		auto     n    = static_cast<uint32_t>(std::min(static_cast<uint64_t>(frames - i), (left + step - 1) / step));
+
+		if (step == (static_cast<uint64_t>(1) << 32u) && static_cast<uint32_t>(voice->position) == 0)
+		{
+			voice->mix_func(out + static_cast<size_t>(i) * 2, data + static_cast<size_t>(index) * voice->frame_size, n, voice->matrix);
+		} else
+		{
+			voice->resample_func(out + static_cast<size_t>(i) * 2, data, block_frames, voice->position, step, n, voice->matrix);
+		}
+
+		voice->position += n * step;
+		voice->decoded += n;
+		i += n;
+	}
+
+	float target = (voice->state == Ngs2VoicePlayState::Stopped ? 0.0f : voice->volume);
+
+	ngs2_ramp(out, frames, voice->gain, target);
+	voice->gain = target;
+
+	if (voice->block_index >= voice->blocks_num)
+	{
+		voice->state = Ngs2VoicePlayState::Empty;
+	}
+}
+
+static bool ngs2_is_bus(const Ngs2RackInternal* rack)
+{
+	return rack->type != Ngs2RackType::Sampler;
+}
+
+static void ngs2_events(Ngs2RackInternal* rack)
+{
+	auto* voices = ngs2_rack_voices(rack);
+
+	for (uint32_t i = 0; i < rack->option.common.max_voices; i++)
+	{
+		auto& voice = voices[i];
+		switch (voice.event)
+		{
+			case Ngs2VoicePlayEvent::None:
+				if (voice.state == Ngs2VoicePlayState::Stopped)
+				{
+					voice.state = Ngs2VoicePlayState::Empty;
+				}
+				break;
+			case Ngs2VoicePlayEvent::Play:
+				if (voice.state == Ngs2VoicePlayState::Empty)
+				{
+					voice.state = Ngs2VoicePlayState::Playing;
+					ngs2_sampler_start(&voice);
+				}
+				break;
+			case Ngs2VoicePlayEvent::Pause:
+				if (voice.state == Ngs2VoicePlayState::Playing)
+				{
+					voice.state = Ngs2VoicePlayState::Paused;
+				}
+				break;
+			case Ngs2VoicePlayEvent::Resume:
+				if (voice.state == Ngs2VoicePlayState::Paused)
+				{
+					voice.state = Ngs2VoicePlayState::Playing;
+				}
+				break;
+			case Ngs2VoicePlayEvent::Stop:
+				if (voice.state == Ngs2VoicePlayState::Playing)
+				{
+					voice.state = Ngs2VoicePlayState::Stopped;
+				}
+				break;
+			case Ngs2VoicePlayEvent::StopImm:
+			case Ngs2VoicePlayEvent::Kill: voice.state = Ngs2VoicePlayState::Empty; break;
+		}
+		voice.event = Ngs2VoicePlayEvent::None;
+	}
+}
+
+static bool ngs2_is_audible(const Ngs2VoiceInternal& voice)
+{
+	return voice.state == Ngs2VoicePlayState::Playing || voice.state == Ngs2VoicePlayState::Stopped;
+}
+
+// Renders the sampler voices of the system on the pool, then mixes every rack into its destinations in one pass per rack: samplers,
+// submixers newest first (a destination is created before its sources), then mastering into 'mix'
+static void ngs2_render(Ngs2Internal* ngs, float* mix, uint32_t frames)
+{
+	Vector<Ngs2RackInternal*>  racks;
+	Vector<Ngs2VoiceInternal*> samplers;
+
+	for (auto* rack = g_racks_list; rack != nullptr; rack = rack->next)
+	{
+		if (rack->ngs == ngs)
+		{
+			racks.Add(rack);
+		}
+	}
+
+	for (auto* rack: racks)
+	{
+		ngs2_events(rack);
+
+		auto* voices = ngs2_rack_voices(rack);
+
+		for (uint32_t i = 0; i < rack->option.common.max_voices; i++)
+		{
+			auto* voice = voices + i;
+			if (ngs2_is_bus(rack))
+			{
+				memset(ngs2_voice_buffer(voice), 0, static_cast<size_t>(frames) * 2 * sizeof(float));
+			} else if (ngs2_is_audible(*voice))
+			{
+				samplers.Add(voice);
+			}
+		}
+	}
+
+	auto render_batch = [frames, &samplers](uint32_t batch)
+	{
+		auto begin = batch * NGS2_VOICES_PER_JOB;
+		auto end   = std::min(begin + NGS2_VOICES_PER_JOB, samplers.Size());
+		for (uint32_t i = begin; i < end; i++)
+		{
+			ngs2_sampler_render(samplers[i], frames);
+		}
+	};
+
+	auto batches_num = (samplers.Size() + NGS2_VOICES_PER_JOB - 1) / NGS2_VOICES_PER_JOB;
+
+	Core::JobSystem::ParallelFor(batches_num, render_batch, Core::JobPriority::High);
+
+	for (auto* voice: samplers)
+	{
+		auto* dest = voice->dest;
+		if (dest != nullptr && ngs2_is_audible(*dest))
+		{
+			ngs2_add(ngs2_voice_buffer(dest), voice->buffer, frames, 1.0f);
+		}
+	}
+
+	memset(mix, 0, static_cast<size_t>(frames) * 2 * sizeof(float));
+
+	for (int pass = 0; pass < 2; pass++)
+	{
+		for (auto* rack: racks)
+		{
+			if (!ngs2_is_bus(rack) || (rack->type == Ngs2RackType::Mastering) != (pass == 1))
+			{
+				continue;
+			}
+
+			auto* voices = ngs2_rack_voices(rack);
+
+			for (uint32_t i = 0; i < rack->option.common.max_voices; i++)
+			{
+				auto& voice = voices[i];
+				if (!ngs2_is_audible(voice))
+				{
+					continue;
+				}
+				if (pass == 1)
+				{
+					ngs2_add(mix, voice.buffer, frames, voice.volume);
+				} else if (voice.dest != nullptr && ngs2_is_audible(*voice.dest))
+				{
+					ngs2_add(ngs2_voice_buffer(voice.dest), voice.buffer, frames, voice.volume);
+				}
+			}
+		}
+	}
+}
+
+// The stereo mix goes to the first two channels of every buffer
+static void ngs2_output(const float* mix, uint32_t frames, const Ngs2RenderBufferInfo& info)
+{
+	EXIT_NOT_IMPLEMENTED(info.buffer == nullptr);
+
+	uint32_t channels = info.num_channels;
+
+	if (info.waveform_type == NGS2_WAVEFORM_TYPE_PCM_F32L)
+	{
+		auto* dst = static_cast<float*>(info.buffer);
+		memset(dst, 0, static_cast<size_t>(frames) * channels * sizeof(float));
+		for (uint32_t i = 0; i < frames; i++)
+		{
+			dst[i * channels] = mix[i * 2];
+			if (channels > 1)
+			{
+				dst[i * channels + 1] = mix[i * 2 + 1];
+			}
+		}
+	} else
+	{
+		EXIT_NOT_IMPLEMENTED(info.waveform_type != NGS2_WAVEFORM_TYPE_PCM_I16L);
+
+		auto* dst = static_cast<int16_t*>(info.buffer);
+		memset(dst, 0, static_cast<size_t>(frames) * channels * sizeof(int16_t));
+		for (uint32_t i = 0; i < frames; i++)
+		{
+			for (uint32_t c = 0; c < std::min(channels, 2u); c++)
+			{
+				dst[i * channels + c] = static_cast<int16_t>(std::clamp(mix[i * 2 + c] * 32768.0f, -32768.0f, 32767.0f));
+			}
+		}
+	}
+}
+
 int KYTY_SYSV_ABI Ngs2RackQueryBufferSize(uint32_t rack_id, const Ngs2RackOption* option, Ngs2ContextBufferInfo* buffer_info)
 {
 	PRINT_NAME();
@@ -1745,9 +3184,8 @@ int KYTY_SYSV_ABI Ngs2RackCreate(uintptr_t system_handle, uint32_t rack_id, cons
 
 	for (uint32_t i = 0; i < option->max_voices; i++)
 	{
-		voices[i].rack  = rack;
-		voices[i].event = Ngs2VoicePlayEvent::None;
-		voices[i].state = Ngs2VoicePlayState::Empty;
+		new (voices + i) Ngs2VoiceInternal;
+		voices[i].rack = rack;
 	}
 
 	*handle = reinterpret_cast<uintptr_t>(rack);
@@ -1818,53 +3256,21 @@ int KYTY_SYSV_ABI Ngs2SystemRender(uintptr_t system_handle, const Ngs2RenderBuff
 
 	Core::LockGuard lock(ngs->mutex);
 
-	for (auto* rack = g_racks_list; rack != nullptr; rack = rack->next)
+	uint32_t bytes  = (buffer_info[0].waveform_type == NGS2_WAVEFORM_TYPE_PCM_F32L ? sizeof(float) : sizeof(int16_t));
+	auto     frames = static_cast<uint32_t>(buffer_info[0].buffer_size / (std::max(buffer_info[0].num_channels, 1u) * bytes));
+
+	EXIT_NOT_IMPLEMENTED(frames > ngs2_grain(ngs));
+
+	if (ngs->mix == nullptr)
 	{
-		if (rack->ngs == ngs)
-		{
-			auto* voices = reinterpret_cast<Ngs2VoiceInternal*>(rack + 1);
+		ngs->mix = new float[static_cast<size_t>(ngs2_grain(ngs)) * 2];
+	}
 
-			for (uint32_t i = 0; i < rack->option.common.max_voices; i++)
-			{
-				auto& voice = voices[i];
-				switch (voice.event)
-				{
-					case Ngs2VoicePlayEvent::None:
-						if (voice.state == Ngs2VoicePlayState::Playing || voice.state == Ngs2VoicePlayState::Stopped)
-						{
-							voice.state = Ngs2VoicePlayState::Empty;
-						}
-						break;
-					case Ngs2VoicePlayEvent::Play:
-						if (voice.state == Ngs2VoicePlayState::Empty)
-						{
-							voice.state = Ngs2VoicePlayState::Playing;
-						}
-						break;
-					case Ngs2VoicePlayEvent::Pause:
-						if (voice.state == Ngs2VoicePlayState::Playing)
-						{
-							voice.state = Ngs2VoicePlayState::Paused;
-						}
-						break;
-					case Ngs2VoicePlayEvent::Resume:
-						if (voice.state == Ngs2VoicePlayState::Paused)
-						{
-							voice.state = Ngs2VoicePlayState::Playing;
-						}
-						break;
-					case Ngs2VoicePlayEvent::Stop:
-						if (voice.state == Ngs2VoicePlayState::Playing)
-						{
-							voice.state = Ngs2VoicePlayState::Stopped;
-						}
-						break;
-					case Ngs2VoicePlayEvent::StopImm:
-					case Ngs2VoicePlayEvent::Kill: voice.state = Ngs2VoicePlayState::Empty; break;
-				}
-				voice.event = Ngs2VoicePlayEvent::None;
-			}
-		}
+	ngs2_render(ngs, ngs->mix, frames);
+
+	for (uint32_t i = 0; i < num_buffer_info; i++)
+	{
+		ngs2_output(ngs->mix, frames, buffer_info[i]);
 	}
 
 	return OK;
@@ -1922,6 +3328,15 @@ int KYTY_SYSV_ABI Ngs2VoiceControl(uintptr_t voice_handle, const Ngs2VoiceParamH
 				auto cid = param->id & 0x7fffu;
 				switch (cid)
 				{
+					case 0x0003:
+					{
+						EXIT_NOT_IMPLEMENTED(param->size != sizeof(Ngs2VoicePortVolumeParam));
+						const auto* pv = reinterpret_cast<const Ngs2VoicePortVolumeParam*>(param);
+						printf("\t port  = %u\n", pv->port);
+						printf("\t level = %f\n", pv->level);
+						voice->volume = pv->level;
+						break;
+					}
 					case 0x0002:
 					{
 						EXIT_NOT_IMPLEMENTED(param->size != sizeof(Ngs2VoicePortMatrixParam));
@@ -1937,6 +3352,7 @@ int KYTY_SYSV_ABI Ngs2VoiceControl(uintptr_t voice_handle, const Ngs2VoiceParamH
 						printf("\t connect->port          = %u\n", patch->port);
 						printf("\t connect->dest_input_id = %u\n", patch->dest_input_id);
 						printf("\t connect->dest_handle   = 0x%016" PRIx64 "\n", patch->dest_handle);
+						voice->dest = reinterpret_cast<Ngs2VoiceInternal*>(patch->dest_handle);
 						break;
 					}
 					case 0x0006:
@@ -1960,7 +3376,50 @@ int KYTY_SYSV_ABI Ngs2VoiceControl(uintptr_t voice_handle, const Ngs2VoiceParamH
 				}
 				break;
 			}
-			case 0x1000: EXIT_NOT_IMPLEMENTED(voice->rack->type != Ngs2RackType::Sampler); break;
+			case 0x1000:
+			{
+				EXIT_NOT_IMPLEMENTED(voice->rack->type != Ngs2RackType::Sampler);
+				auto cid = param->id & 0x7fffu;
+				switch (cid)
+				{
+					case 0x0000:
+					{
+						EXIT_NOT_IMPLEMENTED(param->size != sizeof(Ngs2SamplerVoiceSetupParam));
+						const auto* setup = reinterpret_cast<const Ngs2SamplerVoiceSetupParam*>(param);
+						printf("\t waveform_type = 0x%" PRIx32 "\n", setup->format.waveform_type);
+						printf("\t num_channels  = %u\n", setup->format.num_channels);
+						printf("\t sample_rate   = %u\n", setup->format.sample_rate);
+						ngs2_sampler_setup(voice, setup->format);
+						break;
+					}
+					case 0x0001:
+					{
+						EXIT_NOT_IMPLEMENTED(param->size != sizeof(Ngs2SamplerVoiceWaveformBlocksParam));
+						const auto* wb = reinterpret_cast<const Ngs2SamplerVoiceWaveformBlocksParam*>(param);
+						printf("\t data       = 0x%016" PRIx64 "\n", reinterpret_cast<uint64_t>(wb->data));
+						printf("\t num_blocks = %u\n", wb->num_blocks);
+						EXIT_NOT_IMPLEMENTED(wb->num_blocks > NGS2_MAX_WAVEFORM_BLOCKS);
+						EXIT_NOT_IMPLEMENTED(wb->num_blocks != 0 && wb->blocks == nullptr);
+						voice->waveform   = static_cast<const uint8_t*>(wb->data);
+						voice->blocks_num = wb->num_blocks;
+						for (uint32_t i = 0; i < wb->num_blocks; i++)
+						{
+							voice->blocks[i] = wb->blocks[i];
+						}
+						break;
+					}
+					case 0x0005:
+					{
+						EXIT_NOT_IMPLEMENTED(param->size != sizeof(Ngs2SamplerVoicePitchParam));
+						const auto* pitch = reinterpret_cast<const Ngs2SamplerVoicePitchParam*>(param);
+						printf("\t ratio = %f\n", pitch->ratio);
+						voice->pitch = pitch->ratio;
+						break;
+					}
+					default: break;
+				}
+				break;
+			}
 			case 0x2000: EXIT_NOT_IMPLEMENTED(voice->rack->type != Ngs2RackType::Submixer); break;
 			case 0x2001: EXIT_NOT_IMPLEMENTED(voice->rack->type != Ngs2RackType::Reverb); break;
 			case 0x3000: EXIT_NOT_IMPLEMENTED(voice->rack->type != Ngs2RackType::Mastering); break;
@@ -2003,12 +3462,12 @@ int KYTY_SYSV_ABI Ngs2VoiceGetState(uintptr_t voice_handle, Ngs2VoiceState* stat
 				case Ngs2VoicePlayState::Paused: sampler->voice_state.state_flags = 0x5; break;
 				case Ngs2VoicePlayState::Stopped: sampler->voice_state.state_flags = 0xb; break;
 			}
-			sampler->envelope_height     = 1.0f;
+			sampler->envelope_height     = voice->gain;
 			sampler->peak_height         = 0.0f;
 			sampler->reserved            = 0;
-			sampler->num_decoded_samples = 0;
+			sampler->num_decoded_samples = voice->decoded;
 			sampler->user_data           = 0;
-			sampler->waveform_data       = nullptr;
+			sampler->waveform_data       = voice->waveform;
 			printf("\t state_flags = %u\n", sampler->voice_state.state_flags);
 			break;
 		}
@@ -0,0 +1,519 @@
+#include "Emulator/Benchmark.h"
+
+#include "Kyty/Core/DbgAssert.h"
+#include "Kyty/Core/File.h"
+#include "Kyty/Core/MagicEnum.h"
+#include "Kyty/Core/Subsystems.h"
+#include "Kyty/Core/Threads.h"
+#include "Kyty/Core/Timer.h"
+#include "Kyty/Core/Vector.h"
+
+#include "Emulator/Config.h"
+#include "Emulator/Graphics/GpuCounters.h"
+#include "Emulator/Loader/Timer.h"
+
+#include <cstdlib>
+
+#if KYTY_PLATFORM == KYTY_PLATFORM_WINDOWS
+#include <windows.h> // IWYU pragma: keep
+#else
+#include <ctime>
+#include <pthread.h>
+#endif
+
+#ifdef KYTY_EMU_ENABLED
+
+namespace Kyty::Profiler {
+
+struct BenchmarkThread
+{
+	uint32_t group_id = 0;
+#if KYTY_PLATFORM == KYTY_PLATFORM_WINDOWS
+	HANDLE handle = nullptr;
+#else
+	clockid_t clock {};
+#endif
+};
+
+struct BenchmarkRun
+{
+	uint32_t frames = 0; // 0 - until the emulator is closed
+	String   results_file;
+	String   baseline_file;
+	double   tolerance = 0.0; // percent
+};
+
+struct Benchmark
+{
+	Core::Mutex              mutex {"Benchmark"};
+	uint64_t                 start      = 0; // performance counter
+	uint64_t                 last_frame = 0;
+	uint64_t                 frames     = 0;
+	Vector<uint64_t>         frame_times;
+	Vector<uint64_t>         frame_counters; // GpuCounter::Max values per frame time
+	Vector<String>           groups;
+	Vector<uint64_t>         groups_ns; // CPU time of the finished threads
+	Vector<BenchmarkThread*> threads;
+	BenchmarkRun             run;
+};
+
+struct BenchmarkSummary
+{
+	double           wall_s       = 0.0;
+	double           frame_avg_ms = 0.0;
+	double           frame_p50_ms = 0.0;
+	double           frame_p90_ms = 0.0;
+	double           frame_p99_ms = 0.0;
+	double           frame_max_ms = 0.0;
+	Vector<uint64_t> groups_ns;
+	uint64_t         other_ns = 0;
+	uint64_t         total_ns = 0;
+};
+
+struct BenchmarkMetric
+{
+	String name;
+	double value = 0.0;
+};
+
+constexpr int GPU_COUNTERS_NUM = static_cast<int>(Libs::Graphics::GpuCounter::Max);
+
+// Values are saved with 3 decimals, a smaller difference is rounding
+constexpr double BENCHMARK_EPSILON = 0.001;
+
+static Benchmark*                    g_benchmark      = nullptr;
+static thread_local BenchmarkThread* g_benchmark_self = nullptr;
+
+static void benchmark_finish();
+
+#if KYTY_PLATFORM == KYTY_PLATFORM_WINDOWS
+static uint64_t filetime_to_ns(const FILETIME& t)
+{
+	return ((static_cast<uint64_t>(t.dwHighDateTime) << 32u) | t.dwLowDateTime) * 100;
+}
+#else
+static uint64_t timespec_to_ns(const timespec& t)
+{
+	return static_cast<uint64_t>(t.tv_sec) * 1000000000 + static_cast<uint64_t>(t.tv_nsec);
+}
+#endif
+
+static uint64_t thread_cpu_ns(const BenchmarkThread* t)
+{
+#if KYTY_PLATFORM == KYTY_PLATFORM_WINDOWS
+	FILETIME creation {};
+	FILETIME exit {};
+	FILETIME kernel {};
+	FILETIME user {};
+	if (GetThreadTimes(t->handle, &creation, &exit, &kernel, &user) == 0)
+	{
+		return 0;
+	}
+	return filetime_to_ns(kernel) + filetime_to_ns(user);
+#else
+	timespec ts {};
+	if (clock_gettime(t->clock, &ts) != 0)
+	{
+		return 0;
+	}
+	return timespec_to_ns(ts);
+#endif
+}
+
+static uint64_t process_cpu_ns()
+{
+#if KYTY_PLATFORM == KYTY_PLATFORM_WINDOWS
+	FILETIME creation {};
+	FILETIME exit {};
+	FILETIME kernel {};
+	FILETIME user {};
+	if (GetProcessTimes(GetCurrentProcess(), &creation, &exit, &kernel, &user) == 0)
+	{
+		return 0;
+	}
+	return filetime_to_ns(kernel) + filetime_to_ns(user);
+#else
+	timespec ts {};
+	if (clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts) != 0)
+	{
+		return 0;
+	}
+	return timespec_to_ns(ts);
+#endif
+}
+
+void BenchmarkInit()
+{
+	EXIT_IF(g_benchmark != nullptr);
+
+	if (!Config::BenchmarkEnabled())
+	{
+		return;
+	}
+
+	g_benchmark        = new Benchmark;
+	g_benchmark->start = Core::Timer::QueryPerformanceCounter();
+}
+
+void BenchmarkFrame()
+{
+	if (g_benchmark == nullptr)
+	{
+		return;
+	}
+
+	Loader::Timer::FrameDone();
+
+	uint64_t now = Core::Timer::QueryPerformanceCounter();
+
+	bool finish = false;
+
+	{
+		Core::LockGuard lock(g_benchmark->mutex);
+
+		if (g_benchmark->frames != 0)
+		{
+			g_benchmark->frame_times.Add(now - g_benchmark->last_frame);
+
+			if (Config::GpuCountersEnabled())
+			{
+				for (int c = 0; c < GPU_COUNTERS_NUM; c++)
+				{
+					g_benchmark->frame_counters.Add(Libs::Graphics::GpuCountersGetLastFrame(static_cast<Libs::Graphics::GpuCounter>(c)));
+				}
+			}
+		}
+
+		g_benchmark->last_frame = now;
+		g_benchmark->frames++;
+
+		finish = (g_benchmark->run.frames != 0 && g_benchmark->frames == g_benchmark->run.frames);
+	}
+
+	if (finish)
+	{
+		benchmark_finish();
+	}
+}
+
+void BenchmarkThreadStart(const String& group)
+{
+	if (g_benchmark == nullptr || g_benchmark_self != nullptr)
+	{
+		return;
+	}
+
+	auto* t = new BenchmarkThread;
+
+#if KYTY_PLATFORM == KYTY_PLATFORM_WINDOWS
+	t->handle = OpenThread(THREAD_QUERY_LIMITED_INFORMATION, FALSE, GetCurrentThreadId());
+	EXIT_NOT_IMPLEMENTED(t->handle == nullptr);
+#else
+	EXIT_NOT_IMPLEMENTED(pthread_getcpuclockid(pthread_self(), &t->clock) != 0);
+#endif
+
+	Core::LockGuard lock(g_benchmark->mutex);
+
+	auto group_id = g_benchmark->groups.Find(group);
+	if (!g_benchmark->groups.IndexValid(group_id))
+	{
+		group_id = g_benchmark->groups.Size();
+		g_benchmark->groups.Add(group);
+		g_benchmark->groups_ns.Add(0);
+	}
+	t->group_id = group_id;
+
+	g_benchmark_self = t;
+	g_benchmark->threads.Add(t);
+}
+
+void BenchmarkThreadStop()
+{
+	if (g_benchmark == nullptr || g_benchmark_self == nullptr)
+	{
+		return;
+	}
+
+	uint64_t ns = thread_cpu_ns(g_benchmark_self);
+
+	{
+		Core::LockGuard lock(g_benchmark->mutex);
+		g_benchmark->groups_ns[g_benchmark_self->group_id] += ns;
+		g_benchmark->threads.Remove(g_benchmark_self);
+	}
+
+#if KYTY_PLATFORM == KYTY_PLATFORM_WINDOWS
+	CloseHandle(g_benchmark_self->handle);
+#endif
+
+	delete g_benchmark_self;
+	g_benchmark_self = nullptr;
+}
+
+// Called with the mutex locked
+static BenchmarkSummary benchmark_summary()
+{
+	BenchmarkSummary r;
+
+	double freq = static_cast<double>(Core::Timer::QueryPerformanceFrequency());
+	auto   ms   = [freq](uint64_t t) { return static_cast<double>(t) * 1000.0 / freq; };
+
+	r.wall_s = static_cast<double>(Core::Timer::QueryPerformanceCounter() - g_benchmark->start) / freq;
+
+	if (!g_benchmark->frame_times.IsEmpty())
+	{
+		auto times = g_benchmark->frame_times;
+		times.Sort([](uint64_t a, uint64_t b) { return a < b; });
+
+		uint64_t sum = 0;
+		for (auto t: times)
+		{
+			sum += t;
+		}
+
+		auto percentile = [&times](uint32_t p) { return times.At((times.Size() - 1) * p / 100); };
+
+		r.frame_avg_ms = ms(sum) / times.Size();
+		r.frame_p50_ms = ms(percentile(50));
+		r.frame_p90_ms = ms(percentile(90));
+		r.frame_p99_ms = ms(percentile(99));
+		r.frame_max_ms = ms(times.At(times.Size() - 1));
+	}
+
+	r.groups_ns = g_benchmark->groups_ns;
+	for (const auto* t: g_benchmark->threads)
+	{
+		r.groups_ns[t->group_id] += thread_cpu_ns(t);
+	}
+
+	uint64_t groups_ns_sum = 0;
+	for (auto ns: r.groups_ns)
+	{
+		groups_ns_sum += ns;
+	}
+
+	r.total_ns = process_cpu_ns();
+	r.other_ns = (r.total_ns > groups_ns_sum ? r.total_ns - groups_ns_sum : 0);
+
+	return r;
+}
+
+// Lower is better for all of them
+static Vector<BenchmarkMetric> benchmark_metrics(const BenchmarkSummary& s)
+{
+	Vector<BenchmarkMetric> r;
+
+	auto add = [&r](const String& name, double value) { r.Add({name, value}); };
+	auto ms  = [](uint64_t ns) { return static_cast<double>(ns) / 1000000.0; };
+
+	add(U"frame_avg_ms", s.frame_avg_ms);
+	add(U"frame_p50_ms", s.frame_p50_ms);
+	add(U"frame_p90_ms", s.frame_p90_ms);
+	add(U"frame_p99_ms", s.frame_p99_ms);
+
+	for (uint32_t i = 0; i < s.groups_ns.Size(); i++)
+	{
+		add(U"cpu_" + g_benchmark->groups.At(i) + U"_ms", ms(s.groups_ns.At(i)));
+	}
+	add(U"cpu_Other_ms", ms(s.other_ns));
+	add(U"cpu_Total_ms", ms(s.total_ns));
+
+	// Averages per frame
+	uint32_t frames = g_benchmark->frame_counters.Size() / GPU_COUNTERS_NUM;
+	if (frames != 0)
+	{
+		for (int c = 0; c < GPU_COUNTERS_NUM; c++)
+		{
+			uint64_t sum = 0;
+			for (uint32_t f = 0; f < frames; f++)
+			{
+				sum += g_benchmark->frame_counters.At(f * GPU_COUNTERS_NUM + c);
+			}
+			add(U"gpu_" + Core::EnumName(static_cast<Libs::Graphics::GpuCounter>(c)),
+			    static_cast<double>(sum) / static_cast<double>(frames));
+		}
+	}
+
+	return r;
+}
+
+static void benchmark_save(const Vector<BenchmarkMetric>& metrics)
+{
+	const auto& file_name = g_benchmark->run.results_file;
+
+	Core::File::CreateDirectories(file_name.DirectoryWithoutFilename());
+
+	Core::File f;
+	if (!f.Create(file_name))
+	{
+		printf(FG_BRIGHT_RED "Can't create file: %s\n" FG_DEFAULT, file_name.C_Str());
+		return;
+	}
+
+	for (const auto& m: metrics)
+	{
+		f.Printf("%s %.3f\n", m.name.C_Str(), m.value);
+	}
+
+	f.Close();
+
+	// Host frame time and the GPU counters of each frame
+	Core::File csv;
+	if (!csv.Create(file_name + U".frames.csv"))
+	{
+		printf(FG_BRIGHT_RED "Can't create file: %s.frames.csv\n" FG_DEFAULT, file_name.C_Str());
+		return;
+	}
+
+	bool   counters = !g_benchmark->frame_counters.IsEmpty();
+	double freq     = static_cast<double>(Core::Timer::QueryPerformanceFrequency());
+
+	csv.Printf("frame,ms");
+	for (int c = 0; counters && c < GPU_COUNTERS_NUM; c++)
+	{
+		csv.Printf(",%s", Core::EnumName(static_cast<Libs::Graphics::GpuCounter>(c)).C_Str());
+	}
+	csv.Printf("\n");
+
+	for (uint32_t f = 0; f < g_benchmark->frame_times.Size(); f++)
+	{
+		csv.Printf("%u,%.3f", f + 1, static_cast<double>(g_benchmark->frame_times.At(f)) * 1000.0 / freq);
+		for (int c = 0; counters && c < GPU_COUNTERS_NUM; c++)
+		{
+			csv.Printf(",%" PRIu64, g_benchmark->frame_counters.At(f * GPU_COUNTERS_NUM + c));
+		}
+		csv.Printf("\n");
+	}
+
+	csv.Close();
+
+	printf("Benchmark: results saved to %s\n", file_name.C_Str());
+}
+
+// Returns false if a metric of the baseline is exceeded by more than the tolerance. Metrics missing on either side are skipped.
+static bool benchmark_compare(const Vector<BenchmarkMetric>& metrics)
+{
+	const auto& file_name = g_benchmark->run.baseline_file;
+
+	Core::File f;
+	if (!f.Open(file_name, Core::File::Mode::Read))
+	{
+		printf(FG_BRIGHT_RED "Can't open file: %s\n" FG_DEFAULT, file_name.C_Str());
+		return false;
+	}
+
+	bool ok = true;
+
+	printf("%-24s %12s %12s %9s\n", "metric", "baseline", "current", "change");
+
+	while (!f.IsEOF())
+	{
+		auto fields = f.ReadLine().Trim().Split(U' ');
+		if (fields.Size() != 2)
+		{
+			continue;
+		}
+
+		const auto& name     = fields.At(0);
+		double      baseline = fields.At(1).ToDouble();
+
+		auto index = metrics.Find(name, [](const BenchmarkMetric& m, const String& name) { return m.name == name; });
+		if (!metrics.IndexValid(index))
+		{
+			continue;
+		}
+
+		double current = metrics.At(index).value;
+		bool   worse   = (current > baseline * (1.0 + g_benchmark->run.tolerance / 100.0) + BENCHMARK_EPSILON);
+		double change  = (baseline > 0.0 ? (current - baseline) * 100.0 / baseline : 0.0);
+
+		printf("%s%-24s %12.3f %12.3f %+8.1f%%\n" FG_DEFAULT, (worse ? FG_BRIGHT_RED : ""), name.C_Str(), baseline, current, change);
+
+		ok = ok && !worse;
+	}
+
+	f.Close();
+
+	return ok;
+}
+
+static void benchmark_finish()
+{
+	bool ok = true;
+
+	{
+		Core::LockGuard lock(g_benchmark->mutex);
+
+		auto metrics = benchmark_metrics(benchmark_summary());
+
+		benchmark_save(metrics);
+
+		if (!g_benchmark->run.baseline_file.IsEmpty())
+		{
+			ok = benchmark_compare(metrics);
+		}
+	}
+
+	printf("%sBenchmark: %s\n" FG_DEFAULT, (ok ? FG_BRIGHT_GREEN : FG_BRIGHT_RED), (ok ? "passed" : "regression"));
+
+	Core::SubsystemsListSingleton::Instance()->ShutdownAll();
+	std::_Exit(ok ? EXIT_SUCCESS : EXIT_FAILURE);
+}
+
+void BenchmarkSetRun(uint32_t frames, const String& results_file, const String& baseline_file, double tolerance)
+{
+	if (g_benchmark == nullptr)
+	{
+		EXIT("BenchmarkEnabled is off\n");
+	}
+
+	EXIT_IF(frames == 0);
+	EXIT_IF(results_file.IsEmpty());
+
+	Core::LockGuard lock(g_benchmark->mutex);
+
+	g_benchmark->run.frames        = frames;
+	g_benchmark->run.results_file  = results_file;
+	g_benchmark->run.baseline_file = baseline_file;
+	g_benchmark->run.tolerance     = tolerance;
+}
+
+void BenchmarkPrint()
+{
+	if (g_benchmark == nullptr)
+	{
+		return;
+	}
+
+	Core::LockGuard lock(g_benchmark->mutex);
+
+	auto s = benchmark_summary();
+
+	printf("Benchmark: %" PRIu64 " frames, wall time %.3f s, %.2f fps\n", g_benchmark->frames, s.wall_s,
+	       static_cast<double>(g_benchmark->frames) / s.wall_s);
+
+	if (!g_benchmark->frame_times.IsEmpty())
+	{
+		printf("Frame time: avg %.3f ms, p50 %.3f ms, p90 %.3f ms, p99 %.3f ms, max %.3f ms\n", s.frame_avg_ms, s.frame_p50_ms,
+		       s.frame_p90_ms, s.frame_p99_ms, s.frame_max_ms);
+	}
+
+	printf("%-12s %12s %10s\n", "CPU", "ms", "cores");
+
+	auto print_row = [&s](const char* name, uint64_t ns)
+	{
+		printf("%-12s %12.3f %10.2f\n", name, static_cast<double>(ns) / 1000000.0, static_cast<double>(ns) / 1000000000.0 / s.wall_s);
+	};
+
+	for (uint32_t i = 0; i < s.groups_ns.Size(); i++)
+	{
+		print_row(g_benchmark->groups.At(i).C_Str(), s.groups_ns.At(i));
+	}
+
+	print_row("Other", s.other_ns);
+	print_row("Total", s.total_ns);
+}
+
+} // namespace Kyty::Profiler
+
+#endif // KYTY_EMU_ENABLED
@@ -24,11 +24,81 @@ struct Config
 	Log::Direction         printf_direction            = Log::Direction::Console;
 	String                 printf_output_file          = U"_kyty.txt";
 	String                 printf_output_folder        = U"_Logs";
+	bool                   printf_async_enabled        = false;
+	Log::Overflow          printf_async_overflow       = Log::Overflow::Block;
 	ProfilerDirection      profiler_direction          = ProfilerDirection::None;
 	String                 profiler_output_file        = U"_profile.prof";
+	String                 profiler_trace_file;
+	uint32_t               sampler_period              = 0;
+	String                 sampler_output_file         = U"_samples.folded";
+	bool                   hle_stats_enabled           = false;
 	bool                   spirv_debug_printf_enabled  = false;
 	bool                   pipeline_dump_enabled       = false;
 	String                 pipeline_dump_folder        = U"_Pipelines";
+	bool                   dumps_compressed            = false;
+	uint32_t               dump_queue_size             = 64;
+	bool                   pipeline_cache_enabled      = false;
+	bool                   shader_cache_enabled        = false;
+	bool                   relocation_cache_enabled    = false;
+	bool                   hle_direct_calls_enabled    = false;
+	bool                   host_libc_enabled           = true;
+	bool                   boot_snapshot_enabled       = false;
+	String                 cache_folder                = U"_Cache";
+	String                 remote_cache_url;
+	uint32_t               remote_cache_timeout        = 300;
+	bool                   async_pipelines_enabled     = false;
+	uint32_t               pipeline_evict_min_frames   = 8;
+	bool                   gpu_memory_watcher_enabled  = false;
+	bool                   gpu_detile_enabled          = false;
+	uint32_t               gpu_frames_in_flight        = 3;
+	bool                   gpu_submit_thread_enabled   = false;
+	bool                   fast_clear_enabled          = true;
+	bool                   push_descriptors_enabled    = false;
+	bool                   async_write_back_enabled    = false;
+	PresentMode            present_mode                = PresentMode::Fifo;
+	uint32_t               swapchain_image_count       = 2;
+	bool                   frame_pacing_enabled        = false;
+	bool                   vblank_timer_enabled        = true;
+	bool                   headless_enabled            = false;
+	bool                   headless_uncapped           = false;
+	bool                   benchmark_enabled           = false;
+	bool                   host_memory_import_enabled  = false;
+	bool                   gpu_profiler_enabled        = false;
+	bool                   gpu_counters_enabled        = false;
+	String                 gpu_profiler_output_file    = U"_gpu_profile.json";
+	bool                   capture_enabled             = false;
+	String                 capture_file                = U"_capture.bin";
+	uint32_t               capture_start_frame         = 0;
+	uint32_t               capture_frames              = 1;
+	bool                   spirv_text_assembler        = false;
+	bool                   shader_prefetch_enabled     = false;
+	bool                   shader_code_optimization    = false;
+	bool                   pipeline_prewarm_enabled    = false;
+	bool                   gpu_mip_generation_enabled  = false;
+	bool                   gpu_memory_budget_enabled   = false;
+	uint32_t               gpu_memory_budget_usage     = 90;
+	uint32_t               command_buffer_split_draws  = 0;
+	uint32_t               render_scale                = 100;
+	uint32_t               sampled_hash_interval       = 0;
+	uint32_t               async_upload_threshold      = 0;
+	uint32_t               mutex_spin_count            = 100;
+	uint32_t               job_workers                 = 0;
+	uint32_t               trace_level                 = 2;
+	String                 trace_binary_file;
+	bool                   file_mapping_enabled        = true;
+	bool                   file_prefetch_enabled       = false;
+	bool                   save_data_write_behind      = false;
+	bool                   save_data_compressed        = false;
+	bool                   tls_direct_access           = true;
+	bool                   thread_affinity_enabled     = false;
+	uint32_t               thread_affinity_emu_cores   = 3;
+	bool                   thread_priority_enabled     = false;
+	bool                   raw_tsc_enabled             = true;
+	bool                   large_pages_enabled         = false;
+	bool                   flexible_memory_lazy        = false;
+	String                 startup_report_file         = U"_startup.json";
+	bool                   audio_output_enabled        = false;
+	uint32_t               audio_latency_ms            = 50;
 };
 
 static Config* g_config = nullptr;
@@ -97,11 +167,90 @@ void Load(const Scripts::ScriptVar& cfg)
 	LoadEnum(g_config->printf_direction, cfg, U"PrintfDirection");
 	LoadStr(g_config->printf_output_file, cfg, U"PrintfOutputFile");
 	LoadStr(g_config->printf_output_folder, cfg, U"PrintfOutputFolder");
+	LoadBool(g_config->printf_async_enabled, cfg, U"PrintfAsyncEnabled");
+	LoadEnum(g_config->printf_async_overflow, cfg, U"PrintfAsyncOverflow");
 	LoadEnum(g_config->profiler_direction, cfg, U"ProfilerDirection");
 	LoadStr(g_config->profiler_output_file, cfg, U"ProfilerOutputFile");
+	LoadStr(g_config->profiler_trace_file, cfg, U"ProfilerTraceFile");
+	LoadInt(g_config->sampler_period, cfg, U"SamplerPeriod");
+	LoadStr(g_config->sampler_output_file, cfg, U"SamplerOutputFile");
+	LoadBool(g_config->hle_stats_enabled, cfg, U"HleStatsEnabled");
 	LoadBool(g_config->spirv_debug_printf_enabled, cfg, U"SpirvDebugPrintfEnabled");
 	LoadBool(g_config->pipeline_dump_enabled, cfg, U"PipelineDumpEnabled");
 	LoadStr(g_config->pipeline_dump_folder, cfg, U"PipelineDumpFolder");
+	LoadBool(g_config->dumps_compressed, cfg, U"DumpsCompressed");
+	LoadInt(g_config->dump_queue_size, cfg, U"DumpQueueSize");
+	LoadBool(g_config->pipeline_cache_enabled, cfg, U"PipelineCacheEnabled");
+	LoadBool(g_config->shader_cache_enabled, cfg, U"ShaderCacheEnabled");
+	LoadBool(g_config->relocation_cache_enabled, cfg, U"RelocationCacheEnabled");
+	LoadBool(g_config->hle_direct_calls_enabled, cfg, U"HleDirectCallsEnabled");
+	LoadBool(g_config->host_libc_enabled, cfg, U"HostLibcEnabled");
+	LoadBool(g_config->boot_snapshot_enabled, cfg, U"BootSnapshotEnabled");
+	LoadStr(g_config->cache_folder, cfg, U"CacheFolder");
+	LoadStr(g_config->remote_cache_url, cfg, U"RemoteCacheUrl");
+	LoadInt(g_config->remote_cache_timeout, cfg, U"RemoteCacheTimeout");
+	LoadBool(g_config->async_pipelines_enabled, cfg, U"AsyncPipelinesEnabled");
+	LoadInt(g_config->pipeline_evict_min_frames, cfg, U"PipelineEvictMinFrames");
+	LoadBool(g_config->gpu_memory_watcher_enabled, cfg, U"GpuMemoryWatcherEnabled");
+	LoadBool(g_config->gpu_detile_enabled, cfg, U"GpuDetileEnabled");
+	LoadInt(g_config->gpu_frames_in_flight, cfg, U"GpuFramesInFlight");
+	LoadBool(g_config->gpu_submit_thread_enabled, cfg, U"GpuSubmitThreadEnabled");
+	LoadBool(g_config->fast_clear_enabled, cfg, U"FastClearEnabled");
+	LoadBool(g_config->push_descriptors_enabled, cfg, U"PushDescriptorsEnabled");
+	LoadBool(g_config->async_write_back_enabled, cfg, U"AsyncWriteBackEnabled");
+	LoadEnum(g_config->present_mode, cfg, U"PresentMode");
+	LoadInt(g_config->swapchain_image_count, cfg, U"SwapchainImageCount");
+	LoadBool(g_config->frame_pacing_enabled, cfg, U"FramePacingEnabled");
+	LoadBool(g_config->vblank_timer_enabled, cfg, U"VblankTimerEnabled");
+	LoadBool(g_config->headless_enabled, cfg, U"HeadlessEnabled");
+	LoadBool(g_config->headless_uncapped, cfg, U"HeadlessUncapped");
+	LoadBool(g_config->benchmark_enabled, cfg, U"BenchmarkEnabled");
+	LoadBool(g_config->host_memory_import_enabled, cfg, U"HostMemoryImportEnabled");
+	LoadBool(g_config->gpu_profiler_enabled, cfg, U"GpuProfilerEnabled");
+	LoadBool(g_config->gpu_counters_enabled, cfg, U"GpuCountersEnabled");
+	LoadStr(g_config->gpu_profiler_output_file, cfg, U"GpuProfilerOutputFile");
+	LoadBool(g_config->capture_enabled, cfg, U"CommandBufferCaptureEnabled");
+	LoadStr(g_config->capture_file, cfg, U"CommandBufferCaptureFile");
+	LoadInt(g_config->capture_start_frame, cfg, U"CommandBufferCaptureStartFrame");
+	LoadInt(g_config->capture_frames, cfg, U"CommandBufferCaptureFrames");
+	LoadBool(g_config->spirv_text_assembler, cfg, U"SpirvTextAssemblerEnabled");
+	LoadBool(g_config->shader_prefetch_enabled, cfg, U"ShaderPrefetchEnabled");
+	LoadBool(g_config->shader_code_optimization, cfg, U"ShaderCodeOptimizationEnabled");
+	LoadBool(g_config->pipeline_prewarm_enabled, cfg, U"PipelinePrewarmEnabled");
+	LoadBool(g_config->gpu_mip_generation_enabled, cfg, U"GpuMipGenerationEnabled");
+	LoadBool(g_config->gpu_memory_budget_enabled, cfg, U"GpuMemoryBudgetEnabled");
+	LoadInt(g_config->gpu_memory_budget_usage, cfg, U"GpuMemoryBudgetUsage");
+	LoadInt(g_config->command_buffer_split_draws, cfg, U"CommandBufferSplitDraws");
+	LoadInt(g_config->render_scale, cfg, U"RenderScale");
+	LoadInt(g_config->sampled_hash_interval, cfg, U"SampledHashInterval");
+	LoadInt(g_config->async_upload_threshold, cfg, U"AsyncUploadThreshold");
+	LoadInt(g_config->mutex_spin_count, cfg, U"MutexSpinCount");
+	LoadInt(g_config->job_workers, cfg, U"JobWorkers");
+	LoadInt(g_config->trace_level, cfg, U"TraceLevel");
+	LoadStr(g_config->trace_binary_file, cfg, U"TraceBinaryFile");
+	LoadBool(g_config->file_mapping_enabled, cfg, U"FileMappingEnabled");
+	LoadBool(g_config->file_prefetch_enabled, cfg, U"FilePrefetchEnabled");
+	LoadBool(g_config->save_data_write_behind, cfg, U"SaveDataWriteBehind");
+	LoadBool(g_config->save_data_compressed, cfg, U"SaveDataCompressed");
+	LoadBool(g_config->tls_direct_access, cfg, U"TlsDirectAccess");
+	LoadBool(g_config->thread_affinity_enabled, cfg, U"ThreadAffinityEnabled");
+	LoadInt(g_config->thread_affinity_emu_cores, cfg, U"ThreadAffinityEmulatorCores");
+	LoadBool(g_config->thread_priority_enabled, cfg, U"ThreadPriorityEnabled");
+	LoadBool(g_config->raw_tsc_enabled, cfg, U"RawTscEnabled");
+	LoadBool(g_config->large_pages_enabled, cfg, U"LargePagesEnabled");
+	LoadBool(g_config->flexible_memory_lazy, cfg, U"FlexibleMemoryLazy");
+	LoadStr(g_config->startup_report_file, cfg, U"StartupReportFile");
+	LoadBool(g_config->audio_output_enabled, cfg, U"AudioOutputEnabled");
+	LoadInt(g_config->audio_latency_ms, cfg, U"AudioLatencyMs");
+
+	if (g_config->benchmark_enabled)
+	{
+		// Nothing waits for the display or for a 60 Hz pace
+		g_config->frame_pacing_enabled = false;
+		g_config->vblank_timer_enabled = false;
+		g_config->headless_uncapped    = true;
+		g_config->present_mode         = PresentMode::Immediate;
+	}
 }
 
 uint32_t GetScreenWidth()
@@ -169,6 +318,16 @@ String GetPrintfOutputFolder()
 	return g_config->printf_output_folder;
 }
 
+bool PrintfAsyncEnabled()
+{
+	return g_config->printf_async_enabled;
+}
+
+Log::Overflow GetPrintfAsyncOverflow()
+{
+	return g_config->printf_async_overflow;
+}
+
 ProfilerDirection GetProfilerDirection()
 {
 	return g_config->profiler_direction;
@@ -179,6 +338,26 @@ String GetProfilerOutputFile()
 	return g_config->profiler_output_file;
 }
 
+String GetProfilerTraceFile()
+{
+	return g_config->profiler_trace_file;
+}
+
+uint32_t GetSamplerPeriod()
+{
+	return g_config->sampler_period;
+}
+
+String GetSamplerOutputFile()
+{
+	return g_config->sampler_output_file;
+}
+
+bool HleStatsEnabled()
+{
+	return g_config->hle_stats_enabled;
+}
+
 bool SpirvDebugPrintfEnabled()
 {
 	return g_config->spirv_debug_printf_enabled;
@@ -194,6 +373,326 @@ String GetPipelineDumpFolder()
 	return g_config->pipeline_dump_folder;
 }
 
+bool DumpsCompressed()
+{
+	return g_config->dumps_compressed;
+}
+
+uint32_t GetDumpQueueSize()
+{
+	return g_config->dump_queue_size;
+}
+
+bool PipelineCacheEnabled()
+{
+	return g_config->pipeline_cache_enabled;
+}
+
+bool ShaderCacheEnabled()
+{
+	return g_config->shader_cache_enabled;
+}
+
+bool RelocationCacheEnabled()
+{
+	return g_config->relocation_cache_enabled;
+}
+
+bool HleDirectCallsEnabled()
+{
+	return g_config->hle_direct_calls_enabled;
+}
+
+bool HostLibcEnabled()
+{
+	return g_config->host_libc_enabled;
+}
+
+bool BootSnapshotEnabled()
+{
+	return g_config->boot_snapshot_enabled;
+}
+
+String GetCacheFolder()
+{
+	return g_config->cache_folder;
+}
+
+String GetRemoteCacheUrl()
+{
+	return g_config->remote_cache_url;
+}
+
+uint32_t GetRemoteCacheTimeout()
+{
+	return g_config->remote_cache_timeout;
+}
+
+bool AsyncPipelinesEnabled()
+{
+	return g_config->async_pipelines_enabled;
+}
+
+uint32_t GetPipelineEvictMinFrames()
+{
+	return g_config->pipeline_evict_min_frames;
+}
+
+bool GpuMemoryWatcherEnabled()
+{
+	return g_config->gpu_memory_watcher_enabled;
+}
+
+bool GpuDetileEnabled()
+{
+	return g_config->gpu_detile_enabled;
+}
+
+uint32_t GetGpuFramesInFlight()
+{
+	return g_config->gpu_frames_in_flight;
+}
+
+bool GpuSubmitThreadEnabled()
+{
+	return g_config->gpu_submit_thread_enabled;
+}
+
+bool FastClearEnabled()
+{
+	return g_config->fast_clear_enabled;
+}
+
+bool PushDescriptorsEnabled()
+{
+	return g_config->push_descriptors_enabled;
+}
+
+bool AsyncWriteBackEnabled()
+{
+	return g_config->async_write_back_enabled;
+}
+
+PresentMode GetPresentMode()
+{
+	return g_config->present_mode;
+}
+
+uint32_t GetSwapchainImageCount()
+{
+	return g_config->swapchain_image_count;
+}
+
+bool FramePacingEnabled()
+{
+	return g_config->frame_pacing_enabled;
+}
+
+bool VblankTimerEnabled()
+{
+	return g_config->vblank_timer_enabled;
+}
+
+bool HeadlessEnabled()
+{
+	return g_config->headless_enabled;
+}
+
+bool HeadlessUncapped()
+{
+	return g_config->headless_uncapped;
+}
+
+bool BenchmarkEnabled()
+{
+	return g_config->benchmark_enabled;
+}
+
+bool HostMemoryImportEnabled()
+{
+	return g_config->host_memory_import_enabled;
+}
+
+bool GpuProfilerEnabled()
+{
+	return g_config->gpu_profiler_enabled;
+}
+
+String GetGpuProfilerOutputFile()
+{
+	return g_config->gpu_profiler_output_file;
+}
+
+bool GpuCountersEnabled()
+{
+	return g_config->gpu_counters_enabled;
+}
+
+bool CommandBufferCaptureEnabled()
+{
+	return g_config->capture_enabled;
+}
+
+String GetCommandBufferCaptureFile()
+{
+	return g_config->capture_file;
+}
+
+uint32_t GetCommandBufferCaptureStartFrame()
+{
+	return g_config->capture_start_frame;
+}
+
+uint32_t GetCommandBufferCaptureFrames()
+{
+	return g_config->capture_frames;
+}
+
+bool SpirvTextAssemblerEnabled()
+{
+	return g_config->spirv_text_assembler;
+}
+
+bool ShaderPrefetchEnabled()
+{
+	return g_config->shader_prefetch_enabled;
+}
+
+bool ShaderCodeOptimizationEnabled()
+{
+	return g_config->shader_code_optimization;
+}
+
+bool PipelinePrewarmEnabled()
+{
+	return g_config->pipeline_prewarm_enabled;
+}
+
+bool GpuMipGenerationEnabled()
+{
+	return g_config->gpu_mip_generation_enabled;
+}
+
+bool GpuMemoryBudgetEnabled()
+{
+	return g_config->gpu_memory_budget_enabled;
+}
+
+uint32_t GetGpuMemoryBudgetUsage()
+{
+	return g_config->gpu_memory_budget_usage;
+}
+
+uint32_t GetCommandBufferSplitDraws()
+{
+	return g_config->command_buffer_split_draws;
+}
+
+uint32_t GetRenderScale()
+{
+	return g_config->render_scale;
+}
+
+uint32_t GetSampledHashInterval()
+{
+	return g_config->sampled_hash_interval;
+}
+
+uint32_t GetAsyncUploadThreshold()
+{
+	return g_config->async_upload_threshold;
+}
+
+uint32_t GetMutexSpinCount()
+{
+	return g_config->mutex_spin_count;
+}
+
+uint32_t GetJobWorkers()
+{
+	return g_config->job_workers;
+}
+
+uint32_t GetTraceLevel()
+{
+	return g_config->trace_level;
+}
+
+String GetTraceBinaryFile()
+{
+	return g_config->trace_binary_file;
+}
+
+bool FileMappingEnabled()
+{
+	return g_config->file_mapping_enabled;
+}
+
+bool FilePrefetchEnabled()
+{
+	return g_config->file_prefetch_enabled;
+}
+
+bool SaveDataWriteBehind()
+{
+	return g_config->save_data_write_behind;
+}
+
+bool SaveDataCompressed()
+{
+	return g_config->save_data_compressed;
+}
+
+bool TlsDirectAccess()
+{
+	return g_config->tls_direct_access;
+}
+
+bool ThreadAffinityEnabled()
+{
+	return g_config->thread_affinity_enabled;
+}
+
+uint32_t GetThreadAffinityEmulatorCores()
+{
+	return g_config->thread_affinity_emu_cores;
+}
+
+bool ThreadPriorityEnabled()
+{
+	return g_config->thread_priority_enabled;
+}
+
+bool RawTscEnabled()
+{
+	return g_config->raw_tsc_enabled;
+}
+
+bool LargePagesEnabled()
+{
+	return g_config->large_pages_enabled;
+}
+
+bool FlexibleMemoryLazy()
+{
+	return g_config->flexible_memory_lazy;
+}
+
+String GetStartupReportFile()
+{
+	return g_config->startup_report_file;
+}
+
+bool AudioOutputEnabled()
+{
+	return g_config->audio_output_enabled;
+}
+
+uint32_t GetAudioLatencyMs()
+{
+	return g_config->audio_latency_ms;
+}
+
 void SetNextGen(bool mode)
 {
 	g_config->next_gen = mode;
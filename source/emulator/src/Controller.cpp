@@ -2,6 +2,7 @@
 
 #include "Kyty/Core/Common.h"
 #include "Kyty/Core/DbgAssert.h"
+#include "Kyty/Core/File.h"
 #include "Kyty/Core/String.h"
 #include "Kyty/Core/Threads.h"
 #include "Kyty/Core/Vector.h"
@@ -9,6 +10,10 @@
 #include "Emulator/Kernel/Pthread.h"
 #include "Emulator/Libs/Errno.h"
 #include "Emulator/Libs/Libs.h"
+#include "Emulator/Loader/Timer.h"
+
+#include <algorithm>
+#include <atomic>
 
 #ifdef KYTY_EMU_ENABLED
 
@@ -85,6 +90,23 @@ struct ControllerState
 	int      axes[static_cast<int>(Axis::AxisMax)] = {128, 128, 128, 128, 0, 0};
 };
 
+// Recorded input: the magic, then a record for each state of the active controller, with the number of flips done before it
+constexpr uint32_t CONTROLLER_RECORD_MAGIC = 0x5043594b; // KYCP
+
+// The replayed input is a controller of its own, connected before the host ones, so they can't interfere
+constexpr int CONTROLLER_REPLAY_ID = 0x7fffffff;
+
+struct ControllerRecord
+{
+	uint32_t frame                                 = 0;
+	uint32_t buttons                               = 0;
+	int32_t  axes[static_cast<int>(Axis::AxisMax)] = {};
+};
+
+static std::atomic_uint32_t g_frame = 0;
+
+// States are written by the event thread and read by guest threads without locks. Connect(), Disconnect(), Button() and Axis() must
+// be called from the event thread only.
 class GameController
 {
 public:
@@ -95,34 +117,48 @@ public:
 
 	void Connect(int id);
 	void Disconnect(int id);
-	void Button(int id, uint32_t button, bool down);
-	void Axis(int id, Axis axis, int value);
+	void Button(int id, uint32_t button, bool down, uint64_t time);
+	void Axis(int id, Axis axis, int value, uint64_t time);
 	void GetConnectionInfo(bool* flag, int* count);
 	void ReadState(ControllerState* state, bool* flag, int* count);
 	int  ReadStates(ControllerState* states, int states_num, bool* flag, int* count);
 
+	void RecordStart(const String& file_name);
+	void RecordStop();
+	void ReplayStart(const String& file_name);
+	void ReplayUpdate(uint32_t frame);
+
 private:
 	static constexpr uint32_t STATES_MAX = 64;
 
-	struct StatePrivate
+	// State number N is valid when seq is 2N + 2, seq is odd while the state is written
+	struct StateSlot
 	{
-		bool obtained = false;
+		std::atomic_uint64_t seq = 0;
+		ControllerState      state;
 	};
 
 	void                          CheckActive();
 	[[nodiscard]] ControllerState GetLastState() const;
 	void                          AddState(const ControllerState& state);
+	bool                          CopyState(uint64_t num, ControllerState* state) const;
+	void                          Record(const ControllerState& state);
 
-	Core::Mutex     m_mutex;
+	// Event thread only
 	Vector<int>     m_connected_ids;
-	int             m_active_id       = -1;
-	bool            m_connected       = false;
-	int             m_connected_count = 0;
-	ControllerState m_states[STATES_MAX];
-	StatePrivate    m_private[STATES_MAX];
+	int             m_active_id = -1;
 	ControllerState m_last_state;
-	uint32_t        m_states_num  = 0;
-	uint32_t        m_first_state = 0;
+
+	Core::File*              m_record = nullptr;
+	Vector<ControllerRecord> m_replay;
+	uint32_t                 m_replay_pos = 0;
+
+	std::atomic_bool     m_connected       = false;
+	std::atomic_int      m_connected_count = 0;
+	StateSlot            m_states[STATES_MAX];
+	std::atomic_uint64_t m_write = 0; // states written
+	std::atomic_uint64_t m_read  = 0; // states returned by ReadStates()
+	std::atomic_uint64_t m_first = 0; // first state after the last reset
 };
 
 static GameController* g_controller = nullptr;
@@ -134,14 +170,18 @@ KYTY_SUBSYSTEM_INIT(Controller)
 	g_controller = new GameController;
 }
 
-KYTY_SUBSYSTEM_UNEXPECTED_SHUTDOWN(Controller) {}
+KYTY_SUBSYSTEM_UNEXPECTED_SHUTDOWN(Controller)
+{
+	g_controller->RecordStop();
+}
 
-KYTY_SUBSYSTEM_DESTROY(Controller) {}
+KYTY_SUBSYSTEM_DESTROY(Controller)
+{
+	g_controller->RecordStop();
+}
 
 void GameController::Connect(int id)
 {
-	Core::LockGuard lock(m_mutex);
-
 	EXIT_IF(m_connected_ids.Contains(id));
 
 	m_connected_ids.Add(id);
@@ -151,8 +191,6 @@ void GameController::Connect(int id)
 
 void GameController::Disconnect(int id)
 {
-	Core::LockGuard lock(m_mutex);
-
 	EXIT_IF(!m_connected_ids.Contains(id));
 
 	m_connected_ids.Remove(id);
@@ -193,50 +231,69 @@ void GameController::CheckActive()
 
 	if (reset)
 	{
-		m_states_num = 0;
-		m_last_state = ControllerState();
+		// The default state is the last one, but not returned by ReadStates()
+		AddState(ControllerState());
+
+		uint64_t write = m_write.load(std::memory_order_relaxed);
+		m_read.store(write, std::memory_order_release);
+		m_first.store(write, std::memory_order_release);
 	}
 }
 
-ControllerState GameController::GetLastState() const
+bool GameController::CopyState(uint64_t num, ControllerState* state) const
 {
-	if (m_states_num == 0)
+	const auto& slot = m_states[num % STATES_MAX];
+
+	uint64_t seq = slot.seq.load(std::memory_order_acquire);
+	if (seq != num * 2 + 2)
 	{
-		return m_last_state;
+		return false;
 	}
 
-	auto last = (m_first_state + m_states_num - 1) % STATES_MAX;
+	*state = slot.state;
+
+	std::atomic_thread_fence(std::memory_order_acquire);
 
-	return m_states[last];
+	return slot.seq.load(std::memory_order_relaxed) == seq;
 }
 
-void GameController::AddState(const ControllerState& state)
+ControllerState GameController::GetLastState() const
 {
-	if (m_states_num >= STATES_MAX)
+	ControllerState state;
+
+	for (;;)
 	{
-		m_states_num  = STATES_MAX - 1;
-		m_first_state = (m_first_state + 1) % STATES_MAX;
+		uint64_t write = m_write.load(std::memory_order_acquire);
+		if (write == 0 || CopyState(write - 1, &state))
+		{
+			return state;
+		}
 	}
+}
 
-	auto index = (m_first_state + m_states_num) % STATES_MAX;
+void GameController::AddState(const ControllerState& state)
+{
+	uint64_t num  = m_write.load(std::memory_order_relaxed);
+	auto&    slot = m_states[num % STATES_MAX];
 
-	m_states[index] = state;
-	m_last_state    = state;
+	slot.seq.store(num * 2 + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
 
-	m_private[index].obtained = false;
+	slot.state = state;
 
-	m_states_num++;
+	slot.seq.store(num * 2 + 2, std::memory_order_release);
+	m_write.store(num + 1, std::memory_order_release);
+
+	m_last_state = state;
 }
 
-void GameController::Button(int id, uint32_t button, bool down)
+void GameController::Button(int id, uint32_t button, bool down, uint64_t time)
 {
-	Core::LockGuard lock(m_mutex);
-
 	if (m_active_id == id)
 	{
-		auto state = GetLastState();
+		auto state = m_last_state;
 
-		state.time = LibKernel::KernelGetProcessTime();
+		state.time = time;
 
 		if (down)
 		{
@@ -247,18 +304,17 @@ void GameController::Button(int id, uint32_t button, bool down)
 		}
 
 		AddState(state);
+		Record(state);
 	}
 }
 
-void GameController::Axis(int id, Controller::Axis axis, int value)
+void GameController::Axis(int id, Controller::Axis axis, int value, uint64_t time)
 {
-	Core::LockGuard lock(m_mutex);
-
 	if (m_active_id == id)
 	{
-		auto state = GetLastState();
+		auto state = m_last_state;
 
-		state.time = LibKernel::KernelGetProcessTime();
+		state.time = time;
 
 		int axis_id = static_cast<int>(axis);
 
@@ -288,6 +344,98 @@ void GameController::Axis(int id, Controller::Axis axis, int value)
 			}
 		}
 
+		AddState(state);
+		Record(state);
+	}
+}
+
+void GameController::RecordStart(const String& file_name)
+{
+	EXIT_IF(m_record != nullptr);
+
+	m_record = new Core::File;
+
+	if (!m_record->Create(file_name))
+	{
+		EXIT("Can't create file: %s\n", file_name.C_Str());
+	}
+
+	m_record->Write(&CONTROLLER_RECORD_MAGIC, sizeof(CONTROLLER_RECORD_MAGIC));
+}
+
+void GameController::RecordStop()
+{
+	if (m_record != nullptr)
+	{
+		m_record->Close();
+		delete m_record;
+		m_record = nullptr;
+	}
+}
+
+void GameController::Record(const ControllerState& state)
+{
+	if (m_record == nullptr)
+	{
+		return;
+	}
+
+	ControllerRecord r;
+	r.frame   = g_frame.load(std::memory_order_relaxed);
+	r.buttons = state.buttons;
+	for (int i = 0; i < static_cast<int>(Axis::AxisMax); i++)
+	{
+		r.axes[i] = state.axes[i];
+	}
+
+	m_record->Write(&r, sizeof(r));
+}
+
+void GameController::ReplayStart(const String& file_name)
+{
+	EXIT_IF(!m_replay.IsEmpty());
+
+	Core::File f;
+	if (!f.Open(file_name, Core::File::Mode::Read))
+	{
+		EXIT("Can't open file: %s\n", file_name.C_Str());
+	}
+
+	uint32_t magic = 0;
+	f.Read(&magic, sizeof(magic));
+	EXIT_NOT_IMPLEMENTED(magic != CONTROLLER_RECORD_MAGIC);
+
+	auto num = (f.Size() - sizeof(magic)) / sizeof(ControllerRecord);
+	EXIT_NOT_IMPLEMENTED(num == 0);
+
+	Vector<ControllerRecord> replay(static_cast<uint32_t>(num));
+	uint64_t                 bytes_read = 0;
+	f.Read(replay.GetData(), num * sizeof(ControllerRecord), &bytes_read);
+	f.Close();
+
+	EXIT_NOT_IMPLEMENTED(bytes_read != num * sizeof(ControllerRecord));
+
+	m_replay = replay;
+
+	m_replay_pos = 0;
+
+	Connect(CONTROLLER_REPLAY_ID);
+}
+
+void GameController::ReplayUpdate(uint32_t frame)
+{
+	for (; m_replay_pos < m_replay.Size() && m_replay.At(m_replay_pos).frame <= frame; m_replay_pos++)
+	{
+		const auto& r = m_replay.At(m_replay_pos);
+
+		ControllerState state;
+		state.time    = Loader::Timer::GetTimeUs();
+		state.buttons = r.buttons;
+		for (int i = 0; i < static_cast<int>(Axis::AxisMax); i++)
+		{
+			state.axes[i] = r.axes[i];
+		}
+
 		AddState(state);
 	}
 }
@@ -297,8 +445,6 @@ void GameController::GetConnectionInfo(bool* flag, int* count)
 	EXIT_IF(flag == nullptr);
 	EXIT_IF(count == nullptr);
 
-	Core::LockGuard lock(m_mutex);
-
 	*flag  = m_connected;
 	*count = m_connected_count;
 }
@@ -309,53 +455,59 @@ void GameController::ReadState(ControllerState* state, bool* flag, int* count)
 	EXIT_IF(count == nullptr);
 	EXIT_IF(state == nullptr);
 
-	Core::LockGuard lock(m_mutex);
-
 	*flag  = m_connected;
 	*count = m_connected_count;
 	*state = GetLastState();
 }
 
+// Every state is returned once. The states are claimed by moving m_read, a state overwritten during the copy restarts the read.
 int GameController::ReadStates(ControllerState* states, int states_num, bool* flag, int* count)
 {
 	EXIT_IF(flag == nullptr);
 	EXIT_IF(count == nullptr);
 	EXIT_IF(states == nullptr);
-	EXIT_IF(states_num < 1 || states_num > STATES_MAX);
-
-	Core::LockGuard lock(m_mutex);
+	EXIT_IF(states_num < 1 || states_num > static_cast<int>(STATES_MAX));
 
 	*flag  = m_connected;
 	*count = m_connected_count;
 
-	int ret_num = 0;
+	if (!*flag)
+	{
+		return 0;
+	}
 
-	if (m_connected)
+	for (;;)
 	{
-		if (m_states_num == 0)
+		uint64_t read  = m_read.load(std::memory_order_acquire);
+		uint64_t first = m_first.load(std::memory_order_acquire);
+		uint64_t write = m_write.load(std::memory_order_acquire);
+
+		if (write == first)
 		{
-			ret_num   = 1;
-			states[0] = m_last_state;
-		} else
+			states[0] = GetLastState();
+			return 1;
+		}
+
+		// The oldest slot can be overwritten by the next state
+		uint64_t begin = std::max({read, first, (write >= STATES_MAX ? write - STATES_MAX + 1 : 0)});
+		uint64_t end   = std::min(write, begin + static_cast<uint64_t>(states_num));
+
+		if (begin >= end)
 		{
-			for (uint32_t i = 0; i < m_states_num; i++)
-			{
-				if (ret_num >= states_num)
-				{
-					break;
-				}
-				auto index = (m_first_state + i) % STATES_MAX;
-				if (!m_private[index].obtained)
-				{
-					m_private[index].obtained = true;
-
-					states[ret_num++] = m_states[index];
-				}
-			}
+			return 0;
 		}
-	}
 
-	return ret_num;
+		bool copied = true;
+		for (uint64_t num = begin; num < end && copied; num++)
+		{
+			copied = CopyState(num, &states[num - begin]);
+		}
+
+		if (copied && m_read.compare_exchange_strong(read, end, std::memory_order_acq_rel))
+		{
+			return static_cast<int>(end - begin);
+		}
+	}
 }
 
 void ControllerConnect(int id)
@@ -372,18 +524,44 @@ void ControllerDisconnect(int id)
 	g_controller->Disconnect(id);
 }
 
-void ControllerButton(int id, uint32_t button, bool down)
+void ControllerButton(int id, uint32_t button, bool down, uint64_t time)
 {
 	EXIT_IF(g_controller == nullptr);
 
-	g_controller->Button(id, button, down);
+	g_controller->Button(id, button, down, time);
 }
 
-void ControllerAxis(int id, Axis axis, int value)
+void ControllerAxis(int id, Axis axis, int value, uint64_t time)
 {
 	EXIT_IF(g_controller == nullptr);
 
-	g_controller->Axis(id, axis, value);
+	g_controller->Axis(id, axis, value, time);
+}
+
+void ControllerRecordStart(const String& file_name)
+{
+	EXIT_IF(g_controller == nullptr);
+
+	g_controller->RecordStart(file_name);
+}
+
+void ControllerReplayStart(const String& file_name)
+{
+	EXIT_IF(g_controller == nullptr);
+
+	g_controller->ReplayStart(file_name);
+}
+
+void ControllerReplayUpdate()
+{
+	EXIT_IF(g_controller == nullptr);
+
+	g_controller->ReplayUpdate(g_frame.load(std::memory_order_relaxed));
+}
+
+void ControllerFrameDone()
+{
+	g_frame.fetch_add(1, std::memory_order_relaxed);
 }
 
 int KYTY_SYSV_ABI PadInit()
@@ -0,0 +1,572 @@
+#include "Emulator/Graphics/Capture.h"
+
+#include "Kyty/Core/DbgAssert.h"
+#include "Kyty/Core/File.h"
+#include "Kyty/Core/String.h"
+#include "Kyty/Core/Threads.h"
+#include "Kyty/Core/Vector.h"
+#include "Kyty/Core/VirtualMemory.h"
+
+#include "Emulator/Config.h"
+#include "Emulator/Graphics/GraphicsRun.h"
+#include "Emulator/Graphics/Objects/GpuMemory.h"
+#include "Emulator/Graphics/Window.h"
+#include "Emulator/Kernel/Pthread.h"
+
+#include <algorithm>
+#include <cstring>
+#include <xxhash/xxhash.h>
+
+#ifdef KYTY_EMU_ENABLED
+
+namespace Kyty::Libs::Graphics {
+
+static constexpr uint32_t CAPTURE_MAGIC   = 0x5043594b; // "KYCP"
+static constexpr uint32_t CAPTURE_VERSION = 1;
+
+enum class CaptureRecord : uint32_t
+{
+	Range  = 1, // Contents of a GPU memory range, the range must be mapped on replay
+	Delta  = 2, // Pages of a range written by the CPU
+	Submit = 3,
+	Done   = 4,
+	End    = 5,
+};
+
+struct CaptureHeader
+{
+	uint32_t magic   = CAPTURE_MAGIC;
+	uint32_t version = CAPTURE_VERSION;
+};
+
+struct CaptureMemory
+{
+	uint64_t vaddr = 0;
+	uint64_t size  = 0;
+};
+
+struct CaptureSubmitInfo
+{
+	uint64_t dcb_vaddr = 0;
+	uint64_t ccb_vaddr = 0;
+	uint32_t dcb_dw    = 0;
+	uint32_t ccb_dw    = 0;
+	uint32_t flip      = 0;
+	int32_t  handle    = 0;
+	int32_t  index     = 0;
+	int32_t  flip_mode = 0;
+	int64_t  flip_arg  = 0;
+};
+
+class Capture
+{
+public:
+	static constexpr uint64_t PAGE_SIZE = 4096;
+
+	Capture() { EXIT_NOT_IMPLEMENTED(!Core::Thread::IsMainThread()); }
+	virtual ~Capture() { KYTY_NOT_IMPLEMENTED; }
+	KYTY_CLASS_NO_COPY(Capture);
+
+	void Submit(const uint32_t* cmd_draw_buffer, uint32_t num_draw_dw, const uint32_t* cmd_const_buffer, uint32_t num_const_dw,
+	            bool flip, int handle, int index, int flip_mode, int64_t flip_arg);
+	void Done();
+
+	void SetReplaying(bool flag)
+	{
+		Core::LockGuard lock(m_mutex);
+		m_replaying = flag;
+	}
+
+private:
+	enum class State
+	{
+		Waiting,
+		Capturing,
+		Finished
+	};
+
+	struct Snapshot
+	{
+		uint64_t         vaddr = 0;
+		uint64_t         size  = 0;
+		Vector<uint64_t> hashes;
+	};
+
+	bool Start();
+	void Finish();
+	void WriteChanges();
+	void WriteMemory(CaptureRecord type, uint64_t vaddr, uint64_t size);
+
+	Core::Mutex      m_mutex;
+	Core::File       m_file;
+	State            m_state     = State::Waiting;
+	uint32_t         m_frames    = 0;
+	bool             m_replaying = false;
+	Vector<Snapshot> m_snapshots;
+};
+
+static Capture* g_capture = nullptr;
+
+static void write_large(Core::File* f, const void* data, uint64_t size)
+{
+	static constexpr uint64_t CHUNK_SIZE = 64 * 1024 * 1024;
+
+	const auto* ptr = static_cast<const uint8_t*>(data);
+	while (size > 0)
+	{
+		auto chunk = std::min(size, CHUNK_SIZE);
+		f->Write(ptr, static_cast<uint32_t>(chunk));
+		ptr += chunk;
+		size -= chunk;
+	}
+}
+
+static bool read_large(Core::File* f, void* data, uint64_t size)
+{
+	static constexpr uint64_t CHUNK_SIZE = 64 * 1024 * 1024;
+
+	auto* ptr = static_cast<uint8_t*>(data);
+	while (size > 0)
+	{
+		auto     chunk      = std::min(size, CHUNK_SIZE);
+		uint32_t bytes_read = 0;
+		f->Read(ptr, static_cast<uint32_t>(chunk), &bytes_read);
+		if (bytes_read != chunk)
+		{
+			return false;
+		}
+		ptr += chunk;
+		size -= chunk;
+	}
+	return true;
+}
+
+template <class T>
+static void write_pod(Core::File* f, const T& v)
+{
+	f->Write(&v, sizeof(T));
+}
+
+template <class T>
+static bool read_pod(Core::File* f, T* v)
+{
+	uint32_t bytes_read = 0;
+	f->Read(v, sizeof(T), &bytes_read);
+	return bytes_read == sizeof(T);
+}
+
+static uint64_t page_hash(uint64_t vaddr, uint64_t size, uint64_t page)
+{
+	auto page_size = std::min(Capture::PAGE_SIZE, vaddr + size - page);
+	return XXH64(reinterpret_cast<const void*>(page), page_size, 0);
+}
+
+bool Capture::Start()
+{
+	auto file_name = Config::GetCommandBufferCaptureFile();
+
+	Core::File::CreateDirectories(file_name.DirectoryWithoutFilename());
+	m_file.Create(file_name);
+	if (m_file.IsInvalid())
+	{
+		printf(FG_BRIGHT_RED "Can't create file: %s\n" FG_DEFAULT, file_name.C_Str());
+		m_state = State::Finished;
+		return false;
+	}
+
+	printf("Capture started: %s\n", file_name.C_Str());
+
+	write_pod(&m_file, CaptureHeader());
+
+	m_state  = State::Capturing;
+	m_frames = 0;
+	m_snapshots.Clear();
+
+	return true;
+}
+
+void Capture::Finish()
+{
+	write_pod(&m_file, CaptureRecord::End);
+	m_file.Close();
+
+	m_state = State::Finished;
+	m_snapshots.Clear();
+
+	printf("Capture finished: %" PRIu32 " frames\n", m_frames);
+}
+
+void Capture::WriteMemory(CaptureRecord type, uint64_t vaddr, uint64_t size)
+{
+	CaptureMemory m;
+	m.vaddr = vaddr;
+	m.size  = size;
+
+	write_pod(&m_file, type);
+	write_pod(&m_file, m);
+	write_large(&m_file, reinterpret_cast<const void*>(vaddr), size);
+}
+
+void Capture::WriteChanges()
+{
+	// Ranges are rebuilt every time, so the memory released by the game is no longer read
+	auto             ranges = GpuMemoryGetAllocatedRanges();
+	Vector<Snapshot> snapshots;
+
+	for (const auto& r: ranges)
+	{
+		auto index = m_snapshots.Find(r, [](const Snapshot& s, const GpuMemoryRange& v) { return s.vaddr == v.vaddr && s.size == v.size; });
+
+		Snapshot s;
+		s.vaddr = r.vaddr;
+		s.size  = r.size;
+
+		uint64_t end = r.vaddr + r.size;
+
+		if (index == Vector<Snapshot>::INVALID_INDEX)
+		{
+			for (uint64_t page = r.vaddr; page < end; page += PAGE_SIZE)
+			{
+				s.hashes.Add(page_hash(r.vaddr, r.size, page));
+			}
+
+			WriteMemory(CaptureRecord::Range, r.vaddr, r.size);
+		} else
+		{
+			s.hashes = std::move(m_snapshots[index].hashes);
+
+			// Write adjacent changed pages with a single record
+			uint64_t run_vaddr = r.vaddr;
+			uint64_t run_size  = 0;
+			uint32_t p         = 0;
+
+			for (uint64_t page = r.vaddr; page < end; page += PAGE_SIZE, p++)
+			{
+				auto hash = page_hash(r.vaddr, r.size, page);
+				if (hash != s.hashes[p])
+				{
+					s.hashes[p] = hash;
+					if (run_vaddr + run_size != page)
+					{
+						if (run_size > 0)
+						{
+							WriteMemory(CaptureRecord::Delta, run_vaddr, run_size);
+						}
+						run_vaddr = page;
+						run_size  = 0;
+					}
+					run_size += std::min(PAGE_SIZE, end - page);
+				}
+			}
+
+			if (run_size > 0)
+			{
+				WriteMemory(CaptureRecord::Delta, run_vaddr, run_size);
+			}
+		}
+
+		snapshots.Add(std::move(s));
+	}
+
+	m_snapshots = std::move(snapshots);
+}
+
+void Capture::Submit(const uint32_t* cmd_draw_buffer, uint32_t num_draw_dw, const uint32_t* cmd_const_buffer, uint32_t num_const_dw,
+                     bool flip, int handle, int index, int flip_mode, int64_t flip_arg)
+{
+	Core::LockGuard lock(m_mutex);
+
+	if (m_replaying || m_state == State::Finished)
+	{
+		return;
+	}
+
+	if (m_state == State::Waiting)
+	{
+		if (static_cast<uint32_t>(GraphicsRunGetFrameNum()) < Config::GetCommandBufferCaptureStartFrame() || !Start())
+		{
+			return;
+		}
+	}
+
+	WriteChanges();
+
+	CaptureSubmitInfo info;
+	info.dcb_vaddr = reinterpret_cast<uint64_t>(cmd_draw_buffer);
+	info.ccb_vaddr = reinterpret_cast<uint64_t>(cmd_const_buffer);
+	info.dcb_dw    = (cmd_draw_buffer != nullptr ? num_draw_dw : 0);
+	info.ccb_dw    = (cmd_const_buffer != nullptr ? num_const_dw : 0);
+	info.flip      = (flip ? 1 : 0);
+	info.handle    = handle;
+	info.index     = index;
+	info.flip_mode = flip_mode;
+	info.flip_arg  = flip_arg;
+
+	// Command buffers are stored with the submit, they don't have to be inside of the GPU memory
+	write_pod(&m_file, CaptureRecord::Submit);
+	write_pod(&m_file, info);
+	write_large(&m_file, cmd_draw_buffer, static_cast<uint64_t>(info.dcb_dw) * 4);
+	write_large(&m_file, cmd_const_buffer, static_cast<uint64_t>(info.ccb_dw) * 4);
+}
+
+void Capture::Done()
+{
+	Core::LockGuard lock(m_mutex);
+
+	if (m_replaying || m_state != State::Capturing)
+	{
+		return;
+	}
+
+	write_pod(&m_file, CaptureRecord::Done);
+	m_file.Flush();
+
+	m_frames++;
+
+	if (m_frames >= Config::GetCommandBufferCaptureFrames())
+	{
+		Finish();
+	}
+}
+
+class CaptureReplayer
+{
+public:
+	explicit CaptureReplayer(Core::File* file): m_file(file) {}
+	virtual ~CaptureReplayer() = default;
+	KYTY_CLASS_NO_COPY(CaptureReplayer);
+
+	bool Run(uint32_t loop);
+
+	[[nodiscard]] const Vector<double>& GetFrameTimes() const { return m_frame_times; }
+
+private:
+	void Map(uint64_t vaddr, uint64_t size);
+	bool ReadMemory(uint64_t vaddr, uint64_t size);
+
+	Core::File*           m_file = nullptr;
+	Vector<CaptureMemory> m_mapped;
+	Vector<double>        m_frame_times;
+	uint64_t              m_frame_start = 0;
+	uint64_t              m_frame_io    = 0;
+	bool                  m_frame_open  = false;
+};
+
+void CaptureReplayer::Map(uint64_t vaddr, uint64_t size)
+{
+	static constexpr uint64_t ALIGN = 64 * 1024;
+
+	for (const auto& m: m_mapped)
+	{
+		if (vaddr >= m.vaddr && vaddr + size <= m.vaddr + m.size)
+		{
+			return;
+		}
+		EXIT_NOT_IMPLEMENTED(vaddr < m.vaddr + m.size && m.vaddr < vaddr + size);
+	}
+
+	CaptureMemory m;
+	m.vaddr = vaddr & ~(ALIGN - 1);
+	m.size  = ((vaddr + size + ALIGN - 1) & ~(ALIGN - 1)) - m.vaddr;
+
+	if (!Core::VirtualMemory::AllocFixed(m.vaddr, m.size, Core::VirtualMemory::Mode::ReadWrite))
+	{
+		EXIT("Can't map memory: 0x%016" PRIx64 ", 0x%016" PRIx64 "\n", m.vaddr, m.size);
+	}
+
+	m_mapped.Add(m);
+}
+
+bool CaptureReplayer::ReadMemory(uint64_t vaddr, uint64_t size)
+{
+	// Written pages are no longer valid for the cached objects
+	GpuMemoryCheckAccessViolation(vaddr, size);
+
+	return read_large(m_file, reinterpret_cast<void*>(vaddr), size);
+}
+
+bool CaptureReplayer::Run(uint32_t loop)
+{
+	CaptureHeader header;
+
+	m_file->Seek(0);
+	if (!read_pod(m_file, &header) || header.magic != CAPTURE_MAGIC || header.version != CAPTURE_VERSION)
+	{
+		printf(FG_BRIGHT_RED "Invalid capture file\n" FG_DEFAULT);
+		return false;
+	}
+
+	m_frame_times.Clear();
+	m_frame_open = false;
+
+	for (;;)
+	{
+		CaptureRecord type = CaptureRecord::End;
+		if (!read_pod(m_file, &type))
+		{
+			// Capture was interrupted
+			break;
+		}
+
+		switch (type)
+		{
+			case CaptureRecord::Range:
+			case CaptureRecord::Delta:
+			{
+				CaptureMemory m;
+				EXIT_NOT_IMPLEMENTED(!read_pod(m_file, &m));
+				if (type == CaptureRecord::Range && loop == 0)
+				{
+					Map(m.vaddr, m.size);
+					GpuMemorySetAllocatedRange(m.vaddr, m.size);
+				}
+				// File reads are not counted in the frame time
+				GraphicsRunWait();
+				auto io_start = LibKernel::KernelGetProcessTime();
+				EXIT_NOT_IMPLEMENTED(!ReadMemory(m.vaddr, m.size));
+				m_frame_io += LibKernel::KernelGetProcessTime() - io_start;
+				break;
+			}
+			case CaptureRecord::Submit:
+			{
+				CaptureSubmitInfo info;
+				EXIT_NOT_IMPLEMENTED(!read_pod(m_file, &info));
+				EXIT_NOT_IMPLEMENTED(info.dcb_dw == 0);
+
+				auto io_start = LibKernel::KernelGetProcessTime();
+
+				if (!m_frame_open)
+				{
+					m_frame_open  = true;
+					m_frame_start = io_start;
+					m_frame_io    = 0;
+				}
+
+				for (const auto& cb: {CaptureMemory {info.dcb_vaddr, static_cast<uint64_t>(info.dcb_dw) * 4},
+				                      CaptureMemory {info.ccb_vaddr, static_cast<uint64_t>(info.ccb_dw) * 4}})
+				{
+					if (cb.size > 0)
+					{
+						Vector<uint8_t> buf(static_cast<uint32_t>(cb.size));
+						EXIT_NOT_IMPLEMENTED(!read_large(m_file, buf.GetData(), cb.size));
+						m_frame_io += LibKernel::KernelGetProcessTime() - io_start;
+						Map(cb.vaddr, cb.size);
+						if (std::memcmp(buf.GetDataConst(), reinterpret_cast<const void*>(cb.vaddr), cb.size) != 0)
+						{
+							GraphicsRunWait();
+							GpuMemoryCheckAccessViolation(cb.vaddr, cb.size);
+							std::memcpy(reinterpret_cast<void*>(cb.vaddr), buf.GetDataConst(), cb.size);
+						}
+					}
+				}
+
+				auto* dcb = reinterpret_cast<uint32_t*>(info.dcb_vaddr);
+				auto* ccb = reinterpret_cast<uint32_t*>(info.ccb_vaddr);
+
+				if (info.flip != 0)
+				{
+					// There is no video out, flip packets only write their labels
+					GraphicsRunSubmitAndFlip(dcb, info.dcb_dw, ccb, info.ccb_dw, GRAPHICS_RUN_FLIP_HANDLE_NONE, info.index, info.flip_mode,
+					                         info.flip_arg);
+				} else
+				{
+					GraphicsRunSubmit(dcb, info.dcb_dw, ccb, info.ccb_dw);
+				}
+				break;
+			}
+			case CaptureRecord::Done:
+			{
+				GraphicsRunDone();
+				GraphicsRunWait();
+				GpuMemoryFrameDone(WindowGetGraphicContext());
+				if (m_frame_open)
+				{
+					auto time = LibKernel::KernelGetProcessTime() - m_frame_start - m_frame_io;
+					m_frame_times.Add(static_cast<double>(time) / 1000.0);
+					m_frame_open = false;
+				}
+				break;
+			}
+			case CaptureRecord::End: return true;
+			default: printf(FG_BRIGHT_RED "Invalid capture record: %" PRIu32 "\n" FG_DEFAULT, static_cast<uint32_t>(type)); return false;
+		}
+	}
+
+	return true;
+}
+
+void CaptureInit()
+{
+	EXIT_IF(g_capture != nullptr);
+
+	g_capture = new Capture;
+}
+
+void CaptureSubmit(const uint32_t* cmd_draw_buffer, uint32_t num_draw_dw, const uint32_t* cmd_const_buffer, uint32_t num_const_dw,
+                   bool flip, int handle, int index, int flip_mode, int64_t flip_arg)
+{
+	EXIT_IF(g_capture == nullptr);
+
+	if (Config::CommandBufferCaptureEnabled())
+	{
+		g_capture->Submit(cmd_draw_buffer, num_draw_dw, cmd_const_buffer, num_const_dw, flip, handle, index, flip_mode, flip_arg);
+	}
+}
+
+void CaptureDone()
+{
+	EXIT_IF(g_capture == nullptr);
+
+	if (Config::CommandBufferCaptureEnabled())
+	{
+		g_capture->Done();
+	}
+}
+
+void CaptureReplay(const String& file_name, uint32_t loops)
+{
+	EXIT_IF(g_capture == nullptr);
+
+	Core::File f;
+	f.Open(file_name, Core::File::Mode::Read);
+	if (f.IsInvalid())
+	{
+		printf(FG_BRIGHT_RED "Can't open file: %s\n" FG_DEFAULT, file_name.C_Str());
+		return;
+	}
+
+	g_capture->SetReplaying(true);
+
+	CaptureReplayer replayer(&f);
+
+	for (uint32_t loop = 0; loop < loops; loop++)
+	{
+		if (!replayer.Run(loop))
+		{
+			break;
+		}
+
+		const auto& times = replayer.GetFrameTimes();
+
+		double total    = 0.0;
+		double time_min = (times.IsEmpty() ? 0.0 : times[0]);
+		double time_max = 0.0;
+		for (auto t: times)
+		{
+			time_min = std::min(time_min, t);
+			time_max = std::max(time_max, t);
+			total += t;
+		}
+
+		printf("Replay %" PRIu32 ": frames = %" PRIu32 ", total = %.3f ms, avg = %.3f ms, min = %.3f ms, max = %.3f ms\n", loop,
+		       times.Size(), total, (times.IsEmpty() ? 0.0 : total / times.Size()), time_min, time_max);
+	}
+
+	f.Close();
+
+	g_capture->SetReplaying(false);
+}
+
+} // namespace Kyty::Libs::Graphics
+
+#endif // KYTY_EMU_ENABLED
@@ -0,0 +1,163 @@
+#include "Emulator/Graphics/DumpWriter.h"
+
+#include "Kyty/Core/BufferPool.h"
+#include "Kyty/Core/ByteBuffer.h"
+#include "Kyty/Core/Compression.h"
+#include "Kyty/Core/DbgAssert.h"
+#include "Kyty/Core/File.h"
+#include "Kyty/Core/String.h"
+#include "Kyty/Core/Threads.h"
+#include "Kyty/Core/Vector.h"
+
+#include "Emulator/Config.h"
+
+#ifdef KYTY_EMU_ENABLED
+
+namespace Kyty::Libs::Graphics {
+
+struct DumpWriterItem
+{
+	String           file_name;
+	Core::ByteBuffer data;
+};
+
+struct DumpWriter
+{
+	Core::Mutex            mutex {"DumpWriter"};
+	Core::CondVar          cond_var;
+	Vector<DumpWriterItem> queue;
+	uint64_t               queued_size  = 0;
+	uint64_t               queue_limit  = 0;
+	uint32_t               writing_num  = 0;
+	bool                   compressed   = false;
+	bool                   thread_ready = false;
+};
+
+static DumpWriter* g_dump_writer = nullptr;
+
+static void dump_write(const DumpWriterItem& item, bool compressed)
+{
+	Core::File::CreateDirectories(item.file_name.DirectoryWithoutFilename());
+
+	String     file_name = (compressed ? item.file_name + U".zst" : item.file_name);
+	Core::File f;
+	f.Create(file_name);
+	if (f.IsInvalid())
+	{
+		printf(FG_BRIGHT_RED "Can't create file: %s\n" FG_DEFAULT, file_name.C_Str());
+		return;
+	}
+
+	if (compressed)
+	{
+		Core::ByteBufferLease buf(item.data.Size());
+		Core::CompressZstd(reinterpret_cast<const uint8_t*>(item.data.GetDataConst()), item.data.Size(), buf.Get(),
+		                   Core::ZSTD_BEST_SPEED);
+		f.Write(*buf);
+	} else
+	{
+		f.Write(item.data);
+	}
+
+	f.Close();
+}
+
+static void dump_writer_thread(void* /*arg*/)
+{
+	auto* w = g_dump_writer;
+
+	for (;;)
+	{
+		DumpWriterItem item;
+
+		{
+			Core::LockGuard lock(w->mutex);
+
+			while (w->queue.IsEmpty())
+			{
+				w->cond_var.Wait(&w->mutex);
+			}
+
+			item = w->queue.At(0);
+			w->queue.RemoveAt(0);
+			w->writing_num++;
+		}
+
+		dump_write(item, w->compressed);
+
+		{
+			Core::LockGuard lock(w->mutex);
+
+			w->queued_size -= item.data.Size();
+			w->writing_num--;
+			w->cond_var.SignalAll();
+		}
+	}
+}
+
+void DumpWriterInit()
+{
+	EXIT_IF(g_dump_writer != nullptr);
+
+	g_dump_writer = new DumpWriter;
+
+	g_dump_writer->compressed  = Config::DumpsCompressed();
+	g_dump_writer->queue_limit = static_cast<uint64_t>(Config::GetDumpQueueSize()) * 1024 * 1024;
+
+	if (Config::GetShaderLogDirection() == Config::ShaderLogDirection::File || Config::PipelineDumpEnabled() ||
+	    Config::CommandBufferDumpEnabled())
+	{
+		Core::Thread t(dump_writer_thread, nullptr);
+		t.Detach();
+
+		g_dump_writer->thread_ready = true;
+	}
+}
+
+void DumpWriterPush(const String& file_name, Core::File* f)
+{
+	EXIT_IF(g_dump_writer == nullptr || !g_dump_writer->thread_ready);
+	EXIT_IF(f == nullptr || f->IsInvalid());
+
+	DumpWriterItem item;
+	item.file_name = file_name;
+
+	f->Seek(0);
+	f->ReadWholeBuffer(&item.data);
+	f->Close();
+
+	auto* w = g_dump_writer;
+
+	Core::LockGuard lock(w->mutex);
+
+	// A dump larger than the limit is queued alone
+	while (w->queued_size != 0 && w->queued_size + item.data.Size() > w->queue_limit)
+	{
+		w->cond_var.Wait(&w->mutex);
+	}
+
+	w->queued_size += item.data.Size();
+	w->queue.Add(item);
+	w->cond_var.SignalAll();
+}
+
+void DumpWriterFlush()
+{
+	auto* w = g_dump_writer;
+
+	if (w == nullptr || !w->thread_ready)
+	{
+		return;
+	}
+
+	Core::LockGuard lock(w->mutex);
+
+	while (!w->queue.IsEmpty() || w->writing_num != 0)
+	{
+		w->cond_var.Wait(&w->mutex);
+	}
+}
+
+} // namespace Kyty::Libs::Graphics
+
+#endif // KYTY_EMU_ENABLED
@@ -0,0 +1,77 @@
+#include "Emulator/Graphics/GpuCounters.h"
+
+#include "Kyty/Core/DbgAssert.h"
+#include "Kyty/Core/MagicEnum.h"
+
+#include "Emulator/Config.h"
+
+#include <algorithm>
+#include <atomic>
+
+#ifdef KYTY_EMU_ENABLED
+
+namespace Kyty::Libs::Graphics {
+
+static constexpr int COUNTERS_NUM = static_cast<int>(GpuCounter::Max);
+
+static std::atomic_uint64_t g_counters[COUNTERS_NUM];
+static std::atomic_uint64_t g_last_frame[COUNTERS_NUM];
+
+void GpuCounterAdd(GpuCounter counter, uint64_t value)
+{
+	if (Config::GpuCountersEnabled())
+	{
+		EXIT_IF(counter >= GpuCounter::Max);
+
+		g_counters[static_cast<int>(counter)].fetch_add(value, std::memory_order_relaxed);
+	}
+}
+
+void GpuCountersFrameDone()
+{
+	if (!Config::GpuCountersEnabled())
+	{
+		return;
+	}
+
+	String text;
+
+	for (int i = 0; i < COUNTERS_NUM; i++)
+	{
+		auto value = g_counters[i].exchange(0, std::memory_order_relaxed);
+		g_last_frame[i].store(value, std::memory_order_relaxed);
+
+		text += String::FromPrintf("%s%s = %" PRIu64, (i == 0 ? "" : ", "), Core::EnumName(static_cast<GpuCounter>(i)).C_Str(), value);
+	}
+
+	printf("GpuCounters: %s\n", text.C_Str());
+}
+
+uint64_t GpuCountersGetLastFrame(GpuCounter counter)
+{
+	EXIT_IF(counter >= GpuCounter::Max);
+
+	return g_last_frame[static_cast<int>(counter)].load(std::memory_order_relaxed);
+}
+
+String GpuCountersGetText()
+{
+	if (!Config::GpuCountersEnabled())
+	{
+		return {};
+	}
+
+	auto get = [](GpuCounter c) { return g_last_frame[static_cast<int>(c)].load(std::memory_order_relaxed); };
+
+	return String::FromPrintf("draws: %" PRIu64 ", dispatches: %" PRIu64 ", pipelines: %" PRIu64 "/%" PRIu64 ", shaders: %" PRIu64
+	                          ", sets: %" PRIu64 ", upload: %" PRIu64 " KB, hash: %" PRIu64 " KB, detile: %" PRIu64
+	                          " us, vblank jitter: %" PRIu64 " us",
+	                          get(GpuCounter::Draws), get(GpuCounter::Dispatches), get(GpuCounter::PipelineCacheHits),
+	                          get(GpuCounter::PipelineCacheMisses), get(GpuCounter::ShaderTranslations), get(GpuCounter::DescriptorSets),
+	                          get(GpuCounter::BytesUploaded) / 1024, get(GpuCounter::BytesHashed) / 1024, get(GpuCounter::DetileTimeUs),
+	                          get(GpuCounter::VblankJitterUs) / std::max(get(GpuCounter::Vblanks), static_cast<uint64_t>(1)));
+}
+
+} // namespace Kyty::Libs::Graphics
+
+#endif // KYTY_EMU_ENABLED
@@ -0,0 +1,455 @@
+#include "Emulator/Graphics/GpuProfiler.h"
+
+#include "Kyty/Core/DbgAssert.h"
+#include "Kyty/Core/File.h"
+#include "Kyty/Core/String.h"
+#include "Kyty/Core/Threads.h"
+#include "Kyty/Core/Vector.h"
+
+#include "Emulator/Config.h"
+#include "Emulator/Graphics/GraphicContext.h"
+#include "Emulator/Graphics/GraphicsRun.h"
+#include "Emulator/Kernel/Pthread.h"
+#include "Emulator/Profiler.h"
+
+#include <algorithm>
+
+#ifdef KYTY_EMU_ENABLED
+
+namespace Kyty::Libs::Graphics {
+
+struct GpuProfilerQueries
+{
+	static constexpr uint32_t QUERIES_MAX = 4096;
+	static constexpr uint32_t DROPPED     = static_cast<uint32_t>(-1);
+
+	struct Scope
+	{
+		const char* category    = nullptr;
+		const char* name        = nullptr;
+		uint32_t    begin_query = DROPPED;
+		uint32_t    end_query   = DROPPED;
+		int         frame       = 0;
+	};
+
+	VkQueryPool pool        = nullptr;
+	int         queue       = -1;
+	uint32_t    queries_num = 0;
+	// Queries which may have been written since the last reset. Stays at maximum until the reset is known to be executed.
+	uint32_t      reset_num   = QUERIES_MAX;
+	uint64_t      submit_time = 0;
+	bool          submitted   = false;
+	Vector<Scope> scopes;
+	Vector<int>   open_scopes;
+};
+
+class GpuProfiler
+{
+public:
+	static constexpr uint32_t EVENTS_MAX = 4 * 1024 * 1024;
+
+	GpuProfiler() { EXIT_NOT_IMPLEMENTED(!Core::Thread::IsMainThread()); }
+	virtual ~GpuProfiler() { KYTY_NOT_IMPLEMENTED; }
+	KYTY_CLASS_NO_COPY(GpuProfiler);
+
+	GpuProfilerQueries* Acquire(GraphicContext* ctx, int queue);
+	void                Release(GpuProfilerQueries* queries);
+	void                Collect(GraphicContext* ctx, GpuProfilerQueries* queries);
+	void                Save(const String& file_name);
+	void                WriteEvents(Core::File* f, int pid);
+
+private:
+	struct Event
+	{
+		const char* category = nullptr;
+		const char* name     = nullptr;
+		int         queue    = -1;
+		int         frame    = 0;
+		double      begin_us = 0.0;
+		double      end_us   = 0.0;
+	};
+
+	Core::Mutex                 m_mutex;
+	Vector<GpuProfilerQueries*> m_free;
+	Vector<Event>               m_events;
+	bool                        m_calibrated = false;
+	bool                        m_overflow   = false;
+	uint64_t                    m_gpu_base   = 0;
+	double                      m_cpu_base   = 0.0;
+};
+
+static GpuProfiler* g_gpu_profiler = nullptr;
+
+static const char* queue_name(int queue)
+{
+	switch (queue)
+	{
+		case GraphicContext::QUEUE_GFX: return "Gfx";
+		case GraphicContext::QUEUE_UTIL: return "Util";
+		case GraphicContext::QUEUE_PRESENT: return "Present";
+		default: return "Compute";
+	}
+}
+
+GpuProfilerQueries* GpuProfiler::Acquire(GraphicContext* ctx, int queue)
+{
+	EXIT_IF(ctx == nullptr);
+	EXIT_IF(queue < 0 || queue >= GraphicContext::QUEUES_NUM);
+
+	if (ctx->timestamp_period == 0.0f || !ctx->queues[queue].timestamps)
+	{
+		return nullptr;
+	}
+
+	Core::LockGuard lock(m_mutex);
+
+	GpuProfilerQueries* queries = nullptr;
+
+	if (!m_free.IsEmpty())
+	{
+		queries = m_free[m_free.Size() - 1];
+		m_free.RemoveAt(m_free.Size() - 1);
+	} else
+	{
+		queries = new GpuProfilerQueries;
+
+		VkQueryPoolCreateInfo pool_info {};
+		pool_info.sType      = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+		pool_info.pNext      = nullptr;
+		pool_info.flags      = 0;
+		pool_info.queryType  = VK_QUERY_TYPE_TIMESTAMP;
+		pool_info.queryCount = GpuProfilerQueries::QUERIES_MAX;
+
+		vkCreateQueryPool(ctx->device, &pool_info, nullptr, &queries->pool);
+		EXIT_NOT_IMPLEMENTED(queries->pool == nullptr);
+	}
+
+	queries->queue       = queue;
+	queries->queries_num = 0;
+	queries->submitted   = false;
+	queries->scopes.Clear();
+	queries->open_scopes.Clear();
+
+	return queries;
+}
+
+void GpuProfiler::Release(GpuProfilerQueries* queries)
+{
+	EXIT_IF(queries == nullptr);
+
+	Core::LockGuard lock(m_mutex);
+
+	m_free.Add(queries);
+}
+
+void GpuProfiler::Collect(GraphicContext* ctx, GpuProfilerQueries* queries)
+{
+	KYTY_PROFILER_FUNCTION();
+
+	EXIT_IF(ctx == nullptr);
+	EXIT_IF(queries == nullptr);
+
+	if (!queries->submitted)
+	{
+		return;
+	}
+
+	queries->submitted = false;
+
+	uint32_t num = queries->queries_num;
+
+	if (num != 0)
+	{
+		Vector<uint64_t> results(num);
+
+		auto result = vkGetQueryPoolResults(ctx->device, queries->pool, 0, num, sizeof(uint64_t) * num, results.GetData(), sizeof(uint64_t),
+		                                    VK_QUERY_RESULT_64_BIT);
+
+		if (result == VK_SUCCESS)
+		{
+			Core::LockGuard lock(m_mutex);
+
+			double us_per_tick = static_cast<double>(ctx->timestamp_period) / 1000.0;
+
+			// GPU ticks are mapped to the CPU process time once, by the first buffer ever submitted
+			if (!m_calibrated)
+			{
+				m_gpu_base   = UINT64_MAX;
+				m_cpu_base   = static_cast<double>(queries->submit_time);
+				m_calibrated = true;
+				for (const auto& s: queries->scopes)
+				{
+					if (s.begin_query != GpuProfilerQueries::DROPPED)
+					{
+						m_gpu_base = std::min(m_gpu_base, results[s.begin_query]);
+					}
+				}
+			}
+
+			for (const auto& s: queries->scopes)
+			{
+				if (s.begin_query == GpuProfilerQueries::DROPPED)
+				{
+					continue;
+				}
+
+				if (m_events.Size() >= EVENTS_MAX)
+				{
+					if (!m_overflow)
+					{
+						printf(FG_BRIGHT_RED "GpuProfiler: too many events, the rest is dropped\n" FG_DEFAULT);
+						m_overflow = true;
+					}
+					break;
+				}
+
+				Event e;
+				e.category = s.category;
+				e.name     = s.name;
+				e.queue    = queries->queue;
+				e.frame    = s.frame;
+				e.begin_us = m_cpu_base + static_cast<double>(static_cast<int64_t>(results[s.begin_query] - m_gpu_base)) * us_per_tick;
+				e.end_us   = m_cpu_base + static_cast<double>(static_cast<int64_t>(results[s.end_query] - m_gpu_base)) * us_per_tick;
+
+				m_events.Add(e);
+			}
+		}
+	}
+
+	queries->reset_num   = num;
+	queries->queries_num = 0;
+	queries->scopes.Clear();
+}
+
+void GpuProfiler::Save(const String& file_name)
+{
+	Core::LockGuard lock(m_mutex);
+
+	if (m_events.IsEmpty())
+	{
+		return;
+	}
+
+	Core::File::CreateDirectories(file_name.DirectoryWithoutFilename());
+
+	Core::File f;
+	f.Create(file_name);
+	if (f.IsInvalid())
+	{
+		printf(FG_BRIGHT_RED "Can't create file: %s\n" FG_DEFAULT, file_name.C_Str());
+		return;
+	}
+
+	f.Printf("{\"traceEvents\":[\n");
+	WriteEvents(&f, 1);
+	f.Printf("{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"GPU\"}}\n");
+	f.Printf("]}\n");
+
+	f.Close();
+
+	printf("GpuProfiler: %u events saved to %s\n", m_events.Size(), file_name.C_Str());
+}
+
+void GpuProfiler::WriteEvents(Core::File* f, int pid)
+{
+	Core::LockGuard lock(m_mutex);
+
+	if (m_events.IsEmpty())
+	{
+		return;
+	}
+
+	struct FrameSpan
+	{
+		double begin_us = 0.0;
+		double end_us   = 0.0;
+		bool   valid    = false;
+	};
+
+	int frame_min = m_events[0].frame;
+	int frame_max = m_events[0].frame;
+	for (const auto& e: m_events)
+	{
+		frame_min = std::min(frame_min, e.frame);
+		frame_max = std::max(frame_max, e.frame);
+	}
+
+	Vector<FrameSpan> frames(static_cast<uint32_t>(frame_max - frame_min + 1));
+	bool              queue_used[GraphicContext::QUEUES_NUM] = {};
+
+	for (const auto& e: m_events)
+	{
+		f->Printf("{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%d,\"tid\":%d,\"args\":{\"frame\":%d}},\n",
+		          e.name, e.category, e.begin_us, std::max(e.end_us - e.begin_us, 0.0), pid, e.queue, e.frame);
+
+		auto& span = frames[static_cast<uint32_t>(e.frame - frame_min)];
+		if (!span.valid)
+		{
+			span.begin_us = e.begin_us;
+			span.end_us   = e.end_us;
+			span.valid    = true;
+		} else
+		{
+			span.begin_us = std::min(span.begin_us, e.begin_us);
+			span.end_us   = std::max(span.end_us, e.end_us);
+		}
+
+		queue_used[e.queue] = true;
+	}
+
+	for (uint32_t i = 0; i < frames.Size(); i++)
+	{
+		const auto& span = frames[i];
+		if (span.valid)
+		{
+			f->Printf("{\"name\":\"Frame %d\",\"cat\":\"frame\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%d,\"tid\":%d},\n",
+			          frame_min + static_cast<int>(i), span.begin_us, span.end_us - span.begin_us, pid, GraphicContext::QUEUES_NUM);
+		}
+	}
+
+	for (int queue = 0; queue < GraphicContext::QUEUES_NUM; queue++)
+	{
+		if (queue_used[queue])
+		{
+			f->Printf("{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"GPU %s %d\"}},\n", pid,
+			          queue, queue_name(queue), queue);
+		}
+	}
+
+	f->Printf("{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"GPU Frames\"}},\n", pid,
+	          GraphicContext::QUEUES_NUM);
+}
+
+void GpuProfilerInit()
+{
+	EXIT_IF(g_gpu_profiler != nullptr);
+
+	if (Config::GpuProfilerEnabled())
+	{
+		g_gpu_profiler = new GpuProfiler;
+	}
+}
+
+void GpuProfilerSave()
+{
+	if (g_gpu_profiler != nullptr)
+	{
+		g_gpu_profiler->Save(Config::GetGpuProfilerOutputFile());
+	}
+}
+
+void GpuProfilerWriteTraceEvents(Core::File* f, int pid)
+{
+	EXIT_IF(f == nullptr);
+
+	if (g_gpu_profiler != nullptr)
+	{
+		g_gpu_profiler->WriteEvents(f, pid);
+	}
+}
+
+GpuProfilerQueries* GpuProfilerAcquire(GraphicContext* ctx, int queue)
+{
+	return (g_gpu_profiler != nullptr ? g_gpu_profiler->Acquire(ctx, queue) : nullptr);
+}
+
+void GpuProfilerRelease(GpuProfilerQueries* queries)
+{
+	if (queries != nullptr)
+	{
+		EXIT_IF(g_gpu_profiler == nullptr);
+
+		g_gpu_profiler->Release(queries);
+	}
+}
+
+void GpuProfilerBegin(GpuProfilerQueries* queries, VkCommandBuffer vk_buffer)
+{
+	if (queries != nullptr)
+	{
+		if (queries->reset_num != 0)
+		{
+			vkCmdResetQueryPool(vk_buffer, queries->pool, 0, queries->reset_num);
+		}
+
+		queries->queries_num = 0;
+		queries->scopes.Clear();
+		queries->open_scopes.Clear();
+	}
+}
+
+void GpuProfilerEnd(GpuProfilerQueries* queries, VkCommandBuffer vk_buffer)
+{
+	if (queries != nullptr)
+	{
+		while (!queries->open_scopes.IsEmpty())
+		{
+			GpuProfilerEndScope(queries, vk_buffer);
+		}
+
+		queries->reset_num = std::max(queries->reset_num, queries->queries_num);
+	}
+}
+
+void GpuProfilerSubmit(GpuProfilerQueries* queries)
+{
+	if (queries != nullptr)
+	{
+		queries->submit_time = LibKernel::KernelGetProcessTime();
+		queries->submitted   = true;
+	}
+}
+
+void GpuProfilerCollect(GraphicContext* ctx, GpuProfilerQueries* queries)
+{
+	if (queries != nullptr)
+	{
+		EXIT_IF(g_gpu_profiler == nullptr);
+
+		g_gpu_profiler->Collect(ctx, queries);
+	}
+}
+
+void GpuProfilerBeginScope(GpuProfilerQueries* queries, VkCommandBuffer vk_buffer, const char* category, const char* name)
+{
+	if (queries != nullptr)
+	{
+		GpuProfilerQueries::Scope s;
+		s.category = category;
+		s.name     = name;
+		s.frame    = GraphicsRunGetFrameNum();
+
+		if (queries->queries_num + 2 <= GpuProfilerQueries::QUERIES_MAX)
+		{
+			s.begin_query = queries->queries_num++;
+			s.end_query   = queries->queries_num++;
+
+			vkCmdWriteTimestamp(vk_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, queries->pool, s.begin_query);
+		}
+
+		queries->open_scopes.Add(static_cast<int>(queries->scopes.Size()));
+		queries->scopes.Add(s);
+	}
+}
+
+void GpuProfilerEndScope(GpuProfilerQueries* queries, VkCommandBuffer vk_buffer)
+{
+	if (queries != nullptr)
+	{
+		EXIT_IF(queries->open_scopes.IsEmpty());
+
+		auto index = static_cast<uint32_t>(queries->open_scopes[queries->open_scopes.Size() - 1]);
+		queries->open_scopes.RemoveAt(queries->open_scopes.Size() - 1);
+
+		const auto& s = queries->scopes[index];
+
+		if (s.end_query != GpuProfilerQueries::DROPPED)
+		{
+			vkCmdWriteTimestamp(vk_buffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, queries->pool, s.end_query);
+		}
+	}
+}
+
+} // namespace Kyty::Libs::Graphics
+
+#endif // KYTY_EMU_ENABLED
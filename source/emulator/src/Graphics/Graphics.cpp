@@ -6,13 +6,18 @@
 #include "Kyty/Core/VirtualMemory.h"
 
 #include "Emulator/Config.h"
+#include "Emulator/Graphics/Capture.h"
+#include "Emulator/Graphics/DumpWriter.h"
+#include "Emulator/Graphics/GpuProfiler.h"
 #include "Emulator/Graphics/GraphicsRender.h"
 #include "Emulator/Graphics/GraphicsRun.h"
 #include "Emulator/Graphics/HardwareContext.h"
 #include "Emulator/Graphics/Objects/GpuMemory.h"
 #include "Emulator/Graphics/Objects/IndexBuffer.h"
 #include "Emulator/Graphics/Objects/Label.h"
+#include "Emulator/Graphics/PixelConvert.h"
 #include "Emulator/Graphics/Pm4.h"
+#include "Emulator/Graphics/RemoteCache.h"
 #include "Emulator/Graphics/Shader.h"
 #include "Emulator/Graphics/Tile.h"
 #include "Emulator/Graphics/VideoOut.h"
@@ -20,6 +25,7 @@
 #include "Emulator/Kernel/Pthread.h"
 #include "Emulator/Libs/Errno.h"
 #include "Emulator/Libs/Libs.h"
+#include "Emulator/Loader/SystemContent.h"
 
 #include <algorithm>
 #include <atomic>
@@ -35,16 +41,26 @@ KYTY_SUBSYSTEM_INIT(Graphics)
 
 	WindowInit(width, height);
 	VideoOut::VideoOutInit(width, height);
+	RemoteCacheInit();
 	GraphicsRenderInit();
 	GraphicsRunInit();
 	GpuMemoryInit();
 	LabelInit();
 	TileInit();
+	PixelConvertInit();
 	IndexBufferInit();
 	ShaderInit();
+	GpuProfilerInit();
+	CaptureInit();
+	DumpWriterInit();
 }
 
-KYTY_SUBSYSTEM_UNEXPECTED_SHUTDOWN(Graphics) {}
+KYTY_SUBSYSTEM_UNEXPECTED_SHUTDOWN(Graphics)
+{
+	GraphicsRenderDestroy();
+	DumpWriterFlush();
+	RemoteCacheFlush();
+}
 
 KYTY_SUBSYSTEM_DESTROY(Graphics) {}
 
@@ -59,16 +75,20 @@ void GraphicsDbgDumpDcb(const char* type, uint32_t num_dw, uint32_t* cmd_buffer)
 		Core::File f;
 		String     file_name = Config::GetCommandBufferDumpFolder().FixDirectorySlash() +
 		                   String::FromPrintf("%04d_%04d_buffer_%s.log", GraphicsRunGetFrameNum(), id++, type);
-		Core::File::CreateDirectories(file_name.DirectoryWithoutFilename());
-		f.Create(file_name);
-		if (f.IsInvalid())
-		{
-			printf(FG_BRIGHT_RED "Can't create file: %s\n" FG_DEFAULT, file_name.C_Str());
-			return;
-		}
+		f.CreateInMem();
 		Pm4::DumpPm4PacketStream(&f, cmd_buffer, 0, num_dw);
-		f.Close();
+		DumpWriterPush(file_name, &f);
+	}
+}
+
+String GraphicsGetCacheFolder()
+{
+	String title_id;
+	if (!Loader::SystemContentParamSfoGetString("TITLE_ID", &title_id) || title_id.IsEmpty())
+	{
+		title_id = U"_default";
 	}
+	return Config::GetCacheFolder().FixDirectorySlash() + title_id.FixDirectorySlash();
 }
 
 namespace Gen4 {
@@ -4,13 +4,20 @@
 #include "Kyty/Core/DbgAssert.h"
 #include "Kyty/Core/File.h"
 #include "Kyty/Core/Hash.h"
+#include "Kyty/Core/FlatHashmap.h"
 #include "Kyty/Core/Hashmap.h"
+#include "Kyty/Core/JobSystem.h"
+#include "Kyty/Core/LinkList.h"
 #include "Kyty/Core/String.h"
 #include "Kyty/Core/Threads.h"
 #include "Kyty/Core/Vector.h"
 
 #include "Emulator/Config.h"
+#include "Emulator/Graphics/DumpWriter.h"
+#include "Emulator/Graphics/GpuCounters.h"
+#include "Emulator/Graphics/GpuProfiler.h"
 #include "Emulator/Graphics/GraphicContext.h"
+#include "Emulator/Graphics/Graphics.h"
 #include "Emulator/Graphics/GraphicsRun.h"
 #include "Emulator/Graphics/HardwareContext.h"
 #include "Emulator/Graphics/Objects/DepthStencilBuffer.h"
@@ -22,6 +29,7 @@
 #include "Emulator/Graphics/Objects/StorageTexture.h"
 #include "Emulator/Graphics/Objects/Texture.h"
 #include "Emulator/Graphics/Objects/VertexBuffer.h"
+#include "Emulator/Graphics/RemoteCache.h"
 #include "Emulator/Graphics/Shader.h"
 #include "Emulator/Graphics/Tile.h"
 #include "Emulator/Graphics/Utils.h"
@@ -30,10 +38,15 @@
 #include "Emulator/Kernel/EventQueue.h"
 #include "Emulator/Kernel/Pthread.h"
 #include "Emulator/Libs/Errno.h"
+#include "Emulator/Loader/SystemContent.h"
 #include "Emulator/Profiler.h"
 
+#include <algorithm>
 #include <atomic>
 
+//#define XXH_INLINE_ALL
+#include <xxhash/xxhash.h>
+
 // IWYU pragma: no_forward_declare VkImageView_T
 
 #ifdef KYTY_EMU_ENABLED
@@ -111,6 +124,7 @@ struct PipelineDynamicParameters
 	bool vk_dynamic_state_stencil_write_mask     = false;
 	bool vk_dynamic_state_stencil_reference      = false;
 	bool vk_dynamic_state_color_write_enable_ext = false;
+	bool vk_dynamic_state_extended_ext           = false;
 
 	float line_width         = 1.0f;
 	bool  color_write_enable = true;
@@ -118,6 +132,18 @@ struct PipelineDynamicParameters
 	PipelineStencilDynamicState stencil_front;
 	PipelineStencilDynamicState stencil_back;
 
+	// VK_EXT_extended_dynamic_state, the matching static parameters are left at their defaults
+	VkPrimitiveTopology        topology                 = VK_PRIMITIVE_TOPOLOGY_POINT_LIST;
+	VkCullModeFlags            cull_mode                = VK_CULL_MODE_NONE;
+	VkFrontFace                front_face               = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+	bool                       depth_test_enable        = false;
+	bool                       depth_write_enable       = false;
+	VkCompareOp                depth_compare_op         = VK_COMPARE_OP_NEVER;
+	bool                       depth_bounds_test_enable = false;
+	bool                       stencil_test_enable      = false;
+	PipelineStencilStaticState stencil_front_ops;
+	PipelineStencilStaticState stencil_back_ops;
+
 	bool operator==(const PipelineDynamicParameters& other) const;
 };
 #pragma pack(pop)
@@ -146,11 +172,29 @@ public:
 	void            DeletePipelines(VulkanFramebuffer* framebuffer);
 	void            DeleteAllPipelines();
 
+	// Changes whenever a pipeline is destroyed, so pointers kept outside of the cache can be validated
+	[[nodiscard]] uint64_t GetGeneration() const { return m_generation; }
+
+	void LoadPersistentCache(GraphicContext* ctx);
+	void SavePersistentCache();
+
 private:
-	static constexpr uint32_t MAX_PIPELINES = 128;
+	void Prewarm();
+
+	// When the number of pipelines exceeds this limit, the least recently used one is evicted
+	static constexpr uint32_t MAX_PIPELINES = 1024;
+	static constexpr uint32_t LRU_NONE      = UINT32_MAX;
+
+	static constexpr uint32_t PERSISTENT_CACHE_MAGIC   = 0x4843504b; // KPCH
+	static constexpr uint32_t PERSISTENT_CACHE_VERSION = 2;
+	static constexpr uint32_t REMOTE_CACHE_SIZE_MAX    = 256u * 1024u * 1024u;
 
 	struct Pipeline
 	{
+		uint64_t                   hash           = 0;
+		int                        last_frame     = 0;
+		uint32_t                   lru_prev       = LRU_NONE;
+		uint32_t                   lru_next       = LRU_NONE;
 		uint64_t                   render_pass_id = 0;
 		ShaderId                   vs_shader_id;
 		ShaderId                   ps_shader_id;
@@ -160,15 +204,91 @@ private:
 		PipelineDynamicParameters* dynamic_params = nullptr;
 	};
 
-	[[nodiscard]] VulkanPipeline* Find(const Pipeline& p) const;
+	// Key of the pipeline which was created in this or in a previous session
+	struct PipelineRecord
+	{
+		uint64_t                 render_pass_id = 0;
+		ShaderId                 vs_shader_id;
+		ShaderId                 ps_shader_id;
+		ShaderId                 cs_shader_id;
+		PipelineStaticParameters static_params;
+		bool                     from_file = false;
+	};
+
+	// Stage which is shared by all the pipelines with the same shader, so a new VS/PS combination only needs the pipeline to be linked
+	struct ShaderModule
+	{
+		ShaderType     type = ShaderType::Unknown;
+		ShaderId       id;
+		VkShaderModule module = nullptr;
+	};
+
+	// Graphics pipeline which is compiled by the worker threads
+	struct PipelineJob
+	{
+		Pipeline              p;
+		VkRenderPass          render_pass = nullptr;
+		ShaderVertexInputInfo vs_input_info;
+		ShaderPixelInputInfo  ps_input_info;
+		VkShaderModule        vs_module = nullptr;
+		VkShaderModule        ps_module = nullptr;
+		ShaderCode            vs_code;
+		ShaderCode            ps_code;
+		bool                  ready = false;
+	};
+
+	static uint64_t CalcHash(const Pipeline& p);
+	static bool     IsSame(const Pipeline& p1, const Pipeline& p2);
 
+	VulkanPipeline* Find(const Pipeline& p);
+
+	void Insert(const Pipeline& p);
+	void EvictLeastRecentlyUsed();
+	void LruAdd(uint32_t id);
+	void LruRemove(uint32_t id);
 	void DeletePipelineInternal(uint32_t id);
+	void DestroyPipeline(Pipeline* p);
+
+	VkShaderModule FindShaderModule(ShaderType type, const ShaderId& id);
+	VkShaderModule AddShaderModule(ShaderType type, const ShaderId& id, const Vector<uint32_t>& spirv);
+
+	VulkanPipeline* CreatePipelineAsync(const Pipeline& p, VkRenderPass render_pass, const ShaderVertexInputInfo* vs_input_info,
+	                                    const ShaderPixelInputInfo* ps_input_info, const HW::VertexShaderInfo* vs_regs,
+	                                    const HW::PixelShaderInfo* ps_regs, const HW::ShaderRegisters* sh_regs);
+	void            Compile(PipelineJob* job);
+	void            WaitForJobs();
+	void            DeleteJobs(const VulkanFramebuffer* framebuffer);
 
 	void DumpToFile(Core::File* f, const Pipeline& p);
 	void DumpPipeline(const char* action, uint32_t id);
 
-	Vector<Pipeline> m_pipelines;
-	Core::Mutex      m_mutex;
+	void AddRecord(const Pipeline& p);
+
+	static bool ReadPersistentCache(Core::File* f, Vector<PipelineRecord>* records, Core::ByteBuffer* blob);
+	uint32_t    MergePersistentCache(const Vector<PipelineRecord>& records, const Core::ByteBuffer& blob);
+
+	Vector<Pipeline>                     m_pipelines;
+	Vector<uint32_t>                     m_free_ids;
+	Core::Hashmap<uint64_t, Vector<int>> m_map;
+	uint32_t                             m_pipelines_num = 0;
+	uint32_t                             m_lru_head      = LRU_NONE; // Least recently used
+	uint32_t                             m_lru_tail      = LRU_NONE; // Most recently used
+	std::atomic<uint64_t>                m_generation    = 0;
+	Core::Mutex                          m_mutex {"PipelineCache"};
+
+	GraphicContext*        m_persistent_ctx    = nullptr;
+	VkPipelineCache        m_vk_pipeline_cache = nullptr;
+	Vector<PipelineRecord> m_records;
+	uint32_t               m_records_loaded = 0;
+	uint32_t               m_records_hits   = 0;
+	uint64_t               m_remote_key     = 0;
+
+	Core::Mutex                                   m_modules_mutex;
+	Core::Hashmap<uint64_t, Vector<ShaderModule>> m_modules;
+
+	Core::Mutex          m_jobs_mutex;
+	Core::CondVar        m_jobs_ready_cond_var;
+	Vector<PipelineJob*> m_jobs;
 };
 
 struct VulkanDescriptorSet
@@ -212,23 +332,53 @@ public:
 	void                 FreeDescriptor(VulkanBuffer* buffer);
 	void                 FreeDescriptor(VulkanImage* image);
 
+	// Writes which update the set or are pushed into the command buffer
+	struct DescriptorWrites
+	{
+		static constexpr uint32_t WRITES_MAX = 5;
+
+		VkDescriptorBufferInfo buffer_info[BUFFERS_MAX]                     = {};
+		VkDescriptorImageInfo  texture2d_sampled_info[TEXTURES_SAMPLED_MAX] = {};
+		VkDescriptorImageInfo  texture2d_storage_info[TEXTURES_STORAGE_MAX] = {};
+		VkDescriptorImageInfo  sampler_info[SAMPLERS_MAX]                   = {};
+		VkDescriptorBufferInfo gds_buffer_info[GDS_BUFFER_MAX]              = {};
+		VkWriteDescriptorSet   writes[WRITES_MAX]                           = {};
+		uint32_t               writes_num                                   = 0;
+	};
+
+	static void PrepareWrites(DescriptorWrites* w, VkDescriptorSet dst_set, VulkanBuffer** storage_buffers,
+	                          VulkanImage** textures2d_sampled, const int* textures2d_sampled_view, VulkanImage** textures2d_storage,
+	                          const uint64_t* samplers, VulkanBuffer** gds_buffers, const ShaderBindResources& bind);
+
 private:
+	// Set can still be referenced by the command buffers of the last few frames
+	static constexpr int RETIRE_MIN_FRAMES = 8;
+
+	// Pack struct to guarantee the uniquess of object representation
+#pragma pack(push, 1)
+	struct Key
+	{
+		Stage    stage                                         = Stage::Unknown;
+		int      storage_buffers_num                           = 0;
+		int      textures2d_sampled_num                        = 0;
+		int      textures2d_storage_num                        = 0;
+		int      samplers_num                                  = 0;
+		int      gds_buffers_num                               = 0;
+		uint64_t storage_buffers_id[BUFFERS_MAX]               = {};
+		uint64_t textures2d_sampled_id[TEXTURES_SAMPLED_MAX]   = {};
+		int      textures2d_sampled_view[TEXTURES_SAMPLED_MAX] = {};
+		uint64_t textures2d_storage_id[TEXTURES_STORAGE_MAX]   = {};
+		uint64_t samplers_id[SAMPLERS_MAX]                     = {};
+		uint64_t gds_buffers_id[GDS_BUFFER_MAX]                = {};
+	};
+#pragma pack(pop)
+
 	struct Set
 	{
-		VulkanDescriptorSet* set                                         = nullptr;
-		int                  next_free_set                               = -1;
-		uint32_t             hash                                        = 0;
-		Stage                stage                                       = Stage::Unknown;
-		int                  storage_buffers_num                         = 0;
-		uint64_t             storage_buffers_id[BUFFERS_MAX]             = {};
-		int                  textures2d_sampled_num                      = 0;
-		uint64_t             textures2d_sampled_id[TEXTURES_SAMPLED_MAX] = {};
-		int                  textures2d_storage_num                      = 0;
-		uint64_t             textures2d_storage_id[TEXTURES_STORAGE_MAX] = {};
-		int                  samplers_num                                = 0;
-		uint64_t             samplers_id[SAMPLERS_MAX]                   = {};
-		int                  gds_buffers_num                             = 0;
-		uint64_t             gds_buffers_id[GDS_BUFFER_MAX]              = {};
+		VulkanDescriptorSet* set           = nullptr;
+		int                  next_free_set = -1;
+		uint64_t             hash          = 0;
+		Key                  key;
 	};
 
 	struct Pool
@@ -236,22 +386,36 @@ private:
 		VkDescriptorPool pool           = nullptr;
 		int              next_free_pool = -1;
 		bool             free           = true;
+		uint32_t         sets_num       = 0;
+	};
+
+	struct RetiredSet
+	{
+		VulkanDescriptorSet* set   = nullptr;
+		int                  frame = 0;
 	};
 
 	void Init();
 	void CreatePool();
 
-	static uint32_t CalcHash(const Set& s);
+	static uint64_t CalcHash(const Key& k);
+	static bool     UsesResource(const Key& k, uint64_t resource_id);
 
-	VulkanDescriptorSet* FindSet(const Set& s);
+	VulkanDescriptorSet* FindSet(const Key& k, uint64_t hash);
 
-	Core::Mutex  m_mutex;
-	Vector<Pool> m_pools;
-	Vector<Set>  m_sets;
-	int          m_first_free_set  = -1;
-	int          m_first_free_pool = -1;
+	void RetireSets(uint64_t resource_id);
+	void ReleaseRetiredSets();
 
-	Core::Hashmap<uint32_t, Vector<int>> m_sets_map;
+	Core::Mutex        m_mutex;
+	Vector<Pool>       m_pools;
+	Vector<Set>        m_sets;
+	Vector<RetiredSet> m_retired_sets;
+	int                m_first_free_set  = -1;
+	int                m_first_free_pool = -1;
+	int                m_released_frame  = -1;
+
+	Core::FlatHashmap<uint64_t, int>     m_sets_map;
+	Core::Hashmap<uint64_t, Vector<int>> m_resource_sets;
 
 	VkDescriptorSetLayout m_descriptor_set_layout_vertex[BUFFERS_MAX + 1][TEXTURES_SAMPLED_MAX + 1][TEXTURES_STORAGE_MAX + 1]
 	                                                    [SAMPLERS_MAX + 1][GDS_BUFFER_MAX + 1] = {};
@@ -273,14 +437,23 @@ public:
 	uint64_t  GetSamplerId(const ShaderSamplerResource& r);
 
 private:
+	static constexpr uint32_t SAMPLERS_MAX = 4096;
+	static constexpr uint32_t INDEX_SIZE   = SAMPLERS_MAX * 2;
+
 	struct Sampler
 	{
 		ShaderSamplerResource r;
 		VkSampler             vk = nullptr;
 	};
 
-	Core::Mutex     m_mutex;
-	Vector<Sampler> m_samplers;
+	static uint64_t CalcHash(const ShaderSamplerResource& r);
+
+	// Samplers are never destroyed, so published entries can be read without the mutex.
+	// Index slots hold (id + 1) and are probed linearly, 0 is an empty slot.
+	Core::Mutex           m_mutex;
+	Sampler               m_samplers[SAMPLERS_MAX];
+	std::atomic<uint32_t> m_samplers_num = 0;
+	std::atomic<uint32_t> m_index[INDEX_SIZE] {};
 };
 
 struct VulkanFramebuffer
@@ -301,21 +474,40 @@ public:
 	void               FreeFramebufferByColor(VulkanImage* image);
 	void               FreeFramebufferByDepth(DepthStencilVulkanImage* image);
 
+	// Changes whenever a framebuffer is destroyed, so pointers kept outside of the cache can be validated
+	[[nodiscard]] uint64_t GetGeneration() const { return m_generation; }
+
 private:
 	VideoOutVulkanImage* CreateDummyBuffer(VkFormat format, uint32_t width, uint32_t height);
 
+#pragma pack(push, 1)
+	struct Key
+	{
+		uint64_t image_id             = 0;
+		uint64_t depth_id             = 0;
+		bool     color_clear_enable   = false;
+		bool     depth_clear_enable   = false;
+		bool     stencil_clear_enable = false;
+	};
+#pragma pack(pop)
+
 	struct Framebuffer
 	{
-		VulkanFramebuffer* framebuffer          = nullptr;
-		uint64_t           image_id             = 0;
-		uint64_t           depth_id             = 0;
-		bool               depth_clear_enable   = false;
-		bool               stencil_clear_enable = false;
+		VulkanFramebuffer* framebuffer = nullptr;
+		Key                key;
+		uint64_t           hash = 0;
 	};
 
+	static uint64_t CalcHash(const Key& k);
+
+	VulkanFramebuffer* FindFramebuffer(const Key& k, uint64_t hash);
+	void               DeleteFramebuffer(int index);
+
 	Core::Mutex                  m_mutex;
 	Vector<Framebuffer>          m_framebuffers;
+	Core::Hashmap<uint64_t, int> m_framebuffers_map;
 	Vector<VideoOutVulkanImage*> m_dummy_buffers;
+	std::atomic<uint64_t>        m_generation = 0;
 };
 
 class GdsBuffer
@@ -325,7 +517,8 @@ public:
 	virtual ~GdsBuffer() { KYTY_NOT_IMPLEMENTED; }
 	KYTY_CLASS_NO_COPY(GdsBuffer);
 
-	void Clear(GraphicContext* ctx, uint64_t dw_offset, uint32_t dw_num, uint32_t clear_value);
+	// Recorded into the command buffer, so the clear is ordered with the draws and dispatches around it
+	void Clear(GraphicContext* ctx, CommandBuffer* buffer, uint64_t dw_offset, uint32_t dw_num, uint32_t clear_value);
 	void Read(GraphicContext* ctx, uint32_t* dst, uint32_t dw_offset, uint32_t dw_size);
 
 	VulkanBuffer* GetBuffer(GraphicContext* ctx);
@@ -339,12 +532,100 @@ private:
 	VulkanBuffer* m_buffer = nullptr;
 };
 
+// SGPR data of the shaders which doesn't fit into the push constants of the device. A command buffer writes it linearly into chunks of
+// host visible memory and binds it with a dynamic offset, so only the offset changes between draws. The chunks come back to the pool
+// when the command buffer has completed.
+class UniformBufferPool
+{
+public:
+	static constexpr uint32_t CHUNK_SIZE  = 64 * 1024;
+	static constexpr uint32_t PAYLOAD_MAX = DescriptorCache::PUSH_CONSTANTS_MAX * 4;
+
+	struct Chunk
+	{
+		VulkanBuffer    buffer;
+		uint8_t*        data   = nullptr;
+		VkDescriptorSet set    = nullptr;
+		uint32_t        offset = 0;
+	};
+
+	UniformBufferPool() { EXIT_NOT_IMPLEMENTED(!Core::Thread::IsMainThread()); }
+	virtual ~UniformBufferPool() { KYTY_NOT_IMPLEMENTED; }
+	KYTY_CLASS_NO_COPY(UniformBufferPool);
+
+	// Layout of the set with the dynamic uniform buffer, and an empty one for the unused slots in front of it
+	VkDescriptorSetLayout GetDescriptorSetLayout();
+	VkDescriptorSetLayout GetEmptyDescriptorSetLayout();
+
+	// Copies the data into the current chunk of the command buffer, returns the set and the dynamic offset to bind
+	VkDescriptorSet Write(CommandBufferUniforms* uniforms, const void* data, uint32_t size, uint32_t* offset);
+	void            Release(CommandBufferUniforms* uniforms);
+
+private:
+	static constexpr uint32_t SETS_PER_POOL = 64;
+
+	void   Init(GraphicContext* ctx); // m_mutex must be locked
+	Chunk* Allocate(GraphicContext* ctx);
+
+	Core::Mutex              m_mutex;
+	Vector<Chunk*>           m_free_chunks;
+	Vector<VkDescriptorPool> m_pools;
+	uint32_t                 m_pool_sets    = SETS_PER_POOL;
+	VkDescriptorSetLayout    m_layout       = nullptr;
+	VkDescriptorSetLayout    m_empty_layout = nullptr;
+};
+
+struct CommandBufferUniforms
+{
+	Vector<UniformBufferPool::Chunk*> chunks;
+};
+
+struct QueueSubmit
+{
+	VkCommandBuffer          buffer               = nullptr;
+	VkSemaphore              signal_semaphores[2] = {};
+	uint64_t                 signal_values[2]     = {}; // the value for a binary semaphore is ignored
+	uint32_t                 signal_num           = 0;
+	VulkanCommandBufferWaits waits;
+};
+
+// Command buffers of a queue are collected and sent to the driver by one thread, everything ready at the moment goes with one
+// vkQueueSubmit. The host waits for a buffer on its timeline semaphore, so a submit doesn't need a fence and the recording thread
+// doesn't wait for the queue. A submit that signals a binary semaphore is sent at once together with the collected ones, because
+// presentation waits on it right after.
+class QueueSubmitter
+{
+public:
+	QueueSubmitter() = default;
+	virtual ~QueueSubmitter() { KYTY_NOT_IMPLEMENTED; }
+	KYTY_CLASS_NO_COPY(QueueSubmitter);
+
+	void Submit(int queue, const QueueSubmit& submit);
+	void SubmitNow(int queue, const QueueSubmit& submit);
+
+private:
+	static void ThreadRun(void* data);
+
+	void Send(int queue); // m_submit_mutex must be locked
+
+	Core::Mutex         m_mutex;
+	Core::CondVar       m_cond_var;
+	Vector<QueueSubmit> m_pending;
+	int                 m_queue   = -1;
+	bool                m_started = false;
+
+	Core::Mutex                           m_submit_mutex;
+	Vector<QueueSubmit>                   m_batch;
+	Vector<VkSubmitInfo>                  m_submit_infos;
+	Vector<VkTimelineSemaphoreSubmitInfo> m_timeline_infos;
+};
+
 class RenderContext
 {
 public:
 	RenderContext()
 	    : m_pipeline_cache(new PipelineCache), m_descriptor_cache(new DescriptorCache), m_framebuffer_cache(new FramebufferCache),
-	      m_sampler_cache(new SamplerCache), m_gds_buffer(new GdsBuffer)
+	      m_sampler_cache(new SamplerCache), m_gds_buffer(new GdsBuffer), m_uniform_buffer_pool(new UniformBufferPool)
 	{
 		EXIT_NOT_IMPLEMENTED(!Core::Thread::IsMainThread());
 	}
@@ -354,25 +635,29 @@ public:
 	void            SetGraphicCtx(GraphicContext* ctx) { m_graphic_ctx = ctx; }
 	GraphicContext* GetGraphicCtx() { return m_graphic_ctx; }
 
-	Core::Mutex&      GetMutex() { return m_mutex; }
-	PipelineCache*    GetPipelineCache() { return m_pipeline_cache; }
-	DescriptorCache*  GetDescriptorCache() { return m_descriptor_cache; }
-	FramebufferCache* GetFramebufferCache() { return m_framebuffer_cache; }
-	SamplerCache*     GetSamplerCache() { return m_sampler_cache; }
-	GdsBuffer*        GetGdsBuffer() { return m_gds_buffer; }
+	Core::Mutex&       GetMutex() { return m_mutex; }
+	PipelineCache*     GetPipelineCache() { return m_pipeline_cache; }
+	DescriptorCache*   GetDescriptorCache() { return m_descriptor_cache; }
+	FramebufferCache*  GetFramebufferCache() { return m_framebuffer_cache; }
+	SamplerCache*      GetSamplerCache() { return m_sampler_cache; }
+	GdsBuffer*         GetGdsBuffer() { return m_gds_buffer; }
+	UniformBufferPool* GetUniformBufferPool() { return m_uniform_buffer_pool; }
+	QueueSubmitter*    GetQueueSubmitter(int queue) { return &m_queue_submitters[queue]; }
 
 	void AddEopEq(LibKernel::EventQueue::KernelEqueue eq);
 	void DeleteEopEq(LibKernel::EventQueue::KernelEqueue eq);
 	void TriggerEopEvent();
 
 private:
-	Core::Mutex       m_mutex;
-	PipelineCache*    m_pipeline_cache    = nullptr;
-	DescriptorCache*  m_descriptor_cache  = nullptr;
-	FramebufferCache* m_framebuffer_cache = nullptr;
-	SamplerCache*     m_sampler_cache     = nullptr;
-	GraphicContext*   m_graphic_ctx       = nullptr;
-	GdsBuffer*        m_gds_buffer        = nullptr;
+	Core::Mutex        m_mutex;
+	PipelineCache*     m_pipeline_cache      = nullptr;
+	DescriptorCache*   m_descriptor_cache    = nullptr;
+	FramebufferCache*  m_framebuffer_cache   = nullptr;
+	SamplerCache*      m_sampler_cache       = nullptr;
+	GraphicContext*    m_graphic_ctx         = nullptr;
+	GdsBuffer*         m_gds_buffer          = nullptr;
+	UniformBufferPool* m_uniform_buffer_pool = nullptr;
+	QueueSubmitter     m_queue_submitters[GraphicContext::QUEUES_NUM];
 
 	Core::Mutex                                 m_eop_mutex;
 	Vector<LibKernel::EventQueue::KernelEqueue> m_eop_eqs;
@@ -425,10 +710,12 @@ enum class RenderColorType
 
 struct RenderColorInfo
 {
-	RenderColorType type          = RenderColorType::NoColorOutput;
-	VulkanImage*    vulkan_buffer = nullptr;
-	uint64_t        base_addr     = 0;
-	uint64_t        buffer_size   = 0;
+	RenderColorType   type          = RenderColorType::NoColorOutput;
+	VulkanImage*      vulkan_buffer = nullptr;
+	uint64_t          base_addr     = 0;
+	uint64_t          buffer_size   = 0;
+	bool              clear_enable  = false; // the render pass clears the target instead of a draw, see draw_is_clear()
+	VkClearColorValue clear_value   = {};
 };
 
 class CommandPool
@@ -1141,7 +1428,8 @@ static void vp_check(const HW::ScreenViewport& vp, const HW::ScanModeControl& sm
 	EXIT_NOT_IMPLEMENTED(viewport_scissor && vp.viewports[0].viewport_scissor_window_offset_enable != true);
 }
 
-static void hw_check(const HW::Context& hw)
+// Only the register groups written since the previous draw need to be validated again
+static void hw_check(const HW::Context& hw, uint32_t dirty)
 {
 	const auto& rt   = hw.GetRenderTarget(0);
 	const auto& bc   = hw.GetBlendControl(0);
@@ -1160,19 +1448,36 @@ static void hw_check(const HW::Context& hw)
 	const auto& aa   = hw.GetAaSampleControl();
 	const auto& ac   = hw.GetAaConfig();
 
-	rt_check(rt);
-	vp_check(vp, smc);
-	z_check(z);
-	clip_check(c);
-	rc_check(rc);
-	d_check(d, s, sm);
-	mc_check(mc);
-	bc_check(bc, bclr, cc);
-	eqaa_check(eqaa);
-	aa_check(aa, ac);
-
-	EXIT_NOT_IMPLEMENTED(hw.GetRenderTargetMask() != 0xF && hw.GetRenderTargetMask() != 0x0);
-	EXIT_NOT_IMPLEMENTED(hw.GetDepthClearValue() != 0.0f && hw.GetDepthClearValue() != 1.0f);
+	if ((dirty & HW::Context::DIRTY_COLOR_TARGETS) != 0)
+	{
+		rt_check(rt);
+		EXIT_NOT_IMPLEMENTED(hw.GetRenderTargetMask() != 0xF && hw.GetRenderTargetMask() != 0x0);
+	}
+	if ((dirty & HW::Context::DIRTY_VIEWPORT) != 0)
+	{
+		vp_check(vp, smc);
+	}
+	if ((dirty & HW::Context::DIRTY_DEPTH_TARGET) != 0)
+	{
+		z_check(z);
+		EXIT_NOT_IMPLEMENTED(hw.GetDepthClearValue() != 0.0f && hw.GetDepthClearValue() != 1.0f);
+	}
+	if ((dirty & HW::Context::DIRTY_DEPTH_STENCIL) != 0)
+	{
+		rc_check(rc);
+		d_check(d, s, sm);
+	}
+	if ((dirty & HW::Context::DIRTY_RASTER) != 0)
+	{
+		clip_check(c);
+		mc_check(mc);
+		eqaa_check(eqaa);
+		aa_check(aa, ac);
+	}
+	if ((dirty & HW::Context::DIRTY_BLEND) != 0)
+	{
+		bc_check(bc, bclr, cc);
+	}
 	// EXIT_NOT_IMPLEMENTED(hw.GetStencilClearValue() != 0);
 }
 
@@ -1229,6 +1534,27 @@ void GraphicsRenderCreateContext()
 	EXIT_IF(g_render_ctx == nullptr);
 
 	g_render_ctx->SetGraphicCtx(WindowGetGraphicContext());
+	ShaderSetPushConstantsMax(g_render_ctx->GetGraphicCtx()->push_constants_max);
+	g_render_ctx->GetPipelineCache()->LoadPersistentCache(g_render_ctx->GetGraphicCtx());
+}
+
+// Loads the caches of the title without running it. The window stays hidden, because nothing is presented.
+void GraphicsRenderPrebuildCaches()
+{
+	EXIT_IF(g_render_ctx == nullptr);
+
+	WindowWaitForGraphicInitialized();
+	GraphicsRenderCreateContext();
+}
+
+void GraphicsRenderDestroy()
+{
+	if (g_render_ctx != nullptr)
+	{
+		g_render_ctx->GetPipelineCache()->SavePersistentCache();
+	}
+
+	GpuProfilerSave();
 }
 
 void RenderContext::AddEopEq(LibKernel::EventQueue::KernelEqueue eq)
@@ -1281,9 +1607,10 @@ void GdsBuffer::Init(GraphicContext* ctx)
 	}
 }
 
-void GdsBuffer::Clear(GraphicContext* ctx, uint64_t dw_offset, uint32_t dw_num, uint32_t clear_value)
+void GdsBuffer::Clear(GraphicContext* ctx, CommandBuffer* buffer, uint64_t dw_offset, uint32_t dw_num, uint32_t clear_value)
 {
 	EXIT_IF(ctx == nullptr);
+	EXIT_IF(buffer == nullptr);
 
 	Core::LockGuard lock(m_mutex);
 
@@ -1294,17 +1621,31 @@ void GdsBuffer::Clear(GraphicContext* ctx, uint64_t dw_offset, uint32_t dw_num,
 
 	EXIT_IF(m_buffer == nullptr);
 
-	void* data = nullptr;
-	VulkanMapMemory(ctx, &m_buffer->memory, &data);
-
-	EXIT_IF(data == nullptr);
-
-	for (uint32_t i = 0; i < dw_num; i++)
+	if (dw_num == 0)
 	{
-		static_cast<uint32_t*>(data)[dw_offset + i] = clear_value;
+		return;
 	}
 
-	VulkanUnmapMemory(ctx, &m_buffer->memory);
+	auto* vk_buffer = buffer->GetPool()->buffers[buffer->GetIndex()];
+
+	buffer->FlushBarriers();
+
+	VkMemoryBarrier barrier {};
+	barrier.sType         = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	barrier.pNext         = nullptr;
+	barrier.srcAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+
+	vkCmdPipelineBarrier(vk_buffer, VK_PIPELINE_STAGE_ALL_GRAPHICS_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+	                     VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+	vkCmdFillBuffer(vk_buffer, m_buffer->buffer, dw_offset * 4, static_cast<VkDeviceSize>(dw_num) * 4, clear_value);
+
+	barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+
+	vkCmdPipelineBarrier(vk_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+	                     VK_PIPELINE_STAGE_ALL_GRAPHICS_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
 }
 
 void GdsBuffer::Read(GraphicContext* ctx, uint32_t* dst, uint32_t dw_offset, uint32_t dw_size)
@@ -1342,161 +1683,511 @@ VulkanBuffer* GdsBuffer::GetBuffer(GraphicContext* ctx)
 	return m_buffer;
 }
 
-void CommandPool::Create(int id)
+void UniformBufferPool::Init(GraphicContext* ctx)
 {
-	auto* ctx = g_render_ctx->GetGraphicCtx();
+	EXIT_IF(ctx == nullptr);
 
-	EXIT_IF(id < 0 || id >= GraphicContext::QUEUES_NUM);
-	EXIT_IF(m_pool[id] != nullptr);
+	if (m_layout != nullptr)
+	{
+		return;
+	}
 
-	m_pool[id] = new VulkanCommandPool;
+	VkDescriptorSetLayoutBinding binding {};
+	binding.binding            = 0;
+	binding.descriptorType     = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+	binding.descriptorCount    = 1;
+	binding.stageFlags         = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_COMPUTE_BIT;
+	binding.pImmutableSamplers = nullptr;
 
-	EXIT_IF(ctx == nullptr);
-	EXIT_IF(ctx->device == nullptr);
-	EXIT_IF(ctx->queues[id].family == static_cast<uint32_t>(-1));
-	EXIT_IF(m_pool[id]->pool != nullptr);
-	EXIT_IF(m_pool[id]->buffers != nullptr);
-	EXIT_IF(m_pool[id]->fences != nullptr);
-	EXIT_IF(m_pool[id]->semaphores != nullptr);
-	EXIT_IF(m_pool[id]->buffers_count != 0);
+	VkDescriptorSetLayoutCreateInfo layout_info {};
+	layout_info.sType        = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	layout_info.pNext        = nullptr;
+	layout_info.flags        = 0;
+	layout_info.bindingCount = 1;
+	layout_info.pBindings    = &binding;
+
+	vkCreateDescriptorSetLayout(ctx->device, &layout_info, nullptr, &m_layout);
+	EXIT_NOT_IMPLEMENTED(m_layout == nullptr);
+
+	layout_info.bindingCount = 0;
+	layout_info.pBindings    = nullptr;
+
+	vkCreateDescriptorSetLayout(ctx->device, &layout_info, nullptr, &m_empty_layout);
+	EXIT_NOT_IMPLEMENTED(m_empty_layout == nullptr);
+}
+
+VkDescriptorSetLayout UniformBufferPool::GetDescriptorSetLayout()
+{
+	Core::LockGuard lock(m_mutex);
+
+	Init(g_render_ctx->GetGraphicCtx());
+
+	return m_layout;
+}
 
-	VkCommandPoolCreateInfo pool_info {};
-	pool_info.sType            = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
-	pool_info.pNext            = nullptr;
-	pool_info.queueFamilyIndex = ctx->queues[id].family;
-	pool_info.flags            = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+VkDescriptorSetLayout UniformBufferPool::GetEmptyDescriptorSetLayout()
+{
+	Core::LockGuard lock(m_mutex);
 
-	vkCreateCommandPool(ctx->device, &pool_info, nullptr, &m_pool[id]->pool);
+	Init(g_render_ctx->GetGraphicCtx());
 
-	EXIT_NOT_IMPLEMENTED(m_pool[id]->pool == nullptr);
+	return m_empty_layout;
+}
 
-	m_pool[id]->buffers_count = 4;
-	m_pool[id]->buffers       = new VkCommandBuffer[m_pool[id]->buffers_count];
-	m_pool[id]->fences        = new VkFence[m_pool[id]->buffers_count];
-	m_pool[id]->semaphores    = new VkSemaphore[m_pool[id]->buffers_count];
-	m_pool[id]->busy          = new bool[m_pool[id]->buffers_count];
+UniformBufferPool::Chunk* UniformBufferPool::Allocate(GraphicContext* ctx)
+{
+	KYTY_PROFILER_BLOCK("UniformBufferPool::Allocate");
 
-	VkCommandBufferAllocateInfo alloc_info {};
-	alloc_info.sType              = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-	alloc_info.commandPool        = m_pool[id]->pool;
-	alloc_info.level              = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-	alloc_info.commandBufferCount = m_pool[id]->buffers_count;
+	Core::LockGuard lock(m_mutex);
 
-	if (vkAllocateCommandBuffers(ctx->device, &alloc_info, m_pool[id]->buffers) != VK_SUCCESS)
+	if (!m_free_chunks.IsEmpty())
 	{
-		EXIT("Can't allocate command buffers");
+		auto* chunk = m_free_chunks.At(m_free_chunks.Size() - 1);
+		m_free_chunks.RemoveAt(m_free_chunks.Size() - 1);
+		return chunk;
 	}
 
-	for (uint32_t i = 0; i < m_pool[id]->buffers_count; i++)
+	Init(ctx);
+
+	if (m_pool_sets == SETS_PER_POOL)
 	{
-		m_pool[id]->busy[i] = false;
+		VkDescriptorPoolSize pool_size {};
+		pool_size.type            = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+		pool_size.descriptorCount = SETS_PER_POOL;
 
-		VkFenceCreateInfo fence_info {};
-		fence_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-		fence_info.pNext = nullptr;
-		fence_info.flags = 0;
+		VkDescriptorPoolCreateInfo pool_info {};
+		pool_info.sType         = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+		pool_info.pNext         = nullptr;
+		pool_info.flags         = 0;
+		pool_info.poolSizeCount = 1;
+		pool_info.pPoolSizes    = &pool_size;
+		pool_info.maxSets       = SETS_PER_POOL;
 
-		if (vkCreateFence(ctx->device, &fence_info, nullptr, &m_pool[id]->fences[i]) != VK_SUCCESS)
-		{
-			EXIT("Can't create fence");
-		}
+		VkDescriptorPool pool = nullptr;
+		vkCreateDescriptorPool(ctx->device, &pool_info, nullptr, &pool);
+		EXIT_NOT_IMPLEMENTED(pool == nullptr);
 
-		VkSemaphoreCreateInfo semaphore_info {};
-		semaphore_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
-		semaphore_info.pNext = nullptr;
-		semaphore_info.flags = 0;
+		m_pools.Add(pool);
+		m_pool_sets = 0;
+	}
 
-		if (vkCreateSemaphore(ctx->device, &semaphore_info, nullptr, &m_pool[id]->semaphores[i]) != VK_SUCCESS)
-		{
-			EXIT("Can't create semaphore");
-		}
+	auto* chunk = new Chunk;
 
-		EXIT_IF(m_pool[id]->buffers[i] == nullptr);
-		EXIT_IF(m_pool[id]->fences[i] == nullptr);
-		EXIT_IF(m_pool[id]->semaphores[i] == nullptr);
+	chunk->buffer.usage           = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT;
+	chunk->buffer.memory.property = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+	VulkanCreateBuffer(ctx, CHUNK_SIZE, &chunk->buffer);
+	EXIT_NOT_IMPLEMENTED(chunk->buffer.buffer == nullptr);
+
+	void* data = nullptr;
+	VulkanMapMemory(ctx, &chunk->buffer.memory, &data);
+	EXIT_NOT_IMPLEMENTED(data == nullptr);
+
+	chunk->data = static_cast<uint8_t*>(data);
+
+	VkDescriptorSetAllocateInfo alloc_info {};
+	alloc_info.sType              = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	alloc_info.pNext              = nullptr;
+	alloc_info.descriptorPool     = m_pools.At(m_pools.Size() - 1);
+	alloc_info.descriptorSetCount = 1;
+	alloc_info.pSetLayouts        = &m_layout;
+
+	vkAllocateDescriptorSets(ctx->device, &alloc_info, &chunk->set);
+	EXIT_NOT_IMPLEMENTED(chunk->set == nullptr);
+
+	m_pool_sets++;
+
+	VkDescriptorBufferInfo buffer_info {};
+	buffer_info.buffer = chunk->buffer.buffer;
+	buffer_info.offset = 0;
+	buffer_info.range  = PAYLOAD_MAX;
+
+	VkWriteDescriptorSet write {};
+	write.sType            = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	write.pNext            = nullptr;
+	write.dstSet           = chunk->set;
+	write.dstBinding       = 0;
+	write.dstArrayElement  = 0;
+	write.descriptorType   = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+	write.descriptorCount  = 1;
+	write.pImageInfo       = nullptr;
+	write.pBufferInfo      = &buffer_info;
+	write.pTexelBufferView = nullptr;
+
+	vkUpdateDescriptorSets(ctx->device, 1, &write, 0, nullptr);
+
+	return chunk;
+}
+
+VkDescriptorSet UniformBufferPool::Write(CommandBufferUniforms* uniforms, const void* data, uint32_t size, uint32_t* offset)
+{
+	EXIT_IF(uniforms == nullptr);
+	EXIT_IF(data == nullptr);
+	EXIT_IF(offset == nullptr);
+
+	EXIT_NOT_IMPLEMENTED(size > PAYLOAD_MAX);
+
+	auto* ctx       = g_render_ctx->GetGraphicCtx();
+	auto  alignment = static_cast<uint32_t>(ctx->uniform_alignment);
+
+	Chunk*   chunk = (uniforms->chunks.IsEmpty() ? nullptr : uniforms->chunks.At(uniforms->chunks.Size() - 1));
+	uint32_t pos   = (chunk != nullptr ? (chunk->offset + alignment - 1) / alignment * alignment : 0);
+
+	// The whole range of the descriptor has to stay inside the chunk
+	if (chunk == nullptr || pos + PAYLOAD_MAX > CHUNK_SIZE)
+	{
+		chunk = Allocate(ctx);
+		pos   = 0;
+		uniforms->chunks.Add(chunk);
 	}
+
+	memcpy(chunk->data + pos, data, size);
+
+	chunk->offset = pos + size;
+	*offset       = pos;
+
+	return chunk->set;
 }
 
-void CommandPool::DeleteAll()
+void UniformBufferPool::Release(CommandBufferUniforms* uniforms)
 {
-	auto* ctx = g_render_ctx->GetGraphicCtx();
+	EXIT_IF(uniforms == nullptr);
 
-	for (auto& pool: m_pool)
+	if (uniforms->chunks.IsEmpty())
 	{
-		if (pool != nullptr)
-		{
-			EXIT_IF(ctx == nullptr);
-			EXIT_IF(ctx->device == nullptr);
+		return;
+	}
 
-			for (uint32_t i = 0; i < pool->buffers_count; i++)
-			{
-				vkDestroySemaphore(ctx->device, pool->semaphores[i], nullptr);
-				vkDestroyFence(ctx->device, pool->fences[i], nullptr);
-			}
+	Core::LockGuard lock(m_mutex);
 
-			vkFreeCommandBuffers(ctx->device, pool->pool, pool->buffers_count, pool->buffers);
+	for (auto* chunk: uniforms->chunks)
+	{
+		chunk->offset = 0;
+		m_free_chunks.Add(chunk);
+	}
 
-			vkDestroyCommandPool(ctx->device, pool->pool, nullptr);
+	uniforms->chunks.Clear();
+}
 
-			delete[] pool->semaphores;
-			delete[] pool->fences;
-			delete[] pool->buffers;
-			delete[] pool->busy;
+void QueueSubmitter::Submit(int queue, const QueueSubmit& submit)
+{
+	if (!Config::GpuSubmitThreadEnabled())
+	{
+		SubmitNow(queue, submit);
+		return;
+	}
 
-			delete pool;
-			pool = nullptr;
-		}
+	Core::LockGuard lock(m_mutex);
+
+	m_queue = queue;
+	m_pending.Add(submit);
+
+	if (!m_started)
+	{
+		m_started = true;
+
+		Core::Thread t(ThreadRun, this);
+		t.Detach();
 	}
+
+	m_cond_var.Signal();
 }
 
-VulkanFramebuffer* FramebufferCache::CreateFramebuffer(RenderColorInfo* color, RenderDepthInfo* depth)
+void QueueSubmitter::SubmitNow(int queue, const QueueSubmit& submit)
 {
-	KYTY_PROFILER_FUNCTION();
+	Core::LockGuard submit_lock(m_submit_mutex);
 
-	static std::atomic<uint64_t> seq = 0;
+	// The collected submits go first, the order on the queue stays the order of the calls
+	m_mutex.Lock();
+	std::swap(m_batch, m_pending);
+	m_mutex.Unlock();
 
-	Core::LockGuard lock(m_mutex);
+	m_batch.Add(submit);
 
-	EXIT_IF(color == nullptr);
-	EXIT_IF(depth == nullptr);
-	EXIT_IF(g_render_ctx == nullptr);
+	Send(queue);
+}
 
-	bool with_depth = (depth->format != VK_FORMAT_UNDEFINED && depth->vulkan_buffer != nullptr);
-	bool with_color = (color->vulkan_buffer != nullptr);
+void QueueSubmitter::ThreadRun(void* data)
+{
+	auto* s = static_cast<QueueSubmitter*>(data);
 
-	for (auto& f: m_framebuffers)
+	for (;;)
 	{
-		if (f.framebuffer != nullptr && f.image_id == (with_color ? color->vulkan_buffer->memory.unique_id : 0) &&
-		    f.depth_id == (with_depth ? depth->vulkan_buffer->memory.unique_id : 0) && f.depth_clear_enable == depth->depth_clear_enable &&
-		    f.stencil_clear_enable == depth->stencil_clear_enable)
+		s->m_mutex.Lock();
+		while (s->m_pending.IsEmpty())
 		{
-			return f.framebuffer;
+			s->m_cond_var.Wait(&s->m_mutex);
+		}
+		s->m_mutex.Unlock();
+
+		Core::LockGuard submit_lock(s->m_submit_mutex);
+
+		s->m_mutex.Lock();
+		std::swap(s->m_batch, s->m_pending);
+		int queue = s->m_queue;
+		s->m_mutex.Unlock();
+
+		if (!s->m_batch.IsEmpty())
+		{
+			s->Send(queue);
 		}
 	}
+}
 
-	auto* framebuffer        = new VulkanFramebuffer;
-	framebuffer->render_pass = nullptr;
-	framebuffer->framebuffer = nullptr;
+void QueueSubmitter::Send(int queue)
+{
+	static const VkPipelineStageFlags wait_stages[VulkanCommandBufferWaits::WAITS_MAX] = {
+	    VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+	    VK_PIPELINE_STAGE_ALL_COMMANDS_BIT};
 
-	auto* gctx = g_render_ctx->GetGraphicCtx();
+	uint32_t num = m_batch.Size();
 
-	EXIT_IF(gctx == nullptr);
+	m_submit_infos.Clear();
+	m_timeline_infos.Clear();
 
-	EXIT_NOT_IMPLEMENTED(!with_depth && !with_color);
-	EXIT_NOT_IMPLEMENTED(with_depth && with_color &&
-	                     (color->vulkan_buffer->extent.width != depth->vulkan_buffer->extent.width ||
-	                      color->vulkan_buffer->extent.height != depth->vulkan_buffer->extent.height));
+	// Filled before the submit infos point to them
+	for (const auto& b: m_batch)
+	{
+		VkTimelineSemaphoreSubmitInfo timeline_info {};
+		timeline_info.sType                     = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+		timeline_info.pNext                     = nullptr;
+		timeline_info.waitSemaphoreValueCount   = b.waits.num;
+		timeline_info.pWaitSemaphoreValues      = b.waits.values;
+		timeline_info.signalSemaphoreValueCount = b.signal_num;
+		timeline_info.pSignalSemaphoreValues    = b.signal_values;
 
-	VulkanImage* vulkan_buffer =
-	    (with_color ? color->vulkan_buffer
-	                : CreateDummyBuffer(VK_FORMAT_B8G8R8A8_SRGB, depth->vulkan_buffer->extent.width, depth->vulkan_buffer->extent.height));
+		m_timeline_infos.Add(timeline_info);
+	}
 
-	VkAttachmentDescription attachments[2];
-	attachments[0].flags          = 0;
-	attachments[0].format         = vulkan_buffer->format;
-	attachments[0].samples        = VK_SAMPLE_COUNT_1_BIT;
-	attachments[0].loadOp         = VK_ATTACHMENT_LOAD_OP_LOAD;
-	attachments[0].storeOp        = VK_ATTACHMENT_STORE_OP_STORE;
+	for (uint32_t i = 0; i < num; i++)
+	{
+		const auto& b = m_batch[i];
+
+		VkSubmitInfo submit_info {};
+		submit_info.sType                = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+		submit_info.pNext                = &m_timeline_infos[i];
+		submit_info.waitSemaphoreCount   = b.waits.num;
+		submit_info.pWaitSemaphores      = b.waits.semaphores;
+		submit_info.pWaitDstStageMask    = (b.waits.num != 0 ? wait_stages : nullptr);
+		submit_info.commandBufferCount   = 1;
+		submit_info.pCommandBuffers      = &b.buffer;
+		submit_info.signalSemaphoreCount = b.signal_num;
+		submit_info.pSignalSemaphores    = b.signal_semaphores;
+
+		m_submit_infos.Add(submit_info);
+	}
+
+	EXIT_IF(queue < 0 || queue >= GraphicContext::QUEUES_NUM);
+
+	const auto& q = g_render_ctx->GetGraphicCtx()->queues[queue];
+
+	if (q.mutex != nullptr)
+	{
+		q.mutex->Lock();
+	}
+
+	auto result = vkQueueSubmit(q.vk_queue, num, m_submit_infos.GetDataConst(), nullptr);
+
+	if (q.mutex != nullptr)
+	{
+		q.mutex->Unlock();
+	}
+
+	EXIT_NOT_IMPLEMENTED(result != VK_SUCCESS);
+
+	m_batch.Clear();
+}
+
+void CommandPool::Create(int id)
+{
+	auto* ctx = g_render_ctx->GetGraphicCtx();
+
+	EXIT_IF(id < 0 || id >= GraphicContext::QUEUES_NUM);
+	EXIT_IF(m_pool[id] != nullptr);
+
+	m_pool[id] = new VulkanCommandPool;
+
+	EXIT_IF(ctx == nullptr);
+	EXIT_IF(ctx->device == nullptr);
+	EXIT_IF(ctx->queues[id].family == static_cast<uint32_t>(-1));
+	EXIT_IF(m_pool[id]->pools != nullptr);
+	EXIT_IF(m_pool[id]->buffers != nullptr);
+	EXIT_IF(m_pool[id]->semaphores != nullptr);
+	EXIT_IF(m_pool[id]->timelines != nullptr);
+	EXIT_IF(m_pool[id]->buffers_count != 0);
+
+	// Enough for a command processor with the deepest frames in flight setting plus the utility buffers of the same thread
+	m_pool[id]->buffers_count   = 10;
+	m_pool[id]->pools           = new VkCommandPool[m_pool[id]->buffers_count];
+	m_pool[id]->buffers         = new VkCommandBuffer[m_pool[id]->buffers_count];
+	m_pool[id]->semaphores      = new VkSemaphore[m_pool[id]->buffers_count];
+	m_pool[id]->timelines       = new VkSemaphore[m_pool[id]->buffers_count];
+	m_pool[id]->timeline_values = new uint64_t[m_pool[id]->buffers_count];
+	m_pool[id]->waits           = new VulkanCommandBufferWaits[m_pool[id]->buffers_count];
+	m_pool[id]->busy            = new bool[m_pool[id]->buffers_count];
+
+	for (uint32_t i = 0; i < m_pool[id]->buffers_count; i++)
+	{
+		m_pool[id]->busy[i] = false;
+
+		// Every buffer has its own pool. Once the timeline semaphore of the buffer reaches the value of its last submit the whole
+		// pool is reset, the memory of the buffer is kept and reused by the next recording
+		VkCommandPoolCreateInfo pool_info {};
+		pool_info.sType            = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+		pool_info.pNext            = nullptr;
+		pool_info.queueFamilyIndex = ctx->queues[id].family;
+		pool_info.flags            = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+
+		if (vkCreateCommandPool(ctx->device, &pool_info, nullptr, &m_pool[id]->pools[i]) != VK_SUCCESS)
+		{
+			EXIT("Can't create command pool");
+		}
+
+		VkCommandBufferAllocateInfo alloc_info {};
+		alloc_info.sType              = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+		alloc_info.commandPool        = m_pool[id]->pools[i];
+		alloc_info.level              = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+		alloc_info.commandBufferCount = 1;
+
+		if (vkAllocateCommandBuffers(ctx->device, &alloc_info, &m_pool[id]->buffers[i]) != VK_SUCCESS)
+		{
+			EXIT("Can't allocate command buffers");
+		}
+
+		VkSemaphoreCreateInfo semaphore_info {};
+		semaphore_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+		semaphore_info.pNext = nullptr;
+		semaphore_info.flags = 0;
+
+		if (vkCreateSemaphore(ctx->device, &semaphore_info, nullptr, &m_pool[id]->semaphores[i]) != VK_SUCCESS)
+		{
+			EXIT("Can't create semaphore");
+		}
+
+		// Signaled with an increasing value by every submit of this buffer, the host and labels wait on it
+		VkSemaphoreTypeCreateInfo timeline_type_info {};
+		timeline_type_info.sType         = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+		timeline_type_info.pNext         = nullptr;
+		timeline_type_info.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+		timeline_type_info.initialValue  = 0;
+
+		VkSemaphoreCreateInfo timeline_info {};
+		timeline_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+		timeline_info.pNext = &timeline_type_info;
+		timeline_info.flags = 0;
+
+		if (vkCreateSemaphore(ctx->device, &timeline_info, nullptr, &m_pool[id]->timelines[i]) != VK_SUCCESS)
+		{
+			EXIT("Can't create semaphore");
+		}
+
+		m_pool[id]->timeline_values[i] = 0;
+
+		EXIT_IF(m_pool[id]->pools[i] == nullptr);
+		EXIT_IF(m_pool[id]->buffers[i] == nullptr);
+		EXIT_IF(m_pool[id]->semaphores[i] == nullptr);
+		EXIT_IF(m_pool[id]->timelines[i] == nullptr);
+	}
+}
+
+void CommandPool::DeleteAll()
+{
+	auto* ctx = g_render_ctx->GetGraphicCtx();
+
+	for (auto& pool: m_pool)
+	{
+		if (pool != nullptr)
+		{
+			EXIT_IF(ctx == nullptr);
+			EXIT_IF(ctx->device == nullptr);
+
+			for (uint32_t i = 0; i < pool->buffers_count; i++)
+			{
+				vkDestroySemaphore(ctx->device, pool->timelines[i], nullptr);
+				vkDestroySemaphore(ctx->device, pool->semaphores[i], nullptr);
+				vkFreeCommandBuffers(ctx->device, pool->pools[i], 1, &pool->buffers[i]);
+				vkDestroyCommandPool(ctx->device, pool->pools[i], nullptr);
+			}
+
+			delete[] pool->waits;
+			delete[] pool->timeline_values;
+			delete[] pool->timelines;
+			delete[] pool->semaphores;
+			delete[] pool->buffers;
+			delete[] pool->pools;
+			delete[] pool->busy;
+
+			delete pool;
+			pool = nullptr;
+		}
+	}
+}
+
+VulkanFramebuffer* FramebufferCache::CreateFramebuffer(RenderColorInfo* color, RenderDepthInfo* depth)
+{
+	KYTY_PROFILER_FUNCTION();
+
+	static std::atomic<uint64_t> seq = 0;
+
+	// The last hit of this thread, valid until any framebuffer is destroyed
+	static thread_local Key                t_last_key;
+	static thread_local VulkanFramebuffer* t_last_framebuffer = nullptr;
+	static thread_local uint64_t           t_last_generation  = 0;
+
+	EXIT_IF(color == nullptr);
+	EXIT_IF(depth == nullptr);
+	EXIT_IF(g_render_ctx == nullptr);
+
+	bool with_depth = (depth->format != VK_FORMAT_UNDEFINED && depth->vulkan_buffer != nullptr);
+	bool with_color = (color->vulkan_buffer != nullptr);
+
+	Key key;
+	key.image_id             = (with_color ? color->vulkan_buffer->memory.unique_id : 0);
+	key.depth_id             = (with_depth ? depth->vulkan_buffer->memory.unique_id : 0);
+	key.color_clear_enable   = (with_color && color->clear_enable);
+	key.depth_clear_enable   = depth->depth_clear_enable;
+	key.stencil_clear_enable = depth->stencil_clear_enable;
+
+	// NOLINTNEXTLINE(bugprone-suspicious-memory-comparison,cert-exp42-c,cert-flp37-c)
+	if (t_last_framebuffer != nullptr && t_last_generation == m_generation && memcmp(&t_last_key, &key, sizeof(Key)) == 0)
+	{
+		return t_last_framebuffer;
+	}
+
+	Core::LockGuard lock(m_mutex);
+
+	auto hash = CalcHash(key);
+
+	if (auto* f = FindFramebuffer(key, hash); f != nullptr)
+	{
+		t_last_key         = key;
+		t_last_framebuffer = f;
+		t_last_generation  = m_generation;
+		return f;
+	}
+
+	auto* framebuffer        = new VulkanFramebuffer;
+	framebuffer->render_pass = nullptr;
+	framebuffer->framebuffer = nullptr;
+
+	auto* gctx = g_render_ctx->GetGraphicCtx();
+
+	EXIT_IF(gctx == nullptr);
+
+	EXIT_NOT_IMPLEMENTED(!with_depth && !with_color);
+	EXIT_NOT_IMPLEMENTED(with_depth && with_color &&
+	                     (color->vulkan_buffer->extent.width != depth->vulkan_buffer->extent.width ||
+	                      color->vulkan_buffer->extent.height != depth->vulkan_buffer->extent.height));
+
+	VulkanImage* vulkan_buffer =
+	    (with_color ? color->vulkan_buffer
+	                : CreateDummyBuffer(VK_FORMAT_B8G8R8A8_SRGB, depth->vulkan_buffer->extent.width, depth->vulkan_buffer->extent.height));
+
+	VkAttachmentDescription attachments[2];
+	attachments[0].flags          = 0;
+	attachments[0].format         = vulkan_buffer->format;
+	attachments[0].samples        = VK_SAMPLE_COUNT_1_BIT;
+	attachments[0].loadOp         = (key.color_clear_enable ? VK_ATTACHMENT_LOAD_OP_CLEAR : VK_ATTACHMENT_LOAD_OP_LOAD);
+	attachments[0].storeOp        = VK_ATTACHMENT_STORE_OP_STORE;
 	attachments[0].stencilLoadOp  = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
 	attachments[0].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
 	attachments[0].initialLayout  = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
@@ -1568,87 +2259,113 @@ VulkanFramebuffer* FramebufferCache::CreateFramebuffer(RenderColorInfo* color, R
 	EXIT_NOT_IMPLEMENTED(framebuffer->framebuffer == nullptr);
 
 	Framebuffer fnew;
-	fnew.framebuffer          = framebuffer;
-	fnew.image_id             = (with_color ? color->vulkan_buffer->memory.unique_id : 0);
-	fnew.depth_id             = (with_depth ? depth->vulkan_buffer->memory.unique_id : 0);
-	fnew.depth_clear_enable   = depth->depth_clear_enable;
-	fnew.stencil_clear_enable = depth->stencil_clear_enable;
+	fnew.framebuffer = framebuffer;
+	fnew.key         = key;
+	fnew.hash        = hash;
 
-	bool updated = false;
+	int index = -1;
 
-	for (auto& f: m_framebuffers)
+	for (int i = 0; i < static_cast<int>(m_framebuffers.Size()); i++)
 	{
-		if (f.framebuffer == nullptr)
+		if (m_framebuffers[i].framebuffer == nullptr)
 		{
-			f       = fnew;
-			updated = true;
+			m_framebuffers[i] = fnew;
+			index             = i;
 			break;
 		}
 	}
 
-	if (!updated)
+	if (index < 0)
 	{
+		index = static_cast<int>(m_framebuffers.Size());
 		m_framebuffers.Add(fnew);
 	}
 
+	m_framebuffers_map.Put(hash, index);
+
 	return framebuffer;
 }
 
-void FramebufferCache::FreeFramebufferByColor(VulkanImage* image)
+uint64_t FramebufferCache::CalcHash(const Key& k)
 {
-	EXIT_IF(g_render_ctx == nullptr);
-	EXIT_IF(image == nullptr);
-
-	Core::LockGuard lock(m_mutex);
+	return XXH64(&k, sizeof(Key), 0);
+}
 
-	for (auto& f: m_framebuffers)
+VulkanFramebuffer* FramebufferCache::FindFramebuffer(const Key& k, uint64_t hash)
+{
+	const auto* index = m_framebuffers_map.Find(hash);
+	if (index != nullptr)
 	{
-		if (f.framebuffer != nullptr && f.image_id == image->memory.unique_id)
+		const auto& f = m_framebuffers[*index];
+
+		// NOLINTNEXTLINE(bugprone-suspicious-memory-comparison,cert-exp42-c,cert-flp37-c)
+		if (f.framebuffer != nullptr && memcmp(&f.key, &k, sizeof(Key)) == 0)
 		{
-			g_render_ctx->GetPipelineCache()->DeletePipelines(f.framebuffer);
+			return f.framebuffer;
+		}
+	}
+	return nullptr;
+}
+
+void FramebufferCache::DeleteFramebuffer(int index)
+{
+	auto& f = m_framebuffers[index];
+
+	EXIT_IF(f.framebuffer == nullptr);
 
-			auto* gctx = g_render_ctx->GetGraphicCtx();
+	g_render_ctx->GetPipelineCache()->DeletePipelines(f.framebuffer);
 
-			EXIT_IF(gctx == nullptr);
+	auto* gctx = g_render_ctx->GetGraphicCtx();
 
-			vkDestroyFramebuffer(gctx->device, f.framebuffer->framebuffer, nullptr);
+	EXIT_IF(gctx == nullptr);
 
-			vkDestroyRenderPass(gctx->device, f.framebuffer->render_pass, nullptr);
+	vkDestroyFramebuffer(gctx->device, f.framebuffer->framebuffer, nullptr);
 
-			delete f.framebuffer;
+	vkDestroyRenderPass(gctx->device, f.framebuffer->render_pass, nullptr);
 
-			f.framebuffer = nullptr;
+	delete f.framebuffer;
 
-			break;
-		}
+	f.framebuffer = nullptr;
+
+	if (const auto* i = m_framebuffers_map.Find(f.hash); i != nullptr && *i == index)
+	{
+		m_framebuffers_map.Remove(f.hash);
 	}
+
+	m_generation++;
 }
 
-void FramebufferCache::FreeFramebufferByDepth(DepthStencilVulkanImage* image)
+void FramebufferCache::FreeFramebufferByColor(VulkanImage* image)
 {
 	EXIT_IF(g_render_ctx == nullptr);
 	EXIT_IF(image == nullptr);
 
 	Core::LockGuard lock(m_mutex);
 
-	for (auto& f: m_framebuffers)
+	for (int i = 0; i < static_cast<int>(m_framebuffers.Size()); i++)
 	{
-		if (f.framebuffer != nullptr && f.depth_id == image->memory.unique_id)
+		const auto& f = m_framebuffers[i];
+		if (f.framebuffer != nullptr && f.key.image_id == image->memory.unique_id)
 		{
-			g_render_ctx->GetPipelineCache()->DeletePipelines(f.framebuffer);
-
-			auto* gctx = g_render_ctx->GetGraphicCtx();
-
-			EXIT_IF(gctx == nullptr);
-
-			vkDestroyFramebuffer(gctx->device, f.framebuffer->framebuffer, nullptr);
-
-			vkDestroyRenderPass(gctx->device, f.framebuffer->render_pass, nullptr);
+			DeleteFramebuffer(i);
+			break;
+		}
+	}
+}
 
-			delete f.framebuffer;
+void FramebufferCache::FreeFramebufferByDepth(DepthStencilVulkanImage* image)
+{
+	EXIT_IF(g_render_ctx == nullptr);
+	EXIT_IF(image == nullptr);
 
-			f.framebuffer = nullptr;
+	Core::LockGuard lock(m_mutex);
 
+	for (int i = 0; i < static_cast<int>(m_framebuffers.Size()); i++)
+	{
+		const auto& f = m_framebuffers[i];
+		if (f.framebuffer != nullptr && f.key.depth_id == image->memory.unique_id)
+		{
+			DeleteFramebuffer(i);
 			break;
 		}
 	}
@@ -1746,26 +2463,64 @@ VideoOutVulkanImage* FramebufferCache::CreateDummyBuffer(VkFormat format, uint32
 
 VkSampler SamplerCache::GetSampler(uint64_t id)
 {
-	Core::LockGuard lock(m_mutex);
-	if (id < m_samplers.Size())
+	if (id < m_samplers_num.load(std::memory_order_acquire))
 	{
-		return m_samplers.At(id).vk;
+		return m_samplers[id].vk;
 	}
 	return nullptr;
 }
 
+uint64_t SamplerCache::CalcHash(const ShaderSamplerResource& r)
+{
+	return XXH64(r.fields, sizeof(r.fields), 0);
+}
+
 uint64_t SamplerCache::GetSamplerId(const ShaderSamplerResource& r)
 {
-	Core::LockGuard lock(m_mutex);
-	uint32_t        m_samplers_size = m_samplers.Size();
-	for (uint32_t i = 0; i < m_samplers_size; i++)
+	auto hash = CalcHash(r);
+
+	auto find = [this, &r, hash](uint32_t* free_slot) -> int64_t
 	{
-		const auto& s = m_samplers.At(i);
-		if (s.r.fields[0] == r.fields[0] && s.r.fields[1] == r.fields[1] && s.r.fields[2] == r.fields[2] && s.r.fields[3] == r.fields[3])
+		for (uint32_t n = 0; n < INDEX_SIZE; n++)
 		{
-			return i;
+			auto     slot = static_cast<uint32_t>((hash + n) % INDEX_SIZE);
+			uint32_t id   = m_index[slot].load(std::memory_order_acquire);
+			if (id == 0)
+			{
+				if (free_slot != nullptr)
+				{
+					*free_slot = slot;
+				}
+				return -1;
+			}
+			const auto& s = m_samplers[id - 1];
+			if (s.r.fields[0] == r.fields[0] && s.r.fields[1] == r.fields[1] && s.r.fields[2] == r.fields[2] &&
+			    s.r.fields[3] == r.fields[3])
+			{
+				return id - 1;
+			}
 		}
+		return -1;
+	};
+
+	if (auto id = find(nullptr); id >= 0)
+	{
+		return id;
+	}
+
+	Core::LockGuard lock(m_mutex);
+
+	uint32_t free_slot = 0;
+
+	if (auto id = find(&free_slot); id >= 0)
+	{
+		return id;
 	}
+
+	uint32_t m_samplers_size = m_samplers_num.load(std::memory_order_relaxed);
+
+	EXIT_NOT_IMPLEMENTED(m_samplers_size >= SAMPLERS_MAX);
+
 	Sampler s;
 	s.r  = r;
 	s.vk = nullptr;
@@ -1844,7 +2599,10 @@ uint64_t SamplerCache::GetSamplerId(const ShaderSamplerResource& r)
 	vkCreateSampler(g_render_ctx->GetGraphicCtx()->device, &sampler_info, nullptr, &s.vk);
 	EXIT_NOT_IMPLEMENTED(s.vk == nullptr);
 
-	m_samplers.Add(s);
+	m_samplers[m_samplers_size] = s;
+	m_samplers_num.store(m_samplers_size + 1, std::memory_order_release);
+	m_index[free_slot].store(m_samplers_size + 1, std::memory_order_release);
+
 	return m_samplers_size;
 }
 
@@ -1954,7 +2712,7 @@ static void CreateLayout(VkDescriptorSetLayout* set_layouts, uint32_t* set_layou
 
 	EXIT_IF(need_descriptor && bind.push_constant_size == 0);
 
-	if (bind.push_constant_size != 0)
+	if (bind.push_constant_size != 0 && !bind.uniform_buffer)
 	{
 		auto index = *push_constant_info_num;
 
@@ -1973,11 +2731,34 @@ static void CreateLayout(VkDescriptorSetLayout* set_layouts, uint32_t* set_layou
 	}
 }
 
+// Sets with the uniform buffers go after the resource sets of all stages, the slots in between stay empty
+static void CreateUniformLayout(VkDescriptorSetLayout* set_layouts, uint32_t* set_layouts_num, const ShaderBindResources& bind)
+{
+	EXIT_IF(set_layouts == nullptr);
+	EXIT_IF(set_layouts_num == nullptr);
+
+	if (bind.uniform_buffer)
+	{
+		auto* pool = g_render_ctx->GetUniformBufferPool();
+
+		EXIT_IF(bind.uniform_buffer_slot < *set_layouts_num);
+
+		while (*set_layouts_num < bind.uniform_buffer_slot)
+		{
+			set_layouts[*set_layouts_num] = pool->GetEmptyDescriptorSetLayout();
+			(*set_layouts_num)++;
+		}
+
+		set_layouts[*set_layouts_num] = pool->GetDescriptorSetLayout();
+		(*set_layouts_num)++;
+	}
+}
+
 // NOLINTNEXTLINE(readability-function-cognitive-complexity)
-static VulkanPipeline* CreatePipelineInternal(VkRenderPass render_pass, const ShaderVertexInputInfo* vs_input_info,
-                                              const Vector<uint32_t>& vs_shader, const ShaderPixelInputInfo* ps_input_info,
-                                              const Vector<uint32_t>& ps_shader, const PipelineStaticParameters* static_params,
-                                              PipelineDynamicParameters* dynamic_params)
+static VulkanPipeline* CreatePipelineInternal(VkPipelineCache vk_pipeline_cache, VkRenderPass render_pass,
+                                              const ShaderVertexInputInfo* vs_input_info, VkShaderModule vert_shader_module,
+                                              const ShaderPixelInputInfo* ps_input_info, VkShaderModule frag_shader_module,
+                                              const PipelineStaticParameters* static_params, PipelineDynamicParameters* dynamic_params)
 {
 	EXIT_IF(g_render_ctx == nullptr);
 	EXIT_IF(render_pass == nullptr);
@@ -1991,26 +2772,8 @@ static VulkanPipeline* CreatePipelineInternal(VkRenderPass render_pass, const Sh
 	auto* gctx = g_render_ctx->GetGraphicCtx();
 
 	EXIT_IF(gctx == nullptr);
-
-	VkShaderModule vert_shader_module = nullptr;
-	VkShaderModule frag_shader_module = nullptr;
-
-	VkShaderModuleCreateInfo create_info {};
-
-	create_info.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-	create_info.pNext = nullptr;
-	create_info.flags = 0;
-
-	create_info.codeSize = static_cast<size_t>(vs_shader.Size()) * 4;
-	create_info.pCode    = vs_shader.GetDataConst();
-	vkCreateShaderModule(gctx->device, &create_info, nullptr, &vert_shader_module);
-
-	create_info.codeSize = static_cast<size_t>(ps_shader.Size()) * 4;
-	create_info.pCode    = ps_shader.GetDataConst();
-	vkCreateShaderModule(gctx->device, &create_info, nullptr, &frag_shader_module);
-
-	EXIT_NOT_IMPLEMENTED(vert_shader_module == nullptr);
-	EXIT_NOT_IMPLEMENTED(frag_shader_module == nullptr);
+	EXIT_IF(vert_shader_module == nullptr);
+	EXIT_IF(frag_shader_module == nullptr);
 
 	VkPipelineShaderStageCreateInfo vert_shader_stage_info {};
 	vert_shader_stage_info.sType               = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
@@ -2116,18 +2879,23 @@ static VulkanPipeline* CreatePipelineInternal(VkRenderPass render_pass, const Sh
 	input_assembly.topology               = static_params->topology;
 	input_assembly.primitiveRestartEnable = VK_FALSE;
 
+	// Render targets are allocated at the internal resolution, see UtilApplyRenderScale()
+	auto render_scale = UtilGetRenderScale();
+	auto scale_xy     = static_cast<float>(render_scale) / 100.0f;
+
 	VkViewport viewport {};
-	viewport.x        = static_params->viewport_offset[0] - static_params->viewport_scale[0];
-	viewport.y        = static_params->viewport_offset[1] - static_params->viewport_scale[1];
-	viewport.width    = static_params->viewport_scale[0] * 2.0f;
-	viewport.height   = static_params->viewport_scale[1] * 2.0f;
+	viewport.x        = (static_params->viewport_offset[0] - static_params->viewport_scale[0]) * scale_xy;
+	viewport.y        = (static_params->viewport_offset[1] - static_params->viewport_scale[1]) * scale_xy;
+	viewport.width    = static_params->viewport_scale[0] * 2.0f * scale_xy;
+	viewport.height   = static_params->viewport_scale[1] * 2.0f * scale_xy;
 	viewport.minDepth = static_params->viewport_offset[2];
 	viewport.maxDepth = static_params->viewport_scale[2] + static_params->viewport_offset[2];
 
 	VkRect2D scissor {};
-	scissor.offset = {static_params->scissor_ltrb[0], static_params->scissor_ltrb[1]};
-	scissor.extent = {static_cast<uint32_t>(static_params->scissor_ltrb[2] - static_params->scissor_ltrb[0]),
-	                  static_cast<uint32_t>(static_params->scissor_ltrb[3] - static_params->scissor_ltrb[1])};
+	scissor.offset = {static_params->scissor_ltrb[0] * static_cast<int>(render_scale) / 100,
+	                  static_params->scissor_ltrb[1] * static_cast<int>(render_scale) / 100};
+	scissor.extent = {static_cast<uint32_t>(static_params->scissor_ltrb[2] - static_params->scissor_ltrb[0]) * render_scale / 100,
+	                  static_cast<uint32_t>(static_params->scissor_ltrb[3] - static_params->scissor_ltrb[1]) * render_scale / 100};
 
 	VkPipelineViewportStateCreateInfo viewport_state {};
 	viewport_state.sType         = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
@@ -2225,7 +2993,7 @@ static VulkanPipeline* CreatePipelineInternal(VkRenderPass render_pass, const Sh
 	color_blending.blendConstants[2] = static_params->blend_color_blue;
 	color_blending.blendConstants[3] = static_params->blend_color_alpha;
 
-	VkDescriptorSetLayout set_layouts[2]  = {};
+	VkDescriptorSetLayout set_layouts[4]  = {};
 	uint32_t              set_layouts_num = 0;
 
 	VkPushConstantRange push_constant_info[2];
@@ -2235,6 +3003,8 @@ static VulkanPipeline* CreatePipelineInternal(VkRenderPass render_pass, const Sh
 	             /*additional_params->vs_bind,*/ VK_SHADER_STAGE_VERTEX_BIT, DescriptorCache::Stage::Vertex);
 	CreateLayout(set_layouts, &set_layouts_num, push_constant_info, &push_constant_info_num, ps_input_info->bind,
 	             /*additional_params->ps_bind,*/ VK_SHADER_STAGE_FRAGMENT_BIT, DescriptorCache::Stage::Pixel);
+	CreateUniformLayout(set_layouts, &set_layouts_num, vs_input_info->bind);
+	CreateUniformLayout(set_layouts, &set_layouts_num, ps_input_info->bind);
 
 	VkPipelineLayoutCreateInfo pipeline_layout_info {};
 	pipeline_layout_info.sType                  = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
@@ -2277,7 +3047,7 @@ static VulkanPipeline* CreatePipelineInternal(VkRenderPass render_pass, const Sh
 	depth_stencil_info.minDepthBounds        = static_params->depth_min_bounds;
 	depth_stencil_info.maxDepthBounds        = static_params->depth_max_bounds;
 
-	VkDynamicState dynamic_states[8]    = {};
+	VkDynamicState dynamic_states[16]   = {};
 	uint32_t       dynamic_states_count = 0;
 	if (dynamic_params->vk_dynamic_state_line_width)
 	{
@@ -2299,6 +3069,18 @@ static VulkanPipeline* CreatePipelineInternal(VkRenderPass render_pass, const Sh
 	{
 		dynamic_states[dynamic_states_count++] = VK_DYNAMIC_STATE_COLOR_WRITE_ENABLE_EXT;
 	}
+	if (dynamic_params->vk_dynamic_state_extended_ext)
+	{
+		dynamic_states[dynamic_states_count++] = VK_DYNAMIC_STATE_PRIMITIVE_TOPOLOGY_EXT;
+		dynamic_states[dynamic_states_count++] = VK_DYNAMIC_STATE_CULL_MODE_EXT;
+		dynamic_states[dynamic_states_count++] = VK_DYNAMIC_STATE_FRONT_FACE_EXT;
+		dynamic_states[dynamic_states_count++] = VK_DYNAMIC_STATE_DEPTH_TEST_ENABLE_EXT;
+		dynamic_states[dynamic_states_count++] = VK_DYNAMIC_STATE_DEPTH_WRITE_ENABLE_EXT;
+		dynamic_states[dynamic_states_count++] = VK_DYNAMIC_STATE_DEPTH_COMPARE_OP_EXT;
+		dynamic_states[dynamic_states_count++] = VK_DYNAMIC_STATE_DEPTH_BOUNDS_TEST_ENABLE_EXT;
+		dynamic_states[dynamic_states_count++] = VK_DYNAMIC_STATE_STENCIL_TEST_ENABLE_EXT;
+		dynamic_states[dynamic_states_count++] = VK_DYNAMIC_STATE_STENCIL_OP_EXT;
+	}
 
 	VkPipelineDynamicStateCreateInfo dynamic_state {};
 	dynamic_state.sType             = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
@@ -2330,19 +3112,17 @@ static VulkanPipeline* CreatePipelineInternal(VkRenderPass render_pass, const Sh
 
 	EXIT_IF(pipeline->pipeline != nullptr);
 
-	vkCreateGraphicsPipelines(gctx->device, nullptr, 1, &pipeline_info, nullptr, &pipeline->pipeline);
+	vkCreateGraphicsPipelines(gctx->device, vk_pipeline_cache, 1, &pipeline_info, nullptr, &pipeline->pipeline);
 
 	EXIT_NOT_IMPLEMENTED(pipeline->pipeline == nullptr);
 
-	vkDestroyShaderModule(gctx->device, frag_shader_module, nullptr);
-	vkDestroyShaderModule(gctx->device, vert_shader_module, nullptr);
-
 	return pipeline;
 }
 
 // NOLINTNEXTLINE(readability-function-cognitive-complexity)
-static VulkanPipeline* CreatePipelineInternal(const ShaderComputeInputInfo* input_info, const Vector<uint32_t>& cs_shader,
-                                              const PipelineStaticParameters* static_params, PipelineDynamicParameters* dynamic_params)
+static VulkanPipeline* CreatePipelineInternal(VkPipelineCache vk_pipeline_cache, const ShaderComputeInputInfo* input_info,
+                                              const Vector<uint32_t>& cs_shader, const PipelineStaticParameters* static_params,
+                                              PipelineDynamicParameters* dynamic_params)
 {
 	EXIT_IF(g_render_ctx == nullptr);
 	EXIT_IF(static_params == nullptr);
@@ -2369,6 +3149,21 @@ static VulkanPipeline* CreatePipelineInternal(const ShaderComputeInputInfo* inpu
 
 	EXIT_NOT_IMPLEMENTED(comp_shader_module == nullptr);
 
+	// Workgroup size, see SpecId decorations of the recompiled module
+	VkSpecializationMapEntry spec_entries[3];
+	for (uint32_t i = 0; i < 3; i++)
+	{
+		spec_entries[i].constantID = i;
+		spec_entries[i].offset     = i * static_cast<uint32_t>(sizeof(uint32_t));
+		spec_entries[i].size       = sizeof(uint32_t);
+	}
+
+	VkSpecializationInfo spec_info {};
+	spec_info.mapEntryCount = 3;
+	spec_info.pMapEntries   = spec_entries;
+	spec_info.dataSize      = sizeof(input_info->threads_num);
+	spec_info.pData         = input_info->threads_num;
+
 	VkPipelineShaderStageCreateInfo comp_shader_stage_info {};
 	comp_shader_stage_info.sType               = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
 	comp_shader_stage_info.pNext               = nullptr;
@@ -2376,9 +3171,9 @@ static VulkanPipeline* CreatePipelineInternal(const ShaderComputeInputInfo* inpu
 	comp_shader_stage_info.stage               = VK_SHADER_STAGE_COMPUTE_BIT;
 	comp_shader_stage_info.module              = comp_shader_module;
 	comp_shader_stage_info.pName               = "main";
-	comp_shader_stage_info.pSpecializationInfo = nullptr;
+	comp_shader_stage_info.pSpecializationInfo = &spec_info;
 
-	VkDescriptorSetLayout set_layouts[1]  = {};
+	VkDescriptorSetLayout set_layouts[2]  = {};
 	uint32_t              set_layouts_num = 0;
 
 	VkPushConstantRange push_constant_info[1];
@@ -2387,6 +3182,7 @@ static VulkanPipeline* CreatePipelineInternal(const ShaderComputeInputInfo* inpu
 	CreateLayout(set_layouts, &set_layouts_num, push_constant_info, &push_constant_info_num,
 	             input_info->bind, /*additional_params->cs_bind,*/
 	             VK_SHADER_STAGE_COMPUTE_BIT, DescriptorCache::Stage::Compute);
+	CreateUniformLayout(set_layouts, &set_layouts_num, input_info->bind);
 
 	VkPipelineLayoutCreateInfo pipeline_layout_info {};
 	pipeline_layout_info.sType                  = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
@@ -2414,7 +3210,7 @@ static VulkanPipeline* CreatePipelineInternal(const ShaderComputeInputInfo* inpu
 
 	EXIT_IF(pipeline->pipeline != nullptr);
 
-	vkCreateComputePipelines(gctx->device, nullptr, 1, &info, nullptr, &pipeline->pipeline);
+	vkCreateComputePipelines(gctx->device, vk_pipeline_cache, 1, &info, nullptr, &pipeline->pipeline);
 
 	EXIT_NOT_IMPLEMENTED(pipeline->pipeline == nullptr);
 
@@ -2435,7 +3231,8 @@ bool PipelineDynamicParameters::operator==(const PipelineDynamicParameters& othe
 	        vk_dynamic_state_stencil_compare_mask != other.vk_dynamic_state_stencil_compare_mask ||
 	        vk_dynamic_state_stencil_write_mask != other.vk_dynamic_state_stencil_write_mask ||
 	        vk_dynamic_state_stencil_reference != other.vk_dynamic_state_stencil_reference ||
-	        vk_dynamic_state_color_write_enable_ext != other.vk_dynamic_state_color_write_enable_ext);
+	        vk_dynamic_state_color_write_enable_ext != other.vk_dynamic_state_color_write_enable_ext ||
+	        vk_dynamic_state_extended_ext != other.vk_dynamic_state_extended_ext);
 
 	if (!vk_dynamic_state_line_width)
 	{
@@ -2472,6 +3269,19 @@ bool PipelineDynamicParameters::operator==(const PipelineDynamicParameters& othe
 			return false;
 		}
 	}
+	if (!vk_dynamic_state_extended_ext)
+	{
+		// NOLINTNEXTLINE(bugprone-suspicious-memory-comparison,cert-exp42-c,cert-flp37-c)
+		if (topology != other.topology || cull_mode != other.cull_mode || front_face != other.front_face ||
+		    depth_test_enable != other.depth_test_enable || depth_write_enable != other.depth_write_enable ||
+		    depth_compare_op != other.depth_compare_op || depth_bounds_test_enable != other.depth_bounds_test_enable ||
+		    stencil_test_enable != other.stencil_test_enable ||
+		    memcmp(&stencil_front_ops, &other.stencil_front_ops, sizeof(PipelineStencilStaticState)) != 0 ||
+		    memcmp(&stencil_back_ops, &other.stencil_back_ops, sizeof(PipelineStencilStaticState)) != 0)
+		{
+			return false;
+		}
+	}
 	return true;
 }
 
@@ -2479,52 +3289,402 @@ void PipelineCache::DeletePipelineInternal(uint32_t id)
 {
 	EXIT_NOT_IMPLEMENTED(!m_pipelines.IndexValid(id));
 
-	Pipeline& p = m_pipelines[id];
+	DumpPipeline("delete", id);
 
-	EXIT_IF(g_render_ctx == nullptr);
-	EXIT_IF(p.pipeline == nullptr);
-	EXIT_IF(p.pipeline->pipeline == nullptr);
-	EXIT_IF(p.pipeline->pipeline_layout == nullptr);
-	EXIT_IF(p.static_params == nullptr);
-	EXIT_IF(p.dynamic_params == nullptr);
+	auto& p   = m_pipelines[id];
+	auto& ids = m_map[p.hash];
+	ids.Remove(static_cast<int>(id));
+	if (ids.IsEmpty())
+	{
+		m_map.Remove(p.hash);
+	}
 
-	EXIT_IF(p.pipeline->static_params != p.static_params);
-	EXIT_IF(p.pipeline->dynamic_params != p.dynamic_params);
+	LruRemove(id);
+	DestroyPipeline(&p);
 
-	DumpPipeline("delete", id);
+	m_free_ids.Add(id);
+	m_pipelines_num--;
+	m_generation++;
+}
+
+void PipelineCache::DestroyPipeline(Pipeline* p)
+{
+	EXIT_IF(p == nullptr);
+	EXIT_IF(g_render_ctx == nullptr);
+	EXIT_IF(p->pipeline == nullptr);
+	EXIT_IF(p->pipeline->pipeline == nullptr);
+	EXIT_IF(p->pipeline->pipeline_layout == nullptr);
+	EXIT_IF(p->static_params == nullptr);
+	EXIT_IF(p->dynamic_params == nullptr);
+
+	EXIT_IF(p->pipeline->static_params != p->static_params);
+	EXIT_IF(p->pipeline->dynamic_params != p->dynamic_params);
+
+	delete p->static_params;
+	delete p->dynamic_params;
+
+	p->static_params  = nullptr;
+	p->dynamic_params = nullptr;
+
+	auto* gctx = g_render_ctx->GetGraphicCtx();
+
+	EXIT_IF(gctx == nullptr);
+
+	vkDestroyPipeline(gctx->device, p->pipeline->pipeline, nullptr);
+	vkDestroyPipelineLayout(gctx->device, p->pipeline->pipeline_layout, nullptr);
+
+	delete p->pipeline;
+
+	p->pipeline = nullptr;
+}
+
+static uint64_t hash_shader_id(const ShaderId& id, uint64_t seed)
+{
+	uint64_t h = XXH64(&id.hash0, sizeof(id.hash0), seed);
+	h          = XXH64(&id.crc32, sizeof(id.crc32), h);
+	return XXH64(id.ids.GetDataConst(), static_cast<size_t>(id.ids.Size()) * sizeof(uint32_t), h);
+}
+
+// Modules are shared between the variants of a shader, pipelines are not
+static uint64_t hash_pipeline_shader_id(const ShaderId& id, uint64_t seed)
+{
+	return XXH64(id.variant_ids.GetDataConst(), static_cast<size_t>(id.variant_ids.Size()) * sizeof(uint32_t), hash_shader_id(id, seed));
+}
+
+VkShaderModule PipelineCache::FindShaderModule(ShaderType type, const ShaderId& id)
+{
+	Core::LockGuard lock(m_modules_mutex);
+
+	const auto* modules = m_modules.Find(hash_shader_id(id, static_cast<uint64_t>(type)));
+
+	if (modules != nullptr)
+	{
+		for (const auto& m: *modules)
+		{
+			if (m.type == type && m.id.IsSameModule(id))
+			{
+				return m.module;
+			}
+		}
+	}
 
-	delete p.static_params;
-	delete p.dynamic_params;
+	return nullptr;
+}
 
-	p.static_params  = nullptr;
-	p.dynamic_params = nullptr;
+// Called by the worker threads too. If the same stage was added by another thread in the meantime, its module is returned.
+VkShaderModule PipelineCache::AddShaderModule(ShaderType type, const ShaderId& id, const Vector<uint32_t>& spirv)
+{
+	EXIT_IF(g_render_ctx == nullptr);
+	EXIT_IF(spirv.IsEmpty());
 
 	auto* gctx = g_render_ctx->GetGraphicCtx();
 
 	EXIT_IF(gctx == nullptr);
 
-	vkDestroyPipeline(gctx->device, p.pipeline->pipeline, nullptr);
-	vkDestroyPipelineLayout(gctx->device, p.pipeline->pipeline_layout, nullptr);
+	VkShaderModuleCreateInfo create_info {};
+	create_info.sType    = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+	create_info.pNext    = nullptr;
+	create_info.flags    = 0;
+	create_info.codeSize = static_cast<size_t>(spirv.Size()) * 4;
+	create_info.pCode    = spirv.GetDataConst();
+
+	VkShaderModule module = nullptr;
+	vkCreateShaderModule(gctx->device, &create_info, nullptr, &module);
+
+	EXIT_NOT_IMPLEMENTED(module == nullptr);
+
+	Core::LockGuard lock(m_modules_mutex);
+
+	auto& modules = m_modules[hash_shader_id(id, static_cast<uint64_t>(type))];
+
+	for (const auto& m: modules)
+	{
+		if (m.type == type && m.id.IsSameModule(id))
+		{
+			vkDestroyShaderModule(gctx->device, module, nullptr);
+			return m.module;
+		}
+	}
+
+	ShaderModule m;
+	m.type   = type;
+	m.id     = id;
+	m.module = module;
+	modules.Add(m);
+
+	return module;
+}
+
+// Dynamic parameters are not hashed: most of them are dynamic states, the rest is compared in IsSame()
+uint64_t PipelineCache::CalcHash(const Pipeline& p)
+{
+	EXIT_IF(p.static_params == nullptr);
 
-	delete p.pipeline;
+	uint64_t h = XXH64(p.static_params, sizeof(PipelineStaticParameters), p.render_pass_id);
+	h          = hash_pipeline_shader_id(p.vs_shader_id, h);
+	h          = hash_pipeline_shader_id(p.ps_shader_id, h);
+	return hash_pipeline_shader_id(p.cs_shader_id, h);
+}
 
-	p.pipeline = nullptr;
+bool PipelineCache::IsSame(const Pipeline& p1, const Pipeline& p2)
+{
+	return (p1.hash == p2.hash && p1.render_pass_id == p2.render_pass_id && p1.vs_shader_id == p2.vs_shader_id &&
+	        p1.ps_shader_id == p2.ps_shader_id && p1.cs_shader_id == p2.cs_shader_id && *p1.static_params == *p2.static_params &&
+	        *p1.dynamic_params == *p2.dynamic_params);
 }
 
-VulkanPipeline* PipelineCache::Find(const Pipeline& p) const
+VulkanPipeline* PipelineCache::Find(const Pipeline& p)
 {
-	for (const auto& pn: m_pipelines)
+	const auto* ids = m_map.Find(p.hash);
+
+	if (ids != nullptr)
 	{
-		if (pn.pipeline != nullptr && p.render_pass_id == pn.render_pass_id && p.vs_shader_id == pn.vs_shader_id &&
-		    p.ps_shader_id == pn.ps_shader_id && p.cs_shader_id == pn.cs_shader_id && *p.static_params == *pn.static_params &&
-		    *p.dynamic_params == *pn.dynamic_params)
+		for (int id: *ids)
 		{
-			return pn.pipeline;
+			auto& pn = m_pipelines[id];
+			if (pn.pipeline != nullptr && IsSame(p, pn))
+			{
+				pn.last_frame = GraphicsRunGetFrameNum();
+				LruRemove(static_cast<uint32_t>(id));
+				LruAdd(static_cast<uint32_t>(id));
+				GpuCounterAdd(GpuCounter::PipelineCacheHits);
+				return pn.pipeline;
+			}
 		}
 	}
+	GpuCounterAdd(GpuCounter::PipelineCacheMisses);
 	return nullptr;
 }
 
+void PipelineCache::LruAdd(uint32_t id)
+{
+	auto& p = m_pipelines[id];
+
+	p.lru_prev = m_lru_tail;
+	p.lru_next = LRU_NONE;
+
+	if (m_lru_tail != LRU_NONE)
+	{
+		m_pipelines[m_lru_tail].lru_next = id;
+	} else
+	{
+		m_lru_head = id;
+	}
+	m_lru_tail = id;
+}
+
+void PipelineCache::LruRemove(uint32_t id)
+{
+	auto& p = m_pipelines[id];
+
+	if (p.lru_prev != LRU_NONE)
+	{
+		m_pipelines[p.lru_prev].lru_next = p.lru_next;
+	} else
+	{
+		m_lru_head = p.lru_next;
+	}
+
+	if (p.lru_next != LRU_NONE)
+	{
+		m_pipelines[p.lru_next].lru_prev = p.lru_prev;
+	} else
+	{
+		m_lru_tail = p.lru_prev;
+	}
+
+	p.lru_prev = LRU_NONE;
+	p.lru_next = LRU_NONE;
+}
+
+void PipelineCache::EvictLeastRecentlyUsed()
+{
+	// Pipeline can still be referenced by the command buffers of the last few frames
+	auto min_frames = static_cast<int>(Config::GetPipelineEvictMinFrames());
+
+	// Otherwise everything is in use, so let the cache grow
+	if (m_lru_head != LRU_NONE && GraphicsRunGetFrameNum() - m_pipelines[m_lru_head].last_frame >= min_frames)
+	{
+		DeletePipelineInternal(m_lru_head);
+	}
+}
+
+void PipelineCache::Insert(const Pipeline& p)
+{
+	EXIT_IF(p.pipeline == nullptr);
+
+	if (m_pipelines_num >= MAX_PIPELINES)
+	{
+		EvictLeastRecentlyUsed();
+	}
+
+	uint32_t id = 0;
+
+	if (!m_free_ids.IsEmpty())
+	{
+		id = m_free_ids[m_free_ids.Size() - 1];
+		m_free_ids.RemoveAt(m_free_ids.Size() - 1);
+		EXIT_IF(m_pipelines[id].pipeline != nullptr);
+		m_pipelines[id] = p;
+	} else
+	{
+		id = m_pipelines.Size();
+		m_pipelines.Add(p);
+	}
+
+	m_pipelines[id].last_frame = GraphicsRunGetFrameNum();
+	m_map[p.hash].Add(static_cast<int>(id));
+	m_pipelines_num++;
+	LruAdd(id);
+
+	DumpPipeline("create", id);
+}
+
+// Runs on the shared job pool
+void PipelineCache::Compile(PipelineJob* job)
+{
+	EXIT_IF(job == nullptr);
+
+	KYTY_PROFILER_BLOCK("PipelineCache::Compile", profiler::colors::DeepOrangeA200);
+
+	std::function<void()> tasks[2];
+	uint32_t              tasks_num = 0;
+
+	if (job->vs_module == nullptr)
+	{
+		tasks[tasks_num++] = [this, job]()
+		{
+			Vector<uint32_t> vs_shader;
+			if (!ShaderCacheLoad(ShaderType::Vertex, job->p.vs_shader_id, &vs_shader))
+			{
+				vs_shader = ShaderRecompileVS(job->vs_code, &job->vs_input_info);
+				ShaderCacheStore(ShaderType::Vertex, job->p.vs_shader_id, vs_shader);
+			}
+			job->vs_module = AddShaderModule(ShaderType::Vertex, job->p.vs_shader_id, vs_shader);
+		};
+	}
+
+	if (job->ps_module == nullptr)
+	{
+		tasks[tasks_num++] = [this, job]()
+		{
+			Vector<uint32_t> ps_shader;
+			if (!ShaderCacheLoad(ShaderType::Pixel, job->p.ps_shader_id, &ps_shader))
+			{
+				ps_shader = ShaderRecompilePS(job->ps_code, &job->ps_input_info);
+				ShaderCacheStore(ShaderType::Pixel, job->p.ps_shader_id, ps_shader);
+			}
+			job->ps_module = AddShaderModule(ShaderType::Pixel, job->p.ps_shader_id, ps_shader);
+		};
+	}
+
+	ShaderRunTranslations(tasks, tasks_num);
+
+	job->p.pipeline = CreatePipelineInternal(m_vk_pipeline_cache, job->render_pass, &job->vs_input_info, job->vs_module,
+	                                         &job->ps_input_info, job->ps_module, job->p.static_params, job->p.dynamic_params);
+
+	EXIT_NOT_IMPLEMENTED(job->p.pipeline == nullptr);
+
+	Core::LockGuard lock(m_jobs_mutex);
+	job->ready = true;
+	m_jobs_ready_cond_var.SignalAll();
+}
+
+void PipelineCache::WaitForJobs()
+{
+	Core::LockGuard lock(m_jobs_mutex);
+
+	while (m_jobs.Contains(false, [](auto job, auto ready) { return job->ready == ready; }))
+	{
+		m_jobs_ready_cond_var.Wait(&m_jobs_mutex);
+	}
+}
+
+// Returns nullptr until the pipeline is compiled. The draw is skipped in this case.
+VulkanPipeline* PipelineCache::CreatePipelineAsync(const Pipeline& p, VkRenderPass render_pass, const ShaderVertexInputInfo* vs_input_info,
+                                                   const ShaderPixelInputInfo* ps_input_info, const HW::VertexShaderInfo* vs_regs,
+                                                   const HW::PixelShaderInfo* ps_regs, const HW::ShaderRegisters* sh_regs)
+{
+	PipelineJob* ready_job = nullptr;
+	{
+		Core::LockGuard lock(m_jobs_mutex);
+
+		for (uint32_t index = 0; index < m_jobs.Size(); index++)
+		{
+			auto* job = m_jobs[index];
+			if (IsSame(p, job->p))
+			{
+				if (!job->ready)
+				{
+					delete p.static_params;
+					delete p.dynamic_params;
+					return nullptr;
+				}
+				ready_job = job;
+				m_jobs.RemoveAt(index);
+				break;
+			}
+		}
+	}
+
+	if (ready_job != nullptr)
+	{
+		*ready_job->p.dynamic_params = *p.dynamic_params;
+		delete p.static_params;
+		delete p.dynamic_params;
+
+		auto pn = ready_job->p;
+		delete ready_job;
+
+		AddRecord(pn);
+		Insert(pn);
+
+		return pn.pipeline;
+	}
+
+	// Shader code is read from the guest memory, so parse it here while it's still valid. Stages which are already compiled are reused.
+	auto* job          = new PipelineJob;
+	job->p             = p;
+	job->render_pass   = render_pass;
+	job->vs_input_info = *vs_input_info;
+	job->ps_input_info = *ps_input_info;
+	job->vs_module     = FindShaderModule(ShaderType::Vertex, p.vs_shader_id);
+	job->ps_module     = FindShaderModule(ShaderType::Pixel, p.ps_shader_id);
+
+	if (job->vs_module == nullptr)
+	{
+		job->vs_code = ShaderParseVS(vs_regs, sh_regs);
+	}
+	if (job->ps_module == nullptr)
+	{
+		job->ps_code = ShaderParsePS(ps_regs, sh_regs);
+	}
+
+	{
+		Core::LockGuard lock(m_jobs_mutex);
+		m_jobs.Add(job);
+	}
+
+	Core::JobSystem::Submit([this, job]() { Compile(job); }, Core::JobPriority::Low);
+
+	return nullptr;
+}
+
+static void get_scissor_ltrb(const HW::ScreenViewport& vp, int* ltrb)
+{
+	const auto& v = vp.viewports[0];
+
+	bool generic_scissor =
+	    (vp.generic_scissor_left != 0 || vp.generic_scissor_top != 0 || vp.generic_scissor_right != 0 || vp.generic_scissor_bottom != 0);
+	bool viewport_scissor =
+	    (v.viewport_scissor_left != 0 || v.viewport_scissor_top != 0 || v.viewport_scissor_right != 0 || v.viewport_scissor_bottom != 0);
+
+	ltrb[0] = (viewport_scissor ? v.viewport_scissor_left : (generic_scissor ? vp.generic_scissor_left : vp.screen_scissor_left));
+	ltrb[1] = (viewport_scissor ? v.viewport_scissor_top : (generic_scissor ? vp.generic_scissor_top : vp.screen_scissor_top));
+	ltrb[2] = (viewport_scissor ? v.viewport_scissor_right : (generic_scissor ? vp.generic_scissor_right : vp.screen_scissor_right));
+	ltrb[3] = (viewport_scissor ? v.viewport_scissor_bottom : (generic_scissor ? vp.generic_scissor_bottom : vp.screen_scissor_bottom));
+}
+
 VulkanPipeline* PipelineCache::CreatePipeline(VulkanFramebuffer* framebuffer, RenderColorInfo* color, RenderDepthInfo* depth,
                                               const ShaderVertexInputInfo* vs_input_info, HW::Context* ctx, HW::Shader* sh_ctx,
                                               const ShaderPixelInputInfo* ps_input_info, VkPrimitiveTopology topology)
@@ -2571,25 +3731,13 @@ VulkanPipeline* PipelineCache::CreatePipeline(VulkanFramebuffer* framebuffer, Re
 
 	EXIT_NOT_IMPLEMENTED(depth->depth_test_enable && ps_input_info->ps_execute_on_noop);
 
-	bool generic_scissor =
-	    (vp.generic_scissor_left != 0 || vp.generic_scissor_top != 0 || vp.generic_scissor_right != 0 || vp.generic_scissor_bottom != 0);
-	bool viewport_scissor = (vp.viewports[0].viewport_scissor_left != 0 || vp.viewports[0].viewport_scissor_top != 0 ||
-	                         vp.viewports[0].viewport_scissor_right != 0 || vp.viewports[0].viewport_scissor_bottom != 0);
-
 	p.static_params->viewport_scale[0]  = vp.viewports[0].xscale;
 	p.static_params->viewport_scale[1]  = vp.viewports[0].yscale;
 	p.static_params->viewport_scale[2]  = vp.viewports[0].zscale;
 	p.static_params->viewport_offset[0] = vp.viewports[0].xoffset;
 	p.static_params->viewport_offset[1] = vp.viewports[0].yoffset;
 	p.static_params->viewport_offset[2] = vp.viewports[0].zoffset;
-	p.static_params->scissor_ltrb[0] =
-	    (viewport_scissor ? vp.viewports[0].viewport_scissor_left : (generic_scissor ? vp.generic_scissor_left : vp.screen_scissor_left));
-	p.static_params->scissor_ltrb[1] =
-	    (viewport_scissor ? vp.viewports[0].viewport_scissor_top : (generic_scissor ? vp.generic_scissor_top : vp.screen_scissor_top));
-	p.static_params->scissor_ltrb[2]          = (viewport_scissor ? vp.viewports[0].viewport_scissor_right
-	                                                              : (generic_scissor ? vp.generic_scissor_right : vp.screen_scissor_right));
-	p.static_params->scissor_ltrb[3]          = (viewport_scissor ? vp.viewports[0].viewport_scissor_bottom
-	                                                              : (generic_scissor ? vp.generic_scissor_bottom : vp.screen_scissor_bottom));
+	get_scissor_ltrb(vp, p.static_params->scissor_ltrb);
 	p.static_params->topology                 = topology;
 	p.static_params->with_depth               = (depth->format != VK_FORMAT_UNDEFINED && depth->vulkan_buffer != nullptr);
 	p.static_params->depth_test_enable        = depth->depth_test_enable;
@@ -2623,6 +3771,133 @@ VulkanPipeline* PipelineCache::CreatePipeline(VulkanFramebuffer* framebuffer, Re
 	p.dynamic_params->stencil_back       = depth->stencil_dynamic_back;
 	p.dynamic_params->color_write_enable = (cc.mode == 1);
 
+	if (g_render_ctx->GetGraphicCtx()->extended_dynamic_state)
+	{
+		// Pipelines which differ only in this state are shared. All the topologies used by the draws are in the triangle class, which
+		// is what the static topology has to match.
+		auto* sp = p.static_params;
+		auto* dp = p.dynamic_params;
+
+		dp->vk_dynamic_state_extended_ext = true;
+		dp->topology                      = sp->topology;
+		dp->cull_mode  = (sp->cull_back ? VK_CULL_MODE_BACK_BIT : 0u) | (sp->cull_front ? VK_CULL_MODE_FRONT_BIT : 0u);
+		dp->front_face = (sp->face ? VK_FRONT_FACE_CLOCKWISE : VK_FRONT_FACE_COUNTER_CLOCKWISE);
+		dp->depth_test_enable        = sp->depth_test_enable;
+		dp->depth_write_enable       = sp->depth_write_enable;
+		dp->depth_compare_op         = sp->depth_compare_op;
+		dp->depth_bounds_test_enable = sp->depth_bounds_test_enable;
+		dp->stencil_test_enable      = sp->stencil_test_enable;
+		dp->stencil_front_ops        = sp->stencil_front;
+		dp->stencil_back_ops         = sp->stencil_back;
+
+		sp->topology                 = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+		sp->cull_back                = false;
+		sp->cull_front               = false;
+		sp->face                     = false;
+		sp->depth_test_enable        = false;
+		sp->depth_write_enable       = false;
+		sp->depth_compare_op         = VK_COMPARE_OP_NEVER;
+		sp->depth_bounds_test_enable = false;
+		sp->stencil_test_enable      = false;
+		sp->stencil_front            = PipelineStencilStaticState();
+		sp->stencil_back             = PipelineStencilStaticState();
+	}
+
+	p.hash = CalcHash(p);
+
+	auto* found = Find(p);
+
+	if (found != nullptr)
+	{
+		*found->dynamic_params = *p.dynamic_params;
+		delete p.static_params;
+		delete p.dynamic_params;
+		return found;
+	}
+
+	if (Config::AsyncPipelinesEnabled())
+	{
+		return CreatePipelineAsync(p, framebuffer->render_pass, vs_input_info, ps_input_info, &vs_regs, &ps_regs, &sh_regs);
+	}
+
+	VkShaderModule vs_module = FindShaderModule(ShaderType::Vertex, vs_id);
+	VkShaderModule ps_module = FindShaderModule(ShaderType::Pixel, ps_id);
+
+	// Both stages are translated at the same time, the guest code stays valid because this thread waits for them
+	std::function<void()> tasks[2];
+	uint32_t              tasks_num = 0;
+
+	if (vs_module == nullptr)
+	{
+		tasks[tasks_num++] = [&]()
+		{
+			Vector<uint32_t> vs_shader;
+			if (!ShaderCacheLoad(ShaderType::Vertex, vs_id, &vs_shader))
+			{
+				auto vs_code = ShaderParseVS(&vs_regs, &sh_regs);
+				vs_shader    = ShaderRecompileVS(vs_code, vs_input_info);
+				ShaderCacheStore(ShaderType::Vertex, vs_id, vs_shader);
+			}
+			vs_module = AddShaderModule(ShaderType::Vertex, vs_id, vs_shader);
+		};
+	}
+
+	if (ps_module == nullptr)
+	{
+		tasks[tasks_num++] = [&]()
+		{
+			Vector<uint32_t> ps_shader;
+			if (!ShaderCacheLoad(ShaderType::Pixel, ps_id, &ps_shader))
+			{
+				auto ps_code = ShaderParsePS(&ps_regs, &sh_regs);
+				ps_shader    = ShaderRecompilePS(ps_code, ps_input_info);
+				ShaderCacheStore(ShaderType::Pixel, ps_id, ps_shader);
+			}
+			ps_module = AddShaderModule(ShaderType::Pixel, ps_id, ps_shader);
+		};
+	}
+
+	ShaderRunTranslations(tasks, tasks_num);
+
+	p.pipeline = CreatePipelineInternal(m_vk_pipeline_cache, framebuffer->render_pass, vs_input_info, vs_module, ps_input_info, ps_module,
+	                                    p.static_params, p.dynamic_params);
+
+	EXIT_NOT_IMPLEMENTED(p.pipeline == nullptr);
+
+	AddRecord(p);
+
+	Insert(p);
+
+	return p.pipeline;
+}
+
+VulkanPipeline* PipelineCache::CreatePipeline(const ShaderComputeInputInfo* input_info, const HW::ComputeShaderInfo* cs_regs,
+                                              const HW::ShaderRegisters* sh_regs)
+{
+	KYTY_PROFILER_BLOCK("PipelineCache::CreatePipeline(Compute)", profiler::colors::RedA100);
+
+	EXIT_IF(cs_regs == nullptr);
+	EXIT_IF(sh_regs == nullptr);
+
+	Core::LockGuard lock(m_mutex);
+
+	ShaderDbgDumpInputInfo(input_info);
+
+	auto cs_id = ShaderGetIdCS(cs_regs, input_info);
+
+	Pipeline p {};
+	p.cs_shader_id   = cs_id;
+	p.static_params  = new PipelineStaticParameters;
+	p.dynamic_params = new PipelineDynamicParameters;
+
+	p.dynamic_params->vk_dynamic_state_line_width           = true;
+	p.dynamic_params->vk_dynamic_state_stencil_compare_mask = true;
+	p.dynamic_params->vk_dynamic_state_stencil_reference    = true;
+	p.dynamic_params->vk_dynamic_state_stencil_write_mask   = true;
+	p.dynamic_params->color_write_enable                    = true;
+
+	p.hash = CalcHash(p);
+
 	auto* found = Find(p);
 
 	if (found != nullptr)
@@ -2633,173 +3908,534 @@ VulkanPipeline* PipelineCache::CreatePipeline(VulkanFramebuffer* framebuffer, Re
 		return found;
 	}
 
-	auto vs_code = ShaderParseVS(&vs_regs, &sh_regs);
-	auto ps_code = ShaderParsePS(&ps_regs, &sh_regs);
+	Vector<uint32_t> cs_shader;
 
-	auto vs_shader = ShaderRecompileVS(vs_code, vs_input_info);
-	auto ps_shader = ShaderRecompilePS(ps_code, ps_input_info);
+	if (!ShaderCacheLoad(ShaderType::Compute, cs_id, &cs_shader))
+	{
+		auto cs_code = ShaderParseCS(cs_regs, sh_regs);
+		cs_shader    = ShaderRecompileCS(cs_code, input_info);
+		ShaderCacheStore(ShaderType::Compute, cs_id, cs_shader);
+	}
 
-	EXIT_IF(vs_shader.IsEmpty());
-	EXIT_IF(ps_shader.IsEmpty());
+	EXIT_IF(cs_shader.IsEmpty());
 
-	p.pipeline = CreatePipelineInternal(framebuffer->render_pass, vs_input_info, vs_shader, ps_input_info, ps_shader, p.static_params,
-	                                    p.dynamic_params);
+	p.pipeline = CreatePipelineInternal(m_vk_pipeline_cache, input_info, cs_shader, p.static_params, p.dynamic_params /*, params2*/);
 
 	EXIT_NOT_IMPLEMENTED(p.pipeline == nullptr);
 
-	bool updated = false;
-	int  index   = 0;
-	for (auto& pn: m_pipelines)
+	AddRecord(p);
+
+	Insert(p);
+
+	return p.pipeline;
+}
+
+void PipelineCache::DeletePipeline(VulkanPipeline* pipeline)
+{
+	Core::LockGuard lock(m_mutex);
+
+	auto index = m_pipelines.Find(pipeline, [](auto r, auto p) { return p == r.pipeline; });
+
+	EXIT_IF(!m_pipelines.IndexValid(index));
+
+	if (m_pipelines.IndexValid(index))
+	{
+		DeletePipelineInternal(index);
+	}
+}
+
+void PipelineCache::DeletePipelines(VulkanFramebuffer* framebuffer)
+{
+	EXIT_IF(framebuffer == nullptr);
+
+	Core::LockGuard lock(m_mutex);
+
+	for (uint32_t index = 0; index < m_pipelines.Size(); index++)
 	{
-		if (pn.pipeline == nullptr)
+		const auto& p = m_pipelines[index];
+		if (p.pipeline != nullptr && p.render_pass_id == framebuffer->render_pass_id)
 		{
-			pn      = p;
-			updated = true;
+			DeletePipelineInternal(index);
+		}
+	}
+
+	DeleteJobs(framebuffer);
+}
 
-			DumpPipeline("create", index);
+void PipelineCache::DeleteAllPipelines()
+{
+	Core::LockGuard lock(m_mutex);
 
-			break;
+	for (uint32_t index = 0; index < m_pipelines.Size(); index++)
+	{
+		if (m_pipelines[index].pipeline != nullptr)
+		{
+			DeletePipelineInternal(index);
+		}
+	}
+
+	DeleteJobs(nullptr);
+}
+
+void PipelineCache::DeleteJobs(const VulkanFramebuffer* framebuffer)
+{
+	WaitForJobs();
+
+	Core::LockGuard lock(m_jobs_mutex);
+
+	for (uint32_t index = 0; index < m_jobs.Size();)
+	{
+		auto* job = m_jobs[index];
+		if (framebuffer == nullptr || job->p.render_pass_id == framebuffer->render_pass_id)
+		{
+			DestroyPipeline(&job->p);
+			delete job;
+			m_jobs.RemoveAt(index);
+		} else
+		{
+			index++;
 		}
-		index++;
 	}
+}
+
+void PipelineCache::DumpToFile(Core::File* f, const Pipeline& p) {}
+
+static void write_ids(Core::File* f, const Vector<uint32_t>& ids)
+{
+	uint32_t ids_num = ids.Size();
+	f->Write(&ids_num, sizeof(ids_num));
+	if (ids_num > 0)
+	{
+		f->Write(ids.GetDataConst(), ids_num * static_cast<uint32_t>(sizeof(uint32_t)));
+	}
+}
+
+static void write_shader_id(Core::File* f, const ShaderId& id)
+{
+	f->Write(&id.hash0, sizeof(id.hash0));
+	f->Write(&id.crc32, sizeof(id.crc32));
+	write_ids(f, id.ids);
+	write_ids(f, id.variant_ids);
+}
+
+static bool read_data(Core::File* f, void* data, uint32_t size)
+{
+	uint32_t bytes_read = 0;
+	f->Read(data, size, &bytes_read);
+	return bytes_read == size;
+}
+
+static bool read_ids(Core::File* f, Vector<uint32_t>* ids)
+{
+	uint32_t ids_num = 0;
+	if (!read_data(f, &ids_num, sizeof(ids_num)) || ids_num > f->Remaining() / sizeof(uint32_t))
+	{
+		return false;
+	}
+	*ids = Vector<uint32_t>(ids_num);
+	return (ids_num == 0 || read_data(f, ids->GetData(), ids_num * static_cast<uint32_t>(sizeof(uint32_t))));
+}
+
+static bool read_shader_id(Core::File* f, ShaderId* id)
+{
+	return read_data(f, &id->hash0, sizeof(id->hash0)) && read_data(f, &id->crc32, sizeof(id->crc32)) && read_ids(f, &id->ids) &&
+	       read_ids(f, &id->variant_ids);
+}
+
+void PipelineCache::AddRecord(const Pipeline& p)
+{
+	if (m_vk_pipeline_cache == nullptr)
+	{
+		return;
+	}
+
+	for (auto& r: m_records)
+	{
+		if (r.vs_shader_id == p.vs_shader_id && r.ps_shader_id == p.ps_shader_id && r.cs_shader_id == p.cs_shader_id &&
+		    r.static_params == *p.static_params)
+		{
+			if (r.from_file)
+			{
+				m_records_hits++;
+				r.from_file = false;
+			}
+			r.render_pass_id = p.render_pass_id;
+			return;
+		}
+	}
+
+	PipelineRecord r;
+	r.render_pass_id = p.render_pass_id;
+	r.vs_shader_id   = p.vs_shader_id;
+	r.ps_shader_id   = p.ps_shader_id;
+	r.cs_shader_id   = p.cs_shader_id;
+	r.static_params  = *p.static_params;
+	m_records.Add(r);
+}
+
+bool PipelineCache::ReadPersistentCache(Core::File* f, Vector<PipelineRecord>* records, Core::ByteBuffer* blob)
+{
+	EXIT_IF(f == nullptr || records == nullptr || blob == nullptr);
+
+	records->Clear();
+	blob->Clear();
+
+	uint32_t magic       = 0;
+	uint32_t version     = 0;
+	uint32_t records_num = 0;
+	uint32_t blob_size   = 0;
+
+	bool ok = !f->IsInvalid() && read_data(f, &magic, sizeof(magic)) && read_data(f, &version, sizeof(version)) &&
+	          magic == PERSISTENT_CACHE_MAGIC && version == PERSISTENT_CACHE_VERSION && read_data(f, &records_num, sizeof(records_num));
+
+	for (uint32_t i = 0; ok && i < records_num; i++)
+	{
+		PipelineRecord r;
+		r.from_file = true;
+		ok          = read_data(f, &r.render_pass_id, sizeof(r.render_pass_id)) && read_shader_id(f, &r.vs_shader_id) &&
+		     read_shader_id(f, &r.ps_shader_id) && read_shader_id(f, &r.cs_shader_id) &&
+		     read_data(f, &r.static_params, sizeof(r.static_params));
+		if (ok)
+		{
+			records->Add(r);
+		}
+	}
+
+	if (ok && read_data(f, &blob_size, sizeof(blob_size)) && blob_size <= f->Remaining())
+	{
+		f->Read(blob_size, blob);
+	}
+
+	if (!ok || blob->Size() != blob_size)
+	{
+		records->Clear();
+		blob->Clear();
+		return false;
+	}
+
+	return true;
+}
+
+// Adds the records which aren't known yet and the driver data of another cache, returns the number of the added records
+uint32_t PipelineCache::MergePersistentCache(const Vector<PipelineRecord>& records, const Core::ByteBuffer& blob)
+{
+	uint32_t merged_num = 0;
+
+	for (const auto& s: records)
+	{
+		if (!m_records.Contains(s,
+		                        [](const auto& r, const auto& s)
+		                        {
+			                        return r.vs_shader_id == s.vs_shader_id && r.ps_shader_id == s.ps_shader_id &&
+			                               r.cs_shader_id == s.cs_shader_id && r.static_params == s.static_params;
+		                        }))
+		{
+			m_records.Add(s);
+			merged_num++;
+		}
+	}
+
+	if (!blob.IsEmpty())
+	{
+		VkPipelineCacheCreateInfo info {};
+		info.sType           = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+		info.pNext           = nullptr;
+		info.flags           = 0;
+		info.initialDataSize = blob.Size();
+		info.pInitialData    = blob.GetDataConst();
+
+		VkPipelineCache cache = nullptr;
+		if (vkCreatePipelineCache(m_persistent_ctx->device, &info, nullptr, &cache) == VK_SUCCESS)
+		{
+			vkMergePipelineCaches(m_persistent_ctx->device, m_vk_pipeline_cache, 1, &cache);
+			vkDestroyPipelineCache(m_persistent_ctx->device, cache, nullptr);
+		}
+	}
+
+	return merged_num;
+}
+
+// The driver data is only valid for the same device and driver, the records for the same title and emulator version
+static uint64_t pipeline_cache_remote_key(GraphicContext* ctx, uint32_t version)
+{
+	VkPhysicalDeviceProperties props {};
+	vkGetPhysicalDeviceProperties(ctx->physical_device, &props);
+
+	String title_id;
+	Loader::SystemContentParamSfoGetString("TITLE_ID", &title_id);
+	auto title = title_id.utf8_str();
+
+	uint64_t key = XXH64(KYTY_VERSION, sizeof(KYTY_VERSION), version);
+	key          = XXH64(title.GetDataConst(), title.Size(), key);
+	key          = XXH64(&props.vendorID, sizeof(props.vendorID), key);
+	key          = XXH64(&props.deviceID, sizeof(props.deviceID), key);
+	key          = XXH64(&props.driverVersion, sizeof(props.driverVersion), key);
+	key          = XXH64(props.pipelineCacheUUID, sizeof(props.pipelineCacheUUID), key);
+
+	return key;
+}
+
+void PipelineCache::LoadPersistentCache(GraphicContext* ctx)
+{
+	EXIT_IF(ctx == nullptr);
+
+	Core::LockGuard lock(m_mutex);
+
+	if (m_persistent_ctx != nullptr || !Config::PipelineCacheEnabled())
+	{
+		return;
+	}
+
+	m_persistent_ctx = ctx;
+	m_remote_key     = pipeline_cache_remote_key(ctx, PERSISTENT_CACHE_VERSION);
+
+	String file_name = GraphicsGetCacheFolder() + U"pipeline_cache.bin";
+
+	Core::ByteBuffer blob;
+	Core::ByteBuffer remote_data;
+	Core::File       f;
+
+	if (Core::File::IsFileExisting(file_name))
+	{
+		f.Open(file_name, Core::File::Mode::Read);
+	} else if (RemoteCacheGet("pipelines", m_remote_key, REMOTE_CACHE_SIZE_MAX, &remote_data))
+	{
+		// A fresh host starts with the cache of the other ones
+		file_name = U"remote " + file_name;
+		f.CreateInMem();
+		f.Write(remote_data);
+		f.Seek(0);
+	}
+
+	if (!f.IsInvalid())
+	{
+		if (!ReadPersistentCache(&f, &m_records, &blob))
+		{
+			printf(FG_BRIGHT_RED "Invalid pipeline cache: %s\n" FG_DEFAULT, file_name.C_Str());
+		}
+		f.Close();
+	}
+
+	m_records_loaded = m_records.Size();
+
+	VkPipelineCacheCreateInfo info {};
+	info.sType           = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+	info.pNext           = nullptr;
+	info.flags           = 0;
+	info.initialDataSize = blob.Size();
+	info.pInitialData    = (blob.IsEmpty() ? nullptr : blob.GetDataConst());
+
+	// Driver rejects the blob (e.g. another GPU or driver version) - start with an empty cache. The records don't depend on the driver,
+	// they are still used for the prewarm.
+	if (vkCreatePipelineCache(ctx->device, &info, nullptr, &m_vk_pipeline_cache) != VK_SUCCESS && info.initialDataSize != 0)
+	{
+		info.initialDataSize = 0;
+		info.pInitialData    = nullptr;
+		vkCreatePipelineCache(ctx->device, &info, nullptr, &m_vk_pipeline_cache);
+	}
+
+	EXIT_NOT_IMPLEMENTED(m_vk_pipeline_cache == nullptr);
+
+	printf("Pipeline cache: %s, records = %u, blob size = %u\n", file_name.C_Str(), m_records_loaded, blob.Size());
+
+	if (Config::PipelinePrewarmEnabled())
+	{
+		Prewarm();
+	}
+}
+
+// Creates the shader modules of the recorded pipelines before the first draw, in parallel. The guest code isn't loaded yet, so only the
+// stages found in the shader cache are prewarmed.
+void PipelineCache::Prewarm()
+{
+	KYTY_PROFILER_BLOCK("PipelineCache::Prewarm");
+
+	struct PrewarmShader
+	{
+		ShaderType      type = ShaderType::Unknown;
+		const ShaderId* id   = nullptr;
+	};
+
+	Vector<PrewarmShader> shaders;
+
+	auto add = [&shaders](ShaderType type, const ShaderId& id)
+	{
+		if (!id.ids.IsEmpty() &&
+		    !shaders.Contains(id, [type](const auto& s, const auto& id) { return s.type == type && s.id->IsSameModule(id); }))
+		{
+			shaders.Add({type, &id});
+		}
+	};
 
-	if (!updated)
+	for (const auto& r: m_records)
 	{
-		if (m_pipelines.Size() >= PipelineCache::MAX_PIPELINES)
-		{
-			EXIT_NOT_IMPLEMENTED(m_pipelines.Size() >= PipelineCache::MAX_PIPELINES);
-			//			auto  index = Math::Rand::UintInclusiveRange(0, m_pipelines.Size() - 1);
-			//			auto& pn    = m_pipelines[index];
-			//			DeletePipelineInternal(index);
-			//			pn = p;
-		} else
-		{
-			EXIT_IF(m_pipelines.Size() != index);
+		add(ShaderType::Vertex, r.vs_shader_id);
+		add(ShaderType::Pixel, r.ps_shader_id);
+	}
 
-			m_pipelines.Add(p);
+	std::atomic<uint32_t>         prewarmed = 0;
+	std::atomic<uint32_t>         processed = 0;
+	uint32_t                      total     = shaders.Size();
+	uint32_t                      step      = std::max(total / 10, 1u);
+	Vector<std::function<void()>> tasks;
 
-			DumpPipeline("create", index);
-		}
+	for (const auto& s: shaders)
+	{
+		tasks.Add(
+		    [this, &prewarmed, &processed, total, step, s]()
+		    {
+			    Vector<uint32_t> spirv;
+			    if (FindShaderModule(s.type, *s.id) == nullptr)
+			    {
+				    if (ShaderCacheLoad(s.type, *s.id, &spirv))
+				    {
+					    AddShaderModule(s.type, *s.id, spirv);
+					    prewarmed++;
+				    } else
+				    {
+					    ShaderCachePrefetch(s.type, *s.id);
+				    }
+			    }
+			    if (uint32_t n = ++processed; n % step == 0 || n == total)
+			    {
+				    printf("Pipeline cache: prewarm %u/%u\n", n, total);
+			    }
+		    });
 	}
 
-	return p.pipeline;
+	ShaderRunTranslations(tasks.GetData(), tasks.Size());
+
+	printf("Pipeline cache: prewarmed %u of %u shaders\n", prewarmed.load(), shaders.Size());
 }
 
-VulkanPipeline* PipelineCache::CreatePipeline(const ShaderComputeInputInfo* input_info, const HW::ComputeShaderInfo* cs_regs,
-                                              const HW::ShaderRegisters* sh_regs)
+// Other emulator processes may share the cache folder. The file is rewritten under a file lock, with the records and the driver data
+// they saved since this process loaded it merged in, and replaced atomically, so the readers see either the old or the new file.
+// The cache on the remote server is merged the same way, and uploaded again when this host adds records to it.
+void PipelineCache::SavePersistentCache()
 {
-	KYTY_PROFILER_BLOCK("PipelineCache::CreatePipeline(Compute)", profiler::colors::RedA100);
-
-	EXIT_IF(cs_regs == nullptr);
-	EXIT_IF(sh_regs == nullptr);
-
 	Core::LockGuard lock(m_mutex);
 
-	ShaderDbgDumpInputInfo(input_info);
-
-	auto cs_id = ShaderGetIdCS(cs_regs, input_info);
-
-	Pipeline p {};
-	p.cs_shader_id   = cs_id;
-	p.static_params  = new PipelineStaticParameters;
-	p.dynamic_params = new PipelineDynamicParameters;
-
-	p.dynamic_params->vk_dynamic_state_line_width           = true;
-	p.dynamic_params->vk_dynamic_state_stencil_compare_mask = true;
-	p.dynamic_params->vk_dynamic_state_stencil_reference    = true;
-	p.dynamic_params->vk_dynamic_state_stencil_write_mask   = true;
-	p.dynamic_params->color_write_enable                    = true;
-
-	auto* found = Find(p);
+	WaitForJobs();
 
-	if (found != nullptr)
+	if (m_persistent_ctx == nullptr || m_vk_pipeline_cache == nullptr)
 	{
-		*found->dynamic_params = *p.dynamic_params;
-		delete p.static_params;
-		delete p.dynamic_params;
-		return found;
+		return;
 	}
 
-	auto cs_code = ShaderParseCS(cs_regs, sh_regs);
+	Vector<PipelineRecord> saved_records;
+	Core::ByteBuffer       saved_blob;
+	Core::ByteBuffer       remote_data;
+	uint32_t               merged_num = 0;
+	uint32_t               remote_num = 0;
 
-	auto cs_shader = ShaderRecompileCS(cs_code, input_info);
-	EXIT_IF(cs_shader.IsEmpty());
+	// Before the lock, the server may be slow
+	if (RemoteCacheGet("pipelines", m_remote_key, REMOTE_CACHE_SIZE_MAX, &remote_data))
+	{
+		Core::File remote;
+		remote.CreateInMem();
+		remote.Write(remote_data);
+		remote.Seek(0);
+		if (ReadPersistentCache(&remote, &saved_records, &saved_blob))
+		{
+			remote_num = saved_records.Size();
+			merged_num += MergePersistentCache(saved_records, saved_blob);
+		}
+		remote.Close();
+	}
 
-	p.pipeline = CreatePipelineInternal(input_info, cs_shader, p.static_params, p.dynamic_params /*, params2*/);
+	String file_name = GraphicsGetCacheFolder() + U"pipeline_cache.bin";
 
-	EXIT_NOT_IMPLEMENTED(p.pipeline == nullptr);
+	Core::File::CreateDirectories(file_name.DirectoryWithoutFilename());
 
-	bool updated = false;
-	for (auto& pn: m_pipelines)
+	Core::File lock_file;
+	if (!lock_file.OpenOrCreate(file_name + U".lock") || !lock_file.Lock())
 	{
-		if (pn.pipeline == nullptr)
-		{
-			pn      = p;
-			updated = true;
-			break;
-		}
+		printf(FG_BRIGHT_RED "Can't lock file: %s.lock\n" FG_DEFAULT, file_name.C_Str());
+		return;
 	}
 
-	if (!updated)
+	if (Core::File::IsFileExisting(file_name))
 	{
-		if (m_pipelines.Size() >= PipelineCache::MAX_PIPELINES)
-		{
-			EXIT_NOT_IMPLEMENTED(m_pipelines.Size() >= PipelineCache::MAX_PIPELINES);
-			//			auto  index = Math::Rand::UintInclusiveRange(0, m_pipelines.Size() - 1);
-			//			auto& pn    = m_pipelines[index];
-			//			DeletePipelineInternal(index);
-			//			pn = p;
-		} else
+		Core::File saved;
+		saved.Open(file_name, Core::File::Mode::Read);
+		if (ReadPersistentCache(&saved, &saved_records, &saved_blob))
 		{
-			m_pipelines.Add(p);
+			merged_num += MergePersistentCache(saved_records, saved_blob);
 		}
+		saved.Close();
 	}
 
-	return p.pipeline;
-}
+	size_t blob_size = 0;
+	vkGetPipelineCacheData(m_persistent_ctx->device, m_vk_pipeline_cache, &blob_size, nullptr);
 
-void PipelineCache::DeletePipeline(VulkanPipeline* pipeline)
-{
-	Core::LockGuard lock(m_mutex);
+	Core::ByteBuffer blob(static_cast<uint32_t>(blob_size));
 
-	auto index = m_pipelines.Find(pipeline, [](auto r, auto p) { return p == r.pipeline; });
+	if (blob_size == 0 || vkGetPipelineCacheData(m_persistent_ctx->device, m_vk_pipeline_cache, &blob_size, blob.GetData()) != VK_SUCCESS)
+	{
+		lock_file.Unlock();
+		return;
+	}
 
-	EXIT_IF(!m_pipelines.IndexValid(index));
+	uint32_t magic       = PERSISTENT_CACHE_MAGIC;
+	uint32_t version     = PERSISTENT_CACHE_VERSION;
+	uint32_t records_num = m_records.Size();
+	auto     size        = static_cast<uint32_t>(blob_size);
 
-	if (m_pipelines.IndexValid(index))
+	Core::File out;
+	out.CreateInMem();
+
+	out.Write(&magic, sizeof(magic));
+	out.Write(&version, sizeof(version));
+	out.Write(&records_num, sizeof(records_num));
+
+	for (const auto& r: m_records)
 	{
-		DeletePipelineInternal(index);
+		out.Write(&r.render_pass_id, sizeof(r.render_pass_id));
+		write_shader_id(&out, r.vs_shader_id);
+		write_shader_id(&out, r.ps_shader_id);
+		write_shader_id(&out, r.cs_shader_id);
+		out.Write(&r.static_params, sizeof(r.static_params));
 	}
-}
 
-void PipelineCache::DeletePipelines(VulkanFramebuffer* framebuffer)
-{
-	EXIT_IF(framebuffer == nullptr);
+	out.Write(&size, sizeof(size));
+	out.Write(blob.GetDataConst(), size);
 
-	Core::LockGuard lock(m_mutex);
+	Core::ByteBuffer data;
+	out.Seek(0);
+	out.ReadWholeBuffer(&data);
+	out.Close();
 
-	int index = 0;
-	for (auto& p: m_pipelines)
+	String tmp_file_name = file_name + U".tmp";
+
+	Core::File f;
+	f.Create(tmp_file_name);
+	if (f.IsInvalid())
 	{
-		if (p.pipeline != nullptr && p.render_pass_id == framebuffer->render_pass_id)
-		{
-			DeletePipelineInternal(index);
-		}
-		index++;
+		printf(FG_BRIGHT_RED "Can't create file: %s\n" FG_DEFAULT, tmp_file_name.C_Str());
+		lock_file.Unlock();
+		return;
 	}
-}
 
-void PipelineCache::DeleteAllPipelines()
-{
-	Core::LockGuard lock(m_mutex);
+	f.Write(data);
+	f.Close();
 
-	for (uint32_t index = 0; index < m_pipelines.Size(); index++)
+	if (!Core::File::MoveFile(tmp_file_name, file_name))
 	{
-		DeletePipelineInternal(index);
+		printf(FG_BRIGHT_RED "Can't replace file: %s\n" FG_DEFAULT, file_name.C_Str());
+		Core::File::DeleteFile(tmp_file_name);
 	}
-}
 
-void PipelineCache::DumpToFile(Core::File* f, const Pipeline& p) {}
+	lock_file.Unlock();
+	lock_file.Close();
+
+	if (records_num > remote_num)
+	{
+		RemoteCachePut("pipelines", m_remote_key, data);
+	}
+
+	printf("Pipeline cache saved: %s, records = %u (%u loaded, %u reused, %u merged), blob size = %u\n", file_name.C_Str(), records_num,
+	       m_records_loaded, m_records_hits, merged_num, size);
+}
 
 void PipelineCache::DumpPipeline(const char* action, uint32_t id)
 {
@@ -2813,19 +4449,25 @@ void PipelineCache::DumpPipeline(const char* action, uint32_t id)
 		Core::File f;
 		String     file_name = Config::GetPipelineDumpFolder().FixDirectorySlash() +
 		                   String::FromPrintf("%04d_%04d_pipeline_%u_%s.log", GraphicsRunGetFrameNum(), dump_id++, id, action);
-		Core::File::CreateDirectories(file_name.DirectoryWithoutFilename());
-		f.Create(file_name);
-		if (f.IsInvalid())
-		{
-			printf(FG_BRIGHT_RED "Can't create file: %s\n" FG_DEFAULT, file_name.C_Str());
-			return;
-		}
+		f.CreateInMem();
 		Pipeline& p = m_pipelines[id];
 		DumpToFile(&f, p);
-		f.Close();
+		DumpWriterPush(file_name, &f);
 	}
 }
 
+// Sets which fit into the device limit are pushed into the command buffer instead of being allocated
+static bool use_push_descriptors(const GraphicContext* gctx, int storage_buffers_num, int textures2d_sampled_num,
+                                 int textures2d_storage_num, int samplers_num, int gds_buffers_num)
+{
+	EXIT_IF(gctx == nullptr);
+
+	auto descriptors_num =
+	    static_cast<uint32_t>(storage_buffers_num + textures2d_sampled_num + textures2d_storage_num + samplers_num + gds_buffers_num);
+
+	return (gctx->max_push_descriptors != 0 && descriptors_num <= gctx->max_push_descriptors);
+}
+
 static void create_layout(GraphicContext* gctx, int storage_buffers_num, int textures2d_sampled_num, int textures2d_storage_num,
                           int samplers_num, int gds_buffers_num, VkShaderStageFlags stage, VkDescriptorSetLayout* dst)
 {
@@ -2900,10 +4542,13 @@ static void create_layout(GraphicContext* gctx, int storage_buffers_num, int tex
 
 	if (binding_num > 0)
 	{
+		bool push = use_push_descriptors(gctx, storage_buffers_num, textures2d_sampled_num, textures2d_storage_num, samplers_num,
+		                                 gds_buffers_num);
+
 		VkDescriptorSetLayoutCreateInfo layout_info {};
 		layout_info.sType        = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
 		layout_info.pNext        = nullptr;
-		layout_info.flags        = 0;
+		layout_info.flags        = (push ? VK_DESCRIPTOR_SET_LAYOUT_CREATE_PUSH_DESCRIPTOR_BIT_KHR : 0);
 		layout_info.bindingCount = binding_num;
 		layout_info.pBindings    = ubo_layout_binding;
 
@@ -3064,6 +4709,8 @@ VulkanDescriptorSet* DescriptorCache::Allocate(Stage stage, int storage_buffers_
 
 				if (result == VK_SUCCESS)
 				{
+					pool.sets_num++;
+					GpuCounterAdd(GpuCounter::DescriptorSets);
 					return ret;
 				}
 			}
@@ -3092,7 +4739,16 @@ void DescriptorCache::Free(VulkanDescriptorSet* set)
 
 	auto& pool = m_pools[set->pool_id];
 
-	vkFreeDescriptorSets(gctx->device, pool.pool, 1, &set->set);
+	EXIT_IF(pool.sets_num == 0);
+
+	// The last set of the pool is released by resetting the whole pool, which also undoes its fragmentation
+	if (--pool.sets_num == 0)
+	{
+		vkResetDescriptorPool(gctx->device, pool.pool, 0);
+	} else
+	{
+		vkFreeDescriptorSets(gctx->device, pool.pool, 1, &set->set);
+	}
 
 	if (!pool.free)
 	{
@@ -3104,113 +4760,176 @@ void DescriptorCache::Free(VulkanDescriptorSet* set)
 	delete set;
 }
 
-uint32_t DescriptorCache::CalcHash(const Set& s)
+uint64_t DescriptorCache::CalcHash(const Key& k)
+{
+	return XXH64(&k, sizeof(Key), 0);
+}
+
+bool DescriptorCache::UsesResource(const Key& k, uint64_t resource_id)
+{
+	auto contains = [resource_id](const uint64_t* ids, int num)
+	{
+		for (int i = 0; i < num; i++)
+		{
+			if (ids[i] == resource_id)
+			{
+				return true;
+			}
+		}
+		return false;
+	};
+
+	return contains(k.storage_buffers_id, k.storage_buffers_num) || contains(k.textures2d_sampled_id, k.textures2d_sampled_num) ||
+	       contains(k.textures2d_storage_id, k.textures2d_storage_num) || contains(k.gds_buffers_id, k.gds_buffers_num);
+}
+
+VulkanDescriptorSet* DescriptorCache::FindSet(const Key& k, uint64_t hash)
+{
+	const auto* index = m_sets_map.Find(hash);
+	if (index != nullptr)
+	{
+		const auto& set = m_sets[*index];
+
+		// NOLINTNEXTLINE(bugprone-suspicious-memory-comparison,cert-exp42-c,cert-flp37-c)
+		if (set.set != nullptr && memcmp(&set.key, &k, sizeof(Key)) == 0)
+		{
+			return set.set;
+		}
+	}
+	return nullptr;
+}
+
+// NOLINTNEXTLINE(readability-function-cognitive-complexity)
+void DescriptorCache::PrepareWrites(DescriptorWrites* w, VkDescriptorSet dst_set, VulkanBuffer** storage_buffers,
+                                    VulkanImage** textures2d_sampled, const int* textures2d_sampled_view, VulkanImage** textures2d_storage,
+                                    const uint64_t* samplers, VulkanBuffer** gds_buffers, const ShaderBindResources& bind)
 {
-	uint32_t hash = 0;
-	hash += Core::hash8(static_cast<uint8_t>(s.stage));
-	hash ^= Core::hash8(static_cast<uint8_t>(s.storage_buffers_num));
-	hash += Core::hash8(static_cast<uint8_t>(s.textures2d_sampled_num));
-	hash ^= Core::hash8(static_cast<uint8_t>(s.textures2d_storage_num));
-	hash += Core::hash8(static_cast<uint8_t>(s.samplers_num));
-	hash ^= Core::hash8(static_cast<uint8_t>(s.gds_buffers_num));
-	for (int i = 0; i < s.storage_buffers_num; i++)
+	EXIT_IF(w == nullptr);
+
+	int storage_buffers_num    = bind.storage_buffers.buffers_num;
+	int textures2d_sampled_num = bind.textures2D.textures2d_sampled_num;
+	int textures2d_storage_num = bind.textures2D.textures2d_storage_num;
+	int samplers_num           = bind.samplers.samplers_num;
+	int gds_buffers_num        = bind.gds_pointers.pointers_num;
+
+	w->writes_num = 0;
+
+	for (int i = 0; i < storage_buffers_num; i++)
 	{
-		hash += Core::hash64(s.storage_buffers_id[i]);
+		w->buffer_info[i].buffer = storage_buffers[i]->buffer;
+		w->buffer_info[i].offset = 0;
+		w->buffer_info[i].range  = VK_WHOLE_SIZE;
 	}
-	for (int i = 0; i < s.textures2d_sampled_num; i++)
+
+	for (int i = 0; i < textures2d_sampled_num; i++)
 	{
-		hash ^= Core::hash64(s.textures2d_sampled_id[i]);
+		w->texture2d_sampled_info[i].sampler   = nullptr;
+		w->texture2d_sampled_info[i].imageView = textures2d_sampled[i]->image_view[textures2d_sampled_view[i]];
+		w->texture2d_sampled_info[i].imageLayout =
+		    (textures2d_sampled[i]->type == VulkanImageType::DepthStencil ? VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL
+		                                                                  : VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
 	}
-	for (int i = 0; i < s.textures2d_storage_num; i++)
+
+	for (int i = 0; i < textures2d_storage_num; i++)
 	{
-		hash += Core::hash64(s.textures2d_storage_id[i]);
+		w->texture2d_storage_info[i].sampler     = nullptr;
+		w->texture2d_storage_info[i].imageView   = textures2d_storage[i]->image_view[VulkanImage::VIEW_DEFAULT];
+		w->texture2d_storage_info[i].imageLayout = VK_IMAGE_LAYOUT_GENERAL;
 	}
-	for (int i = 0; i < s.samplers_num; i++)
+
+	for (int i = 0; i < samplers_num; i++)
 	{
-		hash ^= Core::hash64(s.samplers_id[i]);
+		w->sampler_info[i].sampler     = g_render_ctx->GetSamplerCache()->GetSampler(samplers[i]);
+		w->sampler_info[i].imageView   = nullptr;
+		w->sampler_info[i].imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
 	}
-	for (int i = 0; i < s.gds_buffers_num; i++)
+
+	for (int i = 0; i < gds_buffers_num; i++)
 	{
-		hash += Core::hash64(s.gds_buffers_id[i]);
+		w->gds_buffer_info[i].buffer = gds_buffers[i]->buffer;
+		w->gds_buffer_info[i].offset = 0;
+		w->gds_buffer_info[i].range  = VK_WHOLE_SIZE;
 	}
-	return hash;
-}
 
-// NOLINTNEXTLINE(readability-function-cognitive-complexity)
-VulkanDescriptorSet* DescriptorCache::FindSet(const Set& s)
-{
-	const auto* list = m_sets_map.Find(s.hash);
-	if (list != nullptr)
+	if (storage_buffers_num > 0)
 	{
-		for (int index: *list)
-		{
-			auto& set = m_sets[index];
+		EXIT_IF(w->writes_num >= DescriptorWrites::WRITES_MAX);
+		w->writes[w->writes_num].sType            = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		w->writes[w->writes_num].pNext            = nullptr;
+		w->writes[w->writes_num].dstSet           = dst_set;
+		w->writes[w->writes_num].dstBinding       = bind.storage_buffers.binding_index;
+		w->writes[w->writes_num].dstArrayElement  = 0;
+		w->writes[w->writes_num].descriptorType   = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		w->writes[w->writes_num].descriptorCount  = storage_buffers_num;
+		w->writes[w->writes_num].pBufferInfo      = w->buffer_info;
+		w->writes[w->writes_num].pImageInfo       = nullptr;
+		w->writes[w->writes_num].pTexelBufferView = nullptr;
+		w->writes_num++;
+	}
 
-			if (set.set != nullptr && set.stage == s.stage && set.storage_buffers_num == s.storage_buffers_num &&
-			    set.textures2d_sampled_num == s.textures2d_sampled_num && set.textures2d_storage_num == s.textures2d_storage_num &&
-			    set.samplers_num == s.samplers_num && set.gds_buffers_num == s.gds_buffers_num)
-			{
-				bool match = true;
-				for (int i = 0; i < s.storage_buffers_num; i++)
-				{
-					if (match && s.storage_buffers_id[i] != set.storage_buffers_id[i])
-					{
-						match = false;
-						break;
-					}
-				}
-				if (match)
-				{
-					for (int i = 0; i < s.textures2d_sampled_num; i++)
-					{
-						if (s.textures2d_sampled_id[i] != set.textures2d_sampled_id[i])
-						{
-							match = false;
-							break;
-						}
-					}
-				}
-				if (match)
-				{
-					for (int i = 0; i < s.textures2d_storage_num; i++)
-					{
-						if (s.textures2d_storage_id[i] != set.textures2d_storage_id[i])
-						{
-							match = false;
-							break;
-						}
-					}
-				}
-				if (match)
-				{
-					for (int i = 0; i < s.samplers_num; i++)
-					{
-						if (s.samplers_id[i] != set.samplers_id[i])
-						{
-							match = false;
-							break;
-						}
-					}
-				}
-				if (match)
-				{
-					for (int i = 0; i < s.gds_buffers_num; i++)
-					{
-						if (s.gds_buffers_id[i] != set.gds_buffers_id[i])
-						{
-							match = false;
-							break;
-						}
-					}
-				}
-				if (match)
-				{
-					return set.set;
-				}
-			}
-		}
+	if (textures2d_sampled_num > 0)
+	{
+		EXIT_IF(w->writes_num >= DescriptorWrites::WRITES_MAX);
+		w->writes[w->writes_num].sType            = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		w->writes[w->writes_num].pNext            = nullptr;
+		w->writes[w->writes_num].dstSet           = dst_set;
+		w->writes[w->writes_num].dstBinding       = bind.textures2D.binding_sampled_index;
+		w->writes[w->writes_num].dstArrayElement  = 0;
+		w->writes[w->writes_num].descriptorType   = VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+		w->writes[w->writes_num].descriptorCount  = textures2d_sampled_num;
+		w->writes[w->writes_num].pBufferInfo      = nullptr;
+		w->writes[w->writes_num].pImageInfo       = w->texture2d_sampled_info;
+		w->writes[w->writes_num].pTexelBufferView = nullptr;
+		w->writes_num++;
+	}
+
+	if (textures2d_storage_num > 0)
+	{
+		EXIT_IF(w->writes_num >= DescriptorWrites::WRITES_MAX);
+		w->writes[w->writes_num].sType            = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		w->writes[w->writes_num].pNext            = nullptr;
+		w->writes[w->writes_num].dstSet           = dst_set;
+		w->writes[w->writes_num].dstBinding       = bind.textures2D.binding_storage_index;
+		w->writes[w->writes_num].dstArrayElement  = 0;
+		w->writes[w->writes_num].descriptorType   = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+		w->writes[w->writes_num].descriptorCount  = textures2d_storage_num;
+		w->writes[w->writes_num].pBufferInfo      = nullptr;
+		w->writes[w->writes_num].pImageInfo       = w->texture2d_storage_info;
+		w->writes[w->writes_num].pTexelBufferView = nullptr;
+		w->writes_num++;
+	}
+
+	if (samplers_num > 0)
+	{
+		EXIT_IF(w->writes_num >= DescriptorWrites::WRITES_MAX);
+		w->writes[w->writes_num].sType            = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		w->writes[w->writes_num].pNext            = nullptr;
+		w->writes[w->writes_num].dstSet           = dst_set;
+		w->writes[w->writes_num].dstBinding       = bind.samplers.binding_index;
+		w->writes[w->writes_num].dstArrayElement  = 0;
+		w->writes[w->writes_num].descriptorType   = VK_DESCRIPTOR_TYPE_SAMPLER;
+		w->writes[w->writes_num].descriptorCount  = samplers_num;
+		w->writes[w->writes_num].pBufferInfo      = nullptr;
+		w->writes[w->writes_num].pImageInfo       = w->sampler_info;
+		w->writes[w->writes_num].pTexelBufferView = nullptr;
+		w->writes_num++;
+	}
+
+	if (gds_buffers_num > 0)
+	{
+		EXIT_IF(w->writes_num >= DescriptorWrites::WRITES_MAX);
+		w->writes[w->writes_num].sType            = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		w->writes[w->writes_num].pNext            = nullptr;
+		w->writes[w->writes_num].dstSet           = dst_set;
+		w->writes[w->writes_num].dstBinding       = bind.gds_pointers.binding_index;
+		w->writes[w->writes_num].dstArrayElement  = 0;
+		w->writes[w->writes_num].descriptorType   = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		w->writes[w->writes_num].descriptorCount  = gds_buffers_num;
+		w->writes[w->writes_num].pBufferInfo      = w->gds_buffer_info;
+		w->writes[w->writes_num].pImageInfo       = nullptr;
+		w->writes[w->writes_num].pTexelBufferView = nullptr;
+		w->writes_num++;
 	}
-	return nullptr;
 }
 
 // NOLINTNEXTLINE(readability-function-cognitive-complexity)
@@ -3237,37 +4956,40 @@ VulkanDescriptorSet* DescriptorCache::GetDescriptor(Stage stage, VulkanBuffer**
 	auto* gctx = g_render_ctx->GetGraphicCtx();
 	EXIT_IF(gctx == nullptr);
 
+	ReleaseRetiredSets();
+
 	Set nset;
-	nset.set                    = nullptr;
-	nset.storage_buffers_num    = storage_buffers_num;
-	nset.textures2d_sampled_num = textures2d_sampled_num;
-	nset.textures2d_storage_num = textures2d_storage_num;
-	nset.samplers_num           = samplers_num;
-	nset.gds_buffers_num        = gds_buffers_num;
-	nset.stage                  = stage;
+	nset.set                        = nullptr;
+	nset.key.storage_buffers_num    = storage_buffers_num;
+	nset.key.textures2d_sampled_num = textures2d_sampled_num;
+	nset.key.textures2d_storage_num = textures2d_storage_num;
+	nset.key.samplers_num           = samplers_num;
+	nset.key.gds_buffers_num        = gds_buffers_num;
+	nset.key.stage                  = stage;
 	for (int i = 0; i < storage_buffers_num; i++)
 	{
-		nset.storage_buffers_id[i] = storage_buffers[i]->memory.unique_id;
+		nset.key.storage_buffers_id[i] = storage_buffers[i]->memory.unique_id;
 	}
 	for (int i = 0; i < textures2d_sampled_num; i++)
 	{
-		nset.textures2d_sampled_id[i] = textures2d_sampled[i]->memory.unique_id;
+		nset.key.textures2d_sampled_id[i]   = textures2d_sampled[i]->memory.unique_id;
+		nset.key.textures2d_sampled_view[i] = textures2d_sampled_view[i];
 	}
 	for (int i = 0; i < textures2d_storage_num; i++)
 	{
-		nset.textures2d_storage_id[i] = textures2d_storage[i]->memory.unique_id;
+		nset.key.textures2d_storage_id[i] = textures2d_storage[i]->memory.unique_id;
 	}
 	for (int i = 0; i < samplers_num; i++)
 	{
-		nset.samplers_id[i] = samplers[i];
+		nset.key.samplers_id[i] = samplers[i];
 	}
 	for (int i = 0; i < gds_buffers_num; i++)
 	{
-		nset.gds_buffers_id[i] = gds_buffers[i]->memory.unique_id;
+		nset.key.gds_buffers_id[i] = gds_buffers[i]->memory.unique_id;
 	}
-	nset.hash = CalcHash(nset);
+	nset.hash = CalcHash(nset.key);
 
-	if (auto* f = FindSet(nset); f != nullptr)
+	if (auto* f = FindSet(nset.key, nset.hash); f != nullptr)
 	{
 		return f;
 	}
@@ -3279,159 +5001,120 @@ VulkanDescriptorSet* DescriptorCache::GetDescriptor(Stage stage, VulkanBuffer**
 	auto* new_set = Allocate(stage, storage_buffers_num, textures2d_sampled_num, textures2d_storage_num, samplers_num, gds_buffers_num);
 	EXIT_NOT_IMPLEMENTED(new_set == nullptr);
 
-	VkDescriptorBufferInfo buffer_info[BUFFERS_MAX] {};
-	for (int i = 0; i < storage_buffers_num; i++)
+	DescriptorWrites writes {};
+	PrepareWrites(&writes, new_set->set, storage_buffers, textures2d_sampled, textures2d_sampled_view, textures2d_storage, samplers,
+	              gds_buffers, bind);
+
+	vkUpdateDescriptorSets(gctx->device, writes.writes_num, writes.writes, 0, nullptr);
+
+	nset.set = new_set;
+
+	int index = 0;
+
+	if (m_first_free_set != -1)
+	{
+		index            = m_first_free_set;
+		auto& set        = m_sets[m_first_free_set];
+		m_first_free_set = set.next_free_set;
+		set              = nset;
+	} else
 	{
-		buffer_info[i].buffer = storage_buffers[i]->buffer;
-		buffer_info[i].offset = 0;
-		buffer_info[i].range  = VK_WHOLE_SIZE;
+		index = static_cast<int>(m_sets.Size());
+		m_sets.Add(nset);
 	}
 
-	VkDescriptorImageInfo texture2d_sampled_info[TEXTURES_SAMPLED_MAX] {};
-	for (int i = 0; i < textures2d_sampled_num; i++)
+	// On a key collision the previous set is only reachable through its resources
+	m_sets_map.Put(nset.hash, index);
+
+	auto add_resource = [this, index](uint64_t id)
 	{
-		texture2d_sampled_info[i].sampler   = nullptr;
-		texture2d_sampled_info[i].imageView = textures2d_sampled[i]->image_view[textures2d_sampled_view[i]];
-		texture2d_sampled_info[i].imageLayout =
-		    (textures2d_sampled[i]->type == VulkanImageType::DepthStencil ? VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL
-		                                                                  : VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
-	}
+		auto& ids = m_resource_sets[id];
+		if (!ids.Contains(index))
+		{
+			ids.Add(index);
+		}
+	};
 
-	VkDescriptorImageInfo texture2d_storage_info[TEXTURES_STORAGE_MAX] {};
-	for (int i = 0; i < textures2d_storage_num; i++)
+	for (int i = 0; i < storage_buffers_num; i++)
 	{
-		texture2d_storage_info[i].sampler     = nullptr;
-		texture2d_storage_info[i].imageView   = textures2d_storage[i]->image_view[VulkanImage::VIEW_DEFAULT];
-		texture2d_storage_info[i].imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+		add_resource(nset.key.storage_buffers_id[i]);
 	}
-
-	VkDescriptorImageInfo sampler_info[SAMPLERS_MAX] {};
-	for (int i = 0; i < samplers_num; i++)
+	for (int i = 0; i < textures2d_sampled_num; i++)
 	{
-		sampler_info[i].sampler     = g_render_ctx->GetSamplerCache()->GetSampler(samplers[i]);
-		sampler_info[i].imageView   = nullptr;
-		sampler_info[i].imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		add_resource(nset.key.textures2d_sampled_id[i]);
+	}
+	for (int i = 0; i < textures2d_storage_num; i++)
+	{
+		add_resource(nset.key.textures2d_storage_id[i]);
 	}
-
-	VkDescriptorBufferInfo gds_buffer_info[GDS_BUFFER_MAX] {};
 	for (int i = 0; i < gds_buffers_num; i++)
 	{
-		gds_buffer_info[i].buffer = gds_buffers[i]->buffer;
-		gds_buffer_info[i].offset = 0;
-		gds_buffer_info[i].range  = VK_WHOLE_SIZE;
+		add_resource(nset.key.gds_buffers_id[i]);
 	}
 
-	uint32_t binding_num = 0;
-
-	constexpr uint32_t B_MAX = 5;
+	return new_set;
+}
 
-	VkWriteDescriptorSet descriptor_write[B_MAX] = {};
+// Sets which use the resource are not found anymore. They are released when no command buffer can reference them.
+void DescriptorCache::RetireSets(uint64_t resource_id)
+{
+	const auto* list = m_resource_sets.Find(resource_id);
 
-	if (storage_buffers_num > 0)
+	if (list == nullptr)
 	{
-		EXIT_IF(binding_num >= B_MAX);
-		descriptor_write[binding_num].sType            = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-		descriptor_write[binding_num].pNext            = nullptr;
-		descriptor_write[binding_num].dstSet           = new_set->set;
-		descriptor_write[binding_num].dstBinding       = bind.storage_buffers.binding_index;
-		descriptor_write[binding_num].dstArrayElement  = 0;
-		descriptor_write[binding_num].descriptorType   = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
-		descriptor_write[binding_num].descriptorCount  = storage_buffers_num;
-		descriptor_write[binding_num].pBufferInfo      = buffer_info;
-		descriptor_write[binding_num].pImageInfo       = nullptr;
-		descriptor_write[binding_num].pTexelBufferView = nullptr;
-		binding_num++;
+		return;
 	}
 
-	if (textures2d_sampled_num > 0)
-	{
-		EXIT_IF(binding_num >= B_MAX);
-		descriptor_write[binding_num].sType            = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-		descriptor_write[binding_num].pNext            = nullptr;
-		descriptor_write[binding_num].dstSet           = new_set->set;
-		descriptor_write[binding_num].dstBinding       = bind.textures2D.binding_sampled_index;
-		descriptor_write[binding_num].dstArrayElement  = 0;
-		descriptor_write[binding_num].descriptorType   = VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
-		descriptor_write[binding_num].descriptorCount  = textures2d_sampled_num;
-		descriptor_write[binding_num].pBufferInfo      = nullptr;
-		descriptor_write[binding_num].pImageInfo       = texture2d_sampled_info;
-		descriptor_write[binding_num].pTexelBufferView = nullptr;
-		binding_num++;
-	}
+	int frame = GraphicsRunGetFrameNum();
 
-	if (textures2d_storage_num > 0)
+	for (int index: *list)
 	{
-		EXIT_IF(binding_num >= B_MAX);
-		descriptor_write[binding_num].sType            = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-		descriptor_write[binding_num].pNext            = nullptr;
-		descriptor_write[binding_num].dstSet           = new_set->set;
-		descriptor_write[binding_num].dstBinding       = bind.textures2D.binding_storage_index;
-		descriptor_write[binding_num].dstArrayElement  = 0;
-		descriptor_write[binding_num].descriptorType   = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
-		descriptor_write[binding_num].descriptorCount  = textures2d_storage_num;
-		descriptor_write[binding_num].pBufferInfo      = nullptr;
-		descriptor_write[binding_num].pImageInfo       = texture2d_storage_info;
-		descriptor_write[binding_num].pTexelBufferView = nullptr;
-		binding_num++;
-	}
+		auto& set = m_sets[index];
 
-	if (samplers_num > 0)
-	{
-		EXIT_IF(binding_num >= B_MAX);
-		descriptor_write[binding_num].sType            = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-		descriptor_write[binding_num].pNext            = nullptr;
-		descriptor_write[binding_num].dstSet           = new_set->set;
-		descriptor_write[binding_num].dstBinding       = bind.samplers.binding_index;
-		descriptor_write[binding_num].dstArrayElement  = 0;
-		descriptor_write[binding_num].descriptorType   = VK_DESCRIPTOR_TYPE_SAMPLER;
-		descriptor_write[binding_num].descriptorCount  = samplers_num;
-		descriptor_write[binding_num].pBufferInfo      = nullptr;
-		descriptor_write[binding_num].pImageInfo       = sampler_info;
-		descriptor_write[binding_num].pTexelBufferView = nullptr;
-		binding_num++;
-	}
+		// The index may have been reused by a set which doesn't use this resource
+		if (set.set != nullptr && UsesResource(set.key, resource_id))
+		{
+			RetiredSet r;
+			r.set   = set.set;
+			r.frame = frame;
+			m_retired_sets.Add(r);
 
-	if (gds_buffers_num > 0)
-	{
-		EXIT_IF(binding_num >= B_MAX);
-		descriptor_write[binding_num].sType            = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-		descriptor_write[binding_num].pNext            = nullptr;
-		descriptor_write[binding_num].dstSet           = new_set->set;
-		descriptor_write[binding_num].dstBinding       = bind.gds_pointers.binding_index;
-		descriptor_write[binding_num].dstArrayElement  = 0;
-		descriptor_write[binding_num].descriptorType   = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
-		descriptor_write[binding_num].descriptorCount  = gds_buffers_num;
-		descriptor_write[binding_num].pBufferInfo      = gds_buffer_info;
-		descriptor_write[binding_num].pImageInfo       = nullptr;
-		descriptor_write[binding_num].pTexelBufferView = nullptr;
-		binding_num++;
-	}
+			if (const auto* i = m_sets_map.Find(set.hash); i != nullptr && *i == index)
+			{
+				m_sets_map.Remove(set.hash);
+			}
 
-	vkUpdateDescriptorSets(gctx->device, binding_num, descriptor_write, 0, nullptr);
+			set.set           = nullptr;
+			set.next_free_set = m_first_free_set;
+			m_first_free_set  = index;
+		}
+	}
 
-	nset.set = new_set;
+	m_resource_sets.Remove(resource_id);
+}
 
-	int index = 0;
+void DescriptorCache::ReleaseRetiredSets()
+{
+	int frame = GraphicsRunGetFrameNum();
 
-	if (m_first_free_set != -1)
-	{
-		index            = m_first_free_set;
-		auto& set        = m_sets[m_first_free_set];
-		m_first_free_set = set.next_free_set;
-		set              = nset;
-	} else
+	if (m_released_frame == frame || m_retired_sets.IsEmpty())
 	{
-		index = static_cast<int>(m_sets.Size());
-		m_sets.Add(nset);
+		return;
 	}
 
-	auto& ids = m_sets_map[nset.hash];
-	if (!ids.Contains(index))
+	m_released_frame = frame;
+
+	for (uint32_t i = 0; i < m_retired_sets.Size();)
 	{
-		ids.Add(index);
+		if (frame - m_retired_sets[i].frame >= RETIRE_MIN_FRAMES)
+		{
+			Free(m_retired_sets[i].set);
+			m_retired_sets.RemoveAt(i);
+		} else
+		{
+			i++;
+		}
 	}
-
-	return new_set;
 }
 
 void DescriptorCache::FreeDescriptor(VulkanBuffer* buffer)
@@ -3442,31 +5125,7 @@ void DescriptorCache::FreeDescriptor(VulkanBuffer* buffer)
 
 	Core::LockGuard lock(m_mutex);
 
-	int index = 0;
-	for (auto& set: m_sets)
-	{
-		if (set.set != nullptr)
-		{
-			for (int i = 0; i < set.storage_buffers_num; i++)
-			{
-				if (set.storage_buffers_id[i] == buffer->memory.unique_id)
-				{
-					Free(set.set);
-					set.set           = nullptr;
-					set.next_free_set = m_first_free_set;
-					m_first_free_set  = index;
-					auto& ids         = m_sets_map[set.hash];
-					ids.Remove(index);
-					if (ids.IsEmpty())
-					{
-						m_sets_map.Remove(set.hash);
-					}
-					break;
-				}
-			}
-		}
-		index++;
-	}
+	RetireSets(buffer->memory.unique_id);
 }
 
 void DescriptorCache::FreeDescriptor(VulkanImage* image)
@@ -3477,31 +5136,7 @@ void DescriptorCache::FreeDescriptor(VulkanImage* image)
 
 	Core::LockGuard lock(m_mutex);
 
-	int index = 0;
-	for (auto& set: m_sets)
-	{
-		if (set.set != nullptr)
-		{
-			for (int i = 0; i < set.textures2d_sampled_num; i++)
-			{
-				if (set.textures2d_sampled_id[i] == image->memory.unique_id)
-				{
-					Free(set.set);
-					set.set           = nullptr;
-					set.next_free_set = m_first_free_set;
-					m_first_free_set  = index;
-					auto& ids         = m_sets_map[set.hash];
-					ids.Remove(index);
-					if (ids.IsEmpty())
-					{
-						m_sets_map.Remove(set.hash);
-					}
-					break;
-				}
-			}
-		}
-		index++;
-	}
+	RetireSets(image->memory.unique_id);
 }
 
 VkDescriptorSetLayout DescriptorCache::GetDescriptorSetLayout(Stage stage, const ShaderBindResources& bind)
@@ -3687,83 +5322,187 @@ static Vector<DepthStencilVulkanImage*> FindDepthStencil(uint64_t vaddr, uint64_
 	return ret;
 }
 
-void GraphicsRenderMemoryBarrier(CommandBuffer* buffer)
+// Stages and accesses which can use the image in this layout
+static void GetLayoutAccess(VkImageLayout layout, VkPipelineStageFlags* stages, VkAccessFlags* access)
 {
-	EXIT_IF(buffer == nullptr);
-	EXIT_IF(buffer->IsInvalid());
-
-	Core::LockGuard lock(g_render_ctx->GetMutex());
-
-	auto* vk_buffer = buffer->GetPool()->buffers[buffer->GetIndex()];
+	EXIT_IF(stages == nullptr);
+	EXIT_IF(access == nullptr);
 
-	VkMemoryBarrier mem_barrier {};
-	mem_barrier.sType         = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
-	mem_barrier.pNext         = nullptr;
-	mem_barrier.srcAccessMask = VK_ACCESS_MEMORY_WRITE_BIT;
-	mem_barrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+	constexpr VkPipelineStageFlags shader_stages =
+	    VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+	constexpr VkPipelineStageFlags depth_stages = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
 
-	vkCmdPipelineBarrier(vk_buffer, VK_PIPELINE_STAGE_ALL_GRAPHICS_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
-	                     VK_PIPELINE_STAGE_ALL_GRAPHICS_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &mem_barrier, 0, nullptr, 0,
-	                     nullptr);
+	switch (layout)
+	{
+		case VK_IMAGE_LAYOUT_UNDEFINED:
+			*stages = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+			*access = 0;
+			break;
+		case VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL:
+			*stages = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+			*access = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+			break;
+		case VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL:
+			*stages = depth_stages;
+			*access = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+			break;
+		case VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL:
+			*stages = depth_stages | shader_stages;
+			*access = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_SHADER_READ_BIT;
+			break;
+		case VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL:
+			*stages = shader_stages;
+			*access = VK_ACCESS_SHADER_READ_BIT;
+			break;
+		case VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL:
+			*stages = VK_PIPELINE_STAGE_TRANSFER_BIT;
+			*access = VK_ACCESS_TRANSFER_READ_BIT;
+			break;
+		case VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL:
+			*stages = VK_PIPELINE_STAGE_TRANSFER_BIT;
+			*access = VK_ACCESS_TRANSFER_WRITE_BIT;
+			break;
+		default:
+			*stages = VK_PIPELINE_STAGE_ALL_GRAPHICS_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+			*access = VK_ACCESS_MEMORY_READ_BIT | VK_ACCESS_MEMORY_WRITE_BIT;
+			break;
+	}
 }
 
-static void GraphicsRenderRenderTextureBarrier(VkCommandBuffer vk_buffer, VulkanImage* image)
+struct CommandBufferBarriers
 {
-	EXIT_IF(image == nullptr);
+	// Work recorded into the previously submitted buffers is not tracked, so the first memory barrier waits for everything
+	static constexpr VkPipelineStageFlags UNKNOWN_STAGES = VK_PIPELINE_STAGE_ALL_GRAPHICS_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+	static constexpr VkAccessFlags        UNKNOWN_ACCESS = VK_ACCESS_MEMORY_WRITE_BIT;
 
-	if (image->layout == VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL)
+	// Writes which are not made visible by a memory barrier yet
+	VkPipelineStageFlags written_stages = UNKNOWN_STAGES;
+	VkAccessFlags        written_access = UNKNOWN_ACCESS;
+
+	// Pending barriers
+	VkPipelineStageFlags         src_stages = 0;
+	VkPipelineStageFlags         dst_stages = 0;
+	VkAccessFlags                src_access = 0;
+	VkAccessFlags                dst_access = 0;
+	bool                         memory     = false;
+	Vector<VkImageMemoryBarrier> images;
+
+	void Reset()
+	{
+		written_stages = UNKNOWN_STAGES;
+		written_access = UNKNOWN_ACCESS;
+		src_stages     = 0;
+		dst_stages     = 0;
+		src_access     = 0;
+		dst_access     = 0;
+		memory         = false;
+		images.Clear();
+	}
+
+	[[nodiscard]] bool IsPending() const { return memory || !images.IsEmpty(); }
+
+	void AddWrite(VkPipelineStageFlags stages, VkAccessFlags access)
+	{
+		written_stages |= stages;
+		written_access |= access;
+	}
+
+	void AddMemoryBarrier()
+	{
+		if (written_stages != 0)
+		{
+			memory = true;
+			src_stages |= written_stages;
+			src_access |= written_access;
+			dst_stages |= VK_PIPELINE_STAGE_ALL_GRAPHICS_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+			dst_access |= VK_ACCESS_MEMORY_READ_BIT;
+
+			written_stages = 0;
+			written_access = 0;
+		}
+	}
+
+	// The layout of the image is changed right away, the transition itself is recorded by CommandBuffer::FlushBarriers()
+	void AddImageBarrier(VulkanImage* image, VkImageAspectFlags aspect_mask, VkImageLayout new_layout)
 	{
+		EXIT_IF(image == nullptr);
+
+		VkPipelineStageFlags image_src_stages = 0;
+		VkPipelineStageFlags image_dst_stages = 0;
+		VkAccessFlags        image_src_access = 0;
+		VkAccessFlags        image_dst_access = 0;
+
+		GetLayoutAccess(image->layout, &image_src_stages, &image_src_access);
+		GetLayoutAccess(new_layout, &image_dst_stages, &image_dst_access);
+
+		// Barriers of one batch are not ordered, so the second transition of the same image replaces the destination of the first one
+		for (auto& b: images)
+		{
+			if (b.image == image->image && b.subresourceRange.aspectMask == aspect_mask)
+			{
+				b.newLayout     = new_layout;
+				b.dstAccessMask = image_dst_access;
+				dst_stages |= image_dst_stages;
+				image->layout = new_layout;
+				return;
+			}
+		}
+
 		VkImageMemoryBarrier image_memory_barrier {};
 		image_memory_barrier.sType                           = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
 		image_memory_barrier.pNext                           = nullptr;
-		image_memory_barrier.srcAccessMask                   = VK_ACCESS_MEMORY_WRITE_BIT;
-		image_memory_barrier.dstAccessMask                   = VK_ACCESS_MEMORY_READ_BIT;
+		image_memory_barrier.srcAccessMask                   = image_src_access;
+		image_memory_barrier.dstAccessMask                   = image_dst_access;
 		image_memory_barrier.oldLayout                       = image->layout;
-		image_memory_barrier.newLayout                       = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		image_memory_barrier.newLayout                       = new_layout;
 		image_memory_barrier.srcQueueFamilyIndex             = VK_QUEUE_FAMILY_IGNORED;
 		image_memory_barrier.dstQueueFamilyIndex             = VK_QUEUE_FAMILY_IGNORED;
 		image_memory_barrier.image                           = image->image;
-		image_memory_barrier.subresourceRange.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT;
+		image_memory_barrier.subresourceRange.aspectMask     = aspect_mask;
 		image_memory_barrier.subresourceRange.baseMipLevel   = 0;
 		image_memory_barrier.subresourceRange.levelCount     = VK_REMAINING_MIP_LEVELS;
 		image_memory_barrier.subresourceRange.baseArrayLayer = 0;
 		image_memory_barrier.subresourceRange.layerCount     = 1;
 
-		vkCmdPipelineBarrier(vk_buffer, VK_PIPELINE_STAGE_ALL_GRAPHICS_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
-		                     VK_PIPELINE_STAGE_ALL_GRAPHICS_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1,
-		                     &image_memory_barrier);
+		images.Add(image_memory_barrier);
 
-		image->layout = image_memory_barrier.newLayout;
+		src_stages |= image_src_stages;
+		dst_stages |= image_dst_stages;
+
+		image->layout = new_layout;
 	}
+};
+
+void GraphicsRenderMemoryBarrier(CommandBuffer* buffer)
+{
+	EXIT_IF(buffer == nullptr);
+	EXIT_IF(buffer->IsInvalid());
+
+	Core::LockGuard lock(g_render_ctx->GetMutex());
+
+	// Nothing is written since the previous barrier, so there is nothing to wait for
+	buffer->GetBarriers()->AddMemoryBarrier();
 }
 
-static void GraphicsRenderDepthStencilBarrier(VkCommandBuffer vk_buffer, VulkanImage* image)
+static void GraphicsRenderRenderTextureBarrier(CommandBufferBarriers* barriers, VulkanImage* image)
 {
+	EXIT_IF(barriers == nullptr);
 	EXIT_IF(image == nullptr);
 
-	if (image->layout == VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL)
+	if (image->layout == VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL)
 	{
-		VkImageMemoryBarrier image_memory_barrier {};
-		image_memory_barrier.sType                           = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-		image_memory_barrier.pNext                           = nullptr;
-		image_memory_barrier.srcAccessMask                   = VK_ACCESS_MEMORY_WRITE_BIT;
-		image_memory_barrier.dstAccessMask                   = VK_ACCESS_MEMORY_READ_BIT;
-		image_memory_barrier.oldLayout                       = image->layout;
-		image_memory_barrier.newLayout                       = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
-		image_memory_barrier.srcQueueFamilyIndex             = VK_QUEUE_FAMILY_IGNORED;
-		image_memory_barrier.dstQueueFamilyIndex             = VK_QUEUE_FAMILY_IGNORED;
-		image_memory_barrier.image                           = image->image;
-		image_memory_barrier.subresourceRange.aspectMask     = VK_IMAGE_ASPECT_DEPTH_BIT;
-		image_memory_barrier.subresourceRange.baseMipLevel   = 0;
-		image_memory_barrier.subresourceRange.levelCount     = VK_REMAINING_MIP_LEVELS;
-		image_memory_barrier.subresourceRange.baseArrayLayer = 0;
-		image_memory_barrier.subresourceRange.layerCount     = 1;
+		barriers->AddImageBarrier(image, VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+	}
+}
 
-		vkCmdPipelineBarrier(vk_buffer, VK_PIPELINE_STAGE_ALL_GRAPHICS_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
-		                     VK_PIPELINE_STAGE_ALL_GRAPHICS_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1,
-		                     &image_memory_barrier);
+static void GraphicsRenderDepthStencilBarrier(CommandBufferBarriers* barriers, VulkanImage* image)
+{
+	EXIT_IF(barriers == nullptr);
+	EXIT_IF(image == nullptr);
 
-		image->layout = image_memory_barrier.newLayout;
+	if (image->layout == VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL)
+	{
+		barriers->AddImageBarrier(image, VK_IMAGE_ASPECT_DEPTH_BIT, VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL);
 	}
 }
 
@@ -3774,13 +5513,11 @@ void GraphicsRenderRenderTextureBarrier(CommandBuffer* buffer, uint64_t vaddr, u
 
 	Core::LockGuard lock(g_render_ctx->GetMutex());
 
-	auto* vk_buffer = buffer->GetPool()->buffers[buffer->GetIndex()];
-
 	auto images = FindRenderTexture(vaddr, size, false);
 
 	for (auto* image: images)
 	{
-		GraphicsRenderRenderTextureBarrier(vk_buffer, image);
+		GraphicsRenderRenderTextureBarrier(buffer->GetBarriers(), image);
 	}
 }
 
@@ -3791,13 +5528,11 @@ void GraphicsRenderDepthStencilBarrier(CommandBuffer* buffer, uint64_t vaddr, ui
 
 	Core::LockGuard lock(g_render_ctx->GetMutex());
 
-	auto* vk_buffer = buffer->GetPool()->buffers[buffer->GetIndex()];
-
 	auto images = FindDepthStencil(vaddr, size, false);
 
 	for (auto* image: images)
 	{
-		GraphicsRenderDepthStencilBarrier(vk_buffer, image);
+		GraphicsRenderDepthStencilBarrier(buffer->GetBarriers(), image);
 	}
 }
 
@@ -4129,7 +5864,43 @@ static void InvalidateMemoryObject(const RenderDepthInfo& r)
 	if (with_depth)
 	{
 		GpuMemoryResetHash(r.vaddr, r.size, r.vaddr_num, GpuMemoryObjectType::DepthStencilBuffer);
+		r.vulkan_buffer->generation++;
+	}
+}
+
+// The color copy is converted again only if the depth image was rendered to since the last conversion
+static VulkanImage* PrepareDepthColor(CommandBuffer* buffer, DepthStencilVulkanImage* image, bool storage)
+{
+	EXIT_IF(buffer == nullptr);
+	EXIT_IF(image == nullptr);
+
+	auto* color    = UtilGetDepthColor(g_render_ctx->GetGraphicCtx(), image);
+	auto* barriers = buffer->GetBarriers();
+
+	if (image->color_generation != image->generation)
+	{
+		auto depth_layout = image->layout;
+
+		barriers->AddImageBarrier(image, VK_IMAGE_ASPECT_DEPTH_BIT, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL);
+		barriers->AddImageBarrier(color, VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+		buffer->FlushBarriers();
+
+		UtilDepthToColor(buffer, image);
+
+		barriers->AddWrite(VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT);
+		barriers->AddImageBarrier(image, VK_IMAGE_ASPECT_DEPTH_BIT, depth_layout);
+
+		image->color_generation = image->generation;
+	}
+
+	auto color_layout = (storage ? VK_IMAGE_LAYOUT_GENERAL : VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+
+	if (color->layout != color_layout)
+	{
+		barriers->AddImageBarrier(color, VK_IMAGE_ASPECT_COLOR_BIT, color_layout);
 	}
+
+	return color;
 }
 
 // NOLINTNEXTLINE(readability-function-cognitive-complexity)
@@ -4176,7 +5947,7 @@ static void PrepareStorageBuffers(uint64_t submit_id, CommandBuffer* buffer, con
 		EXIT_NOT_IMPLEMENTED(read_only && !(storage_buffers.usages[i] == ShaderStorageUsage::ReadOnly ||
 		                                    storage_buffers.usages[i] == ShaderStorageUsage::Constant));
 
-		StorageBufferGpuObject buf_info(stride, num_records, read_only);
+		StorageBufferGpuObject buf_info(stride, num_records, read_only, VulkanCanImportHost(g_render_ctx->GetGraphicCtx(), addr));
 
 		auto* buf = static_cast<StorageVulkanBuffer*>(
 		    GpuMemoryCreateObject(submit_id, g_render_ctx->GetGraphicCtx(), nullptr, addr, size, buf_info));
@@ -4316,6 +6087,14 @@ static void PrepareTextures(uint64_t submit_id, CommandBuffer* buffer, const Sha
 				EXIT_NOT_IMPLEMENTED(swizzle != DstSel(4, 4, 4, 4));
 				EXIT_NOT_IMPLEMENTED(dtex.At(0)->compressed);
 				tex = dtex.At(0);
+
+				// Depth can't be bound as a storage image, nor sampled if the image wasn't created for it. Such reads get a color
+				// copy which is converted on the GPU. Shader writes to the copy are not seen by the depth image.
+				bool storage = textures.desc[i].textures2d_without_sampler;
+				if (storage || !dtex.At(0)->sampled)
+				{
+					tex = PrepareDepthColor(buffer, dtex.At(0), storage);
+				}
 			}
 		} else
 		{
@@ -4326,7 +6105,16 @@ static void PrepareTextures(uint64_t submit_id, CommandBuffer* buffer, const Sha
 				EXIT_NOT_IMPLEMENTED(rtex.Size() > 1);
 				EXIT_NOT_IMPLEMENTED(swizzle != DstSel(4, 5, 6, 7) && swizzle != DstSel(6, 5, 4, 7));
 				tex = rtex.At(0);
-				if (swizzle == DstSel(6, 5, 4, 7))
+
+				// The render target is sampled in place, a view of the other color space aliases its image
+				bool bgra  = (swizzle == DstSel(6, 5, 4, 7));
+				bool srgb  = (!gen5 && nfmt == 9);
+				bool alias = (srgb != (tex->format == VK_FORMAT_R8G8B8A8_SRGB || tex->format == VK_FORMAT_B8G8R8A8_SRGB) &&
+				              tex->image_view[VulkanImage::VIEW_ALIAS] != nullptr);
+				if (alias)
+				{
+					view_type = (bgra ? VulkanImage::VIEW_ALIAS_BGRA : VulkanImage::VIEW_ALIAS);
+				} else if (bgra)
 				{
 					view_type = VulkanImage::VIEW_BGRA;
 				}
@@ -4508,6 +6296,24 @@ static void PrepareDirectSgprs(const ShaderDirectSgprsResources& direct_sgprs, u
 	}
 }
 
+static void VulkanCmdPushDescriptorSetKHR(GraphicContext* ctx, VkCommandBuffer command_buffer, VkPipelineBindPoint pipeline_bind_point,
+                                          VkPipelineLayout layout, uint32_t set, uint32_t descriptor_write_count,
+                                          const VkWriteDescriptorSet* p_descriptor_writes)
+{
+	EXIT_IF(ctx == nullptr);
+	EXIT_IF(ctx->device == nullptr);
+
+	static auto func = reinterpret_cast<PFN_vkCmdPushDescriptorSetKHR>(vkGetDeviceProcAddr(ctx->device, "vkCmdPushDescriptorSetKHR"));
+
+	if (func != nullptr)
+	{
+		func(command_buffer, pipeline_bind_point, layout, set, descriptor_write_count, p_descriptor_writes);
+	} else
+	{
+		EXIT("vkCmdPushDescriptorSetKHR not present\n");
+	}
+}
+
 static void BindDescriptors(uint64_t submit_id, CommandBuffer* buffer, VkPipelineBindPoint pipeline_bind_point, VkPipelineLayout layout,
                             const ShaderBindResources& bind, VkShaderStageFlags vk_stage, DescriptorCache::Stage stage)
 {
@@ -4573,81 +6379,300 @@ static void BindDescriptors(uint64_t submit_id, CommandBuffer* buffer, VkPipelin
 			{
 				if (textures2d_sampled[i]->type == VulkanImageType::DepthStencil)
 				{
-					GraphicsRenderDepthStencilBarrier(vk_buffer, textures2d_sampled[i]);
+					GraphicsRenderDepthStencilBarrier(buffer->GetBarriers(), textures2d_sampled[i]);
 				} else if (textures2d_sampled[i]->type == VulkanImageType::RenderTexture)
 				{
-					GraphicsRenderRenderTextureBarrier(vk_buffer, textures2d_sampled[i]);
+					GraphicsRenderRenderTextureBarrier(buffer->GetBarriers(), textures2d_sampled[i]);
 				}
 			}
 		}
 
-		if (need_descriptor)
+		if (need_descriptor && use_push_descriptors(g_render_ctx->GetGraphicCtx(), bind.storage_buffers.buffers_num,
+		                                            bind.textures2D.textures2d_sampled_num, bind.textures2D.textures2d_storage_num,
+		                                            bind.samplers.samplers_num, bind.gds_pointers.pointers_num))
+		{
+			DescriptorCache::DescriptorWrites writes;
+			DescriptorCache::PrepareWrites(&writes, nullptr, storage_buffers, textures2d_sampled, textures2d_sampled_view,
+			                               textures2d_storage, samplers, &gds_buffer, bind);
+
+			VulkanCmdPushDescriptorSetKHR(g_render_ctx->GetGraphicCtx(), vk_buffer, pipeline_bind_point, layout, bind.descriptor_set_slot,
+			                              writes.writes_num, writes.writes);
+		} else if (need_descriptor)
 		{
 			auto* descriptor_set = g_render_ctx->GetDescriptorCache()->GetDescriptor(
 			    stage, storage_buffers, textures2d_sampled, textures2d_sampled_view, textures2d_storage, samplers, &gds_buffer, bind);
 
-			EXIT_IF(descriptor_set == nullptr);
+			EXIT_IF(descriptor_set == nullptr);
+
+			vkCmdBindDescriptorSets(vk_buffer, pipeline_bind_point, layout, bind.descriptor_set_slot, 1, &descriptor_set->set, 0, nullptr);
+		}
+
+		if (bind.uniform_buffer)
+		{
+			uint32_t offset = 0;
+			auto*    set    = g_render_ctx->GetUniformBufferPool()->Write(buffer->GetUniforms(), sgprs, bind.push_constant_size, &offset);
+
+			vkCmdBindDescriptorSets(vk_buffer, pipeline_bind_point, layout, bind.uniform_buffer_slot, 1, &set, 1, &offset);
+		} else
+		{
+			vkCmdPushConstants(vk_buffer, layout, vk_stage, bind.push_constant_offset, bind.push_constant_size, sgprs);
+		}
+	}
+}
+
+static void VulkanCmdSetColorWriteEnableEXT(GraphicContext* ctx, VkCommandBuffer command_buffer, uint32_t attachment_count,
+                                            const VkBool32* p_color_write_enables)
+{
+	EXIT_IF(ctx == nullptr);
+	EXIT_IF(ctx->instance == nullptr);
+
+	static auto func =
+	    reinterpret_cast<PFN_vkCmdSetColorWriteEnableEXT>(vkGetInstanceProcAddr(ctx->instance, "vkCmdSetColorWriteEnableEXT"));
+
+	if (func != nullptr)
+	{
+		func(command_buffer, attachment_count, p_color_write_enables);
+	} else
+	{
+		EXIT("vkCmdSetColorWriteEnableEXT not present\n");
+	}
+}
+
+static void VulkanCmdSetExtendedDynamicStateEXT(GraphicContext* ctx, VkCommandBuffer command_buffer,
+                                                const PipelineDynamicParameters* params)
+{
+	EXIT_IF(ctx == nullptr);
+	EXIT_IF(ctx->device == nullptr);
+	EXIT_IF(params == nullptr);
+
+	static auto set_topology =
+	    reinterpret_cast<PFN_vkCmdSetPrimitiveTopologyEXT>(vkGetDeviceProcAddr(ctx->device, "vkCmdSetPrimitiveTopologyEXT"));
+	static auto set_cull_mode  = reinterpret_cast<PFN_vkCmdSetCullModeEXT>(vkGetDeviceProcAddr(ctx->device, "vkCmdSetCullModeEXT"));
+	static auto set_front_face = reinterpret_cast<PFN_vkCmdSetFrontFaceEXT>(vkGetDeviceProcAddr(ctx->device, "vkCmdSetFrontFaceEXT"));
+	static auto set_depth_test_enable =
+	    reinterpret_cast<PFN_vkCmdSetDepthTestEnableEXT>(vkGetDeviceProcAddr(ctx->device, "vkCmdSetDepthTestEnableEXT"));
+	static auto set_depth_write_enable =
+	    reinterpret_cast<PFN_vkCmdSetDepthWriteEnableEXT>(vkGetDeviceProcAddr(ctx->device, "vkCmdSetDepthWriteEnableEXT"));
+	static auto set_depth_compare_op =
+	    reinterpret_cast<PFN_vkCmdSetDepthCompareOpEXT>(vkGetDeviceProcAddr(ctx->device, "vkCmdSetDepthCompareOpEXT"));
+	static auto set_depth_bounds_test_enable =
+	    reinterpret_cast<PFN_vkCmdSetDepthBoundsTestEnableEXT>(vkGetDeviceProcAddr(ctx->device, "vkCmdSetDepthBoundsTestEnableEXT"));
+	static auto set_stencil_test_enable =
+	    reinterpret_cast<PFN_vkCmdSetStencilTestEnableEXT>(vkGetDeviceProcAddr(ctx->device, "vkCmdSetStencilTestEnableEXT"));
+	static auto set_stencil_op = reinterpret_cast<PFN_vkCmdSetStencilOpEXT>(vkGetDeviceProcAddr(ctx->device, "vkCmdSetStencilOpEXT"));
+
+	EXIT_NOT_IMPLEMENTED(set_topology == nullptr || set_cull_mode == nullptr || set_front_face == nullptr ||
+	                     set_depth_test_enable == nullptr || set_depth_write_enable == nullptr || set_depth_compare_op == nullptr ||
+	                     set_depth_bounds_test_enable == nullptr || set_stencil_test_enable == nullptr || set_stencil_op == nullptr);
+
+	const auto& front = params->stencil_front_ops;
+	const auto& back  = params->stencil_back_ops;
+
+	set_topology(command_buffer, params->topology);
+	set_cull_mode(command_buffer, params->cull_mode);
+	set_front_face(command_buffer, params->front_face);
+	set_depth_test_enable(command_buffer, params->depth_test_enable ? VK_TRUE : VK_FALSE);
+	set_depth_write_enable(command_buffer, params->depth_write_enable ? VK_TRUE : VK_FALSE);
+	set_depth_compare_op(command_buffer, params->depth_compare_op);
+	set_depth_bounds_test_enable(command_buffer, params->depth_bounds_test_enable ? VK_TRUE : VK_FALSE);
+	set_stencil_test_enable(command_buffer, params->stencil_test_enable ? VK_TRUE : VK_FALSE);
+	set_stencil_op(command_buffer, VK_STENCIL_FACE_FRONT_BIT, front.failOp, front.passOp, front.depthFailOp, front.compareOp);
+	set_stencil_op(command_buffer, VK_STENCIL_FACE_BACK_BIT, back.failOp, back.passOp, back.depthFailOp, back.compareOp);
+}
+
+static void SetDynamicParams(VkCommandBuffer vk_buffer, VulkanPipeline* pipeline)
+{
+	KYTY_PROFILER_FUNCTION();
+
+	EXIT_IF(pipeline == nullptr);
+	EXIT_IF(pipeline->static_params == nullptr);
+	EXIT_IF(pipeline->dynamic_params == nullptr);
+
+	if (pipeline->dynamic_params->vk_dynamic_state_line_width)
+	{
+		vkCmdSetLineWidth(vk_buffer, pipeline->dynamic_params->line_width);
+	}
+
+	if (pipeline->dynamic_params->vk_dynamic_state_extended_ext)
+	{
+		VulkanCmdSetExtendedDynamicStateEXT(g_render_ctx->GetGraphicCtx(), vk_buffer, pipeline->dynamic_params);
+	}
+
+	if (pipeline->dynamic_params->vk_dynamic_state_extended_ext ? pipeline->dynamic_params->stencil_test_enable
+	                                                            : pipeline->static_params->stencil_test_enable)
+	{
+		if (pipeline->dynamic_params->vk_dynamic_state_stencil_compare_mask)
+		{
+			vkCmdSetStencilCompareMask(vk_buffer, VK_STENCIL_FACE_FRONT_BIT, pipeline->dynamic_params->stencil_front.compareMask);
+			vkCmdSetStencilCompareMask(vk_buffer, VK_STENCIL_FACE_BACK_BIT, pipeline->dynamic_params->stencil_back.compareMask);
+		}
+		if (pipeline->dynamic_params->vk_dynamic_state_stencil_write_mask)
+		{
+			vkCmdSetStencilWriteMask(vk_buffer, VK_STENCIL_FACE_FRONT_BIT, pipeline->dynamic_params->stencil_front.writeMask);
+			vkCmdSetStencilWriteMask(vk_buffer, VK_STENCIL_FACE_BACK_BIT, pipeline->dynamic_params->stencil_back.writeMask);
+		}
+		if (pipeline->dynamic_params->vk_dynamic_state_stencil_reference)
+		{
+			vkCmdSetStencilReference(vk_buffer, VK_STENCIL_FACE_FRONT_BIT, pipeline->dynamic_params->stencil_front.reference);
+			vkCmdSetStencilReference(vk_buffer, VK_STENCIL_FACE_BACK_BIT, pipeline->dynamic_params->stencil_back.reference);
+		}
+	}
+
+	if (pipeline->dynamic_params->vk_dynamic_state_color_write_enable_ext)
+	{
+		VkBool32 enable = (pipeline->dynamic_params->color_write_enable ? VK_TRUE : VK_FALSE);
+		VulkanCmdSetColorWriteEnableEXT(g_render_ctx->GetGraphicCtx(), vk_buffer, 1, &enable);
+	}
+}
+
+// Validates the registers written since the previous draw and consumes their dirty bits. Returns true if none were written.
+static bool draw_state_check(HW::Context* ctx, HW::UserConfig* ucfg, HW::Shader* sh_ctx)
+{
+	uint32_t ctx_dirty = ctx->GetDirty();
+	uint32_t uc_dirty  = ucfg->GetDirty();
+	uint32_t sh_dirty  = sh_ctx->GetDirty() & HW::Shader::DIRTY_GRAPHICS;
+
+	if (sh_dirty != 0)
+	{
+		sh_check(*sh_ctx);
+	}
+	if (uc_dirty != 0)
+	{
+		uc_check(*ucfg);
+	}
+	hw_check(*ctx, ctx_dirty);
+
+	ctx->ClearDirty();
+	ucfg->ClearDirty();
+	sh_ctx->ClearDirty(HW::Shader::DIRTY_GRAPHICS);
+
+	return (ctx_dirty == 0 && uc_dirty == 0 && sh_dirty == 0);
+}
+
+// Back-to-back draws with identical state resolve to the pipeline which is still bound to the command buffer
+static VulkanPipeline* draw_state_pipeline(CommandBuffer* buffer, bool state_clean, VulkanFramebuffer* framebuffer,
+                                           RenderColorInfo* color_info, RenderDepthInfo* depth_info,
+                                           const ShaderVertexInputInfo* vs_input_info, HW::Context* ctx, HW::Shader* sh_ctx,
+                                           const ShaderPixelInputInfo* ps_input_info, VkPrimitiveTopology topology)
+{
+	auto* draw_state = buffer->GetDrawState();
+	auto* cache      = g_render_ctx->GetPipelineCache();
+	int   frame      = GraphicsRunGetFrameNum();
+
+	if (state_clean && draw_state->pipeline != nullptr && draw_state->framebuffer == framebuffer &&
+	    draw_state->topology == static_cast<int>(topology) && draw_state->frame == frame &&
+	    draw_state->generation == cache->GetGeneration())
+	{
+		return draw_state->pipeline;
+	}
+
+	auto* pipeline = cache->CreatePipeline(framebuffer, color_info, depth_info, vs_input_info, ctx, sh_ctx, ps_input_info, topology);
 
-			vkCmdBindDescriptorSets(vk_buffer, pipeline_bind_point, layout, bind.descriptor_set_slot, 1, &descriptor_set->set, 0, nullptr);
-		}
-		vkCmdPushConstants(vk_buffer, layout, vk_stage, bind.push_constant_offset, bind.push_constant_size, sgprs);
+	if (pipeline != nullptr)
+	{
+		auto* vk_buffer = buffer->GetPool()->buffers[buffer->GetIndex()];
+
+		vkCmdBindPipeline(vk_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline->pipeline);
+
+		SetDynamicParams(vk_buffer, pipeline);
 	}
+
+	draw_state->framebuffer = framebuffer;
+	draw_state->pipeline    = pipeline;
+	draw_state->topology    = static_cast<int>(topology);
+	draw_state->frame       = frame;
+	draw_state->generation  = cache->GetGeneration();
+
+	return pipeline;
 }
 
-static void VulkanCmdSetColorWriteEnableEXT(GraphicContext* ctx, VkCommandBuffer command_buffer, uint32_t attachment_count,
-                                            const VkBool32* p_color_write_enables)
+// Runs of draws which only differ in the constants and the index range keep the vertex and index buffers bound
+static void draw_state_bind_vertex_buffer(CommandBuffer* buffer, int binding, VulkanBuffer* vertices, uint64_t offset)
 {
-	EXIT_IF(ctx == nullptr);
-	EXIT_IF(ctx->instance == nullptr);
+	auto* draw_state = buffer->GetDrawState();
 
-	static auto func =
-	    reinterpret_cast<PFN_vkCmdSetColorWriteEnableEXT>(vkGetInstanceProcAddr(ctx->instance, "vkCmdSetColorWriteEnableEXT"));
+	EXIT_IF(binding < 0 || binding >= CommandBuffer::DrawState::VERTEX_BUFFERS_MAX);
 
-	if (func != nullptr)
-	{
-		func(command_buffer, attachment_count, p_color_write_enables);
-	} else
+	if (draw_state->vertex_buffers[binding] != vertices || draw_state->vertex_offsets[binding] != offset)
 	{
-		EXIT("vkCmdSetColorWriteEnableEXT not present\n");
+		auto* vk_buffer = buffer->GetPool()->buffers[buffer->GetIndex()];
+
+		VkDeviceSize vk_offset = offset;
+
+		vkCmdBindVertexBuffers(vk_buffer, binding, 1, &vertices->buffer, &vk_offset);
+
+		draw_state->vertex_buffers[binding] = vertices;
+		draw_state->vertex_offsets[binding] = offset;
 	}
 }
 
-static void SetDynamicParams(VkCommandBuffer vk_buffer, VulkanPipeline* pipeline)
+// Bindings whose ranges overlap are uploaded as one object over the whole range and bound at their offsets in it
+static void draw_state_bind_vertex_buffers(uint64_t submit_id, CommandBuffer* buffer, const ShaderVertexInputInfo& vs_input_info)
 {
-	KYTY_PROFILER_FUNCTION();
-
-	EXIT_IF(pipeline == nullptr);
-	EXIT_IF(pipeline->static_params == nullptr);
-	EXIT_IF(pipeline->dynamic_params == nullptr);
+	int      num = vs_input_info.buffers_num;
+	uint64_t begin[ShaderVertexInputInfo::RES_MAX];
+	uint64_t end[ShaderVertexInputInfo::RES_MAX];
+	int      range[ShaderVertexInputInfo::RES_MAX];
 
-	if (pipeline->dynamic_params->vk_dynamic_state_line_width)
+	for (int i = 0; i < num; i++)
 	{
-		vkCmdSetLineWidth(vk_buffer, pipeline->dynamic_params->line_width);
+		const auto& b = vs_input_info.buffers[i];
+		begin[i]      = b.addr;
+		end[i]        = b.addr + static_cast<uint64_t>(b.stride) * b.num_records;
+		range[i]      = i;
 	}
 
-	if (pipeline->static_params->stencil_test_enable)
+	for (bool merged = true; merged;)
 	{
-		if (pipeline->dynamic_params->vk_dynamic_state_stencil_compare_mask)
-		{
-			vkCmdSetStencilCompareMask(vk_buffer, VK_STENCIL_FACE_FRONT_BIT, pipeline->dynamic_params->stencil_front.compareMask);
-			vkCmdSetStencilCompareMask(vk_buffer, VK_STENCIL_FACE_BACK_BIT, pipeline->dynamic_params->stencil_back.compareMask);
-		}
-		if (pipeline->dynamic_params->vk_dynamic_state_stencil_write_mask)
+		merged = false;
+		for (int i = 0; i < num; i++)
 		{
-			vkCmdSetStencilWriteMask(vk_buffer, VK_STENCIL_FACE_FRONT_BIT, pipeline->dynamic_params->stencil_front.writeMask);
-			vkCmdSetStencilWriteMask(vk_buffer, VK_STENCIL_FACE_BACK_BIT, pipeline->dynamic_params->stencil_back.writeMask);
+			for (int j = 0; j < num; j++)
+			{
+				int ri = range[i];
+				int rj = range[j];
+				if (ri != rj && begin[ri] < end[rj] && begin[rj] < end[ri])
+				{
+					begin[ri] = std::min(begin[ri], begin[rj]);
+					end[ri]   = std::max(end[ri], end[rj]);
+					for (int k = 0; k < num; k++)
+					{
+						range[k] = (range[k] == rj ? ri : range[k]);
+					}
+					merged = true;
+				}
+			}
 		}
-		if (pipeline->dynamic_params->vk_dynamic_state_stencil_reference)
+	}
+
+	VulkanBuffer* vertices[ShaderVertexInputInfo::RES_MAX] = {};
+
+	for (int i = 0; i < num; i++)
+	{
+		int r = range[i];
+		if (vertices[r] == nullptr)
 		{
-			vkCmdSetStencilReference(vk_buffer, VK_STENCIL_FACE_FRONT_BIT, pipeline->dynamic_params->stencil_front.reference);
-			vkCmdSetStencilReference(vk_buffer, VK_STENCIL_FACE_BACK_BIT, pipeline->dynamic_params->stencil_back.reference);
+			vertices[r] = static_cast<VulkanBuffer*>(
+			    GpuMemoryCreateObject(submit_id, g_render_ctx->GetGraphicCtx(), nullptr, begin[r], end[r] - begin[r],
+			                          VertexBufferGpuObject(VulkanCanImportHost(g_render_ctx->GetGraphicCtx(), begin[r]))));
 		}
+
+		draw_state_bind_vertex_buffer(buffer, i, vertices[r], vs_input_info.buffers[i].addr - begin[r]);
 	}
+}
 
-	if (pipeline->dynamic_params->vk_dynamic_state_color_write_enable_ext)
+static void draw_state_bind_index_buffer(CommandBuffer* buffer, VulkanBuffer* indices, VkIndexType index_type)
+{
+	auto* draw_state = buffer->GetDrawState();
+
+	if (draw_state->index_buffer != indices || draw_state->index_type != static_cast<int>(index_type))
 	{
-		VkBool32 enable = (pipeline->dynamic_params->color_write_enable ? VK_TRUE : VK_FALSE);
-		VulkanCmdSetColorWriteEnableEXT(g_render_ctx->GetGraphicCtx(), vk_buffer, 1, &enable);
+		auto* vk_buffer = buffer->GetPool()->buffers[buffer->GetIndex()];
+
+		vkCmdBindIndexBuffer(vk_buffer, indices->buffer, 0, index_type);
+
+		draw_state->index_buffer = indices;
+		draw_state->index_type   = static_cast<int>(index_type);
 	}
 }
 
@@ -4671,6 +6696,67 @@ static bool shader_is_disabled(HW::Shader* sh_ctx)
 	return false;
 }
 
+// A rect drawn over the whole target by the embedded shaders is how the driver clears a render target. Such a draw is replaced by the
+// load operations of the render pass: the depth and stencil clears already are, the draw only has to leave no other trace.
+static bool draw_is_clear(const HW::Context& hw, const HW::UserConfig& ucfg, const HW::Shader& sh_ctx, uint32_t index_count,
+                          RenderColorInfo* color, const RenderDepthInfo& depth)
+{
+	if (!Config::FastClearEnabled())
+	{
+		return false;
+	}
+
+	const auto& vs = sh_ctx.GetVs();
+	const auto& ps = sh_ctx.GetPs();
+
+	if (!(vs.vs_embedded && vs.vs_embedded_id == 0 && ps.ps_embedded && ps.ps_embedded_id == 0 && ucfg.GetPrimType() == 17 &&
+	      index_count == 3))
+	{
+		return false;
+	}
+
+	bool with_depth = (depth.format != VK_FORMAT_UNDEFINED && depth.vulkan_buffer != nullptr);
+
+	if (with_depth && ((depth.depth_write_enable && !depth.depth_clear_enable) || depth.stencil_test_enable))
+	{
+		return false;
+	}
+
+	const auto& cc = hw.GetColorControl();
+
+	if (color->vulkan_buffer == nullptr || (hw.GetRenderTargetMask() & 0xfu) == 0 || cc.mode != 1)
+	{
+		// Nothing is written to the color target
+		return with_depth && (depth.depth_clear_enable || depth.stencil_clear_enable);
+	}
+
+	if ((hw.GetRenderTargetMask() & 0xfu) != 0xf || cc.op != 0xCC || hw.GetBlendControl(0).enable ||
+	    (with_depth && depth.depth_test_enable))
+	{
+		return false;
+	}
+
+	const auto& vp     = hw.GetScreenViewport();
+	auto        extent = color->vulkan_buffer->GetGuestExtent();
+	int         scissor_ltrb[4];
+	get_scissor_ltrb(vp, scissor_ltrb);
+
+	if (scissor_ltrb[0] > 0 || scissor_ltrb[1] > 0 || scissor_ltrb[2] < static_cast<int>(extent.width) ||
+	    scissor_ltrb[3] < static_cast<int>(extent.height) || vp.viewports[0].xoffset - vp.viewports[0].xscale > 0.0f ||
+	    vp.viewports[0].yoffset - vp.viewports[0].yscale > 0.0f ||
+	    vp.viewports[0].xoffset + vp.viewports[0].xscale < static_cast<float>(extent.width) ||
+	    vp.viewports[0].yoffset + vp.viewports[0].yscale < static_cast<float>(extent.height))
+	{
+		return false;
+	}
+
+	// The embedded pixel shader writes zeros
+	color->clear_enable = true;
+	color->clear_value  = {{0.0f, 0.0f, 0.0f, 0.0f}};
+
+	return true;
+}
+
 void GraphicsRenderDrawIndex(uint64_t submit_id, CommandBuffer* buffer, HW::Context* ctx, HW::UserConfig* ucfg, HW::Shader* sh_ctx,
                              uint32_t index_type_and_size, uint32_t index_count, const void* index_addr, uint32_t flags, uint32_t type)
 {
@@ -4683,6 +6769,7 @@ void GraphicsRenderDrawIndex(uint64_t submit_id, CommandBuffer* buffer, HW::Cont
 	EXIT_IF(buffer->IsInvalid());
 
 	Core::LockGuard lock(g_render_ctx->GetMutex());
+	UtilUploadBatch upload_batch(g_render_ctx->GetGraphicCtx());
 
 	if (shader_is_disabled(sh_ctx))
 	{
@@ -4690,13 +6777,10 @@ void GraphicsRenderDrawIndex(uint64_t submit_id, CommandBuffer* buffer, HW::Cont
 	}
 
 	sh_print("GraphicsRenderDrawIndex():Shader:", *sh_ctx);
-	sh_check(*sh_ctx);
-
 	uc_print("GraphicsRenderDrawIndex():UserConfig:", *ucfg);
-	uc_check(*ucfg);
-
 	hw_print(*ctx);
-	hw_check(*ctx);
+
+	bool state_clean = draw_state_check(ctx, ucfg, sh_ctx);
 
 	EXIT_NOT_IMPLEMENTED(ctx->GetShaderStages() != 0 && ctx->GetShaderStages() != 0x02002000);
 
@@ -4707,7 +6791,7 @@ void GraphicsRenderDrawIndex(uint64_t submit_id, CommandBuffer* buffer, HW::Cont
 		case 4: topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST; break;  // kPrimitiveTypeTriList
 		case 5: topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_FAN; break;   // kPrimitiveTypeTriFan
 		case 6: topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_STRIP; break; // kPrimitiveTypeTriStrip
-		case 19: topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_FAN; break;  // kPrimitiveTypeQuadList
+		case 19: topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST; break; // kPrimitiveTypeQuadList, converted to triangles
 		default: EXIT("unknown primitive type: %u\n", ucfg->GetPrimType());
 	}
 
@@ -4718,22 +6802,21 @@ void GraphicsRenderDrawIndex(uint64_t submit_id, CommandBuffer* buffer, HW::Cont
 	printf("\t flags               = 0x%08" PRIx32 "\n", flags);
 	printf("\t type                = 0x%08" PRIx32 "\n", type);
 
-	VkIndexType index_type = VK_INDEX_TYPE_UINT16;
-	uint64_t    index_size = 0;
+	uint32_t guest_index_size = 0;
 
 	switch (index_type_and_size)
 	{
-		case 0:
-			index_type = VK_INDEX_TYPE_UINT16;
-			index_size = 2 * static_cast<uint64_t>(index_count);
-			break;
-		case 1:
-			index_type = VK_INDEX_TYPE_UINT32;
-			index_size = 4 * static_cast<uint64_t>(index_count);
-			break;
+		case 0: guest_index_size = 2; break;
+		case 1: guest_index_size = 4; break;
+		case 2: guest_index_size = 1; break;
 		default: EXIT("unknown index_type_and_size: %u\n", index_type_and_size);
 	}
 
+	uint64_t    index_size = static_cast<uint64_t>(guest_index_size) * index_count;
+	VkIndexType index_type = (IndexBufferGetHostIndexSize(guest_index_size) == 4 ? VK_INDEX_TYPE_UINT32 : VK_INDEX_TYPE_UINT16);
+
+	auto index_conversion = (ucfg->GetPrimType() == 19 ? IndexBufferConversion::QuadList : IndexBufferConversion::None);
+
 	EXIT_NOT_IMPLEMENTED(flags != 0);
 	EXIT_NOT_IMPLEMENTED(type != 1);
 
@@ -4756,28 +6839,23 @@ void GraphicsRenderDrawIndex(uint64_t submit_id, CommandBuffer* buffer, HW::Cont
 	ShaderPixelInputInfo ps_input_info;
 	ShaderGetInputInfoPS(&sh_ctx->GetPs(), &ctx->GetShaderRegisters(), &vs_input_info, &ps_input_info);
 
-	auto* pipeline = g_render_ctx->GetPipelineCache()->CreatePipeline(framebuffer, &color_info, &depth_info, &vs_input_info, ctx, sh_ctx,
-	                                                                  &ps_input_info, topology);
-
-	// EXIT_NOT_IMPLEMENTED(vs_input_info.buffers_num > 1);
-
-	vkCmdBindPipeline(vk_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline->pipeline);
-
-	SetDynamicParams(vk_buffer, pipeline);
+	auto* pipeline = draw_state_pipeline(buffer, state_clean, framebuffer, &color_info, &depth_info, &vs_input_info, ctx, sh_ctx,
+	                                     &ps_input_info, topology);
 
-	for (int i = 0; i < vs_input_info.buffers_num; i++)
+	if (pipeline == nullptr)
 	{
-		const auto& b    = vs_input_info.buffers[i];
-		uint64_t    addr = b.addr;
-		uint64_t    size = static_cast<uint64_t>(b.stride) * b.num_records;
+		// The pipeline is being compiled asynchronously. Skip the draw, but keep the clears and the invalidation.
+		buffer->BeginRenderPass(framebuffer, &color_info, &depth_info);
+		buffer->EndRenderPass();
 
-		auto* vertices = static_cast<VulkanBuffer*>(
-		    GpuMemoryCreateObject(submit_id, g_render_ctx->GetGraphicCtx(), nullptr, addr, size, VertexBufferGpuObject()));
+		InvalidateMemoryObject(color_info);
+		InvalidateMemoryObject(depth_info);
+		return;
+	}
 
-		VkDeviceSize offset = 0;
+	// EXIT_NOT_IMPLEMENTED(vs_input_info.buffers_num > 1);
 
-		vkCmdBindVertexBuffers(vk_buffer, i, 1, &vertices->buffer, &offset);
-	}
+	draw_state_bind_vertex_buffers(submit_id, buffer, vs_input_info);
 
 	BindDescriptors(submit_id, buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline->pipeline_layout, vs_input_info.bind,
 	                VK_SHADER_STAGE_VERTEX_BIT, DescriptorCache::Stage::Vertex);
@@ -4785,14 +6863,17 @@ void GraphicsRenderDrawIndex(uint64_t submit_id, CommandBuffer* buffer, HW::Cont
 	BindDescriptors(submit_id, buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline->pipeline_layout, ps_input_info.bind,
 	                VK_SHADER_STAGE_FRAGMENT_BIT, DescriptorCache::Stage::Pixel);
 
-	VulkanBuffer* indices = static_cast<VulkanBuffer*>(GpuMemoryCreateObject(
-	    submit_id, g_render_ctx->GetGraphicCtx(), nullptr, reinterpret_cast<uint64_t>(index_addr), index_size, IndexBufferGpuObject()));
+	VulkanBuffer* indices = static_cast<VulkanBuffer*>(GpuMemoryCreateObject(submit_id, g_render_ctx->GetGraphicCtx(), nullptr,
+	                                                                         reinterpret_cast<uint64_t>(index_addr), index_size,
+	                                                                         IndexBufferGpuObject(guest_index_size, index_conversion)));
 
 	EXIT_NOT_IMPLEMENTED(indices == nullptr);
 
-	vkCmdBindIndexBuffer(vk_buffer, indices->buffer, 0, index_type);
+	draw_state_bind_index_buffer(buffer, indices, index_type);
 
 	buffer->BeginRenderPass(framebuffer, &color_info, &depth_info);
+	buffer->BeginProfilerScope("draw", "DrawIndex");
+	GpuCounterAdd(GpuCounter::Draws);
 
 	switch (ucfg->GetPrimType())
 	{
@@ -4801,14 +6882,12 @@ void GraphicsRenderDrawIndex(uint64_t submit_id, CommandBuffer* buffer, HW::Cont
 		case 6: vkCmdDrawIndexed(vk_buffer, index_count, 1, 0, 0, 0); break;
 		case 19:
 			EXIT_NOT_IMPLEMENTED((index_count & 0x3u) != 0);
-			for (uint32_t i = 0; i < index_count; i += 4)
-			{
-				vkCmdDrawIndexed(vk_buffer, 4, 1, i, 0, 0);
-			}
+			vkCmdDrawIndexed(vk_buffer, IndexBufferGetHostIndexCount(index_count, index_conversion), 1, 0, 0, 0);
 			break;
 		default: EXIT("unknown primitive type: %u\n", ucfg->GetPrimType());
 	}
 
+	buffer->EndProfilerScope();
 	buffer->EndRenderPass();
 
 	InvalidateMemoryObject(color_info);
@@ -4826,6 +6905,7 @@ void GraphicsRenderDrawIndexAuto(uint64_t submit_id, CommandBuffer* buffer, HW::
 	EXIT_IF(buffer == nullptr || buffer->IsInvalid());
 
 	Core::LockGuard lock(g_render_ctx->GetMutex());
+	UtilUploadBatch upload_batch(g_render_ctx->GetGraphicCtx());
 
 	if (shader_is_disabled(sh_ctx))
 	{
@@ -4833,13 +6913,10 @@ void GraphicsRenderDrawIndexAuto(uint64_t submit_id, CommandBuffer* buffer, HW::
 	}
 
 	sh_print("GraphicsRenderDrawIndexAuto():Shader:", *sh_ctx);
-	sh_check(*sh_ctx);
-
 	uc_print("GraphicsRenderDrawIndexAuto():UserConfig:", *ucfg);
-	uc_check(*ucfg);
-
 	hw_print(*ctx);
-	hw_check(*ctx);
+
+	bool state_clean = draw_state_check(ctx, ucfg, sh_ctx);
 
 	printf("GraphicsRenderDrawIndex():Parameters:\n");
 	printf("\t index_count         = 0x%08" PRIx32 "\n", index_count);
@@ -4854,11 +6931,23 @@ void GraphicsRenderDrawIndexAuto(uint64_t submit_id, CommandBuffer* buffer, HW::
 	RenderColorInfo color_info;
 	FindRenderColorInfo(submit_id, buffer, *ctx, &color_info);
 
+	bool is_clear = draw_is_clear(*ctx, *ucfg, *sh_ctx, index_count, &color_info, depth_info);
+
 	auto* framebuffer = g_render_ctx->GetFramebufferCache()->CreateFramebuffer(&color_info, &depth_info);
 
 	EXIT_NOT_IMPLEMENTED(framebuffer == nullptr);
 	EXIT_NOT_IMPLEMENTED(framebuffer->render_pass == nullptr);
 
+	if (is_clear)
+	{
+		buffer->BeginRenderPass(framebuffer, &color_info, &depth_info);
+		buffer->EndRenderPass();
+
+		InvalidateMemoryObject(color_info);
+		InvalidateMemoryObject(depth_info);
+		return;
+	}
+
 	auto* vk_buffer = buffer->GetPool()->buffers[buffer->GetIndex()];
 
 	VkPrimitiveTopology topology = VK_PRIMITIVE_TOPOLOGY_POINT_LIST;
@@ -4867,7 +6956,7 @@ void GraphicsRenderDrawIndexAuto(uint64_t submit_id, CommandBuffer* buffer, HW::
 	{
 		case 4: topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST; break;   // kPrimitiveTypeTriList
 		case 17: topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_STRIP; break; // kPrimitiveTypeRectList
-		case 19: topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_FAN; break;   // kPrimitiveTypeQuadList
+		case 19: topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST; break;  // kPrimitiveTypeQuadList, converted to triangles
 		default: EXIT("unknown primitive type: %u\n", ucfg->GetPrimType());
 	}
 
@@ -4881,28 +6970,23 @@ void GraphicsRenderDrawIndexAuto(uint64_t submit_id, CommandBuffer* buffer, HW::
 	ShaderPixelInputInfo ps_input_info;
 	ShaderGetInputInfoPS(&pixel_shader_info, &shader_regs, &vs_input_info, &ps_input_info);
 
-	auto* pipeline = g_render_ctx->GetPipelineCache()->CreatePipeline(framebuffer, &color_info, &depth_info, &vs_input_info, ctx, sh_ctx,
-	                                                                  &ps_input_info, topology);
-
-	// EXIT_NOT_IMPLEMENTED(vs_input_info.buffers_num > 1);
-
-	vkCmdBindPipeline(vk_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline->pipeline);
-
-	SetDynamicParams(vk_buffer, pipeline);
+	auto* pipeline = draw_state_pipeline(buffer, state_clean, framebuffer, &color_info, &depth_info, &vs_input_info, ctx, sh_ctx,
+	                                     &ps_input_info, topology);
 
-	for (int i = 0; i < vs_input_info.buffers_num; i++)
+	if (pipeline == nullptr)
 	{
-		const auto& b    = vs_input_info.buffers[i];
-		uint64_t    addr = b.addr;
-		uint64_t    size = static_cast<uint64_t>(b.stride) * b.num_records;
+		// The pipeline is being compiled asynchronously. Skip the draw, but keep the clears and the invalidation.
+		buffer->BeginRenderPass(framebuffer, &color_info, &depth_info);
+		buffer->EndRenderPass();
 
-		auto* vertices = static_cast<VulkanBuffer*>(
-		    GpuMemoryCreateObject(submit_id, g_render_ctx->GetGraphicCtx(), nullptr, addr, size, VertexBufferGpuObject()));
+		InvalidateMemoryObject(color_info);
+		InvalidateMemoryObject(depth_info);
+		return;
+	}
 
-		VkDeviceSize offset = 0;
+	// EXIT_NOT_IMPLEMENTED(vs_input_info.buffers_num > 1);
 
-		vkCmdBindVertexBuffers(vk_buffer, i, 1, &vertices->buffer, &offset);
-	}
+	draw_state_bind_vertex_buffers(submit_id, buffer, vs_input_info);
 
 	BindDescriptors(submit_id, buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline->pipeline_layout, vs_input_info.bind,
 	                VK_SHADER_STAGE_VERTEX_BIT, DescriptorCache::Stage::Vertex);
@@ -4910,7 +6994,18 @@ void GraphicsRenderDrawIndexAuto(uint64_t submit_id, CommandBuffer* buffer, HW::
 	BindDescriptors(submit_id, buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline->pipeline_layout, ps_input_info.bind,
 	                VK_SHADER_STAGE_FRAGMENT_BIT, DescriptorCache::Stage::Pixel);
 
+	if (ucfg->GetPrimType() == 19)
+	{
+		EXIT_NOT_IMPLEMENTED((index_count & 0x3u) != 0);
+
+		auto* indices = IndexBufferGetQuadList(g_render_ctx->GetGraphicCtx(), index_count);
+
+		draw_state_bind_index_buffer(buffer, indices, VK_INDEX_TYPE_UINT32);
+	}
+
 	buffer->BeginRenderPass(framebuffer, &color_info, &depth_info);
+	buffer->BeginProfilerScope("draw", "DrawIndexAuto");
+	GpuCounterAdd(GpuCounter::Draws);
 
 	switch (ucfg->GetPrimType())
 	{
@@ -4919,16 +7014,11 @@ void GraphicsRenderDrawIndexAuto(uint64_t submit_id, CommandBuffer* buffer, HW::
 			EXIT_NOT_IMPLEMENTED(!(index_count == 3 && vs_input_info.buffers_num == 0));
 			vkCmdDraw(vk_buffer, 4, 1, 0, 0);
 			break;
-		case 19:
-			EXIT_NOT_IMPLEMENTED((index_count & 0x3u) != 0);
-			for (uint32_t i = 0; i < index_count; i += 4)
-			{
-				vkCmdDraw(vk_buffer, 4, 1, i, 0);
-			}
-			break;
+		case 19: vkCmdDrawIndexed(vk_buffer, IndexBufferGetHostIndexCount(index_count, IndexBufferConversion::QuadList), 1, 0, 0, 0); break;
 		default: EXIT("unknown primitive type: %u\n", ucfg->GetPrimType());
 	}
 
+	buffer->EndProfilerScope();
 	buffer->EndRenderPass();
 
 	InvalidateMemoryObject(color_info);
@@ -4944,6 +7034,7 @@ void GraphicsRenderDispatchDirect(uint64_t submit_id, CommandBuffer* buffer, HW:
 	EXIT_IF(buffer->IsInvalid());
 
 	Core::LockGuard lock(g_render_ctx->GetMutex());
+	UtilUploadBatch upload_batch(g_render_ctx->GetGraphicCtx());
 
 	if (ShaderIsDisabled(sh_ctx->GetCs().cs_regs.data_addr))
 	{
@@ -4962,14 +7053,22 @@ void GraphicsRenderDispatchDirect(uint64_t submit_id, CommandBuffer* buffer, HW:
 
 	auto* pipeline = g_render_ctx->GetPipelineCache()->CreatePipeline(&input_info, &sh_ctx->GetCs(), &ctx->GetShaderRegisters());
 
+	// Bound after the descriptors, preparing a texture can record a dispatch of its own (see PrepareDepthColor())
+	BindDescriptors(submit_id, buffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline->pipeline_layout, input_info.bind,
+	                VK_SHADER_STAGE_COMPUTE_BIT, DescriptorCache::Stage::Compute);
+
 	vkCmdBindPipeline(vk_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline->pipeline);
 
 	SetDynamicParams(vk_buffer, pipeline);
 
-	BindDescriptors(submit_id, buffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline->pipeline_layout, input_info.bind,
-	                VK_SHADER_STAGE_COMPUTE_BIT, DescriptorCache::Stage::Compute);
+	buffer->FlushBarriers();
 
+	buffer->BeginProfilerScope("dispatch", "DispatchDirect");
+	GpuCounterAdd(GpuCounter::Dispatches);
 	vkCmdDispatch(vk_buffer, thread_group_x, thread_group_y, thread_group_z);
+	buffer->EndProfilerScope();
+
+	buffer->GetBarriers()->AddWrite(VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT);
 }
 
 void GraphicsRenderWriteAtEndOfPipe32(uint64_t submit_id, CommandBuffer* buffer, uint32_t* dst_gpu_addr, uint32_t value)
@@ -4986,7 +7085,7 @@ void GraphicsRenderWriteAtEndOfPipe32(uint64_t submit_id, CommandBuffer* buffer,
 	auto* label = static_cast<Label*>(
 	    GpuMemoryCreateObject(submit_id, g_render_ctx->GetGraphicCtx(), nullptr, reinterpret_cast<uint64_t>(dst_gpu_addr), 4, label_info));
 
-	LabelSet(buffer, label);
+	LabelSet(submit_id, buffer, label);
 }
 
 void GraphicsRenderWriteAtEndOfPipeGds32(uint64_t submit_id, CommandBuffer* buffer, uint32_t* dst_gpu_addr, uint32_t dw_offset,
@@ -5017,7 +7116,7 @@ void GraphicsRenderWriteAtEndOfPipeGds32(uint64_t submit_id, CommandBuffer* buff
 	auto* label = static_cast<Label*>(
 	    GpuMemoryCreateObject(submit_id, g_render_ctx->GetGraphicCtx(), nullptr, reinterpret_cast<uint64_t>(dst_gpu_addr), 4, label_info));
 
-	LabelSet(buffer, label);
+	LabelSet(submit_id, buffer, label);
 }
 
 void GraphicsRenderWriteAtEndOfPipe64(uint64_t submit_id, CommandBuffer* buffer, uint64_t* dst_gpu_addr, uint64_t value)
@@ -5034,7 +7133,7 @@ void GraphicsRenderWriteAtEndOfPipe64(uint64_t submit_id, CommandBuffer* buffer,
 	auto* label = static_cast<Label*>(
 	    GpuMemoryCreateObject(submit_id, g_render_ctx->GetGraphicCtx(), nullptr, reinterpret_cast<uint64_t>(dst_gpu_addr), 8, label_info));
 
-	LabelSet(buffer, label);
+	LabelSet(submit_id, buffer, label);
 }
 
 void GraphicsRenderWriteAtEndOfPipeClockCounter(uint64_t submit_id, CommandBuffer* buffer, uint64_t* dst_gpu_addr)
@@ -5064,7 +7163,7 @@ void GraphicsRenderWriteAtEndOfPipeClockCounter(uint64_t submit_id, CommandBuffe
 	auto* label = static_cast<Label*>(
 	    GpuMemoryCreateObject(submit_id, g_render_ctx->GetGraphicCtx(), nullptr, reinterpret_cast<uint64_t>(dst_gpu_addr), 8, label_info));
 
-	LabelSet(buffer, label);
+	LabelSet(submit_id, buffer, label);
 }
 
 void GraphicsRenderWriteAtEndOfPipeWithWriteBack64(uint64_t submit_id, CommandBuffer* buffer, uint64_t* dst_gpu_addr, uint64_t value)
@@ -5094,7 +7193,7 @@ void GraphicsRenderWriteAtEndOfPipeWithWriteBack64(uint64_t submit_id, CommandBu
 	auto* label = static_cast<Label*>(
 	    GpuMemoryCreateObject(submit_id, g_render_ctx->GetGraphicCtx(), nullptr, reinterpret_cast<uint64_t>(dst_gpu_addr), 8, label_info));
 
-	LabelSet(buffer, label);
+	LabelSet(submit_id, buffer, label);
 }
 
 void GraphicsRenderWriteAtEndOfPipeWithInterruptWriteBack64(uint64_t submit_id, CommandBuffer* buffer, uint64_t* dst_gpu_addr,
@@ -5131,7 +7230,7 @@ void GraphicsRenderWriteAtEndOfPipeWithInterruptWriteBack64(uint64_t submit_id,
 	auto* label = static_cast<Label*>(
 	    GpuMemoryCreateObject(submit_id, g_render_ctx->GetGraphicCtx(), nullptr, reinterpret_cast<uint64_t>(dst_gpu_addr), 8, label_info));
 
-	LabelSet(buffer, label);
+	LabelSet(submit_id, buffer, label);
 }
 
 void GraphicsRenderWriteAtEndOfPipeWithInterrupt64(uint64_t submit_id, CommandBuffer* buffer, uint64_t* dst_gpu_addr, uint64_t value)
@@ -5154,7 +7253,7 @@ void GraphicsRenderWriteAtEndOfPipeWithInterrupt64(uint64_t submit_id, CommandBu
 	auto* label = static_cast<Label*>(
 	    GpuMemoryCreateObject(submit_id, g_render_ctx->GetGraphicCtx(), nullptr, reinterpret_cast<uint64_t>(dst_gpu_addr), 8, label_info));
 
-	LabelSet(buffer, label);
+	LabelSet(submit_id, buffer, label);
 }
 
 void GraphicsRenderWriteAtEndOfPipeWithInterrupt32(uint64_t submit_id, CommandBuffer* buffer, uint32_t* dst_gpu_addr, uint32_t value)
@@ -5177,7 +7276,7 @@ void GraphicsRenderWriteAtEndOfPipeWithInterrupt32(uint64_t submit_id, CommandBu
 	auto* label = static_cast<Label*>(
 	    GpuMemoryCreateObject(submit_id, g_render_ctx->GetGraphicCtx(), nullptr, reinterpret_cast<uint64_t>(dst_gpu_addr), 4, label_info));
 
-	LabelSet(buffer, label);
+	LabelSet(submit_id, buffer, label);
 }
 
 void GraphicsRenderWriteAtEndOfPipeWithInterruptWriteBackFlip32(uint64_t submit_id, CommandBuffer* buffer, uint32_t* dst_gpu_addr,
@@ -5222,7 +7321,7 @@ void GraphicsRenderWriteAtEndOfPipeWithInterruptWriteBackFlip32(uint64_t submit_
 	auto* label = static_cast<Label*>(
 	    GpuMemoryCreateObject(submit_id, g_render_ctx->GetGraphicCtx(), nullptr, reinterpret_cast<uint64_t>(dst_gpu_addr), 4, label_info));
 
-	LabelSet(buffer, label);
+	LabelSet(submit_id, buffer, label);
 }
 
 void GraphicsRenderWriteAtEndOfPipeWithFlip32(uint64_t submit_id, CommandBuffer* buffer, uint32_t* dst_gpu_addr, uint32_t value, int handle,
@@ -5255,10 +7354,10 @@ void GraphicsRenderWriteAtEndOfPipeWithFlip32(uint64_t submit_id, CommandBuffer*
 	auto* label = static_cast<Label*>(
 	    GpuMemoryCreateObject(submit_id, g_render_ctx->GetGraphicCtx(), nullptr, reinterpret_cast<uint64_t>(dst_gpu_addr), 4, label_info));
 
-	LabelSet(buffer, label);
+	LabelSet(submit_id, buffer, label);
 }
 
-void GraphicsRenderWriteAtEndOfPipeOnlyFlip(uint64_t /*submit_id*/, CommandBuffer* buffer, int handle, int index, int flip_mode,
+void GraphicsRenderWriteAtEndOfPipeOnlyFlip(uint64_t submit_id, CommandBuffer* buffer, int handle, int index, int flip_mode,
                                             int64_t flip_arg)
 {
 	EXIT_IF(g_render_ctx == nullptr);
@@ -5284,7 +7383,7 @@ void GraphicsRenderWriteAtEndOfPipeOnlyFlip(uint64_t /*submit_id*/, CommandBuffe
 	    },
 	    nullptr, args);
 
-	LabelSet(buffer, label);
+	LabelSet(submit_id, buffer, label);
 
 	LabelDelete(label);
 }
@@ -5295,7 +7394,22 @@ void GraphicsRenderWriteBack(CommandProcessor* cp)
 
 	EXIT_IF(g_render_ctx == nullptr);
 
-	GpuMemoryWriteBack(g_render_ctx->GetGraphicCtx(), cp);
+	if (Config::AsyncWriteBackEnabled())
+	{
+		// The guest can't see the results before the next label or idle wait, so don't stall the command processor here
+		GpuMemoryDeferWriteBack(cp);
+	} else
+	{
+		GpuMemoryWriteBack(g_render_ctx->GetGraphicCtx(), cp);
+	}
+}
+
+void GraphicsRenderWriteBackPending(CommandProcessor* cp)
+{
+	EXIT_IF(g_render_ctx == nullptr);
+
+	// Called from the label thread, so the render mutex is not taken (the command processor thread locks it after its own mutex)
+	GpuMemoryWriteBackPending(g_render_ctx->GetGraphicCtx(), cp);
 }
 
 static void eop_event_reset_func(LibKernel::EventQueue::KernelEqueueEvent* event)
@@ -5361,20 +7475,16 @@ int GraphicsRenderDeleteEqEvent(LibKernel::EventQueue::KernelEqueue eq, int id)
 	return result;
 }
 
-void GraphicsRenderClearGds(uint64_t dw_offset, uint32_t dw_num, uint32_t clear_value)
+void GraphicsRenderClearGds(CommandBuffer* buffer, uint64_t dw_offset, uint32_t dw_num, uint32_t clear_value)
 {
 	EXIT_IF(g_render_ctx == nullptr);
 	EXIT_IF(g_render_ctx->GetGdsBuffer() == nullptr);
+	EXIT_IF(buffer == nullptr);
+	EXIT_IF(buffer->IsInvalid());
 
-	g_render_ctx->GetGdsBuffer()->Clear(g_render_ctx->GetGraphicCtx(), dw_offset, dw_num, clear_value);
-}
-
-void GraphicsRenderReadGds(uint32_t* dst, uint32_t dw_offset, uint32_t dw_size)
-{
-	EXIT_IF(g_render_ctx == nullptr);
-	EXIT_IF(g_render_ctx->GetGdsBuffer() == nullptr);
+	Core::LockGuard lock(g_render_ctx->GetMutex());
 
-	g_render_ctx->GetGdsBuffer()->Read(g_render_ctx->GetGraphicCtx(), dst, dw_offset, dw_size);
+	g_render_ctx->GetGdsBuffer()->Clear(g_render_ctx->GetGraphicCtx(), buffer, dw_offset, dw_num, clear_value);
 }
 
 void GraphicsRenderMemoryFree(uint64_t vaddr, uint64_t size)
@@ -5418,14 +7528,23 @@ void CommandBuffer::Allocate()
 	{
 		if (!m_pool->busy[i])
 		{
-			m_pool->busy[i] = true;
-			vkResetCommandBuffer(m_pool->buffers[i], VK_COMMAND_BUFFER_RESET_RELEASE_RESOURCES_BIT);
-			m_index = i;
+			m_pool->busy[i]      = true;
+			m_pool->waits[i].num = 0;
+			m_index              = i;
+			m_draw_state  = DrawState();
+			m_render_pass = OpenRenderPass();
 			break;
 		}
 	}
 
 	EXIT_NOT_IMPLEMENTED(IsInvalid());
+	EXIT_IF(m_barriers != nullptr);
+	EXIT_IF(m_uniforms != nullptr);
+	EXIT_IF(m_queries != nullptr);
+
+	m_barriers = new CommandBufferBarriers;
+	m_uniforms = new CommandBufferUniforms;
+	m_queries  = GpuProfilerAcquire(g_render_ctx->GetGraphicCtx(), m_queue);
 }
 
 void CommandBuffer::Free()
@@ -5437,9 +7556,20 @@ void CommandBuffer::Free()
 	WaitForFence();
 
 	m_pool->busy[m_index] = false;
-	vkResetCommandBuffer(m_pool->buffers[m_index], VK_COMMAND_BUFFER_RESET_RELEASE_RESOURCES_BIT);
+	vkResetCommandPool(g_render_ctx->GetGraphicCtx()->device, m_pool->pools[m_index], 0);
 	m_index = static_cast<uint32_t>(-1);
 
+	delete m_barriers;
+	m_barriers = nullptr;
+
+	// Either completed or never submitted
+	g_render_ctx->GetUniformBufferPool()->Release(m_uniforms);
+	delete m_uniforms;
+	m_uniforms = nullptr;
+
+	GpuProfilerRelease(m_queries);
+	m_queries = nullptr;
+
 	EXIT_NOT_IMPLEMENTED(!IsInvalid());
 }
 
@@ -5458,14 +7588,20 @@ void CommandBuffer::Begin() const
 	auto result = vkBeginCommandBuffer(buffer, &begin_info);
 
 	EXIT_NOT_IMPLEMENTED(result != VK_SUCCESS);
+
+	GpuProfilerBegin(m_queries, buffer);
 }
 
-void CommandBuffer::End() const
+void CommandBuffer::End()
 {
 	EXIT_IF(IsInvalid());
 
+	FlushBarriers();
+
 	auto* buffer = m_pool->buffers[m_index];
 
+	GpuProfilerEnd(m_queries, buffer);
+
 	auto result = vkEndCommandBuffer(buffer);
 
 	EXIT_NOT_IMPLEMENTED(result != VK_SUCCESS);
@@ -5474,79 +7610,60 @@ void CommandBuffer::End() const
 void CommandBuffer::Execute()
 {
 	EXIT_IF(IsInvalid());
-
-	auto* buffer = m_pool->buffers[m_index];
-	auto* fence  = m_pool->fences[m_index];
-
-	VkSubmitInfo submit_info {};
-	submit_info.sType                = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-	submit_info.pNext                = nullptr;
-	submit_info.waitSemaphoreCount   = 0;
-	submit_info.pWaitSemaphores      = nullptr;
-	submit_info.pWaitDstStageMask    = nullptr;
-	submit_info.commandBufferCount   = 1;
-	submit_info.pCommandBuffers      = &buffer;
-	submit_info.signalSemaphoreCount = 0;
-	submit_info.pSignalSemaphores    = nullptr;
-
 	EXIT_IF(m_queue < 0 || m_queue >= GraphicContext::QUEUES_NUM);
 
-	const auto& queue = g_render_ctx->GetGraphicCtx()->queues[m_queue];
+	auto& waits = m_pool->waits[m_index];
 
-	if (queue.mutex != nullptr)
-	{
-		queue.mutex->Lock();
-	}
+	UtilAddUploadWaits(&waits);
 
-	auto result = vkQueueSubmit(queue.vk_queue, 1, &submit_info, fence);
+	QueueSubmit submit;
+	submit.buffer               = m_pool->buffers[m_index];
+	submit.signal_semaphores[0] = m_pool->timelines[m_index];
+	submit.signal_values[0]     = ++m_pool->timeline_values[m_index];
+	submit.signal_num           = 1;
+	submit.waits                = waits;
 
-	if (queue.mutex != nullptr)
-	{
-		queue.mutex->Unlock();
-	}
+	g_render_ctx->GetQueueSubmitter(m_queue)->Submit(m_queue, submit);
 
+	waits.num = 0;
 	m_execute = true;
 
-	EXIT_NOT_IMPLEMENTED(result != VK_SUCCESS);
+	GpuProfilerSubmit(m_queries);
 }
 
 void CommandBuffer::ExecuteWithSemaphore()
 {
 	EXIT_IF(IsInvalid());
-
-	auto* buffer = m_pool->buffers[m_index];
-	auto* fence  = m_pool->fences[m_index];
-
-	VkSubmitInfo submit_info {};
-	submit_info.sType                = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-	submit_info.pNext                = nullptr;
-	submit_info.waitSemaphoreCount   = 0;
-	submit_info.pWaitSemaphores      = nullptr;
-	submit_info.pWaitDstStageMask    = nullptr;
-	submit_info.commandBufferCount   = 1;
-	submit_info.pCommandBuffers      = &buffer;
-	submit_info.signalSemaphoreCount = 1;
-	submit_info.pSignalSemaphores    = &m_pool->semaphores[m_index];
-
 	EXIT_IF(m_queue < 0 || m_queue >= GraphicContext::QUEUES_NUM);
 
-	const auto& queue = g_render_ctx->GetGraphicCtx()->queues[m_queue];
-
-	if (queue.mutex != nullptr)
-	{
-		queue.mutex->Lock();
-	}
+	EXIT_NOT_IMPLEMENTED(m_pool->waits[m_index].num != 0);
 
-	auto result = vkQueueSubmit(queue.vk_queue, 1, &submit_info, fence);
+	QueueSubmit submit;
+	submit.buffer               = m_pool->buffers[m_index];
+	submit.signal_semaphores[0] = m_pool->semaphores[m_index];
+	submit.signal_semaphores[1] = m_pool->timelines[m_index];
+	submit.signal_values[1]     = ++m_pool->timeline_values[m_index];
+	submit.signal_num           = 2;
 
-	if (queue.mutex != nullptr)
-	{
-		queue.mutex->Lock();
-	}
+	g_render_ctx->GetQueueSubmitter(m_queue)->SubmitNow(m_queue, submit);
 
 	m_execute = true;
 
-	EXIT_NOT_IMPLEMENTED(result != VK_SUCCESS);
+	GpuProfilerSubmit(m_queries);
+}
+
+// The timeline semaphore of the buffer reaches the value of its last submit
+static void wait_for_timeline(VulkanCommandPool* pool, uint32_t index)
+{
+	VkSemaphoreWaitInfo wait_info {};
+	wait_info.sType          = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+	wait_info.pNext          = nullptr;
+	wait_info.flags          = 0;
+	wait_info.semaphoreCount = 1;
+	wait_info.pSemaphores    = &pool->timelines[index];
+	wait_info.pValues        = &pool->timeline_values[index];
+
+	vkWaitSemaphores(g_render_ctx->GetGraphicCtx()->device, &wait_info, UINT64_MAX);
 }
 
 void CommandBuffer::WaitForFence()
@@ -5555,10 +7672,10 @@ void CommandBuffer::WaitForFence()
 
 	if (m_execute)
 	{
-		auto* device = g_render_ctx->GetGraphicCtx()->device;
+		wait_for_timeline(m_pool, m_index);
 
-		vkWaitForFences(device, 1, &m_pool->fences[m_index], VK_TRUE, UINT64_MAX);
-		vkResetFences(device, 1, &m_pool->fences[m_index]);
+		GpuProfilerCollect(g_render_ctx->GetGraphicCtx(), m_queries);
+		g_render_ctx->GetUniformBufferPool()->Release(m_uniforms);
 
 		m_execute = false;
 	}
@@ -5570,17 +7687,21 @@ void CommandBuffer::WaitForFenceAndReset()
 
 	if (m_execute)
 	{
-		auto* device = g_render_ctx->GetGraphicCtx()->device;
+		wait_for_timeline(m_pool, m_index);
 
-		vkWaitForFences(device, 1, &m_pool->fences[m_index], VK_TRUE, UINT64_MAX);
-		vkResetFences(device, 1, &m_pool->fences[m_index]);
-		vkResetCommandBuffer(m_pool->buffers[m_index], VK_COMMAND_BUFFER_RESET_RELEASE_RESOURCES_BIT);
+		vkResetCommandPool(g_render_ctx->GetGraphicCtx()->device, m_pool->pools[m_index], 0);
 
-		m_execute = false;
+		GpuProfilerCollect(g_render_ctx->GetGraphicCtx(), m_queries);
+		g_render_ctx->GetUniformBufferPool()->Release(m_uniforms);
+
+		m_execute     = false;
+		m_draw_state  = DrawState();
+		m_render_pass = OpenRenderPass();
+		m_barriers->Reset();
 	}
 }
 
-void CommandBuffer::BeginRenderPass(VulkanFramebuffer* framebuffer, RenderColorInfo* color, RenderDepthInfo* depth) const
+void CommandBuffer::BeginRenderPass(VulkanFramebuffer* framebuffer, RenderColorInfo* color, RenderDepthInfo* depth)
 {
 	EXIT_IF(IsInvalid());
 
@@ -5593,8 +7714,20 @@ void CommandBuffer::BeginRenderPass(VulkanFramebuffer* framebuffer, RenderColorI
 
 	EXIT_NOT_IMPLEMENTED(!with_depth && !with_color);
 
+	// Render pass which clears a target has to be started again, the clear is a part of the draw
+	bool can_merge  = !(with_depth && (depth->depth_clear_enable || depth->stencil_clear_enable)) && !(with_color && color->clear_enable);
+	auto generation = g_render_ctx->GetFramebufferCache()->GetGeneration();
+
+	if (m_render_pass.open && m_render_pass.can_merge && can_merge && m_render_pass.framebuffer == framebuffer &&
+	    m_render_pass.generation == generation && !m_barriers->IsPending())
+	{
+		return;
+	}
+
+	BreakRenderPass();
+
 	VkClearValue clears[2];
-	clears[0].color        = {{0.0f, 0.0f, 0.0f, 1.0f}};
+	clears[0].color        = (with_color && color->clear_enable ? color->clear_value : VkClearColorValue {{0.0f, 0.0f, 0.0f, 1.0f}});
 	clears[1].depthStencil = {depth->depth_clear_value, depth->stencil_clear_value};
 
 	VkExtent2D extent = (with_color ? color->vulkan_buffer->extent : depth->vulkan_buffer->extent);
@@ -5611,64 +7744,101 @@ void CommandBuffer::BeginRenderPass(VulkanFramebuffer* framebuffer, RenderColorI
 
 	if (with_color && color->vulkan_buffer->layout != VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL)
 	{
-		VkImageMemoryBarrier image_memory_barrier {};
-		image_memory_barrier.sType                           = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-		image_memory_barrier.pNext                           = nullptr;
-		image_memory_barrier.srcAccessMask                   = VK_ACCESS_MEMORY_READ_BIT;
-		image_memory_barrier.dstAccessMask                   = VK_ACCESS_MEMORY_WRITE_BIT;
-		image_memory_barrier.oldLayout                       = color->vulkan_buffer->layout;
-		image_memory_barrier.newLayout                       = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
-		image_memory_barrier.srcQueueFamilyIndex             = VK_QUEUE_FAMILY_IGNORED;
-		image_memory_barrier.dstQueueFamilyIndex             = VK_QUEUE_FAMILY_IGNORED;
-		image_memory_barrier.image                           = color->vulkan_buffer->image;
-		image_memory_barrier.subresourceRange.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT;
-		image_memory_barrier.subresourceRange.baseMipLevel   = 0;
-		image_memory_barrier.subresourceRange.levelCount     = VK_REMAINING_MIP_LEVELS;
-		image_memory_barrier.subresourceRange.baseArrayLayer = 0;
-		image_memory_barrier.subresourceRange.layerCount     = 1;
-
-		vkCmdPipelineBarrier(buffer, VK_PIPELINE_STAGE_ALL_GRAPHICS_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
-		                     VK_PIPELINE_STAGE_ALL_GRAPHICS_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1,
-		                     &image_memory_barrier);
-
-		color->vulkan_buffer->layout = image_memory_barrier.newLayout;
+		m_barriers->AddImageBarrier(color->vulkan_buffer, VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
 	}
 
 	if (with_depth && depth->vulkan_buffer->layout != VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL)
 	{
-		VkImageMemoryBarrier image_memory_barrier {};
-		image_memory_barrier.sType                           = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-		image_memory_barrier.pNext                           = nullptr;
-		image_memory_barrier.srcAccessMask                   = VK_ACCESS_MEMORY_READ_BIT;
-		image_memory_barrier.dstAccessMask                   = VK_ACCESS_MEMORY_WRITE_BIT;
-		image_memory_barrier.oldLayout                       = depth->vulkan_buffer->layout;
-		image_memory_barrier.newLayout                       = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
-		image_memory_barrier.srcQueueFamilyIndex             = VK_QUEUE_FAMILY_IGNORED;
-		image_memory_barrier.dstQueueFamilyIndex             = VK_QUEUE_FAMILY_IGNORED;
-		image_memory_barrier.image                           = depth->vulkan_buffer->image;
-		image_memory_barrier.subresourceRange.aspectMask     = VK_IMAGE_ASPECT_DEPTH_BIT;
-		image_memory_barrier.subresourceRange.baseMipLevel   = 0;
-		image_memory_barrier.subresourceRange.levelCount     = VK_REMAINING_MIP_LEVELS;
-		image_memory_barrier.subresourceRange.baseArrayLayer = 0;
-		image_memory_barrier.subresourceRange.layerCount     = 1;
+		m_barriers->AddImageBarrier(depth->vulkan_buffer, VK_IMAGE_ASPECT_DEPTH_BIT, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL);
+	}
+
+	FlushBarriers();
+
+	vkCmdBeginRenderPass(buffer, &render_pass_info, VK_SUBPASS_CONTENTS_INLINE);
+
+	GpuProfilerBeginScope(m_queries, buffer, "render_pass", "RenderPass");
+
+	m_render_pass.open        = true;
+	m_render_pass.can_merge   = can_merge;
+	m_render_pass.framebuffer = framebuffer;
+	m_render_pass.generation  = generation;
+}
 
-		vkCmdPipelineBarrier(buffer, VK_PIPELINE_STAGE_ALL_GRAPHICS_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
-		                     VK_PIPELINE_STAGE_ALL_GRAPHICS_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1,
-		                     &image_memory_barrier);
+void CommandBuffer::EndRenderPass()
+{
+	EXIT_IF(IsInvalid());
 
-		depth->vulkan_buffer->layout = image_memory_barrier.newLayout;
+	m_barriers->AddWrite(VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT |
+	                         VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT |
+	                         VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+	                     VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT);
+
+	if (!m_render_pass.can_merge)
+	{
+		BreakRenderPass();
 	}
+}
 
-	vkCmdBeginRenderPass(buffer, &render_pass_info, VK_SUBPASS_CONTENTS_INLINE);
+void CommandBuffer::BeginProfilerScope(const char* category, const char* name)
+{
+	EXIT_IF(IsInvalid());
+
+	GpuProfilerBeginScope(m_queries, m_pool->buffers[m_index], category, name);
+}
+
+void CommandBuffer::EndProfilerScope()
+{
+	EXIT_IF(IsInvalid());
+
+	GpuProfilerEndScope(m_queries, m_pool->buffers[m_index]);
+}
+
+void CommandBuffer::BreakRenderPass()
+{
+	EXIT_IF(IsInvalid());
+
+	if (m_render_pass.open)
+	{
+		auto* buffer = m_pool->buffers[m_index];
+
+		GpuProfilerEndScope(m_queries, buffer);
+
+		vkCmdEndRenderPass(buffer);
+
+		m_render_pass = OpenRenderPass();
+	}
 }
 
-void CommandBuffer::EndRenderPass() const
+// Also called before the commands which can't be recorded inside a render pass
+void CommandBuffer::FlushBarriers()
 {
 	EXIT_IF(IsInvalid());
+	EXIT_IF(m_barriers == nullptr);
+
+	BreakRenderPass();
+
+	if (!m_barriers->IsPending())
+	{
+		return;
+	}
 
 	auto* buffer = m_pool->buffers[m_index];
 
-	vkCmdEndRenderPass(buffer);
+	VkMemoryBarrier mem_barrier {};
+	mem_barrier.sType         = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	mem_barrier.pNext         = nullptr;
+	mem_barrier.srcAccessMask = m_barriers->src_access;
+	mem_barrier.dstAccessMask = m_barriers->dst_access;
+
+	vkCmdPipelineBarrier(buffer, m_barriers->src_stages, m_barriers->dst_stages, 0, (m_barriers->memory ? 1 : 0), &mem_barrier, 0, nullptr,
+	                     m_barriers->images.Size(), m_barriers->images.GetDataConst());
+
+	m_barriers->src_stages = 0;
+	m_barriers->dst_stages = 0;
+	m_barriers->src_access = 0;
+	m_barriers->dst_access = 0;
+	m_barriers->memory     = false;
+	m_barriers->images.Clear();
 }
 
 } // namespace Kyty::Libs::Graphics
@@ -7,17 +7,22 @@
 
 #include "Emulator/Config.h"
 #include "Emulator/Graphics/AsyncJob.h"
+#include "Emulator/Graphics/Capture.h"
 #include "Emulator/Graphics/GraphicContext.h"
 #include "Emulator/Graphics/Graphics.h"
 #include "Emulator/Graphics/GraphicsRender.h"
 #include "Emulator/Graphics/HardwareContext.h"
 #include "Emulator/Graphics/Objects/GpuMemory.h"
 #include "Emulator/Graphics/Pm4.h"
+#include "Emulator/Graphics/Shader.h"
 #include "Emulator/Graphics/VideoOut.h"
 #include "Emulator/Graphics/Window.h"
+#include "Emulator/Kernel/Pthread.h"
 #include "Emulator/Profiler.h"
 
+#include <algorithm>
 #include <atomic>
+#include <immintrin.h>
 
 #ifdef KYTY_EMU_ENABLED
 
@@ -131,13 +136,27 @@ public:
 	void                   SetSumbitId(uint64_t sumbit_id) { m_sumbit_id = sumbit_id; }
 
 private:
-	static constexpr int VK_BUFFERS_NUM = 4;
+	// Large submissions are split between draws, so the GPU starts on the first part while the rest is recorded
+	void BufferSplit();
 
+	// Upper bound for the number of submissions in flight plus the buffer being recorded
+	static constexpr int VK_BUFFERS_MAX = 8;
+
+	// The value is read without a lock. A waiter spins for a while, then sleeps on the condition variable, and the mutex is taken
+	// by a change of the value only if somebody sleeps.
 	struct Counter
 	{
-		Core::Mutex   mutex;
-		Core::CondVar cond_var;
-		uint32_t      value = 0;
+		static constexpr uint32_t SPIN_COUNT = 100;
+
+		template <class Pred>
+		void Wait(Pred&& pred);
+		void Set(uint32_t v);
+		void Increment();
+
+		std::atomic_uint32_t value   = 0;
+		std::atomic_uint32_t waiters = 0;
+		Core::Mutex          mutex;
+		Core::CondVar        cond_var;
 	};
 
 	HW::Context      m_ctx;
@@ -150,8 +169,10 @@ private:
 	Core::Mutex m_mutex;
 	Core::Mutex m_run_mutex;
 
-	CommandBuffer* m_buffer[VK_BUFFERS_NUM] = {};
+	CommandBuffer* m_buffer[VK_BUFFERS_MAX] = {};
+	int            m_buffers_num            = 0;
 	int            m_current_buffer         = -1;
+	uint32_t       m_buffer_commands        = 0;
 	int            m_queue                  = -1;
 
 	Counter m_de_counter;
@@ -166,7 +187,11 @@ private:
 class GraphicsRing
 {
 public:
-	GraphicsRing(): m_job1("Thread_Gfx_Draw"), m_job2("Thread_Gfx_Const") { EXIT_NOT_IMPLEMENTED(!Core::Thread::IsMainThread()); }
+	GraphicsRing(): m_job1("Thread_Gfx_Draw"), m_job2("Thread_Gfx_Const")
+	{
+		EXIT_NOT_IMPLEMENTED(!Core::Thread::IsMainThread());
+		m_job1.Execute([](void* /*unused*/) { LibKernel::PthreadSetEmulatorThreadAffinity(LibKernel::EmulatorThread::GfxDraw); });
+	}
 	virtual ~GraphicsRing() { KYTY_NOT_IMPLEMENTED; }
 
 	KYTY_CLASS_NO_COPY(GraphicsRing);
@@ -478,6 +503,15 @@ void Gpu::Wait()
 			cp->BufferWait();
 		}
 	}
+
+	GraphicsRenderWriteBackPending(m_gfx_cp);
+	for (auto& cp: m_compute_cp)
+	{
+		if (cp != nullptr)
+		{
+			GraphicsRenderWriteBackPending(cp);
+		}
+	}
 }
 
 void Gpu::Init()
@@ -539,8 +573,13 @@ void CommandProcessor::BufferInit()
 
 	if (m_current_buffer < 0)
 	{
-		for (auto& buf: m_buffer)
+		// While one buffer is recorded the others may still execute on the GPU, BufferFlush() only blocks when all of them are in flight
+		m_buffers_num = std::clamp(static_cast<int>(Config::GetGpuFramesInFlight()) + 1, 2, VK_BUFFERS_MAX);
+
+		for (int i = 0; i < m_buffers_num; i++)
 		{
+			auto*& buf = m_buffer[i];
+
 			EXIT_IF(buf != nullptr);
 
 			buf = new CommandBuffer(m_queue);
@@ -557,13 +596,14 @@ void CommandProcessor::BufferFlush()
 {
 	Core::LockGuard lock(m_mutex);
 
-	EXIT_IF(m_current_buffer < 0 || m_current_buffer >= VK_BUFFERS_NUM);
+	EXIT_IF(m_current_buffer < 0 || m_current_buffer >= m_buffers_num);
 	EXIT_IF(m_buffer[m_current_buffer] == nullptr);
 
 	m_buffer[m_current_buffer]->End();
 	m_buffer[m_current_buffer]->Execute();
 
-	m_current_buffer = (m_current_buffer + 1) % VK_BUFFERS_NUM;
+	m_current_buffer  = (m_current_buffer + 1) % m_buffers_num;
+	m_buffer_commands = 0;
 
 	EXIT_IF(m_buffer[m_current_buffer] == nullptr);
 
@@ -571,58 +611,97 @@ void CommandProcessor::BufferFlush()
 	m_buffer[m_current_buffer]->Begin();
 }
 
+void CommandProcessor::BufferSplit()
+{
+	Core::LockGuard lock(m_mutex);
+
+	uint32_t split = Config::GetCommandBufferSplitDraws();
+
+	if (split != 0 && ++m_buffer_commands >= split)
+	{
+		BufferFlush();
+	}
+}
+
 void CommandProcessor::BufferWait()
 {
 	BufferInit();
 
 	Core::LockGuard lock(m_mutex);
 
-	for (auto& buf: m_buffer)
+	for (int i = 0; i < m_buffers_num; i++)
 	{
+		auto* buf = m_buffer[i];
+
 		EXIT_IF(buf == nullptr);
 
 		buf->WaitForFenceAndReset();
 	}
 }
 
-void CommandProcessor::ResetDeCe()
+template <class Pred>
+void CommandProcessor::Counter::Wait(Pred&& pred)
 {
-	m_de_counter.mutex.Lock();
-	m_de_counter.value = 0;
-	m_de_counter.cond_var.Signal();
-	m_de_counter.mutex.Unlock();
-	m_ce_counter.mutex.Lock();
-	m_ce_counter.value = 0;
-	m_ce_counter.cond_var.Signal();
-	m_ce_counter.mutex.Unlock();
+	for (uint32_t i = 0; i < SPIN_COUNT; i++)
+	{
+		if (pred(value.load(std::memory_order_acquire)))
+		{
+			return;
+		}
+		_mm_pause();
+	}
+
+	Core::LockGuard lock(mutex);
+
+	// Seen by a change of the value made after this, or the change is seen here
+	waiters++;
+	while (!pred(value.load()))
+	{
+		cond_var.Wait(&mutex);
+	}
+	waiters--;
 }
 
-void CommandProcessor::WaitCe()
+void CommandProcessor::Counter::Set(uint32_t v)
 {
-	m_de_counter.mutex.Lock();
-	auto de_value = m_de_counter.value;
-	m_de_counter.mutex.Unlock();
+	value.store(v);
 
-	m_ce_counter.mutex.Lock();
-	while (!(m_ce_counter.value > de_value))
+	if (waiters.load() != 0)
 	{
-		m_ce_counter.cond_var.Wait(&m_ce_counter.mutex);
+		Core::LockGuard lock(mutex);
+		cond_var.SignalAll();
 	}
-	m_ce_counter.mutex.Unlock();
 }
 
-void CommandProcessor::WaitDeDiff(uint32_t diff)
+void CommandProcessor::Counter::Increment()
 {
-	m_ce_counter.mutex.Lock();
-	auto ce_value = m_ce_counter.value;
-	m_ce_counter.mutex.Unlock();
+	value++;
 
-	m_de_counter.mutex.Lock();
-	while (!(ce_value - m_de_counter.value < diff))
+	if (waiters.load() != 0)
 	{
-		m_de_counter.cond_var.Wait(&m_de_counter.mutex);
+		Core::LockGuard lock(mutex);
+		cond_var.SignalAll();
 	}
-	m_de_counter.mutex.Unlock();
+}
+
+void CommandProcessor::ResetDeCe()
+{
+	m_de_counter.Set(0);
+	m_ce_counter.Set(0);
+}
+
+void CommandProcessor::WaitCe()
+{
+	auto de_value = m_de_counter.value.load(std::memory_order_acquire);
+
+	m_ce_counter.Wait([de_value](uint32_t ce_value) { return ce_value > de_value; });
+}
+
+void CommandProcessor::WaitDeDiff(uint32_t diff)
+{
+	auto ce_value = m_ce_counter.value.load(std::memory_order_acquire);
+
+	m_de_counter.Wait([ce_value, diff](uint32_t de_value) { return ce_value - de_value < diff; });
 }
 
 void CommandProcessor::IncremenetDe()
@@ -630,18 +709,12 @@ void CommandProcessor::IncremenetDe()
 	BufferFlush();
 	BufferWait();
 
-	m_de_counter.mutex.Lock();
-	m_de_counter.value++;
-	m_de_counter.cond_var.Signal();
-	m_de_counter.mutex.Unlock();
+	m_de_counter.Increment();
 }
 
 void CommandProcessor::IncremenetCe()
 {
-	m_ce_counter.mutex.Lock();
-	m_ce_counter.value++;
-	m_ce_counter.cond_var.Signal();
-	m_ce_counter.mutex.Unlock();
+	m_ce_counter.Increment();
 }
 
 void CommandProcessor::WriteConstRam(uint32_t offset, const uint32_t* src, uint32_t dw_num)
@@ -655,11 +728,23 @@ void CommandProcessor::DumpConstRam(uint32_t* dst, uint32_t offset, uint32_t dw_
 {
 	Core::LockGuard lock(m_mutex);
 
-	GpuMemoryCheckAccessViolation(reinterpret_cast<uint64_t>(dst), static_cast<size_t>(dw_num) * 4);
+	const auto* src  = m_const_ram + offset / 4;
+	auto        size = static_cast<size_t>(dw_num) * 4;
 
-	memcpy(dst, m_const_ram + offset / 4, static_cast<size_t>(dw_num) * 4);
+	GpuMemoryCheckAccessViolation(reinterpret_cast<uint64_t>(dst), size);
 
-	GraphicsRenderMemoryFlush(reinterpret_cast<uint64_t>(dst), static_cast<size_t>(dw_num) * 4);
+	// The same constants are often dumped to the same place draw after draw. If the memory already holds them, the GPU objects
+	// and descriptors built from it stay valid.
+	if (memcmp(dst, src, size) == 0)
+	{
+		return;
+	}
+
+	memcpy(dst, src, size);
+
+	GraphicsRenderMemoryFlush(reinterpret_cast<uint64_t>(dst), size);
+
+	m_sh_ctx.MarkDirty(HW::Shader::DIRTY_USER_DATA);
 }
 
 void CommandProcessor::WaitRegMem32(uint32_t func, const uint32_t* addr, uint32_t ref, uint32_t mask, uint32_t poll)
@@ -700,6 +785,8 @@ void CommandProcessor::WriteData(uint32_t* dst, const uint32_t* src, uint32_t dw
 	memcpy(dst, src, static_cast<size_t>(dw_num) * 4);
 
 	GraphicsRenderMemoryFlush(reinterpret_cast<uint64_t>(dst), static_cast<size_t>(dw_num) * 4);
+
+	m_sh_ctx.MarkDirty(HW::Shader::DIRTY_USER_DATA);
 }
 
 void GraphicsRing::Submit(uint32_t* cmd_draw_buffer, uint32_t num_draw_dw, uint32_t* cmd_const_buffer, uint32_t num_const_dw, int handle,
@@ -837,6 +924,8 @@ void ComputeRing::ThreadRun(void* data)
 
 	KYTY_PROFILER_THREAD("Thread_Compute");
 
+	LibKernel::PthreadSetEmulatorThreadAffinity(LibKernel::EmulatorThread::Compute);
+
 	ring->m_mutex.Lock();
 
 	for (;;)
@@ -1052,43 +1141,56 @@ void CommandProcessor::DrawIndex(uint32_t index_count, const void* index_addr, u
 {
 	Core::LockGuard lock(m_mutex);
 
-	EXIT_IF(m_current_buffer < 0 || m_current_buffer >= VK_BUFFERS_NUM);
+	EXIT_IF(m_current_buffer < 0 || m_current_buffer >= m_buffers_num);
 
 	GraphicsRenderDrawIndex(m_sumbit_id, m_buffer[m_current_buffer], &m_ctx, &m_ucfg, &m_sh_ctx, m_index_type_and_size, index_count,
 	                        index_addr, flags, type);
+
+	BufferSplit();
 }
 
 void CommandProcessor::DispatchDirect(uint32_t thread_group_x, uint32_t thread_group_y, uint32_t thread_group_z, uint32_t mode)
 {
 	Core::LockGuard lock(m_mutex);
 
-	EXIT_IF(m_current_buffer < 0 || m_current_buffer >= VK_BUFFERS_NUM);
+	EXIT_IF(m_current_buffer < 0 || m_current_buffer >= m_buffers_num);
 
 	GraphicsRenderDispatchDirect(m_sumbit_id, m_buffer[m_current_buffer], &m_ctx, &m_sh_ctx, thread_group_x, thread_group_y, thread_group_z,
 	                             mode);
+
+	BufferSplit();
 }
 
 void CommandProcessor::DrawIndexAuto(uint32_t index_count, uint32_t flags)
 {
 	Core::LockGuard lock(m_mutex);
 
-	EXIT_IF(m_current_buffer < 0 || m_current_buffer >= VK_BUFFERS_NUM);
+	EXIT_IF(m_current_buffer < 0 || m_current_buffer >= m_buffers_num);
 
 	GraphicsRenderDrawIndexAuto(m_sumbit_id, m_buffer[m_current_buffer], &m_ctx, &m_ucfg, &m_sh_ctx, index_count, flags);
+
+	BufferSplit();
 }
 
 void CommandProcessor::ClearGds(uint64_t dw_offset, uint32_t dw_num, uint32_t clear_value)
 {
 	Core::LockGuard lock(m_mutex);
 
-	GraphicsRenderClearGds(dw_offset, dw_num, clear_value);
+	EXIT_IF(m_current_buffer < 0 || m_current_buffer >= m_buffers_num);
+
+	GraphicsRenderClearGds(m_buffer[m_current_buffer], dw_offset, dw_num, clear_value);
 }
 
 void CommandProcessor::ReadGds(uint32_t* dst, uint32_t dw_offset, uint32_t dw_size)
 {
 	Core::LockGuard lock(m_mutex);
 
-	GraphicsRenderReadGds(dst, dw_offset, dw_size);
+	EXIT_IF(m_current_buffer < 0 || m_current_buffer >= m_buffers_num);
+
+	// The counters are copied to the guest memory once the GPU has executed the commands recorded before, nothing waits for it here
+	GraphicsRenderWriteAtEndOfPipeGds32(m_sumbit_id, m_buffer[m_current_buffer], dst, dw_offset, dw_size);
+
+	m_sh_ctx.MarkDirty(HW::Shader::DIRTY_USER_DATA);
 }
 
 void CommandProcessor::WaitFlipDone(uint32_t video_out_handle, uint32_t display_buffer_index)
@@ -1104,7 +1206,7 @@ void CommandProcessor::WriteAtEndOfPipe32(uint32_t cache_policy, uint32_t event_
 {
 	Core::LockGuard lock(m_mutex);
 
-	EXIT_IF(m_current_buffer < 0 || m_current_buffer >= VK_BUFFERS_NUM);
+	EXIT_IF(m_current_buffer < 0 || m_current_buffer >= m_buffers_num);
 
 	printf("CommandProcessor::WriteAtEndOfPipe32()\n");
 	printf("\t cache_policy        = 0x%08" PRIx32 "\n", cache_policy);
@@ -1140,7 +1242,7 @@ void CommandProcessor::WriteAtEndOfPipe64(uint32_t cache_policy, uint32_t event_
 {
 	Core::LockGuard lock(m_mutex);
 
-	EXIT_IF(m_current_buffer < 0 || m_current_buffer >= VK_BUFFERS_NUM);
+	EXIT_IF(m_current_buffer < 0 || m_current_buffer >= m_buffers_num);
 
 	printf("CommandProcessor::WriteAtEndOfPipe64()\n");
 	printf("\t cache_policy        = 0x%08" PRIx32 "\n", cache_policy);
@@ -1205,16 +1307,19 @@ void CommandProcessor::MemoryBarrier()
 {
 	Core::LockGuard lock(m_mutex);
 
-	EXIT_IF(m_current_buffer < 0 || m_current_buffer >= VK_BUFFERS_NUM);
+	EXIT_IF(m_current_buffer < 0 || m_current_buffer >= m_buffers_num);
 
 	GraphicsRenderMemoryBarrier(m_buffer[m_current_buffer]);
+
+	// Shaders may have written the memory the user data points to
+	m_sh_ctx.MarkDirty(HW::Shader::DIRTY_USER_DATA);
 }
 
 void CommandProcessor::RenderTextureBarrier(uint64_t vaddr, uint64_t size)
 {
 	Core::LockGuard lock(m_mutex);
 
-	EXIT_IF(m_current_buffer < 0 || m_current_buffer >= VK_BUFFERS_NUM);
+	EXIT_IF(m_current_buffer < 0 || m_current_buffer >= m_buffers_num);
 
 	GraphicsRenderRenderTextureBarrier(m_buffer[m_current_buffer], vaddr, size);
 }
@@ -1223,7 +1328,7 @@ void CommandProcessor::DepthStencilBarrier(uint64_t vaddr, uint64_t size)
 {
 	Core::LockGuard lock(m_mutex);
 
-	EXIT_IF(m_current_buffer < 0 || m_current_buffer >= VK_BUFFERS_NUM);
+	EXIT_IF(m_current_buffer < 0 || m_current_buffer >= m_buffers_num);
 
 	GraphicsRenderDepthStencilBarrier(m_buffer[m_current_buffer], vaddr, size);
 }
@@ -1257,10 +1362,15 @@ void CommandProcessor::Flip()
 {
 	Core::LockGuard lock(m_mutex);
 
-	EXIT_IF(m_current_buffer < 0 || m_current_buffer >= VK_BUFFERS_NUM);
+	EXIT_IF(m_current_buffer < 0 || m_current_buffer >= m_buffers_num);
 
 	printf("CommandProcessor::Flip()\n");
 
+	if (m_flip.handle == GRAPHICS_RUN_FLIP_HANDLE_NONE)
+	{
+		return;
+	}
+
 	GraphicsRenderWriteAtEndOfPipeOnlyFlip(m_sumbit_id, m_buffer[m_current_buffer], m_flip.handle, m_flip.index, m_flip.flip_mode,
 	                                       m_flip.flip_arg);
 }
@@ -1269,12 +1379,18 @@ void CommandProcessor::Flip(void* dst_gpu_addr, uint32_t value)
 {
 	Core::LockGuard lock(m_mutex);
 
-	EXIT_IF(m_current_buffer < 0 || m_current_buffer >= VK_BUFFERS_NUM);
+	EXIT_IF(m_current_buffer < 0 || m_current_buffer >= m_buffers_num);
 
 	printf("CommandProcessor::Flip()\n");
 	printf("\t dst_gpu_addr = 0x%016" PRIx64 "\n", reinterpret_cast<uint64_t>(dst_gpu_addr));
 	printf("\t value        = 0x%08" PRIx32 "\n", value);
 
+	if (m_flip.handle == GRAPHICS_RUN_FLIP_HANDLE_NONE)
+	{
+		GraphicsRenderWriteAtEndOfPipe32(m_sumbit_id, m_buffer[m_current_buffer], static_cast<uint32_t*>(dst_gpu_addr), value);
+		return;
+	}
+
 	GraphicsRenderWriteAtEndOfPipeWithFlip32(m_sumbit_id, m_buffer[m_current_buffer], static_cast<uint32_t*>(dst_gpu_addr), value,
 	                                         m_flip.handle, m_flip.index, m_flip.flip_mode, m_flip.flip_arg);
 }
@@ -1283,7 +1399,7 @@ void CommandProcessor::FlipWithInterrupt(uint32_t eop_event_type, uint32_t cache
 {
 	Core::LockGuard lock(m_mutex);
 
-	EXIT_IF(m_current_buffer < 0 || m_current_buffer >= VK_BUFFERS_NUM);
+	EXIT_IF(m_current_buffer < 0 || m_current_buffer >= m_buffers_num);
 
 	printf("CommandProcessor::FlipWithInterrupt()\n");
 	printf("\t eop_event_type      = 0x%08" PRIx32 "\n", eop_event_type);
@@ -1291,7 +1407,10 @@ void CommandProcessor::FlipWithInterrupt(uint32_t eop_event_type, uint32_t cache
 	printf("\t dst_gpu_addr        = 0x%016" PRIx64 "\n", reinterpret_cast<uint64_t>(dst_gpu_addr));
 	printf("\t value               = 0x%08" PRIx32 "\n", value);
 
-	if (eop_event_type == 0x00000004 && cache_action == 0x00000038)
+	if (m_flip.handle == GRAPHICS_RUN_FLIP_HANDLE_NONE)
+	{
+		GraphicsRenderWriteAtEndOfPipeWithInterrupt32(m_sumbit_id, m_buffer[m_current_buffer], static_cast<uint32_t*>(dst_gpu_addr), value);
+	} else if (eop_event_type == 0x00000004 && cache_action == 0x00000038)
 	{
 		GraphicsRenderWriteAtEndOfPipeWithInterruptWriteBackFlip32(m_sumbit_id, m_buffer[m_current_buffer],
 		                                                           static_cast<uint32_t*>(dst_gpu_addr), value, m_flip.handle, m_flip.index,
@@ -1322,6 +1441,8 @@ void GraphicsRunSubmit(uint32_t* cmd_draw_buffer, uint32_t num_draw_dw, uint32_t
 	EXIT_IF(num_draw_dw == 0);
 	EXIT_IF(g_gpu == nullptr);
 
+	CaptureSubmit(cmd_draw_buffer, num_draw_dw, cmd_const_buffer, num_const_dw, false, 0, 0, 0, 0);
+
 	g_gpu->Submit(cmd_draw_buffer, num_draw_dw, cmd_const_buffer, num_const_dw);
 }
 
@@ -1332,6 +1453,8 @@ void GraphicsRunSubmitAndFlip(uint32_t* cmd_draw_buffer, uint32_t num_draw_dw, u
 	EXIT_IF(num_draw_dw == 0);
 	EXIT_IF(g_gpu == nullptr);
 
+	CaptureSubmit(cmd_draw_buffer, num_draw_dw, cmd_const_buffer, num_const_dw, true, handle, index, flip_mode, flip_arg);
+
 	g_gpu->SubmitAndFlip(cmd_draw_buffer, num_draw_dw, cmd_const_buffer, num_const_dw, handle, index, flip_mode, flip_arg);
 }
 
@@ -1368,6 +1491,8 @@ void GraphicsRunDone()
 {
 	EXIT_IF(g_gpu == nullptr);
 
+	CaptureDone();
+
 	g_gpu->Done();
 }
 
@@ -2239,6 +2364,8 @@ KYTY_HW_SH_PARSER(hw_sh_set_cs_shader)
 
 	cp->GetShCtx()->SetCsShader(r, shader_modifier);
 
+	ShaderPrefetch(ShaderType::Compute, r.data_addr);
+
 	return 24;
 }
 
@@ -2342,6 +2469,8 @@ KYTY_HW_SH_PARSER(hw_sh_set_ps_shader)
 	cp->GetShCtx()->SetPsShaderResource1(r1);
 	cp->GetShCtx()->SetPsShaderResource2(r2);
 
+	ShaderPrefetch(ShaderType::Pixel, addr);
+
 	return 39;
 }
 
@@ -2426,6 +2555,8 @@ KYTY_HW_SH_PARSER(hw_sh_set_vs_shader)
 	cp->GetCtx()->SetShaderPosFormat(m_spi_shader_pos_format);
 	cp->GetCtx()->SetClVsOutCntl(m_pa_cl_vs_out_cntl);
 
+	ShaderPrefetch(ShaderType::Vertex, addr);
+
 	return 28;
 }
 
@@ -2502,6 +2633,8 @@ KYTY_HW_SH_PARSER(hw_sh_update_ps_shader)
 	cp->GetShCtx()->SetPsShaderResource1(r1);
 	cp->GetShCtx()->SetPsShaderResource2(r2);
 
+	ShaderPrefetch(ShaderType::Pixel, addr);
+
 	return 39;
 }
 
@@ -2539,6 +2672,8 @@ KYTY_HW_SH_PARSER(hw_sh_update_vs_shader)
 	cp->GetShCtx()->SetVsShaderResource1(r1);
 	cp->GetShCtx()->SetVsShaderResource2(r2);
 
+	ShaderPrefetch(ShaderType::Vertex, addr);
+
 	return 28;
 }
 
@@ -1,5 +1,6 @@
 #include "Emulator/Graphics/Image.h"
 
+#include "Kyty/Core/ByteBuffer.h"
 #include "Kyty/Core/DbgAssert.h"
 #include "Kyty/Core/File.h"
 #include "Kyty/Core/SafeDelete.h"
@@ -36,7 +37,15 @@ public:
 
 	explicit ImagePrivate(SDL_Surface* s): sdl(s) {}
 
-	virtual ~ImagePrivate() { SDL_FreeSurface(sdl); }
+	virtual ~ImagePrivate()
+	{
+		SDL_FreeSurface(sdl);
+		// SDL doesn't own the pixels of a surface created from them
+		if (stbi_pixels != nullptr)
+		{
+			stbi_image_free(stbi_pixels);
+		}
+	}
 
 	void BgrToRgb() const
 	{
@@ -83,6 +92,7 @@ public:
 	}
 
 	SDL_Surface* sdl;
+	void*        stbi_pixels = nullptr;
 };
 
 Image::Image(const String& name): m_name(name) {}
@@ -101,38 +111,21 @@ void Image::Load(const String& file_name)
 	Load();
 }
 
-static int read(void* user, char* data, int size)
-{
-	auto* src = static_cast<SDL_RWops*>(user);
-	return static_cast<int>(src->read(src, data, 1, size));
-}
-
-static void skip(void* user, int n)
-{
-	auto* src = static_cast<SDL_RWops*>(user);
-	src->seek(src, n, RW_SEEK_CUR);
-}
-
-static int eof(void* user)
-{
-	auto* src = static_cast<SDL_RWops*>(user);
-	return (src->seek(src, 0, RW_SEEK_CUR) >= src->size(src) ? 1 : 0);
-}
-
-static SDL_Surface* IMG_LoadPNG_RW(SDL_RWops* src)
+// The whole file is decoded from memory, stb_image reads a memory buffer without the per-call overhead of the I/O callbacks
+static SDL_Surface* IMG_LoadPNG_Mem(const Core::ByteBuffer& buf, void** pixels)
 {
 	int width           = 0;
 	int height          = 0;
 	int bytes_per_pixel = 0;
 
-	stbi_io_callbacks cb {};
-	cb.read = read;
-	cb.skip = skip;
-	cb.eof  = eof;
+	void* data = stbi_load_from_memory(reinterpret_cast<const stbi_uc*>(buf.GetDataConst()), static_cast<int>(buf.Size()), &width, &height,
+	                                   &bytes_per_pixel, 0);
 
-	void* data = stbi_load_from_callbacks(&cb, src, &width, &height, &bytes_per_pixel, 0);
+	EXIT_NOT_IMPLEMENTED(data == nullptr);
+	EXIT_NOT_IMPLEMENTED(bytes_per_pixel != 3 && bytes_per_pixel != 4);
 
-	uint32_t pitch = (width * bytes_per_pixel + 3u) & ~3u;
+	// Rows of stb_image are packed
+	auto pitch = static_cast<uint32_t>(width * bytes_per_pixel);
 
 	uint32_t r_mask = 0x000000FF;
 	uint32_t g_mask = 0x0000FF00;
@@ -144,6 +137,8 @@ static SDL_Surface* IMG_LoadPNG_RW(SDL_RWops* src)
 
 	EXIT_NOT_IMPLEMENTED(surface == nullptr);
 
+	*pixels = data;
+
 	return surface;
 }
 
@@ -162,11 +157,8 @@ void Image::Load()
 		EXIT("Can't open file %s\n", file_name.C_Str());
 	}
 
-	SDL_RWops* ops = f.CreateSdlRWops();
-
-	EXIT_IF(ops == nullptr);
-
-	SDL_Surface* sdl = nullptr;
+	SDL_Surface* sdl         = nullptr;
+	void*        stbi_pixels = nullptr;
 
 	if (file_name.EndsWith(U".bmp", String::Case::Insensitive))
 	{
@@ -178,8 +170,8 @@ void Image::Load()
 		KYTY_NOT_IMPLEMENTED;
 	} else if (file_name.EndsWith(U".png", String::Case::Insensitive))
 	{
-		sdl = IMG_LoadPNG_RW(ops);
-		// KYTY_NOT_IMPLEMENTED;
+		auto buf = f.Read(static_cast<uint32_t>(f.Size()));
+		sdl      = IMG_LoadPNG_Mem(buf, &stbi_pixels);
 	} else if (file_name.EndsWith(U".webp", String::Case::Insensitive))
 	{
 		/* sdl = IMG_LoadWEBP_RW(ops); */
@@ -189,9 +181,11 @@ void Image::Load()
 		EXIT("Unknown image type %s\n", file_name.utf8_str().GetData());
 	}
 
+	f.Close();
+
 	LoadSdl(sdl);
 
-	SDL_RWclose(ops);
+	m_image->stbi_pixels = stbi_pixels;
 }
 
 // NOLINTNEXTLINE(readability-function-cognitive-complexity)
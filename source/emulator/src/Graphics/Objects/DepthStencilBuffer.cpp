@@ -46,12 +46,15 @@ static void* create_func(GraphicContext* ctx, const uint64_t* params, const uint
 	vk_obj->image         = nullptr;
 	vk_obj->layout        = VK_IMAGE_LAYOUT_UNDEFINED;
 
+	UtilApplyRenderScale(vk_obj);
+
 	for (auto& view: vk_obj->image_view)
 	{
 		view = nullptr;
 	}
 
 	vk_obj->compressed = !htile;
+	vk_obj->sampled    = sampled;
 
 	VkImageCreateInfo image_info {};
 	image_info.sType         = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
@@ -67,6 +70,7 @@ static void* create_func(GraphicContext* ctx, const uint64_t* params, const uint
 	image_info.tiling        = VK_IMAGE_TILING_OPTIMAL;
 	image_info.initialLayout = vk_obj->layout;
 	image_info.usage         = static_cast<VkImageUsageFlags>(VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT) |
+	                   static_cast<VkImageUsageFlags>(VK_IMAGE_USAGE_TRANSFER_SRC_BIT) |
 	                   (sampled ? static_cast<VkImageUsageFlags>(VK_IMAGE_USAGE_SAMPLED_BIT) : static_cast<VkImageUsageFlags>(0));
 	image_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
 	image_info.samples     = VK_SAMPLE_COUNT_1_BIT;
@@ -147,6 +151,7 @@ static void delete_func(GraphicContext* ctx, void* obj, VulkanMemory* mem)
 	EXIT_IF(ctx == nullptr);
 
 	DeleteFramebuffer(vk_obj);
+	UtilDeleteDepthColor(ctx, vk_obj);
 
 	vkDestroyImageView(ctx->device, vk_obj->image_view[VulkanImage::VIEW_DEPTH_TEXTURE], nullptr);
 	vkDestroyImageView(ctx->device, vk_obj->image_view[VulkanImage::VIEW_DEFAULT], nullptr);
@@ -2,13 +2,17 @@
 
 #include "Kyty/Core/Database.h"
 #include "Kyty/Core/DbgAssert.h"
+#include "Kyty/Core/FlatHashmap.h"
 #include "Kyty/Core/Hashmap.h"
 #include "Kyty/Core/MagicEnum.h"
+#include "Kyty/Core/SmallVector.h"
 #include "Kyty/Core/String.h"
 #include "Kyty/Core/Threads.h"
 #include "Kyty/Core/Vector.h"
+#include "Kyty/Core/VirtualMemory.h"
 
 #include "Emulator/Config.h"
+#include "Emulator/Graphics/GpuCounters.h"
 #include "Emulator/Graphics/GraphicContext.h"
 #include "Emulator/Graphics/GraphicsRun.h"
 #include "Emulator/Profiler.h"
@@ -20,6 +24,10 @@
 //#define XXH_INLINE_ALL
 #include <xxhash/xxhash.h>
 
+#if KYTY_COMPILER == KYTY_COMPILER_MSVC
+#include <intrin.h>
+#endif
+
 #ifdef KYTY_EMU_ENABLED
 
 namespace Kyty::Libs::Graphics {
@@ -109,7 +117,7 @@ public:
 		}
 	}
 
-	[[nodiscard]] Vector<int> FindAll(uint64_t vaddr) const { return m_map.Get(vaddr); }
+	[[nodiscard]] const Vector<int>* Find(uint64_t vaddr) const { return m_map.Find(vaddr); }
 
 	[[nodiscard]] bool IsEmpty() const
 	{
@@ -125,9 +133,10 @@ public:
 	}
 
 private:
-	Core::Hashmap<uint64_t, Vector<int>> m_map;
+	Core::FlatHashmap<uint64_t, Vector<int>> m_map;
 };
 
+// Interval tree (AVL tree ordered by the start address, each node keeps the maximum end address of its subtree)
 class GpuMap2
 {
 public:
@@ -139,103 +148,363 @@ public:
 	void Insert(uint64_t vaddr, uint64_t size, int id)
 	{
 		EXIT_IF(size == 0);
-		auto first_page = CalcPageId(vaddr);
-		auto last_page  = CalcPageId(vaddr + size - 1);
-		EXIT_IF(last_page < first_page);
-		for (auto page = first_page; page <= last_page; page++)
+		EXIT_IF(id < 0);
+		m_root = Insert(m_root, vaddr, vaddr + size, id);
+	}
+
+	void Erase(uint64_t vaddr, uint64_t size, int id)
+	{
+		EXIT_IF(size == 0);
+		m_root = Erase(m_root, vaddr, vaddr + size, id);
+	}
+
+	// Calls func(id) once for every object which overlaps any of the ranges
+	template <class F>
+	void ForEach(const uint64_t* vaddr, const uint64_t* size, int vaddr_num, F&& func) const
+	{
+		EXIT_IF(vaddr == nullptr);
+		EXIT_IF(size == nullptr);
+
+		if (++m_stamp == 0)
 		{
-			auto& ids = m_map[page];
-			if (!ids.Contains(id))
+			for (auto& st: m_stamps)
 			{
-				ids.Add(id);
+				st = 0;
 			}
+			m_stamp = 1;
+		}
+
+		for (int i = 0; i < vaddr_num; i++)
+		{
+			EXIT_IF(size[i] == 0);
+			Query(m_root, vaddr[i], vaddr[i] + size[i], func);
 		}
 	}
 
-	void Erase(uint64_t vaddr, uint64_t size, int id)
+	[[nodiscard]] bool IsEmpty() const { return m_root < 0; }
+
+private:
+	struct Node
+	{
+		uint64_t begin   = 0;
+		uint64_t end     = 0;
+		uint64_t max_end = 0;
+		int      id      = -1;
+		int      left    = -1;
+		int      right   = -1;
+		int      height  = 1;
+	};
+
+	[[nodiscard]] static bool Less(uint64_t begin1, uint64_t end1, int id1, const Node& n)
 	{
-		EXIT_IF(size == 0);
-		auto first_page = CalcPageId(vaddr);
-		auto last_page  = CalcPageId(vaddr + size - 1);
-		EXIT_IF(last_page < first_page);
-		for (auto page = first_page; page <= last_page; page++)
-		{
-			auto& ids = m_map[page];
-			ids.Remove(id);
-			if (ids.IsEmpty())
+		return (begin1 != n.begin ? begin1 < n.begin : (id1 != n.id ? id1 < n.id : end1 < n.end));
+	}
+
+	[[nodiscard]] int Height(int n) const { return (n < 0 ? 0 : m_nodes[n].height); }
+
+	void Fix(int n)
+	{
+		auto& node   = m_nodes[n];
+		node.height  = 1 + std::max(Height(node.left), Height(node.right));
+		node.max_end = node.end;
+		if (node.left >= 0)
+		{
+			node.max_end = std::max(node.max_end, m_nodes[node.left].max_end);
+		}
+		if (node.right >= 0)
+		{
+			node.max_end = std::max(node.max_end, m_nodes[node.right].max_end);
+		}
+	}
+
+	int RotateRight(int n)
+	{
+		int l            = m_nodes[n].left;
+		m_nodes[n].left  = m_nodes[l].right;
+		m_nodes[l].right = n;
+		Fix(n);
+		Fix(l);
+		return l;
+	}
+
+	int RotateLeft(int n)
+	{
+		int r            = m_nodes[n].right;
+		m_nodes[n].right = m_nodes[r].left;
+		m_nodes[r].left  = n;
+		Fix(n);
+		Fix(r);
+		return r;
+	}
+
+	int Balance(int n)
+	{
+		Fix(n);
+		int b = Height(m_nodes[n].left) - Height(m_nodes[n].right);
+		if (b > 1)
+		{
+			if (Height(m_nodes[m_nodes[n].left].left) < Height(m_nodes[m_nodes[n].left].right))
+			{
+				m_nodes[n].left = RotateLeft(m_nodes[n].left);
+			}
+			return RotateRight(n);
+		}
+		if (b < -1)
+		{
+			if (Height(m_nodes[m_nodes[n].right].right) < Height(m_nodes[m_nodes[n].right].left))
 			{
-				m_map.Remove(page);
+				m_nodes[n].right = RotateRight(m_nodes[n].right);
 			}
+			return RotateLeft(n);
 		}
+		return n;
 	}
 
-	[[nodiscard]] Vector<int> FindAll(uint64_t vaddr, uint64_t size) const
+	int NewNode(uint64_t begin, uint64_t end, int id)
 	{
-		Vector<int> ret;
-		EXIT_IF(size == 0);
-		auto first_page = CalcPageId(vaddr);
-		auto last_page  = CalcPageId(vaddr + size - 1);
-		EXIT_IF(last_page < first_page);
-		for (auto page = first_page; page <= last_page; page++)
+		int n = 0;
+		if (m_first_free >= 0)
+		{
+			n            = m_first_free;
+			m_first_free = m_nodes[n].left;
+		} else
+		{
+			n = static_cast<int>(m_nodes.Size());
+			m_nodes.Add(Node());
+		}
+		auto& node   = m_nodes[n];
+		node.begin   = begin;
+		node.end     = end;
+		node.max_end = end;
+		node.id      = id;
+		node.left    = -1;
+		node.right   = -1;
+		node.height  = 1;
+
+		while (m_stamps.Size() <= static_cast<uint32_t>(id))
+		{
+			m_stamps.Add(0);
+		}
+		return n;
+	}
+
+	void FreeNode(int n)
+	{
+		m_nodes[n].id   = -1;
+		m_nodes[n].left = m_first_free;
+		m_first_free    = n;
+	}
+
+	int Insert(int n, uint64_t begin, uint64_t end, int id)
+	{
+		if (n < 0)
+		{
+			return NewNode(begin, end, id);
+		}
+		const auto& node = m_nodes[n];
+		if (Less(begin, end, id, node))
+		{
+			int l           = Insert(node.left, begin, end, id);
+			m_nodes[n].left = l;
+		} else if (begin != node.begin || end != node.end || id != node.id)
+		{
+			int r            = Insert(node.right, begin, end, id);
+			m_nodes[n].right = r;
+		} else
+		{
+			// Already inserted
+			return n;
+		}
+		return Balance(n);
+	}
+
+	int EraseMin(int n, int* min)
+	{
+		if (m_nodes[n].left < 0)
+		{
+			*min = n;
+			return m_nodes[n].right;
+		}
+		int l           = EraseMin(m_nodes[n].left, min);
+		m_nodes[n].left = l;
+		return Balance(n);
+	}
+
+	int Erase(int n, uint64_t begin, uint64_t end, int id)
+	{
+		if (n < 0)
+		{
+			return n;
+		}
+		const auto& node = m_nodes[n];
+		if (Less(begin, end, id, node))
+		{
+			int l           = Erase(node.left, begin, end, id);
+			m_nodes[n].left = l;
+		} else if (begin != node.begin || end != node.end || id != node.id)
 		{
-			for (int id: m_map.Get(page))
+			int r            = Erase(node.right, begin, end, id);
+			m_nodes[n].right = r;
+		} else
+		{
+			int l = node.left;
+			int r = node.right;
+			FreeNode(n);
+			if (r < 0)
 			{
-				if (!ret.Contains(id))
-				{
-					ret.Add(id);
-				}
+				return l;
 			}
+			int min            = -1;
+			r                  = EraseMin(r, &min);
+			m_nodes[min].left  = l;
+			m_nodes[min].right = r;
+			return Balance(min);
 		}
-		return ret;
+		return Balance(n);
 	}
 
-	[[nodiscard]] Vector<int> FindAll(const uint64_t* vaddr, const uint64_t* size, int vaddr_num) const
+	template <class F>
+	void Query(int n, uint64_t begin, uint64_t end, F& func) const
 	{
-		EXIT_IF(vaddr == nullptr);
-		EXIT_IF(size == nullptr);
-		Vector<int> ret;
-		for (int i = 0; i < vaddr_num; i++)
+		while (n >= 0)
 		{
-			EXIT_IF(size[i] == 0);
-			auto first_page = CalcPageId(vaddr[i]);
-			auto last_page  = CalcPageId(vaddr[i] + size[i] - 1);
-			EXIT_IF(last_page < first_page);
-			for (auto page = first_page; page <= last_page; page++)
+			const auto& node = m_nodes[n];
+			if (node.max_end <= begin)
 			{
-				for (int id: m_map.Get(page))
-				{
-					if (!ret.Contains(id))
-					{
-						ret.Add(id);
-					}
-				}
+				return;
+			}
+			Query(node.left, begin, end, func);
+			if (node.begin >= end)
+			{
+				return;
+			}
+			if (node.end > begin && m_stamps[node.id] != m_stamp)
+			{
+				m_stamps[node.id] = m_stamp;
+				func(node.id);
 			}
+			n = node.right;
 		}
-		return ret;
 	}
 
-	[[nodiscard]] bool IsEmpty() const
+	Vector<Node>             m_nodes;
+	int                      m_root       = -1;
+	int                      m_first_free = -1;
+	mutable Vector<uint32_t> m_stamps;
+	mutable uint32_t         m_stamp = 0;
+};
+
+// Tracks CPU writes to the memory of GPU objects. Pages are protected as read-only, the first write to a page is caught by the
+// exception handler, which unprotects the page and remembers the time of the write. Guest protection changes go through the same
+// page table: watched pages stay write-protected, and pages the guest made read-only are never unprotected.
+// State of guest pages for the exception handler, read without locks. Writers hold the watcher mutex. Leaves cover 1 GB each, are
+// allocated on the first write and live until the table is destroyed.
+class PageStateTable
+{
+public:
+	enum class State : uint8_t
 	{
-		int num = 0;
-		m_map.ForEach(
-		    [](auto /*key*/, auto value, void* arg)
-		    {
-			    (*static_cast<int*>(arg)) += value->Size();
-			    return true;
-		    },
-		    &num);
-		return num == 0;
+		None,
+		Watched,  // write-protected by the watcher
+		Released, // unprotected by a write, until watched again
+		Unknown,  // outside of the table
+	};
+
+	PageStateTable() = default;
+	~PageStateTable()
+	{
+		for (auto& leaf: m_root)
+		{
+			delete[] leaf.load();
+		}
+	}
+
+	KYTY_CLASS_NO_COPY(PageStateTable);
+
+	[[nodiscard]] State Get(uint64_t vaddr) const
+	{
+		uint64_t index = vaddr >> LEAF_SHIFT;
+		if (index >= ROOT_SIZE)
+		{
+			return State::Unknown;
+		}
+		const auto* leaf = m_root[index].load(std::memory_order_acquire);
+		if (leaf == nullptr)
+		{
+			return State::None;
+		}
+		return static_cast<State>(leaf[(vaddr >> PAGE_SHIFT) & LEAF_MASK].load(std::memory_order_acquire));
+	}
+
+	void Set(uint64_t vaddr, State state)
+	{
+		uint64_t index = vaddr >> LEAF_SHIFT;
+		if (index >= ROOT_SIZE)
+		{
+			return;
+		}
+		auto* leaf = m_root[index].load(std::memory_order_acquire);
+		if (leaf == nullptr)
+		{
+			if (state == State::None)
+			{
+				return;
+			}
+			leaf = new std::atomic_uint8_t[LEAF_MASK + 1]();
+			m_root[index].store(leaf, std::memory_order_release);
+		}
+		leaf[(vaddr >> PAGE_SHIFT) & LEAF_MASK].store(static_cast<uint8_t>(state), std::memory_order_release);
 	}
 
 private:
-	static constexpr uint32_t PAGE_BITS = 14u;
+	static constexpr uint64_t PAGE_SHIFT = 12;
+	static constexpr uint64_t LEAF_SHIFT = 30;
+	static constexpr uint64_t LEAF_MASK  = (static_cast<uint64_t>(1) << (LEAF_SHIFT - PAGE_SHIFT)) - 1;
+	static constexpr uint64_t ROOT_SIZE  = 1024; // 1 TB, the guest address space
+
+	std::atomic<std::atomic_uint8_t*> m_root[ROOT_SIZE] = {};
+};
+
+class GpuMemoryWatcher
+{
+public:
+	static constexpr uint64_t PAGE_SIZE = 4096;
+
+	GpuMemoryWatcher()  = default;
+	~GpuMemoryWatcher() = default;
+
+	KYTY_CLASS_NO_COPY(GpuMemoryWatcher);
+
+	void Watch(const uint64_t* vaddr, const uint64_t* size, int vaddr_num);
+	bool Unwatch(uint64_t vaddr, uint64_t size);
+	void Erase(uint64_t vaddr, uint64_t size);
+	void SetGuestMode(uint64_t vaddr, uint64_t size, Core::VirtualMemory::Mode mode, Core::VirtualMemory::Mode* old_mode, bool track);
+	bool WriteFault(uint64_t vaddr);
+
+	[[nodiscard]] bool IsDirty(const uint64_t* vaddr, const uint64_t* size, int vaddr_num, uint64_t time);
+
+private:
+	struct Page
+	{
+		uint64_t write_time = 0;
+		bool     protect    = false;
+		bool     read_only  = false;
+	};
 
-	static uint32_t CalcPageId(uint64_t vaddr)
+	static void Protect(uint64_t vaddr, uint64_t size, bool protect);
+
+	// m_mutex must be locked
+	void UpdateState(uint64_t page, const Page& p)
 	{
-		EXIT_IF((vaddr >> (PAGE_BITS + 32u)) != 0);
-		return static_cast<uint32_t>(vaddr >> PAGE_BITS);
+		m_states.Set(page, (p.read_only  ? PageStateTable::State::None
+		                    : p.protect ? PageStateTable::State::Watched
+		                                : PageStateTable::State::Released));
 	}
-	Core::Hashmap<uint32_t, Vector<int>> m_map;
+
+	Core::Mutex                   m_mutex;
+	Core::Hashmap<uint64_t, Page> m_pages;
+	PageStateTable                m_states;
+	std::atomic_uint64_t          m_last_write_time = 0;
 };
 
 class GpuMemory
@@ -252,11 +521,14 @@ public:
 	bool IsAllocated(uint64_t vaddr, uint64_t size);
 	void SetAllocatedRange(uint64_t vaddr, uint64_t size);
 	void Free(GraphicContext* ctx, uint64_t vaddr, uint64_t size, bool unmap);
+	void Protect(uint64_t vaddr, uint64_t size, Core::VirtualMemory::Mode mode, Core::VirtualMemory::Mode* old_mode);
+
+	Vector<GpuMemoryRange> GetAllocatedRanges();
 
 	void* CreateObject(uint64_t submit_id, GraphicContext* ctx, CommandBuffer* buffer, const uint64_t* vaddr, const uint64_t* size,
 	                   int vaddr_num, const GpuObject& info);
 	void  ResetHash(const uint64_t* vaddr, const uint64_t* size, int vaddr_num, GpuMemoryObjectType type);
-	void  FrameDone();
+	void  FrameDone(GraphicContext* ctx);
 
 	Vector<GpuMemoryObject> FindObjects(const uint64_t* vaddr, const uint64_t* size, int vaddr_num, GpuMemoryObjectType type, bool exact,
 	                                    bool only_first);
@@ -264,10 +536,19 @@ public:
 	// Sync: GPU -> CPU
 	void WriteBack(GraphicContext* ctx, CommandProcessor* cp);
 
+	// Postpone the write-back until the guest can observe the results (label, EOP or idle wait)
+	void DeferWriteBack(CommandProcessor* cp);
+	bool IsWriteBackPending(CommandProcessor* cp);
+
 	// Sync: CPU -> GPU
 	void Flush(GraphicContext* ctx, uint64_t vaddr, uint64_t size);
 	void FlushAll(GraphicContext* ctx);
 
+	bool CheckAccessViolation(uint64_t vaddr, uint64_t size) { return m_watcher.Unwatch(vaddr, size); }
+
+	// Called from the exception handler
+	bool WriteFault(uint64_t vaddr) { return m_watcher.WriteFault(vaddr); }
+
 	void DbgInit();
 	void DbgDbDump();
 	void DbgDbSave(const String& file_name);
@@ -286,6 +567,8 @@ private:
 		GpuMemoryObject              object;
 		uint64_t                     params[GpuObject::PARAMS_MAX] = {};
 		uint64_t                     hash[VADDR_BLOCKS_MAX]        = {};
+		uint64_t                     sample_hash[VADDR_BLOCKS_MAX] = {};
+		uint32_t                     sampled_checks                = 0;
 		uint64_t                     cpu_update_time               = 0;
 		uint64_t                     gpu_update_time               = 0;
 		uint64_t                     submit_id                     = 0;
@@ -297,6 +580,7 @@ private:
 		bool                         in_use                        = false;
 		bool                         read_only                     = false;
 		bool                         check_hash                    = false;
+		bool                         watched                       = false;
 		VulkanMemory                 mem;
 	};
 
@@ -306,6 +590,9 @@ private:
 		int         object_id = -1;
 	};
 
+	// Lookups usually find a few objects
+	using OverlappedBlocks = Core::SmallVector<OverlappedBlock, 8>;
+
 	struct Block
 	{
 		uint64_t vaddr[VADDR_BLOCKS_MAX] = {};
@@ -342,9 +629,8 @@ private:
 
 	[[nodiscard]] Destructor Free(int heap_id, int object_id);
 
-	Vector<OverlappedBlock> FindBlocks_slow(int heap_id, const uint64_t* vaddr, const uint64_t* size, int vaddr_num,
-	                                        bool only_first = false);
-	Vector<OverlappedBlock> FindBlocks(int heap_id, const uint64_t* vaddr, const uint64_t* size, int vaddr_num, bool only_first = false);
+	OverlappedBlocks FindBlocks_slow(int heap_id, const uint64_t* vaddr, const uint64_t* size, int vaddr_num, bool only_first = false);
+	OverlappedBlocks FindBlocks(int heap_id, const uint64_t* vaddr, const uint64_t* size, int vaddr_num, bool only_first = false);
 	bool  FindFast(int heap_id, const uint64_t* vaddr, const uint64_t* size, int vaddr_num, GpuMemoryObjectType type, bool only_first,
 	               int* id);
 	Block CreateBlock(const uint64_t* vaddr, const uint64_t* size, int vaddr_num, int heap_id, int obj_id);
@@ -355,21 +641,28 @@ private:
 	// Update (CPU -> GPU)
 	void Update(uint64_t submit_id, GraphicContext* ctx, int heap_id, int obj_id);
 
-	bool create_existing(const Vector<OverlappedBlock>& others, const GpuObject& info, int heap_id, int* id);
-	bool create_generate_mips(const Vector<OverlappedBlock>& others, GpuMemoryObjectType type, int heap_id);
-	bool create_texture_triplet(const Vector<OverlappedBlock>& others, GpuMemoryObjectType type, int heap_id);
-	bool create_maybe_deleted(const Vector<OverlappedBlock>& others, GpuMemoryObjectType type, int heap_id);
-	bool create_all_the_same(const Vector<OverlappedBlock>& others, int heap_id);
+	// Frees least recently used objects which can be recreated from the guest memory
+	uint64_t Evict(GraphicContext* ctx, uint64_t size);
+
+	bool create_existing(const OverlappedBlocks& others, const GpuObject& info, int heap_id, int* id);
+	bool create_generate_mips(const OverlappedBlocks& others, GpuMemoryObjectType type, int heap_id);
+	bool create_texture_triplet(const OverlappedBlocks& others, GpuMemoryObjectType type, int heap_id);
+	bool create_maybe_deleted(const OverlappedBlocks& others, GpuMemoryObjectType type, int heap_id);
+	bool create_all_the_same(const OverlappedBlocks& others, int heap_id);
 
 	[[nodiscard]] String create_dbg_exit(const String& msg, const uint64_t* vaddr, const uint64_t* size, int vaddr_num,
-	                                     const Vector<OverlappedBlock>& others, GpuMemoryObjectType type);
+	                                     const OverlappedBlocks& others, GpuMemoryObjectType type);
 
-	Core::Mutex m_mutex;
+	Core::Mutex m_mutex {"GpuMemory"};
 
 	Vector<Heap> m_heaps;
 
 	uint64_t m_current_frame = 0;
 
+	Vector<CommandProcessor*> m_write_back_pending;
+
+	GpuMemoryWatcher m_watcher;
+
 	Core::Database::Connection m_db;
 	Core::Database::Statement* m_db_add_range  = nullptr;
 	Core::Database::Statement* m_db_add_object = nullptr;
@@ -402,16 +695,32 @@ public:
 	bool FindInfo(uint64_t memory, Info* dst);
 
 private:
+	static constexpr uint32_t INVALID_HANDLE = static_cast<uint32_t>(-1);
+
 	struct Owner
 	{
-		String name;
-		bool   free = true;
+		String   name;
+		bool     free           = true;
+		uint32_t first_resource = INVALID_HANDLE;
+	};
+
+	// Resources of an owner are linked into a list
+	struct Resource
+	{
+		Info     info;
+		uint32_t prev = INVALID_HANDLE;
+		uint32_t next = INVALID_HANDLE;
 	};
 
+	void Free(uint32_t resource_handle);
+
 	Core::Mutex m_mutex;
 
-	Vector<Owner> m_owners;
-	Vector<Info>  m_infos;
+	Vector<Owner>    m_owners;
+	Vector<Resource> m_resources;
+	Vector<uint32_t> m_free_owners;
+	Vector<uint32_t> m_free_resources;
+	GpuMap2          m_map;
 };
 
 static GpuMemory*    g_gpu_memory    = nullptr;
@@ -425,20 +734,17 @@ uint32_t GpuResources::AddOwner(const String& name)
 	n.name = name;
 	n.free = false;
 
-	uint32_t index = 0;
-	for (auto& b: m_owners)
+	if (!m_free_owners.IsEmpty())
 	{
-		if (b.free)
-		{
-			b = n;
-			return index;
-		}
-		index++;
+		uint32_t index = m_free_owners.At(m_free_owners.Size() - 1);
+		m_free_owners.RemoveAt(m_free_owners.Size() - 1);
+		m_owners[index] = n;
+		return index;
 	}
 
 	m_owners.Add(n);
 
-	return index;
+	return m_owners.Size() - 1;
 }
 
 uint32_t GpuResources::AddResource(uint32_t owner_handle, uint64_t memory, size_t size, const String& name, uint32_t type,
@@ -449,48 +755,90 @@ uint32_t GpuResources::AddResource(uint32_t owner_handle, uint64_t memory, size_
 	EXIT_NOT_IMPLEMENTED(!m_owners.IndexValid(owner_handle));
 	EXIT_NOT_IMPLEMENTED(memory == 0);
 
-	Info info;
-	info.owner     = owner_handle;
-	info.memory    = memory;
-	info.free      = false;
-	info.name      = name;
-	info.size      = size;
-	info.type      = type;
-	info.user_data = user_data;
+	auto& owner = m_owners[owner_handle];
+
+	Resource r;
+	r.info.owner     = owner_handle;
+	r.info.memory    = memory;
+	r.info.free      = false;
+	r.info.name      = name;
+	r.info.size      = size;
+	r.info.type      = type;
+	r.info.user_data = user_data;
+	r.next           = owner.first_resource;
 
 	uint32_t index = 0;
-	for (auto& i: m_infos)
+	if (!m_free_resources.IsEmpty())
 	{
-		if (i.free)
-		{
-			i = info;
-			return index;
-		}
-		index++;
+		index = m_free_resources.At(m_free_resources.Size() - 1);
+		m_free_resources.RemoveAt(m_free_resources.Size() - 1);
+		m_resources[index] = r;
+	} else
+	{
+		index = m_resources.Size();
+		m_resources.Add(r);
+	}
+
+	if (r.next != INVALID_HANDLE)
+	{
+		m_resources[r.next].prev = index;
 	}
+	owner.first_resource = index;
 
-	m_infos.Add(info);
+	if (size > 0)
+	{
+		m_map.Insert(memory, size, static_cast<int>(index));
+	}
 
 	return index;
 }
 
+void GpuResources::Free(uint32_t resource_handle)
+{
+	auto& r = m_resources[resource_handle];
+
+	EXIT_IF(r.info.free);
+
+	if (r.prev != INVALID_HANDLE)
+	{
+		m_resources[r.prev].next = r.next;
+	} else
+	{
+		m_owners[r.info.owner].first_resource = r.next;
+	}
+	if (r.next != INVALID_HANDLE)
+	{
+		m_resources[r.next].prev = r.prev;
+	}
+
+	if (r.info.size > 0)
+	{
+		m_map.Erase(r.info.memory, r.info.size, static_cast<int>(resource_handle));
+	}
+
+	r.info.free = true;
+	r.prev      = INVALID_HANDLE;
+	r.next      = INVALID_HANDLE;
+
+	m_free_resources.Add(resource_handle);
+}
+
 void GpuResources::DeleteOwner(uint32_t owner_handle)
 {
 	Core::LockGuard lock(m_mutex);
 
 	EXIT_NOT_IMPLEMENTED(!m_owners.IndexValid(owner_handle));
 
-	for (auto& i: m_infos)
+	while (m_owners[owner_handle].first_resource != INVALID_HANDLE)
 	{
-		if (!i.free && i.owner == owner_handle)
-		{
-			i.free = true;
-		}
+		Free(m_owners[owner_handle].first_resource);
 	}
 
 	EXIT_NOT_IMPLEMENTED(m_owners[owner_handle].free);
 
 	m_owners[owner_handle].free = true;
+
+	m_free_owners.Add(owner_handle);
 }
 
 void GpuResources::DeleteResources(uint32_t owner_handle)
@@ -499,12 +847,9 @@ void GpuResources::DeleteResources(uint32_t owner_handle)
 
 	EXIT_NOT_IMPLEMENTED(!m_owners.IndexValid(owner_handle));
 
-	for (auto& i: m_infos)
+	while (m_owners[owner_handle].first_resource != INVALID_HANDLE)
 	{
-		if (!i.free && i.owner == owner_handle)
-		{
-			i.free = true;
-		}
+		Free(m_owners[owner_handle].first_resource);
 	}
 }
 
@@ -512,11 +857,11 @@ void GpuResources::DeleteResource(uint32_t resource_handle)
 {
 	Core::LockGuard lock(m_mutex);
 
-	EXIT_NOT_IMPLEMENTED(!m_infos.IndexValid(resource_handle));
+	EXIT_NOT_IMPLEMENTED(!m_resources.IndexValid(resource_handle));
 
-	EXIT_NOT_IMPLEMENTED(m_infos[resource_handle].free);
+	EXIT_NOT_IMPLEMENTED(m_resources[resource_handle].info.free);
 
-	m_infos[resource_handle].free = true;
+	Free(resource_handle);
 }
 
 bool GpuResources::FindInfo(uint64_t memory, Info* dst)
@@ -525,14 +870,22 @@ bool GpuResources::FindInfo(uint64_t memory, Info* dst)
 
 	Core::LockGuard lock(m_mutex);
 
-	// NOLINTNEXTLINE(readability-use-anyofallof)
-	for (const auto& i: m_infos)
-	{
-		if (!i.free && memory >= i.memory && memory < i.memory + i.size)
-		{
-			*dst = i;
-			return true;
-		}
+	// The oldest slot wins if resources overlap
+	int      found = -1;
+	uint64_t size  = 1;
+	m_map.ForEach(&memory, &size, 1,
+	              [&found](int id)
+	              {
+		              if (found < 0 || id < found)
+		              {
+			              found = id;
+		              }
+	              });
+
+	if (found >= 0)
+	{
+		*dst = m_resources[found].info;
+		return true;
 	}
 
 	return false;
@@ -542,10 +895,16 @@ void GpuMemory::SetAllocatedRange(uint64_t vaddr, uint64_t size)
 {
 	EXIT_IF(size == 0);
 
-	EXIT_NOT_IMPLEMENTED(IsAllocated(vaddr, size));
-
 	Core::LockGuard lock(m_mutex);
 
+	if (int heap_id = GetHeapId(vaddr, size); heap_id >= 0)
+	{
+		// Mapped again after a partial unmap
+		const auto& r = m_heaps[heap_id].range;
+		EXIT_NOT_IMPLEMENTED(vaddr < r.vaddr || vaddr + size > r.vaddr + r.size);
+		return;
+	}
+
 	Heap h;
 	h.range.vaddr  = vaddr;
 	h.range.size   = size;
@@ -555,6 +914,22 @@ void GpuMemory::SetAllocatedRange(uint64_t vaddr, uint64_t size)
 	m_heaps.Add(h);
 }
 
+Vector<GpuMemoryRange> GpuMemory::GetAllocatedRanges()
+{
+	Core::LockGuard lock(m_mutex);
+
+	Vector<GpuMemoryRange> ranges;
+	for (const auto& h: m_heaps)
+	{
+		GpuMemoryRange r;
+		r.vaddr = h.range.vaddr;
+		r.size  = h.range.size;
+		ranges.Add(r);
+	}
+
+	return ranges;
+}
+
 bool GpuMemory::IsAllocated(uint64_t vaddr, uint64_t size)
 {
 	EXIT_IF(size == 0);
@@ -564,6 +939,44 @@ bool GpuMemory::IsAllocated(uint64_t vaddr, uint64_t size)
 	return (GetHeapId(vaddr, size) >= 0);
 }
 
+void GpuMemory::Protect(uint64_t vaddr, uint64_t size, Core::VirtualMemory::Mode mode, Core::VirtualMemory::Mode* old_mode)
+{
+	EXIT_IF(size == 0);
+
+	bool mem_watch = GpuMemoryWatcherEnabled();
+
+	m_watcher.SetGuestMode(vaddr, size, mode, old_mode, mem_watch);
+
+	if (!IsAllocated(vaddr, size))
+	{
+		SetAllocatedRange(vaddr, size);
+		return;
+	}
+
+	if (mem_watch || !Core::VirtualMemory::IsWrite(mode))
+	{
+		return;
+	}
+
+	// Without the watcher CPU writes are found by hashing. A sampled hash may miss them, so the objects in the range get the full
+	// hash on their next use. Other objects are not touched.
+	Core::LockGuard lock(m_mutex);
+
+	int heap_id = GetHeapId(vaddr, size);
+
+	EXIT_IF(heap_id < 0);
+
+	auto& heap = m_heaps[heap_id];
+
+	for (const auto& obj: FindBlocks(heap_id, &vaddr, &size, 1))
+	{
+		auto& o = heap.objects[obj.object_id].info;
+
+		o.submit_id      = 0;
+		o.sampled_checks = Config::GetSampledHashInterval();
+	}
+}
+
 int GpuMemory::GetHeapId(uint64_t vaddr, uint64_t size)
 {
 	int index = 0;
@@ -583,28 +996,270 @@ static uint64_t calc_hash(const uint8_t* buf, uint64_t size)
 {
 	KYTY_PROFILER_FUNCTION();
 
+	GpuCounterAdd(GpuCounter::BytesHashed, size);
+
 	return (size > 0 && buf != nullptr ? XXH64(buf, size, 0) : 0);
 }
 
-static uint64_t get_current_time()
-{
-	static std::atomic_uint64_t t(0);
-	return ++t;
-}
+static constexpr uint64_t SAMPLED_HASH_MIN_SIZE = 256 * 1024;
+static constexpr uint64_t SAMPLED_HASH_LINE     = 64;
+static constexpr uint64_t SAMPLED_HASH_LINES    = 64;
 
-void GpuMemory::Link(int heap_id, int id1, int id2, OverlapType rel, GpuMemoryScenario scenario)
+// Objects that are rarely rewritten by the CPU after the first upload
+static bool sampled_hash_type(GpuMemoryObjectType type)
 {
-	OverlapType other_rel = OverlapType::None;
-	switch (rel)
+	switch (type)
 	{
-		case OverlapType::Equals: other_rel = OverlapType::Equals; break;
-		case OverlapType::IsContainedWithin: other_rel = OverlapType::Contains; break;
-		case OverlapType::Contains: other_rel = OverlapType::IsContainedWithin; break;
-		default: EXIT("invalid rel: %s\n", Core::EnumName(rel).C_Str());
+		case GpuMemoryObjectType::IndexBuffer:
+		case GpuMemoryObjectType::VertexBuffer:
+		case GpuMemoryObjectType::Texture: return true;
+		default: return false;
 	}
+}
+
+// Hash of a fixed set of cache lines spread over the block
+static uint64_t calc_sample_hash(const uint8_t* buf, uint64_t size)
+{
+	KYTY_PROFILER_FUNCTION();
+
+	EXIT_IF(size < SAMPLED_HASH_MIN_SIZE);
+
+	GpuCounterAdd(GpuCounter::BytesHashed, SAMPLED_HASH_LINE * SAMPLED_HASH_LINES);
+
+	uint64_t hash = 0;
+	uint64_t step = (size - SAMPLED_HASH_LINE) / (SAMPLED_HASH_LINES - 1);
+
+	for (uint64_t i = 0; i < SAMPLED_HASH_LINES; i++)
+	{
+		hash = XXH64(buf + i * step, SAMPLED_HASH_LINE, hash);
+	}
+
+	return hash;
+}
+
+static uint64_t get_current_time()
+{
+	static std::atomic_uint64_t t(0);
+	return ++t;
+}
+
+void GpuMemoryWatcher::Protect(uint64_t vaddr, uint64_t size, bool protect)
+{
+	if (size > 0)
+	{
+		[[maybe_unused]] bool ok =
+		    Core::VirtualMemory::Protect(vaddr, size, (protect ? Core::VirtualMemory::Mode::Read : Core::VirtualMemory::Mode::ReadWrite));
+		EXIT_IF(!ok);
+	}
+}
+
+void GpuMemoryWatcher::Watch(const uint64_t* vaddr, const uint64_t* size, int vaddr_num)
+{
+	KYTY_PROFILER_FUNCTION();
+
+	Core::LockGuard lock(m_mutex);
+
+	for (int vi = 0; vi < vaddr_num; vi++)
+	{
+		uint64_t begin = vaddr[vi] & ~(PAGE_SIZE - 1);
+		uint64_t end   = (vaddr[vi] + size[vi] + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
+
+		// Protect adjacent pages with a single call
+		uint64_t run_vaddr = begin;
+		uint64_t run_size  = 0;
+
+		for (uint64_t page = begin; page < end; page += PAGE_SIZE)
+		{
+			auto& p = m_pages[page];
+			if (!p.protect)
+			{
+				p.protect = true;
+				UpdateState(page, p);
+				if (run_vaddr + run_size != page)
+				{
+					Protect(run_vaddr, run_size, true);
+					run_vaddr = page;
+					run_size  = 0;
+				}
+				run_size += PAGE_SIZE;
+			}
+		}
+
+		Protect(run_vaddr, run_size, true);
+	}
+}
+
+bool GpuMemoryWatcher::Unwatch(uint64_t vaddr, uint64_t size)
+{
+	Core::LockGuard lock(m_mutex);
+
+	bool found = false;
+
+	uint64_t begin = vaddr & ~(PAGE_SIZE - 1);
+	uint64_t end   = (vaddr + size + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
+
+	for (uint64_t page = begin; page < end; page += PAGE_SIZE)
+	{
+		if (const auto* f = m_pages.Find(page); f != nullptr && f->protect && !f->read_only)
+		{
+			auto& p      = m_pages[page];
+			p.protect    = false;
+			p.write_time = get_current_time();
+			Protect(page, PAGE_SIZE, false);
+			UpdateState(page, p);
+			m_last_write_time = p.write_time;
+			found             = true;
+		}
+	}
+
+	return found;
+}
+
+// Faults of pages which are not watched return without the lock. A page released by another thread returns true, the write is
+// retried.
+bool GpuMemoryWatcher::WriteFault(uint64_t vaddr)
+{
+	uint64_t page = vaddr & ~(PAGE_SIZE - 1);
+
+	switch (m_states.Get(page))
+	{
+		case PageStateTable::State::None: return false;
+		case PageStateTable::State::Released: return true;
+		default: break;
+	}
+
+	Core::LockGuard lock(m_mutex);
+
+	const auto* found = m_pages.Find(page);
+
+	if (found == nullptr || found->read_only)
+	{
+		return false;
+	}
+
+	auto& p = m_pages[page];
+	if (p.protect)
+	{
+		p.protect    = false;
+		p.write_time = get_current_time();
+		Protect(page, PAGE_SIZE, false);
+		UpdateState(page, p);
+		m_last_write_time = p.write_time;
+	}
+
+	return true;
+}
+
+void GpuMemoryWatcher::Erase(uint64_t vaddr, uint64_t size)
+{
+	Core::LockGuard lock(m_mutex);
+
+	Vector<uint64_t> pages;
+
+	for (m_pages.Start(); !m_pages.End(); m_pages.Next())
+	{
+		if (m_pages.Key() >= vaddr && m_pages.Key() < vaddr + size)
+		{
+			pages.Add(m_pages.Key());
+		}
+	}
+
+	for (auto page: pages)
+	{
+		m_pages.Remove(page);
+		m_states.Set(page, PageStateTable::State::None);
+	}
+}
+
+void GpuMemoryWatcher::SetGuestMode(uint64_t vaddr, uint64_t size, Core::VirtualMemory::Mode mode, Core::VirtualMemory::Mode* old_mode,
+                                    bool track)
+{
+	Core::LockGuard lock(m_mutex);
+
+	[[maybe_unused]] bool ok = Core::VirtualMemory::Protect(vaddr, size, mode, old_mode);
+	EXIT_IF(!ok);
+
+	if (!track)
+	{
+		return;
+	}
+
+	bool read_only = !Core::VirtualMemory::IsWrite(mode);
+
+	uint64_t begin = vaddr & ~(PAGE_SIZE - 1);
+	uint64_t end   = (vaddr + size + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
+
+	// Protect watched pages back with a single call for adjacent pages
+	uint64_t run_vaddr = begin;
+	uint64_t run_size  = 0;
+
+	for (uint64_t page = begin; page < end; page += PAGE_SIZE)
+	{
+		if (!read_only && m_pages.Find(page) == nullptr)
+		{
+			continue;
+		}
+
+		auto& p     = m_pages[page];
+		p.read_only = read_only;
+		UpdateState(page, p);
+
+		if (p.protect && !read_only)
+		{
+			if (run_vaddr + run_size != page)
+			{
+				Protect(run_vaddr, run_size, true);
+				run_vaddr = page;
+				run_size  = 0;
+			}
+			run_size += PAGE_SIZE;
+		}
+	}
+
+	Protect(run_vaddr, run_size, true);
+}
+
+bool GpuMemoryWatcher::IsDirty(const uint64_t* vaddr, const uint64_t* size, int vaddr_num, uint64_t time)
+{
+	KYTY_PROFILER_FUNCTION();
+
+	if (m_last_write_time <= time)
+	{
+		return false;
+	}
+
+	Core::LockGuard lock(m_mutex);
+
+	for (int vi = 0; vi < vaddr_num; vi++)
+	{
+		uint64_t begin = vaddr[vi] & ~(PAGE_SIZE - 1);
+		uint64_t end   = (vaddr[vi] + size[vi] + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
+
+		for (uint64_t page = begin; page < end; page += PAGE_SIZE)
+		{
+			if (const auto* p = m_pages.Find(page); p != nullptr && p->write_time > time)
+			{
+				return true;
+			}
+		}
+	}
+
+	return false;
+}
+
+void GpuMemory::Link(int heap_id, int id1, int id2, OverlapType rel, GpuMemoryScenario scenario)
+{
+	OverlapType other_rel = OverlapType::None;
+	switch (rel)
+	{
+		case OverlapType::Equals: other_rel = OverlapType::Equals; break;
+		case OverlapType::IsContainedWithin: other_rel = OverlapType::Contains; break;
+		case OverlapType::Contains: other_rel = OverlapType::IsContainedWithin; break;
+		default: EXIT("invalid rel: %s\n", Core::EnumName(rel).C_Str());
+	}
+
+	auto& heap = m_heaps[heap_id];
 
-	auto& heap = m_heaps[heap_id];
-
 	auto& h1 = heap.objects[id1];
 	EXIT_IF(h1.free);
 
@@ -628,25 +1283,64 @@ void GpuMemory::Update(uint64_t submit_id, GraphicContext* ctx, int heap_id, int
 	auto& o           = h.info;
 	bool  need_update = false;
 
-	bool mem_watch = false;
+	bool mem_watch = (GpuMemoryWatcherEnabled() && o.check_hash);
+
+	if (mem_watch)
+	{
+		need_update = (!o.watched || o.cpu_update_time > o.gpu_update_time ||
+		               m_watcher.IsDirty(h.block.vaddr, h.block.size, h.block.vaddr_num, o.gpu_update_time));
+
+		for (int vi = 0; need_update && vi < h.block.vaddr_num; vi++)
+		{
+			printf("Update (CPU -> GPU): type = %s, vaddr = 0x%016" PRIx64 ", size = 0x%016" PRIx64 "\n",
+			       Core::EnumName(o.object.type).C_Str(), h.block.vaddr[vi], h.block.size[vi]);
+		}
 
-	if ((mem_watch && o.cpu_update_time > o.gpu_update_time) || (!mem_watch && submit_id > o.submit_id))
+		if (submit_id != UINT64_MAX)
+		{
+			o.submit_id = submit_id;
+		}
+	} else if (submit_id > o.submit_id)
 	{
 		uint64_t hash[VADDR_BLOCKS_MAX] = {};
 
+		// Large objects are checked by a sampled hash first, the full hash runs when the sample changes and every
+		// SampledHashInterval checks
+		uint32_t interval = Config::GetSampledHashInterval();
+		bool     sampled  = (o.check_hash && interval != 0 && sampled_hash_type(o.object.type));
+
+		for (int vi = 0; sampled && vi < h.block.vaddr_num; vi++)
+		{
+			sampled = (h.block.size[vi] >= SAMPLED_HASH_MIN_SIZE);
+		}
+
+		bool sample_changed = !sampled || o.sampled_checks >= interval;
+
+		for (int vi = 0; sampled && vi < h.block.vaddr_num; vi++)
+		{
+			uint64_t sample_hash = calc_sample_hash(reinterpret_cast<const uint8_t*>(h.block.vaddr[vi]), h.block.size[vi]);
+			sample_changed       = sample_changed || (sample_hash != o.sample_hash[vi]);
+			o.sample_hash[vi]    = sample_hash;
+		}
+
 		for (int vi = 0; vi < h.block.vaddr_num; vi++)
 		{
 			EXIT_IF(h.block.size[vi] == 0);
 
-			if (o.check_hash)
+			if (o.check_hash && sample_changed)
 			{
 				hash[vi] = calc_hash(reinterpret_cast<const uint8_t*>(h.block.vaddr[vi]), h.block.size[vi]);
+			} else if (o.check_hash)
+			{
+				hash[vi] = o.hash[vi];
 			} else
 			{
 				hash[vi] = 0;
 			}
 		}
 
+		o.sampled_checks = (sample_changed ? 0 : o.sampled_checks + 1);
+
 		for (int vi = 0; vi < h.block.vaddr_num; vi++)
 		{
 			if (o.hash[vi] != hash[vi])
@@ -667,12 +1361,23 @@ void GpuMemory::Update(uint64_t submit_id, GraphicContext* ctx, int heap_id, int
 	if (need_update)
 	{
 		EXIT_IF(o.update_func == nullptr);
-		o.update_func(ctx, o.params, o.object.obj, h.block.vaddr, h.block.size, h.block.vaddr_num);
-		o.gpu_update_time = get_current_time();
+		if (mem_watch)
+		{
+			// Protect before reading, so that a write during the update is not lost
+			auto time = get_current_time();
+			m_watcher.Watch(h.block.vaddr, h.block.size, h.block.vaddr_num);
+			o.update_func(ctx, o.params, o.object.obj, h.block.vaddr, h.block.size, h.block.vaddr_num);
+			o.gpu_update_time = time;
+			o.watched         = true;
+		} else
+		{
+			o.update_func(ctx, o.params, o.object.obj, h.block.vaddr, h.block.size, h.block.vaddr_num);
+			o.gpu_update_time = get_current_time();
+		}
 	}
 }
 
-bool GpuMemory::create_existing(const Vector<OverlappedBlock>& others, const GpuObject& info, int heap_id, int* id)
+bool GpuMemory::create_existing(const OverlappedBlocks& others, const GpuObject& info, int heap_id, int* id)
 {
 	EXIT_IF(id == nullptr);
 
@@ -724,7 +1429,7 @@ bool GpuMemory::create_existing(const Vector<OverlappedBlock>& others, const Gpu
 	return false;
 }
 
-bool GpuMemory::create_generate_mips(const Vector<OverlappedBlock>& others, GpuMemoryObjectType type, int heap_id)
+bool GpuMemory::create_generate_mips(const OverlappedBlocks& others, GpuMemoryObjectType type, int heap_id)
 {
 	auto& heap = m_heaps[heap_id];
 
@@ -782,7 +1487,7 @@ bool GpuMemory::create_generate_mips(const Vector<OverlappedBlock>& others, GpuM
 	return false;
 }
 
-bool GpuMemory::create_texture_triplet(const Vector<OverlappedBlock>& others, GpuMemoryObjectType type, int heap_id)
+bool GpuMemory::create_texture_triplet(const OverlappedBlocks& others, GpuMemoryObjectType type, int heap_id)
 {
 	auto& heap = m_heaps[heap_id];
 
@@ -808,7 +1513,7 @@ bool GpuMemory::create_texture_triplet(const Vector<OverlappedBlock>& others, Gp
 	return false;
 }
 
-bool GpuMemory::create_maybe_deleted(const Vector<OverlappedBlock>& others, GpuMemoryObjectType type, int heap_id)
+bool GpuMemory::create_maybe_deleted(const OverlappedBlocks& others, GpuMemoryObjectType type, int heap_id)
 {
 	auto& heap = m_heaps[heap_id];
 
@@ -851,7 +1556,7 @@ bool GpuMemory::create_maybe_deleted(const Vector<OverlappedBlock>& others, GpuM
 	return false;
 }
 
-bool GpuMemory::create_all_the_same(const Vector<OverlappedBlock>& others, int heap_id)
+bool GpuMemory::create_all_the_same(const OverlappedBlocks& others, int heap_id)
 {
 	auto&               heap = m_heaps[heap_id];
 	OverlapType         rel  = others.At(0).relation;
@@ -862,7 +1567,7 @@ bool GpuMemory::create_all_the_same(const Vector<OverlappedBlock>& others, int h
 }
 
 String GpuMemory::create_dbg_exit(const String& msg, const uint64_t* vaddr, const uint64_t* size, int vaddr_num,
-                                  const Vector<OverlappedBlock>& others, GpuMemoryObjectType type)
+                                  const OverlappedBlocks& others, GpuMemoryObjectType type)
 {
 	Core::StringList list;
 	list.Add(String::FromPrintf("Exit:"));
@@ -1049,7 +1754,7 @@ void* GpuMemory::CreateObject(uint64_t submit_id, GraphicContext* ctx, CommandBu
 
 	EXIT_IF(delete_all && overlap);
 
-	Vector<Destructor> destructors;
+	Core::SmallVector<Destructor, 8> destructors;
 
 	if (delete_all)
 	{
@@ -1073,11 +1778,13 @@ void* GpuMemory::CreateObject(uint64_t submit_id, GraphicContext* ctx, CommandBu
 
 	uint64_t hash[VADDR_BLOCKS_MAX] = {};
 
+	bool mem_watch = (GpuMemoryWatcherEnabled() && info.check_hash);
+
 	for (int vi = 0; vi < vaddr_num; vi++)
 	{
 		EXIT_IF(size[vi] == 0);
 
-		if (info.check_hash)
+		if (info.check_hash && !mem_watch)
 		{
 			hash[vi] = calc_hash(reinterpret_cast<const uint8_t*>(vaddr[vi]), size[vi]);
 		} else
@@ -1096,6 +1803,12 @@ void* GpuMemory::CreateObject(uint64_t submit_id, GraphicContext* ctx, CommandBu
 	o.gpu_update_time = o.cpu_update_time;
 	o.submit_id       = submit_id;
 
+	if (mem_watch)
+	{
+		m_watcher.Watch(vaddr, size, vaddr_num);
+		o.watched = true;
+	}
+
 	if (create_from_objects)
 	{
 		Vector<GpuMemoryObject> objects;
@@ -1288,12 +2001,14 @@ void GpuMemory::Free(GraphicContext* ctx, uint64_t vaddr, uint64_t size, bool un
 
 	auto object_ids = FindBlocks(heap_id, &vaddr, &size, 1);
 
-	Vector<Destructor> destructors;
+	Core::SmallVector<Destructor, 8> destructors;
 
 	for (const auto& obj: object_ids)
 	{
 		switch (obj.relation)
 		{
+			case OverlapType::Equals:
+			case OverlapType::Contains:
 			case OverlapType::IsContainedWithin:
 			case OverlapType::Crosses: destructors.Add(Free(heap_id, obj.object_id)); break;
 			default: GpuMemoryDbgDump(); EXIT("unknown obj.relation: %s\n", Core::EnumName(obj.relation).C_Str());
@@ -1304,6 +2019,9 @@ void GpuMemory::Free(GraphicContext* ctx, uint64_t vaddr, uint64_t size, bool un
 	{
 		EXIT_NOT_IMPLEMENTED(!IsAllocated(vaddr, size));
 
+		// A part of the range is unmapped: the objects there are gone, the heap stays
+		m_watcher.Erase(vaddr, size);
+
 		int index = 0;
 		for (auto& a: m_heaps)
 		{
@@ -1324,8 +2042,6 @@ void GpuMemory::Free(GraphicContext* ctx, uint64_t vaddr, uint64_t size, bool un
 			}
 			index++;
 		}
-
-		EXIT_NOT_IMPLEMENTED(IsAllocated(vaddr, size));
 	}
 
 	m_mutex.Unlock();
@@ -1386,7 +2102,12 @@ bool GpuMemory::FindFast(int heap_id, const uint64_t* vaddr, const uint64_t* siz
 
 	for (int vi = 0; vi < vaddr_num; vi++)
 	{
-		for (int obj_id: heap.objects_map1->FindAll(vaddr[vi]))
+		const auto* ids = heap.objects_map1->Find(vaddr[vi]);
+		if (ids == nullptr)
+		{
+			continue;
+		}
+		for (int obj_id: *ids)
 		{
 			auto& b = heap.objects[obj_id];
 			EXIT_IF(b.free);
@@ -1423,7 +2144,7 @@ bool GpuMemory::FindFast(int heap_id, const uint64_t* vaddr, const uint64_t* siz
 }
 
 // NOLINTNEXTLINE(readability-function-cognitive-complexity)
-Vector<GpuMemory::OverlappedBlock> GpuMemory::FindBlocks_slow(int heap_id, const uint64_t* vaddr, const uint64_t* size, int vaddr_num,
+GpuMemory::OverlappedBlocks GpuMemory::FindBlocks_slow(int heap_id, const uint64_t* vaddr, const uint64_t* size, int vaddr_num,
                                                               bool only_first)
 {
 	KYTY_PROFILER_BLOCK("GpuMemory::FindBlocks", profiler::colors::Green100);
@@ -1434,7 +2155,7 @@ Vector<GpuMemory::OverlappedBlock> GpuMemory::FindBlocks_slow(int heap_id, const
 	EXIT_IF(vaddr == nullptr || size == nullptr);
 	EXIT_IF(only_first && vaddr_num != 1);
 
-	Vector<GpuMemory::OverlappedBlock> ret;
+	GpuMemory::OverlappedBlocks ret;
 
 	// TODO(): implement interval-tree
 
@@ -1532,7 +2253,7 @@ Vector<GpuMemory::OverlappedBlock> GpuMemory::FindBlocks_slow(int heap_id, const
 }
 
 // NOLINTNEXTLINE(readability-function-cognitive-complexity)
-Vector<GpuMemory::OverlappedBlock> GpuMemory::FindBlocks(int heap_id, const uint64_t* vaddr, const uint64_t* size, int vaddr_num,
+GpuMemory::OverlappedBlocks GpuMemory::FindBlocks(int heap_id, const uint64_t* vaddr, const uint64_t* size, int vaddr_num,
                                                          bool only_first)
 {
 	KYTY_PROFILER_BLOCK("GpuMemory::FindBlocks", profiler::colors::Green100);
@@ -1543,13 +2264,11 @@ Vector<GpuMemory::OverlappedBlock> GpuMemory::FindBlocks(int heap_id, const uint
 	EXIT_IF(vaddr == nullptr || size == nullptr);
 	EXIT_IF(only_first && vaddr_num != 1);
 
-	Vector<GpuMemory::OverlappedBlock> ret;
-
-	// TODO(): implement interval-tree
+	GpuMemory::OverlappedBlocks ret;
 
 	if (vaddr_num != 1)
 	{
-		for (int index: heap.objects_map2->FindAll(vaddr, size, vaddr_num))
+		auto add_block = [&](int index)
 		{
 			const auto& b = heap.objects[index];
 			if (!b.free)
@@ -1590,10 +2309,11 @@ Vector<GpuMemory::OverlappedBlock> GpuMemory::FindBlocks(int heap_id, const uint
 					}
 				}
 			}
-		}
+		};
+		heap.objects_map2->ForEach(vaddr, size, vaddr_num, add_block);
 	} else
 	{
-		for (int index: heap.objects_map2->FindAll(vaddr[0], size[0]))
+		auto add_block = [&](int index)
 		{
 			const auto& b = heap.objects[index];
 			if (!b.free)
@@ -1617,7 +2337,8 @@ Vector<GpuMemory::OverlappedBlock> GpuMemory::FindBlocks(int heap_id, const uint
 					}
 				}
 			}
-		}
+		};
+		heap.objects_map2->ForEach(vaddr, size, 1, add_block);
 	}
 
 	{
@@ -1676,11 +2397,100 @@ void GpuMemory::DeleteBlock(Block* b, int heap_id, int obj_id)
 	}
 }
 
-void GpuMemory::FrameDone()
+void GpuMemory::FrameDone(GraphicContext* ctx)
 {
-	Core::LockGuard lock(m_mutex);
-
+	m_mutex.Lock();
 	m_current_frame++;
+	m_mutex.Unlock();
+
+	uint64_t usage  = 0;
+	uint64_t budget = 0;
+
+	if (ctx != nullptr && ctx->memory_budget && VulkanGetMemoryBudget(ctx, &usage, &budget))
+	{
+		uint64_t limit = budget / 100 * Config::GetGpuMemoryBudgetUsage();
+
+		if (usage > limit)
+		{
+			uint64_t evicted = Evict(ctx, usage - limit);
+
+			printf("Memory budget: usage = %" PRIu64 " MB, budget = %" PRIu64 " MB, evicted = %" PRIu64 " MB\n", usage >> 20u,
+			       budget >> 20u, evicted >> 20u);
+			VulkanMemoryDbgPrint();
+		}
+	}
+}
+
+uint64_t GpuMemory::Evict(GraphicContext* ctx, uint64_t size)
+{
+	KYTY_PROFILER_BLOCK("GpuMemory::Evict", profiler::colors::Green300);
+
+	struct EvictObject
+	{
+		int      heap_id        = -1;
+		int      object_id      = -1;
+		uint64_t use_last_frame = 0;
+	};
+
+	Vector<EvictObject> objects;
+	Vector<Destructor>  destructors;
+
+	m_mutex.Lock();
+
+	// Command buffers of the last frames may still reference the object
+	uint64_t min_age = Config::GetGpuFramesInFlight() + 2;
+
+	int heap_id = 0;
+	for (auto& heap: m_heaps)
+	{
+		int index = 0;
+		for (auto& h: heap.objects)
+		{
+			const auto& o = h.info;
+
+			bool type = (o.object.type == GpuMemoryObjectType::Texture || o.object.type == GpuMemoryObjectType::VertexBuffer ||
+			             o.object.type == GpuMemoryObjectType::IndexBuffer || o.object.type == GpuMemoryObjectType::StorageBuffer);
+
+			// Clean: the contents are the same as in the guest memory and nothing else is built from them
+			bool clean = (o.write_back_func == nullptr || o.read_only || !o.in_use) && h.others.IsEmpty() &&
+			             h.scenario == GpuMemoryScenario::Common;
+
+			if (!h.free && type && clean && (o.mem.property & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT) != 0 &&
+			    o.use_last_frame + min_age < m_current_frame)
+			{
+				objects.Add({heap_id, index, o.use_last_frame});
+			}
+			index++;
+		}
+		heap_id++;
+	}
+
+	objects.Sort([](const EvictObject& a, const EvictObject& b) { return a.use_last_frame < b.use_last_frame; });
+
+	uint64_t evicted = 0;
+	for (const auto& obj: objects)
+	{
+		if (evicted >= size)
+		{
+			break;
+		}
+		evicted += m_heaps[obj.heap_id].objects[obj.object_id].info.mem.requirements.size;
+		destructors.Add(Free(obj.heap_id, obj.object_id));
+	}
+
+	m_mutex.Unlock();
+
+	for (auto& d: destructors)
+	{
+		d.delete_func(ctx, d.obj, &d.mem);
+	}
+
+	if (!destructors.IsEmpty())
+	{
+		VulkanMemoryTrim(ctx);
+	}
+
+	return evicted;
 }
 
 // NOLINTNEXTLINE(readability-function-cognitive-complexity)
@@ -1690,6 +2500,11 @@ void GpuMemory::WriteBack(GraphicContext* ctx, CommandProcessor* cp)
 
 	Core::LockGuard lock(m_mutex);
 
+	if (auto index = m_write_back_pending.Find(cp); m_write_back_pending.IndexValid(index))
+	{
+		m_write_back_pending.RemoveAt(index);
+	}
+
 	struct WriteBackObject
 	{
 		int heap_id   = -1;
@@ -1730,9 +2545,18 @@ void GpuMemory::WriteBack(GraphicContext* ctx, CommandProcessor* cp)
 			auto& o     = h.info;
 			auto& block = h.block;
 
+			bool mem_watch = (GpuMemoryWatcherEnabled() && o.check_hash && o.watched);
+
 			o.write_back_func(ctx, o.params, o.object.obj, block.vaddr, block.size, block.vaddr_num);
 			o.cpu_update_time = get_current_time();
 
+			if (mem_watch)
+			{
+				// The memory now matches the object
+				m_watcher.Watch(block.vaddr, block.size, block.vaddr_num);
+				o.gpu_update_time = o.cpu_update_time;
+			}
+
 			if (!h.others.IsEmpty())
 			{
 				EXIT_NOT_IMPLEMENTED(h.others.Size() != 1);
@@ -1746,6 +2570,7 @@ void GpuMemory::WriteBack(GraphicContext* ctx, CommandProcessor* cp)
 				{
 					o2.hash[vi] = 0;
 				}
+				o2.sampled_checks = UINT32_MAX;
 				Update(o.submit_id, ctx, obj.heap_id, h.others.At(0).object_id);
 
 				for (int vi = 0; vi < block.vaddr_num; vi++)
@@ -1762,7 +2587,7 @@ void GpuMemory::WriteBack(GraphicContext* ctx, CommandProcessor* cp)
 				{
 					uint64_t new_hash = 0;
 
-					if (o.check_hash)
+					if (o.check_hash && !mem_watch)
 					{
 						new_hash = calc_hash(reinterpret_cast<const uint8_t*>(block.vaddr[vi]), block.size[vi]);
 					}
@@ -1782,6 +2607,25 @@ void GpuMemory::WriteBack(GraphicContext* ctx, CommandProcessor* cp)
 	GraphicsRunCommandProcessorUnlock(cp);
 }
 
+void GpuMemory::DeferWriteBack(CommandProcessor* cp)
+{
+	EXIT_IF(cp == nullptr);
+
+	Core::LockGuard lock(m_mutex);
+
+	if (!m_write_back_pending.Contains(cp))
+	{
+		m_write_back_pending.Add(cp);
+	}
+}
+
+bool GpuMemory::IsWriteBackPending(CommandProcessor* cp)
+{
+	Core::LockGuard lock(m_mutex);
+
+	return m_write_back_pending.Contains(cp);
+}
+
 void GpuMemory::Flush(GraphicContext* ctx, uint64_t vaddr, uint64_t size)
 {
 	Core::LockGuard lock(m_mutex);
@@ -1926,7 +2770,7 @@ void GpuMemory::DbgDbDump()
 
 	if (!m_db.IsInvalid())
 	{
-		m_db.Exec("BEGIN TRANSACTION");
+		Core::Database::Transaction transaction(&m_db);
 
 		m_db.Exec("delete from ranges");
 
@@ -2013,7 +2857,7 @@ void GpuMemory::DbgDbDump()
 			heap_id++;
 		}
 
-		m_db.Exec("END TRANSACTION");
+		transaction.Commit();
 	}
 
 	dump_id++;
@@ -2033,6 +2877,7 @@ void GpuMemory::DbgDbSave(const String& file_name)
 			printf("Can't open file: %s\n", file_name.C_Str());
 			return;
 		}
+		db.SetScratchPragmas();
 		m_db.CopyTo(&db);
 		db.Close();
 	}
@@ -2042,27 +2887,554 @@ struct VulkanMemoryStat
 {
 	std::atomic_uint64_t allocated[VK_MAX_MEMORY_TYPES];
 	std::atomic_uint64_t count[VK_MAX_MEMORY_TYPES];
+	std::atomic_uint64_t blocks_size[VK_MAX_MEMORY_TYPES];
+	std::atomic_uint64_t blocks_count[VK_MAX_MEMORY_TYPES];
+	std::atomic_uint64_t dedicated_count[VK_MAX_MEMORY_TYPES];
 };
 
 static VulkanMemoryStat* g_mem_stat = nullptr;
 
-void GpuMemoryInit()
+// Two-level segregated fit (TLSF): free ranges are kept in lists by size class, with bitmaps of the non-empty lists, so both
+// allocation and free take constant time. Offsets and sizes are multiples of the allocator granularity.
+struct VulkanMemoryBlock
 {
-	EXIT_IF(g_gpu_memory != nullptr);
-	EXIT_IF(g_gpu_resources != nullptr);
+	static constexpr uint32_t SL_LOG2  = 4;
+	static constexpr uint32_t SL_COUNT = 1u << SL_LOG2;
+	static constexpr uint32_t FL_COUNT = 32;
+	static constexpr uint32_t NONE     = UINT32_MAX;
 
-	g_gpu_memory    = new GpuMemory;
-	g_gpu_resources = new GpuResources;
+	struct Range
+	{
+		uint32_t offset    = 0;
+		uint32_t size      = 0;
+		uint32_t prev_phys = NONE;
+		uint32_t next_phys = NONE;
+		uint32_t prev_free = NONE;
+		uint32_t next_free = NONE;
+		bool     free      = false;
+	};
+
+	VkDeviceMemory   memory = nullptr;
+	uint32_t         type   = 0;
+	VkDeviceSize     used   = 0;
+	uint8_t*         mapped = nullptr;
+	Vector<Range>    ranges;
+	Vector<uint32_t> unused_ranges;
+	uint32_t         free_num  = 0;
+	uint32_t         fl_bitmap = 0;
+	uint32_t         sl_bitmap[FL_COUNT] {};
+	uint32_t         free_lists[FL_COUNT][SL_COUNT] {};
+};
+
+static uint32_t block_log2(uint32_t i)
+{
+#if KYTY_COMPILER == KYTY_COMPILER_MSVC
+	unsigned long temp = 0;
+	_BitScanReverse(&temp, i | 1u);
+	return temp;
+#else
+	return 31 - __builtin_clz(i | 1u);
+#endif
+}
+
+static uint32_t block_lowest_bit(uint32_t i)
+{
+	EXIT_IF(i == 0);
+#if KYTY_COMPILER == KYTY_COMPILER_MSVC
+	unsigned long temp = 0;
+	_BitScanForward(&temp, i);
+	return temp;
+#else
+	return __builtin_ctz(i);
+#endif
+}
+
+static void block_mapping(uint32_t size, uint32_t* fl, uint32_t* sl)
+{
+	EXIT_IF(size < VulkanMemoryBlock::SL_COUNT);
+
+	*fl = block_log2(size);
+	*sl = (size >> (*fl - VulkanMemoryBlock::SL_LOG2)) ^ VulkanMemoryBlock::SL_COUNT;
+}
+
+static void block_init(VulkanMemoryBlock* block, uint32_t size)
+{
+	for (auto& list: block->free_lists)
+	{
+		for (auto& head: list)
+		{
+			head = VulkanMemoryBlock::NONE;
+		}
+	}
+
+	block->ranges.Add(VulkanMemoryBlock::Range {0, size});
+}
+
+static uint32_t block_new_range(VulkanMemoryBlock* block)
+{
+	if (!block->unused_ranges.IsEmpty())
+	{
+		uint32_t id = block->unused_ranges[block->unused_ranges.Size() - 1];
+		block->unused_ranges.RemoveAt(block->unused_ranges.Size() - 1);
+		block->ranges[id] = VulkanMemoryBlock::Range();
+		return id;
+	}
+	block->ranges.Add(VulkanMemoryBlock::Range());
+	return block->ranges.Size() - 1;
+}
+
+static void block_insert_free(VulkanMemoryBlock* block, uint32_t id)
+{
+	auto& r = block->ranges[id];
+
+	uint32_t fl = 0;
+	uint32_t sl = 0;
+	block_mapping(r.size, &fl, &sl);
+
+	uint32_t& head = block->free_lists[fl][sl];
+
+	r.free      = true;
+	r.prev_free = VulkanMemoryBlock::NONE;
+	r.next_free = head;
+	if (head != VulkanMemoryBlock::NONE)
+	{
+		block->ranges[head].prev_free = id;
+	}
+	head = id;
+
+	block->fl_bitmap |= 1u << fl;
+	block->sl_bitmap[fl] |= 1u << sl;
+	block->free_num++;
+}
+
+static void block_remove_free(VulkanMemoryBlock* block, uint32_t id)
+{
+	auto& r = block->ranges[id];
+
+	EXIT_IF(!r.free);
+
+	uint32_t fl = 0;
+	uint32_t sl = 0;
+	block_mapping(r.size, &fl, &sl);
+
+	if (r.prev_free != VulkanMemoryBlock::NONE)
+	{
+		block->ranges[r.prev_free].next_free = r.next_free;
+	} else
+	{
+		block->free_lists[fl][sl] = r.next_free;
+		if (r.next_free == VulkanMemoryBlock::NONE)
+		{
+			block->sl_bitmap[fl] &= ~(1u << sl);
+			if (block->sl_bitmap[fl] == 0)
+			{
+				block->fl_bitmap &= ~(1u << fl);
+			}
+		}
+	}
+	if (r.next_free != VulkanMemoryBlock::NONE)
+	{
+		block->ranges[r.next_free].prev_free = r.prev_free;
+	}
+
+	r.free      = false;
+	r.prev_free = VulkanMemoryBlock::NONE;
+	r.next_free = VulkanMemoryBlock::NONE;
+	block->free_num--;
+}
+
+// Returns a free range which is not smaller than any size of the class of size
+static uint32_t block_find_free(const VulkanMemoryBlock* block, uint32_t size)
+{
+	// Round up to the next class, so every range of the found list fits
+	size += (1u << (block_log2(size) - VulkanMemoryBlock::SL_LOG2)) - 1;
+
+	uint32_t fl = 0;
+	uint32_t sl = 0;
+	block_mapping(size, &fl, &sl);
+
+	if (fl >= VulkanMemoryBlock::FL_COUNT)
+	{
+		return VulkanMemoryBlock::NONE;
+	}
+
+	uint32_t sl_map = block->sl_bitmap[fl] & (~0u << sl);
+	if (sl_map == 0)
+	{
+		uint32_t fl_map = (fl + 1 < VulkanMemoryBlock::FL_COUNT ? block->fl_bitmap & (~0u << (fl + 1)) : 0);
+		if (fl_map == 0)
+		{
+			return VulkanMemoryBlock::NONE;
+		}
+		fl     = block_lowest_bit(fl_map);
+		sl_map = block->sl_bitmap[fl];
+	}
+
+	return block->free_lists[fl][block_lowest_bit(sl_map)];
+}
+
+// Small and medium objects are placed into large device memory blocks, one block list per memory type. Blocks of host visible types are
+// mapped once and stay mapped.
+class VulkanMemoryAllocator
+{
+public:
+	static constexpr VkDeviceSize BLOCK_SIZE          = static_cast<VkDeviceSize>(64) * 1024 * 1024;
+	static constexpr VkDeviceSize DEDICATED_MIN_SIZE  = BLOCK_SIZE / 4;
+	static constexpr int          EMPTY_BLOCKS_TO_KEEP = 1;
+
+	VulkanMemoryAllocator() = default;
+	virtual ~VulkanMemoryAllocator() { KYTY_NOT_IMPLEMENTED; }
+
+	KYTY_CLASS_NO_COPY(VulkanMemoryAllocator);
+
+	void Init(GraphicContext* ctx);
+
+	[[nodiscard]] const VkPhysicalDeviceMemoryProperties& GetProperties() const { return m_properties; }
+
+	// Returns false if the object should get its own allocation
+	bool Allocate(GraphicContext* ctx, VulkanMemory* mem);
+	void Free(GraphicContext* ctx, VulkanMemory* mem);
+
+	// Defragmentation hook: releases the empty blocks kept for reuse
+	void Trim(GraphicContext* ctx);
+
+	void DbgPrint(Core::StringList* stat);
+
+private:
+	[[nodiscard]] VkDeviceSize AlignSize(VkDeviceSize size) const { return (size + m_granularity - 1) & ~(m_granularity - 1); }
+
+	bool        AllocateFromBlock(VulkanMemoryBlock* block, VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize* offset,
+	                              uint32_t* range_id) const;
+	static void FreeToBlock(VulkanMemoryBlock* block, uint32_t range_id);
+
+	VulkanMemoryBlock* CreateBlock(GraphicContext* ctx, uint32_t type);
+	void               DeleteBlock(GraphicContext* ctx, VulkanMemoryBlock* block);
+
+	Core::Mutex                      m_mutex {"VulkanMemoryAllocator"};
+	bool                             m_initialized = false;
+	VkPhysicalDeviceMemoryProperties m_properties {};
+	VkDeviceSize                     m_granularity = 1;
+	Vector<VulkanMemoryBlock*>       m_blocks[VK_MAX_MEMORY_TYPES];
+};
+
+static VulkanMemoryAllocator* g_mem_allocator = nullptr;
+
+void VulkanMemoryAllocator::Init(GraphicContext* ctx)
+{
+	Core::LockGuard lock(m_mutex);
+
+	if (!m_initialized)
+	{
+		VkPhysicalDeviceProperties device_properties {};
+		vkGetPhysicalDeviceProperties(ctx->physical_device, &device_properties);
+		vkGetPhysicalDeviceMemoryProperties(ctx->physical_device, &m_properties);
+
+		// Buffers and optimal images must not share a granularity page, so every sub-allocation starts and ends on one
+		m_granularity = std::max(device_properties.limits.bufferImageGranularity, static_cast<VkDeviceSize>(256));
+
+		EXIT_NOT_IMPLEMENTED((m_granularity & (m_granularity - 1)) != 0);
+
+		m_initialized = true;
+	}
+}
+
+bool VulkanMemoryAllocator::AllocateFromBlock(VulkanMemoryBlock* block, VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize* offset,
+                                              uint32_t* range_id) const
+{
+	// Every free range starts on the granularity, so this much is enough for any larger alignment
+	auto search_size = static_cast<uint32_t>(size + alignment - m_granularity);
+
+	uint32_t id = block_find_free(block, search_size);
+	if (id == VulkanMemoryBlock::NONE)
+	{
+		return false;
+	}
+
+	block_remove_free(block, id);
+
+	uint32_t start = block->ranges[id].offset;
+	uint32_t pad   = static_cast<uint32_t>(((start + alignment - 1) & ~(alignment - 1)) - start);
+
+	if (pad > 0)
+	{
+		// The previous range is in use, otherwise the two would have been merged
+		uint32_t front = block_new_range(block);
+		auto&    r     = block->ranges[id];
+		auto&    f     = block->ranges[front];
+
+		f.offset    = r.offset;
+		f.size      = pad;
+		f.prev_phys = r.prev_phys;
+		f.next_phys = id;
+		if (r.prev_phys != VulkanMemoryBlock::NONE)
+		{
+			block->ranges[r.prev_phys].next_phys = front;
+		}
+		r.prev_phys = front;
+		r.offset += pad;
+		r.size -= pad;
+
+		block_insert_free(block, front);
+	}
+
+	if (block->ranges[id].size > size)
+	{
+		uint32_t back = block_new_range(block);
+		auto&    r    = block->ranges[id];
+		auto&    b    = block->ranges[back];
+
+		b.offset    = r.offset + static_cast<uint32_t>(size);
+		b.size      = r.size - static_cast<uint32_t>(size);
+		b.prev_phys = id;
+		b.next_phys = r.next_phys;
+		if (r.next_phys != VulkanMemoryBlock::NONE)
+		{
+			block->ranges[r.next_phys].prev_phys = back;
+		}
+		r.next_phys = back;
+		r.size      = static_cast<uint32_t>(size);
+
+		block_insert_free(block, back);
+	}
+
+	block->used += size;
+	*offset   = block->ranges[id].offset;
+	*range_id = id;
+	return true;
+}
+
+void VulkanMemoryAllocator::FreeToBlock(VulkanMemoryBlock* block, uint32_t range_id)
+{
+	EXIT_IF(!block->ranges.IndexValid(range_id));
+	EXIT_IF(block->ranges[range_id].free);
+
+	auto& ranges = block->ranges;
+
+	EXIT_IF(block->used < ranges[range_id].size);
+	block->used -= ranges[range_id].size;
+
+	uint32_t next = ranges[range_id].next_phys;
+	if (next != VulkanMemoryBlock::NONE && ranges[next].free)
+	{
+		block_remove_free(block, next);
+		ranges[range_id].size += ranges[next].size;
+		ranges[range_id].next_phys = ranges[next].next_phys;
+		if (ranges[next].next_phys != VulkanMemoryBlock::NONE)
+		{
+			ranges[ranges[next].next_phys].prev_phys = range_id;
+		}
+		block->unused_ranges.Add(next);
+	}
+
+	uint32_t prev = ranges[range_id].prev_phys;
+	if (prev != VulkanMemoryBlock::NONE && ranges[prev].free)
+	{
+		block_remove_free(block, prev);
+		ranges[prev].size += ranges[range_id].size;
+		ranges[prev].next_phys = ranges[range_id].next_phys;
+		if (ranges[range_id].next_phys != VulkanMemoryBlock::NONE)
+		{
+			ranges[ranges[range_id].next_phys].prev_phys = prev;
+		}
+		block->unused_ranges.Add(range_id);
+		range_id = prev;
+	}
+
+	block_insert_free(block, range_id);
+}
+
+VulkanMemoryBlock* VulkanMemoryAllocator::CreateBlock(GraphicContext* ctx, uint32_t type)
+{
+	VkMemoryAllocateInfo alloc_info {};
+	alloc_info.sType           = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+	alloc_info.pNext           = nullptr;
+	alloc_info.allocationSize  = BLOCK_SIZE;
+	alloc_info.memoryTypeIndex = type;
+
+	VkDeviceMemory memory = nullptr;
+	if (vkAllocateMemory(ctx->device, &alloc_info, nullptr, &memory) != VK_SUCCESS)
+	{
+		return nullptr;
+	}
+
+	auto* block   = new VulkanMemoryBlock;
+	block->memory = memory;
+	block->type   = type;
+	block_init(block, static_cast<uint32_t>(BLOCK_SIZE));
+	block_insert_free(block, 0);
+
+	if ((m_properties.memoryTypes[type].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) != 0)
+	{
+		void* data = nullptr;
+		vkMapMemory(ctx->device, memory, 0, VK_WHOLE_SIZE, 0, &data);
+		EXIT_NOT_IMPLEMENTED(data == nullptr);
+		block->mapped = static_cast<uint8_t*>(data);
+	}
+
+	m_blocks[type].Add(block);
+
+	g_mem_stat->blocks_size[type] += BLOCK_SIZE;
+	g_mem_stat->blocks_count[type]++;
+
+	return block;
+}
+
+void VulkanMemoryAllocator::DeleteBlock(GraphicContext* ctx, VulkanMemoryBlock* block)
+{
+	EXIT_IF(block->used != 0);
+
+	if (block->mapped != nullptr)
+	{
+		vkUnmapMemory(ctx->device, block->memory);
+	}
+	vkFreeMemory(ctx->device, block->memory, nullptr);
+
+	g_mem_stat->blocks_size[block->type] -= BLOCK_SIZE;
+	g_mem_stat->blocks_count[block->type]--;
+
+	m_blocks[block->type].Remove(block);
+	delete block;
+}
+
+bool VulkanMemoryAllocator::Allocate(GraphicContext* ctx, VulkanMemory* mem)
+{
+	if (mem->requirements.size >= DEDICATED_MIN_SIZE || mem->type >= m_properties.memoryTypeCount)
+	{
+		return false;
+	}
+
+	Core::LockGuard lock(m_mutex);
+
+	VkDeviceSize size      = AlignSize(mem->requirements.size);
+	VkDeviceSize alignment = std::max(mem->requirements.alignment, m_granularity);
+	VkDeviceSize offset    = 0;
+	uint32_t     range_id  = 0;
+
+	VulkanMemoryBlock* block = nullptr;
+	for (auto* b: m_blocks[mem->type])
+	{
+		if (AllocateFromBlock(b, size, alignment, &offset, &range_id))
+		{
+			block = b;
+			break;
+		}
+	}
+
+	if (block == nullptr)
+	{
+		block = CreateBlock(ctx, mem->type);
+		if (block == nullptr || !AllocateFromBlock(block, size, alignment, &offset, &range_id))
+		{
+			return false;
+		}
+	}
+
+	mem->memory      = block->memory;
+	mem->offset      = offset;
+	mem->block       = block;
+	mem->block_range = range_id;
+
+	return true;
+}
+
+void VulkanMemoryAllocator::Free(GraphicContext* ctx, VulkanMemory* mem)
+{
+	Core::LockGuard lock(m_mutex);
+
+	auto* block = mem->block;
+
+	EXIT_IF(block->ranges[mem->block_range].offset != mem->offset);
+
+	FreeToBlock(block, mem->block_range);
+
+	if (block->used == 0)
+	{
+		int empty_num = 0;
+		for (auto* b: m_blocks[block->type])
+		{
+			if (b->used == 0)
+			{
+				empty_num++;
+			}
+		}
+		if (empty_num > EMPTY_BLOCKS_TO_KEEP)
+		{
+			DeleteBlock(ctx, block);
+		}
+	}
+
+	mem->block = nullptr;
+}
+
+void VulkanMemoryAllocator::Trim(GraphicContext* ctx)
+{
+	Core::LockGuard lock(m_mutex);
+
+	for (auto& blocks: m_blocks)
+	{
+		Vector<VulkanMemoryBlock*> empty;
+		for (auto* b: blocks)
+		{
+			if (b->used == 0)
+			{
+				empty.Add(b);
+			}
+		}
+		for (auto* b: empty)
+		{
+			DeleteBlock(ctx, b);
+		}
+	}
+}
 
-	g_mem_stat = new VulkanMemoryStat;
+void VulkanMemoryAllocator::DbgPrint(Core::StringList* stat)
+{
+	Core::LockGuard lock(m_mutex);
+
+	for (uint32_t i = 0; i < m_properties.memoryTypeCount; i++)
+	{
+		uint64_t used      = 0;
+		uint32_t fragments = 0;
+		for (const auto* b: m_blocks[i])
+		{
+			used += b->used;
+			fragments += b->free_num;
+		}
+		stat->Add(String::FromPrintf("%u: count = %" PRIu64 ", allocated = %" PRIu64 ", dedicated = %" PRIu64 ", blocks = %" PRIu64
+		                             ", blocks_size = %" PRIu64 ", blocks_used = %" PRIu64 ", free_ranges = %u",
+		                             i, g_mem_stat->count[i].load(), g_mem_stat->allocated[i].load(), g_mem_stat->dedicated_count[i].load(),
+		                             g_mem_stat->blocks_count[i].load(), g_mem_stat->blocks_size[i].load(), used, fragments));
+	}
+}
+
+void GpuMemoryInit()
+{
+	EXIT_IF(g_gpu_memory != nullptr);
+	EXIT_IF(g_gpu_resources != nullptr);
+
+	g_gpu_memory    = new GpuMemory;
+	g_gpu_resources = new GpuResources;
+
+	g_mem_stat      = new VulkanMemoryStat;
+	g_mem_allocator = new VulkanMemoryAllocator;
 
 	for (uint32_t i = 0; i < VK_MAX_MEMORY_TYPES; i++)
 	{
-		g_mem_stat->allocated[i] = 0;
-		g_mem_stat->count[i]     = 0;
+		g_mem_stat->allocated[i]       = 0;
+		g_mem_stat->count[i]           = 0;
+		g_mem_stat->blocks_size[i]     = 0;
+		g_mem_stat->blocks_count[i]    = 0;
+		g_mem_stat->dedicated_count[i] = 0;
 	}
 }
 
+Vector<GpuMemoryRange> GpuMemoryGetAllocatedRanges()
+{
+	EXIT_IF(g_gpu_memory == nullptr);
+
+	return g_gpu_memory->GetAllocatedRanges();
+}
+
 void GpuMemorySetAllocatedRange(uint64_t vaddr, uint64_t size)
 {
 	EXIT_IF(g_gpu_memory == nullptr);
@@ -2078,6 +3450,13 @@ void GpuMemoryFree(GraphicContext* ctx, uint64_t vaddr, uint64_t size, bool unma
 	g_gpu_memory->Free(ctx, vaddr, size, unmap);
 }
 
+void GpuMemoryProtect(uint64_t vaddr, uint64_t size, Core::VirtualMemory::Mode mode, Core::VirtualMemory::Mode* old_mode)
+{
+	EXIT_IF(g_gpu_memory == nullptr);
+
+	g_gpu_memory->Protect(vaddr, size, mode, old_mode);
+}
+
 void* GpuMemoryCreateObject(uint64_t submit_id, GraphicContext* ctx, CommandBuffer* buffer, uint64_t vaddr, uint64_t size,
                             const GpuObject& info)
 {
@@ -2147,11 +3526,11 @@ void GpuMemoryFlushAll(GraphicContext* ctx)
 	g_gpu_memory->FlushAll(ctx);
 }
 
-void GpuMemoryFrameDone()
+void GpuMemoryFrameDone(GraphicContext* ctx)
 {
 	EXIT_IF(g_gpu_memory == nullptr);
 
-	g_gpu_memory->FrameDone();
+	g_gpu_memory->FrameDone(ctx);
 }
 
 void GpuMemoryWriteBack(GraphicContext* ctx, CommandProcessor* cp)
@@ -2163,29 +3542,187 @@ void GpuMemoryWriteBack(GraphicContext* ctx, CommandProcessor* cp)
 	g_gpu_memory->WriteBack(ctx, cp);
 }
 
-bool GpuMemoryCheckAccessViolation(uint64_t /*vaddr*/, uint64_t /*size*/)
+void GpuMemoryDeferWriteBack(CommandProcessor* cp)
 {
-	return false;
+	EXIT_IF(g_gpu_memory == nullptr);
+
+	g_gpu_memory->DeferWriteBack(cp);
+}
+
+void GpuMemoryWriteBackPending(GraphicContext* ctx, CommandProcessor* cp)
+{
+	EXIT_IF(g_gpu_memory == nullptr);
+
+	if (g_gpu_memory->IsWriteBackPending(cp))
+	{
+		g_gpu_memory->WriteBack(ctx, cp);
+	}
+}
+
+bool GpuMemoryWriteFault(uint64_t vaddr)
+{
+	if (g_gpu_memory == nullptr || !GpuMemoryWatcherEnabled())
+	{
+		return false;
+	}
+
+	return g_gpu_memory->WriteFault(vaddr);
+}
+
+bool GpuMemoryCheckAccessViolation(uint64_t vaddr, uint64_t size)
+{
+	if (g_gpu_memory == nullptr || !GpuMemoryWatcherEnabled())
+	{
+		return false;
+	}
+
+	return g_gpu_memory->CheckAccessViolation(vaddr, size);
 }
 
 bool GpuMemoryWatcherEnabled()
 {
+	// Write faults can only be caught on Windows so far
+#if KYTY_PLATFORM == KYTY_PLATFORM_WINDOWS
+	return Config::GpuMemoryWatcherEnabled();
+#else
 	return false;
+#endif
 }
 
-bool VulkanAllocate(GraphicContext* ctx, VulkanMemory* mem)
+static std::atomic_uint64_t g_mem_unique_id_seq = 0;
+
+static VkResult VulkanGetMemoryHostPointerProperties(GraphicContext* ctx, const void* host_ptr,
+                                                     VkMemoryHostPointerPropertiesEXT* properties)
+{
+	EXIT_IF(ctx == nullptr);
+	EXIT_IF(ctx->device == nullptr);
+
+	static auto func = reinterpret_cast<PFN_vkGetMemoryHostPointerPropertiesEXT>(
+	    vkGetDeviceProcAddr(ctx->device, "vkGetMemoryHostPointerPropertiesEXT"));
+
+	if (func != nullptr)
+	{
+		return func(ctx->device, VK_EXTERNAL_MEMORY_HANDLE_TYPE_HOST_ALLOCATION_BIT_EXT, host_ptr, properties);
+	}
+	return VK_ERROR_EXTENSION_NOT_PRESENT;
+}
+
+static uint32_t VulkanFindHostMemoryType(GraphicContext* ctx, uint32_t memory_type_bits)
+{
+	EXIT_IF(g_mem_allocator == nullptr);
+
+	g_mem_allocator->Init(ctx);
+
+	const auto& memory_properties = g_mem_allocator->GetProperties();
+
+	// The CPU keeps using the memory directly, so it must be coherent
+	VkMemoryPropertyFlags property = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+
+	for (uint32_t index = 0; index < memory_properties.memoryTypeCount; index++)
+	{
+		if ((memory_type_bits & (static_cast<uint32_t>(1) << index)) != 0 &&
+		    (memory_properties.memoryTypes[index].propertyFlags & property) == property)
+		{
+			return index;
+		}
+	}
+
+	return UINT32_MAX;
+}
+
+bool VulkanCanImportHost(GraphicContext* ctx, uint64_t vaddr)
+{
+	EXIT_IF(ctx == nullptr);
+
+	if (ctx->host_import_alignment == 0 || (vaddr & (ctx->host_import_alignment - 1)) != 0)
+	{
+		return false;
+	}
+
+	VkMemoryHostPointerPropertiesEXT properties {};
+	properties.sType = VK_STRUCTURE_TYPE_MEMORY_HOST_POINTER_PROPERTIES_EXT;
+	properties.pNext = nullptr;
+
+	if (VulkanGetMemoryHostPointerProperties(ctx, reinterpret_cast<const void*>(vaddr), &properties) != VK_SUCCESS)
+	{
+		return false;
+	}
+
+	return VulkanFindHostMemoryType(ctx, properties.memoryTypeBits) != UINT32_MAX;
+}
+
+// The device memory aliases the guest memory, objects bound to it don't need uploads or write-backs
+bool VulkanAllocateHost(GraphicContext* ctx, VulkanMemory* mem, void* host_ptr)
 {
 	KYTY_PROFILER_FUNCTION();
 
-	static std::atomic_uint64_t seq = 0;
+	EXIT_IF(ctx == nullptr);
+	EXIT_IF(mem == nullptr);
+	EXIT_IF(host_ptr == nullptr);
+	EXIT_IF(mem->memory != nullptr);
+	EXIT_IF(mem->requirements.size == 0);
+	EXIT_IF(ctx->host_import_alignment == 0);
+	EXIT_IF(g_mem_stat == nullptr);
+
+	VkMemoryHostPointerPropertiesEXT properties {};
+	properties.sType = VK_STRUCTURE_TYPE_MEMORY_HOST_POINTER_PROPERTIES_EXT;
+	properties.pNext = nullptr;
+
+	if (VulkanGetMemoryHostPointerProperties(ctx, host_ptr, &properties) != VK_SUCCESS)
+	{
+		return false;
+	}
+
+	uint32_t index = VulkanFindHostMemoryType(ctx, properties.memoryTypeBits & mem->requirements.memoryTypeBits);
+
+	if (index == UINT32_MAX)
+	{
+		return false;
+	}
+
+	VkImportMemoryHostPointerInfoEXT import_info {};
+	import_info.sType        = VK_STRUCTURE_TYPE_IMPORT_MEMORY_HOST_POINTER_INFO_EXT;
+	import_info.pNext        = nullptr;
+	import_info.handleType   = VK_EXTERNAL_MEMORY_HANDLE_TYPE_HOST_ALLOCATION_BIT_EXT;
+	import_info.pHostPointer = host_ptr;
+
+	VkMemoryAllocateInfo alloc_info {};
+	alloc_info.sType           = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+	alloc_info.pNext           = &import_info;
+	alloc_info.allocationSize  = (mem->requirements.size + ctx->host_import_alignment - 1) & ~(ctx->host_import_alignment - 1);
+	alloc_info.memoryTypeIndex = index;
+
+	if (vkAllocateMemory(ctx->device, &alloc_info, nullptr, &mem->memory) != VK_SUCCESS)
+	{
+		mem->memory = nullptr;
+		return false;
+	}
+
+	mem->type      = index;
+	mem->offset    = 0;
+	mem->block     = nullptr;
+	mem->unique_id = ++g_mem_unique_id_seq;
+
+	g_mem_stat->allocated[index] += mem->requirements.size;
+	g_mem_stat->count[index]++;
+	g_mem_stat->dedicated_count[index]++;
+
+	return true;
+}
+
+bool VulkanAllocate(GraphicContext* ctx, VulkanMemory* mem)
+{
+	KYTY_PROFILER_FUNCTION();
 
 	EXIT_IF(ctx == nullptr);
 	EXIT_IF(mem == nullptr);
 	EXIT_IF(mem->memory != nullptr);
 	EXIT_IF(mem->requirements.size == 0);
+	EXIT_IF(g_mem_allocator == nullptr);
+
+	g_mem_allocator->Init(ctx);
 
-	VkPhysicalDeviceMemoryProperties memory_properties {};
-	vkGetPhysicalDeviceMemoryProperties(ctx->physical_device, &memory_properties);
+	const auto& memory_properties = g_mem_allocator->GetProperties();
 
 	uint32_t index = 0;
 	for (; index < memory_properties.memoryTypeCount; index++)
@@ -2199,6 +3736,16 @@ bool VulkanAllocate(GraphicContext* ctx, VulkanMemory* mem)
 
 	mem->type   = index;
 	mem->offset = 0;
+	mem->block  = nullptr;
+
+	mem->unique_id = ++g_mem_unique_id_seq;
+
+	if (g_mem_allocator->Allocate(ctx, mem))
+	{
+		g_mem_stat->allocated[index] += mem->requirements.size;
+		g_mem_stat->count[index]++;
+		return true;
+	}
 
 	VkMemoryAllocateInfo alloc_info {};
 	alloc_info.sType           = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
@@ -2206,24 +3753,18 @@ bool VulkanAllocate(GraphicContext* ctx, VulkanMemory* mem)
 	alloc_info.allocationSize  = mem->requirements.size;
 	alloc_info.memoryTypeIndex = index;
 
-	mem->unique_id = ++seq;
-
 	auto result = vkAllocateMemory(ctx->device, &alloc_info, nullptr, &mem->memory);
 
 	if (result == VK_SUCCESS)
 	{
 		g_mem_stat->allocated[index] += mem->requirements.size;
 		g_mem_stat->count[index]++;
+		g_mem_stat->dedicated_count[index]++;
 		return true;
 	}
 
 	Core::StringList stat;
-	for (uint32_t i = 0; i < memory_properties.memoryTypeCount; i++)
-	{
-		uint64_t allocated = g_mem_stat->allocated[i];
-		uint64_t count     = g_mem_stat->count[i];
-		stat.Add(String::FromPrintf("%u, %" PRIu64 ", %" PRIu64 "", i, count, allocated));
-	}
+	g_mem_allocator->DbgPrint(&stat);
 	g_gpu_memory->DbgDbDump();
 	g_gpu_memory->DbgDbSave(U"_gpu_memory.db");
 	EXIT("size = %" PRIu64 ", index = %u, error: %s:%s\n", mem->requirements.size, index, string_VkResult(result),
@@ -2238,8 +3779,16 @@ void VulkanFree(GraphicContext* ctx, VulkanMemory* mem)
 
 	EXIT_IF(ctx == nullptr);
 	EXIT_IF(mem == nullptr);
+	EXIT_IF(g_mem_allocator == nullptr);
 
-	vkFreeMemory(ctx->device, mem->memory, nullptr);
+	if (mem->block != nullptr)
+	{
+		g_mem_allocator->Free(ctx, mem);
+	} else
+	{
+		vkFreeMemory(ctx->device, mem->memory, nullptr);
+		g_mem_stat->dedicated_count[mem->type]--;
+	}
 
 	g_mem_stat->allocated[mem->type] -= mem->requirements.size;
 	g_mem_stat->count[mem->type]--;
@@ -2247,6 +3796,61 @@ void VulkanFree(GraphicContext* ctx, VulkanMemory* mem)
 	mem->memory = nullptr;
 }
 
+// Sums up the device local heaps
+bool VulkanGetMemoryBudget(GraphicContext* ctx, uint64_t* usage, uint64_t* budget)
+{
+	EXIT_IF(ctx == nullptr);
+	EXIT_IF(usage == nullptr || budget == nullptr);
+
+	if (!ctx->memory_budget)
+	{
+		return false;
+	}
+
+	VkPhysicalDeviceMemoryBudgetPropertiesEXT memory_budget {};
+	memory_budget.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT;
+	memory_budget.pNext = nullptr;
+
+	VkPhysicalDeviceMemoryProperties2 memory_properties2 {};
+	memory_properties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2;
+	memory_properties2.pNext = &memory_budget;
+
+	vkGetPhysicalDeviceMemoryProperties2(ctx->physical_device, &memory_properties2);
+
+	const auto& props = memory_properties2.memoryProperties;
+
+	*usage  = 0;
+	*budget = 0;
+
+	for (uint32_t i = 0; i < props.memoryHeapCount; i++)
+	{
+		if ((props.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) != 0)
+		{
+			*usage += memory_budget.heapUsage[i];
+			*budget += memory_budget.heapBudget[i];
+		}
+	}
+
+	return *budget != 0;
+}
+
+void VulkanMemoryTrim(GraphicContext* ctx)
+{
+	EXIT_IF(ctx == nullptr);
+	EXIT_IF(g_mem_allocator == nullptr);
+
+	g_mem_allocator->Trim(ctx);
+}
+
+void VulkanMemoryDbgPrint()
+{
+	EXIT_IF(g_mem_allocator == nullptr);
+
+	Core::StringList stat;
+	g_mem_allocator->DbgPrint(&stat);
+	printf("Vulkan memory:\n%s\n", stat.Concat(U'\n').C_Str());
+}
+
 void VulkanMapMemory(GraphicContext* ctx, VulkanMemory* mem, void** data)
 {
 	KYTY_PROFILER_FUNCTION();
@@ -2255,7 +3859,15 @@ void VulkanMapMemory(GraphicContext* ctx, VulkanMemory* mem, void** data)
 	EXIT_IF(mem == nullptr);
 	EXIT_IF(data == nullptr);
 
-	vkMapMemory(ctx->device, mem->memory, mem->offset, mem->requirements.size, 0, data);
+	if (mem->block != nullptr)
+	{
+		// Sub-allocated memory is persistently mapped
+		EXIT_NOT_IMPLEMENTED(mem->block->mapped == nullptr);
+		*data = mem->block->mapped + mem->offset;
+	} else
+	{
+		vkMapMemory(ctx->device, mem->memory, mem->offset, mem->requirements.size, 0, data);
+	}
 }
 
 void VulkanUnmapMemory(GraphicContext* ctx, VulkanMemory* mem)
@@ -2265,7 +3877,10 @@ void VulkanUnmapMemory(GraphicContext* ctx, VulkanMemory* mem)
 	EXIT_IF(ctx == nullptr);
 	EXIT_IF(mem == nullptr);
 
-	vkUnmapMemory(ctx->device, mem->memory);
+	if (mem->block == nullptr)
+	{
+		vkUnmapMemory(ctx->device, mem->memory);
+	}
 }
 
 void VulkanBindImageMemory(GraphicContext* ctx, VulkanImage* image, VulkanMemory* mem)
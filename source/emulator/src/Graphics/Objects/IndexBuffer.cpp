@@ -21,16 +21,18 @@ public:
 
 	void RegisterForDelete(VulkanBuffer* buf)
 	{
-		Core::Mutex m_mutex;
+		Core::LockGuard lock(m_mutex);
 
 		m_buffers.Add(buf);
 	}
 
+	VulkanBuffer* GetQuadList(GraphicContext* ctx, uint32_t vertex_count);
+
 	void DeleteAll(GraphicContext* ctx)
 	{
 		KYTY_PROFILER_BLOCK("IndexBufferManager::DeleteAll");
 
-		Core::Mutex m_mutex;
+		Core::LockGuard lock(m_mutex);
 
 		for (auto* vk_obj: m_buffers)
 		{
@@ -47,13 +49,102 @@ public:
 	}
 
 private:
+	static constexpr uint32_t QUAD_LIST_MIN = 1024;
+
 	Core::Mutex m_mutex;
 
 	Vector<VulkanBuffer*> m_buffers;
+
+	VulkanBuffer* m_quad_list     = nullptr;
+	uint32_t      m_quad_list_num = 0;
 };
 
 static IndexBufferManager* g_index_buffer_manager = nullptr;
 
+template <class S, class D>
+static void convert_indices(const S* src, D* dst, uint64_t count, IndexBufferConversion conversion)
+{
+	switch (conversion)
+	{
+		case IndexBufferConversion::None:
+			for (uint64_t i = 0; i < count; i++)
+			{
+				dst[i] = src[i];
+			}
+			break;
+		case IndexBufferConversion::QuadList:
+			for (uint64_t i = 0; i + 3 < count; i += 4, src += 4, dst += 6)
+			{
+				dst[0] = src[0];
+				dst[1] = src[1];
+				dst[2] = src[2];
+				dst[3] = src[0];
+				dst[4] = src[2];
+				dst[5] = src[3];
+			}
+			break;
+		default: EXIT("unknown conversion: %" PRIu64 "\n", static_cast<uint64_t>(conversion));
+	}
+}
+
+// The buffer only grows. The previous one may still be referenced by a submitted command buffer, so it is deleted with the rest.
+VulkanBuffer* IndexBufferManager::GetQuadList(GraphicContext* ctx, uint32_t vertex_count)
+{
+	KYTY_PROFILER_BLOCK("IndexBufferManager::GetQuadList");
+
+	EXIT_IF(ctx == nullptr);
+
+	Core::LockGuard lock(m_mutex);
+
+	uint32_t quads_num = vertex_count / 4;
+
+	if (quads_num > m_quad_list_num)
+	{
+		if (m_quad_list != nullptr)
+		{
+			m_buffers.Add(m_quad_list);
+		}
+
+		uint32_t num = QUAD_LIST_MIN;
+		while (num < quads_num)
+		{
+			num *= 2;
+		}
+
+		auto* indices = new uint32_t[static_cast<uint64_t>(num) * 6];
+		for (uint32_t i = 0; i < num; i++)
+		{
+			uint32_t  v = i * 4;
+			uint32_t* d = indices + static_cast<uint64_t>(i) * 6;
+
+			d[0] = v;
+			d[1] = v + 1;
+			d[2] = v + 2;
+			d[3] = v;
+			d[4] = v + 2;
+			d[5] = v + 3;
+		}
+
+		uint64_t size = static_cast<uint64_t>(num) * 6 * sizeof(uint32_t);
+
+		m_quad_list                  = new VulkanBuffer;
+		m_quad_list->usage           = VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT;
+		m_quad_list->memory.property = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+		m_quad_list->buffer          = nullptr;
+
+		VulkanCreateBuffer(ctx, size, m_quad_list);
+		EXIT_NOT_IMPLEMENTED(m_quad_list->buffer == nullptr);
+
+		UtilUploadBuffer(ctx, m_quad_list, indices, size);
+
+		delete[] indices;
+
+		m_quad_list_num = num;
+	}
+
+	return m_quad_list;
+}
+
 void IndexBufferInit()
 {
 	EXIT_IF(g_index_buffer_manager != nullptr);
@@ -68,7 +159,30 @@ void IndexBufferDeleteAll(GraphicContext* ctx)
 	g_index_buffer_manager->DeleteAll(ctx);
 }
 
-static void* create_func(GraphicContext* ctx, const uint64_t* /*params*/, const uint64_t* vaddr, const uint64_t* size, int vaddr_num,
+uint32_t IndexBufferGetHostIndexSize(uint32_t guest_index_size)
+{
+	return (guest_index_size == 1 ? 2 : guest_index_size);
+}
+
+uint32_t IndexBufferGetHostIndexCount(uint32_t guest_index_count, IndexBufferConversion conversion)
+{
+	switch (conversion)
+	{
+		case IndexBufferConversion::None: return guest_index_count;
+		case IndexBufferConversion::QuadList: return (guest_index_count / 4) * 6;
+		default: EXIT("unknown conversion: %" PRIu64 "\n", static_cast<uint64_t>(conversion));
+	}
+	return 0;
+}
+
+VulkanBuffer* IndexBufferGetQuadList(GraphicContext* ctx, uint32_t vertex_count)
+{
+	EXIT_IF(g_index_buffer_manager == nullptr);
+
+	return g_index_buffer_manager->GetQuadList(ctx, vertex_count);
+}
+
+static void* create_func(GraphicContext* ctx, const uint64_t* params, const uint64_t* vaddr, const uint64_t* size, int vaddr_num,
                          VulkanMemory* mem)
 {
 	KYTY_PROFILER_BLOCK("IndexBufferGpuObject::Create");
@@ -78,32 +192,50 @@ static void* create_func(GraphicContext* ctx, const uint64_t* /*params*/, const
 	EXIT_IF(mem == nullptr);
 	EXIT_IF(ctx == nullptr);
 
+	auto guest_index_size = static_cast<uint32_t>(params[IndexBufferGpuObject::PARAM_INDEX_SIZE]);
+	auto conversion       = static_cast<IndexBufferConversion>(params[IndexBufferGpuObject::PARAM_CONVERSION]);
+
+	EXIT_NOT_IMPLEMENTED(guest_index_size != 1 && guest_index_size != 2 && guest_index_size != 4);
+
+	auto     guest_count     = static_cast<uint32_t>(*size / guest_index_size);
+	uint32_t host_index_size = IndexBufferGetHostIndexSize(guest_index_size);
+	uint64_t host_size       = static_cast<uint64_t>(host_index_size) * IndexBufferGetHostIndexCount(guest_count, conversion);
+
+	EXIT_NOT_IMPLEMENTED(host_size == 0);
+
 	auto* vk_obj = new VulkanBuffer;
 
 	vk_obj->usage           = VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT;
 	vk_obj->memory.property = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
 	vk_obj->buffer          = nullptr;
 
-	VulkanCreateBuffer(ctx, *size, vk_obj);
+	VulkanCreateBuffer(ctx, host_size, vk_obj);
 	EXIT_NOT_IMPLEMENTED(vk_obj->buffer == nullptr);
 
-	VulkanBuffer staging_buffer {};
-	staging_buffer.usage           = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
-	staging_buffer.memory.property = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
-
-	VulkanCreateBuffer(ctx, *size, &staging_buffer);
-	EXIT_NOT_IMPLEMENTED(staging_buffer.buffer == nullptr);
+	if (host_index_size == guest_index_size && conversion == IndexBufferConversion::None)
+	{
+		UtilUploadBuffer(ctx, vk_obj, reinterpret_cast<void*>(*vaddr), host_size);
+	} else
+	{
+		auto* temp_buf = new uint8_t[host_size];
 
-	void* data = nullptr;
-	// vkMapMemory(ctx->device, staging_buffer.memory.memory, staging_buffer.memory.offset, *size, 0, &data);
-	VulkanMapMemory(ctx, &staging_buffer.memory, &data);
-	memcpy(data, reinterpret_cast<void*>(*vaddr), *size);
-	// vkUnmapMemory(ctx->device, staging_buffer.memory.memory);
-	VulkanUnmapMemory(ctx, &staging_buffer.memory);
+		switch (guest_index_size)
+		{
+			case 1:
+				convert_indices(reinterpret_cast<const uint8_t*>(*vaddr), reinterpret_cast<uint16_t*>(temp_buf), guest_count, conversion);
+				break;
+			case 2:
+				convert_indices(reinterpret_cast<const uint16_t*>(*vaddr), reinterpret_cast<uint16_t*>(temp_buf), guest_count, conversion);
+				break;
+			default:
+				convert_indices(reinterpret_cast<const uint32_t*>(*vaddr), reinterpret_cast<uint32_t*>(temp_buf), guest_count, conversion);
+				break;
+		}
 
-	UtilCopyBuffer(&staging_buffer, vk_obj, *size);
+		UtilUploadBuffer(ctx, vk_obj, temp_buf, host_size);
 
-	VulkanDeleteBuffer(ctx, &staging_buffer);
+		delete[] temp_buf;
+	}
 
 	return vk_obj;
 }
@@ -127,9 +259,9 @@ static void delete_func(GraphicContext* /*ctx*/, void* obj, VulkanMemory* /*mem*
 	g_index_buffer_manager->RegisterForDelete(vk_obj);
 }
 
-bool IndexBufferGpuObject::Equal(const uint64_t* /*other*/) const
+bool IndexBufferGpuObject::Equal(const uint64_t* other) const
 {
-	return true;
+	return params[PARAM_INDEX_SIZE] == other[PARAM_INDEX_SIZE] && params[PARAM_CONVERSION] == other[PARAM_CONVERSION];
 }
 
 GpuObject::create_func_t IndexBufferGpuObject::GetCreateFunc() const
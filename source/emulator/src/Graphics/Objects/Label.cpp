@@ -6,15 +6,16 @@
 
 #include "Emulator/Graphics/GraphicContext.h"
 #include "Emulator/Graphics/GraphicsRender.h"
-#include "Emulator/Graphics/GraphicsRun.h"
+#include "Emulator/Kernel/Pthread.h"
 #include "Emulator/Profiler.h"
 
+#include <queue>
+#include <vector>
+
 #ifdef KYTY_EMU_ENABLED
 
 namespace Kyty::Libs::Graphics {
 
-class CommandProcessor;
-
 enum LabelStatus
 {
 	New,
@@ -32,15 +33,33 @@ struct LabelCallbacks
 	LabelGpuObject::callback_t callback_1           = nullptr;
 	LabelGpuObject::callback_t callback_2           = nullptr;
 	uint64_t                   args[LABEL_ARGS_MAX] = {};
+	CommandProcessor*          cp                   = nullptr;
 };
 
+// Fires when the timeline semaphore of the command buffer it was set in reaches the value of that buffer's next submit
 struct Label
 {
-	VkDevice          device = nullptr;
-	VkEvent           event  = nullptr;
-	LabelStatus       status = LabelStatus::New;
-	LabelCallbacks    callbacks;
-	CommandProcessor* cp = nullptr;
+	VkDevice       device    = nullptr;
+	VkSemaphore    semaphore = nullptr;
+	uint64_t       value     = 0;
+	LabelStatus    status    = LabelStatus::New;
+	LabelCallbacks callbacks;
+};
+
+struct LabelPending
+{
+	uint64_t submit_id = 0;
+	uint64_t seq       = 0;
+	Label*   label     = nullptr;
+};
+
+// The top of the queue is the oldest label: the lowest submit id, then the first one set
+struct LabelPendingLater
+{
+	bool operator()(const LabelPending& a, const LabelPending& b) const
+	{
+		return (a.submit_id != b.submit_id ? a.submit_id > b.submit_id : a.seq > b.seq);
+	}
 };
 
 class LabelManager
@@ -60,7 +79,7 @@ public:
 	Label* Create32(GraphicContext* ctx, uint32_t* dst_gpu_addr, uint32_t value, LabelGpuObject::callback_t callback_1,
 	                LabelGpuObject::callback_t callback_2, const uint64_t* args);
 	void   Delete(Label* label);
-	void   Set(CommandBuffer* buffer, Label* label);
+	void   Set(uint64_t submit_id, CommandBuffer* buffer, Label* label);
 
 private:
 	static void ThreadRun(void* data);
@@ -71,46 +90,75 @@ private:
 	Core::Mutex    m_mutex;
 	Core::CondVar  m_cond_var;
 	Vector<Label*> m_labels;
+	uint64_t       m_seq = 0;
+
+	using queue_t = std::priority_queue<LabelPending, std::vector<LabelPending>, LabelPendingLater>;
+
+	// One queue per command processor, the queues of different processors retire independently
+	Vector<CommandProcessor*> m_queue_cps;
+	Vector<queue_t*>          m_queues;
+	int                       m_pending_num = 0;
 };
 
 static LabelManager* g_label_manager = nullptr;
 
+// Upper bound for one sleep of the label thread, labels set while it sleeps are picked up on the next iteration
+constexpr uint64_t LABEL_WAIT_TIMEOUT_NS = 1000000;
+
+// Labels of a command processor retire in submit order, like end-of-pipe events of one GPU queue. The thread waits for the oldest
+// pending label of each queue, so the writes and the interrupts of a submit are done as soon as the GPU completes it.
 void LabelManager::ThreadRun(void* data)
 {
 	auto* manager = static_cast<LabelManager*>(data);
 
+	LibKernel::PthreadSetEmulatorThreadAffinity(LibKernel::EmulatorThread::Label);
+
 	for (;;)
 	{
 		manager->m_mutex.Lock();
 
-		int active_count = 0;
+		while (manager->m_pending_num == 0)
+		{
+			manager->m_cond_var.Wait(&manager->m_mutex);
+		}
 
 		Vector<Label*>         deleted_labels;
 		Vector<LabelCallbacks> fired_labels;
+		Vector<VkSemaphore>    wait_semaphores;
+		Vector<uint64_t>       wait_values;
+		VkDevice               device = nullptr;
 
-		for (auto& label: manager->m_labels)
+		for (auto* queue: manager->m_queues)
 		{
-			if (label->status == LabelStatus::Active || label->status == LabelStatus::ActiveDeleted)
+			while (!queue->empty())
 			{
-				active_count++;
+				auto* label = queue->top().label;
 
-				if (vkGetEventStatus(label->device, label->event) == VK_EVENT_SET)
+				EXIT_IF(label->status != LabelStatus::Active && label->status != LabelStatus::ActiveDeleted);
+
+				uint64_t counter = 0;
+				vkGetSemaphoreCounterValue(label->device, label->semaphore, &counter);
+
+				if (counter < label->value)
 				{
-					if (label->status == LabelStatus::ActiveDeleted)
-					{
-						deleted_labels.Add(label);
-					}
+					wait_semaphores.Add(label->semaphore);
+					wait_values.Add(label->value);
+					device = label->device;
+					break;
+				}
 
-					label->status = LabelStatus::NotActive;
+				queue->pop();
+				manager->m_pending_num--;
 
-					fired_labels.Add(label->callbacks);
+				if (label->status == LabelStatus::ActiveDeleted)
+				{
+					deleted_labels.Add(label);
 				}
-			}
-		}
 
-		if (active_count == 0)
-		{
-			manager->m_cond_var.Wait(&manager->m_mutex);
+				label->status = LabelStatus::NotActive;
+
+				fired_labels.Add(label->callbacks);
+			}
 		}
 
 		for (auto& label: deleted_labels)
@@ -130,6 +178,12 @@ void LabelManager::ThreadRun(void* data)
 		{
 			bool write = true;
 
+			if (label.cp != nullptr)
+			{
+				// Deferred write-backs must land in guest memory before the guest sees the label
+				GraphicsRenderWriteBackPending(label.cp);
+			}
+
 			if (label.callback_1 != nullptr)
 			{
 				write = label.callback_1(label.args);
@@ -157,7 +211,19 @@ void LabelManager::ThreadRun(void* data)
 			}
 		}
 
-		Core::Thread::SleepMicro(100);
+		if (fired_labels.IsEmpty() && !wait_semaphores.IsEmpty())
+		{
+			// Sleep until the GPU completes the oldest submit of any queue
+			VkSemaphoreWaitInfo wait_info {};
+			wait_info.sType          = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+			wait_info.pNext          = nullptr;
+			wait_info.flags          = VK_SEMAPHORE_WAIT_ANY_BIT;
+			wait_info.semaphoreCount = wait_semaphores.Size();
+			wait_info.pSemaphores    = wait_semaphores.GetDataConst();
+			wait_info.pValues        = wait_values.GetDataConst();
+
+			vkWaitSemaphores(device, &wait_info, LABEL_WAIT_TIMEOUT_NS);
+		}
 	}
 }
 
@@ -176,26 +242,17 @@ Label* LabelManager::Create64(GraphicContext* ctx, uint64_t* dst_gpu_addr, uint6
 	label->callbacks.value64        = value;
 	label->callbacks.dst_gpu_addr32 = nullptr;
 	label->callbacks.value32        = 0;
-	label->event                    = nullptr;
+	label->semaphore                = nullptr;
+	label->value                    = 0;
 	label->device                   = ctx->device;
 	label->callbacks.callback_1     = callback_1;
 	label->callbacks.callback_2     = callback_2;
-	label->cp                       = nullptr;
 
 	for (int i = 0; i < LABEL_ARGS_MAX; i++)
 	{
 		label->callbacks.args[i] = args[i];
 	}
 
-	VkEventCreateInfo create_info {};
-	create_info.sType = VK_STRUCTURE_TYPE_EVENT_CREATE_INFO;
-	create_info.pNext = nullptr;
-	create_info.flags = 0;
-
-	vkCreateEvent(ctx->device, &create_info, nullptr, &label->event);
-
-	EXIT_NOT_IMPLEMENTED(label->event == nullptr);
-
 	m_labels.Add(label);
 
 	return label;
@@ -216,26 +273,17 @@ Label* LabelManager::Create32(GraphicContext* ctx, uint32_t* dst_gpu_addr, uint3
 	label->callbacks.value32        = value;
 	label->callbacks.dst_gpu_addr64 = nullptr;
 	label->callbacks.value64        = 0;
-	label->event                    = nullptr;
+	label->semaphore                = nullptr;
+	label->value                    = 0;
 	label->device                   = ctx->device;
 	label->callbacks.callback_1     = callback_1;
 	label->callbacks.callback_2     = callback_2;
-	label->cp                       = nullptr;
 
 	for (int i = 0; i < LABEL_ARGS_MAX; i++)
 	{
 		label->callbacks.args[i] = args[i];
 	}
 
-	VkEventCreateInfo create_info {};
-	create_info.sType = VK_STRUCTURE_TYPE_EVENT_CREATE_INFO;
-	create_info.pNext = nullptr;
-	create_info.flags = 0;
-
-	vkCreateEvent(ctx->device, &create_info, nullptr, &label->event);
-
-	EXIT_NOT_IMPLEMENTED(label->event == nullptr);
-
 	m_labels.Add(label);
 
 	return label;
@@ -244,7 +292,6 @@ Label* LabelManager::Create32(GraphicContext* ctx, uint32_t* dst_gpu_addr, uint3
 bool LabelManager::Remove(Label* label)
 {
 	EXIT_IF(label == nullptr);
-	EXIT_IF(label->event == nullptr);
 	EXIT_IF(label->device == nullptr);
 
 	Core::LockGuard lock(m_mutex);
@@ -270,15 +317,9 @@ bool LabelManager::Remove(Label* label)
 void LabelManager::Destroy(Label* label)
 {
 	EXIT_IF(label == nullptr);
-	EXIT_IF(label->event == nullptr);
 	EXIT_IF(label->device == nullptr);
-	EXIT_IF(label->cp == nullptr);
-
-	// All submitted commands that refer to event must have completed execution
-	GraphicsRunCommandProcessorWait(label->cp);
-
-	vkDestroyEvent(label->device, label->event, nullptr);
 
+	// The label owns no Vulkan objects, the semaphore belongs to the command buffer
 	delete label;
 }
 
@@ -290,12 +331,11 @@ void LabelManager::Delete(Label* label)
 	}
 }
 
-void LabelManager::Set(CommandBuffer* buffer, Label* label)
+void LabelManager::Set(uint64_t submit_id, CommandBuffer* buffer, Label* label)
 {
 	EXIT_IF(label == nullptr);
 	EXIT_IF(buffer == nullptr);
 	EXIT_IF(buffer->IsInvalid());
-	EXIT_IF(label->event == nullptr);
 	EXIT_IF(label->device == nullptr);
 
 	Core::LockGuard lock(m_mutex);
@@ -306,18 +346,29 @@ void LabelManager::Set(CommandBuffer* buffer, Label* label)
 
 	EXIT_NOT_IMPLEMENTED(label->status != LabelStatus::New && label->status != LabelStatus::NotActive);
 
-	label->status = LabelStatus::Active;
+	label->status       = LabelStatus::Active;
+	label->callbacks.cp = buffer->GetParent();
+
+	// The buffer is being recorded, so its next submit signals the value after the current one
+	auto* pool = buffer->GetPool();
 
-	EXIT_IF(label->event == nullptr);
+	label->semaphore = pool->timelines[buffer->GetIndex()];
+	label->value     = pool->timeline_values[buffer->GetIndex()] + 1;
 
-	label->cp = buffer->GetParent();
+	EXIT_NOT_IMPLEMENTED(label->semaphore == nullptr);
 
-	auto* vk_buffer = buffer->GetPool()->buffers[buffer->GetIndex()];
+	auto* cp    = label->callbacks.cp;
+	auto  queue = m_queue_cps.Find(cp);
 
-	EXIT_NOT_IMPLEMENTED(vk_buffer == nullptr);
+	if (!m_queue_cps.IndexValid(queue))
+	{
+		queue = m_queues.Size();
+		m_queue_cps.Add(cp);
+		m_queues.Add(new queue_t);
+	}
 
-	vkResetEvent(label->device, label->event);
-	vkCmdSetEvent(vk_buffer, label->event, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT);
+	m_queues[queue]->push({submit_id, m_seq++, label});
+	m_pending_num++;
 
 	m_cond_var.Signal();
 }
@@ -352,11 +403,11 @@ void LabelDelete(Label* label)
 	g_label_manager->Delete(label);
 }
 
-void LabelSet(CommandBuffer* buffer, Label* label)
+void LabelSet(uint64_t submit_id, CommandBuffer* buffer, Label* label)
 {
 	EXIT_IF(g_label_manager == nullptr);
 
-	g_label_manager->Set(buffer, label);
+	g_label_manager->Set(submit_id, buffer, label);
 }
 
 static void* create_func(GraphicContext* ctx, const uint64_t* params, const uint64_t* vaddr, const uint64_t* size, int vaddr_num,
@@ -32,6 +32,59 @@ static bool buffer_is_tiled(uint64_t vaddr, uint64_t size)
 	return true;
 }
 
+// The same bits in the other color space. A texture which samples a render target in it gets a view instead of a copy.
+static VkFormat get_alias_format(VkFormat format)
+{
+	switch (format)
+	{
+		case VK_FORMAT_R8G8B8A8_UNORM: return VK_FORMAT_R8G8B8A8_SRGB; break;
+		case VK_FORMAT_R8G8B8A8_SRGB: return VK_FORMAT_R8G8B8A8_UNORM; break;
+		case VK_FORMAT_B8G8R8A8_UNORM: return VK_FORMAT_B8G8R8A8_SRGB; break;
+		case VK_FORMAT_B8G8R8A8_SRGB: return VK_FORMAT_B8G8R8A8_UNORM; break;
+		default: break;
+	}
+	return VK_FORMAT_UNDEFINED;
+}
+
+static VkImageView create_view(GraphicContext* ctx, RenderTextureVulkanImage* vk_obj, VkFormat format, bool bgra)
+{
+	VkImageViewCreateInfo create_info {};
+	create_info.sType                           = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+	create_info.pNext                           = nullptr;
+	create_info.flags                           = 0;
+	create_info.image                           = vk_obj->image;
+	create_info.viewType                        = VK_IMAGE_VIEW_TYPE_2D;
+	create_info.format                          = format;
+	create_info.components.r                    = (bgra ? VK_COMPONENT_SWIZZLE_B : VK_COMPONENT_SWIZZLE_IDENTITY);
+	create_info.components.g                    = (bgra ? VK_COMPONENT_SWIZZLE_G : VK_COMPONENT_SWIZZLE_IDENTITY);
+	create_info.components.b                    = (bgra ? VK_COMPONENT_SWIZZLE_R : VK_COMPONENT_SWIZZLE_IDENTITY);
+	create_info.components.a                    = VK_COMPONENT_SWIZZLE_IDENTITY;
+	create_info.subresourceRange.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT;
+	create_info.subresourceRange.baseArrayLayer = 0;
+	create_info.subresourceRange.baseMipLevel   = 0;
+	create_info.subresourceRange.layerCount     = 1;
+	create_info.subresourceRange.levelCount     = 1;
+
+	VkImageView view = nullptr;
+	vkCreateImageView(ctx->device, &create_info, nullptr, &view);
+
+	EXIT_NOT_IMPLEMENTED(view == nullptr);
+
+	return view;
+}
+
+static void create_views(GraphicContext* ctx, RenderTextureVulkanImage* vk_obj)
+{
+	vk_obj->image_view[VulkanImage::VIEW_DEFAULT] = create_view(ctx, vk_obj, vk_obj->format, false);
+	vk_obj->image_view[VulkanImage::VIEW_BGRA]    = create_view(ctx, vk_obj, vk_obj->format, true);
+
+	if (auto alias_format = get_alias_format(vk_obj->format); alias_format != VK_FORMAT_UNDEFINED)
+	{
+		vk_obj->image_view[VulkanImage::VIEW_ALIAS]      = create_view(ctx, vk_obj, alias_format, false);
+		vk_obj->image_view[VulkanImage::VIEW_ALIAS_BGRA] = create_view(ctx, vk_obj, alias_format, true);
+	}
+}
+
 static void update_func(GraphicContext* ctx, const uint64_t* params, void* obj, const uint64_t* vaddr, const uint64_t* size, int vaddr_num)
 {
 	KYTY_PROFILER_BLOCK("RenderTextureObject::update_func");
@@ -183,6 +236,8 @@ static void* create_func(GraphicContext* ctx, const uint64_t* params, const uint
 	vk_obj->format        = vk_format;
 	vk_obj->image         = nullptr;
 
+	UtilApplyRenderScale(vk_obj);
+
 	for (auto& view: vk_obj->image_view)
 	{
 		view = nullptr;
@@ -208,6 +263,19 @@ static void* create_func(GraphicContext* ctx, const uint64_t* params, const uint
 	image_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
 	image_info.samples     = VK_SAMPLE_COUNT_1_BIT;
 
+	VkFormat                       view_formats[] = {vk_obj->format, get_alias_format(vk_obj->format)};
+	VkImageFormatListCreateInfoKHR format_list {};
+	format_list.sType           = VK_STRUCTURE_TYPE_IMAGE_FORMAT_LIST_CREATE_INFO_KHR;
+	format_list.pNext           = nullptr;
+	format_list.viewFormatCount = 2;
+	format_list.pViewFormats    = view_formats;
+
+	if (view_formats[1] != VK_FORMAT_UNDEFINED)
+	{
+		image_info.pNext = &format_list;
+		image_info.flags |= static_cast<VkImageCreateFlags>(VK_IMAGE_CREATE_MUTABLE_FORMAT_BIT);
+	}
+
 	vkCreateImage(ctx->device, &image_info, nullptr, &vk_obj->image);
 
 	EXIT_NOT_IMPLEMENTED(vk_obj->image == nullptr);
@@ -234,46 +302,7 @@ static void* create_func(GraphicContext* ctx, const uint64_t* params, const uint
 
 	update_func(ctx, params, vk_obj, vaddr, size, vaddr_num);
 
-	VkImageViewCreateInfo create_info {};
-	create_info.sType                           = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
-	create_info.pNext                           = nullptr;
-	create_info.flags                           = 0;
-	create_info.image                           = vk_obj->image;
-	create_info.viewType                        = VK_IMAGE_VIEW_TYPE_2D;
-	create_info.format                          = vk_obj->format;
-	create_info.components.r                    = VK_COMPONENT_SWIZZLE_IDENTITY;
-	create_info.components.g                    = VK_COMPONENT_SWIZZLE_IDENTITY;
-	create_info.components.b                    = VK_COMPONENT_SWIZZLE_IDENTITY;
-	create_info.components.a                    = VK_COMPONENT_SWIZZLE_IDENTITY;
-	create_info.subresourceRange.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT;
-	create_info.subresourceRange.baseArrayLayer = 0;
-	create_info.subresourceRange.baseMipLevel   = 0;
-	create_info.subresourceRange.layerCount     = 1;
-	create_info.subresourceRange.levelCount     = 1;
-
-	vkCreateImageView(ctx->device, &create_info, nullptr, &vk_obj->image_view[VulkanImage::VIEW_DEFAULT]);
-
-	VkImageViewCreateInfo create_info2 {};
-	create_info2.sType                           = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
-	create_info2.pNext                           = nullptr;
-	create_info2.flags                           = 0;
-	create_info2.image                           = vk_obj->image;
-	create_info2.viewType                        = VK_IMAGE_VIEW_TYPE_2D;
-	create_info2.format                          = vk_obj->format;
-	create_info2.components.r                    = VK_COMPONENT_SWIZZLE_B;
-	create_info2.components.g                    = VK_COMPONENT_SWIZZLE_G;
-	create_info2.components.b                    = VK_COMPONENT_SWIZZLE_R;
-	create_info2.components.a                    = VK_COMPONENT_SWIZZLE_IDENTITY;
-	create_info2.subresourceRange.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT;
-	create_info2.subresourceRange.baseArrayLayer = 0;
-	create_info2.subresourceRange.baseMipLevel   = 0;
-	create_info2.subresourceRange.layerCount     = 1;
-	create_info2.subresourceRange.levelCount     = 1;
-
-	vkCreateImageView(ctx->device, &create_info2, nullptr, &vk_obj->image_view[VulkanImage::VIEW_BGRA]);
-
-	EXIT_NOT_IMPLEMENTED(vk_obj->image_view[VulkanImage::VIEW_DEFAULT] == nullptr);
-	EXIT_NOT_IMPLEMENTED(vk_obj->image_view[VulkanImage::VIEW_BGRA] == nullptr);
+	create_views(ctx, vk_obj);
 
 	return vk_obj;
 }
@@ -313,6 +342,8 @@ static void* create2_func(GraphicContext* ctx, CommandBuffer* buffer, const uint
 	vk_obj->format        = vk_format;
 	vk_obj->image         = nullptr;
 
+	UtilApplyRenderScale(vk_obj);
+
 	for (auto& view: vk_obj->image_view)
 	{
 		view = nullptr;
@@ -338,6 +369,19 @@ static void* create2_func(GraphicContext* ctx, CommandBuffer* buffer, const uint
 	image_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
 	image_info.samples     = VK_SAMPLE_COUNT_1_BIT;
 
+	VkFormat                       view_formats[] = {vk_obj->format, get_alias_format(vk_obj->format)};
+	VkImageFormatListCreateInfoKHR format_list {};
+	format_list.sType           = VK_STRUCTURE_TYPE_IMAGE_FORMAT_LIST_CREATE_INFO_KHR;
+	format_list.pNext           = nullptr;
+	format_list.viewFormatCount = 2;
+	format_list.pViewFormats    = view_formats;
+
+	if (view_formats[1] != VK_FORMAT_UNDEFINED)
+	{
+		image_info.pNext = &format_list;
+		image_info.flags |= static_cast<VkImageCreateFlags>(VK_IMAGE_CREATE_MUTABLE_FORMAT_BIT);
+	}
+
 	vkCreateImage(ctx->device, &image_info, nullptr, &vk_obj->image);
 
 	EXIT_NOT_IMPLEMENTED(vk_obj->image == nullptr);
@@ -364,46 +408,7 @@ static void* create2_func(GraphicContext* ctx, CommandBuffer* buffer, const uint
 
 	update2_func(ctx, buffer, params, vk_obj, scenario, objects);
 
-	VkImageViewCreateInfo create_info {};
-	create_info.sType                           = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
-	create_info.pNext                           = nullptr;
-	create_info.flags                           = 0;
-	create_info.image                           = vk_obj->image;
-	create_info.viewType                        = VK_IMAGE_VIEW_TYPE_2D;
-	create_info.format                          = vk_obj->format;
-	create_info.components.r                    = VK_COMPONENT_SWIZZLE_IDENTITY;
-	create_info.components.g                    = VK_COMPONENT_SWIZZLE_IDENTITY;
-	create_info.components.b                    = VK_COMPONENT_SWIZZLE_IDENTITY;
-	create_info.components.a                    = VK_COMPONENT_SWIZZLE_IDENTITY;
-	create_info.subresourceRange.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT;
-	create_info.subresourceRange.baseArrayLayer = 0;
-	create_info.subresourceRange.baseMipLevel   = 0;
-	create_info.subresourceRange.layerCount     = 1;
-	create_info.subresourceRange.levelCount     = 1;
-
-	vkCreateImageView(ctx->device, &create_info, nullptr, &vk_obj->image_view[VulkanImage::VIEW_DEFAULT]);
-
-	VkImageViewCreateInfo create_info2 {};
-	create_info2.sType                           = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
-	create_info2.pNext                           = nullptr;
-	create_info2.flags                           = 0;
-	create_info2.image                           = vk_obj->image;
-	create_info2.viewType                        = VK_IMAGE_VIEW_TYPE_2D;
-	create_info2.format                          = vk_obj->format;
-	create_info2.components.r                    = VK_COMPONENT_SWIZZLE_B;
-	create_info2.components.g                    = VK_COMPONENT_SWIZZLE_G;
-	create_info2.components.b                    = VK_COMPONENT_SWIZZLE_R;
-	create_info2.components.a                    = VK_COMPONENT_SWIZZLE_IDENTITY;
-	create_info2.subresourceRange.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT;
-	create_info2.subresourceRange.baseArrayLayer = 0;
-	create_info2.subresourceRange.baseMipLevel   = 0;
-	create_info2.subresourceRange.layerCount     = 1;
-	create_info2.subresourceRange.levelCount     = 1;
-
-	vkCreateImageView(ctx->device, &create_info2, nullptr, &vk_obj->image_view[VulkanImage::VIEW_BGRA]);
-
-	EXIT_NOT_IMPLEMENTED(vk_obj->image_view[VulkanImage::VIEW_DEFAULT] == nullptr);
-	EXIT_NOT_IMPLEMENTED(vk_obj->image_view[VulkanImage::VIEW_BGRA] == nullptr);
+	create_views(ctx, vk_obj);
 
 	return vk_obj;
 }
@@ -421,7 +426,13 @@ static void delete_func(GraphicContext* ctx, void* obj, VulkanMemory* mem)
 
 	DeleteFramebuffer(vk_obj);
 
-	vkDestroyImageView(ctx->device, vk_obj->image_view[VulkanImage::VIEW_DEFAULT], nullptr);
+	for (auto* view: vk_obj->image_view)
+	{
+		if (view != nullptr)
+		{
+			vkDestroyImageView(ctx->device, view, nullptr);
+		}
+	}
 
 	vkDestroyImage(ctx->device, vk_obj->image, nullptr);
 
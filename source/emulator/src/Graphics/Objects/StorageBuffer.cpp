@@ -12,7 +12,7 @@
 
 namespace Kyty::Libs::Graphics {
 
-static void update_func(GraphicContext* ctx, const uint64_t* /*params*/, void* obj, const uint64_t* vaddr, const uint64_t* size,
+static void update_func(GraphicContext* ctx, const uint64_t* params, void* obj, const uint64_t* vaddr, const uint64_t* size,
                         int vaddr_num)
 {
 	KYTY_PROFILER_BLOCK("StorageBufferGpuObject::update_func");
@@ -21,6 +21,11 @@ static void update_func(GraphicContext* ctx, const uint64_t* /*params*/, void* o
 	EXIT_IF(obj == nullptr);
 	EXIT_IF(vaddr == nullptr || size == nullptr || vaddr_num != 1);
 
+	if (params[StorageBufferGpuObject::PARAM_HOST] != 0)
+	{
+		return;
+	}
+
 	auto* vk_obj = reinterpret_cast<StorageVulkanBuffer*>(obj);
 
 	void* data = nullptr;
@@ -48,6 +53,14 @@ static void* create_func(GraphicContext* ctx, const uint64_t* params, const uint
 	                          VK_MEMORY_PROPERTY_HOST_CACHED_BIT;
 	vk_obj->buffer = nullptr;
 
+	if (params[StorageBufferGpuObject::PARAM_HOST] != 0)
+	{
+		VulkanCreateHostBuffer(ctx, reinterpret_cast<void*>(*vaddr), *size, vk_obj);
+		EXIT_NOT_IMPLEMENTED(vk_obj->buffer == nullptr);
+
+		return vk_obj;
+	}
+
 	VulkanCreateBuffer(ctx, *size, vk_obj);
 	EXIT_NOT_IMPLEMENTED(vk_obj->buffer == nullptr);
 
@@ -76,7 +89,7 @@ static void delete_func(GraphicContext* ctx, void* obj, VulkanMemory* /*mem*/)
 	delete vk_obj;
 }
 
-static void write_back(GraphicContext* ctx, const uint64_t* /*params*/, void* obj, const uint64_t* vaddr, const uint64_t* size,
+static void write_back(GraphicContext* ctx, const uint64_t* params, void* obj, const uint64_t* vaddr, const uint64_t* size,
                        int vaddr_num)
 {
 	KYTY_PROFILER_BLOCK("StorageBufferGpuObject::write_back");
@@ -85,6 +98,11 @@ static void write_back(GraphicContext* ctx, const uint64_t* /*params*/, void* ob
 	EXIT_IF(obj == nullptr);
 	EXIT_IF(vaddr == nullptr || size == nullptr || vaddr_num != 1);
 
+	if (params[StorageBufferGpuObject::PARAM_HOST] != 0)
+	{
+		return;
+	}
+
 	auto* vk_obj = reinterpret_cast<StorageVulkanBuffer*>(obj);
 
 	void* data = nullptr;
@@ -106,7 +124,8 @@ static void write_back(GraphicContext* ctx, const uint64_t* /*params*/, void* ob
 
 bool StorageBufferGpuObject::Equal(const uint64_t* other) const
 {
-	return params[0] == other[0] && params[1] == other[1];
+	return params[PARAM_STRIDE] == other[PARAM_STRIDE] && params[PARAM_NUM_RECORDS] == other[PARAM_NUM_RECORDS] &&
+	       params[PARAM_HOST] == other[PARAM_HOST];
 }
 
 GpuObject::create_func_t StorageBufferGpuObject::GetCreateFunc() const
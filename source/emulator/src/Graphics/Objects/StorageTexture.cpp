@@ -6,6 +6,7 @@
 #include "Emulator/Config.h"
 #include "Emulator/Graphics/GraphicContext.h"
 #include "Emulator/Graphics/GraphicsRender.h"
+#include "Emulator/Graphics/PixelConvert.h"
 #include "Emulator/Graphics/Shader.h"
 #include "Emulator/Graphics/Tile.h"
 #include "Emulator/Graphics/Utils.h"
@@ -75,7 +76,7 @@ static bool CheckFormat(GraphicContext* ctx, VkImageCreateInfo* image_info)
 	{
 		if (image_info->format == VK_FORMAT_R8G8B8A8_SRGB)
 		{
-			// TODO() convert SRGB -> LINEAR in shader
+			// texels are decoded on upload, see PixelGetConversion()
 			image_info->format = VK_FORMAT_R8G8B8A8_UNORM;
 			bool result        = CheckFormat(ctx, image_info);
 			printf("replace VK_FORMAT_R8G8B8A8_SRGB => VK_FORMAT_R8G8B8A8_UNORM [%s]\n", (!result ? "FAIL" : "SUCCESS"));
@@ -83,7 +84,7 @@ static bool CheckFormat(GraphicContext* ctx, VkImageCreateInfo* image_info)
 		}
 		if (image_info->format == VK_FORMAT_B8G8R8A8_SRGB)
 		{
-			// TODO() convert SRGB -> LINEAR in shader
+			// texels are decoded on upload, see PixelGetConversion()
 			image_info->format = VK_FORMAT_B8G8R8A8_UNORM;
 			bool result        = CheckFormat(ctx, image_info);
 			printf("replace VK_FORMAT_B8G8R8A8_SRGB => VK_FORMAT_B8G8R8A8_UNORM [%s]\n", (!result ? "FAIL" : "SUCCESS"));
@@ -197,15 +198,22 @@ static void update_func(GraphicContext* ctx, const uint64_t* params, void* obj,
 		}
 	}
 
+	auto conversion = PixelGetConversion(get_texture_format(dfmt, nfmt, fmt), vk_obj->format);
+
 	if (tile == 13)
 	{
 		// EXIT_NOT_IMPLEMENTED(pitch != width);
 		EXIT_NOT_IMPLEMENTED(fmt != 0);
-		auto* temp_buf = new uint8_t[*size];
-		TileConvertTiledToLinear(temp_buf, reinterpret_cast<void*>(*vaddr), TileMode::TextureTiled, dfmt, nfmt, width, height, pitch,
-		                         levels, neo);
-		UtilFillImage(ctx, vk_obj, temp_buf, *size, regions, static_cast<uint64_t>(vk_layout));
-		delete[] temp_buf;
+		auto fill = [=](void* dst)
+		{
+			TileConvertTiledToLinear(dst, reinterpret_cast<void*>(*vaddr), TileMode::TextureTiled, dfmt, nfmt, width, height, pitch, levels,
+			                         neo, conversion);
+		};
+		UtilFillImage(ctx, vk_obj, fill, *size, regions, static_cast<uint64_t>(vk_layout));
+	} else if (tile == 8 && conversion != PixelConversion::None)
+	{
+		auto fill = [=](void* dst) { PixelConvert(conversion, dst, reinterpret_cast<void*>(*vaddr), *size); };
+		UtilFillImage(ctx, vk_obj, fill, *size, regions, static_cast<uint64_t>(vk_layout));
 	} else if (tile == 8)
 	{
 		UtilFillImage(ctx, vk_obj, reinterpret_cast<void*>(*vaddr), *size, regions, static_cast<uint64_t>(vk_layout));
@@ -338,6 +346,9 @@ static void delete_func(GraphicContext* ctx, void* obj, VulkanMemory* mem)
 	EXIT_IF(vk_obj == nullptr);
 	EXIT_IF(ctx == nullptr);
 
+	// The image may still be the target of an upload
+	UtilWaitForUploads();
+
 	DeleteDescriptor(vk_obj);
 
 	vkDestroyImageView(ctx->device, vk_obj->image_view[VulkanImage::VIEW_DEFAULT], nullptr);
@@ -6,11 +6,14 @@
 #include "Emulator/Config.h"
 #include "Emulator/Graphics/GraphicContext.h"
 #include "Emulator/Graphics/GraphicsRender.h"
+#include "Emulator/Graphics/PixelConvert.h"
 #include "Emulator/Graphics/Shader.h"
 #include "Emulator/Graphics/Tile.h"
 #include "Emulator/Graphics/Utils.h"
 #include "Emulator/Profiler.h"
 
+#include <cstring>
+
 // IWYU pragma: no_forward_declare VkImageView_T
 
 #ifdef KYTY_EMU_ENABLED
@@ -65,6 +68,20 @@ static VkFormat get_texture_format(uint32_t dfmt, uint32_t nfmt, uint32_t fmt)
 	return VK_FORMAT_UNDEFINED;
 }
 
+// BC formats which the device can't sample are decoded into RGBA8 on the GPU when the image is uploaded, see UtilDecodeBcImage()
+static uint32_t get_bc_num(VkFormat format)
+{
+	switch (format)
+	{
+		case VK_FORMAT_BC1_RGBA_UNORM_BLOCK: return 1; break;
+		case VK_FORMAT_BC2_UNORM_BLOCK: return 2; break;
+		case VK_FORMAT_BC3_UNORM_BLOCK:
+		case VK_FORMAT_BC3_SRGB_BLOCK: return 3; break;
+		default: return 0;
+	}
+	return 0;
+}
+
 static VkComponentSwizzle get_swizzle(uint8_t s)
 {
 	switch (s)
@@ -87,6 +104,7 @@ static VkImageUsageFlags get_usage()
 	VkImageUsageFlags vk_usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT;
 
 	vk_usage |= VK_IMAGE_USAGE_SAMPLED_BIT;
+	vk_usage |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
 
 	return vk_usage;
 }
@@ -99,7 +117,7 @@ static bool CheckFormat(GraphicContext* ctx, VkImageCreateInfo* image_info)
 	{
 		if (image_info->format == VK_FORMAT_R8G8B8A8_SRGB)
 		{
-			// TODO() convert SRGB -> LINEAR in shader
+			// texels are decoded on upload, see PixelGetConversion()
 			image_info->format = VK_FORMAT_R8G8B8A8_UNORM;
 			bool result        = CheckFormat(ctx, image_info);
 			printf("replace VK_FORMAT_R8G8B8A8_SRGB => VK_FORMAT_R8G8B8A8_UNORM [%s]\n", (!result ? "FAIL" : "SUCCESS"));
@@ -107,12 +125,20 @@ static bool CheckFormat(GraphicContext* ctx, VkImageCreateInfo* image_info)
 		}
 		if (image_info->format == VK_FORMAT_B8G8R8A8_SRGB)
 		{
-			// TODO() convert SRGB -> LINEAR in shader
+			// texels are decoded on upload, see PixelGetConversion()
 			image_info->format = VK_FORMAT_B8G8R8A8_UNORM;
 			bool result        = CheckFormat(ctx, image_info);
 			printf("replace VK_FORMAT_B8G8R8A8_SRGB => VK_FORMAT_B8G8R8A8_UNORM [%s]\n", (!result ? "FAIL" : "SUCCESS"));
 			return result;
 		}
+		if (auto bc = get_bc_num(image_info->format); bc != 0)
+		{
+			// blocks are decoded on upload, see UtilDecodeBcImage()
+			image_info->format = (image_info->format == VK_FORMAT_BC3_SRGB_BLOCK ? VK_FORMAT_R8G8B8A8_SRGB : VK_FORMAT_R8G8B8A8_UNORM);
+			bool result        = CheckFormat(ctx, image_info);
+			printf("replace BC%u => VK_FORMAT_R8G8B8A8 [%s]\n", bc, (!result ? "FAIL" : "SUCCESS"));
+			return result;
+		}
 		return false;
 	}
 	return true;
@@ -222,15 +248,38 @@ static void update_func(GraphicContext* ctx, const uint64_t* params, void* obj,
 
 	if (fmt == 0)
 	{
-		if (tile == 13)
+		auto     requested  = get_texture_format(dfmt, nfmt, fmt);
+		auto     conversion = PixelGetConversion(requested, vk_obj->format);
+		uint32_t bc         = (requested != vk_obj->format ? get_bc_num(requested) : 0);
+
+		if (bc != 0)
+		{
+			auto fill = [=](void* dst)
+			{
+				if (tile == 13)
+				{
+					TileConvertTiledToLinear(dst, reinterpret_cast<void*>(*vaddr), TileMode::TextureTiled, dfmt, nfmt, width, height, pitch,
+					                         levels, neo, PixelConversion::None);
+				} else
+				{
+					std::memcpy(dst, reinterpret_cast<void*>(*vaddr), *size);
+				}
+			};
+			UtilDecodeBcImage(ctx, vk_obj, fill, *size, bc, regions, static_cast<uint64_t>(vk_layout));
+		} else if (tile == 13)
 		{
 			// EXIT_NOT_IMPLEMENTED(pitch != width);
 			EXIT_NOT_IMPLEMENTED(fmt != 0);
-			auto* temp_buf = new uint8_t[*size];
-			TileConvertTiledToLinear(temp_buf, reinterpret_cast<void*>(*vaddr), TileMode::TextureTiled, dfmt, nfmt, width, height, pitch,
-			                         levels, neo);
-			UtilFillImage(ctx, vk_obj, temp_buf, *size, regions, static_cast<uint64_t>(vk_layout));
-			delete[] temp_buf;
+			auto fill = [=](void* dst)
+			{
+				TileConvertTiledToLinear(dst, reinterpret_cast<void*>(*vaddr), TileMode::TextureTiled, dfmt, nfmt, width, height, pitch,
+				                         levels, neo, conversion);
+			};
+			UtilFillImage(ctx, vk_obj, fill, *size, regions, static_cast<uint64_t>(vk_layout));
+		} else if (tile == 8 && conversion != PixelConversion::None)
+		{
+			auto fill = [=](void* dst) { PixelConvert(conversion, dst, reinterpret_cast<void*>(*vaddr), *size); };
+			UtilFillImage(ctx, vk_obj, fill, *size, regions, static_cast<uint64_t>(vk_layout));
 		} else if (tile == 8)
 		{
 			UtilFillImage(ctx, vk_obj, reinterpret_cast<void*>(*vaddr), *size, regions, static_cast<uint64_t>(vk_layout));
@@ -268,7 +317,15 @@ static void update2_func(GraphicContext* ctx, CommandBuffer* buffer, const uint6
 	uint32_t mip_width  = width;
 	uint32_t mip_height = height;
 
-	Vector<ImageImageCopy> regions(levels);
+	// Only mip 0 is copied, the other levels are downsampled from it on the GPU
+	bool gpu_mips = (levels > 1 && UtilCanGenerateMips(ctx, vk_obj) &&
+	                 ((scenario == GpuMemoryScenario::Common && objects.Size() == 1 &&
+	                   objects.At(0).type == GpuMemoryObjectType::RenderTexture) ||
+	                  (scenario == GpuMemoryScenario::GenerateMips && Config::GpuMipGenerationEnabled())));
+
+	uint32_t copy_levels = (gpu_mips ? 1 : levels);
+
+	Vector<ImageImageCopy> regions(copy_levels);
 
 	if (objects.Size() == 1 && objects.At(0).type == GpuMemoryObjectType::StorageTexture && scenario == GpuMemoryScenario::Common)
 	{
@@ -326,13 +383,24 @@ static void update2_func(GraphicContext* ctx, CommandBuffer* buffer, const uint6
 				mip_height /= 2;
 			}
 		}
+	} else if (gpu_mips && scenario == GpuMemoryScenario::Common)
+	{
+		regions[0].src_image = static_cast<RenderTextureVulkanImage*>(objects.At(0).obj);
+		regions[0].src_level = 0;
+		regions[0].dst_level = 0;
+		regions[0].width     = mip_width;
+		regions[0].height    = mip_height;
+		regions[0].src_x     = 0;
+		regions[0].src_y     = 0;
+		regions[0].dst_x     = 0;
+		regions[0].dst_y     = 0;
 		//	} else if (objects.Size() >= 2 && objects.At(0).type == GpuMemoryObjectType::StorageBuffer &&
 		//	           objects.At(1).type == GpuMemoryObjectType::StorageTexture && scenario == GpuMemoryScenario::GenerateMips)
 	} else if (objects.Size() >= 3 && objects.At(0).type == GpuMemoryObjectType::StorageBuffer &&
 	           objects.At(1).type == GpuMemoryObjectType::Texture && objects.At(2).type == GpuMemoryObjectType::StorageTexture &&
 	           scenario == GpuMemoryScenario::GenerateMips)
 	{
-		for (uint32_t i = 0; i < levels; i++)
+		for (uint32_t i = 0; i < copy_levels; i++)
 		{
 			VulkanImage* src_image = nullptr;
 			bool         storage   = false;
@@ -350,8 +418,9 @@ static void update2_func(GraphicContext* ctx, CommandBuffer* buffer, const uint6
 					}
 				} else if (o.type == GpuMemoryObjectType::RenderTexture)
 				{
-					auto* src_obj = static_cast<RenderTextureVulkanImage*>(o.obj);
-					if (mip_width == src_obj->extent.width && mip_height == src_obj->extent.height)
+					auto* src_obj   = static_cast<RenderTextureVulkanImage*>(o.obj);
+					auto  src_guest = src_obj->GetGuestExtent();
+					if (mip_width == src_guest.width && mip_height == src_guest.height)
 					{
 						src_image = src_obj;
 						storage   = false;
@@ -404,10 +473,20 @@ static void update2_func(GraphicContext* ctx, CommandBuffer* buffer, const uint6
 
 	if (buffer == nullptr)
 	{
-		UtilFillImage(ctx, regions, vk_obj, static_cast<uint64_t>(vk_layout));
+		if (gpu_mips)
+		{
+			UtilFillImageGenerateMips(ctx, regions, vk_obj, levels, static_cast<uint64_t>(vk_layout));
+		} else
+		{
+			UtilFillImage(ctx, regions, vk_obj, static_cast<uint64_t>(vk_layout));
+		}
 	} else
 	{
 		UtilImageToImage(buffer, regions, vk_obj, static_cast<uint64_t>(vk_layout));
+		if (gpu_mips)
+		{
+			UtilGenerateMips(buffer, vk_obj, levels, static_cast<uint64_t>(vk_layout));
+		}
 	}
 }
 
@@ -646,6 +725,9 @@ static void delete_func(GraphicContext* ctx, void* obj, VulkanMemory* mem)
 	EXIT_IF(vk_obj == nullptr);
 	EXIT_IF(ctx == nullptr);
 
+	// The image may still be the target of an upload
+	UtilWaitForUploads();
+
 	DeleteDescriptor(vk_obj);
 
 	vkDestroyImageView(ctx->device, vk_obj->image_view[VulkanImage::VIEW_DEFAULT], nullptr);
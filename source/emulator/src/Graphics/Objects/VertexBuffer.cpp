@@ -10,7 +10,7 @@
 
 namespace Kyty::Libs::Graphics {
 
-static void update_func(GraphicContext* ctx, const uint64_t* /*params*/, void* obj, const uint64_t* vaddr, const uint64_t* size,
+static void update_func(GraphicContext* ctx, const uint64_t* params, void* obj, const uint64_t* vaddr, const uint64_t* size,
                         int vaddr_num)
 {
 	KYTY_PROFILER_BLOCK("VertexBufferGpuObject::update_func");
@@ -18,23 +18,14 @@ static void update_func(GraphicContext* ctx, const uint64_t* /*params*/, void* o
 	EXIT_IF(vaddr_num != 1 || size == nullptr || vaddr == nullptr || *vaddr == 0);
 	EXIT_IF(obj == nullptr);
 
-	auto* vk_obj = static_cast<VulkanBuffer*>(obj);
-
-	VulkanBuffer staging_buffer {};
-	staging_buffer.usage           = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
-	staging_buffer.memory.property = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
-
-	VulkanCreateBuffer(ctx, *size, &staging_buffer);
-	EXIT_NOT_IMPLEMENTED(staging_buffer.buffer == nullptr);
-
-	void* data = nullptr;
-	VulkanMapMemory(ctx, &staging_buffer.memory, &data);
-	memcpy(data, reinterpret_cast<void*>(*vaddr), *size);
-	VulkanUnmapMemory(ctx, &staging_buffer.memory);
+	if (params[VertexBufferGpuObject::PARAM_HOST] != 0)
+	{
+		return;
+	}
 
-	UtilCopyBuffer(&staging_buffer, vk_obj, *size);
+	auto* vk_obj = static_cast<VulkanBuffer*>(obj);
 
-	VulkanDeleteBuffer(ctx, &staging_buffer);
+	UtilUploadBuffer(ctx, vk_obj, reinterpret_cast<void*>(*vaddr), *size);
 }
 
 static void* create_func(GraphicContext* ctx, const uint64_t* params, const uint64_t* vaddr, const uint64_t* size, int vaddr_num,
@@ -48,6 +39,17 @@ static void* create_func(GraphicContext* ctx, const uint64_t* params, const uint
 
 	auto* vk_obj = new VulkanBuffer;
 
+	if (params[VertexBufferGpuObject::PARAM_HOST] != 0)
+	{
+		vk_obj->usage  = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT;
+		vk_obj->buffer = nullptr;
+
+		VulkanCreateHostBuffer(ctx, reinterpret_cast<void*>(*vaddr), *size, vk_obj);
+		EXIT_NOT_IMPLEMENTED(vk_obj->buffer == nullptr);
+
+		return vk_obj;
+	}
+
 	vk_obj->usage           = VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT;
 	vk_obj->memory.property = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
 	vk_obj->buffer          = nullptr;
@@ -75,9 +77,9 @@ static void delete_func(GraphicContext* ctx, void* obj, VulkanMemory* /*mem*/)
 	delete vk_obj;
 }
 
-bool VertexBufferGpuObject::Equal(const uint64_t* /*other*/) const
+bool VertexBufferGpuObject::Equal(const uint64_t* other) const
 {
-	return true;
+	return params[PARAM_HOST] == other[PARAM_HOST];
 }
 
 GpuObject::create_func_t VertexBufferGpuObject::GetCreateFunc() const
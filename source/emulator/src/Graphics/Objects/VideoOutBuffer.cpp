@@ -2,6 +2,7 @@
 
 #include "Kyty/Core/DbgAssert.h"
 
+#include "Emulator/Config.h"
 #include "Emulator/Graphics/GraphicContext.h"
 #include "Emulator/Graphics/GraphicsRender.h"
 #include "Emulator/Graphics/Tile.h"
@@ -51,13 +52,21 @@ static void update_func(GraphicContext* ctx, const uint64_t* params, void* obj,
 
 	vk_obj->layout = VK_IMAGE_LAYOUT_UNDEFINED;
 
-	if (tiled && buffer_is_tiled(*vaddr, *size))
+	// A buffer filled with one value looks the same tiled and linear. The GPU detiler doesn't need this check, so the CPU doesn't
+	// scan the whole buffer before every upload.
+	if (tiled && (Config::GpuDetileEnabled() || buffer_is_tiled(*vaddr, *size)))
 	{
 		EXIT_NOT_IMPLEMENTED(width != pitch);
-		auto* temp_buf = new uint8_t[*size];
-		TileConvertTiledToLinear(temp_buf, reinterpret_cast<void*>(*vaddr), TileMode::VideoOutTiled, width, height, neo);
-		UtilFillImage(ctx, vk_obj, temp_buf, *size, pitch, static_cast<uint64_t>(VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL));
-		delete[] temp_buf;
+		if (Config::GpuDetileEnabled())
+		{
+			UtilDetileVideoOutImage(ctx, vk_obj, reinterpret_cast<void*>(*vaddr), *size, width, height, neo,
+			                        static_cast<uint64_t>(VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL));
+		} else
+		{
+			auto fill = [=](void* dst)
+			{ TileConvertTiledToLinear(dst, reinterpret_cast<void*>(*vaddr), TileMode::VideoOutTiled, width, height, neo); };
+			UtilFillImage(ctx, vk_obj, fill, *size, pitch, static_cast<uint64_t>(VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL));
+		}
 	} else
 	{
 		UtilFillImage(ctx, vk_obj, reinterpret_cast<void*>(*vaddr), *size, pitch,
@@ -99,6 +108,8 @@ static void* create_func(GraphicContext* ctx, const uint64_t* params, const uint
 	vk_obj->image         = nullptr;
 	vk_obj->layout        = VK_IMAGE_LAYOUT_UNDEFINED;
 
+	UtilApplyRenderScale(vk_obj);
+
 	for (auto& view: vk_obj->image_view)
 	{
 		view = nullptr;
@@ -0,0 +1,131 @@
+#include "Emulator/Graphics/PixelConvert.h"
+
+#include "Kyty/Core/DbgAssert.h"
+#include "Kyty/Core/JobSystem.h"
+
+#include "Emulator/Graphics/GraphicContext.h"
+#include "Emulator/Profiler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#ifdef KYTY_EMU_ENABLED
+
+namespace Kyty::Libs::Graphics {
+
+// Texels are converted in bands of this size in parallel on the shared pool
+constexpr uint64_t PIXEL_CONVERT_BAND_SIZE = 256 * 1024;
+
+// Color channels of 8-bit sRGB texels are decoded with a table, the alpha channel is linear
+static uint8_t g_srgb_to_linear[256] = {};
+
+static void init_tables()
+{
+	for (int i = 0; i < 256; i++)
+	{
+		double c = static_cast<double>(i) / 255.0;
+		double l = (c <= 0.04045 ? c / 12.92 : std::pow((c + 0.055) / 1.055, 2.4));
+
+		g_srgb_to_linear[i] = static_cast<uint8_t>(std::lround(l * 255.0));
+	}
+}
+
+void PixelConvertInit()
+{
+	init_tables();
+}
+
+PixelConversion PixelGetConversion(uint64_t requested_format, uint64_t image_format)
+{
+	auto requested = static_cast<VkFormat>(requested_format);
+	auto image     = static_cast<VkFormat>(image_format);
+
+	// The red and blue swap of storage images is a part of the view swizzle, the texels are not moved
+	if ((requested == VK_FORMAT_R8G8B8A8_SRGB || requested == VK_FORMAT_B8G8R8A8_SRGB) &&
+	    (image == VK_FORMAT_R8G8B8A8_UNORM || image == VK_FORMAT_B8G8R8A8_UNORM))
+	{
+		return PixelConversion::SrgbToLinear;
+	}
+
+	return PixelConversion::None;
+}
+
+static void convert_srgb_to_linear(uint32_t* dst, const uint32_t* src, uint64_t num)
+{
+	const uint8_t* t = g_srgb_to_linear;
+
+	for (uint64_t i = 0; i < num; i++)
+	{
+		uint32_t p = src[i];
+		dst[i]     = static_cast<uint32_t>(t[p & 0xffu]) | (static_cast<uint32_t>(t[(p >> 8u) & 0xffu]) << 8u) |
+		         (static_cast<uint32_t>(t[(p >> 16u) & 0xffu]) << 16u) | (p & 0xff000000u);
+	}
+}
+
+static void convert_band(PixelConversion conversion, uint8_t* dst, const uint8_t* src, uint64_t size)
+{
+	switch (conversion)
+	{
+		case PixelConversion::SrgbToLinear:
+			EXIT_NOT_IMPLEMENTED((size % 4) != 0);
+			convert_srgb_to_linear(reinterpret_cast<uint32_t*>(dst), reinterpret_cast<const uint32_t*>(src), size / 4);
+			break;
+		default: EXIT("unknown conversion: %d\n", static_cast<int>(conversion));
+	}
+}
+
+void PixelConvert(PixelConversion conversion, void* dst, const void* src, uint64_t size)
+{
+	KYTY_PROFILER_FUNCTION();
+
+	EXIT_IF(dst == nullptr || src == nullptr);
+
+	if (conversion == PixelConversion::None)
+	{
+		if (dst != src)
+		{
+			std::memcpy(dst, src, size);
+		}
+		return;
+	}
+
+	auto*       dst_ptr = static_cast<uint8_t*>(dst);
+	const auto* src_ptr = static_cast<const uint8_t*>(src);
+
+	if (size <= PIXEL_CONVERT_BAND_SIZE)
+	{
+		convert_band(conversion, dst_ptr, src_ptr, size);
+		return;
+	}
+
+	auto bands_num = static_cast<uint32_t>((size + PIXEL_CONVERT_BAND_SIZE - 1) / PIXEL_CONVERT_BAND_SIZE);
+
+	Core::JobSystem::ParallelFor(
+	    bands_num,
+	    [=](uint32_t band)
+	    {
+		    uint64_t offset = band * PIXEL_CONVERT_BAND_SIZE;
+
+		    convert_band(conversion, dst_ptr + offset, src_ptr + offset, std::min(PIXEL_CONVERT_BAND_SIZE, size - offset));
+	    },
+	    Core::JobPriority::High);
+}
+
+void PixelConvertRun(PixelConversion conversion, void* dst, const void* src, uint64_t size)
+{
+	if (conversion == PixelConversion::None)
+	{
+		if (dst != src)
+		{
+			std::memcpy(dst, src, size);
+		}
+		return;
+	}
+
+	convert_band(conversion, static_cast<uint8_t*>(dst), static_cast<const uint8_t*>(src), size);
+}
+
+} // namespace Kyty::Libs::Graphics
+
+#endif // KYTY_EMU_ENABLED
@@ -0,0 +1,290 @@
+#include "Emulator/Graphics/RemoteCache.h"
+
+#include "Kyty/Core/ByteBuffer.h"
+#include "Kyty/Core/DbgAssert.h"
+#include "Kyty/Core/Http.h"
+#include "Kyty/Core/String.h"
+#include "Kyty/Core/Threads.h"
+#include "Kyty/Core/Timer.h"
+
+#include "Emulator/Config.h"
+
+#include <atomic>
+#include <cstring>
+
+//#define XXH_INLINE_ALL
+#include <xxhash/xxhash.h>
+
+#ifdef KYTY_EMU_ENABLED
+
+namespace Kyty::Libs::Graphics {
+
+constexpr uint32_t REMOTE_CACHE_MAX_FAILURES = 3;
+constexpr uint32_t REMOTE_CACHE_QUEUE_ITEMS  = 1024;
+constexpr uint64_t REMOTE_CACHE_QUEUE_LIMIT  = 64u * 1024u * 1024u;
+
+// Precedes the value on the server
+struct RemoteCacheHeader
+{
+	uint64_t key  = 0;
+	uint64_t hash = 0;
+};
+
+struct RemoteCacheItem
+{
+	String               url;
+	Core::ByteBuffer     value; // to upload
+	uint64_t             key      = 0;
+	uint32_t             size_max = 0;
+	RemoteCacheFetchFunc fetch; // nullptr for an upload
+};
+
+struct RemoteCache
+{
+	String                url;
+	uint32_t              timeout = 0;
+	std::atomic<uint32_t> failures {0};
+	Core::Mutex           mutex {"RemoteCache"};
+	Core::CondVar         cond_var;
+	RemoteCacheItem       queue[REMOTE_CACHE_QUEUE_ITEMS]; // ring
+	uint32_t              queue_first = 0;
+	uint32_t              queue_num   = 0;
+	uint64_t              queued_size = 0;
+	uint32_t              sending_num = 0;
+};
+
+static RemoteCache* g_remote_cache = nullptr;
+
+static String remote_cache_url(const char* kind, uint64_t key)
+{
+	return g_remote_cache->url + String::FromPrintf("/%s/%016" PRIx64, kind, key);
+}
+
+// Any response means that the server is up and 404 is an ordinary miss, but a server which answers slower than the timeout delays
+// every miss as much as one which doesn't answer
+static void remote_cache_result(int status, const Core::Timer& t)
+{
+	auto* c = g_remote_cache;
+
+	if (status != 0 && status < 500 && t.GetTimeMs() <= static_cast<double>(c->timeout))
+	{
+		c->failures = 0;
+	} else if (++c->failures == REMOTE_CACHE_MAX_FAILURES)
+	{
+		printf(FG_BRIGHT_RED "Remote cache: %s doesn't respond in time, disabled\n" FG_DEFAULT, c->url.C_Str());
+	}
+}
+
+// The value without the header, false if it doesn't belong to the key
+static bool remote_cache_get(const String& url, uint64_t key, uint32_t size_max, Core::ByteBuffer* value)
+{
+	Core::Timer t;
+	t.Start();
+
+	int status = Core::HttpGet(url, value, g_remote_cache->timeout, size_max + static_cast<uint32_t>(sizeof(RemoteCacheHeader)));
+
+	remote_cache_result(status, t);
+
+	RemoteCacheHeader h;
+
+	if (status != 200 || value->Size() < sizeof(h))
+	{
+		return false;
+	}
+
+	memcpy(&h, value->GetDataConst(), sizeof(h));
+
+	uint32_t size = value->Size() - static_cast<uint32_t>(sizeof(h));
+
+	if (h.key != key || XXH64(value->GetDataConst() + sizeof(h), size, key) != h.hash)
+	{
+		printf(FG_BRIGHT_RED "Remote cache: invalid value %s\n" FG_DEFAULT, url.C_Str());
+		return false;
+	}
+
+	memmove(value->GetData(), value->GetDataConst() + sizeof(h), size);
+	value->Resize(size);
+
+	return true;
+}
+
+static void remote_cache_thread(void* /*arg*/)
+{
+	auto* c = g_remote_cache;
+
+	for (;;)
+	{
+		RemoteCacheItem item;
+
+		{
+			Core::LockGuard lock(c->mutex);
+
+			while (c->queue_num == 0)
+			{
+				c->cond_var.Wait(&c->mutex);
+			}
+
+			item           = std::move(c->queue[c->queue_first]);
+			c->queue_first = (c->queue_first + 1) % REMOTE_CACHE_QUEUE_ITEMS;
+			c->queue_num--;
+			c->sending_num++;
+		}
+
+		if (c->failures < REMOTE_CACHE_MAX_FAILURES)
+		{
+			if (item.fetch != nullptr)
+			{
+				Core::ByteBuffer value;
+				if (remote_cache_get(item.url, item.key, item.size_max, &value))
+				{
+					item.fetch(value);
+				}
+			} else
+			{
+				Core::Timer t;
+				t.Start();
+				remote_cache_result(Core::HttpPut(item.url, item.value.GetDataConst(), item.value.Size(), c->timeout), t);
+			}
+		}
+
+		{
+			Core::LockGuard lock(c->mutex);
+
+			c->queued_size -= item.value.Size();
+			c->sending_num--;
+			c->cond_var.SignalAll();
+		}
+	}
+}
+
+// m_mutex must be locked. False if the queue is full.
+static bool remote_cache_add(RemoteCacheItem&& item)
+{
+	auto* c = g_remote_cache;
+
+	if (c->queue_num == REMOTE_CACHE_QUEUE_ITEMS || c->queued_size + item.value.Size() > REMOTE_CACHE_QUEUE_LIMIT)
+	{
+		return false;
+	}
+
+	c->queued_size += item.value.Size();
+	c->queue[(c->queue_first + c->queue_num) % REMOTE_CACHE_QUEUE_ITEMS] = std::move(item);
+	c->queue_num++;
+	c->cond_var.SignalAll();
+
+	return true;
+}
+
+void RemoteCacheInit()
+{
+	EXIT_IF(g_remote_cache != nullptr);
+
+	auto url = Config::GetRemoteCacheUrl();
+
+	if (url.IsEmpty())
+	{
+		return;
+	}
+
+	Core::HttpUrl u;
+	if (!Core::HttpParseUrl(url, &u))
+	{
+		printf(FG_BRIGHT_RED "Remote cache: invalid url %s\n" FG_DEFAULT, url.C_Str());
+		return;
+	}
+
+	g_remote_cache = new RemoteCache;
+
+	g_remote_cache->url     = (url.EndsWith(U'/') ? url.Left(url.Size() - 1) : url);
+	g_remote_cache->timeout = Config::GetRemoteCacheTimeout();
+
+	Core::Thread t(remote_cache_thread, nullptr);
+	t.Detach();
+
+	printf("Remote cache: %s\n", g_remote_cache->url.C_Str());
+}
+
+bool RemoteCacheEnabled()
+{
+	return g_remote_cache != nullptr && g_remote_cache->failures < REMOTE_CACHE_MAX_FAILURES;
+}
+
+bool RemoteCacheGet(const char* kind, uint64_t key, uint32_t size_max, Core::ByteBuffer* value)
+{
+	EXIT_IF(kind == nullptr || value == nullptr);
+
+	if (!RemoteCacheEnabled())
+	{
+		return false;
+	}
+
+	return remote_cache_get(remote_cache_url(kind, key), key, size_max, value);
+}
+
+void RemoteCacheFetch(const char* kind, uint64_t key, uint32_t size_max, RemoteCacheFetchFunc func)
+{
+	EXIT_IF(kind == nullptr || func == nullptr);
+
+	if (!RemoteCacheEnabled())
+	{
+		return;
+	}
+
+	RemoteCacheItem item;
+	item.url      = remote_cache_url(kind, key);
+	item.key      = key;
+	item.size_max = size_max;
+	item.fetch    = std::move(func);
+
+	Core::LockGuard lock(g_remote_cache->mutex);
+
+	remote_cache_add(std::move(item));
+}
+
+void RemoteCachePut(const char* kind, uint64_t key, const Core::ByteBuffer& value)
+{
+	EXIT_IF(kind == nullptr);
+
+	if (!RemoteCacheEnabled())
+	{
+		return;
+	}
+
+	RemoteCacheHeader h;
+	h.key  = key;
+	h.hash = XXH64(value.GetDataConst(), value.Size(), key);
+
+	RemoteCacheItem item;
+	item.url = remote_cache_url(kind, key);
+	item.value.Resize(static_cast<uint32_t>(sizeof(h)) + value.Size());
+	memcpy(item.value.GetData(), &h, sizeof(h));
+	if (!value.IsEmpty())
+	{
+		memcpy(item.value.GetData() + sizeof(h), value.GetDataConst(), value.Size());
+	}
+
+	Core::LockGuard lock(g_remote_cache->mutex);
+
+	remote_cache_add(std::move(item));
+}
+
+void RemoteCacheFlush()
+{
+	auto* c = g_remote_cache;
+
+	if (c == nullptr)
+	{
+		return;
+	}
+
+	Core::LockGuard lock(c->mutex);
+
+	while (c->queue_num != 0 || c->sending_num != 0)
+	{
+		c->cond_var.Wait(&c->mutex);
+	}
+}
+
+} // namespace Kyty::Libs::Graphics
+
+#endif // KYTY_EMU_ENABLED
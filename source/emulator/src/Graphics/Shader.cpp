@@ -1,18 +1,29 @@
 #include "Emulator/Graphics/Shader.h"
 
+#include "Kyty/Core/BufferPool.h"
+#include "Kyty/Core/ByteBuffer.h"
 #include "Kyty/Core/Common.h"
+#include "Kyty/Core/Compression.h"
 #include "Kyty/Core/DbgAssert.h"
 #include "Kyty/Core/File.h"
+#include "Kyty/Core/JobSystem.h"
 #include "Kyty/Core/MagicEnum.h"
+#include "Kyty/Core/SharedStore.h"
 #include "Kyty/Core/String.h"
 #include "Kyty/Core/String8.h"
+#include "Kyty/Core/Threads.h"
 #include "Kyty/Core/Vector.h"
 
 #include "Emulator/Config.h"
+#include "Emulator/Graphics/DumpWriter.h"
+#include "Emulator/Graphics/GpuCounters.h"
+#include "Emulator/Graphics/Graphics.h"
 #include "Emulator/Graphics/GraphicsRun.h"
 #include "Emulator/Graphics/HardwareContext.h"
+#include "Emulator/Graphics/RemoteCache.h"
 #include "Emulator/Graphics/ShaderParse.h"
 #include "Emulator/Graphics/ShaderSpirv.h"
+#include "Emulator/Graphics/ShaderSpirvBinary.h"
 #include "Emulator/Profiler.h"
 
 #include "spirv-tools/libspirv.h"
@@ -25,6 +36,9 @@
 #include <unordered_map>
 #include <vector>
 
+//#define XXH_INLINE_ALL
+#include <xxhash/xxhash.h>
+
 //#define SPIRV_CROSS_EXCEPTIONS_TO_ASSERTIONS
 //#include "spirv_cross/spirv_glsl.hpp"
 
@@ -90,6 +104,21 @@ struct ShaderParsedUsage
 	int  direct_sgprs              = 0;
 };
 
+struct ShaderCacheHeader
+{
+	uint32_t magic             = 0;
+	uint32_t version           = 0;
+	uint32_t emu_version       = 0;
+	uint32_t type              = 0;
+	uint32_t optimization      = 0;
+	uint32_t code_optimization = 0;
+	uint32_t next_gen          = 0;
+	uint32_t hash0             = 0;
+	uint32_t crc32             = 0;
+	uint32_t ids_num           = 0;
+	uint32_t spirv_num         = 0;
+};
+
 struct ShaderDebugPrintfCmds
 {
 	uint64_t                  id = 0;
@@ -99,12 +128,72 @@ struct ShaderDebugPrintfCmds
 static Vector<uint64_t>*                               g_disabled_shaders = nullptr;
 static Vector<ShaderDebugPrintfCmds>*                  g_debug_printfs    = nullptr;
 static std::unordered_map<uint64_t, ShaderMappedData>* g_shader_map       = nullptr;
+static uint32_t                                        g_push_constants_max = 128;
+
+// A vertex buffer descriptor read by a fetch shader and the registers it fills
+struct ShaderFetchLoad
+{
+	uint32_t buffer_index[4] = {};
+	int      register_start  = 0;
+	int      registers_num   = 0;
+};
+
+// Fetch shaders are decoded once, the draws only read the descriptors their loads point to
+struct ShaderFetchLayout
+{
+	uint64_t                hash = 0;
+	uint32_t                size = 0; // Bytes of code
+	Vector<ShaderFetchLoad> loads;
+};
+
+// Used by ShaderGetInputInfoVS() only, under the render mutex
+static std::unordered_map<uint64_t, ShaderFetchLayout>* g_fetch_layouts = nullptr;
+
+// Guest code decoded by ShaderPrefetch() before the draw needs it
+struct ShaderPrefetched
+{
+	ShaderType type  = ShaderType::Unknown;
+	uint32_t   hash0 = 0;
+	uint32_t   crc32 = 0;
+	bool       ready = false;
+	ShaderCode code;
+};
+
+// Pipeline creation runs its stages on the shared job pool and waits, prefetches are queued and picked up later by
+// ShaderParseVS/PS/CS
+class ShaderTranslator
+{
+public:
+	ShaderTranslator() = default;
+	virtual ~ShaderTranslator() { KYTY_NOT_IMPLEMENTED; }
+
+	KYTY_CLASS_NO_COPY(ShaderTranslator);
+
+	static void Run(std::function<void()>* tasks, uint32_t num)
+	{
+		Core::JobSystem::ParallelFor(num, [tasks](uint32_t i) { tasks[i](); }, Core::JobPriority::High);
+	}
+
+	void Prefetch(ShaderType type, const uint32_t* src);
+	bool FindPrefetched(ShaderType type, const uint32_t* src, uint32_t hash0, uint32_t crc32, ShaderCode* code);
+
+private:
+	Core::Mutex                                     m_mutex {"ShaderTranslator"};
+	Core::CondVar                                   m_cond_var;
+	std::unordered_map<uint64_t, ShaderPrefetched*> m_prefetched;
+};
+
+static ShaderTranslator* g_translator = nullptr;
 
 void ShaderInit()
 {
 	EXIT_IF(g_shader_map != nullptr);
+	EXIT_IF(g_fetch_layouts != nullptr);
+	EXIT_IF(g_translator != nullptr);
 
-	g_shader_map = new std::unordered_map<uint64_t, ShaderMappedData>();
+	g_shader_map    = new std::unordered_map<uint64_t, ShaderMappedData>();
+	g_fetch_layouts = new std::unordered_map<uint64_t, ShaderFetchLayout>();
+	g_translator    = new ShaderTranslator;
 }
 
 void ShaderMapUserData(uint64_t addr, const ShaderMappedData& data)
@@ -114,6 +203,11 @@ void ShaderMapUserData(uint64_t addr, const ShaderMappedData& data)
 	g_shader_map->insert({addr, data});
 }
 
+void ShaderSetPushConstantsMax(uint32_t size)
+{
+	g_push_constants_max = size;
+}
+
 static String8 operand_to_str(ShaderOperand op)
 {
 	String8 ret = "???";
@@ -867,8 +961,13 @@ static bool SpirvRun(const String8& src, Vector<uint32_t>* dst, String8* err_msg
 
 	dst->Clear();
 
+	// The text is assembled by spirv-tools only if asked or if the encoder doesn't know some instruction
 	std::vector<uint32_t> spirv;
-	if (!core.Assemble(src.GetDataConst(), src.Size(), &spirv))
+	if (!Config::SpirvTextAssemblerEnabled() && SpirvEncodeBinary(src, dst))
+	{
+		spirv.assign(dst->begin(), dst->end());
+		dst->Clear();
+	} else if (!core.Assemble(src.GetDataConst(), src.Size(), &spirv))
 	{
 		printf("Assemble failed at:\n%s\n", src.Mid(src.FindIndex('\n', error_position.index - 100), 200).c_str());
 		*err_msg = String8::FromPrintf("Assemble failed at:\n%s\n", src.Mid(src.FindIndex('\n', error_position.index - 100), 200).c_str());
@@ -918,6 +1017,111 @@ static const ShaderBinaryInfo* GetBinaryInfo(const uint32_t* code)
 	return nullptr;
 }
 
+void ShaderTranslator::Prefetch(ShaderType type, const uint32_t* src)
+{
+	const auto* header = GetBinaryInfo(src);
+
+	if (header == nullptr)
+	{
+		return;
+	}
+
+	auto id = (static_cast<uint64_t>(header->hash0) << 32u) | header->crc32;
+
+	if (g_disabled_shaders != nullptr && g_disabled_shaders->Contains(id))
+	{
+		return;
+	}
+
+	auto* entry  = new ShaderPrefetched;
+	entry->type  = type;
+	entry->hash0 = header->hash0;
+	entry->crc32 = header->crc32;
+
+	{
+		Core::LockGuard lock(m_mutex);
+
+		auto& slot = m_prefetched[reinterpret_cast<uint64_t>(src)];
+		if (slot != nullptr)
+		{
+			// Same code was already decoded, or the old one is still in flight and the draw will parse the new one itself
+			if ((slot->type == type && slot->hash0 == entry->hash0 && slot->crc32 == entry->crc32) || !slot->ready)
+			{
+				delete entry;
+				return;
+			}
+			delete slot;
+		}
+		slot = entry;
+	}
+
+	Core::JobSystem::Submit(
+	    [this, entry, src]()
+	    {
+		    KYTY_PROFILER_BLOCK("ShaderTranslator::Prefetch", profiler::colors::Amber300);
+
+		    ShaderCode code;
+		    code.SetType(entry->type);
+		    code.SetCrc32(entry->crc32);
+		    code.SetHash0(entry->hash0);
+		    ShaderParse(src, &code);
+
+		    Core::LockGuard lock(m_mutex);
+		    entry->code  = code;
+		    entry->ready = true;
+		    m_cond_var.SignalAll();
+	    },
+	    Core::JobPriority::Low);
+}
+
+bool ShaderTranslator::FindPrefetched(ShaderType type, const uint32_t* src, uint32_t hash0, uint32_t crc32, ShaderCode* code)
+{
+	EXIT_IF(code == nullptr);
+
+	Core::LockGuard lock(m_mutex);
+
+	auto it = m_prefetched.find(reinterpret_cast<uint64_t>(src));
+	if (it == m_prefetched.end())
+	{
+		return false;
+	}
+
+	auto* entry = it->second;
+	if (entry->type != type || entry->hash0 != hash0 || entry->crc32 != crc32)
+	{
+		return false;
+	}
+
+	while (!entry->ready)
+	{
+		m_cond_var.Wait(&m_mutex);
+	}
+
+	*code = entry->code;
+
+	return true;
+}
+
+void ShaderRunTranslations(std::function<void()>* tasks, uint32_t num)
+{
+	EXIT_IF(g_translator == nullptr);
+
+	g_translator->Run(tasks, num);
+}
+
+void ShaderPrefetch(ShaderType type, uint64_t addr)
+{
+	EXIT_IF(g_translator == nullptr);
+
+	// Next-gen shaders are identified by the registers, not by a header in the code
+	if (!Config::ShaderPrefetchEnabled() || Config::IsNextGen() || addr == 0)
+	{
+		return;
+	}
+
+	g_translator->Prefetch(type, reinterpret_cast<const uint32_t*>(addr));
+}
+
 static ShaderUsageInfo GetUsageSlots(const uint32_t* code)
 {
 	EXIT_IF(code == nullptr);
@@ -949,10 +1153,15 @@ static void ShaderDetectBuffers(ShaderVertexInputInfo* info, bool ps5)
 
 	info->buffers_num = 0;
 
+	// Highest attribute address of each buffer, all attributes of an interleaved buffer lie within one stride
+	uint64_t last_addr[ShaderVertexInputInfo::RES_MAX] = {};
+
 	for (int ri = 0; ri < info->resources_num; ri++)
 	{
 		const auto& r = info->resources[ri];
 
+		uint64_t rbase = (ps5 ? r.Base48() : r.Base44());
+
 		bool merged = false;
 		for (int bi = 0; bi < info->buffers_num; bi++)
 		{
@@ -962,15 +1171,14 @@ static void ShaderDetectBuffers(ShaderVertexInputInfo* info, bool ps5)
 
 			if (stride == r.Stride())
 			{
-				uint64_t rbase   = (ps5 ? r.Base48() : r.Base44());
-				uint64_t base    = std::min(rbase, b.addr);
-				uint64_t offset1 = rbase - base;
-				uint64_t offset2 = b.addr - base;
+				uint64_t base = std::min(rbase, b.addr);
+				uint64_t last = std::max(rbase, last_addr[bi]);
 
-				if (offset1 < stride && offset2 < stride)
+				if (last - base < stride)
 				{
-					EXIT_NOT_IMPLEMENTED(b.num_records != r.NumRecords());
-					b.addr = base;
+					b.addr        = base;
+					b.num_records = std::max(b.num_records, r.NumRecords());
+					last_addr[bi] = last;
 					EXIT_NOT_IMPLEMENTED(b.attr_num >= ShaderVertexInputBuffer::ATTR_MAX);
 					b.attr_indices[b.attr_num++] = ri;
 					merged                       = true;
@@ -983,7 +1191,8 @@ static void ShaderDetectBuffers(ShaderVertexInputInfo* info, bool ps5)
 		{
 			EXIT_NOT_IMPLEMENTED(info->buffers_num >= ShaderVertexInputInfo::RES_MAX);
 			int bi                            = info->buffers_num++;
-			info->buffers[bi].addr            = (ps5 ? r.Base48() : r.Base44());
+			last_addr[bi]                     = rbase;
+			info->buffers[bi].addr            = rbase;
 			info->buffers[bi].stride          = r.Stride();
 			info->buffers[bi].num_records     = r.NumRecords();
 			info->buffers[bi].attr_num        = 1;
@@ -1002,11 +1211,21 @@ static void ShaderDetectBuffers(ShaderVertexInputInfo* info, bool ps5)
 	}
 }
 
-static void ShaderParseFetch(ShaderVertexInputInfo* info, const uint32_t* fetch, const uint32_t* buffer)
+// NOLINTNEXTLINE(readability-function-cognitive-complexity)
+static const ShaderFetchLayout& ShaderGetFetchLayout(const uint32_t* fetch)
 {
 	KYTY_PROFILER_FUNCTION();
 
-	EXIT_IF(info == nullptr || fetch == nullptr || buffer == nullptr);
+	EXIT_IF(fetch == nullptr);
+	EXIT_IF(g_fetch_layouts == nullptr);
+
+	auto& layout = (*g_fetch_layouts)[reinterpret_cast<uint64_t>(fetch)];
+
+	// The code can be replaced at the same address, so the cached layout is checked against its hash
+	if (layout.size != 0 && XXH64(fetch, layout.size, 0) == layout.hash)
+	{
+		return layout;
+	}
 
 	KYTY_PROFILER_BLOCK("ShaderParseFetch::parse_code");
 
@@ -1024,10 +1243,12 @@ static void ShaderParseFetch(ShaderVertexInputInfo* info, const uint32_t* fetch,
 	const auto& insts = code.GetInstructions();
 	uint32_t    size  = insts.Size();
 	// int         temp_register = 0;
-	uint32_t temp_value[104] = {0};
+	uint32_t temp_index[104] = {0};
 	int      s_num           = 0;
 	int      v_num           = 0;
 
+	layout.loads.Clear();
+
 	for (uint32_t i = 0; i < size; i++)
 	{
 		const auto& inst = insts.At(i);
@@ -1040,10 +1261,10 @@ static void ShaderParseFetch(ShaderVertexInputInfo* info, const uint32_t* fetch,
 
 			uint32_t index    = inst.src[1].constant.u >> 2u;
 			int      t        = inst.dst.register_id;
-			temp_value[t + 0] = buffer[index + 0];
-			temp_value[t + 1] = buffer[index + 1];
-			temp_value[t + 2] = buffer[index + 2];
-			temp_value[t + 3] = buffer[index + 3];
+			temp_index[t + 0] = index + 0;
+			temp_index[t + 1] = index + 1;
+			temp_index[t + 2] = index + 2;
+			temp_index[t + 3] = index + 3;
 
 			s_num++;
 		}
@@ -1068,20 +1289,19 @@ static void ShaderParseFetch(ShaderVertexInputInfo* info, const uint32_t* fetch,
 			EXIT_NOT_IMPLEMENTED(inst.src[1].type != ShaderOperandType::Sgpr);
 			EXIT_NOT_IMPLEMENTED(inst.src[2].type != ShaderOperandType::IntegerInlineConstant || inst.src[2].constant.i != 0);
 
-			EXIT_NOT_IMPLEMENTED(info->resources_num >= ShaderVertexInputInfo::RES_MAX);
+			EXIT_NOT_IMPLEMENTED(layout.loads.Size() >= ShaderVertexInputInfo::RES_MAX);
 
 			int t = inst.src[1].register_id;
 
-			auto& r           = info->resources[info->resources_num];
-			auto& rd          = info->resources_dst[info->resources_num];
-			rd.register_start = inst.dst.register_id;
-			rd.registers_num  = registers_num;
-			r.fields[0]       = temp_value[t + 0];
-			r.fields[1]       = temp_value[t + 1];
-			r.fields[2]       = temp_value[t + 2];
-			r.fields[3]       = temp_value[t + 3];
+			ShaderFetchLoad load;
+			load.register_start  = inst.dst.register_id;
+			load.registers_num   = registers_num;
+			load.buffer_index[0] = temp_index[t + 0];
+			load.buffer_index[1] = temp_index[t + 1];
+			load.buffer_index[2] = temp_index[t + 2];
+			load.buffer_index[3] = temp_index[t + 3];
 
-			info->resources_num++;
+			layout.loads.Add(load);
 
 			v_num++;
 		}
@@ -1090,6 +1310,38 @@ static void ShaderParseFetch(ShaderVertexInputInfo* info, const uint32_t* fetch,
 	KYTY_PROFILER_END_BLOCK;
 
 	EXIT_NOT_IMPLEMENTED(s_num != v_num);
+	EXIT_NOT_IMPLEMENTED(size == 0 || insts.At(size - 1).type != ShaderInstructionType::SSetpcB64);
+
+	// The code ends with s_setpc_b64
+	layout.size = insts.At(size - 1).pc + 4;
+	layout.hash = XXH64(fetch, layout.size, 0);
+
+	return layout;
+}
+
+static void ShaderParseFetch(ShaderVertexInputInfo* info, const uint32_t* fetch, const uint32_t* buffer)
+{
+	KYTY_PROFILER_FUNCTION();
+
+	EXIT_IF(info == nullptr || fetch == nullptr || buffer == nullptr);
+
+	const auto& layout = ShaderGetFetchLayout(fetch);
+
+	for (const auto& load: layout.loads)
+	{
+		EXIT_NOT_IMPLEMENTED(info->resources_num >= ShaderVertexInputInfo::RES_MAX);
+
+		auto& r           = info->resources[info->resources_num];
+		auto& rd          = info->resources_dst[info->resources_num];
+		rd.register_start = load.register_start;
+		rd.registers_num  = load.registers_num;
+		r.fields[0]       = buffer[load.buffer_index[0]];
+		r.fields[1]       = buffer[load.buffer_index[1]];
+		r.fields[2]       = buffer[load.buffer_index[2]];
+		r.fields[3]       = buffer[load.buffer_index[3]];
+
+		info->resources_num++;
+	}
 }
 
 static void ShaderParseAttrib(ShaderVertexInputInfo* info, const ShaderSemantic* input_semantics, uint32_t num_input_semantics,
@@ -1358,6 +1610,8 @@ void ShaderCalcBindingIndices(ShaderBindResources* bind)
 	}
 
 	EXIT_IF((bind->push_constant_size % 16) != 0);
+
+	bind->uniform_buffer = (bind->push_constant_size > 0 && bind->push_constant_offset + bind->push_constant_size > g_push_constants_max);
 }
 
 // NOLINTNEXTLINE(readability-function-cognitive-complexity)
@@ -1637,6 +1891,7 @@ void ShaderGetInputInfoVS(const HW::VertexShaderInfo* regs, const HW::ShaderRegi
 	info->bind.push_constant_offset = 0;
 	info->bind.push_constant_size   = 0;
 	info->bind.descriptor_set_slot  = 0;
+	info->bind.uniform_buffer_slot  = 2;
 
 	if (regs->vs_embedded)
 	{
@@ -1767,9 +2022,11 @@ void ShaderGetInputInfoPS(const HW::PixelShaderInfo* regs, const HW::ShaderRegis
 		ps_info->interpolator_settings[i] = sh->ps_interpolator_settings[i];
 	}
 
-	ps_info->bind.descriptor_set_slot  = (vs_info->bind.storage_buffers.buffers_num > 0 ? 1 : 0);
-	ps_info->bind.push_constant_offset = vs_info->bind.push_constant_offset + vs_info->bind.push_constant_size;
-	ps_info->bind.push_constant_size   = 0;
+	ps_info->bind.descriptor_set_slot = (vs_info->bind.storage_buffers.buffers_num > 0 ? 1 : 0);
+	ps_info->bind.push_constant_offset =
+	    vs_info->bind.push_constant_offset + (vs_info->bind.uniform_buffer ? 0 : vs_info->bind.push_constant_size);
+	ps_info->bind.push_constant_size  = 0;
+	ps_info->bind.uniform_buffer_slot = 3;
 
 	for (int i = 0; i < 8; i++)
 	{
@@ -1826,6 +2083,7 @@ void ShaderGetInputInfoCS(const HW::ComputeShaderInfo* regs, const HW::ShaderReg
 	info->bind.push_constant_offset = 0;
 	info->bind.push_constant_size   = 0;
 	info->bind.descriptor_set_slot  = 0;
+	info->bind.uniform_buffer_slot  = 1;
 
 	ShaderParsedUsage usage;
 
@@ -1844,6 +2102,8 @@ static void ShaderDbgDumpResources(const ShaderBindResources& bind)
 	printf("\t descriptor_set_slot            = %u\n", bind.descriptor_set_slot);
 	printf("\t push_constant_offset           = %u\n", bind.push_constant_offset);
 	printf("\t push_constant_size             = %u\n", bind.push_constant_size);
+	printf("\t uniform_buffer                 = %s\n", (bind.uniform_buffer ? "true" : "false"));
+	printf("\t uniform_buffer_slot            = %u\n", bind.uniform_buffer_slot);
 	printf("\t storage_buffers.buffers_num    = %d\n", bind.storage_buffers.buffers_num);
 	printf("\t storage_buffers.binding_index  = %d\n", bind.storage_buffers.binding_index);
 	printf("\t textures.textures_num          = %d\n", bind.textures2D.textures_num);
@@ -2145,15 +2405,10 @@ public:
 				break;
 			case Config::ShaderLogDirection::File:
 			{
+				// Written by the dump writer
 				m_file_name = Config::GetShaderLogFolder().FixDirectorySlash() +
 				              String::FromPrintf("%04d_%04d_shader_%s.log", GraphicsRunGetFrameNum(), id++, type);
-				Core::File::CreateDirectories(m_file_name.DirectoryWithoutFilename());
-				m_file.Create(m_file_name);
-				if (m_file.IsInvalid())
-				{
-					printf(FG_BRIGHT_RED "Can't create file: %s\n" FG_DEFAULT, m_file_name.C_Str());
-					m_enabled = false;
-				}
+				m_file.CreateInMem();
 				m_enabled = true;
 				m_console = false;
 			}
@@ -2165,7 +2420,7 @@ public:
 	{
 		if (m_enabled && !m_console && !m_file.IsInvalid())
 		{
-			m_file.Close();
+			DumpWriterPush(m_file_name, &m_file);
 		}
 	}
 
@@ -2264,16 +2519,9 @@ public:
 		if (m_enabled && !m_console && !m_file.IsInvalid())
 		{
 			Core::File file;
-			String     file_name = m_file_name.FilenameWithoutExtension() + ".spv";
-			file.Create(file_name);
-			if (file.IsInvalid())
-			{
-				printf(FG_BRIGHT_RED "Can't create file: %s\n" FG_DEFAULT, file_name.C_Str());
-			} else
-			{
-				file.Write(bin.GetDataConst(), bin.Size() * 4);
-				file.Close();
-			}
+			file.CreateInMem();
+			file.Write(bin.GetDataConst(), bin.Size() * 4);
+			DumpWriterPush(m_file_name.FilenameWithoutExtension() + ".spv", &file);
 		}
 	}
 
@@ -2342,8 +2590,11 @@ ShaderCode ShaderParseVS(const HW::VertexShaderInfo* regs, const HW::ShaderRegis
 
 		code.SetCrc32(crc32);
 		code.SetHash0(hash0);
-		// shader_parse(0, src, nullptr, &code);
-		ShaderParse(src, &code);
+		if (!g_translator->FindPrefetched(code.GetType(), src, hash0, crc32, &code))
+		{
+			// shader_parse(0, src, nullptr, &code);
+			ShaderParse(src, &code);
+		}
 
 		if (g_debug_printfs != nullptr)
 		{
@@ -2368,20 +2619,21 @@ Vector<uint32_t> ShaderRecompileVS(const ShaderCode& code, const ShaderVertexInp
 
 	if (code.IsVsEmbedded())
 	{
-		source = SpirvGetEmbeddedVs(code.GetVsEmbeddedId());
-	} else
-	{
-		for (int i = 0; i < input_info->bind.storage_buffers.buffers_num; i++)
-		{
-			const auto& r = input_info->bind.storage_buffers.buffers[i];
-			EXIT_NOT_IMPLEMENTED(((r.Stride() * r.NumRecords()) & 0x3u) != 0);
-		}
+		return SpirvGetEmbeddedVs(code.GetVsEmbeddedId());
+	}
 
-		log.DumpOriginalShader(code);
+	GpuCounterAdd(GpuCounter::ShaderTranslations);
 
-		source = SpirvGenerateSource(code, input_info, nullptr, nullptr);
+	for (int i = 0; i < input_info->bind.storage_buffers.buffers_num; i++)
+	{
+		const auto& r = input_info->bind.storage_buffers.buffers[i];
+		EXIT_NOT_IMPLEMENTED(((r.Stride() * r.NumRecords()) & 0x3u) != 0);
 	}
 
+	log.DumpOriginalShader(code);
+
+	source = SpirvGenerateSource(code, input_info, nullptr, nullptr);
+
 	log.DumpRecompiledShader(source);
 
 	if (String8 err_msg; !SpirvRun(source, &ret, &err_msg))
@@ -2440,8 +2692,11 @@ ShaderCode ShaderParsePS(const HW::PixelShaderInfo* regs, const HW::ShaderRegist
 
 		code.SetCrc32(crc32);
 		code.SetHash0(hash0);
-		// shader_parse(0, src, nullptr, &code);
-		ShaderParse(src, &code);
+		if (!g_translator->FindPrefetched(code.GetType(), src, hash0, crc32, &code))
+		{
+			// shader_parse(0, src, nullptr, &code);
+			ShaderParse(src, &code);
+		}
 
 		if (g_debug_printfs != nullptr)
 		{
@@ -2464,27 +2719,28 @@ Vector<uint32_t> ShaderRecompilePS(const ShaderCode& code, const ShaderPixelInpu
 	Vector<uint32_t> ret;
 	ShaderLogHelper  log("ps");
 
+	GpuCounterAdd(GpuCounter::ShaderTranslations);
+
 	if (code.IsPsEmbedded())
 	{
-		source = SpirvGetEmbeddedPs(code.GetPsEmbeddedId());
-	} else
-	{
-		//		for (uint32_t i = 0; i < input_info->input_num; i++)
-		//		{
-		//			EXIT_NOT_IMPLEMENTED(input_info->interpolator_settings[i] != i);
-		//		}
-
-		for (int i = 0; i < input_info->bind.storage_buffers.buffers_num; i++)
-		{
-			const auto& r = input_info->bind.storage_buffers.buffers[i];
-			EXIT_NOT_IMPLEMENTED(((r.Stride() * r.NumRecords()) & 0x3u) != 0);
-		}
+		return SpirvGetEmbeddedPs(code.GetPsEmbeddedId());
+	}
 
-		log.DumpOriginalShader(code);
+	//	for (uint32_t i = 0; i < input_info->input_num; i++)
+	//	{
+	//		EXIT_NOT_IMPLEMENTED(input_info->interpolator_settings[i] != i);
+	//	}
 
-		source = SpirvGenerateSource(code, nullptr, input_info, nullptr);
+	for (int i = 0; i < input_info->bind.storage_buffers.buffers_num; i++)
+	{
+		const auto& r = input_info->bind.storage_buffers.buffers[i];
+		EXIT_NOT_IMPLEMENTED(((r.Stride() * r.NumRecords()) & 0x3u) != 0);
 	}
 
+	log.DumpOriginalShader(code);
+
+	source = SpirvGenerateSource(code, nullptr, input_info, nullptr);
+
 	log.DumpRecompiledShader(source);
 
 	if (String8 err_msg; !SpirvRun(source, &ret, &err_msg))
@@ -2524,8 +2780,11 @@ ShaderCode ShaderParseCS(const HW::ComputeShaderInfo* regs, const HW::ShaderRegi
 
 	code.SetCrc32(header->crc32);
 	code.SetHash0(header->hash0);
-	// shader_parse(0, src, nullptr, &code);
-	ShaderParse(src, &code);
+	if (!g_translator->FindPrefetched(ShaderType::Compute, src, header->hash0, header->crc32, &code))
+	{
+		// shader_parse(0, src, nullptr, &code);
+		ShaderParse(src, &code);
+	}
 
 	if (g_debug_printfs != nullptr)
 	{
@@ -2545,6 +2804,8 @@ Vector<uint32_t> ShaderRecompileCS(const ShaderCode& code, const ShaderComputeIn
 
 	ShaderLogHelper log("cs");
 
+	GpuCounterAdd(GpuCounter::ShaderTranslations);
+
 	for (int i = 0; i < input_info->bind.storage_buffers.buffers_num; i++)
 	{
 		const auto& r = input_info->bind.storage_buffers.buffers[i];
@@ -2571,6 +2832,13 @@ Vector<uint32_t> ShaderRecompileCS(const ShaderCode& code, const ShaderComputeIn
 	return ret;
 }
 
+Vector<uint32_t> ShaderRecompileEmbeddedCS(uint32_t id)
+{
+	KYTY_PROFILER_FUNCTION(profiler::colors::CyanA700);
+
+	return SpirvGetEmbeddedCs(id);
+}
+
 //// NOLINTNEXTLINE(readability-function-cognitive-complexity)
 // static ShaderBindParameters ShaderUpdateBindInfo(const ShaderCode& code, const ShaderBindResources* bind)
 //{
@@ -2678,6 +2946,8 @@ Vector<uint32_t> ShaderRecompileCS(const ShaderCode& code, const ShaderComputeIn
 
 static void ShaderGetBindIds(ShaderId* ret, const ShaderBindResources& bind)
 {
+	ret->ids.Add(static_cast<uint32_t>(bind.uniform_buffer));
+
 	ret->ids.Add(bind.storage_buffers.buffers_num);
 
 	for (int i = 0; i < bind.storage_buffers.buffers_num; i++)
@@ -2845,35 +3115,37 @@ ShaderId ShaderGetIdVS(const HW::VertexShaderInfo* regs, const ShaderVertexInput
 
 		ret.ids.Add(rd.register_start);
 		ret.ids.Add(rd.registers_num);
-		ret.ids.Add(r.Stride());
-		ret.ids.Add(static_cast<uint32_t>(r.SwizzleEnabled()));
-		ret.ids.Add(r.DstSelX());
-		ret.ids.Add(r.DstSelY());
-		ret.ids.Add(r.DstSelZ());
-		ret.ids.Add(r.DstSelW());
+
+		// Fetch formats are converted by the vertex input state, the shader always reads floats
+		ret.variant_ids.Add(r.Stride());
+		ret.variant_ids.Add(static_cast<uint32_t>(r.SwizzleEnabled()));
+		ret.variant_ids.Add(r.DstSelX());
+		ret.variant_ids.Add(r.DstSelY());
+		ret.variant_ids.Add(r.DstSelZ());
+		ret.variant_ids.Add(r.DstSelW());
 		if (gen5)
 		{
-			ret.ids.Add(r.Format());
-			ret.ids.Add(r.OutOfBounds());
+			ret.variant_ids.Add(r.Format());
+			ret.variant_ids.Add(r.OutOfBounds());
 		} else
 		{
-			ret.ids.Add(r.Nfmt());
-			ret.ids.Add(r.Dfmt());
+			ret.variant_ids.Add(r.Nfmt());
+			ret.variant_ids.Add(r.Dfmt());
 		}
-		ret.ids.Add(static_cast<uint32_t>(r.AddTid()));
+		ret.variant_ids.Add(static_cast<uint32_t>(r.AddTid()));
 	}
 
-	ret.ids.Add(input_info->buffers_num);
+	ret.variant_ids.Add(input_info->buffers_num);
 
 	for (int i = 0; i < input_info->buffers_num; i++)
 	{
 		const auto& r = input_info->buffers[i];
-		ret.ids.Add(r.attr_num);
-		ret.ids.Add(r.stride);
+		ret.variant_ids.Add(r.attr_num);
+		ret.variant_ids.Add(r.stride);
 		for (int j = 0; j < r.attr_num; j++)
 		{
-			ret.ids.Add(r.attr_indices[j]);
-			ret.ids.Add(r.attr_offsets[j]);
+			ret.variant_ids.Add(r.attr_indices[j]);
+			ret.variant_ids.Add(r.attr_offsets[j]);
 		}
 	}
 
@@ -2920,7 +3192,7 @@ ShaderId ShaderGetIdPS(const HW::PixelShaderInfo* regs, const ShaderPixelInputIn
 	ret.ids.Add(static_cast<uint32_t>(input_info->ps_pos_xy));
 	ret.ids.Add(static_cast<uint32_t>(input_info->ps_pixel_kill_enable));
 	ret.ids.Add(static_cast<uint32_t>(input_info->ps_early_z));
-	ret.ids.Add(static_cast<uint32_t>(input_info->ps_execute_on_noop));
+	ret.variant_ids.Add(static_cast<uint32_t>(input_info->ps_execute_on_noop));
 
 	for (uint32_t i = 0; i < input_info->input_num; i++)
 	{
@@ -2955,7 +3227,8 @@ ShaderId ShaderGetIdCS(const HW::ComputeShaderInfo* regs, const ShaderComputeInp
 
 	for (int i = 0; i < 3; i++)
 	{
-		ret.ids.Add(input_info->threads_num[i]);
+		// Workgroup size is a specialization constant of the module
+		ret.variant_ids.Add(input_info->threads_num[i]);
 		ret.ids.Add(static_cast<uint32_t>(input_info->group_id[i]));
 	}
 
@@ -2964,6 +3237,207 @@ ShaderId ShaderGetIdCS(const HW::ComputeShaderInfo* regs, const ShaderComputeInp
 	return ret;
 }
 
+static constexpr uint32_t SHADER_CACHE_MAGIC = 0x4348534b; // KSHC
+// Increment when the recompiler output changes for the same input
+static constexpr uint32_t SHADER_CACHE_VERSION    = 3;
+static constexpr uint32_t SHADER_CACHE_SPIRV_MAX  = 16u * 1024u * 1024u; // words
+static constexpr uint32_t SHADER_CACHE_RECORD_MAX = 64u * 1024u * 1024u;
+
+static bool shader_cache_enabled()
+{
+	// Logs and injected printfs are produced by the recompiler, so bypass the cache when they are wanted
+	return Config::ShaderCacheEnabled() && Config::GetShaderLogDirection() == Config::ShaderLogDirection::Silent &&
+	       g_debug_printfs == nullptr;
+}
+
+static ShaderCacheHeader shader_cache_header(ShaderType type, const ShaderId& id)
+{
+	ShaderCacheHeader h;
+	h.magic             = SHADER_CACHE_MAGIC;
+	h.version           = SHADER_CACHE_VERSION;
+	h.emu_version       = static_cast<uint32_t>(XXH64(KYTY_VERSION, sizeof(KYTY_VERSION), 0));
+	h.type              = static_cast<uint32_t>(type);
+	h.optimization      = static_cast<uint32_t>(Config::GetShaderOptimizationType());
+	h.code_optimization = static_cast<uint32_t>(Config::ShaderCodeOptimizationEnabled());
+	h.next_gen          = static_cast<uint32_t>(Config::IsNextGen());
+	h.hash0             = id.hash0;
+	h.crc32             = id.crc32;
+	h.ids_num           = id.ids.Size();
+	return h;
+}
+
+// The key doesn't depend on the spirv size, so it's computed before the size is known
+static uint64_t shader_cache_key(const ShaderCacheHeader& h, const ShaderId& id)
+{
+	EXIT_IF(h.spirv_num != 0);
+
+	return XXH64(id.ids.GetDataConst(), static_cast<size_t>(id.ids.Size()) * 4, XXH64(&h, sizeof(h), 0));
+}
+
+// One append-only file is shared by all the emulator processes which use the same cache folder
+static Core::SharedStore* shader_cache_store()
+{
+	static auto* store = []()
+	{
+		auto* s = new Core::SharedStore;
+		if (!s->Open(GraphicsGetCacheFolder() + U"shaders.kss"))
+		{
+			delete s;
+			return static_cast<Core::SharedStore*>(nullptr);
+		}
+		return s;
+	}();
+
+	return store;
+}
+
+// Checks a record found by the key, which may come from another emulator build or from a remote server. False if the record doesn't
+// belong to the shader or is broken.
+static bool shader_cache_decode(ShaderCacheHeader expected, const ShaderId& id, const Core::ByteBuffer& buf, Vector<uint32_t>* spirv)
+{
+	ShaderCacheHeader h;
+	uint32_t          ids_size = expected.ids_num * 4;
+
+	if (buf.Size() < sizeof(h) + ids_size)
+	{
+		return false;
+	}
+
+	memcpy(&h, buf.GetDataConst(), sizeof(h));
+	expected.spirv_num = h.spirv_num;
+
+	// Key collision or stale record
+	if (memcmp(&h, &expected, sizeof(h)) != 0 ||
+	    (ids_size > 0 && memcmp(buf.GetDataConst() + sizeof(h), id.ids.GetDataConst(), ids_size) != 0))
+	{
+		return false;
+	}
+
+	if (h.spirv_num == 0 || h.spirv_num > SHADER_CACHE_SPIRV_MAX)
+	{
+		return false;
+	}
+
+	auto offset = static_cast<uint32_t>(sizeof(h)) + ids_size;
+	auto src    = reinterpret_cast<const uint8_t*>(buf.GetDataConst()) + offset;
+
+	Vector<uint32_t> words(h.spirv_num);
+	uint32_t         size = 0;
+
+	if (!Core::TryDecompressZstd(src, buf.Size() - offset, reinterpret_cast<uint8_t*>(words.GetData()), h.spirv_num * 4, &size) ||
+	    size != h.spirv_num * 4)
+	{
+		return false;
+	}
+
+	*spirv = std::move(words);
+
+	return true;
+}
+
+bool ShaderCacheLoad(ShaderType type, const ShaderId& id, Vector<uint32_t>* spirv)
+{
+	KYTY_PROFILER_FUNCTION();
+
+	EXIT_IF(spirv == nullptr);
+
+	if (!shader_cache_enabled())
+	{
+		return false;
+	}
+
+	auto* store = shader_cache_store();
+
+	if (store == nullptr)
+	{
+		return false;
+	}
+
+	auto                  expected = shader_cache_header(type, id);
+	Core::ByteBufferLease buf;
+
+	return store->Find(shader_cache_key(expected, id), buf.Get()) && shader_cache_decode(expected, id, *buf, spirv);
+}
+
+// Downloads the record in the background and puts it to the local store, ShaderCacheLoad finds it there later
+void ShaderCachePrefetch(ShaderType type, const ShaderId& id)
+{
+	KYTY_PROFILER_FUNCTION();
+
+	if (!shader_cache_enabled() || !RemoteCacheEnabled())
+	{
+		return;
+	}
+
+	auto* store = shader_cache_store();
+
+	if (store == nullptr)
+	{
+		return;
+	}
+
+	auto                  expected = shader_cache_header(type, id);
+	auto                  key      = shader_cache_key(expected, id);
+	Core::ByteBufferLease buf;
+
+	if (store->Find(key, buf.Get()))
+	{
+		return;
+	}
+
+	RemoteCacheFetch("shaders", key, SHADER_CACHE_RECORD_MAX,
+	                 [store, expected, id, key](const Core::ByteBuffer& value)
+	                 {
+		                 Vector<uint32_t> spirv;
+		                 if (shader_cache_decode(expected, id, value, &spirv))
+		                 {
+			                 store->Append(key, value);
+		                 }
+	                 });
+}
+
+void ShaderCacheStore(ShaderType type, const ShaderId& id, const Vector<uint32_t>& spirv)
+{
+	KYTY_PROFILER_FUNCTION();
+
+	if (!shader_cache_enabled() || spirv.IsEmpty())
+	{
+		return;
+	}
+
+	auto* store = shader_cache_store();
+
+	if (store == nullptr)
+	{
+		return;
+	}
+
+	auto h      = shader_cache_header(type, id);
+	auto key    = shader_cache_key(h, id);
+	h.spirv_num = spirv.Size();
+
+	Core::ByteBufferLease words(spirv.Size() * 4);
+	Core::CompressZstd(reinterpret_cast<const uint8_t*>(spirv.GetDataConst()), spirv.Size() * 4, words.Get());
+
+	uint32_t              ids_size = h.ids_num * 4;
+	Core::ByteBufferLease buf(static_cast<uint32_t>(sizeof(h)) + ids_size + words->Size());
+	buf->Resize(static_cast<uint32_t>(sizeof(h)) + ids_size + words->Size());
+
+	auto* dst = buf->GetData();
+	memcpy(dst, &h, sizeof(h));
+	if (ids_size > 0)
+	{
+		memcpy(dst + sizeof(h), id.ids.GetDataConst(), ids_size);
+	}
+	memcpy(dst + sizeof(h) + ids_size, words->GetDataConst(), words->Size());
+
+	// Another process or thread may have stored the same shader first, then it's uploaded by that one
+	if (store->Append(key, *buf))
+	{
+		RemoteCachePut("shaders", key, *buf);
+	}
+}
+
 bool ShaderIsDisabled(uint64_t addr)
 {
 	const auto* src = reinterpret_cast<const uint32_t*>(addr);
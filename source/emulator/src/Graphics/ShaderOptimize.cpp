@@ -0,0 +1,300 @@
+#include "Emulator/Graphics/ShaderOptimize.h"
+
+#include "Kyty/Core/Common.h"
+#include "Kyty/Core/DbgAssert.h"
+#include "Kyty/Core/Vector.h"
+
+#include "Emulator/Graphics/Shader.h"
+#include "Emulator/Graphics/ShaderSpirv.h"
+
+#ifdef KYTY_EMU_ENABLED
+
+namespace Kyty::Libs::Graphics {
+
+struct ShaderKnownConstant
+{
+	int           register_id = 0;
+	ShaderOperand value;
+};
+
+static bool is_constant(const ShaderOperand& op)
+{
+	return (op.type == ShaderOperandType::LiteralConstant || op.type == ShaderOperandType::IntegerInlineConstant ||
+	        op.type == ShaderOperandType::FloatInlineConstant);
+}
+
+static bool is_register(const ShaderOperand& op)
+{
+	return (op.type == ShaderOperandType::Sgpr || op.type == ShaderOperandType::Vgpr) && op.size > 0;
+}
+
+static bool is_overlapped(const ShaderOperand& op1, const ShaderOperand& op2)
+{
+	return is_register(op1) && is_register(op2) && op1.type == op2.type && op1.register_id < op2.register_id + op2.size &&
+	       op2.register_id < op1.register_id + op1.size;
+}
+
+static bool is_written(const ShaderInstruction& inst, const ShaderOperand& op)
+{
+	return is_overlapped(inst.dst, op) || is_overlapped(inst.dst2, op);
+}
+
+static bool is_store(const ShaderInstruction& inst)
+{
+	switch (inst.type)
+	{
+		case ShaderInstructionType::BufferStoreDword:
+		case ShaderInstructionType::BufferStoreFormatX:
+		case ShaderInstructionType::BufferStoreFormatXy:
+		case ShaderInstructionType::ImageStore:
+		case ShaderInstructionType::ImageStoreMip: return true;
+		default: break;
+	}
+	return false;
+}
+
+static bool is_read(const ShaderInstruction& inst, const ShaderOperand& op)
+{
+	for (int i = 0; i < inst.src_num; i++)
+	{
+		if (is_overlapped(inst.src[i], op))
+		{
+			return true;
+		}
+	}
+
+	// Data of the stores is kept in the destination operand
+	return is_store(inst) && is_overlapped(inst.dst, op);
+}
+
+static bool is_block_end(const ShaderInstruction& inst)
+{
+	switch (inst.type)
+	{
+		case ShaderInstructionType::SBranch:
+		case ShaderInstructionType::SCbranchExecz:
+		case ShaderInstructionType::SCbranchScc0:
+		case ShaderInstructionType::SCbranchScc1:
+		case ShaderInstructionType::SCbranchVccz:
+		case ShaderInstructionType::SCbranchVccnz:
+		case ShaderInstructionType::SEndpgm:
+		case ShaderInstructionType::SSetpcB64:
+		case ShaderInstructionType::SSwappcB64: return true;
+		default: break;
+	}
+	return false;
+}
+
+static bool is_scalar_load(const ShaderInstruction& inst)
+{
+	switch (inst.type)
+	{
+		case ShaderInstructionType::SLoadDword:
+		case ShaderInstructionType::SLoadDwordx2:
+		case ShaderInstructionType::SLoadDwordx4:
+		case ShaderInstructionType::SLoadDwordx8:
+		case ShaderInstructionType::SLoadDwordx16: return true;
+		default: break;
+	}
+	return false;
+}
+
+static bool is_label_target(const ShaderCode& code, uint32_t pc)
+{
+	return code.GetLabels().Contains(pc, [](auto label, auto pc) { return !label.IsDisabled() && label.GetDst() == pc; }) ||
+	       code.GetIndirectLabels().Contains(pc, [](auto label, auto pc) { return label.GetDst() == pc; });
+}
+
+// Instructions which start a block keep their place, the recompiler looks up blocks and branch successors by pc
+static bool is_removable(const ShaderCode& code, uint32_t index)
+{
+	const auto& insts = code.GetInstructions();
+	return !is_label_target(code, insts.At(index).pc) && (index == 0 || !is_block_end(insts.At(index - 1)));
+}
+
+static uint32_t remove_instructions(ShaderCode* code, const Vector<bool>& removed)
+{
+	Vector<ShaderInstruction> insts;
+	uint32_t                  num = 0;
+	for (uint32_t index = 0; index < code->GetInstructions().Size(); index++)
+	{
+		if (removed.At(index))
+		{
+			num++;
+		} else
+		{
+			insts.Add(code->GetInstructions().At(index));
+		}
+	}
+	if (num > 0)
+	{
+		code->GetInstructions() = insts;
+	}
+	return num;
+}
+
+// s_mov_b32 sN, constant followed by vector ALU instructions which read sN. Only the recompiler functions which load every
+// source through the common operand loaders take the constant, the value is kept bit for bit.
+static void propagate_constants(ShaderCode* code)
+{
+	Vector<ShaderKnownConstant> known;
+
+	for (auto& inst: code->GetInstructions())
+	{
+		if (is_label_target(*code, inst.pc))
+		{
+			known.Clear();
+		}
+
+		if (!known.IsEmpty() && SpirvAcceptsConstantSources(inst))
+		{
+			for (int i = 0; i < inst.src_num; i++)
+			{
+				auto& src = inst.src[i];
+				if (src.type == ShaderOperandType::Sgpr && src.size == 1)
+				{
+					if (auto ki = known.Find(src.register_id, [](auto k, auto id) { return k.register_id == id; }); known.IndexValid(ki))
+					{
+						const auto& value = known.At(ki).value;
+						src.type          = value.type;
+						src.constant      = value.constant;
+						src.register_id   = 0;
+						src.size          = 0;
+					}
+				}
+			}
+		}
+
+		for (uint32_t ki = 0; ki < known.Size();)
+		{
+			ShaderOperand reg;
+			reg.type        = ShaderOperandType::Sgpr;
+			reg.register_id = known.At(ki).register_id;
+			reg.size        = 1;
+			if (is_written(inst, reg))
+			{
+				known.RemoveAt(ki);
+			} else
+			{
+				ki++;
+			}
+		}
+
+		if (inst.type == ShaderInstructionType::SMovB32 && inst.format == ShaderInstructionFormat::SVdstSVsrc0 &&
+		    inst.dst.type == ShaderOperandType::Sgpr && inst.dst.size == 1 && is_constant(inst.src[0]) && !inst.src[0].negate &&
+		    !inst.src[0].absolute)
+		{
+			ShaderKnownConstant k;
+			k.register_id = inst.dst.register_id;
+			k.value       = inst.src[0];
+			known.Add(k);
+		}
+
+		if (is_block_end(inst))
+		{
+			known.Clear();
+		}
+	}
+}
+
+// A scalar load with the same destination and address as an earlier one in the block, while none of those registers were written
+static uint32_t remove_redundant_loads(ShaderCode* code)
+{
+	const auto& insts = code->GetInstructions();
+
+	Vector<bool>     removed;
+	Vector<uint32_t> available;
+
+	for (uint32_t index = 0; index < insts.Size(); index++)
+	{
+		const auto& inst = insts.At(index);
+
+		removed.Add(false);
+
+		if (is_label_target(*code, inst.pc))
+		{
+			available.Clear();
+		}
+
+		auto same_load = [&insts](auto ai, const auto& load)
+		{
+			const auto& a = insts.At(ai);
+			return a.type == load.type && a.format == load.format && a.dst == load.dst && a.src[0] == load.src[0] &&
+			       a.src[1] == load.src[1];
+		};
+
+		if (is_scalar_load(inst) && available.Contains(inst, same_load))
+		{
+			removed[index] = true;
+			continue;
+		}
+
+		for (uint32_t ai = 0; ai < available.Size();)
+		{
+			const auto& a = insts.At(available.At(ai));
+			if (is_store(inst) || is_written(inst, a.dst) || is_written(inst, a.src[0]) || is_written(inst, a.src[1]))
+			{
+				available.RemoveAt(ai);
+			} else
+			{
+				ai++;
+			}
+		}
+
+		if (is_scalar_load(inst) && !is_overlapped(inst.dst, inst.src[0]) && !is_overlapped(inst.dst, inst.src[1]))
+		{
+			available.Add(index);
+		}
+
+		if (is_block_end(inst))
+		{
+			available.Clear();
+		}
+	}
+
+	return remove_instructions(code, removed);
+}
+
+// s_mov_b32 / v_mov_b32 into a register which no instruction of the shader reads
+static uint32_t remove_dead_moves(ShaderCode* code)
+{
+	const auto& insts = code->GetInstructions();
+
+	Vector<bool> removed;
+
+	for (uint32_t index = 0; index < insts.Size(); index++)
+	{
+		const auto& inst = insts.At(index);
+
+		bool dead = ((inst.type == ShaderInstructionType::SMovB32 && inst.dst.type == ShaderOperandType::Sgpr) ||
+		             (inst.type == ShaderInstructionType::VMovB32 && inst.dst.type == ShaderOperandType::Vgpr)) &&
+		            inst.format == ShaderInstructionFormat::SVdstSVsrc0 && inst.dst.size == 1 && is_removable(*code, index) &&
+		            !insts.Contains(inst.dst, [](const auto& i, const auto& dst) { return is_read(i, dst); });
+
+		removed.Add(dead);
+	}
+
+	return remove_instructions(code, removed);
+}
+
+void ShaderOptimize(ShaderCode* code)
+{
+	EXIT_IF(code == nullptr);
+
+	// Registers may be read by code outside of this list (fetch shader calls) or by the injected printfs
+	if (code->HasAnyOf({ShaderInstructionType::SSetpcB64, ShaderInstructionType::SSwappcB64}) || !code->GetDebugPrintfs().IsEmpty())
+	{
+		return;
+	}
+
+	propagate_constants(code);
+	remove_redundant_loads(code);
+
+	while (remove_dead_moves(code) > 0)
+	{
+	}
+}
+
+} // namespace Kyty::Libs::Graphics
+
+#endif // KYTY_EMU_ENABLED
@@ -29,7 +29,8 @@
 
 namespace Kyty::Libs::Graphics {
 
-static ShaderOperand operand_parse(uint32_t code)
+// Operand codes without a meaning are returned as ShaderOperandType::Unknown
+static ShaderOperand operand_decode(uint32_t code)
 {
 	ShaderOperand ret;
 
@@ -74,13 +75,236 @@ static ShaderOperand operand_parse(uint32_t code)
 				ret.type = ShaderOperandType::LiteralConstant;
 				ret.size = 0;
 				break;
-			default: EXIT("unknown operand: %u\n", code);
+			default:
+				ret.type = ShaderOperandType::Unknown;
+				ret.size = 0;
+				break;
+		}
+	}
+
+	return ret;
+}
+
+static ShaderOperand operand_parse(uint32_t code)
+{
+	// Every 9-bit source code (SGPRs, constants, special registers and VGPRs) is decoded only once
+	static constexpr uint32_t TABLE_SIZE = 512;
+	static const auto*        table      = []()
+	{
+		auto* t = new ShaderOperand[TABLE_SIZE];
+		for (uint32_t c = 0; c < TABLE_SIZE; c++)
+		{
+			t[c] = operand_decode(c);
 		}
+		return t;
+	}();
+
+	ShaderOperand ret = (code < TABLE_SIZE ? table[code] : operand_decode(code));
+
+	if (ret.type == ShaderOperandType::Unknown)
+	{
+		EXIT("unknown operand: %u\n", code);
 	}
 
 	return ret;
 }
 
+// Opcode descriptor of the regular scalar ALU encodings (SOP1, SOP2)
+struct ShaderSaluOpcode
+{
+	ShaderInstructionType           type        = ShaderInstructionType::Unknown;
+	ShaderInstructionFormat::Format format      = ShaderInstructionFormat::Unknown;
+	int                             dst_size    = 0; // 0 - keep the size of the decoded operand
+	int                             src_size[2] = {0, 0};
+	const char*                     name        = nullptr; // Known, but not implemented instruction
+	bool                            next_gen    = false;   // Gen5 only
+};
+
+static constexpr uint32_t SOP1_OPCODES_NUM = 0x36;
+static constexpr uint32_t SOP2_OPCODES_NUM = 0x60;
+
+static const ShaderSaluOpcode* sop1_opcodes()
+{
+	static const auto* table = []()
+	{
+		auto* t  = new ShaderSaluOpcode[SOP1_OPCODES_NUM];
+		auto  op = [t](uint32_t opcode, ShaderInstructionType type, ShaderInstructionFormat::Format format, int dst_size, int src0_size)
+		{
+			t[opcode].type        = type;
+			t[opcode].format      = format;
+			t[opcode].dst_size    = dst_size;
+			t[opcode].src_size[0] = src0_size;
+		};
+		auto ni = [t](uint32_t opcode, const char* name) { t[opcode].name = name; };
+
+		op(0x03, ShaderInstructionType::SMovB32, ShaderInstructionFormat::SVdstSVsrc0, 0, 0);
+		op(0x04, ShaderInstructionType::SMovB64, ShaderInstructionFormat::Sdst2Ssrc02, 2, 2);
+		ni(0x05, "s_cmov_b32");
+		ni(0x06, "s_cmov_b64");
+		ni(0x07, "s_not_b32");
+		ni(0x08, "s_not_b64");
+		ni(0x09, "s_wqm_b32");
+		op(0x0a, ShaderInstructionType::SWqmB64, ShaderInstructionFormat::Sdst2Ssrc02, 2, 2);
+		ni(0x0B, "s_brev_b32");
+		ni(0x0C, "s_brev_b64");
+		ni(0x0D, "s_bcnt0_i32_b32");
+		ni(0x0E, "s_bcnt0_i32_b64");
+		ni(0x0F, "s_bcnt1_i32_b32");
+		ni(0x10, "s_bcnt1_i32_b64");
+		ni(0x11, "s_ff0_i32_b32");
+		ni(0x12, "s_ff0_i32_b64");
+		ni(0x13, "s_ff1_i32_b32");
+		ni(0x14, "s_ff1_i32_b64");
+		ni(0x15, "s_flbit_i32_b32");
+		ni(0x16, "s_flbit_i32_b64");
+		ni(0x17, "s_flbit_i32");
+		ni(0x18, "s_flbit_i32_i64");
+		ni(0x19, "s_sext_i32_i8");
+		ni(0x1A, "s_sext_i32_i16");
+		ni(0x1B, "s_bitset0_b32");
+		ni(0x1C, "s_bitset0_b64");
+		ni(0x1D, "s_bitset1_b32");
+		ni(0x1E, "s_bitset1_b64");
+		ni(0x1F, "s_getpc_b64");
+		op(0x20, ShaderInstructionType::SSetpcB64, ShaderInstructionFormat::Saddr, 0, 2);
+		op(0x21, ShaderInstructionType::SSwappcB64, ShaderInstructionFormat::Sdst2Ssrc02, 2, 2);
+		ni(0x22, "s_rfe_b64");
+		op(0x24, ShaderInstructionType::SAndSaveexecB64, ShaderInstructionFormat::Sdst2Ssrc02, 2, 2);
+		ni(0x25, "s_or_saveexec_b64");
+		ni(0x26, "s_xor_saveexec_b64");
+		ni(0x27, "s_andn2_saveexec_b64");
+		ni(0x28, "s_orn2_saveexec_b64");
+		ni(0x29, "s_nand_saveexec_b64");
+		ni(0x2A, "s_nor_saveexec_b64");
+		ni(0x2B, "s_xnor_saveexec_b64");
+		ni(0x2C, "s_quadmask_b32");
+		ni(0x2D, "s_quadmask_b64");
+		ni(0x2E, "s_movrels_b32");
+		ni(0x2F, "s_movrels_b64");
+		ni(0x30, "s_movreld_b32");
+		ni(0x31, "s_movreld_b64");
+		ni(0x32, "s_cbranch_join");
+		ni(0x33, "s_mov_regrd_b32");
+		ni(0x34, "s_abs_i32");
+		ni(0x35, "s_mov_fed_b32");
+
+		return t;
+	}();
+
+	return table;
+}
+
+static const ShaderSaluOpcode* sop2_opcodes()
+{
+	static const auto* table = []()
+	{
+		auto* t  = new ShaderSaluOpcode[SOP2_OPCODES_NUM];
+		auto  op = [t](uint32_t opcode, ShaderInstructionType type,
+		              ShaderInstructionFormat::Format format = ShaderInstructionFormat::SVdstSVsrc0SVsrc1, int dst_size = 0,
+		              int src0_size = 0, int src1_size = 0)
+		{
+			t[opcode].type        = type;
+			t[opcode].format      = format;
+			t[opcode].dst_size    = dst_size;
+			t[opcode].src_size[0] = src0_size;
+			t[opcode].src_size[1] = src1_size;
+		};
+		auto op64 = [&op](uint32_t opcode, ShaderInstructionType type)
+		{ op(opcode, type, ShaderInstructionFormat::Sdst2Ssrc02Ssrc12, 2, 2, 2); };
+		auto shift64 = [&op](uint32_t opcode, ShaderInstructionType type)
+		{ op(opcode, type, ShaderInstructionFormat::Sdst2Ssrc02Ssrc1, 2, 2); };
+		auto ni = [t](uint32_t opcode, const char* name) { t[opcode].name = name; };
+
+		op(0x00, ShaderInstructionType::SAddU32);
+		ni(0x01, "s_sub_u32");
+		op(0x02, ShaderInstructionType::SAddI32);
+		op(0x03, ShaderInstructionType::SSubI32);
+		op(0x04, ShaderInstructionType::SAddcU32);
+		ni(0x05, "s_subb_u32");
+		ni(0x06, "s_min_i32");
+		ni(0x07, "s_min_u32");
+		ni(0x08, "s_max_i32");
+		ni(0x09, "s_max_u32");
+		op(0x0a, ShaderInstructionType::SCselectB32);
+		op64(0x0b, ShaderInstructionType::SCselectB64);
+		op(0x0e, ShaderInstructionType::SAndB32);
+		op64(0x0f, ShaderInstructionType::SAndB64);
+		op(0x10, ShaderInstructionType::SOrB32);
+		op64(0x11, ShaderInstructionType::SOrB64);
+		ni(0x12, "s_xor_b32");
+		op64(0x13, ShaderInstructionType::SXorB64);
+		ni(0x14, "s_andn2_b32");
+		op64(0x15, ShaderInstructionType::SAndn2B64);
+		ni(0x16, "s_orn2_b32");
+		op64(0x17, ShaderInstructionType::SOrn2B64);
+		ni(0x18, "s_nand_b32");
+		op64(0x19, ShaderInstructionType::SNandB64);
+		ni(0x1A, "s_nor_b32");
+		op64(0x1b, ShaderInstructionType::SNorB64);
+		ni(0x1C, "s_xnor_b32");
+		op64(0x1d, ShaderInstructionType::SXnorB64);
+		op(0x1e, ShaderInstructionType::SLshlB32);
+		shift64(0x1f, ShaderInstructionType::SLshlB64);
+		op(0x20, ShaderInstructionType::SLshrB32);
+		shift64(0x21, ShaderInstructionType::SLshrB64);
+		ni(0x22, "s_ashr_i32");
+		ni(0x23, "s_ashr_i64");
+		op(0x24, ShaderInstructionType::SBfmB32);
+		ni(0x25, "s_bfm_b64");
+		op(0x26, ShaderInstructionType::SMulI32);
+		op(0x27, ShaderInstructionType::SBfeU32);
+		ni(0x28, "s_bfe_i32");
+		shift64(0x29, ShaderInstructionType::SBfeU64);
+		ni(0x2A, "s_bfe_i64");
+		ni(0x2B, "s_cbranch_g_fork");
+		ni(0x2C, "s_absdiff_i32");
+		op(0x31, ShaderInstructionType::SLshl4AddU32);
+		t[0x31].next_gen = true;
+		ni(0x32, "s_pack_ll_b32_b16");
+		ni(0x33, "s_pack_lh_b32_b16");
+		ni(0x34, "s_pack_hh_b32_b16");
+		op(0x35, ShaderInstructionType::SMulHiU32);
+
+		return t;
+	}();
+
+	return table;
+}
+
+static void salu_opcode_decode(const ShaderSaluOpcode* opcodes, uint32_t opcodes_num, uint32_t opcode, uint32_t pc, const char* type_str,
+                               bool next_gen, ShaderCode* dst, ShaderInstruction* inst)
+{
+	const auto* op = (opcode < opcodes_num ? &opcodes[opcode] : nullptr);
+
+	if (op != nullptr && op->type == ShaderInstructionType::Unknown && op->name != nullptr)
+	{
+		KYTY_NI(op->name);
+	}
+
+	if (op == nullptr || op->type == ShaderInstructionType::Unknown)
+	{
+		KYTY_UNKNOWN_OP();
+	}
+
+	EXIT_NOT_IMPLEMENTED(op->next_gen && !next_gen);
+
+	inst->type   = op->type;
+	inst->format = op->format;
+
+	if (op->dst_size != 0)
+	{
+		inst->dst.size = op->dst_size;
+	}
+
+	for (int i = 0; i < inst->src_num; i++)
+	{
+		if (op->src_size[i] != 0)
+		{
+			inst->src[i].size = op->src_size[i];
+		}
+	}
+}
+
 KYTY_SHADER_PARSER(shader_parse_sopc)
 {
 	EXIT_IF(dst == nullptr);
@@ -318,88 +542,7 @@ KYTY_SHADER_PARSER(shader_parse_sop1)
 		size++;
 	}
 
-	switch (opcode)
-	{
-		case 0x03:
-			inst.type   = ShaderInstructionType::SMovB32;
-			inst.format = ShaderInstructionFormat::SVdstSVsrc0;
-			break;
-		case 0x04:
-			inst.type        = ShaderInstructionType::SMovB64;
-			inst.format      = ShaderInstructionFormat::Sdst2Ssrc02;
-			inst.dst.size    = 2;
-			inst.src[0].size = 2;
-			break;
-		case 0x05: KYTY_NI("s_cmov_b32"); break;
-		case 0x06: KYTY_NI("s_cmov_b64"); break;
-		case 0x07: KYTY_NI("s_not_b32"); break;
-		case 0x08: KYTY_NI("s_not_b64"); break;
-		case 0x09: KYTY_NI("s_wqm_b32"); break;
-		case 0x0a:
-			inst.type        = ShaderInstructionType::SWqmB64;
-			inst.format      = ShaderInstructionFormat::Sdst2Ssrc02;
-			inst.dst.size    = 2;
-			inst.src[0].size = 2;
-			break;
-		case 0x0B: KYTY_NI("s_brev_b32"); break;
-		case 0x0C: KYTY_NI("s_brev_b64"); break;
-		case 0x0D: KYTY_NI("s_bcnt0_i32_b32"); break;
-		case 0x0E: KYTY_NI("s_bcnt0_i32_b64"); break;
-		case 0x0F: KYTY_NI("s_bcnt1_i32_b32"); break;
-		case 0x10: KYTY_NI("s_bcnt1_i32_b64"); break;
-		case 0x11: KYTY_NI("s_ff0_i32_b32"); break;
-		case 0x12: KYTY_NI("s_ff0_i32_b64"); break;
-		case 0x13: KYTY_NI("s_ff1_i32_b32"); break;
-		case 0x14: KYTY_NI("s_ff1_i32_b64"); break;
-		case 0x15: KYTY_NI("s_flbit_i32_b32"); break;
-		case 0x16: KYTY_NI("s_flbit_i32_b64"); break;
-		case 0x17: KYTY_NI("s_flbit_i32"); break;
-		case 0x18: KYTY_NI("s_flbit_i32_i64"); break;
-		case 0x19: KYTY_NI("s_sext_i32_i8"); break;
-		case 0x1A: KYTY_NI("s_sext_i32_i16"); break;
-		case 0x1B: KYTY_NI("s_bitset0_b32"); break;
-		case 0x1C: KYTY_NI("s_bitset0_b64"); break;
-		case 0x1D: KYTY_NI("s_bitset1_b32"); break;
-		case 0x1E: KYTY_NI("s_bitset1_b64"); break;
-		case 0x1F: KYTY_NI("s_getpc_b64"); break;
-		case 0x20:
-			inst.type        = ShaderInstructionType::SSetpcB64;
-			inst.format      = ShaderInstructionFormat::Saddr;
-			inst.src[0].size = 2;
-			break;
-		case 0x21:
-			inst.type        = ShaderInstructionType::SSwappcB64;
-			inst.format      = ShaderInstructionFormat::Sdst2Ssrc02;
-			inst.src[0].size = 2;
-			inst.dst.size    = 2;
-			break;
-		case 0x22: KYTY_NI("s_rfe_b64"); break;
-		case 0x24:
-			inst.type        = ShaderInstructionType::SAndSaveexecB64;
-			inst.format      = ShaderInstructionFormat::Sdst2Ssrc02;
-			inst.dst.size    = 2;
-			inst.src[0].size = 2;
-			break;
-		case 0x25: KYTY_NI("s_or_saveexec_b64"); break;
-		case 0x26: KYTY_NI("s_xor_saveexec_b64"); break;
-		case 0x27: KYTY_NI("s_andn2_saveexec_b64"); break;
-		case 0x28: KYTY_NI("s_orn2_saveexec_b64"); break;
-		case 0x29: KYTY_NI("s_nand_saveexec_b64"); break;
-		case 0x2A: KYTY_NI("s_nor_saveexec_b64"); break;
-		case 0x2B: KYTY_NI("s_xnor_saveexec_b64"); break;
-		case 0x2C: KYTY_NI("s_quadmask_b32"); break;
-		case 0x2D: KYTY_NI("s_quadmask_b64"); break;
-		case 0x2E: KYTY_NI("s_movrels_b32"); break;
-		case 0x2F: KYTY_NI("s_movrels_b64"); break;
-		case 0x30: KYTY_NI("s_movreld_b32"); break;
-		case 0x31: KYTY_NI("s_movreld_b64"); break;
-		case 0x32: KYTY_NI("s_cbranch_join"); break;
-		case 0x33: KYTY_NI("s_mov_regrd_b32"); break;
-		case 0x34: KYTY_NI("s_abs_i32"); break;
-		case 0x35: KYTY_NI("s_mov_fed_b32"); break;
-
-		default: KYTY_UNKNOWN_OP();
-	}
+	salu_opcode_decode(sop1_opcodes(), SOP1_OPCODES_NUM, opcode, pc, type_str, next_gen, dst, &inst);
 
 	dst->GetInstructions().Add(inst);
 
@@ -455,133 +598,7 @@ KYTY_SHADER_PARSER(shader_parse_sop2)
 		size++;
 	}
 
-	inst.format = ShaderInstructionFormat::SVdstSVsrc0SVsrc1;
-
-	switch (opcode)
-	{
-		case 0x00: inst.type = ShaderInstructionType::SAddU32; break;
-		case 0x01: KYTY_NI("s_sub_u32"); break;
-		case 0x02: inst.type = ShaderInstructionType::SAddI32; break;
-		case 0x03: inst.type = ShaderInstructionType::SSubI32; break;
-		case 0x04: inst.type = ShaderInstructionType::SAddcU32; break;
-		case 0x05: KYTY_NI("s_subb_u32"); break;
-		case 0x06: KYTY_NI("s_min_i32"); break;
-		case 0x07: KYTY_NI("s_min_u32"); break;
-		case 0x08: KYTY_NI("s_max_i32"); break;
-		case 0x09: KYTY_NI("s_max_u32"); break;
-		case 0x0a: inst.type = ShaderInstructionType::SCselectB32; break;
-		case 0x0b:
-			inst.type        = ShaderInstructionType::SCselectB64;
-			inst.format      = ShaderInstructionFormat::Sdst2Ssrc02Ssrc12;
-			inst.dst.size    = 2;
-			inst.src[0].size = 2;
-			inst.src[1].size = 2;
-			break;
-		case 0x0e: inst.type = ShaderInstructionType::SAndB32; break;
-		case 0x0f:
-			inst.type        = ShaderInstructionType::SAndB64;
-			inst.format      = ShaderInstructionFormat::Sdst2Ssrc02Ssrc12;
-			inst.dst.size    = 2;
-			inst.src[0].size = 2;
-			inst.src[1].size = 2;
-			break;
-		case 0x10: inst.type = ShaderInstructionType::SOrB32; break;
-		case 0x11:
-			inst.type        = ShaderInstructionType::SOrB64;
-			inst.format      = ShaderInstructionFormat::Sdst2Ssrc02Ssrc12;
-			inst.dst.size    = 2;
-			inst.src[0].size = 2;
-			inst.src[1].size = 2;
-			break;
-		case 0x12: KYTY_NI("s_xor_b32"); break;
-		case 0x13:
-			inst.type        = ShaderInstructionType::SXorB64;
-			inst.format      = ShaderInstructionFormat::Sdst2Ssrc02Ssrc12;
-			inst.dst.size    = 2;
-			inst.src[0].size = 2;
-			inst.src[1].size = 2;
-			break;
-		case 0x14: KYTY_NI("s_andn2_b32"); break;
-		case 0x15:
-			inst.type        = ShaderInstructionType::SAndn2B64;
-			inst.format      = ShaderInstructionFormat::Sdst2Ssrc02Ssrc12;
-			inst.dst.size    = 2;
-			inst.src[0].size = 2;
-			inst.src[1].size = 2;
-			break;
-		case 0x16: KYTY_NI("s_orn2_b32"); break;
-		case 0x17:
-			inst.type        = ShaderInstructionType::SOrn2B64;
-			inst.format      = ShaderInstructionFormat::Sdst2Ssrc02Ssrc12;
-			inst.dst.size    = 2;
-			inst.src[0].size = 2;
-			inst.src[1].size = 2;
-			break;
-		case 0x18: KYTY_NI("s_nand_b32"); break;
-		case 0x19:
-			inst.type        = ShaderInstructionType::SNandB64;
-			inst.format      = ShaderInstructionFormat::Sdst2Ssrc02Ssrc12;
-			inst.dst.size    = 2;
-			inst.src[0].size = 2;
-			inst.src[1].size = 2;
-			break;
-		case 0x1A: KYTY_NI("s_nor_b32"); break;
-		case 0x1b:
-			inst.type        = ShaderInstructionType::SNorB64;
-			inst.format      = ShaderInstructionFormat::Sdst2Ssrc02Ssrc12;
-			inst.dst.size    = 2;
-			inst.src[0].size = 2;
-			inst.src[1].size = 2;
-			break;
-		case 0x1C: KYTY_NI("s_xnor_b32"); break;
-		case 0x1d:
-			inst.type        = ShaderInstructionType::SXnorB64;
-			inst.format      = ShaderInstructionFormat::Sdst2Ssrc02Ssrc12;
-			inst.dst.size    = 2;
-			inst.src[0].size = 2;
-			inst.src[1].size = 2;
-			break;
-		case 0x1e: inst.type = ShaderInstructionType::SLshlB32; break;
-		case 0x1f:
-			inst.type        = ShaderInstructionType::SLshlB64;
-			inst.format      = ShaderInstructionFormat::Sdst2Ssrc02Ssrc1;
-			inst.dst.size    = 2;
-			inst.src[0].size = 2;
-			break;
-		case 0x20: inst.type = ShaderInstructionType::SLshrB32; break;
-		case 0x21:
-			inst.type        = ShaderInstructionType::SLshrB64;
-			inst.format      = ShaderInstructionFormat::Sdst2Ssrc02Ssrc1;
-			inst.dst.size    = 2;
-			inst.src[0].size = 2;
-			break;
-		case 0x22: KYTY_NI("s_ashr_i32"); break;
-		case 0x23: KYTY_NI("s_ashr_i64"); break;
-		case 0x24: inst.type = ShaderInstructionType::SBfmB32; break;
-		case 0x25: KYTY_NI("s_bfm_b64"); break;
-		case 0x26: inst.type = ShaderInstructionType::SMulI32; break;
-		case 0x27: inst.type = ShaderInstructionType::SBfeU32; break;
-		case 0x28: KYTY_NI("s_bfe_i32"); break;
-		case 0x29:
-			inst.type        = ShaderInstructionType::SBfeU64;
-			inst.format      = ShaderInstructionFormat::Sdst2Ssrc02Ssrc1;
-			inst.dst.size    = 2;
-			inst.src[0].size = 2;
-			break;
-		case 0x2A: KYTY_NI("s_bfe_i64"); break;
-		case 0x2B: KYTY_NI("s_cbranch_g_fork"); break;
-		case 0x2C: KYTY_NI("s_absdiff_i32"); break;
-		case 0x31:
-			EXIT_NOT_IMPLEMENTED(!next_gen);
-			inst.type = ShaderInstructionType::SLshl4AddU32;
-			break;
-		case 0x32: KYTY_NI("s_pack_ll_b32_b16"); break;
-		case 0x33: KYTY_NI("s_pack_lh_b32_b16"); break;
-		case 0x34: KYTY_NI("s_pack_hh_b32_b16"); break;
-		case 0x35: inst.type = ShaderInstructionType::SMulHiU32; break;
-
-		default: KYTY_UNKNOWN_OP();
-	}
+	salu_opcode_decode(sop2_opcodes(), SOP2_OPCODES_NUM, opcode, pc, type_str, next_gen, dst, &inst);
 
 	dst->GetInstructions().Add(inst);
 
@@ -3345,62 +3362,86 @@ KYTY_SHADER_PARSER(shader_parse_vintrp)
 	return 1;
 }
 
+using shader_parser_t = uint32_t (*)(KYTY_SHADER_PARSER_ARGS);
+
+static constexpr uint32_t ENCODINGS_NUM = 64;
+
+// Encoding is selected by the high 6 bits of the first dword
+static const shader_parser_t* encoding_parsers(bool next_gen)
+{
+	auto create = [](bool next_gen)
+	{
+		auto* t = new shader_parser_t[ENCODINGS_NUM];
+		for (uint32_t e = 0; e < ENCODINGS_NUM; e++)
+		{
+			if (e < 0x20)
+			{
+				t[e] = shader_parse_vop2;
+			} else if (e < 0x30)
+			{
+				t[e] = shader_parse_sop2;
+			} else
+			{
+				t[e] = nullptr;
+			}
+		}
+		if (!next_gen)
+		{
+			t[0x30] = shader_parse_smrd;
+			t[0x31] = shader_parse_smrd;
+			t[0x34] = shader_parse_vop3;
+		} else
+		{
+			t[0x35] = shader_parse_vop3;
+			t[0x3d] = shader_parse_smem;
+		}
+		t[0x32] = shader_parse_vintrp;
+		t[0x36] = shader_parse_ds;
+		t[0x38] = shader_parse_mubuf;
+		t[0x3a] = shader_parse_mtbuf;
+		t[0x3c] = shader_parse_mimg;
+		t[0x3e] = shader_parse_exp;
+		return t;
+	};
+
+	static const auto* gen4 = create(false);
+	static const auto* gen5 = create(true);
+
+	return (next_gen ? gen5 : gen4);
+}
+
 KYTY_SHADER_PARSER(shader_parse)
 {
 	EXIT_IF(dst == nullptr);
 	EXIT_IF(src == nullptr);
 	EXIT_IF(buffer != nullptr);
 
-	auto type = dst->GetType();
+	auto        type    = dst->GetType();
+	const auto* parsers = encoding_parsers(next_gen);
 
 	dst->GetInstructions().Clear();
 	dst->GetLabels().Clear();
 	dst->GetIndirectLabels().Clear();
 
+	// The binary info follows the code, its offset is an upper bound of the instructions number
+	if (pc == 0 && src[0] == 0xBEEB03FF)
+	{
+		dst->GetInstructions().Expand((src[1] + 1) * 2);
+	}
+
 	const auto* ptr = src + pc / 4;
 	for (;;)
 	{
 		auto instruction = ptr[0];
 		auto pc          = 4 * static_cast<uint32_t>(ptr - src);
 
-		if ((instruction & 0x80000000u) == 0x00000000)
-		{
-			ptr += shader_parse_vop2(pc, src, ptr, dst, next_gen);
-		} else if ((instruction & 0xF8000000u) == 0xC0000000)
+		if (auto parser = parsers[instruction >> 26u]; parser != nullptr)
 		{
-			EXIT_NOT_IMPLEMENTED(next_gen);
-			ptr += shader_parse_smrd(pc, src, ptr, dst, next_gen);
-		} else if ((instruction & 0xC0000000u) == 0x80000000)
-		{
-			ptr += shader_parse_sop2(pc, src, ptr, dst, next_gen);
+			ptr += parser(pc, src, ptr, dst, next_gen);
 		} else
 		{
-			switch (instruction >> 26u)
-			{
-				case 0x32: ptr += shader_parse_vintrp(pc, src, ptr, dst, next_gen); break;
-				case 0x34:
-					EXIT_NOT_IMPLEMENTED(next_gen);
-					ptr += shader_parse_vop3(pc, src, ptr, dst, next_gen);
-					break;
-				case 0x35:
-					EXIT_NOT_IMPLEMENTED(!next_gen);
-					ptr += shader_parse_vop3(pc, src, ptr, dst, next_gen);
-					break;
-				case 0x36: ptr += shader_parse_ds(pc, src, ptr, dst, next_gen); break;
-				case 0x38: ptr += shader_parse_mubuf(pc, src, ptr, dst, next_gen); break;
-				case 0x3a: ptr += shader_parse_mtbuf(pc, src, ptr, dst, next_gen); break;
-				case 0x3c: ptr += shader_parse_mimg(pc, src, ptr, dst, next_gen); break;
-				case 0x3d:
-					EXIT_NOT_IMPLEMENTED(!next_gen);
-					ptr += shader_parse_smem(pc, src, ptr, dst, next_gen);
-					break;
-				case 0x3e: ptr += shader_parse_exp(pc, src, ptr, dst, next_gen); break;
-				default:
-				{
-					printf("%s", dst->DbgDump().c_str());
-					EXIT("unknown code 0x%08" PRIx32 " at addr 0x%08" PRIx32 "\n", ptr[0], pc);
-				}
-			}
+			printf("%s", dst->DbgDump().c_str());
+			EXIT("unknown code 0x%08" PRIx32 " at addr 0x%08" PRIx32 "\n", ptr[0], pc);
 		}
 
 		if ((instruction == 0xBF810000 && (type == ShaderType::Vertex || type == ShaderType::Pixel || type == ShaderType::Compute) &&
@@ -3419,6 +3460,11 @@ void ShaderParse(const uint32_t* src, ShaderCode* dst)
 	shader_parse(0, src, nullptr, dst, Config::IsNextGen());
 }
 
+void ShaderParse(const uint32_t* src, ShaderCode* dst, bool next_gen)
+{
+	shader_parse(0, src, nullptr, dst, next_gen);
+}
+
 } // namespace Kyty::Libs::Graphics
 
 #endif // KYTY_EMU_ENABLED
@@ -10,6 +10,12 @@
 
 #include "Emulator/Config.h"
 #include "Emulator/Graphics/Shader.h"
+#include "Emulator/Graphics/ShaderOptimize.h"
+
+#include <algorithm>
+#include <iterator>
+
+#include "EmbeddedShaders.h"
 
 #ifdef KYTY_EMU_ENABLED
 
@@ -146,24 +152,6 @@ constexpr char FUNC_ABS_DIFF[] = R"(
                OpFunctionEnd
 )";
 
-constexpr char FUNC_WQM[] = R"(
-                    ; uint w(uint u, uint s, uint m)
-                    ; {
-                    ; 	return ((u >> s) & 0xF) != 0 ? m : 0;
-                    ; }
-         %wqm = OpFunction %uint None %function_u_u_u
-         %wqm_155 = OpFunctionParameter %uint
-         %wqm_156 = OpFunctionParameter %uint
-         %wqm_161 = OpFunctionParameter %uint
-         %wqm_50 = OpLabel
-        %wqm_157 = OpShiftRightLogical %uint %wqm_155 %wqm_156
-        %wqm_159 = OpBitwiseAnd %uint %wqm_157 %uint_15
-        %wqm_160 = OpINotEqual %bool %wqm_159 %uint_0
-        %wqm_162 = OpSelect %uint %wqm_160 %wqm_161 %uint_0
-               OpReturnValue %wqm_162
-               OpFunctionEnd
-)";
-
 constexpr char FUNC_ADDC[] = R"(
                   ; uvec2 addc(uint a, uint b, uint c)
                   ; {
@@ -1241,125 +1229,6 @@ constexpr char SBUFFER_LOAD_DWORD_16[] = R"(
                OpFunctionEnd
 )";
 
-constexpr char EMBEDDED_SHADER_VS_0[] = R"(
-               ; #version 450
-               ; 
-               ; void main() 
-               ; {
-               ; 	float x = gl_VertexIndex == 0 || gl_VertexIndex == 2 ? 1.0 : -1.0;
-               ; 	float y = gl_VertexIndex == 2 || gl_VertexIndex == 3 ? -1.0 : 1.0;
-               ; 
-               ;     gl_Position = vec4(x,y, 0.0, 1.0);
-               ; }
-
-               OpCapability Shader
-          %1 = OpExtInstImport "GLSL.std.450"
-               OpMemoryModel Logical GLSL450
-               OpEntryPoint Vertex %4 "main" %gl_VertexIndex %43
-
-               ; Annotations
-               OpDecorate %gl_VertexIndex BuiltIn VertexIndex
-               OpMemberDecorate %_struct_41 0 BuiltIn Position
-               OpMemberDecorate %_struct_41 1 BuiltIn PointSize
-               OpMemberDecorate %_struct_41 2 BuiltIn ClipDistance
-               OpMemberDecorate %_struct_41 3 BuiltIn CullDistance
-               OpDecorate %_struct_41 Block
-
-               ; Types, variables and constants
-       %void = OpTypeVoid
-          %3 = OpTypeFunction %void
-      %float = OpTypeFloat 32
-%_ptr_Function_float = OpTypePointer Function %float
-       %bool = OpTypeBool
-        %int = OpTypeInt 32 1
-%_ptr_Input_int = OpTypePointer Input %int
-%gl_VertexIndex = OpVariable %_ptr_Input_int Input
-      %int_0 = OpConstant %int 0
-      %int_2 = OpConstant %int 2
-    %float_1 = OpConstant %float 1
-   %float_n1 = OpConstant %float -1
-      %int_3 = OpConstant %int 3
-    %v4float = OpTypeVector %float 4
-       %uint = OpTypeInt 32 0
-     %uint_1 = OpConstant %uint 1
-%_arr_float_uint_1 = OpTypeArray %float %uint_1
- %_struct_41 = OpTypeStruct %v4float %float %_arr_float_uint_1 %_arr_float_uint_1
-%_ptr_Output__struct_41 = OpTypePointer Output %_struct_41
-         %43 = OpVariable %_ptr_Output__struct_41 Output
-    %float_0 = OpConstant %float 0
-%_ptr_Output_v4float = OpTypePointer Output %v4float
-
-               ; Function 4
-          %4 = OpFunction %void None %3
-          %5 = OpLabel
-          %8 = OpVariable %_ptr_Function_float Function
-         %26 = OpVariable %_ptr_Function_float Function
-         %13 = OpLoad %int %gl_VertexIndex
-         %15 = OpIEqual %bool %13 %int_0
-         %16 = OpLogicalNot %bool %15
-               OpSelectionMerge %18 None
-               OpBranchConditional %16 %17 %18
-         %17 = OpLabel
-         %21 = OpIEqual %bool %13 %int_2
-               OpBranch %18
-         %18 = OpLabel
-         %22 = OpPhi %bool %15 %5 %21 %17
-         %25 = OpSelect %float %22 %float_1 %float_n1
-               OpStore %8 %25
-         %28 = OpIEqual %bool %13 %int_2
-         %29 = OpLogicalNot %bool %28
-               OpSelectionMerge %31 None
-               OpBranchConditional %29 %30 %31
-         %30 = OpLabel
-         %34 = OpIEqual %bool %13 %int_3
-               OpBranch %31
-         %31 = OpLabel
-         %35 = OpPhi %bool %28 %18 %34 %30
-         %36 = OpSelect %float %35 %float_n1 %float_1
-               OpStore %26 %36
-         %47 = OpCompositeConstruct %v4float %25 %36 %float_0 %float_1
-         %49 = OpAccessChain %_ptr_Output_v4float %43 %int_0
-               OpStore %49 %47
-               OpReturn
-               OpFunctionEnd
-)";
-
-constexpr char EMBEDDED_SHADER_PS_0[] = R"(
-               ; #version 450
-               ; 
-               ; layout(location = 0) out vec4 outColor;
-               ; 
-               ; void main() {
-               ; 	outColor = vec4(0);
-               ; }
-
-               OpCapability Shader
-          %1 = OpExtInstImport "GLSL.std.450"
-               OpMemoryModel Logical GLSL450
-               OpEntryPoint Fragment %4 "main" %9
-               OpExecutionMode %4 OriginUpperLeft
-
-               ; Annotations
-               OpDecorate %9 Location 0
-
-               ; Types, variables and constants
-       %void = OpTypeVoid
-          %3 = OpTypeFunction %void
-      %float = OpTypeFloat 32
-    %v4float = OpTypeVector %float 4
-%_ptr_Output_v4float = OpTypePointer Output %v4float
-          %9 = OpVariable %_ptr_Output_v4float Output
-    %float_0 = OpConstant %float 0
-         %11 = OpConstantComposite %v4float %float_0 %float_0 %float_0 %float_0
-
-               ; Function 4
-          %4 = OpFunction %void None %3
-          %5 = OpLabel
-               OpStore %9 %11
-               OpReturn
-               OpFunctionEnd
-)";
-
 constexpr char EXECZ[] = R"(
         %z191_<index> = OpLoad %uint %exec_lo
         %z192_<index> = OpIEqual %bool %z191_<index> %uint_0
@@ -1499,12 +1368,25 @@ public:
 		*field  = m_extended_mapping[offset][1];
 	}
 
+	[[nodiscard]] bool IsLoopBackedge(int index) const
+	{
+		return m_loops.Contains(index, [](const Loop& loop, int index) { return loop.backedge_index == index; });
+	}
+
 private:
 	struct Variable
 	{
 		ShaderOperand op;
 	};
 
+	// A conditional branch back to the header, with no other branches into or out of the body
+	struct Loop
+	{
+		int         head_index     = 0;
+		int         backedge_index = 0;
+		ShaderLabel label {0, 0};
+	};
+
 	struct Constant
 	{
 		SpirvType      type     = SpirvType::Unknown;
@@ -1533,6 +1415,7 @@ private:
 
 	void FindConstants();
 	void FindVariables();
+	void FindLoops();
 
 	void ModifyCode();
 
@@ -1542,6 +1425,7 @@ private:
 	ShaderCode                    m_code;
 	Vector<Constant>              m_constants;
 	Vector<Variable>              m_variables;
+	Vector<Loop>                  m_loops;
 	const ShaderVertexInputInfo*  m_vs_input_info = nullptr;
 	const ShaderComputeInputInfo* m_cs_input_info = nullptr;
 	const ShaderPixelInputInfo*   m_ps_input_info = nullptr;
@@ -4073,7 +3957,31 @@ KYTY_RECOMPILER_FUNC(Recompile_SCbranch_XXX_Label)
 
 	EXIT_NOT_IMPLEMENTED(!operand_is_constant(inst.src[0]));
 
-	// TODO(): analyze control flow graph
+	//	do
+	//	{
+	//		L1: /* header */
+	//		...
+	//	} while (condition);
+	//	/* merge */
+	static const char* text_loop = R"(
+        <param0>
+        <param1>
+               OpBranch %loop_continue_<index>
+        %loop_continue_<index> = OpLabel
+               OpBranchConditional %cc_b_<index> %<label> %loop_merge_<index>
+        %loop_merge_<index> = OpLabel
+)";
+
+	if (spirv->IsLoopBackedge(static_cast<int>(index)))
+	{
+		*dst_source += String8(text_loop)
+		                   .ReplaceStr("<param0>", param[0])
+		                   .ReplaceStr("<param1>", param[1])
+		                   .ReplaceStr("<index>", String8::FromPrintf("%u", index))
+		                   .ReplaceStr("<label>", ShaderLabel(inst).ToString());
+		return true;
+	}
+
 	auto label            = ShaderLabel(inst);
 	auto dst_block        = code.ReadBlock(label.GetDst());
 	auto next_block       = code.ReadBlock(next_inst.pc);
@@ -4347,7 +4255,7 @@ KYTY_RECOMPILER_FUNC(Recompile_SLoadDwordx4_Sdst4SbaseSoffset)
 		EXIT_NOT_IMPLEMENTED(src0_value1.type != SpirvType::Uint);
 
 		static const char* text = R"(
-		         %vsharp_<index>_<reg> = OpAccessChain %_ptr_PushConstant_uint %vsharp %int_0 %int_<buffer> %int_<field>
+		         %vsharp_<index>_<reg> = OpAccessChain %_ptr_Vsharp_uint %vsharp %int_0 %int_<buffer> %int_<field>
 		         %vsharp_<index>_value_<reg> = OpLoad %uint %vsharp_<index>_<reg>
 		               OpStore %<reg> %vsharp_<index>_value_<reg>
 				)";
@@ -4410,7 +4318,7 @@ KYTY_RECOMPILER_FUNC(Recompile_SLoadDwordx8_Sdst8SbaseSoffset)
 		EXIT_NOT_IMPLEMENTED(src0_value1.type != SpirvType::Uint);
 
 		static const char* text = R"(
-		         %vsharp_<index>_<reg> = OpAccessChain %_ptr_PushConstant_uint %vsharp %int_0 %int_<buffer> %int_<field>
+		         %vsharp_<index>_<reg> = OpAccessChain %_ptr_Vsharp_uint %vsharp %int_0 %int_<buffer> %int_<field>
 		         %vsharp_<index>_value_<reg> = OpLoad %uint %vsharp_<index>_<reg>
 		               OpStore %<reg> %vsharp_<index>_value_<reg>
 				)";
@@ -4650,43 +4558,25 @@ KYTY_RECOMPILER_FUNC(Recompile_SWqmB64_Sdst2Ssrc02)
 		return false;
 	}
 
+	// A nibble of the result is 0xF if any bit of the source nibble is set: the bits of each nibble are folded into its lowest bit,
+	// which is then spread back over the nibble
 	static const char* text = R"(
         <load0>
         <load1>
-        %t170_<index> = OpFunctionCall %uint %wqm %t0_<index> %uint_0 %uint_15
-        %t172_<index> = OpBitwiseOr %uint %uint_0 %t170_<index>
-        %t179_<index> = OpFunctionCall %uint %wqm %t0_<index> %uint_4 %uint_240
-        %t181_<index> = OpBitwiseOr %uint %t172_<index> %t179_<index>
-        %t188_<index> = OpFunctionCall %uint %wqm %t0_<index> %uint_8 %uint_0x00000f00
-        %t190_<index> = OpBitwiseOr %uint %t181_<index> %t188_<index>
-        %t197_<index> = OpFunctionCall %uint %wqm %t0_<index> %uint_12 %uint_0x0000f000
-        %t199_<index> = OpBitwiseOr %uint %t190_<index> %t197_<index>
-        %t206_<index> = OpFunctionCall %uint %wqm %t0_<index> %uint_16 %uint_0x000f0000
-        %t208_<index> = OpBitwiseOr %uint %t199_<index> %t206_<index>
-        %t215_<index> = OpFunctionCall %uint %wqm %t0_<index> %uint_20 %uint_0x00f00000
-        %t217_<index> = OpBitwiseOr %uint %t208_<index> %t215_<index>
-        %t224_<index> = OpFunctionCall %uint %wqm %t0_<index> %uint_24 %uint_0x0f000000
-        %t226_<index> = OpBitwiseOr %uint %t217_<index> %t224_<index>
-        %t233_<index> = OpFunctionCall %uint %wqm %t0_<index> %uint_28 %uint_0xf0000000
-        %t235_<index> = OpBitwiseOr %uint %t226_<index> %t233_<index>
-        %t1701_<index> = OpFunctionCall %uint %wqm %t1_<index> %uint_0 %uint_15
-        %t1721_<index> = OpBitwiseOr %uint %uint_0 %t1701_<index>
-        %t1791_<index> = OpFunctionCall %uint %wqm %t1_<index> %uint_4 %uint_240
-        %t1811_<index> = OpBitwiseOr %uint %t1721_<index> %t1791_<index>
-        %t1881_<index> = OpFunctionCall %uint %wqm %t1_<index> %uint_8 %uint_0x00000f00
-        %t1901_<index> = OpBitwiseOr %uint %t1811_<index> %t1881_<index>
-        %t1971_<index> = OpFunctionCall %uint %wqm %t1_<index> %uint_12 %uint_0x0000f000
-        %t1991_<index> = OpBitwiseOr %uint %t1901_<index> %t1971_<index>
-        %t2061_<index> = OpFunctionCall %uint %wqm %t1_<index> %uint_16 %uint_0x000f0000
-        %t2081_<index> = OpBitwiseOr %uint %t1991_<index> %t2061_<index>
-        %t2151_<index> = OpFunctionCall %uint %wqm %t1_<index> %uint_20 %uint_0x00f00000
-        %t2171_<index> = OpBitwiseOr %uint %t2081_<index> %t2151_<index>
-        %t2241_<index> = OpFunctionCall %uint %wqm %t1_<index> %uint_24 %uint_0x0f000000
-        %t2261_<index> = OpBitwiseOr %uint %t2171_<index> %t2241_<index>
-        %t2331_<index> = OpFunctionCall %uint %wqm %t1_<index> %uint_28 %uint_0xf0000000
-        %t2351_<index> = OpBitwiseOr %uint %t2261_<index> %t2331_<index>
-               OpStore %<dst0> %t235_<index>
-               OpStore %<dst1> %t2351_<index>
+        %t2_<index> = OpShiftRightLogical %uint %t0_<index> %uint_1
+        %t3_<index> = OpBitwiseOr %uint %t0_<index> %t2_<index>
+        %t4_<index> = OpShiftRightLogical %uint %t3_<index> %uint_2
+        %t5_<index> = OpBitwiseOr %uint %t3_<index> %t4_<index>
+        %t6_<index> = OpBitwiseAnd %uint %t5_<index> %uint_0x11111111
+        %t7_<index> = OpIMul %uint %t6_<index> %uint_15
+        %t12_<index> = OpShiftRightLogical %uint %t1_<index> %uint_1
+        %t13_<index> = OpBitwiseOr %uint %t1_<index> %t12_<index>
+        %t14_<index> = OpShiftRightLogical %uint %t13_<index> %uint_2
+        %t15_<index> = OpBitwiseOr %uint %t13_<index> %t14_<index>
+        %t16_<index> = OpBitwiseAnd %uint %t15_<index> %uint_0x11111111
+        %t17_<index> = OpIMul %uint %t16_<index> %uint_15
+               OpStore %<dst0> %t7_<index>
+               OpStore %<dst1> %t17_<index>
         <execz>
         <scc>
 )";
@@ -6445,25 +6335,42 @@ const RecompilerFunc* RecompFunc(ShaderInstructionType type, ShaderInstructionFo
 	    // clang-format on
 	};
 
-	static Core::Hashmap<ShaderInstructionTypeFormat, const RecompilerFunc*>* map = nullptr;
-
-	if (map == nullptr)
+	// Shaders are recompiled by several threads at once, so the map is built by the thread-safe static initialization
+	static const auto* map = []()
 	{
-		map = new Core::Hashmap<ShaderInstructionTypeFormat, const RecompilerFunc*>();
+		auto* m = new Core::Hashmap<ShaderInstructionTypeFormat, const RecompilerFunc*>();
 
 		for (const auto& func: g_recomp_func)
 		{
 			ShaderInstructionTypeFormat p = {func.type, func.format};
-			EXIT_IF(map->Contains(p));
-			map->Put(p, &func);
+			EXIT_IF(m->Contains(p));
+			m->Put(p, &func);
 		}
-	}
+
+		return m;
+	}();
 
 	ShaderInstructionTypeFormat p = {type, format};
 
 	return map->Get(p, nullptr);
 }
 
+bool SpirvAcceptsConstantSources(const ShaderInstruction& inst)
+{
+	static const inst_recompile_func_t funcs[] = {
+	    Recompile_V_XXX_F32_SVdstSVsrc0SVsrc1,   Recompile_V_XXX_B32_SVdstSVsrc0SVsrc1,   Recompile_V_XXX_I32_SVdstSVsrc0SVsrc1,
+	    Recompile_V_XXX_F32_VdstVsrc0Vsrc1Vsrc2, Recompile_V_XXX_U32_VdstVsrc0Vsrc1Vsrc2, Recompile_V_XXX_U32_VdstSdst2Vsrc0Vsrc1,
+	    Recompile_V_XXX_F32_SVdstSVsrc0,         Recompile_V_XXX_B32_SVdstSVsrc0,         Recompile_VCvtF32_XXX_SVdstSVsrc0,
+	    Recompile_VCvt_XXX_F32_SVdstSVsrc0,      Recompile_VCmp_XXX_F32_SmaskVsrc0Vsrc1,  Recompile_VCmp_XXX_I32_SmaskVsrc0Vsrc1,
+	    Recompile_VCmp_XXX_U32_SmaskVsrc0Vsrc1,  Recompile_VCndmaskB32_VdstVsrc0Vsrc1Smask2, Recompile_VCvtPkrtzF16F32_SVdstSVsrc0SVsrc1,
+	    Recompile_VMovB32_SVdstSVsrc0,
+	};
+
+	const auto* func = RecompFunc(inst.type, inst.format);
+
+	return func != nullptr && std::find(std::begin(funcs), std::end(funcs), func->func) != std::end(funcs);
+}
+
 void Spirv::AddConstantUint(uint32_t u)
 {
 	ShaderConstant c {};
@@ -6661,6 +6568,11 @@ void Spirv::GenerateSource()
 		default: m_bind = nullptr; break;
 	}
 
+	if (Config::ShaderCodeOptimizationEnabled())
+	{
+		ShaderOptimize(&m_code);
+	}
+
 	if (m_vs_input_info != nullptr)
 	{
 		if (m_vs_input_info->fetch_embedded || m_vs_input_info->fetch_inline)
@@ -6835,6 +6747,9 @@ void Spirv::WriteAnnotations()
                OpDecorate %gl_LocalInvocationID BuiltIn LocalInvocationId
                OpDecorate %gl_WorkGroupID BuiltIn WorkgroupId
                OpDecorate %gl_WorkGroupSize BuiltIn WorkgroupSize
+               OpDecorate %cs_local_size_x SpecId 0
+               OpDecorate %cs_local_size_y SpecId 1
+               OpDecorate %cs_local_size_z SpecId 2
                <Variables>
 )";
 
@@ -6923,6 +6838,11 @@ void Spirv::WriteAnnotations()
        OpDecorate %BufferResource Block
 )";
 
+	static const char* vsharp_uniform_annotations = R"(
+       OpDecorate %vsharp DescriptorSet <DescriptorSet>
+       OpDecorate %vsharp Binding 0
+)";
+
 	if (m_bind != nullptr)
 	{
 		if (m_bind->storage_buffers.buffers_num > 0)
@@ -6959,7 +6879,12 @@ void Spirv::WriteAnnotations()
 		{
 			m_source += String8(vsharp_annotations)
 			                .ReplaceStr("<buffers_num>", String8::FromPrintf("%d", m_bind->push_constant_size / 16))
-			                .ReplaceStr("<Offset>", String8::FromPrintf("%u", m_bind->push_constant_offset));
+			                .ReplaceStr("<Offset>", String8::FromPrintf("%u", m_bind->uniform_buffer ? 0 : m_bind->push_constant_offset));
+			if (m_bind->uniform_buffer)
+			{
+				m_source += String8(vsharp_uniform_annotations)
+				                .ReplaceStr("<DescriptorSet>", String8::FromPrintf("%u", m_bind->uniform_buffer_slot));
+			}
 		}
 	}
 }
@@ -7092,10 +7017,10 @@ void Spirv::WriteTypes()
          %vsharp_buffers_num_uint_<buffers_num> = OpConstant %uint <buffers_num>
                              %vsharp_num_uint_4 = OpConstant %uint 4
                         %vsharp_arr_uint_uint_4 = OpTypeArray %uint %vsharp_num_uint_4
-%vsharp_arr__arr_uint_uint_4_uint_<buffers_num> = OpTypeArray %vsharp_arr_uint_uint_4 %vsharp_buffers_num_uint_<buffers_num>
+%vsharp_arr__arr_uint_uint_4_uint_<buffers_num> = OpTypeArray <Element> %vsharp_buffers_num_uint_<buffers_num>
                                 %BufferResource = OpTypeStruct %vsharp_arr__arr_uint_uint_4_uint_<buffers_num>           
-              %_ptr_PushConstant_BufferResource = OpTypePointer PushConstant %BufferResource
-                        %_ptr_PushConstant_uint = OpTypePointer PushConstant %uint
+                    %_ptr_Vsharp_BufferResource = OpTypePointer <StorageClass> %BufferResource
+                              %_ptr_Vsharp_uint = OpTypePointer <StorageClass> %uint
 )";
 
 	if (m_bind != nullptr)
@@ -7125,7 +7050,11 @@ void Spirv::WriteTypes()
 		}
 		if (m_bind->push_constant_size > 0)
 		{
-			m_source += String8(vsharp_types).ReplaceStr("<buffers_num>", String8::FromPrintf("%d", m_bind->push_constant_size / 16));
+			// std140 needs a stride of 16 for the elements, so a uniform buffer has vectors instead of arrays
+			m_source += String8(vsharp_types)
+			                .ReplaceStr("<buffers_num>", String8::FromPrintf("%d", m_bind->push_constant_size / 16))
+			                .ReplaceStr("<Element>", m_bind->uniform_buffer ? "%v4uint" : "%vsharp_arr_uint_uint_4")
+			                .ReplaceStr("<StorageClass>", m_bind->uniform_buffer ? "Uniform" : "PushConstant");
 		}
 	}
 }
@@ -7201,7 +7130,8 @@ void Spirv::WriteGlobalVariables()
 		}
 		if (m_bind->push_constant_size > 0)
 		{
-			vars.Add("%vsharp = OpVariable %_ptr_PushConstant_BufferResource PushConstant");
+			vars.Add(m_bind->uniform_buffer ? "%vsharp = OpVariable %_ptr_Vsharp_BufferResource Uniform"
+			                                 : "%vsharp = OpVariable %_ptr_Vsharp_BufferResource PushConstant");
 		}
 	}
 
@@ -7245,9 +7175,11 @@ void Spirv::WriteGlobalVariables()
 		case ShaderType::Compute:
 			if (m_cs_input_info != nullptr)
 			{
-				vars.Add(String8::FromPrintf("%%gl_WorkGroupSize = OpConstantComposite %%v3uint %%uint_%u %%uint_%u %%uint_%u",
-				                             m_cs_input_info->threads_num[0], m_cs_input_info->threads_num[1],
-				                             m_cs_input_info->threads_num[2]));
+				// The size is set when the pipeline is created, these are the defaults
+				vars.Add(String8::FromPrintf("%%cs_local_size_x = OpSpecConstant %%uint %u", m_cs_input_info->threads_num[0]));
+				vars.Add(String8::FromPrintf("%%cs_local_size_y = OpSpecConstant %%uint %u", m_cs_input_info->threads_num[1]));
+				vars.Add(String8::FromPrintf("%%cs_local_size_z = OpSpecConstant %%uint %u", m_cs_input_info->threads_num[2]));
+				vars.Add("%gl_WorkGroupSize = OpSpecConstantComposite %v3uint %cs_local_size_x %cs_local_size_y %cs_local_size_z");
 			}
 			m_source += String8(compute_variables).ReplaceStr("<Variables>", vars.Concat("\n" + String8(' ', 15)));
 			break;
@@ -7386,7 +7318,7 @@ void Spirv::WriteLocalVariables()
 	if (m_bind != nullptr)
 	{
 		static const char* text = R"(
-         %vsharp_<reg> = OpAccessChain %_ptr_PushConstant_uint %vsharp %int_0 %int_<buffer> %int_<field>
+         %vsharp_<reg> = OpAccessChain %_ptr_Vsharp_uint %vsharp %int_0 %int_<buffer> %int_<field>
          %vsharp_value_<reg> = OpLoad %uint %vsharp_<reg>
                OpStore %<reg> %vsharp_value_<reg>
 		)";
@@ -7559,10 +7491,16 @@ void Spirv::WriteLabel(int index)
 
 		auto& labels     = m_code.GetLabels();
 		int   labels_num = 0;
+
+		// The back edge must target the block with OpLoopMerge, and no other branch may enter the loop after it, so its label goes last
+		auto loop_index = m_loops.Find(index, [](const Loop& loop, int index) { return loop.head_index == index; });
+		bool loop       = m_loops.IndexValid(loop_index);
+
 		for (uint32_t i = labels.Size(); i > 0; i--)
 		{
 			auto& label = labels[i - 1];
-			if (!label.IsDisabled() && label.GetDst() == inst.pc)
+			if (!label.IsDisabled() && label.GetDst() == inst.pc &&
+			    !(loop && label.GetSrc() == m_loops.At(loop_index).label.GetSrc()))
 			{
 				static const char* text = R"(
                    <branch>
@@ -7586,6 +7524,103 @@ void Spirv::WriteLabel(int index)
 				}
 			}
 		}
+
+		if (loop)
+		{
+			static const char* text = R"(
+                   <branch>
+                   %<label> = OpLabel
+                   OpLoopMerge %loop_merge_<backedge> %loop_continue_<backedge> None
+                   OpBranch %loop_body_<backedge>
+                   %loop_body_<backedge> = OpLabel
+		)";
+
+			const auto& l = m_loops.At(loop_index);
+
+			bool skip_branch = ((instructions.At(index - 1).type == ShaderInstructionType::SEndpgm ||
+			                     instructions.At(index - 1).type == ShaderInstructionType::SBranch) &&
+			                    labels_num == 0);
+
+			m_source += String8(text)
+			                .ReplaceStr("<branch>", (skip_branch ? "" : "OpBranch %<label>"))
+			                .ReplaceStr("<label>", l.label.ToString())
+			                .ReplaceStr("<backedge>", String8::FromPrintf("%d", l.backedge_index));
+		}
+	}
+}
+
+// Only loops which can be expressed as a structured do-while are found. The other backward branches are left as before.
+void Spirv::FindLoops()
+{
+	m_loops.Clear();
+
+	const auto& instructions = m_code.GetInstructions();
+	const auto& labels       = m_code.GetLabels();
+	int         inst_count   = static_cast<int>(instructions.Size());
+
+	for (int backedge_index = 0; backedge_index < inst_count; backedge_index++)
+	{
+		const auto& inst = instructions.At(backedge_index);
+
+		if (inst.type != ShaderInstructionType::SCbranchExecz && inst.type != ShaderInstructionType::SCbranchScc0 &&
+		    inst.type != ShaderInstructionType::SCbranchScc1 && inst.type != ShaderInstructionType::SCbranchVccz &&
+		    inst.type != ShaderInstructionType::SCbranchVccnz)
+		{
+			continue;
+		}
+
+		ShaderLabel back(inst);
+
+		uint32_t head_pc = back.GetDst();
+		uint32_t end_pc  = inst.pc;
+
+		if (head_pc > end_pc)
+		{
+			continue;
+		}
+
+		auto head_index = instructions.Find(head_pc, [](const ShaderInstruction& i, uint32_t pc) { return i.pc == pc; });
+
+		// Labels aren't written before the first instruction
+		bool structured = (instructions.IndexValid(head_index) && head_index != 0 && !m_code.ReadBlock(head_pc).is_discard &&
+		                   labels.Contains(back, [](const ShaderLabel& l, const ShaderLabel& back)
+		                                   { return l.GetDst() == back.GetDst() && l.GetSrc() == back.GetSrc(); }));
+
+		for (int i = static_cast<int>(head_index); structured && i < backedge_index; i++)
+		{
+			structured = (instructions.At(i).type != ShaderInstructionType::SEndpgm);
+		}
+
+		for (const auto& l: labels)
+		{
+			if (!structured)
+			{
+				break;
+			}
+			if (l.IsDisabled() || l.GetSrc() == end_pc)
+			{
+				continue;
+			}
+
+			bool src_inside = (l.GetSrc() >= head_pc && l.GetSrc() <= end_pc);
+			bool dst_inside = (l.GetDst() > head_pc && l.GetDst() <= end_pc);
+
+			structured = (src_inside == dst_inside && !(src_inside && l.GetDst() == head_pc) &&
+			              !(dst_inside && m_code.ReadBlock(l.GetDst()).is_discard));
+		}
+
+		structured = structured && !m_code.GetIndirectLabels().Contains(
+		                               head_pc, [end_pc](const ShaderLabel& l, uint32_t head_pc)
+		                               { return l.GetDst() >= head_pc && l.GetDst() <= end_pc; });
+
+		if (structured)
+		{
+			Loop loop;
+			loop.head_index     = static_cast<int>(head_index);
+			loop.backedge_index = backedge_index;
+			loop.label          = back;
+			m_loops.Add(loop);
+		}
 	}
 }
 
@@ -7797,16 +7832,26 @@ void Spirv::DetectFetch()
 void Spirv::WriteInstructions()
 {
 	ModifyCode();
+	FindLoops();
 
 	int         index        = -1;
 	const auto& instructions = m_code.GetInstructions();
 	bool        need_debug   = (Config::SpirvDebugPrintfEnabled() && !m_code.GetDebugPrintfs().IsEmpty());
+	// The prolog starts with all the lanes enabled. Until the first write or branch target, exec reads are replaced with this value.
+	bool exec_known = Config::ShaderCodeOptimizationEnabled();
 	for (const auto& inst: instructions)
 	{
 		index++;
 
 		WriteLabel(index);
 
+		if (exec_known &&
+		    (m_code.GetLabels().Contains(inst.pc, [](auto label, auto pc) { return !label.IsDisabled() && label.GetDst() == pc; }) ||
+		     m_code.GetIndirectLabels().Contains(inst.pc, [](auto label, auto pc) { return label.GetDst() == pc; })))
+		{
+			exec_known = false;
+		}
+
 		String8 src = ShaderCode::DbgInstructionToStr(inst);
 		String8 dst;
 		String8 dst_debug;
@@ -7822,6 +7867,19 @@ void Spirv::WriteInstructions()
 			ok = func->func(index, m_code, &dst, this, func->param, func->scc_check);
 		}
 
+		if (ok && exec_known)
+		{
+			if (dst.ContainsStr("OpStore %exec"))
+			{
+				exec_known = false;
+			} else
+			{
+				dst = dst.ReplaceStr("OpLoad %uint %exec_lo", "OpCopyObject %uint %uint_1")
+				          .ReplaceStr("OpLoad %uint %exec_hi", "OpCopyObject %uint %uint_0")
+				          .ReplaceStr("OpLoad %uint %execz", "OpCopyObject %uint %uint_0");
+			}
+		}
+
 		if (!ok)
 		{
 			printf("%s\n", m_source.c_str());
@@ -7855,11 +7913,6 @@ void Spirv::WriteFunctions()
 		m_source += FUNC_ABS_DIFF;
 	}
 
-	if (m_code.HasAnyOf({ShaderInstructionType::SWqmB64}))
-	{
-		m_source += FUNC_WQM;
-	}
-
 	if (m_code.HasAnyOf({ShaderInstructionType::SAddcU32}))
 	{
 		m_source += FUNC_ADDC;
@@ -7990,6 +8043,10 @@ void Spirv::FindConstants()
 		AddConstantUint(0x0f000000);
 		AddConstantUint(0xf0000000);
 	}
+	if (m_code.HasAnyOf({ShaderInstructionType::SWqmB64}))
+	{
+		AddConstantUint(0x11111111);
+	}
 	if (m_cs_input_info != nullptr)
 	{
 		AddConstantUint(m_cs_input_info->threads_num[0]);
@@ -8084,18 +8141,37 @@ String8 SpirvGenerateSource(const ShaderCode& code, const ShaderVertexInputInfo*
 	return spirv.GetSource();
 }
 
-String8 SpirvGetEmbeddedVs(uint32_t id)
+Vector<uint32_t> SpirvGetEmbeddedVs(uint32_t id)
 {
 	EXIT_NOT_IMPLEMENTED(id != 0);
 
-	return EMBEDDED_SHADER_VS_0;
+	Vector<uint32_t> ret;
+	ret.Add(EMBEDDED_SHADER_VS_0, std::size(EMBEDDED_SHADER_VS_0));
+	return ret;
 }
 
-String8 SpirvGetEmbeddedPs(uint32_t id)
+Vector<uint32_t> SpirvGetEmbeddedPs(uint32_t id)
 {
 	EXIT_NOT_IMPLEMENTED(id != 0);
 
-	return EMBEDDED_SHADER_PS_0;
+	Vector<uint32_t> ret;
+	ret.Add(EMBEDDED_SHADER_PS_0, std::size(EMBEDDED_SHADER_PS_0));
+	return ret;
+}
+
+Vector<uint32_t> SpirvGetEmbeddedCs(uint32_t id)
+{
+	EXIT_NOT_IMPLEMENTED(id > 2);
+
+	Vector<uint32_t> ret;
+	switch (id)
+	{
+		case 0: ret.Add(EMBEDDED_SHADER_CS_0, std::size(EMBEDDED_SHADER_CS_0)); break;
+		case 1: ret.Add(EMBEDDED_SHADER_CS_1, std::size(EMBEDDED_SHADER_CS_1)); break;
+		case 2: ret.Add(EMBEDDED_SHADER_CS_2, std::size(EMBEDDED_SHADER_CS_2)); break;
+		default: break;
+	}
+	return ret;
 }
 
 } // namespace Kyty::Libs::Graphics
@@ -0,0 +1,907 @@
+#include "Emulator/Graphics/ShaderSpirvBinary.h"
+
+#include "Kyty/Core/DbgAssert.h"
+
+#define SPV_ENABLE_UTILITY_CODE
+#include "spirv-headers/GLSL.std.450.h"
+#include "spirv-headers/spirv.hpp"
+
+#include <cstdlib>
+#include <cstring>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#ifdef KYTY_EMU_ENABLED
+
+namespace Kyty::Libs::Graphics {
+
+// Operand kinds:
+//  i - id
+//  n - literal integer
+//  s - literal string
+//  c - literal number, typed by the result type
+//  C - capability, A - addressing model, M - memory model, X - execution model
+//  E - execution mode followed by literals
+//  D - decoration followed by literals or a built-in
+//  S - storage class, d - dim, f - image format
+//  F - function control, L - selection or loop control
+//  O - image operands followed by ids
+//  G - extended instruction
+//  ? - the rest is optional
+//  * - the rest is repeated
+struct SpirvOpInfo
+{
+	const char* name     = nullptr;
+	spv::Op     op       = spv::OpNop;
+	const char* operands = nullptr;
+};
+
+struct SpirvEnumerant
+{
+	const char* name  = nullptr;
+	uint32_t    value = 0;
+};
+
+#define KYTY_SPIRV_OP(n, o) {#n, spv::n, o}
+
+static const SpirvOpInfo g_spirv_ops[] = {
+    KYTY_SPIRV_OP(OpCapability, "C"),
+    KYTY_SPIRV_OP(OpExtension, "s"),
+    KYTY_SPIRV_OP(OpExtInstImport, "s"),
+    KYTY_SPIRV_OP(OpMemoryModel, "AM"),
+    KYTY_SPIRV_OP(OpEntryPoint, "Xis*i"),
+    KYTY_SPIRV_OP(OpExecutionMode, "iE"),
+    KYTY_SPIRV_OP(OpString, "s"),
+    KYTY_SPIRV_OP(OpDecorate, "iD"),
+    KYTY_SPIRV_OP(OpMemberDecorate, "inD"),
+    KYTY_SPIRV_OP(OpTypeVoid, ""),
+    KYTY_SPIRV_OP(OpTypeBool, ""),
+    KYTY_SPIRV_OP(OpTypeInt, "nn"),
+    KYTY_SPIRV_OP(OpTypeFloat, "n"),
+    KYTY_SPIRV_OP(OpTypeVector, "in"),
+    KYTY_SPIRV_OP(OpTypeMatrix, "in"),
+    KYTY_SPIRV_OP(OpTypeArray, "ii"),
+    KYTY_SPIRV_OP(OpTypeRuntimeArray, "i"),
+    KYTY_SPIRV_OP(OpTypeStruct, "*i"),
+    KYTY_SPIRV_OP(OpTypePointer, "Si"),
+    KYTY_SPIRV_OP(OpTypeFunction, "i*i"),
+    KYTY_SPIRV_OP(OpTypeImage, "idnnnnf"),
+    KYTY_SPIRV_OP(OpTypeSampler, ""),
+    KYTY_SPIRV_OP(OpTypeSampledImage, "i"),
+    KYTY_SPIRV_OP(OpConstant, "c"),
+    KYTY_SPIRV_OP(OpConstantTrue, ""),
+    KYTY_SPIRV_OP(OpConstantFalse, ""),
+    KYTY_SPIRV_OP(OpConstantComposite, "*i"),
+    KYTY_SPIRV_OP(OpSpecConstant, "c"),
+    KYTY_SPIRV_OP(OpSpecConstantComposite, "*i"),
+    KYTY_SPIRV_OP(OpUndef, ""),
+    KYTY_SPIRV_OP(OpFunction, "Fi"),
+    KYTY_SPIRV_OP(OpFunctionParameter, ""),
+    KYTY_SPIRV_OP(OpFunctionEnd, ""),
+    KYTY_SPIRV_OP(OpFunctionCall, "i*i"),
+    KYTY_SPIRV_OP(OpVariable, "S?i"),
+    KYTY_SPIRV_OP(OpLoad, "i"),
+    KYTY_SPIRV_OP(OpStore, "ii"),
+    KYTY_SPIRV_OP(OpAccessChain, "i*i"),
+    KYTY_SPIRV_OP(OpLabel, ""),
+    KYTY_SPIRV_OP(OpBranch, "i"),
+    KYTY_SPIRV_OP(OpBranchConditional, "iii*n"),
+    KYTY_SPIRV_OP(OpSelectionMerge, "iL"),
+    KYTY_SPIRV_OP(OpLoopMerge, "iiL"),
+    KYTY_SPIRV_OP(OpSwitch, "ii*ni"),
+    KYTY_SPIRV_OP(OpReturn, ""),
+    KYTY_SPIRV_OP(OpReturnValue, "i"),
+    KYTY_SPIRV_OP(OpKill, ""),
+    KYTY_SPIRV_OP(OpPhi, "*ii"),
+    KYTY_SPIRV_OP(OpExtInst, "iG*i"),
+    KYTY_SPIRV_OP(OpIAdd, "ii"),
+    KYTY_SPIRV_OP(OpISub, "ii"),
+    KYTY_SPIRV_OP(OpIMul, "ii"),
+    KYTY_SPIRV_OP(OpSDiv, "ii"),
+    KYTY_SPIRV_OP(OpUDiv, "ii"),
+    KYTY_SPIRV_OP(OpUMod, "ii"),
+    KYTY_SPIRV_OP(OpSRem, "ii"),
+    KYTY_SPIRV_OP(OpSMod, "ii"),
+    KYTY_SPIRV_OP(OpFAdd, "ii"),
+    KYTY_SPIRV_OP(OpFSub, "ii"),
+    KYTY_SPIRV_OP(OpFMul, "ii"),
+    KYTY_SPIRV_OP(OpFDiv, "ii"),
+    KYTY_SPIRV_OP(OpFMod, "ii"),
+    KYTY_SPIRV_OP(OpSNegate, "i"),
+    KYTY_SPIRV_OP(OpFNegate, "i"),
+    KYTY_SPIRV_OP(OpIAddCarry, "ii"),
+    KYTY_SPIRV_OP(OpISubBorrow, "ii"),
+    KYTY_SPIRV_OP(OpUMulExtended, "ii"),
+    KYTY_SPIRV_OP(OpSMulExtended, "ii"),
+    KYTY_SPIRV_OP(OpDot, "ii"),
+    KYTY_SPIRV_OP(OpVectorTimesScalar, "ii"),
+    KYTY_SPIRV_OP(OpShiftRightLogical, "ii"),
+    KYTY_SPIRV_OP(OpShiftRightArithmetic, "ii"),
+    KYTY_SPIRV_OP(OpShiftLeftLogical, "ii"),
+    KYTY_SPIRV_OP(OpBitwiseOr, "ii"),
+    KYTY_SPIRV_OP(OpBitwiseXor, "ii"),
+    KYTY_SPIRV_OP(OpBitwiseAnd, "ii"),
+    KYTY_SPIRV_OP(OpNot, "i"),
+    KYTY_SPIRV_OP(OpBitFieldInsert, "iiii"),
+    KYTY_SPIRV_OP(OpBitFieldSExtract, "iii"),
+    KYTY_SPIRV_OP(OpBitFieldUExtract, "iii"),
+    KYTY_SPIRV_OP(OpBitReverse, "i"),
+    KYTY_SPIRV_OP(OpBitCount, "i"),
+    KYTY_SPIRV_OP(OpAny, "i"),
+    KYTY_SPIRV_OP(OpAll, "i"),
+    KYTY_SPIRV_OP(OpIsNan, "i"),
+    KYTY_SPIRV_OP(OpIsInf, "i"),
+    KYTY_SPIRV_OP(OpLogicalEqual, "ii"),
+    KYTY_SPIRV_OP(OpLogicalNotEqual, "ii"),
+    KYTY_SPIRV_OP(OpLogicalOr, "ii"),
+    KYTY_SPIRV_OP(OpLogicalAnd, "ii"),
+    KYTY_SPIRV_OP(OpLogicalNot, "i"),
+    KYTY_SPIRV_OP(OpSelect, "iii"),
+    KYTY_SPIRV_OP(OpIEqual, "ii"),
+    KYTY_SPIRV_OP(OpINotEqual, "ii"),
+    KYTY_SPIRV_OP(OpUGreaterThan, "ii"),
+    KYTY_SPIRV_OP(OpSGreaterThan, "ii"),
+    KYTY_SPIRV_OP(OpUGreaterThanEqual, "ii"),
+    KYTY_SPIRV_OP(OpSGreaterThanEqual, "ii"),
+    KYTY_SPIRV_OP(OpULessThan, "ii"),
+    KYTY_SPIRV_OP(OpSLessThan, "ii"),
+    KYTY_SPIRV_OP(OpULessThanEqual, "ii"),
+    KYTY_SPIRV_OP(OpSLessThanEqual, "ii"),
+    KYTY_SPIRV_OP(OpFOrdEqual, "ii"),
+    KYTY_SPIRV_OP(OpFUnordEqual, "ii"),
+    KYTY_SPIRV_OP(OpFOrdNotEqual, "ii"),
+    KYTY_SPIRV_OP(OpFUnordNotEqual, "ii"),
+    KYTY_SPIRV_OP(OpFOrdLessThan, "ii"),
+    KYTY_SPIRV_OP(OpFUnordLessThan, "ii"),
+    KYTY_SPIRV_OP(OpFOrdGreaterThan, "ii"),
+    KYTY_SPIRV_OP(OpFUnordGreaterThan, "ii"),
+    KYTY_SPIRV_OP(OpFOrdLessThanEqual, "ii"),
+    KYTY_SPIRV_OP(OpFUnordLessThanEqual, "ii"),
+    KYTY_SPIRV_OP(OpFOrdGreaterThanEqual, "ii"),
+    KYTY_SPIRV_OP(OpFUnordGreaterThanEqual, "ii"),
+    KYTY_SPIRV_OP(OpBitcast, "i"),
+    KYTY_SPIRV_OP(OpCopyObject, "i"),
+    KYTY_SPIRV_OP(OpConvertFToU, "i"),
+    KYTY_SPIRV_OP(OpConvertFToS, "i"),
+    KYTY_SPIRV_OP(OpConvertSToF, "i"),
+    KYTY_SPIRV_OP(OpConvertUToF, "i"),
+    KYTY_SPIRV_OP(OpVectorShuffle, "ii*n"),
+    KYTY_SPIRV_OP(OpCompositeConstruct, "*i"),
+    KYTY_SPIRV_OP(OpCompositeExtract, "i*n"),
+    KYTY_SPIRV_OP(OpCompositeInsert, "ii*n"),
+    KYTY_SPIRV_OP(OpSampledImage, "ii"),
+    KYTY_SPIRV_OP(OpImage, "i"),
+    KYTY_SPIRV_OP(OpImageSampleImplicitLod, "ii?O"),
+    KYTY_SPIRV_OP(OpImageSampleExplicitLod, "iiO"),
+    KYTY_SPIRV_OP(OpImageFetch, "ii?O"),
+    KYTY_SPIRV_OP(OpImageRead, "ii?O"),
+    KYTY_SPIRV_OP(OpImageWrite, "iii?O"),
+    KYTY_SPIRV_OP(OpImageQuerySizeLod, "ii"),
+    KYTY_SPIRV_OP(OpImageQuerySize, "i"),
+    KYTY_SPIRV_OP(OpMemoryBarrier, "ii"),
+    KYTY_SPIRV_OP(OpControlBarrier, "iii"),
+    KYTY_SPIRV_OP(OpAtomicIAdd, "iiii"),
+    KYTY_SPIRV_OP(OpAtomicISub, "iiii"),
+};
+
+#undef KYTY_SPIRV_OP
+
+static const SpirvEnumerant g_spirv_capabilities[] = {
+    {"Shader", spv::CapabilityShader},
+    {"ImageQuery", spv::CapabilityImageQuery},
+};
+
+static const SpirvEnumerant g_spirv_addressing_models[] = {
+    {"Logical", spv::AddressingModelLogical},
+};
+
+static const SpirvEnumerant g_spirv_memory_models[] = {
+    {"GLSL450", spv::MemoryModelGLSL450},
+};
+
+static const SpirvEnumerant g_spirv_execution_models[] = {
+    {"Vertex", spv::ExecutionModelVertex},
+    {"Fragment", spv::ExecutionModelFragment},
+    {"GLCompute", spv::ExecutionModelGLCompute},
+};
+
+static const SpirvEnumerant g_spirv_execution_modes[] = {
+    {"OriginUpperLeft", spv::ExecutionModeOriginUpperLeft},
+    {"EarlyFragmentTests", spv::ExecutionModeEarlyFragmentTests},
+    {"LocalSize", spv::ExecutionModeLocalSize},
+};
+
+static const SpirvEnumerant g_spirv_storage_classes[] = {
+    {"UniformConstant", spv::StorageClassUniformConstant},
+    {"Input", spv::StorageClassInput},
+    {"Uniform", spv::StorageClassUniform},
+    {"Output", spv::StorageClassOutput},
+    {"Workgroup", spv::StorageClassWorkgroup},
+    {"Private", spv::StorageClassPrivate},
+    {"Function", spv::StorageClassFunction},
+    {"PushConstant", spv::StorageClassPushConstant},
+    {"StorageBuffer", spv::StorageClassStorageBuffer},
+};
+
+static const SpirvEnumerant g_spirv_decorations[] = {
+    {"Block", spv::DecorationBlock},
+    {"BufferBlock", spv::DecorationBufferBlock},
+    {"ArrayStride", spv::DecorationArrayStride},
+    {"BuiltIn", spv::DecorationBuiltIn},
+    {"Flat", spv::DecorationFlat},
+    {"Coherent", spv::DecorationCoherent},
+    {"NonWritable", spv::DecorationNonWritable},
+    {"NonReadable", spv::DecorationNonReadable},
+    {"Location", spv::DecorationLocation},
+    {"Binding", spv::DecorationBinding},
+    {"DescriptorSet", spv::DecorationDescriptorSet},
+    {"Offset", spv::DecorationOffset},
+    {"SpecId", spv::DecorationSpecId},
+};
+
+static const SpirvEnumerant g_spirv_built_ins[] = {
+    {"Position", spv::BuiltInPosition},
+    {"PointSize", spv::BuiltInPointSize},
+    {"ClipDistance", spv::BuiltInClipDistance},
+    {"CullDistance", spv::BuiltInCullDistance},
+    {"FragCoord", spv::BuiltInFragCoord},
+    {"FrontFacing", spv::BuiltInFrontFacing},
+    {"NumWorkgroups", spv::BuiltInNumWorkgroups},
+    {"WorkgroupSize", spv::BuiltInWorkgroupSize},
+    {"WorkgroupId", spv::BuiltInWorkgroupId},
+    {"LocalInvocationId", spv::BuiltInLocalInvocationId},
+    {"GlobalInvocationId", spv::BuiltInGlobalInvocationId},
+    {"LocalInvocationIndex", spv::BuiltInLocalInvocationIndex},
+    {"VertexIndex", spv::BuiltInVertexIndex},
+    {"InstanceIndex", spv::BuiltInInstanceIndex},
+};
+
+static const SpirvEnumerant g_spirv_dims[] = {
+    {"1D", spv::Dim1D}, {"2D", spv::Dim2D}, {"3D", spv::Dim3D}, {"Cube", spv::DimCube}, {"Buffer", spv::DimBuffer},
+};
+
+static const SpirvEnumerant g_spirv_image_formats[] = {
+    {"Unknown", spv::ImageFormatUnknown}, {"Rgba32f", spv::ImageFormatRgba32f}, {"Rgba8", spv::ImageFormatRgba8},
+    {"R32f", spv::ImageFormatR32f},       {"R32ui", spv::ImageFormatR32ui},
+};
+
+static const SpirvEnumerant g_spirv_function_controls[] = {
+    {"None", spv::FunctionControlMaskNone},
+    {"Inline", spv::FunctionControlInlineMask},
+    {"DontInline", spv::FunctionControlDontInlineMask},
+    {"Pure", spv::FunctionControlPureMask},
+    {"Const", spv::FunctionControlConstMask},
+};
+
+// Selection and loop controls share the values of the first bits
+static const SpirvEnumerant g_spirv_controls[] = {
+    {"None", spv::SelectionControlMaskNone},          {"Flatten", spv::SelectionControlFlattenMask},
+    {"DontFlatten", spv::SelectionControlDontFlattenMask}, {"Unroll", spv::LoopControlUnrollMask},
+    {"DontUnroll", spv::LoopControlDontUnrollMask},
+};
+
+static const SpirvEnumerant g_spirv_image_operands[] = {
+    {"None", spv::ImageOperandsMaskNone},
+    {"Bias", spv::ImageOperandsBiasMask},
+    {"Lod", spv::ImageOperandsLodMask},
+    {"Grad", spv::ImageOperandsGradMask},
+    {"ConstOffset", spv::ImageOperandsConstOffsetMask},
+    {"Offset", spv::ImageOperandsOffsetMask},
+    {"Sample", spv::ImageOperandsSampleMask},
+};
+
+static const SpirvEnumerant g_spirv_glsl_std_450[] = {
+    {"Round", GLSLstd450Round},
+    {"RoundEven", GLSLstd450RoundEven},
+    {"Trunc", GLSLstd450Trunc},
+    {"FAbs", GLSLstd450FAbs},
+    {"SAbs", GLSLstd450SAbs},
+    {"FSign", GLSLstd450FSign},
+    {"SSign", GLSLstd450SSign},
+    {"Floor", GLSLstd450Floor},
+    {"Ceil", GLSLstd450Ceil},
+    {"Fract", GLSLstd450Fract},
+    {"Sin", GLSLstd450Sin},
+    {"Cos", GLSLstd450Cos},
+    {"Pow", GLSLstd450Pow},
+    {"Exp", GLSLstd450Exp},
+    {"Log", GLSLstd450Log},
+    {"Exp2", GLSLstd450Exp2},
+    {"Log2", GLSLstd450Log2},
+    {"Sqrt", GLSLstd450Sqrt},
+    {"InverseSqrt", GLSLstd450InverseSqrt},
+    {"FMin", GLSLstd450FMin},
+    {"UMin", GLSLstd450UMin},
+    {"SMin", GLSLstd450SMin},
+    {"FMax", GLSLstd450FMax},
+    {"UMax", GLSLstd450UMax},
+    {"SMax", GLSLstd450SMax},
+    {"FClamp", GLSLstd450FClamp},
+    {"UClamp", GLSLstd450UClamp},
+    {"SClamp", GLSLstd450SClamp},
+    {"FMix", GLSLstd450FMix},
+    {"Fma", GLSLstd450Fma},
+    {"PackHalf2x16", GLSLstd450PackHalf2x16},
+    {"UnpackHalf2x16", GLSLstd450UnpackHalf2x16},
+    {"FindILsb", GLSLstd450FindILsb},
+    {"FindUMsb", GLSLstd450FindUMsb},
+    {"FindSMsb", GLSLstd450FindSMsb},
+};
+
+template <size_t N>
+static bool find_enumerant(const SpirvEnumerant (&table)[N], std::string_view name, uint32_t* value)
+{
+	for (const auto& e: table)
+	{
+		if (name == e.name)
+		{
+			*value = e.value;
+			return true;
+		}
+	}
+	return false;
+}
+
+// Bitmasks are separated by '|'
+template <size_t N>
+static bool find_mask(const SpirvEnumerant (&table)[N], std::string_view name, uint32_t* value)
+{
+	*value = 0;
+	for (;;)
+	{
+		auto     sep = name.find('|');
+		uint32_t v   = 0;
+		if (!find_enumerant(table, name.substr(0, sep), &v))
+		{
+			return false;
+		}
+		*value |= v;
+		if (sep == std::string_view::npos)
+		{
+			return true;
+		}
+		name.remove_prefix(sep + 1);
+	}
+}
+
+static const SpirvOpInfo* find_op(std::string_view name)
+{
+	static const auto* ops = []()
+	{
+		auto* m = new std::unordered_map<std::string_view, const SpirvOpInfo*>;
+		for (const auto& op: g_spirv_ops)
+		{
+			(*m)[op.name] = &op;
+		}
+		return m;
+	}();
+
+	auto f = ops->find(name);
+	return (f != ops->end() ? f->second : nullptr);
+}
+
+static bool parse_int(std::string_view str, bool is_signed, uint32_t* value)
+{
+	char buf[32];
+	if (str.empty() || str.size() >= sizeof(buf))
+	{
+		return false;
+	}
+	std::memcpy(buf, str.data(), str.size());
+	buf[str.size()] = '\0';
+
+	bool        negative = (buf[0] == '-');
+	const char* digits   = buf + (negative ? 1 : 0);
+	int         base     = (digits[0] == '0' && (digits[1] == 'x' || digits[1] == 'X') ? 16 : 10);
+	char*       end      = nullptr;
+
+	if (*digits == '\0' || *digits == '-' || *digits == '+')
+	{
+		return false;
+	}
+
+	auto v = std::strtoull(digits, &end, base);
+	if (*end != '\0' || (negative && !is_signed))
+	{
+		return false;
+	}
+	if (negative ? v > 0x80000000ull : v > 0xffffffffull)
+	{
+		return false;
+	}
+
+	*value = (negative ? static_cast<uint32_t>(0u - static_cast<uint32_t>(v)) : static_cast<uint32_t>(v));
+	return true;
+}
+
+static bool parse_float(std::string_view str, uint32_t* value)
+{
+	char buf[64];
+	if (str.empty() || str.size() >= sizeof(buf))
+	{
+		return false;
+	}
+	std::memcpy(buf, str.data(), str.size());
+	buf[str.size()] = '\0';
+
+	char* end = nullptr;
+	float f   = std::strtof(buf, &end);
+	if (*end != '\0' || f != f || f - f != 0.0f)
+	{
+		return false;
+	}
+
+	std::memcpy(value, &f, sizeof(f));
+	return true;
+}
+
+class SpirvEncoder
+{
+public:
+	explicit SpirvEncoder(const String8& src): m_ptr(src.GetDataConst()), m_end(src.GetDataConst() + src.Size()) {}
+	virtual ~SpirvEncoder() = default;
+	KYTY_CLASS_NO_COPY(SpirvEncoder);
+
+	bool Encode(Vector<uint32_t>* dst);
+
+private:
+	struct Token
+	{
+		std::string_view str;
+		bool             is_string = false;
+	};
+
+	struct NumberType
+	{
+		bool     is_float  = false;
+		bool     is_signed = false;
+		uint32_t width     = 0;
+	};
+
+	bool Tokenize();
+	bool EncodeInstruction(std::string_view result, const SpirvOpInfo* info, const Token* operands, uint32_t operands_num);
+	bool EncodeOperands(const SpirvOpInfo* info, uint32_t result_type, const Token* operands, uint32_t operands_num);
+	void EncodeString(std::string_view str);
+
+	uint32_t GetId(std::string_view name);
+
+	const char*                                    m_ptr = nullptr;
+	const char*                                    m_end = nullptr;
+	std::vector<Token>                             m_tokens;
+	std::vector<uint32_t>                          m_words;
+	std::unordered_map<std::string_view, uint32_t> m_ids;
+	std::unordered_map<uint32_t, NumberType>       m_number_types;
+	std::unordered_map<uint32_t, bool>             m_glsl_std_450;
+};
+
+bool SpirvEncoder::Tokenize()
+{
+	while (m_ptr < m_end)
+	{
+		char c = *m_ptr;
+		if (c == ' ' || c == '\t' || c == '\n' || c == '\r')
+		{
+			m_ptr++;
+		} else if (c == ';')
+		{
+			while (m_ptr < m_end && *m_ptr != '\n')
+			{
+				m_ptr++;
+			}
+		} else if (c == '"')
+		{
+			const char* begin = ++m_ptr;
+			while (m_ptr < m_end && *m_ptr != '"')
+			{
+				m_ptr += (*m_ptr == '\\' ? 2 : 1);
+			}
+			if (m_ptr >= m_end)
+			{
+				return false;
+			}
+			m_tokens.push_back({std::string_view(begin, m_ptr - begin), true});
+			m_ptr++;
+		} else
+		{
+			const char* begin = m_ptr;
+			while (m_ptr < m_end && *m_ptr != ' ' && *m_ptr != '\t' && *m_ptr != '\n' && *m_ptr != '\r' && *m_ptr != ';' && *m_ptr != '"')
+			{
+				m_ptr++;
+			}
+			m_tokens.push_back({std::string_view(begin, m_ptr - begin), false});
+		}
+	}
+	return true;
+}
+
+uint32_t SpirvEncoder::GetId(std::string_view name)
+{
+	auto [p, inserted] = m_ids.try_emplace(name, static_cast<uint32_t>(m_ids.size() + 1));
+	return p->second;
+}
+
+void SpirvEncoder::EncodeString(std::string_view str)
+{
+	uint32_t word  = 0;
+	uint32_t shift = 0;
+
+	auto put = [&](uint8_t b)
+	{
+		word |= static_cast<uint32_t>(b) << shift;
+		shift += 8;
+		if (shift == 32)
+		{
+			m_words.push_back(word);
+			word  = 0;
+			shift = 0;
+		}
+	};
+
+	for (size_t i = 0; i < str.size(); i++)
+	{
+		if (str[i] == '\\' && i + 1 < str.size())
+		{
+			i++;
+		}
+		put(static_cast<uint8_t>(str[i]));
+	}
+
+	// Always null-terminated
+	put(0);
+	if (shift != 0)
+	{
+		m_words.push_back(word);
+	}
+}
+
+bool SpirvEncoder::EncodeOperands(const SpirvOpInfo* info, uint32_t result_type, const Token* operands, uint32_t operands_num)
+{
+	uint32_t    t            = 0;
+	const char* repeat       = nullptr;
+	uint32_t    ext_inst_set = 0;
+
+	auto next = [&](std::string_view* str) -> bool
+	{
+		if (t >= operands_num || operands[t].is_string)
+		{
+			return false;
+		}
+		*str = operands[t++].str;
+		return true;
+	};
+
+	auto rest_literals = [&]() -> bool
+	{
+		while (t < operands_num)
+		{
+			uint32_t v = 0;
+			if (operands[t].is_string || !parse_int(operands[t].str, false, &v))
+			{
+				return false;
+			}
+			m_words.push_back(v);
+			t++;
+		}
+		return true;
+	};
+
+	for (const char* k = info->operands;; k++)
+	{
+		if (*k == '\0')
+		{
+			if (repeat == nullptr || t >= operands_num)
+			{
+				break;
+			}
+			k = repeat;
+		}
+
+		if (*k == '?' || *k == '*')
+		{
+			if (*k == '*')
+			{
+				repeat = k + 1;
+			}
+			if (t >= operands_num)
+			{
+				break;
+			}
+			continue;
+		}
+
+		std::string_view str;
+		uint32_t         v = 0;
+
+		if (*k == 's')
+		{
+			if (t >= operands_num || !operands[t].is_string)
+			{
+				return false;
+			}
+			EncodeString(operands[t++].str);
+			continue;
+		}
+
+		if (!next(&str))
+		{
+			return false;
+		}
+
+		switch (*k)
+		{
+			case 'i':
+				if (str[0] != '%')
+				{
+					return false;
+				}
+				v = GetId(str);
+				if (ext_inst_set == 0 && info->op == spv::OpExtInst)
+				{
+					ext_inst_set = v;
+				}
+				break;
+			case 'n':
+				if (!parse_int(str, true, &v))
+				{
+					return false;
+				}
+				break;
+			case 'c':
+			{
+				auto f = m_number_types.find(result_type);
+				if (f == m_number_types.end() || f->second.width != 32 ||
+				    !(f->second.is_float ? parse_float(str, &v) : parse_int(str, f->second.is_signed, &v)))
+				{
+					return false;
+				}
+				break;
+			}
+			case 'C':
+				if (!find_enumerant(g_spirv_capabilities, str, &v))
+				{
+					return false;
+				}
+				break;
+			case 'A':
+				if (!find_enumerant(g_spirv_addressing_models, str, &v))
+				{
+					return false;
+				}
+				break;
+			case 'M':
+				if (!find_enumerant(g_spirv_memory_models, str, &v))
+				{
+					return false;
+				}
+				break;
+			case 'X':
+				if (!find_enumerant(g_spirv_execution_models, str, &v))
+				{
+					return false;
+				}
+				break;
+			case 'S':
+				if (!find_enumerant(g_spirv_storage_classes, str, &v))
+				{
+					return false;
+				}
+				break;
+			case 'd':
+				if (!find_enumerant(g_spirv_dims, str, &v))
+				{
+					return false;
+				}
+				break;
+			case 'f':
+				if (!find_enumerant(g_spirv_image_formats, str, &v))
+				{
+					return false;
+				}
+				break;
+			case 'F':
+				if (!find_mask(g_spirv_function_controls, str, &v))
+				{
+					return false;
+				}
+				break;
+			case 'L':
+				if (!find_mask(g_spirv_controls, str, &v))
+				{
+					return false;
+				}
+				break;
+			case 'G':
+				if (!parse_int(str, false, &v) &&
+				    !(m_glsl_std_450.count(ext_inst_set) != 0 && find_enumerant(g_spirv_glsl_std_450, str, &v)))
+				{
+					return false;
+				}
+				break;
+			case 'E':
+				if (!find_enumerant(g_spirv_execution_modes, str, &v))
+				{
+					return false;
+				}
+				m_words.push_back(v);
+				return rest_literals();
+			case 'D':
+				if (!find_enumerant(g_spirv_decorations, str, &v))
+				{
+					return false;
+				}
+				m_words.push_back(v);
+				if (v == spv::DecorationBuiltIn)
+				{
+					if (!next(&str) || !find_enumerant(g_spirv_built_ins, str, &v))
+					{
+						return false;
+					}
+					m_words.push_back(v);
+					return t == operands_num;
+				}
+				return rest_literals();
+			case 'O':
+				if (!find_mask(g_spirv_image_operands, str, &v))
+				{
+					return false;
+				}
+				m_words.push_back(v);
+				while (t < operands_num)
+				{
+					if (!next(&str) || str[0] != '%')
+					{
+						return false;
+					}
+					m_words.push_back(GetId(str));
+				}
+				return true;
+			default: return false;
+		}
+
+		m_words.push_back(v);
+	}
+
+	return t == operands_num;
+}
+
+bool SpirvEncoder::EncodeInstruction(std::string_view result, const SpirvOpInfo* info, const Token* operands, uint32_t operands_num)
+{
+	bool has_result      = false;
+	bool has_result_type = false;
+	spv::HasResultAndType(info->op, &has_result, &has_result_type);
+
+	if (has_result != !result.empty())
+	{
+		return false;
+	}
+
+	auto start = m_words.size();
+	m_words.push_back(0);
+
+	uint32_t result_type = 0;
+	uint32_t result_id   = 0;
+
+	if (has_result_type)
+	{
+		if (operands_num == 0 || operands[0].is_string || operands[0].str[0] != '%')
+		{
+			return false;
+		}
+		result_type = GetId(operands[0].str);
+		m_words.push_back(result_type);
+		operands++;
+		operands_num--;
+	}
+
+	if (has_result)
+	{
+		result_id = GetId(result);
+		m_words.push_back(result_id);
+	}
+
+	if (!EncodeOperands(info, result_type, operands, operands_num))
+	{
+		return false;
+	}
+
+	auto words_num = m_words.size() - start;
+	if (words_num > 0xffff)
+	{
+		return false;
+	}
+
+	m_words[start] = (static_cast<uint32_t>(words_num) << spv::WordCountShift) | static_cast<uint32_t>(info->op);
+
+	// Remember what is needed to encode the literals of later instructions
+	switch (info->op)
+	{
+		case spv::OpTypeInt: m_number_types[result_id] = {false, m_words[start + 3] != 0, m_words[start + 2]}; break;
+		case spv::OpTypeFloat: m_number_types[result_id] = {true, true, m_words[start + 2]}; break;
+		case spv::OpExtInstImport:
+			if (operands[0].str == "GLSL.std.450")
+			{
+				m_glsl_std_450[result_id] = true;
+			}
+			break;
+		default: break;
+	}
+
+	return true;
+}
+
+bool SpirvEncoder::Encode(Vector<uint32_t>* dst)
+{
+	EXIT_IF(dst == nullptr);
+
+	if (!Tokenize())
+	{
+		return false;
+	}
+
+	m_words.reserve(m_tokens.size() + 5);
+	m_words.push_back(spv::MagicNumber);
+	m_words.push_back(spv::Version);
+	m_words.push_back(0);
+	m_words.push_back(0); // Bound
+	m_words.push_back(0);
+
+	auto     tokens_num = static_cast<uint32_t>(m_tokens.size());
+	uint32_t t          = 0;
+
+	while (t < tokens_num)
+	{
+		std::string_view result;
+		if (!m_tokens[t].is_string && m_tokens[t].str[0] == '%' && t + 2 < tokens_num && m_tokens[t + 1].str == "=" &&
+		    !m_tokens[t + 1].is_string)
+		{
+			result = m_tokens[t].str;
+			t += 2;
+		}
+
+		if (m_tokens[t].is_string)
+		{
+			return false;
+		}
+
+		const auto* info = find_op(m_tokens[t].str);
+		if (info == nullptr)
+		{
+			return false;
+		}
+
+		// Operands last until the next instruction
+		uint32_t first = ++t;
+		auto starts_instruction = [&](uint32_t i)
+		{
+			return !m_tokens[i].is_string && (m_tokens[i].str.substr(0, 2) == "Op" ||
+			                                  (i + 1 < tokens_num && m_tokens[i + 1].str == "=" && !m_tokens[i + 1].is_string));
+		};
+		while (t < tokens_num && !starts_instruction(t))
+		{
+			t++;
+		}
+
+		if (!EncodeInstruction(result, info, m_tokens.data() + first, t - first))
+		{
+			return false;
+		}
+	}
+
+	m_words[3] = static_cast<uint32_t>(m_ids.size() + 1);
+
+	dst->Clear();
+	dst->Add(m_words.data(), static_cast<uint32_t>(m_words.size()));
+
+	return true;
+}
+
+bool SpirvEncodeBinary(const String8& src, Vector<uint32_t>* dst)
+{
+	SpirvEncoder encoder(src);
+	return encoder.Encode(dst);
+}
+
+} // namespace Kyty::Libs::Graphics
+
+#endif // KYTY_EMU_ENABLED
@@ -1,21 +1,33 @@
 #include "Emulator/Graphics/Tile.h"
 
 #include "Kyty/Core/DbgAssert.h"
+#include "Kyty/Core/JobSystem.h"
 #include "Kyty/Core/String.h"
 #include "Kyty/Core/Threads.h"
+#include "Kyty/Core/Timer.h"
+#include "Kyty/Core/Vector.h"
 
-#include "Emulator/Graphics/AsyncJob.h"
+#include "Emulator/Graphics/GpuCounters.h"
 #include "Emulator/Profiler.h"
 
+#include "cpuinfo.h"
+
 #if KYTY_COMPILER != KYTY_COMPILER_CLANG && KYTY_PLATFORM == KYTY_PLATFORM_WINDOWS
 #include <intrin.h>
 #endif
 
 #include <algorithm>
+#include <immintrin.h>
 #include <iterator>
 
 #ifdef KYTY_EMU_ENABLED
 
+#if KYTY_COMPILER == KYTY_COMPILER_MSVC
+#define KYTY_TILE_AVX2
+#else
+#define KYTY_TILE_AVX2 __attribute__((target("avx2")))
+#endif
+
 namespace Kyty::Libs::Graphics {
 
 static uint32_t IntLog2(uint32_t i)
@@ -39,30 +51,6 @@ struct Uint128
 	uint64_t n[2];
 };
 
-struct Uint256
-{
-	Uint128 n[2];
-};
-
-class Tiler
-{
-public:
-	Tiler(): m_job1(nullptr), m_job2(nullptr) /*, m_job3(nullptr), m_job4(nullptr)*/
-	{
-		EXIT_NOT_IMPLEMENTED(!Core::Thread::IsMainThread());
-	}
-	virtual ~Tiler() { KYTY_NOT_IMPLEMENTED; }
-
-	KYTY_CLASS_NO_COPY(Tiler);
-
-	Core::Mutex m_mutex;
-
-	AsyncJob m_job1;
-	AsyncJob m_job2;
-	// AsyncJob m_job3;
-	// AsyncJob m_job4;
-};
-
 class Tiler32
 {
 public:
@@ -271,178 +259,287 @@ public:
 	}
 };
 
-static Tiler* g_tiler = nullptr;
+// Element index of pixel (x, y) inside an 8x8 micro-tile, indexed by y * 8 + x
+static uint8_t g_video_out_elements[64] = {};
+static uint8_t g_texture_elements[64]   = {};
+
+// Copies one whole 8x8 micro-tile from its tiled location to the linear image
+using DetileMicroTileFunc = void (*)(uint8_t* dst, uint64_t dst_pitch, const uint8_t* src);
+
+struct DetileFuncs
+{
+	DetileMicroTileFunc video_out_32 = nullptr;
+	DetileMicroTileFunc texture_32   = nullptr;
+	DetileMicroTileFunc texture_64   = nullptr;
+	DetileMicroTileFunc texture_128  = nullptr;
+};
+
+static DetileFuncs g_detile_funcs;
+
+constexpr uint32_t DETILE_BAND_HEIGHT = 64;
 
 static void init_maps();
+static void init_detile();
 
 void TileInit()
 {
-	EXIT_IF(g_tiler != nullptr);
-
-	g_tiler = new Tiler;
+	EXIT_NOT_IMPLEMENTED(!Core::Thread::IsMainThread());
+	EXIT_IF(g_detile_funcs.video_out_32 != nullptr);
 
 	init_maps();
+	init_detile();
 }
 
-// NOLINTNEXTLINE(readability-non-const-parameter)
-static void Detile32(const Tiler32* t, uint32_t width, uint32_t height, uint32_t dst_pitch, uint8_t* dst, const uint8_t* src, bool neo)
+bool TileIsInitialized()
 {
-	EXIT_IF(g_tiler == nullptr);
+	return g_detile_funcs.video_out_32 != nullptr;
+}
 
-	Core::LockGuard lock(g_tiler->m_mutex);
+template <typename T, bool VIDEO_OUT>
+static void DetilePartialMicroTile(uint8_t* dst, uint64_t dst_pitch, const uint8_t* src, uint32_t width, uint32_t height)
+{
+	const uint8_t* elements = (VIDEO_OUT ? g_video_out_elements : g_texture_elements);
 
-	struct DetileParams
+	for (uint32_t y = 0; y < height; y++)
 	{
-		const Tiler32* t;
-		uint32_t       start_y;
-		uint32_t       width;
-		uint32_t       height;
-		uint32_t       dst_pitch;
-		uint8_t*       dst;
-		const uint8_t* src;
-		bool           neo;
-	};
+		for (uint32_t x = 0; x < width; x++)
+		{
+			*reinterpret_cast<T*>(dst + y * dst_pitch + x * sizeof(T)) = *reinterpret_cast<const T*>(src + elements[y * 8 + x] * sizeof(T));
+		}
+	}
+}
 
-	auto func = [](void* args)
+// Video out: elements are x0 x1 y0 x2 y1 y2, so every row is two 16-byte runs
+static void DetileVideoOut32Sse2(uint8_t* dst, uint64_t dst_pitch, const uint8_t* src)
+{
+	for (uint32_t y = 0; y < 8; y++, dst += dst_pitch)
 	{
-		auto* p = static_cast<DetileParams*>(args);
-
-		auto*          dst       = p->dst;
-		const auto*    src       = p->src;
-		const Tiler32* t         = p->t;
-		uint32_t       start_y   = p->start_y;
-		uint32_t       width     = p->width;
-		uint32_t       height    = p->height;
-		uint64_t       dst_pitch = p->dst_pitch;
-		bool           neo       = p->neo;
-
-		for (uint32_t y = start_y; y < height; y++)
-		{
-			uint32_t x             = 0;
-			uint64_t linear_offset = y * dst_pitch * 4;
+		const uint8_t* row = g_video_out_elements + y * 8;
 
-			for (; x + 1 < width; x += 2)
-			{
-				auto tiled_offset = t->GetTiledOffset(x, y, neo);
+		__m128i x0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + row[0] * 4));
+		__m128i x4 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + row[4] * 4));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dst), x0);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 16), x4);
+	}
+}
 
-				*reinterpret_cast<uint64_t*>(dst + linear_offset) = *reinterpret_cast<const uint64_t*>(src + tiled_offset);
-				linear_offset += 8;
-			}
-			if (x < width)
-			{
-				auto tiled_offset = t->GetTiledOffset(x, y, neo);
+// Texture: elements are x0 y0 x1 y1 x2 y2, so every row is four 2-element runs
+static void DetileTexture32Sse2(uint8_t* dst, uint64_t dst_pitch, const uint8_t* src)
+{
+	for (uint32_t y = 0; y < 8; y += 2, dst += dst_pitch * 2)
+	{
+		const uint8_t* row = g_texture_elements + y * 8;
+
+		__m128i q0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + row[0] * 4));
+		__m128i q2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + row[2] * 4));
+		__m128i q4 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + row[4] * 4));
+		__m128i q6 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + row[6] * 4));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dst), _mm_unpacklo_epi64(q0, q2));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 16), _mm_unpacklo_epi64(q4, q6));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + dst_pitch), _mm_unpackhi_epi64(q0, q2));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + dst_pitch + 16), _mm_unpackhi_epi64(q4, q6));
+	}
+}
 
-				*reinterpret_cast<uint32_t*>(dst + linear_offset) = *reinterpret_cast<const uint32_t*>(src + tiled_offset);
-			}
-		}
-	};
+static void DetileTexture64Sse2(uint8_t* dst, uint64_t dst_pitch, const uint8_t* src)
+{
+	for (uint32_t y = 0; y < 8; y++, dst += dst_pitch)
+	{
+		const uint8_t* row = g_texture_elements + y * 8;
 
-	DetileParams p1 {t, 0, width, height / 4, dst_pitch, dst, src, neo};
-	DetileParams p2 {t, p1.height, width, /*(height * 2) / 4*/ height, dst_pitch, dst, src, neo};
-	// DetileParams p3 {t, p2.height, width, (height * 3) / 4, dst_pitch, dst, src, neo};
-	// DetileParams p4 {t, p3.height, width, height, dst_pitch, dst, src, neo};
-
-	g_tiler->m_job1.Execute(func, &p1);
-	g_tiler->m_job2.Execute(func, &p2);
-	// g_tiler->m_job3.Execute(func, &p3);
-	// g_tiler->m_job4.Execute(func, &p4);
-
-	g_tiler->m_job1.Wait();
-	g_tiler->m_job2.Wait();
-	// g_tiler->m_job3.Wait();
-	// g_tiler->m_job4.Wait();
-
-	//	Core::Thread t1(func, &p1);
-	//	Core::Thread t2(func, &p2);
-	//	Core::Thread t3(func, &p3);
-	//	Core::Thread t4(func, &p4);
-	//
-	//	t1.Join();
-	//	t2.Join();
-	//	t3.Join();
-	//	t4.Join();
+		for (uint32_t x = 0; x < 8; x += 2)
+		{
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + x * 8), _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + row[x] * 8)));
+		}
+	}
 }
 
-static void Detile32(const Tiler1d* t, uint32_t width, uint32_t height, uint32_t dst_pitch, uint8_t* dst, const uint8_t* src, bool neo)
+static void DetileTexture128Sse2(uint8_t* dst, uint64_t dst_pitch, const uint8_t* src)
 {
-	for (uint32_t y = 0; y < height; y++)
+	for (uint32_t y = 0; y < 8; y++, dst += dst_pitch)
 	{
-		uint32_t x             = 0;
-		uint64_t linear_offset = y * static_cast<uint64_t>(dst_pitch) * 4;
+		const uint8_t* row = g_texture_elements + y * 8;
 
-		for (; x + 1 < width; x += 2)
+		for (uint32_t x = 0; x < 8; x += 2)
 		{
-			auto tiled_offset = t->GetTiledOffset(x, y, neo);
-
-			*reinterpret_cast<uint64_t*>(dst + linear_offset) = *reinterpret_cast<const uint64_t*>(src + tiled_offset);
-			linear_offset += 8;
+			const auto* s = src + row[x] * 16;
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + x * 16), _mm_loadu_si128(reinterpret_cast<const __m128i*>(s)));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + x * 16 + 16), _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + 16)));
 		}
-		if (x < width)
-		{
-			auto tiled_offset = t->GetTiledOffset(x, y, neo);
+	}
+}
 
-			*reinterpret_cast<uint32_t*>(dst + linear_offset) = *reinterpret_cast<const uint32_t*>(src + tiled_offset);
-		}
+// Two rows share 64 contiguous bytes: [row0 x0-3, row1 x0-3, row0 x4-7, row1 x4-7]
+KYTY_TILE_AVX2 static void DetileVideoOut32Avx2(uint8_t* dst, uint64_t dst_pitch, const uint8_t* src)
+{
+	for (uint32_t y = 0; y < 8; y += 2, dst += dst_pitch * 2)
+	{
+		const uint8_t* row = g_video_out_elements + y * 8;
+
+		__m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + row[0] * 4));
+		__m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + row[4] * 4));
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(dst), _mm256_permute2x128_si256(a, b, 0x20));
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + dst_pitch), _mm256_permute2x128_si256(a, b, 0x31));
 	}
 }
 
-static void Detile64(const Tiler1d* t, uint32_t width, uint32_t height, uint32_t dst_pitch, uint8_t* dst, const uint8_t* src, bool neo)
+// Two 2x2 quads per load: [row0 x0-1, row1 x0-1, row0 x2-3, row1 x2-3]
+KYTY_TILE_AVX2 static void DetileTexture32Avx2(uint8_t* dst, uint64_t dst_pitch, const uint8_t* src)
 {
-	for (uint32_t y = 0; y < height; y++)
+	for (uint32_t y = 0; y < 8; y += 2, dst += dst_pitch * 2)
 	{
-		uint32_t x             = 0;
-		uint64_t linear_offset = y * static_cast<uint64_t>(dst_pitch) * 8;
+		const uint8_t* row = g_texture_elements + y * 8;
 
-		for (; x + 1 < width; x += 2)
-		{
-			auto tiled_offset = t->GetTiledOffset(x, y, neo);
+		__m256i a = _mm256_permute4x64_epi64(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + row[0] * 4)), 0xd8);
+		__m256i b = _mm256_permute4x64_epi64(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + row[4] * 4)), 0xd8);
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(dst), _mm256_permute2x128_si256(a, b, 0x20));
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + dst_pitch), _mm256_permute2x128_si256(a, b, 0x31));
+	}
+}
 
-			*reinterpret_cast<Uint128*>(dst + linear_offset) = *reinterpret_cast<const Uint128*>(src + tiled_offset);
-			linear_offset += 16;
+KYTY_TILE_AVX2 static void DetileTexture64Avx2(uint8_t* dst, uint64_t dst_pitch, const uint8_t* src)
+{
+	for (uint32_t y = 0; y < 8; y += 2, dst += dst_pitch * 2)
+	{
+		const uint8_t* row = g_texture_elements + y * 8;
+
+		for (uint32_t x = 0; x < 8; x += 4)
+		{
+			__m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + row[x] * 8));
+			__m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + row[x + 2] * 8));
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + x * 8), _mm256_permute2x128_si256(a, b, 0x20));
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + dst_pitch + x * 8), _mm256_permute2x128_si256(a, b, 0x31));
 		}
-		if (x < width)
+	}
+}
+
+KYTY_TILE_AVX2 static void DetileTexture128Avx2(uint8_t* dst, uint64_t dst_pitch, const uint8_t* src)
+{
+	for (uint32_t y = 0; y < 8; y++, dst += dst_pitch)
+	{
+		const uint8_t* row = g_texture_elements + y * 8;
+
+		for (uint32_t x = 0; x < 8; x += 2)
 		{
-			auto tiled_offset = t->GetTiledOffset(x, y, neo);
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + x * 16),
+			                    _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + row[x] * 16)));
+		}
+	}
+}
 
-			*reinterpret_cast<uint64_t*>(dst + linear_offset) = *reinterpret_cast<const uint64_t*>(src + tiled_offset);
+static void init_detile()
+{
+	for (uint32_t y = 0; y < 8; y++)
+	{
+		for (uint32_t x = 0; x < 8; x++)
+		{
+			g_video_out_elements[y * 8 + x] = static_cast<uint8_t>(Tiler32::GetElementIndex(x, y));
+			g_texture_elements[y * 8 + x]   = static_cast<uint8_t>(Tiler1d::GetElementIndex(x, y));
 		}
 	}
+
+	if (cpuinfo_has_x86_avx2())
+	{
+		g_detile_funcs.video_out_32 = DetileVideoOut32Avx2;
+		g_detile_funcs.texture_32   = DetileTexture32Avx2;
+		g_detile_funcs.texture_64   = DetileTexture64Avx2;
+		g_detile_funcs.texture_128  = DetileTexture128Avx2;
+	} else
+	{
+		g_detile_funcs.video_out_32 = DetileVideoOut32Sse2;
+		g_detile_funcs.texture_32   = DetileTexture32Sse2;
+		g_detile_funcs.texture_64   = DetileTexture64Sse2;
+		g_detile_funcs.texture_128  = DetileTexture128Sse2;
+	}
 }
 
-static void Detile128(const Tiler1d* t, uint32_t width, uint32_t height, uint32_t dst_pitch, uint8_t* dst, const uint8_t* src, bool neo)
+// Inside a micro-tile only the element index changes, so the tiled offset is computed once per 8x8 block. The rows of a detiled
+// micro-tile row are converted while they are still in the cache.
+template <typename T, bool VIDEO_OUT, typename TILER>
+static void DetileMicroTiles(const TILER* t, DetileMicroTileFunc func, uint32_t start_y, uint32_t end_y, uint32_t width,
+                             uint64_t dst_pitch, uint8_t* dst, const uint8_t* src, bool neo, PixelConversion conversion)
 {
-	for (uint32_t y = 0; y < height; y++)
+	uint64_t pitch_bytes = dst_pitch * sizeof(T);
+
+	for (uint32_t y = start_y; y < end_y; y += 8)
 	{
-		uint32_t x             = 0;
-		uint64_t linear_offset = y * static_cast<uint64_t>(dst_pitch) * 16;
+		uint32_t h = std::min(end_y - y, 8u);
 
-		for (; x + 1 < width; x += 2)
+		for (uint32_t x = 0; x < width; x += 8)
 		{
-			auto tiled_offset = t->GetTiledOffset(x, y, neo);
+			uint32_t w = std::min(width - x, 8u);
 
-			*reinterpret_cast<Uint256*>(dst + linear_offset) = *reinterpret_cast<const Uint256*>(src + tiled_offset);
-			linear_offset += 32;
+			auto*       d = dst + y * pitch_bytes + x * sizeof(T);
+			const auto* s = src + t->GetTiledOffset(x, y, neo);
+
+			if (w == 8 && h == 8)
+			{
+				func(d, pitch_bytes, s);
+			} else
+			{
+				DetilePartialMicroTile<T, VIDEO_OUT>(d, pitch_bytes, s, w, h);
+			}
 		}
-		if (x < width)
-		{
-			auto tiled_offset = t->GetTiledOffset(x, y, neo);
 
-			*reinterpret_cast<Uint128*>(dst + linear_offset) = *reinterpret_cast<const Uint128*>(src + tiled_offset);
+		if (conversion != PixelConversion::None)
+		{
+			for (uint32_t i = 0; i < h; i++)
+			{
+				auto* row = dst + (y + i) * pitch_bytes;
+				PixelConvertRun(conversion, row, row, width * sizeof(T));
+			}
 		}
 	}
 }
 
-static void Detile1d(const Tiler1d* t, uint8_t* dst, const uint8_t* src, bool neo)
+// Rows are split into bands of whole micro-tiles which are detiled in parallel on the shared pool. Everything used by the detilers
+// is read-only after TileInit().
+template <typename T, bool VIDEO_OUT, typename TILER>
+static void DetileMicroTilesParallel(const TILER* t, DetileMicroTileFunc func, uint32_t width, uint32_t height, uint64_t dst_pitch,
+                                     uint8_t* dst, const uint8_t* src, bool neo, PixelConversion conversion)
+{
+	EXIT_IF(func == nullptr);
+
+	if (height <= DETILE_BAND_HEIGHT)
+	{
+		DetileMicroTiles<T, VIDEO_OUT>(t, func, 0, height, width, dst_pitch, dst, src, neo, conversion);
+		return;
+	}
+
+	uint32_t bands_num = (height + DETILE_BAND_HEIGHT - 1) / DETILE_BAND_HEIGHT;
+
+	Core::JobSystem::ParallelFor(
+	    bands_num,
+	    [=](uint32_t band)
+	    {
+		    uint32_t start_y = band * DETILE_BAND_HEIGHT;
+		    uint32_t end_y   = std::min(start_y + DETILE_BAND_HEIGHT, height);
+
+		    DetileMicroTiles<T, VIDEO_OUT>(t, func, start_y, end_y, width, dst_pitch, dst, src, neo, conversion);
+	    },
+	    Core::JobPriority::High);
+}
+
+static void Detile32(const Tiler32* t, uint32_t width, uint32_t height, uint32_t dst_pitch, uint8_t* dst, const uint8_t* src, bool neo)
+{
+	DetileMicroTilesParallel<uint32_t, true>(t, g_detile_funcs.video_out_32, width, height, dst_pitch, dst, src, neo,
+	                                         PixelConversion::None);
+}
+
+static void Detile1d(const Tiler1d* t, uint8_t* dst, const uint8_t* src, bool neo, PixelConversion conversion)
 {
 	if (t->m_bits_per_element == 32)
 	{
-		Detile32(t, t->m_width, t->m_height, t->m_pitch, dst, src, neo);
+		DetileMicroTilesParallel<uint32_t, false>(t, g_detile_funcs.texture_32, t->m_width, t->m_height, t->m_pitch, dst, src, neo,
+		                                          conversion);
 	} else if (t->m_bits_per_element == 64)
 	{
-		Detile64(t, t->m_width, t->m_height, t->m_pitch, dst, src, neo);
+		DetileMicroTilesParallel<uint64_t, false>(t, g_detile_funcs.texture_64, t->m_width, t->m_height, t->m_pitch, dst, src, neo,
+		                                          conversion);
 	} else if (t->m_bits_per_element == 128)
 	{
-		Detile128(t, t->m_width, t->m_height, t->m_pitch, dst, src, neo);
+		DetileMicroTilesParallel<Uint128, false>(t, g_detile_funcs.texture_128, t->m_width, t->m_height, t->m_pitch, dst, src, neo,
+		                                         conversion);
 	} else
 	{
 		EXIT("Unknown size");
@@ -455,17 +552,43 @@ void TileConvertTiledToLinear(void* dst, const void* src, TileMode mode, uint32_
 
 	EXIT_NOT_IMPLEMENTED(mode != TileMode::VideoOutTiled);
 
+	Core::Timer timer;
+	timer.Start();
+
 	Tiler32 t;
 	t.Init(width, height, neo);
 
 	Detile32(&t, width, height, width, static_cast<uint8_t*>(dst), static_cast<const uint8_t*>(src), neo);
+
+	GpuCounterAdd(GpuCounter::DetileTimeUs, static_cast<uint64_t>(timer.GetTimeMs() * 1000.0));
+}
+
+void TileGetVideoOutDetileParams(uint32_t width, uint32_t height, bool neo, TileVideoOutDetileParams* params)
+{
+	EXIT_IF(params == nullptr);
+
+	Tiler32 t;
+	t.Init(width, height, neo);
+
+	params->width               = width;
+	params->height              = height;
+	params->macro_tiles_per_row = t.m_padded_width / 128;
+	params->macro_tile_height   = t.m_macro_tile_height;
+	params->macro_tile_bytes    = (128 / 8) * (t.m_macro_tile_height / 8) * 256 / (t.m_num_pipes * t.m_num_banks);
+	params->bank_height_mask    = t.m_bank_height - 1;
+	params->bank_height_shift   = IntLog2(t.m_bank_height);
+	params->pipe_bits           = t.m_pipe_bits;
+	params->bank_bits           = t.m_bank_bits;
 }
 
 void TileConvertTiledToLinear(void* dst, const void* src, TileMode mode, uint32_t dfmt, uint32_t nfmt, uint32_t width, uint32_t height,
-                              uint32_t pitch, uint32_t levels, bool neo)
+                              uint32_t pitch, uint32_t levels, bool neo, PixelConversion conversion)
 {
 	EXIT_NOT_IMPLEMENTED(mode != TileMode::TextureTiled);
 
+	Core::Timer timer;
+	timer.Start();
+
 	TilePaddedSize padded_sizes[16];
 	TileSizeOffset level_sizes[16];
 
@@ -483,7 +606,7 @@ void TileConvertTiledToLinear(void* dst, const void* src, TileMode mode, uint32_
 		Tiler1d t;
 		t.Init(dfmt, nfmt, mip_width, mip_height, mip_pitch, padded_sizes[l].width, padded_sizes[l].height, neo);
 
-		Detile1d(&t, dstptr + level_sizes[l].offset, srcptr + level_sizes[l].offset, neo);
+		Detile1d(&t, dstptr + level_sizes[l].offset, srcptr + level_sizes[l].offset, neo, conversion);
 
 		if (mip_width > 1)
 		{
@@ -498,6 +621,8 @@ void TileConvertTiledToLinear(void* dst, const void* src, TileMode mode, uint32_
 			mip_pitch /= 2;
 		}
 	}
+
+	GpuCounterAdd(GpuCounter::DetileTimeUs, static_cast<uint64_t>(timer.GetTimeMs() * 1000.0));
 }
 
 bool TileGetDepthSize(uint32_t width, uint32_t height, uint32_t pitch, uint32_t z_format, uint32_t stencil_format, bool htile, bool neo,
@@ -1,17 +1,500 @@
 #include "Emulator/Graphics/Utils.h"
 
 #include "Kyty/Core/DbgAssert.h"
+#include "Kyty/Core/Threads.h"
+#include "Kyty/Core/Timer.h"
 #include "Kyty/Core/Vector.h"
 
+#include "Emulator/Config.h"
+#include "Emulator/Graphics/GpuCounters.h"
 #include "Emulator/Graphics/GraphicContext.h"
 #include "Emulator/Graphics/GraphicsRender.h"
 #include "Emulator/Graphics/Objects/GpuMemory.h"
+#include "Emulator/Graphics/Shader.h"
+#include "Emulator/Graphics/Tile.h"
 #include "Emulator/Profiler.h"
 
 #ifdef KYTY_EMU_ENABLED
 
 namespace Kyty::Libs::Graphics {
 
+struct ComputePipeline
+{
+	Core::Mutex           mutex;
+	VkDescriptorSetLayout set_layout      = nullptr;
+	VkPipelineLayout      pipeline_layout = nullptr;
+	VkPipeline            pipeline        = nullptr;
+	VkDescriptorPool      pool            = nullptr;
+	VkDescriptorSet       set             = nullptr;
+};
+
+struct DepthColorCopy
+{
+	TextureVulkanImage image;
+	VulkanBuffer       buffer;
+	VkDescriptorSet    set = nullptr;
+};
+
+// Every color copy of a depth image keeps its own descriptor set, so the recorded conversions never see a set being updated
+constexpr uint32_t DEPTH_COLOR_SETS_MAX = 1024;
+
+// Push constants of the BC decoding compute shader, offsets are in 32-bit words
+struct BcDecodeParams
+{
+	uint32_t width      = 0;
+	uint32_t height     = 0;
+	uint32_t pitch      = 0;
+	uint32_t format     = 0;
+	uint32_t src_offset = 0;
+	uint32_t dst_offset = 0;
+};
+
+static ComputePipeline* g_detile_pipeline      = nullptr;
+static ComputePipeline* g_depth_color_pipeline = nullptr;
+static ComputePipeline* g_bc_decode_pipeline   = nullptr;
+
+// Persistently mapped host buffer shared by all uploads and readbacks. Regions are handed out in ring order and given back
+// once the transfer that uses them has completed, so the oldest region is always the first one to be recycled. When the ring
+// is full, the caller gets a buffer of its own instead of waiting: the regions may be held by the caller's own pending uploads.
+class StagingRing
+{
+public:
+	static constexpr uint64_t RING_SIZE = static_cast<uint64_t>(64) * 1024 * 1024;
+	static constexpr uint64_t ALIGNMENT = 256;
+
+	explicit StagingRing(GraphicContext* ctx);
+	virtual ~StagingRing() = default;
+
+	KYTY_CLASS_NO_COPY(StagingRing);
+
+	bool Allocate(uint64_t size, uint64_t* offset);
+	void Release(uint64_t offset);
+
+	[[nodiscard]] VulkanBuffer* GetBuffer() { return &m_buffer; }
+	[[nodiscard]] uint8_t*      GetData() { return m_data; }
+
+private:
+	struct Region
+	{
+		uint64_t offset   = 0;
+		uint64_t size     = 0;
+		bool     released = false;
+	};
+
+	Core::Mutex    m_mutex;
+	VulkanBuffer   m_buffer {};
+	uint8_t*       m_data = nullptr;
+	uint64_t       m_head = 0;
+	Vector<Region> m_regions;
+};
+
+// Staging memory for one transfer. Falls back to a temporary buffer when the ring has no room for the request.
+class StagingBuffer
+{
+public:
+	StagingBuffer(GraphicContext* ctx, uint64_t size);
+	virtual ~StagingBuffer();
+
+	KYTY_CLASS_NO_COPY(StagingBuffer);
+
+	[[nodiscard]] VulkanBuffer* GetBuffer() { return m_buffer; }
+	[[nodiscard]] uint64_t      GetOffset() const { return m_offset; }
+	[[nodiscard]] void*         GetData() { return m_data; }
+
+private:
+	GraphicContext* m_ctx    = nullptr;
+	VulkanBuffer*   m_buffer = nullptr;
+	uint64_t        m_offset = 0;
+	void*           m_data   = nullptr;
+	bool            m_ring   = false;
+	VulkanBuffer    m_temp {};
+};
+
+// Uploads above Config::GetAsyncUploadThreshold() are submitted to the transfer queue and not waited for. Every later submit of
+// any queue waits for them through the timeline semaphores of their command buffers, so a draw never samples a half uploaded
+// texture. A separate thread gives back the staging memory and the command buffer once an upload has completed.
+class UploadStream
+{
+public:
+	// The util command pool of a thread has 10 buffers, the synchronous transfers need the rest
+	static constexpr uint32_t UPLOADS_MAX = 4;
+
+	UploadStream()
+	{
+		Core::Thread t(ThreadRun, this);
+		t.Detach();
+	}
+	virtual ~UploadStream() { KYTY_NOT_IMPLEMENTED; }
+
+	KYTY_CLASS_NO_COPY(UploadStream);
+
+	void Add(GraphicContext* ctx, CommandBuffer* buffer, const Vector<StagingBuffer*>& staging);
+	void AddWaits(VulkanCommandBufferWaits* waits);
+	void WaitAll();
+
+private:
+	struct Upload
+	{
+		CommandBuffer*         buffer = nullptr;
+		Vector<StagingBuffer*> staging;
+		VkSemaphore            timeline = nullptr;
+		uint64_t               value    = 0;
+	};
+
+	static void ThreadRun(void* data);
+
+	Core::Mutex     m_mutex;
+	Core::CondVar   m_cond_var;
+	GraphicContext* m_ctx = nullptr;
+	Vector<Upload>  m_uploads;
+};
+
+// Texture uploads of one thread between UtilBeginUploadBatch() and UtilEndUploadBatch()
+struct UploadBatch
+{
+	GraphicContext*        ctx    = nullptr;
+	CommandBuffer*         buffer = nullptr;
+	Vector<StagingBuffer*> staging;
+	int                    depth = 0;
+};
+
+static StagingRing*  g_staging_ring  = nullptr;
+static UploadStream* g_upload_stream = nullptr;
+
+static thread_local UploadBatch* g_upload_batch = nullptr;
+
+StagingRing::StagingRing(GraphicContext* ctx)
+{
+	EXIT_IF(ctx == nullptr);
+
+	m_buffer.usage           = VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+	m_buffer.memory.property = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+	VulkanCreateBuffer(ctx, RING_SIZE, &m_buffer);
+	EXIT_NOT_IMPLEMENTED(m_buffer.buffer == nullptr);
+
+	void* data = nullptr;
+	VulkanMapMemory(ctx, &m_buffer.memory, &data);
+	EXIT_NOT_IMPLEMENTED(data == nullptr);
+
+	m_data = static_cast<uint8_t*>(data);
+}
+
+bool StagingRing::Allocate(uint64_t size, uint64_t* offset)
+{
+	EXIT_IF(offset == nullptr);
+
+	size = (size + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+
+	if (size == 0 || size > RING_SIZE)
+	{
+		return false;
+	}
+
+	Core::LockGuard lock(m_mutex);
+
+	bool found = false;
+
+	if (m_regions.IsEmpty())
+	{
+		*offset = 0;
+		found   = true;
+	} else
+	{
+		uint64_t tail = m_regions.At(0).offset;
+
+		if (m_head > tail)
+		{
+			if (m_head + size <= RING_SIZE)
+			{
+				*offset = m_head;
+				found   = true;
+			} else if (size <= tail)
+			{
+				*offset = 0;
+				found   = true;
+			}
+		} else if (m_head + size <= tail)
+		{
+			*offset = m_head;
+			found   = true;
+		}
+	}
+
+	if (found)
+	{
+		Region r;
+		r.offset = *offset;
+		r.size   = size;
+		m_regions.Add(r);
+		m_head = *offset + size;
+	}
+
+	return found;
+}
+
+void StagingRing::Release(uint64_t offset)
+{
+	Core::LockGuard lock(m_mutex);
+
+	bool found = false;
+	for (auto& r: m_regions)
+	{
+		if (r.offset == offset && !r.released)
+		{
+			r.released = true;
+			found      = true;
+			break;
+		}
+	}
+
+	EXIT_IF(!found);
+
+	while (!m_regions.IsEmpty() && m_regions.At(0).released)
+	{
+		m_regions.RemoveAt(0);
+	}
+}
+
+StagingBuffer::StagingBuffer(GraphicContext* ctx, uint64_t size): m_ctx(ctx)
+{
+	EXIT_IF(ctx == nullptr);
+
+	GpuCounterAdd(GpuCounter::BytesUploaded, size);
+
+	static Core::Mutex init_mutex;
+	{
+		Core::LockGuard lock(init_mutex);
+		if (g_staging_ring == nullptr)
+		{
+			g_staging_ring = new StagingRing(ctx);
+		}
+	}
+
+	if (g_staging_ring->Allocate(size, &m_offset))
+	{
+		m_ring   = true;
+		m_buffer = g_staging_ring->GetBuffer();
+		m_data   = g_staging_ring->GetData() + m_offset;
+	} else
+	{
+		m_temp.usage           = VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+		m_temp.memory.property = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+		VulkanCreateBuffer(ctx, size, &m_temp);
+		EXIT_NOT_IMPLEMENTED(m_temp.buffer == nullptr);
+		VulkanMapMemory(ctx, &m_temp.memory, &m_data);
+		m_buffer = &m_temp;
+		m_offset = 0;
+	}
+}
+
+StagingBuffer::~StagingBuffer()
+{
+	if (m_ring)
+	{
+		g_staging_ring->Release(m_offset);
+	} else
+	{
+		VulkanUnmapMemory(m_ctx, &m_temp.memory);
+		VulkanDeleteBuffer(m_ctx, &m_temp);
+	}
+}
+
+static void wait_for_upload(GraphicContext* ctx, VkSemaphore timeline, uint64_t value)
+{
+	VkSemaphoreWaitInfo wait_info {};
+	wait_info.sType          = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+	wait_info.pNext          = nullptr;
+	wait_info.flags          = 0;
+	wait_info.semaphoreCount = 1;
+	wait_info.pSemaphores    = &timeline;
+	wait_info.pValues        = &value;
+
+	vkWaitSemaphores(ctx->device, &wait_info, UINT64_MAX);
+}
+
+void UploadStream::Add(GraphicContext* ctx, CommandBuffer* buffer, const Vector<StagingBuffer*>& staging)
+{
+	EXIT_IF(ctx == nullptr);
+	EXIT_IF(buffer == nullptr);
+	EXIT_IF(staging.IsEmpty());
+
+	Upload u;
+	u.buffer   = buffer;
+	u.staging  = staging;
+	u.timeline = buffer->GetPool()->timelines[buffer->GetIndex()];
+	u.value    = buffer->GetPool()->timeline_values[buffer->GetIndex()];
+
+	Core::LockGuard lock(m_mutex);
+
+	m_ctx = ctx;
+
+	while (m_uploads.Size() >= UPLOADS_MAX)
+	{
+		m_cond_var.Wait(&m_mutex);
+	}
+
+	m_uploads.Add(u);
+
+	m_cond_var.SignalAll();
+}
+
+void UploadStream::AddWaits(VulkanCommandBufferWaits* waits)
+{
+	EXIT_IF(waits == nullptr);
+
+	Core::LockGuard lock(m_mutex);
+
+	for (const auto& u: m_uploads)
+	{
+		bool found = false;
+		for (uint32_t i = 0; i < waits->num; i++)
+		{
+			if (waits->semaphores[i] == u.timeline)
+			{
+				waits->values[i] = std::max(waits->values[i], u.value);
+				found            = true;
+				break;
+			}
+		}
+
+		if (found)
+		{
+			continue;
+		}
+
+		if (waits->num < VulkanCommandBufferWaits::WAITS_MAX)
+		{
+			waits->semaphores[waits->num] = u.timeline;
+			waits->values[waits->num]     = u.value;
+			waits->num++;
+		} else
+		{
+			// No room for one more semaphore, the host waits instead
+			wait_for_upload(m_ctx, u.timeline, u.value);
+		}
+	}
+}
+
+void UploadStream::WaitAll()
+{
+	Core::LockGuard lock(m_mutex);
+
+	while (!m_uploads.IsEmpty())
+	{
+		m_cond_var.Wait(&m_mutex);
+	}
+}
+
+void UploadStream::ThreadRun(void* data)
+{
+	auto* s = static_cast<UploadStream*>(data);
+
+	for (;;)
+	{
+		s->m_mutex.Lock();
+		while (s->m_uploads.IsEmpty())
+		{
+			s->m_cond_var.Wait(&s->m_mutex);
+		}
+		auto  u   = s->m_uploads.At(0);
+		auto* ctx = s->m_ctx;
+		s->m_mutex.Unlock();
+
+		wait_for_upload(ctx, u.timeline, u.value);
+
+		// The buffer and the staging memory stay valid while the upload is in the list
+		delete u.buffer;
+		for (auto* staging: u.staging)
+		{
+			delete staging;
+		}
+
+		s->m_mutex.Lock();
+		s->m_uploads.RemoveAt(0);
+		s->m_cond_var.SignalAll();
+		s->m_mutex.Unlock();
+	}
+}
+
+static UploadStream* get_upload_stream()
+{
+	static Core::Mutex init_mutex;
+
+	Core::LockGuard lock(init_mutex);
+	if (g_upload_stream == nullptr)
+	{
+		g_upload_stream = new UploadStream;
+	}
+	return g_upload_stream;
+}
+
+// Submits the uploads recorded so far. The batch is emptied first, because Execute() calls UtilAddUploadWaits() again.
+static void flush_upload_batch()
+{
+	auto* b = g_upload_batch;
+
+	if (b == nullptr || b->buffer == nullptr)
+	{
+		return;
+	}
+
+	auto* buffer  = b->buffer;
+	auto  staging = b->staging;
+
+	b->buffer = nullptr;
+	b->staging.Clear();
+
+	buffer->End();
+	buffer->Execute();
+
+	get_upload_stream()->Add(b->ctx, buffer, staging);
+}
+
+void UtilBeginUploadBatch(GraphicContext* ctx)
+{
+	EXIT_IF(ctx == nullptr);
+
+	if (g_upload_batch == nullptr)
+	{
+		g_upload_batch = new UploadBatch;
+	}
+
+	g_upload_batch->ctx = ctx;
+	g_upload_batch->depth++;
+}
+
+void UtilEndUploadBatch()
+{
+	EXIT_IF(g_upload_batch == nullptr);
+	EXIT_IF(g_upload_batch->depth <= 0);
+
+	if (--g_upload_batch->depth == 0)
+	{
+		flush_upload_batch();
+	}
+}
+
+void UtilAddUploadWaits(VulkanCommandBufferWaits* waits)
+{
+	// A submit from this thread may use the textures of its pending batch
+	flush_upload_batch();
+
+	if (g_upload_stream != nullptr)
+	{
+		g_upload_stream->AddWaits(waits);
+	}
+}
+
+void UtilWaitForUploads()
+{
+	flush_upload_batch();
+
+	if (g_upload_stream != nullptr)
+	{
+		g_upload_stream->WaitAll();
+	}
+}
+
 static void set_image_layout(VkCommandBuffer buffer, VulkanImage* dst_image, uint32_t base_level, uint32_t levels,
                              VkImageAspectFlags aspect_mask, VkImageLayout old_image_layout, VkImageLayout new_image_layout)
 {
@@ -84,7 +567,128 @@ static void set_image_layout(VkCommandBuffer buffer, VulkanImage* dst_image, uin
 	dst_image->layout = new_image_layout;
 }
 
-void UtilBufferToImage(CommandBuffer* buffer, VulkanBuffer* src_buffer, uint32_t src_pitch, VulkanImage* dst_image, uint64_t dst_layout)
+static bool is_scaled(const VulkanImage* image)
+{
+	return image->guest_extent.width != 0;
+}
+
+// Converts a position in the guest image to the position in the Vulkan image
+static VkOffset3D scale_offset(const VulkanImage* image, int x, int y)
+{
+	auto guest = image->GetGuestExtent();
+	return {static_cast<int>(static_cast<int64_t>(x) * image->extent.width / guest.width),
+	        static_cast<int>(static_cast<int64_t>(y) * image->extent.height / guest.height), 0};
+}
+
+static void blit_barrier(VkCommandBuffer buffer, VulkanImage* image, VkImageLayout new_image_layout, VkAccessFlags dst_access)
+{
+	VkImageMemoryBarrier image_memory_barrier {};
+	image_memory_barrier.sType                           = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	image_memory_barrier.pNext                           = nullptr;
+	image_memory_barrier.srcAccessMask                   = VK_ACCESS_MEMORY_WRITE_BIT;
+	image_memory_barrier.dstAccessMask                   = dst_access;
+	image_memory_barrier.oldLayout                       = image->layout;
+	image_memory_barrier.newLayout                       = new_image_layout;
+	image_memory_barrier.srcQueueFamilyIndex             = VK_QUEUE_FAMILY_IGNORED;
+	image_memory_barrier.dstQueueFamilyIndex             = VK_QUEUE_FAMILY_IGNORED;
+	image_memory_barrier.image                           = image->image;
+	image_memory_barrier.subresourceRange.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT;
+	image_memory_barrier.subresourceRange.baseMipLevel   = 0;
+	image_memory_barrier.subresourceRange.levelCount     = 1;
+	image_memory_barrier.subresourceRange.baseArrayLayer = 0;
+	image_memory_barrier.subresourceRange.layerCount     = 1;
+
+	vkCmdPipelineBarrier(buffer, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, nullptr, 0, nullptr, 1,
+	                     &image_memory_barrier);
+
+	image->layout = new_image_layout;
+}
+
+// Whole image copy between a scaled image and an image of the guest size
+static void blit_image(CommandBuffer* buffer, VulkanImage* src_image, uint64_t src_layout, VulkanImage* dst_image, uint64_t dst_layout)
+{
+	auto* vk_buffer = buffer->GetPool()->buffers[buffer->GetIndex()];
+
+	buffer->FlushBarriers();
+
+	blit_barrier(vk_buffer, src_image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_ACCESS_TRANSFER_READ_BIT);
+
+	dst_image->layout = VK_IMAGE_LAYOUT_UNDEFINED;
+	blit_barrier(vk_buffer, dst_image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_ACCESS_TRANSFER_WRITE_BIT);
+
+	VkImageBlit region {};
+	region.srcSubresource.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT;
+	region.srcSubresource.mipLevel       = 0;
+	region.srcSubresource.baseArrayLayer = 0;
+	region.srcSubresource.layerCount     = 1;
+	region.srcOffsets[0]                 = {0, 0, 0};
+	region.srcOffsets[1]                 = {static_cast<int>(src_image->extent.width), static_cast<int>(src_image->extent.height), 1};
+	region.dstSubresource.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT;
+	region.dstSubresource.mipLevel       = 0;
+	region.dstSubresource.baseArrayLayer = 0;
+	region.dstSubresource.layerCount     = 1;
+	region.dstOffsets[0]                 = {0, 0, 0};
+	region.dstOffsets[1]                 = {static_cast<int>(dst_image->extent.width), static_cast<int>(dst_image->extent.height), 1};
+
+	buffer->BeginProfilerScope("transfer", "ScaleImage");
+	vkCmdBlitImage(vk_buffer, src_image->image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, dst_image->image,
+	               VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region, VK_FILTER_LINEAR);
+	buffer->EndProfilerScope();
+
+	blit_barrier(vk_buffer, src_image, static_cast<VkImageLayout>(src_layout), VK_ACCESS_MEMORY_READ_BIT);
+	blit_barrier(vk_buffer, dst_image, static_cast<VkImageLayout>(dst_layout), VK_ACCESS_MEMORY_READ_BIT);
+}
+
+// Guest data of a scaled image goes through a temporary image of the guest size
+static void create_guest_image(GraphicContext* ctx, const VulkanImage* image, VulkanImage* guest_image)
+{
+	EXIT_IF(!is_scaled(image));
+
+	guest_image->extent = image->guest_extent;
+	guest_image->format = image->format;
+	guest_image->layout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+	VkImageCreateInfo image_info {};
+	image_info.sType         = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+	image_info.pNext         = nullptr;
+	image_info.flags         = 0;
+	image_info.imageType     = VK_IMAGE_TYPE_2D;
+	image_info.extent.width  = guest_image->extent.width;
+	image_info.extent.height = guest_image->extent.height;
+	image_info.extent.depth  = 1;
+	image_info.mipLevels     = 1;
+	image_info.arrayLayers   = 1;
+	image_info.format        = guest_image->format;
+	image_info.tiling        = VK_IMAGE_TILING_OPTIMAL;
+	image_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	image_info.usage         = static_cast<VkImageUsageFlags>(VK_IMAGE_USAGE_TRANSFER_SRC_BIT) | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+	image_info.sharingMode   = VK_SHARING_MODE_EXCLUSIVE;
+	image_info.samples       = VK_SAMPLE_COUNT_1_BIT;
+
+	vkCreateImage(ctx->device, &image_info, nullptr, &guest_image->image);
+
+	EXIT_NOT_IMPLEMENTED(guest_image->image == nullptr);
+
+	vkGetImageMemoryRequirements(ctx->device, guest_image->image, &guest_image->memory.requirements);
+
+	guest_image->memory.property = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+
+	bool allocated = VulkanAllocate(ctx, &guest_image->memory);
+
+	EXIT_NOT_IMPLEMENTED(!allocated);
+
+	VulkanBindImageMemory(ctx, guest_image, &guest_image->memory);
+}
+
+static void delete_guest_image(GraphicContext* ctx, VulkanImage* guest_image)
+{
+	vkDestroyImage(ctx->device, guest_image->image, nullptr);
+	VulkanFree(ctx, &guest_image->memory);
+	guest_image->image = nullptr;
+}
+
+void UtilBufferToImage(CommandBuffer* buffer, VulkanBuffer* src_buffer, uint64_t src_offset, uint32_t src_pitch, VulkanImage* dst_image,
+                       uint64_t dst_layout)
 {
 	EXIT_IF(src_buffer == nullptr);
 	EXIT_IF(src_buffer->buffer == nullptr);
@@ -93,11 +697,13 @@ void UtilBufferToImage(CommandBuffer* buffer, VulkanBuffer* src_buffer, uint32_t
 
 	auto* vk_buffer = buffer->GetPool()->buffers[buffer->GetIndex()];
 
+	buffer->FlushBarriers();
+
 	set_image_layout(vk_buffer, dst_image, 0, 1, VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_LAYOUT_UNDEFINED,
 	                 VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
 
 	VkBufferImageCopy region {};
-	region.bufferOffset      = 0;
+	region.bufferOffset      = src_offset;
 	region.bufferRowLength   = (src_pitch != dst_image->extent.width ? src_pitch : 0);
 	region.bufferImageHeight = 0;
 
@@ -109,13 +715,16 @@ void UtilBufferToImage(CommandBuffer* buffer, VulkanBuffer* src_buffer, uint32_t
 	region.imageOffset = {0, 0, 0};
 	region.imageExtent = {dst_image->extent.width, dst_image->extent.height, 1};
 
+	buffer->BeginProfilerScope("transfer", "BufferToImage");
 	vkCmdCopyBufferToImage(vk_buffer, src_buffer->buffer, dst_image->image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+	buffer->EndProfilerScope();
 
 	set_image_layout(vk_buffer, dst_image, 0, 1, VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
 	                 static_cast<VkImageLayout>(dst_layout));
 }
 
-void UtilImageToBuffer(CommandBuffer* buffer, VulkanImage* src_image, VulkanBuffer* dst_buffer, uint32_t dst_pitch, uint64_t src_layout)
+void UtilImageToBuffer(CommandBuffer* buffer, VulkanImage* src_image, VulkanBuffer* dst_buffer, uint64_t dst_offset, uint32_t dst_pitch,
+                       uint64_t src_layout)
 {
 	EXIT_IF(dst_buffer == nullptr);
 	EXIT_IF(dst_buffer->buffer == nullptr);
@@ -124,10 +733,12 @@ void UtilImageToBuffer(CommandBuffer* buffer, VulkanImage* src_image, VulkanBuff
 
 	auto* vk_buffer = buffer->GetPool()->buffers[buffer->GetIndex()];
 
+	buffer->FlushBarriers();
+
 	set_image_layout(vk_buffer, src_image, 0, 1, VK_IMAGE_ASPECT_COLOR_BIT, src_image->layout, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL);
 
 	VkBufferImageCopy region {};
-	region.bufferOffset      = 0;
+	region.bufferOffset      = dst_offset;
 	region.bufferRowLength   = (dst_pitch != src_image->extent.width ? dst_pitch : 0);
 	region.bufferImageHeight = 0;
 
@@ -139,14 +750,16 @@ void UtilImageToBuffer(CommandBuffer* buffer, VulkanImage* src_image, VulkanBuff
 	region.imageOffset = {0, 0, 0};
 	region.imageExtent = {src_image->extent.width, src_image->extent.height, 1};
 
+	buffer->BeginProfilerScope("transfer", "ImageToBuffer");
 	vkCmdCopyImageToBuffer(vk_buffer, src_image->image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, dst_buffer->buffer, 1, &region);
+	buffer->EndProfilerScope();
 
 	set_image_layout(vk_buffer, src_image, 0, 1, VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
 	                 static_cast<VkImageLayout>(src_layout));
 }
 
-void UtilBufferToImage(CommandBuffer* buffer, VulkanBuffer* src_buffer, VulkanImage* dst_image, const Vector<BufferImageCopy>& regions,
-                       uint64_t dst_layout)
+void UtilBufferToImage(CommandBuffer* buffer, VulkanBuffer* src_buffer, uint64_t src_offset, VulkanImage* dst_image,
+                       const Vector<BufferImageCopy>& regions, uint64_t dst_layout)
 {
 	EXIT_IF(src_buffer == nullptr);
 	EXIT_IF(src_buffer->buffer == nullptr);
@@ -155,6 +768,8 @@ void UtilBufferToImage(CommandBuffer* buffer, VulkanBuffer* src_buffer, VulkanIm
 
 	auto* vk_buffer = buffer->GetPool()->buffers[buffer->GetIndex()];
 
+	buffer->FlushBarriers();
+
 	EXIT_NOT_IMPLEMENTED(regions.Size() >= 16);
 
 	VkBufferImageCopy region[16];
@@ -162,7 +777,7 @@ void UtilBufferToImage(CommandBuffer* buffer, VulkanBuffer* src_buffer, VulkanIm
 	uint32_t index = 0;
 	for (const auto& r: regions)
 	{
-		region[index].bufferOffset                    = r.offset;
+		region[index].bufferOffset                    = src_offset + r.offset;
 		region[index].bufferRowLength                 = (r.width != r.pitch ? r.pitch : 0);
 		region[index].bufferImageHeight               = 0;
 		region[index].imageSubresource.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT;
@@ -177,7 +792,9 @@ void UtilBufferToImage(CommandBuffer* buffer, VulkanBuffer* src_buffer, VulkanIm
 	set_image_layout(vk_buffer, dst_image, 0, VK_REMAINING_MIP_LEVELS, VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_LAYOUT_UNDEFINED,
 	                 VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
 
+	buffer->BeginProfilerScope("transfer", "BufferToImage");
 	vkCmdCopyBufferToImage(vk_buffer, src_buffer->buffer, dst_image->image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, index, region);
+	buffer->EndProfilerScope();
 
 	set_image_layout(vk_buffer, dst_image, 0, VK_REMAINING_MIP_LEVELS, VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
 	                 static_cast<VkImageLayout>(dst_layout));
@@ -190,6 +807,8 @@ void UtilImageToImage(CommandBuffer* buffer, const Vector<ImageImageCopy>& regio
 
 	auto* vk_buffer = buffer->GetPool()->buffers[buffer->GetIndex()];
 
+	buffer->FlushBarriers();
+
 	EXIT_NOT_IMPLEMENTED(regions.Size() >= 16);
 
 	set_image_layout(vk_buffer, dst_image, 0, VK_REMAINING_MIP_LEVELS, VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_LAYOUT_UNDEFINED,
@@ -201,6 +820,37 @@ void UtilImageToImage(CommandBuffer* buffer, const Vector<ImageImageCopy>& regio
 
 		auto src_layout = r.src_image->layout;
 
+		if (is_scaled(r.src_image) || is_scaled(dst_image))
+		{
+			VkImageBlit blit {};
+			blit.srcSubresource.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT;
+			blit.srcSubresource.mipLevel       = r.src_level;
+			blit.srcSubresource.baseArrayLayer = 0;
+			blit.srcSubresource.layerCount     = 1;
+			blit.srcOffsets[0]                 = scale_offset(r.src_image, r.src_x, r.src_y);
+			blit.srcOffsets[1] = scale_offset(r.src_image, r.src_x + static_cast<int>(r.width), r.src_y + static_cast<int>(r.height));
+			blit.srcOffsets[1].z               = 1;
+			blit.dstSubresource.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT;
+			blit.dstSubresource.mipLevel       = r.dst_level;
+			blit.dstSubresource.baseArrayLayer = 0;
+			blit.dstSubresource.layerCount     = 1;
+			blit.dstOffsets[0]                 = scale_offset(dst_image, r.dst_x, r.dst_y);
+			blit.dstOffsets[1]   = scale_offset(dst_image, r.dst_x + static_cast<int>(r.width), r.dst_y + static_cast<int>(r.height));
+			blit.dstOffsets[1].z = 1;
+
+			set_image_layout(vk_buffer, r.src_image, r.src_level, 1, VK_IMAGE_ASPECT_COLOR_BIT, src_layout,
+			                 VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL);
+
+			buffer->BeginProfilerScope("transfer", "ScaleImage");
+			vkCmdBlitImage(vk_buffer, r.src_image->image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, dst_image->image,
+			               VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &blit, VK_FILTER_LINEAR);
+			buffer->EndProfilerScope();
+
+			set_image_layout(vk_buffer, r.src_image, r.src_level, 1, VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+			                 src_layout);
+			continue;
+		}
+
 		region.srcSubresource.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT;
 		region.srcSubresource.mipLevel       = r.src_level;
 		region.srcSubresource.baseArrayLayer = 0;
@@ -216,8 +866,10 @@ void UtilImageToImage(CommandBuffer* buffer, const Vector<ImageImageCopy>& regio
 		set_image_layout(vk_buffer, r.src_image, r.src_level, 1, VK_IMAGE_ASPECT_COLOR_BIT, src_layout,
 		                 VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL);
 
+		buffer->BeginProfilerScope("transfer", "ImageToImage");
 		vkCmdCopyImage(vk_buffer, r.src_image->image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, dst_image->image,
 		               VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+		buffer->EndProfilerScope();
 
 		set_image_layout(vk_buffer, r.src_image, r.src_level, 1, VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
 		                 src_layout);
@@ -235,6 +887,8 @@ void UtilBlitImage(CommandBuffer* buffer, VulkanImage* src_image, VulkanSwapchai
 
 	auto* vk_buffer = buffer->GetPool()->buffers[buffer->GetIndex()];
 
+	buffer->FlushBarriers();
+
 	VulkanImage swapchain_image(VulkanImageType::Unknown);
 
 	swapchain_image.image  = dst_swapchain->swapchain_images[dst_swapchain->current_index];
@@ -267,45 +921,185 @@ void UtilBlitImage(CommandBuffer* buffer, VulkanImage* src_image, VulkanSwapchai
 	region.dstOffsets[1].y               = static_cast<int>(dst_swapchain->swapchain_extent.height);
 	region.dstOffsets[1].z               = 1;
 
+	buffer->BeginProfilerScope("transfer", "BlitImage");
 	vkCmdBlitImage(vk_buffer, src_image->image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, swapchain_image.image,
 	               VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region, VK_FILTER_LINEAR);
+	buffer->EndProfilerScope();
 
 	set_image_layout(vk_buffer, src_image, 0, 1, VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
 	                 VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
 }
 
-void VulkanCreateBuffer(GraphicContext* gctx, uint64_t size, VulkanBuffer* buffer)
+static void mip_barrier(VkCommandBuffer buffer, VulkanImage* image, uint32_t base_level, uint32_t levels, VkImageLayout old_image_layout,
+                        VkImageLayout new_image_layout, VkAccessFlags src_access, VkAccessFlags dst_access)
 {
-	KYTY_PROFILER_FUNCTION();
-
-	EXIT_IF(gctx == nullptr);
-	EXIT_IF(buffer == nullptr);
-	EXIT_IF(buffer->buffer != nullptr);
+	VkImageMemoryBarrier image_memory_barrier {};
+	image_memory_barrier.sType                           = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	image_memory_barrier.pNext                           = nullptr;
+	image_memory_barrier.srcAccessMask                   = src_access;
+	image_memory_barrier.dstAccessMask                   = dst_access;
+	image_memory_barrier.oldLayout                       = old_image_layout;
+	image_memory_barrier.newLayout                       = new_image_layout;
+	image_memory_barrier.srcQueueFamilyIndex             = VK_QUEUE_FAMILY_IGNORED;
+	image_memory_barrier.dstQueueFamilyIndex             = VK_QUEUE_FAMILY_IGNORED;
+	image_memory_barrier.image                           = image->image;
+	image_memory_barrier.subresourceRange.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT;
+	image_memory_barrier.subresourceRange.baseMipLevel   = base_level;
+	image_memory_barrier.subresourceRange.levelCount     = levels;
+	image_memory_barrier.subresourceRange.baseArrayLayer = 0;
+	image_memory_barrier.subresourceRange.layerCount     = 1;
 
-	VkBufferCreateInfo buffer_info {};
-	buffer_info.sType       = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-	buffer_info.size        = size;
-	buffer_info.usage       = buffer->usage;
-	buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	vkCmdPipelineBarrier(buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1,
+	                     &image_memory_barrier);
+}
 
-	vkCreateBuffer(gctx->device, &buffer_info, nullptr, &buffer->buffer);
-	EXIT_NOT_IMPLEMENTED(buffer->buffer == nullptr);
+bool UtilCanGenerateMips(GraphicContext* ctx, VulkanImage* image)
+{
+	EXIT_IF(ctx == nullptr);
+	EXIT_IF(image == nullptr);
 
-	vkGetBufferMemoryRequirements(gctx->device, buffer->buffer, &buffer->memory.requirements);
+	VkFormatFeatureFlags features = VK_FORMAT_FEATURE_BLIT_SRC_BIT | VK_FORMAT_FEATURE_BLIT_DST_BIT |
+	                                VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
 
-	bool allocated = VulkanAllocate(gctx, &buffer->memory);
-	EXIT_NOT_IMPLEMENTED(!allocated);
+	VkFormatProperties props {};
+	vkGetPhysicalDeviceFormatProperties(ctx->physical_device, image->format, &props);
 
-	// vkBindBufferMemory(gctx->device, buffer->buffer, buffer->memory.memory, buffer->memory.offset);
-	VulkanBindBufferMemory(gctx, buffer, &buffer->memory);
+	return (props.optimalTilingFeatures & features) == features;
 }
 
-void VulkanDeleteBuffer(GraphicContext* gctx, VulkanBuffer* buffer)
+// Mip 0 is already filled, every next level is a linear downsample of the previous one
+void UtilGenerateMips(CommandBuffer* buffer, VulkanImage* image, uint32_t levels, uint64_t layout)
 {
-	KYTY_PROFILER_FUNCTION();
+	EXIT_IF(image == nullptr);
+	EXIT_IF(image->image == nullptr);
+	EXIT_IF(image->layout == VK_IMAGE_LAYOUT_UNDEFINED);
+	EXIT_IF(levels < 2);
 
-	EXIT_IF(buffer == nullptr);
-	EXIT_IF(gctx == nullptr);
+	auto* vk_buffer = buffer->GetPool()->buffers[buffer->GetIndex()];
+
+	buffer->FlushBarriers();
+
+	auto dst_layout = static_cast<VkImageLayout>(layout);
+
+	mip_barrier(vk_buffer, image, 0, 1, image->layout, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_ACCESS_MEMORY_WRITE_BIT,
+	            VK_ACCESS_TRANSFER_READ_BIT);
+	mip_barrier(vk_buffer, image, 1, levels - 1, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 0,
+	            VK_ACCESS_TRANSFER_WRITE_BIT);
+
+	auto mip_width  = static_cast<int>(image->extent.width);
+	auto mip_height = static_cast<int>(image->extent.height);
+
+	buffer->BeginProfilerScope("transfer", "GenerateMips");
+	for (uint32_t i = 1; i < levels; i++)
+	{
+		VkImageBlit region {};
+		region.srcSubresource.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT;
+		region.srcSubresource.mipLevel       = i - 1;
+		region.srcSubresource.baseArrayLayer = 0;
+		region.srcSubresource.layerCount     = 1;
+		region.srcOffsets[0]                 = {0, 0, 0};
+		region.srcOffsets[1]                 = {mip_width, mip_height, 1};
+
+		if (mip_width > 1)
+		{
+			mip_width /= 2;
+		}
+		if (mip_height > 1)
+		{
+			mip_height /= 2;
+		}
+
+		region.dstSubresource.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT;
+		region.dstSubresource.mipLevel       = i;
+		region.dstSubresource.baseArrayLayer = 0;
+		region.dstSubresource.layerCount     = 1;
+		region.dstOffsets[0]                 = {0, 0, 0};
+		region.dstOffsets[1]                 = {mip_width, mip_height, 1};
+
+		vkCmdBlitImage(vk_buffer, image->image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, image->image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1,
+		               &region, VK_FILTER_LINEAR);
+
+		if (i + 1 < levels)
+		{
+			mip_barrier(vk_buffer, image, i, 1, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+			            VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_TRANSFER_READ_BIT);
+		}
+	}
+	buffer->EndProfilerScope();
+
+	mip_barrier(vk_buffer, image, 0, levels - 1, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, dst_layout, VK_ACCESS_TRANSFER_READ_BIT,
+	            VK_ACCESS_MEMORY_READ_BIT);
+	mip_barrier(vk_buffer, image, levels - 1, 1, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, dst_layout, VK_ACCESS_TRANSFER_WRITE_BIT,
+	            VK_ACCESS_MEMORY_READ_BIT);
+
+	image->layout = dst_layout;
+}
+
+void VulkanCreateBuffer(GraphicContext* gctx, uint64_t size, VulkanBuffer* buffer)
+{
+	KYTY_PROFILER_FUNCTION();
+
+	EXIT_IF(gctx == nullptr);
+	EXIT_IF(buffer == nullptr);
+	EXIT_IF(buffer->buffer != nullptr);
+
+	VkBufferCreateInfo buffer_info {};
+	buffer_info.sType       = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	buffer_info.size        = size;
+	buffer_info.usage       = buffer->usage;
+	buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+	vkCreateBuffer(gctx->device, &buffer_info, nullptr, &buffer->buffer);
+	EXIT_NOT_IMPLEMENTED(buffer->buffer == nullptr);
+
+	vkGetBufferMemoryRequirements(gctx->device, buffer->buffer, &buffer->memory.requirements);
+
+	bool allocated = VulkanAllocate(gctx, &buffer->memory);
+	EXIT_NOT_IMPLEMENTED(!allocated);
+
+	// vkBindBufferMemory(gctx->device, buffer->buffer, buffer->memory.memory, buffer->memory.offset);
+	VulkanBindBufferMemory(gctx, buffer, &buffer->memory);
+}
+
+// The buffer is bound to the imported guest memory, see VulkanCanImportHost()
+void VulkanCreateHostBuffer(GraphicContext* gctx, void* host_ptr, uint64_t size, VulkanBuffer* buffer)
+{
+	KYTY_PROFILER_FUNCTION();
+
+	EXIT_IF(gctx == nullptr);
+	EXIT_IF(host_ptr == nullptr);
+	EXIT_IF(buffer == nullptr);
+	EXIT_IF(buffer->buffer != nullptr);
+
+	VkExternalMemoryBufferCreateInfo external_info {};
+	external_info.sType       = VK_STRUCTURE_TYPE_EXTERNAL_MEMORY_BUFFER_CREATE_INFO;
+	external_info.pNext       = nullptr;
+	external_info.handleTypes = VK_EXTERNAL_MEMORY_HANDLE_TYPE_HOST_ALLOCATION_BIT_EXT;
+
+	VkBufferCreateInfo buffer_info {};
+	buffer_info.sType       = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	buffer_info.pNext       = &external_info;
+	buffer_info.size        = size;
+	buffer_info.usage       = buffer->usage;
+	buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+	vkCreateBuffer(gctx->device, &buffer_info, nullptr, &buffer->buffer);
+	EXIT_NOT_IMPLEMENTED(buffer->buffer == nullptr);
+
+	vkGetBufferMemoryRequirements(gctx->device, buffer->buffer, &buffer->memory.requirements);
+
+	bool allocated = VulkanAllocateHost(gctx, &buffer->memory, host_ptr);
+	EXIT_NOT_IMPLEMENTED(!allocated);
+
+	VulkanBindBufferMemory(gctx, buffer, &buffer->memory);
+}
+
+void VulkanDeleteBuffer(GraphicContext* gctx, VulkanBuffer* buffer)
+{
+	KYTY_PROFILER_FUNCTION();
+
+	EXIT_IF(buffer == nullptr);
+	EXIT_IF(gctx == nullptr);
 
 	DeleteDescriptor(buffer);
 
@@ -316,35 +1110,56 @@ void VulkanDeleteBuffer(GraphicContext* gctx, VulkanBuffer* buffer)
 
 void UtilFillImage(GraphicContext* ctx, VulkanImage* dst_image, const void* src_data, uint64_t size, uint32_t src_pitch,
                    uint64_t dst_layout)
+{
+	EXIT_IF(src_data == nullptr);
+
+	UtilFillImage(
+	    ctx, dst_image, [src_data, size](void* dst) { std::memcpy(dst, src_data, size); }, size, src_pitch, dst_layout);
+}
+
+void UtilFillImage(GraphicContext* ctx, VulkanImage* dst_image, const UtilFillFunc& fill, uint64_t size, uint32_t src_pitch,
+                   uint64_t dst_layout)
 {
 	KYTY_PROFILER_FUNCTION();
 
 	EXIT_IF(ctx == nullptr);
 	EXIT_IF(dst_image == nullptr);
-	EXIT_IF(src_data == nullptr);
 
-	VulkanBuffer staging_buffer {};
-	staging_buffer.usage           = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
-	staging_buffer.memory.property = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
-	VulkanCreateBuffer(ctx, size, &staging_buffer);
+	StagingBuffer staging_buffer(ctx, size);
+	fill(staging_buffer.GetData());
 
-	void* data = nullptr;
-	VulkanMapMemory(ctx, &staging_buffer.memory, &data);
-	std::memcpy(data, src_data, size);
-	VulkanUnmapMemory(ctx, &staging_buffer.memory);
+	bool        scaled = is_scaled(dst_image);
+	VulkanImage guest_image(VulkanImageType::Unknown);
 
-	CommandBuffer buffer(GraphicContext::QUEUE_UTIL);
+	if (scaled)
+	{
+		create_guest_image(ctx, dst_image, &guest_image);
+	}
+
+	// QUEUE_UTIL may be a transfer-only queue, blits need the graphics one
+	CommandBuffer buffer(scaled ? GraphicContext::QUEUE_GFX : GraphicContext::QUEUE_UTIL);
 	// buffer.SetQueue(GraphicContext::QUEUE_UTIL);
 
 	EXIT_NOT_IMPLEMENTED(buffer.IsInvalid());
 
 	buffer.Begin();
-	UtilBufferToImage(&buffer, &staging_buffer, src_pitch, dst_image, dst_layout);
+	if (scaled)
+	{
+		UtilBufferToImage(&buffer, staging_buffer.GetBuffer(), staging_buffer.GetOffset(), src_pitch, &guest_image,
+		                  static_cast<uint64_t>(VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL));
+		blit_image(&buffer, &guest_image, static_cast<uint64_t>(VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL), dst_image, dst_layout);
+	} else
+	{
+		UtilBufferToImage(&buffer, staging_buffer.GetBuffer(), staging_buffer.GetOffset(), src_pitch, dst_image, dst_layout);
+	}
 	buffer.End();
 	buffer.Execute();
 	buffer.WaitForFence();
 
-	VulkanDeleteBuffer(ctx, &staging_buffer);
+	if (scaled)
+	{
+		delete_guest_image(ctx, &guest_image);
+	}
 }
 
 void UtilFillBuffer(GraphicContext* ctx, void* dst_data, uint64_t size, uint32_t dst_pitch, VulkanImage* src_image, uint64_t src_layout)
@@ -355,28 +1170,41 @@ void UtilFillBuffer(GraphicContext* ctx, void* dst_data, uint64_t size, uint32_t
 	EXIT_IF(src_image == nullptr);
 	EXIT_IF(dst_data == nullptr);
 
-	VulkanBuffer staging_buffer {};
-	staging_buffer.usage           = VK_BUFFER_USAGE_TRANSFER_DST_BIT;
-	staging_buffer.memory.property = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
-	VulkanCreateBuffer(ctx, size, &staging_buffer);
+	StagingBuffer staging_buffer(ctx, size);
 
-	CommandBuffer buffer(GraphicContext::QUEUE_UTIL);
+	bool        scaled = is_scaled(src_image);
+	VulkanImage guest_image(VulkanImageType::Unknown);
+
+	if (scaled)
+	{
+		create_guest_image(ctx, src_image, &guest_image);
+	}
+
+	CommandBuffer buffer(scaled ? GraphicContext::QUEUE_GFX : GraphicContext::QUEUE_UTIL);
 	// buffer.SetQueue(GraphicContext::QUEUE_UTIL);
 
 	EXIT_NOT_IMPLEMENTED(buffer.IsInvalid());
 
 	buffer.Begin();
-	UtilImageToBuffer(&buffer, src_image, &staging_buffer, dst_pitch, src_layout);
+	if (scaled)
+	{
+		blit_image(&buffer, src_image, src_layout, &guest_image, static_cast<uint64_t>(VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL));
+		UtilImageToBuffer(&buffer, &guest_image, staging_buffer.GetBuffer(), staging_buffer.GetOffset(), dst_pitch,
+		                  static_cast<uint64_t>(VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL));
+	} else
+	{
+		UtilImageToBuffer(&buffer, src_image, staging_buffer.GetBuffer(), staging_buffer.GetOffset(), dst_pitch, src_layout);
+	}
 	buffer.End();
 	buffer.Execute();
 	buffer.WaitForFence();
 
-	void* data = nullptr;
-	VulkanMapMemory(ctx, &staging_buffer.memory, &data);
-	std::memcpy(dst_data, data, size);
-	VulkanUnmapMemory(ctx, &staging_buffer.memory);
+	if (scaled)
+	{
+		delete_guest_image(ctx, &guest_image);
+	}
 
-	VulkanDeleteBuffer(ctx, &staging_buffer);
+	std::memcpy(dst_data, staging_buffer.GetData(), size);
 }
 
 void UtilSetDepthLayoutOptimal(DepthStencilVulkanImage* image)
@@ -424,21 +1252,86 @@ void UtilSetImageLayoutOptimal(VulkanImage* image)
 	buffer.WaitForFence();
 }
 
+uint32_t UtilGetRenderScale()
+{
+	return std::clamp(Config::GetRenderScale(), static_cast<uint32_t>(50), static_cast<uint32_t>(200));
+}
+
+// Render targets and depth buffers are created at the configured scale of the guest size, which is kept in guest_extent. Copies
+// from and to guest memory go through an image of the guest size.
+void UtilApplyRenderScale(VulkanImage* image)
+{
+	EXIT_IF(image == nullptr);
+	EXIT_IF(image->image != nullptr);
+
+	uint32_t scale = UtilGetRenderScale();
+
+	if (scale != 100)
+	{
+		image->guest_extent  = image->extent;
+		image->extent.width  = std::max(static_cast<uint32_t>(1), image->guest_extent.width * scale / 100);
+		image->extent.height = std::max(static_cast<uint32_t>(1), image->guest_extent.height * scale / 100);
+	}
+}
+
 void UtilFillImage(GraphicContext* ctx, VulkanImage* image, const void* src_data, uint64_t size, const Vector<BufferImageCopy>& regions,
                    uint64_t dst_layout)
+{
+	EXIT_IF(src_data == nullptr);
+
+	UtilFillImage(
+	    ctx, image, [src_data, size](void* dst) { std::memcpy(dst, src_data, size); }, size, regions, dst_layout);
+}
+
+void UtilFillImage(GraphicContext* ctx, VulkanImage* image, const UtilFillFunc& fill, uint64_t size, const Vector<BufferImageCopy>& regions,
+                   uint64_t dst_layout)
 {
 	EXIT_IF(ctx == nullptr);
 	EXIT_IF(image == nullptr);
 
-	VulkanBuffer staging_buffer {};
-	staging_buffer.usage           = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
-	staging_buffer.memory.property = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
-	VulkanCreateBuffer(ctx, size, &staging_buffer);
+	uint32_t threshold = Config::GetAsyncUploadThreshold();
 
-	void* data = nullptr;
-	VulkanMapMemory(ctx, &staging_buffer.memory, &data);
-	std::memcpy(data, src_data, size);
-	VulkanUnmapMemory(ctx, &staging_buffer.memory);
+	if (g_upload_batch != nullptr && g_upload_batch->depth > 0)
+	{
+		auto* b = g_upload_batch;
+
+		auto* staging_buffer = new StagingBuffer(ctx, size);
+		fill(staging_buffer->GetData());
+
+		if (b->buffer == nullptr)
+		{
+			b->buffer = new CommandBuffer(GraphicContext::QUEUE_UTIL);
+			EXIT_NOT_IMPLEMENTED(b->buffer->IsInvalid());
+			b->buffer->Begin();
+		}
+
+		UtilBufferToImage(b->buffer, staging_buffer->GetBuffer(), staging_buffer->GetOffset(), image, regions, dst_layout);
+		b->staging.Add(staging_buffer);
+
+		return;
+	}
+
+	if (threshold != 0 && size > static_cast<uint64_t>(threshold) * 1024)
+	{
+		auto* staging_buffer = new StagingBuffer(ctx, size);
+		fill(staging_buffer->GetData());
+
+		auto* buffer = new CommandBuffer(GraphicContext::QUEUE_UTIL);
+
+		EXIT_NOT_IMPLEMENTED(buffer->IsInvalid());
+
+		buffer->Begin();
+		UtilBufferToImage(buffer, staging_buffer->GetBuffer(), staging_buffer->GetOffset(), image, regions, dst_layout);
+		buffer->End();
+		buffer->Execute();
+
+		get_upload_stream()->Add(ctx, buffer, {staging_buffer});
+
+		return;
+	}
+
+	StagingBuffer staging_buffer(ctx, size);
+	fill(staging_buffer.GetData());
 
 	CommandBuffer buffer(GraphicContext::QUEUE_UTIL);
 	// buffer.SetQueue(GraphicContext::QUEUE_UTIL);
@@ -446,12 +1339,10 @@ void UtilFillImage(GraphicContext* ctx, VulkanImage* image, const void* src_data
 	EXIT_NOT_IMPLEMENTED(buffer.IsInvalid());
 
 	buffer.Begin();
-	UtilBufferToImage(&buffer, &staging_buffer, image, regions, dst_layout);
+	UtilBufferToImage(&buffer, staging_buffer.GetBuffer(), staging_buffer.GetOffset(), image, regions, dst_layout);
 	buffer.End();
 	buffer.Execute();
 	buffer.WaitForFence();
-
-	VulkanDeleteBuffer(ctx, &staging_buffer);
 }
 
 void UtilFillImage(GraphicContext* ctx, const Vector<ImageImageCopy>& regions, VulkanImage* dst_image, uint64_t dst_layout)
@@ -459,7 +1350,9 @@ void UtilFillImage(GraphicContext* ctx, const Vector<ImageImageCopy>& regions, V
 	EXIT_IF(ctx == nullptr);
 	EXIT_IF(dst_image == nullptr);
 
-	CommandBuffer buffer(GraphicContext::QUEUE_UTIL);
+	bool scaled = is_scaled(dst_image) || regions.Contains(true, [](const auto& r, auto b) { return is_scaled(r.src_image) == b; });
+
+	CommandBuffer buffer(scaled ? GraphicContext::QUEUE_GFX : GraphicContext::QUEUE_UTIL);
 	// buffer.SetQueue(GraphicContext::QUEUE_UTIL);
 
 	EXIT_NOT_IMPLEMENTED(buffer.IsInvalid());
@@ -471,7 +1364,672 @@ void UtilFillImage(GraphicContext* ctx, const Vector<ImageImageCopy>& regions, V
 	buffer.WaitForFence();
 }
 
-void UtilCopyBuffer(VulkanBuffer* src_buffer, VulkanBuffer* dst_buffer, uint64_t size)
+void UtilFillImageGenerateMips(GraphicContext* ctx, const Vector<ImageImageCopy>& regions, VulkanImage* dst_image, uint32_t levels,
+                               uint64_t dst_layout)
+{
+	EXIT_IF(ctx == nullptr);
+	EXIT_IF(dst_image == nullptr);
+
+	// QUEUE_UTIL may be a transfer-only queue, blits need the graphics one
+	CommandBuffer buffer(GraphicContext::QUEUE_GFX);
+
+	EXIT_NOT_IMPLEMENTED(buffer.IsInvalid());
+
+	buffer.Begin();
+	UtilImageToImage(&buffer, regions, dst_image, dst_layout);
+	UtilGenerateMips(&buffer, dst_image, levels, dst_layout);
+	buffer.End();
+	buffer.Execute();
+	buffer.WaitForFence();
+}
+
+// The set of a single-set pipeline is allocated here and shared by all the dispatches, otherwise the sets are allocated by the user
+static void CreateComputePipeline(GraphicContext* ctx, ComputePipeline* p, uint32_t cs_id, uint32_t buffers_num,
+                                  uint32_t push_constants_size, uint32_t sets_num)
+{
+	EXIT_IF(ctx == nullptr);
+	EXIT_IF(p == nullptr);
+	EXIT_IF(p->pipeline != nullptr);
+	EXIT_IF(buffers_num == 0 || buffers_num > 2);
+	EXIT_IF(sets_num == 0);
+
+	VkDescriptorSetLayoutBinding bindings[2];
+	for (uint32_t i = 0; i < buffers_num; i++)
+	{
+		bindings[i].binding            = i;
+		bindings[i].descriptorType     = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		bindings[i].descriptorCount    = 1;
+		bindings[i].stageFlags         = VK_SHADER_STAGE_COMPUTE_BIT;
+		bindings[i].pImmutableSamplers = nullptr;
+	}
+
+	VkDescriptorSetLayoutCreateInfo layout_info {};
+	layout_info.sType        = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	layout_info.pNext        = nullptr;
+	layout_info.flags        = 0;
+	layout_info.bindingCount = buffers_num;
+	layout_info.pBindings    = bindings;
+
+	vkCreateDescriptorSetLayout(ctx->device, &layout_info, nullptr, &p->set_layout);
+	EXIT_NOT_IMPLEMENTED(p->set_layout == nullptr);
+
+	VkPushConstantRange push_constant_info {};
+	push_constant_info.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	push_constant_info.offset     = 0;
+	push_constant_info.size       = push_constants_size;
+
+	VkPipelineLayoutCreateInfo pipeline_layout_info {};
+	pipeline_layout_info.sType                  = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	pipeline_layout_info.pNext                  = nullptr;
+	pipeline_layout_info.flags                  = 0;
+	pipeline_layout_info.setLayoutCount         = 1;
+	pipeline_layout_info.pSetLayouts            = &p->set_layout;
+	pipeline_layout_info.pushConstantRangeCount = 1;
+	pipeline_layout_info.pPushConstantRanges    = &push_constant_info;
+
+	vkCreatePipelineLayout(ctx->device, &pipeline_layout_info, nullptr, &p->pipeline_layout);
+	EXIT_NOT_IMPLEMENTED(p->pipeline_layout == nullptr);
+
+	auto cs_shader = ShaderRecompileEmbeddedCS(cs_id);
+
+	VkShaderModuleCreateInfo create_info {};
+	create_info.sType    = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+	create_info.pNext    = nullptr;
+	create_info.flags    = 0;
+	create_info.codeSize = static_cast<size_t>(cs_shader.Size()) * 4;
+	create_info.pCode    = cs_shader.GetDataConst();
+
+	VkShaderModule comp_shader_module = nullptr;
+	vkCreateShaderModule(ctx->device, &create_info, nullptr, &comp_shader_module);
+	EXIT_NOT_IMPLEMENTED(comp_shader_module == nullptr);
+
+	VkComputePipelineCreateInfo info {};
+	info.sType                     = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+	info.pNext                     = nullptr;
+	info.flags                     = 0;
+	info.stage.sType               = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	info.stage.pNext               = nullptr;
+	info.stage.flags               = 0;
+	info.stage.stage               = VK_SHADER_STAGE_COMPUTE_BIT;
+	info.stage.module              = comp_shader_module;
+	info.stage.pName               = "main";
+	info.stage.pSpecializationInfo = nullptr;
+	info.layout                    = p->pipeline_layout;
+	info.basePipelineHandle        = nullptr;
+	info.basePipelineIndex         = -1;
+
+	vkCreateComputePipelines(ctx->device, nullptr, 1, &info, nullptr, &p->pipeline);
+	EXIT_NOT_IMPLEMENTED(p->pipeline == nullptr);
+
+	vkDestroyShaderModule(ctx->device, comp_shader_module, nullptr);
+
+	VkDescriptorPoolSize pool_size {};
+	pool_size.type            = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	pool_size.descriptorCount = buffers_num * sets_num;
+
+	VkDescriptorPoolCreateInfo pool_info {};
+	pool_info.sType         = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	pool_info.pNext         = nullptr;
+	pool_info.flags         = 0;
+	pool_info.poolSizeCount = 1;
+	pool_info.pPoolSizes    = &pool_size;
+	pool_info.maxSets       = sets_num;
+
+	if (sets_num > 1)
+	{
+		pool_info.flags = VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT;
+	}
+
+	vkCreateDescriptorPool(ctx->device, &pool_info, nullptr, &p->pool);
+	EXIT_NOT_IMPLEMENTED(p->pool == nullptr);
+
+	if (sets_num > 1)
+	{
+		return;
+	}
+
+	VkDescriptorSetAllocateInfo alloc_info {};
+	alloc_info.sType              = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	alloc_info.pNext              = nullptr;
+	alloc_info.descriptorPool     = p->pool;
+	alloc_info.descriptorSetCount = 1;
+	alloc_info.pSetLayouts        = &p->set_layout;
+
+	vkAllocateDescriptorSets(ctx->device, &alloc_info, &p->set);
+	EXIT_NOT_IMPLEMENTED(p->set == nullptr);
+}
+
+// The tiled bytes are uploaded as-is and detiled by a compute shader into a device local buffer, which is then copied into the image.
+// If the guest memory can be imported, the shader reads it directly and nothing is copied on the CPU.
+void UtilDetileVideoOutImage(GraphicContext* ctx, VulkanImage* dst_image, const void* src_data, uint64_t size, uint32_t width,
+                             uint32_t height, bool neo, uint64_t dst_layout)
+{
+	KYTY_PROFILER_FUNCTION();
+
+	EXIT_IF(ctx == nullptr);
+	EXIT_IF(dst_image == nullptr);
+	EXIT_IF(src_data == nullptr);
+
+	Core::Timer timer;
+	timer.Start();
+
+	static Core::Mutex init_mutex;
+	{
+		Core::LockGuard lock(init_mutex);
+		if (g_detile_pipeline == nullptr)
+		{
+			auto* p = new ComputePipeline;
+			CreateComputePipeline(ctx, p, 0, 2, sizeof(TileVideoOutDetileParams), 1);
+			g_detile_pipeline = p;
+		}
+	}
+
+	auto* p = g_detile_pipeline;
+
+	TileVideoOutDetileParams params;
+	TileGetVideoOutDetileParams(width, height, neo, &params);
+
+	uint64_t linear_size = static_cast<uint64_t>(width) * height * 4;
+
+	bool import_host = VulkanCanImportHost(ctx, reinterpret_cast<uint64_t>(src_data));
+
+	StagingBuffer* tiled_buffer = nullptr;
+	VulkanBuffer   host_buffer {};
+
+	if (import_host)
+	{
+		host_buffer.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+		VulkanCreateHostBuffer(ctx, const_cast<void*>(src_data), size, &host_buffer);
+	} else
+	{
+		tiled_buffer = new StagingBuffer(ctx, size);
+		std::memcpy(tiled_buffer->GetData(), src_data, size);
+	}
+
+	VulkanBuffer linear_buffer {};
+	linear_buffer.usage           = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+	linear_buffer.memory.property = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+	VulkanCreateBuffer(ctx, linear_size, &linear_buffer);
+
+	Core::LockGuard lock(p->mutex);
+
+	VkDescriptorBufferInfo buffer_info[2];
+	buffer_info[0].buffer = (import_host ? host_buffer.buffer : tiled_buffer->GetBuffer()->buffer);
+	buffer_info[0].offset = (import_host ? 0 : tiled_buffer->GetOffset());
+	buffer_info[0].range  = size;
+	buffer_info[1].buffer = linear_buffer.buffer;
+	buffer_info[1].offset = 0;
+	buffer_info[1].range  = VK_WHOLE_SIZE;
+
+	VkWriteDescriptorSet descriptor_write[2];
+	for (uint32_t i = 0; i < 2; i++)
+	{
+		descriptor_write[i].sType            = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		descriptor_write[i].pNext            = nullptr;
+		descriptor_write[i].dstSet           = p->set;
+		descriptor_write[i].dstBinding       = i;
+		descriptor_write[i].dstArrayElement  = 0;
+		descriptor_write[i].descriptorType   = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		descriptor_write[i].descriptorCount  = 1;
+		descriptor_write[i].pBufferInfo      = &buffer_info[i];
+		descriptor_write[i].pImageInfo       = nullptr;
+		descriptor_write[i].pTexelBufferView = nullptr;
+	}
+
+	vkUpdateDescriptorSets(ctx->device, 2, descriptor_write, 0, nullptr);
+
+	// QUEUE_UTIL is a transfer queue, the graphics queue is the one guaranteed to support compute
+	CommandBuffer buffer(GraphicContext::QUEUE_GFX);
+
+	EXIT_NOT_IMPLEMENTED(buffer.IsInvalid());
+
+	auto* vk_buffer = buffer.GetPool()->buffers[buffer.GetIndex()];
+
+	buffer.Begin();
+
+	vkCmdBindPipeline(vk_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, p->pipeline);
+	vkCmdBindDescriptorSets(vk_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, p->pipeline_layout, 0, 1, &p->set, 0, nullptr);
+	vkCmdPushConstants(vk_buffer, p->pipeline_layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(params), &params);
+	buffer.BeginProfilerScope("dispatch", "Detile");
+	vkCmdDispatch(vk_buffer, (width + 7) / 8, (height + 7) / 8, 1);
+	buffer.EndProfilerScope();
+
+	VkBufferMemoryBarrier barrier {};
+	barrier.sType               = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+	barrier.pNext               = nullptr;
+	barrier.srcAccessMask       = VK_ACCESS_SHADER_WRITE_BIT;
+	barrier.dstAccessMask       = VK_ACCESS_TRANSFER_READ_BIT;
+	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.buffer              = linear_buffer.buffer;
+	barrier.offset              = 0;
+	barrier.size                = VK_WHOLE_SIZE;
+
+	vkCmdPipelineBarrier(vk_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 1, &barrier, 0,
+	                     nullptr);
+
+	bool        scaled = is_scaled(dst_image);
+	VulkanImage guest_image(VulkanImageType::Unknown);
+
+	if (scaled)
+	{
+		create_guest_image(ctx, dst_image, &guest_image);
+		UtilBufferToImage(&buffer, &linear_buffer, 0, width, &guest_image, static_cast<uint64_t>(VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL));
+		blit_image(&buffer, &guest_image, static_cast<uint64_t>(VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL), dst_image, dst_layout);
+	} else
+	{
+		UtilBufferToImage(&buffer, &linear_buffer, 0, width, dst_image, dst_layout);
+	}
+
+	buffer.End();
+	buffer.Execute();
+	buffer.WaitForFence();
+
+	if (scaled)
+	{
+		delete_guest_image(ctx, &guest_image);
+	}
+
+	if (import_host)
+	{
+		VulkanDeleteBuffer(ctx, &host_buffer);
+	}
+
+	delete tiled_buffer;
+
+	GpuCounterAdd(GpuCounter::DetileTimeUs, static_cast<uint64_t>(timer.GetTimeMs() * 1000.0));
+
+	VulkanDeleteBuffer(ctx, &linear_buffer);
+}
+
+// The BC blocks are written into the staging memory and decoded by a compute shader into a device local buffer of RGBA8 texels,
+// which is then copied into the image. One dispatch per region, every thread decodes one texel.
+void UtilDecodeBcImage(GraphicContext* ctx, VulkanImage* dst_image, const UtilFillFunc& fill, uint64_t size, uint32_t bc,
+                       const Vector<BufferImageCopy>& regions, uint64_t dst_layout)
+{
+	KYTY_PROFILER_FUNCTION();
+
+	EXIT_IF(ctx == nullptr);
+	EXIT_IF(dst_image == nullptr);
+	EXIT_IF(bc < 1 || bc > 3);
+	EXIT_IF(is_scaled(dst_image));
+
+	static Core::Mutex init_mutex;
+	{
+		Core::LockGuard lock(init_mutex);
+		if (g_bc_decode_pipeline == nullptr)
+		{
+			auto* p = new ComputePipeline;
+			CreateComputePipeline(ctx, p, 2, 2, sizeof(BcDecodeParams), 1);
+			g_bc_decode_pipeline = p;
+		}
+	}
+
+	auto* p = g_bc_decode_pipeline;
+
+	Vector<BufferImageCopy> linear_regions;
+	uint64_t                linear_size = 0;
+
+	for (const auto& r: regions)
+	{
+		EXIT_NOT_IMPLEMENTED((r.offset % 4) != 0);
+
+		BufferImageCopy l = r;
+		l.offset          = static_cast<uint32_t>(linear_size);
+		l.pitch           = r.width;
+		linear_regions.Add(l);
+
+		linear_size += static_cast<uint64_t>(r.width) * r.height * 4;
+	}
+
+	StagingBuffer src_buffer(ctx, size);
+	fill(src_buffer.GetData());
+
+	VulkanBuffer linear_buffer {};
+	linear_buffer.usage           = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+	linear_buffer.memory.property = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+	VulkanCreateBuffer(ctx, linear_size, &linear_buffer);
+
+	Core::LockGuard lock(p->mutex);
+
+	VkDescriptorBufferInfo buffer_info[2];
+	buffer_info[0].buffer = src_buffer.GetBuffer()->buffer;
+	buffer_info[0].offset = src_buffer.GetOffset();
+	buffer_info[0].range  = size;
+	buffer_info[1].buffer = linear_buffer.buffer;
+	buffer_info[1].offset = 0;
+	buffer_info[1].range  = VK_WHOLE_SIZE;
+
+	VkWriteDescriptorSet descriptor_write[2];
+	for (uint32_t i = 0; i < 2; i++)
+	{
+		descriptor_write[i].sType            = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		descriptor_write[i].pNext            = nullptr;
+		descriptor_write[i].dstSet           = p->set;
+		descriptor_write[i].dstBinding       = i;
+		descriptor_write[i].dstArrayElement  = 0;
+		descriptor_write[i].descriptorType   = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		descriptor_write[i].descriptorCount  = 1;
+		descriptor_write[i].pBufferInfo      = &buffer_info[i];
+		descriptor_write[i].pImageInfo       = nullptr;
+		descriptor_write[i].pTexelBufferView = nullptr;
+	}
+
+	vkUpdateDescriptorSets(ctx->device, 2, descriptor_write, 0, nullptr);
+
+	// QUEUE_UTIL is a transfer queue, the graphics queue is the one guaranteed to support compute
+	CommandBuffer buffer(GraphicContext::QUEUE_GFX);
+
+	EXIT_NOT_IMPLEMENTED(buffer.IsInvalid());
+
+	auto* vk_buffer = buffer.GetPool()->buffers[buffer.GetIndex()];
+
+	buffer.Begin();
+
+	vkCmdBindPipeline(vk_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, p->pipeline);
+	vkCmdBindDescriptorSets(vk_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, p->pipeline_layout, 0, 1, &p->set, 0, nullptr);
+	buffer.BeginProfilerScope("dispatch", "DecodeBc");
+	for (uint32_t i = 0; i < regions.Size(); i++)
+	{
+		const auto& r = regions.At(i);
+
+		BcDecodeParams params;
+		params.width      = r.width;
+		params.height     = r.height;
+		params.pitch      = r.pitch;
+		params.format     = bc;
+		params.src_offset = r.offset / 4;
+		params.dst_offset = linear_regions.At(i).offset / 4;
+
+		vkCmdPushConstants(vk_buffer, p->pipeline_layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(params), &params);
+		vkCmdDispatch(vk_buffer, (r.width + 7) / 8, (r.height + 7) / 8, 1);
+	}
+	buffer.EndProfilerScope();
+
+	VkBufferMemoryBarrier barrier {};
+	barrier.sType               = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+	barrier.pNext               = nullptr;
+	barrier.srcAccessMask       = VK_ACCESS_SHADER_WRITE_BIT;
+	barrier.dstAccessMask       = VK_ACCESS_TRANSFER_READ_BIT;
+	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.buffer              = linear_buffer.buffer;
+	barrier.offset              = 0;
+	barrier.size                = VK_WHOLE_SIZE;
+
+	vkCmdPipelineBarrier(vk_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 1, &barrier, 0,
+	                     nullptr);
+
+	UtilBufferToImage(&buffer, &linear_buffer, 0, dst_image, linear_regions, dst_layout);
+
+	buffer.End();
+	buffer.Execute();
+	buffer.WaitForFence();
+
+	VulkanDeleteBuffer(ctx, &linear_buffer);
+}
+
+static ComputePipeline* get_depth_color_pipeline(GraphicContext* ctx)
+{
+	static Core::Mutex init_mutex;
+
+	Core::LockGuard lock(init_mutex);
+	if (g_depth_color_pipeline == nullptr)
+	{
+		auto* p = new ComputePipeline;
+		CreateComputePipeline(ctx, p, 1, 1, sizeof(uint32_t), DEPTH_COLOR_SETS_MAX);
+		g_depth_color_pipeline = p;
+	}
+	return g_depth_color_pipeline;
+}
+
+// The depth aspect is copied bit-exact, only D24 texels are converted by a shader
+static VkFormat get_depth_color_format(VkFormat depth_format)
+{
+	switch (depth_format)
+	{
+		case VK_FORMAT_D16_UNORM: return VK_FORMAT_R16_UNORM; break;
+		case VK_FORMAT_D24_UNORM_S8_UINT:
+		case VK_FORMAT_D32_SFLOAT:
+		case VK_FORMAT_D32_SFLOAT_S8_UINT: return VK_FORMAT_R32_SFLOAT; break;
+		default: EXIT("unknown depth format: %d\n", static_cast<int>(depth_format));
+	}
+	return VK_FORMAT_UNDEFINED;
+}
+
+static void create_depth_color(GraphicContext* ctx, DepthStencilVulkanImage* image, DepthColorCopy* c)
+{
+	EXIT_IF(ctx == nullptr);
+	EXIT_IF(image == nullptr);
+	EXIT_IF(c == nullptr);
+
+	c->image.format = get_depth_color_format(image->format);
+	c->image.extent = image->extent;
+	c->image.layout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+	VkImageCreateInfo image_info {};
+	image_info.sType         = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+	image_info.pNext         = nullptr;
+	image_info.flags         = 0;
+	image_info.imageType     = VK_IMAGE_TYPE_2D;
+	image_info.extent.width  = c->image.extent.width;
+	image_info.extent.height = c->image.extent.height;
+	image_info.extent.depth  = 1;
+	image_info.mipLevels     = 1;
+	image_info.arrayLayers   = 1;
+	image_info.format        = c->image.format;
+	image_info.tiling        = VK_IMAGE_TILING_OPTIMAL;
+	image_info.initialLayout = c->image.layout;
+	image_info.usage         = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+	image_info.sharingMode   = VK_SHARING_MODE_EXCLUSIVE;
+	image_info.samples       = VK_SAMPLE_COUNT_1_BIT;
+
+	vkCreateImage(ctx->device, &image_info, nullptr, &c->image.image);
+	EXIT_NOT_IMPLEMENTED(c->image.image == nullptr);
+
+	VulkanMemory mem;
+	vkGetImageMemoryRequirements(ctx->device, c->image.image, &mem.requirements);
+	mem.property = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+
+	bool allocated = VulkanAllocate(ctx, &mem);
+	EXIT_NOT_IMPLEMENTED(!allocated);
+
+	VulkanBindImageMemory(ctx, &c->image, &mem);
+	c->image.memory = mem;
+
+	// VIEW_DEFAULT is bound as a storage image, VIEW_DEPTH_TEXTURE is sampled like the depth image itself
+	for (int view: {VulkanImage::VIEW_DEFAULT, VulkanImage::VIEW_DEPTH_TEXTURE})
+	{
+		auto swizzle = (view == VulkanImage::VIEW_DEFAULT ? VK_COMPONENT_SWIZZLE_IDENTITY : VK_COMPONENT_SWIZZLE_R);
+
+		VkImageViewCreateInfo create_info {};
+		create_info.sType                           = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+		create_info.pNext                           = nullptr;
+		create_info.flags                           = 0;
+		create_info.image                           = c->image.image;
+		create_info.viewType                        = VK_IMAGE_VIEW_TYPE_2D;
+		create_info.format                          = c->image.format;
+		create_info.components.r                    = swizzle;
+		create_info.components.g                    = swizzle;
+		create_info.components.b                    = swizzle;
+		create_info.components.a                    = swizzle;
+		create_info.subresourceRange.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT;
+		create_info.subresourceRange.baseArrayLayer = 0;
+		create_info.subresourceRange.baseMipLevel   = 0;
+		create_info.subresourceRange.layerCount     = 1;
+		create_info.subresourceRange.levelCount     = 1;
+
+		vkCreateImageView(ctx->device, &create_info, nullptr, &c->image.image_view[view]);
+		EXIT_NOT_IMPLEMENTED(c->image.image_view[view] == nullptr);
+	}
+
+	c->buffer.usage           = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+	c->buffer.memory.property = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+	VulkanCreateBuffer(ctx, static_cast<uint64_t>(c->image.extent.width) * c->image.extent.height * 4, &c->buffer);
+
+	auto* p = get_depth_color_pipeline(ctx);
+
+	Core::LockGuard lock(p->mutex);
+
+	VkDescriptorSetAllocateInfo alloc_info {};
+	alloc_info.sType              = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	alloc_info.pNext              = nullptr;
+	alloc_info.descriptorPool     = p->pool;
+	alloc_info.descriptorSetCount = 1;
+	alloc_info.pSetLayouts        = &p->set_layout;
+
+	vkAllocateDescriptorSets(ctx->device, &alloc_info, &c->set);
+	EXIT_NOT_IMPLEMENTED(c->set == nullptr);
+
+	VkDescriptorBufferInfo buffer_info {};
+	buffer_info.buffer = c->buffer.buffer;
+	buffer_info.offset = 0;
+	buffer_info.range  = VK_WHOLE_SIZE;
+
+	VkWriteDescriptorSet descriptor_write {};
+	descriptor_write.sType            = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	descriptor_write.pNext            = nullptr;
+	descriptor_write.dstSet           = c->set;
+	descriptor_write.dstBinding       = 0;
+	descriptor_write.dstArrayElement  = 0;
+	descriptor_write.descriptorType   = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	descriptor_write.descriptorCount  = 1;
+	descriptor_write.pBufferInfo      = &buffer_info;
+	descriptor_write.pImageInfo       = nullptr;
+	descriptor_write.pTexelBufferView = nullptr;
+
+	vkUpdateDescriptorSets(ctx->device, 1, &descriptor_write, 0, nullptr);
+}
+
+VulkanImage* UtilGetDepthColor(GraphicContext* ctx, DepthStencilVulkanImage* image)
+{
+	EXIT_IF(ctx == nullptr);
+	EXIT_IF(image == nullptr);
+
+	if (image->color_copy == nullptr)
+	{
+		auto* c = new DepthColorCopy;
+		create_depth_color(ctx, image, c);
+		image->color_copy       = c;
+		image->color_generation = static_cast<uint64_t>(-1);
+	}
+
+	return &image->color_copy->image;
+}
+
+void UtilDeleteDepthColor(GraphicContext* ctx, DepthStencilVulkanImage* image)
+{
+	EXIT_IF(ctx == nullptr);
+	EXIT_IF(image == nullptr);
+
+	auto* c = image->color_copy;
+
+	if (c == nullptr)
+	{
+		return;
+	}
+
+	auto* p = get_depth_color_pipeline(ctx);
+
+	{
+		Core::LockGuard lock(p->mutex);
+		vkFreeDescriptorSets(ctx->device, p->pool, 1, &c->set);
+	}
+
+	for (auto& view: c->image.image_view)
+	{
+		if (view != nullptr)
+		{
+			vkDestroyImageView(ctx->device, view, nullptr);
+		}
+	}
+
+	vkDestroyImage(ctx->device, c->image.image, nullptr);
+	VulkanFree(ctx, &c->image.memory);
+	VulkanDeleteBuffer(ctx, &c->buffer);
+
+	delete c;
+	image->color_copy = nullptr;
+}
+
+static void depth_color_barrier(VkCommandBuffer vk_buffer, VulkanBuffer* buffer, VkPipelineStageFlags src_stage, VkAccessFlags src_access,
+                                VkPipelineStageFlags dst_stage, VkAccessFlags dst_access)
+{
+	VkBufferMemoryBarrier barrier {};
+	barrier.sType               = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+	barrier.pNext               = nullptr;
+	barrier.srcAccessMask       = src_access;
+	barrier.dstAccessMask       = dst_access;
+	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.buffer              = buffer->buffer;
+	barrier.offset              = 0;
+	barrier.size                = VK_WHOLE_SIZE;
+
+	vkCmdPipelineBarrier(vk_buffer, src_stage, dst_stage, 0, 0, nullptr, 1, &barrier, 0, nullptr);
+}
+
+// Depth images can't be copied to color images directly, the texels go through the buffer of the copy. Nothing leaves the GPU.
+void UtilDepthToColor(CommandBuffer* buffer, DepthStencilVulkanImage* image)
+{
+	KYTY_PROFILER_FUNCTION();
+
+	EXIT_IF(buffer == nullptr);
+	EXIT_IF(image == nullptr);
+	EXIT_IF(image->color_copy == nullptr);
+	EXIT_IF(image->layout != VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL);
+	EXIT_IF(image->color_copy->image.layout != VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+
+	auto* c         = image->color_copy;
+	auto* vk_buffer = buffer->GetPool()->buffers[buffer->GetIndex()];
+
+	VkBufferImageCopy region {};
+	region.bufferOffset                    = 0;
+	region.bufferRowLength                 = 0;
+	region.bufferImageHeight               = 0;
+	region.imageSubresource.aspectMask     = VK_IMAGE_ASPECT_DEPTH_BIT;
+	region.imageSubresource.mipLevel       = 0;
+	region.imageSubresource.baseArrayLayer = 0;
+	region.imageSubresource.layerCount     = 1;
+	region.imageOffset                     = {0, 0, 0};
+	region.imageExtent                     = {image->extent.width, image->extent.height, 1};
+
+	buffer->BeginProfilerScope("copy", "DepthToColor");
+
+	vkCmdCopyImageToBuffer(vk_buffer, image->image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, c->buffer.buffer, 1, &region);
+
+	if (image->format == VK_FORMAT_D24_UNORM_S8_UINT)
+	{
+		// 24-bit depth in the low bits of every texel, the top 8 bits are undefined
+		auto*    p     = g_depth_color_pipeline;
+		uint32_t count = image->extent.width * image->extent.height;
+
+		EXIT_IF(p == nullptr);
+
+		depth_color_barrier(vk_buffer, &c->buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+		                    VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+
+		vkCmdBindPipeline(vk_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, p->pipeline);
+		vkCmdBindDescriptorSets(vk_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, p->pipeline_layout, 0, 1, &c->set, 0, nullptr);
+		vkCmdPushConstants(vk_buffer, p->pipeline_layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(count), &count);
+		vkCmdDispatch(vk_buffer, (count + 63) / 64, 1, 1);
+
+		depth_color_barrier(vk_buffer, &c->buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+		                    VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT);
+	} else
+	{
+		depth_color_barrier(vk_buffer, &c->buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+		                    VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT);
+	}
+
+	region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+
+	vkCmdCopyBufferToImage(vk_buffer, c->buffer.buffer, c->image.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+
+	buffer->EndProfilerScope();
+}
+
+static void copy_buffer(VulkanBuffer* src_buffer, uint64_t src_offset, VulkanBuffer* dst_buffer, uint64_t size)
 {
 	EXIT_IF(src_buffer == nullptr);
 	EXIT_IF(src_buffer->buffer == nullptr);
@@ -488,17 +2046,37 @@ void UtilCopyBuffer(VulkanBuffer* src_buffer, VulkanBuffer* dst_buffer, uint64_t
 	buffer.Begin();
 
 	VkBufferCopy copy_region {};
-	copy_region.srcOffset = 0;
+	copy_region.srcOffset = src_offset;
 	copy_region.dstOffset = 0;
 	copy_region.size      = size;
 
+	buffer.BeginProfilerScope("transfer", "CopyBuffer");
 	vkCmdCopyBuffer(vk_buffer, src_buffer->buffer, dst_buffer->buffer, 1, &copy_region);
+	buffer.EndProfilerScope();
 
 	buffer.End();
 	buffer.Execute();
 	buffer.WaitForFence();
 }
 
+void UtilCopyBuffer(VulkanBuffer* src_buffer, VulkanBuffer* dst_buffer, uint64_t size)
+{
+	copy_buffer(src_buffer, 0, dst_buffer, size);
+}
+
+void UtilUploadBuffer(GraphicContext* ctx, VulkanBuffer* dst_buffer, const void* src_data, uint64_t size)
+{
+	KYTY_PROFILER_FUNCTION();
+
+	EXIT_IF(ctx == nullptr);
+	EXIT_IF(src_data == nullptr);
+
+	StagingBuffer staging_buffer(ctx, size);
+	std::memcpy(staging_buffer.GetData(), src_data, size);
+
+	copy_buffer(staging_buffer.GetBuffer(), staging_buffer.GetOffset(), dst_buffer, size);
+}
+
 } // namespace Kyty::Libs::Graphics
 
 #endif // KYTY_EMU_ENABLED
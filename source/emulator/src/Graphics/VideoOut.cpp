@@ -3,12 +3,17 @@
 #include "Kyty/Core/Common.h"
 #include "Kyty/Core/DbgAssert.h"
 #include "Kyty/Core/LinkList.h"
+#include "Kyty/Core/SmallVector.h"
 #include "Kyty/Core/String.h"
 #include "Kyty/Core/Threads.h"
+#include "Kyty/Core/Timer.h"
 #include "Kyty/Core/Vector.h"
 
+#include "Emulator/Benchmark.h"
 #include "Emulator/Common.h"
 #include "Emulator/Config.h"
+#include "Emulator/Controller.h"
+#include "Emulator/Graphics/GpuCounters.h"
 #include "Emulator/Graphics/GraphicsRender.h"
 #include "Emulator/Graphics/Objects/GpuMemory.h"
 #include "Emulator/Graphics/Objects/VideoOutBuffer.h"
@@ -163,6 +168,8 @@ public:
 	void Wait(VideoOutConfig* cfg, int index);
 
 private:
+	static constexpr uint64_t VBLANK_PERIOD_US = 16667;
+
 	struct Request
 	{
 		VideoOutConfig* cfg;
@@ -171,10 +178,13 @@ private:
 		uint64_t        submit_tsc;
 	};
 
+	void WaitFlipTime(const VideoOutConfig* cfg);
+
 	Core::Mutex         m_mutex;
 	Core::CondVar       m_submit_cond_var;
 	Core::CondVar       m_done_cond_var;
 	Core::List<Request> m_requests;
+	uint64_t            m_next_flip_time = 0;
 };
 
 class VideoOutContext
@@ -212,11 +222,20 @@ public:
 	void VblankBegin();
 	void VblankEnd();
 
+	void               StartVblankTimer();
+	[[nodiscard]] bool IsVblankTimerStarted() const { return m_vblank_timer_started; }
+
 private:
+	static constexpr uint64_t VBLANK_PERIOD_NS = 16666667;
+
+	void        Vblank(bool pre);
+	static void VblankTimer(void* arg);
+
 	Core::Mutex               m_mutex;
 	VideoOutConfig            m_video_out_ctx[VIDEO_OUT_NUM_MAX];
 	Graphics::GraphicContext* m_graphic_ctx = nullptr;
 	FlipQueue                 m_flip_queue;
+	bool                      m_vblank_timer_started = false;
 };
 
 static VideoOutContext* g_video_out_context = nullptr;
@@ -261,6 +280,12 @@ void VideoOutInit(uint32_t width, uint32_t height)
 	g_video_out_context = new VideoOutContext;
 
 	g_video_out_context->Init(width, height);
+
+	// Uncapped headless runs signal a vblank after each flip
+	if (Config::VblankTimerEnabled() && !(Config::HeadlessEnabled() && Config::HeadlessUncapped()))
+	{
+		g_video_out_context->StartVblankTimer();
+	}
 }
 
 void VideoOutContext::Init(uint32_t width, uint32_t height)
@@ -294,6 +319,8 @@ int VideoOutContext::Open()
 	EXIT_IF(!m_video_out_ctx[handle].vblank_eqs.IsEmpty());
 	EXIT_IF(m_video_out_ctx[handle].flip_rate != 0);
 
+	// The vblank timer reads the state under the mutex of the output only
+	m_video_out_ctx[handle].mutex.Lock();
 	m_video_out_ctx[handle].opened                    = true;
 	m_video_out_ctx[handle].flip_status               = VideoOutFlipStatus();
 	m_video_out_ctx[handle].flip_status.flipArg       = -1;
@@ -301,6 +328,7 @@ int VideoOutContext::Open()
 	m_video_out_ctx[handle].flip_status.count         = 0;
 	m_video_out_ctx[handle].pre_vblank_status         = VideoOutVblankStatus();
 	m_video_out_ctx[handle].vblank_status             = VideoOutVblankStatus();
+	m_video_out_ctx[handle].mutex.Unlock();
 
 	return handle;
 }
@@ -312,9 +340,8 @@ void VideoOutContext::Close(int handle)
 	EXIT_NOT_IMPLEMENTED(handle >= VIDEO_OUT_NUM_MAX);
 	EXIT_NOT_IMPLEMENTED(!m_video_out_ctx[handle].opened);
 
-	m_video_out_ctx[handle].opened = false;
-
 	m_video_out_ctx[handle].mutex.Lock();
+	m_video_out_ctx[handle].opened = false;
 	for (auto& flip_eq: m_video_out_ctx[handle].flip_eqs)
 	{
 		if (flip_eq != nullptr)
@@ -367,58 +394,97 @@ VideoOutConfig* VideoOutContext::Get(int handle)
 	return m_video_out_ctx + handle;
 }
 
-void VideoOutContext::VblankBegin()
+// The queues are copied under the mutex of the output and triggered without it, so a waiter woken by the event doesn't wait for
+// the other queues. An event deleted in between is skipped.
+void VideoOutContext::Vblank(bool pre)
 {
-	Core::LockGuard lock(m_mutex);
-
 	for (int i = 1; i < VIDEO_OUT_NUM_MAX; i++)
 	{
 		auto& ctx = m_video_out_ctx[i];
+
+		Core::SmallVector<EventQueue::KernelEqueue, 4> eqs;
+		uint64_t                                       count = 0;
+
+		ctx.mutex.Lock();
 		if (ctx.opened)
 		{
-			ctx.mutex.Lock();
-			ctx.pre_vblank_status.count++;
-			ctx.pre_vblank_status.processTime = LibKernel::KernelGetProcessTime();
-			ctx.pre_vblank_status.tsc         = LibKernel::KernelReadTsc();
+			auto& status = (pre ? ctx.pre_vblank_status : ctx.vblank_status);
+
+			status.count++;
+			status.processTime = LibKernel::KernelGetProcessTime();
+			status.tsc         = LibKernel::KernelReadTsc();
+			count              = status.count;
 
-			for (auto& vblank_eq: ctx.pre_vblank_eqs)
+			for (const auto& vblank_eq: (pre ? ctx.pre_vblank_eqs : ctx.vblank_eqs))
 			{
 				if (vblank_eq != nullptr)
 				{
-					auto result = EventQueue::KernelTriggerEvent(vblank_eq, VIDEO_OUT_EVENT_VBLANK, EventQueue::KERNEL_EVFILT_VIDEO_OUT,
-					                                             reinterpret_cast<void*>(ctx.pre_vblank_status.count));
-					EXIT_NOT_IMPLEMENTED(result != OK);
+					eqs.Add(vblank_eq);
 				}
 			}
-			ctx.mutex.Unlock();
+		}
+		ctx.mutex.Unlock();
+
+		for (const auto& vblank_eq: eqs)
+		{
+			auto result = EventQueue::KernelTriggerEvent(vblank_eq, VIDEO_OUT_EVENT_VBLANK, EventQueue::KERNEL_EVFILT_VIDEO_OUT,
+			                                             reinterpret_cast<void*>(count));
+			EXIT_NOT_IMPLEMENTED(result != OK && result != LibKernel::KERNEL_ERROR_ENOENT);
 		}
 	}
 }
 
+void VideoOutContext::VblankBegin()
+{
+	Vblank(true);
+}
+
 void VideoOutContext::VblankEnd()
 {
-	Core::LockGuard lock(m_mutex);
+	Vblank(false);
+}
 
-	for (int i = 1; i < VIDEO_OUT_NUM_MAX; i++)
+void VideoOutContext::StartVblankTimer()
+{
+	EXIT_IF(m_vblank_timer_started);
+
+	m_vblank_timer_started = true;
+
+	Core::Thread t(VblankTimer, this);
+	t.Detach();
+}
+
+// The deadlines are counted from the start, so the period doesn't drift with the time the events take. Vblanks missed by more than
+// a period are dropped instead of being signaled in a burst. How late the thread wakes up is counted as GpuCounter::VblankJitterUs.
+void VideoOutContext::VblankTimer(void* arg)
+{
+	KYTY_PROFILER_THREAD("Thread_Vblank");
+
+	auto* ctx = static_cast<VideoOutContext*>(arg);
+
+	uint64_t freq  = Core::Timer::QueryPerformanceFrequency();
+	uint64_t start = Core::Timer::QueryPerformanceCounter();
+
+	// Split to avoid overflows
+	auto ns_to_ticks = [freq](uint64_t ns) { return (ns / 1000000000) * freq + (ns % 1000000000) * freq / 1000000000; };
+	auto ticks_to_ns = [freq](uint64_t ticks) { return (ticks / freq) * 1000000000 + (ticks % freq) * 1000000000 / freq; };
+
+	for (uint64_t n = 1;; n++)
 	{
-		auto& ctx = m_video_out_ctx[i];
-		if (ctx.opened)
-		{
-			ctx.mutex.Lock();
-			ctx.vblank_status.count++;
-			ctx.vblank_status.processTime = LibKernel::KernelGetProcessTime();
-			ctx.vblank_status.tsc         = LibKernel::KernelReadTsc();
+		uint64_t deadline = start + ns_to_ticks(n * VBLANK_PERIOD_NS);
 
-			for (auto& vblank_eq: ctx.vblank_eqs)
-			{
-				if (vblank_eq != nullptr)
-				{
-					auto result = EventQueue::KernelTriggerEvent(vblank_eq, VIDEO_OUT_EVENT_VBLANK, EventQueue::KERNEL_EVFILT_VIDEO_OUT,
-					                                             reinterpret_cast<void*>(ctx.vblank_status.count));
-					EXIT_NOT_IMPLEMENTED(result != OK);
-				}
-			}
-			ctx.mutex.Unlock();
+		Core::Timer::SleepUntil(deadline);
+
+		uint64_t now = Core::Timer::QueryPerformanceCounter();
+
+		Graphics::GpuCounterAdd(Graphics::GpuCounter::Vblanks);
+		Graphics::GpuCounterAdd(Graphics::GpuCounter::VblankJitterUs, (now - deadline) * 1000000 / freq);
+
+		ctx->VblankEnd();
+
+		if (uint64_t ahead = start + ns_to_ticks((n + 1) * VBLANK_PERIOD_NS); now > ahead)
+		{
+			n = ticks_to_ns(now - start) / VBLANK_PERIOD_NS;
 		}
 	}
 }
@@ -489,6 +555,28 @@ void FlipQueue::Wait(VideoOutConfig* cfg, int index)
 	}
 }
 
+// Present at most once per (flip_rate + 1) vblanks. The deadline advances by whole periods, so a late flip doesn't shift the
+// following ones, unless it is behind by more than a period.
+void FlipQueue::WaitFlipTime(const VideoOutConfig* cfg)
+{
+	EXIT_IF(cfg == nullptr);
+
+	uint64_t period = VBLANK_PERIOD_US * static_cast<uint64_t>(cfg->flip_rate + 1);
+	uint64_t now    = LibKernel::KernelGetProcessTime();
+
+	if (m_next_flip_time > now)
+	{
+		Core::Thread::SleepMicro(static_cast<uint32_t>(m_next_flip_time - now));
+		m_next_flip_time += period;
+	} else if (now - m_next_flip_time > period)
+	{
+		m_next_flip_time = now + period;
+	} else
+	{
+		m_next_flip_time += period;
+	}
+}
+
 bool FlipQueue::Flip(uint32_t micros)
 {
 	KYTY_PROFILER_BLOCK("FlipQueue::Flip");
@@ -510,6 +598,12 @@ bool FlipQueue::Flip(uint32_t micros)
 
 	auto* buffer = r.cfg->buffers[r.index].buffer_vulkan;
 
+	// Uncapped headless runs measure throughput, flips are done as soon as they are submitted
+	if (Config::FramePacingEnabled() && !(Config::HeadlessEnabled() && Config::HeadlessUncapped()))
+	{
+		WaitFlipTime(r.cfg);
+	}
+
 	Graphics::WindowDrawBuffer(buffer);
 
 	m_mutex.Lock();
@@ -543,8 +637,11 @@ bool FlipQueue::Flip(uint32_t micros)
 
 	m_mutex.Unlock();
 
-	Graphics::GpuMemoryFrameDone();
+	Graphics::GpuMemoryFrameDone(Graphics::WindowGetGraphicContext());
 	Graphics::GpuMemoryDbgDump();
+	Graphics::GpuCountersFrameDone();
+	Controller::ControllerFrameDone();
+	Profiler::BenchmarkFrame();
 
 	return true;
 }
@@ -577,7 +674,10 @@ void VideoOutEndVblank()
 {
 	EXIT_IF(g_video_out_context == nullptr);
 
-	g_video_out_context->VblankEnd();
+	if (!g_video_out_context->IsVblankTimerStarted())
+	{
+		g_video_out_context->VblankEnd();
+	}
 }
 
 KYTY_SYSV_ABI int VideoOutOpen(int user_id, int bus_type, int index, const void* param)
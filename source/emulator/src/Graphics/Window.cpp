@@ -2,6 +2,7 @@
 
 #include "Kyty/Core/Common.h"
 #include "Kyty/Core/DbgAssert.h"
+#include "Kyty/Core/MagicEnum.h"
 #include "Kyty/Core/SafeDelete.h"
 #include "Kyty/Core/String.h"
 #include "Kyty/Core/Subsystems.h"
@@ -10,13 +11,19 @@
 #include "Kyty/Core/Vector.h"
 #include "Kyty/Core/VirtualMemory.h"
 
+#include "Emulator/Benchmark.h"
 #include "Emulator/Config.h"
 #include "Emulator/Controller.h"
+#include "Emulator/Graphics/GpuCounters.h"
 #include "Emulator/Graphics/GraphicContext.h"
 #include "Emulator/Graphics/GraphicsRender.h"
 #include "Emulator/Graphics/Image.h"
+#include "Emulator/Graphics/Objects/GpuMemory.h"
 #include "Emulator/Graphics/Utils.h"
 #include "Emulator/Graphics/VideoOut.h"
+#include "Emulator/HleStats.h"
+#include "Emulator/Loader/Startup.h"
+#include "Emulator/Loader/Timer.h"
 #include "Emulator/Loader/SystemContent.h"
 #include "Emulator/Profiler.h"
 
@@ -36,6 +43,7 @@
 #include "SDL_vulkan.h"
 
 #include <algorithm>
+#include <atomic>
 #include <cstdlib>
 #include <string>
 #include <vulkan/vk_enum_string_helper.h>
@@ -51,8 +59,11 @@
 
 namespace Kyty::Libs::Graphics {
 
-constexpr float FPS_AVERAGE_FRAMES = 5.0f;
-constexpr float FPS_UPDATE_TIME    = 0.25f;
+constexpr float    FPS_AVERAGE_FRAMES    = 5.0f;
+constexpr float    FPS_UPDATE_TIME       = 0.25f;
+constexpr uint32_t GAME_PAUSE_SLEEP_MS   = 10;
+constexpr uint32_t GAME_EVENT_TIMEOUT_MS = 5;
+constexpr uint32_t HEADLESS_VBLANK_US    = 16667;
 
 struct EventKeyboard
 {
@@ -106,19 +117,20 @@ struct EventFinger
 
 struct EventController
 {
-	int    id;
-	int    button;
-	int    axis_id;
-	int    axis_value;
-	bool   down;
-	bool   up;
-	bool   added;
-	bool   removed;
-	bool   remapped;
-	bool   axis;
-	bool   pressed;
-	bool   released;
-	double timestamp_seconds;
+	int      id;
+	int      button;
+	int      axis_id;
+	int      axis_value;
+	bool     down;
+	bool     up;
+	bool     added;
+	bool     removed;
+	bool     remapped;
+	bool     axis;
+	bool     pressed;
+	bool       released;
+	double   timestamp_seconds;
+	uint64_t arrival_us; // process time when SDL queued the event
 };
 
 enum class DisplayOrientation
@@ -194,9 +206,12 @@ struct GameApiPrivateStruct
 {
 	GameApiPrivateStruct() = default;
 
-	Core::Mutex     mutex;
-	int             skip_frames = 0;
-	GraphicContext* ctx         = nullptr;
+	Core::Mutex        mutex;
+	int                skip_frames    = 0;
+	GraphicContext*    ctx            = nullptr;
+	const Core::Timer* timer          = nullptr;
+	Core::Thread*      present_thread = nullptr;
+	std::atomic_bool   present_stop   = false;
 };
 
 // void game_main_loop(GameApi* game);
@@ -205,6 +220,8 @@ GameApi* game_create_api();
 void     game_delete_api(GameApi* api);
 int      game_poll_event(GameApi* game);
 int      game_wait_event(GameApi* game);
+
+static void game_present_thread(void* data);
 void     game_process_event(GameApi* game, double time_s);
 
 struct VulkanExtensions
@@ -232,6 +249,7 @@ struct WindowContext
 	VulkanSwapchain*     swapchain            = nullptr;
 	SDL_Window*          window               = nullptr;
 	bool                 window_hidden        = true;
+	bool                 headless             = false;
 	VkSurfaceKHR         surface              = nullptr;
 	SurfaceCapabilities* surface_capabilities = nullptr;
 	GameApi*             game                 = nullptr;
@@ -242,10 +260,16 @@ struct WindowContext
 	Core::Mutex   mutex;
 	bool          graphic_initialized = false;
 	Core::CondVar graphic_initialized_condvar;
+
+	// Set by the present thread, SDL window calls are made by the main thread
+	std::atomic_bool frame_presented = false;
 };
 
 static WindowContext* g_window_ctx = nullptr;
 
+static void WindowUpdateIcon();
+static void WindowUpdateTitle();
+
 constexpr const char* KYTY_SDL_WINDOW_CAPTION = "Game";
 // constexpr uint32_t    KYTY_SDL_WINDOW_FLAGS       = (static_cast<uint32_t>(SDL_WINDOW_HIDDEN) |
 // static_cast<uint32_t>(SDL_WINDOW_OPENGL));
@@ -290,6 +314,11 @@ static void CalcFrameTime(GameApi* game, double game_time_s)
 			game->m_current_fps    = static_cast<double>(game->m_fps_frames_num) / (game->m_current_time_seconds - game->m_fps_start_time);
 			game->m_fps_frames_num = 0;
 			game->m_fps_start_time = game->m_current_time_seconds;
+
+			if (g_window_ctx != nullptr && g_window_ctx->headless)
+			{
+				printf("Headless: frame = %d, fps = %f\n", game->m_frame_num, game->m_current_fps);
+			}
 		}
 	} else
 	{
@@ -375,11 +404,16 @@ bool game_init(GameApi* game, const Core::Timer& timer, void* data)
 
 	CalcFrameTime(game, timer.GetTimeS());
 
+	pdata->timer          = &timer;
+	pdata->present_thread = new Core::Thread(game_present_thread, game);
+
 	return Init(game);
 }
 
 bool game_render_and_update(GameApi* game, const Core::Timer& /*timer*/)
 {
+	Controller::ControllerReplayUpdate();
+
 	return RenderAndUpdate(game);
 }
 
@@ -389,37 +423,120 @@ bool game_close(GameApi* game)
 
 	EXIT_IF(!game->data1 || !game->data2);
 
-	delete (static_cast<GameApiPrivateStruct*>(game->data1));
+	auto* p = static_cast<GameApiPrivateStruct*>(game->data1);
+
+	p->present_stop = true;
+	p->present_thread->Join();
+	delete p->present_thread;
+
+	delete p;
 	delete (static_cast<SDL_Event*>(game->data2));
 
 	return Close(game);
 }
 
-void game_show_window(GameApi* game, const Core::Timer& timer)
+// The deadline advances by whole periods, so a late vblank doesn't shift the following ones, unless it is behind by more than a period
+static void game_wait_vblank(double* next_vblank, double now)
 {
+	double period = HEADLESS_VBLANK_US / 1000000.0;
+
+	if (*next_vblank > now)
+	{
+		Core::Thread::SleepMicro(static_cast<uint32_t>((*next_vblank - now) * 1000000.0));
+		*next_vblank += period;
+	} else if (now - *next_vblank > period)
+	{
+		*next_vblank = now + period;
+	} else
+	{
+		*next_vblank += period;
+	}
+}
+
+// Acquires, blits and presents the flipped buffers, so a slow swapchain doesn't delay the event handling in game_main_loop
+static void game_present_thread(void* data)
+{
+	KYTY_PROFILER_THREAD("Thread_Present");
+
+	Profiler::BenchmarkThreadStart(U"Present");
+
+	auto* game = static_cast<GameApi*>(data);
+
 	EXIT_IF(!game);
 
 	auto* p = static_cast<GameApiPrivateStruct*>(game->data1);
 
 	EXIT_IF(!p);
+	EXIT_IF(!p->timer);
 
-	p->mutex.Lock();
+	// Headless: vblank is driven by a virtual clock instead of the swapchain. Uncapped, a vblank is signaled as soon as a flip is done.
+	bool   headless    = g_window_ctx->headless;
+	bool   uncapped    = headless && Config::HeadlessUncapped();
+	double next_vblank = 0.0;
+
+	while (!p->present_stop)
 	{
-		if (p->skip_frames > 0)
+		if (game->is_paused(game))
+		{
+			Core::Thread::Sleep(GAME_PAUSE_SLEEP_MS);
+			continue;
+		}
+
+		p->mutex.Lock();
+		bool skip = (p->skip_frames > 0);
+		if (skip)
 		{
 			p->skip_frames--;
 			printf("skip frame %d\n", p->skip_frames);
-		} else
+		}
+		p->mutex.Unlock();
+
+		if (!skip)
 		{
 			VideoOut::VideoOutBeginVblank();
-			if (VideoOut::VideoOutFlipWindow(100000))
+			if (VideoOut::VideoOutFlipWindow(headless ? HEADLESS_VBLANK_US : 100000))
 			{
-				CalcFrameTime(game, timer.GetTimeS());
+				p->mutex.Lock();
+				CalcFrameTime(game, p->timer->GetTimeS());
+				p->mutex.Unlock();
 			}
 			VideoOut::VideoOutEndVblank();
+
+			if (headless && !uncapped)
+			{
+				game_wait_vblank(&next_vblank, p->timer->GetTimeS());
+			}
 		}
 	}
-	p->mutex.Unlock();
+}
+
+void game_show_window(GameApi* game, const Core::Timer& /*timer*/)
+{
+	EXIT_IF(!game);
+	EXIT_IF(g_window_ctx == nullptr);
+
+	auto* p = static_cast<GameApiPrivateStruct*>(game->data1);
+
+	EXIT_IF(!p);
+
+	if (g_window_ctx->frame_presented.exchange(false) && !g_window_ctx->headless)
+	{
+		if (g_window_ctx->window_hidden)
+		{
+			WindowUpdateIcon();
+
+			SDL_ShowWindow(g_window_ctx->window);
+
+			g_window_ctx->window_hidden = false;
+		}
+
+		p->mutex.Lock();
+		WindowUpdateTitle();
+		p->mutex.Unlock();
+	}
+
+	// Presentation is done by the present thread, so just wait for the next event here
+	SDL_WaitEventTimeout(nullptr, GAME_EVENT_TIMEOUT_MS);
 }
 
 void game_event_quit(GameApi* game)
@@ -454,6 +571,11 @@ void game_event_keyboard(GameApi* game, const EventKeyboard* key)
 	{
 		SetPause(game, !game->m_game_is_paused);
 	}
+
+	if (key->down && key->key_code == SDLK_F9)
+	{
+		Profiler::HleStatsPrint();
+	}
 #endif
 }
 
@@ -557,7 +679,7 @@ void game_event_controller([[maybe_unused]] GameApi* game, [[maybe_unused]] cons
 		}
 		if (button != 0)
 		{
-			Controller::ControllerButton(f->id, button, f->down);
+			Controller::ControllerButton(f->id, button, f->down, f->arrival_us);
 		}
 	}
 
@@ -585,7 +707,7 @@ void game_event_controller([[maybe_unused]] GameApi* game, [[maybe_unused]] cons
 
 		if (axis != Controller::Axis::AxisMax)
 		{
-			Controller::ControllerAxis(f->id, axis, value);
+			Controller::ControllerAxis(f->id, axis, value, f->arrival_us);
 		}
 	}
 }
@@ -663,6 +785,14 @@ void game_event_resize(GameApi* game, uint32_t new_width, uint32_t new_height)
 	p->mutex.Unlock();
 }
 
+// Events wait in the SDL queue until the next frame, the SDL timestamp tells how long
+static uint64_t event_arrival_us(uint32_t sdl_timestamp_ms)
+{
+	uint64_t now = Loader::Timer::GetTimeUs();
+	uint64_t age = static_cast<uint64_t>(SDL_GetTicks() - sdl_timestamp_ms) * 1000;
+	return (age < now ? now - age : 0);
+}
+
 static void process_window_event(GameApi* game, SDL_WindowEvent window)
 {
 	switch (window.event)
@@ -1030,6 +1160,7 @@ void game_process_event(GameApi* game, double time_s)
 			c.pressed           = false;
 			c.released          = false;
 			c.timestamp_seconds = time_s;
+			c.arrival_us        = event_arrival_us(event->common.timestamp);
 
 			if (game->event_controller != nullptr)
 			{
@@ -1057,6 +1188,7 @@ void game_process_event(GameApi* game, double time_s)
 			c.pressed           = (event->cbutton.state == SDL_PRESSED);
 			c.released          = (event->cbutton.state == SDL_RELEASED);
 			c.timestamp_seconds = time_s;
+			c.arrival_us        = event_arrival_us(event->common.timestamp);
 
 			if (game->event_controller != nullptr)
 			{
@@ -1085,6 +1217,7 @@ void game_process_event(GameApi* game, double time_s)
 			c.pressed           = false;
 			c.released          = false;
 			c.timestamp_seconds = time_s;
+			c.arrival_us        = event_arrival_us(event->common.timestamp);
 
 			if (game->event_controller != nullptr)
 			{
@@ -1223,6 +1356,18 @@ static void WindowCreate(WindowContext* ctx)
 	int width  = static_cast<int>(ctx->graphic_ctx.screen_width);
 	int height = static_cast<int>(ctx->graphic_ctx.screen_height);
 
+	if (ctx->headless)
+	{
+		// Events and controllers still work without a display
+		if (SDL_InitSubSystem(SDL_INIT_GAMECONTROLLER) < 0)
+		{
+			EXIT("%s\n", SDL_GetError());
+		}
+
+		printf("WindowCreate(): headless, width = %d, height = %d\n", width, height);
+		return;
+	}
+
 	if (SDL_InitSubSystem(SDL_INIT_VIDEO | SDL_INIT_GAMECONTROLLER) < 0)
 	{
 		EXIT("%s\n", SDL_GetError());
@@ -1304,12 +1449,13 @@ static bool CheckFormat(VkPhysicalDevice device, VkFormat format, bool tile, VkF
 
 struct QueueInfo
 {
-	uint32_t family   = 0;
-	uint32_t index    = 0;
-	bool     graphics = false;
-	bool     compute  = false;
-	bool     transfer = false;
-	bool     present  = false;
+	uint32_t family     = 0;
+	uint32_t index      = 0;
+	bool     graphics   = false;
+	bool     compute    = false;
+	bool     transfer   = false;
+	bool     present    = false;
+	bool     timestamps = false;
 };
 
 struct VulkanQueues
@@ -1359,7 +1505,6 @@ static VulkanQueues VulkanFindQueues(VkPhysicalDevice device, VkSurfaceKHR surfa
                                      uint32_t transfer_num, uint32_t present_num)
 {
 	EXIT_IF(device == nullptr);
-	EXIT_IF(surface == nullptr);
 
 	VulkanQueues qs;
 
@@ -1374,7 +1519,14 @@ static VulkanQueues VulkanFindQueues(VkPhysicalDevice device, VkSurfaceKHR surfa
 	for (auto& f: queue_families)
 	{
 		VkBool32 presentation_supported = VK_FALSE;
-		vkGetPhysicalDeviceSurfaceSupportKHR(device, family, surface, &presentation_supported);
+		if (surface != nullptr)
+		{
+			vkGetPhysicalDeviceSurfaceSupportKHR(device, family, surface, &presentation_supported);
+		} else
+		{
+			// Headless: the present queue only blits to offscreen images
+			presentation_supported = ((f.queueFlags & VK_QUEUE_GRAPHICS_BIT) != 0 ? VK_TRUE : VK_FALSE);
+		}
 
 		printf("\tqueue family: %s [count = %u], [present = %s]\n", string_VkQueueFlags(f.queueFlags).c_str(), f.queueCount,
 		       (presentation_supported == VK_TRUE ? "true" : "false"));
@@ -1382,12 +1534,13 @@ static VulkanQueues VulkanFindQueues(VkPhysicalDevice device, VkSurfaceKHR surfa
 		for (uint32_t i = 0; i < f.queueCount; i++)
 		{
 			QueueInfo info;
-			info.family   = family;
-			info.index    = i;
-			info.graphics = (f.queueFlags & VK_QUEUE_GRAPHICS_BIT) != 0;
-			info.compute  = (f.queueFlags & VK_QUEUE_COMPUTE_BIT) != 0;
-			info.transfer = (f.queueFlags & VK_QUEUE_TRANSFER_BIT) != 0;
-			info.present  = (presentation_supported == VK_TRUE);
+			info.family     = family;
+			info.index      = i;
+			info.graphics   = (f.queueFlags & VK_QUEUE_GRAPHICS_BIT) != 0;
+			info.compute    = (f.queueFlags & VK_QUEUE_COMPUTE_BIT) != 0;
+			info.transfer   = (f.queueFlags & VK_QUEUE_TRANSFER_BIT) != 0;
+			info.present    = (presentation_supported == VK_TRUE);
+			info.timestamps = (f.timestampValidBits != 0);
 
 			qs.available.Add(info);
 		}
@@ -1409,7 +1562,13 @@ static VulkanQueues VulkanFindQueues(VkPhysicalDevice device, VkSurfaceKHR surfa
 
 	for (uint32_t i = 0; i < compute_num; i++)
 	{
-		if (auto index = qs.available.Find(true, [](auto& q, auto& b) { return q.compute == b; }); qs.available.IndexValid(index))
+		// Prefer queues of a compute-only family, they run asynchronously to the graphics queue
+		auto index = qs.available.Find(true, [](auto& q, auto& b) { return q.compute == b && !q.graphics; });
+		if (!qs.available.IndexValid(index))
+		{
+			index = qs.available.Find(true, [](auto& q, auto& b) { return q.compute == b; });
+		}
+		if (qs.available.IndexValid(index))
 		{
 			qs.family_used[qs.available.At(index).family]++;
 			qs.compute.Add(qs.available.At(index));
@@ -1445,7 +1604,6 @@ static void VulkanFindPhysicalDevice(VkInstance instance, VkSurfaceKHR surface,
                                      SurfaceCapabilities* out_capabilities, VkPhysicalDevice* out_device, VulkanQueues* out_queues)
 {
 	EXIT_IF(instance == nullptr);
-	EXIT_IF(surface == nullptr);
 	EXIT_IF(out_capabilities == nullptr);
 	EXIT_IF(out_device == nullptr);
 	EXIT_IF(out_queues == nullptr);
@@ -1468,9 +1626,13 @@ static void VulkanFindPhysicalDevice(VkInstance instance, VkSurfaceKHR surface,
 		VkPhysicalDeviceProperties device_properties {};
 		VkPhysicalDeviceFeatures2  device_features2 {};
 
+		VkPhysicalDeviceTimelineSemaphoreFeatures timeline_semaphore {};
+		timeline_semaphore.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES;
+		timeline_semaphore.pNext = nullptr;
+
 		VkPhysicalDeviceColorWriteEnableFeaturesEXT color_write_ext {};
 		color_write_ext.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_COLOR_WRITE_ENABLE_FEATURES_EXT;
-		color_write_ext.pNext = nullptr;
+		color_write_ext.pNext = &timeline_semaphore;
 
 		device_features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
 		device_features2.pNext = &color_write_ext;
@@ -1499,6 +1661,12 @@ static void VulkanFindPhysicalDevice(VkInstance instance, VkSurfaceKHR surface,
 			skip_device = true;
 		}
 
+		if (timeline_semaphore.timelineSemaphore != VK_TRUE)
+		{
+			printf("timelineSemaphore is not supported\n");
+			skip_device = true;
+		}
+
 		if (device_features2.features.fragmentStoresAndAtomics != VK_TRUE)
 		{
 			printf("fragmentStoresAndAtomics is not supported\n");
@@ -1545,7 +1713,7 @@ static void VulkanFindPhysicalDevice(VkInstance instance, VkSurfaceKHR surface,
 			}
 		}
 
-		if (!skip_device)
+		if (!skip_device && surface != nullptr)
 		{
 			VulkanGetSurfaceCapabilities(device, surface, out_capabilities);
 
@@ -1668,12 +1836,112 @@ static void VulkanFindPhysicalDevice(VkInstance instance, VkSurfaceKHR surface,
 	*out_queues = best_queues;
 }
 
-static VkDevice VulkanCreateDevice(VkPhysicalDevice physical_device, VkSurfaceKHR surface, const VulkanExtensions* r,
-                                   const VulkanQueues& queues, const Vector<const char*>& device_extensions)
+static bool VulkanCheckExtendedDynamicState(VkPhysicalDevice physical_device)
+{
+	EXIT_IF(physical_device == nullptr);
+
+	uint32_t extensions_count = 0;
+	vkEnumerateDeviceExtensionProperties(physical_device, nullptr, &extensions_count, nullptr);
+
+	Vector<VkExtensionProperties> available_extensions(extensions_count);
+	vkEnumerateDeviceExtensionProperties(physical_device, nullptr, &extensions_count, available_extensions.GetData());
+
+	if (!available_extensions.Contains(VK_EXT_EXTENDED_DYNAMIC_STATE_EXTENSION_NAME,
+	                                   [](auto p, auto ext) { return strcmp(p.extensionName, ext) == 0; }))
+	{
+		return false;
+	}
+
+	VkPhysicalDeviceExtendedDynamicStateFeaturesEXT dynamic_state_ext {};
+	dynamic_state_ext.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTENDED_DYNAMIC_STATE_FEATURES_EXT;
+	dynamic_state_ext.pNext = nullptr;
+
+	VkPhysicalDeviceFeatures2 device_features2 {};
+	device_features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+	device_features2.pNext = &dynamic_state_ext;
+
+	vkGetPhysicalDeviceFeatures2(physical_device, &device_features2);
+
+	return (dynamic_state_ext.extendedDynamicState == VK_TRUE);
+}
+
+static uint32_t VulkanCheckPushDescriptor(VkPhysicalDevice physical_device)
+{
+	EXIT_IF(physical_device == nullptr);
+
+	uint32_t extensions_count = 0;
+	vkEnumerateDeviceExtensionProperties(physical_device, nullptr, &extensions_count, nullptr);
+
+	Vector<VkExtensionProperties> available_extensions(extensions_count);
+	vkEnumerateDeviceExtensionProperties(physical_device, nullptr, &extensions_count, available_extensions.GetData());
+
+	if (!available_extensions.Contains(VK_KHR_PUSH_DESCRIPTOR_EXTENSION_NAME,
+	                                   [](auto p, auto ext) { return strcmp(p.extensionName, ext) == 0; }))
+	{
+		return 0;
+	}
+
+	VkPhysicalDevicePushDescriptorPropertiesKHR push_descriptor {};
+	push_descriptor.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PUSH_DESCRIPTOR_PROPERTIES_KHR;
+	push_descriptor.pNext = nullptr;
+
+	VkPhysicalDeviceProperties2 device_properties2 {};
+	device_properties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+	device_properties2.pNext = &push_descriptor;
+
+	vkGetPhysicalDeviceProperties2(physical_device, &device_properties2);
+
+	return push_descriptor.maxPushDescriptors;
+}
+
+static uint64_t VulkanCheckExternalMemoryHost(VkPhysicalDevice physical_device)
+{
+	EXIT_IF(physical_device == nullptr);
+
+	uint32_t extensions_count = 0;
+	vkEnumerateDeviceExtensionProperties(physical_device, nullptr, &extensions_count, nullptr);
+
+	Vector<VkExtensionProperties> available_extensions(extensions_count);
+	vkEnumerateDeviceExtensionProperties(physical_device, nullptr, &extensions_count, available_extensions.GetData());
+
+	if (!available_extensions.Contains(VK_EXT_EXTERNAL_MEMORY_HOST_EXTENSION_NAME,
+	                                   [](auto p, auto ext) { return strcmp(p.extensionName, ext) == 0; }))
+	{
+		return 0;
+	}
+
+	VkPhysicalDeviceExternalMemoryHostPropertiesEXT memory_host {};
+	memory_host.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTERNAL_MEMORY_HOST_PROPERTIES_EXT;
+	memory_host.pNext = nullptr;
+
+	VkPhysicalDeviceProperties2 device_properties2 {};
+	device_properties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+	device_properties2.pNext = &memory_host;
+
+	vkGetPhysicalDeviceProperties2(physical_device, &device_properties2);
+
+	return memory_host.minImportedHostPointerAlignment;
+}
+
+static bool VulkanCheckMemoryBudget(VkPhysicalDevice physical_device)
+{
+	EXIT_IF(physical_device == nullptr);
+
+	uint32_t extensions_count = 0;
+	vkEnumerateDeviceExtensionProperties(physical_device, nullptr, &extensions_count, nullptr);
+
+	Vector<VkExtensionProperties> available_extensions(extensions_count);
+	vkEnumerateDeviceExtensionProperties(physical_device, nullptr, &extensions_count, available_extensions.GetData());
+
+	return available_extensions.Contains(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME,
+	                                     [](auto p, auto ext) { return strcmp(p.extensionName, ext) == 0; });
+}
+
+static VkDevice VulkanCreateDevice(VkPhysicalDevice physical_device, VkSurfaceKHR /*surface*/, const VulkanExtensions* r,
+                                   const VulkanQueues& queues, const Vector<const char*>& device_extensions, bool extended_dynamic_state)
 {
 	EXIT_IF(physical_device == nullptr);
 	EXIT_IF(r == nullptr);
-	EXIT_IF(surface == nullptr);
 
 	Vector<VkDeviceQueueCreateInfo> queue_create_info(queues.family_count);
 	Vector<Vector<float>>           queue_priority(queues.family_count);
@@ -1704,9 +1972,19 @@ static VkDevice VulkanCreateDevice(VkPhysicalDevice physical_device, VkSurfaceKH
 	device_features.samplerAnisotropy        = VK_TRUE;
 	// device_features.shaderImageGatherExtended = VK_TRUE;
 
+	VkPhysicalDeviceExtendedDynamicStateFeaturesEXT dynamic_state_ext {};
+	dynamic_state_ext.sType                = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTENDED_DYNAMIC_STATE_FEATURES_EXT;
+	dynamic_state_ext.pNext                = nullptr;
+	dynamic_state_ext.extendedDynamicState = VK_TRUE;
+
+	VkPhysicalDeviceTimelineSemaphoreFeatures timeline_semaphore {};
+	timeline_semaphore.sType             = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES;
+	timeline_semaphore.pNext             = (extended_dynamic_state ? &dynamic_state_ext : nullptr);
+	timeline_semaphore.timelineSemaphore = VK_TRUE;
+
 	VkPhysicalDeviceColorWriteEnableFeaturesEXT color_write_ext {};
 	color_write_ext.sType            = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_COLOR_WRITE_ENABLE_FEATURES_EXT;
-	color_write_ext.pNext            = nullptr;
+	color_write_ext.pNext            = &timeline_semaphore;
 	color_write_ext.colorWriteEnable = VK_TRUE;
 
 	VkDeviceCreateInfo create_info {};
@@ -1728,28 +2006,31 @@ static VkDevice VulkanCreateDevice(VkPhysicalDevice physical_device, VkSurfaceKH
 	return device;
 }
 
+// window is nullptr in headless mode, no surface extensions are needed then
 static void VulkanGetExtensions(SDL_Window* window, VulkanExtensions* r)
 {
-	EXIT_IF(window == nullptr);
 	EXIT_IF(r == nullptr);
 
 	uint32_t required_extensions_count  = 0;
 	uint32_t available_extensions_count = 0;
 	uint32_t available_layers_count     = 0;
 
-	auto sdl_result = SDL_Vulkan_GetInstanceExtensions(window, &required_extensions_count, nullptr);
+	if (window != nullptr)
+	{
+		auto sdl_result = SDL_Vulkan_GetInstanceExtensions(window, &required_extensions_count, nullptr);
 
-	EXIT_NOT_IMPLEMENTED(sdl_result == SDL_FALSE);
-	EXIT_NOT_IMPLEMENTED(required_extensions_count == 0);
+		EXIT_NOT_IMPLEMENTED(sdl_result == SDL_FALSE);
+		EXIT_NOT_IMPLEMENTED(required_extensions_count == 0);
 
-	r->required_extensions = Vector<const char*>(required_extensions_count, false); // @suppress("Ambiguous problem")
-	r->required_extensions.Memset(0);
+		r->required_extensions = Vector<const char*>(required_extensions_count, false); // @suppress("Ambiguous problem")
+		r->required_extensions.Memset(0);
 
-	sdl_result = SDL_Vulkan_GetInstanceExtensions(window, &required_extensions_count, r->required_extensions.GetData());
+		sdl_result = SDL_Vulkan_GetInstanceExtensions(window, &required_extensions_count, r->required_extensions.GetData());
 
-	EXIT_NOT_IMPLEMENTED(sdl_result == SDL_FALSE);
-	EXIT_NOT_IMPLEMENTED(required_extensions_count == 0);
-	EXIT_NOT_IMPLEMENTED(required_extensions_count != r->required_extensions.Size());
+		EXIT_NOT_IMPLEMENTED(sdl_result == SDL_FALSE);
+		EXIT_NOT_IMPLEMENTED(required_extensions_count == 0);
+		EXIT_NOT_IMPLEMENTED(required_extensions_count != r->required_extensions.Size());
+	}
 
 	vkEnumerateInstanceExtensionProperties(nullptr, &available_extensions_count, nullptr);
 
@@ -1934,7 +2215,31 @@ static VKAPI_ATTR VkResult VKAPI_CALL VulkanCreateDebugUtilsMessengerEXT(VkInsta
 	extent.width  = std::clamp(width, r->capabilities.minImageExtent.width, r->capabilities.maxImageExtent.width);
 	extent.height = std::clamp(height, r->capabilities.minImageExtent.height, r->capabilities.maxImageExtent.height);
 
-	image_count = std::clamp(image_count, r->capabilities.minImageCount, r->capabilities.maxImageCount);
+	// maxImageCount is 0 if there is no limit
+	image_count = std::max(image_count, r->capabilities.minImageCount);
+	if (r->capabilities.maxImageCount != 0)
+	{
+		image_count = std::min(image_count, r->capabilities.maxImageCount);
+	}
+
+	VkPresentModeKHR present_mode = VK_PRESENT_MODE_FIFO_KHR;
+	switch (Config::GetPresentMode())
+	{
+		case Config::PresentMode::Fifo: present_mode = VK_PRESENT_MODE_FIFO_KHR; break;
+		case Config::PresentMode::FifoRelaxed: present_mode = VK_PRESENT_MODE_FIFO_RELAXED_KHR; break;
+		case Config::PresentMode::Mailbox: present_mode = VK_PRESENT_MODE_MAILBOX_KHR; break;
+		case Config::PresentMode::Immediate: present_mode = VK_PRESENT_MODE_IMMEDIATE_KHR; break;
+		default: EXIT("unknown present mode: %d\n", static_cast<int>(Config::GetPresentMode()));
+	}
+
+	// FIFO is the only mode which is always supported
+	if (!r->present_modes.Contains(present_mode))
+	{
+		printf("Present mode %s is not supported, FIFO is used\n", Core::EnumName(Config::GetPresentMode()).C_Str());
+		present_mode = VK_PRESENT_MODE_FIFO_KHR;
+	}
+
+	printf("Swapchain: present mode = %d, image count = %u\n", static_cast<int>(present_mode), image_count);
 
 	VkSwapchainCreateInfoKHR create_info {};
 	create_info.sType         = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR;
@@ -1965,7 +2270,7 @@ static VKAPI_ATTR VkResult VKAPI_CALL VulkanCreateDebugUtilsMessengerEXT(VkInsta
 	create_info.pQueueFamilyIndices   = nullptr;
 	create_info.preTransform          = r->capabilities.currentTransform;
 	create_info.compositeAlpha        = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
-	create_info.presentMode           = VK_PRESENT_MODE_FIFO_KHR;
+	create_info.presentMode           = present_mode;
 	create_info.clipped               = VK_TRUE;
 	create_info.oldSwapchain          = nullptr;
 
@@ -2017,17 +2322,14 @@ static void VulkanCreateQueues(GraphicContext* ctx, const VulkanQueues& queues)
 	EXIT_IF(queues.present.Size() != 1);
 	EXIT_IF(!(queues.compute.Size() >= 1 && queues.compute.Size() <= GraphicContext::QUEUE_COMPUTE_NUM));
 
-	auto get_queue = [ctx](int id, const QueueInfo& info, bool with_mutex = false)
+	auto get_queue = [ctx](int id, const QueueInfo& info)
 	{
-		ctx->queues[id].family = info.family;
-		ctx->queues[id].index  = info.index;
+		ctx->queues[id].family     = info.family;
+		ctx->queues[id].index      = info.index;
+		ctx->queues[id].timestamps = info.timestamps;
 		EXIT_IF(ctx->queues[id].vk_queue != nullptr);
 		vkGetDeviceQueue(ctx->device, ctx->queues[id].family, ctx->queues[id].index, &ctx->queues[id].vk_queue);
 		EXIT_NOT_IMPLEMENTED(ctx->queues[id].vk_queue == nullptr);
-		if (with_mutex)
-		{
-			ctx->queues[id].mutex = new Core::Mutex;
-		}
 	};
 
 	get_queue(GraphicContext::QUEUE_GFX, queues.graphics.At(0));
@@ -2036,8 +2338,26 @@ static void VulkanCreateQueues(GraphicContext* ctx, const VulkanQueues& queues)
 
 	for (int id = 0; id < GraphicContext::QUEUE_COMPUTE_NUM; id++)
 	{
-		bool with_mutex = (GraphicContext::QUEUE_COMPUTE_NUM == queues.compute.Size());
-		get_queue(GraphicContext::QUEUE_COMPUTE_START + id, queues.compute.At(id % queues.compute.Size()), with_mutex);
+		get_queue(GraphicContext::QUEUE_COMPUTE_START + id, queues.compute.At(id % queues.compute.Size()));
+	}
+
+	// Slots that map to the same Vulkan queue share one mutex, slots with a queue of their own don't need any
+	for (int id = 0; id < GraphicContext::QUEUES_NUM; id++)
+	{
+		auto& q = ctx->queues[id];
+		for (int prev_id = 0; prev_id < id; prev_id++)
+		{
+			auto& prev = ctx->queues[prev_id];
+			if (prev.family == q.family && prev.index == q.index)
+			{
+				if (prev.mutex == nullptr)
+				{
+					prev.mutex = new Core::Mutex;
+				}
+				q.mutex = prev.mutex;
+				break;
+			}
+		}
 	}
 }
 
@@ -2081,9 +2401,65 @@ static VulkanSwapchain* VulkanCreateSwapchain(GraphicContext* ctx, uint32_t imag
 	return s;
 }
 
+// Headless: the swapchain images are plain images the flipped buffers are blitted to, nothing is presented
+static VulkanSwapchain* VulkanCreateOffscreenSwapchain(GraphicContext* ctx, uint32_t image_count)
+{
+	EXIT_IF(ctx == nullptr);
+	EXIT_IF(ctx->screen_width == 0);
+	EXIT_IF(ctx->screen_height == 0);
+
+	image_count = std::max(image_count, 1u);
+
+	auto* s = new VulkanSwapchain;
+
+	s->swapchain_format        = VK_FORMAT_B8G8R8A8_UNORM;
+	s->swapchain_extent.width  = ctx->screen_width;
+	s->swapchain_extent.height = ctx->screen_height;
+	s->swapchain_images_count  = image_count;
+	s->swapchain_images        = new VkImage[image_count];
+	s->current_index           = static_cast<uint32_t>(-1);
+
+	for (uint32_t i = 0; i < image_count; i++)
+	{
+		VkImageCreateInfo image_info {};
+		image_info.sType         = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+		image_info.pNext         = nullptr;
+		image_info.flags         = 0;
+		image_info.imageType     = VK_IMAGE_TYPE_2D;
+		image_info.extent.width  = s->swapchain_extent.width;
+		image_info.extent.height = s->swapchain_extent.height;
+		image_info.extent.depth  = 1;
+		image_info.mipLevels     = 1;
+		image_info.arrayLayers   = 1;
+		image_info.format        = s->swapchain_format;
+		image_info.tiling        = VK_IMAGE_TILING_OPTIMAL;
+		image_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		image_info.usage         = VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+		image_info.sharingMode   = VK_SHARING_MODE_EXCLUSIVE;
+		image_info.samples       = VK_SAMPLE_COUNT_1_BIT;
+
+		s->swapchain_images[i] = nullptr;
+		vkCreateImage(ctx->device, &image_info, nullptr, &s->swapchain_images[i]);
+		EXIT_NOT_IMPLEMENTED(s->swapchain_images[i] == nullptr);
+
+		VulkanMemory mem;
+		vkGetImageMemoryRequirements(ctx->device, s->swapchain_images[i], &mem.requirements);
+		mem.property = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+
+		bool allocated = VulkanAllocate(ctx, &mem);
+		EXIT_NOT_IMPLEMENTED(!allocated);
+
+		vkBindImageMemory(ctx->device, s->swapchain_images[i], mem.memory, mem.offset);
+	}
+
+	printf("Offscreen swapchain: image count = %u\n", image_count);
+
+	return s;
+}
+
 static void VulkanCreate(WindowContext* ctx)
 {
-	EXIT_IF(ctx->window == nullptr);
+	EXIT_IF(ctx->window == nullptr && !ctx->headless);
 	EXIT_IF(ctx->graphic_ctx.instance != nullptr);
 	EXIT_IF(ctx->graphic_ctx.physical_device != nullptr);
 	EXIT_IF(ctx->graphic_ctx.device != nullptr);
@@ -2171,13 +2547,18 @@ static void VulkanCreate(WindowContext* ctx)
 		}
 	}
 
-	if (SDL_Vulkan_CreateSurface(ctx->window, ctx->graphic_ctx.instance, &ctx->surface) == SDL_FALSE)
+	Vector<const char*> device_extensions = {VK_EXT_DEPTH_CLIP_ENABLE_EXTENSION_NAME, VK_EXT_COLOR_WRITE_ENABLE_EXTENSION_NAME,
+	                                         "VK_KHR_maintenance1"};
+
+	if (!ctx->headless)
 	{
-		EXIT("Could not create a Vulkan surface");
-	}
+		if (SDL_Vulkan_CreateSurface(ctx->window, ctx->graphic_ctx.instance, &ctx->surface) == SDL_FALSE)
+		{
+			EXIT("Could not create a Vulkan surface");
+		}
 
-	Vector<const char*> device_extensions = {VK_KHR_SWAPCHAIN_EXTENSION_NAME, VK_EXT_DEPTH_CLIP_ENABLE_EXTENSION_NAME,
-	                                         VK_EXT_COLOR_WRITE_ENABLE_EXTENSION_NAME, "VK_KHR_maintenance1"};
+		device_extensions.Add(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
+	}
 
 #ifdef KYTY_ENABLE_DEBUG_PRINTF
 	if (Config::SpirvDebugPrintfEnabled())
@@ -2203,10 +2584,60 @@ static void VulkanCreate(WindowContext* ctx)
 
 	printf("Select device: %s\n", device_properties.deviceName);
 
+	ctx->graphic_ctx.timestamp_period   = device_properties.limits.timestampPeriod;
+	ctx->graphic_ctx.push_constants_max = device_properties.limits.maxPushConstantsSize;
+	ctx->graphic_ctx.uniform_alignment  = device_properties.limits.minUniformBufferOffsetAlignment;
+
+	// Optional: moves cull mode, front face, topology and depth/stencil state out of the pipeline key
+	ctx->graphic_ctx.extended_dynamic_state = VulkanCheckExtendedDynamicState(ctx->graphic_ctx.physical_device);
+	if (ctx->graphic_ctx.extended_dynamic_state)
+	{
+		device_extensions.Add(VK_EXT_EXTENDED_DYNAMIC_STATE_EXTENSION_NAME);
+	}
+
+	printf("Extended dynamic state: %s\n", ctx->graphic_ctx.extended_dynamic_state ? "true" : "false");
+
+	// Optional: descriptors are written into the command buffer instead of allocated sets
+	if (Config::PushDescriptorsEnabled())
+	{
+		ctx->graphic_ctx.max_push_descriptors = VulkanCheckPushDescriptor(ctx->graphic_ctx.physical_device);
+		if (ctx->graphic_ctx.max_push_descriptors != 0)
+		{
+			device_extensions.Add(VK_KHR_PUSH_DESCRIPTOR_EXTENSION_NAME);
+		}
+	}
+
+	printf("Max push descriptors: %u\n", ctx->graphic_ctx.max_push_descriptors);
+
+	// Optional: aligned guest buffers are imported as device memory instead of being copied
+	if (Config::HostMemoryImportEnabled())
+	{
+		ctx->graphic_ctx.host_import_alignment = VulkanCheckExternalMemoryHost(ctx->graphic_ctx.physical_device);
+		if (ctx->graphic_ctx.host_import_alignment != 0)
+		{
+			device_extensions.Add(VK_EXT_EXTERNAL_MEMORY_HOST_EXTENSION_NAME);
+		}
+	}
+
+	printf("Host memory import alignment: 0x%016" PRIx64 "\n", ctx->graphic_ctx.host_import_alignment);
+
+	// Optional: least recently used objects are evicted when the device memory usage gets close to the budget
+	if (Config::GpuMemoryBudgetEnabled())
+	{
+		ctx->graphic_ctx.memory_budget = VulkanCheckMemoryBudget(ctx->graphic_ctx.physical_device);
+		if (ctx->graphic_ctx.memory_budget)
+		{
+			device_extensions.Add(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+		}
+	}
+
+	printf("Memory budget: %s\n", ctx->graphic_ctx.memory_budget ? "true" : "false");
+
 	memcpy(ctx->device_name, device_properties.deviceName, sizeof(ctx->device_name));
 	memcpy(ctx->processor_name, Core::GetSystemInfo().ProcessorName.C_Str(), sizeof(ctx->processor_name));
 
-	ctx->graphic_ctx.device = VulkanCreateDevice(ctx->graphic_ctx.physical_device, ctx->surface, &r, queues, device_extensions);
+	ctx->graphic_ctx.device = VulkanCreateDevice(ctx->graphic_ctx.physical_device, ctx->surface, &r, queues, device_extensions,
+	                                             ctx->graphic_ctx.extended_dynamic_state);
 	if (ctx->graphic_ctx.device == nullptr)
 	{
 		EXIT("Could not create device");
@@ -2214,7 +2645,8 @@ static void VulkanCreate(WindowContext* ctx)
 
 	VulkanCreateQueues(&ctx->graphic_ctx, queues);
 
-	ctx->swapchain = VulkanCreateSwapchain(&ctx->graphic_ctx, 2);
+	ctx->swapchain = (ctx->headless ? VulkanCreateOffscreenSwapchain(&ctx->graphic_ctx, Config::GetSwapchainImageCount())
+	                                : VulkanCreateSwapchain(&ctx->graphic_ctx, Config::GetSwapchainImageCount()));
 }
 
 void WindowInit(uint32_t width, uint32_t height)
@@ -2226,6 +2658,7 @@ void WindowInit(uint32_t width, uint32_t height)
 
 	g_window_ctx->graphic_ctx.screen_width  = width;
 	g_window_ctx->graphic_ctx.screen_height = height;
+	g_window_ctx->headless                  = Config::HeadlessEnabled();
 }
 
 void WindowWaitForGraphicInitialized()
@@ -2253,8 +2686,14 @@ void WindowRun()
 	{
 		EXIT_IF(g_window_ctx->graphic_initialized);
 
-		WindowCreate(g_window_ctx);
-		VulkanCreate(g_window_ctx);
+		{
+			Loader::StartupPhase phase("window_create");
+			WindowCreate(g_window_ctx);
+		}
+		{
+			Loader::StartupPhase phase("vulkan_create");
+			VulkanCreate(g_window_ctx);
+		}
 		api = game_create_api();
 
 		g_window_ctx->game = api;
@@ -2291,7 +2730,7 @@ GraphicContext* WindowGetGraphicContext()
 	return &g_window_ctx->graphic_ctx;
 }
 
-void WindowUpdateIcon()
+static void WindowUpdateIcon()
 {
 	EXIT_IF(g_window_ctx == nullptr);
 
@@ -2303,7 +2742,7 @@ void WindowUpdateIcon()
 	}
 }
 
-void WindowUpdateTitle()
+static void WindowUpdateTitle()
 {
 	EXIT_IF(g_window_ctx == nullptr);
 	EXIT_IF(g_window_ctx->game == nullptr);
@@ -2320,9 +2759,37 @@ void WindowUpdateTitle()
 	                              (has_app_ver ? ", " : ""), g_window_ctx->device_name, g_window_ctx->processor_name,
 	                              g_window_ctx->game->m_frame_num, g_window_ctx->game->m_current_fps);
 
+	auto counters = GpuCountersGetText();
+
+	if (!counters.IsEmpty())
+	{
+		fps += U" | " + counters;
+	}
+
 	SDL_SetWindowTitle(g_window_ctx->window, fps.C_Str());
 }
 
+// Headless: the blit is still done, so a frame costs the same GPU work as with a window
+static void WindowDrawOffscreen(VideoOutVulkanImage* image)
+{
+	auto* swapchain = g_window_ctx->swapchain;
+
+	swapchain->current_index = (swapchain->current_index + 1) % swapchain->swapchain_images_count;
+
+	CommandBuffer buffer(GraphicContext::QUEUE_PRESENT);
+
+	EXIT_NOT_IMPLEMENTED(buffer.IsInvalid());
+
+	buffer.Begin();
+	UtilBlitImage(&buffer, image, swapchain);
+	buffer.End();
+	buffer.Execute();
+
+	g_window_ctx->frame_presented = true;
+
+	Loader::StartupFirstFlip();
+}
+
 void WindowDrawBuffer(VideoOutVulkanImage* image)
 {
 	KYTY_PROFILER_FUNCTION();
@@ -2331,13 +2798,10 @@ void WindowDrawBuffer(VideoOutVulkanImage* image)
 	EXIT_IF(g_window_ctx == nullptr);
 	EXIT_IF(g_window_ctx->swapchain == nullptr);
 
-	if (g_window_ctx->window_hidden)
+	if (g_window_ctx->headless)
 	{
-		WindowUpdateIcon();
-
-		SDL_ShowWindow(g_window_ctx->window);
-
-		g_window_ctx->window_hidden = false;
+		WindowDrawOffscreen(image);
+		return;
 	}
 
 	g_window_ctx->swapchain->current_index = static_cast<uint32_t>(-1);
@@ -2407,12 +2871,23 @@ void WindowDrawBuffer(VideoOutVulkanImage* image)
 
 	const auto& queue = g_window_ctx->graphic_ctx.queues[GraphicContext::QUEUE_PRESENT];
 
-	EXIT_IF(queue.mutex != nullptr);
+	if (queue.mutex != nullptr)
+	{
+		queue.mutex->Lock();
+	}
 
 	result = vkQueuePresentKHR(queue.vk_queue, &present);
+
+	if (queue.mutex != nullptr)
+	{
+		queue.mutex->Unlock();
+	}
+
 	EXIT_NOT_IMPLEMENTED(result != VK_SUCCESS);
 
-	WindowUpdateTitle();
+	g_window_ctx->frame_presented = true;
+
+	Loader::StartupFirstFlip();
 }
 
 } // namespace Kyty::Libs::Graphics
@@ -0,0 +1,225 @@
+#include "Emulator/HleStats.h"
+
+#include "Kyty/Core/DbgAssert.h"
+#include "Kyty/Core/String.h"
+#include "Kyty/Core/Threads.h"
+#include "Kyty/Core/Vector.h"
+#include "Kyty/Core/VirtualMemory.h"
+
+#include "Emulator/Config.h"
+#include "Emulator/Loader/Jit.h"
+#include "Emulator/Loader/Timer.h"
+
+#include <atomic>
+#include <new>
+
+#ifdef KYTY_EMU_ENABLED
+
+namespace Kyty::Profiler {
+
+constexpr int      HLE_STATS_DEPTH_MAX  = 64;
+constexpr uint64_t HLE_STATS_CODE_CHUNK = 64 * 1024;
+
+struct HleStatsEntry
+{
+	const char*          library  = nullptr;
+	const char*          name     = nullptr;
+	const char32_t*      dbg_name = nullptr;
+	std::atomic_uint64_t calls    = 0;
+	std::atomic_uint64_t ticks    = 0;
+	std::atomic_uint64_t max      = 0;
+};
+
+struct HleStatsFrame
+{
+	uint64_t*      ret_slot;
+	uint64_t       ret;
+	uint64_t       start;
+	HleStatsEntry* entry;
+};
+
+struct HleStatsThread
+{
+	HleStatsFrame frames[HLE_STATS_DEPTH_MAX];
+	int           depth = 0;
+};
+
+struct HleStats
+{
+	Core::Mutex            mutex {"HleStats"};
+	Vector<HleStatsEntry*> entries;
+	uint64_t               return_stub = 0;
+	uint64_t               code_vaddr  = 0;
+	uint64_t               code_size   = 0;
+};
+
+static HleStats*                   g_hle_stats = nullptr;
+static thread_local HleStatsThread g_hle_stats_thread;
+
+static uint64_t alloc_code(uint64_t size)
+{
+	if (g_hle_stats->code_size < size)
+	{
+		g_hle_stats->code_vaddr = Core::VirtualMemory::Alloc(0, HLE_STATS_CODE_CHUNK, Core::VirtualMemory::Mode::ExecuteReadWrite);
+		g_hle_stats->code_size  = HLE_STATS_CODE_CHUNK;
+		EXIT_NOT_IMPLEMENTED(g_hle_stats->code_vaddr == 0);
+	}
+
+	uint64_t vaddr = g_hle_stats->code_vaddr;
+
+	g_hle_stats->code_vaddr += size;
+	g_hle_stats->code_size -= size;
+
+	return vaddr;
+}
+
+// Called by the thunk with the arguments of the function saved
+static KYTY_SYSV_ABI void hle_stats_enter(void* entry, uint64_t* ret_slot)
+{
+	auto& t = g_hle_stats_thread;
+
+	// Frames at or below the new one were left by a longjmp or by a function which didn't return
+	while (t.depth > 0 && t.frames[t.depth - 1].ret_slot <= ret_slot)
+	{
+		t.depth--;
+	}
+
+	EXIT_NOT_IMPLEMENTED(t.depth >= HLE_STATS_DEPTH_MAX);
+
+	auto& f    = t.frames[t.depth++];
+	f.ret_slot = ret_slot;
+	f.ret      = *ret_slot;
+	f.entry    = static_cast<HleStatsEntry*>(entry);
+	f.start    = Loader::Timer::GetTsc();
+
+	*ret_slot = g_hle_stats->return_stub;
+}
+
+// Called by the return stub with the return value saved
+static KYTY_SYSV_ABI uint64_t hle_stats_leave(uint64_t* ret_slot)
+{
+	uint64_t end = Loader::Timer::GetTsc();
+
+	auto& t = g_hle_stats_thread;
+
+	while (t.depth > 0 && t.frames[t.depth - 1].ret_slot < ret_slot)
+	{
+		t.depth--;
+	}
+
+	EXIT_IF(t.depth == 0 || t.frames[t.depth - 1].ret_slot != ret_slot);
+
+	const auto& f     = t.frames[--t.depth];
+	uint64_t    ticks = end - f.start;
+
+	f.entry->calls.fetch_add(1, std::memory_order_relaxed);
+	f.entry->ticks.fetch_add(ticks, std::memory_order_relaxed);
+
+	uint64_t max = f.entry->max.load(std::memory_order_relaxed);
+	while (ticks > max && !f.entry->max.compare_exchange_weak(max, ticks, std::memory_order_relaxed))
+	{
+	}
+
+	return f.ret;
+}
+
+void HleStatsInit()
+{
+	EXIT_IF(g_hle_stats != nullptr);
+
+	if (!Config::HleStatsEnabled())
+	{
+		return;
+	}
+
+	g_hle_stats = new HleStats;
+
+	Core::LockGuard lock(g_hle_stats->mutex);
+
+	auto  vaddr = alloc_code(Loader::Jit::CallStatsReturn::GetSize());
+	auto* code  = new (reinterpret_cast<void*>(vaddr)) Loader::Jit::CallStatsReturn;
+	code->SetLeave(hle_stats_leave);
+	Core::VirtualMemory::FlushInstructionCache(vaddr, Loader::Jit::CallStatsReturn::GetSize());
+
+	g_hle_stats->return_stub = vaddr;
+}
+
+uint64_t HleStatsWrap(uint64_t func, const char* library, const char* name, const char32_t* dbg_name)
+{
+	if (g_hle_stats == nullptr)
+	{
+		return func;
+	}
+
+	Core::LockGuard lock(g_hle_stats->mutex);
+
+	auto* entry     = new HleStatsEntry;
+	entry->library  = library;
+	entry->name     = name;
+	entry->dbg_name = dbg_name;
+
+	g_hle_stats->entries.Add(entry);
+
+	auto  vaddr = alloc_code(Loader::Jit::CallStats::GetSize());
+	auto* code  = new (reinterpret_cast<void*>(vaddr)) Loader::Jit::CallStats;
+	code->SetEntry(entry);
+	code->SetEnter(hle_stats_enter);
+	code->SetFunc(func);
+	Core::VirtualMemory::FlushInstructionCache(vaddr, Loader::Jit::CallStats::GetSize());
+
+	return vaddr;
+}
+
+void HleStatsPrint()
+{
+	if (g_hle_stats == nullptr)
+	{
+		return;
+	}
+
+	struct Row
+	{
+		const HleStatsEntry* entry;
+		uint64_t             calls;
+		uint64_t             ticks;
+		uint64_t             max;
+	};
+
+	Vector<Row> rows;
+	uint64_t    calls = 0;
+	uint64_t    ticks = 0;
+
+	{
+		Core::LockGuard lock(g_hle_stats->mutex);
+
+		for (const auto* e: g_hle_stats->entries)
+		{
+			Row r {e, e->calls.load(std::memory_order_relaxed), e->ticks.load(std::memory_order_relaxed),
+			       e->max.load(std::memory_order_relaxed)};
+			if (r.calls != 0)
+			{
+				calls += r.calls;
+				ticks += r.ticks;
+				rows.Add(r);
+			}
+		}
+	}
+
+	rows.Sort([](const Row& a, const Row& b) { return a.ticks > b.ticks; });
+
+	double us = 1000000.0 / static_cast<double>(Loader::Timer::GetTscFrequency());
+
+	printf("HLE calls: %" PRIu64 ", %.3f ms, %u functions\n", calls, static_cast<double>(ticks) * us / 1000.0, rows.Size());
+	printf("%12s %12s %10s %10s  %s\n", "calls", "total ms", "avg us", "max us", "function");
+
+	for (const auto& r: rows)
+	{
+		printf("%12" PRIu64 " %12.3f %10.3f %10.3f  %s::%s [%s]\n", r.calls, static_cast<double>(r.ticks) * us / 1000.0,
+		       static_cast<double>(r.ticks) * us / static_cast<double>(r.calls), static_cast<double>(r.max) * us, r.entry->library,
+		       String(r.entry->dbg_name).C_Str(), r.entry->name);
+	}
+}
+
+} // namespace Kyty::Profiler
+
+#endif // KYTY_EMU_ENABLED
@@ -9,6 +9,8 @@
 #include "Emulator/Libs/Errno.h"
 #include "Emulator/Libs/Libs.h"
 
+#include <atomic>
+
 #ifdef KYTY_EMU_ENABLED
 
 namespace Kyty::Libs::LibKernel::EventFlag {
@@ -65,13 +67,18 @@ private:
 		Deleted
 	};
 
-	Core::Mutex   m_mutex;
-	Core::CondVar m_cond_var;
-	Status        m_status          = Status::Set;
-	int           m_waiting_threads = 0;
-	String        m_name;
-	bool          m_single_thread = false;
-	uint64_t      m_bits          = 0;
+	// Checks the pattern and clears the bits in one step, '*prev' receives the pattern seen
+	bool TryAcquire(uint64_t bits, WaitMode wait_mode, ClearMode clear_mode, uint64_t* prev);
+
+	// The pattern, the status and the waiter count are also accessed without the mutex by the fast paths. A thread is counted as
+	// waiting before it checks the pattern under the mutex, so Set() knows whether somebody has to be woken up.
+	Core::Mutex           m_mutex;
+	Core::CondVar         m_cond_var;
+	std::atomic<Status>   m_status {Status::Set};
+	std::atomic_int       m_waiting_threads {0};
+	String                m_name;
+	bool                  m_single_thread = false;
+	std::atomic<uint64_t> m_bits {0};
 };
 
 KernelEventFlagPrivate::~KernelEventFlagPrivate()
@@ -97,9 +104,63 @@ KernelEventFlagPrivate::~KernelEventFlagPrivate()
 	}
 }
 
+bool KernelEventFlagPrivate::TryAcquire(uint64_t bits, WaitMode wait_mode, ClearMode clear_mode, uint64_t* prev)
+{
+	uint64_t pattern = m_bits.load();
+
+	for (;;)
+	{
+		if (!((wait_mode == WaitMode::And && (pattern & bits) == bits) || (wait_mode == WaitMode::Or && (pattern & bits) != 0)))
+		{
+			*prev = pattern;
+			return false;
+		}
+
+		uint64_t new_pattern = pattern;
+
+		if (clear_mode == ClearMode::All)
+		{
+			new_pattern = 0;
+		} else if (clear_mode == ClearMode::Bits)
+		{
+			new_pattern &= ~bits;
+		}
+
+		if (new_pattern == pattern || m_bits.compare_exchange_weak(pattern, new_pattern))
+		{
+			*prev = pattern;
+			return true;
+		}
+	}
+}
+
 KernelEventFlagPrivate::Result KernelEventFlagPrivate::Wait(uint64_t bits, WaitMode wait_mode, ClearMode clear_mode, uint64_t* result,
                                                             uint32_t* ptr_micros)
 {
+	uint64_t pattern = 0;
+
+	// Fast path: nobody is queued, so taking the bits can't overtake a waiter
+	if (m_waiting_threads.load() == 0)
+	{
+		if (TryAcquire(bits, wait_mode, clear_mode, &pattern))
+		{
+			if (result != nullptr)
+			{
+				*result = pattern;
+			}
+			return Result::Ok;
+		}
+
+		if (ptr_micros != nullptr && *ptr_micros == 0)
+		{
+			if (result != nullptr)
+			{
+				*result = pattern;
+			}
+			return Result::TimedOut;
+		}
+	}
+
 	Core::LockGuard lock(m_mutex);
 
 	uint32_t micros     = 0;
@@ -119,20 +180,18 @@ KernelEventFlagPrivate::Result KernelEventFlagPrivate::Wait(uint64_t bits, WaitM
 		return Result::AlreadyWaiting;
 	}
 
-	while (!((wait_mode == WaitMode::And && (m_bits & bits) == bits) || (wait_mode == WaitMode::Or && (m_bits & bits) != 0)))
+	m_waiting_threads++;
+
+	Result ret = Result::Ok;
+
+	while (!TryAcquire(bits, wait_mode, clear_mode, &pattern))
 	{
 		if ((elapsed >= micros && !infinitely))
 		{
-			if (result != nullptr)
-			{
-				*result = m_bits;
-			}
-			*ptr_micros = 0;
-			return Result::TimedOut;
+			ret = Result::TimedOut;
+			break;
 		}
 
-		m_waiting_threads++;
-
 		if (infinitely)
 		{
 			m_cond_var.Wait(&m_mutex);
@@ -141,60 +200,53 @@ KernelEventFlagPrivate::Result KernelEventFlagPrivate::Wait(uint64_t bits, WaitM
 			m_cond_var.WaitFor(&m_mutex, micros - elapsed);
 		}
 
-		m_waiting_threads--;
-
 		elapsed = static_cast<uint32_t>(t.GetTimeS() * 1000000.0);
 
 		if (m_status == Status::Canceled)
 		{
-			if (result != nullptr)
-			{
-				*result = m_bits;
-			}
-			if (ptr_micros != nullptr)
-			{
-				*ptr_micros = (elapsed >= micros ? 0 : micros - elapsed);
-			}
-			return Result::Canceled;
+			pattern = m_bits;
+			ret     = Result::Canceled;
+			break;
 		}
 
 		if (m_status == Status::Deleted)
 		{
-			if (result != nullptr)
-			{
-				*result = m_bits;
-			}
-			if (ptr_micros != nullptr)
-			{
-				*ptr_micros = (elapsed >= micros ? 0 : micros - elapsed);
-			}
-			return Result::Deleted;
+			pattern = m_bits;
+			ret     = Result::Deleted;
+			break;
 		}
 	}
 
-	if (result != nullptr)
-	{
-		*result = m_bits;
-	}
+	m_waiting_threads--;
 
-	if (clear_mode == ClearMode::All)
-	{
-		m_bits = 0;
-	} else if (clear_mode == ClearMode::Bits)
+	if (result != nullptr)
 	{
-		m_bits &= ~bits;
+		*result = pattern;
 	}
 
 	if (ptr_micros != nullptr)
 	{
-		*ptr_micros = (elapsed >= micros ? 0 : micros - elapsed);
+		*ptr_micros = (elapsed >= micros || ret == Result::TimedOut ? 0 : micros - elapsed);
 	}
 
-	return Result::Ok;
+	return ret;
 }
 
 void KernelEventFlagPrivate::Set(uint64_t bits)
 {
+	if (m_status == Status::Set)
+	{
+		m_bits.fetch_or(bits);
+
+		if (m_waiting_threads.load() > 0)
+		{
+			Core::LockGuard lock(m_mutex);
+			m_cond_var.SignalAll();
+		}
+
+		return;
+	}
+
 	Core::LockGuard lock(m_mutex);
 
 	EXIT_NOT_IMPLEMENTED(m_status == Status::Deleted);
@@ -206,13 +258,19 @@ void KernelEventFlagPrivate::Set(uint64_t bits)
 		m_mutex.Lock();
 	}
 
-	m_bits |= bits;
+	m_bits.fetch_or(bits);
 
 	m_cond_var.SignalAll();
 }
 
 void KernelEventFlagPrivate::Clear(uint64_t bits)
 {
+	if (m_status == Status::Set)
+	{
+		m_bits.fetch_and(bits);
+		return;
+	}
+
 	Core::LockGuard lock(m_mutex);
 
 	EXIT_NOT_IMPLEMENTED(m_status == Status::Deleted);
@@ -224,7 +282,7 @@ void KernelEventFlagPrivate::Clear(uint64_t bits)
 		m_mutex.Lock();
 	}
 
-	m_bits &= bits;
+	m_bits.fetch_and(bits);
 }
 
 void KernelEventFlagPrivate::Cancel(uint64_t bits, int* num_waiting_threads)
@@ -2,13 +2,17 @@
 
 #include "Kyty/Core/Common.h"
 #include "Kyty/Core/DbgAssert.h"
-#include "Kyty/Core/LinkList.h"
+#include "Kyty/Core/Hashmap.h"
 #include "Kyty/Core/String.h"
 #include "Kyty/Core/Threads.h"
 #include "Kyty/Core/Timer.h"
+#include "Kyty/Core/Vector.h"
 
 #include "Emulator/Libs/Errno.h"
 #include "Emulator/Libs/Libs.h"
+#include "Emulator/Libs/Trace.h"
+
+#include <atomic>
 
 #ifdef KYTY_EMU_ENABLED
 
@@ -16,6 +20,107 @@ namespace Kyty::Libs::LibKernel::EventQueue {
 
 LIB_NAME("libkernel", "libkernel");
 
+struct KernelEqueueEventKey
+{
+	uintptr_t ident  = 0;
+	int16_t   filter = 0;
+};
+
+} // namespace Kyty::Libs::LibKernel::EventQueue
+
+namespace Kyty::Core {
+
+KYTY_HASH_DEFINE_CALC(Kyty::Libs::LibKernel::EventQueue::KernelEqueueEventKey)
+{
+	return hash64(static_cast<uint64_t>(key->ident)) ^ hash16(static_cast<uint16_t>(key->filter));
+}
+
+KYTY_HASH_DEFINE_EQUALS(Kyty::Libs::LibKernel::EventQueue::KernelEqueueEventKey)
+{
+	return key_a->ident == key_b->ident && key_a->filter == key_b->filter;
+}
+
+} // namespace Kyty::Core
+
+namespace Kyty::Libs::LibKernel::EventQueue {
+
+// Triggers posted without the queue lock. Many producers (GPU, vblank and flip threads), one consumer at a time (the owner of the
+// queue lock). Bounded queue with a sequence number per cell.
+class KernelEqueuePendingTriggers
+{
+public:
+	static constexpr uint32_t CAPACITY = 256;
+
+	KernelEqueuePendingTriggers()
+	{
+		for (uint32_t i = 0; i < CAPACITY; i++)
+		{
+			m_cells[i].seq.store(i, std::memory_order_relaxed);
+		}
+	}
+
+	KYTY_CLASS_NO_COPY(KernelEqueuePendingTriggers);
+
+	// Returns false if the queue is full
+	bool Push(uintptr_t ident, int16_t filter, void* trigger_data)
+	{
+		auto pos = m_tail.load(std::memory_order_relaxed);
+		for (;;)
+		{
+			auto& cell = m_cells[pos % CAPACITY];
+			auto  seq  = cell.seq.load(std::memory_order_acquire);
+			auto  diff = static_cast<int32_t>(seq - pos);
+			if (diff == 0)
+			{
+				if (m_tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+				{
+					cell.ident        = ident;
+					cell.filter       = filter;
+					cell.trigger_data = trigger_data;
+					cell.seq.store(pos + 1, std::memory_order_release);
+					return true;
+				}
+			} else if (diff < 0)
+			{
+				return false;
+			} else
+			{
+				pos = m_tail.load(std::memory_order_relaxed);
+			}
+		}
+	}
+
+	// Must be called with the queue lock held
+	template <class F>
+	void Drain(F&& func)
+	{
+		for (;;)
+		{
+			auto& cell = m_cells[m_head % CAPACITY];
+			if (cell.seq.load(std::memory_order_acquire) != m_head + 1)
+			{
+				break;
+			}
+			func(cell.ident, cell.filter, cell.trigger_data);
+			cell.seq.store(m_head + CAPACITY, std::memory_order_release);
+			m_head++;
+		}
+	}
+
+private:
+	struct Cell
+	{
+		std::atomic_uint32_t seq {0};
+		uintptr_t            ident        = 0;
+		int16_t              filter       = 0;
+		void*                trigger_data = nullptr;
+	};
+
+	Cell                 m_cells[CAPACITY];
+	std::atomic_uint32_t m_tail {0};
+	uint32_t             m_head = 0;
+};
+
 class KernelEqueuePrivate
 {
 public:
@@ -35,20 +140,27 @@ public:
 	int WaitForEvents(KernelEvent* ev, int num, uint32_t micros);
 
 private:
-	Core::List<KernelEqueueEvent> m_events;
-	Core::Mutex                   m_mutex;
-	Core::CondVar                 m_cond_var;
-	String                        m_name;
+	[[nodiscard]] uint32_t FindEvent(uintptr_t ident, int16_t filter) const;
+
+	bool ApplyTrigger(uintptr_t ident, int16_t filter, void* trigger_data);
+	void ApplyPendingTriggers();
+	int  GetTriggeredEventsLocked(KernelEvent* ev, int num);
+
+	Vector<KernelEqueueEvent>                     m_events;
+	Core::Hashmap<KernelEqueueEventKey, uint32_t> m_events_index;
+	KernelEqueuePendingTriggers                   m_pending;
+	std::atomic_int                               m_waiters {0};
+	Core::Mutex                                   m_mutex;
+	Core::CondVar                                 m_cond_var;
+	String                                        m_name;
 };
 
 KernelEqueuePrivate::~KernelEqueuePrivate()
 {
 	Core::LockGuard lock(m_mutex);
 
-	FOR_LIST(index, m_events)
+	for (auto& event: m_events)
 	{
-		auto& event = m_events[index];
-
 		if (event.filter.delete_event_func != nullptr)
 		{
 			event.filter.delete_event_func(this, &event);
@@ -56,18 +168,51 @@ KernelEqueuePrivate::~KernelEqueuePrivate()
 	}
 }
 
-int KernelEqueuePrivate::GetTriggeredEvents(KernelEvent* ev, int num)
+uint32_t KernelEqueuePrivate::FindEvent(uintptr_t ident, int16_t filter) const
 {
-	Core::LockGuard lock(m_mutex);
+	KernelEqueueEventKey key;
+	key.ident  = ident;
+	key.filter = filter;
 
-	EXIT_IF(num < 1);
+	const auto* index = m_events_index.Find(key);
 
-	int ret = 0;
+	return (index != nullptr ? *index : static_cast<uint32_t>(-1));
+}
 
-	FOR_LIST(index, m_events)
+bool KernelEqueuePrivate::ApplyTrigger(uintptr_t ident, int16_t filter, void* trigger_data)
+{
+	if (auto index = FindEvent(ident, filter); m_events.IndexValid(index))
 	{
 		auto& event = m_events[index];
 
+		if (event.filter.trigger_func != nullptr)
+		{
+			event.filter.trigger_func(&event, trigger_data);
+		} else
+		{
+			event.triggered = true;
+		}
+
+		return true;
+	}
+
+	return false;
+}
+
+void KernelEqueuePrivate::ApplyPendingTriggers()
+{
+	// A pending trigger of an event deleted in the meantime is dropped
+	m_pending.Drain([this](uintptr_t ident, int16_t filter, void* trigger_data) { ApplyTrigger(ident, filter, trigger_data); });
+}
+
+int KernelEqueuePrivate::GetTriggeredEventsLocked(KernelEvent* ev, int num)
+{
+	ApplyPendingTriggers();
+
+	int ret = 0;
+
+	for (auto& event: m_events)
+	{
 		if (event.triggered)
 		{
 			ev[ret++] = event.event;
@@ -87,23 +232,37 @@ int KernelEqueuePrivate::GetTriggeredEvents(KernelEvent* ev, int num)
 	return ret;
 }
 
+int KernelEqueuePrivate::GetTriggeredEvents(KernelEvent* ev, int num)
+{
+	Core::LockGuard lock(m_mutex);
+
+	EXIT_IF(num < 1);
+
+	return GetTriggeredEventsLocked(ev, num);
+}
+
 int KernelEqueuePrivate::WaitForEvents(KernelEvent* ev, int num, uint32_t micros)
 {
 	Core::LockGuard lock(m_mutex);
 
 	EXIT_IF(num < 1);
 
+	// Must be visible to TriggerEvent() before the pending triggers are checked, otherwise a wake-up can be lost
+	m_waiters.fetch_add(1, std::memory_order_seq_cst);
+
 	uint32_t    elapsed = 0;
 	Core::Timer t;
 	t.Start();
 
+	int ret = 0;
+
 	for (;;)
 	{
-		int ret = GetTriggeredEvents(ev, num);
+		ret = GetTriggeredEventsLocked(ev, num);
 
 		if (ret > 0 || (elapsed >= micros && micros != 0))
 		{
-			return ret;
+			break;
 		}
 
 		if (micros == 0)
@@ -117,20 +276,28 @@ int KernelEqueuePrivate::WaitForEvents(KernelEvent* ev, int num, uint32_t micros
 		elapsed = static_cast<uint32_t>(t.GetTimeS() * 1000000.0);
 	}
 
-	return 0;
+	m_waiters.fetch_sub(1, std::memory_order_relaxed);
+
+	return ret;
 }
 
 void KernelEqueuePrivate::AddEvent(const KernelEqueueEvent& event)
 {
 	Core::LockGuard lock(m_mutex);
 
-	if (auto index = m_events.Find(event.event.ident, event.event.filter,
-	                               [](auto e, auto ident, auto filter) { return e.event.ident == ident && e.event.filter == filter; });
-	    m_events.IndexValid(index))
+	// Triggers posted before the event is replaced belong to the old one
+	ApplyPendingTriggers();
+
+	if (auto index = FindEvent(event.event.ident, event.event.filter); m_events.IndexValid(index))
 	{
 		m_events[index] = event;
 	} else
 	{
+		KernelEqueueEventKey key;
+		key.ident  = event.event.ident;
+		key.filter = event.event.filter;
+
+		m_events_index.Put(key, m_events.Size());
 		m_events.Add(event);
 	}
 
@@ -140,24 +307,30 @@ void KernelEqueuePrivate::AddEvent(const KernelEqueueEvent& event)
 	}
 }
 
+// Called from the GPU, vblank and flip threads. The trigger is posted without the queue lock, the lock is taken only to wake up a
+// waiter. Triggers posted while nobody waits are applied in one batch by the next GetTriggeredEvents() or WaitForEvents().
 bool KernelEqueuePrivate::TriggerEvent(uintptr_t ident, int16_t filter, void* trigger_data)
 {
-	Core::LockGuard lock(m_mutex);
-
-	if (auto index = m_events.Find(ident, filter,
-	                               [](auto e, auto ident, auto filter) { return e.event.ident == ident && e.event.filter == filter; });
-	    m_events.IndexValid(index))
+	if (m_pending.Push(ident, filter, trigger_data))
 	{
-		auto& event = m_events[index];
-
-		if (event.filter.trigger_func != nullptr)
+		if (m_waiters.load(std::memory_order_seq_cst) > 0)
 		{
-			event.filter.trigger_func(&event, trigger_data);
-		} else
-		{
-			event.triggered = true;
+			Core::LockGuard lock(m_mutex);
+
+			ApplyPendingTriggers();
+
+			m_cond_var.Signal();
 		}
 
+		return true;
+	}
+
+	Core::LockGuard lock(m_mutex);
+
+	ApplyPendingTriggers();
+
+	if (ApplyTrigger(ident, filter, trigger_data))
+	{
 		m_cond_var.Signal();
 
 		return true;
@@ -170,9 +343,9 @@ bool KernelEqueuePrivate::DeleteEvent(uintptr_t ident, int16_t filter)
 {
 	Core::LockGuard lock(m_mutex);
 
-	if (auto index = m_events.Find(ident, filter,
-	                               [](auto e, auto ident, auto filter) { return e.event.ident == ident && e.event.filter == filter; });
-	    m_events.IndexValid(index))
+	ApplyPendingTriggers();
+
+	if (auto index = FindEvent(ident, filter); m_events.IndexValid(index))
 	{
 		auto& event = m_events[index];
 
@@ -181,7 +354,26 @@ bool KernelEqueuePrivate::DeleteEvent(uintptr_t ident, int16_t filter)
 			event.filter.delete_event_func(this, &event);
 		}
 
-		m_events.Remove(index);
+		KernelEqueueEventKey key;
+		key.ident  = ident;
+		key.filter = filter;
+
+		m_events_index.Remove(key);
+
+		// Keep the vector dense: the last event takes the freed slot
+		auto last = m_events.Size() - 1;
+		if (index != last)
+		{
+			m_events[index] = m_events[last];
+
+			KernelEqueueEventKey moved_key;
+			moved_key.ident  = m_events[index].event.ident;
+			moved_key.filter = m_events[index].event.filter;
+
+			m_events_index[moved_key] = index;
+		}
+
+		m_events.RemoveAt(last);
 
 		return true;
 	}
@@ -191,7 +383,7 @@ bool KernelEqueuePrivate::DeleteEvent(uintptr_t ident, int16_t filter)
 
 int KYTY_SYSV_ABI KernelCreateEqueue(KernelEqueue* eq, const char* name)
 {
-	PRINT_NAME();
+	TRACE_NAME(EventQueue);
 
 	if (eq == nullptr || name == nullptr)
 	{
@@ -202,7 +394,7 @@ int KYTY_SYSV_ABI KernelCreateEqueue(KernelEqueue* eq, const char* name)
 
 	(*eq)->SetName(String::FromUtf8(name));
 
-	printf("\tEqueue create: %s\n", name);
+	TRACE(EventQueue, "\tEqueue create: %s\n", name);
 
 	return OK;
 }
@@ -251,14 +443,14 @@ int KYTY_SYSV_ABI KernelDeleteEvent(KernelEqueue eq, uintptr_t ident, int16_t fi
 
 int KYTY_SYSV_ABI KernelDeleteEqueue(KernelEqueue eq)
 {
-	PRINT_NAME();
+	TRACE_NAME(EventQueue);
 
 	if (eq == nullptr)
 	{
 		return KERNEL_ERROR_EBADF;
 	}
 
-	printf("\tEqueue delete: %s\n", eq->GetName().C_Str());
+	TRACE(EventQueue, "\tEqueue delete: %s\n", eq->GetName().C_Str());
 
 	delete eq;
 
@@ -317,7 +509,7 @@ int KYTY_SYSV_ABI KernelWaitEqueue(KernelEqueue eq, KernelEvent* ev, int num, in
 
 intptr_t KYTY_SYSV_ABI KernelGetEventData(const KernelEvent* ev)
 {
-	PRINT_NAME();
+	TRACE_NAME_LIMITED(EventQueue);
 
 	if (ev != nullptr)
 	{
@@ -329,7 +521,7 @@ intptr_t KYTY_SYSV_ABI KernelGetEventData(const KernelEvent* ev)
 
 intptr_t KYTY_SYSV_ABI KernelGetEventFflags(const KernelEvent* ev)
 {
-	PRINT_NAME();
+	TRACE_NAME_LIMITED(EventQueue);
 
 	if (ev != nullptr)
 	{
@@ -341,7 +533,7 @@ intptr_t KYTY_SYSV_ABI KernelGetEventFflags(const KernelEvent* ev)
 
 int KYTY_SYSV_ABI KernelGetEventFilter(const KernelEvent* ev)
 {
-	PRINT_NAME();
+	TRACE_NAME_LIMITED(EventQueue);
 
 	if (ev != nullptr)
 	{
@@ -353,7 +545,7 @@ int KYTY_SYSV_ABI KernelGetEventFilter(const KernelEvent* ev)
 
 uintptr_t KYTY_SYSV_ABI KernelGetEventId(const KernelEvent* ev)
 {
-	PRINT_NAME();
+	TRACE_NAME_LIMITED(EventQueue);
 
 	if (ev != nullptr)
 	{
@@ -365,7 +557,7 @@ uintptr_t KYTY_SYSV_ABI KernelGetEventId(const KernelEvent* ev)
 
 void* KYTY_SYSV_ABI KernelGetEventUserData(const KernelEvent* ev)
 {
-	PRINT_NAME();
+	TRACE_NAME_LIMITED(EventQueue);
 
 	if (ev != nullptr)
 	{
@@ -377,7 +569,7 @@ void* KYTY_SYSV_ABI KernelGetEventUserData(const KernelEvent* ev)
 
 int KYTY_SYSV_ABI KernelGetEventError(const KernelEvent* /*ev*/)
 {
-	PRINT_NAME();
+	TRACE_NAME(EventQueue);
 
 	KYTY_NOT_IMPLEMENTED;
 
@@ -1,17 +1,34 @@
 #include "Emulator/Kernel/FileSystem.h"
 
+#include "Kyty/Core/BufferPool.h"
 #include "Kyty/Core/Common.h"
+#include "Kyty/Core/Compression.h"
 #include "Kyty/Core/DateTime.h"
 #include "Kyty/Core/DbgAssert.h"
 #include "Kyty/Core/File.h"
+#include "Kyty/Core/FlatHashmap.h"
+#include "Kyty/Core/Hashmap.h"
+#include "Kyty/Core/JobSystem.h"
+#include "Kyty/Core/String8.h"
+#include "Kyty/Core/StringView8.h"
 #include "Kyty/Core/Threads.h"
 #include "Kyty/Core/Vector.h"
 
+#include "Emulator/Config.h"
+#include "Emulator/Graphics/Graphics.h"
+#include "Emulator/Graphics/Objects/GpuMemory.h"
 #include "Emulator/Libs/Errno.h"
 #include "Emulator/Libs/Libs.h"
+#include "Emulator/Libs/Trace.h"
 
+#include <algorithm>
 #include <atomic>
 #include <climits>
+#include <vector>
+
+#if KYTY_COMPILER == KYTY_COMPILER_MSVC
+#include <intrin.h>
+#endif
 
 #ifdef KYTY_EMU_ENABLED
 
@@ -19,7 +36,8 @@ namespace Kyty::Libs::LibKernel::FileSystem {
 
 LIB_NAME("libkernel", "libkernel");
 
-constexpr int DESCRIPTOR_MIN = 3;
+constexpr int      DESCRIPTOR_MIN = 3;
+constexpr uint64_t READ_AHEAD_MIN = 1024 * 1024;
 
 class MountPoints
 {
@@ -38,14 +56,38 @@ public:
 	void Mount(const String& folder, const String& point);
 	void Umount(const String& folder_or_point);
 
+	// Guest paths come as UTF-8, a cached name is found without converting the path to String
+	[[nodiscard]] String GetRealFilename(Core::StringView8 mounted_file_name);
+	[[nodiscard]] String GetRealDirectory(Core::StringView8 mounted_directory);
 	[[nodiscard]] String GetRealFilename(const String& mounted_file_name);
 	[[nodiscard]] String GetRealDirectory(const String& mounted_directory);
 
+	// Resolved names depend on which host files exist, the cache is reset when the guest creates or deletes one
+	void ResetCache();
+
 private:
+	static constexpr uint32_t CACHE_MAX = 65536;
+
+	using Cache = Core::FlatHashmap<String8, String, Core::StringHash8>;
+
 	Vector<MountPair> m_mount_pairs;
+	Cache             m_real_filenames;
+	Cache             m_real_directories;
 	Core::Mutex       m_mutex;
 };
 
+struct SaveDataFile
+{
+	Core::Mutex          mutex;
+	std::vector<uint8_t> data;
+	Core::DateTime       access;
+	Core::DateTime       write;
+	bool                 exists = false; // false if the file is not created yet or deleted
+	bool                 broken = false; // the host file can't be read, it can only be truncated or deleted
+	bool                 dirty  = false;
+	uint32_t             opened = 0;
+};
+
 struct File
 {
 	Core::File                   f;
@@ -56,8 +98,17 @@ struct File
 	Core::Mutex                  mutex;
 	Vector<Core::File::DirEntry> dents;
 	uint32_t                     dents_index;
+	bool                         read_only; // Reads are positional, the file position is kept in pos
+	uint64_t                     pos;
+	const uint8_t*               map_data; // Read-only game files are mapped, their reads don't touch the host file
+	uint64_t                     map_size;
+	std::atomic_uint64_t         read_end; // Sequential reads are detected by where the previous one ended
+	std::atomic_uint64_t         read_ahead_end;
+	SaveDataFile*                save_data; // Files of a write-behind save data mount are read and written in memory, f is not used
 };
 
+// Slots are allocated in chunks which are never moved or freed, so GetFile(int) reads them without the lock. Like POSIX, a new
+// descriptor is the lowest free one, the free slots are found through a two-level bitmap.
 class FileDescriptors
 {
 public:
@@ -68,81 +119,975 @@ public:
 
 	int   CreateDescriptor();
 	void  DeleteDescriptor(int d);
+	void  SetRealName(int d, const String& real_name);
 	File* GetFile(int d);
 	File* GetFile(const String& real_name);
 	void  CloseAll();
 
-private:
-	Vector<File*> m_files;
-	Core::Mutex   m_mutex;
-};
+private:
+	static constexpr uint32_t CHUNK_SIZE = 256;
+	static constexpr uint32_t CHUNKS_MAX = 64;
+	static constexpr uint32_t SLOTS_MAX  = CHUNK_SIZE * CHUNKS_MAX;
+
+	using Slot = std::atomic<File*>;
+
+	Slot* GetSlot(uint32_t index);
+	void  SetFree(uint32_t index);
+	bool  FindFree(uint32_t* index);
+	void  RemoveName(int d, const File* file);
+
+	std::atomic<Slot*>                 m_chunks[CHUNKS_MAX]              = {};
+	uint32_t                           m_slots_num                       = 0;
+	uint64_t                           m_free_bits[SLOTS_MAX / 64]       = {};
+	uint64_t                           m_free_words[SLOTS_MAX / 64 / 64] = {}; // Words of m_free_bits which are not 0
+	Core::Hashmap<String, Vector<int>> m_names;
+	Core::Mutex                        m_mutex;
+};
+
+struct FileInfo
+{
+	bool           is_dir  = false;
+	bool           is_file = false;
+	uint64_t       size    = 0;
+	Core::DateTime access;
+	Core::DateTime write;
+};
+
+// Game content doesn't change while it runs, so its listings and stat info are read from the host once and shared by all handles
+class DirectoryCache
+{
+public:
+	DirectoryCache() { EXIT_NOT_IMPLEMENTED(!Core::Thread::IsMainThread()); }
+	virtual ~DirectoryCache() { KYTY_NOT_IMPLEMENTED; }
+
+	KYTY_CLASS_NO_COPY(DirectoryCache);
+
+	static bool IsCached(const String& name) { return name == U"/app0" || name.StartsWith(U"/app0/"); }
+	static bool IsCached(Core::StringView8 name) { return name == "/app0" || name.StartsWith("/app0/"); }
+
+	Vector<Core::File::DirEntry> GetDirEntries(const String& real_name);
+	FileInfo                     GetFileInfo(const String& real_name);
+
+private:
+	Core::Hashmap<String, Vector<Core::File::DirEntry>> m_dirs;
+	Core::Hashmap<String, FileInfo>                     m_infos;
+	Core::Mutex                                         m_mutex;
+};
+
+// Game files are read into the host cache in the background before the title opens them, in the order of their PlayGo chunks.
+// Extracted content has no map of files to chunks, so it's learned: a file belongs to the last chunk the title asked about before
+// opening it for the first time. The map is saved in the cache folder of the title and used by the next run.
+class ChunkPrefetch
+{
+public:
+	ChunkPrefetch() { EXIT_NOT_IMPLEMENTED(!Core::Thread::IsMainThread()); }
+	virtual ~ChunkPrefetch() { KYTY_NOT_IMPLEMENTED; }
+
+	KYTY_CLASS_NO_COPY(ChunkPrefetch);
+
+	void FileOpened(const String& name);
+	void ChunkQueried(uint16_t chunk_id);
+	void Save();
+
+private:
+	struct Entry
+	{
+		String   name;
+		uint16_t chunk_id = 0;
+		bool     queued   = false;
+	};
+
+	static constexpr uint64_t BYTES_MAX  = 2ull * 1024 * 1024 * 1024;
+	static constexpr uint32_t BLOCK_SIZE = 1024 * 1024;
+
+	static String GetMapFileName() { return Libs::Graphics::GraphicsGetCacheFolder() + U"playgo_files.txt"; }
+
+	void        Start();
+	static void Run(void* arg);
+
+	Vector<Entry>                   m_map; // in the order of the first open
+	Core::Hashmap<String, uint32_t> m_index;
+	Vector<uint32_t>                m_queue; // the next file first
+	uint16_t                        m_chunk_id = 0;
+	bool                            m_started  = false;
+	bool                            m_changed  = false;
+	Core::Mutex                     m_mutex;
+};
+
+// Save data of a write-behind mount is read from the host when the title asks for a file for the first time and then kept in memory
+// until the unmount, so saving doesn't wait for the disk on the title's thread. At the unmount the changed files are written by a
+// worker, each one to a temporary file which then replaces the old one, so a crash in the middle leaves either the old or the new
+// contents. Directories are created and listed on the host as usual, listings are patched with the files in memory.
+class SaveDataBuffer
+{
+public:
+	SaveDataBuffer() { EXIT_NOT_IMPLEMENTED(!Core::Thread::IsMainThread()); }
+	virtual ~SaveDataBuffer() { KYTY_NOT_IMPLEMENTED; }
+
+	KYTY_CLASS_NO_COPY(SaveDataBuffer);
+
+	void Mount(const String& folder, const String& point);
+	int  Umount(const String& folder_or_point); // KERNEL_ERROR_EBUSY if a file of the mount is open, the mount stays
+	void FlushAll();                            // Writes the changes of all mounts and waits
+
+	// The file of a name on a write-behind mount, read from the host the first time, nullptr for other names. Open() and Close()
+	// count the descriptors, files must be closed before the unmount.
+	SaveDataFile* Open(const String& real_name);
+	void          Close(SaveDataFile* file);
+	SaveDataFile* Find(const String& real_name);
+
+	void PatchDirEntries(const String& real_directory, Vector<Core::File::DirEntry>* dents);
+
+private:
+	struct MountInfo
+	{
+		String                               dir;
+		String                               point;
+		Core::Hashmap<String, SaveDataFile*> files;
+	};
+
+	// Files saved with Config::SaveDataCompressed() are stored as one zstd frame under the name with the extension .kzst
+	static constexpr char32_t COMPRESSED_EXT[] = U".kzst";
+
+	static String CompressedName(const String& real_name) { return real_name + COMPRESSED_EXT; }
+
+	MountInfo*  FindMount(const String& real_name);
+	static void Load(const String& real_name, SaveDataFile* file);
+	static bool Read(const String& name, SaveDataFile* file, std::vector<uint8_t>* buf);
+	static void Save(const String& real_name, const SaveDataFile* file);
+	static void Flush(MountInfo* m, bool free);
+
+	Vector<MountInfo*> m_mounts;
+	Core::TaskGroup    m_flush;
+	Core::Mutex        m_mutex;
+};
+
+static MountPoints*     g_mount_points = nullptr;
+static FileDescriptors* g_files        = nullptr;
+static DirectoryCache*  g_dir_cache    = nullptr;
+static ChunkPrefetch*   g_prefetch     = nullptr;
+static SaveDataBuffer*  g_save_data    = nullptr;
+
+static FileInfo get_file_info(const String& real_name)
+{
+	FileInfo info;
+
+	info.is_dir  = Core::File::IsDirectoryExisting(real_name);
+	info.is_file = Core::File::IsFileExisting(real_name);
+
+	if (info.is_file && !info.is_dir)
+	{
+		info.size = Core::File::Size(real_name);
+		Core::File::GetLastAccessAndWriteTimeUTC(real_name, &info.access, &info.write);
+	}
+
+	return info;
+}
+
+Vector<Core::File::DirEntry> DirectoryCache::GetDirEntries(const String& real_name)
+{
+	Core::LockGuard lock(m_mutex);
+
+	if (const auto* dents = m_dirs.Find(real_name); dents != nullptr)
+	{
+		return *dents;
+	}
+
+	auto dents = Core::File::GetDirEntries(real_name);
+	m_dirs.Put(real_name, dents);
+
+	return dents;
+}
+
+FileInfo DirectoryCache::GetFileInfo(const String& real_name)
+{
+	Core::LockGuard lock(m_mutex);
+
+	if (const auto* info = m_infos.Find(real_name); info != nullptr)
+	{
+		return *info;
+	}
+
+	auto info = get_file_info(real_name);
+	m_infos.Put(real_name, info);
+
+	return info;
+}
+
+// m_mutex must be locked
+void ChunkPrefetch::Start()
+{
+	m_started = true;
+
+	Core::File f;
+	if (auto file_name = GetMapFileName(); Core::File::IsFileExisting(file_name) && f.Open(file_name, Core::File::Mode::Read))
+	{
+		while (!f.IsEOF())
+		{
+			auto line = f.ReadLine().Split(U'\t');
+			if (line.Size() == 2 && !m_index.Contains(line.At(1)))
+			{
+				m_index.Put(line.At(1), m_map.Size());
+				m_map.Add({line.At(1), static_cast<uint16_t>(line.At(0).ToUint32()), true});
+			}
+		}
+		f.Close();
+	}
+
+	// Initial chunk first, the files of a chunk in the order they were opened
+	for (uint32_t i = 0; i < m_map.Size(); i++)
+	{
+		m_queue.Add(i);
+	}
+	std::stable_sort(m_queue.begin(), m_queue.end(), [this](uint32_t a, uint32_t b) { return m_map[a].chunk_id < m_map[b].chunk_id; });
+
+	if (!m_queue.IsEmpty())
+	{
+		printf("Prefetch: %u files\n", m_queue.Size());
+
+		Core::Thread t(Run, this);
+		t.Detach();
+	}
+}
+
+void ChunkPrefetch::FileOpened(const String& name)
+{
+	Core::LockGuard lock(m_mutex);
+
+	if (!m_started)
+	{
+		Start();
+	}
+
+	if (const auto* index = m_index.Find(name); index != nullptr)
+	{
+		// Too late to read it ahead
+		if (auto& e = m_map[*index]; e.queued)
+		{
+			m_queue.Remove(*index);
+			e.queued = false;
+		}
+		return;
+	}
+
+	m_index.Put(name, m_map.Size());
+	m_map.Add({name, m_chunk_id, false});
+	m_changed = true;
+}
+
+void ChunkPrefetch::ChunkQueried(uint16_t chunk_id)
+{
+	Core::LockGuard lock(m_mutex);
+
+	m_chunk_id = chunk_id;
+
+	std::stable_partition(m_queue.begin(), m_queue.end(), [this, chunk_id](uint32_t i) { return m_map[i].chunk_id == chunk_id; });
+}
+
+void ChunkPrefetch::Save()
+{
+	Core::LockGuard lock(m_mutex);
+
+	if (!m_changed)
+	{
+		return;
+	}
+	m_changed = false;
+
+	auto file_name = GetMapFileName();
+
+	Core::File::CreateDirectories(file_name.DirectoryWithoutFilename());
+
+	Core::File f;
+	if (!f.Create(file_name))
+	{
+		printf(FG_BRIGHT_RED "Can't create file: %s\n" FG_DEFAULT, file_name.C_Str());
+		return;
+	}
+
+	for (const auto& e: m_map)
+	{
+		f.Printf("%u\t%s\n", static_cast<uint32_t>(e.chunk_id), e.name.C_Str());
+	}
+
+	f.Close();
+}
+
+void ChunkPrefetch::Run(void* arg)
+{
+	auto* p = static_cast<ChunkPrefetch*>(arg);
+
+	auto*    buf   = new uint8_t[BLOCK_SIZE];
+	uint64_t total = 0;
+
+	while (total < BYTES_MAX)
+	{
+		String name;
+
+		{
+			Core::LockGuard lock(p->m_mutex);
+
+			if (p->m_queue.IsEmpty())
+			{
+				break;
+			}
+
+			auto index = p->m_queue.At(0);
+			p->m_queue.RemoveAt(0);
+			p->m_map[index].queued = false;
+			name                   = p->m_map[index].name;
+		}
+
+		// The data stays in the host cache, reading it is the portable way to get it there
+		Core::File f;
+		if (f.Open(g_mount_points->GetRealFilename(name), Core::File::Mode::Read))
+		{
+			for (uint64_t offset = 0; total < BYTES_MAX; offset += BLOCK_SIZE)
+			{
+				uint64_t read = 0;
+				f.ReadAt(buf, BLOCK_SIZE, offset, &read);
+				total += read;
+				if (read != BLOCK_SIZE)
+				{
+					break;
+				}
+			}
+			f.Close();
+		}
+	}
+
+	delete[] buf;
+
+	printf("Prefetch: %" PRIu64 " bytes read\n", total);
+}
+
+// m_mutex must be locked
+SaveDataBuffer::MountInfo* SaveDataBuffer::FindMount(const String& real_name)
+{
+	for (auto* m: m_mounts)
+	{
+		if (real_name.StartsWith(m->dir))
+		{
+			return m;
+		}
+	}
+	return nullptr;
+}
+
+void SaveDataBuffer::Mount(const String& folder, const String& point)
+{
+	Core::LockGuard lock(m_mutex);
+
+	auto folder_str = folder.FixDirectorySlash();
+	auto point_str  = point.FixDirectorySlash();
+
+	EXIT_NOT_IMPLEMENTED(Umount(folder_str) != OK || Umount(point_str) != OK);
+
+	// The previous mount of the folder may be still being written
+	m_flush.Wait();
+
+	auto* m  = new MountInfo;
+	m->dir   = folder_str;
+	m->point = point_str;
+
+	m_mounts.Add(m);
+}
+
+int SaveDataBuffer::Umount(const String& folder_or_point)
+{
+	Core::LockGuard lock(m_mutex);
+
+	auto folder_or_point_str = folder_or_point.FixDirectorySlash();
+
+	if (auto index = m_mounts.Find(folder_or_point_str, [](const MountInfo* m, const String& s) { return m->dir == s || m->point == s; });
+	    m_mounts.IndexValid(index))
+	{
+		auto* m = m_mounts.At(index);
+
+		FOR_HASH (m->files)
+		{
+			if (m->files.Value()->opened != 0)
+			{
+				return KERNEL_ERROR_EBUSY;
+			}
+		}
+
+		m_mounts.RemoveAt(index);
+
+		m_flush.Run([m]() { Flush(m, true); });
+	}
+
+	return OK;
+}
+
+void SaveDataBuffer::FlushAll()
+{
+	Core::LockGuard lock(m_mutex);
+
+	// Files may be still open, the mounts are kept
+	for (auto* m: m_mounts)
+	{
+		Flush(m, false);
+	}
+
+	m_flush.Wait();
+}
+
+SaveDataFile* SaveDataBuffer::Open(const String& real_name)
+{
+	Core::LockGuard lock(m_mutex);
+
+	auto* file = Find(real_name);
+
+	if (file != nullptr)
+	{
+		file->opened++;
+	}
+
+	return file;
+}
+
+void SaveDataBuffer::Close(SaveDataFile* file)
+{
+	Core::LockGuard lock(m_mutex);
+
+	EXIT_IF(file->opened == 0);
+
+	file->opened--;
+}
+
+SaveDataFile* SaveDataBuffer::Find(const String& real_name)
+{
+	Core::LockGuard lock(m_mutex);
+
+	auto* m = FindMount(real_name);
+
+	if (m == nullptr)
+	{
+		return nullptr;
+	}
+
+	if (const auto* file = m->files.Find(real_name); file != nullptr)
+	{
+		return *file;
+	}
+
+	auto* file = new SaveDataFile;
+	Load(real_name, file);
+	m->files.Put(real_name, file);
+
+	return file;
+}
+
+void SaveDataBuffer::PatchDirEntries(const String& real_directory, Vector<Core::File::DirEntry>* dents)
+{
+	Core::LockGuard lock(m_mutex);
+
+	auto* m = FindMount(real_directory);
+
+	if (m == nullptr)
+	{
+		return;
+	}
+
+	auto dir = real_directory.FixDirectorySlash();
+
+	// Compressed files are listed under their names
+	String ext(COMPRESSED_EXT);
+	for (uint32_t i = 0; i < dents->Size();)
+	{
+		auto& e = (*dents)[i];
+		if (e.is_file && e.name.EndsWith(ext))
+		{
+			auto name = e.name.RemoveLast(ext.Size());
+			if (dents->Contains(name, [](const Core::File::DirEntry& d, const String& n) { return d.is_file && d.name == n; }))
+			{
+				dents->RemoveAt(i);
+				continue;
+			}
+			e.name = name;
+		}
+		i++;
+	}
+
+	FOR_HASH (m->files)
+	{
+		const auto& real_name = m->files.Key();
+
+		if (!real_name.StartsWith(dir))
+		{
+			continue;
+		}
+
+		// Files of subdirectories are listed with them
+		auto name = real_name.RemoveFirst(dir.Size());
+
+		if (name.IsEmpty() || name.ContainsChar(U'/'))
+		{
+			continue;
+		}
+
+		auto* file  = m->files.Value();
+		auto  index = dents->Find(name, [](const Core::File::DirEntry& e, const String& n) { return e.is_file && e.name == n; });
+
+		Core::LockGuard file_lock(file->mutex);
+
+		if (file->exists && !dents->IndexValid(index))
+		{
+			dents->Add({name, true});
+		} else if (!file->exists && dents->IndexValid(index))
+		{
+			dents->RemoveAt(index);
+		}
+	}
+}
+
+// The file is read as it is, false if it can't be read
+bool SaveDataBuffer::Read(const String& name, SaveDataFile* file, std::vector<uint8_t>* buf)
+{
+	Core::File f;
+	if (!f.Open(name, Core::File::Mode::Read))
+	{
+		return false;
+	}
+
+	f.GetLastAccessAndWriteTimeUTC(&file->access, &file->write);
+
+	buf->resize(f.Size());
+	uint64_t bytes_read = 0;
+	f.Read(buf->data(), static_cast<uint64_t>(buf->size()), &bytes_read);
+	f.Close();
+
+	return bytes_read == buf->size();
+}
+
+void SaveDataBuffer::Load(const String& real_name, SaveDataFile* file)
+{
+	file->access = Core::DateTime::FromSystemUTC();
+	file->write  = file->access;
+
+	auto compressed_name = CompressedName(real_name);
+	bool plain_exists    = Core::File::IsFileExisting(real_name);
+	bool compressed      = Core::File::IsFileExisting(compressed_name);
+
+	// Both exist only after a crash in the middle of Save(), then the file of the current mode is the new one
+	if (plain_exists && compressed)
+	{
+		compressed = Config::SaveDataCompressed();
+	}
+
+	if (!plain_exists && !compressed)
+	{
+		return;
+	}
+
+	file->exists = true;
+
+	std::vector<uint8_t> buf;
+
+	if (!Read(compressed ? compressed_name : real_name, file, &buf))
+	{
+		file->broken = true;
+	} else if (compressed)
+	{
+		uint64_t size      = 0;
+		uint32_t size_read = 0;
+
+		file->broken = !(buf.size() <= UINT32_MAX && Core::GetZstdContentSize(buf.data(), static_cast<uint32_t>(buf.size()), &size) &&
+		                 size <= UINT32_MAX);
+
+		if (!file->broken)
+		{
+			file->data.resize(size);
+			file->broken = !(Core::TryDecompressZstd(buf.data(), static_cast<uint32_t>(buf.size()), file->data.data(),
+			                                         static_cast<uint32_t>(size), &size_read) &&
+			                 size_read == size);
+		}
+	} else
+	{
+		file->data = std::move(buf);
+	}
+
+	if (file->broken)
+	{
+		file->data.clear();
+		printf(FG_BRIGHT_RED "Can't read file: %s\n" FG_DEFAULT, real_name.C_Str());
+	}
+}
+
+void SaveDataBuffer::Save(const String& real_name, const SaveDataFile* file)
+{
+	auto compressed_name = CompressedName(real_name);
+
+	if (!file->exists)
+	{
+		for (const auto& name: {real_name, compressed_name})
+		{
+			if (Core::File::IsFileExisting(name))
+			{
+				Core::File::DeleteFile(name);
+			}
+		}
+		return;
+	}
+
+	bool compressed = Config::SaveDataCompressed();
+	auto name       = (compressed ? compressed_name : real_name);
+	auto old_name   = (compressed ? real_name : compressed_name);
+	auto tmp_name   = name + U".tmp";
+
+	Core::File::CreateDirectories(real_name.DirectoryWithoutFilename());
+
+	Core::File f;
+	if (!f.Create(tmp_name))
+	{
+		printf(FG_BRIGHT_RED "Can't create file: %s\n" FG_DEFAULT, tmp_name.C_Str());
+		return;
+	}
+
+	bool ok = false;
+
+	if (compressed)
+	{
+		EXIT_NOT_IMPLEMENTED(file->data.size() > UINT32_MAX);
+
+		Core::ByteBufferLease buf(static_cast<uint32_t>(file->data.size()));
+		Core::CompressZstd(file->data.data(), static_cast<uint32_t>(file->data.size()), buf.Get());
+
+		uint32_t buf_written = 0;
+		f.Write(*buf, &buf_written);
+
+		ok = (buf_written == buf->Size());
+	} else
+	{
+		uint64_t bytes_written = 0;
+		f.Write(file->data.data(), static_cast<uint64_t>(file->data.size()), &bytes_written);
+
+		ok = (bytes_written == file->data.size());
+	}
+
+	ok = f.Flush() && ok;
+
+	f.Close();
+
+	// The old file stays if the new one is not complete
+	if (!ok || !Core::File::MoveFile(tmp_name, name))
+	{
+		printf(FG_BRIGHT_RED "Can't write file: %s\n" FG_DEFAULT, name.C_Str());
+		Core::File::DeleteFile(tmp_name);
+		return;
+	}
+
+	// The file was saved in the other mode before
+	if (Core::File::IsFileExisting(old_name))
+	{
+		Core::File::DeleteFile(old_name);
+	}
+}
+
+void SaveDataBuffer::Flush(MountInfo* m, bool free)
+{
+	uint32_t num = 0;
+
+	FOR_HASH (m->files)
+	{
+		auto* file = m->files.Value();
+
+		file->mutex.Lock();
+
+		if (file->dirty)
+		{
+			Save(m->files.Key(), file);
+			file->dirty = false;
+			num++;
+		}
+
+		file->mutex.Unlock();
+
+		if (free)
+		{
+			delete file;
+		}
+	}
+
+	if (num != 0)
+	{
+		printf("SaveData: %u files written to %s\n", num, m->dir.C_Str());
+	}
+
+	if (free)
+	{
+		delete m;
+	}
+}
+
+static void sec_to_timespec(KernelTimespec* ts, double sec)
+{
+	ts->tv_sec  = static_cast<int64_t>(sec);
+	ts->tv_nsec = static_cast<int64_t>((sec - static_cast<double>(ts->tv_sec)) * 1000000000.0);
+}
+
+static uint64_t map_read(const File* file, void* buf, uint64_t nbytes, uint64_t offset)
+{
+	if (offset >= file->map_size)
+	{
+		return 0;
+	}
+
+	auto size = std::min(nbytes, file->map_size - offset);
+	memcpy(buf, file->map_data + offset, size);
+
+	return size;
+}
+
+// A read which starts where the previous one ended asks the host to fetch the data after it in the background
+static void read_ahead(File* file, uint64_t offset, uint64_t nbytes)
+{
+	auto end = offset + nbytes;
+
+	if (file->read_end.exchange(end, std::memory_order_relaxed) == offset && end > file->read_ahead_end.load(std::memory_order_relaxed))
+	{
+		auto size = std::max(nbytes * 4, READ_AHEAD_MIN);
+		file->f.WillNeed(end, size);
+		file->read_ahead_end.store(end + size, std::memory_order_relaxed);
+	}
+}
+
+static uint64_t positional_read(File* file, void* buf, uint64_t nbytes, uint64_t offset)
+{
+	if (file->map_data != nullptr)
+	{
+		return map_read(file, buf, nbytes, offset);
+	}
+
+	read_ahead(file, offset, nbytes);
+
+	uint64_t bytes_read = 0;
+	file->f.ReadAt(buf, nbytes, offset, &bytes_read);
+
+	return bytes_read;
+}
+
+// Core::File reads at most 4 GB at once
+static uint64_t buffered_read(File* file, void* buf, uint64_t nbytes)
+{
+	uint64_t total = 0;
+
+	while (total < nbytes)
+	{
+		auto     size = static_cast<uint32_t>(std::min(nbytes - total, static_cast<uint64_t>(UINT32_MAX)));
+		uint32_t read = 0;
+		file->f.Read(static_cast<uint8_t*>(buf) + total, size, &read);
+		total += read;
+		if (read != size)
+		{
+			break;
+		}
+	}
+
+	return total;
+}
+
+static uint64_t save_data_read(File* file, void* buf, uint64_t nbytes, uint64_t offset)
+{
+	auto* save_data = file->save_data;
+
+	Core::LockGuard lock(save_data->mutex);
+
+	if (offset >= save_data->data.size())
+	{
+		return 0;
+	}
+
+	auto size = std::min(nbytes, save_data->data.size() - offset);
+	memcpy(buf, save_data->data.data() + offset, size);
+
+	return size;
+}
+
+static uint32_t save_data_write(File* file, const void* buf, uint32_t nbytes, uint64_t offset)
+{
+	auto* save_data = file->save_data;
+
+	Core::LockGuard lock(save_data->mutex);
+
+	if (offset + nbytes > save_data->data.size())
+	{
+		save_data->data.resize(offset + nbytes);
+	}
+
+	memcpy(save_data->data.data() + offset, buf, nbytes);
+
+	save_data->dirty = true;
+	save_data->write = Core::DateTime::FromSystemUTC();
+
+	return nbytes;
+}
+
+static uint64_t save_data_size(File* file)
+{
+	Core::LockGuard lock(file->save_data->mutex);
+
+	return file->save_data->data.size();
+}
+
+FileDescriptors::Slot* FileDescriptors::GetSlot(uint32_t index)
+{
+	auto chunk = index / CHUNK_SIZE;
+
+	if (chunk >= CHUNKS_MAX)
+	{
+		return nullptr;
+	}
+
+	auto* slots = m_chunks[chunk].load(std::memory_order_acquire);
+
+	return (slots != nullptr ? slots + index % CHUNK_SIZE : nullptr);
+}
+
+static uint32_t fd_lowest_bit(uint64_t i)
+{
+#if KYTY_COMPILER == KYTY_COMPILER_MSVC
+	unsigned long temp = 0;
+	_BitScanForward64(&temp, i);
+	return temp;
+#else
+	return __builtin_ctzll(i);
+#endif
+}
+
+void FileDescriptors::SetFree(uint32_t index)
+{
+	m_free_bits[index / 64] |= (1ull << (index % 64));
+	m_free_words[index / 4096] |= (1ull << ((index / 64) % 64));
+}
+
+bool FileDescriptors::FindFree(uint32_t* index)
+{
+	for (uint32_t i = 0; i < SLOTS_MAX / 64 / 64; i++)
+	{
+		if (m_free_words[i] != 0)
+		{
+			uint32_t word = i * 64 + fd_lowest_bit(m_free_words[i]);
+			uint32_t bit  = fd_lowest_bit(m_free_bits[word]);
 
-static MountPoints*     g_mount_points = nullptr;
-static FileDescriptors* g_files        = nullptr;
+			m_free_bits[word] &= ~(1ull << bit);
+			if (m_free_bits[word] == 0)
+			{
+				m_free_words[i] &= ~(1ull << (word % 64));
+			}
 
-static void sec_to_timespec(KernelTimespec* ts, double sec)
+			*index = word * 64 + bit;
+			return true;
+		}
+	}
+	return false;
+}
+
+void FileDescriptors::RemoveName(int d, const File* file)
 {
-	ts->tv_sec  = static_cast<int64_t>(sec);
-	ts->tv_nsec = static_cast<int64_t>((sec - static_cast<double>(ts->tv_sec)) * 1000000000.0);
+	if (m_names.Contains(file->real_name))
+	{
+		auto& ds = m_names[file->real_name];
+		ds.Remove(d);
+		if (ds.IsEmpty())
+		{
+			m_names.Remove(file->real_name);
+		}
+	}
 }
 
+// Returns KERNEL_ERROR_EMFILE when all descriptors are in use
 int FileDescriptors::CreateDescriptor()
 {
 	Core::LockGuard lock(m_mutex);
 
-	auto* file      = new File {};
-	file->opened    = false;
-	file->directory = false;
+	uint32_t index = 0;
 
-	int files_num = static_cast<int>(m_files.Size());
-	for (int index = 0; index < files_num; index++)
+	if (!FindFree(&index))
 	{
-		if (m_files.At(index) == nullptr)
+		index      = m_slots_num;
+		auto chunk = index / CHUNK_SIZE;
+
+		if (chunk >= CHUNKS_MAX)
+		{
+			return KERNEL_ERROR_EMFILE;
+		}
+
+		if (index % CHUNK_SIZE == 0)
 		{
-			m_files[index] = file;
-			return index + DESCRIPTOR_MIN;
+			auto* slots = new Slot[CHUNK_SIZE];
+			for (uint32_t i = 0; i < CHUNK_SIZE; i++)
+			{
+				slots[i].store(nullptr, std::memory_order_relaxed);
+			}
+			m_chunks[chunk].store(slots, std::memory_order_release);
 		}
+
+		m_slots_num++;
 	}
 
-	m_files.Add(file);
-	return static_cast<int>(m_files.Size()) + DESCRIPTOR_MIN - 1;
+	auto* file      = new File {};
+	file->opened    = false;
+	file->directory = false;
+
+	GetSlot(index)->store(file, std::memory_order_release);
+
+	return static_cast<int>(index) + DESCRIPTOR_MIN;
 }
 
 void FileDescriptors::DeleteDescriptor(int d)
 {
 	Core::LockGuard lock(m_mutex);
 
-	auto index = static_cast<uint32_t>(d - DESCRIPTOR_MIN);
+	auto  index = static_cast<uint32_t>(d - DESCRIPTOR_MIN);
+	auto* slot  = (index < m_slots_num ? GetSlot(index) : nullptr);
 
-	EXIT_IF(!m_files.IndexValid(index));
-	EXIT_IF(m_files.At(index) == nullptr);
-	EXIT_IF(m_files.At(index)->opened);
+	EXIT_IF(slot == nullptr);
 
-	delete m_files.At(index);
-	m_files[index] = nullptr;
+	auto* file = slot->load(std::memory_order_relaxed);
+
+	EXIT_IF(file == nullptr);
+	EXIT_IF(file->opened);
+
+	RemoveName(d, file);
+
+	slot->store(nullptr, std::memory_order_release);
+	delete file;
+
+	SetFree(index);
 }
 
-File* FileDescriptors::GetFile(int d)
+void FileDescriptors::SetRealName(int d, const String& real_name)
 {
 	Core::LockGuard lock(m_mutex);
 
-	auto index = static_cast<uint32_t>(d - DESCRIPTOR_MIN);
+	auto* file = GetFile(d);
+
+	EXIT_IF(file == nullptr);
+	EXIT_IF(!file->real_name.IsEmpty());
+
+	file->real_name = real_name;
+	m_names[real_name].Add(d);
+}
+
+File* FileDescriptors::GetFile(int d)
+{
+	auto  index = static_cast<uint32_t>(d - DESCRIPTOR_MIN);
+	auto* slot  = GetSlot(index);
 
-	EXIT_IF(!m_files.IndexValid(index));
+	EXIT_IF(slot == nullptr);
 
-	return m_files.At(index);
+	return slot->load(std::memory_order_acquire);
 }
 
 File* FileDescriptors::GetFile(const String& real_name)
 {
 	Core::LockGuard lock(m_mutex);
 
-	for (auto* f: m_files)
+	if (const auto* ds = m_names.Find(real_name); ds != nullptr && !ds->IsEmpty())
 	{
-		if (f != nullptr && f->real_name == real_name)
-		{
-			return f;
-		}
+		return GetFile(ds->At(0));
 	}
 
 	return nullptr;
@@ -152,13 +1097,17 @@ void FileDescriptors::CloseAll()
 {
 	Core::LockGuard lock(m_mutex);
 
-	for (auto& f: m_files)
+	for (uint32_t index = 0; index < m_slots_num; index++)
 	{
+		auto* slot = GetSlot(index);
+		auto* f    = slot->load(std::memory_order_relaxed);
 		if (f != nullptr && f->opened)
 		{
 			f->f.Close();
+			RemoveName(static_cast<int>(index) + DESCRIPTOR_MIN, f);
+			slot->store(nullptr, std::memory_order_release);
 			delete f;
-			f = nullptr;
+			SetFree(index);
 		}
 	}
 }
@@ -178,6 +1127,8 @@ void MountPoints::Mount(const String& folder, const String& point)
 	p.point = point_str;
 
 	m_mount_pairs.Add(p);
+
+	ResetCache();
 }
 
 void MountPoints::Umount(const String& folder_or_point)
@@ -192,48 +1143,161 @@ void MountPoints::Umount(const String& folder_or_point)
 	{
 		m_mount_pairs.RemoveAt(index);
 	}
+
+	ResetCache();
 }
 
-String MountPoints::GetRealFilename(const String& mounted_file_name)
+void MountPoints::ResetCache()
+{
+	Core::LockGuard lock(m_mutex);
+
+	m_real_filenames.Clear();
+	m_real_directories.Clear();
+}
+
+// The guest file system is case-insensitive. If the host one is not, a missing path is looked up again ignoring the case.
+static String fix_case(const String& dir, const String& name)
+{
+	auto real_name = dir + name;
+
+#if KYTY_PLATFORM != KYTY_PLATFORM_WINDOWS
+	if (name.IsEmpty() || Core::File::IsFileExisting(real_name) || Core::File::IsDirectoryExisting(real_name))
+	{
+		return real_name;
+	}
+
+	auto   parts = name.FixFilenameSlash().Split(U'/');
+	String fixed = dir;
+
+	for (uint32_t i = 0; i < parts.Size(); i++)
+	{
+		const auto& part = parts.At(i);
+		bool        last = (i + 1 == parts.Size());
+
+		String found;
+		if (Core::File::IsDirectoryExisting(fixed + part) || (last && Core::File::IsFileExisting(fixed + part)))
+		{
+			found = part;
+		} else
+		{
+			for (const auto& e: Core::File::GetDirEntries(fixed))
+			{
+				if (e.name.EqualNoCase(part) && (last || !e.is_file))
+				{
+					found = e.name;
+					break;
+				}
+			}
+		}
+
+		if (found.IsEmpty())
+		{
+			return real_name;
+		}
+
+		fixed += (last ? found : found + U"/");
+	}
+
+	if (name.EndsWith(U'/'))
+	{
+		fixed += U"/";
+	}
+
+	return fixed;
+#else
+	return real_name;
+#endif
+}
+
+String MountPoints::GetRealFilename(Core::StringView8 mounted_file_name_utf8)
 {
 	Core::LockGuard lock(m_mutex);
 
+	if (const auto* cached = m_real_filenames.FindEquivalent(mounted_file_name_utf8); cached != nullptr)
+	{
+		return *cached;
+	}
+
+	auto mounted_file_name = mounted_file_name_utf8.ToString();
+
 	auto mounted_path = mounted_file_name.FixFilenameSlash().DirectoryWithoutFilename();
+	auto real_name    = mounted_file_name;
 
 	if (auto index = m_mount_pairs.Find(mounted_path, [](const MountPair& p, const String& s) { return s.StartsWith(p.point); });
 	    m_mount_pairs.IndexValid(index))
 	{
 		const auto& p = m_mount_pairs.At(index);
-		return p.dir + mounted_file_name.RemoveFirst(p.point.Size());
+		real_name     = fix_case(p.dir, mounted_file_name.RemoveFirst(p.point.Size()));
 	}
 
-	return mounted_file_name;
+	if (m_real_filenames.Size() >= CACHE_MAX)
+	{
+		m_real_filenames.Clear();
+	}
+	m_real_filenames.Put(mounted_file_name_utf8.ToString8(), real_name);
+
+	return real_name;
 }
 
-String MountPoints::GetRealDirectory(const String& mounted_directory)
+String MountPoints::GetRealDirectory(Core::StringView8 mounted_directory_utf8)
 {
 	Core::LockGuard lock(m_mutex);
 
+	if (const auto* cached = m_real_directories.FindEquivalent(mounted_directory_utf8); cached != nullptr)
+	{
+		return *cached;
+	}
+
+	auto mounted_directory = mounted_directory_utf8.ToString();
+
 	auto mounted_path = mounted_directory.FixDirectorySlash();
+	auto real_name    = mounted_directory;
 
 	if (auto index = m_mount_pairs.Find(mounted_path, [](const MountPair& p, const String& s) { return s.StartsWith(p.point); });
 	    m_mount_pairs.IndexValid(index))
 	{
 		const auto& p = m_mount_pairs.At(index);
-		return p.dir + mounted_directory.RemoveFirst(p.point.Size());
+		real_name     = fix_case(p.dir, mounted_directory.RemoveFirst(p.point.Size()));
 	}
 
-	return mounted_directory;
+	if (m_real_directories.Size() >= CACHE_MAX)
+	{
+		m_real_directories.Clear();
+	}
+	m_real_directories.Put(mounted_directory_utf8.ToString8(), real_name);
+
+	return real_name;
+}
+
+String MountPoints::GetRealFilename(const String& mounted_file_name)
+{
+	return GetRealFilename(Core::StringView8(mounted_file_name.C_Str()));
+}
+
+String MountPoints::GetRealDirectory(const String& mounted_directory)
+{
+	return GetRealDirectory(Core::StringView8(mounted_directory.C_Str()));
 }
 
 KYTY_SUBSYSTEM_INIT(FileSystem)
 {
 	g_mount_points = new MountPoints;
 	g_files        = new FileDescriptors;
+	g_dir_cache    = new DirectoryCache;
+	g_prefetch     = new ChunkPrefetch;
+	g_save_data    = new SaveDataBuffer;
 }
 
 KYTY_SUBSYSTEM_UNEXPECTED_SHUTDOWN(FileSystem)
 {
+	if (g_prefetch != nullptr)
+	{
+		g_prefetch->Save();
+	}
+	if (g_save_data != nullptr)
+	{
+		g_save_data->FlushAll();
+	}
 	if (g_files != nullptr)
 	{
 		g_files->CloseAll();
@@ -242,6 +1306,14 @@ KYTY_SUBSYSTEM_UNEXPECTED_SHUTDOWN(FileSystem)
 
 KYTY_SUBSYSTEM_DESTROY(FileSystem)
 {
+	if (g_prefetch != nullptr)
+	{
+		g_prefetch->Save();
+	}
+	if (g_save_data != nullptr)
+	{
+		g_save_data->FlushAll();
+	}
 	if (g_files != nullptr)
 	{
 		g_files->CloseAll();
@@ -255,11 +1327,26 @@ void Mount(const String& folder, const String& point)
 	g_mount_points->Mount(folder, point);
 }
 
-void Umount(const String& folder_or_point)
+void MountWriteBehind(const String& folder, const String& point)
 {
-	EXIT_IF(g_mount_points == nullptr);
+	EXIT_IF(g_mount_points == nullptr || g_save_data == nullptr);
+
+	g_mount_points->Mount(folder, point);
+	g_save_data->Mount(folder, point);
+}
+
+int Umount(const String& folder_or_point)
+{
+	EXIT_IF(g_mount_points == nullptr || g_save_data == nullptr);
+
+	if (int result = g_save_data->Umount(folder_or_point); result != OK)
+	{
+		return result;
+	}
 
 	g_mount_points->Umount(folder_or_point);
+
+	return OK;
 }
 
 String GetRealFilename(const String& mounted_file_name)
@@ -269,10 +1356,20 @@ String GetRealFilename(const String& mounted_file_name)
 	return g_mount_points->GetRealFilename(mounted_file_name);
 }
 
+void PrefetchChunk(uint16_t chunk_id)
+{
+	EXIT_IF(g_prefetch == nullptr);
+
+	if (Config::FilePrefetchEnabled())
+	{
+		g_prefetch->ChunkQueried(chunk_id);
+	}
+}
+
 // NOLINTNEXTLINE(readability-function-cognitive-complexity)
 int KYTY_SYSV_ABI KernelOpen(const char* path, int flags, uint16_t mode)
 {
-	PRINT_NAME();
+	TRACE_NAME(FileSystem);
 
 	EXIT_IF(g_mount_points == nullptr || g_files == nullptr);
 
@@ -283,9 +1380,9 @@ int KYTY_SYSV_ABI KernelOpen(const char* path, int flags, uint16_t mode)
 
 	auto flags_u = static_cast<uint32_t>(flags);
 
-	printf("\t path = %s\n", path);
-	printf("\t flags = %08" PRIx32 "\n", flags_u);
-	printf("\t mode = %04" PRIx16 "\n", mode);
+	TRACE(FileSystem, "\t path = %s\n", path);
+	TRACE(FileSystem, "\t flags = %08" PRIx32 "\n", flags_u);
+	TRACE(FileSystem, "\t mode = %04" PRIx16 "\n", mode);
 
 	bool nonblock  = (flags_u & 0x0004u) != 0;
 	bool append    = (flags_u & 0x0008u) != 0;
@@ -317,20 +1414,30 @@ int KYTY_SYSV_ABI KernelOpen(const char* path, int flags, uint16_t mode)
 	EXIT_NOT_IMPLEMENTED(directory && rw_mode != Core::File::Mode::Read);
 	EXIT_NOT_IMPLEMENTED(directory && (trunc || creat));
 
-	int   descriptor = g_files->CreateDescriptor();
-	auto* file       = g_files->GetFile(descriptor);
+	int descriptor = g_files->CreateDescriptor();
+
+	if (descriptor < 0)
+	{
+		return descriptor;
+	}
+
+	auto* file = g_files->GetFile(descriptor);
 
 	EXIT_IF(file == nullptr || file->opened || file->directory);
 
-	file->name      = path;
-	file->real_name = (directory ? g_mount_points->GetRealDirectory(file->name) : g_mount_points->GetRealFilename(file->name));
+	Core::StringView8 path_utf8(path);
+
+	file->name = path;
+	g_files->SetRealName(descriptor,
+	                     (directory ? g_mount_points->GetRealDirectory(path_utf8) : g_mount_points->GetRealFilename(path_utf8)));
 
 	if (trunc && rw_mode == Core::File::Mode::Read)
 	{
 		return KERNEL_ERROR_EACCES;
 	}
 
-	bool dir_exist = Core::File::IsDirectoryExisting(file->real_name);
+	bool cached    = DirectoryCache::IsCached(file->name);
+	bool dir_exist = (cached ? g_dir_cache->GetFileInfo(file->real_name).is_dir : Core::File::IsDirectoryExisting(file->real_name));
 
 	if (directory || dir_exist)
 	{
@@ -343,17 +1450,51 @@ int KYTY_SYSV_ABI KernelOpen(const char* path, int flags, uint16_t mode)
 		EXIT_NOT_IMPLEMENTED(!directory && rw_mode != Core::File::Mode::Read);
 		EXIT_NOT_IMPLEMENTED(!directory && (trunc || creat));
 
-		file->dents       = Core::File::GetDirEntries(file->real_name);
+		file->dents       = (cached ? g_dir_cache->GetDirEntries(file->real_name) : Core::File::GetDirEntries(file->real_name));
 		file->dents_index = 0;
 		file->directory   = true;
 
-		printf("\tOpen dir: " FG_WHITE BOLD "%s" DEFAULT ", entries = %" PRIu32 ", " FG_GREEN "[ok]" FG_DEFAULT "\n",
-		       file->real_name.C_Str(), file->dents.Size());
+		g_save_data->PatchDirEntries(file->real_name, &file->dents);
+
+		TRACE(FileSystem, "\tOpen dir: " FG_WHITE BOLD "%s" DEFAULT ", entries = %" PRIu32 ", " FG_GREEN "[ok]" FG_DEFAULT "\n",
+		      file->real_name.C_Str(), file->dents.Size());
 
 		for (const auto& f: file->dents)
 		{
-			printf("\t\t%s %s\n", f.is_file ? "[file]" : "[dir ]", f.name.C_Str());
+			TRACE(FileSystem, "\t\t%s %s\n", f.is_file ? "[file]" : "[dir ]", f.name.C_Str());
+		}
+	} else if (auto* save_data = g_save_data->Open(file->real_name); save_data != nullptr)
+	{
+		EXIT_NOT_IMPLEMENTED(creat && !trunc);
+
+		save_data->mutex.Lock();
+
+		bool result = (save_data->exists || creat);
+		bool broken = (save_data->broken && !trunc);
+
+		if (result && trunc)
+		{
+			save_data->data.clear();
+			save_data->exists = true;
+			save_data->broken = false;
+			save_data->dirty  = true;
+			save_data->write  = Core::DateTime::FromSystemUTC();
+		}
+
+		save_data->mutex.Unlock();
+
+		TRACE(FileSystem, "\tOpen in memory: " FG_WHITE BOLD "%s" DEFAULT ", %s\n", file->real_name.C_Str(),
+		      (result && !broken ? FG_GREEN "[ok]" FG_DEFAULT : FG_RED "[fail]" FG_DEFAULT));
+
+		if (!result || broken)
+		{
+			g_save_data->Close(save_data);
+			g_files->DeleteDescriptor(descriptor);
+			return (broken ? KERNEL_ERROR_EIO : KERNEL_ERROR_EACCES);
 		}
+
+		file->save_data = save_data;
+		file->pos       = 0;
 	} else
 	{
 		bool result = false;
@@ -362,14 +1503,16 @@ int KYTY_SYSV_ABI KernelOpen(const char* path, int flags, uint16_t mode)
 		{
 			result = file->f.Create(file->real_name);
 
-			printf("\tCreate: " FG_WHITE BOLD "%s" DEFAULT ", %s\n", file->real_name.C_Str(),
-			       (result ? FG_GREEN "[ok]" FG_DEFAULT : FG_RED "[fail]" FG_DEFAULT));
+			g_mount_points->ResetCache();
+
+			TRACE(FileSystem, "\tCreate: " FG_WHITE BOLD "%s" DEFAULT ", %s\n", file->real_name.C_Str(),
+			      (result ? FG_GREEN "[ok]" FG_DEFAULT : FG_RED "[fail]" FG_DEFAULT));
 		} else
 		{
 			result = file->f.Open(file->real_name, rw_mode);
 
-			printf("\tOpen: " FG_WHITE BOLD "%s" DEFAULT ", %s\n", file->real_name.C_Str(),
-			       (result ? FG_GREEN "[ok]" FG_DEFAULT : FG_RED "[fail]" FG_DEFAULT));
+			TRACE(FileSystem, "\tOpen: " FG_WHITE BOLD "%s" DEFAULT ", %s\n", file->real_name.C_Str(),
+			      (result ? FG_GREEN "[ok]" FG_DEFAULT : FG_RED "[fail]" FG_DEFAULT));
 		}
 
 		EXIT_NOT_IMPLEMENTED(creat && !trunc);
@@ -386,13 +1529,31 @@ int KYTY_SYSV_ABI KernelOpen(const char* path, int flags, uint16_t mode)
 		}
 	}
 
+	if (rw_mode == Core::File::Mode::Read && !creat && !file->directory && file->save_data == nullptr)
+	{
+		file->read_only = true;
+		file->pos       = 0;
+
+		if (Config::FileMappingEnabled() && file->name.StartsWith(U"/app0/"))
+		{
+			uint64_t size  = 0;
+			file->map_data = static_cast<const uint8_t*>(file->f.Map(&size));
+			file->map_size = size;
+		}
+
+		if (Config::FilePrefetchEnabled() && file->name.StartsWith(U"/app0/"))
+		{
+			g_prefetch->FileOpened(file->name);
+		}
+	}
+
 	file->opened = true;
 	return descriptor;
 }
 
 int KYTY_SYSV_ABI KernelClose(int d)
 {
-	PRINT_NAME();
+	TRACE_NAME(FileSystem);
 
 	EXIT_IF(g_files == nullptr);
 
@@ -410,14 +1571,19 @@ int KYTY_SYSV_ABI KernelClose(int d)
 
 	EXIT_IF(!file->opened);
 
-	if (!file->directory)
+	if (file->save_data != nullptr)
+	{
+		g_save_data->Close(file->save_data);
+		file->save_data = nullptr;
+	} else if (!file->directory)
 	{
+		file->map_data = nullptr;
 		file->f.Close();
 	}
 
 	file->opened = false;
 
-	printf("\tClose: " FG_WHITE BOLD "%s" DEFAULT "\n", file->real_name.C_Str());
+	TRACE(FileSystem, "\tClose: " FG_WHITE BOLD "%s" DEFAULT "\n", file->real_name.C_Str());
 
 	g_files->DeleteDescriptor(d);
 
@@ -426,7 +1592,7 @@ int KYTY_SYSV_ABI KernelClose(int d)
 
 int64_t KYTY_SYSV_ABI KernelRead(int d, void* buf, size_t nbytes)
 {
-	PRINT_NAME();
+	TRACE_NAME_LIMITED(FileSystem);
 
 	EXIT_IF(g_files == nullptr);
 
@@ -451,30 +1617,65 @@ int64_t KYTY_SYSV_ABI KernelRead(int d, void* buf, size_t nbytes)
 
 	EXIT_IF(!file->opened);
 
-	EXIT_NOT_IMPLEMENTED(nbytes > UINT_MAX);
+	// The host read fails instead of faulting when the buffer is watched
+	Graphics::GpuMemoryCheckAccessViolation(reinterpret_cast<uint64_t>(buf), nbytes);
 
-	file->mutex.Lock();
+	bool     is_invalid = false;
+	uint64_t bytes_read = 0;
+
+	if (file->save_data != nullptr)
+	{
+		file->mutex.Lock();
 
-	bool     is_invalid = file->f.IsInvalid();
-	uint32_t bytes_read = 0;
-	file->f.Read(buf, static_cast<uint32_t>(nbytes), &bytes_read);
+		bytes_read = save_data_read(file, buf, nbytes, file->pos);
+		file->pos += bytes_read;
 
-	file->mutex.Unlock();
+		file->mutex.Unlock();
+	} else if (file->map_data != nullptr)
+	{
+		file->mutex.Lock();
+
+		auto pos = file->pos;
+		if (pos < file->map_size)
+		{
+			file->pos = pos + std::min(nbytes, file->map_size - pos);
+		}
+
+		file->mutex.Unlock();
+
+		bytes_read = map_read(file, buf, nbytes, pos);
+	} else if (file->read_only)
+	{
+		file->mutex.Lock();
+
+		bytes_read = positional_read(file, buf, nbytes, file->pos);
+		file->pos += bytes_read;
+
+		file->mutex.Unlock();
+	} else
+	{
+		file->mutex.Lock();
+
+		is_invalid = file->f.IsInvalid();
+		bytes_read = buffered_read(file, buf, nbytes);
+
+		file->mutex.Unlock();
+	}
 
 	if (is_invalid)
 	{
-		printf("\tfile is invalid\n");
+		TRACE_LIMITED(FileSystem, "\tfile is invalid\n");
 		return KERNEL_ERROR_EIO;
 	}
 
-	printf("\tRead %u bytes from: " FG_WHITE BOLD "%s" DEFAULT "\n", bytes_read, file->real_name.C_Str());
+	TRACE_LIMITED(FileSystem, "\tRead %" PRIu64 " bytes from: " FG_WHITE BOLD "%s" DEFAULT "\n", bytes_read, file->real_name.C_Str());
 
-	return bytes_read;
+	return static_cast<int64_t>(bytes_read);
 }
 
 int64_t KYTY_SYSV_ABI KernelWrite(int d, const void* buf, size_t nbytes)
 {
-	PRINT_NAME();
+	TRACE_NAME_LIMITED(FileSystem);
 
 	EXIT_IF(g_files == nullptr);
 
@@ -503,26 +1704,35 @@ int64_t KYTY_SYSV_ABI KernelWrite(int d, const void* buf, size_t nbytes)
 
 	file->mutex.Lock();
 
-	bool     is_invalid    = file->f.IsInvalid();
+	bool     is_invalid    = false;
 	uint32_t bytes_written = 0;
-	file->f.Write(buf, static_cast<uint32_t>(nbytes), &bytes_written);
+
+	if (file->save_data != nullptr)
+	{
+		bytes_written = save_data_write(file, buf, static_cast<uint32_t>(nbytes), file->pos);
+		file->pos += bytes_written;
+	} else
+	{
+		is_invalid = file->f.IsInvalid();
+		file->f.Write(buf, static_cast<uint32_t>(nbytes), &bytes_written);
+	}
 
 	file->mutex.Unlock();
 
 	if (is_invalid)
 	{
-		printf("\tfile is invalid\n");
+		TRACE_LIMITED(FileSystem, "\tfile is invalid\n");
 		return KERNEL_ERROR_EIO;
 	}
 
-	printf("\tWrite %u bytes to: " FG_WHITE BOLD "%s" DEFAULT "\n", bytes_written, file->real_name.C_Str());
+	TRACE_LIMITED(FileSystem, "\tWrite %u bytes to: " FG_WHITE BOLD "%s" DEFAULT "\n", bytes_written, file->real_name.C_Str());
 
 	return bytes_written;
 }
 
 int64_t KYTY_SYSV_ABI KernelPread(int d, void* buf, size_t nbytes, int64_t offset)
 {
-	PRINT_NAME();
+	TRACE_NAME_LIMITED(FileSystem);
 
 	EXIT_IF(g_files == nullptr);
 
@@ -552,33 +1762,46 @@ int64_t KYTY_SYSV_ABI KernelPread(int d, void* buf, size_t nbytes, int64_t offse
 
 	EXIT_IF(!file->opened);
 
-	EXIT_NOT_IMPLEMENTED(nbytes > UINT_MAX);
+	// The host read fails instead of faulting when the buffer is watched
+	Graphics::GpuMemoryCheckAccessViolation(reinterpret_cast<uint64_t>(buf), nbytes);
 
-	file->mutex.Lock();
+	bool     is_invalid = false;
+	uint64_t bytes_read = 0;
+
+	if (file->save_data != nullptr)
+	{
+		bytes_read = save_data_read(file, buf, nbytes, offset);
+	} else if (file->read_only)
+	{
+		bytes_read = positional_read(file, buf, nbytes, offset);
+	} else
+	{
+		file->mutex.Lock();
 
-	bool     is_invalid = file->f.IsInvalid();
-	auto     pos        = file->f.Tell();
-	uint32_t bytes_read = 0;
-	file->f.Seek(offset);
-	file->f.Read(buf, static_cast<uint32_t>(nbytes), &bytes_read);
-	file->f.Seek(pos);
+		is_invalid = file->f.IsInvalid();
+		auto pos   = file->f.Tell();
+		file->f.Seek(offset);
+		bytes_read = buffered_read(file, buf, nbytes);
+		file->f.Seek(pos);
 
-	file->mutex.Unlock();
+		file->mutex.Unlock();
+	}
 
 	if (is_invalid)
 	{
-		printf("\tfile is invalid\n");
+		TRACE_LIMITED(FileSystem, "\tfile is invalid\n");
 		return KERNEL_ERROR_EIO;
 	}
 
-	printf("\tRead %u bytes (pos = %" PRId64 ") from: " FG_WHITE BOLD "%s" DEFAULT "\n", bytes_read, offset, file->real_name.C_Str());
+	TRACE_LIMITED(FileSystem, "\tRead %" PRIu64 " bytes (pos = %" PRId64 ") from: " FG_WHITE BOLD "%s" DEFAULT "\n", bytes_read, offset,
+	              file->real_name.C_Str());
 
-	return bytes_read;
+	return static_cast<int64_t>(bytes_read);
 }
 
 int64_t KYTY_SYSV_ABI KernelPwrite(int d, const void* buf, size_t nbytes, int64_t offset)
 {
-	PRINT_NAME();
+	TRACE_NAME_LIMITED(FileSystem);
 
 	EXIT_IF(g_files == nullptr);
 
@@ -610,31 +1833,40 @@ int64_t KYTY_SYSV_ABI KernelPwrite(int d, const void* buf, size_t nbytes, int64_
 
 	EXIT_NOT_IMPLEMENTED(nbytes > UINT_MAX);
 
-	file->mutex.Lock();
-
-	bool     is_invalid    = file->f.IsInvalid();
-	auto     pos           = file->f.Tell();
+	bool     is_invalid    = false;
 	uint32_t bytes_written = 0;
-	file->f.Seek(offset);
-	file->f.Write(buf, static_cast<uint32_t>(nbytes), &bytes_written);
-	file->f.Seek(pos);
 
-	file->mutex.Unlock();
+	if (file->save_data != nullptr)
+	{
+		bytes_written = save_data_write(file, buf, static_cast<uint32_t>(nbytes), offset);
+	} else
+	{
+		file->mutex.Lock();
+
+		is_invalid = file->f.IsInvalid();
+		auto pos   = file->f.Tell();
+		file->f.Seek(offset);
+		file->f.Write(buf, static_cast<uint32_t>(nbytes), &bytes_written);
+		file->f.Seek(pos);
+
+		file->mutex.Unlock();
+	}
 
 	if (is_invalid)
 	{
-		printf("\tfile is invalid\n");
+		TRACE_LIMITED(FileSystem, "\tfile is invalid\n");
 		return KERNEL_ERROR_EIO;
 	}
 
-	printf("\tWrite %u bytes (pos = %" PRId64 ") to: " FG_WHITE BOLD "%s" DEFAULT "\n", bytes_written, offset, file->real_name.C_Str());
+	TRACE_LIMITED(FileSystem, "\tWrite %u bytes (pos = %" PRId64 ") to: " FG_WHITE BOLD "%s" DEFAULT "\n", bytes_written, offset,
+	              file->real_name.C_Str());
 
 	return bytes_written;
 }
 
 int64_t KYTY_SYSV_ABI KernelLseek(int d, int64_t offset, int whence)
 {
-	PRINT_NAME();
+	TRACE_NAME_LIMITED(FileSystem);
 
 	EXIT_IF(g_files == nullptr);
 
@@ -656,17 +1888,26 @@ int64_t KYTY_SYSV_ABI KernelLseek(int d, int64_t offset, int whence)
 
 	file->mutex.Lock();
 
-	bool is_invalid = file->f.IsInvalid();
+	bool is_invalid = (file->save_data == nullptr && file->f.IsInvalid());
+	bool positional = (file->read_only || file->save_data != nullptr);
 
 	if (whence == 1)
 	{
-		offset = static_cast<int64_t>(file->f.Tell()) + offset;
+		offset = static_cast<int64_t>(positional ? file->pos : file->f.Tell()) + offset;
 		whence = 0;
 	}
 
 	if (whence == 2)
 	{
-		offset = static_cast<int64_t>(file->f.Size()) + offset;
+		uint64_t size = 0;
+		if (file->save_data != nullptr)
+		{
+			size = save_data_size(file);
+		} else
+		{
+			size = (file->map_data != nullptr ? file->map_size : file->f.Size());
+		}
+		offset = static_cast<int64_t>(size) + offset;
 		whence = 0;
 	}
 
@@ -674,11 +1915,20 @@ int64_t KYTY_SYSV_ABI KernelLseek(int d, int64_t offset, int whence)
 
 	if (offset < 0)
 	{
+		file->mutex.Unlock();
 		return KERNEL_ERROR_EINVAL;
 	}
 
-	file->f.Seek(offset);
-	auto pos = static_cast<int64_t>(file->f.Tell());
+	int64_t pos = offset;
+
+	if (positional)
+	{
+		file->pos = offset;
+	} else
+	{
+		file->f.Seek(offset);
+		pos = static_cast<int64_t>(file->f.Tell());
+	}
 
 	EXIT_IF(pos != offset);
 
@@ -686,18 +1936,18 @@ int64_t KYTY_SYSV_ABI KernelLseek(int d, int64_t offset, int whence)
 
 	if (is_invalid)
 	{
-		printf("\tfile is invalid\n");
+		TRACE_LIMITED(FileSystem, "\tfile is invalid\n");
 		return KERNEL_ERROR_EIO;
 	}
 
-	printf("\tLseek (pos = %" PRId64 ") to: " FG_WHITE BOLD "%s" DEFAULT "\n", offset, file->real_name.C_Str());
+	TRACE_LIMITED(FileSystem, "\tLseek (pos = %" PRId64 ") to: " FG_WHITE BOLD "%s" DEFAULT "\n", offset, file->real_name.C_Str());
 
 	return pos;
 }
 
 int KYTY_SYSV_ABI KernelStat(const char* path, FileStat* sb)
 {
-	PRINT_NAME();
+	TRACE_NAME(FileSystem);
 
 	EXIT_IF(g_mount_points == nullptr);
 
@@ -706,18 +1956,40 @@ int KYTY_SYSV_ABI KernelStat(const char* path, FileStat* sb)
 		return KERNEL_ERROR_EINVAL;
 	}
 
-	printf("\t KernelStat: %s\n", path);
+	TRACE(FileSystem, "\t KernelStat: %s\n", path);
+
+	Core::StringView8 path_utf8(path);
+
+	auto real_file_name = g_mount_points->GetRealFilename(path_utf8);
+	auto real_directory = g_mount_points->GetRealDirectory(path_utf8);
 
-	String path_s         = String::FromUtf8(path);
-	auto   real_file_name = g_mount_points->GetRealFilename(path_s);
-	auto   real_directory = g_mount_points->GetRealDirectory(path_s);
+	bool cached    = DirectoryCache::IsCached(path_utf8);
+	auto file_info = (cached ? g_dir_cache->GetFileInfo(real_file_name) : get_file_info(real_file_name));
 
-	bool is_dir  = Core::File::IsDirectoryExisting(real_file_name) || Core::File::IsDirectoryExisting(real_directory);
-	bool is_file = Core::File::IsFileExisting(real_file_name);
+	// The host file may be not written yet or compressed
+	if (auto* save_data = g_save_data->Find(real_file_name); save_data != nullptr && !file_info.is_dir)
+	{
+		Core::LockGuard lock(save_data->mutex);
+
+		if (save_data->broken)
+		{
+			return KERNEL_ERROR_EIO;
+		}
+
+		file_info.is_file = save_data->exists;
+		file_info.size    = save_data->data.size();
+		file_info.access  = save_data->access;
+		file_info.write   = save_data->write;
+	}
+
+	bool is_dir = file_info.is_dir ||
+	              (real_directory != real_file_name &&
+	               (cached ? g_dir_cache->GetFileInfo(real_directory).is_dir : Core::File::IsDirectoryExisting(real_directory)));
+	bool is_file = file_info.is_file;
 
 	if (!is_dir && !is_file)
 	{
-		printf("\t file not found\n");
+		TRACE(FileSystem, "\t file not found\n");
 		return KERNEL_ERROR_ENOENT;
 	}
 
@@ -727,9 +1999,6 @@ int KYTY_SYSV_ABI KernelStat(const char* path, FileStat* sb)
 
 	sb->st_mode = 0000777u | (is_dir ? 0040000u : 0100000u);
 
-	Core::DateTime at;
-	Core::DateTime wt;
-
 	if (is_dir)
 	{
 		sb->st_size    = 0;
@@ -737,15 +2006,13 @@ int KYTY_SYSV_ABI KernelStat(const char* path, FileStat* sb)
 		sb->st_blocks  = 0;
 	} else
 	{
-		sb->st_size    = static_cast<int64_t>(Core::File::Size(real_file_name));
+		sb->st_size    = static_cast<int64_t>(file_info.size);
 		sb->st_blksize = 512;
 		sb->st_blocks  = (sb->st_size + 511) / 512;
-
-		Core::File::GetLastAccessAndWriteTimeUTC(real_file_name, &at, &wt);
 	}
 
-	sec_to_timespec(&sb->st_atim, at.ToUnix());
-	sec_to_timespec(&sb->st_mtim, wt.ToUnix());
+	sec_to_timespec(&sb->st_atim, file_info.access.ToUnix());
+	sec_to_timespec(&sb->st_mtim, file_info.write.ToUnix());
 	sb->st_ctim     = sb->st_atim;
 	sb->st_birthtim = sb->st_mtim;
 
@@ -754,7 +2021,7 @@ int KYTY_SYSV_ABI KernelStat(const char* path, FileStat* sb)
 
 int KYTY_SYSV_ABI KernelFstat(int d, FileStat* sb)
 {
-	PRINT_NAME();
+	TRACE_NAME_LIMITED(FileSystem);
 
 	EXIT_IF(g_files == nullptr);
 
@@ -777,7 +2044,7 @@ int KYTY_SYSV_ABI KernelFstat(int d, FileStat* sb)
 
 	EXIT_IF(!file->opened);
 
-	printf("\tKernelFstat: %s\n", file->real_name.C_Str());
+	TRACE_LIMITED(FileSystem, "\tKernelFstat: %s\n", file->real_name.C_Str());
 
 	memset(sb, 0, sizeof(FileStat));
 
@@ -786,7 +2053,20 @@ int KYTY_SYSV_ABI KernelFstat(int d, FileStat* sb)
 	Core::DateTime at;
 	Core::DateTime wt;
 
-	if (!file->directory)
+	if (file->save_data != nullptr)
+	{
+		file->save_data->mutex.Lock();
+
+		auto size = file->save_data->data.size();
+		at        = file->save_data->access;
+		wt        = file->save_data->write;
+
+		file->save_data->mutex.Unlock();
+
+		sb->st_size    = static_cast<int64_t>(size);
+		sb->st_blksize = 512;
+		sb->st_blocks  = (sb->st_size + 511) / 512;
+	} else if (!file->directory)
 	{
 		file->mutex.Lock();
 
@@ -798,7 +2078,7 @@ int KYTY_SYSV_ABI KernelFstat(int d, FileStat* sb)
 
 		if (is_invalid)
 		{
-			printf("\tfile is invalid\n");
+			TRACE_LIMITED(FileSystem, "\tfile is invalid\n");
 			return KERNEL_ERROR_EIO;
 		}
 
@@ -822,7 +2102,7 @@ int KYTY_SYSV_ABI KernelFstat(int d, FileStat* sb)
 
 int KYTY_SYSV_ABI KernelUnlink(const char* path)
 {
-	PRINT_NAME();
+	TRACE_NAME(FileSystem);
 
 	EXIT_IF(g_mount_points == nullptr);
 	EXIT_IF(g_files == nullptr);
@@ -832,15 +2112,17 @@ int KYTY_SYSV_ABI KernelUnlink(const char* path)
 		return KERNEL_ERROR_EINVAL;
 	}
 
-	auto path_s         = String::FromUtf8(path);
-	auto real_file_name = g_mount_points->GetRealFilename(path_s);
-	auto real_directory = g_mount_points->GetRealDirectory(path_s);
+	Core::StringView8 path_utf8(path);
+
+	auto real_file_name = g_mount_points->GetRealFilename(path_utf8);
+	auto real_directory = g_mount_points->GetRealDirectory(path_utf8);
 
 	EXIT_NOT_IMPLEMENTED(g_files->GetFile(real_file_name) != nullptr);
 	EXIT_NOT_IMPLEMENTED(g_files->GetFile(real_directory) != nullptr);
 
-	bool is_dir  = Core::File::IsDirectoryExisting(real_file_name) || Core::File::IsDirectoryExisting(real_directory);
-	bool is_file = Core::File::IsFileExisting(real_file_name);
+	bool is_dir    = Core::File::IsDirectoryExisting(real_file_name) || Core::File::IsDirectoryExisting(real_directory);
+	auto save_data = (is_dir ? nullptr : g_save_data->Find(real_file_name));
+	bool is_file   = (save_data != nullptr ? save_data->exists : Core::File::IsFileExisting(real_file_name));
 
 	if (is_dir)
 	{
@@ -852,21 +2134,38 @@ int KYTY_SYSV_ABI KernelUnlink(const char* path)
 		return KERNEL_ERROR_ENOENT;
 	}
 
+	if (save_data != nullptr)
+	{
+		// The host file is deleted at the unmount
+		Core::LockGuard lock(save_data->mutex);
+
+		save_data->data.clear();
+		save_data->exists = false;
+		save_data->broken = false;
+		save_data->dirty  = true;
+
+		TRACE(FileSystem, "\tKernelUnlink: %s\n", path);
+
+		return OK;
+	}
+
 	bool ok = Core::File::DeleteFile(real_file_name);
 
+	g_mount_points->ResetCache();
+
 	if (!ok)
 	{
 		return KERNEL_ERROR_EIO;
 	}
 
-	printf("\tKernelUnlink: %s\n", path);
+	TRACE(FileSystem, "\tKernelUnlink: %s\n", path);
 
 	return OK;
 }
 
 int KYTY_SYSV_ABI KernelGetdirentries(int fd, char* buf, int nbytes, int64_t* basep)
 {
-	PRINT_NAME();
+	TRACE_NAME(FileSystem);
 
 	EXIT_IF(g_files == nullptr);
 
@@ -894,9 +2193,9 @@ int KYTY_SYSV_ABI KernelGetdirentries(int fd, char* buf, int nbytes, int64_t* ba
 
 	EXIT_IF(!file->opened);
 
-	printf("\t dir    = %s\n", file->real_name.C_Str());
-	printf("\t nbytes = %d\n", nbytes);
-	printf("\t index = %d\n", file->dents_index);
+	TRACE(FileSystem, "\t dir    = %s\n", file->real_name.C_Str());
+	TRACE(FileSystem, "\t nbytes = %d\n", nbytes);
+	TRACE(FileSystem, "\t index = %d\n", file->dents_index);
 
 	if (basep != nullptr)
 	{
@@ -914,7 +2213,7 @@ int KYTY_SYSV_ABI KernelGetdirentries(int fd, char* buf, int nbytes, int64_t* ba
 	auto str_size = str.Size() - 1;
 	EXIT_NOT_IMPLEMENTED(str_size > 255);
 
-	printf("\t name  = %s\n", str.GetDataConst());
+	TRACE(FileSystem, "\t name  = %s\n", str.GetDataConst());
 
 	*reinterpret_cast<uint32_t*>(buf + 0) = entry.name.Hash();
 	*reinterpret_cast<uint16_t*>(buf + 4) = 512;
@@ -928,14 +2227,14 @@ int KYTY_SYSV_ABI KernelGetdirentries(int fd, char* buf, int nbytes, int64_t* ba
 
 int KYTY_SYSV_ABI KernelGetdents(int fd, char* buf, int nbytes)
 {
-	PRINT_NAME();
+	TRACE_NAME(FileSystem);
 
 	return KernelGetdirentries(fd, buf, nbytes, nullptr);
 }
 
 int KYTY_SYSV_ABI KernelMkdir(const char* path, uint16_t mode)
 {
-	PRINT_NAME();
+	TRACE_NAME(FileSystem);
 
 	EXIT_IF(g_mount_points == nullptr || g_files == nullptr);
 
@@ -944,17 +2243,21 @@ int KYTY_SYSV_ABI KernelMkdir(const char* path, uint16_t mode)
 		return KERNEL_ERROR_EINVAL;
 	}
 
-	printf("\t path = %s\n", path);
-	printf("\t mode = %04" PRIx16 "\n", mode);
+	TRACE(FileSystem, "\t path = %s\n", path);
+	TRACE(FileSystem, "\t mode = %04" PRIx16 "\n", mode);
 
-	String real_name = g_mount_points->GetRealDirectory(String::FromUtf8(path));
+	String real_name = g_mount_points->GetRealDirectory(Core::StringView8(path));
 
 	if (Core::File::IsDirectoryExisting(real_name))
 	{
 		return KERNEL_ERROR_EEXIST;
 	}
 
-	if (!Core::File::CreateDirectory(real_name))
+	bool ok = Core::File::CreateDirectory(real_name);
+
+	g_mount_points->ResetCache();
+
+	if (!ok)
 	{
 		return KERNEL_ERROR_EIO;
 	}
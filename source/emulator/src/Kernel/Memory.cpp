@@ -7,6 +7,7 @@
 #include "Kyty/Core/Vector.h"
 #include "Kyty/Core/VirtualMemory.h"
 
+#include "Emulator/Config.h"
 #include "Emulator/Graphics/GraphicsRun.h"
 #include "Emulator/Graphics/Objects/GpuMemory.h"
 #include "Emulator/Graphics/Window.h"
@@ -14,6 +15,8 @@
 #include "Emulator/Libs/Libs.h"
 
 #include <algorithm>
+#include <iterator>
+#include <map>
 
 #ifdef KYTY_EMU_ENABLED
 
@@ -23,6 +26,8 @@ namespace VirtualMemory = Core::VirtualMemory;
 
 LIB_NAME("libkernel", "libkernel");
 
+// Blocks are ordered by the physical address, mapped blocks are also indexed by the virtual address. Alloc() is first fit over
+// the ordered free ranges.
 class PhysicalMemory
 {
 public:
@@ -38,7 +43,13 @@ public:
 		int                     memory_type;
 	};
 
-	PhysicalMemory() { EXIT_NOT_IMPLEMENTED(!Core::Thread::IsMainThread()); }
+	using BlockMap = std::map<uint64_t, AllocatedBlock>;
+
+	PhysicalMemory()
+	{
+		EXIT_NOT_IMPLEMENTED(!Core::Thread::IsMainThread());
+		m_free[0] = UINT64_MAX;
+	}
 	virtual ~PhysicalMemory() { KYTY_NOT_IMPLEMENTED; }
 
 	KYTY_CLASS_NO_COPY(PhysicalMemory);
@@ -52,12 +63,16 @@ public:
 	bool Find(uint64_t vaddr, uint64_t* base_addr, size_t* len, int* prot, VirtualMemory::Mode* mode, Graphics::GpuMemoryMode* gpu_mode);
 	bool Find(uint64_t phys_addr, bool next, PhysicalMemory::AllocatedBlock* out);
 
-	[[nodiscard]] Core::Mutex&                  GetMutex() { return m_mutex; }
-	[[nodiscard]] const Vector<AllocatedBlock>& GetBlocks() const { return m_allocated; }
+	[[nodiscard]] Core::Mutex&    GetMutex() { return m_mutex; }
+	[[nodiscard]] const BlockMap& GetBlocks() const { return m_allocated; }
 
 private:
-	Vector<AllocatedBlock> m_allocated;
-	Core::Mutex            m_mutex;
+	BlockMap::iterator FindBlock(uint64_t phys_addr);
+
+	BlockMap                     m_allocated; // start_addr -> block
+	std::map<uint64_t, uint64_t> m_mapped;    // map_vaddr -> start_addr
+	std::map<uint64_t, uint64_t> m_free;      // start -> end
+	Core::Mutex                  m_mutex;
 };
 
 class FlexibleMemory
@@ -72,6 +87,8 @@ public:
 		Graphics::GpuMemoryMode gpu_mode;
 	};
 
+	using BlockMap = std::map<uint64_t, AllocatedBlock>;
+
 	FlexibleMemory() { EXIT_NOT_IMPLEMENTED(!Core::Thread::IsMainThread()); }
 	virtual ~FlexibleMemory() { KYTY_NOT_IMPLEMENTED; }
 
@@ -84,13 +101,13 @@ public:
 	bool Unmap(uint64_t vaddr, uint64_t size, Graphics::GpuMemoryMode* gpu_mode);
 	bool Find(uint64_t vaddr, uint64_t* base_addr, size_t* len, int* prot, VirtualMemory::Mode* mode, Graphics::GpuMemoryMode* gpu_mode);
 
-	[[nodiscard]] Core::Mutex&                  GetMutex() { return m_mutex; }
-	[[nodiscard]] const Vector<AllocatedBlock>& GetBlocks() const { return m_allocated; }
+	[[nodiscard]] Core::Mutex&    GetMutex() { return m_mutex; }
+	[[nodiscard]] const BlockMap& GetBlocks() const { return m_allocated; }
 
 private:
-	Vector<AllocatedBlock> m_allocated;
-	uint64_t               m_allocated_total = 0;
-	Core::Mutex            m_mutex;
+	BlockMap    m_allocated; // map_vaddr -> block
+	uint64_t    m_allocated_total = 0;
+	Core::Mutex m_mutex;
 };
 
 static PhysicalMemory* g_physical_memory = nullptr;
@@ -115,6 +132,15 @@ static uint64_t get_aligned_pos(uint64_t pos, size_t align)
 	return (align != 0 ? (pos + (align - 1)) & ~(align - 1) : pos);
 }
 
+// Large pages cut TLB misses on multi-GB working sets. GPU-visible memory is write-watched per 4K page, so it can use them only if
+// the host splits a large page on partial protection.
+static bool use_large_pages(size_t len, Graphics::GpuMemoryMode gpu_mode)
+{
+	auto page = VirtualMemory::LargePageSize();
+	return (Config::LargePagesEnabled() && page != 0 && len >= page &&
+	        (gpu_mode == Graphics::GpuMemoryMode::NoAccess || VirtualMemory::LargePagesProtectable()));
+}
+
 void RegisterCallbacks(callback_func_t alloc_func, callback_func_t free_func)
 {
 	EXIT_IF(g_alloc_callback != nullptr || g_free_callback != nullptr);
@@ -126,14 +152,14 @@ void RegisterCallbacks(callback_func_t alloc_func, callback_func_t free_func)
 	g_physical_memory->GetMutex().Lock();
 	for (const auto& b: g_physical_memory->GetBlocks())
 	{
-		g_alloc_callback(b.map_vaddr, b.map_size);
+		g_alloc_callback(b.second.map_vaddr, b.second.map_size);
 	}
 	g_physical_memory->GetMutex().Unlock();
 
 	g_flexible_memory->GetMutex().Lock();
 	for (const auto& b: g_flexible_memory->GetBlocks())
 	{
-		g_alloc_callback(b.map_vaddr, b.map_size);
+		g_alloc_callback(b.second.map_vaddr, b.second.map_size);
 	}
 	g_flexible_memory->GetMutex().Unlock();
 }
@@ -148,24 +174,39 @@ bool PhysicalMemory::Alloc(uint64_t search_start, uint64_t search_end, size_t le
 
 	Core::LockGuard lock(m_mutex);
 
-	uint64_t free_pos = 0;
+	// Start from the free range that contains search_start
+	auto it = m_free.upper_bound(search_start);
+	if (it != m_free.begin() && std::prev(it)->second > search_start)
+	{
+		--it;
+	}
 
-	for (const auto& b: m_allocated)
+	for (; it != m_free.end() && it->first < search_end; ++it)
 	{
-		uint64_t n = b.start_addr + b.size;
-		if (n > free_pos)
+		uint64_t range_start = it->first;
+		uint64_t range_end   = it->second;
+
+		uint64_t pos = get_aligned_pos(std::max(range_start, search_start), alignment);
+		uint64_t end = std::min(range_end, search_end);
+
+		if (pos < range_start || pos >= end || len > end - pos)
 		{
-			free_pos = n;
+			continue;
 		}
-	}
 
-	free_pos = get_aligned_pos(free_pos, alignment);
+		m_free.erase(it);
+		if (pos > range_start)
+		{
+			m_free[range_start] = pos;
+		}
+		if (pos + len < range_end)
+		{
+			m_free[pos + len] = range_end;
+		}
 
-	if (free_pos >= search_start && free_pos + len <= search_end)
-	{
 		AllocatedBlock b {};
 		b.size        = len;
-		b.start_addr  = free_pos;
+		b.start_addr  = pos;
 		b.gpu_mode    = Graphics::GpuMemoryMode::NoAccess;
 		b.map_size    = 0;
 		b.map_vaddr   = 0;
@@ -173,9 +214,9 @@ bool PhysicalMemory::Alloc(uint64_t search_start, uint64_t search_end, size_t le
 		b.mode        = VirtualMemory::Mode::NoAccess;
 		b.memory_type = memory_type;
 
-		m_allocated.Add(b);
+		m_allocated[pos] = b;
 
-		*phys_addr_out = free_pos;
+		*phys_addr_out = pos;
 		return true;
 	}
 
@@ -190,22 +231,62 @@ bool PhysicalMemory::Release(uint64_t start, size_t len, uint64_t* vaddr, uint64
 
 	Core::LockGuard lock(m_mutex);
 
-	uint32_t index = 0;
-	for (auto& b: m_allocated)
+	auto it = m_allocated.find(start);
+	if (it == m_allocated.end() || it->second.size != len)
 	{
-		if (start == b.start_addr && len == b.size)
-		{
-			*vaddr    = b.map_vaddr;
-			*size     = b.map_size;
-			*gpu_mode = b.gpu_mode;
+		return false;
+	}
 
-			m_allocated.RemoveAt(index);
-			return true;
+	const auto& b = it->second;
+
+	*vaddr    = b.map_vaddr;
+	*size     = b.map_size;
+	*gpu_mode = b.gpu_mode;
+
+	if (b.map_vaddr != 0 || b.map_size != 0)
+	{
+		m_mapped.erase(b.map_vaddr);
+	}
+
+	m_allocated.erase(it);
+
+	// Return the range to the free index, merged with its neighbours
+	uint64_t free_start = start;
+	uint64_t free_end   = start + len;
+
+	auto next = m_free.lower_bound(free_start);
+	if (next != m_free.end() && next->first == free_end)
+	{
+		free_end = next->second;
+		next     = m_free.erase(next);
+	}
+	if (next != m_free.begin())
+	{
+		auto prev = std::prev(next);
+		if (prev->second == free_start)
+		{
+			free_start = prev->first;
+			m_free.erase(prev);
 		}
-		index++;
 	}
 
-	return false;
+	m_free[free_start] = free_end;
+
+	return true;
+}
+
+PhysicalMemory::BlockMap::iterator PhysicalMemory::FindBlock(uint64_t phys_addr)
+{
+	auto it = m_allocated.upper_bound(phys_addr);
+	if (it != m_allocated.begin())
+	{
+		--it;
+		if (phys_addr < it->second.start_addr + it->second.size)
+		{
+			return it;
+		}
+	}
+	return m_allocated.end();
 }
 
 bool PhysicalMemory::Map(uint64_t vaddr, uint64_t phys_addr, size_t len, int prot, VirtualMemory::Mode mode,
@@ -213,26 +294,28 @@ bool PhysicalMemory::Map(uint64_t vaddr, uint64_t phys_addr, size_t len, int pro
 {
 	Core::LockGuard lock(m_mutex);
 
-	for (auto& b: m_allocated)
+	auto it = FindBlock(phys_addr);
+	if (it == m_allocated.end())
 	{
-		if (phys_addr >= b.start_addr && phys_addr < b.start_addr + b.size)
-		{
-			if (b.map_vaddr != 0 || b.map_size != 0)
-			{
-				return false;
-			}
+		return false;
+	}
 
-			b.map_vaddr = vaddr;
-			b.map_size  = len;
-			b.prot      = prot;
-			b.mode      = mode;
-			b.gpu_mode  = gpu_mode;
+	auto& b = it->second;
 
-			return true;
-		}
+	if (b.map_vaddr != 0 || b.map_size != 0)
+	{
+		return false;
 	}
 
-	return false;
+	b.map_vaddr = vaddr;
+	b.map_size  = len;
+	b.prot      = prot;
+	b.mode      = mode;
+	b.gpu_mode  = gpu_mode;
+
+	m_mapped[vaddr] = b.start_addr;
+
+	return true;
 }
 
 bool PhysicalMemory::Unmap(uint64_t vaddr, uint64_t size, Graphics::GpuMemoryMode* gpu_mode)
@@ -241,23 +324,30 @@ bool PhysicalMemory::Unmap(uint64_t vaddr, uint64_t size, Graphics::GpuMemoryMod
 
 	Core::LockGuard lock(m_mutex);
 
-	for (auto& b: m_allocated)
+	auto m = m_mapped.find(vaddr);
+	if (m == m_mapped.end())
 	{
-		if (b.map_vaddr == vaddr && b.map_size == size)
-		{
-			*gpu_mode = b.gpu_mode;
+		return false;
+	}
 
-			b.gpu_mode  = Graphics::GpuMemoryMode::NoAccess;
-			b.map_size  = 0;
-			b.map_vaddr = 0;
-			b.prot      = 0;
-			b.mode      = VirtualMemory::Mode::NoAccess;
+	auto& b = m_allocated[m->second];
 
-			return true;
-		}
+	if (b.map_size != size)
+	{
+		return false;
 	}
 
-	return false;
+	*gpu_mode = b.gpu_mode;
+
+	b.gpu_mode  = Graphics::GpuMemoryMode::NoAccess;
+	b.map_size  = 0;
+	b.map_vaddr = 0;
+	b.prot      = 0;
+	b.mode      = VirtualMemory::Mode::NoAccess;
+
+	m_mapped.erase(m);
+
+	return true;
 }
 
 bool PhysicalMemory::Find(uint64_t phys_addr, bool next, AllocatedBlock* out)
@@ -266,30 +356,19 @@ bool PhysicalMemory::Find(uint64_t phys_addr, bool next, AllocatedBlock* out)
 
 	Core::LockGuard lock(m_mutex);
 
-	for (auto& b: m_allocated)
+	auto it = FindBlock(phys_addr);
+	if (it != m_allocated.end())
 	{
-		if (phys_addr >= b.start_addr && phys_addr < b.start_addr + b.size)
-		{
-			*out = b;
-			return true;
-		}
+		*out = it->second;
+		return true;
 	}
 
 	if (next)
 	{
-		uint64_t        min_start_addr = UINT64_MAX;
-		AllocatedBlock* next           = nullptr;
-		for (auto& b: m_allocated)
-		{
-			if (b.start_addr > phys_addr && b.start_addr < min_start_addr)
-			{
-				min_start_addr = b.start_addr;
-				next           = &b;
-			}
-		}
-		if (next != nullptr)
+		it = m_allocated.upper_bound(phys_addr);
+		if (it != m_allocated.end())
 		{
-			*out = *next;
+			*out = it->second;
 			return true;
 		}
 	}
@@ -297,41 +376,66 @@ bool PhysicalMemory::Find(uint64_t phys_addr, bool next, AllocatedBlock* out)
 	return false;
 }
 
+template <class B>
+static bool find_mapped_block(const std::map<uint64_t, B>& blocks, uint64_t vaddr, const B** out)
+{
+	auto it = blocks.upper_bound(vaddr);
+	if (it == blocks.begin())
+	{
+		return false;
+	}
+	--it;
+	*out = &it->second;
+	return true;
+}
+
+template <class B>
+static void copy_mapped_block(const B& b, uint64_t* base_addr, size_t* len, int* prot, VirtualMemory::Mode* mode,
+                              Graphics::GpuMemoryMode* gpu_mode)
+{
+	if (base_addr != nullptr)
+	{
+		*base_addr = b.map_vaddr;
+	}
+	if (len != nullptr)
+	{
+		*len = b.map_size;
+	}
+	if (prot != nullptr)
+	{
+		*prot = b.prot;
+	}
+	if (mode != nullptr)
+	{
+		*mode = b.mode;
+	}
+	if (gpu_mode != nullptr)
+	{
+		*gpu_mode = b.gpu_mode;
+	}
+}
+
 bool PhysicalMemory::Find(uint64_t vaddr, uint64_t* base_addr, size_t* len, int* prot, VirtualMemory::Mode* mode,
                           Graphics::GpuMemoryMode* gpu_mode)
 {
 	Core::LockGuard lock(m_mutex);
 
-	return std::any_of(m_allocated.begin(), m_allocated.end(),
-	                   [vaddr, base_addr, len, prot, mode, gpu_mode](auto& b)
-	                   {
-		                   if (vaddr >= b.map_vaddr && vaddr < b.map_vaddr + b.map_size)
-		                   {
-			                   if (base_addr != nullptr)
-			                   {
-				                   *base_addr = b.map_vaddr;
-			                   }
-			                   if (len != nullptr)
-			                   {
-				                   *len = b.map_size;
-			                   }
-			                   if (prot != nullptr)
-			                   {
-				                   *prot = b.prot;
-			                   }
-			                   if (mode != nullptr)
-			                   {
-				                   *mode = b.mode;
-			                   }
-			                   if (gpu_mode != nullptr)
-			                   {
-				                   *gpu_mode = b.gpu_mode;
-			                   }
-
-			                   return true;
-		                   }
-		                   return false;
-	                   });
+	const uint64_t* start_addr = nullptr;
+	if (!find_mapped_block(m_mapped, vaddr, &start_addr))
+	{
+		return false;
+	}
+
+	const auto& b = m_allocated[*start_addr];
+
+	if (vaddr >= b.map_vaddr + b.map_size)
+	{
+		return false;
+	}
+
+	copy_mapped_block(b, base_addr, len, prot, mode, gpu_mode);
+
+	return true;
 }
 
 bool FlexibleMemory::Map(uint64_t vaddr, size_t len, int prot, VirtualMemory::Mode mode, Graphics::GpuMemoryMode gpu_mode)
@@ -345,7 +449,7 @@ bool FlexibleMemory::Map(uint64_t vaddr, size_t len, int prot, VirtualMemory::Mo
 	b.mode      = mode;
 	b.gpu_mode  = gpu_mode;
 
-	m_allocated.Add(b);
+	m_allocated[vaddr] = b;
 	m_allocated_total += len;
 
 	return true;
@@ -357,21 +461,18 @@ bool FlexibleMemory::Unmap(uint64_t vaddr, uint64_t size, Graphics::GpuMemoryMod
 
 	Core::LockGuard lock(m_mutex);
 
-	uint32_t index = 0;
-	for (auto& b: m_allocated)
+	auto it = m_allocated.find(vaddr);
+	if (it == m_allocated.end() || it->second.map_size != size)
 	{
-		if (b.map_vaddr == vaddr && b.map_size == size)
-		{
-			*gpu_mode = b.gpu_mode;
-
-			m_allocated.RemoveAt(index);
-			m_allocated_total -= size;
-			return true;
-		}
-		index++;
+		return false;
 	}
 
-	return false;
+	*gpu_mode = it->second.gpu_mode;
+
+	m_allocated.erase(it);
+	m_allocated_total -= size;
+
+	return true;
 }
 
 bool FlexibleMemory::Find(uint64_t vaddr, uint64_t* base_addr, size_t* len, int* prot, VirtualMemory::Mode* mode,
@@ -379,38 +480,18 @@ bool FlexibleMemory::Find(uint64_t vaddr, uint64_t* base_addr, size_t* len, int*
 {
 	Core::LockGuard lock(m_mutex);
 
-	return std::any_of(m_allocated.begin(), m_allocated.end(),
-	                   [vaddr, base_addr, len, prot, mode, gpu_mode](auto& b)
-	                   {
-		                   if (vaddr >= b.map_vaddr && vaddr < b.map_vaddr + b.map_size)
-		                   {
-			                   if (base_addr != nullptr)
-			                   {
-				                   *base_addr = b.map_vaddr;
-			                   }
-			                   if (len != nullptr)
-			                   {
-				                   *len = b.map_size;
-			                   }
-			                   if (prot != nullptr)
-			                   {
-				                   *prot = b.prot;
-			                   }
-			                   if (mode != nullptr)
-			                   {
-				                   *mode = b.mode;
-			                   }
-			                   if (gpu_mode != nullptr)
-			                   {
-				                   *gpu_mode = b.gpu_mode;
-			                   }
-
-			                   return true;
-		                   }
-		                   return false;
-	                   });
+	const AllocatedBlock* b = nullptr;
+	if (!find_mapped_block(m_allocated, vaddr, &b) || vaddr >= b->map_vaddr + b->map_size)
+	{
+		return false;
+	}
+
+	copy_mapped_block(*b, base_addr, len, prot, mode, gpu_mode);
+
+	return true;
 }
 
+// The whole guest size of a mapping is counted, even if it's allocated lazily and not touched yet
 uint64_t FlexibleMemory::Available()
 {
 	Core::LockGuard lock(m_mutex);
@@ -448,9 +529,21 @@ int32_t KYTY_SYSV_ABI KernelMapNamedFlexibleMemory(void** addr_in_out, size_t le
 		default: EXIT("unknown prot: %d\n", prot);
 	}
 
-	auto in_addr  = reinterpret_cast<uint64_t>(*addr_in_out);
-	auto out_addr = VirtualMemory::Alloc(in_addr, len, mode);
-	*addr_in_out  = reinterpret_cast<void*>(out_addr);
+	auto     in_addr  = reinterpret_cast<uint64_t>(*addr_in_out);
+	uint64_t out_addr = 0;
+
+	if (Config::FlexibleMemoryLazy())
+	{
+		out_addr = VirtualMemory::AllocLazy(in_addr, len, mode);
+	} else if (use_large_pages(len, gpu_mode))
+	{
+		out_addr = VirtualMemory::AllocAlignedLarge(in_addr, len, mode, VirtualMemory::LargePageSize());
+	} else
+	{
+		out_addr = VirtualMemory::Alloc(in_addr, len, mode);
+	}
+
+	*addr_in_out = reinterpret_cast<void*>(out_addr);
 
 	if (!g_flexible_memory->Map(out_addr, len, prot, mode, gpu_mode))
 	{
@@ -720,21 +813,23 @@ int KYTY_SYSV_ABI KernelMapDirectMemory(void** addr, size_t len, int prot, int f
 		default: EXIT("unknown prot: %d\n", prot);
 	}
 
-	auto     in_addr  = reinterpret_cast<uint64_t>(*addr);
-	uint64_t out_addr = 0;
+	auto     in_addr     = reinterpret_cast<uint64_t>(*addr);
+	uint64_t out_addr    = 0;
+	bool     large_pages = use_large_pages(len, gpu_mode);
 
 	if (fixed)
 	{
 		EXIT_NOT_IMPLEMENTED(in_addr == 0);
 		EXIT_NOT_IMPLEMENTED((in_addr & (alignment - 1)) != 0);
 
-		if (VirtualMemory::AllocFixed(in_addr, len, mode))
+		if (large_pages ? VirtualMemory::AllocFixedLarge(in_addr, len, mode) : VirtualMemory::AllocFixed(in_addr, len, mode))
 		{
 			out_addr = in_addr;
 		}
 	} else
 	{
-		out_addr = VirtualMemory::AllocAligned(in_addr, len, mode, alignment);
+		out_addr = (large_pages ? VirtualMemory::AllocAlignedLarge(in_addr, len, mode, alignment)
+		                        : VirtualMemory::AllocAligned(in_addr, len, mode, alignment));
 	}
 
 	*addr = reinterpret_cast<void*>(out_addr);
@@ -866,13 +961,16 @@ int KYTY_SYSV_ABI KernelMprotect(const void* addr, size_t len, int prot)
 	}
 
 	VirtualMemory::Mode old_mode {};
-	bool                ok = VirtualMemory::Protect(vaddr, len, mode, &old_mode);
-
-	EXIT_NOT_IMPLEMENTED(!ok);
 
 	if (gpu_mode != Graphics::GpuMemoryMode::NoAccess)
 	{
-		Graphics::GpuMemorySetAllocatedRange(vaddr, len);
+		// Keeps the GPU write watch intact and invalidates only the objects in the range
+		Graphics::GpuMemoryProtect(vaddr, len, mode, &old_mode);
+	} else
+	{
+		bool ok = VirtualMemory::Protect(vaddr, len, mode, &old_mode);
+
+		EXIT_NOT_IMPLEMENTED(!ok);
 	}
 
 	printf("\t prot: %s -> %s\n", Core::EnumName(old_mode).C_Str(), Core::EnumName(mode).C_Str());
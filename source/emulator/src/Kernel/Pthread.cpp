@@ -3,20 +3,30 @@
 #include "Kyty/Core/Common.h"
 #include "Kyty/Core/DateTime.h"
 #include "Kyty/Core/DbgAssert.h"
+#include "Kyty/Core/Hashmap.h"
+#include "Kyty/Core/LockProfiler.h"
+#include "Kyty/Core/MagicEnum.h"
 #include "Kyty/Core/Singleton.h"
 #include "Kyty/Core/String.h"
 #include "Kyty/Core/Threads.h"
 #include "Kyty/Core/Timer.h"
 #include "Kyty/Core/Vector.h"
 
+#include "Emulator/Benchmark.h"
+#include "Emulator/Config.h"
 #include "Emulator/Libs/Errno.h"
 #include "Emulator/Libs/Libs.h"
+#include "Emulator/Libs/Trace.h"
 #include "Emulator/Loader/RuntimeLinker.h"
 #include "Emulator/Loader/Timer.h"
+#include "Emulator/Sampler.h"
+
+#include "cpuinfo.h"
 
 #include <atomic>
 #include <cerrno>
 #include <ctime>
+#include <immintrin.h>
 
 #ifdef KYTY_EMU_ENABLED
 
@@ -29,6 +39,12 @@
 
 #if KYTY_PLATFORM == KYTY_PLATFORM_WINDOWS
 #include <pthread_time.h>
+#include <windows.h> // IWYU pragma: keep
+#else
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
 #endif
 
 namespace Kyty::Libs {
@@ -39,12 +55,23 @@ LIB_NAME("libkernel", "libkernel");
 
 constexpr int KEYS_MAX              = 256;
 constexpr int DESTRUCTOR_ITERATIONS = 4;
+constexpr int GUEST_CORES_NUM       = 7;
+constexpr int HOST_NICE_HIGH        = -5;
+constexpr int HOST_NICE_LOW         = 5;
+constexpr int RWLOCK_STRIPES_NUM    = 8;
+
+constexpr int RWLOCK_TYPE_PREFER_READER = 2;
 
 struct PthreadMutexPrivate
 {
 	uint8_t         reserved[256];
 	String          name;
 	pthread_mutex_t p;
+#ifdef KYTY_PROFILE_LOCKS
+	Core::LockProfilerStats* stats     = nullptr;
+	uint64_t                 hold_from = 0;
+	uint32_t                 owned     = 0; // recursion depth, changed by the owner only
+#endif
 };
 
 struct PthreadMutexattrPrivate
@@ -60,6 +87,7 @@ struct PthreadAttrPrivate
 	KernelCpumask  affinity;
 	size_t         guard_size;
 	int            policy;
+	int            priority;
 	bool           detached;
 	pthread_attr_t p;
 };
@@ -73,17 +101,39 @@ struct PthreadPrivate
 	pthread_entry_func_t entry;
 	void*                arg;
 	int                  unique_id;
+	int                  host_tid;
+	std::atomic_int      priority;
 	std::atomic_bool     started;
 	std::atomic_bool     detached;
 	std::atomic_bool     almost_done;
 	std::atomic_bool     free;
+	void*                ret;
+};
+
+// Readers of a rwlock are counted in stripes of their own cache lines, so read locks taken on different cores don't contend
+struct alignas(64) PthreadRwlockStripe
+{
+	std::atomic_int readers = 0;
 };
 
 struct PthreadRwlockPrivate
 {
-	uint8_t          reserved[256];
-	String           name;
-	pthread_rwlock_t p;
+	uint8_t             reserved[256];
+	String              name;
+	bool                prefer_reader = false;
+	std::atomic_int     writers       = 0;     // waiting or owning, new readers wait for them unless prefer_reader is set
+	std::atomic_int     owner         = 0;     // the writer which waits for the readers to leave or holds the lock
+	std::atomic_bool    writing       = false; // the owner holds the lock
+	pthread_mutex_t     m;                     // protects the writer state and the waits
+	pthread_cond_t      cond;                  // the writer state changed
+	pthread_cond_t      drained;               // a reader left
+	PthreadRwlockStripe stripes[RWLOCK_STRIPES_NUM];
+};
+
+struct PthreadRwlockThread
+{
+	int                                 id = 0;
+	Vector<const PthreadRwlockPrivate*> rdlocks; // read locks held by the thread, one item per lock call
 };
 
 struct PthreadRwlockattrPrivate
@@ -99,11 +149,41 @@ struct PthreadCondattrPrivate
 	pthread_condattr_t p;
 };
 
+// A thread waits for one condition variable at a time
+struct PthreadCondWaiter
+{
+	PthreadCondWaiter() { pthread_cond_init(&c, nullptr); }
+	~PthreadCondWaiter() { pthread_cond_destroy(&c); }
+
+	KYTY_CLASS_NO_COPY(PthreadCondWaiter);
+
+	PthreadCondWaiter* next  = nullptr;
+	bool               woken = false;
+	pthread_cond_t     c {};
+};
+
+struct PthreadCondQueue
+{
+	PthreadCondWaiter* head = nullptr;
+	PthreadCondWaiter* tail = nullptr;
+};
+
 struct PthreadCondPrivate
 {
-	uint8_t        reserved[256];
-	String         name;
-	pthread_cond_t p;
+	uint8_t          reserved[256];
+	String           name;
+	pthread_mutex_t  m;        // protects the rest
+	PthreadCondQueue waiters;  // blocked
+	PthreadCondQueue requeued; // unblocked by a broadcast, woken one at a time as the guest mutex is released
+	int              handoffs  = 0;
+	bool             destroyed = false; // freed by the last handoff
+};
+
+// The thread was woken with requeued waiters left, it wakes the next one when it releases the mutex
+struct PthreadCondHandoff
+{
+	PthreadCondPrivate*  cond  = nullptr;
+	PthreadMutexPrivate* mutex = nullptr;
 };
 
 struct PthreadStaticObject
@@ -133,7 +213,7 @@ public:
 
 private:
 	Vector<PthreadStaticObject*> m_objects;
-	Core::Mutex                  m_mutex;
+	Core::Mutex                  m_mutex {"PthreadStaticObjects"};
 };
 
 class PthreadKeys
@@ -150,22 +230,46 @@ public:
 	bool Set(int key, int thread_id, void* data);
 	bool Get(int key, int thread_id, void** data);
 
-private:
-	struct Map
+	struct Value
+	{
+		uint32_t gen  = 0;
+		void*    data = nullptr;
+	};
+
+	// Values of one thread, reached through thread-local storage
+	struct ThreadValues
 	{
-		int   thread_id = -1;
-		void* data      = nullptr;
+		Value values[KEYS_MAX];
 	};
 
+private:
+	// The generation is odd while the key is in use. It changes on every create and delete, so a value left by a deleted key
+	// doesn't show up under a new one.
 	struct Key
 	{
-		bool                          used       = false;
+		std::atomic_uint32_t          gen {0};
 		pthread_key_destructor_func_t destructor = nullptr;
-		Vector<Map>                   specific_values;
 	};
 
-	Core::Mutex m_mutex;
-	Key         m_keys[KEYS_MAX];
+	Core::Mutex                       m_mutex {"PthreadKeys"};
+	Key                               m_keys[KEYS_MAX];
+	Core::Hashmap<int, ThreadValues*> m_threads;
+};
+
+// A host thread can run the next guest thread only if it has the same stack and scheduling
+struct PthreadWorkerKey
+{
+	size_t stack_size = 0;
+	size_t guard_size = 0;
+	int    policy     = 0;
+	int    priority   = 0;
+};
+
+struct PthreadWorker
+{
+	PthreadWorkerKey key;
+	Core::CondVar    cond_var;
+	Pthread          next = nullptr;
 };
 
 class PthreadPool
@@ -180,9 +284,22 @@ public:
 
 	void FreeDetachedThreads();
 
+	// Host threads of finished guest threads wait for a new guest thread instead of exiting
+	bool    StartOnIdleWorker(Pthread thread, const PthreadWorkerKey& key);
+	Pthread WaitForWork(PthreadWorker* worker);
+
+	void Finish(Pthread thread);
+	void WaitFinished(Pthread thread);
+
 private:
-	Vector<Pthread> m_threads;
-	Core::Mutex     m_mutex;
+	static constexpr uint32_t WORKERS_IDLE_MAX    = 16;
+	static constexpr uint32_t WORKER_IDLE_TIMEOUT = 10000000; // microseconds
+
+	Vector<Pthread>        m_threads;
+	Core::Mutex            m_mutex {"PthreadPool"};
+	Vector<PthreadWorker*> m_idle_workers;
+	Core::Mutex            m_workers_mutex;
+	Core::CondVar          m_finished_cond_var;
 };
 
 class PThreadContext
@@ -224,8 +341,32 @@ private:
 	std::atomic<thread_dtors_func_t> m_thread_dtors = nullptr;
 };
 
-thread_local Pthread g_pthread_self    = nullptr;
-PThreadContext*      g_pthread_context = nullptr;
+// Guest cores are placed on separate host physical cores, a guest core gets all SMT siblings of its host core. The last
+// physical cores are kept for the emulator threads. Hosts with fewer cores share them between guest cores.
+class HostCpuMap
+{
+public:
+	HostCpuMap();
+	virtual ~HostCpuMap() = default;
+
+	KYTY_CLASS_NO_COPY(HostCpuMap);
+
+	[[nodiscard]] bool     IsEnabled() const { return m_enabled; }
+	[[nodiscard]] uint64_t GetGuestMask(KernelCpumask mask) const;
+	[[nodiscard]] uint64_t GetEmulatorMask(EmulatorThread thread) const;
+
+private:
+	static constexpr int HOST_CORES_MAX = 64;
+
+	bool     m_enabled                        = false;
+	uint64_t m_guest_cores[GUEST_CORES_NUM]   = {};
+	uint64_t m_emulator_cores[HOST_CORES_MAX] = {};
+	int      m_emulator_cores_num             = 0;
+};
+
+thread_local Pthread                    g_pthread_self     = nullptr;
+thread_local PthreadKeys::ThreadValues* g_pthread_specific = nullptr;
+PThreadContext*                         g_pthread_context  = nullptr;
 
 static void FreeDetachedThreads(void* /*arg*/)
 {
@@ -244,6 +385,171 @@ static void FreeDetachedThreads(void* /*arg*/)
 	}
 }
 
+HostCpuMap::HostCpuMap()
+{
+	if (!Config::ThreadAffinityEnabled() || !cpuinfo_initialize())
+	{
+		return;
+	}
+
+	uint64_t cores[HOST_CORES_MAX] = {};
+	int      cores_num             = 0;
+
+	for (uint32_t i = 0; i < cpuinfo_get_cores_count() && cores_num < HOST_CORES_MAX; i++)
+	{
+		const auto* core = cpuinfo_get_core(i);
+		uint64_t    mask = 0;
+
+		for (uint32_t j = 0; j < core->processor_count; j++)
+		{
+			const auto* processor = cpuinfo_get_processor(core->processor_start + j);
+#if KYTY_PLATFORM == KYTY_PLATFORM_WINDOWS
+			int id = (processor->windows_group_id == 0 ? processor->windows_processor_id : -1);
+#else
+			int id = processor->linux_id;
+#endif
+			if (id >= 0 && id < HOST_CORES_MAX)
+			{
+				mask |= static_cast<uint64_t>(1) << static_cast<uint32_t>(id);
+			}
+		}
+
+		if (mask != 0)
+		{
+			cores[cores_num++] = mask;
+		}
+	}
+
+	if (cores_num < 2)
+	{
+		return;
+	}
+
+	auto emulator_cores_num = static_cast<int>(Config::GetThreadAffinityEmulatorCores());
+	if (emulator_cores_num > cores_num - 1)
+	{
+		emulator_cores_num = cores_num - 1;
+	}
+	int guest_cores_num = cores_num - emulator_cores_num;
+
+	for (int i = 0; i < GUEST_CORES_NUM; i++)
+	{
+		m_guest_cores[i] = cores[i % guest_cores_num];
+		printf("\tguest core %d -> host 0x%016" PRIx64 "\n", i, m_guest_cores[i]);
+	}
+
+	for (int i = 0; i < emulator_cores_num; i++)
+	{
+		m_emulator_cores[i] = cores[guest_cores_num + i];
+		printf("\temulator core %d -> host 0x%016" PRIx64 "\n", i, m_emulator_cores[i]);
+	}
+
+	m_emulator_cores_num = emulator_cores_num;
+	m_enabled            = true;
+}
+
+uint64_t HostCpuMap::GetGuestMask(KernelCpumask mask) const
+{
+	uint64_t ret = 0;
+	for (int i = 0; i < GUEST_CORES_NUM; i++)
+	{
+		if ((mask & (static_cast<KernelCpumask>(1) << static_cast<uint32_t>(i))) != 0)
+		{
+			ret |= m_guest_cores[i];
+		}
+	}
+	return ret;
+}
+
+uint64_t HostCpuMap::GetEmulatorMask(EmulatorThread thread) const
+{
+	if (m_emulator_cores_num == 0)
+	{
+		return 0;
+	}
+	return m_emulator_cores[static_cast<int>(thread) % m_emulator_cores_num];
+}
+
+// Built on first use, the config is loaded by then
+static const HostCpuMap& get_host_cpu_map()
+{
+	static const HostCpuMap map;
+	return map;
+}
+
+static void pthread_set_host_affinity(pthread_t p, uint64_t mask)
+{
+	if (mask == 0)
+	{
+		return;
+	}
+
+#if KYTY_PLATFORM == KYTY_PLATFORM_WINDOWS
+	SetThreadAffinityMask(static_cast<HANDLE>(pthread_gethandle(p)), mask);
+#else
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	for (int i = 0; i < 64; i++)
+	{
+		if ((mask & (static_cast<uint64_t>(1) << static_cast<uint32_t>(i))) != 0)
+		{
+			CPU_SET(i, &set);
+		}
+	}
+	pthread_setaffinity_np(p, sizeof(set), &set);
+#endif
+}
+
+// Linux ignores priorities of SCHED_OTHER threads, there the guest priority is applied as the nice value of the host thread
+static bool pthread_nice_priority()
+{
+#if KYTY_PLATFORM == KYTY_PLATFORM_LINUX
+	return Config::ThreadPriorityEnabled();
+#else
+	return false;
+#endif
+}
+
+static int pthread_host_tid()
+{
+#if KYTY_PLATFORM == KYTY_PLATFORM_LINUX
+	return static_cast<int>(syscall(SYS_gettid));
+#else
+	return 0;
+#endif
+}
+
+// Raising the priority needs CAP_SYS_NICE or RLIMIT_NICE, without them the thread keeps its nice value
+static void pthread_set_nice([[maybe_unused]] int host_tid, [[maybe_unused]] int prio)
+{
+#if KYTY_PLATFORM == KYTY_PLATFORM_LINUX
+	int nice = (prio <= 478 ? HOST_NICE_HIGH : (prio >= 733 ? HOST_NICE_LOW : 0));
+	setpriority(PRIO_PROCESS, static_cast<id_t>(host_tid), nice);
+#endif
+}
+
+static bool pthread_nice_is_default()
+{
+#if KYTY_PLATFORM == KYTY_PLATFORM_LINUX
+	errno = 0;
+	return getpriority(PRIO_PROCESS, 0) == 0 && errno == 0;
+#else
+	return true;
+#endif
+}
+
+void PthreadSetEmulatorThreadAffinity(EmulatorThread thread)
+{
+	const auto& map = get_host_cpu_map();
+
+	if (map.IsEnabled())
+	{
+		pthread_set_host_affinity(pthread_self(), map.GetEmulatorMask(thread));
+	}
+
+	Profiler::BenchmarkThreadStart(Core::EnumName(thread));
+}
+
 void PthreadDeleteStaticObjects(Loader::Program* program)
 {
 	EXIT_IF(g_pthread_context == nullptr);
@@ -255,6 +561,11 @@ void PthreadDeleteStaticObjects(Loader::Program* program)
 	pthread_static_objects->DeleteObjects(program);
 }
 
+bool PthreadIsInitialized()
+{
+	return g_pthread_context != nullptr;
+}
+
 void PthreadInitSelfForMainThread()
 {
 	EXIT_IF(g_pthread_self != nullptr);
@@ -269,6 +580,18 @@ void PthreadInitSelfForMainThread()
 	g_pthread_self->almost_done = false;
 	g_pthread_self->entry       = nullptr;
 	g_pthread_self->arg         = nullptr;
+	g_pthread_self->host_tid    = pthread_host_tid();
+	g_pthread_self->priority    = g_pthread_self->attr->priority;
+
+	const auto& map = get_host_cpu_map();
+
+	if (map.IsEnabled())
+	{
+		pthread_set_host_affinity(g_pthread_self->p, map.GetGuestMask(g_pthread_self->attr->affinity));
+	}
+
+	Profiler::SamplerThreadStart(g_pthread_self->name);
+	Profiler::BenchmarkThreadStart(U"Guest");
 }
 
 KYTY_SUBSYSTEM_INIT(Pthread)
@@ -353,6 +676,38 @@ static int pthread_attr_copy(PthreadAttr* dst, const PthreadAttr* src)
 	return result;
 }
 
+// Returns false if a thread with these attributes can't run on a reused host thread
+static bool pthread_worker_key(const PthreadAttr* attr, PthreadWorkerKey* key)
+{
+	void*       stack_addr = nullptr;
+	int         inherit    = 0;
+	sched_param param {};
+
+	if (pthread_attr_getstackaddr(&(*attr)->p, &stack_addr) != 0 || stack_addr != nullptr ||
+	    pthread_attr_getstacksize(&(*attr)->p, &key->stack_size) != 0 || pthread_attr_getinheritsched(&(*attr)->p, &inherit) != 0)
+	{
+		return false;
+	}
+
+	key->guard_size = (*attr)->guard_size;
+
+	// An inheriting thread gets the scheduling of the creating thread
+	if (inherit == PTHREAD_INHERIT_SCHED)
+	{
+		if (pthread_getschedparam(pthread_self(), &key->policy, &param) != 0)
+		{
+			return false;
+		}
+	} else if (pthread_attr_getschedpolicy(&(*attr)->p, &key->policy) != 0 || pthread_attr_getschedparam(&(*attr)->p, &param) != 0)
+	{
+		return false;
+	}
+
+	key->priority = param.sched_priority;
+
+	return true;
+}
+
 static void pthread_attr_dbg_print(const PthreadAttr* src)
 {
 	KernelCpumask    mask          = 0;
@@ -383,10 +738,19 @@ static void pthread_attr_dbg_print(const PthreadAttr* src)
 	printf("\tstack_size    = %" PRIu64 "\n", reinterpret_cast<uint64_t>(stack_size));
 }
 
-static void usec_to_timespec(struct timespec* ts, KernelUseconds usec)
+// The host wait functions take an absolute CLOCK_REALTIME deadline, the guest passes a timeout
+static void usec_to_deadline(struct timespec* ts, KernelUseconds usec)
 {
-	ts->tv_sec  = usec / 1000000;
-	ts->tv_nsec = static_cast<decltype(ts->tv_nsec)>((usec % 1000000) * 1000);
+	clock_gettime(CLOCK_REALTIME, ts);
+
+	ts->tv_sec += usec / 1000000;
+	ts->tv_nsec += static_cast<decltype(ts->tv_nsec)>((usec % 1000000) * 1000);
+
+	if (ts->tv_nsec >= 1000000000)
+	{
+		ts->tv_sec++;
+		ts->tv_nsec -= 1000000000;
+	}
 }
 
 static void sec_to_timeval(KernelTimeval* ts, double sec)
@@ -395,17 +759,18 @@ static void sec_to_timeval(KernelTimeval* ts, double sec)
 	ts->tv_usec = static_cast<int64_t>((sec - static_cast<double>(ts->tv_sec)) * 1000000.0);
 }
 
-static void sec_to_timespec(KernelTimespec* ts, double sec)
-{
-	ts->tv_sec  = static_cast<int64_t>(sec);
-	ts->tv_nsec = static_cast<int64_t>((sec - static_cast<double>(ts->tv_sec)) * 1000000000.0);
-}
-
+// Called by every mutex, cond and rwlock function. Only a static initializer, which is nullptr, takes the lock.
 void* PthreadStaticObjects::CreateObject(void* addr, PthreadStaticObject::Type type)
 {
+	if (addr == nullptr || *static_cast<void* volatile*>(addr) != nullptr)
+	{
+		std::atomic_thread_fence(std::memory_order_acquire);
+		return addr;
+	}
+
 	Core::LockGuard lock(m_mutex);
 
-	if (addr == nullptr || *static_cast<void**>(addr) != nullptr)
+	if (*static_cast<void* volatile*>(addr) != nullptr)
 	{
 		return addr;
 	}
@@ -423,17 +788,28 @@ void* PthreadStaticObjects::CreateObject(void* addr, PthreadStaticObject::Type t
 
 	String name = String::FromPrintf("Static%016" PRIx64, vaddr);
 
-	int result = OK;
+	// The object is created aside and published after it is complete, other threads read it without the lock
+	void* created = nullptr;
+	int   result  = OK;
 	switch (type)
 	{
-		case PthreadStaticObject::Type::Mutex: result = PthreadMutexInit(static_cast<PthreadMutex*>(addr), nullptr, name.C_Str()); break;
-		case PthreadStaticObject::Type::Cond: result = PthreadCondInit(static_cast<PthreadCond*>(addr), nullptr, name.C_Str()); break;
-		case PthreadStaticObject::Type::Rwlock: result = PthreadRwlockInit(static_cast<PthreadRwlock*>(addr), nullptr, name.C_Str()); break;
+		case PthreadStaticObject::Type::Mutex:
+			result = PthreadMutexInit(reinterpret_cast<PthreadMutex*>(&created), nullptr, name.C_Str());
+			break;
+		case PthreadStaticObject::Type::Cond:
+			result = PthreadCondInit(reinterpret_cast<PthreadCond*>(&created), nullptr, name.C_Str());
+			break;
+		case PthreadStaticObject::Type::Rwlock:
+			result = PthreadRwlockInit(reinterpret_cast<PthreadRwlock*>(&created), nullptr, name.C_Str());
+			break;
 		default: EXIT("unknown type: %d\n", static_cast<int>(type));
 	}
 
 	EXIT_NOT_IMPLEMENTED(result != OK);
 
+	std::atomic_thread_fence(std::memory_order_release);
+	*static_cast<void* volatile*>(addr) = created;
+
 	auto index = m_objects.Find(nullptr);
 
 	if (m_objects.IndexValid(index))
@@ -510,6 +886,83 @@ void PthreadPool::FreeDetachedThreads()
 	}
 }
 
+bool PthreadPool::StartOnIdleWorker(Pthread thread, const PthreadWorkerKey& key)
+{
+	Core::LockGuard lock(m_workers_mutex);
+
+	for (uint32_t index = 0; index < m_idle_workers.Size(); index++)
+	{
+		auto* worker = m_idle_workers[index];
+
+		if (worker->key.stack_size == key.stack_size && worker->key.guard_size == key.guard_size && worker->key.policy == key.policy &&
+		    worker->key.priority == key.priority)
+		{
+			m_idle_workers.RemoveAt(index);
+
+			worker->next = thread;
+			worker->cond_var.Signal();
+
+			return true;
+		}
+	}
+
+	return false;
+}
+
+// Returns nullptr if the host thread should exit
+Pthread PthreadPool::WaitForWork(PthreadWorker* worker)
+{
+	Core::LockGuard lock(m_workers_mutex);
+
+	if (m_idle_workers.Size() >= WORKERS_IDLE_MAX)
+	{
+		return nullptr;
+	}
+
+	m_idle_workers.Add(worker);
+
+	uint32_t    elapsed = 0;
+	Core::Timer t;
+	t.Start();
+
+	while (worker->next == nullptr)
+	{
+		if (elapsed >= WORKER_IDLE_TIMEOUT)
+		{
+			m_idle_workers.Remove(worker);
+			return nullptr;
+		}
+
+		worker->cond_var.WaitFor(&m_workers_mutex, WORKER_IDLE_TIMEOUT - elapsed);
+
+		elapsed = static_cast<uint32_t>(t.GetTimeS() * 1000000.0);
+	}
+
+	auto* next   = worker->next;
+	worker->next = nullptr;
+
+	return next;
+}
+
+void PthreadPool::Finish(Pthread thread)
+{
+	Core::LockGuard lock(m_workers_mutex);
+
+	thread->almost_done = true;
+
+	m_finished_cond_var.SignalAll();
+}
+
+void PthreadPool::WaitFinished(Pthread thread)
+{
+	Core::LockGuard lock(m_workers_mutex);
+
+	while (!thread->almost_done)
+	{
+		m_finished_cond_var.Wait(&m_workers_mutex);
+	}
+}
+
 bool PthreadKeys::Create(int* key, pthread_key_destructor_func_t destructor)
 {
 	EXIT_IF(key == nullptr);
@@ -518,12 +971,11 @@ bool PthreadKeys::Create(int* key, pthread_key_destructor_func_t destructor)
 
 	for (int index = 0; index < KEYS_MAX; index++)
 	{
-		if (!m_keys[index].used)
+		if (auto gen = m_keys[index].gen.load(std::memory_order_relaxed); (gen & 1u) == 0)
 		{
 			*key                     = index;
-			m_keys[index].used       = true;
 			m_keys[index].destructor = destructor;
-			m_keys[index].specific_values.Clear();
+			m_keys[index].gen.store(gen + 1, std::memory_order_release);
 			return true;
 		}
 	}
@@ -535,49 +987,70 @@ bool PthreadKeys::Delete(int key)
 {
 	Core::LockGuard lock(m_mutex);
 
-	if (key < 0 || key >= KEYS_MAX || !m_keys[key].used)
+	if (key < 0 || key >= KEYS_MAX)
+	{
+		return false;
+	}
+
+	auto gen = m_keys[key].gen.load(std::memory_order_relaxed);
+
+	if ((gen & 1u) == 0)
 	{
 		return false;
 	}
 
-	m_keys[key].used       = false;
+	m_keys[key].gen.store(gen + 1, std::memory_order_release);
 	m_keys[key].destructor = nullptr;
-	m_keys[key].specific_values.Clear();
 
 	return true;
 }
 
 void PthreadKeys::Destruct(int thread_id)
 {
-	Core::LockGuard lock(m_mutex);
-
 	struct CallInfo
 	{
 		pthread_key_destructor_func_t destructor;
 		void*                         data;
 	};
 
+	// Called by the exiting thread itself, destructors may set values again
+	ThreadValues* values = nullptr;
+
+	{
+		Core::LockGuard lock(m_mutex);
+
+		values = m_threads.Get(thread_id, nullptr);
+		m_threads.Remove(thread_id);
+	}
+
+	if (values == nullptr)
+	{
+		return;
+	}
+
 	for (int iter = 0; iter < DESTRUCTOR_ITERATIONS; iter++)
 	{
 		Vector<CallInfo> delete_list;
 
-		for (auto& key: m_keys)
 		{
-			if (key.used && key.destructor != nullptr)
+			Core::LockGuard lock(m_mutex);
+
+			for (int index = 0; index < KEYS_MAX; index++)
 			{
-				for (auto& v: key.specific_values)
+				const auto& key   = m_keys[index];
+				auto&       value = values->values[index];
+
+				if (key.gen.load(std::memory_order_relaxed) == value.gen && key.destructor != nullptr && value.data != nullptr)
 				{
-					if (v.thread_id == thread_id && v.data != nullptr)
-					{
-						delete_list.Add(CallInfo({key.destructor, v.data}));
-					}
+					delete_list.Add(CallInfo({key.destructor, value.data}));
+					value.data = nullptr;
 				}
 			}
 		}
 
 		if (delete_list.IsEmpty())
 		{
-			return;
+			break;
 		}
 
 		for (auto& d: delete_list)
@@ -585,52 +1058,69 @@ void PthreadKeys::Destruct(int thread_id)
 			d.destructor(d.data);
 		}
 	}
+
+	if (g_pthread_specific == values)
+	{
+		g_pthread_specific = nullptr;
+	}
+
+	delete values;
 }
 
 bool PthreadKeys::Set(int key, int thread_id, void* data)
 {
-	Core::LockGuard lock(m_mutex);
+	if (key < 0 || key >= KEYS_MAX)
+	{
+		return false;
+	}
 
-	if (key < 0 || key >= KEYS_MAX || !m_keys[key].used)
+	auto gen = m_keys[key].gen.load(std::memory_order_acquire);
+
+	if ((gen & 1u) == 0)
 	{
 		return false;
 	}
 
-	for (auto& v: m_keys[key].specific_values)
+	auto* values = g_pthread_specific;
+
+	if (values == nullptr)
 	{
-		if (v.thread_id == thread_id)
-		{
-			v.data = data;
-			return true;
-		}
+		values = new ThreadValues;
+
+		Core::LockGuard lock(m_mutex);
+
+		EXIT_IF(m_threads.Contains(thread_id));
+
+		m_threads.Put(thread_id, values);
+		g_pthread_specific = values;
 	}
 
-	m_keys[key].specific_values.Add(Map({thread_id, data}));
+	values->values[key].gen  = gen;
+	values->values[key].data = data;
 
 	return true;
 }
 
-bool PthreadKeys::Get(int key, int thread_id, void** data)
+bool PthreadKeys::Get(int key, int /*thread_id*/, void** data)
 {
 	EXIT_IF(data == nullptr);
 
-	Core::LockGuard lock(m_mutex);
-
-	if (key < 0 || key >= KEYS_MAX || !m_keys[key].used)
+	if (key < 0 || key >= KEYS_MAX)
 	{
 		return false;
 	}
 
-	for (auto& v: m_keys[key].specific_values)
+	auto gen = m_keys[key].gen.load(std::memory_order_acquire);
+
+	if ((gen & 1u) == 0)
 	{
-		if (v.thread_id == thread_id)
-		{
-			*data = v.data;
-			return true;
-		}
+		return false;
 	}
 
-	*data = nullptr;
+	const auto* values = g_pthread_specific;
+
+	// A value set before the key was deleted and created again has an old generation
+	*data = (values != nullptr && values->values[key].gen == gen ? values->values[key].data : nullptr);
 
 	return true;
 }
@@ -751,6 +1241,9 @@ int KYTY_SYSV_ABI PthreadMutexInit(PthreadMutex* mutex, const PthreadMutexattr*
 	*mutex = new PthreadMutexPrivate {};
 
 	(*mutex)->name = name;
+#ifdef KYTY_PROFILE_LOCKS
+	(*mutex)->stats = Core::LockProfiler::GetStats(name != nullptr ? name : "<guest mutex>");
+#endif
 
 	int result = pthread_mutex_init(&(*mutex)->p, &(*attr)->p);
 
@@ -794,6 +1287,206 @@ int KYTY_SYSV_ABI PthreadMutexDestroy(PthreadMutex* mutex)
 	}
 }
 
+// Short critical sections are waited out in user mode, the thread blocks in the host mutex only if it stays locked. Recursive and
+// error checking mutexes behave as before, trylock succeeds for the owner of a recursive one and fails for an error checking one.
+static int mutex_lock(pthread_mutex_t* m)
+{
+	static const uint32_t spin_count = Config::GetMutexSpinCount();
+
+	for (uint32_t i = 0; i < spin_count; i++)
+	{
+		if (pthread_mutex_trylock(m) == 0)
+		{
+			return 0;
+		}
+		_mm_pause();
+	}
+
+	return pthread_mutex_lock(m);
+}
+
+// Wait morphing. A broadcast wakes only the first waiter and requeues the others, each woken thread wakes the next requeued one after
+// it releases the guest mutex, so they take the mutex in turn instead of all contending for it. A signal wakes the first waiter.
+
+static thread_local PthreadCondWaiter  g_cond_waiter;
+static thread_local PthreadCondHandoff g_cond_handoff;
+
+static void cond_queue_add(PthreadCondQueue* q, PthreadCondWaiter* w)
+{
+	w->next = nullptr;
+	if (q->tail != nullptr)
+	{
+		q->tail->next = w;
+	} else
+	{
+		q->head = w;
+	}
+	q->tail = w;
+}
+
+static PthreadCondWaiter* cond_queue_pop(PthreadCondQueue* q)
+{
+	auto* w = q->head;
+	if (w != nullptr)
+	{
+		q->head = w->next;
+		if (q->head == nullptr)
+		{
+			q->tail = nullptr;
+		}
+	}
+	return w;
+}
+
+static bool cond_queue_remove(PthreadCondQueue* q, PthreadCondWaiter* w)
+{
+	PthreadCondWaiter* prev = nullptr;
+	for (auto* i = q->head; i != nullptr; prev = i, i = i->next)
+	{
+		if (i == w)
+		{
+			(prev != nullptr ? prev->next : q->head) = w->next;
+			if (q->tail == w)
+			{
+				q->tail = prev;
+			}
+			return true;
+		}
+	}
+	return false;
+}
+
+// Called with the mutex of the condition variable locked
+static void cond_wake(PthreadCondWaiter* w)
+{
+	w->woken = true;
+	pthread_cond_signal(&w->c);
+}
+
+static void cond_free(PthreadCondPrivate* cond)
+{
+	pthread_mutex_destroy(&cond->m);
+	delete cond;
+}
+
+// Called after the guest mutex is released
+static void cond_handoff(PthreadMutexPrivate* mutex)
+{
+	auto& h = g_cond_handoff;
+
+	if (h.cond == nullptr || h.mutex != mutex)
+	{
+		return;
+	}
+
+	auto* cond = h.cond;
+	h          = {};
+
+	pthread_mutex_lock(&cond->m);
+	cond->handoffs--;
+	if (auto* w = cond_queue_pop(&cond->requeued); w != nullptr)
+	{
+		cond_wake(w);
+	}
+	bool free = (cond->destroyed && cond->handoffs == 0);
+	pthread_mutex_unlock(&cond->m);
+
+	if (free)
+	{
+		cond_free(cond);
+	}
+}
+
+static void cond_handoff_flush()
+{
+	cond_handoff(g_cond_handoff.mutex);
+}
+
+// Returns errno. deadline - nullptr to wait without a timeout
+static int cond_wait(PthreadCondPrivate* cond, PthreadMutexPrivate* mutex, const timespec* deadline)
+{
+	cond_handoff_flush();
+
+	auto* w  = &g_cond_waiter;
+	w->woken = false;
+
+	pthread_mutex_lock(&cond->m);
+
+	cond_queue_add(&cond->waiters, w);
+
+	int result = pthread_mutex_unlock(&mutex->p);
+
+	while (result == 0 && !w->woken)
+	{
+		result = (deadline != nullptr ? pthread_cond_timedwait(&w->c, &cond->m, deadline) : pthread_cond_wait(&w->c, &cond->m));
+	}
+
+	if (w->woken)
+	{
+		result = 0;
+	} else if (!cond_queue_remove(&cond->waiters, w))
+	{
+		cond_queue_remove(&cond->requeued, w);
+	}
+
+	bool handoff = (w->woken && cond->requeued.head != nullptr);
+	if (handoff)
+	{
+		cond->handoffs++;
+	}
+
+	pthread_mutex_unlock(&cond->m);
+
+	if (result == EPERM)
+	{
+		// The mutex wasn't released
+		return result;
+	}
+
+	int lock_result = mutex_lock(&mutex->p);
+
+	if (handoff)
+	{
+		g_cond_handoff = {cond, mutex};
+	}
+
+	return (result != 0 ? result : lock_result);
+}
+
+#ifdef KYTY_PROFILE_LOCKS
+static void mutex_profile_locked(PthreadMutexPrivate* m, uint64_t wait_from, bool contended)
+{
+	if (m->owned++ == 0)
+	{
+		m->hold_from = Core::LockProfiler::GetTime();
+		Core::LockProfiler::Locked(m->stats, m->hold_from - wait_from, contended);
+	}
+}
+
+static void mutex_profile_unlocked(PthreadMutexPrivate* m)
+{
+	if (m->owned > 0 && --m->owned == 0)
+	{
+		Core::LockProfiler::Unlocked(m->stats, Core::LockProfiler::GetTime() - m->hold_from);
+	}
+}
+
+// Waiting for a condition variable doesn't count as holding the mutex
+static uint32_t mutex_profile_cond_release(PthreadMutexPrivate* m)
+{
+	uint32_t owned = m->owned;
+	m->owned       = 1;
+	mutex_profile_unlocked(m);
+	return owned;
+}
+
+static void mutex_profile_cond_acquire(PthreadMutexPrivate* m, uint32_t owned)
+{
+	mutex_profile_locked(m, Core::LockProfiler::GetTime(), false);
+	m->owned = owned;
+}
+#endif
+
 int KYTY_SYSV_ABI PthreadMutexLock(PthreadMutex* mutex)
 {
 	// PRINT_NAME();
@@ -813,7 +1506,22 @@ int KYTY_SYSV_ABI PthreadMutexLock(PthreadMutex* mutex)
 
 	EXIT_NOT_IMPLEMENTED(*mutex == nullptr);
 
-	int result = pthread_mutex_lock(&(*mutex)->p);
+#ifdef KYTY_PROFILE_LOCKS
+	uint64_t wait_from = Core::LockProfiler::GetTime();
+	bool     contended = false;
+	int      result    = pthread_mutex_trylock(&(*mutex)->p);
+	if (result != 0)
+	{
+		contended = true;
+		result    = mutex_lock(&(*mutex)->p);
+	}
+	if (result == 0)
+	{
+		mutex_profile_locked(*mutex, wait_from, contended);
+	}
+#else
+	int result = mutex_lock(&(*mutex)->p);
+#endif
 
 	// printf("\tmutex lock: %s, %d\n", (*mutex)->name.C_Str(), result);
 
@@ -840,6 +1548,13 @@ int KYTY_SYSV_ABI PthreadMutexTrylock(PthreadMutex* mutex)
 
 	int result = pthread_mutex_trylock(&(*mutex)->p);
 
+#ifdef KYTY_PROFILE_LOCKS
+	if (result == 0)
+	{
+		mutex_profile_locked(*mutex, Core::LockProfiler::GetTime(), false);
+	}
+#endif
+
 	// printf("\tmutex trylock: %s, %d\n", (*mutex)->name.C_Str(), result);
 
 	switch (result)
@@ -871,8 +1586,17 @@ int KYTY_SYSV_ABI PthreadMutexUnlock(PthreadMutex* mutex)
 
 	EXIT_NOT_IMPLEMENTED(*mutex == nullptr);
 
+#ifdef KYTY_PROFILE_LOCKS
+	mutex_profile_unlocked(*mutex);
+#endif
+
 	int result = pthread_mutex_unlock(&(*mutex)->p);
 
+	if (result == 0)
+	{
+		cond_handoff(*mutex);
+	}
+
 	// printf("\tmutex unlock: %s, %d\n", (*mutex)->name.C_Str(), result);
 
 	switch (result)
@@ -1050,6 +1774,11 @@ int KYTY_SYSV_ABI PthreadAttrGetschedparam(const PthreadAttr* attr, KernelSchedP
 		param->sched_priority = 700;
 	}
 
+	if (pthread_nice_priority())
+	{
+		param->sched_priority = (*attr)->priority;
+	}
+
 	if (result == 0)
 	{
 		return OK;
@@ -1231,7 +1960,10 @@ int KYTY_SYSV_ABI PthreadAttrSetschedparam(PthreadAttr* attr, const KernelSchedP
 	}
 
 	KernelSchedParam pparam {};
-	if (param->sched_priority <= 478)
+	if (pthread_nice_priority())
+	{
+		pparam.sched_priority = 0;
+	} else if (param->sched_priority <= 478)
 	{
 		pparam.sched_priority = +2;
 	} else if (param->sched_priority >= 733)
@@ -1242,6 +1974,8 @@ int KYTY_SYSV_ABI PthreadAttrSetschedparam(PthreadAttr* attr, const KernelSchedP
 		pparam.sched_priority = 0;
 	}
 
+	(*attr)->priority = param->sched_priority;
+
 	int result = pthread_attr_setschedparam(&(*attr)->p, &pparam);
 
 	if (result == 0)
@@ -1260,73 +1994,297 @@ int KYTY_SYSV_ABI PthreadAttrSetschedpolicy(PthreadAttr* attr, int policy)
 		return KERNEL_ERROR_EINVAL;
 	}
 
-	// winpthreads supports only SCHED_OTHER policy
-	int ppolicy = SCHED_OTHER;
+	// winpthreads supports only SCHED_OTHER policy
+	int ppolicy = SCHED_OTHER;
+
+	(*attr)->policy = policy;
+
+	int result = pthread_attr_setschedpolicy(&(*attr)->p, ppolicy);
+
+	if (result == 0)
+	{
+		return OK;
+	}
+	return KERNEL_ERROR_EINVAL;
+}
+
+int KYTY_SYSV_ABI PthreadAttrSetstack(PthreadAttr* attr, void* addr, size_t size)
+{
+	PRINT_NAME();
+
+	if (addr == nullptr || size == 0 || attr == nullptr || *attr == nullptr)
+	{
+		return KERNEL_ERROR_EINVAL;
+	}
+
+	int result1 = pthread_attr_setstackaddr(&(*attr)->p, addr);
+	int result2 = pthread_attr_setstacksize(&(*attr)->p, size);
+
+	if (result1 == 0 && result2 == 0)
+	{
+		return OK;
+	}
+	return KERNEL_ERROR_EINVAL;
+}
+
+int KYTY_SYSV_ABI PthreadAttrSetstackaddr(PthreadAttr* attr, void* addr)
+{
+	PRINT_NAME();
+
+	if (addr == nullptr || attr == nullptr || *attr == nullptr)
+	{
+		return KERNEL_ERROR_EINVAL;
+	}
+
+	int result1 = pthread_attr_setstackaddr(&(*attr)->p, addr);
+
+	if (result1 == 0)
+	{
+		return OK;
+	}
+	return KERNEL_ERROR_EINVAL;
+}
+
+int KYTY_SYSV_ABI PthreadAttrSetstacksize(PthreadAttr* attr, size_t stack_size)
+{
+	PRINT_NAME();
+
+	if (stack_size == 0 || attr == nullptr || *attr == nullptr)
+	{
+		return KERNEL_ERROR_EINVAL;
+	}
+
+	int result2 = pthread_attr_setstacksize(&(*attr)->p, stack_size);
+
+	if (result2 == 0)
+	{
+		return OK;
+	}
+	return KERNEL_ERROR_EINVAL;
+}
+
+// Reader-biased rwlock. A reader increments the counter of its stripe and checks the writer state after that, a writer publishes
+// the state and sums the counters after that, so at least one of them sees the other. Readers don't share a cache line unless a
+// writer comes. Writers are preferred: new readers wait while a writer waits, except for the threads which already hold a read lock,
+// which would deadlock on a recursive read lock otherwise.
+
+static thread_local PthreadRwlockThread g_rwlock_thread;
+static std::atomic_int                  g_rwlock_thread_seq = 0;
+
+static PthreadRwlockThread* rwlock_thread()
+{
+	auto* t = &g_rwlock_thread;
+	if (t->id == 0)
+	{
+		t->id = ++g_rwlock_thread_seq;
+	}
+	return t;
+}
+
+static std::atomic_int* rwlock_readers(PthreadRwlockPrivate* l, const PthreadRwlockThread* t)
+{
+	return &l->stripes[static_cast<uint32_t>(t->id) % RWLOCK_STRIPES_NUM].readers;
+}
+
+static int rwlock_readers_num(PthreadRwlockPrivate* l)
+{
+	int num = 0;
+	for (auto& s: l->stripes)
+	{
+		num += s.readers.load();
+	}
+	return num;
+}
+
+static bool rwlock_reader_blocked(const PthreadRwlockPrivate* l, const PthreadRwlockThread* t)
+{
+	return l->writing.load() || (l->writers.load() != 0 && !l->prefer_reader && t->rdlocks.IsEmpty());
+}
+
+// Wakes the writer which waits for the readers to leave
+static void rwlock_reader_left(PthreadRwlockPrivate* l)
+{
+	if (l->writers.load() != 0)
+	{
+		pthread_mutex_lock(&l->m);
+		pthread_cond_signal(&l->drained);
+		pthread_mutex_unlock(&l->m);
+	}
+}
+
+// Called with the mutex locked
+static int rwlock_wait(pthread_cond_t* cond, pthread_mutex_t* m, const timespec* deadline)
+{
+	return (deadline != nullptr ? pthread_cond_timedwait(cond, m, deadline) : pthread_cond_wait(cond, m));
+}
+
+// Returns errno. deadline - nullptr to wait without a timeout
+static int rwlock_rdlock(PthreadRwlockPrivate* l, const timespec* deadline, bool try_lock)
+{
+	auto* t       = rwlock_thread();
+	auto* readers = rwlock_readers(l, t);
+
+	for (;;)
+	{
+		readers->fetch_add(1);
+
+		if (!rwlock_reader_blocked(l, t))
+		{
+			t->rdlocks.Add(l);
+			return 0;
+		}
+
+		readers->fetch_sub(1);
+		rwlock_reader_left(l);
+
+		if (try_lock)
+		{
+			return EBUSY;
+		}
+
+		int result = 0;
+
+		pthread_mutex_lock(&l->m);
+		while (result == 0 && rwlock_reader_blocked(l, t))
+		{
+			result = rwlock_wait(&l->cond, &l->m, deadline);
+		}
+		pthread_mutex_unlock(&l->m);
+
+		if (result != 0)
+		{
+			return result;
+		}
+	}
+}
+
+// Called with the mutex locked
+static void rwlock_writer_cancel(PthreadRwlockPrivate* l)
+{
+	l->writing = false;
+	l->owner   = 0;
+	l->writers--;
+	pthread_cond_broadcast(&l->cond);
+}
+
+static int rwlock_wrlock(PthreadRwlockPrivate* l, const timespec* deadline, bool try_lock)
+{
+	auto* t = rwlock_thread();
+
+	if (l->owner.load() == t->id)
+	{
+		return EDEADLK;
+	}
+
+	int result = 0;
+
+	pthread_mutex_lock(&l->m);
+
+	if (try_lock && l->owner.load() != 0)
+	{
+		result = EBUSY;
+	} else
+	{
+		l->writers++;
+
+		while (result == 0 && l->owner.load() != 0)
+		{
+			result = rwlock_wait(&l->cond, &l->m, deadline);
+		}
+
+		if (result != 0)
+		{
+			// Another writer still owns the lock
+			l->writers--;
+			pthread_cond_broadcast(&l->cond);
+		} else
+		{
+			l->owner = t->id;
+
+			for (;;)
+			{
+				while (!try_lock && result == 0 && rwlock_readers_num(l) != 0)
+				{
+					result = rwlock_wait(&l->drained, &l->m, deadline);
+				}
+
+				if (result != 0)
+				{
+					break;
+				}
 
-	(*attr)->policy = policy;
+				// A reader which holds another read lock or prefers readers could come in after the counters were summed
+				l->writing = true;
 
-	int result = pthread_attr_setschedpolicy(&(*attr)->p, ppolicy);
+				if (rwlock_readers_num(l) == 0)
+				{
+					break;
+				}
 
-	if (result == 0)
-	{
-		return OK;
-	}
-	return KERNEL_ERROR_EINVAL;
-}
+				l->writing = false;
+				pthread_cond_broadcast(&l->cond);
 
-int KYTY_SYSV_ABI PthreadAttrSetstack(PthreadAttr* attr, void* addr, size_t size)
-{
-	PRINT_NAME();
+				if (try_lock)
+				{
+					result = EBUSY;
+					break;
+				}
+			}
 
-	if (addr == nullptr || size == 0 || attr == nullptr || *attr == nullptr)
-	{
-		return KERNEL_ERROR_EINVAL;
+			if (result != 0)
+			{
+				rwlock_writer_cancel(l);
+			}
+		}
 	}
 
-	int result1 = pthread_attr_setstackaddr(&(*attr)->p, addr);
-	int result2 = pthread_attr_setstacksize(&(*attr)->p, size);
+	pthread_mutex_unlock(&l->m);
 
-	if (result1 == 0 && result2 == 0)
-	{
-		return OK;
-	}
-	return KERNEL_ERROR_EINVAL;
+	return result;
 }
 
-int KYTY_SYSV_ABI PthreadAttrSetstackaddr(PthreadAttr* attr, void* addr)
+static int rwlock_unlock(PthreadRwlockPrivate* l)
 {
-	PRINT_NAME();
+	auto* t = rwlock_thread();
 
-	if (addr == nullptr || attr == nullptr || *attr == nullptr)
+	if (l->owner.load() == t->id && l->writing.load())
 	{
-		return KERNEL_ERROR_EINVAL;
+		pthread_mutex_lock(&l->m);
+		rwlock_writer_cancel(l);
+		pthread_mutex_unlock(&l->m);
+		return 0;
 	}
 
-	int result1 = pthread_attr_setstackaddr(&(*attr)->p, addr);
+	auto index = t->rdlocks.Find(l);
 
-	if (result1 == 0)
+	if (index == Vector<const PthreadRwlockPrivate*>::INVALID_INDEX)
 	{
-		return OK;
+		return EPERM;
 	}
-	return KERNEL_ERROR_EINVAL;
+
+	t->rdlocks.RemoveAt(index);
+	rwlock_readers(l, t)->fetch_sub(1);
+	rwlock_reader_left(l);
+
+	return 0;
 }
 
-int KYTY_SYSV_ABI PthreadAttrSetstacksize(PthreadAttr* attr, size_t stack_size)
+// A static initializer is nullptr, then the rwlock is created on the first use. An initialized rwlock doesn't need the context.
+static PthreadRwlock* rwlock_static_object(PthreadRwlock* rwlock)
 {
-	PRINT_NAME();
-
-	if (stack_size == 0 || attr == nullptr || *attr == nullptr)
+	if (rwlock == nullptr || *static_cast<PthreadRwlockPrivate* volatile*>(rwlock) != nullptr)
 	{
-		return KERNEL_ERROR_EINVAL;
+		std::atomic_thread_fence(std::memory_order_acquire);
+		return rwlock;
 	}
 
-	int result2 = pthread_attr_setstacksize(&(*attr)->p, stack_size);
+	EXIT_IF(g_pthread_context == nullptr);
 
-	if (result2 == 0)
-	{
-		return OK;
-	}
-	return KERNEL_ERROR_EINVAL;
+	auto* pthread_static_objects = g_pthread_context->GetPthreadStaticObjects();
+
+	EXIT_IF(pthread_static_objects == nullptr);
+
+	return static_cast<PthreadRwlock*>(pthread_static_objects->CreateObject(rwlock, PthreadStaticObject::Type::Rwlock));
 }
 
 int KYTY_SYSV_ABI PthreadRwlockDestroy(PthreadRwlock* rwlock)
@@ -1340,7 +2298,14 @@ int KYTY_SYSV_ABI PthreadRwlockDestroy(PthreadRwlock* rwlock)
 
 	EXIT_NOT_IMPLEMENTED(*rwlock == nullptr);
 
-	int result = pthread_rwlock_destroy(&(*rwlock)->p);
+	if ((*rwlock)->writers.load() != 0 || rwlock_readers_num(*rwlock) != 0)
+	{
+		return KERNEL_ERROR_EBUSY;
+	}
+
+	pthread_cond_destroy(&(*rwlock)->drained);
+	pthread_cond_destroy(&(*rwlock)->cond);
+	int result = pthread_mutex_destroy(&(*rwlock)->m);
 
 	printf("\trwlock destroy: %s, %d\n", (*rwlock)->name.C_Str(), result);
 
@@ -1372,9 +2337,12 @@ int KYTY_SYSV_ABI PthreadRwlockInit(PthreadRwlock* rwlock, const PthreadRwlockat
 
 	*rwlock = new PthreadRwlockPrivate {};
 
-	(*rwlock)->name = name;
+	(*rwlock)->name          = name;
+	(*rwlock)->prefer_reader = ((*attr)->type == RWLOCK_TYPE_PREFER_READER);
 
-	int result = pthread_rwlock_init(&(*rwlock)->p, &(*attr)->p);
+	int result = pthread_mutex_init(&(*rwlock)->m, nullptr);
+	result     = (result == 0 ? pthread_cond_init(&(*rwlock)->cond, nullptr) : result);
+	result     = (result == 0 ? pthread_cond_init(&(*rwlock)->drained, nullptr) : result);
 
 	printf("\trwlock init: %s, %d\n", (*rwlock)->name.C_Str(), result);
 
@@ -1390,15 +2358,9 @@ int KYTY_SYSV_ABI PthreadRwlockInit(PthreadRwlock* rwlock, const PthreadRwlockat
 
 int KYTY_SYSV_ABI PthreadRwlockRdlock(PthreadRwlock* rwlock)
 {
-	PRINT_NAME();
+	TRACE_NAME_LIMITED(Pthread);
 
-	EXIT_IF(g_pthread_context == nullptr);
-
-	auto* pthread_static_objects = g_pthread_context->GetPthreadStaticObjects();
-
-	EXIT_IF(pthread_static_objects == nullptr);
-
-	rwlock = static_cast<PthreadRwlock*>(pthread_static_objects->CreateObject(rwlock, PthreadStaticObject::Type::Rwlock));
+	rwlock = rwlock_static_object(rwlock);
 
 	if (rwlock == nullptr)
 	{
@@ -1407,7 +2369,7 @@ int KYTY_SYSV_ABI PthreadRwlockRdlock(PthreadRwlock* rwlock)
 
 	EXIT_NOT_IMPLEMENTED(*rwlock == nullptr);
 
-	int result = pthread_rwlock_rdlock(&(*rwlock)->p);
+	int result = rwlock_rdlock(*rwlock, nullptr, false);
 
 	// printf("\trwlock rdlock: %s, %d\n", (*rwlock)->name.C_Str(), result);
 
@@ -1422,7 +2384,7 @@ int KYTY_SYSV_ABI PthreadRwlockRdlock(PthreadRwlock* rwlock)
 
 int KYTY_SYSV_ABI PthreadRwlockTimedrdlock(PthreadRwlock* rwlock, KernelUseconds usec)
 {
-	PRINT_NAME();
+	TRACE_NAME_LIMITED(Pthread);
 
 	if (rwlock == nullptr)
 	{
@@ -1432,9 +2394,9 @@ int KYTY_SYSV_ABI PthreadRwlockTimedrdlock(PthreadRwlock* rwlock, KernelUseconds
 	EXIT_NOT_IMPLEMENTED(*rwlock == nullptr);
 
 	timespec t {};
-	usec_to_timespec(&t, usec);
+	usec_to_deadline(&t, usec);
 
-	int result = pthread_rwlock_timedrdlock(&(*rwlock)->p, &t);
+	int result = rwlock_rdlock(*rwlock, &t, false);
 
 	// printf("\trwlock timedrdlock: %s, %d\n", (*rwlock)->name.C_Str(), result);
 
@@ -1450,7 +2412,7 @@ int KYTY_SYSV_ABI PthreadRwlockTimedrdlock(PthreadRwlock* rwlock, KernelUseconds
 
 int KYTY_SYSV_ABI PthreadRwlockTimedwrlock(PthreadRwlock* rwlock, KernelUseconds usec)
 {
-	PRINT_NAME();
+	TRACE_NAME_LIMITED(Pthread);
 
 	if (rwlock == nullptr)
 	{
@@ -1460,9 +2422,9 @@ int KYTY_SYSV_ABI PthreadRwlockTimedwrlock(PthreadRwlock* rwlock, KernelUseconds
 	EXIT_NOT_IMPLEMENTED(*rwlock == nullptr);
 
 	timespec t {};
-	usec_to_timespec(&t, usec);
+	usec_to_deadline(&t, usec);
 
-	int result = pthread_rwlock_timedwrlock(&(*rwlock)->p, &t);
+	int result = rwlock_wrlock(*rwlock, &t, false);
 
 	// printf("\trwlock timedwrlock: %s, %d\n", (*rwlock)->name.C_Str(), result);
 
@@ -1470,6 +2432,7 @@ int KYTY_SYSV_ABI PthreadRwlockTimedwrlock(PthreadRwlock* rwlock, KernelUseconds
 	{
 		case 0: return OK;
 		case ETIMEDOUT: return KERNEL_ERROR_ETIMEDOUT;
+		case EDEADLK: return KERNEL_ERROR_EDEADLK;
 		case EAGAIN: return KERNEL_ERROR_EAGAIN;
 		case EINVAL:
 		default: return KERNEL_ERROR_EINVAL;
@@ -1478,7 +2441,7 @@ int KYTY_SYSV_ABI PthreadRwlockTimedwrlock(PthreadRwlock* rwlock, KernelUseconds
 
 int KYTY_SYSV_ABI PthreadRwlockTryrdlock(PthreadRwlock* rwlock)
 {
-	PRINT_NAME();
+	TRACE_NAME_LIMITED(Pthread);
 
 	if (rwlock == nullptr)
 	{
@@ -1487,7 +2450,7 @@ int KYTY_SYSV_ABI PthreadRwlockTryrdlock(PthreadRwlock* rwlock)
 
 	EXIT_NOT_IMPLEMENTED(*rwlock == nullptr);
 
-	int result = pthread_rwlock_tryrdlock(&(*rwlock)->p);
+	int result = rwlock_rdlock(*rwlock, nullptr, true);
 
 	// printf("\trwlock tryrdlock: %s, %d\n", (*rwlock)->name.C_Str(), result);
 
@@ -1503,7 +2466,7 @@ int KYTY_SYSV_ABI PthreadRwlockTryrdlock(PthreadRwlock* rwlock)
 
 int KYTY_SYSV_ABI PthreadRwlockTrywrlock(PthreadRwlock* rwlock)
 {
-	PRINT_NAME();
+	TRACE_NAME_LIMITED(Pthread);
 
 	if (rwlock == nullptr)
 	{
@@ -1512,13 +2475,14 @@ int KYTY_SYSV_ABI PthreadRwlockTrywrlock(PthreadRwlock* rwlock)
 
 	EXIT_NOT_IMPLEMENTED(*rwlock == nullptr);
 
-	int result = pthread_rwlock_trywrlock(&(*rwlock)->p);
+	int result = rwlock_wrlock(*rwlock, nullptr, true);
 
 	// printf("\trwlock trywrlock: %s, %d\n", (*rwlock)->name.C_Str(), result);
 
 	switch (result)
 	{
 		case 0: return OK;
+		case EDEADLK: return KERNEL_ERROR_EDEADLK;
 		case EAGAIN: return KERNEL_ERROR_EAGAIN;
 		case EBUSY: return KERNEL_ERROR_EBUSY;
 		case EINVAL:
@@ -1530,13 +2494,7 @@ int KYTY_SYSV_ABI PthreadRwlockUnlock(PthreadRwlock* rwlock)
 {
 	// PRINT_NAME();
 
-	EXIT_IF(g_pthread_context == nullptr);
-
-	auto* pthread_static_objects = g_pthread_context->GetPthreadStaticObjects();
-
-	EXIT_IF(pthread_static_objects == nullptr);
-
-	rwlock = static_cast<PthreadRwlock*>(pthread_static_objects->CreateObject(rwlock, PthreadStaticObject::Type::Rwlock));
+	rwlock = rwlock_static_object(rwlock);
 
 	if (rwlock == nullptr)
 	{
@@ -1545,7 +2503,7 @@ int KYTY_SYSV_ABI PthreadRwlockUnlock(PthreadRwlock* rwlock)
 
 	EXIT_NOT_IMPLEMENTED(*rwlock == nullptr);
 
-	int result = pthread_rwlock_unlock(&(*rwlock)->p);
+	int result = rwlock_unlock(*rwlock);
 
 	// printf("\trwlock unlock: %s, %d\n", (*rwlock)->name.C_Str(), result);
 
@@ -1563,13 +2521,7 @@ int KYTY_SYSV_ABI PthreadRwlockWrlock(PthreadRwlock* rwlock)
 {
 	// PRINT_NAME();
 
-	EXIT_IF(g_pthread_context == nullptr);
-
-	auto* pthread_static_objects = g_pthread_context->GetPthreadStaticObjects();
-
-	EXIT_IF(pthread_static_objects == nullptr);
-
-	rwlock = static_cast<PthreadRwlock*>(pthread_static_objects->CreateObject(rwlock, PthreadStaticObject::Type::Rwlock));
+	rwlock = rwlock_static_object(rwlock);
 
 	if (rwlock == nullptr)
 	{
@@ -1578,13 +2530,14 @@ int KYTY_SYSV_ABI PthreadRwlockWrlock(PthreadRwlock* rwlock)
 
 	EXIT_NOT_IMPLEMENTED(*rwlock == nullptr);
 
-	int result = pthread_rwlock_wrlock(&(*rwlock)->p);
+	int result = rwlock_wrlock(*rwlock, nullptr, false);
 
 	// printf("\trwlock wrlock: %s, %d\n", (*rwlock)->name.C_Str(), result);
 
 	switch (result)
 	{
 		case 0: return OK;
+		case EDEADLK: return KERNEL_ERROR_EDEADLK;
 		case EAGAIN: return KERNEL_ERROR_EAGAIN;
 		case EINVAL:
 		default: return KERNEL_ERROR_EINVAL;
@@ -1701,7 +2654,7 @@ int KYTY_SYSV_ABI PthreadCondattrInit(PthreadCondattr* attr)
 
 int KYTY_SYSV_ABI PthreadCondBroadcast(PthreadCond* cond)
 {
-	PRINT_NAME();
+	TRACE_NAME_LIMITED(Pthread);
 
 	EXIT_IF(g_pthread_context == nullptr);
 
@@ -1718,9 +2671,22 @@ int KYTY_SYSV_ABI PthreadCondBroadcast(PthreadCond* cond)
 
 	EXIT_NOT_IMPLEMENTED(*cond == nullptr);
 
-	int result = pthread_cond_broadcast(&(*cond)->p);
+	auto* c = *cond;
+
+	pthread_mutex_lock(&c->m);
+	if (auto* w = cond_queue_pop(&c->waiters); w != nullptr)
+	{
+		cond_wake(w);
+		while ((w = cond_queue_pop(&c->waiters)) != nullptr)
+		{
+			cond_queue_add(&c->requeued, w);
+		}
+	}
+	pthread_mutex_unlock(&c->m);
+
+	int result = 0;
 
-	printf("\tcond broadcast: %s, %d\n", (*cond)->name.C_Str(), result);
+	TRACE_LIMITED(Pthread, "\tcond broadcast: %s, %d\n", (*cond)->name.C_Str(), result);
 
 	if (result == 0)
 	{
@@ -1740,23 +2706,32 @@ int KYTY_SYSV_ABI PthreadCondDestroy(PthreadCond* cond)
 
 	EXIT_NOT_IMPLEMENTED(*cond == nullptr);
 
-	int result = pthread_cond_destroy(&(*cond)->p);
+	auto* c = *cond;
 
-	printf("\tcond destroy: %s, %d\n", (*cond)->name.C_Str(), result);
+	pthread_mutex_lock(&c->m);
+	bool busy = (c->waiters.head != nullptr || c->requeued.head != nullptr);
+	bool free = (!busy && c->handoffs == 0);
+	c->destroyed = !busy;
+	pthread_mutex_unlock(&c->m);
 
-	delete *cond;
-	*cond = nullptr;
+	printf("\tcond destroy: %s, %s\n", c->name.C_Str(), (busy ? "busy" : "ok"));
 
-	switch (result)
+	if (busy)
 	{
-		case 0: return OK;
-		case EINVAL: return KERNEL_ERROR_EINVAL;
-		case EBUSY: return KERNEL_ERROR_EBUSY;
-		default: return KERNEL_ERROR_EINVAL;
+		return KERNEL_ERROR_EBUSY;
+	}
+
+	if (free)
+	{
+		cond_free(c);
 	}
+	*cond = nullptr;
+
+	return OK;
 }
 
-int KYTY_SYSV_ABI PthreadCondInit(PthreadCond* cond, const PthreadCondattr* attr, const char* name)
+// No condition variable attributes are supported, timed waits have CLOCK_REALTIME deadlines
+int KYTY_SYSV_ABI PthreadCondInit(PthreadCond* cond, const PthreadCondattr* /*attr*/, const char* name)
 {
 	PRINT_NAME();
 
@@ -1765,18 +2740,11 @@ int KYTY_SYSV_ABI PthreadCondInit(PthreadCond* cond, const PthreadCondattr* attr
 		return KERNEL_ERROR_EINVAL;
 	}
 
-	if (attr == nullptr)
-	{
-		EXIT_IF(g_pthread_context == nullptr);
-
-		attr = g_pthread_context->GetDefaultCondattr();
-	}
-
 	*cond = new PthreadCondPrivate {};
 
 	(*cond)->name = name;
 
-	int result = pthread_cond_init(&(*cond)->p, &(*attr)->p);
+	int result = pthread_mutex_init(&(*cond)->m, nullptr);
 
 	printf("\tcond init: %s, %d\n", (*cond)->name.C_Str(), result);
 
@@ -1792,7 +2760,7 @@ int KYTY_SYSV_ABI PthreadCondInit(PthreadCond* cond, const PthreadCondattr* attr
 
 int KYTY_SYSV_ABI PthreadCondSignal(PthreadCond* cond)
 {
-	PRINT_NAME();
+	TRACE_NAME_LIMITED(Pthread);
 
 	EXIT_NOT_IMPLEMENTED(cond == nullptr);
 
@@ -1803,7 +2771,16 @@ int KYTY_SYSV_ABI PthreadCondSignal(PthreadCond* cond)
 
 	EXIT_NOT_IMPLEMENTED(*cond == nullptr);
 
-	int result = pthread_cond_signal(&(*cond)->p);
+	auto* c = *cond;
+
+	pthread_mutex_lock(&c->m);
+	if (auto* w = cond_queue_pop(&c->waiters); w != nullptr)
+	{
+		cond_wake(w);
+	}
+	pthread_mutex_unlock(&c->m);
+
+	int result = 0;
 
 	// printf("\tcond signal: %s, %d\n", (*cond)->name.C_Str(), result);
 
@@ -1840,7 +2817,7 @@ int KYTY_SYSV_ABI PthreadCondSignalto(PthreadCond* cond, Pthread thread)
 
 int KYTY_SYSV_ABI PthreadCondTimedwait(PthreadCond* cond, PthreadMutex* mutex, KernelUseconds usec)
 {
-	PRINT_NAME();
+	TRACE_NAME_LIMITED(Pthread);
 
 	if (cond == nullptr || mutex == nullptr)
 	{
@@ -1851,9 +2828,17 @@ int KYTY_SYSV_ABI PthreadCondTimedwait(PthreadCond* cond, PthreadMutex* mutex, K
 	EXIT_NOT_IMPLEMENTED(*mutex == nullptr);
 
 	timespec t {};
-	usec_to_timespec(&t, usec);
+	usec_to_deadline(&t, usec);
+
+	#ifdef KYTY_PROFILE_LOCKS
+	uint32_t owned = mutex_profile_cond_release(*mutex);
+#endif
 
-	int result = pthread_cond_timedwait(&(*cond)->p, &(*mutex)->p, &t);
+	int result = cond_wait(*cond, *mutex, &t);
+
+#ifdef KYTY_PROFILE_LOCKS
+	mutex_profile_cond_acquire(*mutex, owned);
+#endif
 
 	// printf("\tcond timedwait: %s, %d\n", (*cond)->name.C_Str(), result);
 
@@ -1869,7 +2854,7 @@ int KYTY_SYSV_ABI PthreadCondTimedwait(PthreadCond* cond, PthreadMutex* mutex, K
 
 int KYTY_SYSV_ABI PthreadCondWait(PthreadCond* cond, PthreadMutex* mutex)
 {
-	PRINT_NAME();
+	TRACE_NAME_LIMITED(Pthread);
 
 	EXIT_IF(g_pthread_context == nullptr);
 
@@ -1888,7 +2873,15 @@ int KYTY_SYSV_ABI PthreadCondWait(PthreadCond* cond, PthreadMutex* mutex)
 	EXIT_NOT_IMPLEMENTED(*cond == nullptr);
 	EXIT_NOT_IMPLEMENTED(*mutex == nullptr);
 
-	int result = pthread_cond_wait(&(*cond)->p, &(*mutex)->p);
+	#ifdef KYTY_PROFILE_LOCKS
+	uint32_t owned = mutex_profile_cond_release(*mutex);
+#endif
+
+	int result = cond_wait(*cond, *mutex, nullptr);
+
+#ifdef KYTY_PROFILE_LOCKS
+	mutex_profile_cond_acquire(*mutex, owned);
+#endif
 
 	// printf("\tcond wait: %s, %d\n", (*cond)->name.C_Str(), result);
 
@@ -1910,6 +2903,8 @@ Pthread KYTY_SYSV_ABI PthreadSelf()
 	return g_pthread_self;
 }
 
+// Runs on the exiting thread, also if it is exited or canceled. TLS and keys are released here because the host thread may run
+// another guest thread before this one is joined.
 static void cleanup_thread(void* arg)
 {
 	auto* thread = static_cast<Pthread>(arg);
@@ -1923,29 +2918,91 @@ static void cleanup_thread(void* arg)
 		thread_dtors();
 	}
 
-	thread->almost_done = true;
+	g_pthread_context->GetPthreadKeys()->Destruct(thread->unique_id);
+	Core::Singleton<Loader::RuntimeLinker>::Instance()->DeleteTlss(thread->unique_id);
+
+	Profiler::SamplerThreadStop();
+	Profiler::BenchmarkThreadStop();
+
+	cond_handoff_flush();
+
+	g_pthread_self = nullptr;
+
+	g_pthread_context->GetPthreadPool()->Finish(thread);
 }
 
-static void* run_thread(void* arg)
+static void run_guest_thread(Pthread thread)
 {
-	auto* thread = static_cast<Pthread>(arg);
-	void* ret    = nullptr;
-
 	thread->unique_id = Core::Thread::GetThreadIdUnique();
+	thread->p         = pthread_self();
+	thread->host_tid  = pthread_host_tid();
+	thread->ret       = nullptr;
 
 	g_pthread_self = thread;
 
+	// Applied on every start, a reused host thread may still have the placement of the previous guest thread
+	const auto& map = get_host_cpu_map();
+
+	if (map.IsEnabled())
+	{
+		pthread_set_host_affinity(thread->p, map.GetGuestMask(thread->attr->affinity));
+	}
+
+	if (pthread_nice_priority())
+	{
+		pthread_set_nice(thread->host_tid, thread->priority);
+	}
+
+	Loader::RuntimeLinker::TlsInitThread();
+
+	Profiler::SamplerThreadStart(thread->name);
+	Profiler::BenchmarkThreadStart(U"Guest");
+
 	// NOLINTNEXTLINE(cppcoreguidelines-pro-type-cstyle-cast)
 	pthread_cleanup_push(cleanup_thread, thread);
 
 	thread->started = true;
 
-	ret = thread->entry(thread->arg);
+	thread->ret = thread->entry(thread->arg);
 
 	// NOLINTNEXTLINE(cppcoreguidelines-pro-type-cstyle-cast)
 	pthread_cleanup_pop(1);
+}
 
-	return ret;
+static void* run_thread(void* arg)
+{
+	auto* thread = static_cast<Pthread>(arg);
+
+	EXIT_IF(g_pthread_context == nullptr);
+
+	auto* pthread_pool = g_pthread_context->GetPthreadPool();
+
+	PthreadWorker worker;
+	bool          reusable = pthread_worker_key(&thread->attr, &worker.key);
+
+	while (thread != nullptr)
+	{
+		run_guest_thread(thread);
+
+		// The guest may have changed the priority of the host thread
+		sched_param param {};
+		int         policy = 0;
+		if (reusable)
+		{
+			reusable = (pthread_getschedparam(pthread_self(), &policy, &param) == 0 && policy == worker.key.policy &&
+			            param.sched_priority == worker.key.priority);
+		}
+
+		// A raised nice value may not be lowered again without privileges
+		if (reusable && pthread_nice_priority())
+		{
+			reusable = pthread_nice_is_default();
+		}
+
+		thread = (reusable ? pthread_pool->WaitForWork(&worker) : nullptr);
+	}
+
+	return nullptr;
 }
 
 int KYTY_SYSV_ABI PthreadCreate(Pthread* thread, const PthreadAttr* attr, pthread_entry_func_t entry, void* arg, const char* name)
@@ -1992,8 +3049,29 @@ int KYTY_SYSV_ABI PthreadCreate(Pthread* thread, const PthreadAttr* attr, pthrea
 		(*thread)->detached    = (*attr)->detached;
 		(*thread)->started     = false;
 		(*thread)->unique_id   = -1;
+		(*thread)->host_tid    = 0;
+		(*thread)->priority    = (*attr)->priority;
+
+		int inherit = 0;
+		if (pthread_attr_getinheritsched(&(*attr)->p, &inherit) == 0 && inherit == PTHREAD_INHERIT_SCHED && g_pthread_self != nullptr)
+		{
+			(*thread)->priority = g_pthread_self->priority.load();
+		}
+
+		PthreadWorkerKey key;
+
+		if (!(pthread_worker_key(attr, &key) && pthread_pool->StartOnIdleWorker(*thread, key)))
+		{
+			pthread_t p {};
+
+			result = pthread_create(&p, &(*attr)->p, run_thread, *thread);
 
-		result = pthread_create(&(*thread)->p, &(*attr)->p, run_thread, *thread);
+			// Host threads are never joined, the guest thread is joined with PthreadPool::WaitFinished()
+			if (result == 0 && !(*attr)->detached)
+			{
+				pthread_detach(p);
+			}
+		}
 	}
 
 	if (result == 0)
@@ -2046,31 +3124,32 @@ int KYTY_SYSV_ABI PthreadJoin(Pthread thread, void** value)
 		return KERNEL_ERROR_EINVAL;
 	}
 
-	int result = pthread_join(thread->p, value);
-
-	if (PRINT_NAME_ENABLED)
+	if (thread == g_pthread_self)
 	{
-		printf("\tthread join: %s, %d\n", thread->name.C_Str(), result);
+		return KERNEL_ERROR_EDEADLK;
 	}
 
-	int id = thread->unique_id;
-
-	thread->almost_done = false;
-	thread->free        = true;
+	if (thread->free)
+	{
+		return KERNEL_ERROR_ESRCH;
+	}
 
-	auto* rt = Core::Singleton<Loader::RuntimeLinker>::Instance();
-	rt->DeleteTlss(id);
+	g_pthread_context->GetPthreadPool()->WaitFinished(thread);
 
-	g_pthread_context->GetPthreadKeys()->Destruct(id);
+	if (value != nullptr)
+	{
+		*value = thread->ret;
+	}
 
-	switch (result)
+	if (PRINT_NAME_ENABLED)
 	{
-		case 0: return OK;
-		case ESRCH: return KERNEL_ERROR_ESRCH;
-		case EDEADLK: return KERNEL_ERROR_EDEADLK;
-		case EOPNOTSUPP: return KERNEL_ERROR_EOPNOTSUPP;
-		default: return KERNEL_ERROR_EINVAL;
+		printf("\tthread join: %s\n", thread->name.C_Str());
 	}
+
+	thread->almost_done = false;
+	thread->free        = true;
+
+	return OK;
 }
 
 int KYTY_SYSV_ABI PthreadCancel(Pthread thread)
@@ -2082,6 +3161,12 @@ int KYTY_SYSV_ABI PthreadCancel(Pthread thread)
 		return KERNEL_ERROR_EINVAL;
 	}
 
+	// The host thread may already run another guest thread
+	if (thread->almost_done)
+	{
+		return OK;
+	}
+
 	int result = pthread_cancel(thread->p);
 
 	printf("\tthread cancel: %s, %d\n", thread->name.C_Str(), result);
@@ -2105,6 +3190,13 @@ int KYTY_SYSV_ABI PthreadSetaffinity(Pthread thread, KernelCpumask mask)
 
 	auto result = PthreadAttrSetaffinity(&thread->attr, mask);
 
+	const auto& map = get_host_cpu_map();
+
+	if (result == OK && map.IsEnabled() && thread->started && !thread->almost_done)
+	{
+		pthread_set_host_affinity(thread->p, map.GetGuestMask(mask));
+	}
+
 	return result;
 }
 
@@ -2181,6 +3273,13 @@ int KYTY_SYSV_ABI PthreadGetprio(Pthread thread, int* prio)
 
 	EXIT_NOT_IMPLEMENTED(prio == nullptr);
 
+	if (pthread_nice_priority())
+	{
+		*prio = thread->priority;
+
+		return OK;
+	}
+
 	sched_param param {};
 	int         pol = 0;
 
@@ -2216,6 +3315,20 @@ int KYTY_SYSV_ABI PthreadSetprio(Pthread thread, int prio)
 		return KERNEL_ERROR_ESRCH;
 	}
 
+	if (pthread_nice_priority())
+	{
+		thread->priority = prio;
+
+		if (thread->started && !thread->almost_done)
+		{
+			pthread_set_nice(thread->host_tid, prio);
+		}
+
+		printf("\t PthreadSetprio: %d, %d\n", thread->unique_id, prio);
+
+		return OK;
+	}
+
 	sched_param param {};
 	int         pol = 0;
 
@@ -2258,6 +3371,10 @@ void KYTY_SYSV_ABI PthreadExit(void* value)
 {
 	PRINT_NAME();
 
+	EXIT_NOT_IMPLEMENTED(g_pthread_self == nullptr);
+
+	g_pthread_self->ret = value;
+
 	pthread_exit(value);
 }
 
@@ -2290,21 +3407,21 @@ int KYTY_SYSV_ABI PthreadGetname(Pthread thread, char* name)
 
 void KYTY_SYSV_ABI PthreadYield()
 {
-	PRINT_NAME();
+	TRACE_NAME_LIMITED(Pthread);
 
 	sched_yield();
 }
 
 int KYTY_SYSV_ABI PthreadGetthreadid()
 {
-	PRINT_NAME();
+	TRACE_NAME_LIMITED(Pthread);
 
 	return Core::Thread::GetThreadIdUnique();
 }
 
 int KYTY_SYSV_ABI KernelClockGetres(KernelClockid clock_id, KernelTimespec* tp)
 {
-	PRINT_NAME();
+	TRACE_NAME_LIMITED(Pthread);
 
 	if (tp == nullptr)
 	{
@@ -2335,7 +3452,7 @@ int KYTY_SYSV_ABI KernelClockGetres(KernelClockid clock_id, KernelTimespec* tp)
 
 int KYTY_SYSV_ABI KernelClockGettime(KernelClockid clock_id, KernelTimespec* tp)
 {
-	PRINT_NAME();
+	TRACE_NAME_LIMITED(Pthread);
 
 	if (tp == nullptr)
 	{
@@ -2351,6 +3468,16 @@ int KYTY_SYSV_ABI KernelClockGettime(KernelClockid clock_id, KernelTimespec* tp)
 		default: EXIT("unknown clock_id: %d", clock_id);
 	}
 
+	if (pclock_id == CLOCK_MONOTONIC)
+	{
+		uint64_t ns = Loader::Timer::GetMonotonicNs();
+
+		tp->tv_sec  = static_cast<int64_t>(ns / 1000000000);
+		tp->tv_nsec = static_cast<int64_t>(ns % 1000000000);
+
+		return OK;
+	}
+
 	timespec t {};
 
 	int result = clock_gettime(pclock_id, &t);
@@ -2367,7 +3494,7 @@ int KYTY_SYSV_ABI KernelClockGettime(KernelClockid clock_id, KernelTimespec* tp)
 
 int KYTY_SYSV_ABI KernelGettimeofday(KernelTimeval* tp)
 {
-	PRINT_NAME();
+	TRACE_NAME_LIMITED(Pthread);
 
 	if (tp == nullptr)
 	{
@@ -2392,17 +3519,17 @@ int KYTY_SYSV_ABI KernelGettimeofday(KernelTimeval* tp)
 
 uint64_t KYTY_SYSV_ABI KernelGetTscFrequency()
 {
-	return Core::Timer::QueryPerformanceFrequency();
+	return Loader::Timer::GetTscFrequency();
 }
 
 uint64_t KYTY_SYSV_ABI KernelReadTsc()
 {
-	return Core::Timer::QueryPerformanceCounter();
+	return Loader::Timer::GetTsc();
 }
 
 uint64_t KYTY_SYSV_ABI KernelGetProcessTime()
 {
-	return static_cast<uint64_t>(Loader::Timer::GetTimeMs() * 1000.0);
+	return Loader::Timer::GetTimeUs();
 }
 
 uint64_t KYTY_SYSV_ABI KernelGetProcessTimeCounter()
@@ -2430,31 +3557,29 @@ void KYTY_SYSV_ABI KernelSetThreadDtors(thread_dtors_func_t dtors)
 
 int KYTY_SYSV_ABI KernelUsleep(KernelUseconds microseconds)
 {
-	PRINT_NAME();
-	printf("\tusleep: %u\n", microseconds);
-	Core::Timer t;
-	t.Start();
-	Core::Thread::SleepMicro(microseconds);
-	double ts = t.GetTimeS();
-	printf("\tactual: %g microseconds\n", ts * 1000000.0);
+	TRACE_NAME_LIMITED(Pthread);
+	TRACE_LIMITED(Pthread, "\tusleep: %u\n", microseconds);
+
+	Core::Timer::SleepPrecise(static_cast<uint64_t>(microseconds) * 1000);
+
 	return OK;
 }
 
 unsigned int KYTY_SYSV_ABI KernelSleep(unsigned int seconds)
 {
-	PRINT_NAME();
-	printf("\tsleep: %u\n", seconds);
+	TRACE_NAME_LIMITED(Pthread);
+	TRACE_LIMITED(Pthread, "\tsleep: %u\n", seconds);
 	Core::Timer t;
 	t.Start();
 	Core::Thread::Sleep(seconds);
 	double ts = t.GetTimeS();
-	printf("\tactual: %g seconds\n", ts);
+	TRACE_LIMITED(Pthread, "\tactual: %g seconds\n", ts);
 	return OK;
 }
 
 int KYTY_SYSV_ABI KernelNanosleep(const KernelTimespec* rqtp, KernelTimespec* rmtp)
 {
-	PRINT_NAME();
+	TRACE_NAME_LIMITED(Pthread);
 
 	if (rqtp == nullptr)
 	{
@@ -2468,17 +3593,15 @@ int KYTY_SYSV_ABI KernelNanosleep(const KernelTimespec* rqtp, KernelTimespec* rm
 
 	uint64_t nanos = rqtp->tv_sec * 1000000000 + rqtp->tv_nsec;
 
-	printf("\tnanosleep: %" PRIu64 "\n", nanos);
+	TRACE_LIMITED(Pthread, "\tnanosleep: %" PRIu64 "\n", nanos);
 
-	Core::Timer t;
-	t.Start();
-	Core::Thread::SleepNano(nanos);
-	double ts = t.GetTimeS();
-	printf("\tactual: %g nanoseconds\n", ts * 1000000000.0);
+	Core::Timer::SleepPrecise(nanos);
 
+	// The sleep is never interrupted, nothing remains
 	if (rmtp != nullptr)
 	{
-		sec_to_timespec(rmtp, ts);
+		rmtp->tv_sec  = 0;
+		rmtp->tv_nsec = 0;
 	}
 
 	return OK;
@@ -2524,13 +3647,13 @@ int KYTY_SYSV_ABI PthreadKeyDelete(PthreadKey key)
 
 int KYTY_SYSV_ABI PthreadSetspecific(PthreadKey key, void* value)
 {
-	PRINT_NAME();
+	TRACE_NAME_LIMITED(Pthread);
 
 	int thread_id = Core::Thread::GetThreadIdUnique();
 
-	printf("\t key       = %d\n", key);
-	printf("\t thread_id = %d\n", thread_id);
-	printf("\t value     = %016" PRIx64 "\n", reinterpret_cast<uint64_t>(value));
+	TRACE_LIMITED(Pthread, "\t key       = %d\n", key);
+	TRACE_LIMITED(Pthread, "\t thread_id = %d\n", thread_id);
+	TRACE_LIMITED(Pthread, "\t value     = %016" PRIx64 "\n", reinterpret_cast<uint64_t>(value));
 
 	EXIT_IF(g_pthread_context == nullptr || g_pthread_context->GetPthreadKeys() == nullptr);
 
@@ -2544,12 +3667,12 @@ int KYTY_SYSV_ABI PthreadSetspecific(PthreadKey key, void* value)
 
 void* KYTY_SYSV_ABI PthreadGetspecific(PthreadKey key)
 {
-	PRINT_NAME();
+	TRACE_NAME_LIMITED(Pthread);
 
 	int thread_id = Core::Thread::GetThreadIdUnique();
 
-	printf("\t key       = %d\n", key);
-	printf("\t thread_id = %d\n", thread_id);
+	TRACE_LIMITED(Pthread, "\t key       = %d\n", key);
+	TRACE_LIMITED(Pthread, "\t thread_id = %d\n", thread_id);
 
 	EXIT_IF(g_pthread_context == nullptr || g_pthread_context->GetPthreadKeys() == nullptr);
 
@@ -2560,7 +3683,7 @@ void* KYTY_SYSV_ABI PthreadGetspecific(PthreadKey key)
 		return nullptr;
 	}
 
-	printf("\t value     = %016" PRIx64 "\n", reinterpret_cast<uint64_t>(value));
+	TRACE_LIMITED(Pthread, "\t value     = %016" PRIx64 "\n", reinterpret_cast<uint64_t>(value));
 
 	return value;
 }
@@ -2588,14 +3711,14 @@ int KYTY_SYSV_ABI pthread_join(LibKernel::Pthread thread, void** value)
 
 int KYTY_SYSV_ABI pthread_cond_broadcast(LibKernel::PthreadCond* cond)
 {
-	PRINT_NAME();
+	TRACE_NAME_LIMITED(Pthread);
 
 	return POSIX_PTHREAD_CALL(LibKernel::PthreadCondBroadcast(cond));
 }
 
 int KYTY_SYSV_ABI pthread_cond_wait(LibKernel::PthreadCond* cond, LibKernel::PthreadMutex* mutex)
 {
-	PRINT_NAME();
+	TRACE_NAME_LIMITED(Pthread);
 
 	return POSIX_PTHREAD_CALL(LibKernel::PthreadCondWait(cond, mutex));
 }
@@ -2623,21 +3746,21 @@ int KYTY_SYSV_ABI pthread_mutex_unlock(LibKernel::PthreadMutex* mutex)
 
 int KYTY_SYSV_ABI pthread_rwlock_rdlock(LibKernel::PthreadRwlock* rwlock)
 {
-	PRINT_NAME();
+	TRACE_NAME_LIMITED(Pthread);
 
 	return POSIX_PTHREAD_CALL(LibKernel::PthreadRwlockRdlock(rwlock));
 }
 
 int KYTY_SYSV_ABI pthread_rwlock_unlock(LibKernel::PthreadRwlock* rwlock)
 {
-	PRINT_NAME();
+	TRACE_NAME_LIMITED(Pthread);
 
 	return POSIX_PTHREAD_CALL(LibKernel::PthreadRwlockUnlock(rwlock));
 }
 
 int KYTY_SYSV_ABI pthread_rwlock_wrlock(LibKernel::PthreadRwlock* rwlock)
 {
-	PRINT_NAME();
+	TRACE_NAME_LIMITED(Pthread);
 
 	return POSIX_PTHREAD_CALL(LibKernel::PthreadRwlockWrlock(rwlock));
 }
@@ -2658,14 +3781,14 @@ int KYTY_SYSV_ABI pthread_key_delete(LibKernel::PthreadKey key)
 
 int KYTY_SYSV_ABI pthread_setspecific(LibKernel::PthreadKey key, void* value)
 {
-	PRINT_NAME();
+	TRACE_NAME_LIMITED(Pthread);
 
 	return POSIX_PTHREAD_CALL(LibKernel::PthreadSetspecific(key, value));
 }
 
 void* KYTY_SYSV_ABI pthread_getspecific(LibKernel::PthreadKey key)
 {
-	PRINT_NAME();
+	TRACE_NAME_LIMITED(Pthread);
 
 	return (LibKernel::PthreadGetspecific(key));
 }
@@ -4,10 +4,12 @@
 #include "Kyty/Core/String.h"
 #include "Kyty/Core/Threads.h"
 #include "Kyty/Core/Timer.h"
-#include "Kyty/Core/Vector.h"
 
 #include "Emulator/Libs/Errno.h"
 #include "Emulator/Libs/Libs.h"
+#include "Emulator/Libs/Trace.h"
+
+#include <atomic>
 
 #ifdef KYTY_EMU_ENABLED
 
@@ -53,15 +55,20 @@ private:
 		Deleted
 	};
 
-	Core::Mutex   m_mutex;
-	Core::CondVar m_cond_var;
-	String        m_name;
-	Status        m_status = Status::Set;
-	Vector<int>   m_waiting_threads;
+	// Takes the count if it is big enough
+	bool TryAcquire(int need_count);
+
+	// The count, the status and the waiter count are also accessed without the mutex by the fast paths. A thread is counted as
+	// waiting before it checks the count under the mutex, so Signal() knows whether somebody has to be woken up.
+	Core::Mutex         m_mutex;
+	Core::CondVar       m_cond_var;
+	String              m_name;
+	std::atomic<Status> m_status {Status::Set};
+	std::atomic_int     m_waiting_threads {0};
 	// bool          m_fifo_order;
-	int m_count;
-	int m_init_count;
-	int m_max_count;
+	std::atomic_int m_count;
+	int             m_init_count;
+	int             m_max_count;
 };
 
 KernelSemaPrivate::~KernelSemaPrivate()
@@ -79,7 +86,7 @@ KernelSemaPrivate::~KernelSemaPrivate()
 
 	m_cond_var.SignalAll();
 
-	while (!m_waiting_threads.IsEmpty())
+	while (m_waiting_threads > 0)
 	{
 		m_mutex.Unlock();
 		Core::Thread::SleepMicro(10);
@@ -107,7 +114,7 @@ KernelSemaPrivate::Result KernelSemaPrivate::Cancel(int set_count, int* num_wait
 
 	if (num_waiting_threads != nullptr)
 	{
-		*num_waiting_threads = static_cast<int>(m_waiting_threads.Size());
+		*num_waiting_threads = m_waiting_threads;
 	}
 
 	m_status = Status::Canceled;
@@ -116,7 +123,7 @@ KernelSemaPrivate::Result KernelSemaPrivate::Cancel(int set_count, int* num_wait
 
 	m_cond_var.SignalAll();
 
-	while (!m_waiting_threads.IsEmpty())
+	while (m_waiting_threads > 0)
 	{
 		m_mutex.Unlock();
 		Core::Thread::SleepMicro(10);
@@ -128,8 +135,45 @@ KernelSemaPrivate::Result KernelSemaPrivate::Cancel(int set_count, int* num_wait
 	return Result::Ok;
 }
 
+bool KernelSemaPrivate::TryAcquire(int need_count)
+{
+	int count = m_count.load();
+
+	while (count - need_count >= 0)
+	{
+		if (m_count.compare_exchange_weak(count, count - need_count))
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
 KernelSemaPrivate::Result KernelSemaPrivate::Signal(int signal_count)
 {
+	// Fast path: no cancel in progress, the mutex is taken only to wake up waiters
+	if (m_status == Status::Set)
+	{
+		int count = m_count.load();
+
+		do
+		{
+			if (count + signal_count > m_max_count)
+			{
+				return Result::InvalCount;
+			}
+		} while (!m_count.compare_exchange_weak(count, count + signal_count));
+
+		if (m_waiting_threads.load() > 0)
+		{
+			Core::LockGuard lock(m_mutex);
+			m_cond_var.SignalAll();
+		}
+
+		return Result::Ok;
+	}
+
 	Core::LockGuard lock(m_mutex);
 
 	EXIT_NOT_IMPLEMENTED(m_status == Status::Deleted);
@@ -141,12 +185,15 @@ KernelSemaPrivate::Result KernelSemaPrivate::Signal(int signal_count)
 		m_mutex.Lock();
 	}
 
-	if (m_count + signal_count > m_max_count)
-	{
-		return Result::InvalCount;
-	}
+	int count = m_count.load();
 
-	m_count += signal_count;
+	do
+	{
+		if (count + signal_count > m_max_count)
+		{
+			return Result::InvalCount;
+		}
+	} while (!m_count.compare_exchange_weak(count, count + signal_count));
 
 	m_cond_var.SignalAll();
 
@@ -155,13 +202,27 @@ KernelSemaPrivate::Result KernelSemaPrivate::Signal(int signal_count)
 
 KernelSemaPrivate::Result KernelSemaPrivate::Wait(int need_count, uint32_t* ptr_micros)
 {
-	Core::LockGuard lock(m_mutex);
-
 	if (need_count < 1 || need_count > m_max_count)
 	{
 		return Result::InvalCount;
 	}
 
+	// Fast path: nobody is queued, so taking the count can't overtake a waiter
+	if (m_waiting_threads.load() == 0)
+	{
+		if (TryAcquire(need_count))
+		{
+			return Result::Ok;
+		}
+
+		if (ptr_micros != nullptr && *ptr_micros == 0)
+		{
+			return Result::TimedOut;
+		}
+	}
+
+	Core::LockGuard lock(m_mutex);
+
 	uint32_t micros     = 0;
 	bool     infinitely = true;
 	if (ptr_micros != nullptr)
@@ -174,18 +235,18 @@ KernelSemaPrivate::Result KernelSemaPrivate::Wait(int need_count, uint32_t* ptr_
 	Core::Timer t;
 	t.Start();
 
-	int id = Core::Thread::GetThreadIdUnique();
+	m_waiting_threads++;
+
+	Result ret = Result::Ok;
 
-	while (!(m_count - need_count >= 0))
+	while (!TryAcquire(need_count))
 	{
 		if ((elapsed >= micros && !infinitely))
 		{
-			*ptr_micros = 0;
-			return Result::TimedOut;
+			ret = Result::TimedOut;
+			break;
 		}
 
-		m_waiting_threads.Add(id);
-
 		if (infinitely)
 		{
 			m_cond_var.Wait(&m_mutex);
@@ -194,42 +255,34 @@ KernelSemaPrivate::Result KernelSemaPrivate::Wait(int need_count, uint32_t* ptr_
 			m_cond_var.WaitFor(&m_mutex, micros - elapsed);
 		}
 
-		m_waiting_threads.Remove(id);
-
 		elapsed = static_cast<uint32_t>(t.GetTimeS() * 1000000.0);
 
 		if (m_status == Status::Canceled)
 		{
-			if (ptr_micros != nullptr)
-			{
-				*ptr_micros = (elapsed >= micros ? 0 : micros - elapsed);
-			}
-			return Result::Canceled;
+			ret = Result::Canceled;
+			break;
 		}
 
 		if (m_status == Status::Deleted)
 		{
-			if (ptr_micros != nullptr)
-			{
-				*ptr_micros = (elapsed >= micros ? 0 : micros - elapsed);
-			}
-			return Result::Deleted;
+			ret = Result::Deleted;
+			break;
 		}
 	}
 
-	m_count -= need_count;
+	m_waiting_threads--;
 
 	if (ptr_micros != nullptr)
 	{
-		*ptr_micros = (elapsed >= micros ? 0 : micros - elapsed);
+		*ptr_micros = (elapsed >= micros || ret == Result::TimedOut ? 0 : micros - elapsed);
 	}
 
-	return Result::Ok;
+	return ret;
 }
 
 int KYTY_SYSV_ABI KernelCreateSema(KernelSema* sem, const char* name, uint32_t attr, int init, int max, void* opt)
 {
-	PRINT_NAME();
+	TRACE_NAME(Semaphore);
 
 	EXIT_NOT_IMPLEMENTED(sem == nullptr);
 
@@ -249,14 +302,14 @@ int KYTY_SYSV_ABI KernelCreateSema(KernelSema* sem, const char* name, uint32_t a
 
 	*sem = new KernelSemaPrivate(String::FromUtf8(name), fifo, init, max);
 
-	printf("\t Semaphore create: %s, %d, %d\n", name, init, max);
+	TRACE(Semaphore, "\t Semaphore create: %s, %d, %d\n", name, init, max);
 
 	return OK;
 }
 
 int KYTY_SYSV_ABI KernelDeleteSema(KernelSema sem)
 {
-	PRINT_NAME();
+	TRACE_NAME(Semaphore);
 
 	if (sem == nullptr)
 	{
@@ -270,14 +323,14 @@ int KYTY_SYSV_ABI KernelDeleteSema(KernelSema sem)
 
 int KYTY_SYSV_ABI KernelWaitSema(KernelSema sem, int need, KernelUseconds* time)
 {
-	PRINT_NAME();
+	TRACE_NAME_LIMITED(Semaphore);
 
 	if (sem == nullptr)
 	{
 		return KERNEL_ERROR_ESRCH;
 	}
 
-	printf("\t Semaphore wait: %s, %d, %d\n", sem->GetName().C_Str(), need, (time != nullptr ? *time : -1));
+	TRACE_LIMITED(Semaphore, "\t Semaphore wait: %s, %d, %d\n", sem->GetName().C_Str(), need, (time != nullptr ? *time : -1));
 
 	auto result = sem->Wait(need, time);
 
@@ -297,14 +350,14 @@ int KYTY_SYSV_ABI KernelWaitSema(KernelSema sem, int need, KernelUseconds* time)
 
 int KYTY_SYSV_ABI KernelPollSema(KernelSema sem, int need)
 {
-	PRINT_NAME();
+	TRACE_NAME_LIMITED(Semaphore);
 
 	if (sem == nullptr)
 	{
 		return KERNEL_ERROR_ESRCH;
 	}
 
-	printf("\t Semaphore poll: %s, %d\n", sem->GetName().C_Str(), need);
+	TRACE_LIMITED(Semaphore, "\t Semaphore poll: %s, %d\n", sem->GetName().C_Str(), need);
 
 	auto result = sem->Poll(need);
 
@@ -324,14 +377,14 @@ int KYTY_SYSV_ABI KernelPollSema(KernelSema sem, int need)
 
 int KYTY_SYSV_ABI KernelSignalSema(KernelSema sem, int count)
 {
-	PRINT_NAME();
+	TRACE_NAME_LIMITED(Semaphore);
 
 	if (sem == nullptr)
 	{
 		return KERNEL_ERROR_ESRCH;
 	}
 
-	printf("\t Semaphore signal: %s, %d\n", sem->GetName().C_Str(), count);
+	TRACE_LIMITED(Semaphore, "\t Semaphore signal: %s, %d\n", sem->GetName().C_Str(), count);
 
 	auto result = sem->Signal(count);
 
@@ -351,7 +404,7 @@ int KYTY_SYSV_ABI KernelSignalSema(KernelSema sem, int count)
 
 int KYTY_SYSV_ABI KernelCancelSema(KernelSema sem, int count, int* threads)
 {
-	PRINT_NAME();
+	TRACE_NAME(Semaphore);
 
 	if (sem == nullptr)
 	{
@@ -1,5 +1,6 @@
 #include "Kyty/Core/Core.h"
 #include "Kyty/Core/DbgAssert.h"
+#include "Kyty/Core/JobSystem.h"
 #include "Kyty/Core/MagicEnum.h"
 #include "Kyty/Core/Singleton.h"
 #include "Kyty/Core/String.h"
@@ -11,17 +12,22 @@
 #include "Kyty/UnitTest.h"
 
 #include "Emulator/Audio.h"
+#include "Emulator/Benchmark.h"
 #include "Emulator/Common.h"
 #include "Emulator/Config.h"
 #include "Emulator/Controller.h"
+#include "Emulator/Graphics/Capture.h"
 #include "Emulator/Graphics/Graphics.h"
+#include "Emulator/Graphics/GraphicsRender.h"
 #include "Emulator/Graphics/Shader.h"
 #include "Emulator/Graphics/Window.h"
 #include "Emulator/Kernel/FileSystem.h"
 #include "Emulator/Kernel/Memory.h"
 #include "Emulator/Kernel/Pthread.h"
 #include "Emulator/Libs/Libs.h"
+#include "Emulator/Libs/Trace.h"
 #include "Emulator/Loader/RuntimeLinker.h"
+#include "Emulator/Loader/Startup.h"
 #include "Emulator/Loader/SystemContent.h"
 #include "Emulator/Loader/Timer.h"
 #include "Emulator/Network.h"
@@ -98,18 +104,24 @@ static void Init(const Scripts::ScriptVar& cfg)
 
 	Config::Load(cfg);
 
-	slist->Add(audio, {core, log, pthread, memory});
-	slist->Add(controller, {core, log, config});
-	slist->Add(file_system, {core, log, pthread});
+	if (Config::GetJobWorkers() != 0)
+	{
+		Core::JobSystem::Init(static_cast<int>(Config::GetJobWorkers()));
+	}
+
+	// The window and the Vulkan device are created by Graphics on the main thread, the rest don't care
+	slist->AddConcurrent(audio, {core, log, pthread, memory});
+	slist->AddConcurrent(controller, {core, log, config});
+	slist->AddConcurrent(file_system, {core, log, pthread});
 	slist->Add(graphics, {core, log, pthread, memory, config, profiler, controller});
 	slist->Add(log, {core, config});
-	slist->Add(memory, {core, log});
-	slist->Add(network, {core, log, pthread});
-	slist->Add(profiler, {core, config});
+	slist->AddConcurrent(memory, {core, log});
+	slist->AddConcurrent(network, {core, log, pthread});
+	slist->AddConcurrent(profiler, {core, config});
 	slist->Add(pthread, {core, log, timer});
-	slist->Add(timer, {core, log});
+	slist->AddConcurrent(timer, {core, log});
 
-	slist->InitAll(true);
+	slist->InitAll(true, 4);
 }
 
 KYTY_SCRIPT_FUNC(kyty_load_cfg_func)
@@ -135,7 +147,10 @@ KYTY_SCRIPT_FUNC(kyty_init_func)
 
 	Scripts::ScriptVar cfg = Scripts::ArgGetVar(0);
 
-	Init(cfg);
+	{
+		Loader::StartupPhase phase("kyty_init");
+		Init(cfg);
+	}
 
 	print_system_info();
 
@@ -156,6 +171,8 @@ KYTY_SCRIPT_FUNC(kyty_load_elf_func)
 
 	auto* rt = Core::Singleton<Loader::RuntimeLinker>::Instance();
 
+	Loader::StartupPhase phase("load_elf");
+
 	auto* program = rt->LoadProgram(Libs::LibKernel::FileSystem::GetRealFilename(elf.ToString()));
 
 	if (Scripts::ArgGetVarCount() >= 2)
@@ -203,6 +220,8 @@ KYTY_SCRIPT_FUNC(kyty_load_symbols_func)
 
 	auto* rt = Core::Singleton<Loader::RuntimeLinker>::Instance();
 
+	Loader::StartupPhase phase("load_symbols");
+
 	for (int i = 0; i < count; i++)
 	{
 		Scripts::ScriptVar id = Scripts::ArgGetVar(i);
@@ -223,6 +242,8 @@ KYTY_SCRIPT_FUNC(kyty_load_symbols_all_func)
 
 	auto* rt = Core::Singleton<Loader::RuntimeLinker>::Instance();
 
+	Loader::StartupPhase phase("load_symbols");
+
 	load_symbols_all(rt);
 
 	return 0;
@@ -263,13 +284,8 @@ KYTY_SCRIPT_FUNC(kyty_dbg_dump_func)
 	return 0;
 }
 
-KYTY_SCRIPT_FUNC(kyty_execute_func)
+static void execute()
 {
-	if (Scripts::ArgGetVarCount() != 0)
-	{
-		EXIT("invalid args\n");
-	}
-
 	int thread_model = 1;
 
 	if (thread_model == 0)
@@ -291,6 +307,120 @@ KYTY_SCRIPT_FUNC(kyty_execute_func)
 		Libs::Graphics::WindowRun();
 		t.Join();
 	}
+}
+
+KYTY_SCRIPT_FUNC(kyty_execute_func)
+{
+	if (Scripts::ArgGetVarCount() != 0)
+	{
+		EXIT("invalid args\n");
+	}
+
+	execute();
+
+	return 0;
+}
+
+// kyty_benchmark(frames, results [, baseline [, tolerance [, input]]])
+// Runs the title for the number of frames in the benchmark mode, saves the results and compares them with the baseline, see
+// Profiler::BenchmarkSetRun(). The tolerance is in percent, 10 by default. The input is a file saved by kyty_record_input().
+KYTY_SCRIPT_FUNC(kyty_benchmark_func)
+{
+	auto count = Scripts::ArgGetVarCount();
+
+	if (count < 2 || count > 5)
+	{
+		EXIT("invalid args\n");
+	}
+
+	if (!Config::BenchmarkEnabled())
+	{
+		EXIT("BenchmarkEnabled is off\n");
+	}
+
+	auto   frames    = static_cast<uint32_t>(Scripts::ArgGetVar(0).ToInteger());
+	String results   = Scripts::ArgGetVar(1).ToString();
+	String baseline  = (count >= 3 ? Scripts::ArgGetVar(2).ToString() : String());
+	double tolerance = (count >= 4 ? Scripts::ArgGetVar(3).ToDouble() : 10.0);
+
+	if (count == 5)
+	{
+		Libs::Controller::ControllerReplayStart(Scripts::ArgGetVar(4).ToString());
+	}
+
+	Profiler::BenchmarkSetRun(frames, results, baseline, tolerance);
+
+	execute();
+
+	return 0;
+}
+
+// The input of the active controller is saved to the file until the emulator is closed
+KYTY_SCRIPT_FUNC(kyty_record_input_func)
+{
+	if (Scripts::ArgGetVarCount() != 1)
+	{
+		EXIT("invalid args\n");
+	}
+
+	Libs::Controller::ControllerRecordStart(Scripts::ArgGetVar(0).ToString());
+
+	return 0;
+}
+
+KYTY_SCRIPT_FUNC(kyty_replay_func)
+{
+	auto count = Scripts::ArgGetVarCount();
+
+	if (count != 1 && count != 2)
+	{
+		EXIT("invalid args\n");
+	}
+
+	static String   file_name;
+	static uint32_t loops = 1;
+
+	file_name = Scripts::ArgGetVar(0).ToString();
+	if (count == 2)
+	{
+		loops = static_cast<uint32_t>(Scripts::ArgGetVar(1).ToInteger());
+	}
+
+	Core::Thread t(
+	    [](void* /*unused*/)
+	    {
+		    Libs::Graphics::CaptureReplay(file_name, loops);
+
+		    Core::SubsystemsListSingleton::Instance()->ShutdownAll();
+		    std::_Exit(0);
+	    },
+	    nullptr);
+	t.Detach();
+	Libs::Graphics::WindowRun();
+	t.Join();
+
+	return 0;
+}
+
+KYTY_SCRIPT_FUNC(kyty_prebuild_caches_func)
+{
+	if (Scripts::ArgGetVarCount() != 0)
+	{
+		EXIT("invalid args\n");
+	}
+
+	Core::Thread t(
+	    [](void* /*unused*/)
+	    {
+		    Libs::Graphics::GraphicsRenderPrebuildCaches();
+
+		    Core::SubsystemsListSingleton::Instance()->ShutdownAll();
+		    std::_Exit(0);
+	    },
+	    nullptr);
+	t.Detach();
+	Libs::Graphics::WindowRun();
+	t.Join();
 
 	return 0;
 }
@@ -400,6 +530,24 @@ KYTY_SCRIPT_FUNC(kyty_shader_printf)
 	return 0;
 }
 
+KYTY_SCRIPT_FUNC(kyty_trace_decode)
+{
+	if (Scripts::ArgGetVarCount() != 2)
+	{
+		EXIT("invalid args\n");
+	}
+
+	auto file_name     = Scripts::ArgGetVar(0).ToString();
+	auto out_file_name = Scripts::ArgGetVar(1).ToString();
+
+	if (!Libs::TraceBinaryDecode(file_name, out_file_name))
+	{
+		EXIT("can't decode %s\n", file_name.C_Str());
+	}
+
+	return 0;
+}
+
 KYTY_SCRIPT_FUNC(kyty_run_tests)
 {
 	if (!UnitTest::unit_test_all())
@@ -425,9 +573,14 @@ void kyty_reg()
 	Scripts::RegisterFunc("kyty_load_param_sfo", LuaFunc::kyty_load_param_sfo_func, LuaFunc::kyty_help);
 	Scripts::RegisterFunc("kyty_dbg_dump", LuaFunc::kyty_dbg_dump_func, LuaFunc::kyty_help);
 	Scripts::RegisterFunc("kyty_execute", LuaFunc::kyty_execute_func, LuaFunc::kyty_help);
+	Scripts::RegisterFunc("kyty_replay", LuaFunc::kyty_replay_func, LuaFunc::kyty_help);
+	Scripts::RegisterFunc("kyty_benchmark", LuaFunc::kyty_benchmark_func, LuaFunc::kyty_help);
+	Scripts::RegisterFunc("kyty_record_input", LuaFunc::kyty_record_input_func, LuaFunc::kyty_help);
+	Scripts::RegisterFunc("kyty_prebuild_caches", LuaFunc::kyty_prebuild_caches_func, LuaFunc::kyty_help);
 	Scripts::RegisterFunc("kyty_mount", LuaFunc::kyty_mount_func, LuaFunc::kyty_help);
 	Scripts::RegisterFunc("kyty_shader_disable", LuaFunc::kyty_shader_disable, LuaFunc::kyty_help);
 	Scripts::RegisterFunc("kyty_shader_printf", LuaFunc::kyty_shader_printf, LuaFunc::kyty_help);
+	Scripts::RegisterFunc("kyty_trace_decode", LuaFunc::kyty_trace_decode, LuaFunc::kyty_help);
 	Scripts::RegisterFunc("kyty_run_tests", LuaFunc::kyty_run_tests, LuaFunc::kyty_help);
 }
 
@@ -63,6 +63,13 @@ LIB_DEFINE(InitAudio_1_Ajm)
 {
 	LIB_FUNC("dl+4eHSzUu4", Ajm::AjmInitialize);
 	LIB_FUNC("Q3dyFuwGn64", Ajm::AjmModuleRegister);
+	LIB_FUNC("AxoDrINp4J8", Ajm::AjmInstanceCreate);
+	LIB_FUNC("RbLbuKv8zho", Ajm::AjmInstanceDestroy);
+	LIB_FUNC("dmDybN--Fn8", Ajm::AjmBatchJobControlBufferRa);
+	LIB_FUNC("ElslOCpOIns", Ajm::AjmBatchJobRunBufferRa);
+	LIB_FUNC("7jdAXK+2fMo", Ajm::AjmBatchJobRunSplitBufferRa);
+	LIB_FUNC("fFFkk0xfGWs", Ajm::AjmBatchStartBuffer);
+	LIB_FUNC("-qLsfDAywIY", Ajm::AjmBatchWait);
 }
 
 } // namespace LibAjm
@@ -6,12 +6,14 @@
 #include "Kyty/Core/String.h"
 
 #include "Emulator/Common.h"
+#include "Emulator/Config.h"
 #include "Emulator/Libs/Libs.h"
 #include "Emulator/Libs/Printf.h"
 #include "Emulator/Libs/VaContext.h"
 #include "Emulator/Loader/SymbolDatabase.h"
 
 #include <cstdlib>
+#include <cstring>
 
 #ifdef KYTY_EMU_ENABLED
 
@@ -153,6 +155,124 @@ LIB_DEFINE(InitLibcInternalExt_1)
 
 } // namespace LibcInternalExt
 
+namespace LibcHost {
+
+LIB_VERSION("libc", 1, "libc", 1, 1);
+
+// Replace the generic implementations of the guest libc. The host ones are vectorized for the CPU they run on. These functions
+// are called too often to print their names.
+
+static KYTY_SYSV_ABI void* memset(void* s, int c, size_t n)
+{
+	return ::memset(s, c, n);
+}
+
+static KYTY_SYSV_ABI void* memcpy(void* dst, const void* src, size_t n)
+{
+	return ::memcpy(dst, src, n);
+}
+
+static KYTY_SYSV_ABI void* memmove(void* dst, const void* src, size_t n)
+{
+	return ::memmove(dst, src, n);
+}
+
+static KYTY_SYSV_ABI int memcmp(const void* s1, const void* s2, size_t n)
+{
+	return ::memcmp(s1, s2, n);
+}
+
+static KYTY_SYSV_ABI const void* memchr(const void* s, int c, size_t n)
+{
+	return ::memchr(s, c, n);
+}
+
+static KYTY_SYSV_ABI size_t strlen(const char* str)
+{
+	return ::strlen(str);
+}
+
+static KYTY_SYSV_ABI size_t strnlen(const char* str, size_t max_len)
+{
+	return ::strnlen(str, max_len);
+}
+
+static KYTY_SYSV_ABI int strcmp(const char* s1, const char* s2)
+{
+	return ::strcmp(s1, s2);
+}
+
+static KYTY_SYSV_ABI int strncmp(const char* s1, const char* s2, size_t n)
+{
+	return ::strncmp(s1, s2, n);
+}
+
+static KYTY_SYSV_ABI char* strcpy(char* dst, const char* src)
+{
+	return ::strcpy(dst, src); // NOLINT(clang-analyzer-security.insecureAPI.strcpy)
+}
+
+static KYTY_SYSV_ABI char* strncpy(char* dst, const char* src, size_t n)
+{
+	return ::strncpy(dst, src, n);
+}
+
+static KYTY_SYSV_ABI char* strcat(char* dst, const char* src)
+{
+	return ::strcat(dst, src);
+}
+
+static KYTY_SYSV_ABI char* strncat(char* dst, const char* src, size_t n)
+{
+	return ::strncat(dst, src, n);
+}
+
+static KYTY_SYSV_ABI const char* strchr(const char* s, int c)
+{
+	return ::strchr(s, c);
+}
+
+static KYTY_SYSV_ABI const char* strrchr(const char* s, int c)
+{
+	return ::strrchr(s, c);
+}
+
+static KYTY_SYSV_ABI const char* strstr(const char* s1, const char* s2)
+{
+	return ::strstr(s1, s2);
+}
+
+// The host functions exported by both libc and LibcInternal. memset is not here, LibcInternal has its own.
+// NOLINTNEXTLINE(cppcoreguidelines-macro-usage)
+#define LIBC_HOST_FUNCS(F)                                                                                                                 \
+	F("Q3VBxCXhUHs", memcpy)                                                                                                               \
+	F("+P6FRGH4LfA", memmove)                                                                                                              \
+	F("DfivPArhucg", memcmp)                                                                                                               \
+	F("8u8lPzUEq+U", memchr)                                                                                                               \
+	F("j4ViWNHEgww", strlen)                                                                                                               \
+	F("5jNubw4vlAA", strnlen)                                                                                                              \
+	F("Ovb2dSJOAuE", strcmp)                                                                                                               \
+	F("aesyjrHVWy4", strncmp)                                                                                                              \
+	F("kiZSXIWd9vg", strcpy)                                                                                                               \
+	F("6sJWiWSRuqk", strncpy)                                                                                                              \
+	F("Ls4tzzhimqQ", strcat)                                                                                                               \
+	F("kHg45qPC6f0", strncat)                                                                                                              \
+	F("ob5xAW4ln-0", strchr)                                                                                                               \
+	F("9yDWMxEFdJU", strrchr)                                                                                                              \
+	F("viiwFMaNamA", strstr)
+
+// NOLINTNEXTLINE(cppcoreguidelines-macro-usage)
+#define LIBC_HOST_FUNC(n, f) LIB_FUNC(n, LibcHost::f);
+
+LIB_DEFINE(InitLibcHost_1)
+{
+	LIB_FUNC("8zTFvBIAIN8", LibcHost::memset);
+
+	LIBC_HOST_FUNCS(LIBC_HOST_FUNC)
+}
+
+} // namespace LibcHost
+
 namespace LibcInternal {
 
 LIB_VERSION("LibcInternal", 1, "LibcInternal", 1, 1);
@@ -251,6 +371,13 @@ LIB_DEFINE(InitLibcInternal_1)
 
 	LIB_FUNC("-hn1tcVHq5Q", LibcInternal::LibcMspaceCreate);
 	LIB_FUNC("OJjm-QOIHlI", LibcInternal::LibcMspaceMalloc);
+
+	if (Config::HostLibcEnabled())
+	{
+		LibcHost::InitLibcHost_1(s);
+
+		LIBC_HOST_FUNCS(LIBC_HOST_FUNC)
+	}
 }
 
 } // namespace LibcInternal
@@ -3,6 +3,7 @@
 #include "Kyty/Core/String.h"
 
 #include "Emulator/Common.h"
+#include "Emulator/Kernel/FileSystem.h"
 #include "Emulator/Libs/Errno.h"
 #include "Emulator/Libs/Libs.h"
 #include "Emulator/Loader/SymbolDatabase.h"
@@ -91,6 +92,8 @@ int KYTY_SYSV_ABI PlayGoGetLocus(int handle, const uint16_t* chunk_ids, uint32_t
 		if (chunk_ids[i] <= g_chunks_num)
 		{
 			out_loci[i] = 3;
+
+			LibKernel::FileSystem::PrefetchChunk(chunk_ids[i]);
 		} else
 		{
 			return PLAYGO_ERROR_BAD_CHUNK_ID;
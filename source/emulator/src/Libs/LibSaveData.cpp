@@ -4,6 +4,7 @@
 #include "Kyty/Core/String.h"
 
 #include "Emulator/Common.h"
+#include "Emulator/Config.h"
 #include "Emulator/Kernel/FileSystem.h"
 #include "Emulator/Libs/Errno.h"
 #include "Emulator/Libs/Libs.h"
@@ -117,6 +118,17 @@ int KYTY_SYSV_ABI SaveDataInitialize3(const void* /*init*/)
 	return OK;
 }
 
+static void mount_save_data(const String& dir, const String& point)
+{
+	if (Config::SaveDataWriteBehind())
+	{
+		LibKernel::FileSystem::MountWriteBehind(dir, point);
+	} else
+	{
+		LibKernel::FileSystem::Mount(dir, point);
+	}
+}
+
 int KYTY_SYSV_ABI SaveDataMount(const SaveDataMount* mount, SaveDataMountResult* mount_result)
 {
 	PRINT_NAME();
@@ -150,7 +162,7 @@ int KYTY_SYSV_ABI SaveDataMount(const SaveDataMount* mount, SaveDataMountResult*
 			return SAVE_DATA_ERROR_NOT_FOUND;
 		}
 
-		LibKernel::FileSystem::Mount(mount_dir, mount_point);
+		mount_save_data(mount_dir, mount_point);
 
 		mount_result->mount_status = 0;
 	}
@@ -168,7 +180,7 @@ int KYTY_SYSV_ABI SaveDataMount(const SaveDataMount* mount, SaveDataMountResult*
 
 		EXIT_NOT_IMPLEMENTED((!Core::File::IsDirectoryExisting(mount_dir)));
 
-		LibKernel::FileSystem::Mount(mount_dir, mount_point);
+		mount_save_data(mount_dir, mount_point);
 
 		mount_result->mount_status = 1;
 	}
@@ -213,7 +225,7 @@ int KYTY_SYSV_ABI SaveDataMount2(const SaveDataMount2* mount, SaveDataMountResul
 			return SAVE_DATA_ERROR_NOT_FOUND;
 		}
 
-		LibKernel::FileSystem::Mount(mount_dir, mount_point);
+		mount_save_data(mount_dir, mount_point);
 
 		mount_result->mount_status = 0;
 	}
@@ -231,7 +243,7 @@ int KYTY_SYSV_ABI SaveDataMount2(const SaveDataMount2* mount, SaveDataMountResul
 
 		EXIT_NOT_IMPLEMENTED((!Core::File::IsDirectoryExisting(mount_dir)));
 
-		LibKernel::FileSystem::Mount(mount_dir, mount_point);
+		mount_save_data(mount_dir, mount_point);
 
 		mount_result->mount_status = 1;
 	}
@@ -253,7 +265,10 @@ int KYTY_SYSV_ABI SaveDataUmount(const SaveDataMountPoint* mount_point)
 
 	printf("\t mount_point = %s\n", mount_point->data);
 
-	LibKernel::FileSystem::Umount(String::FromUtf8(mount_point->data));
+	if (LibKernel::FileSystem::Umount(String::FromUtf8(mount_point->data)) != OK)
+	{
+		return SAVE_DATA_ERROR_BUSY;
+	}
 
 	return OK;
 }
@@ -9,13 +9,13 @@
 
 #include "Kyty/Core/Common.h"
 #include "Kyty/Core/DbgAssert.h"
-#include "Kyty/Core/Vector.h"
 
 #include "Emulator/Common.h"
 #include "Emulator/Libs/VaContext.h"
 
 #include <cfloat>
 #include <cmath>
+#include <cstring>
 
 #ifdef KYTY_EMU_ENABLED
 
@@ -38,13 +38,23 @@ constexpr size_t   PRINTF_NTOA_BUFFER_SIZE        = 32U;
 constexpr size_t   PRINTF_FTOA_BUFFER_SIZE        = 32U;
 constexpr double   PRINTF_MAX_FLOAT               = 1e9;
 constexpr uint32_t PRINTF_DEFAULT_FLOAT_PRECISION = 6U;
+constexpr size_t   PRINTF_OUT_BUFFER_SIZE         = 4096U;
 
-using out_fct_type = void (*)(char character, Vector<char>* buffer, size_t idx, size_t /*maxlen*/);
+constexpr char PRINTF_COLOR_BEGIN[] = FG_BRIGHT_MAGENTA;
+constexpr char PRINTF_COLOR_END[]   = DEFAULT;
 
-// internal null output
-static inline void _out_null(char character, Vector<char>* buffer, size_t /*idx*/, size_t /*maxlen*/)
+// Most of the output fits, so printf formats here and doesn't allocate
+static thread_local char g_printf_out[PRINTF_OUT_BUFFER_SIZE];
+
+using out_fct_type = void (*)(char character, char* buffer, size_t idx, size_t maxlen);
+
+// internal buffer output
+static inline void _out_buffer(char character, char* buffer, size_t idx, size_t maxlen)
 {
-	buffer->Add(character);
+	if (idx < maxlen)
+	{
+		buffer[idx] = character;
+	}
 }
 
 static inline bool _is_digit(char ch)
@@ -62,7 +72,7 @@ static unsigned int _atoi(const char** str)
 	return i;
 }
 
-static size_t _out_rev(out_fct_type out, Vector<char>* buffer, size_t idx, size_t maxlen, const char* buf, size_t len, unsigned int width,
+static size_t _out_rev(out_fct_type out, char* buffer, size_t idx, size_t maxlen, const char* buf, size_t len, unsigned int width,
                        unsigned int flags)
 {
 	const size_t start_idx = idx;
@@ -95,7 +105,7 @@ static size_t _out_rev(out_fct_type out, Vector<char>* buffer, size_t idx, size_
 }
 
 // internal itoa format
-static size_t _ntoa_format(out_fct_type out, Vector<char>* buffer, size_t idx, size_t maxlen, char* buf, size_t len, bool negative,
+static size_t _ntoa_format(out_fct_type out, char* buffer, size_t idx, size_t maxlen, char* buf, size_t len, bool negative,
                            unsigned int base, unsigned int prec, unsigned int width, unsigned int flags)
 {
 	// pad leading zeros
@@ -159,7 +169,7 @@ static size_t _ntoa_format(out_fct_type out, Vector<char>* buffer, size_t idx, s
 	return _out_rev(out, buffer, idx, maxlen, buf, len, width, flags);
 }
 
-static size_t _ntoa_long_long(out_fct_type out, Vector<char>* buffer, size_t idx, size_t maxlen, uint64_t value, bool negative,
+static size_t _ntoa_long_long(out_fct_type out, char* buffer, size_t idx, size_t maxlen, uint64_t value, bool negative,
                               uint64_t base, unsigned int prec, unsigned int width, unsigned int flags)
 {
 	char   buf[PRINTF_NTOA_BUFFER_SIZE];
@@ -187,7 +197,7 @@ static size_t _ntoa_long_long(out_fct_type out, Vector<char>* buffer, size_t idx
 }
 
 // internal itoa for 'long' type
-static size_t _ntoa_long(out_fct_type out, Vector<char>* buffer, size_t idx, size_t maxlen, uint32_t value, bool negative, uint32_t base,
+static size_t _ntoa_long(out_fct_type out, char* buffer, size_t idx, size_t maxlen, uint32_t value, bool negative, uint32_t base,
                          unsigned int prec, unsigned int width, unsigned int flags)
 {
 	char   buf[PRINTF_NTOA_BUFFER_SIZE];
@@ -214,12 +224,12 @@ static size_t _ntoa_long(out_fct_type out, Vector<char>* buffer, size_t idx, siz
 	return _ntoa_format(out, buffer, idx, maxlen, buf, len, negative, static_cast<unsigned int>(base), prec, width, flags);
 }
 
-static size_t _etoa(out_fct_type out, Vector<char>* buffer, size_t idx, size_t maxlen, double value, unsigned int prec, unsigned int width,
+static size_t _etoa(out_fct_type out, char* buffer, size_t idx, size_t maxlen, double value, unsigned int prec, unsigned int width,
                     unsigned int flags);
 
 // internal ftoa for fixed decimal floating point
 // NOLINTNEXTLINE(readability-function-cognitive-complexity)
-static size_t _ftoa(out_fct_type out, Vector<char>* buffer, size_t idx, size_t maxlen, double value, unsigned int prec, unsigned int width,
+static size_t _ftoa(out_fct_type out, char* buffer, size_t idx, size_t maxlen, double value, unsigned int prec, unsigned int width,
                     unsigned int flags)
 {
 	char   buf[PRINTF_FTOA_BUFFER_SIZE];
@@ -368,7 +378,7 @@ static size_t _ftoa(out_fct_type out, Vector<char>* buffer, size_t idx, size_t m
 }
 
 // internal ftoa variant for exponential floating-point type, contributed by Martijn Jasperse <m.jasperse@gmail.com>
-static size_t _etoa(out_fct_type out, Vector<char>* buffer, size_t idx, size_t maxlen, double value, unsigned int prec, unsigned int width,
+static size_t _etoa(out_fct_type out, char* buffer, size_t idx, size_t maxlen, double value, unsigned int prec, unsigned int width,
                     unsigned int flags)
 {
 	// check for NaN and special values
@@ -505,20 +515,17 @@ static inline unsigned int _strnlen_s(const char* str, size_t maxsize)
 	return static_cast<unsigned int>(s - str);
 }
 
+// Like vsnprintf: writes at most maxlen chars including the terminating \0, returns the length of the whole output
 // NOLINTNEXTLINE(readability-function-cognitive-complexity)
-static int kyty_printf_internal(bool sn, char* sn_s, size_t sn_n, const char* format, VaList* va_list)
+static size_t kyty_format(char* buffer, size_t maxlen, const char* format, VaList* va_list)
 {
-	Vector<char> buffer;
-
 	uint32_t flags     = 0;
 	uint32_t width     = 0;
 	uint32_t precision = 0;
 	uint32_t n         = 0;
 	size_t   idx       = 0U;
-	auto     maxlen    = static_cast<size_t>(-1);
 
-	// use null output function
-	auto out = _out_null;
+	auto out = _out_buffer;
 
 	while (*format != 0)
 	{
@@ -526,7 +533,7 @@ static int kyty_printf_internal(bool sn, char* sn_s, size_t sn_n, const char* fo
 		if (*format != '%')
 		{
 			// no
-			out(*format, &buffer, idx++, maxlen);
+			out(*format, buffer, idx++, maxlen);
 			format++;
 			continue;
 		}
@@ -696,13 +703,13 @@ static int kyty_printf_internal(bool sn, char* sn_s, size_t sn_n, const char* fo
 					{
 						// const long long value = va_arg(va, long long);
 						auto value = VaArg_long_long(va_list);
-						idx = _ntoa_long_long(out, &buffer, idx, maxlen, static_cast<uint64_t>(value > 0 ? value : 0 - value), value < 0,
+						idx = _ntoa_long_long(out, buffer, idx, maxlen, static_cast<uint64_t>(value > 0 ? value : 0 - value), value < 0,
 						                      base, precision, width, flags);
 					} else if ((flags & FLAGS_LONG) != 0u)
 					{
 						// const long value = va_arg(va, long);
 						auto value = VaArg_long(va_list);
-						idx = _ntoa_long(out, &buffer, idx, maxlen, static_cast<uint32_t>(value > 0 ? value : 0 - value), value < 0, base,
+						idx = _ntoa_long(out, buffer, idx, maxlen, static_cast<uint32_t>(value > 0 ? value : 0 - value), value < 0, base,
 						                 precision, width, flags);
 					} else
 					{
@@ -712,7 +719,7 @@ static int kyty_printf_internal(bool sn, char* sn_s, size_t sn_n, const char* fo
 						int value = (flags & FLAGS_CHAR) != 0u    ? static_cast<char>(VaArg_int(va_list))
 						            : (flags & FLAGS_SHORT) != 0u ? static_cast<int16_t>(VaArg_int(va_list))
 						                                          : VaArg_int(va_list);
-						idx = _ntoa_long(out, &buffer, idx, maxlen, static_cast<unsigned int>(value > 0 ? value : 0 - value), value < 0,
+						idx = _ntoa_long(out, buffer, idx, maxlen, static_cast<unsigned int>(value > 0 ? value : 0 - value), value < 0,
 						                 base, precision, width, flags);
 					}
 				} else
@@ -720,18 +727,18 @@ static int kyty_printf_internal(bool sn, char* sn_s, size_t sn_n, const char* fo
 					// unsigned
 					if ((flags & FLAGS_LONG_LONG) != 0u || (flags & FLAGS_LONG) != 0u)
 					{
-						idx = _ntoa_long_long(out, &buffer, idx, maxlen, static_cast<uint64_t>(VaArg_long_long(va_list)), false, base,
+						idx = _ntoa_long_long(out, buffer, idx, maxlen, static_cast<uint64_t>(VaArg_long_long(va_list)), false, base,
 						                      precision, width, flags);
 					} else if ((flags & FLAGS_LONG) != 0u)
 					{
-						idx = _ntoa_long(out, &buffer, idx, maxlen, static_cast<uint32_t>(VaArg_long(va_list)), false, base, precision,
+						idx = _ntoa_long(out, buffer, idx, maxlen, static_cast<uint32_t>(VaArg_long(va_list)), false, base, precision,
 						                 width, flags);
 					} else
 					{
 						const unsigned int value = (flags & FLAGS_CHAR) != 0u    ? static_cast<unsigned char>(VaArg_int(va_list))
 						                           : (flags & FLAGS_SHORT) != 0u ? static_cast<uint16_t>(VaArg_int(va_list))
 						                                                         : static_cast<unsigned int>(VaArg_int(va_list));
-						idx                      = _ntoa_long(out, &buffer, idx, maxlen, value, false, base, precision, width, flags);
+						idx                      = _ntoa_long(out, buffer, idx, maxlen, value, false, base, precision, width, flags);
 					}
 				}
 				format++;
@@ -743,7 +750,7 @@ static int kyty_printf_internal(bool sn, char* sn_s, size_t sn_n, const char* fo
 				{
 					flags |= FLAGS_UPPERCASE;
 				}
-				idx = _ftoa(out, &buffer, idx, maxlen, VaArg_double(va_list), precision, width, flags);
+				idx = _ftoa(out, buffer, idx, maxlen, VaArg_double(va_list), precision, width, flags);
 				format++;
 				break;
 			case 'e':
@@ -758,7 +765,7 @@ static int kyty_printf_internal(bool sn, char* sn_s, size_t sn_n, const char* fo
 				{
 					flags |= FLAGS_UPPERCASE;
 				}
-				idx = _etoa(out, &buffer, idx, maxlen, VaArg_double(va_list), precision, width, flags);
+				idx = _etoa(out, buffer, idx, maxlen, VaArg_double(va_list), precision, width, flags);
 				format++;
 				break;
 			case 'c':
@@ -769,17 +776,17 @@ static int kyty_printf_internal(bool sn, char* sn_s, size_t sn_n, const char* fo
 				{
 					while (l++ < width)
 					{
-						out(' ', &buffer, idx++, maxlen);
+						out(' ', buffer, idx++, maxlen);
 					}
 				}
 				// char output
-				out(static_cast<char>(VaArg_int(va_list)), &buffer, idx++, maxlen);
+				out(static_cast<char>(VaArg_int(va_list)), buffer, idx++, maxlen);
 				// post padding
 				if ((flags & FLAGS_LEFT) != 0u)
 				{
 					while (l++ < width)
 					{
-						out(' ', &buffer, idx++, maxlen);
+						out(' ', buffer, idx++, maxlen);
 					}
 				}
 				format++;
@@ -800,20 +807,20 @@ static int kyty_printf_internal(bool sn, char* sn_s, size_t sn_n, const char* fo
 				{
 					while (l++ < width)
 					{
-						out(' ', &buffer, idx++, maxlen);
+						out(' ', buffer, idx++, maxlen);
 					}
 				}
 				// string output
 				while ((*p != 0) && (((flags & FLAGS_PRECISION) == 0u) || ((precision--) != 0u)))
 				{
-					out(*(p++), &buffer, idx++, maxlen);
+					out(*(p++), buffer, idx++, maxlen);
 				}
 				// post padding
 				if ((flags & FLAGS_LEFT) != 0u)
 				{
 					while (l++ < width)
 					{
-						out(' ', &buffer, idx++, maxlen);
+						out(' ', buffer, idx++, maxlen);
 					}
 				}
 				format++;
@@ -827,12 +834,12 @@ static int kyty_printf_internal(bool sn, char* sn_s, size_t sn_n, const char* fo
 				const bool is_ll = sizeof(uintptr_t) == sizeof(int64_t);
 				if (is_ll)
 				{
-					idx = _ntoa_long_long(out, &buffer, idx, maxlen, reinterpret_cast<uintptr_t>(VaArg_ptr<void>(va_list)), false, 16U,
+					idx = _ntoa_long_long(out, buffer, idx, maxlen, reinterpret_cast<uintptr_t>(VaArg_ptr<void>(va_list)), false, 16U,
 					                      precision, width, flags);
 				} else
 				{
 					idx =
-					    _ntoa_long(out, &buffer, idx, maxlen, static_cast<uint32_t>(reinterpret_cast<uintptr_t>(VaArg_ptr<void>(va_list))),
+					    _ntoa_long(out, buffer, idx, maxlen, static_cast<uint32_t>(reinterpret_cast<uintptr_t>(VaArg_ptr<void>(va_list))),
 					               false, 16U, precision, width, flags);
 				}
 				format++;
@@ -840,43 +847,71 @@ static int kyty_printf_internal(bool sn, char* sn_s, size_t sn_n, const char* fo
 			}
 
 			case '%':
-				out('%', &buffer, idx++, maxlen);
+				out('%', buffer, idx++, maxlen);
 				format++;
 				break;
 
 			default:
-				out(*format, &buffer, idx++, maxlen);
+				out(*format, buffer, idx++, maxlen);
 				format++;
 				break;
 		}
 	}
 
 	// termination
-	out(static_cast<char>(0), &buffer, idx < maxlen ? idx : maxlen - 1U, maxlen);
+	if (maxlen != 0)
+	{
+		out(static_cast<char>(0), buffer, idx < maxlen ? idx : maxlen - 1U, maxlen);
+	}
+
+	// return written chars without terminating \0
+	return idx;
+}
+
+static int kyty_printf_internal(const char* format, VaList* va_list)
+{
+	// The arguments are not even read if the output is disabled
+	if (Log::GetDirection() == Log::Direction::Silent)
+	{
+		return 0;
+	}
 
-	if (sn)
+	constexpr size_t begin_len = sizeof(PRINTF_COLOR_BEGIN) - 1;
+	constexpr size_t end_len   = sizeof(PRINTF_COLOR_END) - 1;
+
+	VaList va_copy = *va_list;
+	char*  buf     = g_printf_out;
+	size_t len     = kyty_format(buf + begin_len, PRINTF_OUT_BUFFER_SIZE - begin_len - end_len, format, va_list);
+
+	if (begin_len + len + end_len >= PRINTF_OUT_BUFFER_SIZE)
 	{
-		int s = snprintf(sn_s, sn_n, "%s", buffer.GetDataConst());
-		EXIT_NOT_IMPLEMENTED(static_cast<size_t>(s) >= sn_n);
-	} else
+		buf = new char[begin_len + len + end_len + 1];
+		kyty_format(buf + begin_len, len + 1, format, &va_copy);
+	}
+
+	memcpy(buf, PRINTF_COLOR_BEGIN, begin_len);
+	memcpy(buf + begin_len + len, PRINTF_COLOR_END, end_len);
+
+	Log::Write(buf, static_cast<uint32_t>(begin_len + len + end_len));
+
+	if (buf != g_printf_out)
 	{
-		printf(FG_BRIGHT_MAGENTA "%s" DEFAULT, buffer.GetDataConst());
+		delete[] buf;
 	}
 
-	// return written chars without terminating \0
-	return static_cast<int>(idx);
+	return static_cast<int>(len);
 }
 
 static int kyty_vprintf(const char* format, VaList* va_list)
 {
-	return kyty_printf_internal(false, nullptr, 0, format, va_list);
+	return kyty_printf_internal(format, va_list);
 }
 
 static int kyty_printf_ctx(VaContext* ctx)
 {
 	const char* format = VaArg_ptr<const char>(&ctx->va_list);
 
-	return kyty_printf_internal(false, nullptr, 0, format, &ctx->va_list);
+	return kyty_printf_internal(format, &ctx->va_list);
 }
 
 static int kyty_snprintf_ctx(VaContext* ctx)
@@ -885,7 +920,10 @@ static int kyty_snprintf_ctx(VaContext* ctx)
 	size_t      n      = VaArg_size_t(&ctx->va_list);
 	const char* format = VaArg_ptr<const char>(&ctx->va_list);
 
-	return kyty_printf_internal(true, s, n, format, &ctx->va_list);
+	size_t len = kyty_format(s, n, format, &ctx->va_list);
+	EXIT_NOT_IMPLEMENTED(len >= n);
+
+	return static_cast<int>(len);
 }
 
 static int KYTY_SYSV_ABI kyty_printf_std(VA_ARGS)
@@ -0,0 +1,414 @@
+#include "Emulator/Libs/Trace.h"
+
+#include "Kyty/Core/ByteBuffer.h"
+#include "Kyty/Core/DateTime.h"
+#include "Kyty/Core/DbgAssert.h"
+#include "Kyty/Core/File.h"
+#include "Kyty/Core/Threads.h"
+#include "Kyty/Core/Vector.h"
+
+#include "Emulator/Config.h"
+#include "Emulator/Loader/Timer.h"
+
+#include <algorithm>
+#include <cstdio>
+
+#ifdef KYTY_EMU_ENABLED
+
+namespace Kyty::Libs {
+
+// The file is the magic and then the entries. An entry is TraceBinaryHeader and the text of a format or the arguments of
+// a record.
+constexpr char     TRACE_BINARY_MAGIC[8]   = {'K', 'Y', 'T', 'Y', 'T', 'R', 'C', '1'};
+constexpr uint32_t TRACE_BINARY_FORMAT     = 1;
+constexpr uint32_t TRACE_BINARY_NAME       = 2;
+constexpr uint32_t TRACE_BINARY_CALL       = 3;
+constexpr uint32_t TRACE_BINARY_ARG_MAX    = 512;
+constexpr uint32_t TRACE_BINARY_SPEC_MAX   = 32;
+constexpr uint32_t TRACE_BINARY_STR_HEADER = 1 + sizeof(uint32_t);
+
+struct TraceBinaryHeader
+{
+	uint32_t size;
+	uint32_t type;
+	uint32_t id;
+	int32_t  thread_id;
+	int32_t  time_ms;
+};
+
+struct TraceBinaryDef
+{
+	uint32_t     type = 0;
+	Vector<char> text;
+};
+
+struct TraceBinaryValue
+{
+	TraceBinaryArg type = TraceBinaryArg::Int;
+	uint64_t       u    = 0;
+	double         d    = 0.0;
+	const char*    str  = nullptr;
+	uint32_t       len  = 0;
+};
+
+int  g_trace_levels[static_cast<int>(TraceSubsystem::Max)] = {};
+bool g_trace_binary                                        = false;
+
+static std::atomic_uint32_t g_trace_binary_next_id(0);
+
+void TraceInit()
+{
+	int level = (Log::GetDirection() == Log::Direction::Silent ? KYTY_TRACE_OFF : static_cast<int>(Config::GetTraceLevel()));
+
+	for (auto& l: g_trace_levels)
+	{
+		l = level;
+	}
+
+	auto file_name = Config::GetTraceBinaryFile();
+
+	if (level != KYTY_TRACE_OFF && !file_name.IsEmpty() && !Log::IsTraceFile())
+	{
+		Log::SetTraceFile(file_name);
+		if (Log::IsTraceFile())
+		{
+			Log::WriteTrace(TRACE_BINARY_MAGIC, sizeof(TRACE_BINARY_MAGIC));
+			g_trace_binary = true;
+		}
+	}
+}
+
+void TraceSetLevel(TraceSubsystem sub, int level)
+{
+	EXIT_IF(sub >= TraceSubsystem::Max);
+
+	g_trace_levels[static_cast<int>(sub)] = level;
+}
+
+static void trace_binary_header(TraceBinaryRecord* r, uint32_t type, uint32_t id, int32_t thread_id, int32_t time_ms)
+{
+	TraceBinaryHeader h {};
+	h.type      = type;
+	h.id        = id;
+	h.thread_id = thread_id;
+	h.time_ms   = time_ms;
+	r->size     = 0;
+	r->Add(&h, sizeof(h));
+}
+
+static uint32_t trace_binary_define(std::atomic_uint32_t* id, uint32_t type, const char* text, uint32_t size)
+{
+	uint32_t new_id = ++g_trace_binary_next_id;
+
+	TraceBinaryRecord r;
+	trace_binary_header(&r, type, new_id, 0, 0);
+	r.Add(text, std::min(size, TRACE_BINARY_RECORD_MAX - r.size));
+	TraceBinaryEnd(&r);
+
+	// Two threads may define the same call site, the second id is never used
+	uint32_t old_id = 0;
+	return (id->compare_exchange_strong(old_id, new_id) ? new_id : old_id);
+}
+
+uint32_t TraceBinaryId(std::atomic_uint32_t* id, const char* format)
+{
+	if (uint32_t v = id->load(std::memory_order_acquire); v != 0)
+	{
+		return v;
+	}
+	return trace_binary_define(id, TRACE_BINARY_FORMAT, format, static_cast<uint32_t>(strlen(format)));
+}
+
+uint32_t TraceBinaryNameId(std::atomic_uint32_t* id, const char* library, const char* module, const char* func)
+{
+	if (uint32_t v = id->load(std::memory_order_acquire); v != 0)
+	{
+		return v;
+	}
+	auto text = String::FromPrintf("%s::%s::%s()", library, module, func).utf8_str();
+	return trace_binary_define(id, TRACE_BINARY_NAME, text.GetDataConst(), text.Size() - 1);
+}
+
+void TraceBinaryBegin(TraceBinaryRecord* r, uint32_t id)
+{
+	trace_binary_header(r, TRACE_BINARY_CALL, id, Core::Thread::GetThreadIdUnique(), Loader::Timer::GetTime().MsecTotal());
+}
+
+void TraceBinaryEnd(TraceBinaryRecord* r)
+{
+	auto* h = reinterpret_cast<TraceBinaryHeader*>(r->data);
+	h->size = r->size;
+	Log::WriteTrace(r->data, r->size);
+}
+
+void TraceBinaryAddStr(TraceBinaryRecord* r, const char* str)
+{
+	if (str == nullptr)
+	{
+		str = "(null)";
+	}
+	if (r->size + TRACE_BINARY_STR_HEADER > TRACE_BINARY_RECORD_MAX)
+	{
+		return;
+	}
+	auto len  = std::min(static_cast<uint32_t>(strlen(str)), TRACE_BINARY_RECORD_MAX - r->size - TRACE_BINARY_STR_HEADER);
+	auto type = TraceBinaryArg::Str;
+	r->Add(&type, 1);
+	r->Add(&len, sizeof(len));
+	r->Add(str, len);
+}
+
+static bool trace_binary_read(const uint8_t** p, const uint8_t* end, TraceBinaryValue* v)
+{
+	if (*p >= end)
+	{
+		return false;
+	}
+	v->type = static_cast<TraceBinaryArg>(**p);
+	(*p)++;
+	switch (v->type)
+	{
+		case TraceBinaryArg::Int:
+		case TraceBinaryArg::Uint:
+		case TraceBinaryArg::Double:
+			if (end - *p < 8)
+			{
+				return false;
+			}
+			memcpy(&v->u, *p, 8);
+			memcpy(&v->d, *p, 8);
+			if (v->type == TraceBinaryArg::Double)
+			{
+				v->u = static_cast<uint64_t>(static_cast<int64_t>(v->d));
+			} else
+			{
+				v->d = (v->type == TraceBinaryArg::Int ? static_cast<double>(static_cast<int64_t>(v->u)) : static_cast<double>(v->u));
+			}
+			*p += 8;
+			return true;
+		case TraceBinaryArg::Str:
+			if (end - *p < 4)
+			{
+				return false;
+			}
+			memcpy(&v->len, *p, 4);
+			*p += 4;
+			if (end - *p < v->len)
+			{
+				return false;
+			}
+			v->str = reinterpret_cast<const char*>(*p);
+			*p += v->len;
+			return true;
+	}
+	return false;
+}
+
+template <class T>
+static void trace_binary_append(Vector<char>* out, const char* spec, T value)
+{
+	char buf[TRACE_BINARY_ARG_MAX];
+	int  len = snprintf(buf, sizeof(buf), spec, value);
+	if (len < 0)
+	{
+		return;
+	}
+	if (static_cast<uint32_t>(len) < sizeof(buf))
+	{
+		out->Add(buf, len);
+	} else
+	{
+		auto* big = new char[len + 1];
+		snprintf(big, len + 1, spec, value);
+		out->Add(big, len);
+		delete[] big;
+	}
+}
+
+// Each conversion of the format is printed with its own argument, the length modifiers are replaced by the stored types
+static void trace_binary_format(const char* format, const uint8_t* args, const uint8_t* end, Vector<char>* out)
+{
+	char             spec[TRACE_BINARY_SPEC_MAX + 8];
+	TraceBinaryValue v;
+
+	for (const char* p = format; *p != '\0'; p++)
+	{
+		if (*p != '%')
+		{
+			out->Add(*p);
+			continue;
+		}
+		if (p[1] == '%')
+		{
+			out->Add('%');
+			p++;
+			continue;
+		}
+
+		uint32_t n = 0;
+		spec[n++]  = *p++;
+		while (*p != '\0' && strchr("-+ #0123456789.*", *p) != nullptr && n < TRACE_BINARY_SPEC_MAX)
+		{
+			if (*p == '*')
+			{
+				int width = (trace_binary_read(&args, end, &v) ? static_cast<int>(v.u) : 0);
+				n += snprintf(spec + n, TRACE_BINARY_SPEC_MAX - n, "%d", width);
+				n = std::min(n, TRACE_BINARY_SPEC_MAX - 1);
+			} else
+			{
+				spec[n++] = *p;
+			}
+			p++;
+		}
+		while (*p != '\0' && strchr("hljztL", *p) != nullptr)
+		{
+			p++;
+		}
+		char conv = *p;
+		if (conv == '\0')
+		{
+			break;
+		}
+
+		if (!trace_binary_read(&args, end, &v))
+		{
+			out->Add("<?>", 3);
+			continue;
+		}
+
+		switch (conv)
+		{
+			case 'd':
+			case 'i':
+				spec[n++] = 'l';
+				spec[n++] = 'l';
+				spec[n++] = conv;
+				spec[n]   = '\0';
+				trace_binary_append(out, spec, static_cast<long long>(v.u));
+				break;
+			case 'u':
+			case 'o':
+			case 'x':
+			case 'X':
+			case 'p':
+				spec[n++] = 'l';
+				spec[n++] = 'l';
+				spec[n++] = (conv == 'p' ? 'x' : conv);
+				spec[n]   = '\0';
+				trace_binary_append(out, spec, static_cast<unsigned long long>(v.u));
+				break;
+			case 'c':
+				spec[n++] = 'c';
+				spec[n]   = '\0';
+				trace_binary_append(out, spec, static_cast<int>(v.u));
+				break;
+			case 's':
+			{
+				Vector<char> str;
+				if (v.type == TraceBinaryArg::Str)
+				{
+					str.Add(v.str, v.len);
+				}
+				str.Add('\0');
+				spec[n++] = 's';
+				spec[n]   = '\0';
+				trace_binary_append(out, spec, str.GetDataConst());
+				break;
+			}
+			default:
+				spec[n++] = conv;
+				spec[n]   = '\0';
+				trace_binary_append(out, spec, v.d);
+				break;
+		}
+	}
+}
+
+bool TraceBinaryDecode(const String& file_name, const String& out_file_name)
+{
+	Core::File f;
+	if (!f.Open(file_name, Core::File::Mode::Read))
+	{
+		return false;
+	}
+	auto data = f.Read(static_cast<uint32_t>(f.Size()));
+	f.Close();
+
+	const auto* begin = reinterpret_cast<const uint8_t*>(data.GetDataConst());
+	const auto* end   = begin + data.Size();
+
+	if (data.Size() < sizeof(TRACE_BINARY_MAGIC) || memcmp(begin, TRACE_BINARY_MAGIC, sizeof(TRACE_BINARY_MAGIC)) != 0)
+	{
+		return false;
+	}
+
+	Core::File out;
+	out.Create(out_file_name);
+	if (out.IsInvalid())
+	{
+		return false;
+	}
+
+	// A call can be written before the format it uses, the formats are collected first. The file of a crashed run ends with a
+	// partial entry.
+	Vector<TraceBinaryDef> defs;
+	for (int pass = 0; pass < 2; pass++)
+	{
+		Vector<char> text;
+
+		for (const auto* p = begin + sizeof(TRACE_BINARY_MAGIC); end - p >= static_cast<ptrdiff_t>(sizeof(TraceBinaryHeader));)
+		{
+			TraceBinaryHeader h {};
+			memcpy(&h, p, sizeof(h));
+			if (h.size < sizeof(h) || h.size > end - p)
+			{
+				break;
+			}
+			const auto* payload     = p + sizeof(h);
+			const auto* payload_end = p + h.size;
+			p                       = payload_end;
+
+			if (pass == 0 && h.type != TRACE_BINARY_CALL)
+			{
+				while (defs.Size() <= h.id)
+				{
+					defs.Add(TraceBinaryDef());
+				}
+				auto& def = defs[h.id];
+				def.type  = h.type;
+				def.text.Clear();
+				def.text.Add(reinterpret_cast<const char*>(payload), static_cast<uint32_t>(payload_end - payload));
+				def.text.Add('\0');
+			} else if (pass == 1 && h.type == TRACE_BINARY_CALL)
+			{
+				if (h.id >= defs.Size() || defs[h.id].type == 0)
+				{
+					auto msg = String::FromPrintf("<unknown trace %u>\n", h.id).utf8_str();
+					text.Add(msg.GetDataConst(), msg.Size() - 1);
+				} else if (const auto& def = defs[h.id]; def.type == TRACE_BINARY_NAME)
+				{
+					auto msg = String::FromPrintf("[%d][%s] %s\n", h.thread_id, Core::Time(h.time_ms).ToString("HH24:MI:SS.FFF").C_Str(),
+					                              def.text.GetDataConst())
+					               .utf8_str();
+					text.Add(msg.GetDataConst(), msg.Size() - 1);
+				} else
+				{
+					trace_binary_format(def.text.GetDataConst(), payload, payload_end, &text);
+				}
+			}
+		}
+
+		if (!text.IsEmpty())
+		{
+			out.Write(text.GetDataConst(), text.Size());
+		}
+	}
+
+	out.Close();
+
+	return true;
+}
+
+} // namespace Kyty::Libs
+
+#endif // KYTY_EMU_ENABLED
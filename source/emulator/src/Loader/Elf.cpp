@@ -1,8 +1,11 @@
 #include "Emulator/Loader/Elf.h"
 
+#include "Kyty/Core/Compression.h"
 #include "Kyty/Core/DbgAssert.h"
 #include "Kyty/Core/File.h"
 
+#include "Emulator/Config.h"
+
 #ifdef KYTY_EMU_ENABLED
 
 namespace Kyty::Loader {
@@ -253,7 +256,55 @@ Elf64::~Elf64()
 	Clear();
 }
 
-void Elf64::LoadSegment(uint64_t vaddr, uint64_t file_offset, uint64_t size)
+// With 'map', whole pages are mapped from the file when the file offset and the address are aligned the same way, the rest is read
+static void load_file_range(Core::File* f, uint64_t vaddr, uint64_t file_offset, uint64_t size, bool map)
+{
+	constexpr uint64_t PAGE_MASK = 0xfffu;
+
+	if (map && Config::FileMappingEnabled() && ((vaddr ^ file_offset) & PAGE_MASK) == 0)
+	{
+		uint64_t map_start = (vaddr + PAGE_MASK) & ~PAGE_MASK;
+		uint64_t map_end   = (vaddr + size) & ~PAGE_MASK;
+
+		if (map_end > map_start && f->MapFixed(file_offset + (map_start - vaddr), map_end - map_start, map_start))
+		{
+			f->ReadAt(reinterpret_cast<void*>(static_cast<uintptr_t>(vaddr)), map_start - vaddr, file_offset);
+			f->ReadAt(reinterpret_cast<void*>(static_cast<uintptr_t>(map_end)), vaddr + size - map_end, file_offset + (map_end - vaddr));
+			return;
+		}
+	}
+
+	// Segments may be loaded by several threads
+	uint64_t bytes_read = 0;
+	f->ReadAt(reinterpret_cast<void*>(static_cast<uintptr_t>(vaddr)), size, file_offset, &bytes_read);
+	EXIT_NOT_IMPLEMENTED(bytes_read != size);
+}
+
+// The segment is a zlib stream. If the whole segment is loaded, it's inflated straight to vaddr.
+static void load_compressed_range(Core::File* f, uint64_t vaddr, const SelfSegment& seg, uint64_t offset, uint64_t size)
+{
+	auto*    packed     = new uint8_t[seg.compressed_size];
+	uint64_t bytes_read = 0;
+	f->ReadAt(packed, seg.compressed_size, seg.offset, &bytes_read);
+	EXIT_NOT_IMPLEMENTED(bytes_read != seg.compressed_size);
+
+	auto* dst = reinterpret_cast<uint8_t*>(static_cast<uintptr_t>(vaddr));
+
+	if (offset == 0 && size == seg.decompressed_size)
+	{
+		EXIT_NOT_IMPLEMENTED(Core::DecompressZip(packed, seg.compressed_size, dst, size) != size);
+	} else
+	{
+		auto* buf = new uint8_t[seg.decompressed_size];
+		EXIT_NOT_IMPLEMENTED(Core::DecompressZip(packed, seg.compressed_size, buf, seg.decompressed_size) != seg.decompressed_size);
+		memcpy(dst, buf + offset, size);
+		delete[] buf;
+	}
+
+	delete[] packed;
+}
+
+void Elf64::LoadSegment(uint64_t vaddr, uint64_t file_offset, uint64_t size, bool map)
 {
 	EXIT_IF(m_f == nullptr);
 
@@ -274,14 +325,20 @@ void Elf64::LoadSegment(uint64_t vaddr, uint64_t file_offset, uint64_t size)
 				if (file_offset >= phdr.p_offset && file_offset < phdr.p_offset + phdr.p_filesz)
 				{
 					EXIT_NOT_IMPLEMENTED(seg.decompressed_size != phdr.p_filesz);
-					EXIT_NOT_IMPLEMENTED(seg.compressed_size != seg.decompressed_size);
 
 					auto offset = file_offset - phdr.p_offset;
 
 					EXIT_NOT_IMPLEMENTED(offset + size > seg.decompressed_size);
 
-					m_f->Seek(offset + seg.offset);
-					m_f->Read(reinterpret_cast<void*>(static_cast<uintptr_t>(vaddr)), size);
+					if ((seg.type & 0x8u) != 0)
+					{
+						load_compressed_range(m_f, vaddr, seg, offset, size);
+					} else
+					{
+						EXIT_NOT_IMPLEMENTED(seg.compressed_size != seg.decompressed_size);
+
+						load_file_range(m_f, vaddr, offset + seg.offset, size, map);
+					}
 
 					return;
 				}
@@ -290,8 +347,7 @@ void Elf64::LoadSegment(uint64_t vaddr, uint64_t file_offset, uint64_t size)
 
 		if (m_f->Size() - m_self->file_size == size)
 		{
-			m_f->Seek(m_self->file_size);
-			m_f->Read(reinterpret_cast<void*>(static_cast<uintptr_t>(vaddr)), size);
+			load_file_range(m_f, vaddr, m_self->file_size, size, map);
 
 			return;
 		}
@@ -299,8 +355,7 @@ void Elf64::LoadSegment(uint64_t vaddr, uint64_t file_offset, uint64_t size)
 		EXIT("missing self segment\n");
 	} else
 	{
-		m_f->Seek(file_offset);
-		m_f->Read(reinterpret_cast<void*>(static_cast<uintptr_t>(vaddr)), size);
+		load_file_range(m_f, vaddr, file_offset, size, map);
 	}
 }
 
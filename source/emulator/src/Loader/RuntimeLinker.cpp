@@ -2,22 +2,32 @@
 
 #include "Kyty/Core/Common.h"
 #include "Kyty/Core/DbgAssert.h"
+#include "Kyty/Core/Debug.h"
 #include "Kyty/Core/File.h"
+#include "Kyty/Core/JobSystem.h"
 #include "Kyty/Core/MagicEnum.h"
 #include "Kyty/Core/Singleton.h"
 #include "Kyty/Core/String.h"
+#include "Kyty/Core/StringView8.h"
 #include "Kyty/Core/Threads.h"
 #include "Kyty/Core/VirtualMemory.h"
 #include "Kyty/Sys/SysDbg.h"
 
 #include "Emulator/Config.h"
+#include "Emulator/Graphics/Graphics.h"
 #include "Emulator/Graphics/Objects/GpuMemory.h"
 #include "Emulator/Kernel/Pthread.h"
 #include "Emulator/Loader/Elf.h"
 #include "Emulator/Loader/Jit.h"
+#include "Emulator/Loader/Startup.h"
 #include "Emulator/Loader/SymbolDatabase.h"
 #include "Emulator/Profiler.h"
 
+#include <algorithm>
+#include <atomic>
+#include <vector>
+#include <xxhash/xxhash.h>
+
 #ifdef KYTY_EMU_ENABLED
 
 namespace Kyty::Libs::LibKernel {
@@ -51,15 +61,15 @@ enum class BindType
 
 struct RelocationInfo
 {
-	bool       resolved   = false;
-	BindType   bind       = BindType::Unknown;
-	SymbolType type       = SymbolType::Unknown;
-	uint64_t   value      = 0;
-	uint64_t   vaddr      = 0;
-	uint64_t   base_vaddr = 0;
-	String     name;
-	String     dbg_name;
-	bool       bind_self = false;
+	bool        resolved   = false;
+	BindType    bind       = BindType::Unknown;
+	SymbolType  type       = SymbolType::Unknown;
+	uint64_t    value      = 0;
+	uint64_t    vaddr      = 0;
+	uint64_t    base_vaddr = 0;
+	const char* symbol     = nullptr; // 'nid#library#module'
+	String      dbg_name;
+	bool        bind_self = false;
 };
 
 // The structure will be passed via the stack
@@ -85,6 +95,39 @@ static Program* g_tls_main_program = nullptr;
 alignas(64) static uint8_t g_tls_reg_save_area[XSAVE_BUFFER_SIZE + sizeof(XSAVE_CHK_GUARD)];
 static uint8_t g_tls_spinlock = 0;
 
+// Set if guest TLS accesses are patched to load the TLS pointer from the host thread slot
+static bool     g_tls_direct         = false;
+static uint8_t  g_tls_direct_segment = 0;
+static uint32_t g_tls_direct_offset  = 0;
+
+// TLS blocks already returned to this thread. Entries are valid while the generation is unchanged, it changes when a program
+// or a TLS block is deleted.
+struct TlsCacheEntry
+{
+	Program* program = nullptr;
+	uint8_t* tls     = nullptr;
+};
+
+constexpr int TLS_CACHE_SIZE = 4;
+
+// Relocations resolved by one job, and the page granularity used to write them
+constexpr uint32_t RELOCATION_JOB_SIZE  = 1024;
+constexpr uint64_t RELOCATION_PAGE_MASK = 0xfffu;
+
+constexpr uint32_t RELOCATION_CACHE_MAGIC   = 0x4352524b; // KRRC
+constexpr uint32_t RELOCATION_CACHE_VERSION = 1;
+// An HLE value further than this from the nearest HLE symbol below it is not cached
+constexpr uint64_t RELOCATION_CACHE_MAX_HLE_OFFSET = 0x100000u;
+
+constexpr uint32_t BOOT_SNAPSHOT_MAGIC     = 0x5342424b; // KBBS
+constexpr uint32_t BOOT_SNAPSHOT_VERSION   = 1;
+constexpr uint64_t BOOT_SNAPSHOT_PAGE_MASK = 0xfffu;
+
+static std::atomic_uint64_t       g_tls_cache_generation(1);
+thread_local static TlsCacheEntry g_tls_cache[TLS_CACHE_SIZE];
+thread_local static uint64_t      g_tls_cache_thread_generation = 0;
+thread_local static int           g_tls_cache_next              = 0;
+
 static KYTY_SYSV_ABI void run_entry(uint64_t addr, EntryParams* params, atexit_func_t atexit_func)
 {
 	reinterpret_cast<entry_func_t>(addr)(params, atexit_func);
@@ -202,16 +245,18 @@ void KYTY_SYSV_ABI sys_stack_walk_x86(uint64_t rbp, void** stack, int* depth)
 
 static void kyty_exception_handler(const Core::VirtualMemory::ExceptionHandler::ExceptionInfo* info)
 {
+	// Writes to watched GPU memory are expected, they are resolved before any logging
+	if (info->type == Core::VirtualMemory::ExceptionHandler::ExceptionType::AccessViolation &&
+	    info->access_violation_type == Core::VirtualMemory::ExceptionHandler::AccessViolationType::Write &&
+	    Libs::Graphics::GpuMemoryWriteFault(info->access_violation_vaddr))
+	{
+		return;
+	}
+
 	printf("kyty_exception_handler: %016" PRIx64 "\n", info->exception_address);
 
 	if (info->type == Core::VirtualMemory::ExceptionHandler::ExceptionType::AccessViolation)
 	{
-		if (info->access_violation_type == Core::VirtualMemory::ExceptionHandler::AccessViolationType::Write &&
-		    Libs::Graphics::GpuMemoryCheckAccessViolation(info->access_violation_vaddr, sizeof(uint64_t)))
-		{
-			return;
-		}
-
 		if (info->rbp != 0)
 		{
 			Core::Singleton<Loader::RuntimeLinker>::Instance()->StackTrace(info->rbp);
@@ -305,11 +350,12 @@ static void get_dyn_modules(Elf64* elf, T* out, const char* names, Elf64_Sxword
 	for (auto need: needed_modules)
 	{
 		ModuleId id {};
-		// id.id            = static_cast<int>((need >> 48u) & 0xffffu);
-		encode_id_64(static_cast<uint16_t>((need >> 48u) & 0xffffu), &id.id);
+		id.id_num = static_cast<uint16_t>((need >> 48u) & 0xffffu);
+		encode_id_64(id.id_num, &id.id);
 		id.version_major = static_cast<int>((need >> 40u) & 0xffu);
 		id.version_minor = static_cast<int>((need >> 32u) & 0xffu);
 		id.name          = names + (need & 0xffffffff);
+		id.key           = SymbolDatabase::ModuleKey(id.name, id.version_major, id.version_minor);
 		out->Add(id);
 	}
 }
@@ -322,15 +368,17 @@ static void get_dyn_libs(Elf64* elf, T* out, const char* names, Elf64_Sxword tag
 	for (auto need: needed_modules)
 	{
 		LibraryId id {};
-		// id.id      = static_cast<int>((need >> 48u) & 0xffffu);
-		encode_id_64(static_cast<uint16_t>((need >> 48u) & 0xffffu), &id.id);
+		id.id_num = static_cast<uint16_t>((need >> 48u) & 0xffffu);
+		encode_id_64(id.id_num, &id.id);
 		id.version = static_cast<int>((need >> 32u) & 0xffffu);
 		id.name    = names + (need & 0xffffffff);
+		id.key     = SymbolDatabase::LibraryKey(id.name, id.version);
 		out->Add(id);
 	}
 }
 
-static RelocationInfo GetRelocationInfo(Elf64_Rela* r, Program* program)
+// Relocation workers pass lock_linker = false, see RuntimeLinker::Resolve()
+static RelocationInfo GetRelocationInfo(Elf64_Rela* r, Program* program, bool lock_linker = true)
 {
 	KYTY_PROFILER_FUNCTION();
 
@@ -366,7 +414,6 @@ static RelocationInfo GetRelocationInfo(Elf64_Rela* r, Program* program)
 			auto         bind         = sym.GetBind();
 			auto         sym_type     = sym.GetType();
 			uint64_t     symbol_vaddr = 0;
-			SymbolRecord sr {};
 			switch (sym_type)
 			{
 				case STT_NOTYPE: ret.type = SymbolType::NoType; break;
@@ -383,18 +430,15 @@ static RelocationInfo GetRelocationInfo(Elf64_Rela* r, Program* program)
 				case STB_GLOBAL: ret.bind = BindType::Global; [[fallthrough]];
 				case STB_WEAK:
 				{
-					ret.bind = (ret.bind == BindType::Unknown ? BindType::Weak : ret.bind);
-					ret.name = names + sym.st_name;
-					program->rt->Resolve(ret.name, ret.type, program, &sr, &ret.bind_self);
-					symbol_vaddr = sr.vaddr;
+					ret.bind     = (ret.bind == BindType::Unknown ? BindType::Weak : ret.bind);
+					ret.symbol   = names + sym.st_name;
+					symbol_vaddr = program->rt->Resolve(ret.symbol, ret.type, program, &ret.bind_self, lock_linker);
 				}
 				break;
 				default: EXIT("unknown bind: %d\n", (int)bind);
 			}
 			ret.resolved = (symbol_vaddr != 0);
 			ret.value    = (ret.resolved ? symbol_vaddr + addend : 0);
-			ret.name     = sr.name;
-			ret.dbg_name = sr.dbg_name;
 		}
 		break;
 		case R_X86_64_RELATIVE:
@@ -416,79 +460,612 @@ static RelocationInfo GetRelocationInfo(Elf64_Rela* r, Program* program)
 	return ret;
 }
 
+// Names are only needed for messages, so relocation doesn't build them
+static void get_reloc_names(const RelocationInfo& ri, Program* program, String* name, String* dbg_name)
+{
+	if (ri.symbol != nullptr)
+	{
+		auto rec  = program->rt->ResolveRecord(String::FromUtf8(ri.symbol), ri.type, program);
+		*name     = rec.name;
+		*dbg_name = rec.dbg_name;
+	} else
+	{
+		*dbg_name = ri.dbg_name;
+	}
+}
+
+// Returns the value to write at ri.vaddr, unresolved weak symbols get a stub
+static uint64_t get_relocation_value(uint32_t index, const RelocationInfo& ri, Program* program, bool jmprela_table)
+{
+	if (ri.resolved)
+	{
+		return ri.value;
+	}
+
+	uint64_t value = 0;
+	bool     weak  = (ri.bind == BindType::Weak || !program->fail_if_global_not_resolved);
+	if (ri.type == SymbolType::Object && weak)
+	{
+		value = g_invalid_memory;
+	} else if (ri.type == SymbolType::Func && jmprela_table && weak)
+	{
+		if (program->custom_call_plt_vaddr != 0)
+		{
+			EXIT_NOT_IMPLEMENTED(index >= program->custom_call_plt_num);
+			value = reinterpret_cast<Jit::CallPlt*>(program->custom_call_plt_vaddr)->GetAddr(index);
+		} else
+		{
+			value = RuntimeLinker::ReadFromElf(program, ri.vaddr) + ri.base_vaddr;
+		}
+	} else if ((ri.type == SymbolType::Func && !jmprela_table && weak) || (ri.type == SymbolType::NoType && weak))
+	{
+		value = RuntimeLinker::ReadFromElf(program, ri.vaddr) + ri.base_vaddr;
+	}
+
+	if (value == 0)
+	{
+		String name;
+		String dbg_name;
+		get_reloc_names(ri, program, &name, &dbg_name);
+
+		auto dbg_str = String::FromPrintf("[%016" PRIx64 "] <- %s%016" PRIx64 "%s, %s, %s, %s, %s", ri.vaddr,
+		                                  ri.value == 0 ? FG_BRIGHT_RED : FG_BRIGHT_GREEN, ri.value, DEFAULT, name.C_Str(),
+		                                  Core::EnumName(ri.type).C_Str(), Core::EnumName(ri.bind).C_Str(), dbg_name.C_Str());
+
+		EXIT("Can't resolve: %s\n", (Log::IsColoredPrintf() ? dbg_str : Log::RemoveColors(dbg_str)).C_Str());
+	}
+
+	return value;
+}
+
+// The page of the relocation is made writable by the batch of relocate_all()
 static void relocate(uint32_t index, Elf64_Rela* r, Program* program, bool jmprela_table)
 {
 	KYTY_PROFILER_FUNCTION();
 
 	auto ri = GetRelocationInfo(r, program);
 
-	[[maybe_unused]] bool patched = false;
+	[[maybe_unused]] bool patched =
+	    Core::VirtualMemory::PatchBatch::Replace(ri.vaddr, get_relocation_value(index, ri, program, jmprela_table));
+
+	if (program->dbg_print_reloc)
+	{
+		if (/* !dbg_str.ContainsStr(U"libc_") && */ patched && !ri.bind_self &&
+		    (ri.bind == BindType::Global || ri.bind == BindType::Weak || ri.type == SymbolType::TlsModule))
+		{
+			String name;
+			String dbg_name;
+			get_reloc_names(ri, program, &name, &dbg_name);
+
+			auto dbg_str = String::FromPrintf("[%016" PRIx64 "] <- %s%016" PRIx64 "%s, %s, %s, %s, %s", ri.vaddr,
+			                                  ri.value == 0 ? FG_BRIGHT_RED : FG_BRIGHT_GREEN, ri.value, DEFAULT, name.C_Str(),
+			                                  Core::EnumName(ri.type).C_Str(), Core::EnumName(ri.bind).C_Str(), dbg_name.C_Str());
 
-	// KYTY_PROFILER_BLOCK("patch");
+			printf("Relocate: %s\n", dbg_str.C_Str());
+		}
+	}
+}
 
-	if (ri.resolved)
+static void relocate_all(Elf64_Rela* records, uint64_t size, Program* program, bool jmprela_table)
+{
+	KYTY_PROFILER_FUNCTION();
+
+	Core::VirtualMemory::PatchBatch batch;
+
+	for (auto* r = records; reinterpret_cast<uint8_t*>(r) < reinterpret_cast<uint8_t*>(records) + size; r++)
 	{
-		patched = Core::VirtualMemory::PatchReplace(ri.vaddr, ri.value);
-	} else
+		batch.Add(program->base_vaddr + r->r_offset, sizeof(uint64_t));
+	}
+
+	batch.Begin();
+
+	uint32_t index = 0;
+	for (auto* r = records; reinterpret_cast<uint8_t*>(r) < reinterpret_cast<uint8_t*>(records) + size; r++, index++)
 	{
-		uint64_t value = 0;
-		bool     weak  = (ri.bind == BindType::Weak || !program->fail_if_global_not_resolved);
-		if (ri.type == SymbolType::Object && weak)
+		relocate(index, r, program, jmprela_table);
+	}
+
+	batch.End();
+}
+
+struct RelocationPatch
+{
+	uint64_t vaddr;
+	uint64_t value;
+};
+
+struct RelocationJob
+{
+	Program*                     program       = nullptr;
+	Elf64_Rela*                  records       = nullptr;
+	uint32_t                     first         = 0;
+	uint32_t                     num           = 0;
+	bool                         jmprela_table = false;
+	std::vector<RelocationPatch> patches;
+};
+
+static void add_relocation_jobs(std::vector<RelocationJob>* jobs, Program* program, Elf64_Rela* records, uint64_t size, bool jmprela_table)
+{
+	auto num = static_cast<uint32_t>(size / sizeof(Elf64_Rela));
+	for (uint32_t first = 0; first < num; first += RELOCATION_JOB_SIZE)
+	{
+		RelocationJob job;
+		job.program       = program;
+		job.records       = records;
+		job.first         = first;
+		job.num           = std::min(RELOCATION_JOB_SIZE, num - first);
+		job.jmprela_table = jmprela_table;
+		jobs->push_back(std::move(job));
+	}
+}
+
+// Cached values are stored relative to what they point to, so they stay valid when the modules are loaded at other addresses
+enum class RelocationBase : uint32_t
+{
+	Program,
+	CallPlt,
+	TlsModule,
+	InvalidMemory,
+	Hle,
+};
+
+struct RelocationCacheEntry
+{
+	uint32_t       target;
+	RelocationBase base;
+	uint32_t       base_index;
+	uint32_t       reserved;
+	uint64_t       target_offset;
+	uint64_t       value_offset;
+};
+
+struct RelocationCache
+{
+	RelocationCache(const Vector<Program*>& all_programs, const SymbolDatabase* hle_symbols)
+	    : programs(all_programs), hle(hle_symbols->GetRecords())
+	{
+	}
+
+	[[nodiscard]] bool Encode(const RelocationPatch& patch, RelocationCacheEntry* entry) const;
+	[[nodiscard]] bool Decode(const RelocationCacheEntry& entry, RelocationPatch* patch) const;
+
+	const Vector<Program*>&     programs;
+	const Vector<SymbolRecord>& hle;
+	std::vector<uint64_t>       hle_sorted; // HLE addresses in ascending order
+	std::vector<uint32_t>       hle_index;  // record of each hle_sorted entry
+	uint64_t                    key = 0;
+	String                      file_name;
+};
+
+static bool find_program(const Vector<Program*>& programs, uint64_t vaddr, uint32_t* index)
+{
+	for (uint32_t i = 0; i < programs.Size(); i++)
+	{
+		const auto* p = programs.At(i);
+		if (vaddr >= p->base_vaddr && vaddr < p->base_vaddr + p->base_size_aligned)
 		{
-			value = g_invalid_memory;
-		} else if (ri.type == SymbolType::Func && jmprela_table && weak)
+			*index = i;
+			return true;
+		}
+	}
+	return false;
+}
+
+bool RelocationCache::Encode(const RelocationPatch& patch, RelocationCacheEntry* entry) const
+{
+	*entry = {};
+
+	if (!find_program(programs, patch.vaddr, &entry->target))
+	{
+		return false;
+	}
+	entry->target_offset = patch.vaddr - programs.At(entry->target)->base_vaddr;
+
+	uint64_t value = patch.value;
+
+	if (find_program(programs, value, &entry->base_index))
+	{
+		entry->base         = RelocationBase::Program;
+		entry->value_offset = value - programs.At(entry->base_index)->base_vaddr;
+		return true;
+	}
+
+	for (uint32_t i = 0; i < programs.Size(); i++)
+	{
+		const auto* p = programs.At(i);
+		if (value == reinterpret_cast<uint64_t>(p))
+		{
+			entry->base       = RelocationBase::TlsModule;
+			entry->base_index = i;
+			return true;
+		}
+		if (p->custom_call_plt_vaddr != 0 && value >= p->custom_call_plt_vaddr &&
+		    value < p->custom_call_plt_vaddr + Jit::CallPlt::GetSize(p->custom_call_plt_num))
 		{
-			if (program->custom_call_plt_vaddr != 0)
+			entry->base         = RelocationBase::CallPlt;
+			entry->base_index   = i;
+			entry->value_offset = value - p->custom_call_plt_vaddr;
+			return true;
+		}
+	}
+
+	if (value >= g_invalid_memory && value < g_invalid_memory + RELOCATION_PAGE_MASK + 1)
+	{
+		entry->base         = RelocationBase::InvalidMemory;
+		entry->value_offset = value - g_invalid_memory;
+		return true;
+	}
+
+	auto next = std::upper_bound(hle_sorted.begin(), hle_sorted.end(), value);
+	if (next == hle_sorted.begin() || value - *(next - 1) >= RELOCATION_CACHE_MAX_HLE_OFFSET)
+	{
+		return false;
+	}
+
+	entry->base         = RelocationBase::Hle;
+	entry->base_index   = hle_index[next - 1 - hle_sorted.begin()];
+	entry->value_offset = value - *(next - 1);
+	return true;
+}
+
+bool RelocationCache::Decode(const RelocationCacheEntry& entry, RelocationPatch* patch) const
+{
+	if (entry.target >= programs.Size() || entry.target_offset >= programs.At(entry.target)->base_size_aligned)
+	{
+		return false;
+	}
+
+	patch->vaddr = programs.At(entry.target)->base_vaddr + entry.target_offset;
+
+	uint64_t base = 0;
+	switch (entry.base)
+	{
+		case RelocationBase::Program:
+		case RelocationBase::CallPlt:
+		case RelocationBase::TlsModule:
+		{
+			if (entry.base_index >= programs.Size())
 			{
-				EXIT_NOT_IMPLEMENTED(index >= program->custom_call_plt_num);
-				value = reinterpret_cast<Jit::CallPlt*>(program->custom_call_plt_vaddr)->GetAddr(index);
-			} else
+				return false;
+			}
+			const auto* p = programs.At(entry.base_index);
+			base          = (entry.base == RelocationBase::Program   ? p->base_vaddr
+			                 : entry.base == RelocationBase::CallPlt ? p->custom_call_plt_vaddr
+			                                                         : reinterpret_cast<uint64_t>(p));
+			break;
+		}
+		case RelocationBase::InvalidMemory: base = g_invalid_memory; break;
+		case RelocationBase::Hle:
+			if (entry.base_index >= hle.Size())
 			{
-				value = RuntimeLinker::ReadFromElf(program, ri.vaddr) + ri.base_vaddr;
+				return false;
 			}
-		} else if ((ri.type == SymbolType::Func && !jmprela_table && weak) || (ri.type == SymbolType::NoType && weak))
+			base = hle.At(entry.base_index).vaddr;
+			break;
+		default: return false;
+	}
+
+	patch->value = base + entry.value_offset;
+	return base != 0;
+}
+
+// The key covers what the resolved values depend on: the relocation tables, symbols and exports of every loaded module, the
+// names of the HLE symbols and the way the values are computed.
+static void relocation_cache_init(RelocationCache* cache, const Vector<Program*>& programs)
+{
+	uint64_t hash = XXH64(&RELOCATION_CACHE_VERSION, sizeof(RELOCATION_CACHE_VERSION), 0);
+
+	for (auto* p: cache->programs)
+	{
+		auto     name      = p->file_name.utf8_str();
+		uint64_t size      = Core::File::Size(p->file_name);
+		bool     relocated = programs.Contains(p);
+		hash               = XXH64(name.GetDataConst(), name.Size(), hash);
+		hash               = XXH64(&size, sizeof(size), hash);
+		hash               = XXH64(&relocated, sizeof(relocated), hash);
+
+		const auto* ehdr = p->elf->GetEhdr();
+		const auto* phdr = p->elf->GetPhdr();
+		hash             = XXH64(ehdr, sizeof(Elf64_Ehdr), hash);
+		hash             = XXH64(phdr, sizeof(Elf64_Phdr) * ehdr->e_phnum, hash);
+
+		for (Elf64_Half i = 0; i < ehdr->e_phnum; i++)
 		{
-			value = RuntimeLinker::ReadFromElf(program, ri.vaddr) + ri.base_vaddr;
+			if (phdr[i].p_type == PT_OS_DYNLIBDATA)
+			{
+				hash = XXH64(p->elf->GetDynamicData<const uint8_t*>(0), phdr[i].p_filesz, hash);
+			}
 		}
+	}
 
-		if (value != 0)
-		{
-			patched = Core::VirtualMemory::PatchReplace(ri.vaddr, value);
-		} else
+	for (uint32_t i = 0; i < cache->hle.Size(); i++)
+	{
+		auto name = cache->hle.At(i).name.utf8_str();
+		hash      = XXH64(name.GetDataConst(), name.Size(), hash);
+		cache->hle_sorted.push_back(cache->hle.At(i).vaddr);
+	}
+
+	cache->hle_index.resize(cache->hle_sorted.size());
+	for (uint32_t i = 0; i < cache->hle_index.size(); i++)
+	{
+		cache->hle_index[i] = i;
+	}
+	std::sort(cache->hle_index.begin(), cache->hle_index.end(),
+	          [cache](uint32_t a, uint32_t b) { return cache->hle_sorted[a] < cache->hle_sorted[b]; });
+	std::sort(cache->hle_sorted.begin(), cache->hle_sorted.end());
+
+	cache->key       = hash;
+	cache->file_name = Libs::Graphics::GraphicsGetCacheFolder() + String::FromPrintf("relocation_cache_%016" PRIx64 ".bin", hash);
+}
+
+static bool relocation_cache_load(const RelocationCache& cache, std::vector<RelocationPatch>* patches)
+{
+	KYTY_PROFILER_FUNCTION();
+
+	if (!Core::File::IsFileExisting(cache.file_name))
+	{
+		return false;
+	}
+
+	Core::File f;
+	f.Open(cache.file_name, Core::File::Mode::Read);
+
+	uint32_t header[3] = {};
+	uint64_t key       = 0;
+	uint32_t bytes     = 0;
+
+	if (!f.IsInvalid())
+	{
+		f.Read(header, sizeof(header), &bytes);
+		f.Read(&key, sizeof(key), &bytes);
+	}
+
+	bool ok = (!f.IsInvalid() && bytes == sizeof(key) && header[0] == RELOCATION_CACHE_MAGIC && header[1] == RELOCATION_CACHE_VERSION &&
+	           key == cache.key && header[2] <= f.Remaining() / sizeof(RelocationCacheEntry));
+
+	if (ok)
+	{
+		std::vector<RelocationCacheEntry> entries(header[2]);
+		f.Read(entries.data(), static_cast<uint32_t>(entries.size() * sizeof(RelocationCacheEntry)), &bytes);
+		ok = (bytes == entries.size() * sizeof(RelocationCacheEntry));
+
+		patches->resize(entries.size());
+		for (size_t i = 0; ok && i < entries.size(); i++)
 		{
-			auto dbg_str = String::FromPrintf("[%016" PRIx64 "] <- %s%016" PRIx64 "%s, %s, %s, %s, %s", ri.vaddr,
-			                                  ri.value == 0 ? FG_BRIGHT_RED : FG_BRIGHT_GREEN, ri.value, DEFAULT, ri.name.C_Str(),
-			                                  Core::EnumName(ri.type).C_Str(), Core::EnumName(ri.bind).C_Str(), ri.dbg_name.C_Str());
+			ok = cache.Decode(entries[i], &(*patches)[i]);
+		}
+	}
+
+	f.Close();
+
+	if (!ok)
+	{
+		printf(FG_BRIGHT_RED "Invalid relocation cache: %s\n" FG_DEFAULT, cache.file_name.C_Str());
+		patches->clear();
+		return false;
+	}
+
+	printf("Relocation cache: %s, relocations = %u\n", cache.file_name.C_Str(), static_cast<uint32_t>(patches->size()));
+
+	return true;
+}
+
+static void relocation_cache_save(const RelocationCache& cache, const std::vector<RelocationPatch>& patches)
+{
+	KYTY_PROFILER_FUNCTION();
 
-			EXIT("Can't resolve: %s\n", (Log::IsColoredPrintf() ? dbg_str : Log::RemoveColors(dbg_str)).C_Str());
+	std::vector<RelocationCacheEntry> entries(patches.size());
+
+	for (size_t i = 0; i < patches.size(); i++)
+	{
+		if (!cache.Encode(patches[i], &entries[i]))
+		{
+			printf(FG_BRIGHT_RED "Relocation cache is not saved, unknown value: [%016" PRIx64 "] <- %016" PRIx64 "\n" FG_DEFAULT,
+			       patches[i].vaddr, patches[i].value);
+			return;
 		}
 	}
 
-	// KYTY_PROFILER_END_BLOCK;
+	Core::File::CreateDirectories(cache.file_name.DirectoryWithoutFilename());
 
-	if (program->dbg_print_reloc)
+	Core::File f;
+	f.Create(cache.file_name);
+	if (f.IsInvalid())
 	{
-		if (/* !dbg_str.ContainsStr(U"libc_") && */ patched && !ri.bind_self &&
-		    (ri.bind == BindType::Global || ri.bind == BindType::Weak || ri.type == SymbolType::TlsModule))
+		printf(FG_BRIGHT_RED "Can't create file: %s\n" FG_DEFAULT, cache.file_name.C_Str());
+		return;
+	}
+
+	uint32_t header[3] = {RELOCATION_CACHE_MAGIC, RELOCATION_CACHE_VERSION, static_cast<uint32_t>(entries.size())};
+
+	f.Write(header, sizeof(header));
+	f.Write(&cache.key, sizeof(cache.key));
+	f.Write(entries.data(), static_cast<uint32_t>(entries.size() * sizeof(RelocationCacheEntry)));
+
+	f.Close();
+
+	printf("Relocation cache saved: %s, relocations = %u\n", cache.file_name.C_Str(), static_cast<uint32_t>(entries.size()));
+}
+
+static void resolve_parallel(const Vector<Program*>& programs, std::vector<RelocationPatch>* patches)
+{
+	KYTY_PROFILER_FUNCTION();
+
+	std::vector<RelocationJob> jobs;
+
+	for (auto* program: programs)
+	{
+		add_relocation_jobs(&jobs, program, program->dynamic_info->rela_table, program->dynamic_info->rela_table_total_size, false);
+		add_relocation_jobs(&jobs, program, program->dynamic_info->jmprela_table, program->dynamic_info->jmprela_table_size, true);
+	}
+
+	Core::JobSystem::ParallelFor(
+	    static_cast<uint32_t>(jobs.size()),
+	    [&jobs](uint32_t job_index)
+	    {
+		    auto* job = &jobs[job_index];
+
+		    job->patches.reserve(job->num);
+
+		    for (uint32_t i = job->first; i < job->first + job->num; i++)
+		    {
+			    auto ri = GetRelocationInfo(job->records + i, job->program, false);
+			    job->patches.push_back({ri.vaddr, get_relocation_value(i, ri, job->program, job->jmprela_table)});
+		    }
+	    });
+
+	for (const auto& job: jobs)
+	{
+		patches->insert(patches->end(), job.patches.begin(), job.patches.end());
+	}
+
+	std::sort(patches->begin(), patches->end(), [](const RelocationPatch& a, const RelocationPatch& b) { return a.vaddr < b.vaddr; });
+}
+
+// Must be called with the linker mutex held, so that nothing is added to the symbol databases. The values are resolved in
+// parallel first (or loaded from the cache), then written in parallel page by page: each page is made writable once and no two
+// workers touch the same page.
+static void relocate_parallel(const Vector<Program*>& programs, const Vector<Program*>& all_programs, const SymbolDatabase* hle_symbols)
+{
+	KYTY_PROFILER_FUNCTION();
+
+	if (programs.IsEmpty())
+	{
+		return;
+	}
+
+	std::vector<RelocationPatch> patches;
+
+	if (Config::RelocationCacheEnabled() && hle_symbols != nullptr)
+	{
+		RelocationCache cache(all_programs, hle_symbols);
+		relocation_cache_init(&cache, programs);
+
+		if (!relocation_cache_load(cache, &patches))
 		{
-			auto dbg_str = String::FromPrintf("[%016" PRIx64 "] <- %s%016" PRIx64 "%s, %s, %s, %s, %s", ri.vaddr,
-			                                  ri.value == 0 ? FG_BRIGHT_RED : FG_BRIGHT_GREEN, ri.value, DEFAULT, ri.name.C_Str(),
-			                                  Core::EnumName(ri.type).C_Str(), Core::EnumName(ri.bind).C_Str(), ri.dbg_name.C_Str());
+			resolve_parallel(programs, &patches);
+			relocation_cache_save(cache, patches);
+		}
+	} else
+	{
+		resolve_parallel(programs, &patches);
+	}
 
-			printf("Relocate: %s\n", dbg_str.C_Str());
+	// The protection is changed once per run of pages, not per page
+	Core::VirtualMemory::PatchBatch batch;
+	for (const auto& p: patches)
+	{
+		batch.Add(p.vaddr, sizeof(uint64_t));
+	}
+	batch.Begin();
+
+	Core::JobSystem::ParallelFor(static_cast<uint32_t>((patches.size() + RELOCATION_JOB_SIZE - 1) / RELOCATION_JOB_SIZE),
+	                             [&patches](uint32_t job_index)
+	                             {
+		                             auto start = static_cast<size_t>(job_index) * RELOCATION_JOB_SIZE;
+		                             auto end   = std::min(start + RELOCATION_JOB_SIZE, patches.size());
+		                             for (size_t i = start; i < end; i++)
+		                             {
+			                             memcpy(reinterpret_cast<void*>(patches[i].vaddr), &patches[i].value, sizeof(uint64_t));
+		                             }
+	                             });
+
+	batch.End();
+}
+
+static bool is_guest_code(const Vector<Program*>& programs, uint64_t vaddr)
+{
+	for (const auto* p: programs)
+	{
+		if ((vaddr >= p->base_vaddr && vaddr < p->base_vaddr + p->base_size_aligned) ||
+		    (p->custom_call_plt_vaddr != 0 && vaddr >= p->custom_call_plt_vaddr &&
+		     vaddr < p->custom_call_plt_vaddr + Jit::CallPlt::GetSize(p->custom_call_plt_num)))
+		{
+			return true;
 		}
 	}
+	return vaddr >= g_invalid_memory && vaddr < g_invalid_memory + RELOCATION_PAGE_MASK + 1;
 }
 
-static void relocate_all(Elf64_Rela* records, uint64_t size, Program* program, bool jmprela_table)
+// Replace the PLT entries of imports bound to HLE functions:
+//   jmp qword ptr [rip + <GOT slot>]
+//   push <index>
+//   jmp <PLT0>
+// with:
+//   jmp <func>
+// if the function is in range. Otherwise with:
+//   movabs r11, <func>
+//   jmp r11
+// The entry is found through the initial value of its GOT slot, which points to the push.
+static void patch_hle_calls(Program* program, const Vector<Program*>& programs)
 {
 	KYTY_PROFILER_FUNCTION();
 
-	uint32_t index = 0;
-	for (auto* r = records; reinterpret_cast<uint8_t*>(r) < reinterpret_cast<uint8_t*>(records) + size; r++, index++)
+	const uint8_t plt_pattern[2] = {0xFF, 0x25};
+
+	struct PltPatch
 	{
-		relocate(index, r, program, jmprela_table);
+		uint64_t vaddr;
+		uint64_t func;
+	};
+
+	std::vector<PltPatch> patches;
+
+	auto* records = program->dynamic_info->jmprela_table;
+	auto  size    = program->dynamic_info->jmprela_table_size;
+
+	for (auto* r = records; reinterpret_cast<uint8_t*>(r) < reinterpret_cast<uint8_t*>(records) + size; r++)
+	{
+		if (r->GetType() != R_X86_64_JUMP_SLOT)
+		{
+			continue;
+		}
+
+		uint64_t slot = program->base_vaddr + r->r_offset;
+		uint64_t func = *reinterpret_cast<uint64_t*>(slot);
+		uint64_t plt  = RuntimeLinker::ReadFromElf(program, slot) + program->base_vaddr - sizeof(plt_pattern) - sizeof(uint32_t);
+
+		if (func == 0 || is_guest_code(programs, func) || (plt & 0xfu) != 0 || plt < program->base_vaddr ||
+		    plt + Jit::JmpWithIndex::GetSize() > program->base_vaddr + program->base_size)
+		{
+			continue;
+		}
+
+		auto* code = reinterpret_cast<uint8_t*>(plt);
+
+		if (memcmp(code, plt_pattern, sizeof(plt_pattern)) == 0 &&
+		    plt + 6 + static_cast<int64_t>(*reinterpret_cast<int32_t*>(code + 2)) == slot)
+		{
+			patches.push_back({plt, func});
+		}
+	}
+
+	Core::VirtualMemory::PatchBatch batch;
+	for (const auto& p: patches)
+	{
+		batch.Add(p.vaddr, Jit::JmpWithIndex::GetSize());
+	}
+	batch.Begin();
+
+	uint32_t direct = 0;
+
+	for (const auto& p: patches)
+	{
+		if (Jit::Jmp5::InRange(p.vaddr, p.func))
+		{
+			auto* code = new (reinterpret_cast<void*>(p.vaddr)) Jit::Jmp5;
+			code->SetFunc(p.func);
+			direct++;
+		} else
+		{
+			auto* code = new (reinterpret_cast<void*>(p.vaddr)) Jit::JmpR11;
+			code->SetFunc(p.func);
+		}
 	}
+
+	batch.End();
+
+	printf("Patch HLE calls: %s, %u entries, %u direct\n", program->file_name.C_Str(), static_cast<uint32_t>(patches.size()), direct);
 }
 
 static KYTY_SYSV_ABI void RelocateHandler(RelocateHandlerStack s)
@@ -502,7 +1079,11 @@ static KYTY_SYSV_ABI void RelocateHandler(RelocateHandlerStack s)
 	{
 		auto ri = GetRelocationInfo(program->dynamic_info->jmprela_table + rel_index, program);
 
-		name = String::FromPrintf(FG_BRIGHT_RED "%s" DEFAULT, ri.name.C_Str());
+		String sym_name;
+		String dbg_name;
+		get_reloc_names(ri, program, &sym_name, &dbg_name);
+
+		name = String::FromPrintf(FG_BRIGHT_RED "%s" DEFAULT, sym_name.C_Str());
 	}
 
 	// Restore return address (for stack trace)
@@ -526,6 +1107,14 @@ static KYTY_MS_ABI uint8_t* TlsMainGetAddr()
 	return RuntimeLinker::TlsGetAddr(g_tls_main_program) + g_tls_main_program->tls.image_size;
 }
 
+static void tls_direct_init()
+{
+	if (!g_tls_direct && Config::TlsDirectAccess())
+	{
+		g_tls_direct = Core::VirtualMemory::ThreadSlotAlloc(&g_tls_direct_segment, &g_tls_direct_offset);
+	}
+}
+
 static void PatchProgram(Program* program, uint64_t address, uint64_t size)
 {
 	EXIT_IF(program == nullptr);
@@ -536,6 +1125,8 @@ static void PatchProgram(Program* program, uint64_t address, uint64_t size)
 		// Replace:
 		//   mov rax, qword ptr fs:[0x00]
 		// with:
+		//   mov rax, qword ptr gs:[<thread slot>]
+		// if the host has a thread slot, see TlsInitThread(). Otherwise with:
 		//   call <handler>
 		//   mov rax,rax
 		//   nop
@@ -543,6 +1134,9 @@ static void PatchProgram(Program* program, uint64_t address, uint64_t size)
 		const uint8_t tls_pattern[9] = {0x64, 0x48, 0x8B, 0x04, 0x25, 0x00, 0x00, 0x00, 0x00};
 
 		EXIT_IF(Jit::Call9::GetSize() != sizeof(tls_pattern));
+		EXIT_IF(Jit::SegmentLoad9::GetSize() != sizeof(tls_pattern));
+
+		tls_direct_init();
 
 		auto* start_ptr = reinterpret_cast<uint8_t*>(address);
 		auto* end_ptr   = start_ptr + size - sizeof(tls_pattern);
@@ -553,11 +1147,236 @@ static void PatchProgram(Program* program, uint64_t address, uint64_t size)
 			{
 				printf("Patch tls at addr: [%016" PRIx64 "]\n", reinterpret_cast<uint64_t>(ptr));
 
-				auto* code = new (ptr) Jit::Call9;
-				code->SetFunc(program->tls.handler_vaddr);
-			}
+				if (g_tls_direct)
+				{
+					auto* code = new (ptr) Jit::SegmentLoad9;
+					code->SetAddress(g_tls_direct_segment, g_tls_direct_offset);
+				} else
+				{
+					auto* code = new (ptr) Jit::Call9;
+					code->SetFunc(program->tls.handler_vaddr);
+				}
+			}
+		}
+	}
+}
+
+struct BootSnapshotEntry
+{
+	uint64_t vaddr  = 0;
+	uint64_t size   = 0;
+	uint64_t offset = 0; // in the file
+};
+
+// Pages of the loaded segments of a batch of programs, saved after the TLS patches and before relocation. Pages are mapped
+// copy-on-write from the file on the next boot, so segments are not read from the ELF and the code is not scanned again.
+struct BootSnapshot
+{
+	uint64_t                       key = 0;
+	String                         file_name;
+	Core::File                     file;
+	std::vector<BootSnapshotEntry> entries; // sorted by vaddr
+	bool                           loaded = false;
+};
+
+static void boot_snapshot_segment_pages(const Program* program, const Elf64_Phdr& phdr, uint64_t* vaddr, uint64_t* size)
+{
+	uint64_t start = phdr.p_vaddr + program->base_vaddr;
+	uint64_t end   = start + get_aligned_size(&phdr);
+
+	*vaddr = start & ~BOOT_SNAPSHOT_PAGE_MASK;
+	*size  = ((end + BOOT_SNAPSHOT_PAGE_MASK) & ~BOOT_SNAPSHOT_PAGE_MASK) - *vaddr;
+}
+
+// The snapshot is valid while the modules, their base addresses and the TLS patches are the same
+static void boot_snapshot_init(BootSnapshot* s, const Vector<Program*>& programs)
+{
+	uint64_t hash = XXH64(&BOOT_SNAPSHOT_VERSION, sizeof(BOOT_SNAPSHOT_VERSION), 0);
+
+	for (const auto* p: programs)
+	{
+		auto     name = p->file_name.utf8_str();
+		uint64_t size = Core::File::Size(p->file_name);
+		hash          = XXH64(name.GetDataConst(), name.Size(), hash);
+		hash          = XXH64(&size, sizeof(size), hash);
+		hash          = XXH64(&p->base_vaddr, sizeof(p->base_vaddr), hash);
+		hash          = XXH64(&p->tls.handler_vaddr, sizeof(p->tls.handler_vaddr), hash);
+
+		const auto* ehdr = p->elf->GetEhdr();
+		hash             = XXH64(ehdr, sizeof(Elf64_Ehdr), hash);
+		hash             = XXH64(p->elf->GetPhdr(), sizeof(Elf64_Phdr) * ehdr->e_phnum, hash);
+
+		if (!p->elf->IsShared())
+		{
+			tls_direct_init();
+		}
+	}
+
+	hash = XXH64(&g_tls_direct, sizeof(g_tls_direct), hash);
+	hash = XXH64(&g_tls_direct_segment, sizeof(g_tls_direct_segment), hash);
+	hash = XXH64(&g_tls_direct_offset, sizeof(g_tls_direct_offset), hash);
+
+	s->key       = hash;
+	s->file_name = Libs::Graphics::GraphicsGetCacheFolder() + String::FromPrintf("boot_snapshot_%016" PRIx64 ".bin", hash);
+}
+
+static bool boot_snapshot_load(BootSnapshot* s)
+{
+	KYTY_PROFILER_FUNCTION();
+
+	if (!Core::File::IsFileExisting(s->file_name))
+	{
+		return false;
+	}
+
+	s->file.Open(s->file_name, Core::File::Mode::Read);
+
+	uint32_t header[3] = {};
+	uint64_t key       = 0;
+	uint32_t bytes     = 0;
+
+	if (!s->file.IsInvalid())
+	{
+		s->file.Read(header, sizeof(header), &bytes);
+		s->file.Read(&key, sizeof(key), &bytes);
+	}
+
+	bool ok = (!s->file.IsInvalid() && bytes == sizeof(key) && header[0] == BOOT_SNAPSHOT_MAGIC && header[1] == BOOT_SNAPSHOT_VERSION &&
+	           key == s->key && header[2] <= s->file.Remaining() / sizeof(BootSnapshotEntry));
+
+	if (ok)
+	{
+		s->entries.resize(header[2]);
+		s->file.Read(s->entries.data(), static_cast<uint32_t>(s->entries.size() * sizeof(BootSnapshotEntry)), &bytes);
+		ok = (bytes == s->entries.size() * sizeof(BootSnapshotEntry));
+
+		uint64_t file_size = s->file.Size();
+		for (size_t i = 0; ok && i < s->entries.size(); i++)
+		{
+			const auto& e = s->entries[i];
+			ok = ((e.offset & BOOT_SNAPSHOT_PAGE_MASK) == 0 && e.offset <= file_size && e.size <= file_size - e.offset &&
+			      (i == 0 || s->entries[i - 1].vaddr <= e.vaddr));
+		}
+	}
+
+	if (!ok)
+	{
+		printf(FG_BRIGHT_RED "Invalid boot snapshot: %s\n" FG_DEFAULT, s->file_name.C_Str());
+		s->file.Close();
+		s->entries.clear();
+		return false;
+	}
+
+	printf("Boot snapshot: %s, segments = %u\n", s->file_name.C_Str(), static_cast<uint32_t>(s->entries.size()));
+
+	s->loaded = true;
+	return true;
+}
+
+// Called from the load workers. False if the snapshot doesn't have the pages.
+static bool boot_snapshot_map(BootSnapshot* s, uint64_t vaddr, uint64_t size)
+{
+	auto it = std::lower_bound(s->entries.begin(), s->entries.end(), vaddr,
+	                           [](const BootSnapshotEntry& e, uint64_t v) { return e.vaddr < v; });
+
+	for (; it != s->entries.end() && it->vaddr == vaddr; ++it)
+	{
+		if (it->size == size)
+		{
+			if (!s->file.MapFixed(it->offset, size, vaddr))
+			{
+				s->file.ReadAt(reinterpret_cast<void*>(vaddr), size, it->offset);
+			}
+			return true;
+		}
+	}
+
+	return false;
+}
+
+static void boot_snapshot_save(const BootSnapshot& s, const Vector<Program*>& programs)
+{
+	KYTY_PROFILER_FUNCTION();
+
+	std::vector<BootSnapshotEntry> entries;
+
+	for (const auto* p: programs)
+	{
+		const auto* ehdr = p->elf->GetEhdr();
+		const auto* phdr = p->elf->GetPhdr();
+
+		for (Elf64_Half i = 0; i < ehdr->e_phnum; i++)
+		{
+			if (phdr[i].p_memsz != 0 && (phdr[i].p_type == PT_LOAD || phdr[i].p_type == PT_OS_RELRO))
+			{
+				BootSnapshotEntry e;
+				boot_snapshot_segment_pages(p, phdr[i], &e.vaddr, &e.size);
+				entries.push_back(e);
+			}
+		}
+	}
+
+	// PT_OS_RELRO usually covers the same pages as a PT_LOAD segment
+	auto less  = [](const BootSnapshotEntry& a, const BootSnapshotEntry& b)
+	{ return a.vaddr < b.vaddr || (a.vaddr == b.vaddr && a.size < b.size); };
+	auto equal = [](const BootSnapshotEntry& a, const BootSnapshotEntry& b) { return a.vaddr == b.vaddr && a.size == b.size; };
+	std::sort(entries.begin(), entries.end(), less);
+	entries.erase(std::unique(entries.begin(), entries.end(), equal), entries.end());
+
+	uint64_t offset = sizeof(uint32_t) * 3 + sizeof(uint64_t) + entries.size() * sizeof(BootSnapshotEntry);
+	for (auto& e: entries)
+	{
+		e.offset = (offset + BOOT_SNAPSHOT_PAGE_MASK) & ~BOOT_SNAPSHOT_PAGE_MASK;
+		offset   = e.offset + e.size;
+	}
+
+	Core::File::CreateDirectories(s.file_name.DirectoryWithoutFilename());
+
+	// Written aside and renamed, a snapshot mapped by another process must not change
+	String tmp_name = s.file_name + U".tmp";
+
+	Core::File f;
+	f.Create(tmp_name);
+	if (f.IsInvalid())
+	{
+		printf(FG_BRIGHT_RED "Can't create file: %s\n" FG_DEFAULT, tmp_name.C_Str());
+		return;
+	}
+
+	uint32_t header[3] = {BOOT_SNAPSHOT_MAGIC, BOOT_SNAPSHOT_VERSION, static_cast<uint32_t>(entries.size())};
+
+	f.Write(header, sizeof(header));
+	f.Write(&s.key, sizeof(s.key));
+	f.Write(entries.data(), static_cast<uint32_t>(entries.size() * sizeof(BootSnapshotEntry)));
+
+	uint8_t  zeros[BOOT_SNAPSHOT_PAGE_MASK + 1] = {};
+	uint64_t written                            = sizeof(header) + sizeof(s.key) + entries.size() * sizeof(BootSnapshotEntry);
+
+	for (const auto& e: entries)
+	{
+		f.Write(zeros, static_cast<uint32_t>(e.offset - written));
+
+		// Pages keep the mode of their segment, some are not readable
+		for (uint64_t page = e.vaddr; page < e.vaddr + e.size; page += BOOT_SNAPSHOT_PAGE_MASK + 1)
+		{
+			Core::VirtualMemory::Mode old_mode {};
+			Core::VirtualMemory::Protect(page, BOOT_SNAPSHOT_PAGE_MASK + 1, Core::VirtualMemory::Mode::Read, &old_mode);
+			f.Write(reinterpret_cast<const void*>(page), BOOT_SNAPSHOT_PAGE_MASK + 1);
+			Core::VirtualMemory::Protect(page, BOOT_SNAPSHOT_PAGE_MASK + 1, old_mode);
 		}
+
+		written = e.offset + e.size;
+	}
+
+	f.Close();
+
+	if (!Core::File::MoveFile(tmp_name, s.file_name))
+	{
+		printf(FG_BRIGHT_RED "Can't create file: %s\n" FG_DEFAULT, s.file_name.C_Str());
+		return;
 	}
+
+	printf("Boot snapshot saved: %s, segments = %u\n", s.file_name.C_Str(), static_cast<uint32_t>(entries.size()));
 }
 
 uint64_t RuntimeLinker::GetEntry()
@@ -600,6 +1419,8 @@ void RuntimeLinker::DbgDump(const String& folder)
 
 	Core::LockGuard lock(m_mutex);
 
+	LoadPendingPrograms();
+
 	for (const auto* p: m_programs)
 	{
 		auto folder_str = folder.FixDirectorySlash();
@@ -653,9 +1474,14 @@ void RuntimeLinker::RelocateAll()
 
 	Core::LockGuard lock(m_mutex);
 
-	for (auto* p: m_programs)
 	{
-		Relocate(p);
+		StartupPhase phase("load_programs");
+		LoadPendingPrograms();
+	}
+
+	{
+		StartupPhase phase("relocate");
+		Relocate(m_programs);
 	}
 
 	m_relocated = true;
@@ -692,6 +1518,7 @@ RuntimeLinker::~RuntimeLinker()
 	Clear();
 }
 
+// The program is loaded by LoadPendingPrograms() together with the other queued ones
 Program* RuntimeLinker::LoadProgram(const String& elf_name)
 {
 	KYTY_PROFILER_FUNCTION();
@@ -708,36 +1535,100 @@ Program* RuntimeLinker::LoadProgram(const String& elf_name)
 	program->file_name = elf_name;
 	program->unique_id = ++id_seq;
 
-	program->elf = new Elf64;
-	program->elf->Open(elf_name);
+	m_programs.Add(program);
+	m_pending.Add(program);
+
+	return program;
+}
+
+// The files are read, mapped and parsed in parallel. Memory is reserved in load order, so the layout doesn't depend on the threads.
+void RuntimeLinker::LoadPendingPrograms()
+{
+	KYTY_PROFILER_FUNCTION();
+
+	Core::LockGuard lock(m_mutex);
 
-	if (program->elf->IsValid())
+	if (m_pending.IsEmpty())
 	{
-		LoadProgramToMemory(program);
-		ParseProgramDynamicInfo(program);
-		CreateSymbolDatabase(program);
-	} else
+		return;
+	}
+
+	Core::JobSystem::ParallelFor(
+	    m_pending.Size(),
+	    [this](uint32_t index)
+	    {
+		    auto* program = m_pending.At(index);
+
+		    program->elf = new Elf64;
+		    program->elf->Open(program->file_name);
+
+		    if (!program->elf->IsValid())
+		    {
+			    EXIT("elf is not valid: %s\n", program->file_name.C_Str());
+		    }
+	    });
+
+	for (auto* program: m_pending)
+	{
+		ReserveProgramMemory(program);
+
+		const auto& elf_name = program->file_name;
+
+		if (!program->elf->IsShared())
+		{
+			program->fail_if_global_not_resolved = false;
+			Libs::LibKernel::SetProgName(elf_name.FilenameWithoutDirectory());
+		}
+
+		if (/*elf_name.FilenameWithoutExtension().EndsWith(U"libc") || elf_name.FilenameWithoutExtension().EndsWith(U"Fios2") ||
+		    elf_name.FilenameWithoutExtension().EndsWith(U"Fios2_debug") || elf_name.FilenameWithoutExtension().EndsWith(U"NpToolkit") ||
+		    elf_name.FilenameWithoutExtension().EndsWith(U"NpToolkit2") || elf_name.FilenameWithoutExtension().EndsWith(U"JobManager")*/
+		    elf_name.DirectoryWithoutFilename().EndsWith(U"_module/", String::Case::Insensitive))
+		{
+			program->fail_if_global_not_resolved = false;
+		}
+	}
+
+	BootSnapshot snapshot;
+
+	if (Config::BootSnapshotEnabled())
 	{
-		EXIT("elf is not valid: %s\n", elf_name.C_Str());
+		boot_snapshot_init(&snapshot, m_pending);
+		boot_snapshot_load(&snapshot);
 	}
 
-	m_programs.Add(program);
+	struct LoadJob
+	{
+		Program*      program;
+		BootSnapshot* snapshot;
+	};
 
-	if (!program->elf->IsShared())
+	std::vector<LoadJob> jobs;
+	for (auto* program: m_pending)
 	{
-		program->fail_if_global_not_resolved = false;
-		Libs::LibKernel::SetProgName(elf_name.FilenameWithoutDirectory());
+		jobs.push_back({program, (snapshot.loaded ? &snapshot : nullptr)});
 	}
 
-	if (/*elf_name.FilenameWithoutExtension().EndsWith(U"libc") || elf_name.FilenameWithoutExtension().EndsWith(U"Fios2") ||
-	    elf_name.FilenameWithoutExtension().EndsWith(U"Fios2_debug") || elf_name.FilenameWithoutExtension().EndsWith(U"NpToolkit") ||
-	    elf_name.FilenameWithoutExtension().EndsWith(U"NpToolkit2") || elf_name.FilenameWithoutExtension().EndsWith(U"JobManager")*/
-	    elf_name.DirectoryWithoutFilename().EndsWith(U"_module/", String::Case::Insensitive))
+	Core::JobSystem::ParallelFor(
+	    static_cast<uint32_t>(jobs.size()),
+	    [&jobs](uint32_t index)
+	    {
+		    auto* job = &jobs[index];
+
+		    LoadProgramToMemory(job->program, job->snapshot);
+		    ParseProgramDynamicInfo(job->program);
+		    CreateSymbolDatabase(job->program);
+	    });
+
+	if (snapshot.loaded)
+	{
+		snapshot.file.Close();
+	} else if (Config::BootSnapshotEnabled())
 	{
-		program->fail_if_global_not_resolved = false;
+		boot_snapshot_save(snapshot, m_pending);
 	}
 
-	return program;
+	m_pending.Clear();
 }
 
 void RuntimeLinker::SaveMainProgram(const String& elf_name)
@@ -746,6 +1637,8 @@ void RuntimeLinker::SaveMainProgram(const String& elf_name)
 
 	Core::LockGuard lock(m_mutex);
 
+	LoadPendingPrograms();
+
 	for (const auto* p: m_programs)
 	{
 		EXIT_IF(p->elf == nullptr);
@@ -764,6 +1657,8 @@ void RuntimeLinker::SaveProgram(Program* program, const String& elf_name)
 
 	Core::LockGuard lock(m_mutex);
 
+	LoadPendingPrograms();
+
 	if (auto index = m_programs.Find(program); m_programs.IndexValid(index))
 	{
 		EXIT_IF(m_programs.At(index)->elf == nullptr);
@@ -782,7 +1677,12 @@ void RuntimeLinker::Execute()
 	Libs::LibKernel::PthreadInitSelfForMainThread();
 
 	RelocateAll();
-	StartAllModules();
+	TlsInitThread();
+
+	{
+		StartupPhase phase("start_modules");
+		StartAllModules();
+	}
 
 	printf(FG_BRIGHT_YELLOW "---" DEFAULT "\n");
 	printf(FG_BRIGHT_YELLOW "--- Execute: " BOLD BG_BLUE "%s" BG_DEFAULT NO_BOLD DEFAULT "\n", "Main");
@@ -821,6 +1721,8 @@ void RuntimeLinker::Clear()
 
 	Core::LockGuard lock(m_mutex);
 
+	LoadPendingPrograms();
+
 	for (auto* p: m_programs)
 	{
 		DeleteProgram(p);
@@ -831,76 +1733,176 @@ void RuntimeLinker::Clear()
 	m_relocated = false;
 }
 
-void RuntimeLinker::Resolve(const String& name, SymbolType type, Program* program, SymbolRecord* out_info, bool* bind_self)
+// Inverse of encode_id_64()
+static bool decode_id_64(const char* str, uint32_t len, uint16_t* out_id)
 {
-	KYTY_PROFILER_FUNCTION();
+	if (len == 0 || len > 3)
+	{
+		return false;
+	}
 
-	Core::LockGuard lock(m_mutex);
+	uint32_t id = 0;
+	for (uint32_t i = 0; i < len; i++)
+	{
+		const char c = str[i];
+		uint32_t   d = 0;
+		if (c >= 'A' && c <= 'Z')
+		{
+			d = c - 'A';
+		} else if (c >= 'a' && c <= 'z')
+		{
+			d = c - 'a' + 26;
+		} else if (c >= '0' && c <= '9')
+		{
+			d = c - '0' + 52;
+		} else if (c == '+')
+		{
+			d = 62;
+		} else if (c == '-')
+		{
+			d = 63;
+		} else
+		{
+			return false;
+		}
+		id = (id << 6u) | d;
+	}
+
+	*out_id = static_cast<uint16_t>(id);
+	return true;
+}
 
-	EXIT_IF(out_info == nullptr);
+uint64_t RuntimeLinker::Resolve(const char* name, SymbolType type, Program* program, bool* bind_self, bool lock_linker)
+{
+	KYTY_PROFILER_FUNCTION();
 
-	auto ids = name.Split(U'#');
+	EXIT_IF(name == nullptr);
+	EXIT_IF(program == nullptr);
 
 	if (bind_self != nullptr)
 	{
 		*bind_self = false;
 	}
 
+	// name#library#module
+	auto ids = Core::StringView8(name).Split('#', Core::StringView8::SplitType::WithEmptyParts);
+
+	if (ids.Size() != 3)
+	{
+		return 0;
+	}
+
+	uint16_t lib_id = 0;
+	uint16_t mod_id = 0;
+
+	if (!decode_id_64(ids[1].GetDataConst(), ids[1].Size(), &lib_id) || !decode_id_64(ids[2].GetDataConst(), ids[2].Size(), &mod_id))
+	{
+		EXIT("invalid symbol: %s\n", name);
+	}
+
+	const LibraryId* l = FindLibrary(*program, lib_id);
+	const ModuleId*  m = FindModule(*program, mod_id);
+
+	EXIT_IF(l == nullptr || m == nullptr);
+
+	SymbolKey key {};
+	key.library = l->key;
+	key.module  = m->key;
+	key.type    = type;
+
+	if (!SymbolDatabase::DecodeName(name, ids[0].Size(), &key))
+	{
+		return 0;
+	}
+
+	// Relocation workers run while RelocateAll() holds the mutex, so the databases can't change under them
+	if (lock_linker)
+	{
+		m_mutex.Lock();
+	}
+
+	const SymbolRecord* rec = nullptr;
+
+	if (m_symbols != nullptr)
+	{
+		rec = m_symbols->Find(key);
+	}
+
+	if (rec == nullptr)
+	{
+		if (auto* p = FindProgram(*m, *l); p != nullptr && p->export_symbols != nullptr)
+		{
+			rec = p->export_symbols->Find(key);
+			if (bind_self != nullptr)
+			{
+				*bind_self = (p == program);
+			}
+		}
+	}
+
+	uint64_t vaddr = (rec != nullptr ? rec->vaddr : 0);
+
+	if (lock_linker)
+	{
+		m_mutex.Unlock();
+	}
+
+	return vaddr;
+}
+
+SymbolRecord RuntimeLinker::ResolveRecord(const String& name, SymbolType type, Program* program)
+{
+	Core::LockGuard lock(m_mutex);
+
+	SymbolRecord ret {};
+
+	auto ids = name.Split(U'#');
+
 	if (ids.Size() == 3)
 	{
 		const LibraryId* l = FindLibrary(*program, ids.At(1));
 		const ModuleId*  m = FindModule(*program, ids.At(2));
 
-		if (l != nullptr && m != nullptr)
-		{
-			SymbolResolve sr {};
-			sr.name                 = ids.At(0);
-			sr.library              = l->name;
-			sr.library_version      = l->version;
-			sr.module               = m->name;
-			sr.module_version_major = m->version_major;
-			sr.module_version_minor = m->version_minor;
-			sr.type                 = type;
+		EXIT_IF(l == nullptr || m == nullptr);
 
-			const SymbolRecord* rec = nullptr;
+		SymbolResolve sr {};
+		sr.name                 = ids.At(0);
+		sr.library              = l->name;
+		sr.library_version      = l->version;
+		sr.module               = m->name;
+		sr.module_version_major = m->version_major;
+		sr.module_version_minor = m->version_minor;
+		sr.type                 = type;
 
-			if (m_symbols != nullptr)
-			{
-				rec = m_symbols->Find(sr);
-			}
+		const SymbolRecord* rec = nullptr;
 
-			if (rec == nullptr)
-			{
-				if (auto* p = FindProgram(*m, *l); p != nullptr && p->export_symbols != nullptr)
-				{
-					rec = p->export_symbols->Find(sr);
-					if (bind_self != nullptr)
-					{
-						*bind_self = (p == program);
-					}
-				}
-			}
+		if (m_symbols != nullptr)
+		{
+			m_symbols->Materialize(l->key);
+			rec = m_symbols->Find(sr);
+		}
 
-			if (rec != nullptr)
-			{
-				//*out_vaddr = rec->vaddr;
-				*out_info = *rec;
-			} else
+		if (rec == nullptr)
+		{
+			if (auto* p = FindProgram(*m, *l); p != nullptr && p->export_symbols != nullptr)
 			{
-				out_info->vaddr    = 0;
-				out_info->name     = SymbolDatabase::GenerateName(sr);
-				out_info->dbg_name = U"";
+				rec = p->export_symbols->Find(sr);
 			}
+		}
+
+		if (rec != nullptr)
+		{
+			ret = *rec;
 		} else
 		{
-			EXIT("l == nullptr || m == nullptr");
+			ret.name = SymbolDatabase::GenerateName(sr);
 		}
 	} else
 	{
-		out_info->vaddr    = 0;
-		out_info->name     = name;
-		out_info->dbg_name = U"";
+		ret.name = name;
 	}
+
+	return ret;
 }
 
 uint64_t RuntimeLinker::ReadFromElf(Program* program, uint64_t vaddr)
@@ -989,10 +1991,42 @@ void RuntimeLinker::StackTrace(uint64_t frame_ptr)
 
 	for (int i = 0; i < depth; i++)
 	{
-		auto  vaddr = reinterpret_cast<uint64_t>(stack[i]);
-		auto* p     = FindProgramByAddr(vaddr);
-		std::printf("[%d] %016" PRIx64 ", %s\n", i, vaddr, (p == nullptr ? "???" : p->file_name.FilenameWithoutDirectory().C_Str()));
+		auto   vaddr = reinterpret_cast<uint64_t>(stack[i]);
+		String name;
+		std::printf("[%d] %016" PRIx64 ", %s\n", i, vaddr, (Symbolize(vaddr, &name) ? name.C_Str() : "???"));
+	}
+}
+
+bool RuntimeLinker::Symbolize(uint64_t vaddr, String* name)
+{
+	EXIT_IF(name == nullptr);
+
+	if (auto* p = FindProgramByAddr(vaddr); p != nullptr)
+	{
+		auto file_name = p->file_name.FilenameWithoutDirectory();
+		if (const auto* s = p->export_symbols != nullptr ? p->export_symbols->FindByAddr(vaddr) : nullptr; s != nullptr)
+		{
+			*name = String::FromPrintf("%s!%s+0x%" PRIx64, file_name.C_Str(), s->name.C_Str(), vaddr - s->vaddr);
+		} else
+		{
+			*name = String::FromPrintf("%s+0x%" PRIx64, file_name.C_Str(), vaddr - p->base_vaddr);
+		}
+		return true;
+	}
+
+	if (Core::DebugSymbol sym {}; Core::Debug::FindSymbol(vaddr, &sym))
+	{
+		*name = String::FromPrintf("%s+0x%" PRIx64, sym.name, static_cast<uint64_t>(vaddr - sym.addr));
+		return true;
 	}
+
+	return false;
+}
+
+void RuntimeLinker::StackWalk(uint64_t frame_ptr, uint64_t stack_addr, uint64_t stack_size, void** stack, int* depth)
+{
+	stackwalk_x86(frame_ptr, stack, depth, stack_addr, stack_size, SYSTEM_RESERVED + CODE_BASE_OFFSET,
+	              g_desired_base_addr - (SYSTEM_RESERVED + CODE_BASE_OFFSET));
 }
 
 void RuntimeLinker::StartAllModules()
@@ -1065,6 +2099,26 @@ uint8_t* RuntimeLinker::TlsGetAddr(Program* program)
 {
 	EXIT_IF(program == nullptr);
 
+	auto generation = g_tls_cache_generation.load(std::memory_order_acquire);
+
+	if (g_tls_cache_thread_generation == generation)
+	{
+		for (const auto& entry: g_tls_cache)
+		{
+			if (entry.program == program)
+			{
+				return entry.tls;
+			}
+		}
+	} else
+	{
+		for (auto& entry: g_tls_cache)
+		{
+			entry = TlsCacheEntry();
+		}
+		g_tls_cache_thread_generation = generation;
+	}
+
 	program->tls.mutex.Lock();
 
 	auto& tls = program->tls.tlss.GetOrPutDef(Core::Thread::GetThreadIdUnique(), nullptr);
@@ -1079,9 +2133,27 @@ uint8_t* RuntimeLinker::TlsGetAddr(Program* program)
 
 	program->tls.mutex.Unlock();
 
+	g_tls_cache[g_tls_cache_next].program = program;
+	g_tls_cache[g_tls_cache_next].tls     = ret;
+	g_tls_cache_next                      = (g_tls_cache_next + 1) % TLS_CACHE_SIZE;
+
 	return ret;
 }
 
+// Must be called by every thread before it runs guest code if TLS accesses are patched to direct loads
+void RuntimeLinker::TlsInitThread()
+{
+	if (g_tls_direct && g_tls_main_program != nullptr)
+	{
+		auto tls = reinterpret_cast<uint64_t>(TlsGetAddr(g_tls_main_program) + g_tls_main_program->tls.image_size);
+
+		if (!Core::VirtualMemory::ThreadSlotSet(tls))
+		{
+			EXIT("can't set thread slot\n");
+		}
+	}
+}
+
 void RuntimeLinker::DeleteTls(Program* program, int thread_id)
 {
 	EXIT_IF(program == nullptr);
@@ -1092,6 +2164,9 @@ void RuntimeLinker::DeleteTls(Program* program, int thread_id)
 	program->tls.tlss.Remove(thread_id);
 
 	program->tls.mutex.Unlock();
+
+	// The host thread may be reused for another guest thread
+	g_tls_cache_generation++;
 }
 
 static uint64_t calc_base_size(const Elf64_Ehdr* ehdr, const Elf64_Phdr* phdr)
@@ -1112,7 +2187,7 @@ static uint64_t calc_base_size(const Elf64_Ehdr* ehdr, const Elf64_Phdr* phdr)
 }
 
 // NOLINTNEXTLINE(readability-function-cognitive-complexity)
-void RuntimeLinker::LoadProgramToMemory(Program* program)
+void RuntimeLinker::ReserveProgramMemory(Program* program)
 {
 	KYTY_PROFILER_FUNCTION();
 
@@ -1180,9 +2255,47 @@ void RuntimeLinker::LoadProgramToMemory(Program* program)
 			Core::VirtualMemory::ExceptionHandler::InstallVectored(kyty_exception_handler);
 		}
 	}
+}
+
+void RuntimeLinker::LoadProgramToMemory(Program* program, BootSnapshot* snapshot)
+{
+	KYTY_PROFILER_FUNCTION();
+
+	EXIT_IF(program == nullptr || program->base_vaddr == 0 || program->elf == nullptr);
+
+	bool is_shared   = program->elf->IsShared();
+	bool is_next_gen = program->elf->IsNextGen();
+
+	const auto* ehdr = program->elf->GetEhdr();
+	const auto* phdr = program->elf->GetPhdr();
 
 	// program->elf->SetBaseVAddr(program->base_vaddr);
 
+	std::vector<Elf64_Half> loaded;
+
+	for (Elf64_Half i = 0; i < ehdr->e_phnum; i++)
+	{
+		if (phdr[i].p_memsz != 0 && (phdr[i].p_type == PT_LOAD || phdr[i].p_type == PT_OS_RELRO))
+		{
+			uint64_t pages_vaddr = 0;
+			uint64_t pages_size  = 0;
+			boot_snapshot_segment_pages(program, phdr[i], &pages_vaddr, &pages_size);
+
+			if (snapshot == nullptr || !boot_snapshot_map(snapshot, pages_vaddr, pages_size))
+			{
+				loaded.push_back(i);
+			}
+		}
+	}
+
+	// Segments don't overlap, so they are read (and inflated, if the SELF is compressed) in parallel
+	Core::JobSystem::ParallelFor(static_cast<uint32_t>(loaded.size()),
+	                             [program, phdr, &loaded](uint32_t index)
+	                             {
+		                             const auto& p = phdr[loaded[index]];
+		                             program->elf->LoadSegment(p.p_vaddr + program->base_vaddr, p.p_offset, p.p_filesz, true);
+	                             });
+
 	for (Elf64_Half i = 0; i < ehdr->e_phnum; i++)
 	{
 		if (phdr[i].p_memsz != 0 && (phdr[i].p_type == PT_LOAD || phdr[i].p_type == PT_OS_RELRO))
@@ -1197,15 +2310,13 @@ void RuntimeLinker::LoadProgramToMemory(Program* program)
 			printf("[%d] memory_size = %" PRIu64 "\n", i, segment_memory_size);
 			printf("[%d] mode        = %s\n", i, Core::EnumName(mode).C_Str());
 
-			program->elf->LoadSegment(segment_addr, phdr[i].p_offset, segment_file_size);
-
-			bool skip_protect = (phdr[i].p_type == PT_LOAD && is_next_gen && mode == Core::VirtualMemory::Mode::NoAccess);
-
-			if (Core::VirtualMemory::IsExecute(mode))
+			if (Core::VirtualMemory::IsExecute(mode) && std::find(loaded.begin(), loaded.end(), i) != loaded.end())
 			{
 				PatchProgram(program, segment_addr, segment_memory_size);
 			}
 
+			bool skip_protect = (phdr[i].p_type == PT_LOAD && is_next_gen && mode == Core::VirtualMemory::Mode::NoAccess);
+
 			if (!skip_protect)
 			{
 				Core::VirtualMemory::Protect(segment_addr, segment_memory_size, mode);
@@ -1263,6 +2374,8 @@ void RuntimeLinker::DeleteProgram(Program* p)
 	delete p->export_symbols;
 	delete p->import_symbols;
 
+	g_tls_cache_generation++;
+
 	FOR_HASH (p->tls.tlss)
 	{
 		delete p->tls.tlss.Value();
@@ -1409,11 +2522,55 @@ static void InstallRelocateHandler(Program* program)
 	}
 }
 
-void RuntimeLinker::Relocate(Program* program)
+void RuntimeLinker::Relocate(const Vector<Program*>& programs)
 {
 	KYTY_PROFILER_FUNCTION();
 
-	EXIT_IF(program == nullptr);
+	// The relocation workers only read the database
+	for (const auto* p: m_programs)
+	{
+		for (const auto& l: p->dynamic_info->import_libs)
+		{
+			if (m_symbols != nullptr)
+			{
+				m_symbols->Materialize(l.key);
+			}
+		}
+	}
+
+	Vector<Program*> parallel;
+
+	for (auto* program: programs)
+	{
+		EXIT_IF(program == nullptr);
+
+		PrepareRelocation(program);
+
+		if (program->dbg_print_reloc)
+		{
+			// Keep the log in table order
+			relocate_all(program->dynamic_info->rela_table, program->dynamic_info->rela_table_total_size, program, false);
+			relocate_all(program->dynamic_info->jmprela_table, program->dynamic_info->jmprela_table_size, program, true);
+		} else
+		{
+			parallel.Add(program);
+		}
+	}
+
+	relocate_parallel(parallel, m_programs, m_symbols);
+
+	if (Config::HleDirectCallsEnabled())
+	{
+		for (auto* program: programs)
+		{
+			patch_hle_calls(program, m_programs);
+		}
+	}
+}
+
+void RuntimeLinker::PrepareRelocation(Program* program)
+{
+	KYTY_PROFILER_FUNCTION();
 
 	if (g_invalid_memory == 0)
 	{
@@ -1431,15 +2588,11 @@ void RuntimeLinker::Relocate(Program* program)
 	EXIT_NOT_IMPLEMENTED(program->dynamic_info->pltgot_vaddr == 0);
 
 	InstallRelocateHandler(program);
-
-	relocate_all(program->dynamic_info->rela_table, program->dynamic_info->rela_table_total_size, program, false);
-	relocate_all(program->dynamic_info->jmprela_table, program->dynamic_info->jmprela_table_size, program, true);
 }
 
+// Called with the mutex held
 Program* RuntimeLinker::FindProgram(const ModuleId& m, const LibraryId& l)
 {
-	Core::LockGuard lock(m_mutex);
-
 	for (auto* p: m_programs)
 	{
 		const auto& export_libs    = p->dynamic_info->export_libs;
@@ -1472,6 +2625,38 @@ const ModuleId* RuntimeLinker::FindModule(const Program& program, const String&
 	return nullptr;
 }
 
+const ModuleId* RuntimeLinker::FindModule(const Program& program, uint16_t id)
+{
+	for (const auto* modules: {&program.dynamic_info->import_modules, &program.dynamic_info->export_modules})
+	{
+		for (const auto& m: *modules)
+		{
+			if (m.id_num == id)
+			{
+				return &m;
+			}
+		}
+	}
+
+	return nullptr;
+}
+
+const LibraryId* RuntimeLinker::FindLibrary(const Program& program, uint16_t id)
+{
+	for (const auto* libs: {&program.dynamic_info->import_libs, &program.dynamic_info->export_libs})
+	{
+		for (const auto& l: *libs)
+		{
+			if (l.id_num == id)
+			{
+				return &l;
+			}
+		}
+	}
+
+	return nullptr;
+}
+
 // void RuntimeLinker::CreateTls() {}
 
 const LibraryId* RuntimeLinker::FindLibrary(const Program& program, const String& id)
@@ -1551,6 +2736,8 @@ void RuntimeLinker::CreateSymbolDatabase(Program* program)
 
 	syms(program, program->export_symbols, true);
 	syms(program, program->import_symbols, false);
+
+	program->export_symbols->BuildAddrIndex();
 }
 
 void RuntimeLinker::SetupTlsHandler(Program* program)
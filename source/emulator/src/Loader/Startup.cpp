@@ -0,0 +1,163 @@
+#include "Emulator/Loader/Startup.h"
+
+#include "Kyty/Core/DbgAssert.h"
+#include "Kyty/Core/File.h"
+#include "Kyty/Core/MemoryAlloc.h"
+#include "Kyty/Core/String.h"
+#include "Kyty/Core/Threads.h"
+#include "Kyty/Core/Timer.h"
+#include "Kyty/Core/Vector.h"
+
+#include "Emulator/Config.h"
+
+#ifdef KYTY_EMU_ENABLED
+
+namespace Kyty::Loader {
+
+struct StartupRecord
+{
+	const char* name       = nullptr;
+	int         depth      = 0;
+	double      begin_ms   = 0.0;
+	double      end_ms     = 0.0;
+	uint64_t    bytes_read = 0;
+	uint64_t    allocs     = 0;
+	bool        done       = false;
+};
+
+struct StartupTimeline
+{
+	Core::Mutex           mutex;
+	Core::Timer           timer;
+	Vector<StartupRecord> records;
+	bool                  reported = false;
+};
+
+// Created by the first phase, kyty_init() runs it on the main thread before other threads are started
+static StartupTimeline* g_startup = nullptr;
+
+thread_local static int g_startup_depth = 0;
+
+static StartupTimeline* startup_get()
+{
+	if (g_startup == nullptr)
+	{
+		g_startup = new StartupTimeline;
+		g_startup->timer.Start();
+	}
+	return g_startup;
+}
+
+StartupPhase::StartupPhase(const char* name)
+{
+	auto* t = startup_get();
+
+	Core::LockGuard lock(t->mutex);
+
+	if (!t->reported)
+	{
+		StartupRecord r;
+		r.name       = name;
+		r.depth      = g_startup_depth++;
+		r.begin_ms   = t->timer.GetTimeMs();
+		r.bytes_read = Core::File::GetBytesRead();
+		r.allocs     = Core::mem_get_alloc_num();
+
+		m_index = static_cast<int>(t->records.Size());
+		t->records.Add(r);
+	}
+}
+
+StartupPhase::~StartupPhase()
+{
+	if (m_index < 0)
+	{
+		return;
+	}
+
+	auto* t = startup_get();
+
+	Core::LockGuard lock(t->mutex);
+
+	g_startup_depth--;
+
+	if (!t->reported)
+	{
+		auto& r      = t->records[m_index];
+		r.end_ms     = t->timer.GetTimeMs();
+		r.bytes_read = Core::File::GetBytesRead() - r.bytes_read;
+		r.allocs     = Core::mem_get_alloc_num() - r.allocs;
+		r.done       = true;
+	}
+}
+
+static void startup_save(const StartupTimeline* t, const String& file_name, double first_flip_ms, uint64_t bytes_read, uint64_t allocs)
+{
+	Core::File::CreateDirectories(file_name.DirectoryWithoutFilename());
+
+	Core::File f;
+	f.Create(file_name);
+	if (f.IsInvalid())
+	{
+		printf(FG_BRIGHT_RED "Can't create file: %s\n" FG_DEFAULT, file_name.C_Str());
+		return;
+	}
+
+	f.Printf("{\"first_flip_ms\":%.3f,\"bytes_read\":%" PRIu64 ",\"allocations\":%" PRIu64 ",\"phases\":[", first_flip_ms, bytes_read,
+	         allocs);
+
+	bool first = true;
+	for (const auto& r: t->records)
+	{
+		if (r.done)
+		{
+			f.Printf("%s\n{\"name\":\"%s\",\"depth\":%d,\"start_ms\":%.3f,\"duration_ms\":%.3f,\"bytes_read\":%" PRIu64
+			         ",\"allocations\":%" PRIu64 "}",
+			         (first ? "" : ","), r.name, r.depth, r.begin_ms, r.end_ms - r.begin_ms, r.bytes_read, r.allocs);
+			first = false;
+		}
+	}
+
+	f.Printf("\n]}\n");
+	f.Close();
+}
+
+void StartupFirstFlip()
+{
+	auto* t = startup_get();
+
+	Core::LockGuard lock(t->mutex);
+
+	if (t->reported)
+	{
+		return;
+	}
+	t->reported = true;
+
+	double   first_flip_ms = t->timer.GetTimeMs();
+	uint64_t bytes_read    = Core::File::GetBytesRead();
+	uint64_t allocs        = Core::mem_get_alloc_num();
+
+	printf("--- Startup timeline ---\n");
+	printf("%10s %10s %12s %10s  %s\n", "start, ms", "time, ms", "read, KB", "allocs", "phase");
+	for (const auto& r: t->records)
+	{
+		if (r.done)
+		{
+			printf("%10.1f %10.1f %12" PRIu64 " %10" PRIu64 "  %*s%s\n", r.begin_ms, r.end_ms - r.begin_ms, r.bytes_read >> 10u, r.allocs,
+			       r.depth * 2, "", r.name);
+		}
+	}
+	printf("%10.1f %10s %12" PRIu64 " %10" PRIu64 "  first flip\n", first_flip_ms, "", bytes_read >> 10u, allocs);
+	printf("------------------------\n");
+
+	auto file_name = Config::GetStartupReportFile();
+	if (!file_name.IsEmpty())
+	{
+		startup_save(t, file_name, first_flip_ms, bytes_read, allocs);
+	}
+}
+
+} // namespace Kyty::Loader
+
+#endif // KYTY_EMU_ENABLED
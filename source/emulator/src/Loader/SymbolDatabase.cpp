@@ -1,9 +1,16 @@
 #include "Emulator/Loader/SymbolDatabase.h"
 
 #include "Kyty/Core/File.h"
+#include "Kyty/Core/FlatHashmap.h"
 #include "Kyty/Core/MagicEnum.h"
+#include "Kyty/Core/Threads.h"
 #include "Kyty/Core/Vector.h"
 
+#include "Emulator/HleStats.h"
+
+#include <algorithm>
+#include <cstring>
+
 #ifdef KYTY_EMU_ENABLED
 
 namespace Kyty::Loader {
@@ -21,6 +28,101 @@ static String update_name(const String& str)
 	return ret.ReplaceStr(LIB_OLD_4, LIB_NEW_4).ReplaceStr(LIB_OLD_5, LIB_NEW_5);
 }
 
+constexpr uint32_t NID_LENGTH     = 11;
+constexpr uint32_t TABLE_MIN_SIZE = 256;
+
+// Library, module and non-NID symbol names are interned when programs and HLE libraries are loaded, lookups don't touch them
+struct InternedNames
+{
+	Core::Mutex                         mutex;
+	Core::FlatHashmap<String, uint32_t> libraries;
+	Core::FlatHashmap<String, uint32_t> modules;
+	Core::FlatHashmap<String, uint32_t> names;
+};
+
+static InternedNames& get_interned_names()
+{
+	static InternedNames names;
+	return names;
+}
+
+static uint32_t intern(Core::FlatHashmap<String, uint32_t>* map, const String& str)
+{
+	auto id = map->Get(str, 0);
+	if (id == 0)
+	{
+		id = map->Size() + 1;
+		map->Put(str, id);
+	}
+	return id;
+}
+
+static int base64_digit(char c)
+{
+	if (c >= 'A' && c <= 'Z')
+	{
+		return c - 'A';
+	}
+	if (c >= 'a' && c <= 'z')
+	{
+		return c - 'a' + 26;
+	}
+	if (c >= '0' && c <= '9')
+	{
+		return c - '0' + 52;
+	}
+	if (c == '+')
+	{
+		return 62;
+	}
+	if (c == '-')
+	{
+		return 63;
+	}
+	return -1;
+}
+
+// A NID is 8 bytes in 11 base64 characters, the last one holds 4 bits
+static bool decode_nid(const char* str, uint32_t len, uint64_t* nid)
+{
+	if (len != NID_LENGTH)
+	{
+		return false;
+	}
+
+	uint64_t value = 0;
+	for (uint32_t i = 0; i < NID_LENGTH - 1; i++)
+	{
+		int d = base64_digit(str[i]);
+		if (d < 0)
+		{
+			return false;
+		}
+		value = (value << 6u) | static_cast<uint64_t>(d);
+	}
+
+	int d = base64_digit(str[NID_LENGTH - 1]);
+	if (d < 0 || (static_cast<uint32_t>(d) & 0x3u) != 0)
+	{
+		return false;
+	}
+
+	*nid = (value << 4u) | (static_cast<uint64_t>(d) >> 2u);
+	return true;
+}
+
+static uint64_t key_hash(const SymbolKey& key)
+{
+	uint64_t h = key.nid ^ (((static_cast<uint64_t>(key.library) << 32u) | key.module) * 0x9e3779b97f4a7c15u) ^
+	             ((static_cast<uint64_t>(key.type) << 1u) | (key.interned_name ? 1u : 0u));
+	h ^= h >> 30u;
+	h *= 0xbf58476d1ce4e5b9u;
+	h ^= h >> 27u;
+	h *= 0x94d049bb133111ebu;
+	h ^= h >> 31u;
+	return h;
+}
+
 String SymbolDatabase::GenerateName(const SymbolResolve& s)
 {
 	auto library = update_name(s.library);
@@ -29,13 +131,111 @@ String SymbolDatabase::GenerateName(const SymbolResolve& s)
 	                          s.module_version_major, s.module_version_minor, Core::EnumName(s.type).C_Str());
 }
 
+SymbolKey SymbolDatabase::GenerateKey(const SymbolResolve& s)
+{
+	SymbolKey key {};
+	key.library = LibraryKey(s.library, s.library_version);
+	key.module  = ModuleKey(s.module, s.module_version_major, s.module_version_minor);
+	key.type    = s.type;
+
+	auto name = s.name.utf8_str();
+	if (!decode_nid(name.GetData(), static_cast<uint32_t>(strlen(name.GetData())), &key.nid))
+	{
+		auto& in = get_interned_names();
+
+		Core::LockGuard lock(in.mutex);
+
+		key.nid           = intern(&in.names, s.name);
+		key.interned_name = true;
+	}
+
+	return key;
+}
+
+uint32_t SymbolDatabase::LibraryKey(const String& name, int version)
+{
+	auto& in = get_interned_names();
+
+	Core::LockGuard lock(in.mutex);
+
+	return intern(&in.libraries, String::FromPrintf("%s_v%d", update_name(name).C_Str(), version));
+}
+
+uint32_t SymbolDatabase::ModuleKey(const String& name, int version_major, int version_minor)
+{
+	auto& in = get_interned_names();
+
+	Core::LockGuard lock(in.mutex);
+
+	return intern(&in.modules, String::FromPrintf("%s_v%d.%d", update_name(name).C_Str(), version_major, version_minor));
+}
+
+bool SymbolDatabase::DecodeName(const char* str, uint32_t len, SymbolKey* key)
+{
+	EXIT_IF(key == nullptr);
+
+	if (decode_nid(str, len, &key->nid))
+	{
+		key->interned_name = false;
+		return true;
+	}
+
+	auto& in = get_interned_names();
+
+	Core::LockGuard lock(in.mutex);
+
+	key->nid           = in.names.Get(String::FromUtf8(str, len), 0);
+	key->interned_name = true;
+
+	return key->nid != 0;
+}
+
+void SymbolDatabase::Grow()
+{
+	auto old_table = std::move(m_table);
+
+	m_table.assign(old_table.empty() ? TABLE_MIN_SIZE : old_table.size() * 2, 0);
+	m_used = 0;
+
+	for (auto slot: old_table)
+	{
+		if (slot != 0)
+		{
+			Put(m_keys.At(slot - 1), slot - 1);
+		}
+	}
+}
+
+void SymbolDatabase::Put(const SymbolKey& key, uint32_t index)
+{
+	// Keep the load factor at most 1/2
+	if ((m_used + 1) * 2 > m_table.size())
+	{
+		Grow();
+	}
+
+	auto mask = static_cast<uint32_t>(m_table.size() - 1);
+
+	for (auto i = static_cast<uint32_t>(key_hash(key)) & mask;; i = (i + 1) & mask)
+	{
+		auto& slot = m_table[i];
+		if (slot == 0)
+		{
+			slot = index + 1;
+			m_used++;
+			return;
+		}
+		if (m_keys.At(slot - 1) == key)
+		{
+			slot = index + 1;
+			return;
+		}
+	}
+}
+
 void SymbolDatabase::Add(const SymbolResolve& s, uint64_t vaddr)
 {
-	SymbolRecord r {};
-	r.name  = GenerateName(s);
-	r.vaddr = vaddr;
-	m_map.Put(r.name, m_symbols.Size());
-	m_symbols.Add(r);
+	Add(s, vaddr, String());
 }
 
 void SymbolDatabase::Add(const SymbolResolve& s, uint64_t vaddr, const String& dbg_name)
@@ -44,8 +244,48 @@ void SymbolDatabase::Add(const SymbolResolve& s, uint64_t vaddr, const String& d
 	r.name     = GenerateName(s);
 	r.vaddr    = vaddr;
 	r.dbg_name = dbg_name;
-	m_map.Put(r.name, m_symbols.Size());
+
+	uint32_t index = m_symbols.Size();
 	m_symbols.Add(r);
+	m_keys.Add(GenerateKey(s));
+	Put(m_keys.At(index), index);
+}
+
+void SymbolDatabase::AddLazy(const SymbolEntry& e)
+{
+	if (e.library != m_lazy_library || e.library_version != m_lazy_library_version)
+	{
+		m_lazy_library         = e.library;
+		m_lazy_library_version = e.library_version;
+		m_lazy_library_key     = LibraryKey(String::FromUtf8(e.library), e.library_version);
+	}
+
+	m_lazy.push_back({m_lazy_library_key, e});
+}
+
+void SymbolDatabase::Materialize(uint32_t library)
+{
+	auto it = std::stable_partition(m_lazy.begin(), m_lazy.end(), [library](const LazySymbol& s) { return s.library != library; });
+
+	for (auto i = it; i != m_lazy.end(); ++i)
+	{
+		const auto& e = i->entry;
+
+		SymbolResolve sr {};
+		sr.name                 = String::FromUtf8(e.name);
+		sr.library              = String::FromUtf8(e.library);
+		sr.library_version      = e.library_version;
+		sr.module               = String::FromUtf8(e.module);
+		sr.module_version_major = e.module_version_major;
+		sr.module_version_minor = e.module_version_minor;
+		sr.type                 = e.type;
+
+		uint64_t vaddr = (e.type == SymbolType::Func ? Profiler::HleStatsWrap(e.vaddr, e.library, e.name, e.dbg_name) : e.vaddr);
+
+		Add(sr, vaddr, String(e.dbg_name));
+	}
+
+	m_lazy.erase(it, m_lazy.end());
 }
 
 void SymbolDatabase::DbgDump(const String& folder, const String& file_name)
@@ -65,14 +305,56 @@ void SymbolDatabase::DbgDump(const String& folder, const String& file_name)
 	f.Close();
 }
 
+void SymbolDatabase::BuildAddrIndex()
+{
+	m_by_addr.clear();
+	for (uint32_t i = 0; i < m_symbols.Size(); i++)
+	{
+		if (m_symbols.At(i).vaddr != 0)
+		{
+			m_by_addr.push_back(i);
+		}
+	}
+	std::sort(m_by_addr.begin(), m_by_addr.end(), [this](uint32_t a, uint32_t b) { return m_symbols.At(a).vaddr < m_symbols.At(b).vaddr; });
+}
+
+const SymbolRecord* SymbolDatabase::FindByAddr(uint64_t vaddr) const
+{
+	auto it = std::upper_bound(m_by_addr.begin(), m_by_addr.end(), vaddr,
+	                           [this](uint64_t v, uint32_t index) { return v < m_symbols.At(index).vaddr; });
+	if (it == m_by_addr.begin())
+	{
+		return nullptr;
+	}
+	return &m_symbols.At(*(it - 1));
+}
+
 const SymbolRecord* SymbolDatabase::Find(const SymbolResolve& s) const
 {
-	auto index = m_map.Get(GenerateName(s), decltype(m_symbols)::INVALID_INDEX);
-	if (!m_symbols.IndexValid(index))
+	return Find(GenerateKey(s));
+}
+
+const SymbolRecord* SymbolDatabase::Find(const SymbolKey& key) const
+{
+	if (m_table.empty())
 	{
 		return nullptr;
 	}
-	return &m_symbols.At(index);
+
+	auto mask = static_cast<uint32_t>(m_table.size() - 1);
+
+	for (auto i = static_cast<uint32_t>(key_hash(key)) & mask;; i = (i + 1) & mask)
+	{
+		auto slot = m_table[i];
+		if (slot == 0)
+		{
+			return nullptr;
+		}
+		if (m_keys.At(slot - 1) == key)
+		{
+			return &m_symbols.At(slot - 1);
+		}
+	}
 }
 
 } // namespace Kyty::Loader
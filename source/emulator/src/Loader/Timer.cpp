@@ -2,18 +2,161 @@
 
 #include "Kyty/Core/DateTime.h"
 #include "Kyty/Core/Subsystems.h"
+#include "Kyty/Core/Threads.h"
 
 #include "Emulator/Common.h"
+#include "Emulator/Config.h"
 #include "Emulator/Loader/Timer.h"
 
+#include <algorithm>
+#include <atomic>
+
+#if KYTY_COMPILER == KYTY_COMPILER_MSVC
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#include <x86intrin.h>
+#endif
+
 #ifdef KYTY_EMU_ENABLED
 
 namespace Kyty::Loader::Timer {
 
-static Core::Timer g_timer;
+// Time to measure the TSC frequency against the performance counter
+constexpr uint32_t TSC_CALIBRATION_MS = 20;
+
+// Guest time of one frame of the virtual clock, 60 Hz
+constexpr uint64_t VIRTUAL_FRAME_NS = 16666667;
+
+// With an invariant TSC the counters are read with rdtsc, and converted to time with 32.32 fixed-point multipliers computed at
+// startup. Otherwise they come from the performance counter.
+struct TimerState
+{
+	bool     tsc             = false;
+	uint64_t frequency       = 0;
+	uint64_t start           = 0;
+	uint64_t us_mul          = 0;
+	uint64_t ns_mul          = 0;
+	uint64_t monotonic_start = 0; // nanoseconds
+	uint64_t tsc_start       = 0; // the first value of GetTsc()
+	uint64_t pc_start        = 0;
+	bool     virtual_clock   = false;
+};
+
+// Benchmark mode: the guest time runs at the host rate inside a frame, and a flip moves it to the start of the next frame period. A
+// frame which takes longer than the period keeps its host time. Written by FrameDone() only, read with a sequence lock.
+struct VirtualClock
+{
+	std::atomic_uint64_t seq         = 0;
+	std::atomic_uint64_t base        = 0; // guest nanoseconds at the start of the frame
+	std::atomic_uint64_t frame_start = 0; // host nanoseconds
+};
+
+static Core::Timer  g_timer;
+static TimerState   g_state;
+static VirtualClock g_virtual;
+
+static bool tsc_is_invariant()
+{
+	uint32_t regs[4] = {};
+#if KYTY_COMPILER == KYTY_COMPILER_MSVC
+	int info[4] = {};
+	__cpuid(info, 0x80000000);
+	if (static_cast<uint32_t>(info[0]) < 0x80000007)
+	{
+		return false;
+	}
+	__cpuid(info, 0x80000007);
+	regs[3] = static_cast<uint32_t>(info[3]);
+#else
+	if (__get_cpuid(0x80000007, &regs[0], &regs[1], &regs[2], &regs[3]) == 0)
+	{
+		return false;
+	}
+#endif
+	return (regs[3] & (1u << 8u)) != 0;
+}
+
+static uint64_t tsc_calibrate()
+{
+	uint64_t pc_freq  = Core::Timer::QueryPerformanceFrequency();
+	uint64_t pc_start = Core::Timer::QueryPerformanceCounter();
+	uint64_t tsc      = __rdtsc();
+
+	Core::Thread::Sleep(TSC_CALIBRATION_MS);
+
+	uint64_t pc_ticks  = Core::Timer::QueryPerformanceCounter() - pc_start;
+	uint64_t tsc_ticks = __rdtsc() - tsc;
+
+	auto freq = static_cast<uint64_t>(static_cast<double>(tsc_ticks) * static_cast<double>(pc_freq) / static_cast<double>(pc_ticks));
+
+	// Measurement noise is below 1 kHz
+	return (freq + 500) / 1000 * 1000;
+}
+
+static uint64_t fixed_mul(uint64_t ticks, uint64_t mul)
+{
+	return (ticks >> 32u) * mul + (((ticks & 0xffffffffu) * mul) >> 32u);
+}
+
+static uint64_t pc_to_ns(uint64_t counter, uint64_t freq)
+{
+	return (counter / freq) * 1000000000 + (counter % freq) * 1000000000 / freq;
+}
+
+static uint64_t ns_to_pc(uint64_t ns, uint64_t freq)
+{
+	return (ns / 1000000000) * freq + (ns % 1000000000) * freq / 1000000000;
+}
+
+// Host nanoseconds since Start()
+static uint64_t host_ns()
+{
+	if (g_state.tsc)
+	{
+		return fixed_mul(__rdtsc() - g_state.start, g_state.ns_mul);
+	}
+	return pc_to_ns(Core::Timer::QueryPerformanceCounter() - g_state.pc_start, Core::Timer::QueryPerformanceFrequency());
+}
+
+// Guest nanoseconds since Start()
+static uint64_t virtual_ns()
+{
+	for (;;)
+	{
+		uint64_t seq = g_virtual.seq.load();
+		if ((seq & 1u) == 0)
+		{
+			uint64_t base        = g_virtual.base.load();
+			uint64_t frame_start = g_virtual.frame_start.load();
+			if (g_virtual.seq.load() == seq)
+			{
+				return base + (host_ns() - frame_start);
+			}
+		}
+		_mm_pause();
+	}
+}
 
 KYTY_SUBSYSTEM_INIT(Timer)
 {
+	if (Config::RawTscEnabled() && tsc_is_invariant())
+	{
+		// The fixed-point multipliers need at least 1 GHz
+		g_state.frequency = tsc_calibrate();
+		g_state.tsc       = (g_state.frequency >= 1000000000);
+	}
+
+	if (g_state.tsc)
+	{
+		g_state.us_mul = (static_cast<uint64_t>(1000000) << 32u) / g_state.frequency;
+		g_state.ns_mul = (static_cast<uint64_t>(1000000000) << 32u) / g_state.frequency;
+
+		printf("TSC frequency: %" PRIu64 "\n", g_state.frequency);
+	}
+
+	g_state.virtual_clock = Config::BenchmarkEnabled();
+
 	Start();
 }
 
@@ -24,13 +167,76 @@ KYTY_SUBSYSTEM_DESTROY(Timer) {}
 void Start()
 {
 	g_timer.Start();
+
+	g_state.pc_start        = Core::Timer::QueryPerformanceCounter();
+	g_state.monotonic_start = pc_to_ns(g_state.pc_start, Core::Timer::QueryPerformanceFrequency());
+
+	if (g_state.tsc)
+	{
+		g_state.start = __rdtsc();
+	}
+
+	g_state.tsc_start = (g_state.tsc ? g_state.start : g_state.pc_start);
+
+	g_virtual.base        = 0;
+	g_virtual.frame_start = 0;
+}
+
+void FrameDone()
+{
+	if (!g_state.virtual_clock)
+	{
+		return;
+	}
+
+	uint64_t now  = host_ns();
+	uint64_t base = g_virtual.base.load() + std::max(VIRTUAL_FRAME_NS, now - g_virtual.frame_start.load());
+
+	g_virtual.seq++;
+	g_virtual.base        = base;
+	g_virtual.frame_start = now;
+	g_virtual.seq++;
 }
 
 double GetTimeMs()
 {
+	if (g_state.virtual_clock)
+	{
+		return static_cast<double>(virtual_ns()) / 1000000.0;
+	}
+	if (g_state.tsc)
+	{
+		return 1000.0 * static_cast<double>(__rdtsc() - g_state.start) / static_cast<double>(g_state.frequency);
+	}
 	return g_timer.GetTimeMs();
 }
 
+uint64_t GetTimeUs()
+{
+	if (g_state.virtual_clock)
+	{
+		return virtual_ns() / 1000;
+	}
+	if (g_state.tsc)
+	{
+		return fixed_mul(__rdtsc() - g_state.start, g_state.us_mul);
+	}
+	return static_cast<uint64_t>(g_timer.GetTimeMs() * 1000.0);
+}
+
+uint64_t GetMonotonicNs()
+{
+	if (g_state.virtual_clock)
+	{
+		return g_state.monotonic_start + virtual_ns();
+	}
+	if (g_state.tsc)
+	{
+		return g_state.monotonic_start + fixed_mul(__rdtsc() - g_state.start, g_state.ns_mul);
+	}
+	return pc_to_ns(Core::Timer::QueryPerformanceCounter(), Core::Timer::QueryPerformanceFrequency());
+}
+
 Core::Time GetTime()
 {
 	return Core::Time(static_cast<int>(GetTimeMs()));
@@ -38,14 +244,48 @@ Core::Time GetTime()
 
 uint64_t GetCounter()
 {
+	if (g_state.virtual_clock)
+	{
+		return ns_to_pc(virtual_ns(), GetFrequency());
+	}
+	if (g_state.tsc)
+	{
+		return __rdtsc() - g_state.start;
+	}
 	return g_timer.GetTicks();
 }
 
 uint64_t GetFrequency()
 {
+	if (g_state.tsc)
+	{
+		return g_state.frequency;
+	}
 	return g_timer.GetFrequency();
 }
 
+uint64_t GetTsc()
+{
+	if (g_state.virtual_clock)
+	{
+		return g_state.tsc_start + ns_to_pc(virtual_ns(), GetTscFrequency());
+	}
+	if (g_state.tsc)
+	{
+		return __rdtsc();
+	}
+	return Core::Timer::QueryPerformanceCounter();
+}
+
+uint64_t GetTscFrequency()
+{
+	if (g_state.tsc)
+	{
+		return g_state.frequency;
+	}
+	return Core::Timer::QueryPerformanceFrequency();
+}
+
 } // namespace Kyty::Loader::Timer
 
 #endif // KYTY_EMU_ENABLED
@@ -9,6 +9,12 @@
 
 #include "Emulator/Common.h"
 #include "Emulator/Config.h"
+#include "Emulator/Libs/Trace.h"
+
+#include <atomic>
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
 
 #if KYTY_PLATFORM == KYTY_PLATFORM_WINDOWS
 #include <windows.h> // IWYU pragma: keep
@@ -32,6 +38,126 @@ static Core::File*              g_file               = nullptr;
 static bool                     g_colored_printf     = false;
 static thread_local Core::File* g_thread_local_file  = nullptr;
 static Vector<Core::File*>*     g_thread_local_files = nullptr;
+static Core::File*              g_trace_file         = nullptr;
+
+constexpr uint32_t LOG_RING_SIZE   = 256 * 1024;
+constexpr uint32_t LOG_FORMAT_SIZE = 4096;
+constexpr uint32_t LOG_TO_CONSOLE  = 1;
+constexpr uint32_t LOG_TO_FILE     = 2;
+constexpr uint32_t LOG_TO_TRACE    = 4;
+
+// Records of one thread. The thread pushes, the writer thread pops.
+class LogRing
+{
+public:
+	LogRing(): m_data(new char[LOG_RING_SIZE]) {}
+	virtual ~LogRing() { delete[] m_data; }
+
+	KYTY_CLASS_NO_COPY(LogRing);
+
+	struct Header
+	{
+		uint32_t size;
+		uint32_t flags;
+	};
+
+	static bool Fits(uint32_t size) { return sizeof(Header) + size <= LOG_RING_SIZE / 2; }
+
+	bool Push(const char* str, uint32_t size, uint32_t flags)
+	{
+		uint64_t head = m_head.load(std::memory_order_relaxed);
+		uint64_t need = sizeof(Header) + size;
+
+		if (need > LOG_RING_SIZE - (head - m_tail.load(std::memory_order_acquire)))
+		{
+			return false;
+		}
+
+		Header h {size, flags};
+		Copy(head, &h, sizeof(Header));
+		Copy(head + sizeof(Header), str, size);
+
+		m_head.store(head + need, std::memory_order_release);
+		return true;
+	}
+
+	// Calls func(str, size, flags) for every record, returns the number of records
+	template <class F>
+	uint64_t Pop(char* buf, F&& func)
+	{
+		uint64_t tail = m_tail.load(std::memory_order_relaxed);
+		uint64_t head = m_head.load(std::memory_order_acquire);
+		uint64_t num  = 0;
+
+		while (tail != head)
+		{
+			Header h {};
+			Read(tail, &h, sizeof(Header));
+			Read(tail + sizeof(Header), buf, h.size);
+			func(buf, h.size, h.flags);
+
+			tail += sizeof(Header) + h.size;
+			num++;
+		}
+
+		m_tail.store(tail, std::memory_order_release);
+		return num;
+	}
+
+	void Close() { m_closed = true; }
+
+	[[nodiscard]] bool IsClosed() const { return m_closed; }
+
+private:
+	void Copy(uint64_t pos, const void* src, uint32_t size)
+	{
+		auto     offset = static_cast<uint32_t>(pos % LOG_RING_SIZE);
+		uint32_t first  = std::min(size, LOG_RING_SIZE - offset);
+		memcpy(m_data + offset, src, first);
+		memcpy(m_data, static_cast<const char*>(src) + first, size - first);
+	}
+
+	void Read(uint64_t pos, void* dst, uint32_t size) const
+	{
+		auto     offset = static_cast<uint32_t>(pos % LOG_RING_SIZE);
+		uint32_t first  = std::min(size, LOG_RING_SIZE - offset);
+		memcpy(dst, m_data + offset, first);
+		memcpy(static_cast<char*>(dst) + first, m_data, size - first);
+	}
+
+	char*                m_data;
+	std::atomic_uint64_t m_head   = 0;
+	std::atomic_uint64_t m_tail   = 0;
+	std::atomic_bool     m_closed = false;
+};
+
+// The ring is closed when the thread exits and deleted by the writer once it is empty
+struct LogThreadRing
+{
+	LogThreadRing() = default;
+	~LogThreadRing()
+	{
+		if (ring != nullptr)
+		{
+			ring->Close();
+		}
+	}
+
+	KYTY_CLASS_NO_COPY(LogThreadRing);
+
+	LogRing* ring = nullptr;
+};
+
+static bool                       g_async_enabled  = false;
+static Overflow                   g_async_overflow = Overflow::Block;
+static Core::Mutex*               g_async_mutex    = nullptr;
+static Core::CondVar*             g_async_cond_var = nullptr;
+static Vector<LogRing*>*          g_async_rings    = nullptr;
+static std::atomic_uint64_t       g_async_queued   = 0;
+static std::atomic_uint64_t       g_async_written  = 0;
+static std::atomic_uint64_t       g_async_dropped  = 0;
+static std::atomic_bool           g_async_sleeping = false;
+static thread_local LogThreadRing g_async_thread_ring;
 
 static bool EnableVTMode()
 {
@@ -85,10 +211,279 @@ String RemoveColors(const String& str)
 	return ret;
 }
 
+// Appends str without the escape sequences
+static void remove_colors(const char* str, uint32_t size, Vector<char>* out)
+{
+	for (uint32_t i = 0; i < size;)
+	{
+		const auto* esc = static_cast<const char*>(memchr(str + i, '\x1b', size - i));
+		if (esc == nullptr)
+		{
+			out->Add(str + i, size - i);
+			break;
+		}
+		auto index = static_cast<uint32_t>(esc - str);
+		out->Add(str + i, index - i);
+		const auto* m = static_cast<const char*>(memchr(esc, 'm', size - index));
+		if (m == nullptr)
+		{
+			break;
+		}
+		i = static_cast<uint32_t>(m - str) + 1;
+	}
+}
+
+struct LogBatch
+{
+	Vector<char> console;
+	Vector<char> file;
+	Vector<char> trace;
+
+	void Clear()
+	{
+		console.Clear();
+		file.Clear();
+		trace.Clear();
+	}
+};
+
+static void append_text(const char* str, uint32_t size, Vector<char>* out)
+{
+	if (g_colored_printf)
+	{
+		out->Add(str, size);
+	} else
+	{
+		remove_colors(str, size, out);
+	}
+}
+
+static void append_record(const char* str, uint32_t size, uint32_t flags, LogBatch* batch)
+{
+	if ((flags & LOG_TO_CONSOLE) != 0)
+	{
+		append_text(str, size, &batch->console);
+	}
+	if ((flags & LOG_TO_FILE) != 0)
+	{
+		append_text(str, size, &batch->file);
+	}
+	if ((flags & LOG_TO_TRACE) != 0)
+	{
+		batch->trace.Add(str, size);
+	}
+}
+
+// g_mutex must be locked
+static void write_output(const LogBatch& batch)
+{
+	if (!batch.console.IsEmpty())
+	{
+		fwrite(batch.console.GetDataConst(), 1, batch.console.Size(), stdout);
+	}
+	if (!batch.file.IsEmpty() && g_file != nullptr)
+	{
+		if (g_file->GetEncoding() == Core::File::Encoding::Utf8)
+		{
+			g_file->Write(batch.file.GetDataConst(), batch.file.Size());
+		} else
+		{
+			g_file->Write(String::FromUtf8(batch.file.GetDataConst(), batch.file.Size()));
+		}
+	}
+	if (!batch.trace.IsEmpty() && g_trace_file != nullptr)
+	{
+		g_trace_file->Write(batch.trace.GetDataConst(), batch.trace.Size());
+	}
+}
+
+static void async_wake()
+{
+	Core::LockGuard lock(*g_async_mutex);
+	g_async_cond_var->Signal();
+}
+
+static void async_writer(void* /*arg*/)
+{
+	static char buf[LOG_RING_SIZE];
+
+	LogBatch batch;
+
+	for (;;)
+	{
+		uint64_t num     = 0;
+		bool     dropped = false;
+
+		batch.Clear();
+
+		if (uint64_t dropped_num = g_async_dropped.exchange(0); dropped_num != 0)
+		{
+			auto msg = String::FromPrintf("[log] %" PRIu64 " records dropped\n", dropped_num).utf8_str();
+			batch.console.Add(msg.GetDataConst(), msg.Size() - 1);
+			batch.file.Add(msg.GetDataConst(), msg.Size() - 1);
+			dropped = true;
+		}
+
+		{
+			Core::LockGuard lock(*g_async_mutex);
+
+			for (uint32_t i = 0; i < g_async_rings->Size();)
+			{
+				auto* ring   = g_async_rings->At(i);
+				bool  closed = ring->IsClosed();
+
+				num += ring->Pop(buf,
+				                 [&batch](const char* str, uint32_t size, uint32_t flags) { append_record(str, size, flags, &batch); });
+
+				if (closed)
+				{
+					g_async_rings->RemoveAt(i);
+					delete ring;
+				} else
+				{
+					i++;
+				}
+			}
+		}
+
+		if (num != 0 || dropped)
+		{
+			g_mutex->Lock();
+			write_output(batch);
+			g_mutex->Unlock();
+
+			g_async_written += num;
+			continue;
+		}
+
+		// A thread increments g_async_queued before it checks g_async_sleeping, so either the record is seen here or the thread
+		// wakes the writer up
+		Core::LockGuard lock(*g_async_mutex);
+		g_async_sleeping = true;
+		if (g_async_queued.load() == g_async_written.load())
+		{
+			g_async_cond_var->WaitFor(g_async_mutex, 100000);
+		}
+		g_async_sleeping = false;
+	}
+}
+
+static void async_push(const char* str, uint32_t size, uint32_t flags)
+{
+	if (!LogRing::Fits(size))
+	{
+		// Too long for the ring, written at once after the queued records
+		Flush();
+
+		LogBatch batch;
+		append_record(str, size, flags, &batch);
+		g_mutex->Lock();
+		write_output(batch);
+		g_mutex->Unlock();
+		return;
+	}
+
+	auto* ring = g_async_thread_ring.ring;
+	if (ring == nullptr)
+	{
+		ring                     = new LogRing;
+		g_async_thread_ring.ring = ring;
+
+		Core::LockGuard lock(*g_async_mutex);
+		g_async_rings->Add(ring);
+	}
+
+	while (!ring->Push(str, size, flags))
+	{
+		if (g_async_overflow == Overflow::Drop)
+		{
+			g_async_dropped++;
+			return;
+		}
+		async_wake();
+		Core::Thread::SleepMicro(100);
+	}
+
+	g_async_queued++;
+
+	if (g_async_sleeping.load())
+	{
+		async_wake();
+	}
+}
+
+static void async_vprintf(uint32_t flags, const char* format, va_list args)
+{
+	char    buf[LOG_FORMAT_SIZE];
+	va_list copy {};
+	va_copy(copy, args);
+
+	int size = vsnprintf(buf, LOG_FORMAT_SIZE, format, args);
+
+	if (size >= static_cast<int>(LOG_FORMAT_SIZE))
+	{
+		auto* big = new char[size + 1];
+		vsnprintf(big, size + 1, format, copy);
+		async_push(big, size, flags);
+		delete[] big;
+	} else if (size > 0)
+	{
+		async_push(buf, size, flags);
+	}
+
+	va_end(copy);
+}
+
+void StartAsync(Overflow overflow)
+{
+	EXIT_IF(!g_log_initialized);
+	EXIT_IF(!Core::Thread::IsMainThread());
+	EXIT_IF(g_async_enabled);
+
+	g_async_overflow = overflow;
+	g_async_mutex    = new Core::Mutex;
+	g_async_cond_var = new Core::CondVar;
+	g_async_rings    = new Vector<LogRing*>;
+
+	Core::Thread t(async_writer, nullptr);
+	t.Detach();
+
+	g_async_enabled = true;
+}
+
+void Flush()
+{
+	EXIT_IF(!g_log_initialized);
+
+	if (g_async_enabled)
+	{
+		uint64_t queued = g_async_queued.load();
+		while (g_async_written.load() < queued)
+		{
+			async_wake();
+			Core::Thread::SleepMicro(100);
+		}
+	}
+
+	g_mutex->Lock();
+	fflush(stdout);
+	if (g_file != nullptr)
+	{
+		g_file->Flush();
+	}
+	if (g_trace_file != nullptr)
+	{
+		g_trace_file->Flush();
+	}
+	g_mutex->Unlock();
+}
+
 static void Close()
 {
 	if (g_log_initialized)
 	{
+		Flush();
+
 		g_mutex->Lock();
 		if (g_dir == Direction::File && g_file != nullptr)
 		{
@@ -107,6 +502,12 @@ static void Close()
 			}
 			g_thread_local_files->Clear();
 		}
+		if (g_trace_file != nullptr)
+		{
+			g_trace_file->Close();
+			delete g_trace_file;
+			g_trace_file = nullptr;
+		}
 		g_mutex->Unlock();
 	}
 }
@@ -121,12 +522,18 @@ KYTY_SUBSYSTEM_INIT(Log)
 
 	auto dir = Config::GetPrintfDirection();
 	SetDirection(dir);
+	Libs::TraceInit();
 	if (dir == Log::Direction::File)
 	{
 		SetOutputFile(Config::GetPrintfOutputFile());
 	}
 
 	g_thread_local_files = new Vector<Core::File*>;
+
+	if (Config::PrintfAsyncEnabled() && (dir == Log::Direction::Console || dir == Log::Direction::File))
+	{
+		StartAsync(Config::GetPrintfAsyncOverflow());
+	}
 }
 
 KYTY_SUBSYSTEM_UNEXPECTED_SHUTDOWN(Log)
@@ -189,6 +596,48 @@ void SetOutputFile(const String& file_name, Core::File::Encoding enc)
 	}
 }
 
+void SetTraceFile(const String& file_name)
+{
+	EXIT_IF(!Log::g_log_initialized);
+	EXIT_IF(!Core::Thread::IsMainThread());
+	EXIT_IF(Log::g_trace_file != nullptr);
+
+	g_trace_file = new Core::File;
+	g_trace_file->Create(file_name);
+
+	if (g_trace_file->IsInvalid())
+	{
+		::printf("Can't create trace file: %s\n", file_name.C_Str());
+		delete g_trace_file;
+		g_trace_file = nullptr;
+	}
+}
+
+bool IsTraceFile()
+{
+	return g_trace_file != nullptr;
+}
+
+void WriteTrace(const void* data, uint32_t size)
+{
+	EXIT_IF(!Log::g_log_initialized);
+
+	if (g_trace_file == nullptr)
+	{
+		return;
+	}
+
+	if (g_async_enabled)
+	{
+		async_push(static_cast<const char*>(data), size, LOG_TO_TRACE);
+	} else
+	{
+		g_mutex->Lock();
+		g_trace_file->Write(data, size);
+		g_mutex->Unlock();
+	}
+}
+
 void SetOutputThreadLocalFile(const String& file_name, Core::File::Encoding enc)
 {
 	EXIT_IF(!Log::g_log_initialized);
@@ -223,6 +672,48 @@ void CreateThreadLocalFile()
 	SetOutputThreadLocalFile(file_name, Core::File::Encoding::Utf8);
 }
 
+void Write(const char* str, uint32_t size)
+{
+	EXIT_IF(!g_log_initialized);
+
+	if (g_dir == Direction::Silent || size == 0)
+	{
+		return;
+	}
+
+	EXIT_IF(g_mutex == nullptr);
+
+	if (g_async_enabled && g_dir != Direction::Directory)
+	{
+		if (g_dir == Direction::Console || g_file != nullptr)
+		{
+			async_push(str, size, g_dir == Direction::Console ? LOG_TO_CONSOLE : LOG_TO_FILE);
+		}
+		return;
+	}
+
+	if (g_dir == Direction::Directory)
+	{
+		if (g_thread_local_file == nullptr)
+		{
+			CreateThreadLocalFile();
+		}
+		if (g_thread_local_file != nullptr)
+		{
+			Vector<char> text;
+			append_text(str, size, &text);
+			g_thread_local_file->Write(text.GetDataConst(), text.Size());
+		}
+		return;
+	}
+
+	LogBatch batch;
+	append_record(str, size, g_dir == Direction::Console ? LOG_TO_CONSOLE : LOG_TO_FILE, &batch);
+	g_mutex->Lock();
+	write_output(batch);
+	g_mutex->Unlock();
+}
+
 } // namespace Log
 
 void emu_printf(const char* format, ...)
@@ -231,6 +722,16 @@ void emu_printf(const char* format, ...)
 
 	EXIT_IF(Log::g_mutex == nullptr);
 
+	if (Log::g_async_enabled)
+	{
+		va_list args {};
+		va_start(args, format);
+		Log::async_vprintf(Log::LOG_TO_CONSOLE | (Log::g_dir == Log::Direction::File && Log::g_file != nullptr ? Log::LOG_TO_FILE : 0),
+		                   format, args);
+		va_end(args);
+		return;
+	}
+
 	Log::g_mutex->Lock();
 	{
 		va_list args {};
@@ -265,6 +766,18 @@ void printf(const char* format, ...)
 
 	EXIT_IF(Log::g_mutex == nullptr);
 
+	if (Log::g_async_enabled && Log::g_dir != Log::Direction::Directory)
+	{
+		if (Log::g_dir == Log::Direction::Console || Log::g_file != nullptr)
+		{
+			va_list args {};
+			va_start(args, format);
+			Log::async_vprintf(Log::g_dir == Log::Direction::Console ? Log::LOG_TO_CONSOLE : Log::LOG_TO_FILE, format, args);
+			va_end(args);
+		}
+		return;
+	}
+
 	va_list args {};
 	va_start(args, format);
 	String s;
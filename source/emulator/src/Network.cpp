@@ -3,6 +3,7 @@
 #include "Kyty/Core/ByteBuffer.h"
 #include "Kyty/Core/Common.h"
 #include "Kyty/Core/DbgAssert.h"
+#include "Kyty/Core/MSpace.h"
 #include "Kyty/Core/String.h"
 #include "Kyty/Core/Threads.h"
 #include "Kyty/Core/Vector.h"
@@ -17,6 +18,80 @@
 
 namespace Kyty::Libs::Network {
 
+struct HttpUrl
+{
+	String   scheme;
+	String   host;
+	uint16_t port = 0;
+};
+
+// scheme://[user[:password]@]host[:port][/path], only http and https
+static int http_parse_url(const char* url, HttpUrl* r)
+{
+	EXIT_IF(r == nullptr);
+
+	if (url == nullptr)
+	{
+		return HTTP_ERROR_INVALID_URL;
+	}
+
+	auto str = String::FromUtf8(url);
+
+	uint32_t scheme_end = str.FindIndex(U"://");
+	if (!str.IndexValid(scheme_end) || scheme_end == 0)
+	{
+		return HTTP_ERROR_INVALID_URL;
+	}
+
+	r->scheme = str.Left(scheme_end).ToLower();
+
+	if (r->scheme == U"http")
+	{
+		r->port = 80;
+	} else if (r->scheme == U"https")
+	{
+		r->port = 443;
+	} else
+	{
+		return HTTP_ERROR_UNKNOWN_SCHEME;
+	}
+
+	auto     authority = str.Mid(scheme_end + 3);
+	uint32_t path      = authority.FindIndex(U'/');
+	if (authority.IndexValid(path))
+	{
+		authority = authority.Left(path);
+	}
+	uint32_t user = authority.FindLastIndex(U'@');
+	if (authority.IndexValid(user))
+	{
+		authority = authority.Mid(user + 1);
+	}
+
+	// IPv6 addresses are in brackets
+	uint32_t host_end = (authority.StartsWith(U'[') ? authority.FindIndex(U']') : 0);
+	if (!authority.IndexValid(host_end))
+	{
+		return HTTP_ERROR_INVALID_URL;
+	}
+
+	uint32_t port = authority.FindIndex(U':', host_end);
+	if (authority.IndexValid(port))
+	{
+		uint32_t value = authority.Mid(port + 1).ToUint32();
+		if (value == 0 || value > 0xffff)
+		{
+			return HTTP_ERROR_INVALID_URL;
+		}
+		r->port   = static_cast<uint16_t>(value);
+		authority = authority.Left(port);
+	}
+
+	r->host = authority.ToLower();
+
+	return (r->host.IsEmpty() ? HTTP_ERROR_INVALID_URL : OK);
+}
+
 class Network
 {
 public:
@@ -94,10 +169,11 @@ public:
 	bool HttpValidTemplate(Id tmpl_id);
 	bool HttpValidConnection(Id conn_id);
 	bool HttpValidRequest(Id req_id);
-	Id   HttpCreateConnectionWithURL(Id tmpl_id, const char* url, bool enable_keep_alive);
+	Id   HttpCreateConnectionWithURL(Id tmpl_id, const HttpUrl& url, bool enable_keep_alive);
 	bool HttpDeleteConnection(Id conn_id);
 	Id   HttpCreateRequestWithURL2(Id conn_id, const char* method, const char* url, uint64_t content_length);
 	bool HttpDeleteRequest(Id req_id);
+	int  HttpSendRequest(Id req_id, const void* post_data, size_t size);
 	bool HttpSetResolveTimeOut(Id id, uint32_t usec);
 	bool HttpSetResolveRetry(Id id, int32_t retry);
 	bool HttpSetConnectTimeOut(Id id, uint32_t usec);
@@ -107,6 +183,13 @@ public:
 	bool HttpSetAuthEnabled(Id id, int enable);
 
 private:
+	// Memory of an Http context, allocations are freed all at once when the context is terminated
+	struct Arena
+	{
+		uint8_t*       base = nullptr;
+		Core::mspace_t msp  = nullptr;
+	};
+
 	struct Pool
 	{
 		bool   used = false;
@@ -126,6 +209,7 @@ private:
 		uint64_t size       = 0;
 		int      memid      = 0;
 		int      ssl_ctx_id = 0;
+		Arena    arena;
 	};
 
 	struct HttpHeader
@@ -174,6 +258,8 @@ private:
 		String   method;
 		String   url;
 		uint64_t content_length = 0;
+		void*    post_data      = nullptr; // in the arena of the Http context
+		size_t   post_size      = 0;
 	};
 
 	static constexpr int POOLS_MAX = 32;
@@ -187,6 +273,10 @@ private:
 	Vector<HttpTemplate>   m_templates;
 	Vector<HttpConnection> m_connections;
 	Vector<HttpRequest>    m_requests;
+
+	static void ArenaCreate(Arena* arena, const char* name, uint64_t size);
+	static void ArenaDestroy(Arena* arena);
+	void        RequestFreeData(HttpRequest* req);
 };
 
 static Network* g_net = nullptr;
@@ -202,6 +292,60 @@ KYTY_SUBSYSTEM_UNEXPECTED_SHUTDOWN(Network) {}
 
 KYTY_SUBSYSTEM_DESTROY(Network) {}
 
+// A pool too small for the arena header has no arena, and every allocation from it fails
+void Network::ArenaCreate(Arena* arena, const char* name, uint64_t size)
+{
+	EXIT_IF(arena == nullptr);
+	EXIT_IF(arena->base != nullptr);
+
+	size &= ~static_cast<uint64_t>(7);
+
+	if (size == 0 || (size >> 32u) != 0)
+	{
+		return;
+	}
+
+	arena->base = new uint8_t[size];
+	arena->msp  = Core::MSpaceCreate(name, arena->base, size, true, nullptr);
+
+	if (arena->msp == nullptr)
+	{
+		delete[] arena->base;
+		arena->base = nullptr;
+	}
+}
+
+void Network::ArenaDestroy(Arena* arena)
+{
+	EXIT_IF(arena == nullptr);
+
+	if (arena->msp != nullptr)
+	{
+		Core::MSpaceDestroy(arena->msp);
+	}
+	delete[] arena->base;
+
+	arena->base = nullptr;
+	arena->msp  = nullptr;
+}
+
+void Network::RequestFreeData(HttpRequest* req)
+{
+	EXIT_IF(req == nullptr);
+
+	if (req->post_data != nullptr)
+	{
+		const auto& arena = m_http[req->http_ctx_id].arena;
+
+		EXIT_IF(arena.msp == nullptr);
+
+		Core::MSpaceFree(arena.msp, req->post_data);
+
+		req->post_data = nullptr;
+		req->post_size = 0;
+	}
+}
+
 int Network::PoolCreate(const char* name, int size)
 {
 	Core::LockGuard lock(m_mutex);
@@ -283,6 +427,8 @@ Network::Id Network::HttpInit(int memid, Id ssl_ctx_id, uint64_t pool_size)
 				m_http[id].ssl_ctx_id = ssl_ctx_id.GetId();
 				m_http[id].memid      = memid;
 
+				ArenaCreate(&m_http[id].arena, "http_pool", pool_size);
+
 				return Id::Create(id, Id::Type::Http);
 			}
 		}
@@ -327,8 +473,20 @@ bool Network::HttpTerm(Id http_ctx_id)
 
 	if (HttpValid(http_ctx_id))
 	{
+		// Request data is freed with the arena
+		for (auto& req: m_requests)
+		{
+			if (req.http_ctx_id == http_ctx_id.GetId())
+			{
+				req.post_data = nullptr;
+				req.post_size = 0;
+			}
+		}
+
 		m_http[http_ctx_id.GetId()].used = false;
 
+		ArenaDestroy(&m_http[http_ctx_id.GetId()].arena);
+
 		return true;
 	}
 
@@ -370,7 +528,7 @@ Network::Id Network::HttpCreateTemplate(Id http_ctx_id, const char* user_agent,
 	return Id::Invalid();
 }
 
-Network::Id Network::HttpCreateConnectionWithURL(Id tmpl_id, const char* url, bool enable_keep_alive)
+Network::Id Network::HttpCreateConnectionWithURL(Id tmpl_id, const HttpUrl& url, bool enable_keep_alive)
 {
 	Core::LockGuard lock(m_mutex);
 
@@ -379,7 +537,7 @@ Network::Id Network::HttpCreateConnectionWithURL(Id tmpl_id, const char* url, bo
 		HttpConnection cn(m_templates[tmpl_id.GetId()]);
 		cn.used              = true;
 		cn.enable_keep_alive = enable_keep_alive;
-		cn.url               = String::FromUtf8(url);
+		cn.url               = url.scheme + U"://" + url.host + U":" + String::FromPrintf("%u", static_cast<uint32_t>(url.port));
 		// cn.tmpl_id           = tmpl_id.ToInt();
 
 		int index = 0;
@@ -457,6 +615,8 @@ bool Network::HttpDeleteRequest(Id req_id)
 
 	if (HttpValidRequest(req_id))
 	{
+		RequestFreeData(&m_requests[req_id.GetId()]);
+
 		m_requests[req_id.GetId()].used = false;
 
 		return true;
@@ -465,6 +625,39 @@ bool Network::HttpDeleteRequest(Id req_id)
 	return false;
 }
 
+// Guest requests are not sent: there is no TLS, and the Sys sockets block the caller. A request fails at once and never blocks,
+// with or without HttpSetNonblock().
+int Network::HttpSendRequest(Id req_id, const void* post_data, size_t size)
+{
+	Core::LockGuard lock(m_mutex);
+
+	if (!HttpValidRequest(req_id))
+	{
+		return HTTP_ERROR_INVALID_ID;
+	}
+
+	auto& req = m_requests[req_id.GetId()];
+
+	RequestFreeData(&req);
+
+	if (post_data != nullptr && size != 0)
+	{
+		auto* buf = Core::MSpaceMalloc(m_http[req.http_ctx_id].arena.msp, size);
+		if (buf == nullptr)
+		{
+			return HTTP_ERROR_OUT_OF_MEMORY;
+		}
+		memcpy(buf, post_data, size);
+
+		req.post_data = buf;
+		req.post_size = size;
+	}
+
+	printf("\t %s %s%s\n", req.method.C_Str(), req.url.C_Str(), (req.enable_keep_alive ? ", keep-alive" : ""));
+
+	return HTTP_ERROR_TIMEOUT;
+}
+
 bool Network::HttpDeleteTemplate(Id tmpl_id)
 {
 	Core::LockGuard lock(m_mutex);
@@ -1232,13 +1425,16 @@ int KYTY_SYSV_ABI HttpUnsetEpoll(int id)
 	return OK;
 }
 
-int KYTY_SYSV_ABI HttpSendRequest(int request_id, const void* /*post_data*/, size_t /*size*/)
+int KYTY_SYSV_ABI HttpSendRequest(int request_id, const void* post_data, size_t size)
 {
 	PRINT_NAME();
 
 	printf("\t request_id = %d\n", request_id);
+	printf("\t size       = %" PRIu64 "\n", static_cast<uint64_t>(size));
 
-	return HTTP_ERROR_TIMEOUT;
+	EXIT_IF(g_net == nullptr);
+
+	return g_net->HttpSendRequest(Network::Id(request_id), post_data, size);
 }
 
 int KYTY_SYSV_ABI HttpCreateConnectionWithURL(int tmpl_id, const char* url, int enable_keep_alive)
@@ -1251,7 +1447,13 @@ int KYTY_SYSV_ABI HttpCreateConnectionWithURL(int tmpl_id, const char* url, int
 
 	EXIT_IF(g_net == nullptr);
 
-	auto id = g_net->HttpCreateConnectionWithURL(Network::Id(tmpl_id), url, enable_keep_alive != 0);
+	HttpUrl parsed;
+	if (int result = http_parse_url(url, &parsed); result != OK)
+	{
+		return result;
+	}
+
+	auto id = g_net->HttpCreateConnectionWithURL(Network::Id(tmpl_id), parsed, enable_keep_alive != 0);
 
 	if (!id.IsValid())
 	{
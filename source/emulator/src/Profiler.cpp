@@ -1,22 +1,128 @@
 #include "Emulator/Profiler.h"
 
+#include "Kyty/Core/File.h"
 #include "Kyty/Core/String.h"
 #include "Kyty/Core/Subsystems.h"
+#include "Kyty/Core/Vector.h"
 
+#include "Emulator/Benchmark.h"
 #include "Emulator/Config.h"
+#include "Emulator/Graphics/GpuProfiler.h"
+#include "Emulator/HleStats.h"
+#include "Emulator/Loader/Timer.h"
+#include "Emulator/Sampler.h"
 
 #include <easy/profiler.h>
+#include <easy/reader.h>
+#include <sstream>
 
 #ifdef KYTY_EMU_ENABLED
 
 namespace Kyty::Profiler {
 
+constexpr int TRACE_CPU_PID = 0;
+constexpr int TRACE_GPU_PID = 1;
+
+// Blocks of the profile file and the GPU events as a Chrome trace (chrome://tracing, Perfetto). The times are in the process time
+// of the GPU profiler.
+static void save_trace(const String& prof_file_name, const String& file_name)
+{
+	profiler::SerializedData       serialized_blocks;
+	profiler::SerializedData       serialized_descriptors;
+	profiler::descriptors_list_t   descriptors;
+	profiler::blocks_t             blocks;
+	profiler::thread_blocks_tree_t threads;
+	profiler::bookmarks_t          bookmarks;
+	profiler::BeginEndTime         begin_end_time {};
+	uint32_t                       descriptors_count = 0;
+	uint32_t                       version           = 0;
+	profiler::processid_t          pid               = 0;
+	std::stringstream              log;
+
+	if (::fillTreesFromFile(prof_file_name.C_Str(), begin_end_time, serialized_blocks, serialized_descriptors, descriptors, blocks, threads,
+	                      bookmarks, descriptors_count, version, pid, false, log) == 0)
+	{
+		printf(FG_BRIGHT_RED "Profiler: can't read %s\n" FG_DEFAULT, prof_file_name.C_Str());
+		return;
+	}
+
+	double offset_us =
+	    static_cast<double>(profiler::toNanoseconds(profiler::now())) / 1000.0 - static_cast<double>(Loader::Timer::GetTimeUs());
+
+	Core::File::CreateDirectories(file_name.DirectoryWithoutFilename());
+
+	Core::File f;
+	f.Create(file_name);
+	if (f.IsInvalid())
+	{
+		printf(FG_BRIGHT_RED "Can't create file: %s\n" FG_DEFAULT, file_name.C_Str());
+		return;
+	}
+
+	f.Printf("{\"traceEvents\":[\n");
+
+	Vector<profiler::block_index_t> stack;
+
+	for (const auto& t: threads)
+	{
+		const auto& root = t.second;
+
+		f.Printf("{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%" PRIu64 ",\"args\":{\"name\":\"%s\"}},\n", TRACE_CPU_PID,
+		         static_cast<uint64_t>(t.first), root.got_name() ? root.name() : "Thread");
+
+		stack.Clear();
+		for (auto index: root.children)
+		{
+			stack.Add(index);
+		}
+
+		while (!stack.IsEmpty())
+		{
+			auto index = stack[stack.Size() - 1];
+			stack.RemoveAt(stack.Size() - 1);
+
+			const auto& b    = blocks[index];
+			const auto* desc = descriptors[b.node->id()];
+			const char* name = (b.node->name()[0] != '\0' ? b.node->name() : desc->name());
+
+			f.Printf("{\"name\":\"%s\",\"cat\":\"cpu\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%d,\"tid\":%" PRIu64 "},\n", name,
+			         static_cast<double>(b.node->begin()) / 1000.0 - offset_us, static_cast<double>(b.node->duration()) / 1000.0,
+			         TRACE_CPU_PID, static_cast<uint64_t>(t.first));
+
+			for (auto child: b.children)
+			{
+				stack.Add(child);
+			}
+		}
+	}
+
+	// Frame markers are the frame spans of the GPU events
+	Libs::Graphics::GpuProfilerWriteTraceEvents(&f, TRACE_GPU_PID);
+
+	f.Printf("{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"args\":{\"name\":\"GPU\"}},\n", TRACE_GPU_PID);
+	f.Printf("{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"args\":{\"name\":\"CPU\"}}\n", TRACE_CPU_PID);
+	f.Printf("]}\n");
+
+	f.Close();
+
+	printf("Profiler: trace saved to %s\n", file_name.C_Str());
+}
+
 void Close()
 {
+	SamplerSave();
+	HleStatsPrint();
+	BenchmarkPrint();
+
 	auto dir = Config::GetProfilerDirection();
 	if (dir == Config::ProfilerDirection::File || dir == Config::ProfilerDirection::FileAndNetwork)
 	{
 		profiler::dumpBlocksToFile(Config::GetProfilerOutputFile().C_Str());
+
+		if (auto trace_file = Config::GetProfilerTraceFile(); !trace_file.IsEmpty())
+		{
+			save_trace(Config::GetProfilerOutputFile(), trace_file);
+		}
 	}
 }
 
@@ -33,6 +139,10 @@ KYTY_SUBSYSTEM_INIT(Profiler)
 		case Config::ProfilerDirection::None:
 		default: break;
 	}
+
+	SamplerInit();
+	HleStatsInit();
+	BenchmarkInit();
 }
 
 KYTY_SUBSYSTEM_UNEXPECTED_SHUTDOWN(Profiler)
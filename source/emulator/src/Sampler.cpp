@@ -0,0 +1,376 @@
+#include "Emulator/Sampler.h"
+
+#include "Kyty/Core/DbgAssert.h"
+#include "Kyty/Core/File.h"
+#include "Kyty/Core/FlatHashmap.h"
+#include "Kyty/Core/Singleton.h"
+#include "Kyty/Core/Threads.h"
+#include "Kyty/Core/Vector.h"
+
+#include "Emulator/Config.h"
+#include "Emulator/Loader/RuntimeLinker.h"
+
+#include <atomic>
+
+#if KYTY_PLATFORM == KYTY_PLATFORM_WINDOWS
+#include <windows.h> // IWYU pragma: keep
+#else
+#include <csignal>
+#include <dlfcn.h>
+#include <pthread.h>
+#include <ucontext.h>
+#endif
+
+#ifdef KYTY_EMU_ENABLED
+
+namespace Kyty::Profiler {
+
+constexpr int      SAMPLER_DEPTH_MAX  = 64;
+constexpr uint32_t SAMPLER_WAIT_MAX   = 10000; // microseconds a Linux thread has to answer the signal
+constexpr uint32_t SAMPLER_STACKS_MAX = 1024 * 1024;
+
+struct SamplerThread
+{
+	uint32_t name_id    = 0;
+	uint64_t stack_addr = 0;
+	uint64_t stack_size = 0;
+#if KYTY_PLATFORM == KYTY_PLATFORM_WINDOWS
+	HANDLE handle = nullptr;
+#else
+	pthread_t        handle {};
+	std::atomic_bool ready = false;
+#endif
+	// Written while the thread is stopped: the instruction pointer, then the return addresses
+	void* frames[SAMPLER_DEPTH_MAX + 1] = {};
+	int   depth                         = 0;
+};
+
+struct SamplerStack
+{
+	uint32_t name_id = 0;
+	uint32_t offset  = 0;
+	uint32_t depth   = 0;
+	uint64_t count   = 0;
+};
+
+struct Sampler
+{
+	Core::Mutex                           mutex {"Sampler"};
+	uint32_t                              period  = 0;
+	bool                                  stopped = false;
+	uint64_t                              samples = 0;
+	Vector<SamplerThread*>                threads;
+	Vector<String>                        names;
+	Vector<uint64_t>                      frames;
+	Vector<SamplerStack>                  stacks;
+	Core::FlatHashmap<uint64_t, uint32_t> index;
+};
+
+static Sampler*                    g_sampler      = nullptr;
+static thread_local SamplerThread* g_sampler_self = nullptr;
+
+static void sampler_walk(SamplerThread* t, uint64_t rip, uint64_t rbp)
+{
+	int depth = SAMPLER_DEPTH_MAX;
+	Loader::RuntimeLinker::StackWalk(rbp, t->stack_addr, t->stack_size, t->frames + 1, &depth);
+	t->frames[0] = reinterpret_cast<void*>(rip);
+	t->depth     = depth + 1;
+}
+
+#if KYTY_PLATFORM != KYTY_PLATFORM_WINDOWS
+// Runs on the sampled thread, only reads its registers and stack
+static void sampler_signal_handler(int /*sig*/, siginfo_t* /*info*/, void* context)
+{
+	auto* t = g_sampler_self;
+	if (t != nullptr)
+	{
+		const auto* uc = static_cast<const ucontext_t*>(context);
+		sampler_walk(t, static_cast<uint64_t>(uc->uc_mcontext.gregs[REG_RIP]), static_cast<uint64_t>(uc->uc_mcontext.gregs[REG_RBP]));
+		t->ready.store(true, std::memory_order_release);
+	}
+}
+#endif
+
+static bool sampler_capture(SamplerThread* t)
+{
+#if KYTY_PLATFORM == KYTY_PLATFORM_WINDOWS
+	if (SuspendThread(t->handle) == static_cast<DWORD>(-1))
+	{
+		return false;
+	}
+	CONTEXT context {};
+	context.ContextFlags = CONTEXT_CONTROL | CONTEXT_INTEGER;
+	bool ok              = (GetThreadContext(t->handle, &context) != 0);
+	if (ok)
+	{
+		sampler_walk(t, context.Rip, context.Rbp);
+	}
+	ResumeThread(t->handle);
+	return ok;
+#else
+	t->ready.store(false, std::memory_order_relaxed);
+	if (pthread_kill(t->handle, SIGPROF) != 0)
+	{
+		return false;
+	}
+	for (uint32_t us = 0; !t->ready.load(std::memory_order_acquire); us += 10)
+	{
+		if (us >= SAMPLER_WAIT_MAX)
+		{
+			return false;
+		}
+		Core::Thread::SleepMicro(10);
+	}
+	return true;
+#endif
+}
+
+// g_sampler->mutex must be locked
+static void sampler_add(const SamplerThread* t)
+{
+	uint64_t hash = 14695981039346656037ull;
+	auto     mix  = [&hash](uint64_t v)
+	{
+		hash ^= v;
+		hash *= 1099511628211ull;
+	};
+
+	mix(t->name_id);
+	for (int i = 0; i < t->depth; i++)
+	{
+		mix(reinterpret_cast<uint64_t>(t->frames[i]));
+	}
+
+	g_sampler->samples++;
+
+	if (auto* index = g_sampler->index.Find(hash); index != nullptr)
+	{
+		g_sampler->stacks[*index].count++;
+		return;
+	}
+
+	if (g_sampler->stacks.Size() >= SAMPLER_STACKS_MAX)
+	{
+		return;
+	}
+
+	SamplerStack s;
+	s.name_id = t->name_id;
+	s.offset  = g_sampler->frames.Size();
+	s.depth   = static_cast<uint32_t>(t->depth);
+	s.count   = 1;
+
+	for (int i = 0; i < t->depth; i++)
+	{
+		g_sampler->frames.Add(reinterpret_cast<uint64_t>(t->frames[i]));
+	}
+
+	g_sampler->index.Put(hash, g_sampler->stacks.Size());
+	g_sampler->stacks.Add(s);
+}
+
+static void sampler_run(void* /*arg*/)
+{
+	for (;;)
+	{
+		Core::Thread::SleepMicro(g_sampler->period);
+
+		Core::LockGuard lock(g_sampler->mutex);
+
+		if (g_sampler->stopped)
+		{
+			break;
+		}
+
+		for (auto* t: g_sampler->threads)
+		{
+			if (sampler_capture(t))
+			{
+				sampler_add(t);
+			}
+		}
+	}
+}
+
+static String sampler_symbol(uint64_t vaddr)
+{
+	// Guest exports and the host debug map
+	if (String name; Core::Singleton<Loader::RuntimeLinker>::Instance()->Symbolize(vaddr, &name))
+	{
+		return name;
+	}
+#if KYTY_PLATFORM == KYTY_PLATFORM_WINDOWS
+	HMODULE module = nullptr;
+	char    name[MAX_PATH];
+	if (GetModuleHandleExA(GET_MODULE_HANDLE_EX_FLAG_FROM_ADDRESS | GET_MODULE_HANDLE_EX_FLAG_UNCHANGED_REFCOUNT,
+	                       reinterpret_cast<LPCSTR>(vaddr), &module) != 0 &&
+	    GetModuleFileNameA(module, name, MAX_PATH) != 0)
+	{
+		return String::FromPrintf("%s+0x%" PRIx64, String::FromUtf8(name).FilenameWithoutDirectory().C_Str(),
+		                          vaddr - reinterpret_cast<uint64_t>(module));
+	}
+#else
+	Dl_info info {};
+	if (dladdr(reinterpret_cast<void*>(vaddr), &info) != 0)
+	{
+		if (info.dli_sname != nullptr)
+		{
+			return String::FromUtf8(info.dli_sname);
+		}
+		if (info.dli_fname != nullptr)
+		{
+			return String::FromPrintf("%s+0x%" PRIx64, String::FromUtf8(info.dli_fname).FilenameWithoutDirectory().C_Str(),
+			                          vaddr - reinterpret_cast<uint64_t>(info.dli_fbase));
+		}
+	}
+#endif
+	return String::FromPrintf("0x%016" PRIx64, vaddr);
+}
+
+void SamplerInit()
+{
+	EXIT_IF(g_sampler != nullptr);
+
+	if (Config::GetSamplerPeriod() == 0)
+	{
+		return;
+	}
+
+#if KYTY_PLATFORM != KYTY_PLATFORM_WINDOWS
+	struct sigaction action {};
+	action.sa_sigaction = sampler_signal_handler;
+	action.sa_flags     = SA_SIGINFO | SA_RESTART;
+	sigemptyset(&action.sa_mask);
+	EXIT_NOT_IMPLEMENTED(sigaction(SIGPROF, &action, nullptr) != 0);
+#endif
+
+	g_sampler         = new Sampler;
+	g_sampler->period = Config::GetSamplerPeriod();
+
+	Core::Thread t(sampler_run, nullptr);
+	t.Detach();
+}
+
+void SamplerThreadStart(const String& name)
+{
+	if (g_sampler == nullptr)
+	{
+		return;
+	}
+
+	EXIT_IF(g_sampler_self != nullptr);
+
+	auto* t = new SamplerThread;
+
+#if KYTY_PLATFORM == KYTY_PLATFORM_WINDOWS
+	ULONG_PTR low  = 0;
+	ULONG_PTR high = 0;
+	GetCurrentThreadStackLimits(&low, &high);
+	t->stack_addr = low;
+	t->stack_size = high - low;
+	t->handle     = OpenThread(THREAD_SUSPEND_RESUME | THREAD_GET_CONTEXT | THREAD_QUERY_INFORMATION, FALSE, GetCurrentThreadId());
+	EXIT_NOT_IMPLEMENTED(t->handle == nullptr);
+#else
+	pthread_attr_t attr {};
+	void*          addr = nullptr;
+	size_t         size = 0;
+	EXIT_NOT_IMPLEMENTED(pthread_getattr_np(pthread_self(), &attr) != 0);
+	pthread_attr_getstack(&attr, &addr, &size);
+	pthread_attr_destroy(&attr);
+	t->stack_addr = reinterpret_cast<uint64_t>(addr);
+	t->stack_size = size;
+	t->handle     = pthread_self();
+#endif
+
+	Core::LockGuard lock(g_sampler->mutex);
+
+	auto name_id = g_sampler->names.Find(name);
+	if (!g_sampler->names.IndexValid(name_id))
+	{
+		name_id = g_sampler->names.Size();
+		g_sampler->names.Add(name);
+	}
+	t->name_id = name_id;
+
+	g_sampler_self = t;
+	g_sampler->threads.Add(t);
+}
+
+void SamplerThreadStop()
+{
+	if (g_sampler == nullptr || g_sampler_self == nullptr)
+	{
+		return;
+	}
+
+	{
+		Core::LockGuard lock(g_sampler->mutex);
+		g_sampler->threads.Remove(g_sampler_self);
+	}
+
+#if KYTY_PLATFORM == KYTY_PLATFORM_WINDOWS
+	CloseHandle(g_sampler_self->handle);
+#endif
+
+	delete g_sampler_self;
+	g_sampler_self = nullptr;
+}
+
+void SamplerSave()
+{
+	if (g_sampler == nullptr)
+	{
+		return;
+	}
+
+	Core::LockGuard lock(g_sampler->mutex);
+
+	if (g_sampler->stopped)
+	{
+		return;
+	}
+	g_sampler->stopped = true;
+
+	auto file_name = Config::GetSamplerOutputFile();
+
+	Core::File::CreateDirectories(file_name.DirectoryWithoutFilename());
+
+	Core::File f;
+	f.Create(file_name);
+	if (f.IsInvalid())
+	{
+		printf(FG_BRIGHT_RED "Can't create file: %s\n" FG_DEFAULT, file_name.C_Str());
+		return;
+	}
+
+	// The same addresses are found in many stacks
+	Core::FlatHashmap<uint64_t, uint32_t> symbol_index;
+	Vector<String>                        symbols;
+
+	for (const auto& s: g_sampler->stacks)
+	{
+		String line = g_sampler->names[s.name_id];
+
+		// Folded stacks start at the root
+		for (uint32_t i = s.depth; i > 0; i--)
+		{
+			uint64_t vaddr = g_sampler->frames[s.offset + i - 1];
+			uint32_t index = symbol_index.GetOrPutDef(vaddr, symbols.Size());
+			if (index == symbols.Size())
+			{
+				symbols.Add(sampler_symbol(vaddr));
+			}
+			line += U";" + symbols[index];
+		}
+
+		f.Printf("%s %" PRIu64 "\n", line.C_Str(), s.count);
+	}
+
+	f.Close();
+
+	printf("Sampler: %" PRIu64 " samples, %u stacks saved to %s\n", g_sampler->samples, g_sampler->stacks.Size(), file_name.C_Str());
+}
+
+} // namespace Kyty::Profiler
+
+#endif // KYTY_EMU_ENABLED
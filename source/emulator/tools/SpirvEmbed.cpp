@@ -0,0 +1,83 @@
+// Build time helper: assembles, validates and optimizes the built-in shaders and writes them as uint32_t arrays into a header
+//
+// usage: spirv_embed <output.h> <NAME>=<file.spvasm> [<NAME>=<file.spvasm> ...]
+
+#include "spirv-tools/libspirv.hpp"
+#include "spirv-tools/optimizer.hpp"
+
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+static bool compile(const std::string& file_name, std::vector<uint32_t>* dst)
+{
+	std::ifstream f(file_name);
+	if (!f)
+	{
+		fprintf(stderr, "can't open %s\n", file_name.c_str());
+		return false;
+	}
+
+	std::stringstream text;
+	text << f.rdbuf();
+	std::string src = text.str();
+
+	spvtools::SpirvTools core(SPV_ENV_VULKAN_1_2);
+	spvtools::Optimizer  opt(SPV_ENV_VULKAN_1_2);
+
+	auto print_msg = [&file_name](spv_message_level_t /*level*/, const char* /*source*/, const spv_position_t& position, const char* m)
+	{ fprintf(stderr, "%s:%d:%d: %s\n", file_name.c_str(), static_cast<int>(position.line), static_cast<int>(position.column), m); };
+	core.SetMessageConsumer(print_msg);
+	opt.SetMessageConsumer(print_msg);
+
+	opt.RegisterPerformancePasses();
+
+	return core.Assemble(src, dst) && core.Validate(*dst) && opt.Run(dst->data(), dst->size(), dst);
+}
+
+int main(int argc, char** argv)
+{
+	if (argc < 3)
+	{
+		fprintf(stderr, "usage: %s <output.h> <NAME>=<file.spvasm> ...\n", argv[0]);
+		return 1;
+	}
+
+	std::string out;
+	out += "// Generated by spirv_embed, do not edit\n\n";
+	out += "#pragma once\n\n";
+	out += "#include <cstdint>\n";
+
+	for (int i = 2; i < argc; i++)
+	{
+		std::string arg = argv[i];
+		auto        eq  = arg.find('=');
+		if (eq == std::string::npos)
+		{
+			fprintf(stderr, "invalid argument: %s\n", arg.c_str());
+			return 1;
+		}
+
+		std::vector<uint32_t> spirv;
+		if (!compile(arg.substr(eq + 1), &spirv))
+		{
+			return 1;
+		}
+
+		out += "\nstatic constexpr uint32_t " + arg.substr(0, eq) + "[] = {";
+		for (size_t w = 0; w < spirv.size(); w++)
+		{
+			char buf[32];
+			snprintf(buf, sizeof(buf), "%s0x%08x,", (w % 8 == 0 ? "\n    " : " "), spirv[w]);
+			out += buf;
+		}
+		out += "\n};\n";
+	}
+
+	std::ofstream f(argv[1]);
+	f << out;
+
+	return f ? 0 : 1;
+}
@@ -0,0 +1,46 @@
+#ifndef INCLUDE_KYTY_CORE_BUFFERPOOL_H_
+#define INCLUDE_KYTY_CORE_BUFFERPOOL_H_
+
+#include "Kyty/Core/ByteBuffer.h"
+#include "Kyty/Core/Common.h"
+
+namespace Kyty::Core {
+
+// Pool of transient byte buffers (file reads, compression, uploads). The buffers are kept in power of two size classes from 4 KiB to
+// 256 MiB, a lease takes one with at least the requested capacity and gives it back with its storage when it ends. Larger buffers
+// and buffers over the pool limits are freed. Copy the data out (ByteBuffer(ptr, size)) instead of copying the buffer, a buffer
+// which shares its storage can't go back to the pool.
+class ByteBufferLease
+{
+public:
+	// The buffer is empty, Capacity() >= capacity
+	explicit ByteBufferLease(uint32_t capacity = 0);
+	virtual ~ByteBufferLease();
+
+	[[nodiscard]] ByteBuffer* Get() { return m_buf; }
+
+	ByteBuffer& operator*() { return *m_buf; }
+	ByteBuffer* operator->() { return m_buf; }
+
+	KYTY_CLASS_NO_COPY(ByteBufferLease);
+
+private:
+	ByteBuffer* m_buf = nullptr;
+};
+
+struct BufferPoolStats
+{
+	uint64_t leases      = 0;
+	uint64_t hits        = 0;
+	uint32_t buffers_num = 0;
+	uint64_t bytes       = 0;
+};
+
+void BufferPoolGetStats(BufferPoolStats* stats);
+
+// Frees the pooled buffers
+void BufferPoolTrim();
+
+} // namespace Kyty::Core
+
+#endif /* INCLUDE_KYTY_CORE_BUFFERPOOL_H_ */
@@ -6,6 +6,8 @@
 #include "Kyty/Core/DateTime.h"
 #include "Kyty/Core/String.h"
 
+#include <functional>
+
 namespace Kyty::Core {
 
 using ZipCompressLevel  = int;
@@ -20,15 +22,106 @@ constexpr ZstdCompressLevel ZSTD_BEST_SPEED       = 1;
 constexpr ZstdCompressLevel ZSTD_DEFAULT_LEVEL    = 3;
 constexpr ZstdCompressLevel ZSTD_BEST_COMPRESSION = 22;
 
+constexpr uint32_t ZSTD_DICT_DEFAULT_SIZE = 112 * 1024;
+
 ByteBuffer CompressZstd(const uint8_t* buf, uint32_t length, int level = ZSTD_DEFAULT_LEVEL);
 ByteBuffer CompressZstd(const ByteBuffer& buf, int level = ZSTD_DEFAULT_LEVEL);
 ByteBuffer CompressZstd(const String& str, int level = ZSTD_DEFAULT_LEVEL);
 
+// The overloads with out replace its contents and reuse its storage, for buffers of a ByteBufferLease
+void CompressZstd(const uint8_t* buf, uint32_t length, ByteBuffer* out, int level = ZSTD_DEFAULT_LEVEL);
+void DecompressZstd(const uint8_t* buf, uint32_t length, ByteBuffer* out);
+
 ByteBuffer DecompressZstd(const uint8_t* buf, uint32_t length);
 ByteBuffer DecompressZstd(const ByteBuffer& buf);
 String     DecompressZstdStr(const uint8_t* buf, uint32_t length);
 String     DecompressZstdStr(const ByteBuffer& buf);
 
+class ZstdDict;
+
+// Decompresses a whole frame into dst and returns the size. dst must be large enough, see GetZstdContentSize().
+uint32_t DecompressZstd(const uint8_t* buf, uint32_t length, uint8_t* dst, uint32_t dst_size, const ZstdDict* dict = nullptr);
+
+// The same for data read from disk, false instead of the exit if the frame is broken or doesn't fit dst
+bool TryDecompressZstd(const uint8_t* buf, uint32_t length, uint8_t* dst, uint32_t dst_size, uint32_t* size);
+
+// The decompressed size written in the frame header. False if the frame doesn't have it (streamed frames).
+bool GetZstdContentSize(const uint8_t* buf, uint32_t length, uint64_t* size);
+
+struct ZstdDictPrivate;
+struct ZstdCompressorPrivate;
+struct ZstdDecompressorPrivate;
+
+// Dictionary for many small similar blobs (shaders, pipelines). Frames compressed with a dictionary need the same one to be
+// decompressed.
+class ZstdDict
+{
+public:
+	ZstdDict() = default;
+	virtual ~ZstdDict();
+
+	// The samples should be typical blobs, a few hundred of them at least. Returns false if there is too little data.
+	bool Train(const Vector<ByteBuffer>& samples, uint32_t dict_size = ZSTD_DICT_DEFAULT_SIZE, int level = ZSTD_DEFAULT_LEVEL);
+	bool Load(const ByteBuffer& dict, int level = ZSTD_DEFAULT_LEVEL);
+
+	[[nodiscard]] bool     IsValid() const { return m_p != nullptr; }
+	[[nodiscard]] uint32_t GetId() const;
+
+	// To be stored next to the compressed blobs
+	[[nodiscard]] const ByteBuffer& GetData() const;
+
+	friend class ZstdCompressor;
+	friend class ZstdDecompressor;
+	friend uint32_t DecompressZstd(const uint8_t* buf, uint32_t length, uint8_t* dst, uint32_t dst_size, const ZstdDict* dict);
+
+	KYTY_CLASS_NO_COPY(ZstdDict);
+
+private:
+	ZstdDictPrivate* m_p = nullptr;
+};
+
+// Streaming compressor. The input is pushed in chunks, the compressed data is appended to out as soon as it is produced, so the
+// caller can write it out and clear the buffer. Finish() ends the frame, the next Push() starts a new one.
+class ZstdCompressor
+{
+public:
+	// workers_num > 0 compresses on that many extra threads. With a dictionary the level of the dictionary is used.
+	explicit ZstdCompressor(int level = ZSTD_DEFAULT_LEVEL, int workers_num = 0, const ZstdDict* dict = nullptr);
+	virtual ~ZstdCompressor();
+
+	void Push(const uint8_t* buf, uint32_t length, ByteBuffer* out);
+	void Push(const ByteBuffer& buf, ByteBuffer* out);
+	void Finish(ByteBuffer* out);
+
+	// A whole frame
+	ByteBuffer Compress(const uint8_t* buf, uint32_t length);
+	ByteBuffer Compress(const ByteBuffer& buf);
+
+	KYTY_CLASS_NO_COPY(ZstdCompressor);
+
+private:
+	ZstdCompressorPrivate* m_p = nullptr;
+};
+
+// Streaming decompressor. A chunk may end anywhere, the rest of a block is kept until the next Push().
+class ZstdDecompressor
+{
+public:
+	explicit ZstdDecompressor(const ZstdDict* dict = nullptr);
+	virtual ~ZstdDecompressor();
+
+	void Push(const uint8_t* buf, uint32_t length, ByteBuffer* out);
+	void Push(const ByteBuffer& buf, ByteBuffer* out);
+
+	// True if the data pushed so far ends on a frame boundary
+	[[nodiscard]] bool IsFrameFinished() const;
+
+	KYTY_CLASS_NO_COPY(ZstdDecompressor);
+
+private:
+	ZstdDecompressorPrivate* m_p = nullptr;
+};
+
 ByteBuffer CompressLzma(const uint8_t* buf, uint32_t length);
 ByteBuffer CompressLzma(const ByteBuffer& buf);
 ByteBuffer CompressLzma(const String& str);
@@ -38,6 +131,9 @@ ByteBuffer DecompressLzma(const ByteBuffer& buf);
 String     DecompressLzmaStr(const uint8_t* buf, uint32_t length);
 String     DecompressLzmaStr(const ByteBuffer& buf);
 
+void CompressLzma(const uint8_t* buf, uint32_t length, ByteBuffer* out);
+void DecompressLzma(const uint8_t* buf, uint32_t length, ByteBuffer* out);
+
 ByteBuffer CompressZip(const uint8_t* buf, uint32_t length, ZipCompressLevel level = ZIP_DEFAULT_LEVEL);
 ByteBuffer CompressZip(const ByteBuffer& buf, ZipCompressLevel level = ZIP_DEFAULT_LEVEL);
 ByteBuffer CompressZip(const String& str, ZipCompressLevel level = ZIP_DEFAULT_LEVEL);
@@ -47,6 +143,12 @@ ByteBuffer DecompressZip(const ByteBuffer& buf);
 String     DecompressZipStr(const uint8_t* buf, uint32_t length);
 String     DecompressZipStr(const ByteBuffer& buf);
 
+void CompressZip(const uint8_t* buf, uint32_t length, ByteBuffer* out, ZipCompressLevel level = ZIP_DEFAULT_LEVEL);
+void DecompressZip(const uint8_t* buf, uint32_t length, ByteBuffer* out);
+
+// Decompresses a zlib stream into dst and returns the size. dst must be large enough for the whole stream.
+uint64_t DecompressZip(const uint8_t* buf, uint64_t length, uint8_t* dst, uint64_t dst_size);
+
 ByteBuffer CompressLzf(const uint8_t* buf, uint32_t length);
 ByteBuffer CompressLzf(const ByteBuffer& buf);
 ByteBuffer CompressLzf(const String& str);
@@ -56,6 +158,9 @@ ByteBuffer DecompressLzf(const ByteBuffer& buf);
 String     DecompressLzfStr(const uint8_t* buf, uint32_t length);
 String     DecompressLzfStr(const ByteBuffer& buf);
 
+void CompressLzf(const uint8_t* buf, uint32_t length, ByteBuffer* out);
+void DecompressLzf(const uint8_t* buf, uint32_t length, ByteBuffer* out);
+
 struct ZipFileStat
 {
 	uint32_t m_file_index;
@@ -78,6 +183,9 @@ struct ZipFileStat
 
 struct ZipPrivate;
 
+// Receives the next chunk of an extracted file, returns false to stop
+using ZipExtractFunc = std::function<bool(const void* data, uint64_t size)>;
+
 class ZipReader
 {
 public:
@@ -88,6 +196,9 @@ public:
 	bool Open(const ByteBuffer& buf);
 	bool Open(uint8_t* mem, uint32_t size);
 
+	// Maps the archive into memory instead of reading it, falls back to Open() if the file can't be mapped
+	bool OpenMapped(const String& file_name);
+
 	void Close();
 
 	// Returns the total number of files in the archive.
@@ -110,6 +221,17 @@ public:
 	// Extracts a archive file to a memory buffer
 	ByteBuffer ExtractFile(int file_index);
 	ByteBuffer ExtractFile(const String& name);
+	bool       ExtractFile(int file_index, ByteBuffer* out);
+
+	// Extracts to a caller buffer of at least m_uncomp_size bytes
+	bool ExtractFileTo(int file_index, void* dst, uint64_t dst_size);
+
+	// Extracts without holding the whole file in memory
+	bool ExtractFileChunks(int file_index, const ZipExtractFunc& func);
+
+	// A stored (not compressed) file of a mapped or in-memory archive without copying, nullptr for other files. The data is valid
+	// until Close() and is not checked against the CRC.
+	const uint8_t* GetFileView(int file_index, uint64_t* size);
 
 	friend class ZipWriter;
 
@@ -135,14 +135,22 @@ public:
 
 	Statement* Prepare(const char* sql_text);
 	Statement* Prepare(const String& sql_text) { return Prepare(sql_text.C_Str()); }
+	// Compiled once per SQL text and kept until Close(). The statement is returned reset, with the bindings cleared.
+	Statement* PrepareCached(const char* sql_text);
+	Statement* PrepareCached(const String& sql_text) { return PrepareCached(sql_text.C_Str()); }
 	void       CloseAllStatements();
 	ExecResult Exec(const char* sql_text);
 	ExecResult Exec(const String& sql_text) { return Exec(sql_text.C_Str()); }
 
 	void BeginTransaction();
 	void EndTransaction();
+	void RollbackTransaction();
 	void Vacuum();
 
+	// WAL journal, no fsync, exclusive lock. For databases that can be rebuilt (dumps, caches): a crash may lose the last
+	// transactions, and other connections can't open the file until this one is closed.
+	void SetScratchPragmas();
+
 	int64_t GetLastInsertRowid();
 	int     Changes();
 
@@ -159,6 +167,24 @@ private:
 	ConnectionPrivate* m_p {nullptr};
 };
 
+// Statements stepped inside a transaction are written to the journal once, not once per row. The transaction is committed by
+// the destructor unless Commit() or Rollback() was called before.
+class Transaction final
+{
+public:
+	explicit Transaction(Connection* db);
+	~Transaction();
+
+	void Commit();
+	void Rollback();
+
+	KYTY_CLASS_NO_COPY(Transaction);
+
+private:
+	Connection* m_db   = nullptr;
+	bool        m_done = false;
+};
+
 } // namespace Kyty::Core::Database
 
 #endif /* INCLUDE_KYTY_CORE_DATABASE_H_ */
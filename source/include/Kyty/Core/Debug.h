@@ -17,10 +17,21 @@ constexpr int DEBUG_MAX_STACK_DEPTH = 15;
 
 struct DebugMapPrivate;
 
+struct DebugSymbol
+{
+	uintptr_t   addr;
+	uintptr_t   length;
+	const char* name;
+	const char* obj;
+};
+
 namespace Debug {
 String GetCompiler();
 String GetLinker();
 String GetBitness();
+
+// Binary search in the map loaded by core_debug_init(), the strings live as long as the map
+bool FindSymbol(uintptr_t addr, DebugSymbol* sym);
 } // namespace Debug
 
 class DebugMap
@@ -75,11 +75,18 @@ public:
 	bool OpenInMem(void* buf, uint32_t buf_size);
 	bool OpenInMem(ByteBuffer& buf); // NOLINT(google-runtime-references)
 	bool CreateInMem();
+	// Read and write, a missing file is created and an existing one isn't truncated. Other processes may open the file too.
+	bool OpenOrCreate(const String& name);
 
 	void Close();
 
 	bool Flush();
 
+	// Exclusive lock between processes (and between File objects of one process), waits until it is taken. Only the processes which
+	// lock the file wait, reads and writes are not blocked.
+	bool Lock();
+	void Unlock();
+
 	[[nodiscard]] uint64_t Size() const;
 	[[nodiscard]] uint64_t Remaining() const;
 
@@ -88,6 +95,15 @@ public:
 
 	bool Truncate(uint64_t size);
 
+	// Maps the whole file read-only, nullptr if it can't be mapped. The mapping lives until Close().
+	const void* Map(uint64_t* size);
+	// Maps a page-aligned range of the file copy-on-write over the allocated memory at vaddr. False if the caller must read it.
+	bool MapFixed(uint64_t offset, uint64_t size, uint64_t vaddr);
+
+	// Files opened with Mode::Read are read through a buffer of READ_BUFFER_SIZE bytes, so small reads and ReadLine() don't go to
+	// the host each time. The next block is requested ahead while the file is read sequentially. 0 turns the buffer off.
+	void SetReadBufferSize(uint32_t size);
+
 	[[nodiscard]] bool IsInvalid() const;
 
 	[[nodiscard]] bool IsEOF() const { return Tell() >= Size(); }
@@ -95,8 +111,14 @@ public:
 	void GetLastAccessAndWriteTimeUTC(DateTime* access, DateTime* write);
 
 	void       Read(void* data, uint32_t size, uint32_t* bytes_read = nullptr);
+	void       Read(void* data, uint64_t size, uint64_t* bytes_read);
+	// Read-only files, see sys_file_read_at()
+	void       ReadAt(void* data, uint64_t size, uint64_t offset, uint64_t* bytes_read = nullptr);
+	void       WillNeed(uint64_t offset, uint64_t size); // Asks the host to read ahead
 	ByteBuffer Read(uint32_t size);
+	void       Read(uint32_t size, ByteBuffer* buf); // Replaces the contents of buf, its storage is reused
 	void       Write(const void* data, uint32_t size, uint32_t* bytes_written = nullptr);
+	void       Write(const void* data, uint64_t size, uint64_t* bytes_written);
 	void       Write(const ByteBuffer& buf, uint32_t* bytes_written = nullptr);
 	void       ReadR(void* data, uint32_t size);
 	void       WriteR(const void* data, uint32_t size);
@@ -113,9 +135,11 @@ public:
 	void PrintfLF(const char* format, ...) KYTY_FORMAT_PRINTF(2, 3);
 
 	ByteBuffer ReadWholeBuffer();
+	void       ReadWholeBuffer(ByteBuffer* buf);
 
 	static uint64_t Size(const String& name);
 	static String   Read(const String& name, Encoding e);
+	static uint64_t GetBytesRead(); // by all files since the start, mapped ranges are not counted
 
 	static bool IsDirectoryExisting(const String& path);
 	static bool IsFileExisting(const String& name);
@@ -136,7 +160,7 @@ public:
 	static Vector<FindInfo> FindFiles(const String& path);
 	static Vector<DirEntry> GetDirEntries(const String& path);
 	static bool             CopyFile(const String& src, const String& dst);
-	static bool             MoveFile(const String& src, const String& dst);
+	static bool             MoveFile(const String& src, const String& dst); // An existing dst is replaced atomically
 	static void             RemoveReadonly(const String& name);
 	static void             SyncDirectories(const String& src_dir, const String& dst_dir, bool del_dst = true);
 
@@ -147,15 +171,59 @@ public:
 
 	SDL_RWops* CreateSdlRWops();
 
+	static constexpr uint32_t READ_BUFFER_SIZE = 64 * 1024;
+
 	KYTY_CLASS_NO_COPY(File);
 
 private:
+	friend class MappedFile;
+
 	struct FilePrivate;
 
+	void DropReadBuffer();
+
 	String       m_file_name;
 	FilePrivate* m_p;
 };
 
+// A view of a range of the file. The view stays valid after the file is closed.
+// ReadOnly views fault on write, CopyOnWrite views can be changed, the changes are private and never reach the file.
+class MappedFile
+{
+public:
+	enum class Mode
+	{
+		ReadOnly,
+		CopyOnWrite
+	};
+
+	MappedFile() = default;
+	~MappedFile();
+
+	// size 0 maps up to the end of the file. Any offset is allowed, false if the range is outside the file or can't be mapped.
+	bool Map(File* f, Mode mode, uint64_t offset = 0, uint64_t size = 0);
+	bool Map(const String& name, Mode mode, uint64_t offset = 0, uint64_t size = 0);
+	void Unmap();
+
+	// Asks the host to read the pages ahead, offset is relative to the view
+	void Prefetch(uint64_t offset, uint64_t size) const;
+
+	[[nodiscard]] bool           IsMapped() const { return m_data != nullptr; }
+	[[nodiscard]] Mode           GetMode() const { return m_mode; }
+	[[nodiscard]] const uint8_t* GetData() const { return m_data; }
+	[[nodiscard]] uint8_t*       GetDataCow(); // CopyOnWrite views only
+	[[nodiscard]] uint64_t       GetSize() const { return m_size; }
+
+	KYTY_CLASS_NO_COPY(MappedFile);
+
+private:
+	void*    m_base      = nullptr;
+	uint64_t m_base_size = 0;
+	uint8_t* m_data      = nullptr;
+	uint64_t m_size      = 0;
+	Mode     m_mode      = Mode::ReadOnly;
+};
+
 } // namespace Kyty::Core
 
 #endif /* INCLUDE_KYTY_CORE_FILE_H_ */
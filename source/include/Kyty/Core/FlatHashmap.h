@@ -0,0 +1,302 @@
+#ifndef INCLUDE_KYTY_CORE_FLATHASHMAP_H_
+#define INCLUDE_KYTY_CORE_FLATHASHMAP_H_
+
+#include "Kyty/Core/Common.h"
+#include "Kyty/Core/DbgAssert.h"
+#include "Kyty/Core/Hashmap.h"
+
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace Kyty::Core {
+
+// Integers, enums and pointers are hashed inline, other keys use hash_calc<K>() (see Hashmap.h)
+template <class K>
+struct FlatHash
+{
+	uint32_t operator()(const K& key) const
+	{
+		if constexpr (std::is_integral_v<K> || std::is_enum_v<K> || std::is_pointer_v<K>)
+		{
+			uint64_t v = 0;
+			if constexpr (std::is_pointer_v<K>)
+			{
+				v = reinterpret_cast<uintptr_t>(key);
+			} else
+			{
+				v = static_cast<uint64_t>(key);
+			}
+			v ^= v >> 33u;
+			v *= 0xff51afd7ed558ccdULL;
+			v ^= v >> 33u;
+			v *= 0xc4ceb9fe1a85ec53ULL;
+			v ^= v >> 33u;
+			return static_cast<uint32_t>(v);
+		} else
+		{
+			return hash_calc<K>(&key);
+		}
+	}
+};
+
+// Open addressing with Robin Hood linear probing and backward shift deletion. Entries are stored in one array, so unlike
+// Hashmap, pointers and references to values are invalidated by Put(), operator[], GetOrPutDef() and Remove().
+template <class K, class V, class H = FlatHash<K>>
+class FlatHashmap
+{
+public:
+	FlatHashmap() = default;
+	virtual ~FlatHashmap()
+	{
+		Clear();
+		delete[] m_slots;
+		delete[] m_dist;
+	}
+
+	KYTY_CLASS_NO_COPY(FlatHashmap);
+
+	void Clear()
+	{
+		for (uint32_t i = 0; i < Capacity(); i++)
+		{
+			if (m_dist[i] != 0)
+			{
+				At(i)->~Entry();
+				m_dist[i] = 0;
+			}
+		}
+		m_size = 0;
+	}
+
+	[[nodiscard]] uint32_t Size() const { return m_size; }
+
+	V& operator[](const K& key) { return GetOrPutDef(key, V()); }
+
+	V& GetOrPutDef(const K& key, const V& def)
+	{
+		uint32_t index = FindIndex(key);
+		return (index != INVALID_INDEX ? At(index)->value : Insert(Entry {key, def})->value);
+	}
+
+	void Put(const K& key, const V& value)
+	{
+		uint32_t index = FindIndex(key);
+		if (index != INVALID_INDEX)
+		{
+			At(index)->value = value;
+		} else
+		{
+			Insert(Entry {key, value});
+		}
+	}
+
+	[[nodiscard]] V Get(const K& key, const V& default_value = V()) const
+	{
+		const V* v = Find(key);
+		return (v != nullptr ? *v : default_value);
+	}
+
+	[[nodiscard]] const V* Find(const K& key) const
+	{
+		uint32_t index = FindIndex(key);
+		return (index != INVALID_INDEX ? &At(index)->value : nullptr);
+	}
+
+	[[nodiscard]] V* Find(const K& key)
+	{
+		uint32_t index = FindIndex(key);
+		return (index != INVALID_INDEX ? &At(index)->value : nullptr);
+	}
+
+	// Lookup by a key of another type which H hashes and compares equal like K, e.g. a view of a string key
+	template <class Q>
+	[[nodiscard]] const V* FindEquivalent(const Q& key) const
+	{
+		uint32_t index = FindIndex(key);
+		return (index != INVALID_INDEX ? &At(index)->value : nullptr);
+	}
+
+	[[nodiscard]] bool Contains(const K& key) const { return FindIndex(key) != INVALID_INDEX; }
+
+	void Remove(const K& key)
+	{
+		uint32_t index = FindIndex(key);
+		if (index == INVALID_INDEX)
+		{
+			return;
+		}
+
+		At(index)->~Entry();
+
+		// Shift the following entries of the cluster back by one, until an empty slot or an entry in its home slot
+		for (;;)
+		{
+			uint32_t next = (index + 1) & m_mask;
+			if (m_dist[next] <= 1)
+			{
+				m_dist[index] = 0;
+				break;
+			}
+			new (At(index)) Entry(std::move(*At(next)));
+			At(next)->~Entry();
+			m_dist[index] = m_dist[next] - 1;
+			index         = next;
+		}
+
+		m_size--;
+	}
+
+	void Start() const
+	{
+		m_iter = 0;
+		Skip();
+	}
+
+	[[nodiscard]] bool End() const { return m_iter >= Capacity(); }
+
+	void Next() const
+	{
+		m_iter++;
+		Skip();
+	}
+
+	[[nodiscard]] const V& Value() const { return At(m_iter)->value; }
+
+	[[nodiscard]] const K& Key() const { return At(m_iter)->key; }
+
+	void ForEach(bool(KYTY_HASH_CALL* callback)(const K* key, const V* value, void* context), void* arg) const
+	{
+		for (uint32_t i = 0; i < Capacity(); i++)
+		{
+			if (m_dist[i] != 0 && !callback(&At(i)->key, &At(i)->value, arg))
+			{
+				break;
+			}
+		}
+	}
+
+private:
+	static constexpr uint32_t INVALID_INDEX = static_cast<uint32_t>(-1);
+	static constexpr uint32_t MIN_CAPACITY  = 16;
+
+	struct Entry
+	{
+		K key;
+		V value;
+	};
+
+	struct alignas(Entry) Slot
+	{
+		uint8_t data[sizeof(Entry)];
+	};
+
+	[[nodiscard]] uint32_t Capacity() const { return (m_slots != nullptr ? m_mask + 1 : 0); }
+
+	Entry*                     At(uint32_t index) { return std::launder(reinterpret_cast<Entry*>(m_slots[index].data)); }
+	[[nodiscard]] const Entry* At(uint32_t index) const { return std::launder(reinterpret_cast<const Entry*>(m_slots[index].data)); }
+
+	void Skip() const
+	{
+		while (m_iter < Capacity() && m_dist[m_iter] == 0)
+		{
+			m_iter++;
+		}
+	}
+
+	template <class Q>
+	[[nodiscard]] uint32_t FindIndex(const Q& key) const
+	{
+		if (m_size == 0)
+		{
+			return INVALID_INDEX;
+		}
+
+		uint32_t index = H()(key) & m_mask;
+		for (uint32_t dist = 1;; dist++)
+		{
+			// An entry closer to its home slot than the key would be means the key is absent
+			if (m_dist[index] < dist)
+			{
+				return INVALID_INDEX;
+			}
+			if (m_dist[index] == dist && At(index)->key == key)
+			{
+				return index;
+			}
+			index = (index + 1) & m_mask;
+		}
+	}
+
+	// The key must be absent. Returns the slot of the new entry.
+	Entry* Insert(Entry&& entry)
+	{
+		if ((m_size + 1) * 8 > Capacity() * 7)
+		{
+			Grow();
+		}
+
+		Entry*   ret   = nullptr;
+		uint32_t index = H()(entry.key) & m_mask;
+		for (uint32_t dist = 1;; dist++)
+		{
+			if (m_dist[index] == 0)
+			{
+				new (At(index)) Entry(std::move(entry));
+				m_dist[index] = dist;
+				m_size++;
+				return (ret != nullptr ? ret : At(index));
+			}
+			if (m_dist[index] < dist)
+			{
+				// Take the slot from the richer entry and carry it further
+				std::swap(entry, *At(index));
+				std::swap(dist, m_dist[index]);
+				if (ret == nullptr)
+				{
+					ret = At(index);
+				}
+			}
+			index = (index + 1) & m_mask;
+		}
+	}
+
+	void Grow()
+	{
+		uint32_t old_capacity = Capacity();
+		Slot*    old_slots    = m_slots;
+		auto*    old_dist     = m_dist;
+
+		uint32_t capacity = (old_capacity == 0 ? MIN_CAPACITY : old_capacity * 2);
+
+		EXIT_IF(capacity == 0);
+
+		m_slots = new Slot[capacity];
+		m_dist  = new uint32_t[capacity] {};
+		m_mask  = capacity - 1;
+		m_size  = 0;
+
+		for (uint32_t i = 0; i < old_capacity; i++)
+		{
+			if (old_dist[i] != 0)
+			{
+				auto* e = std::launder(reinterpret_cast<Entry*>(old_slots[i].data));
+				Insert(std::move(*e));
+				e->~Entry();
+			}
+		}
+
+		delete[] old_slots;
+		delete[] old_dist;
+	}
+
+	Slot*            m_slots = nullptr;
+	uint32_t*        m_dist  = nullptr; // 0 - empty slot, otherwise the distance from the home slot + 1
+	uint32_t         m_mask  = 0;
+	uint32_t         m_size  = 0;
+	mutable uint32_t m_iter  = 0;
+};
+
+} // namespace Kyty::Core
+
+#endif /* INCLUDE_KYTY_CORE_FLATHASHMAP_H_ */
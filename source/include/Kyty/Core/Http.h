@@ -0,0 +1,30 @@
+#ifndef INCLUDE_KYTY_CORE_HTTP_H_
+#define INCLUDE_KYTY_CORE_HTTP_H_
+
+#include "Kyty/Core/ByteBuffer.h"
+#include "Kyty/Core/Common.h"
+#include "Kyty/Core/String.h"
+
+namespace Kyty::Core {
+
+struct HttpUrl
+{
+	String   host;
+	uint16_t port = 80;
+	String   path = U"/";
+};
+
+// http://host[:port][/path]. There is no TLS, https isn't supported.
+bool HttpParseUrl(const String& url, HttpUrl* r);
+
+constexpr uint32_t HTTP_BODY_SIZE_MAX = 256u * 1024u * 1024u;
+
+// Blocking HTTP/1.0 requests over a new connection. Return the status code of the response, or 0 if the server can't be reached, the
+// timeout expires or the response is broken. The timeout applies to the connect and to each send and receive. A response body
+// larger than size_max is not received, the request fails.
+int HttpGet(const String& url, ByteBuffer* body, uint32_t timeout_ms, uint32_t size_max = HTTP_BODY_SIZE_MAX);
+int HttpPut(const String& url, const void* data, uint32_t size, uint32_t timeout_ms);
+
+} // namespace Kyty::Core
+
+#endif /* INCLUDE_KYTY_CORE_HTTP_H_ */
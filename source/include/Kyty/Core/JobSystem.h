@@ -0,0 +1,92 @@
+#ifndef INCLUDE_KYTY_CORE_JOBSYSTEM_H_
+#define INCLUDE_KYTY_CORE_JOBSYSTEM_H_
+
+#include "Kyty/Core/Common.h"
+#include "Kyty/Core/SmallVector.h"
+#include "Kyty/Core/Threads.h"
+
+#include <functional>
+
+namespace Kyty::Core {
+
+struct Job;
+
+// Workers take jobs of a higher lane first: High for work a frame is waiting for (detiling, draw-time shader translation),
+// Normal for loading, Low for speculative work (prefetch, async pipelines)
+enum class JobPriority
+{
+	High,
+	Normal,
+	Low,
+};
+
+constexpr int JOB_PRIORITIES_NUM = 3;
+
+// Set of jobs which can be waited for. Wait() runs the jobs of this group only, so a thread which holds a lock while waiting
+// never enters an unrelated job. Jobs may add more jobs to their own group.
+class TaskGroup
+{
+public:
+	TaskGroup() = default;
+	virtual ~TaskGroup();
+
+	KYTY_CLASS_NO_COPY(TaskGroup);
+
+	void Run(std::function<void()> func, JobPriority priority = JobPriority::Normal);
+
+	// Calls func(i) for every i < num, the calls are spread among the workers
+	void Run(uint32_t num, std::function<void(uint32_t)> func, JobPriority priority = JobPriority::Normal);
+
+	// func runs as a job of this group once all the jobs added so far are finished
+	void Then(std::function<void()> func, JobPriority priority = JobPriority::Normal);
+
+	// Returns when all jobs and continuations are finished
+	void Wait();
+
+	[[nodiscard]] bool IsDone();
+
+	friend class JobSystem;
+
+private:
+	void Add(Job* job, uint32_t num);
+	void FinishItem();
+	void Help();
+
+	Mutex                 m_mutex {"TaskGroup"};
+	CondVar               m_cond_var;
+	uint32_t              m_pending = 0;
+	SmallVector<Job*, 4>  m_jobs;
+	std::function<void()> m_continuation;
+	JobPriority           m_continuation_priority = JobPriority::Normal;
+};
+
+// Work-stealing pool shared by all subsystems. Every worker has a deque per priority lane: it pushes and pops its own jobs at
+// the back and steals from the front of the others'. Jobs submitted by other threads go to a shared queue.
+class JobSystem
+{
+public:
+	// The pool is created with GetWorkersNum() workers on first use, call this before to override the number
+	static void Init(int workers_num);
+
+	[[nodiscard]] static int GetWorkersNum();
+
+	// Queues func and returns immediately
+	static void Submit(std::function<void()> func, JobPriority priority = JobPriority::Normal);
+
+	// Calls func(i) for every i < num and returns when all calls are finished. The calling thread takes part.
+	static void ParallelFor(uint32_t num, std::function<void(uint32_t)> func, JobPriority priority = JobPriority::Normal);
+
+	[[nodiscard]] static bool IsWorkerThread();
+
+	friend class TaskGroup;
+	friend class JobPool;
+
+private:
+	static void Push(Job* job);
+	static void RunItem(Job* job, uint32_t index);
+	static void Release(Job* job);
+};
+
+} // namespace Kyty::Core
+
+#endif /* INCLUDE_KYTY_CORE_JOBSYSTEM_H_ */
@@ -3,6 +3,8 @@
 
 #include "Kyty/Core/Common.h"
 #include "Kyty/Core/String.h"
+#include "Kyty/Core/String8.h"
+#include "Kyty/Core/StringView8.h"
 #include "Kyty/Core/Vector.h"
 
 namespace Kyty::Core {
@@ -75,6 +77,41 @@ private:
 	String   m_name;
 };
 
+// Events of JsonSax::Parse(). Keys and strings are views into the input without the quotes. If escaped is true the escape
+// sequences are still there, JsonSax::Unescape() decodes them. Returning false stops the parser.
+class JsonSaxHandler
+{
+public:
+	virtual ~JsonSaxHandler() = default;
+
+	virtual bool Null() { return true; }
+	virtual bool Bool(bool /*value*/) { return true; }
+	virtual bool Int(int64_t /*value*/) { return true; }                             // Numbers without a fraction or an exponent that fit
+	virtual bool Uint(uint64_t value) { return Float(static_cast<double>(value)); }  // Same, above INT64_MAX
+	virtual bool Float(double /*value*/) { return true; }                            // All other numbers
+	virtual bool Str(StringView8 /*value*/, bool /*escaped*/) { return true; }
+	virtual bool Key(StringView8 /*key*/, bool /*escaped*/) { return true; }
+	virtual bool StartObject() { return true; }
+	virtual bool EndObject() { return true; }
+	virtual bool StartArray() { return true; }
+	virtual bool EndArray() { return true; }
+};
+
+// Streaming UTF-8 parser. Unlike Json::Create() it builds no tree and doesn't allocate, the input must outlive the views.
+class JsonSax
+{
+public:
+	// False on a syntax error or if the handler stopped, error_offset is then the position in data
+	static bool Parse(const char* data, uint32_t size, JsonSaxHandler* handler, uint32_t* error_offset = nullptr);
+	static bool Parse(StringView8 str, JsonSaxHandler* handler, uint32_t* error_offset = nullptr)
+	{
+		return Parse(str.GetDataConst(), str.Size(), handler, error_offset);
+	}
+
+	// Decodes \n, \uXXXX (with surrogate pairs) and the other escapes
+	static String8 Unescape(StringView8 str);
+};
+
 } // namespace Kyty::Core
 
 #endif /* INCLUDE_KYTY_CORE_JSONREADER_H_ */
@@ -0,0 +1,32 @@
+#ifndef INCLUDE_KYTY_CORE_LOCKPROFILER_H_
+#define INCLUDE_KYTY_CORE_LOCKPROFILER_H_
+
+#include "Kyty/Core/Common.h"
+
+namespace Kyty::Core {
+
+struct LockProfilerStats;
+
+// Wait time, hold time and contention of Core::Mutex and guest mutexes. The locks report here only in a build with
+// -D KYTY_PROFILE_LOCKS=ON. Locks of the same name share the counters, the report is sorted by the total wait time.
+class LockProfiler
+{
+public:
+	// Prints the report every period_seconds and at exit
+	static void Init(uint32_t period_seconds);
+
+	// Counters of the locks named name. They are never freed, a lock keeps the pointer.
+	[[nodiscard]] static LockProfilerStats* GetStats(const char* name);
+
+	// Nanoseconds
+	[[nodiscard]] static uint64_t GetTime();
+
+	static void Locked(LockProfilerStats* stats, uint64_t wait_time, bool contended);
+	static void Unlocked(LockProfilerStats* stats, uint64_t hold_time);
+
+	static void Dump();
+};
+
+} // namespace Kyty::Core
+
+#endif /* INCLUDE_KYTY_CORE_LOCKPROFILER_H_ */
@@ -16,17 +16,18 @@ struct MemStats
 	uint32_t blocks_num;
 };
 
-void* mem_alloc(size_t size);
-void* mem_realloc(void* ptr, size_t size);
-void  mem_free(void* ptr);
-void  mem_print(int from_state);
-void  mem_get_stat(MemStats* s);
-void  mem_set_max_size(size_t size);
-int   mem_new_state();
-bool  mem_tracker_enabled();
-void  mem_tracker_enable();
-void  mem_tracker_disable();
-bool  mem_check(const void* ptr);
+void*    mem_alloc(size_t size);
+void*    mem_realloc(void* ptr, size_t size);
+void     mem_free(void* ptr);
+void     mem_print(int from_state);
+void     mem_get_stat(MemStats* s);
+uint64_t mem_get_alloc_num(); // calls of mem_alloc() since the start
+void     mem_set_max_size(size_t size);
+int      mem_new_state();
+bool     mem_tracker_enabled();
+void     mem_tracker_enable();
+void     mem_tracker_disable();
+bool     mem_check(const void* ptr);
 
 #define KYTY_MEM_CHECK(ptr) EXIT_IF(!mem_check(ptr))
 
@@ -0,0 +1,49 @@
+#ifndef INCLUDE_KYTY_CORE_SHAREDSTORE_H_
+#define INCLUDE_KYTY_CORE_SHAREDSTORE_H_
+
+#include "Kyty/Core/ByteBuffer.h"
+#include "Kyty/Core/Common.h"
+#include "Kyty/Core/String.h"
+
+namespace Kyty::Core {
+
+struct SharedStorePrivate;
+
+// Append-only key-value store in one file which several processes use at the same time. Readers map the file and don't lock it. A
+// writer appends the record under the file lock and then publishes the new end in the header, so the other processes see either
+// the whole record or nothing. The first valid record of a key wins, a broken one (which fails the check) is replaced by the next
+// Append(). When the file would grow over its size limit, the writer compacts it: the broken and replaced records are dropped and
+// then the oldest ones, until the rest fits in the half of the limit.
+class SharedStore
+{
+public:
+	static constexpr uint64_t SIZE_MAX_DEFAULT = 512ull * 1024 * 1024;
+	static constexpr uint64_t SIZE_MAX_MIN     = 64ull * 1024;
+
+	SharedStore() = default;
+	virtual ~SharedStore();
+
+	// Creates the file if it doesn't exist. False if it can't be opened or was written by another version.
+	bool Open(const String& file_name, uint64_t size_max = SIZE_MAX_DEFAULT);
+	void Close();
+
+	[[nodiscard]] bool IsInvalid() const { return m_p == nullptr; }
+
+	// Copies the value. Records appended by other processes since the last call are found too.
+	bool Find(uint64_t key, ByteBuffer* value);
+
+	// False if there is a valid record with the key already or the value is larger than the half of the size limit
+	bool Append(uint64_t key, const void* value, uint32_t size);
+	bool Append(uint64_t key, const ByteBuffer& value);
+
+	[[nodiscard]] uint32_t GetRecordsNum();
+
+	KYTY_CLASS_NO_COPY(SharedStore);
+
+private:
+	SharedStorePrivate* m_p = nullptr;
+};
+
+} // namespace Kyty::Core
+
+#endif /* INCLUDE_KYTY_CORE_SHAREDSTORE_H_ */
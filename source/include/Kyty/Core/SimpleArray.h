@@ -129,6 +129,18 @@ public:
 
 	void Expand(uint32_t num) { expand(num); } // @suppress("Ambiguous problem")
 
+	// New values are not initialized, the storage is kept when the array shrinks
+	template <typename U = T>
+	IsTriviallyCopyable<U, void> Resize(uint32_t size)
+	{
+		if (size > m_values_num)
+		{
+			expand(size - m_values_num); // @suppress("Ambiguous problem")
+		}
+		m_values_num = size;
+		m_hash       = 0;
+	}
+
 	void Add(const T& val)
 	{
 		uint32_t values_i = m_values_num;
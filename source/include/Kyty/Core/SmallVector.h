@@ -0,0 +1,264 @@
+#ifndef INCLUDE_KYTY_CORE_SMALLVECTOR_H_
+#define INCLUDE_KYTY_CORE_SMALLVECTOR_H_
+
+#include "Kyty/Core/Common.h"
+#include "Kyty/Core/DbgAssert.h"
+#include "Kyty/Core/MemoryAlloc.h"
+
+#include <algorithm>
+#include <initializer_list>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace Kyty::Core {
+
+// Vector without reference counting and copy-on-write. The first N elements are stored inline, so a small temporary doesn't
+// allocate. Copies are deep, moves steal the heap buffer. SmallVector<T, 0> is a plain heap vector.
+template <typename T, uint32_t N>
+class SmallVector
+{
+public:
+	using iterator       = T*;       // NOLINT(readability-identifier-naming)
+	using const_iterator = const T*; // NOLINT(readability-identifier-naming)
+
+	static constexpr uint32_t INVALID_INDEX = static_cast<uint32_t>(-1);
+
+	SmallVector() = default;
+
+	SmallVector(const SmallVector& src)
+	{
+		Reserve(src.m_size);
+		for (uint32_t i = 0; i < src.m_size; i++)
+		{
+			new (m_ptr + i) T(src.m_ptr[i]);
+		}
+		m_size = src.m_size;
+	}
+
+	SmallVector(SmallVector&& src) noexcept { MoveFrom(std::move(src)); }
+
+	SmallVector(std::initializer_list<T> list)
+	{
+		Reserve(static_cast<uint32_t>(list.size()));
+		for (const auto& v: list)
+		{
+			new (m_ptr + m_size) T(v);
+			m_size++;
+		}
+	}
+
+	~SmallVector()
+	{
+		Clear();
+		FreeHeap();
+	}
+
+	SmallVector& operator=(const SmallVector& src)
+	{
+		if (this != &src)
+		{
+			Clear();
+			Reserve(src.m_size);
+			for (uint32_t i = 0; i < src.m_size; i++)
+			{
+				new (m_ptr + i) T(src.m_ptr[i]);
+			}
+			m_size = src.m_size;
+		}
+		return *this;
+	}
+
+	SmallVector& operator=(SmallVector&& src) noexcept
+	{
+		if (this != &src)
+		{
+			Clear();
+			FreeHeap();
+			MoveFrom(std::move(src));
+		}
+		return *this;
+	}
+
+	[[nodiscard]] uint32_t Size() const { return m_size; }
+	[[nodiscard]] uint32_t Capacity() const { return m_capacity; }
+	[[nodiscard]] bool     IsEmpty() const { return m_size == 0; }
+
+	// Destroys the elements, keeps the memory
+	void Clear()
+	{
+		for (uint32_t i = 0; i < m_size; i++)
+		{
+			m_ptr[i].~T();
+		}
+		m_size = 0;
+	}
+
+	void Reserve(uint32_t capacity)
+	{
+		if (capacity <= m_capacity)
+		{
+			return;
+		}
+
+		auto* values = static_cast<T*>(mem_alloc(static_cast<size_t>(capacity) * sizeof(T)));
+		for (uint32_t i = 0; i < m_size; i++)
+		{
+			new (values + i) T(std::move(m_ptr[i]));
+			m_ptr[i].~T();
+		}
+
+		FreeHeap();
+
+		m_ptr      = values;
+		m_capacity = capacity;
+	}
+
+	void Add(const T& val)
+	{
+		if (m_size == m_capacity)
+		{
+			// The value may be an element of this vector
+			T copy(val);
+			Grow();
+			new (m_ptr + m_size) T(std::move(copy));
+		} else
+		{
+			new (m_ptr + m_size) T(val);
+		}
+		m_size++;
+	}
+
+	void Add(T&& val)
+	{
+		if (m_size == m_capacity)
+		{
+			T tmp(std::move(val));
+			Grow();
+			new (m_ptr + m_size) T(std::move(tmp));
+		} else
+		{
+			new (m_ptr + m_size) T(std::move(val));
+		}
+		m_size++;
+	}
+
+	bool RemoveAt(uint32_t index, uint32_t count = 1)
+	{
+		if (index >= m_size || count == 0 || count > m_size - index)
+		{
+			return false;
+		}
+		for (uint32_t i = index; i + count < m_size; i++)
+		{
+			m_ptr[i] = std::move(m_ptr[i + count]);
+		}
+		for (uint32_t i = m_size - count; i < m_size; i++)
+		{
+			m_ptr[i].~T();
+		}
+		m_size -= count;
+		return true;
+	}
+
+	[[nodiscard]] uint32_t Find(const T& t) const
+	{
+		for (uint32_t i = 0; i < m_size; i++)
+		{
+			if (m_ptr[i] == t)
+			{
+				return i;
+			}
+		}
+		return INVALID_INDEX;
+	}
+
+	[[nodiscard]] bool Contains(const T& t) const { return Find(t) != INVALID_INDEX; }
+
+	bool Remove(const T& t) { return RemoveAt(Find(t)); }
+
+	[[nodiscard]] bool IndexValid(uint32_t index) const { return index < m_size; }
+
+	template <typename OP>
+	void Sort(OP&& comp_func)
+	{
+		std::sort(begin(), end(), std::forward<OP>(comp_func));
+	}
+
+	T& operator[](uint32_t index)
+	{
+		EXIT_IF(index >= m_size);
+		return m_ptr[index];
+	}
+
+	const T& operator[](uint32_t index) const
+	{
+		EXIT_IF(index >= m_size);
+		return m_ptr[index];
+	}
+
+	[[nodiscard]] const T& At(uint32_t index) const
+	{
+		EXIT_IF(index >= m_size);
+		return m_ptr[index];
+	}
+
+	T*                     GetData() { return m_ptr; }
+	[[nodiscard]] const T* GetData() const { return m_ptr; }
+	[[nodiscard]] const T* GetDataConst() const { return m_ptr; }
+
+	iterator                     begin() { return m_ptr; }                   // NOLINT(readability-identifier-naming)
+	iterator                     end() { return m_ptr + m_size; }            // NOLINT(readability-identifier-naming)
+	[[nodiscard]] const_iterator begin() const { return m_ptr; }             // NOLINT(readability-identifier-naming)
+	[[nodiscard]] const_iterator end() const { return m_ptr + m_size; }      // NOLINT(readability-identifier-naming)
+	[[nodiscard]] const_iterator cbegin() const { return m_ptr; }            // NOLINT(readability-identifier-naming)
+	[[nodiscard]] const_iterator cend() const { return m_ptr + m_size; }     // NOLINT(readability-identifier-naming)
+
+private:
+	[[nodiscard]] T* Inline() { return std::launder(reinterpret_cast<T*>(m_inline)); }
+
+	[[nodiscard]] bool IsInline() const { return m_ptr == reinterpret_cast<const T*>(m_inline); }
+
+	void Grow() { Reserve(m_capacity < 4 ? 4 : m_capacity * 2); }
+
+	void FreeHeap()
+	{
+		if (!IsInline())
+		{
+			mem_free(m_ptr);
+			m_ptr      = Inline();
+			m_capacity = N;
+		}
+	}
+
+	// This vector must be empty and inline
+	void MoveFrom(SmallVector&& src)
+	{
+		if (src.IsInline())
+		{
+			for (uint32_t i = 0; i < src.m_size; i++)
+			{
+				new (m_ptr + i) T(std::move(src.m_ptr[i]));
+			}
+			m_size = src.m_size;
+			src.Clear();
+		} else
+		{
+			m_ptr          = src.m_ptr;
+			m_size         = src.m_size;
+			m_capacity     = src.m_capacity;
+			src.m_ptr      = src.Inline();
+			src.m_size     = 0;
+			src.m_capacity = N;
+		}
+	}
+
+	alignas(T) uint8_t m_inline[N > 0 ? N * sizeof(T) : 1];
+	T*       m_ptr      = Inline();
+	uint32_t m_size     = 0;
+	uint32_t m_capacity = N;
+};
+
+} // namespace Kyty::Core
+
+#endif /* INCLUDE_KYTY_CORE_SMALLVECTOR_H_ */
@@ -51,6 +51,9 @@ public:
 	static char32_t ToLower(char32_t ucs4);
 	static char32_t ToUpper(char32_t ucs4);
 
+	// Unicode properties. The functions above don't go to the tables for ASCII.
+	static const CharProperty& GetProperty(char32_t ucs4);
+
 	static char32_t ReadCp866(const uint8_t** str);
 	static char32_t ReadCp1251(const uint8_t** str);
 	static char32_t ReadUtf8(const uint8_t** str);
@@ -63,6 +66,90 @@ public:
 	static bool EqualAsciiNoCaseN(const char32_t* utf32_str, const char* ascii_str, int n);
 };
 
+inline bool Char::IsDecimal(char32_t ucs4)
+{
+	return ucs4 < 0x80 ? (ucs4 - U'0' < 10u) : GetProperty(ucs4).decimal != 0;
+}
+
+inline bool Char::IsAlpha(char32_t ucs4)
+{
+	return ucs4 < 0x80 ? ((ucs4 | 0x20u) - U'a' < 26u) : GetProperty(ucs4).alpha != 0;
+}
+
+inline bool Char::IsAlphaNum(char32_t ucs4)
+{
+	if (ucs4 < 0x80)
+	{
+		return (ucs4 - U'0' < 10u) || ((ucs4 | 0x20u) - U'a' < 26u);
+	}
+	const CharProperty& p = GetProperty(ucs4);
+	return (p.alpha || p.decimal);
+}
+
+inline bool Char::IsLower(char32_t ucs4)
+{
+	return ucs4 < 0x80 ? (ucs4 - U'a' < 26u) : GetProperty(ucs4).lower != 0;
+}
+
+inline bool Char::IsUpper(char32_t ucs4)
+{
+	return ucs4 < 0x80 ? (ucs4 - U'A' < 26u) : GetProperty(ucs4).upper != 0;
+}
+
+inline bool Char::IsSpace(char32_t ucs4)
+{
+	return ucs4 < 0x80 ? (ucs4 == U' ' || ucs4 - U'\t' < 5u) : GetProperty(ucs4).space != 0;
+}
+
+inline bool Char::IsHex(char32_t ucs4)
+{
+	return ucs4 < 0x80 ? (ucs4 - U'0' < 10u || (ucs4 | 0x20u) - U'a' < 6u) : GetProperty(ucs4).hex != 0;
+}
+
+inline int Char::HexDigit(char32_t ucs4)
+{
+	if (ucs4 < 0x80)
+	{
+		if (ucs4 - U'0' < 10u)
+		{
+			return static_cast<int>(ucs4 - U'0');
+		}
+		return (ucs4 | 0x20u) - U'a' < 6u ? static_cast<int>((ucs4 | 0x20u) - U'a' + 10) : -1;
+	}
+	const CharProperty& p = GetProperty(ucs4);
+	return p.hex ? p.hex_data : -1;
+}
+
+inline int Char::DecimalDigit(char32_t ucs4)
+{
+	if (ucs4 < 0x80)
+	{
+		return ucs4 - U'0' < 10u ? static_cast<int>(ucs4 - U'0') : -1;
+	}
+	const CharProperty& p = GetProperty(ucs4);
+	return p.decimal ? p.hex_data : -1;
+}
+
+inline char32_t Char::ToLower(char32_t ucs4)
+{
+	if (ucs4 < 0x80)
+	{
+		return ucs4 - U'A' < 26u ? ucs4 + 0x20u : ucs4;
+	}
+	const CharProperty& p = GetProperty(ucs4);
+	return p.upper ? ucs4 + p.case_offset : ucs4;
+}
+
+inline char32_t Char::ToUpper(char32_t ucs4)
+{
+	if (ucs4 < 0x80)
+	{
+		return ucs4 - U'a' < 26u ? ucs4 - 0x20u : ucs4;
+	}
+	const CharProperty& p = GetProperty(ucs4);
+	return p.lower ? ucs4 + p.case_offset : ucs4;
+}
+
 class String
 {
 public:
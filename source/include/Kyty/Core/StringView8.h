@@ -0,0 +1,133 @@
+#ifndef INCLUDE_KYTY_CORE_STRINGVIEW8_H_
+#define INCLUDE_KYTY_CORE_STRINGVIEW8_H_
+
+#include "Kyty/Core/Common.h"
+#include "Kyty/Core/DbgAssert.h"
+#include "Kyty/Core/Hash.h"
+#include "Kyty/Core/SmallVector.h"
+#include "Kyty/Core/String.h"
+#include "Kyty/Core/String8.h"
+
+#include <cstring>
+
+namespace Kyty::Core {
+
+class StringView8;
+
+using StringViewList8 = SmallVector<StringView8, 8>;
+
+// Non-owning UTF-8 string. Slicing and splitting don't copy or allocate, so guest paths and symbol names can be parsed and
+// looked up without converting them to String. The viewed memory must outlive the view, and the view is not null-terminated.
+class StringView8
+{
+public:
+	using SplitType = String8::SplitType;
+
+	constexpr StringView8() = default;
+	constexpr StringView8(const char* str, uint32_t size): m_data(str), m_size(size) {}
+	StringView8(const char* str): m_data(str), m_size(str != nullptr ? static_cast<uint32_t>(strlen(str)) : 0) {} // NOLINT
+	StringView8(const String8& str): m_data(str.GetDataConst()), m_size(str.Size()) {} // NOLINT(google-explicit-constructor)
+
+	[[nodiscard]] uint32_t    Size() const { return m_size; }
+	[[nodiscard]] bool        IsEmpty() const { return m_size == 0; }
+	[[nodiscard]] const char* GetDataConst() const { return m_data; }
+
+	const char& operator[](uint32_t index) const
+	{
+		EXIT_IF(index >= m_size);
+		return m_data[index];
+	}
+
+	[[nodiscard]] StringView8 Mid(uint32_t first, uint32_t count) const
+	{
+		if (first >= m_size)
+		{
+			return {};
+		}
+		return {m_data + first, (count > m_size - first ? m_size - first : count)};
+	}
+	[[nodiscard]] StringView8 Mid(uint32_t first) const { return Mid(first, m_size); }
+	[[nodiscard]] StringView8 Left(uint32_t count) const { return Mid(0, count); }
+	[[nodiscard]] StringView8 RemoveFirst(uint32_t num) const { return Mid(num); }
+
+	[[nodiscard]] bool IndexValid(uint32_t index) const { return index < m_size; }
+
+	[[nodiscard]] uint32_t FindIndex(char chr, uint32_t from = 0) const
+	{
+		for (uint32_t i = from; i < m_size; i++)
+		{
+			if (m_data[i] == chr)
+			{
+				return i;
+			}
+		}
+		return STRING8_INVALID_INDEX;
+	}
+
+	[[nodiscard]] uint32_t FindLastIndex(char chr) const
+	{
+		for (uint32_t i = m_size; i > 0; i--)
+		{
+			if (m_data[i - 1] == chr)
+			{
+				return i - 1;
+			}
+		}
+		return STRING8_INVALID_INDEX;
+	}
+
+	[[nodiscard]] bool StartsWith(StringView8 str) const { return str.m_size <= m_size && memcmp(m_data, str.m_data, str.m_size) == 0; }
+	[[nodiscard]] bool EndsWith(StringView8 str) const
+	{
+		return str.m_size <= m_size && memcmp(m_data + m_size - str.m_size, str.m_data, str.m_size) == 0;
+	}
+	[[nodiscard]] bool StartsWith(char chr) const { return m_size > 0 && m_data[0] == chr; }
+	[[nodiscard]] bool EndsWith(char chr) const { return m_size > 0 && m_data[m_size - 1] == chr; }
+
+	[[nodiscard]] bool Equal(StringView8 str) const { return m_size == str.m_size && memcmp(m_data, str.m_data, m_size) == 0; }
+
+	friend bool operator==(StringView8 str1, StringView8 str2) { return str1.Equal(str2); }
+	friend bool operator!=(StringView8 str1, StringView8 str2) { return !str1.Equal(str2); }
+
+	// Parts point into this view
+	[[nodiscard]] StringViewList8 Split(char sep, SplitType type = SplitType::SplitNoEmptyParts) const
+	{
+		StringViewList8 list;
+		uint32_t        first = 0;
+		for (uint32_t i = 0; i <= m_size; i++)
+		{
+			if (i == m_size || m_data[i] == sep)
+			{
+				if (i > first || type == SplitType::WithEmptyParts)
+				{
+					list.Add(StringView8(m_data + first, i - first));
+				}
+				first = i + 1;
+			}
+		}
+		return list;
+	}
+
+	[[nodiscard]] uint32_t Hash() const { return hash(m_data, m_size); }
+
+	[[nodiscard]] String8 ToString8() const { return String8(m_data, m_size); }
+	[[nodiscard]] String  ToString() const { return String::FromUtf8(m_data, m_size); }
+
+private:
+	const char* m_data = "";
+	uint32_t    m_size = 0;
+};
+
+// Hashes String8 keys and their views the same way, so FlatHashmap<String8, V, StringHash8>::FindEquivalent() takes a view
+struct StringHash8
+{
+	uint32_t operator()(StringView8 str) const { return str.Hash(); }
+};
+
+} // namespace Kyty::Core
+
+namespace Kyty {
+using StringView8 = Core::StringView8;
+} // namespace Kyty
+
+#endif /* INCLUDE_KYTY_CORE_STRINGVIEW8_H_ */
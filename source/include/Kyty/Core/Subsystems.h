@@ -21,8 +21,12 @@ public:
 
 	// void Add(Subsystem* s, const char* name, ...);
 	void Add(Subsystem* s, std::initializer_list<Subsystem*> deps);
+	// Init() doesn't need the main thread and may run on a worker, at the same time as the other subsystems
+	void AddConcurrent(Subsystem* s, std::initializer_list<Subsystem*> deps);
 
-	bool InitAll(bool print_msg = false);
+	// With workers_num > 0 the concurrent subsystems are initialized by that many threads as soon as their dependencies are ready,
+	// the rest are initialized by the calling thread in the meantime. The destroy order is the reverse of the actual init order.
+	bool InitAll(bool print_msg = false, int workers_num = 0);
 	void DestroyAll(bool print_msg = false);
 
 	int*   GetArgc();
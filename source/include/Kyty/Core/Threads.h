@@ -53,6 +53,8 @@ class Mutex
 {
 public:
 	Mutex();
+	// Mutexes of the same name are reported together by the lock profiler
+	explicit Mutex(const char* name);
 	virtual ~Mutex();
 
 	void Lock();
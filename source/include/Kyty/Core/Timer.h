@@ -36,6 +36,11 @@ public:
 	[[nodiscard]] static uint64_t QueryPerformanceFrequency();
 	[[nodiscard]] static uint64_t QueryPerformanceCounter();
 
+	// Sleeps until QueryPerformanceCounter() reaches the counter. The OS timer wakes the thread a little early, the last
+	// microseconds are spun.
+	static void SleepUntil(uint64_t counter);
+	static void SleepPrecise(uint64_t nanos);
+
 private:
 	bool     m_is_paused = true;
 	uint64_t m_Frequency = 0;
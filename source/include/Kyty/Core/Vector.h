@@ -94,6 +94,13 @@ public:
 		m_data->Expand(num);
 	}
 
+	// Only for trivially copyable types, new elements are not initialized
+	void Resize(uint32_t size)
+	{
+		copy_on_write();
+		m_data->Resize(size);
+	}
+
 	void Add(const T& val)
 	{
 		copy_on_write();
@@ -79,6 +79,11 @@ inline bool IsExecute(Mode mode)
 	return (mode == Mode::Execute || mode == Mode::ExecuteRead || mode == Mode::ExecuteWrite || mode == Mode::ExecuteReadWrite);
 }
 
+inline bool IsWrite(Mode mode)
+{
+	return (mode == Mode::Write || mode == Mode::ReadWrite || mode == Mode::ExecuteWrite || mode == Mode::ExecuteReadWrite);
+}
+
 void Init();
 
 uint64_t Alloc(uint64_t address, uint64_t size, Mode mode);
@@ -89,6 +94,50 @@ bool     Protect(uint64_t address, uint64_t size, Mode mode, Mode* old_mode = nu
 bool     FlushInstructionCache(uint64_t address, uint64_t size);
 bool     PatchReplace(uint64_t vaddr, uint64_t value);
 
+// Same as AllocAligned()/AllocFixed(), but try to back the range with large pages (2 MB THP on Linux, large pages on Windows).
+// Fall back to normal pages when the host can't provide them. LargePageSize() is 0 if large pages are not available at all.
+// If LargePagesProtectable() is false, Protect() on a part of a large page fails.
+uint64_t AllocAlignedLarge(uint64_t address, uint64_t size, Mode mode, uint64_t alignment);
+bool     AllocFixedLarge(uint64_t address, uint64_t size, Mode mode);
+uint64_t LargePageSize();
+bool     LargePagesProtectable();
+
+// Same as Alloc(), but host memory is taken by the pages which are touched only: the host doesn't reserve memory for the range
+// (MAP_NORESERVE on Linux) and never backs it with large pages
+uint64_t AllocLazy(uint64_t address, uint64_t size, Mode mode);
+
+class PatchBatchPrivate;
+
+// Protection changes for many small writes. The pages of all patch sites are added first. Begin() makes them writable with one
+// call per run of adjacent pages of the same mode, End() restores the modes the same way and flushes the instruction cache once.
+// The writes between Begin() and End() may come from any thread.
+class PatchBatch
+{
+public:
+	PatchBatch();
+	virtual ~PatchBatch();
+
+	KYTY_CLASS_NO_COPY(PatchBatch);
+
+	void Add(uint64_t address, uint64_t size);
+
+	void Begin();
+	void End();
+
+	// Same as PatchReplace(), the page must be added
+	static bool Replace(uint64_t vaddr, uint64_t value);
+
+	[[nodiscard]] uint32_t GetRunsNum() const;
+
+private:
+	PatchBatchPrivate* m_p = nullptr;
+};
+
+// A per-thread 8-byte slot that code can read with one segment-relative load: 'mov rax, qword ptr <segment>:[offset]'.
+// The segment override prefix and the offset are the same for all threads.
+bool ThreadSlotAlloc(uint8_t* segment_prefix, uint32_t* offset);
+bool ThreadSlotSet(uint64_t value);
+
 } // namespace VirtualMemory
 
 } // namespace Kyty::Core
@@ -7,6 +7,10 @@
 
 namespace Kyty::Math {
 
+// AES-NI and PCLMULQDQ are used when CPUID reports them. Tests and benchmarks turn them off to compare with the table code.
+void               CryptoEnableCpuExtensions(bool enabled);
+[[nodiscard]] bool CryptoIsCpuExtensionsEnabled();
+
 namespace AES {
 enum class Mode
 {
@@ -312,6 +312,17 @@ MAT4_DECL mat4 operator*(float s, const mat4& m)
 
 MAT4_DECL mat4 operator*(const mat4& m1, const mat4& m2)
 {
+#ifdef KYTY_MATH_SSE
+	__m128 c0 = simd::load(m1.data[0]);
+	__m128 c1 = simd::load(m1.data[1]);
+	__m128 c2 = simd::load(m1.data[2]);
+	__m128 c3 = simd::load(m1.data[3]);
+
+	return mat4(simd::store(simd::mul(c0, c1, c2, c3, simd::load(m2.data[0]))),
+	            simd::store(simd::mul(c0, c1, c2, c3, simd::load(m2.data[1]))),
+	            simd::store(simd::mul(c0, c1, c2, c3, simd::load(m2.data[2]))),
+	            simd::store(simd::mul(c0, c1, c2, c3, simd::load(m2.data[3]))));
+#else
 	/*#define MUL4(i, j)*/ auto mul4 = [&](auto i, auto j) {
 		return (m1.data[0].data[(j)] * m2.data[(i)].data[0] + m1.data[1].data[(j)] * m2.data[(i)].data[1] +
 		        m1.data[2].data[(j)] * m2.data[(i)].data[2] + m1.data[3].data[(j)] * m2.data[(i)].data[3]);
@@ -321,10 +332,15 @@ MAT4_DECL mat4 operator*(const mat4& m1, const mat4& m2)
 	            mul4(2, 2), mul4(2, 3), mul4(3, 0), mul4(3, 1), mul4(3, 2), mul4(3, 3));
 
 	//#undef MUL4
+#endif
 }
 
 MAT4_DECL vec4 operator*(const mat4& m, const vec4& v)
 {
+#ifdef KYTY_MATH_SSE
+	return simd::store(
+	    simd::mul(simd::load(m.data[0]), simd::load(m.data[1]), simd::load(m.data[2]), simd::load(m.data[3]), simd::load(v)));
+#else
 	float x1 = m.data[0].x * v.x + m.data[1].x * v.y;
 	float x2 = m.data[2].x * v.z + m.data[3].x * v.w;
 	float y1 = m.data[0].y * v.x + m.data[1].y * v.y;
@@ -335,6 +351,7 @@ MAT4_DECL vec4 operator*(const mat4& m, const vec4& v)
 	float w2 = m.data[2].w * v.z + m.data[3].w * v.w;
 
 	return vec4(x1 + x2, y1 + y2, z1 + z2, w1 + w2);
+#endif
 
 	//	return vec4(m.data[0].x * v.x + m.data[1].x * v.y + m.data[2].x * v.z + m.data[3].x * v.w,
 	//				m.data[0].y * v.x + m.data[1].y * v.y + m.data[2].y * v.z + m.data[3].y * v.w,
@@ -344,10 +361,21 @@ MAT4_DECL vec4 operator*(const mat4& m, const vec4& v)
 
 MAT4_DECL vec4 operator*(const vec4& v, const mat4& m)
 {
+#ifdef KYTY_MATH_SSE
+	// Four dot products: transpose the products and add the rows
+	__m128 r  = simd::load(v);
+	__m128 p0 = _mm_mul_ps(simd::load(m.data[0]), r);
+	__m128 p1 = _mm_mul_ps(simd::load(m.data[1]), r);
+	__m128 p2 = _mm_mul_ps(simd::load(m.data[2]), r);
+	__m128 p3 = _mm_mul_ps(simd::load(m.data[3]), r);
+	_MM_TRANSPOSE4_PS(p0, p1, p2, p3);
+	return simd::store(_mm_add_ps(_mm_add_ps(p0, p1), _mm_add_ps(p2, p3)));
+#else
 	return vec4(m.data[0].x * v.x + m.data[0].y * v.y + m.data[0].z * v.z + m.data[0].w * v.w,
 	            m.data[1].x * v.x + m.data[1].y * v.y + m.data[1].z * v.z + m.data[1].w * v.w,
 	            m.data[2].x * v.x + m.data[2].y * v.y + m.data[2].z * v.z + m.data[2].w * v.w,
 	            m.data[3].x * v.x + m.data[3].y * v.y + m.data[3].z * v.z + m.data[3].w * v.w);
+#endif
 }
 
 MAT4_DECL mat4 operator/(const mat4& m, float s)
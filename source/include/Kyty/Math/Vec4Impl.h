@@ -57,10 +57,14 @@ VEC4_DECL vec4& vec4::operator+=(float s)
 
 VEC4_DECL vec4& vec4::operator+=(const vec4& v)
 {
+#ifdef KYTY_MATH_SSE
+	_mm_storeu_ps(data, _mm_add_ps(simd::load(*this), simd::load(v)));
+#else
 	x += v.x;
 	y += v.y;
 	z += v.z;
 	w += v.w;
+#endif
 	return *this;
 }
 
@@ -75,10 +79,14 @@ VEC4_DECL vec4& vec4::operator-=(float s)
 
 VEC4_DECL vec4& vec4::operator-=(const vec4& v)
 {
+#ifdef KYTY_MATH_SSE
+	_mm_storeu_ps(data, _mm_sub_ps(simd::load(*this), simd::load(v)));
+#else
 	x -= v.x;
 	y -= v.y;
 	z -= v.z;
 	w -= v.w;
+#endif
 	return *this;
 }
 
@@ -93,10 +101,14 @@ VEC4_DECL vec4& vec4::operator*=(float s)
 
 VEC4_DECL vec4& vec4::operator*=(const vec4& v)
 {
+#ifdef KYTY_MATH_SSE
+	_mm_storeu_ps(data, _mm_mul_ps(simd::load(*this), simd::load(v)));
+#else
 	x *= v.x;
 	y *= v.y;
 	z *= v.z;
 	w *= v.w;
+#endif
 	return *this;
 }
 
@@ -111,10 +123,14 @@ VEC4_DECL vec4& vec4::operator/=(float s)
 
 VEC4_DECL vec4& vec4::operator/=(const vec4& v)
 {
+#ifdef KYTY_MATH_SSE
+	_mm_storeu_ps(data, _mm_div_ps(simd::load(*this), simd::load(v)));
+#else
 	x /= v.x;
 	y /= v.y;
 	z /= v.z;
 	w /= v.w;
+#endif
 	return *this;
 }
 
@@ -135,7 +151,11 @@ VEC4_DECL vec4 operator+(float s, const vec4& v)
 
 VEC4_DECL vec4 operator+(const vec4& v1, const vec4& v2)
 {
+#ifdef KYTY_MATH_SSE
+	return simd::store(_mm_add_ps(simd::load(v1), simd::load(v2)));
+#else
 	return vec4(v1.x + v2.x, v1.y + v2.y, v1.z + v2.z, v1.w + v2.w);
+#endif
 }
 
 VEC4_DECL vec4 operator-(const vec4& v, float s)
@@ -150,12 +170,20 @@ VEC4_DECL vec4 operator-(float s, const vec4& v)
 
 VEC4_DECL vec4 operator-(const vec4& v1, const vec4& v2)
 {
+#ifdef KYTY_MATH_SSE
+	return simd::store(_mm_sub_ps(simd::load(v1), simd::load(v2)));
+#else
 	return vec4(v1.x - v2.x, v1.y - v2.y, v1.z - v2.z, v1.w - v2.w);
+#endif
 }
 
 VEC4_DECL vec4 operator*(const vec4& v, float s)
 {
+#ifdef KYTY_MATH_SSE
+	return simd::store(_mm_mul_ps(simd::load(v), _mm_set1_ps(s)));
+#else
 	return vec4(v.x * s, v.y * s, v.z * s, v.w * s);
+#endif
 }
 
 VEC4_DECL vec4 operator*(float s, const vec4& v)
@@ -165,7 +193,11 @@ VEC4_DECL vec4 operator*(float s, const vec4& v)
 
 VEC4_DECL vec4 operator*(const vec4& v1, const vec4& v2)
 {
+#ifdef KYTY_MATH_SSE
+	return simd::store(_mm_mul_ps(simd::load(v1), simd::load(v2)));
+#else
 	return vec4(v1.x * v2.x, v1.y * v2.y, v1.z * v2.z, v1.w * v2.w);
+#endif
 }
 
 VEC4_DECL vec4 operator/(const vec4& v, float s)
@@ -180,7 +212,11 @@ VEC4_DECL vec4 operator/(float s, const vec4& v)
 
 VEC4_DECL vec4 operator/(const vec4& v1, const vec4& v2)
 {
+#ifdef KYTY_MATH_SSE
+	return simd::store(_mm_div_ps(simd::load(v1), simd::load(v2)));
+#else
 	return vec4(v1.x / v2.x, v1.y / v2.y, v1.z / v2.z, v1.w / v2.w);
+#endif
 }
 
 VEC4_DECL bool operator==(const vec4& v1, const vec4& v2)
@@ -7,6 +7,19 @@
 
 #include <cmath> // IWYU pragma: export
 
+// vec4 and mat4 use SSE where the compiler targets it (always on x86-64) and FMA if it is enabled at compile time (-mfma, /arch:AVX2).
+// Other targets get the scalar code. The layout of the types doesn't change: loads and stores are unaligned, so vec4 and mat4 in
+// existing arrays, structs and files stay valid.
+#if !defined(KYTY_MATH_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define KYTY_MATH_SSE
+#if defined(__FMA__) || defined(__AVX2__)
+#define KYTY_MATH_FMA
+#include <immintrin.h>
+#else
+#include <emmintrin.h>
+#endif
+#endif
+
 namespace Kyty::Math::m {
 
 class vec3;
@@ -369,6 +382,55 @@ public:
 	vec4 data[4];
 };
 
+#ifdef KYTY_MATH_SSE
+namespace simd {
+
+inline __m128 load(const vec4& v)
+{
+	return _mm_loadu_ps(v.data);
+}
+
+inline vec4 store(__m128 r)
+{
+	vec4 v; // NOLINT(cppcoreguidelines-pro-type-member-init,hicpp-member-init)
+	_mm_storeu_ps(v.data, r);
+	return v;
+}
+
+// a * b + c
+inline __m128 madd(__m128 a, __m128 b, __m128 c)
+{
+#ifdef KYTY_MATH_FMA
+	return _mm_fmadd_ps(a, b, c);
+#else
+	return _mm_add_ps(_mm_mul_ps(a, b), c);
+#endif
+}
+
+template <int I>
+inline __m128 splat(__m128 v)
+{
+	return _mm_shuffle_ps(v, v, _MM_SHUFFLE(I, I, I, I));
+}
+
+inline __m128 hsum(__m128 v)
+{
+	__m128 s = _mm_add_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1)));
+	return _mm_add_ps(s, _mm_shuffle_ps(s, s, _MM_SHUFFLE(1, 0, 3, 2)));
+}
+
+// m * v, the columns of m are c0..c3
+inline __m128 mul(__m128 c0, __m128 c1, __m128 c2, __m128 c3, __m128 v)
+{
+	__m128 r = _mm_mul_ps(c0, splat<0>(v));
+	r        = madd(c1, splat<1>(v), r);
+	r        = madd(c2, splat<2>(v), r);
+	return madd(c3, splat<3>(v), r);
+}
+
+} // namespace simd
+#endif
+
 inline float* value_ptr(vec2& v) // NOLINT(google-runtime-references)
 {
 	return &v.x;
@@ -468,7 +530,12 @@ inline vec3 normalize(const vec3& v)
 }
 inline vec4 normalize(const vec4& v)
 {
+#ifdef KYTY_MATH_SSE
+	__m128 r = simd::load(v);
+	return simd::store(_mm_div_ps(r, _mm_sqrt_ps(simd::hsum(_mm_mul_ps(r, r)))));
+#else
 	return v / sqrtf(v.x * v.x + v.y * v.y + v.z * v.z + v.w * v.w);
+#endif
 }
 
 inline float dot(const vec2& v1, const vec2& v2)
@@ -481,7 +548,11 @@ inline float dot(const vec3& v1, const vec3& v2)
 }
 inline float dot(const vec4& v1, const vec4& v2)
 {
+#ifdef KYTY_MATH_SSE
+	return _mm_cvtss_f32(simd::hsum(_mm_mul_ps(simd::load(v1), simd::load(v2))));
+#else
 	return v1.x * v2.x + v1.y * v2.y + v1.z * v2.z + v1.w * v2.w;
+#endif
 }
 
 inline vec3 cross(const vec3& x, const vec3& y)
@@ -724,8 +795,17 @@ inline mat3 transpose(const mat3& m)
 
 inline mat4 transpose(const mat4& m)
 {
+#ifdef KYTY_MATH_SSE
+	__m128 c0 = simd::load(m.data[0]);
+	__m128 c1 = simd::load(m.data[1]);
+	__m128 c2 = simd::load(m.data[2]);
+	__m128 c3 = simd::load(m.data[3]);
+	_MM_TRANSPOSE4_PS(c0, c1, c2, c3);
+	return mat4(simd::store(c0), simd::store(c1), simd::store(c2), simd::store(c3));
+#else
 	return mat4(m.data[0].x, m.data[1].x, m.data[2].x, m.data[3].x, m.data[0].y, m.data[1].y, m.data[2].y, m.data[3].y, m.data[0].z,
 	            m.data[1].z, m.data[2].z, m.data[3].z, m.data[0].w, m.data[1].w, m.data[2].w, m.data[3].w);
+#endif
 }
 
 inline mat2 inverse(const mat2& m)
@@ -781,7 +861,11 @@ inline vec3 max(const vec3& a, const vec3& b)
 }
 inline vec4 max(const vec4& a, const vec4& b)
 {
+#ifdef KYTY_MATH_SSE
+	return simd::store(_mm_max_ps(simd::load(a), simd::load(b)));
+#else
 	return vec4(a.x > b.x ? a.x : b.x, a.y > b.y ? a.y : b.y, a.z > b.z ? a.z : b.z, a.w > b.w ? a.w : b.w);
+#endif
 }
 inline vec2 max(const vec2& a, float b)
 {
@@ -810,7 +894,11 @@ inline vec3 min(const vec3& a, const vec3& b)
 }
 inline vec4 min(const vec4& a, const vec4& b)
 {
+#ifdef KYTY_MATH_SSE
+	return simd::store(_mm_min_ps(simd::load(a), simd::load(b)));
+#else
 	return vec4(a.x < b.x ? a.x : b.x, a.y < b.y ? a.y : b.y, a.z < b.z ? a.z : b.z, a.w < b.w ? a.w : b.w);
+#endif
 }
 inline vec2 min(const vec2& a, float b)
 {
@@ -847,6 +935,61 @@ inline float radians(float degrees)
 	return degrees * (0.01745329251994329576923690768489f);
 }
 
+// a * b + c, rounded once where the CPU has FMA
+inline vec4 fma(const vec4& a, const vec4& b, const vec4& c)
+{
+#ifdef KYTY_MATH_SSE
+	return simd::store(simd::madd(simd::load(a), simd::load(b), simd::load(c)));
+#else
+	return vec4(std::fma(a.x, b.x, c.x), std::fma(a.y, b.y, c.y), std::fma(a.z, b.z, c.z), std::fma(a.w, b.w, c.w));
+#endif
+}
+
+// dst[i] = m * src[i]. src and dst may be the same array.
+inline void transform(const mat4& m, const vec4* src, vec4* dst, uint32_t num)
+{
+#ifdef KYTY_MATH_SSE
+	__m128 c0 = simd::load(m.data[0]);
+	__m128 c1 = simd::load(m.data[1]);
+	__m128 c2 = simd::load(m.data[2]);
+	__m128 c3 = simd::load(m.data[3]);
+	for (uint32_t i = 0; i < num; i++)
+	{
+		_mm_storeu_ps(dst[i].data, simd::mul(c0, c1, c2, c3, simd::load(src[i])));
+	}
+#else
+	for (uint32_t i = 0; i < num; i++)
+	{
+		dst[i] = m * src[i];
+	}
+#endif
+}
+
+// dst[i] = (m * vec4(src[i], 1)).xyz, for affine transforms of positions. src and dst may be the same array.
+inline void transform_points(const mat4& m, const vec3* src, vec3* dst, uint32_t num)
+{
+#ifdef KYTY_MATH_SSE
+	__m128 c0 = simd::load(m.data[0]);
+	__m128 c1 = simd::load(m.data[1]);
+	__m128 c2 = simd::load(m.data[2]);
+	__m128 c3 = simd::load(m.data[3]);
+	for (uint32_t i = 0; i < num; i++)
+	{
+		__m128 r = simd::madd(c0, _mm_set1_ps(src[i].x), c3);
+		r        = simd::madd(c1, _mm_set1_ps(src[i].y), r);
+		r        = simd::madd(c2, _mm_set1_ps(src[i].z), r);
+		float f[4];
+		_mm_storeu_ps(f, r);
+		dst[i] = vec3(f[0], f[1], f[2]);
+	}
+#else
+	for (uint32_t i = 0; i < num; i++)
+	{
+		dst[i] = (m * vec4(src[i], 1.0f)).Xyz();
+	}
+#endif
+}
+
 } // namespace Kyty::Math::m
 
 #define VEC2_DECL inline /*NOLINT(cppcoreguidelines-macro-usage)*/
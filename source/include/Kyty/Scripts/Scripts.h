@@ -49,6 +49,8 @@ using help_func_t   = void (*)();
 
 ScriptError   RunFile(const String& file_name);
 ScriptError   RunString(const String& source);
+// RunFile() keeps the compiled chunks there, named by the hash of the source. An empty folder disables the cache.
+void          SetBytecodeCacheFolder(const String& folder);
 const String& GetErrMsg();
 void          SetErrMsg(const String& msg);
 void          ResetErrMsg();
@@ -0,0 +1,35 @@
+#ifndef SYS_LINUX_INCLUDE_KYTY_SYSNET_H_
+#define SYS_LINUX_INCLUDE_KYTY_SYSNET_H_
+
+// IWYU pragma: private
+
+#include "Kyty/Core/Common.h"
+
+#if KYTY_PLATFORM != KYTY_PLATFORM_LINUX
+//#error "KYTY_PLATFORM != KYTY_PLATFORM_LINUX"
+#else
+
+#include "Kyty/Core/String.h"
+
+namespace Kyty {
+
+using sys_socket_t = int; // NOLINT(readability-identifier-naming)
+
+constexpr sys_socket_t SYS_SOCKET_INVALID = -1;
+
+// Blocking TCP client sockets. The timeout applies to the connect and to each send and receive.
+sys_socket_t sys_net_connect(const String& host, uint16_t port, uint32_t timeout_ms);
+void         sys_net_close(sys_socket_t s);
+bool         sys_net_send(sys_socket_t s, const void* data, uint32_t size); // Sends all the data
+int          sys_net_recv(sys_socket_t s, void* data, uint32_t size);       // 0 when the peer closed the connection, -1 on error
+
+// Server side, for the tests. Listens on 127.0.0.1, port 0 takes a free port, the port is returned. The accepted sockets are the same
+// as the client ones, the timeout applies to the accept and then to each send and receive.
+sys_socket_t sys_net_listen(uint16_t* port);
+sys_socket_t sys_net_accept(sys_socket_t s, uint32_t timeout_ms);
+
+} // namespace Kyty
+
+#endif
+
+#endif /* SYS_LINUX_INCLUDE_KYTY_SYSNET_H_ */
@@ -7,6 +7,7 @@
 //#error "KYTY_PLATFORM != KYTY_PLATFORM_LINUX"
 #else
 
+#include <cerrno>
 #include <ctime>
 
 namespace Kyty {
@@ -144,6 +145,19 @@ inline void sys_query_performance_counter(uint64_t* counter)
 	*counter = now.tv_sec * 1000000000LL + now.tv_nsec;
 }
 
+// Sleeps until sys_query_performance_counter() reaches the counter. The deadline is absolute, so an interrupted sleep doesn't drift.
+inline void sys_sleep_until(uint64_t counter)
+{
+	struct timespec ts
+	{
+	};
+	ts.tv_sec  = static_cast<time_t>(counter / 1000000000LL);
+	ts.tv_nsec = static_cast<int64_t>(counter % 1000000000LL);
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, nullptr) == EINTR)
+	{
+	}
+}
+
 } // namespace Kyty
 
 #endif
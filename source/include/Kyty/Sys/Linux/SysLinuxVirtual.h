@@ -18,10 +18,20 @@ void sys_virtual_init();
 uint64_t sys_virtual_alloc(uint64_t address, uint64_t size, VirtualMemory::Mode mode);
 uint64_t sys_virtual_alloc_aligned(uint64_t address, uint64_t size, VirtualMemory::Mode mode, uint64_t alignment);
 bool     sys_virtual_alloc_fixed(uint64_t address, uint64_t size, VirtualMemory::Mode mode);
+uint64_t sys_virtual_alloc_aligned_large(uint64_t address, uint64_t size, VirtualMemory::Mode mode, uint64_t alignment);
+bool     sys_virtual_alloc_fixed_large(uint64_t address, uint64_t size, VirtualMemory::Mode mode);
+uint64_t sys_virtual_alloc_lazy(uint64_t address, uint64_t size, VirtualMemory::Mode mode);
+uint64_t sys_virtual_large_page_size();
+bool     sys_virtual_large_pages_protectable();
 bool     sys_virtual_free(uint64_t address);
 bool     sys_virtual_protect(uint64_t address, uint64_t size, VirtualMemory::Mode mode, VirtualMemory::Mode* old_mode = nullptr);
 bool     sys_virtual_flush_instruction_cache(uint64_t address, uint64_t size);
 bool     sys_virtual_patch_replace(uint64_t vaddr, uint64_t value);
+bool     sys_virtual_thread_slot_alloc(uint8_t* segment_prefix, uint32_t* offset);
+bool     sys_virtual_thread_slot_set(uint64_t value);
+
+// Mode of the page at address and the size of the run of pages with the same mode, not larger than size
+VirtualMemory::Mode sys_virtual_query(uint64_t address, uint64_t size, uint64_t* run_size);
 
 } // namespace Kyty::Core
 
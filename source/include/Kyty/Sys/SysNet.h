@@ -0,0 +1,8 @@
+#ifndef INCLUDE_KYTY_SYS_SYSNET_H_
+#define INCLUDE_KYTY_SYS_SYSNET_H_
+
+#include "Kyty/Core/Common.h"
+#include "Kyty/Sys/Linux/SysLinuxNet.h"     // IWYU pragma: export
+#include "Kyty/Sys/Windows/SysWindowsNet.h" // IWYU pragma: export
+
+#endif /* INCLUDE_KYTY_SYS_SYSNET_H_ */
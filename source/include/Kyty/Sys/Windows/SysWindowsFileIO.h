@@ -35,6 +35,13 @@ enum sys_file_cache_type_t
 	SYS_FILE_CACHE_SEQUENTIAL_SCAN = 2  // NOLINT(readability-identifier-naming)
 };
 
+// NOLINTNEXTLINE(readability-identifier-naming)
+enum sys_file_map_mode_t
+{
+	SYS_FILE_MAP_READ_ONLY,    // NOLINT(readability-identifier-naming)
+	SYS_FILE_MAP_COPY_ON_WRITE // NOLINT(readability-identifier-naming)
+};
+
 // NOLINTNEXTLINE(readability-identifier-naming)
 struct sys_file_mem_buf_t
 {
@@ -80,6 +87,7 @@ sys_file_t*       sys_file_open_w(const String& file_name, sys_file_cache_type_t
 sys_file_t*       sys_file_open(uint8_t* buf, uint32_t buf_size);
 sys_file_t*       sys_file_create();
 sys_file_t*       sys_file_open_rw(const String& file_name, sys_file_cache_type_t cache_type = SYS_FILE_CACHE_AUTO);
+sys_file_t*       sys_file_open_or_create(const String& file_name);
 void              sys_file_close(sys_file_t* f);
 uint64_t          sys_file_size(sys_file_t& f);                    // NOLINT(google-runtime-references)
 bool              sys_file_seek(sys_file_t& f, uint64_t offset);   // NOLINT(google-runtime-references)
@@ -95,7 +103,9 @@ bool              sys_file_is_file_existing(const String& name);
 bool              sys_file_create_directory(const String& path);
 bool              sys_file_delete_directory(const String& path);
 bool              sys_file_delete_file(const String& name);
-bool              sys_file_flush(sys_file_t& f); // NOLINT(google-runtime-references)
+bool              sys_file_flush(sys_file_t& f);  // NOLINT(google-runtime-references)
+bool              sys_file_lock(sys_file_t& f);   // NOLINT(google-runtime-references)
+void              sys_file_unlock(sys_file_t& f); // NOLINT(google-runtime-references)
 SysFileTimeStruct sys_file_get_last_access_time_utc(const String& name);
 SysFileTimeStruct sys_file_get_last_write_time_utc(const String& name);
 // NOLINTNEXTLINE(google-runtime-references)
@@ -115,6 +125,19 @@ void sys_file_get_dents(const String& path, Kyty::Vector<sys_dir_entry_t>& out);
 bool sys_file_copy_file(const String& src, const String& dst);
 bool sys_file_move_file(const String& src, const String& dst);
 void sys_file_remove_readonly(const String& name);
+// NOLINTNEXTLINE(google-runtime-references)
+void* sys_file_map_r(sys_file_t& f, uint64_t* size);
+// NOLINTNEXTLINE(google-runtime-references)
+bool sys_file_map_fixed(sys_file_t& f, uint64_t offset, uint64_t size, uint64_t vaddr);
+// NOLINTNEXTLINE(google-runtime-references)
+void sys_file_read_at(void* data, uint64_t size, uint64_t offset, sys_file_t& f, uint64_t* bytes_read);
+// NOLINTNEXTLINE(google-runtime-references)
+void sys_file_will_need(sys_file_t& f, uint64_t offset, uint64_t size);
+void  sys_file_unmap(void* data, uint64_t size);
+// NOLINTNEXTLINE(google-runtime-references)
+void*    sys_file_map(sys_file_t& f, uint64_t offset, uint64_t* size, sys_file_map_mode_t mode);
+uint64_t sys_file_map_alignment();
+void     sys_file_prefetch(const void* data, uint64_t size);
 
 } // namespace Kyty
 
@@ -9,6 +9,10 @@
 
 #include <windows.h>
 
+#ifndef CREATE_WAITABLE_TIMER_HIGH_RESOLUTION
+#define CREATE_WAITABLE_TIMER_HIGH_RESOLUTION 0x00000002
+#endif
+
 namespace Kyty {
 
 struct SysTimeStruct
@@ -125,6 +129,44 @@ inline void sys_query_performance_counter(uint64_t* counter)
 	*counter = c.QuadPart;
 }
 
+// Sleeps until sys_query_performance_counter() reaches the counter. High-resolution waitable timers are available since
+// Windows 10 1803, older versions fall back to a timer with the system timer resolution.
+inline void sys_sleep_until(uint64_t counter)
+{
+	static thread_local HANDLE timer = nullptr;
+
+	if (timer == nullptr)
+	{
+		timer = CreateWaitableTimerExW(nullptr, nullptr, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS);
+		if (timer == nullptr)
+		{
+			timer = CreateWaitableTimerExW(nullptr, nullptr, 0, TIMER_ALL_ACCESS);
+		}
+	}
+
+	LARGE_INTEGER f;
+	LARGE_INTEGER c;
+	QueryPerformanceFrequency(&f);
+	QueryPerformanceCounter(&c);
+
+	if (static_cast<uint64_t>(c.QuadPart) >= counter)
+	{
+		return;
+	}
+
+	// Negative due time is relative, in 100 ns units
+	LARGE_INTEGER due;
+	due.QuadPart = -static_cast<LONGLONG>((counter - c.QuadPart) * 10000000 / f.QuadPart);
+
+	if (timer != nullptr && SetWaitableTimer(timer, &due, 0, nullptr, nullptr, FALSE) != 0)
+	{
+		WaitForSingleObject(timer, INFINITE);
+	} else
+	{
+		Sleep(static_cast<DWORD>(-due.QuadPart / 10000));
+	}
+}
+
 } // namespace Kyty
 
 #endif
@@ -1,6 +1,7 @@
 #ifndef UNIT_TEST_INCLUDE_UNITTEST_H_
 #define UNIT_TEST_INCLUDE_UNITTEST_H_
 
+#include "Kyty/Core/ByteBuffer.h"
 #include "Kyty/Core/Common.h"      // IWYU pragma: export
 #include "Kyty/Core/MemoryAlloc.h" // IWYU pragma: keep
 #include "Kyty/Core/Subsystems.h"
@@ -9,7 +10,8 @@
 #include "gtest/gtest-test-part.h" // IWYU pragma: export
 #include "gtest/gtest.h"           // IWYU pragma: export
 
-#include <memory> // IWYU pragma: export
+#include <memory>      // IWYU pragma: export
+#include <type_traits> // IWYU pragma: keep
 
 namespace Kyty::UnitTest {
 
@@ -49,6 +51,35 @@ KYTY_SUBSYSTEM_DEFINE(UnitTest);
 
 #define UT_LINK(test) KYTY_FORCE_LINK_THAT(UnitTest##test);
 
+using bench_func_t = void (*)(void*);
+
+void BenchRun(const char* name, uint64_t bytes_per_run, bench_func_t func, void* arg);
+
+// Microbenchmark. Calls func until it has run for about 200 ms and prints the time of one call. The results are also recorded
+// as properties of the current test, "--gtest_output=json:bench.json" saves them for trend tracking.
+// bytes_per_run is used only to print the throughput, 0 if it doesn't apply.
+// The benchmark tests are named DISABLED_*Bench, so the correctness run skips them. They are run with
+// "--gtest_also_run_disabled_tests --gtest_filter=*Bench*".
+template <class F>
+void Bench(const char* name, uint64_t bytes_per_run, F&& func)
+{
+	BenchRun(
+	    name, bytes_per_run, [](void* arg) { (*static_cast<std::remove_reference_t<F>*>(arg))(); }, &func);
+}
+
+// Test data: a buffer of size bytes, byte i is byte_at(i)
+template <class F>
+Core::ByteBuffer CreateData(uint32_t size, F&& byte_at)
+{
+	Core::ByteBuffer buf(size, false);
+	auto*            data = buf.GetData();
+	for (uint32_t i = 0; i < size; i++)
+	{
+		data[i] = static_cast<Core::Byte>(byte_at(i));
+	}
+	return buf;
+}
+
 } // namespace Kyty::UnitTest
 
 #endif /* UNIT_TEST_INCLUDE_UNITTEST_H_ */
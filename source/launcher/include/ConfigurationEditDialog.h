@@ -4,12 +4,16 @@
 #include "Common.h"
 
 #include <QDialog>
+#include <QPointer>
 #include <QProcess>
 #include <QString>
+#include <QStringList>
+#include <QTimer>
 class QByteArray;
 class QMoveEvent;
 class QSettings;
 class ConfigurationListWidget;
+class ElfScanner;
 
 namespace Kyty {
 class Configuration;
@@ -38,9 +42,13 @@ private:
 	Kyty::Configuration*         m_info = nullptr;
 	QProcess                     m_process;
 	ConfigurationListWidget*     m_parent = nullptr;
+	QTimer                       m_scan_timer;
+	QPointer<ElfScanner>         m_scanner;
 
 protected:
 	void Init();
+	void CancelScan();
+	void UpdateElfs(const QStringList& elfs, bool complete);
 
 	void moveEvent(QMoveEvent* event) override;
 
@@ -26,6 +26,8 @@ public:
 
 	void               SetRunEnabled(bool flag) { m_run_enabled = flag; }
 	[[nodiscard]] bool IsRunEnabled() const { return m_run_enabled; }
+	void               SetPrebuildEnabled(bool flag) { m_prebuild_enabled = flag; }
+	[[nodiscard]] bool IsPrebuildEnabled() const { return m_prebuild_enabled; }
 
 	[[nodiscard]] const ConfigurationItem* GetSelectedItem() const { return m_selected_item; }
 	ConfigurationItem*                     GetSelectedItem() { return m_selected_item; }
@@ -38,6 +40,7 @@ public:
 signals:
 
 	void Run();
+	void Prebuild();
 	void Select();
 
 public slots:
@@ -50,14 +53,16 @@ protected slots:
 	void edit_configuration();
 	void delete_configuartion();
 	void run_configuration();
+	void prebuild_configuration();
 	void list_itemClicked(QListWidgetItem* witem);
 	void show_context_menu(const QPoint& pos);
 
 private:
-	ConfigurationItem*           m_selected_item = nullptr;
-	bool                         m_run_enabled   = true;
-	Ui::ConfigurationListWidget* m_ui            = nullptr;
-	MainDialog*                  m_main_dialog   = nullptr;
+	ConfigurationItem*           m_selected_item    = nullptr;
+	bool                         m_run_enabled      = true;
+	bool                         m_prebuild_enabled = false;
+	Ui::ConfigurationListWidget* m_ui               = nullptr;
+	MainDialog*                  m_main_dialog      = nullptr;
 	QString                      m_settings_file;
 };
 
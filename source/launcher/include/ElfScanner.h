@@ -0,0 +1,47 @@
+#ifndef LAUNCHER_INCLUDE_ELFSCANNER_H_
+#define LAUNCHER_INCLUDE_ELFSCANNER_H_
+
+#include "Common.h"
+
+#include <QString>
+#include <QStringList>
+#include <QThread>
+#include <QVariant>
+
+class QSettings;
+
+// Looks for the executables of a game directory in a background thread. The results are sent in batches while the directory
+// is walked, so large libraries and network shares don't block the dialog.
+//
+// The files found by the last scan of every directory and the parsed param.sfo files are kept in an index which is saved with
+// the settings. A param.sfo is parsed again only when its mtime or size changes.
+class ElfScanner: public QThread
+{
+	Q_OBJECT
+	KYTY_QT_CLASS_NO_COPY(ElfScanner);
+
+public:
+	explicit ElfScanner(QString dir, QObject* parent = nullptr);
+	~ElfScanner() override = default;
+
+	static void WriteSettings(QSettings* s);
+	static void ReadSettings(QSettings* s);
+
+	// Files (relative to dir) found by the last finished scan
+	static QStringList GetCached(const QString& dir);
+
+	// Parameters of a param.sfo, empty if the file doesn't exist
+	static QVariantMap LoadPsf(const QString& file_name);
+
+signals:
+	void found(const QStringList& elfs);
+	void done(const QStringList& elfs);
+
+protected:
+	void run() override;
+
+private:
+	QString m_dir;
+};
+
+#endif /* LAUNCHER_INCLUDE_ELFSCANNER_H_ */
@@ -2,17 +2,18 @@
 
 #include "Configuration.h"
 #include "ConfigurationListWidget.h"
+#include "ElfScanner.h"
 #include "MainDialog.h"
 #include "MandatoryLineEdit.h"
-#include "Psf.h"
 
 #include <QByteArray>
 #include <QCheckBox>
 #include <QColor>
 #include <QComboBox>
 #include <QDir>
-#include <QDirIterator>
+#include <QFile>
 #include <QFileDialog>
+#include <QFileInfo>
 #include <QFlags>
 #include <QInternal>
 #include <QLayout>
@@ -23,6 +24,7 @@
 #include <QMessageBox>
 #include <QPicture>
 #include <QPushButton>
+#include <QSet>
 #include <QSettings>
 #include <QStringList>
 #include <QVariant>
@@ -35,6 +37,7 @@ constexpr char SETTINGS_LAST_BASE_DIR[]     = "last_base_dir";
 constexpr char COLOR_SELECTED[]             = "#e2ffe2";
 constexpr char COLOR_NOT_SELECTED[]         = "#ffffff";
 constexpr char COLOR_ODD_ROW[]              = "#fff5e5";
+constexpr int  SCAN_DELAY_MS                = 300;
 
 static void ChangeColor(QListWidgetItem* item)
 {
@@ -77,7 +80,11 @@ ConfigurationEditDialog::ConfigurationEditDialog(Kyty::Configuration* info, Conf
 		        m_ui->lineEdit_profiler_file->setEnabled(log == Kyty::Configuration::ProfilerDirection::File ||
 		                                                 log == Kyty::Configuration::ProfilerDirection::FileAndNetwork);
 	        });
-	connect(m_ui->base_directory_lineedit, &QLineEdit::textChanged, this, &ConfigurationEditDialog::scan_elfs);
+	// Don't start a scan for every typed character
+	m_scan_timer.setSingleShot(true);
+	m_scan_timer.setInterval(SCAN_DELAY_MS);
+	connect(&m_scan_timer, &QTimer::timeout, this, &ConfigurationEditDialog::scan_elfs);
+	connect(m_ui->base_directory_lineedit, &QLineEdit::textChanged, [=]() { m_scan_timer.start(); });
 	connect(m_ui->param_file_lineedit, &QLineEdit::textChanged, this, &ConfigurationEditDialog::load_param_sfo);
 	connect(m_ui->listWidget_elfs, &QListWidget::itemChanged, this, &ChangeColor);
 	// connect(m_ui->listWidget_libs, &QListWidget::itemChanged, this, &ChangeColor);
@@ -106,6 +113,7 @@ QByteArray ConfigurationEditDialog::g_last_geometry;
 
 ConfigurationEditDialog::~ConfigurationEditDialog()
 {
+	CancelScan();
 	delete m_ui;
 }
 
@@ -123,6 +131,8 @@ void ConfigurationEditDialog::WriteSettings(QSettings* s)
 		s->setValue(SETTINGS_CFG_LAST_GEOMETRY, g_last_geometry);
 	}
 
+	ElfScanner::WriteSettings(s);
+
 	s->endGroup();
 }
 
@@ -133,6 +143,8 @@ void ConfigurationEditDialog::ReadSettings(QSettings* s)
 	g_last_base_dir = s->value(SETTINGS_LAST_BASE_DIR, g_last_base_dir).toString();
 	g_last_geometry = s->value(SETTINGS_CFG_LAST_GEOMETRY, g_last_geometry).toByteArray();
 
+	ElfScanner::ReadSettings(s);
+
 	s->endGroup();
 }
 
@@ -287,59 +299,108 @@ void ConfigurationEditDialog::browse_param_file()
 	}
 }
 
-void ConfigurationEditDialog::scan_elfs()
+void ConfigurationEditDialog::CancelScan()
 {
-	auto dir        = m_ui->base_directory_lineedit->text();
-	auto qdir       = QDir(dir);
-	bool dir_exists = !dir.isEmpty() && qdir.exists();
-
-	QStringList elfs;
-
-	if (dir_exists)
+	if (m_scanner != nullptr)
 	{
-		QDirIterator it(dir, QStringList({"*.elf", "*.prx", "*.sprx", "eboot.bin"}), QDir::Files, QDirIterator::Subdirectories);
-		while (it.hasNext())
-		{
-			auto file = it.next();
-			elfs << qdir.relativeFilePath(file);
-		}
+		// The scanner deletes itself when the thread finishes
+		m_scanner->disconnect(this);
+		m_scanner->requestInterruption();
+		m_scanner = nullptr;
 	}
+}
 
-	m_ui->listWidget_elfs->clear();
+void ConfigurationEditDialog::UpdateElfs(const QStringList& elfs, bool complete)
+{
+	auto* list_widget = m_ui->listWidget_elfs;
 
-	// int selected_num = 0;
+	QSet<QString> found(elfs.begin(), elfs.end());
+	QSet<QString> shown;
 
-	for (const auto& elf: m_info->elfs)
+	for (int i = list_widget->count() - 1; i >= 0; i--)
 	{
-		bool not_enabled = !elfs.contains(elf);
-		bool selected    = m_info->elfs_selected.contains(elf);
-
-		auto* item = new QListWidgetItem(elf, m_ui->listWidget_elfs);
-		item->setFlags(item->flags() | Qt::ItemIsUserCheckable);
+		auto*       item = list_widget->item(i);
+		const auto& elf  = item->text();
 
-		if (not_enabled)
+		if (found.contains(elf))
+		{
+			if ((item->flags() & Qt::ItemIsEnabled) == 0)
+			{
+				item->setFlags(item->flags() | Qt::ItemIsEnabled);
+				item->setCheckState(m_info->elfs_selected.contains(elf) ? Qt::Checked : Qt::Unchecked);
+			}
+		} else if (complete && (item->flags() & Qt::ItemIsEnabled) != 0)
 		{
+			if (!m_info->elfs.contains(elf))
+			{
+				delete list_widget->takeItem(i);
+				continue;
+			}
 			item->setCheckState(Qt::Unchecked);
 			item->setFlags(item->flags() & ~Qt::ItemIsEnabled);
-		} else
-		{
-			item->setCheckState(selected ? Qt::Checked : Qt::Unchecked);
 		}
 
-		// selected_num += (selected ? 1 : 0);
+		shown.insert(elf);
 	}
 
 	for (const auto& elf: elfs)
 	{
-		if (!m_info->elfs.contains(elf))
+		if (!shown.contains(elf))
 		{
-			auto* item = new QListWidgetItem(elf, m_ui->listWidget_elfs);
+			auto* item = new QListWidgetItem(elf, list_widget);
 			item->setFlags(item->flags() | Qt::ItemIsUserCheckable);
 			item->setCheckState(Qt::Unchecked);
+			shown.insert(elf);
+		}
+	}
+
+	list_widget->sortItems();
+}
+
+void ConfigurationEditDialog::scan_elfs()
+{
+	m_scan_timer.stop();
+	CancelScan();
+
+	auto dir        = m_ui->base_directory_lineedit->text();
+	bool dir_exists = !dir.isEmpty() && QDir(dir).exists();
+
+	m_ui->listWidget_elfs->clear();
+
+	// Until the scan is complete the configured files are expected to exist
+	for (const auto& elf: m_info->elfs)
+	{
+		bool selected = dir_exists && m_info->elfs_selected.contains(elf);
+
+		auto* item = new QListWidgetItem(elf, m_ui->listWidget_elfs);
+		item->setFlags(item->flags() | Qt::ItemIsUserCheckable);
+		item->setCheckState(selected ? Qt::Checked : Qt::Unchecked);
+
+		if (!dir_exists)
+		{
+			item->setFlags(item->flags() & ~Qt::ItemIsEnabled);
 		}
 	}
 
-	m_ui->listWidget_elfs->sortItems();
+	if (dir_exists)
+	{
+		// Show the files found last time, the scan only corrects the list
+		UpdateElfs(ElfScanner::GetCached(dir), false);
+
+		m_scanner = new ElfScanner(dir);
+		connect(m_scanner, &ElfScanner::found, this, [=](const QStringList& elfs) { UpdateElfs(elfs, false); });
+		connect(m_scanner, &ElfScanner::done, this,
+		        [=](const QStringList& elfs)
+		        {
+			        UpdateElfs(elfs, true);
+			        m_scanner = nullptr;
+		        });
+		connect(m_scanner, &QThread::finished, m_scanner, &QObject::deleteLater);
+		m_scanner->start(QThread::LowPriority);
+	} else
+	{
+		m_ui->listWidget_elfs->sortItems();
+	}
 
 	m_ui->test_button->setEnabled(m_process.state() == QProcess::NotRunning && dir_exists);
 }
@@ -400,10 +461,7 @@ void ConfigurationEditDialog::load_param_sfo()
 
 	if (param.exists())
 	{
-		Psf psf;
-		psf.Load(file_name);
-
-		const auto& map = psf.GetMap();
+		auto map = ElfScanner::LoadPsf(file_name);
 
 		m_ui->params_table->setColumnCount(2);
 		m_ui->params_table->setRowCount(map.size());
@@ -464,7 +522,7 @@ void ConfigurationEditDialog::test()
 
 	UpdateInfo(info, m_ui);
 
-	m_parent->GetMainDialog()->RunInterpreter(&m_process, info, false);
+	m_parent->GetMainDialog()->RunInterpreter(&m_process, info, false, false);
 
 	delete info;
 }
@@ -171,6 +171,11 @@ void ConfigurationListWidget::run_configuration()
 	emit Run();
 }
 
+void ConfigurationListWidget::prebuild_configuration()
+{
+	emit Prebuild();
+}
+
 void ConfigurationListWidget::list_itemClicked(QListWidgetItem* witem)
 {
 	auto* item = static_cast<ConfigurationItem*>(witem);
@@ -194,7 +199,8 @@ void ConfigurationListWidget::show_context_menu(const QPoint& pos)
 
 	QMenu menu;
 
-	QAction* action_run = menu.addAction(tr("Run"), this, SLOT(run_configuration()));
+	QAction* action_run      = menu.addAction(tr("Run"), this, SLOT(run_configuration()));
+	QAction* action_prebuild = menu.addAction(tr("Prebuild caches"), this, SLOT(prebuild_configuration()));
 	menu.addSeparator();
 	/*QAction *action_new = */ menu.addAction(QIcon(":/add"), tr("New..."), this, SLOT(add_configuration()));
 	QAction* action_edit   = menu.addAction(QIcon(":/edit"), tr("Edit..."), this, SLOT(edit_configuration()));
@@ -203,11 +209,13 @@ void ConfigurationListWidget::show_context_menu(const QPoint& pos)
 	if (item != nullptr)
 	{
 		action_run->setDisabled(item->IsRunning());
+		action_prebuild->setDisabled(item->IsRunning());
 		action_edit->setDisabled(item->IsRunning());
 		action_delete->setDisabled(item->IsRunning());
 	} else
 	{
 		action_run->setDisabled(true);
+		action_prebuild->setDisabled(true);
 		action_edit->setDisabled(true);
 		action_delete->setDisabled(true);
 	}
@@ -217,5 +225,10 @@ void ConfigurationListWidget::show_context_menu(const QPoint& pos)
 		action_run->setDisabled(true);
 	}
 
+	if (!m_prebuild_enabled)
+	{
+		action_prebuild->setDisabled(true);
+	}
+
 	menu.exec(QCursor::pos());
 }
@@ -0,0 +1,176 @@
+#include "ElfScanner.h"
+
+#include "Psf.h"
+
+#include <QDateTime>
+#include <QDir>
+#include <QDirIterator>
+#include <QElapsedTimer>
+#include <QFileInfo>
+#include <QMap>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QSettings>
+#include <QVariantList>
+
+#include <utility>
+
+constexpr char   SETTINGS_ELF_INDEX[]  = "elf_index";
+constexpr char   SETTINGS_PSF_CACHE[]  = "psf_cache";
+constexpr char   PSF_FILE_NAME[]       = "param.sfo";
+constexpr qint64 SCAN_BATCH_MS         = 100;
+constexpr int    PSF_CACHED_VALUES_NUM = 3; // mtime, size, params
+
+struct PsfCacheEntry
+{
+	qint64      mtime = 0;
+	qint64      size  = 0;
+	QVariantMap params;
+};
+
+static QMutex                       g_index_mutex;
+static QMap<QString, QStringList>   g_elf_index;
+static QMap<QString, PsfCacheEntry> g_psf_cache;
+
+ElfScanner::ElfScanner(QString dir, QObject* parent): QThread(parent), m_dir(std::move(dir)) {}
+
+void ElfScanner::WriteSettings(QSettings* s)
+{
+	QVariantMap elf_index;
+	QVariantMap psf_cache;
+
+	{
+		QMutexLocker lock(&g_index_mutex);
+
+		for (auto it = g_elf_index.constBegin(); it != g_elf_index.constEnd(); ++it)
+		{
+			elf_index.insert(it.key(), it.value());
+		}
+		for (auto it = g_psf_cache.constBegin(); it != g_psf_cache.constEnd(); ++it)
+		{
+			psf_cache.insert(it.key(), QVariantList({it.value().mtime, it.value().size, it.value().params}));
+		}
+	}
+
+	s->setValue(SETTINGS_ELF_INDEX, elf_index);
+	s->setValue(SETTINGS_PSF_CACHE, psf_cache);
+}
+
+void ElfScanner::ReadSettings(QSettings* s)
+{
+	auto elf_index = s->value(SETTINGS_ELF_INDEX).toMap();
+	auto psf_cache = s->value(SETTINGS_PSF_CACHE).toMap();
+
+	QMutexLocker lock(&g_index_mutex);
+
+	for (auto it = elf_index.constBegin(); it != elf_index.constEnd(); ++it)
+	{
+		g_elf_index.insert(it.key(), it.value().toStringList());
+	}
+	for (auto it = psf_cache.constBegin(); it != psf_cache.constEnd(); ++it)
+	{
+		auto values = it.value().toList();
+		if (values.size() == PSF_CACHED_VALUES_NUM)
+		{
+			PsfCacheEntry entry;
+			entry.mtime  = values.at(0).toLongLong();
+			entry.size   = values.at(1).toLongLong();
+			entry.params = values.at(2).toMap();
+			g_psf_cache.insert(it.key(), entry);
+		}
+	}
+}
+
+QStringList ElfScanner::GetCached(const QString& dir)
+{
+	QMutexLocker lock(&g_index_mutex);
+
+	return g_elf_index.value(QDir(dir).absolutePath());
+}
+
+QVariantMap ElfScanner::LoadPsf(const QString& file_name)
+{
+	QFileInfo info(file_name);
+
+	if (!info.exists())
+	{
+		return {};
+	}
+
+	auto   path  = info.absoluteFilePath();
+	qint64 mtime = info.lastModified().toMSecsSinceEpoch();
+	qint64 size  = info.size();
+
+	{
+		QMutexLocker lock(&g_index_mutex);
+
+		auto it = g_psf_cache.constFind(path);
+		if (it != g_psf_cache.constEnd() && it.value().mtime == mtime && it.value().size == size)
+		{
+			return it.value().params;
+		}
+	}
+
+	Psf psf;
+	psf.Load(path);
+
+	PsfCacheEntry entry;
+	entry.mtime  = mtime;
+	entry.size   = size;
+	entry.params = psf.GetMap();
+
+	QMutexLocker lock(&g_index_mutex);
+
+	g_psf_cache.insert(path, entry);
+
+	return entry.params;
+}
+
+void ElfScanner::run()
+{
+	QDir          qdir(m_dir);
+	QStringList   elfs;
+	QStringList   batch;
+	QElapsedTimer timer;
+
+	timer.start();
+
+	QDirIterator it(m_dir, QStringList({"*.elf", "*.prx", "*.sprx", "eboot.bin", PSF_FILE_NAME}), QDir::Files,
+	                QDirIterator::Subdirectories);
+	while (it.hasNext())
+	{
+		if (isInterruptionRequested())
+		{
+			return;
+		}
+
+		auto file = it.next();
+
+		if (it.fileName().compare(PSF_FILE_NAME, Qt::CaseInsensitive) == 0)
+		{
+			// Parsed now, so the dialog finds it in the cache
+			LoadPsf(file);
+			continue;
+		}
+
+		batch << qdir.relativeFilePath(file);
+
+		if (timer.elapsed() >= SCAN_BATCH_MS)
+		{
+			emit found(batch);
+			elfs << batch;
+			batch.clear();
+			timer.restart();
+		}
+	}
+
+	elfs << batch;
+
+	{
+		QMutexLocker lock(&g_index_mutex);
+
+		g_elf_index.insert(qdir.absolutePath(), elfs);
+	}
+
+	emit done(elfs);
+}
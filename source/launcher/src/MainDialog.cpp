@@ -21,6 +21,7 @@
 #include <QSettings>
 #include <QStringList>
 #include <QTextStream>
+#include <QThread>
 #include <QVariant>
 #include <Q_STARTUPINFO>
 #include <QtCore>
@@ -58,6 +59,7 @@ constexpr char KYTY_LOAD_ELF[] = "kyty_load_elf";
 constexpr char KYTY_LOAD_SYMBOLS_ALL[] = "kyty_load_symbols_all";
 constexpr char KYTY_LOAD_PARAM_SFO[]   = "kyty_load_param_sfo";
 constexpr char KYTY_INIT[]             = "kyty_init";
+constexpr char KYTY_PREBUILD_CACHES[]  = "kyty_prebuild_caches";
 constexpr char KYTY_LUA_FILE[]         = "kyty_run.lua";
 #ifndef __linux__
 constexpr DWORD CMD_X_CHARS = 175;
@@ -95,6 +97,7 @@ public:
 	void Update();
 	void FindInterpreter();
 	void Run();
+	void Prebuild();
 
 	[[nodiscard]] const QString& GetInterpreter() const { return m_interpreter; }
 
@@ -102,10 +105,13 @@ public:
 	static void ReadSettings(QSettings* s);
 
 private:
+	void Start(bool prebuild);
+
 	static QByteArray g_last_geometry;
 
-	Ui::MainDialog* m_ui          = {nullptr};
-	MainDialog*     m_main_dialog = nullptr;
+	Ui::MainDialog* m_ui                 = {nullptr};
+	MainDialog*     m_main_dialog        = nullptr;
+	bool            m_prebuild_supported = false;
 	QString         m_interpreter;
 
 	/*DetachableProcess*/ QProcess m_process;
@@ -140,6 +146,7 @@ void MainDialogPrivate::Setup(MainDialog* main_dialog)
 	connect(m_ui->pushButton_Run, &QPushButton::clicked, this, &MainDialogPrivate::Run);
 	connect(m_ui->widget, &ConfigurationListWidget::Select, this, &MainDialogPrivate::Update);
 	connect(m_ui->widget, &ConfigurationListWidget::Run, this, &MainDialogPrivate::Run);
+	connect(m_ui->widget, &ConfigurationListWidget::Prebuild, this, &MainDialogPrivate::Prebuild);
 	connect(main_dialog, &MainDialog::Resize,
 	        [=]()
 	        {
@@ -206,6 +213,9 @@ void MainDialogPrivate::FindInterpreter()
 		found = found && lines.contains(QString("Lua function: ") + KYTY_LOAD_SYMBOLS_ALL);
 		found = found && lines.contains(QString("Lua function: ") + KYTY_LOAD_PARAM_SFO);
 		found = found && lines.contains(QString("Lua function: ") + KYTY_INIT);
+
+		// Older emulators can only run the game
+		m_prebuild_supported = lines.contains(QString("Lua function: ") + KYTY_PREBUILD_CACHES);
 	}
 
 	if (!found)
@@ -235,7 +245,7 @@ void MainDialogPrivate::FindInterpreter()
 	Update();
 }
 
-static bool CreateLuaScript(Kyty::Configuration* info, const QString& file_name)
+static bool CreateLuaScript(Kyty::Configuration* info, const QString& file_name, bool prebuild)
 {
 	QFile file(file_name);
 	if (file.open(QIODevice::WriteOnly | QIODevice::Text))
@@ -266,6 +276,13 @@ static bool CreateLuaScript(Kyty::Configuration* info, const QString& file_name)
 		s << "\t ProfilerDirection = '" << EnumToText(info->profiler_direction) << "';\n";
 		s << "\t ProfilerOutputFile = '" << info->profiler_output_file << "';\n";
 		s << "\t SpirvDebugPrintfEnabled = false;\n";
+		s << "\t PipelineCacheEnabled = true;\n";
+		s << "\t ShaderCacheEnabled = true;\n";
+		if (prebuild)
+		{
+			s << "\t PipelinePrewarmEnabled = true;\n";
+			s << "\t ShaderTranslationThreads = " << QThread::idealThreadCount() << ";\n";
+		}
 		s << "}\n";
 
 		s << KYTY_INIT << "(cfg);\n";
@@ -273,6 +290,14 @@ static bool CreateLuaScript(Kyty::Configuration* info, const QString& file_name)
 
 		s << KYTY_LOAD_PARAM_SFO << "('" << info->param_file << "');\n";
 
+		if (prebuild)
+		{
+			// The caches are found by the title id, the game itself is not loaded
+			s << KYTY_PREBUILD_CACHES << "();\n";
+			file.close();
+			return true;
+		}
+
 		for (const auto& elf: info->elfs_selected)
 		{
 			s << KYTY_LOAD_ELF << "('/app0/" << elf << "');\n";
@@ -314,7 +339,7 @@ static bool CreateBashScript(const QString& interpreter, const QString& lua_file
 }
 #endif
 
-void MainDialog::RunInterpreter(QProcess* process, Kyty::Configuration* info, [[maybe_unused]] bool con_emu)
+void MainDialog::RunInterpreter(QProcess* process, Kyty::Configuration* info, [[maybe_unused]] bool con_emu, bool prebuild)
 {
 	const auto& interpreter = m_p->GetInterpreter();
 
@@ -322,7 +347,7 @@ void MainDialog::RunInterpreter(QProcess* process, Kyty::Configuration* info, [[
 	auto      dir = f.absoluteDir();
 
 	auto lua_file_name = dir.filePath(KYTY_LUA_FILE);
-	if (!CreateLuaScript(info, lua_file_name))
+	if (!CreateLuaScript(info, lua_file_name, prebuild))
 	{
 		QMessageBox::critical(this, tr("Error"), tr("Can't create file:\n") + lua_file_name);
 		QApplication::quit();
@@ -415,12 +440,22 @@ void MainDialogPrivate::ReadSettings(QSettings* s)
 }
 
 void MainDialogPrivate::Run()
+{
+	Start(false);
+}
+
+void MainDialogPrivate::Prebuild()
+{
+	Start(true);
+}
+
+void MainDialogPrivate::Start(bool prebuild)
 {
 	m_running_item = m_ui->widget->GetSelectedItem();
 
 	m_running_item->SetRunning(true);
 
-	m_main_dialog->RunInterpreter(&m_process, m_running_item->GetInfo(), m_ui->radioButton_ConEmu->isChecked());
+	m_main_dialog->RunInterpreter(&m_process, m_running_item->GetInfo(), m_ui->radioButton_ConEmu->isChecked(), prebuild);
 
 	Update();
 }
@@ -440,6 +475,7 @@ void MainDialogPrivate::Update()
 
 	m_ui->pushButton_Run->setEnabled(run_enabled);
 	m_ui->widget->SetRunEnabled(run_enabled);
+	m_ui->widget->SetPrebuildEnabled(run_enabled && m_prebuild_supported);
 }
 
 #include "MainDialog.moc"
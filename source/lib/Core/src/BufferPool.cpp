@@ -0,0 +1,137 @@
+#include "Kyty/Core/BufferPool.h"
+
+#include "Kyty/Core/DbgAssert.h"
+#include "Kyty/Core/Threads.h"
+#include "Kyty/Core/Vector.h"
+
+namespace Kyty::Core {
+
+constexpr uint32_t BUFFER_POOL_CLASS_MIN   = 12;
+constexpr uint32_t BUFFER_POOL_CLASS_MAX   = 28;
+constexpr uint32_t BUFFER_POOL_CLASSES_NUM = BUFFER_POOL_CLASS_MAX - BUFFER_POOL_CLASS_MIN + 1;
+constexpr uint32_t BUFFER_POOL_CLASS_LIMIT = 8;
+constexpr uint64_t BUFFER_POOL_BYTES_LIMIT = 512ull * 1024 * 1024;
+
+struct BufferPool
+{
+	Mutex               mutex {"BufferPool"};
+	Vector<ByteBuffer*> free[BUFFER_POOL_CLASSES_NUM];
+	BufferPoolStats     stats;
+};
+
+static BufferPool* get_pool()
+{
+	// Never freed, leases may end after the static destructors
+	static auto* pool = new BufferPool;
+	return pool;
+}
+
+// The smallest class which holds size bytes
+static uint32_t size_class_ceil(uint32_t size)
+{
+	uint32_t c = BUFFER_POOL_CLASS_MIN;
+	while (c <= BUFFER_POOL_CLASS_MAX && (1u << c) < size)
+	{
+		c++;
+	}
+	return c;
+}
+
+// The largest class which fits in capacity bytes
+static uint32_t size_class_floor(uint32_t capacity)
+{
+	uint32_t c = 0;
+	while (c < 31 && (2u << c) <= capacity)
+	{
+		c++;
+	}
+	return c;
+}
+
+ByteBufferLease::ByteBufferLease(uint32_t capacity)
+{
+	auto*    pool = get_pool();
+	uint32_t c    = size_class_ceil(capacity);
+
+	if (c <= BUFFER_POOL_CLASS_MAX)
+	{
+		LockGuard lock(pool->mutex);
+
+		pool->stats.leases++;
+
+		auto& list = pool->free[c - BUFFER_POOL_CLASS_MIN];
+		if (!list.IsEmpty())
+		{
+			m_buf = list.At(list.Size() - 1);
+			list.RemoveAt(list.Size() - 1);
+
+			pool->stats.hits++;
+			pool->stats.buffers_num--;
+			pool->stats.bytes -= m_buf->Capacity();
+			return;
+		}
+	}
+
+	m_buf = new ByteBuffer;
+	m_buf->Expand(c <= BUFFER_POOL_CLASS_MAX ? (1u << c) : capacity);
+}
+
+ByteBufferLease::~ByteBufferLease()
+{
+	EXIT_IF(m_buf == nullptr);
+
+	m_buf->Clear();
+
+	auto*    pool     = get_pool();
+	uint32_t capacity = m_buf->Capacity();
+	uint32_t c        = size_class_floor(capacity);
+
+	if (c >= BUFFER_POOL_CLASS_MIN && c <= BUFFER_POOL_CLASS_MAX)
+	{
+		LockGuard lock(pool->mutex);
+
+		auto& list = pool->free[c - BUFFER_POOL_CLASS_MIN];
+		if (list.Size() < BUFFER_POOL_CLASS_LIMIT && pool->stats.bytes + capacity <= BUFFER_POOL_BYTES_LIMIT)
+		{
+			list.Add(m_buf);
+
+			pool->stats.buffers_num++;
+			pool->stats.bytes += capacity;
+			return;
+		}
+	}
+
+	delete m_buf;
+}
+
+void BufferPoolGetStats(BufferPoolStats* stats)
+{
+	EXIT_IF(stats == nullptr);
+
+	auto* pool = get_pool();
+
+	LockGuard lock(pool->mutex);
+
+	*stats = pool->stats;
+}
+
+void BufferPoolTrim()
+{
+	auto* pool = get_pool();
+
+	LockGuard lock(pool->mutex);
+
+	for (auto& list: pool->free)
+	{
+		for (auto* buf: list)
+		{
+			delete buf;
+		}
+		list.Free();
+	}
+
+	pool->stats.buffers_num = 0;
+	pool->stats.bytes       = 0;
+}
+
+} // namespace Kyty::Core
@@ -1,5 +1,6 @@
 #include "Kyty/Core/Compression.h"
 
+#include "Kyty/Core/BufferPool.h"
 #include "Kyty/Core/Common.h"
 #include "Kyty/Core/DbgAssert.h"
 #include "Kyty/Core/File.h"
@@ -38,6 +39,7 @@ extern "C" {
 //#pragma GCC diagnostic pop
 //#endif
 
+#include "dictBuilder/zdict.h"
 #include "zstd.h"
 
 namespace Kyty::Core {
@@ -56,9 +58,9 @@ struct InStream
 struct OutStream
 {
 	ISeqOutStream    t {};
-	Core::ByteBuffer buf;
+	Core::ByteBuffer* buf = nullptr;
 
-	void Init(uint32_t initial_size);
+	void Init(Core::ByteBuffer* out, uint32_t initial_size);
 };
 
 SRes Read(void* p, void* buf, size_t* size)
@@ -99,7 +101,7 @@ size_t Write(void* p, const void* buf, size_t size)
 
 	EXIT_IF((s64 >> 32u) != 0);
 
-	s->buf.Add(static_cast<const Byte*>(buf), s64);
+	s->buf->Add(static_cast<const Byte*>(buf), s64);
 
 	return s64;
 }
@@ -131,10 +133,12 @@ void InStream::Close()
 	this->mem_file.Close();
 }
 
-void OutStream::Init(uint32_t initial_size)
+void OutStream::Init(Core::ByteBuffer* out, uint32_t initial_size)
 {
 	this->t.Write = Write;
-	this->buf.Expand(initial_size);
+	this->buf     = out;
+	this->buf->Clear();
+	this->buf->Expand(initial_size);
 }
 
 static ICompressProgress g_progress_callback = {&LzmaImpl::Progress};
@@ -643,6 +647,15 @@ static uint32_t lzf_decompress(const void* input, uint32_t length, void* output,
 
 ByteBuffer CompressLzma(const uint8_t* buf, uint32_t length)
 {
+	ByteBuffer out;
+	CompressLzma(buf, length, &out);
+	return out;
+}
+
+void CompressLzma(const uint8_t* buf, uint32_t length, ByteBuffer* out)
+{
+	EXIT_IF(out == nullptr);
+
 	CLzmaEncHandle enc = LzmaEnc_Create(&LzmaImpl::g_alloc_lzma);
 
 	EXIT_IF(!enc);
@@ -674,7 +687,7 @@ ByteBuffer CompressLzma(const uint8_t* buf, uint32_t length)
 	std::memcpy(header + LZMA_PROPS_SIZE, &length64, 8);
 
 	in_stream.Init(buf, length);
-	out_stream.Init(0);
+	out_stream.Init(out, 0);
 
 	out_stream.t.Write(&out_stream.t, header, LZMA_PROPS_SIZE + 8);
 
@@ -686,8 +699,6 @@ ByteBuffer CompressLzma(const uint8_t* buf, uint32_t length)
 	LzmaEnc_Destroy(enc, &LzmaImpl::g_alloc_lzma, &LzmaImpl::g_alloc_lzma);
 
 	in_stream.Close();
-
-	return out_stream.buf;
 }
 
 ByteBuffer CompressLzma(const ByteBuffer& buf)
@@ -764,6 +775,14 @@ static SRes Decode2(CLzmaDec* state, ISeqOutStream* out_stream, ISeqInStream* in
 
 ByteBuffer DecompressLzma(const uint8_t* buf, uint32_t length)
 {
+	ByteBuffer out;
+	DecompressLzma(buf, length, &out);
+	return out;
+}
+
+void DecompressLzma(const uint8_t* buf, uint32_t length, ByteBuffer* out)
+{
+	EXIT_IF(out == nullptr);
 	EXIT_IF(!buf);
 	EXIT_IF(length == 0);
 
@@ -791,7 +810,7 @@ ByteBuffer DecompressLzma(const uint8_t* buf, uint32_t length)
 
 	EXIT_IF((length64 >> 32u) != 0);
 
-	out_stream.Init(length64);
+	out_stream.Init(out, length64);
 
 	[[maybe_unused]] SRes res = LzmaDec_Allocate(&dec, header, LZMA_PROPS_SIZE, &LzmaImpl::g_alloc_lzma);
 
@@ -804,8 +823,6 @@ ByteBuffer DecompressLzma(const uint8_t* buf, uint32_t length)
 	LzmaDec_Free(&dec, &LzmaImpl::g_alloc_lzma);
 
 	in_stream.Close();
-
-	return out_stream.buf;
 }
 
 ByteBuffer DecompressLzma(const ByteBuffer& buf)
@@ -829,12 +846,22 @@ constexpr uint32_t ZIP_OUT_BUF_SIZE = (16 * 1024);
 
 ByteBuffer CompressZip(const uint8_t* buf, uint32_t length, ZipCompressLevel level)
 {
+	ByteBuffer out;
+	CompressZip(buf, length, &out, level);
+	return out;
+}
+
+void CompressZip(const uint8_t* buf, uint32_t length, ByteBuffer* out, ZipCompressLevel level)
+{
+	EXIT_IF(out == nullptr);
+
 	int       status = 0;
 	mz_stream stream;
 	memset(&stream, 0, sizeof(stream));
 
-	ByteBuffer out;
-	uint8_t    temp_buf[ZIP_OUT_BUF_SIZE];
+	uint8_t temp_buf[ZIP_OUT_BUF_SIZE];
+
+	out->Clear();
 
 	stream.next_in  = buf;
 	stream.avail_in = length;
@@ -856,7 +883,7 @@ ByteBuffer CompressZip(const uint8_t* buf, uint32_t length, ZipCompressLevel lev
 
 			EXIT_IF(status != MZ_OK && status != MZ_STREAM_END);
 
-			out.Add(reinterpret_cast<Byte*>(temp_buf), ZIP_OUT_BUF_SIZE - stream.avail_out);
+			out->Add(reinterpret_cast<Byte*>(temp_buf), ZIP_OUT_BUF_SIZE - stream.avail_out);
 
 			if (status != MZ_OK)
 			{
@@ -865,11 +892,9 @@ ByteBuffer CompressZip(const uint8_t* buf, uint32_t length, ZipCompressLevel lev
 		}
 	}
 
-	EXIT_IF(stream.total_out != out.Size());
+	EXIT_IF(stream.total_out != out->Size());
 
 	mz_deflateEnd(&stream);
-
-	return out;
 }
 
 ByteBuffer CompressZip(const ByteBuffer& buf, ZipCompressLevel level)
@@ -885,12 +910,22 @@ ByteBuffer CompressZip(const String& str, ZipCompressLevel level)
 
 ByteBuffer DecompressZip(const uint8_t* buf, uint32_t length)
 {
+	ByteBuffer out;
+	DecompressZip(buf, length, &out);
+	return out;
+}
+
+void DecompressZip(const uint8_t* buf, uint32_t length, ByteBuffer* out)
+{
+	EXIT_IF(out == nullptr);
+
 	int       status = 0;
 	mz_stream stream;
 	memset(&stream, 0, sizeof(stream));
 
-	ByteBuffer out;
-	uint8_t    temp_buf[ZIP_OUT_BUF_SIZE];
+	uint8_t temp_buf[ZIP_OUT_BUF_SIZE];
+
+	out->Clear();
 
 	stream.next_in  = buf;
 	stream.avail_in = length;
@@ -912,7 +947,7 @@ ByteBuffer DecompressZip(const uint8_t* buf, uint32_t length)
 
 			EXIT_IF(status != MZ_OK && status != MZ_STREAM_END);
 
-			out.Add(reinterpret_cast<Byte*>(temp_buf), ZIP_OUT_BUF_SIZE - stream.avail_out);
+			out->Add(reinterpret_cast<Byte*>(temp_buf), ZIP_OUT_BUF_SIZE - stream.avail_out);
 
 			if (status != MZ_OK)
 			{
@@ -921,11 +956,9 @@ ByteBuffer DecompressZip(const uint8_t* buf, uint32_t length)
 		}
 	}
 
-	EXIT_IF(stream.total_out != out.Size());
+	EXIT_IF(stream.total_out != out->Size());
 
 	mz_deflateEnd(&stream);
-
-	return out;
 }
 
 ByteBuffer DecompressZip(const ByteBuffer& buf)
@@ -933,6 +966,56 @@ ByteBuffer DecompressZip(const ByteBuffer& buf)
 	return DecompressZip(reinterpret_cast<const uint8_t*>(buf.GetDataConst()), buf.Size());
 }
 
+uint64_t DecompressZip(const uint8_t* buf, uint64_t length, uint8_t* dst, uint64_t dst_size)
+{
+	constexpr uint64_t CHUNK_MAX = 0x40000000;
+
+	int       status = 0;
+	mz_stream stream;
+	memset(&stream, 0, sizeof(stream));
+
+	stream.zalloc = ZipImpl::Alloc;
+	stream.zfree  = ZipImpl::Free;
+
+	status = mz_inflateInit(&stream);
+
+	EXIT_IF(status != MZ_OK);
+
+	uint64_t in_pos  = 0;
+	uint64_t out_pos = 0;
+
+	// avail_in and avail_out are 32-bit
+	for (;;)
+	{
+		uint64_t in_size  = (length - in_pos < CHUNK_MAX ? length - in_pos : CHUNK_MAX);
+		uint64_t out_size = (dst_size - out_pos < CHUNK_MAX ? dst_size - out_pos : CHUNK_MAX);
+
+		stream.next_in   = buf + in_pos;
+		stream.avail_in  = static_cast<uint32_t>(in_size);
+		stream.next_out  = dst + out_pos;
+		stream.avail_out = static_cast<uint32_t>(out_size);
+
+		status = mz_inflate(&stream, MZ_NO_FLUSH);
+
+		EXIT_IF(status != MZ_OK && status != MZ_STREAM_END);
+
+		in_pos += in_size - stream.avail_in;
+		out_pos += out_size - stream.avail_out;
+
+		if (status == MZ_STREAM_END)
+		{
+			break;
+		}
+
+		// Truncated stream or dst is too small
+		EXIT_IF(stream.avail_in == in_size && stream.avail_out == out_size);
+	}
+
+	mz_inflateEnd(&stream);
+
+	return out_pos;
+}
+
 String DecompressZipStr(const uint8_t* buf, uint32_t length)
 {
 	ByteBuffer utf8 = DecompressZip(buf, length);
@@ -947,20 +1030,24 @@ String DecompressZipStr(const ByteBuffer& buf)
 
 ByteBuffer CompressLzf(const uint8_t* buf, uint32_t length)
 {
-	uint32_t   size = lzf_calc_compressed_size(buf, length);
-	ByteBuffer b(size * 2);
-	size = lzf_compress(buf, length, b.GetData());
+	ByteBuffer b;
+	CompressLzf(buf, length, &b);
+	return b;
+}
+
+void CompressLzf(const uint8_t* buf, uint32_t length, ByteBuffer* out)
+{
+	EXIT_IF(out == nullptr);
 
-	KYTY_MEM_CHECK(b.GetDataConst());
+	uint32_t size = lzf_calc_compressed_size(buf, length);
+	out->Resize(size * 2);
+	size = lzf_compress(buf, length, out->GetData());
 
-	EXIT_IF(size > b.Size());
+	KYTY_MEM_CHECK(out->GetDataConst());
 
-	if (size != b.Size())
-	{
-		b.RemoveAt(size, b.Size() - size);
-	}
+	EXIT_IF(size > out->Size());
 
-	return b;
+	out->Resize(size);
 }
 
 ByteBuffer CompressLzf(const ByteBuffer& buf)
@@ -976,13 +1063,20 @@ ByteBuffer CompressLzf(const String& str)
 
 ByteBuffer DecompressLzf(const uint8_t* buf, uint32_t length)
 {
-	[[maybe_unused]] uint32_t size = lzf_calc_decompressed_size(buf, length);
-	ByteBuffer                b(size);
-	size = lzf_decompress(buf, length, b.GetData(), size);
+	ByteBuffer b;
+	DecompressLzf(buf, length, &b);
+	return b;
+}
 
-	EXIT_IF(size != b.Size());
+void DecompressLzf(const uint8_t* buf, uint32_t length, ByteBuffer* out)
+{
+	EXIT_IF(out == nullptr);
 
-	return b;
+	[[maybe_unused]] uint32_t size = lzf_calc_decompressed_size(buf, length);
+	out->Resize(size);
+	size = lzf_decompress(buf, length, out->GetData(), size);
+
+	EXIT_IF(size != out->Size());
 }
 
 ByteBuffer DecompressLzf(const ByteBuffer& buf)
@@ -1002,18 +1096,27 @@ String DecompressLzfStr(const ByteBuffer& buf)
 	return DecompressLzfStr(reinterpret_cast<const uint8_t*>(buf.GetDataConst()), buf.Size());
 }
 
-ByteBuffer CompressZstd(const uint8_t* buf, uint32_t length, int level)
+void CompressZstd(const uint8_t* buf, uint32_t length, ByteBuffer* out, int level)
 {
-	size_t dst_size = ZSTD_compressBound(length) * 2;
-	auto*  dst      = new uint8_t[dst_size];
-	dst_size        = ZSTD_compress(dst, dst_size, buf, length, level);
+	EXIT_IF(out == nullptr);
+
+	size_t dst_size = ZSTD_compressBound(length);
+	EXIT_IF((uint64_t(dst_size) >> 32u) > 0);
+	out->Resize(static_cast<uint32_t>(dst_size));
+	dst_size = ZSTD_compress(out->GetData(), dst_size, buf, length, level);
 	if (ZSTD_isError(dst_size) != 0u)
 	{
 		EXIT("ZSTD: %s\n", ZSTD_getErrorName(dst_size));
 	}
-	ByteBuffer ret(dst, static_cast<uint32_t>(dst_size));
-	DeleteArray(dst);
-	return ret;
+	out->Resize(static_cast<uint32_t>(dst_size));
+}
+
+ByteBuffer CompressZstd(const uint8_t* buf, uint32_t length, int level)
+{
+	// The bound is much larger than the result, only the result is copied
+	ByteBufferLease dst(static_cast<uint32_t>(ZSTD_compressBound(length)));
+	CompressZstd(buf, length, dst.Get(), level);
+	return ByteBuffer(dst->GetDataConst(), dst->Size());
 }
 
 ByteBuffer CompressZstd(const ByteBuffer& buf, int level)
@@ -1029,24 +1132,43 @@ ByteBuffer CompressZstd(const String& str, int level)
 
 ByteBuffer DecompressZstd(const uint8_t* buf, uint32_t length)
 {
-	ByteBuffer       r;
-	size_t           buff_out_size = ZSTD_DStreamOutSize();
-	Byte*            buff_out      = new Byte[buff_out_size];
-	ZSTD_DCtx* const dctx          = ZSTD_createDCtx();
-	ZSTD_inBuffer    input         = {buf, length, 0};
+	ByteBuffer r;
+	DecompressZstd(buf, length, &r);
+	return r;
+}
+
+void DecompressZstd(const uint8_t* buf, uint32_t length, ByteBuffer* out)
+{
+	EXIT_IF(out == nullptr);
+
+	out->Clear();
+
+	// A single frame with the size in the header is decompressed in place
+	uint64_t content_size = 0;
+	if (GetZstdContentSize(buf, length, &content_size) && content_size != 0 && (content_size >> 32u) == 0 &&
+	    ZSTD_findFrameCompressedSize(buf, length) == length)
+	{
+		out->Resize(static_cast<uint32_t>(content_size));
+		[[maybe_unused]] uint32_t size = DecompressZstd(buf, length, reinterpret_cast<uint8_t*>(out->GetData()), out->Size());
+		EXIT_IF(size != content_size);
+		return;
+	}
+
+	ByteBufferLease  buff_out(static_cast<uint32_t>(ZSTD_DStreamOutSize()));
+	ZSTD_DCtx* const dctx  = ZSTD_createDCtx();
+	ZSTD_inBuffer    input = {buf, length, 0};
+	buff_out->Resize(static_cast<uint32_t>(ZSTD_DStreamOutSize()));
 	while (input.pos < input.size)
 	{
-		ZSTD_outBuffer output = {buff_out, buff_out_size, 0};
+		ZSTD_outBuffer output = {buff_out->GetData(), buff_out->Size(), 0};
 		auto           ret    = ZSTD_decompressStream(dctx, &output, &input);
 		if (ZSTD_isError(ret) != 0u)
 		{
 			EXIT("ZSTD: %s\n", ZSTD_getErrorName(ret));
 		}
-		r.Add(buff_out, static_cast<uint32_t>(output.pos));
+		out->Add(buff_out->GetDataConst(), static_cast<uint32_t>(output.pos));
 	}
 	ZSTD_freeDCtx(dctx);
-	DeleteArray(buff_out);
-	return r;
 }
 
 ByteBuffer DecompressZstd(const ByteBuffer& buf)
@@ -1066,11 +1188,281 @@ String DecompressZstdStr(const ByteBuffer& buf)
 	return DecompressZstdStr(reinterpret_cast<const uint8_t*>(buf.GetDataConst()), buf.Size());
 }
 
+struct ZstdDictPrivate
+{
+	ByteBuffer   data;
+	ZSTD_CDict*  cdict = nullptr;
+	ZSTD_DDict*  ddict = nullptr;
+	unsigned int id    = 0;
+};
+
+struct ZstdCompressorPrivate
+{
+	ZSTD_CCtx* cctx = nullptr;
+	ByteBuffer buf_out;
+};
+
+struct ZstdDecompressorPrivate
+{
+	ZSTD_DCtx* dctx = nullptr;
+	ByteBuffer buf_out;
+	bool       finished = true;
+};
+
+static void zstd_check(size_t ret)
+{
+	if (ZSTD_isError(ret) != 0u)
+	{
+		EXIT("ZSTD: %s\n", ZSTD_getErrorName(ret));
+	}
+}
+
+uint32_t DecompressZstd(const uint8_t* buf, uint32_t length, uint8_t* dst, uint32_t dst_size, const ZstdDict* dict)
+{
+	ZSTD_DCtx* dctx = ZSTD_createDCtx();
+	size_t     size = 0;
+	if (dict != nullptr && dict->IsValid())
+	{
+		size = ZSTD_decompress_usingDDict(dctx, dst, dst_size, buf, length, dict->m_p->ddict);
+	} else
+	{
+		size = ZSTD_decompressDCtx(dctx, dst, dst_size, buf, length);
+	}
+	ZSTD_freeDCtx(dctx);
+	zstd_check(size);
+	return static_cast<uint32_t>(size);
+}
+
+bool TryDecompressZstd(const uint8_t* buf, uint32_t length, uint8_t* dst, uint32_t dst_size, uint32_t* size)
+{
+	EXIT_IF(size == nullptr);
+
+	ZSTD_DCtx* dctx = ZSTD_createDCtx();
+	size_t     ret  = ZSTD_decompressDCtx(dctx, dst, dst_size, buf, length);
+	ZSTD_freeDCtx(dctx);
+	if (ZSTD_isError(ret) != 0u)
+	{
+		return false;
+	}
+	*size = static_cast<uint32_t>(ret);
+	return true;
+}
+
+bool GetZstdContentSize(const uint8_t* buf, uint32_t length, uint64_t* size)
+{
+	EXIT_IF(size == nullptr);
+
+	auto s = ZSTD_getFrameContentSize(buf, length);
+	if (s == ZSTD_CONTENTSIZE_UNKNOWN || s == ZSTD_CONTENTSIZE_ERROR)
+	{
+		return false;
+	}
+	*size = s;
+	return true;
+}
+
+ZstdDict::~ZstdDict()
+{
+	if (m_p != nullptr)
+	{
+		ZSTD_freeCDict(m_p->cdict);
+		ZSTD_freeDDict(m_p->ddict);
+		Delete(m_p);
+	}
+}
+
+bool ZstdDict::Train(const Vector<ByteBuffer>& samples, uint32_t dict_size, int level)
+{
+	ByteBuffer     all;
+	Vector<size_t> sizes;
+	for (const auto& sample: samples)
+	{
+		all.Add(sample);
+		sizes.Add(sample.Size());
+	}
+
+	ByteBuffer dict(dict_size, false);
+
+	auto size = ZDICT_trainFromBuffer(dict.GetData(), dict_size, all.GetDataConst(), sizes.GetDataConst(), sizes.Size());
+	if (ZDICT_isError(size) != 0u)
+	{
+		return false;
+	}
+
+	dict.RemoveAt(static_cast<uint32_t>(size), dict_size - static_cast<uint32_t>(size));
+
+	return Load(dict, level);
+}
+
+bool ZstdDict::Load(const ByteBuffer& dict, int level)
+{
+	EXIT_IF(m_p != nullptr);
+
+	auto* cdict = ZSTD_createCDict(dict.GetDataConst(), dict.Size(), level);
+	auto* ddict = ZSTD_createDDict(dict.GetDataConst(), dict.Size());
+
+	if (cdict == nullptr || ddict == nullptr)
+	{
+		ZSTD_freeCDict(cdict);
+		ZSTD_freeDDict(ddict);
+		return false;
+	}
+
+	m_p        = new ZstdDictPrivate;
+	m_p->data  = dict;
+	m_p->cdict = cdict;
+	m_p->ddict = ddict;
+	m_p->id    = ZDICT_getDictID(dict.GetDataConst(), dict.Size());
+
+	return true;
+}
+
+uint32_t ZstdDict::GetId() const
+{
+	EXIT_IF(m_p == nullptr);
+
+	return m_p->id;
+}
+
+const ByteBuffer& ZstdDict::GetData() const
+{
+	EXIT_IF(m_p == nullptr);
+
+	return m_p->data;
+}
+
+ZstdCompressor::ZstdCompressor(int level, int workers_num, const ZstdDict* dict): m_p(new ZstdCompressorPrivate)
+{
+	m_p->cctx    = ZSTD_createCCtx();
+	m_p->buf_out = ByteBuffer(static_cast<uint32_t>(ZSTD_CStreamOutSize()), false);
+
+	zstd_check(ZSTD_CCtx_setParameter(m_p->cctx, ZSTD_c_compressionLevel, level));
+	if (workers_num > 0)
+	{
+		// Fails if zstd is built without ZSTD_MULTITHREAD
+		zstd_check(ZSTD_CCtx_setParameter(m_p->cctx, ZSTD_c_nbWorkers, workers_num));
+	}
+	if (dict != nullptr && dict->IsValid())
+	{
+		zstd_check(ZSTD_CCtx_refCDict(m_p->cctx, dict->m_p->cdict));
+	}
+}
+
+ZstdCompressor::~ZstdCompressor()
+{
+	ZSTD_freeCCtx(m_p->cctx);
+	Delete(m_p);
+}
+
+void ZstdCompressor::Push(const uint8_t* buf, uint32_t length, ByteBuffer* out)
+{
+	EXIT_IF(out == nullptr);
+
+	ZSTD_inBuffer input = {buf, length, 0};
+	while (input.pos < input.size)
+	{
+		ZSTD_outBuffer output = {m_p->buf_out.GetData(), m_p->buf_out.Size(), 0};
+		zstd_check(ZSTD_compressStream2(m_p->cctx, &output, &input, ZSTD_e_continue));
+		out->Add(m_p->buf_out.GetDataConst(), static_cast<uint32_t>(output.pos));
+	}
+}
+
+void ZstdCompressor::Push(const ByteBuffer& buf, ByteBuffer* out)
+{
+	Push(reinterpret_cast<const uint8_t*>(buf.GetDataConst()), buf.Size(), out);
+}
+
+void ZstdCompressor::Finish(ByteBuffer* out)
+{
+	EXIT_IF(out == nullptr);
+
+	ZSTD_inBuffer input     = {nullptr, 0, 0};
+	size_t        remaining = 0;
+	do
+	{
+		ZSTD_outBuffer output = {m_p->buf_out.GetData(), m_p->buf_out.Size(), 0};
+		remaining             = ZSTD_compressStream2(m_p->cctx, &output, &input, ZSTD_e_end);
+		zstd_check(remaining);
+		out->Add(m_p->buf_out.GetDataConst(), static_cast<uint32_t>(output.pos));
+	} while (remaining != 0);
+}
+
+ByteBuffer ZstdCompressor::Compress(const uint8_t* buf, uint32_t length)
+{
+	ByteBuffer out;
+	Push(buf, length, &out);
+	Finish(&out);
+	return out;
+}
+
+ByteBuffer ZstdCompressor::Compress(const ByteBuffer& buf)
+{
+	return Compress(reinterpret_cast<const uint8_t*>(buf.GetDataConst()), buf.Size());
+}
+
+ZstdDecompressor::ZstdDecompressor(const ZstdDict* dict): m_p(new ZstdDecompressorPrivate)
+{
+	m_p->dctx    = ZSTD_createDCtx();
+	m_p->buf_out = ByteBuffer(static_cast<uint32_t>(ZSTD_DStreamOutSize()), false);
+
+	if (dict != nullptr && dict->IsValid())
+	{
+		zstd_check(ZSTD_DCtx_refDDict(m_p->dctx, dict->m_p->ddict));
+	}
+}
+
+ZstdDecompressor::~ZstdDecompressor()
+{
+	ZSTD_freeDCtx(m_p->dctx);
+	Delete(m_p);
+}
+
+void ZstdDecompressor::Push(const uint8_t* buf, uint32_t length, ByteBuffer* out)
+{
+	EXIT_IF(out == nullptr);
+
+	ZSTD_inBuffer input = {buf, length, 0};
+	size_t        hint  = 0;
+	for (;;)
+	{
+		ZSTD_outBuffer output = {m_p->buf_out.GetData(), m_p->buf_out.Size(), 0};
+		hint                  = ZSTD_decompressStream(m_p->dctx, &output, &input);
+		zstd_check(hint);
+		out->Add(m_p->buf_out.GetDataConst(), static_cast<uint32_t>(output.pos));
+
+		// A full output buffer may leave data inside the context even if all the input is consumed
+		if (input.pos == input.size && output.pos < output.size)
+		{
+			break;
+		}
+	}
+	m_p->finished = (hint == 0);
+}
+
+void ZstdDecompressor::Push(const ByteBuffer& buf, ByteBuffer* out)
+{
+	Push(reinterpret_cast<const uint8_t*>(buf.GetDataConst()), buf.Size(), out);
+}
+
+bool ZstdDecompressor::IsFrameFinished() const
+{
+	return m_p->finished;
+}
+
 struct ZipPrivate
 {
 	mz_zip_archive zip;
+	File*          file     = nullptr;
+	const uint8_t* mem      = nullptr; // the whole archive if it is in memory or mapped
+	uint64_t       mem_size = 0;
 };
 
+static size_t zip_extract_chunk(void* opaque, mz_uint64 /*file_ofs*/, const void* buf, size_t n)
+{
+	const auto& func = *static_cast<const ZipExtractFunc*>(opaque);
+	return func(buf, n) ? n : 0;
+}
+
 ZipReader::~ZipReader()
 {
 	Close();
@@ -1091,6 +1483,7 @@ bool ZipReader::Open(const String& file_name)
 	File* f = new File;
 	f->Open(file_name, File::Mode::Read);
 
+	m_p->file             = f;
 	m_p->zip.m_pIO_opaque = f;
 
 	if (f->IsInvalid() || (mz_zip_reader_init(&m_p->zip, f->Size(), 0) == 0))
@@ -1118,6 +1511,9 @@ bool ZipReader::Open(const ByteBuffer& buf)
 	File* f = new File;
 	f->OpenInMem(const_cast<ByteBuffer&>(buf)); // NOLINT(cppcoreguidelines-pro-type-const-cast)
 
+	m_p->file             = f;
+	m_p->mem              = reinterpret_cast<const uint8_t*>(buf.GetDataConst());
+	m_p->mem_size         = buf.Size();
 	m_p->zip.m_pIO_opaque = f;
 
 	if (mz_zip_reader_init(&m_p->zip, f->Size(), 0) == 0)
@@ -1145,6 +1541,9 @@ bool ZipReader::Open(uint8_t* mem, uint32_t size)
 	File* f = new File;
 	f->OpenInMem(mem, size);
 
+	m_p->file             = f;
+	m_p->mem              = mem;
+	m_p->mem_size         = size;
 	m_p->zip.m_pIO_opaque = f;
 
 	if (mz_zip_reader_init(&m_p->zip, f->Size(), 0) == 0)
@@ -1157,14 +1556,60 @@ bool ZipReader::Open(uint8_t* mem, uint32_t size)
 	return true;
 }
 
+bool ZipReader::OpenMapped(const String& file_name)
+{
+	Close();
+
+	m_p = new ZipPrivate;
+	memset(&m_p->zip, 0, sizeof(m_p->zip));
+	m_p->zip.m_pAlloc   = ZipImpl::Alloc;
+	m_p->zip.m_pFree    = ZipImpl::Free;
+	m_p->zip.m_pRealloc = ZipImpl::Realloc;
+
+	m_p->file = new File;
+	m_p->file->Open(file_name, File::Mode::Read);
+
+	if (m_p->file->IsInvalid())
+	{
+		Close();
+
+		return false;
+	}
+
+	uint64_t    size = 0;
+	const auto* map  = static_cast<const uint8_t*>(m_p->file->Map(&size));
+
+	if (map == nullptr)
+	{
+		Close();
+
+		return Open(file_name);
+	}
+
+	m_p->mem      = map;
+	m_p->mem_size = size;
+
+	// The reads become memcpy from the mapping
+	if (mz_zip_reader_init_mem(&m_p->zip, map, size, 0) == 0)
+	{
+		Close();
+
+		return false;
+	}
+
+	return true;
+}
+
 void ZipReader::Close()
 {
 	if (m_p != nullptr)
 	{
 		mz_zip_reader_end(&m_p->zip);
-		File* f = static_cast<File*>(m_p->zip.m_pIO_opaque);
-		f->Close();
-		Delete(f);
+		if (m_p->file != nullptr)
+		{
+			m_p->file->Close();
+			Delete(m_p->file);
+		}
 		Delete(m_p);
 		m_p = nullptr;
 	}
@@ -1233,11 +1678,20 @@ int ZipReader::FindFile(const String& name, const String& comment)
 
 ByteBuffer ZipReader::ExtractFile(int file_index)
 {
-	size_t size = 0;
+	ByteBuffer buf;
+	ExtractFile(file_index, &buf);
+	return buf;
+}
+
+bool ZipReader::ExtractFile(int file_index, ByteBuffer* out)
+{
+	EXIT_IF(out == nullptr);
+
+	out->Clear();
 
 	if (file_index < 0 || IsFileDirectory(file_index))
 	{
-		return {};
+		return false;
 	}
 
 	ZipFileStat s {};
@@ -1245,22 +1699,19 @@ ByteBuffer ZipReader::ExtractFile(int file_index)
 
 	if (s.m_uncomp_size == 0)
 	{
-		return {};
+		return true;
 	}
 
-	void* ptr = mz_zip_reader_extract_to_heap(&m_p->zip, file_index, &size, 0);
+	EXIT_IF((s.m_uncomp_size >> 32u) > 0);
+	auto nn = static_cast<uint32_t>(s.m_uncomp_size);
 
-	EXIT_IF(!ptr || !size);
+	out->Resize(nn);
 
-	EXIT_IF(sizeof(size_t) > 4 && (uint64_t(size) >> 32u) > 0);
-	auto nn = static_cast<uint32_t>(size);
+	[[maybe_unused]] bool ok = ExtractFileTo(file_index, out->GetData(), nn);
 
-	ByteBuffer buf(nn);
-	std::memcpy(buf.GetData(), ptr, size);
+	EXIT_IF(!ok);
 
-	m_p->zip.m_pFree(nullptr, ptr);
-
-	return buf;
+	return true;
 }
 
 ByteBuffer ZipReader::ExtractFile(const String& name)
@@ -1268,6 +1719,62 @@ ByteBuffer ZipReader::ExtractFile(const String& name)
 	return ExtractFile(FindFile(name));
 }
 
+bool ZipReader::ExtractFileTo(int file_index, void* dst, uint64_t dst_size)
+{
+	EXIT_IF(!m_p);
+
+	return file_index >= 0 && mz_zip_reader_extract_to_mem(&m_p->zip, file_index, dst, dst_size, 0) != 0;
+}
+
+bool ZipReader::ExtractFileChunks(int file_index, const ZipExtractFunc& func)
+{
+	EXIT_IF(!m_p);
+
+	return file_index >= 0 &&
+	       mz_zip_reader_extract_to_callback(&m_p->zip, file_index, zip_extract_chunk, const_cast<ZipExtractFunc*>(&func), 0) != 0;
+}
+
+const uint8_t* ZipReader::GetFileView(int file_index, uint64_t* size)
+{
+	EXIT_IF(!m_p);
+	EXIT_IF(size == nullptr);
+
+	constexpr uint32_t LOCAL_HEADER_SIGNATURE = 0x04034b50;
+	constexpr uint32_t LOCAL_HEADER_SIZE      = 30;
+
+	mz_zip_archive_file_stat s;
+
+	if (m_p->mem == nullptr || file_index < 0 || mz_zip_reader_file_stat(&m_p->zip, file_index, &s) == 0 || s.m_method != 0 ||
+	    s.m_is_encrypted != 0 || s.m_comp_size != s.m_uncomp_size)
+	{
+		return nullptr;
+	}
+
+	// The data follows the local header, its name and extra fields may differ from the central directory
+	uint64_t offset = s.m_local_header_ofs;
+	if (offset + LOCAL_HEADER_SIZE > m_p->mem_size)
+	{
+		return nullptr;
+	}
+
+	const uint8_t* header = m_p->mem + offset;
+
+	if ((header[0] | (header[1] << 8u) | (header[2] << 16u) | (static_cast<uint32_t>(header[3]) << 24u)) != LOCAL_HEADER_SIGNATURE)
+	{
+		return nullptr;
+	}
+
+	offset += LOCAL_HEADER_SIZE + (header[26] | (header[27] << 8u)) + (header[28] | (header[29] << 8u));
+	if (offset + s.m_comp_size > m_p->mem_size)
+	{
+		return nullptr;
+	}
+
+	*size = s.m_uncomp_size;
+
+	return m_p->mem + offset;
+}
+
 // ZipWriter::ZipWriter()
 //{
 //	m_p = nullptr;
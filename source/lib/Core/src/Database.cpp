@@ -3,6 +3,7 @@
 #include "Kyty/Core/DateTime.h"
 #include "Kyty/Core/DbgAssert.h"
 #include "Kyty/Core/File.h"
+#include "Kyty/Core/FlatHashmap.h"
 #include "Kyty/Core/SafeDelete.h"
 #include "Kyty/Core/Threads.h"
 #include "Kyty/Math/Rand.h"
@@ -58,9 +59,10 @@ struct ConnectionPrivate
 	void SetError(bool error) const;
 	void SetError(bool error, const String& msg) const;
 
-	sqlite3*           db {nullptr};
-	Connection*        parent;
-	Vector<Statement*> statements;
+	sqlite3*                              db {nullptr};
+	Connection*                           parent;
+	Vector<Statement*>                    statements;
+	Core::FlatHashmap<String, Statement*> cache;
 };
 
 static void errorLogCallback(void* /*pArg*/, int i_err_code, const char* z_msg)
@@ -849,6 +851,31 @@ Statement* Connection::Prepare(const char* sql_text)
 	return s;
 }
 
+Statement* Connection::PrepareCached(const char* sql_text)
+{
+	EXIT_IF(!m_p->db);
+
+	auto text = String::FromUtf8(sql_text);
+
+	if (auto* cached = m_p->cache.Find(text); cached != nullptr)
+	{
+		auto* s = *cached;
+		s->m_p->Reset();
+		s->m_p->ClearBindings();
+		return s;
+	}
+
+	auto* s = Prepare(sql_text);
+
+	// Failed statements are not kept, the error is reported again next time
+	if (s->m_p->p_stmt != nullptr)
+	{
+		m_p->cache.Put(text, s);
+	}
+
+	return s;
+}
+
 static int exec_callback(void* data, int count, char** values, char** names)
 {
 	auto* r = static_cast<Connection::ExecResult*>(data);
@@ -1039,6 +1066,20 @@ void Connection::EndTransaction()
 	Exec("END TRANSACTION");
 }
 
+void Connection::RollbackTransaction()
+{
+	Exec("ROLLBACK TRANSACTION");
+}
+
+void Connection::SetScratchPragmas()
+{
+	// Our VFS has no shared memory, WAL works only while the database is locked exclusively
+	Exec("PRAGMA locking_mode = EXCLUSIVE");
+	Exec("PRAGMA journal_mode = WAL");
+	Exec("PRAGMA synchronous = OFF");
+	Exec("PRAGMA temp_store = MEMORY");
+}
+
 void Connection::Vacuum()
 {
 	Exec("VACUUM");
@@ -1054,6 +1095,40 @@ void Connection::CloseAllStatements()
 			s = nullptr;
 		}
 	}
+
+	m_p->statements.Clear();
+	m_p->cache.Clear();
+}
+
+Transaction::Transaction(Connection* db): m_db(db)
+{
+	EXIT_IF(m_db == nullptr);
+
+	m_db->BeginTransaction();
+}
+
+Transaction::~Transaction()
+{
+	if (!m_done)
+	{
+		Commit();
+	}
+}
+
+void Transaction::Commit()
+{
+	EXIT_IF(m_done);
+
+	m_db->EndTransaction();
+	m_done = true;
+}
+
+void Transaction::Rollback()
+{
+	EXIT_IF(m_done);
+
+	m_db->RollbackTransaction();
+	m_done = true;
 }
 
 } // namespace Kyty::Core::Database
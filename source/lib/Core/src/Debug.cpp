@@ -70,7 +70,7 @@ struct DebugMapPrivate
 
 	void FixBaseAddress();
 
-	static const DebugFunctionInfo* FindFunc(DebugMap* map, uintptr_t addr);
+	static bool FindFunc(const DebugMap* map, uintptr_t addr, DebugSymbol* sym);
 
 	KYTY_CLASS_NO_COPY(DebugMapPrivate)
 
@@ -144,7 +144,8 @@ void DebugMap::LoadMap()
 
 #endif
 
-#if KYTY_PLATFORM == KYTY_PLATFORM_WINDOWS
+#if KYTY_PLATFORM == KYTY_PLATFORM_WINDOWS || KYTY_PLATFORM == KYTY_PLATFORM_LINUX
+	// The next run loads the csv instead of parsing the map
 	DumpMap(map_file.FilenameWithoutExtension() + U".csv");
 
 	if (linker == U"lld")
@@ -172,6 +173,15 @@ void DebugMap::LoadCsv()
 	String map_file =
 	    g_exe_name->FilenameWithoutExtension() + U"_" + Debug::GetCompiler() + U"_" + linker + U"_" + Debug::GetBitness() + U".csv";
 
+	// The csv is made from the map after the build. If it's missing or older than the map, the map is parsed and the csv is written.
+	String src_file = map_file.FilenameWithoutExtension() + U".map";
+	if (File::IsFileExisting(src_file) &&
+	    (!File::IsFileExisting(map_file) || File::GetLastWriteTimeUTC(map_file) < File::GetLastWriteTimeUTC(src_file)))
+	{
+		LoadMap();
+		return;
+	}
+
 	LoadCsv(map_file);
 
 	if (linker == U"lld")
@@ -734,16 +744,9 @@ void DebugMap::DumpMap(const String& name)
 	file.Close();
 }
 
-static const DebugFunctionInfo* GetFunc(const DebugStack& s, int i)
+static bool GetFunc(const DebugStack& s, int i, DebugSymbol* sym)
 {
-	uintptr_t addr = s.GetAddr(i);
-
-	if (g_dbg_map != nullptr)
-	{
-		return DebugMapPrivate::FindFunc(g_dbg_map, addr);
-	}
-
-	return nullptr;
+	return Debug::FindSymbol(s.GetAddr(i), sym);
 }
 
 template <class T>
@@ -813,33 +816,34 @@ void DebugMapPrivate::FixBaseAddress()
 	}
 }
 
-const DebugFunctionInfo* DebugMapPrivate::FindFunc(DebugMap* map, uintptr_t addr)
+bool DebugMapPrivate::FindFunc(const DebugMap* map, uintptr_t addr, DebugSymbol* sym)
 {
-	static DebugFunctionInfo s {};
-
-	if (map->m_p->data.Size() == 0)
+	if (map->m_p->data.Size() != 0)
 	{
-		if (map->m_p->data2.Size() == 0)
+		const auto* f = find_info(map->m_p->data.GetDataConst(), addr, 0, map->m_p->data.Size() - 1);
+		if (f != nullptr)
 		{
-			return nullptr;
+			*sym = {f->addr, f->length, f->name.GetDataConst(), f->obj.GetDataConst()};
+			return true;
 		}
-
-		const DebugFunctionInfo2* f2 = find_info(map->m_p->data2.GetData(), addr, 0, map->m_p->data2.Size() - 1);
-
-		if (f2 != nullptr)
+	} else if (map->m_p->data2.Size() != 0)
+	{
+		const auto* f = find_info(map->m_p->data2.GetDataConst(), addr, 0, map->m_p->data2.Size() - 1);
+		if (f != nullptr)
 		{
-			s.addr   = f2->addr;
-			s.length = f2->length;
-			s.name   = String::FromUtf8(f2->name).utf8_str();
-			s.obj    = String::FromUtf8(f2->obj).utf8_str();
-
-			return &s;
+			*sym = {f->addr, f->length, f->name, f->obj};
+			return true;
 		}
-
-		return nullptr;
 	}
 
-	return find_info(map->m_p->data.GetData(), addr, 0, map->m_p->data.Size() - 1);
+	return false;
+}
+
+bool Debug::FindSymbol(uintptr_t addr, DebugSymbol* sym)
+{
+	EXIT_IF(sym == nullptr);
+
+	return g_dbg_map != nullptr && DebugMapPrivate::FindFunc(g_dbg_map, addr, sym);
 }
 
 #if KYTY_PLATFORM != KYTY_PLATFORM_WINDOWS
@@ -896,17 +900,18 @@ void DebugStack::Print(int from, bool with_name) const
 {
 	for (int i = from; i < depth; i++)
 	{
-		const DebugFunctionInfo* f = with_name ? GetFunc(*this, i) : nullptr;
+		DebugSymbol        sym {};
+		const DebugSymbol* f = with_name && GetFunc(*this, i, &sym) ? &sym : nullptr;
 		if (sizeof(uintptr_t) == 4)
 		{
 			printf("[%d] %08" PRIx32 ", %08" PRIx32 ", %s, %s\n", i - from, static_cast<uint32_t>(GetAddr(i)),
-			       f != nullptr ? static_cast<uint32_t>(f->addr) : 0, f != nullptr ? f->obj.GetData() : "unknown",
-			       f != nullptr ? f->name.GetData() : "unknown");
+			       f != nullptr ? static_cast<uint32_t>(f->addr) : 0, f != nullptr ? f->obj : "unknown",
+			       f != nullptr ? f->name : "unknown");
 		} else
 		{
 			printf("[%d] %016" PRIx64 ", %016" PRIx64 ", %s, %s\n", i - from, static_cast<uint64_t>(GetAddr(i)),
-			       f != nullptr ? static_cast<uint64_t>(f->addr) : 0, f != nullptr ? f->obj.GetData() : "unknown",
-			       f != nullptr ? f->name.GetData() : "unknown");
+			       f != nullptr ? static_cast<uint64_t>(f->addr) : 0, f != nullptr ? f->obj : "unknown",
+			       f != nullptr ? f->name : "unknown");
 		}
 	}
 }
@@ -922,17 +927,18 @@ void DebugStack::PrintAndroid(int from, bool with_name) const
 	KYTY_LOGI("---stack---\n");
 	for (int i = from; i < depth; i++)
 	{
-		const DebugFunctionInfo* f = with_name ? GetFunc(*this, i) : nullptr;
+		DebugSymbol        sym {};
+		const DebugSymbol* f = with_name && GetFunc(*this, i, &sym) ? &sym : nullptr;
 		if (sizeof(uintptr_t) == 4)
 		{
 			KYTY_LOGI("[%d] %08" PRIx32 ", %08" PRIx32 ", %s, %s\n", i - from, static_cast<uint32_t>(GetAddr(i)),
-			          f != nullptr ? static_cast<uint32_t>(f->addr) : 0, f != nullptr ? f->obj.GetData() : "unknown",
-			          f != nullptr ? f->name.GetData() : "unknown");
+			          f != nullptr ? static_cast<uint32_t>(f->addr) : 0, f != nullptr ? f->obj : "unknown",
+			          f != nullptr ? f->name : "unknown");
 		} else
 		{
 			KYTY_LOGI("[%d] %016" PRIx64 ", %016" PRIx64 ", %s, %s\n", i - from, static_cast<uint64_t>(GetAddr(i)),
-			          f != nullptr ? static_cast<uint64_t>(f->addr) : 0, f != nullptr ? f->obj.GetData() : "unknown",
-			          f != nullptr ? f->name.GetData() : "unknown");
+			          f != nullptr ? static_cast<uint64_t>(f->addr) : 0, f != nullptr ? f->obj : "unknown",
+			          f != nullptr ? f->name : "unknown");
 		}
 	}
 }
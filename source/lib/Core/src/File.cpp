@@ -2,6 +2,7 @@
 
 #include "Kyty/Core/Common.h"
 #include "Kyty/Core/DbgAssert.h"
+#include "Kyty/Core/MemoryAlloc.h"
 #include "Kyty/Core/SafeDelete.h"
 #include "Kyty/Core/Vector.h"
 #include "Kyty/Sys/SysFileIO.h"
@@ -11,6 +12,10 @@
 #include "SDL_rwops.h"
 #include "SDL_stdinc.h"
 
+#include <atomic>
+#include <cstring>
+#include <utility>
+
 // IWYU pragma: no_include <fileapi.h>
 // IWYU pragma: no_include <windows.h>
 // IWYU pragma: no_include <winbase.h>
@@ -34,10 +39,21 @@ namespace Kyty::Core {
 
 // namespace Core {
 
+static std::atomic_uint64_t g_bytes_read = 0;
+
 struct File::FilePrivate
 {
 	Encoding    e;
 	sys_file_t* f;
+	void*       map;
+	uint64_t    map_size;
+
+	// The host position is rbuf_offset + rbuf_len, the file position is rbuf_offset + rbuf_pos
+	uint32_t rbuf_size   = 0;
+	uint8_t* rbuf        = nullptr;
+	uint32_t rbuf_pos    = 0;
+	uint32_t rbuf_len    = 0;
+	uint64_t rbuf_offset = 0;
 };
 
 String* g_assets_dir     = nullptr;
@@ -56,8 +72,10 @@ void core_file_init()
 
 File::File(): m_p(new FilePrivate)
 {
-	m_p->f = nullptr;
-	m_p->e = File::Encoding::Unknown;
+	m_p->f        = nullptr;
+	m_p->e        = File::Encoding::Unknown;
+	m_p->map      = nullptr;
+	m_p->map_size = 0;
 }
 
 File::~File()
@@ -69,16 +87,20 @@ File::~File()
 
 File::File(const String& name): m_p(new FilePrivate)
 {
-	m_p->f = nullptr;
-	m_p->e = File::Encoding::Unknown;
+	m_p->f        = nullptr;
+	m_p->e        = File::Encoding::Unknown;
+	m_p->map      = nullptr;
+	m_p->map_size = 0;
 
 	Create(name);
 }
 
 File::File(const String& name, Mode mode): m_p(new FilePrivate)
 {
-	m_p->f = nullptr;
-	m_p->e = File::Encoding::Unknown;
+	m_p->f        = nullptr;
+	m_p->e        = File::Encoding::Unknown;
+	m_p->map      = nullptr;
+	m_p->map_size = 0;
 
 	Open(name, mode);
 }
@@ -135,6 +157,11 @@ bool File::Open(const String& name, Mode mode)
 		return false;
 	}
 
+	if (mode == Mode::Read)
+	{
+		SetReadBufferSize(READ_BUFFER_SIZE);
+	}
+
 	return true;
 }
 
@@ -158,6 +185,23 @@ bool File::OpenInMem(ByteBuffer& buf)
 	return OpenInMem(buf.GetData(), buf.Size());
 }
 
+bool File::OpenOrCreate(const String& name)
+{
+	EXIT_IF(m_p->f != nullptr);
+
+	m_file_name = name;
+
+	m_p->f = sys_file_open_or_create(name);
+
+	if (sys_file_is_error(*m_p->f))
+	{
+		Close();
+		return false;
+	}
+
+	return true;
+}
+
 bool File::CreateInMem()
 {
 	EXIT_IF(m_p->f != nullptr);
@@ -175,6 +219,22 @@ bool File::CreateInMem()
 
 void File::Close()
 {
+	if (m_p->rbuf != nullptr)
+	{
+		mem_free(m_p->rbuf);
+		m_p->rbuf = nullptr;
+	}
+	m_p->rbuf_size = 0;
+	m_p->rbuf_pos  = 0;
+	m_p->rbuf_len  = 0;
+
+	if (m_p->map != nullptr)
+	{
+		sys_file_unmap(m_p->map, m_p->map_size);
+		m_p->map      = nullptr;
+		m_p->map_size = 0;
+	}
+
 	if (m_p->f != nullptr)
 	{
 		sys_file_close(m_p->f);
@@ -183,6 +243,111 @@ void File::Close()
 	}
 }
 
+const void* File::Map(uint64_t* size)
+{
+	EXIT_IF(m_p->f == nullptr);
+	EXIT_IF(size == nullptr);
+
+	if (m_p->map == nullptr)
+	{
+		m_p->map_size = 0;
+		m_p->map      = sys_file_map(*m_p->f, 0, &m_p->map_size, SYS_FILE_MAP_READ_ONLY);
+	}
+
+	*size = m_p->map_size;
+
+	return m_p->map;
+}
+
+bool File::MapFixed(uint64_t offset, uint64_t size, uint64_t vaddr)
+{
+	EXIT_IF(m_p->f == nullptr);
+
+	return sys_file_map_fixed(*m_p->f, offset, size, vaddr);
+}
+
+MappedFile::~MappedFile()
+{
+	Unmap();
+}
+
+bool MappedFile::Map(File* f, Mode mode, uint64_t offset, uint64_t size)
+{
+	EXIT_IF(f == nullptr || f->m_p->f == nullptr);
+
+	Unmap();
+
+	// The view starts at the aligned offset, the extra bytes before the requested offset are hidden
+	uint64_t alignment = sys_file_map_alignment();
+	uint64_t delta     = offset % alignment;
+	uint64_t base_size = (size == 0 ? 0 : size + delta);
+	auto     sys_mode  = (mode == Mode::CopyOnWrite ? SYS_FILE_MAP_COPY_ON_WRITE : SYS_FILE_MAP_READ_ONLY);
+
+	void* base = sys_file_map(*f->m_p->f, offset - delta, &base_size, sys_mode);
+
+	if (base == nullptr || base_size <= delta)
+	{
+		if (base != nullptr)
+		{
+			sys_file_unmap(base, base_size);
+		}
+		return false;
+	}
+
+	m_base      = base;
+	m_base_size = base_size;
+	m_data      = static_cast<uint8_t*>(base) + delta;
+	m_size      = base_size - delta;
+	m_mode      = mode;
+
+	return true;
+}
+
+bool MappedFile::Map(const String& name, Mode mode, uint64_t offset, uint64_t size)
+{
+	File f;
+	if (!f.Open(name, File::Mode::Read))
+	{
+		return false;
+	}
+
+	bool ok = Map(&f, mode, offset, size);
+
+	f.Close();
+
+	return ok;
+}
+
+void MappedFile::Unmap()
+{
+	if (m_base != nullptr)
+	{
+		sys_file_unmap(m_base, m_base_size);
+
+		m_base      = nullptr;
+		m_base_size = 0;
+		m_data      = nullptr;
+		m_size      = 0;
+	}
+}
+
+void MappedFile::Prefetch(uint64_t offset, uint64_t size) const
+{
+	EXIT_IF(m_data == nullptr);
+
+	if (offset < m_size)
+	{
+		sys_file_prefetch(m_data + offset, (size < m_size - offset ? size : m_size - offset));
+	}
+}
+
+uint8_t* MappedFile::GetDataCow()
+{
+	EXIT_IF(m_mode != Mode::CopyOnWrite);
+
+	return m_data;
+}
+
 uint64_t File::Size() const
 {
 	EXIT_IF(m_p->f == nullptr);
@@ -211,6 +376,20 @@ bool File::Seek(uint64_t offset)
 {
 	EXIT_IF(m_p->f == nullptr);
 
+	if (m_p->rbuf != nullptr)
+	{
+		// Short seeks (peeking a header, skipping a field) stay inside the buffer
+		if (offset >= m_p->rbuf_offset && offset - m_p->rbuf_offset <= m_p->rbuf_len)
+		{
+			m_p->rbuf_pos = static_cast<uint32_t>(offset - m_p->rbuf_offset);
+			return true;
+		}
+
+		m_p->rbuf_offset = offset;
+		m_p->rbuf_pos    = 0;
+		m_p->rbuf_len    = 0;
+	}
+
 	return sys_file_seek(*m_p->f, offset);
 }
 
@@ -218,6 +397,8 @@ bool File::Truncate(uint64_t size)
 {
 	EXIT_IF(m_p->f == nullptr);
 
+	DropReadBuffer();
+
 	return sys_file_truncate(*m_p->f, size);
 }
 
@@ -225,37 +406,210 @@ uint64_t File::Tell() const
 {
 	EXIT_IF(m_p->f == nullptr);
 
+	if (m_p->rbuf != nullptr)
+	{
+		return m_p->rbuf_offset + m_p->rbuf_pos;
+	}
+
 	return sys_file_tell(*m_p->f);
 }
 
+void File::SetReadBufferSize(uint32_t size)
+{
+	EXIT_IF(m_p->f == nullptr);
+
+	DropReadBuffer();
+
+	if (m_p->rbuf != nullptr)
+	{
+		mem_free(m_p->rbuf);
+		m_p->rbuf = nullptr;
+	}
+
+	// Memory files don't need it. The buffer is allocated by the first small read.
+	m_p->rbuf_size = (m_p->f->type == SYS_FILE_FILE ? size : 0);
+}
+
+void File::DropReadBuffer()
+{
+	if (m_p->rbuf != nullptr)
+	{
+		if (m_p->rbuf_pos != m_p->rbuf_len)
+		{
+			sys_file_seek(*m_p->f, m_p->rbuf_offset + m_p->rbuf_pos);
+		}
+		m_p->rbuf_offset += m_p->rbuf_pos;
+		m_p->rbuf_pos = 0;
+		m_p->rbuf_len = 0;
+	}
+}
+
 void File::Read(void* data, uint32_t size, uint32_t* bytes_read)
 {
 	EXIT_IF(m_p->f == nullptr);
 
-	if (m_p->f != nullptr)
+	if (m_p->f == nullptr)
 	{
-		sys_file_read(data, size, *m_p->f, bytes_read);
+		return;
+	}
+
+	uint32_t read = 0;
+
+	if (m_p->rbuf == nullptr && m_p->rbuf_size != 0 && size < m_p->rbuf_size)
+	{
+		m_p->rbuf        = static_cast<uint8_t*>(mem_alloc(m_p->rbuf_size));
+		m_p->rbuf_offset = sys_file_tell(*m_p->f);
+	}
+
+	if (m_p->rbuf != nullptr)
+	{
+		auto* dst = static_cast<uint8_t*>(data);
+		for (;;)
+		{
+			uint32_t n = (size - read < m_p->rbuf_len - m_p->rbuf_pos ? size - read : m_p->rbuf_len - m_p->rbuf_pos);
+			memcpy(dst + read, m_p->rbuf + m_p->rbuf_pos, n);
+			m_p->rbuf_pos += n;
+			read += n;
+
+			if (read == size)
+			{
+				break;
+			}
+
+			m_p->rbuf_offset += m_p->rbuf_len;
+			m_p->rbuf_pos = 0;
+			m_p->rbuf_len = 0;
+
+			uint32_t r = 0;
+			if (size - read >= m_p->rbuf_size)
+			{
+				// The copy would only cost time
+				sys_file_read(dst + read, size - read, *m_p->f, &r);
+				m_p->rbuf_offset += r;
+				read += r;
+				break;
+			}
+
+			sys_file_read(m_p->rbuf, m_p->rbuf_size, *m_p->f, &r);
+			if (r == 0)
+			{
+				break;
+			}
+			m_p->rbuf_len = r;
+
+			// The file is read sequentially, the next block will be needed soon
+			sys_file_will_need(*m_p->f, m_p->rbuf_offset + r, m_p->rbuf_size);
+		}
+	} else
+	{
+		sys_file_read(data, size, *m_p->f, &read);
+	}
+
+	g_bytes_read += read;
+	if (bytes_read != nullptr)
+	{
+		*bytes_read = read;
+	}
+}
+
+void File::Read(void* data, uint64_t size, uint64_t* bytes_read)
+{
+	uint64_t total = 0;
+
+	while (total < size)
+	{
+		auto     chunk = static_cast<uint32_t>(size - total < 0x40000000u ? size - total : 0x40000000u);
+		uint32_t r     = 0;
+		Read(static_cast<uint8_t*>(data) + total, chunk, &r);
+		total += r;
+		if (r != chunk)
+		{
+			break;
+		}
+	}
+
+	if (bytes_read != nullptr)
+	{
+		*bytes_read = total;
 	}
 }
 
+void File::ReadAt(void* data, uint64_t size, uint64_t offset, uint64_t* bytes_read)
+{
+	EXIT_IF(m_p->f == nullptr);
+
+	uint64_t read = 0;
+	sys_file_read_at(data, size, offset, *m_p->f, &read);
+	g_bytes_read += read;
+
+	if (m_p->rbuf != nullptr)
+	{
+		// Some hosts move the position
+		sys_file_seek(*m_p->f, m_p->rbuf_offset + m_p->rbuf_len);
+	}
+	if (bytes_read != nullptr)
+	{
+		*bytes_read = read;
+	}
+}
+
+void File::WillNeed(uint64_t offset, uint64_t size)
+{
+	EXIT_IF(m_p->f == nullptr);
+
+	sys_file_will_need(*m_p->f, offset, size);
+}
+
 void File::Write(const void* data, uint32_t size, uint32_t* bytes_written)
 {
 	EXIT_IF(m_p->f == nullptr);
 
+	DropReadBuffer();
+
 	sys_file_write(data, size, *m_p->f, bytes_written);
 }
 
+void File::Write(const void* data, uint64_t size, uint64_t* bytes_written)
+{
+	uint64_t total = 0;
+
+	while (total < size)
+	{
+		auto     chunk = static_cast<uint32_t>(size - total < 0x40000000u ? size - total : 0x40000000u);
+		uint32_t w     = 0;
+		Write(static_cast<const uint8_t*>(data) + total, chunk, &w);
+		total += w;
+		if (w != chunk)
+		{
+			break;
+		}
+	}
+
+	if (bytes_written != nullptr)
+	{
+		*bytes_written = total;
+	}
+}
+
 void File::ReadR(void* data, uint32_t size)
 {
 	EXIT_IF(m_p->f == nullptr);
 
-	sys_file_read_r(data, size, *m_p->f);
+	Read(data, size);
+
+	auto* bytes = static_cast<uint8_t*>(data);
+	for (uint32_t i = 0; i < size / 2; i++)
+	{
+		std::swap(bytes[i], bytes[size - i - 1]);
+	}
 }
 
 void File::WriteR(const void* data, uint32_t size)
 {
 	EXIT_IF(m_p->f == nullptr);
 
+	DropReadBuffer();
+
 	sys_file_write_r(data, size, *m_p->f);
 }
 
@@ -611,9 +965,30 @@ bool File::Flush()
 {
 	EXIT_IF(m_p->f == nullptr);
 
+	DropReadBuffer();
+
 	return sys_file_flush(*m_p->f);
 }
 
+bool File::Lock()
+{
+	EXIT_IF(m_p->f == nullptr);
+
+	return sys_file_lock(*m_p->f);
+}
+
+void File::Unlock()
+{
+	EXIT_IF(m_p->f == nullptr);
+
+	sys_file_unlock(*m_p->f);
+}
+
+uint64_t File::GetBytesRead()
+{
+	return g_bytes_read;
+}
+
 String File::Read(const String& name, Encoding e)
 {
 	File f;
@@ -814,6 +1189,14 @@ SDL_RWops* File::CreateSdlRWops()
 
 ByteBuffer File::ReadWholeBuffer()
 {
+	ByteBuffer buf;
+	ReadWholeBuffer(&buf);
+	return buf;
+}
+
+void File::ReadWholeBuffer(ByteBuffer* buf)
+{
+	EXIT_IF(buf == nullptr);
 	EXIT_IF(IsInvalid());
 	EXIT_IF(Tell() != 0);
 
@@ -821,11 +1204,9 @@ ByteBuffer File::ReadWholeBuffer()
 
 	EXIT_IF((s >> 32u) != 0);
 
-	ByteBuffer buf(s, false);
+	buf->Resize(static_cast<uint32_t>(s));
 
-	Read(buf.GetData(), s);
-
-	return buf;
+	Read(buf->GetData(), static_cast<uint32_t>(s));
 }
 
 String File::ReadWholeString()
@@ -913,13 +1294,21 @@ String File::ReadWholeString()
 
 ByteBuffer File::Read(uint32_t size)
 {
-	ByteBuffer buf(size);
-	uint32_t   b = 0;
-	Read(buf.GetData(), size, &b);
-	buf.RemoveAt(b, size - b);
+	ByteBuffer buf;
+	Read(size, &buf);
 	return buf;
 }
 
+void File::Read(uint32_t size, ByteBuffer* buf)
+{
+	EXIT_IF(buf == nullptr);
+
+	uint32_t b = 0;
+	buf->Resize(size);
+	Read(buf->GetData(), size, &b);
+	buf->Resize(b);
+}
+
 void File::Write(const ByteBuffer& buf, uint32_t* bytes_written)
 {
 	Write(buf.GetDataConst(), buf.Size(), bytes_written);
@@ -1187,11 +1576,6 @@ bool File::CopyFile(const String& src, const String& dst) // @suppress("Member d
 
 bool File::MoveFile(const String& src, const String& dst) // @suppress("Member declaration not found")
 {
-	if (IsFileExisting(dst))
-	{
-		DeleteFile(dst); // @suppress("Invalid arguments")
-	}
-
 	return sys_file_move_file(src, dst);
 }
 
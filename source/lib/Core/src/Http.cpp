@@ -0,0 +1,187 @@
+#include "Kyty/Core/Http.h"
+
+#include "Kyty/Core/BufferPool.h"
+#include "Kyty/Core/DbgAssert.h"
+#include "Kyty/Sys/SysNet.h"
+
+#include <cstring>
+
+namespace Kyty::Core {
+
+constexpr uint32_t HTTP_HEADERS_SIZE_MAX = 64u * 1024u;
+
+bool HttpParseUrl(const String& url, HttpUrl* r)
+{
+	EXIT_IF(r == nullptr);
+
+	if (!url.StartsWith(U"http://", String::Case::Insensitive))
+	{
+		return false;
+	}
+
+	auto     authority = url.Mid(7);
+	uint32_t path      = authority.FindIndex(U'/');
+
+	r->path = U"/";
+	if (authority.IndexValid(path))
+	{
+		r->path   = authority.Mid(path);
+		authority = authority.Left(path);
+	}
+
+	// IPv6 addresses are in brackets
+	uint32_t host_end = (authority.StartsWith(U'[') ? authority.FindIndex(U']') : 0);
+	if (!authority.IndexValid(host_end))
+	{
+		return false;
+	}
+
+	r->port       = 80;
+	uint32_t port = authority.FindIndex(U':', host_end);
+	if (authority.IndexValid(port))
+	{
+		uint32_t value = authority.Mid(port + 1).ToUint32();
+		if (value == 0 || value > 0xffff)
+		{
+			return false;
+		}
+		r->port   = static_cast<uint16_t>(value);
+		authority = authority.Left(port);
+	}
+
+	if (authority.StartsWith(U'['))
+	{
+		authority = authority.Mid(1, authority.Size() - 2);
+	}
+
+	r->host = authority;
+
+	return !r->host.IsEmpty();
+}
+
+// Returns the status code, the body follows the headers up to the end of the connection
+static int http_parse_response(const ByteBuffer& response, ByteBuffer* body, uint32_t size_max)
+{
+	const auto* data = reinterpret_cast<const char*>(response.GetDataConst());
+	uint32_t    size = response.Size();
+
+	uint32_t headers_size = 0;
+	for (uint32_t i = 0; i + 4 <= size; i++)
+	{
+		if (std::memcmp(data + i, "\r\n\r\n", 4) == 0)
+		{
+			headers_size = i + 4;
+			break;
+		}
+	}
+
+	if (headers_size == 0 || size < 12 || std::memcmp(data, "HTTP/1.", 7) != 0)
+	{
+		return 0;
+	}
+
+	auto headers = String::FromUtf8(data, headers_size);
+	int  status  = static_cast<int>(headers.Mid(9, 3).ToUint32());
+
+	if (status < 100)
+	{
+		return 0;
+	}
+
+	uint32_t body_size = size - headers_size;
+
+	if (body_size > size_max)
+	{
+		return 0;
+	}
+
+	// A connection closed before the whole body was received
+	uint32_t length = headers.FindIndex(U"\r\ncontent-length:", 0, String::Case::Insensitive);
+	if (headers.IndexValid(length) && headers.Mid(length + 17, headers.FindIndex(U'\r', length + 17) - length - 17).Trim().ToUint32() !=
+	                                      body_size)
+	{
+		return 0;
+	}
+
+	if (body != nullptr)
+	{
+		body->Clear();
+		body->Add(response.GetDataConst() + headers_size, body_size);
+	}
+
+	return status;
+}
+
+static int http_request(const char* method, const String& url, const void* data, uint32_t size, ByteBuffer* body, uint32_t timeout_ms,
+                        uint32_t size_max)
+{
+	HttpUrl u;
+	if (!HttpParseUrl(url, &u))
+	{
+		return 0;
+	}
+
+	auto s = sys_net_connect(u.host, u.port, timeout_ms);
+	if (s == SYS_SOCKET_INVALID)
+	{
+		return 0;
+	}
+
+	// HTTP/1.0, so the server doesn't keep the connection or send the body in chunks
+	auto header = String::FromPrintf("%s %s HTTP/1.0\r\nHost: %s:%u\r\nContent-Length: %u\r\n\r\n", method, u.path.C_Str(),
+	                                 u.host.C_Str(), static_cast<uint32_t>(u.port), size)
+	                  .utf8_str();
+
+	int status = 0;
+
+	if (sys_net_send(s, header.GetData(), header.Size() - 1) && (size == 0 || sys_net_send(s, data, size)))
+	{
+		constexpr uint32_t CHUNK_SIZE = 64 * 1024;
+
+		ByteBufferLease response(CHUNK_SIZE);
+
+		for (;;)
+		{
+			uint32_t offset = response->Size();
+			if (offset > size_max + HTTP_HEADERS_SIZE_MAX)
+			{
+				break;
+			}
+
+			response->Resize(offset + CHUNK_SIZE);
+			int received = sys_net_recv(s, response->GetData() + offset, CHUNK_SIZE);
+			response->Resize(offset + static_cast<uint32_t>(received > 0 ? received : 0));
+
+			if (received == 0)
+			{
+				status = http_parse_response(*response, body, size_max);
+				break;
+			}
+			if (received < 0)
+			{
+				break;
+			}
+		}
+	}
+
+	sys_net_close(s);
+
+	return status;
+}
+
+int HttpGet(const String& url, ByteBuffer* body, uint32_t timeout_ms, uint32_t size_max)
+{
+	EXIT_IF(body == nullptr);
+	EXIT_IF(size_max > HTTP_BODY_SIZE_MAX);
+
+	return http_request("GET", url, nullptr, 0, body, timeout_ms, size_max);
+}
+
+int HttpPut(const String& url, const void* data, uint32_t size, uint32_t timeout_ms)
+{
+	EXIT_IF(data == nullptr && size != 0);
+
+	return http_request("PUT", url, data, size, nullptr, timeout_ms, HTTP_HEADERS_SIZE_MAX);
+}
+
+} // namespace Kyty::Core
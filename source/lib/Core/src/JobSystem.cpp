@@ -0,0 +1,485 @@
+#include "Kyty/Core/JobSystem.h"
+
+#include "Kyty/Core/Common.h"
+#include "Kyty/Core/DbgAssert.h"
+#include "Kyty/Core/MemoryAlloc.h"
+#include "Kyty/Core/Threads.h"
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <utility>
+
+namespace Kyty::Core {
+
+constexpr int      JOB_WORKERS_MAX        = 32;
+constexpr uint32_t JOB_QUEUE_MIN_CAPACITY = 64;
+constexpr int      JOB_SPIN_COUNT         = 64;
+
+// Job of num items. Whoever claims an index (a worker or a thread in TaskGroup::Wait()) runs that item. Every pointer in a
+// queue, in a group and in a running item holds a reference.
+struct Job
+{
+	std::function<void(uint32_t)> func;
+	uint32_t                      num      = 0;
+	JobPriority                   priority = JobPriority::Normal;
+	TaskGroup*                    group    = nullptr;
+	std::atomic_uint32_t          next     = 0;
+	std::atomic_uint32_t          refs     = 0;
+};
+
+// The queues are locked for a few instructions only
+class JobSpinLock
+{
+public:
+	JobSpinLock()  = default;
+	~JobSpinLock() = default;
+
+	KYTY_CLASS_NO_COPY(JobSpinLock);
+
+	void Lock()
+	{
+		for (int i = 0; m_flag.test_and_set(std::memory_order_acquire); i++)
+		{
+			if (i >= JOB_SPIN_COUNT)
+			{
+				std::this_thread::yield();
+			}
+		}
+	}
+
+	void Unlock() { m_flag.clear(std::memory_order_release); }
+
+private:
+	std::atomic_flag m_flag = ATOMIC_FLAG_INIT;
+};
+
+// Ring buffer deque
+class JobQueue
+{
+public:
+	JobQueue() = default;
+	~JobQueue() { mem_free(m_ring); }
+
+	KYTY_CLASS_NO_COPY(JobQueue);
+
+	[[nodiscard]] bool IsEmpty() const { return m_size.load(std::memory_order_relaxed) == 0; }
+
+	void PushBack(Job* job)
+	{
+		m_lock.Lock();
+		uint32_t size = m_size.load(std::memory_order_relaxed);
+		if (size == m_capacity)
+		{
+			Grow();
+		}
+		m_ring[(m_head + size) & (m_capacity - 1)] = job;
+		m_size.store(size + 1, std::memory_order_relaxed);
+		m_lock.Unlock();
+	}
+
+	Job* PopBack()
+	{
+		Job* job = nullptr;
+		m_lock.Lock();
+		uint32_t size = m_size.load(std::memory_order_relaxed);
+		if (size != 0)
+		{
+			job = m_ring[(m_head + size - 1) & (m_capacity - 1)];
+			m_size.store(size - 1, std::memory_order_relaxed);
+		}
+		m_lock.Unlock();
+		return job;
+	}
+
+	Job* PopFront()
+	{
+		Job* job = nullptr;
+		m_lock.Lock();
+		uint32_t size = m_size.load(std::memory_order_relaxed);
+		if (size != 0)
+		{
+			job    = m_ring[m_head];
+			m_head = (m_head + 1) & (m_capacity - 1);
+			m_size.store(size - 1, std::memory_order_relaxed);
+		}
+		m_lock.Unlock();
+		return job;
+	}
+
+private:
+	void Grow()
+	{
+		uint32_t capacity = std::max(m_capacity * 2, JOB_QUEUE_MIN_CAPACITY);
+		auto*    ring     = static_cast<Job**>(mem_alloc(capacity * sizeof(Job*)));
+		for (uint32_t i = 0; i < m_capacity; i++)
+		{
+			ring[i] = m_ring[(m_head + i) & (m_capacity - 1)];
+		}
+		mem_free(m_ring);
+		m_ring     = ring;
+		m_capacity = capacity;
+		m_head     = 0;
+	}
+
+	JobSpinLock          m_lock;
+	Job**                m_ring     = nullptr;
+	uint32_t             m_capacity = 0;
+	uint32_t             m_head     = 0;
+	std::atomic_uint32_t m_size     = 0;
+};
+
+class JobPool;
+
+struct JobWorker
+{
+	JobPool* pool  = nullptr;
+	int      index = 0;
+	JobQueue queues[JOB_PRIORITIES_NUM];
+};
+
+class JobPool
+{
+public:
+	explicit JobPool(int workers_num);
+	virtual ~JobPool() { KYTY_NOT_IMPLEMENTED; }
+
+	KYTY_CLASS_NO_COPY(JobPool);
+
+	void Push(Job* job);
+	Job* Pop(JobWorker* worker);
+
+	[[nodiscard]] int GetWorkersNum() const { return m_workers_num; }
+
+private:
+	static void ThreadRun(void* data);
+
+	JobWorker*      m_workers     = nullptr;
+	int             m_workers_num = 0;
+	JobQueue        m_shared[JOB_PRIORITIES_NUM];
+	std::atomic_int m_queued   = 0;
+	std::atomic_int m_sleeping = 0;
+	Mutex           m_sleep_mutex {"JobPool"};
+	CondVar         m_sleep_cond_var;
+};
+
+static int g_job_workers_num = 0;
+
+static std::atomic_bool g_job_pool_created = false;
+
+thread_local static JobWorker* g_job_worker = nullptr;
+
+static int job_default_workers_num()
+{
+	// The thread which waits for a group runs its jobs too
+	return std::clamp(static_cast<int>(std::thread::hardware_concurrency()) - 1, 1, JOB_WORKERS_MAX);
+}
+
+static JobPool* job_pool()
+{
+	static auto* pool = new JobPool(g_job_workers_num > 0 ? g_job_workers_num : job_default_workers_num());
+	return pool;
+}
+
+JobPool::JobPool(int workers_num): m_workers(new JobWorker[workers_num]), m_workers_num(workers_num)
+{
+	g_job_pool_created = true;
+
+	for (int i = 0; i < workers_num; i++)
+	{
+		m_workers[i].pool  = this;
+		m_workers[i].index = i;
+
+		Thread t(ThreadRun, m_workers + i);
+		t.Detach();
+	}
+}
+
+void JobPool::Push(Job* job)
+{
+	auto lane = static_cast<int>(job->priority);
+
+	m_queued.fetch_add(1);
+
+	if (g_job_worker != nullptr)
+	{
+		g_job_worker->queues[lane].PushBack(job);
+	} else
+	{
+		m_shared[lane].PushBack(job);
+	}
+
+	// A worker increments m_sleeping before it checks m_queued, so either it sees the job or the job sees it
+	if (m_sleeping.load() > 0)
+	{
+		LockGuard lock(m_sleep_mutex);
+		m_sleep_cond_var.Signal();
+	}
+}
+
+// Own jobs are taken from the back (the most recent one is likely in the cache), other jobs from the front
+Job* JobPool::Pop(JobWorker* worker)
+{
+	for (int lane = 0; lane < JOB_PRIORITIES_NUM; lane++)
+	{
+		Job* job = worker->queues[lane].PopBack();
+
+		if (job == nullptr)
+		{
+			job = m_shared[lane].PopFront();
+		}
+
+		for (int i = 1; i < m_workers_num && job == nullptr; i++)
+		{
+			auto& victim = m_workers[(worker->index + i) % m_workers_num].queues[lane];
+			if (!victim.IsEmpty())
+			{
+				job = victim.PopFront();
+			}
+		}
+
+		if (job != nullptr)
+		{
+			m_queued.fetch_sub(1);
+			return job;
+		}
+	}
+	return nullptr;
+}
+
+void JobPool::ThreadRun(void* data)
+{
+	auto* worker = static_cast<JobWorker*>(data);
+	auto* pool   = worker->pool;
+
+	g_job_worker = worker;
+
+	for (;;)
+	{
+		if (Job* job = pool->Pop(worker); job != nullptr)
+		{
+			uint32_t index = job->next.fetch_add(1);
+			if (index < job->num)
+			{
+				// Leave the rest of the items to the other workers
+				if (index + 1 < job->num)
+				{
+					job->refs.fetch_add(1);
+					pool->Push(job);
+				}
+				JobSystem::RunItem(job, index);
+			}
+			JobSystem::Release(job);
+			continue;
+		}
+
+		LockGuard lock(pool->m_sleep_mutex);
+		pool->m_sleeping.fetch_add(1);
+		if (pool->m_queued.load() == 0)
+		{
+			pool->m_sleep_cond_var.Wait(&pool->m_sleep_mutex);
+		}
+		pool->m_sleeping.fetch_sub(1);
+	}
+}
+
+static Job* job_create(std::function<void(uint32_t)> func, uint32_t num, JobPriority priority)
+{
+	auto* job     = new Job;
+	job->func     = std::move(func);
+	job->num      = num;
+	job->priority = priority;
+	return job;
+}
+
+static std::function<void(uint32_t)> job_func(std::function<void()> func)
+{
+	return [f = std::move(func)](uint32_t /*index*/) { f(); };
+}
+
+void JobSystem::Init(int workers_num)
+{
+	EXIT_IF(workers_num <= 0);
+	EXIT_IF(g_job_pool_created);
+
+	g_job_workers_num = std::min(workers_num, JOB_WORKERS_MAX);
+}
+
+int JobSystem::GetWorkersNum()
+{
+	return job_pool()->GetWorkersNum();
+}
+
+bool JobSystem::IsWorkerThread()
+{
+	return g_job_worker != nullptr;
+}
+
+void JobSystem::Submit(std::function<void()> func, JobPriority priority)
+{
+	auto* job = job_create(job_func(std::move(func)), 1, priority);
+	job->refs = 1;
+	Push(job);
+}
+
+void JobSystem::ParallelFor(uint32_t num, std::function<void(uint32_t)> func, JobPriority priority)
+{
+	if (num == 1)
+	{
+		func(0);
+	} else if (num > 1)
+	{
+		TaskGroup group;
+		group.Run(num, std::move(func), priority);
+		group.Wait();
+	}
+}
+
+void JobSystem::Push(Job* job)
+{
+	job_pool()->Push(job);
+}
+
+void JobSystem::RunItem(Job* job, uint32_t index)
+{
+	job->func(index);
+
+	if (job->group != nullptr)
+	{
+		job->group->FinishItem();
+	}
+}
+
+void JobSystem::Release(Job* job)
+{
+	if (job->refs.fetch_sub(1) == 1)
+	{
+		delete job;
+	}
+}
+
+TaskGroup::~TaskGroup()
+{
+	Wait();
+}
+
+void TaskGroup::Run(std::function<void()> func, JobPriority priority)
+{
+	LockGuard lock(m_mutex);
+	Add(job_create(job_func(std::move(func)), 1, priority), 1);
+}
+
+void TaskGroup::Run(uint32_t num, std::function<void(uint32_t)> func, JobPriority priority)
+{
+	if (num > 0)
+	{
+		LockGuard lock(m_mutex);
+		Add(job_create(std::move(func), num, priority), num);
+	}
+}
+
+void TaskGroup::Then(std::function<void()> func, JobPriority priority)
+{
+	LockGuard lock(m_mutex);
+
+	if (m_pending == 0)
+	{
+		Add(job_create(job_func(std::move(func)), 1, priority), 1);
+	} else
+	{
+		EXIT_NOT_IMPLEMENTED(m_continuation);
+
+		m_continuation          = std::move(func);
+		m_continuation_priority = priority;
+	}
+}
+
+bool TaskGroup::IsDone()
+{
+	LockGuard lock(m_mutex);
+	return m_pending == 0;
+}
+
+// m_mutex must be locked
+void TaskGroup::Add(Job* job, uint32_t num)
+{
+	job->group = this;
+	job->refs  = 2;
+
+	m_pending += num;
+	m_jobs.Add(job);
+
+	JobSystem::Push(job);
+}
+
+void TaskGroup::FinishItem()
+{
+	LockGuard lock(m_mutex);
+
+	EXIT_IF(m_pending == 0);
+
+	if (--m_pending == 0)
+	{
+		if (m_continuation)
+		{
+			Add(job_create(job_func(std::move(m_continuation)), 1, m_continuation_priority), 1);
+			m_continuation = nullptr;
+		}
+		m_cond_var.SignalAll();
+	}
+}
+
+// Runs the unclaimed items of this group
+void TaskGroup::Help()
+{
+	for (;;)
+	{
+		Job* job = nullptr;
+		{
+			LockGuard lock(m_mutex);
+			for (auto* j: m_jobs)
+			{
+				if (j->next.load() < j->num)
+				{
+					job = j;
+					break;
+				}
+			}
+		}
+
+		if (job == nullptr)
+		{
+			break;
+		}
+
+		if (uint32_t index = job->next.fetch_add(1); index < job->num)
+		{
+			JobSystem::RunItem(job, index);
+		}
+	}
+}
+
+void TaskGroup::Wait()
+{
+	for (;;)
+	{
+		Help();
+
+		LockGuard lock(m_mutex);
+
+		if (m_pending == 0)
+		{
+			for (auto* job: m_jobs)
+			{
+				JobSystem::Release(job);
+			}
+			m_jobs.Clear();
+			break;
+		}
+
+		// Woken up when the last item is finished or a continuation is added
+		m_cond_var.Wait(&m_mutex);
+	}
+}
+
+} // namespace Kyty::Core
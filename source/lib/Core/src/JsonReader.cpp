@@ -3,6 +3,10 @@
 #include "Kyty/Core/DbgAssert.h"
 #include "Kyty/Core/SafeDelete.h"
 
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+
 namespace Kyty::Core {
 
 static String* g_json_error = nullptr;
@@ -474,4 +478,418 @@ StringList Json::DbgCheckList(const StringList& required, const StringList& opti
 	return errors;
 }
 
+constexpr int      JSON_SAX_DEPTH_MAX  = 512;
+constexpr uint32_t JSON_SAX_NUMBER_MAX = 64;
+
+struct JsonSaxState
+{
+	const char*     p       = nullptr;
+	const char*     end     = nullptr;
+	JsonSaxHandler* handler = nullptr;
+	int             depth   = 0;
+};
+
+static void sax_skip(JsonSaxState* s)
+{
+	while (s->p < s->end && (*s->p == ' ' || *s->p == '\t' || *s->p == '\n' || *s->p == '\r'))
+	{
+		s->p++;
+	}
+}
+
+static bool sax_literal(JsonSaxState* s, const char* literal, uint32_t len)
+{
+	if (static_cast<uint32_t>(s->end - s->p) < len || std::memcmp(s->p, literal, len) != 0)
+	{
+		return false;
+	}
+	s->p += len;
+	return true;
+}
+
+// s->p is at the opening quote
+static bool sax_string(JsonSaxState* s, StringView8* str, bool* escaped)
+{
+	const char* begin = ++s->p;
+
+	*escaped = false;
+
+	while (s->p < s->end)
+	{
+		char c = *s->p;
+		if (c == '\"')
+		{
+			*str = StringView8(begin, static_cast<uint32_t>(s->p - begin));
+			s->p++;
+			return true;
+		}
+		if (c == '\\')
+		{
+			*escaped = true;
+			if (s->end - s->p < 2)
+			{
+				break;
+			}
+			s->p += 2;
+			continue;
+		}
+		if (static_cast<unsigned char>(c) < 0x20u)
+		{
+			break;
+		}
+		s->p++;
+	}
+
+	return false;
+}
+
+// One or more digits
+static bool sax_digits(JsonSaxState* s)
+{
+	const char* begin = s->p;
+	while (s->p < s->end && *s->p >= '0' && *s->p <= '9')
+	{
+		s->p++;
+	}
+	return s->p != begin;
+}
+
+static bool sax_number(JsonSaxState* s)
+{
+	const char* begin    = s->p;
+	bool        is_float = false;
+
+	if (s->p < s->end && *s->p == '-')
+	{
+		s->p++;
+	}
+
+	// RFC 8259 grammar: no '+' sign, no leading zeros, digits on both sides of the point and in the exponent
+	const char* int_begin = s->p;
+	if (!sax_digits(s) || (*int_begin == '0' && s->p - int_begin > 1))
+	{
+		return false;
+	}
+	if (s->p < s->end && *s->p == '.')
+	{
+		s->p++;
+		is_float = true;
+		if (!sax_digits(s))
+		{
+			return false;
+		}
+	}
+	if (s->p < s->end && (*s->p == 'e' || *s->p == 'E'))
+	{
+		s->p++;
+		is_float = true;
+		if (s->p < s->end && (*s->p == '+' || *s->p == '-'))
+		{
+			s->p++;
+		}
+		if (!sax_digits(s))
+		{
+			return false;
+		}
+	}
+
+	auto len      = static_cast<uint32_t>(s->p - begin);
+	bool negative = (*begin == '-');
+
+	// Up to 18 digits always fit
+	if (!is_float && s->p - int_begin <= 18)
+	{
+		int64_t value = 0;
+		for (const char* d = int_begin; d < s->p; d++)
+		{
+			value = value * 10 + (*d - '0');
+		}
+		return s->handler->Int(negative ? -value : value);
+	}
+
+	if (len >= JSON_SAX_NUMBER_MAX)
+	{
+		return false;
+	}
+
+	// strto*() need a terminated string
+	char buf[JSON_SAX_NUMBER_MAX];
+	std::memcpy(buf, begin, len);
+	buf[len] = '\0';
+
+	// Integers go to Float() only if they don't fit in 64 bits
+	if (!is_float)
+	{
+		errno = 0;
+		if (negative)
+		{
+			int64_t value = std::strtoll(buf, nullptr, 10);
+			if (errno != ERANGE)
+			{
+				return s->handler->Int(value);
+			}
+		} else
+		{
+			uint64_t value = std::strtoull(buf, nullptr, 10);
+			if (errno != ERANGE)
+			{
+				return (value <= static_cast<uint64_t>(INT64_MAX) ? s->handler->Int(static_cast<int64_t>(value)) : s->handler->Uint(value));
+			}
+		}
+	}
+
+	return s->handler->Float(std::strtod(buf, nullptr));
+}
+
+static bool sax_value(JsonSaxState* s); // NOLINT(misc-no-recursion)
+
+static bool sax_object(JsonSaxState* s) // NOLINT(misc-no-recursion)
+{
+	s->p++;
+
+	if (!s->handler->StartObject())
+	{
+		return false;
+	}
+
+	sax_skip(s);
+	if (s->p < s->end && *s->p == '}')
+	{
+		s->p++;
+		return s->handler->EndObject();
+	}
+
+	for (;;)
+	{
+		StringView8 key;
+		bool        escaped = false;
+
+		sax_skip(s);
+		if (s->p >= s->end || *s->p != '\"' || !sax_string(s, &key, &escaped) || !s->handler->Key(key, escaped))
+		{
+			return false;
+		}
+
+		sax_skip(s);
+		if (s->p >= s->end || *s->p != ':')
+		{
+			return false;
+		}
+		s->p++;
+
+		if (!sax_value(s))
+		{
+			return false;
+		}
+
+		sax_skip(s);
+		if (s->p < s->end && *s->p == ',')
+		{
+			s->p++;
+			continue;
+		}
+		if (s->p < s->end && *s->p == '}')
+		{
+			s->p++;
+			return s->handler->EndObject();
+		}
+		return false;
+	}
+}
+
+static bool sax_array(JsonSaxState* s) // NOLINT(misc-no-recursion)
+{
+	s->p++;
+
+	if (!s->handler->StartArray())
+	{
+		return false;
+	}
+
+	sax_skip(s);
+	if (s->p < s->end && *s->p == ']')
+	{
+		s->p++;
+		return s->handler->EndArray();
+	}
+
+	for (;;)
+	{
+		if (!sax_value(s))
+		{
+			return false;
+		}
+
+		sax_skip(s);
+		if (s->p < s->end && *s->p == ',')
+		{
+			s->p++;
+			continue;
+		}
+		if (s->p < s->end && *s->p == ']')
+		{
+			s->p++;
+			return s->handler->EndArray();
+		}
+		return false;
+	}
+}
+
+static bool sax_value(JsonSaxState* s) // NOLINT(misc-no-recursion)
+{
+	sax_skip(s);
+
+	if (s->p >= s->end)
+	{
+		return false;
+	}
+
+	switch (*s->p)
+	{
+		case 'n': return sax_literal(s, "null", 4) && s->handler->Null();
+		case 'f': return sax_literal(s, "false", 5) && s->handler->Bool(false);
+		case 't': return sax_literal(s, "true", 4) && s->handler->Bool(true);
+		case '\"':
+		{
+			StringView8 str;
+			bool        escaped = false;
+			return sax_string(s, &str, &escaped) && s->handler->Str(str, escaped);
+		}
+		case '{':
+		case '[':
+		{
+			if (s->depth == JSON_SAX_DEPTH_MAX)
+			{
+				return false;
+			}
+			s->depth++;
+			bool ok = (*s->p == '{' ? sax_object(s) : sax_array(s));
+			s->depth--;
+			return ok;
+		}
+		default: return sax_number(s);
+	}
+}
+
+bool JsonSax::Parse(const char* data, uint32_t size, JsonSaxHandler* handler, uint32_t* error_offset)
+{
+	EXIT_IF(handler == nullptr);
+	EXIT_IF(data == nullptr && size != 0);
+
+	JsonSaxState s;
+	s.p       = data;
+	s.end     = data + size;
+	s.handler = handler;
+
+	bool ok = sax_value(&s);
+
+	if (ok)
+	{
+		sax_skip(&s);
+		ok = (s.p == s.end);
+	}
+
+	if (!ok && error_offset != nullptr)
+	{
+		*error_offset = static_cast<uint32_t>(s.p - data);
+	}
+
+	return ok;
+}
+
+static int sax_hex4(const char* p, const char* end)
+{
+	if (end - p < 4)
+	{
+		return -1;
+	}
+	int value = 0;
+	for (int i = 0; i < 4; i++)
+	{
+		char c = p[i];
+		int  d = (c >= '0' && c <= '9' ? c - '0' : c >= 'a' && c <= 'f' ? c - 'a' + 10 : c >= 'A' && c <= 'F' ? c - 'A' + 10 : -1);
+		if (d < 0)
+		{
+			return -1;
+		}
+		value = value * 16 + d;
+	}
+	return value;
+}
+
+static void sax_add_utf8(String8* out, uint32_t c)
+{
+	if (c < 0x80u)
+	{
+		*out += static_cast<char>(c);
+	} else if (c < 0x800u)
+	{
+		*out += static_cast<char>(0xC0u | (c >> 6u));
+		*out += static_cast<char>(0x80u | (c & 0x3Fu));
+	} else if (c < 0x10000u)
+	{
+		*out += static_cast<char>(0xE0u | (c >> 12u));
+		*out += static_cast<char>(0x80u | ((c >> 6u) & 0x3Fu));
+		*out += static_cast<char>(0x80u | (c & 0x3Fu));
+	} else
+	{
+		*out += static_cast<char>(0xF0u | (c >> 18u));
+		*out += static_cast<char>(0x80u | ((c >> 12u) & 0x3Fu));
+		*out += static_cast<char>(0x80u | ((c >> 6u) & 0x3Fu));
+		*out += static_cast<char>(0x80u | (c & 0x3Fu));
+	}
+}
+
+String8 JsonSax::Unescape(StringView8 str)
+{
+	String8 out;
+
+	const char* p   = str.GetDataConst();
+	const char* end = p + str.Size();
+
+	while (p < end)
+	{
+		if (*p != '\\' || end - p < 2)
+		{
+			out += *p++;
+			continue;
+		}
+
+		p++;
+		switch (char c = *p++; c)
+		{
+			case 'b': out += '\b'; break;
+			case 'f': out += '\f'; break;
+			case 'n': out += '\n'; break;
+			case 'r': out += '\r'; break;
+			case 't': out += '\t'; break;
+			case 'u':
+			{
+				int c1 = sax_hex4(p, end);
+				if (c1 < 0)
+				{
+					out += "\\u";
+					break;
+				}
+				p += 4;
+				auto code = static_cast<uint32_t>(c1);
+				if (code >= 0xD800u && code < 0xDC00u && end - p >= 6 && p[0] == '\\' && p[1] == 'u')
+				{
+					int c2 = sax_hex4(p + 2, end);
+					if (c2 >= 0xDC00 && c2 < 0xE000)
+					{
+						code = 0x10000u + ((code - 0xD800u) << 10u) + (static_cast<uint32_t>(c2) - 0xDC00u);
+						p += 6;
+					}
+				}
+				sax_add_utf8(&out, code);
+				break;
+			}
+			default: out += c; break;
+		}
+	}
+
+	return out;
+}
+
 } // namespace Kyty::Core
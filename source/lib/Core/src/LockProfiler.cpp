@@ -0,0 +1,174 @@
+#include "Kyty/Core/LockProfiler.h"
+
+#include "Kyty/Core/DbgAssert.h"
+#include "Kyty/Core/Threads.h"
+#include "Kyty/Core/Vector.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+
+namespace Kyty::Core {
+
+constexpr int LOCK_PROFILER_STATS_MAX = 4096;
+constexpr int LOCK_PROFILER_NAME_MAX  = 64;
+constexpr int LOCK_PROFILER_DUMP_MAX  = 50;
+
+struct LockProfilerStats
+{
+	char                 name[LOCK_PROFILER_NAME_MAX] = {};
+	std::atomic_uint64_t locks                        = 0;
+	std::atomic_uint64_t contended                    = 0;
+	std::atomic_uint64_t wait_time                    = 0;
+	std::atomic_uint64_t wait_max                     = 0;
+	std::atomic_uint64_t hold_time                    = 0;
+	std::atomic_uint64_t hold_max                     = 0;
+};
+
+// Core::Mutex can't be used here, it reports to the profiler itself
+static std::mutex        g_lock_profiler_mutex;
+static LockProfilerStats g_lock_profiler_stats[LOCK_PROFILER_STATS_MAX];
+static int               g_lock_profiler_stats_num = 0;
+static uint32_t          g_lock_profiler_period    = 0;
+
+static void lock_profiler_max(std::atomic_uint64_t* max, uint64_t value)
+{
+	uint64_t old_value = max->load(std::memory_order_relaxed);
+	while (value > old_value && !max->compare_exchange_weak(old_value, value, std::memory_order_relaxed))
+	{
+	}
+}
+
+static void lock_profiler_run(void* /*arg*/)
+{
+	for (;;)
+	{
+		Thread::Sleep(g_lock_profiler_period * 1000);
+		LockProfiler::Dump();
+	}
+}
+
+static void lock_profiler_at_exit()
+{
+	LockProfiler::Dump();
+}
+
+void LockProfiler::Init(uint32_t period_seconds)
+{
+	EXIT_IF(g_lock_profiler_period != 0);
+	EXIT_IF(period_seconds == 0);
+
+	g_lock_profiler_period = period_seconds;
+
+	Thread t(lock_profiler_run, nullptr);
+	t.Detach();
+
+	std::atexit(lock_profiler_at_exit);
+}
+
+LockProfilerStats* LockProfiler::GetStats(const char* name)
+{
+	std::lock_guard lock(g_lock_profiler_mutex);
+
+	if (name == nullptr || name[0] == '\0')
+	{
+		name = "<unnamed>";
+	}
+
+	for (int i = 0; i < g_lock_profiler_stats_num; i++)
+	{
+		if (strncmp(g_lock_profiler_stats[i].name, name, LOCK_PROFILER_NAME_MAX - 1) == 0)
+		{
+			return &g_lock_profiler_stats[i];
+		}
+	}
+
+	// The last slot collects the rest
+	auto* stats = &g_lock_profiler_stats[g_lock_profiler_stats_num];
+	if (g_lock_profiler_stats_num == LOCK_PROFILER_STATS_MAX - 1)
+	{
+		name = "<other>";
+	} else
+	{
+		g_lock_profiler_stats_num++;
+	}
+
+	strncpy(stats->name, name, LOCK_PROFILER_NAME_MAX - 1);
+
+	return stats;
+}
+
+uint64_t LockProfiler::GetTime()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void LockProfiler::Locked(LockProfilerStats* stats, uint64_t wait_time, bool contended)
+{
+	stats->locks.fetch_add(1, std::memory_order_relaxed);
+	if (contended)
+	{
+		stats->contended.fetch_add(1, std::memory_order_relaxed);
+		stats->wait_time.fetch_add(wait_time, std::memory_order_relaxed);
+		lock_profiler_max(&stats->wait_max, wait_time);
+	}
+}
+
+void LockProfiler::Unlocked(LockProfilerStats* stats, uint64_t hold_time)
+{
+	stats->hold_time.fetch_add(hold_time, std::memory_order_relaxed);
+	lock_profiler_max(&stats->hold_max, hold_time);
+}
+
+void LockProfiler::Dump()
+{
+	struct Snapshot
+	{
+		const char* name;
+		uint64_t    locks;
+		uint64_t    contended;
+		uint64_t    wait_time;
+		uint64_t    wait_max;
+		uint64_t    hold_time;
+		uint64_t    hold_max;
+	};
+
+	// The counters keep changing, the sort needs stable values
+	Vector<Snapshot> list;
+
+	{
+		std::lock_guard lock(g_lock_profiler_mutex);
+		for (int i = 0; i <= g_lock_profiler_stats_num && i < LOCK_PROFILER_STATS_MAX; i++)
+		{
+			const auto& s = g_lock_profiler_stats[i];
+			if (uint64_t locks = s.locks.load(std::memory_order_relaxed); locks != 0)
+			{
+				list.Add({s.name, locks, s.contended.load(std::memory_order_relaxed), s.wait_time.load(std::memory_order_relaxed),
+				          s.wait_max.load(std::memory_order_relaxed), s.hold_time.load(std::memory_order_relaxed),
+				          s.hold_max.load(std::memory_order_relaxed)});
+			}
+		}
+	}
+
+	list.Sort([](const Snapshot& a, const Snapshot& b) { return a.wait_time > b.wait_time; });
+
+	printf("--- lock profile: %u locks ---\n", list.Size());
+	printf("%-40s %12s %12s %12s %12s %12s %12s\n", "name", "locks", "contended", "wait_ms", "wait_max_ms", "hold_ms", "hold_max_ms");
+
+	uint32_t num = 0;
+	for (const auto& s: list)
+	{
+		if (num++ == LOCK_PROFILER_DUMP_MAX)
+		{
+			break;
+		}
+		printf("%-40.40s %12" PRIu64 " %12" PRIu64 " %12.3f %12.3f %12.3f %12.3f\n", s.name, s.locks, s.contended,
+		       static_cast<double>(s.wait_time) / 1e6, static_cast<double>(s.wait_max) / 1e6, static_cast<double>(s.hold_time) / 1e6,
+		       static_cast<double>(s.hold_max) / 1e6);
+	}
+}
+
+} // namespace Kyty::Core
@@ -9,6 +9,9 @@
 #include "Kyty/Core/String.h"
 #include "Kyty/Core/Threads.h"
 
+#include <atomic>
+#include <new>
+
 namespace Kyty::Core {
 
 static constexpr size_t MSPACE_HEADER_SIZE = 1440;
@@ -20,6 +23,7 @@ static uint64_t align(uint64_t v, uint64_t a)
 
 static constexpr uint32_t MSPACE_ARRAY_SMALL = 10;
 static constexpr uint32_t MSPACE_ARRAY_HASH  = 61;
+static constexpr uint32_t MSPACE_FAST_BINS   = 32; // chunks of 2..33 blocks
 
 struct MSpaceBlock
 {
@@ -50,8 +54,11 @@ struct MSpaceContext
 	uint32_t              size_of_key_chunk                   = 0;
 	uint32_t              array_small[MSPACE_ARRAY_SMALL - 1] = {};
 	uint32_t              array_hash[MSPACE_ARRAY_HASH]       = {};
+	std::atomic_uint64_t  fast_bins[MSPACE_FAST_BINS]         = {}; // (tag << 32) | index of the first chunk
 };
 
+static_assert(sizeof(MSpaceContext) <= MSPACE_HEADER_SIZE);
+
 static void MSpaceInternalUnlinkFromList(MSpaceContext& ctx, uint32_t i, uint32_t* root)
 {
 	uint32_t next = ctx.base[i].u.list.next;
@@ -211,17 +218,78 @@ static void MSpaceInternalMerge(MSpaceContext& ctx, uint32_t* root)
 	}
 }
 
-static void* MSpaceInternalMallocUnsafe(MSpaceContext& ctx, uint32_t size, uint32_t report_size)
+static uint32_t MSpaceInternalNumBlocks(uint32_t size)
 {
-	uint32_t num_blocks = 0;
+	return (size <= 12 ? 2 : (size + 11) / 8);
+}
 
-	if (size <= 12)
+// Thread-safe mspaces keep freed small chunks in lock-free stacks, one for each size. The chunks stay checked out, so malloc() and
+// free() of them don't take the mutex. The tag in the head prevents ABA when a chunk is popped and pushed back meanwhile.
+static void* MSpaceInternalFastPop(MSpaceContext& ctx, uint32_t num_blocks)
+{
+	auto&    bin  = ctx.fast_bins[num_blocks - 2];
+	uint64_t head = bin.load(std::memory_order_acquire);
+
+	for (;;)
 	{
-		num_blocks = 2;
-	} else
+		auto i = static_cast<uint32_t>(head);
+		if (i == 0)
+		{
+			return nullptr;
+		}
+		uint64_t next = (((head >> 32u) + 1) << 32u) | ctx.base[i].u.list.next;
+		if (bin.compare_exchange_weak(head, next, std::memory_order_acquire, std::memory_order_acquire))
+		{
+			return &ctx.base[i];
+		}
+	}
+}
+
+static void MSpaceInternalFastPush(MSpaceContext& ctx, uint32_t i, uint32_t num_blocks)
+{
+	auto&    bin  = ctx.fast_bins[num_blocks - 2];
+	uint64_t head = bin.load(std::memory_order_relaxed);
+
+	for (;;)
 	{
-		num_blocks = (size + 11) / 8;
+		ctx.base[i].u.list.next = static_cast<uint32_t>(head);
+		if (bin.compare_exchange_weak(head, (((head >> 32u) + 1) << 32u) | i, std::memory_order_release, std::memory_order_relaxed))
+		{
+			return;
+		}
 	}
+}
+
+static void MSpaceInternalFreeUnsafe(MSpaceContext& ctx, void* old);
+
+// Returns the chunks of the fast bins to the lists, so they can be merged. Returns false if the bins were empty.
+static bool MSpaceInternalFlushFastBins(MSpaceContext& ctx)
+{
+	bool flushed = false;
+
+	for (auto& bin: ctx.fast_bins)
+	{
+		uint64_t head = bin.load(std::memory_order_acquire);
+		while (static_cast<uint32_t>(head) != 0 &&
+		       !bin.compare_exchange_weak(head, ((head >> 32u) + 1) << 32u, std::memory_order_acquire, std::memory_order_acquire))
+		{
+		}
+
+		for (auto i = static_cast<uint32_t>(head); i != 0;)
+		{
+			uint32_t next = ctx.base[i].u.list.next;
+			MSpaceInternalFreeUnsafe(ctx, &ctx.base[i]);
+			i       = next;
+			flushed = true;
+		}
+	}
+
+	return flushed;
+}
+
+static void* MSpaceInternalMallocUnsafe(MSpaceContext& ctx, uint32_t size, uint32_t report_size)
+{
+	uint32_t num_blocks = MSpaceInternalNumBlocks(size);
 
 	if (num_blocks <= MSPACE_ARRAY_SMALL)
 	{
@@ -249,9 +317,19 @@ static void* MSpaceInternalMallocUnsafe(MSpaceContext& ctx, uint32_t size, uint3
 		return MSpaceInternalFromKeyBlk(ctx, num_blocks);
 	}
 
+	if (ctx.mutex != nullptr && MSpaceInternalFlushFastBins(ctx))
+	{
+		return MSpaceInternalMallocUnsafe(ctx, size, report_size);
+	}
+
 	for (uint32_t to_free = num_blocks * 16; to_free < (ctx.capacity * 16); to_free *= 2)
 	{
 		MSpaceInternalOutOfMemory(ctx, to_free, report_size);
+		if (ctx.mutex != nullptr)
+		{
+			// The callback may free chunks
+			MSpaceInternalFlushFastBins(ctx);
+		}
 		if (ctx.index_of_key_chunk != 0u)
 		{
 			MSpaceInternalLink(ctx, ctx.index_of_key_chunk);
@@ -321,6 +399,14 @@ static uint32_t MSpaceInternalSize(void* p)
 
 static void* MSpaceInternalMalloc(MSpaceContext& ctx, uint32_t size, uint32_t report_size)
 {
+	if (uint32_t num_blocks = MSpaceInternalNumBlocks(size); ctx.mutex != nullptr && num_blocks - 2 < MSPACE_FAST_BINS)
+	{
+		if (auto* p = MSpaceInternalFastPop(ctx, num_blocks); p != nullptr)
+		{
+			return p;
+		}
+	}
+
 	MSpaceInternalEnter(ctx);
 	auto* p = MSpaceInternalMallocUnsafe(ctx, size, report_size);
 	MSpaceInternalLeave(ctx);
@@ -342,6 +428,15 @@ static void* MSpaceInternalMalloc_align(MSpaceContext& ctx, uint32_t size, uint6
 
 static void MSpaceInternalFree(MSpaceContext& ctx, void* prior)
 {
+	auto     index      = static_cast<uint32_t>(static_cast<MSpaceBlock*>(prior) - ctx.base);
+	uint32_t num_blocks = ctx.base[index - 1].u.hdr.size_4x / 4;
+
+	if (ctx.mutex != nullptr && num_blocks - 2 < MSPACE_FAST_BINS)
+	{
+		MSpaceInternalFastPush(ctx, index, num_blocks);
+		return;
+	}
+
 	MSpaceInternalEnter(ctx);
 	MSpaceInternalFreeUnsafe(ctx, prior);
 	MSpaceInternalLeave(ctx);
@@ -424,7 +519,7 @@ static bool MSpaceInternalInit(MSpaceContext& ctx, const char* name, void* base,
 		return false;
 	}
 
-	ctx = MSpaceContext();
+	new (&ctx) MSpaceContext;
 
 	int s = snprintf(ctx.name, sizeof(ctx.name), "%s", name);
 
@@ -8,12 +8,20 @@
 #include "Kyty/Sys/SysHeap.h"
 #include "Kyty/Sys/SysSync.h"
 
+#include <algorithm>
+#include <atomic>
 #include <cstdlib>
+#include <cstring>
 #include <new>
 
+#if KYTY_COMPILER == KYTY_COMPILER_MSVC
+#include <intrin.h>
+#endif
+
 namespace Kyty::Core {
 
-#if !defined(KYTY_FINAL) && !defined(KYTY_SHARED_DLL)
+// The tracker (leak reports, overflow checks) serializes all allocations, it is compiled in only with -D KYTY_MEM_TRACKER=ON
+#if defined(KYTY_MEM_TRACKER) && !defined(KYTY_FINAL) && !defined(KYTY_SHARED_DLL)
 #define MEM_TRACKER
 #endif
 
@@ -42,6 +50,8 @@ static size_t        g_mem_max_size    = 0;
 
 #ifdef MEM_TRACKER
 
+static uint64_t g_mem_alloc_num = 0;
+
 using pattern_t = uint32_t;
 
 constexpr size_t PATTERN_SIZE = (sizeof(pattern_t));
@@ -157,6 +167,367 @@ static bool pattern_check(MemBlockInfoT* info)
 
 #endif
 
+#ifndef MEM_TRACKER
+
+// Blocks up to MEM_SMALL_MAX bytes come from per-thread free lists, one for each size class. A thread refills its list from the
+// central pool of the class and gives blocks back in batches, so most calls don't take a lock. Larger blocks and the chunks the
+// pools are carved from come from the system heap, chunks are never returned to it.
+
+constexpr uint32_t MEM_SMALL_MAX   = 32768;
+constexpr uint32_t MEM_CLASSES_NUM = 40;
+constexpr uint32_t MEM_CLASS_LARGE = 0xFFFFFFFFu;
+constexpr uint32_t MEM_MAGIC       = 0x4D454D4Bu;
+constexpr uint32_t MEM_CHUNK_SIZE  = 64 * 1024;
+constexpr uint32_t MEM_BATCH_BYTES = 16 * 1024;
+
+struct MemBlockHeader
+{
+	uint64_t size;       // requested size
+	uint32_t size_class; // MEM_CLASS_LARGE for blocks from the system heap
+	uint32_t magic;      // cleared when the block is freed
+};
+
+static_assert(sizeof(MemBlockHeader) == 16);
+
+// Overlays the header of a free block
+struct MemFreeBlock
+{
+	MemFreeBlock* next;
+};
+
+struct MemPool
+{
+	SysCS         cs;
+	MemFreeBlock* free;
+	uint8_t*      chunk_pos;
+	size_t        chunk_left;
+};
+
+class MemThreadCache
+{
+public:
+	constexpr MemThreadCache() = default;
+	~MemThreadCache();
+
+	KYTY_CLASS_NO_COPY(MemThreadCache);
+
+	MemFreeBlock*        free[MEM_CLASSES_NUM]     = {};
+	uint32_t             free_num[MEM_CLASSES_NUM] = {};
+	std::atomic_uint64_t alloc_num {0}; // written only by the owner thread
+	MemThreadCache*      prev  = nullptr;
+	MemThreadCache*      next  = nullptr;
+	int                  state = 0; // 0 - not used yet, 1 - registered, 2 - destroyed at the thread exit
+};
+
+static MemPool*                    g_mem_pools             = nullptr;
+static MemThreadCache*             g_mem_caches            = nullptr; // registered caches, under g_mem_cs
+static uint64_t                    g_mem_retired_alloc_num = 0;       // allocations of exited threads, under g_mem_cs
+thread_local static MemThreadCache g_mem_cache;
+
+// 16-byte steps up to 128, then 4 classes for each power of two
+static constexpr uint32_t mem_class_size(uint32_t c)
+{
+	if (c < 8)
+	{
+		return (c + 1) * 16;
+	}
+	uint32_t bit = 7 + (c - 8) / 4;
+	return (5 + (c - 8) % 4) << (bit - 2);
+}
+
+static_assert(mem_class_size(MEM_CLASSES_NUM - 1) == MEM_SMALL_MAX);
+
+static uint32_t mem_log2(uint32_t i)
+{
+#if KYTY_COMPILER == KYTY_COMPILER_MSVC
+	unsigned long temp = 0;
+	_BitScanReverse(&temp, i | 1u);
+	return temp;
+#else
+	return 31 - __builtin_clz(i | 1u);
+#endif
+}
+
+static uint32_t mem_class(size_t size)
+{
+	if (size <= 128)
+	{
+		return static_cast<uint32_t>(size - 1) / 16;
+	}
+	auto     s   = static_cast<uint32_t>(size - 1);
+	uint32_t bit = mem_log2(s);
+	return 8 + (bit - 7) * 4 + (s >> (bit - 2)) - 4;
+}
+
+static uint32_t mem_batch(uint32_t c)
+{
+	uint32_t n = MEM_BATCH_BYTES / mem_class_size(c);
+	return (n < 2 ? 2 : (n > 64 ? 64 : n));
+}
+
+static void* mem_heap_alloc(size_t size)
+{
+	// The system heap is not serialized on Windows
+	g_mem_cs->Enter();
+	void* ptr = sys_heap_alloc(g_default_heap, size);
+	g_mem_cs->Leave();
+
+	if (ptr == nullptr)
+	{
+		EXIT("mem_alloc(): can't alloc %" PRIu64 " bytes\n", uint64_t(size));
+	}
+
+	return ptr;
+}
+
+static MemFreeBlock* mem_pool_take(uint32_t c, uint32_t num)
+{
+	auto&    pool       = g_mem_pools[c];
+	uint32_t block_size = sizeof(MemBlockHeader) + mem_class_size(c);
+
+	MemFreeBlock* list = nullptr;
+
+	pool.cs.Enter();
+
+	for (uint32_t i = 0; i < num; i++)
+	{
+		MemFreeBlock* b = pool.free;
+		if (b != nullptr)
+		{
+			pool.free = b->next;
+		} else
+		{
+			if (pool.chunk_left < block_size)
+			{
+				size_t chunk_size = std::max(static_cast<size_t>(MEM_CHUNK_SIZE), static_cast<size_t>(block_size) * mem_batch(c));
+				pool.chunk_pos    = static_cast<uint8_t*>(mem_heap_alloc(chunk_size));
+				pool.chunk_left   = chunk_size;
+			}
+			b = reinterpret_cast<MemFreeBlock*>(pool.chunk_pos);
+			pool.chunk_pos += block_size;
+			pool.chunk_left -= block_size;
+		}
+		b->next = list;
+		list    = b;
+	}
+
+	pool.cs.Leave();
+
+	return list;
+}
+
+static void mem_pool_give(uint32_t c, MemFreeBlock* first, MemFreeBlock* last)
+{
+	auto& pool = g_mem_pools[c];
+
+	pool.cs.Enter();
+	last->next = pool.free;
+	pool.free  = first;
+	pool.cs.Leave();
+}
+
+MemThreadCache::~MemThreadCache()
+{
+	if (state != 1)
+	{
+		return;
+	}
+
+	for (uint32_t c = 0; c < MEM_CLASSES_NUM; c++)
+	{
+		if (free[c] != nullptr)
+		{
+			MemFreeBlock* last = free[c];
+			while (last->next != nullptr)
+			{
+				last = last->next;
+			}
+			mem_pool_give(c, free[c], last);
+			free[c]     = nullptr;
+			free_num[c] = 0;
+		}
+	}
+
+	g_mem_cs->Enter();
+	(prev != nullptr ? prev->next : g_mem_caches) = next;
+	if (next != nullptr)
+	{
+		next->prev = prev;
+	}
+	g_mem_retired_alloc_num += alloc_num.load(std::memory_order_relaxed);
+	g_mem_cs->Leave();
+
+	state = 2;
+}
+
+// Returns nullptr after the thread's cache is destroyed
+static MemThreadCache* mem_cache_get()
+{
+	auto* tc = &g_mem_cache;
+
+	if (tc->state == 0)
+	{
+		g_mem_cs->Enter();
+		tc->next = g_mem_caches;
+		if (g_mem_caches != nullptr)
+		{
+			g_mem_caches->prev = tc;
+		}
+		g_mem_caches = tc;
+		g_mem_cs->Leave();
+
+		tc->state = 1;
+	}
+
+	return (tc->state == 1 ? tc : nullptr);
+}
+
+static void* mem_cache_alloc(size_t size, bool count)
+{
+	auto* tc = mem_cache_get();
+
+	if (count)
+	{
+		if (tc != nullptr)
+		{
+			tc->alloc_num.store(tc->alloc_num.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+		} else
+		{
+			g_mem_cs->Enter();
+			g_mem_retired_alloc_num++;
+			g_mem_cs->Leave();
+		}
+	}
+
+	MemBlockHeader* h = nullptr;
+
+	if (size > MEM_SMALL_MAX)
+	{
+		h             = static_cast<MemBlockHeader*>(mem_heap_alloc(size + sizeof(MemBlockHeader)));
+		h->size_class = MEM_CLASS_LARGE;
+	} else
+	{
+		uint32_t      c = mem_class(size);
+		MemFreeBlock* b = nullptr;
+
+		if (tc == nullptr)
+		{
+			b = mem_pool_take(c, 1);
+		} else
+		{
+			if (tc->free[c] == nullptr)
+			{
+				tc->free_num[c] = mem_batch(c);
+				tc->free[c]     = mem_pool_take(c, tc->free_num[c]);
+			}
+			b           = tc->free[c];
+			tc->free[c] = b->next;
+			tc->free_num[c]--;
+		}
+
+		h             = reinterpret_cast<MemBlockHeader*>(b);
+		h->size_class = c;
+	}
+
+	h->size  = size;
+	h->magic = MEM_MAGIC;
+
+	return h + 1;
+}
+
+static MemBlockHeader* mem_cache_header(void* ptr)
+{
+	auto* h = static_cast<MemBlockHeader*>(ptr) - 1;
+
+	if (h->magic != MEM_MAGIC)
+	{
+		EXIT("invalid or freed block: %016" PRIx64 "\n", reinterpret_cast<uint64_t>(ptr));
+	}
+
+	return h;
+}
+
+static void mem_cache_free(void* ptr)
+{
+	auto* h = mem_cache_header(ptr);
+
+	h->magic = 0;
+
+	if (h->size_class == MEM_CLASS_LARGE)
+	{
+		g_mem_cs->Enter();
+		sys_heap_free(g_default_heap, h);
+		g_mem_cs->Leave();
+		return;
+	}
+
+	uint32_t c  = h->size_class;
+	auto*    b  = reinterpret_cast<MemFreeBlock*>(h);
+	auto*    tc = (g_mem_cache.state == 1 ? &g_mem_cache : nullptr);
+
+	if (tc == nullptr)
+	{
+		mem_pool_give(c, b, b);
+		return;
+	}
+
+	b->next     = tc->free[c];
+	tc->free[c] = b;
+
+	// Blocks freed by a thread which doesn't allocate them (a consumer of a queue) go back to the pool
+	if (uint32_t batch = mem_batch(c); ++tc->free_num[c] > batch * 2)
+	{
+		MemFreeBlock* last = b;
+		for (uint32_t i = 1; i < batch; i++)
+		{
+			last = last->next;
+		}
+		tc->free[c] = last->next;
+		tc->free_num[c] -= batch;
+		mem_pool_give(c, b, last);
+	}
+}
+
+static void* mem_cache_realloc(void* ptr, size_t size)
+{
+	if (ptr == nullptr)
+	{
+		return mem_cache_alloc(size, false);
+	}
+
+	auto* h = mem_cache_header(ptr);
+
+	// A large block stays in the system heap even if it shrinks, the heap may resize it in place
+	if (h->size_class == MEM_CLASS_LARGE)
+	{
+		g_mem_cs->Enter();
+		h = static_cast<MemBlockHeader*>(sys_heap_realloc(g_default_heap, h, size + sizeof(MemBlockHeader)));
+		g_mem_cs->Leave();
+
+		if (h == nullptr)
+		{
+			EXIT("mem_realloc(): can't alloc %" PRIu64 " bytes\n", uint64_t(size));
+		}
+
+		h->size = size;
+		return h + 1;
+	}
+
+	if (size <= mem_class_size(h->size_class))
+	{
+		h->size = size;
+		return ptr;
+	}
+
+	void* ptr2 = mem_cache_alloc(size, false);
+	memcpy(ptr2, ptr, std::min(static_cast<size_t>(h->size), size));
+	mem_cache_free(ptr);
+
+	return ptr2;
+}
+
+#endif
+
 static void mem_init()
 {
 	if (g_mem_initialized)
@@ -184,6 +555,19 @@ static void mem_init()
 
 	g_default_heap = sys_heap_create();
 
+#ifndef MEM_TRACKER
+	// NOLINTNEXTLINE(cppcoreguidelines-no-malloc,hicpp-no-malloc)
+	g_mem_pools = static_cast<MemPool*>(std::malloc(sizeof(MemPool) * MEM_CLASSES_NUM));
+	for (uint32_t c = 0; c < MEM_CLASSES_NUM; c++)
+	{
+		auto* pool       = new (g_mem_pools + c) MemPool;
+		pool->free       = nullptr;
+		pool->chunk_pos  = nullptr;
+		pool->chunk_left = 0;
+		pool->cs.Init();
+	}
+#endif
+
 #ifdef MEM_TRACKER
 	g_mem_depth--;
 #endif
@@ -223,9 +607,14 @@ void* mem_alloc(size_t size)
 	}
 
 	mem_init();
+
+#ifndef MEM_TRACKER
+	return mem_alloc_check_alignment(mem_cache_alloc(size, true));
+#else
 	MemLock lock;
 
-#ifdef MEM_TRACKER
+	g_mem_alloc_num++;
+
 	DebugStack stack;
 	DebugStack::Trace(&stack);
 
@@ -236,22 +625,15 @@ void* mem_alloc(size_t size)
 		KYTY_MDBG("- std alloc -", r);
 		return mem_alloc_check_alignment(r);
 	}
-#endif
 
-#ifdef MEM_TRACKER
 	auto* ptr_p = static_cast<pattern_t*>(sys_heap_alloc(g_default_heap, size + PATTERN_SIZE * PATTERNS_NUM * 2));
 	void* ptr   = ptr_p + PATTERNS_NUM;
-#else
-	void* ptr  = sys_heap_alloc(g_default_heap, size);
-#endif
 
 	if (ptr == nullptr)
 	{
 		EXIT("mem_alloc(): can't alloc %" PRIu64 " bytes\n", uint64_t(size));
 	}
 
-#ifdef MEM_TRACKER
-
 	// NOLINTNEXTLINE(cppcoreguidelines-no-malloc,hicpp-no-malloc)
 	auto* info = static_cast<MemBlockInfoT*>(std::malloc(sizeof(MemBlockInfoT)));
 
@@ -271,9 +653,8 @@ void* mem_alloc(size_t size)
 
 	KYTY_MDBG("- mem_alloc -", ptr);
 
-#endif
-
 	return mem_alloc_check_alignment(ptr);
+#endif
 }
 
 void* mem_realloc(void* ptr, size_t size)
@@ -286,9 +667,12 @@ void* mem_realloc(void* ptr, size_t size)
 	}
 
 	mem_init();
+
+#ifndef MEM_TRACKER
+	return mem_alloc_check_alignment(mem_cache_realloc(ptr, size));
+#else
 	MemLock lock;
 
-#ifdef MEM_TRACKER
 	DebugStack stack;
 	DebugStack::Trace(&stack);
 
@@ -301,22 +685,16 @@ void* mem_realloc(void* ptr, size_t size)
 		KYTY_MDBG("- std realloc new -", ptr2);
 		return mem_alloc_check_alignment(ptr2);
 	}
-#endif
 
-#ifdef MEM_TRACKER
 	auto* ptr2_b = static_cast<pattern_t*>(sys_heap_realloc(
 	    g_default_heap, ptr != nullptr ? (static_cast<pattern_t*>(ptr)) - PATTERNS_NUM : nullptr, size + PATTERN_SIZE * PATTERNS_NUM * 2));
 	void* ptr2   = ptr2_b + PATTERNS_NUM;
-#else
-	void* ptr2 = sys_heap_realloc(g_default_heap, ptr, size);
-#endif
 
 	if (ptr2 == nullptr)
 	{
 		EXIT("mem_realloc(): can't alloc %" PRIu64 " bytes\n", uint64_t(size));
 	}
 
-#ifdef MEM_TRACKER
 	if (ptr != nullptr)
 	{
 		MemBlockInfoT* const* info_p = g_mem_map->Find(reinterpret_cast<uintptr_t>(ptr));
@@ -371,11 +749,9 @@ void* mem_realloc(void* ptr, size_t size)
 
 	KYTY_MDBG("- mem_realloc old -", ptr);
 	KYTY_MDBG("- mem_realloc new -", ptr2);
-#endif
-
-	// g_mem_cs->Leave();
 
 	return mem_alloc_check_alignment(ptr2);
+#endif
 }
 
 void mem_free(void* ptr)
@@ -383,9 +759,14 @@ void mem_free(void* ptr)
 
 	EXIT_IF(!g_mem_initialized);
 
+#ifndef MEM_TRACKER
+	if (ptr != nullptr)
+	{
+		mem_cache_free(ptr);
+	}
+#else
 	MemLock lock;
 
-#ifdef MEM_TRACKER
 	MemBlockInfoT* const* info = g_mem_map->Find(reinterpret_cast<uintptr_t>(ptr));
 
 	if (info != nullptr)
@@ -401,15 +782,8 @@ void mem_free(void* ptr)
 		std::free(*info);
 		g_mem_map->Remove(reinterpret_cast<uintptr_t>(ptr));
 		// printf("heap_free: %x\n", uintptr_t(ptr));
-#endif
 
-#ifdef MEM_TRACKER
 		sys_heap_free(g_default_heap, ptr != nullptr ? (static_cast<pattern_t*>(ptr)) - PATTERNS_NUM : nullptr);
-#else
-	sys_heap_free(g_default_heap, ptr);
-#endif
-
-#ifdef MEM_TRACKER
 	} else
 	{
 		if (ptr != nullptr)
@@ -503,6 +877,27 @@ void mem_get_stat(MemStats* s)
 #endif
 }
 
+uint64_t mem_get_alloc_num()
+{
+	if (!g_mem_initialized)
+	{
+		return 0;
+	}
+
+	MemLock lock;
+
+#ifdef MEM_TRACKER
+	return g_mem_alloc_num;
+#else
+	uint64_t num = g_mem_retired_alloc_num;
+	for (const auto* tc = g_mem_caches; tc != nullptr; tc = tc->next)
+	{
+		num += tc->alloc_num.load(std::memory_order_relaxed);
+	}
+	return num;
+#endif
+}
+
 int mem_new_state()
 {
 #ifdef MEM_TRACKER
@@ -0,0 +1,422 @@
+#include "Kyty/Core/SharedStore.h"
+
+#include "Kyty/Core/DbgAssert.h"
+#include "Kyty/Core/File.h"
+#include "Kyty/Core/Hash.h"
+#include "Kyty/Core/Hashmap.h"
+#include "Kyty/Core/Threads.h"
+#include "Kyty/Core/Vector.h"
+
+#include <cstddef>
+#include <cstring>
+
+namespace Kyty::Core {
+
+constexpr uint32_t SHARED_STORE_MAGIC   = 0x5353594b; // KYSS
+constexpr uint32_t SHARED_STORE_VERSION = 2;
+
+struct SharedStoreHeader
+{
+	uint32_t magic      = 0;
+	uint32_t version    = 0;
+	uint64_t end        = 0; // Records are complete up to this offset
+	uint64_t generation = 0; // Changed by the compaction, the offsets of the older generations are not valid
+};
+
+// Followed by the value, the next record starts at an 8-byte boundary
+struct SharedStoreRecord
+{
+	uint64_t key   = 0;
+	uint32_t size  = 0;
+	uint32_t check = 0; // Of the key, the size and the value
+};
+
+struct SharedStorePrivate
+{
+	Mutex                       mutex {"SharedStore"};
+	File                        file;
+	MappedFile                  map;
+	Hashmap<uint64_t, uint64_t> index; // Key -> offset of the last record
+	uint64_t                    scanned    = 0;
+	uint64_t                    generation = 0;
+	uint64_t                    size_max   = 0;
+};
+
+static uint64_t record_size(uint32_t value_size)
+{
+	return sizeof(SharedStoreRecord) + ((static_cast<uint64_t>(value_size) + 7u) & ~static_cast<uint64_t>(7u));
+}
+
+static uint32_t record_check(uint64_t key, uint32_t size, const void* value)
+{
+	struct
+	{
+		uint64_t key;
+		uint32_t size;
+		uint32_t value_check;
+	} r {key, size, hash(value, size)};
+
+	return hash(&r, sizeof(r));
+}
+
+// Read without the lock, the writer updates the end after the record is written
+static bool read_header(SharedStorePrivate* p, SharedStoreHeader* h)
+{
+	uint64_t bytes_read = 0;
+	p->file.ReadAt(h, sizeof(SharedStoreHeader), 0, &bytes_read);
+	return (bytes_read == sizeof(SharedStoreHeader) && h->magic == SHARED_STORE_MAGIC && h->version == SHARED_STORE_VERSION &&
+	        h->end >= sizeof(SharedStoreHeader));
+}
+
+static void write_header(SharedStorePrivate* p, const SharedStoreHeader& h)
+{
+	p->file.Seek(0);
+	p->file.Write(&h, sizeof(h));
+	p->file.Flush();
+}
+
+static bool map_to(SharedStorePrivate* p, uint64_t end)
+{
+	if (p->map.IsMapped() && p->map.GetSize() >= end)
+	{
+		return true;
+	}
+	return p->map.Map(&p->file, MappedFile::Mode::ReadOnly, 0, end);
+}
+
+// The record is complete and its value matches the check. Another process may be compacting the file, then the record is broken.
+static bool record_valid(SharedStorePrivate* p, uint64_t offset, SharedStoreRecord* r)
+{
+	if (offset + sizeof(SharedStoreRecord) > p->scanned || !map_to(p, p->scanned))
+	{
+		return false;
+	}
+
+	std::memcpy(r, p->map.GetData() + offset, sizeof(SharedStoreRecord));
+
+	return (offset + record_size(r->size) <= p->scanned &&
+	        record_check(r->key, r->size, p->map.GetData() + offset + sizeof(SharedStoreRecord)) == r->check);
+}
+
+// Indexes the records appended since the last call. A record is appended only if the key has no valid record, so the last record
+// of a key is the one to read.
+static void refresh(SharedStorePrivate* p)
+{
+	SharedStoreHeader h;
+
+	if (!read_header(p, &h))
+	{
+		return;
+	}
+
+	if (h.generation != p->generation || h.end < p->scanned)
+	{
+		p->index.Clear();
+		p->scanned    = sizeof(SharedStoreHeader);
+		p->generation = h.generation;
+	}
+
+	if (h.end <= p->scanned || !map_to(p, h.end))
+	{
+		return;
+	}
+
+	const uint8_t* data   = p->map.GetData();
+	uint64_t       offset = p->scanned;
+
+	// A record which doesn't fit is broken, the records after it are lost until the compaction
+	while (offset + sizeof(SharedStoreRecord) <= h.end)
+	{
+		SharedStoreRecord r;
+		std::memcpy(&r, data + offset, sizeof(r));
+
+		if (offset + record_size(r.size) > h.end)
+		{
+			break;
+		}
+
+		p->index.Put(r.key, offset);
+
+		offset += record_size(r.size);
+	}
+
+	p->scanned = offset;
+}
+
+// Called under the file lock. Rewrites the valid records at the start of the file, the newest ones that fit in the half of the size
+// limit. The file keeps its size, the other processes may have it mapped. They see the new generation and index it again, until
+// then their reads of the moved records fail the check.
+static bool compact(SharedStorePrivate* p)
+{
+	struct Live
+	{
+		uint64_t offset;
+		uint64_t size;
+	};
+
+	if (!map_to(p, p->scanned))
+	{
+		return false;
+	}
+
+	Vector<Live> live;
+
+	for (uint64_t offset = sizeof(SharedStoreHeader); offset < p->scanned;)
+	{
+		SharedStoreRecord r;
+		std::memcpy(&r, p->map.GetData() + offset, sizeof(r));
+
+		const auto* last = p->index.Find(r.key);
+
+		if (last != nullptr && *last == offset && record_valid(p, offset, &r))
+		{
+			live.Add(Live {offset, record_size(r.size)});
+		}
+
+		offset += record_size(r.size);
+	}
+
+	uint64_t budget = p->size_max / 2 - sizeof(SharedStoreHeader);
+	uint32_t first  = live.Size();
+
+	for (uint64_t size = 0; first > 0 && size + live[first - 1].size <= budget; first--)
+	{
+		size += live[first - 1].size;
+	}
+
+	// A crash in the middle leaves an empty store
+	SharedStoreHeader h;
+	h.magic      = SHARED_STORE_MAGIC;
+	h.version    = SHARED_STORE_VERSION;
+	h.end        = sizeof(SharedStoreHeader);
+	h.generation = p->generation + 1;
+	write_header(p, h);
+
+	// Records only move to lower offsets, each one is copied before the place is overwritten
+	ByteBuffer buf;
+	for (uint32_t i = first; i < live.Size(); i++)
+	{
+		buf.Resize(static_cast<uint32_t>(live[i].size));
+		std::memcpy(buf.GetData(), p->map.GetData() + live[i].offset, live[i].size);
+		p->file.Seek(h.end);
+		p->file.Write(buf);
+		h.end += live[i].size;
+	}
+	p->file.Flush();
+
+	write_header(p, h);
+
+	printf("SharedStore: compacted, %u of %u records kept\n", live.Size() - first, live.Size());
+
+	p->index.Clear();
+	p->scanned    = sizeof(SharedStoreHeader);
+	p->generation = h.generation;
+
+	refresh(p);
+
+	return true;
+}
+
+SharedStore::~SharedStore()
+{
+	Close();
+}
+
+bool SharedStore::Open(const String& file_name, uint64_t size_max)
+{
+	EXIT_IF(m_p != nullptr);
+	EXIT_IF(size_max < SIZE_MAX_MIN);
+
+	File::CreateDirectories(file_name.DirectoryWithoutFilename());
+
+	auto* p = new SharedStorePrivate;
+
+	if (!p->file.OpenOrCreate(file_name))
+	{
+		delete p;
+		return false;
+	}
+
+	bool              ok = true;
+	SharedStoreHeader h;
+
+	p->file.Lock();
+
+	if (p->file.Size() == 0)
+	{
+		h.magic   = SHARED_STORE_MAGIC;
+		h.version = SHARED_STORE_VERSION;
+		h.end     = sizeof(SharedStoreHeader);
+		write_header(p, h);
+	} else if (!read_header(p, &h))
+	{
+		// The other processes may have it mapped, so the file isn't reset
+		printf("Invalid or old shared store, delete it to recreate: %s\n", file_name.C_Str());
+		ok = false;
+	}
+
+	p->file.Unlock();
+
+	if (!ok)
+	{
+		p->file.Close();
+		delete p;
+		return false;
+	}
+
+	p->scanned  = sizeof(SharedStoreHeader);
+	p->size_max = size_max;
+
+	m_p = p;
+
+	Core::LockGuard lock(m_p->mutex);
+	refresh(m_p);
+
+	return true;
+}
+
+void SharedStore::Close()
+{
+	if (m_p != nullptr)
+	{
+		m_p->map.Unmap();
+		m_p->file.Close();
+		delete m_p;
+		m_p = nullptr;
+	}
+}
+
+bool SharedStore::Find(uint64_t key, ByteBuffer* value)
+{
+	EXIT_IF(m_p == nullptr);
+	EXIT_IF(value == nullptr);
+
+	Core::LockGuard lock(m_p->mutex);
+
+	const auto*       offset = m_p->index.Find(key);
+	SharedStoreRecord r;
+
+	// The record may be broken or moved by the compaction, a newer one is looked for then
+	if (offset == nullptr || !record_valid(m_p, *offset, &r))
+	{
+		refresh(m_p);
+		offset = m_p->index.Find(key);
+	}
+
+	if (offset == nullptr || !record_valid(m_p, *offset, &r) || r.key != key)
+	{
+		return false;
+	}
+
+	value->Resize(r.size);
+
+	if (r.size != 0)
+	{
+		std::memcpy(value->GetData(), m_p->map.GetData() + *offset + sizeof(r), r.size);
+	}
+
+	// The other process may be compacting the file right now
+	return (record_check(r.key, r.size, value->GetDataConst()) == r.check);
+}
+
+// A valid record of the key (m_p->mutex must be locked)
+static bool contains(SharedStorePrivate* p, uint64_t key)
+{
+	const auto*       offset = p->index.Find(key);
+	SharedStoreRecord r;
+	return (offset != nullptr && record_valid(p, *offset, &r) && r.key == key);
+}
+
+bool SharedStore::Append(uint64_t key, const void* value, uint32_t size)
+{
+	EXIT_IF(m_p == nullptr);
+	EXIT_IF(value == nullptr && size != 0);
+
+	uint64_t new_size = record_size(size);
+
+	if (new_size > m_p->size_max / 2 - sizeof(SharedStoreHeader))
+	{
+		return false;
+	}
+
+	Core::LockGuard lock(m_p->mutex);
+
+	refresh(m_p);
+
+	if (contains(m_p, key))
+	{
+		return false;
+	}
+
+	m_p->file.Lock();
+
+	// Another process may have appended the key after the refresh above
+	refresh(m_p);
+
+	SharedStoreHeader h;
+
+	if (!read_header(m_p, &h) || contains(m_p, key))
+	{
+		m_p->file.Unlock();
+		return false;
+	}
+
+	// The end isn't reached if a record is broken
+	if ((h.end != m_p->scanned || h.end + new_size > m_p->size_max) && !compact(m_p))
+	{
+		m_p->file.Unlock();
+		return false;
+	}
+
+	uint64_t end = m_p->scanned;
+
+	SharedStoreRecord r;
+	r.key   = key;
+	r.size  = size;
+	r.check = record_check(key, size, value);
+
+	static const uint8_t zeros[8] = {};
+
+	m_p->file.Seek(end);
+	m_p->file.Write(&r, sizeof(r));
+	if (size != 0)
+	{
+		m_p->file.Write(value, size);
+	}
+	if (auto pad = static_cast<uint32_t>(record_size(size) - sizeof(r) - size); pad != 0)
+	{
+		m_p->file.Write(zeros, pad);
+	}
+	m_p->file.Flush();
+
+	// Publish the record
+	uint64_t new_end = end + new_size;
+	m_p->file.Seek(offsetof(SharedStoreHeader, end));
+	m_p->file.Write(&new_end, sizeof(new_end));
+	m_p->file.Flush();
+
+	m_p->file.Unlock();
+
+	m_p->index.Put(key, end);
+	m_p->scanned = new_end;
+
+	return true;
+}
+
+bool SharedStore::Append(uint64_t key, const ByteBuffer& value)
+{
+	return Append(key, value.GetDataConst(), value.Size());
+}
+
+uint32_t SharedStore::GetRecordsNum()
+{
+	EXIT_IF(m_p == nullptr);
+
+	Core::LockGuard lock(m_p->mutex);
+
+	refresh(m_p);
+
+	return m_p->index.Size();
+}
+
+} // namespace Kyty::Core
@@ -25,14 +25,6 @@ KYTY_HASH_DEFINE_EQUALS(String)
 	return *key_a == *key_b;
 }
 
-struct CharPropRange
-{
-	CharProperty r[256];
-};
-
-extern uint8_t       g_char_prop_p[];
-extern CharPropRange g_char_prop_r[];
-
 static size_t strlen(const char32_t* str)
 {
 	const char32_t* eos = str;
@@ -42,11 +34,6 @@ static size_t strlen(const char32_t* str)
 	return (eos - str - 1);
 }
 
-static const CharProperty& char_get_prop(uint32_t code)
-{
-	return g_char_prop_r[g_char_prop_p[code >> 8u]].r[code & 0xffU];
-}
-
 static const int g_fc_extra_bytes_for_utf8[256] = {
     0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
     0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
@@ -288,86 +275,6 @@ int Char::ToCp1251(char32_t src, uint8_t* dst)
 	return 1;
 }
 
-bool Char::IsDecimal(char32_t ucs4)
-{
-	return char_get_prop(ucs4).decimal;
-}
-
-bool Char::IsAlpha(char32_t ucs4)
-{
-	return char_get_prop(ucs4).alpha;
-}
-
-bool Char::IsAlphaNum(char32_t ucs4)
-{
-	const CharProperty& p = char_get_prop(ucs4);
-	return (p.alpha || p.decimal);
-}
-
-bool Char::IsLower(char32_t ucs4)
-{
-	return char_get_prop(ucs4).lower;
-}
-
-bool Char::IsUpper(char32_t ucs4)
-{
-	return char_get_prop(ucs4).upper;
-}
-
-bool Char::IsSpace(char32_t ucs4)
-{
-	return char_get_prop(ucs4).space;
-}
-
-bool Char::IsHex(char32_t ucs4)
-{
-	return char_get_prop(ucs4).hex;
-}
-
-int Char::HexDigit(char32_t ucs4)
-{
-	const CharProperty& p = char_get_prop(ucs4);
-	return p.hex ? p.hex_data : -1;
-}
-
-int Char::DecimalDigit(char32_t ucs4)
-{
-	const CharProperty& p = char_get_prop(ucs4);
-	return p.decimal ? p.hex_data : -1;
-}
-
-static char32_t MakeLower(char32_t* ucs4)
-{
-	const CharProperty& p = char_get_prop(*ucs4);
-	if (p.upper)
-	{
-		*ucs4 += p.case_offset;
-	}
-	return *ucs4;
-}
-
-static char32_t MakeUpper(char32_t* ucs4)
-{
-	const CharProperty& p = char_get_prop(*ucs4);
-	if (p.lower)
-	{
-		*ucs4 += p.case_offset;
-	}
-	return *ucs4;
-}
-
-char32_t Char::ToLower(char32_t ucs4)
-{
-	MakeLower(&ucs4);
-	return ucs4;
-}
-
-char32_t Char::ToUpper(char32_t ucs4)
-{
-	MakeUpper(&ucs4);
-	return ucs4;
-}
-
 char32_t Char::ReadUtf32(const char32_t** str)
 {
 	EXIT_IF(str == nullptr);
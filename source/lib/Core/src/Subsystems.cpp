@@ -2,6 +2,7 @@
 
 #include "Kyty/Core/DbgAssert.h"
 #include "Kyty/Core/SafeDelete.h"
+#include "Kyty/Core/Threads.h"
 #include "Kyty/Sys/SysStdio.h"
 
 #include <cstdarg>
@@ -18,10 +19,9 @@ public:
 
 	virtual ~SubsystemPrivate()
 	{
-		if (fail_msg != nullptr)
-		{
-			DeleteArray(fail_msg);
-		}
+		// Allocated by Subsystem::Fail()
+		// NOLINTNEXTLINE(cppcoreguidelines-no-malloc,hicpp-no-malloc)
+		std::free(fail_msg);
 	}
 
 	KYTY_CLASS_NO_COPY(SubsystemPrivate);
@@ -76,7 +76,7 @@ public:
 		this->m_argv = argv;
 	}
 
-	void Add(Subsystem* s, std::initializer_list<Subsystem*> deps)
+	void Add(Subsystem* s, std::initializer_list<Subsystem*> deps, bool concurrent)
 	{
 		EXIT_IF(!s);
 
@@ -88,9 +88,11 @@ public:
 
 		nl->s         = s;
 		nl->name      = name;
-		nl->deps      = nullptr;
-		nl->next      = list;
-		nl->prev_init = nullptr;
+		nl->deps        = nullptr;
+		nl->next        = list;
+		nl->prev_init   = nullptr;
+		nl->next_queued = nullptr;
+		nl->concurrent  = concurrent;
 
 		list = nl;
 
@@ -105,11 +107,17 @@ public:
 			nl->deps = l;
 		}
 
+		nl->started     = false;
 		nl->initialized = false;
 	}
 
-	bool InitAll(bool print_msg)
+	bool InitAll(bool print_msg, int workers_num)
 	{
+		if (workers_num > 0)
+		{
+			return InitAllParallel(print_msg, workers_num);
+		}
+
 		for (;;)
 		{
 			SubsListStruct* n = FindNextToInitialize();
@@ -119,27 +127,185 @@ public:
 				break;
 			}
 
+			n->started = true;
+
 			n->s->Init(parent);
 
-			if (n->s->m_p->failed)
+			if (!Initialized(n, print_msg))
 			{
-				fail_msg  = n->s->m_p->fail_msg;
-				fail_name = n->name;
 				return false;
 			}
+		}
 
-			if (print_msg)
+		return true;
+	}
+
+	struct SubsListStruct;
+
+	struct InitState
+	{
+		SubsystemsListPrivate* p         = nullptr;
+		Mutex                  mutex;
+		CondVar                cond_var;
+		SubsListStruct*        queue     = nullptr;
+		int                    running   = 0;
+		bool                   failed    = false;
+		bool                   done      = false;
+		bool                   print_msg = false;
+	};
+
+	static void InitWorker(void* arg)
+	{
+		auto* st = static_cast<InitState*>(arg);
+
+		st->mutex.Lock();
+
+		for (;;)
+		{
+			while (st->queue == nullptr && !st->done)
 			{
-				printf("Initialized: %s\n", n->name);
+				st->cond_var.Wait(&st->mutex);
 			}
 
-			n->initialized = true;
+			SubsListStruct* n = st->queue;
 
-			SubsListStruct* last = last_init;
-			last_init            = n;
-			n->prev_init         = last;
+			if (n == nullptr)
+			{
+				break;
+			}
+
+			st->queue = n->next_queued;
+
+			st->mutex.Unlock();
+			n->s->Init(st->p->parent);
+			st->mutex.Lock();
+
+			st->running--;
+			st->p->Finished(st, n);
+		}
+
+		st->mutex.Unlock();
+	}
+
+	bool InitAllParallel(bool print_msg, int workers_num)
+	{
+		InitState st;
+		st.p         = this;
+		st.print_msg = print_msg;
+
+		auto** workers = new Thread*[workers_num];
+		for (int i = 0; i < workers_num; i++)
+		{
+			workers[i] = new Thread(InitWorker, &st);
 		}
 
+		st.mutex.Lock();
+
+		for (;;)
+		{
+			SubsListStruct* main_n = nullptr;
+
+			// Hand out everything whose dependencies are ready, stop at the first one for this thread
+			while (!st.failed && main_n == nullptr)
+			{
+				SubsListStruct* n = FindNextToInitialize();
+
+				if (n == nullptr)
+				{
+					break;
+				}
+
+				n->started = true;
+
+				if (n->concurrent)
+				{
+					n->next_queued = st.queue;
+					st.queue       = n;
+					st.running++;
+					st.cond_var.SignalAll();
+				} else
+				{
+					main_n = n;
+				}
+			}
+
+			if (main_n != nullptr)
+			{
+				st.mutex.Unlock();
+				main_n->s->Init(parent);
+				st.mutex.Lock();
+
+				Finished(&st, main_n);
+				continue;
+			}
+
+			if (st.running == 0)
+			{
+				break;
+			}
+
+			st.cond_var.Wait(&st.mutex);
+		}
+
+		st.done = true;
+		st.cond_var.SignalAll();
+		st.mutex.Unlock();
+
+		for (int i = 0; i < workers_num; i++)
+		{
+			workers[i]->Join();
+			Delete(workers[i]);
+		}
+		DeleteArray(workers);
+
+		return !st.failed;
+	}
+
+	// st->mutex must be locked
+	void Finished(InitState* st, SubsListStruct* n)
+	{
+		if (st->failed)
+		{
+			// Another subsystem failed first, this one is still destroyed in order
+			if (!n->s->m_p->failed)
+			{
+				n->initialized = true;
+				n->prev_init   = last_init;
+				last_init      = n;
+			} else
+			{
+				n->started = false;
+			}
+		} else if (!Initialized(n, st->print_msg))
+		{
+			st->failed = true;
+		}
+
+		st->cond_var.SignalAll();
+	}
+
+	// Returns false if the subsystem failed
+	bool Initialized(SubsListStruct* n, bool print_msg)
+	{
+		if (n->s->m_p->failed)
+		{
+			fail_msg   = n->s->m_p->fail_msg;
+			fail_name  = n->name;
+			n->started = false;
+			return false;
+		}
+
+		if (print_msg)
+		{
+			printf("Initialized: %s\n", n->name);
+		}
+
+		n->initialized = true;
+
+		SubsListStruct* last = last_init;
+		last_init            = n;
+		n->prev_init         = last;
+
 		return true;
 	}
 
@@ -155,6 +321,7 @@ public:
 			}
 
 			n->s->Destroy(parent);
+			n->started     = false;
 			n->initialized = false;
 
 			if (print_msg)
@@ -180,6 +347,7 @@ public:
 			}
 
 			n->s->UnexpectedShutdown(parent);
+			n->started     = false;
 			n->initialized = false;
 
 			n = n->prev_init;
@@ -201,6 +369,9 @@ public:
 		DepsListStruct* deps;
 		SubsListStruct* next;
 		SubsListStruct* prev_init;
+		SubsListStruct* next_queued;
+		bool            concurrent;
+		bool            started;
 		bool            initialized;
 	};
 
@@ -232,7 +403,7 @@ public:
 				break;
 			}
 
-			if (!n->initialized)
+			if (!n->started)
 			{
 				DepsListStruct* d = n->deps;
 
@@ -292,12 +463,17 @@ SubsystemsList::~SubsystemsList()
 
 void SubsystemsList::Add(Subsystem* s, std::initializer_list<Subsystem*> deps)
 {
-	m_p->Add(s, deps);
+	m_p->Add(s, deps, false);
+}
+
+void SubsystemsList::AddConcurrent(Subsystem* s, std::initializer_list<Subsystem*> deps)
+{
+	m_p->Add(s, deps, true);
 }
 
-bool SubsystemsList::InitAll(bool print_msg)
+bool SubsystemsList::InitAll(bool print_msg, int workers_num)
 {
-	return m_p->InitAll(print_msg);
+	return m_p->InitAll(print_msg, workers_num);
 }
 
 void SubsystemsList::DestroyAll(bool print_msg)
@@ -2,6 +2,7 @@
 
 #include "Kyty/Core/DbgAssert.h"
 #include "Kyty/Core/Debug.h"
+#include "Kyty/Core/LockProfiler.h"
 #include "Kyty/Core/MagicEnum.h"
 #include "Kyty/Core/SafeDelete.h"
 #include "Kyty/Core/String.h"
@@ -21,9 +22,14 @@
 #define KYTY_SDL_CS
 #endif
 
-//#define KYTY_DEBUG_LOCKS
+// KYTY_DEBUG_LOCKS is a CMake option
 //#define KYTY_DEBUG_LOCKS_TIMED
 
+// Release builds on Linux and MSVC spin on the lock before parking the thread
+#if !(defined(KYTY_DEBUG_LOCKS) || defined(KYTY_DEBUG_LOCKS_TIMED)) && !defined(KYTY_WIN_CS) && !defined(KYTY_SDL_CS)
+#define KYTY_SPIN_CS
+#endif
+
 #ifdef KYTY_SDL_THREADS
 #include "SDL_thread.h"
 #include "SDL_timer.h"
@@ -37,6 +43,10 @@
 #include "SDL_mutex.h"
 #endif
 
+#if defined(KYTY_SPIN_CS) && (defined(__x86_64__) || defined(_M_X64))
+#include <immintrin.h>
+#endif
+
 #if defined(KYTY_WIN_CS) && defined(KYTY_SDL_CS)
 #error "defined(KYTY_WIN_CS) && defined(KYTY_SDL_CS)"
 #endif
@@ -132,7 +142,14 @@ struct MutexPrivate
 	SDL_mutex* sdl;
 #else
 	std::recursive_mutex m_mutex;
+	std::atomic_bool     m_locked = false; // read by the spinning threads
+	uint32_t             m_depth  = 0;     // recursion depth, changed by the owner only
+#endif
 #endif
+#ifdef KYTY_PROFILE_LOCKS
+	LockProfilerStats* stats     = nullptr;
+	uint64_t           hold_from = 0;
+	uint32_t           owned     = 0; // recursion depth, changed by the owner only
 #endif
 };
 
@@ -267,6 +284,79 @@ static thread_id_t      g_main_thread;
 static int              g_main_thread_int;
 static std::atomic<int> g_thread_counter = 0;
 
+#ifdef KYTY_PROFILE_LOCKS
+constexpr uint32_t LOCK_PROFILER_PERIOD = 10;
+
+// The hold time is counted from the outermost lock to the last unlock
+static void lock_profiler_locked(MutexPrivate* m, uint64_t wait_from, bool contended)
+{
+	if (m->owned++ == 0)
+	{
+		m->hold_from = LockProfiler::GetTime();
+		LockProfiler::Locked(m->stats, m->hold_from - wait_from, contended);
+	}
+}
+
+static void lock_profiler_unlocked(MutexPrivate* m)
+{
+	if (--m->owned == 0)
+	{
+		LockProfiler::Unlocked(m->stats, LockProfiler::GetTime() - m->hold_from);
+	}
+}
+
+// Waiting for a condition variable doesn't count as holding the mutex
+static uint32_t lock_profiler_cond_var_release(MutexPrivate* m)
+{
+	uint32_t owned = m->owned;
+	m->owned       = 1;
+	lock_profiler_unlocked(m);
+	return owned;
+}
+
+static void lock_profiler_cond_var_acquire(MutexPrivate* m, uint32_t owned)
+{
+	lock_profiler_locked(m, LockProfiler::GetTime(), false);
+	m->owned = owned;
+}
+#endif
+
+#ifdef KYTY_SPIN_CS
+// A few microseconds. Most critical sections are left sooner than a parked thread would wake up.
+constexpr uint32_t KYTY_CS_SPIN_COUNT = 100;
+
+// A single core host doesn't spin
+static uint32_t mutex_spin_count()
+{
+	static const uint32_t count = (std::thread::hardware_concurrency() > 1 ? KYTY_CS_SPIN_COUNT : 0);
+	return count;
+}
+
+static void cpu_pause()
+{
+#if defined(__x86_64__) || defined(_M_X64)
+	_mm_pause();
+#else
+	std::this_thread::yield();
+#endif
+}
+
+// The condition variable unlocks and relocks the mutex itself
+static uint32_t cond_var_release(MutexPrivate* m)
+{
+	uint32_t depth = m->m_depth;
+	m->m_depth     = 0;
+	m->m_locked.store(false, std::memory_order_relaxed);
+	return depth;
+}
+
+static void cond_var_acquire(MutexPrivate* m, uint32_t depth)
+{
+	m->m_depth = depth;
+	m->m_locked.store(true, std::memory_order_relaxed);
+}
+#endif
+
 KYTY_SUBSYSTEM_INIT(Threads)
 {
 #ifdef KYTY_SDL_THREADS
@@ -275,7 +365,12 @@ KYTY_SUBSYSTEM_INIT(Threads)
 	g_main_thread = std::this_thread::get_id();
 #endif
 	g_main_thread_int = Thread::GetThreadIdUnique();
-	g_wait_for_graph  = new WaitForGraph;
+#ifdef KYTY_DEBUG_LOCKS
+	g_wait_for_graph = new WaitForGraph;
+#endif
+#ifdef KYTY_PROFILE_LOCKS
+	LockProfiler::Init(LOCK_PROFILER_PERIOD);
+#endif
 }
 
 KYTY_SUBSYSTEM_UNEXPECTED_SHUTDOWN(Threads) {}
@@ -621,7 +716,14 @@ String Thread::GetThreadId()
 #endif
 }
 
-Mutex::Mutex(): m_mutex(new MutexPrivate) {}
+Mutex::Mutex(): Mutex(nullptr) {}
+
+Mutex::Mutex([[maybe_unused]] const char* name): m_mutex(new MutexPrivate)
+{
+#ifdef KYTY_PROFILE_LOCKS
+	m_mutex->stats = LockProfiler::GetStats(name != nullptr ? name : "Core::Mutex");
+#endif
+}
 
 Mutex::~Mutex()
 {
@@ -636,6 +738,13 @@ Mutex::~Mutex()
 
 void Mutex::Lock()
 {
+#ifdef KYTY_PROFILE_LOCKS
+	if (TryLock())
+	{
+		return;
+	}
+	uint64_t wait_from = LockProfiler::GetTime();
+#endif
 #ifdef KYTY_DEBUG_LOCKS
 	if (g_wait_for_graph != nullptr)
 	{
@@ -677,14 +786,36 @@ void Mutex::Lock()
 #elif defined(KYTY_SDL_CS)
 	SDL_LockMutex(m_mutex->sdl);
 #else
-	m_mutex->m_mutex.lock();
+	if (!m_mutex->m_mutex.try_lock())
+	{
+		bool locked = false;
+		for (uint32_t i = mutex_spin_count(); i > 0 && !locked; i--)
+		{
+			cpu_pause();
+			locked = (!m_mutex->m_locked.load(std::memory_order_relaxed) && m_mutex->m_mutex.try_lock());
+		}
+		if (!locked)
+		{
+			m_mutex->m_mutex.lock();
+		}
+	}
+	if (m_mutex->m_depth++ == 0)
+	{
+		m_mutex->m_locked.store(true, std::memory_order_relaxed);
+	}
+#endif
 #endif
 #endif
+#ifdef KYTY_PROFILE_LOCKS
+	lock_profiler_locked(m_mutex, wait_from, true);
 #endif
 }
 
 void Mutex::Unlock()
 {
+#ifdef KYTY_PROFILE_LOCKS
+	lock_profiler_unlocked(m_mutex);
+#endif
 #ifdef KYTY_DEBUG_LOCKS
 	if (g_wait_for_graph != nullptr)
 	{
@@ -697,34 +828,64 @@ void Mutex::Unlock()
 #elif !defined(KYTY_DEBUG_LOCKS_TIMED) && defined(KYTY_SDL_CS)
 	SDL_UnlockMutex(m_mutex->sdl);
 #else
+#ifdef KYTY_SPIN_CS
+	if (--m_mutex->m_depth == 0)
+	{
+		m_mutex->m_locked.store(false, std::memory_order_relaxed);
+	}
+#endif
 	m_mutex->m_mutex.unlock();
 #endif
 #endif
 }
 
-bool Mutex::TryLock()
+static bool mutex_try_lock(MutexPrivate* m)
 {
 #ifdef KYTY_DEBUG_LOCKS
-	if (m_mutex->m_mutex.try_lock())
+	if (m->m_mutex.try_lock())
 	{
 		if (g_wait_for_graph != nullptr)
 		{
-			g_wait_for_graph.load()->Insert(Thread::GetThreadIdUnique(), m_mutex, WaitForGraph::Link::Own);
+			g_wait_for_graph.load()->Insert(Thread::GetThreadIdUnique(), m, WaitForGraph::Link::Own);
 		}
 		return true;
 	}
 	return false;
 #else
 #if !defined(KYTY_DEBUG_LOCKS_TIMED) && defined(KYTY_WIN_CS)
-	return (TryEnterCriticalSection(&m_mutex->m_cs) != 0);
+	return (TryEnterCriticalSection(&m->m_cs) != 0);
 #elif !defined(KYTY_DEBUG_LOCKS_TIMED) && defined(KYTY_SDL_CS)
-	return (SDL_TryLockMutex(m_mutex->sdl) == 0);
+	return (SDL_TryLockMutex(m->sdl) == 0);
+#elif defined(KYTY_SPIN_CS)
+	if (!m->m_mutex.try_lock())
+	{
+		return false;
+	}
+	if (m->m_depth++ == 0)
+	{
+		m->m_locked.store(true, std::memory_order_relaxed);
+	}
+	return true;
 #else
-	return m_mutex->m_mutex.try_lock();
+	return m->m_mutex.try_lock();
 #endif
 #endif
 }
 
+bool Mutex::TryLock()
+{
+#ifdef KYTY_PROFILE_LOCKS
+	if (!mutex_try_lock(m_mutex))
+	{
+		return false;
+	}
+	lock_profiler_locked(m_mutex, LockProfiler::GetTime(), false);
+	return true;
+#else
+	return mutex_try_lock(m_mutex);
+#endif
+}
+
 CondVar::CondVar(): m_cond_var(new CondVarPrivate) {}
 
 CondVar::~CondVar()
@@ -734,6 +895,9 @@ CondVar::~CondVar()
 
 void CondVar::Wait(Mutex* mutex)
 {
+#ifdef KYTY_PROFILE_LOCKS
+	uint32_t owned = lock_profiler_cond_var_release(mutex->m_mutex);
+#endif
 #if defined(KYTY_DEBUG_LOCKS) || defined(KYTY_DEBUG_LOCKS_TIMED)
 	std::unique_lock<std::recursive_timed_mutex> cpp_lock(mutex->m_mutex->m_mutex, std::adopt_lock_t());
 #else
@@ -761,6 +925,10 @@ void CondVar::Wait(Mutex* mutex)
 	func(&m_cond_var->m_cv, &mutex->m_mutex->m_cs, INFINITE);
 #elif !defined(KYTY_DEBUG_LOCKS_TIMED) && defined(KYTY_SDL_CS)
 	SDL_CondWait(m_cond_var->sdl, mutex->m_mutex->sdl);
+#elif defined(KYTY_SPIN_CS)
+	uint32_t depth = cond_var_release(mutex->m_mutex);
+	m_cond_var->m_cv.wait(cpp_lock);
+	cond_var_acquire(mutex->m_mutex, depth);
 #else
 	m_cond_var->m_cv.wait(cpp_lock);
 #endif
@@ -769,11 +937,17 @@ void CondVar::Wait(Mutex* mutex)
 #else
 	cpp_lock.release();
 #endif
+#ifdef KYTY_PROFILE_LOCKS
+	lock_profiler_cond_var_acquire(mutex->m_mutex, owned);
+#endif
 }
 
 bool CondVar::WaitFor(Mutex* mutex, uint32_t micros)
 {
 	bool ok = false;
+#ifdef KYTY_PROFILE_LOCKS
+	uint32_t owned = lock_profiler_cond_var_release(mutex->m_mutex);
+#endif
 #if defined(KYTY_DEBUG_LOCKS) || defined(KYTY_DEBUG_LOCKS_TIMED)
 	std::unique_lock<std::recursive_timed_mutex> cpp_lock(mutex->m_mutex->m_mutex, std::adopt_lock_t());
 #else
@@ -788,9 +962,17 @@ bool CondVar::WaitFor(Mutex* mutex, uint32_t micros)
 	ok = !(func(&m_cond_var->m_cv, &mutex->m_mutex->m_cs, (micros < 1000 ? 1 : micros / 1000)) == 0 && GetLastError() == ERROR_TIMEOUT);
 #elif !(defined(KYTY_DEBUG_LOCKS) || defined(KYTY_DEBUG_LOCKS_TIMED)) && defined(KYTY_SDL_CS)
 	ok = !(SDL_CondWaitTimeout(m_cond_var->sdl, mutex->m_mutex->sdl, (micros < 1000 ? 1 : micros / 1000)) == SDL_MUTEX_TIMEDOUT);
+#elif defined(KYTY_SPIN_CS)
+	uint32_t depth = cond_var_release(mutex->m_mutex);
+	ok             = (m_cond_var->m_cv.wait_for(cpp_lock, std::chrono::microseconds(micros)) == std::cv_status::no_timeout);
+	cond_var_acquire(mutex->m_mutex, depth);
+	cpp_lock.release();
 #else
 	ok = (m_cond_var->m_cv.wait_for(cpp_lock, std::chrono::microseconds(micros)) == std::cv_status::no_timeout);
 	cpp_lock.release();
+#endif
+#ifdef KYTY_PROFILE_LOCKS
+	lock_profiler_cond_var_acquire(mutex->m_mutex, owned);
 #endif
 	return ok;
 }
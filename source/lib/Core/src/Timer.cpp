@@ -3,8 +3,17 @@
 #include "Kyty/Core/DbgAssert.h"
 #include "Kyty/Sys/SysTimer.h"
 
+#include <immintrin.h>
+
 namespace Kyty::Core {
 
+// How early the OS timer is asked to wake the thread, covers its usual latency
+#if KYTY_PLATFORM == KYTY_PLATFORM_WINDOWS
+constexpr uint64_t SLEEP_SPIN_NS = 500000;
+#else
+constexpr uint64_t SLEEP_SPIN_NS = 100000;
+#endif
+
 Timer::Timer() noexcept
 {
 	sys_query_performance_frequency(&m_Frequency);
@@ -103,4 +112,39 @@ uint64_t Timer::QueryPerformanceCounter()
 	return ret;
 }
 
+void Timer::SleepUntil(uint64_t counter)
+{
+	uint64_t freq = 0;
+	uint64_t now  = 0;
+	sys_query_performance_frequency(&freq);
+	sys_query_performance_counter(&now);
+
+	uint64_t spin = SLEEP_SPIN_NS * freq / 1000000000;
+
+	if (now + spin < counter)
+	{
+		sys_sleep_until(counter - spin);
+		sys_query_performance_counter(&now);
+	}
+
+	while (now < counter)
+	{
+		_mm_pause();
+		sys_query_performance_counter(&now);
+	}
+}
+
+void Timer::SleepPrecise(uint64_t nanos)
+{
+	uint64_t freq = 0;
+	uint64_t now  = 0;
+	sys_query_performance_frequency(&freq);
+	sys_query_performance_counter(&now);
+
+	// Split to avoid overflow of nanos * freq
+	uint64_t ticks = (nanos / 1000000000) * freq + (nanos % 1000000000) * freq / 1000000000;
+
+	SleepUntil(now + ticks);
+}
+
 } // namespace Kyty::Core
@@ -2,6 +2,9 @@
 
 #include "Kyty/Sys/SysVirtual.h"
 
+#include <algorithm>
+#include <vector>
+
 #if KYTY_PLATFORM == KYTY_PLATFORM_WINDOWS
 #define KYTY_HAS_EXCEPTIONS
 #endif
@@ -299,6 +302,31 @@ bool AllocFixed(uint64_t address, uint64_t size, Mode mode)
 	return sys_virtual_alloc_fixed(address, size, mode);
 }
 
+uint64_t AllocAlignedLarge(uint64_t address, uint64_t size, Mode mode, uint64_t alignment)
+{
+	return sys_virtual_alloc_aligned_large(address, size, mode, alignment);
+}
+
+bool AllocFixedLarge(uint64_t address, uint64_t size, Mode mode)
+{
+	return sys_virtual_alloc_fixed_large(address, size, mode);
+}
+
+uint64_t AllocLazy(uint64_t address, uint64_t size, Mode mode)
+{
+	return sys_virtual_alloc_lazy(address, size, mode);
+}
+
+uint64_t LargePageSize()
+{
+	return sys_virtual_large_page_size();
+}
+
+bool LargePagesProtectable()
+{
+	return sys_virtual_large_pages_protectable();
+}
+
 bool Free(uint64_t address)
 {
 	return sys_virtual_free(address);
@@ -319,6 +347,149 @@ bool PatchReplace(uint64_t vaddr, uint64_t value)
 	return sys_virtual_patch_replace(vaddr, value);
 }
 
+constexpr uint64_t PATCH_PAGE_MASK = 0xfffu;
+
+struct PatchBatchRun
+{
+	uint64_t vaddr;
+	uint64_t size;
+	Mode     mode;
+};
+
+class PatchBatchPrivate
+{
+public:
+	std::vector<uint64_t>      pages;
+	std::vector<PatchBatchRun> runs;
+	bool                       begun = false;
+};
+
+PatchBatch::PatchBatch(): m_p(new PatchBatchPrivate) {}
+
+PatchBatch::~PatchBatch()
+{
+	End();
+	delete m_p;
+}
+
+void PatchBatch::Add(uint64_t address, uint64_t size)
+{
+	EXIT_IF(m_p->begun);
+	EXIT_IF(size == 0);
+
+	for (uint64_t page = address & ~PATCH_PAGE_MASK; page < address + size; page += PATCH_PAGE_MASK + 1)
+	{
+		if (m_p->pages.empty() || m_p->pages.back() != page)
+		{
+			m_p->pages.push_back(page);
+		}
+	}
+}
+
+void PatchBatch::Begin()
+{
+	EXIT_IF(m_p->begun);
+
+	m_p->begun = true;
+
+	auto& pages = m_p->pages;
+
+	std::sort(pages.begin(), pages.end());
+	pages.erase(std::unique(pages.begin(), pages.end()), pages.end());
+
+	for (size_t i = 0; i < pages.size();)
+	{
+		size_t end = i + 1;
+		while (end < pages.size() && pages[end] == pages[end - 1] + PATCH_PAGE_MASK + 1)
+		{
+			end++;
+		}
+
+		uint64_t vaddr     = pages[i];
+		uint64_t end_vaddr = pages[end - 1] + PATCH_PAGE_MASK + 1;
+
+		while (vaddr < end_vaddr)
+		{
+			uint64_t run_size = 0;
+			Mode     mode     = sys_virtual_query(vaddr, end_vaddr - vaddr, &run_size);
+
+			EXIT_IF(run_size == 0);
+
+			if (mode != Mode::ReadWrite)
+			{
+				sys_virtual_protect(vaddr, run_size, Mode::ReadWrite);
+			}
+
+			m_p->runs.push_back({vaddr, run_size, mode});
+
+			vaddr += run_size;
+		}
+
+		i = end;
+	}
+
+	pages.clear();
+}
+
+void PatchBatch::End()
+{
+	if (!m_p->begun)
+	{
+		return;
+	}
+
+	uint64_t flush_start = UINT64_MAX;
+	uint64_t flush_end   = 0;
+
+	for (const auto& r: m_p->runs)
+	{
+		if (r.mode != Mode::ReadWrite)
+		{
+			sys_virtual_protect(r.vaddr, r.size, r.mode);
+		}
+
+		if (IsExecute(r.mode))
+		{
+			flush_start = (r.vaddr < flush_start ? r.vaddr : flush_start);
+			flush_end   = (r.vaddr + r.size > flush_end ? r.vaddr + r.size : flush_end);
+		}
+	}
+
+	if (flush_start < flush_end)
+	{
+		sys_virtual_flush_instruction_cache(flush_start, flush_end - flush_start);
+	}
+
+	m_p->runs.clear();
+	m_p->begun = false;
+}
+
+bool PatchBatch::Replace(uint64_t vaddr, uint64_t value)
+{
+	auto* ptr = reinterpret_cast<uint64_t*>(vaddr);
+
+	bool ret = (*ptr != value);
+
+	*ptr = value;
+
+	return ret;
+}
+
+uint32_t PatchBatch::GetRunsNum() const
+{
+	return static_cast<uint32_t>(m_p->runs.size());
+}
+
+bool ThreadSlotAlloc(uint8_t* segment_prefix, uint32_t* offset)
+{
+	return sys_virtual_thread_slot_alloc(segment_prefix, offset);
+}
+
+bool ThreadSlotSet(uint64_t value)
+{
+	return sys_virtual_thread_slot_set(value);
+}
+
 } // namespace VirtualMemory
 
 } // namespace Kyty::Core
@@ -5,8 +5,234 @@ extern "C" {
 #include "rijndael-alg-fst.h"
 }
 
+#if KYTY_COMPILER == KYTY_COMPILER_MSVC
+#include <intrin.h>
+#define KYTY_AES_NI
+#else
+#include <cpuid.h>
+#include <wmmintrin.h>
+#define KYTY_AES_NI __attribute__((target("aes,sse2")))
+#endif
+
 namespace Kyty::Math {
 
+// With AES-NI the blocks are processed by the CPU, otherwise by the table-based reference code
+struct AesContext
+{
+	bool     ni = false;
+	int      nr = 0;
+	uint32_t rk[4 * (MAXNR + 1)];
+	__m128i  ni_rk[15];
+};
+
+static bool aes_ni_supported()
+{
+	static const bool supported = []()
+	{
+		uint32_t regs[4] = {};
+#if KYTY_COMPILER == KYTY_COMPILER_MSVC
+		int info[4] = {};
+		__cpuid(info, 1);
+		regs[2] = static_cast<uint32_t>(info[2]);
+#else
+		if (__get_cpuid(1, &regs[0], &regs[1], &regs[2], &regs[3]) == 0)
+		{
+			return false;
+		}
+#endif
+		return (regs[2] & (1u << 25u)) != 0;
+	}();
+	return supported;
+}
+
+KYTY_AES_NI static __m128i aes_ni_key_expand(__m128i k, __m128i assist)
+{
+	k = _mm_xor_si128(k, _mm_slli_si128(k, 4));
+	k = _mm_xor_si128(k, _mm_slli_si128(k, 4));
+	k = _mm_xor_si128(k, _mm_slli_si128(k, 4));
+	return _mm_xor_si128(k, assist);
+}
+
+template <int RCON>
+KYTY_AES_NI static void aes_ni_key_step(__m128i* rk, int i)
+{
+	rk[i] = aes_ni_key_expand(rk[i - 2], _mm_shuffle_epi32(_mm_aeskeygenassist_si128(rk[i - 1], RCON), 0xff));
+	if (i < 14)
+	{
+		rk[i + 1] = aes_ni_key_expand(rk[i - 1], _mm_shuffle_epi32(_mm_aeskeygenassist_si128(rk[i], 0x00), 0xaa));
+	}
+}
+
+KYTY_AES_NI static void aes_ni_key_setup(__m128i* rk, const uint8_t* key, bool decrypt)
+{
+	rk[0] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(key));
+	rk[1] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(key + 16));
+
+	aes_ni_key_step<0x01>(rk, 2);
+	aes_ni_key_step<0x02>(rk, 4);
+	aes_ni_key_step<0x04>(rk, 6);
+	aes_ni_key_step<0x08>(rk, 8);
+	aes_ni_key_step<0x10>(rk, 10);
+	aes_ni_key_step<0x20>(rk, 12);
+	aes_ni_key_step<0x40>(rk, 14);
+
+	if (decrypt)
+	{
+		// Equivalent inverse cipher: reversed order, InvMixColumns applied to the middle keys
+		__m128i ek[15];
+		std::memcpy(ek, rk, sizeof(ek));
+		rk[0]  = ek[14];
+		rk[14] = ek[0];
+		for (int i = 1; i < 14; i++)
+		{
+			rk[i] = _mm_aesimc_si128(ek[14 - i]);
+		}
+	}
+}
+
+KYTY_AES_NI static void aes_ni_cbc_encrypt(const __m128i* rk, const uint8_t* in, uint8_t* out, uint32_t blocks, uint8_t* iv)
+{
+	__m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(iv));
+
+	for (uint32_t b = 0; b < blocks; b++)
+	{
+		x = _mm_xor_si128(x, _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + b * 16)));
+		x = _mm_xor_si128(x, rk[0]);
+		for (int r = 1; r < 14; r++)
+		{
+			x = _mm_aesenc_si128(x, rk[r]);
+		}
+		x = _mm_aesenclast_si128(x, rk[14]);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(out + b * 16), x);
+	}
+
+	_mm_storeu_si128(reinterpret_cast<__m128i*>(iv), x);
+}
+
+// Unlike encryption, the blocks of CBC decryption are independent, 4 of them are kept in flight
+KYTY_AES_NI static void aes_ni_cbc_decrypt(const __m128i* rk, const uint8_t* in, uint8_t* out, uint32_t blocks, uint8_t* iv)
+{
+	__m128i prev = _mm_loadu_si128(reinterpret_cast<const __m128i*>(iv));
+
+	uint32_t b = 0;
+	for (; b + 4 <= blocks; b += 4)
+	{
+		const auto* src = reinterpret_cast<const __m128i*>(in + b * 16);
+
+		__m128i c0 = _mm_loadu_si128(src + 0);
+		__m128i c1 = _mm_loadu_si128(src + 1);
+		__m128i c2 = _mm_loadu_si128(src + 2);
+		__m128i c3 = _mm_loadu_si128(src + 3);
+		__m128i x0 = _mm_xor_si128(c0, rk[0]);
+		__m128i x1 = _mm_xor_si128(c1, rk[0]);
+		__m128i x2 = _mm_xor_si128(c2, rk[0]);
+		__m128i x3 = _mm_xor_si128(c3, rk[0]);
+		for (int r = 1; r < 14; r++)
+		{
+			x0 = _mm_aesdec_si128(x0, rk[r]);
+			x1 = _mm_aesdec_si128(x1, rk[r]);
+			x2 = _mm_aesdec_si128(x2, rk[r]);
+			x3 = _mm_aesdec_si128(x3, rk[r]);
+		}
+		x0 = _mm_xor_si128(_mm_aesdeclast_si128(x0, rk[14]), prev);
+		x1 = _mm_xor_si128(_mm_aesdeclast_si128(x1, rk[14]), c0);
+		x2 = _mm_xor_si128(_mm_aesdeclast_si128(x2, rk[14]), c1);
+		x3 = _mm_xor_si128(_mm_aesdeclast_si128(x3, rk[14]), c2);
+
+		auto* dst = reinterpret_cast<__m128i*>(out + b * 16);
+		_mm_storeu_si128(dst + 0, x0);
+		_mm_storeu_si128(dst + 1, x1);
+		_mm_storeu_si128(dst + 2, x2);
+		_mm_storeu_si128(dst + 3, x3);
+
+		prev = c3;
+	}
+
+	for (; b < blocks; b++)
+	{
+		__m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + b * 16));
+		__m128i x = _mm_xor_si128(c, rk[0]);
+		for (int r = 1; r < 14; r++)
+		{
+			x = _mm_aesdec_si128(x, rk[r]);
+		}
+		x = _mm_xor_si128(_mm_aesdeclast_si128(x, rk[14]), prev);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(out + b * 16), x);
+
+		prev = c;
+	}
+
+	_mm_storeu_si128(reinterpret_cast<__m128i*>(iv), prev);
+}
+
+static void aes_setup(AesContext* ctx, const uint8_t* key, bool decrypt)
+{
+	ctx->ni = CryptoIsCpuExtensionsEnabled() && aes_ni_supported();
+
+	if (ctx->ni)
+	{
+		aes_ni_key_setup(ctx->ni_rk, key, decrypt);
+		ctx->nr = 14;
+	} else
+	{
+		ctx->nr = (decrypt ? rijndaelKeySetupDec(ctx->rk, key, 256) : rijndaelKeySetupEnc(ctx->rk, key, 256));
+	}
+
+	EXIT_IF(ctx->nr != 14);
+}
+
+static void aes_cbc_encrypt(const AesContext& ctx, const uint8_t* in, uint8_t* out, uint32_t blocks, uint8_t* iv)
+{
+	if (ctx.ni)
+	{
+		aes_ni_cbc_encrypt(ctx.ni_rk, in, out, blocks, iv);
+		return;
+	}
+
+	uint8_t tmp_buf[16];
+
+	for (uint32_t b = 0; b < blocks; b++)
+	{
+		for (int n = 0; n < 16; n++)
+		{
+			tmp_buf[n] = in[n] ^ iv[n];
+		}
+
+		rijndaelEncrypt(ctx.rk, ctx.nr, tmp_buf, out);
+
+		std::memcpy(iv, out, 16);
+
+		in += 16;
+		out += 16;
+	}
+}
+
+static void aes_cbc_decrypt(const AesContext& ctx, const uint8_t* in, uint8_t* out, uint32_t blocks, uint8_t* iv)
+{
+	if (ctx.ni)
+	{
+		aes_ni_cbc_decrypt(ctx.ni_rk, in, out, blocks, iv);
+		return;
+	}
+
+	uint8_t tmp_buf[16];
+
+	for (uint32_t b = 0; b < blocks; b++)
+	{
+		rijndaelDecrypt(ctx.rk, ctx.nr, in, tmp_buf);
+
+		for (int n = 0; n < 16; n++)
+		{
+			out[n] = tmp_buf[n] ^ iv[n];
+		}
+
+		std::memcpy(iv, in, 16);
+
+		in += 16;
+		out += 16;
+	}
+}
+
 Core::ByteBuffer AES::Encrypt(const uint8_t* buf, uint32_t length, const uint8_t* key, const uint8_t* iv, Mode mode)
 {
 	Core::ByteBuffer out;
@@ -15,9 +241,9 @@ Core::ByteBuffer AES::Encrypt(const uint8_t* buf, uint32_t length, const uint8_t
 	EXIT_IF(length == 0);
 	EXIT_IF(mode != Mode::Cbc256Pkcs7Padding && mode != Mode::Cbc256ZeroPadding);
 
-	uint32_t rk[4 * (MAXNR + 1)];
-	uint8_t  tmp_buf[16];
-	uint8_t  tmp_iv[16];
+	AesContext ctx;
+	uint8_t    tmp_buf[16];
+	uint8_t    tmp_iv[16];
 
 	if (iv != nullptr)
 	{
@@ -29,9 +255,7 @@ Core::ByteBuffer AES::Encrypt(const uint8_t* buf, uint32_t length, const uint8_t
 
 	if (mode == Mode::Cbc256Pkcs7Padding || mode == Mode::Cbc256ZeroPadding)
 	{
-		int nr = rijndaelKeySetupEnc(rk, key, 256);
-
-		EXIT_IF(nr != 14);
+		aes_setup(&ctx, key, false);
 
 		uint32_t padding = 16 - (length % 16);
 
@@ -44,46 +268,29 @@ Core::ByteBuffer AES::Encrypt(const uint8_t* buf, uint32_t length, const uint8_t
 
 		auto* out_ptr = reinterpret_cast<uint8_t*>(o.GetData());
 
-		while (length >= 16)
-		{
-			for (int n = 0; n < 16; n++)
-			{
-				tmp_buf[n] = buf[n] ^ tmp_iv[n];
-			}
-
-			rijndaelEncrypt(rk, nr, tmp_buf, out_ptr);
+		uint32_t blocks = length / 16;
 
-			std::memcpy(tmp_iv, out_ptr, 16);
+		aes_cbc_encrypt(ctx, buf, out_ptr, blocks, tmp_iv);
 
-			length -= 16;
-			buf += 16;
-			out_ptr += 16;
-		}
+		length -= blocks * 16;
+		buf += blocks * 16;
+		out_ptr += blocks * 16;
 
 		if ((length + padding) != 0u)
 		{
 			EXIT_IF(length + padding != 16);
 
-			for (uint32_t n = 0; n < length; n++)
-			{
-				tmp_buf[n] = buf[n] ^ tmp_iv[n];
-			}
+			std::memcpy(tmp_buf, buf, length);
 
 			if (mode == Mode::Cbc256ZeroPadding)
 			{
-				for (uint32_t n = length; n < 16; n++)
-				{
-					tmp_buf[n] = 0u ^ tmp_iv[n];
-				}
+				std::memset(tmp_buf + length, 0, 16 - length);
 			} else
 			{
-				for (uint32_t n = length; n < 16; n++)
-				{
-					tmp_buf[n] = padding ^ tmp_iv[n];
-				}
+				std::memset(tmp_buf + length, static_cast<int>(padding), 16 - length);
 			}
 
-			rijndaelEncrypt(rk, nr, tmp_buf, out_ptr);
+			aes_cbc_encrypt(ctx, tmp_buf, out_ptr, 1, tmp_iv);
 		}
 
 		out = o;
@@ -107,9 +314,8 @@ Core::ByteBuffer AES::Decrypt(const uint8_t* buf, uint32_t length, const uint8_t
 
 	EXIT_IF((length % 16) != 0);
 
-	uint32_t rk[4 * (MAXNR + 1)];
-	uint8_t  tmp_buf[16];
-	uint8_t  tmp_iv[16];
+	AesContext ctx;
+	uint8_t    tmp_iv[16];
 
 	if (iv != nullptr)
 	{
@@ -121,31 +327,13 @@ Core::ByteBuffer AES::Decrypt(const uint8_t* buf, uint32_t length, const uint8_t
 
 	if (mode == Mode::Cbc256Pkcs7Padding || mode == Mode::Cbc256ZeroPadding)
 	{
-		int nr = rijndaelKeySetupDec(rk, key, 256);
-
-		EXIT_IF(nr != 14);
+		aes_setup(&ctx, key, true);
 
 		Core::ByteBuffer o(length);
 
 		auto* out_ptr = reinterpret_cast<uint8_t*>(o.GetData());
 
-		while (length >= 16)
-		{
-			rijndaelDecrypt(rk, nr, buf, tmp_buf);
-
-			for (int n = 0; n < 16; n++)
-			{
-				out_ptr[n] = tmp_buf[n] ^ tmp_iv[n];
-			}
-
-			std::memcpy(tmp_iv, buf, 16);
-
-			length -= 16;
-			buf += 16;
-			out_ptr += 16;
-		}
-
-		EXIT_IF(length > 0);
+		aes_cbc_decrypt(ctx, buf, out_ptr, length / 16, tmp_iv);
 
 		if (mode == Mode::Cbc256Pkcs7Padding)
 		{
@@ -1,7 +1,31 @@
 #include "Kyty/Math/Crypto.h" // IWYU pragma: associated
 
+#include <atomic>
+
+#if KYTY_COMPILER == KYTY_COMPILER_MSVC
+#include <intrin.h>
+#define KYTY_CRC32_CLMUL
+#else
+#include <cpuid.h>
+#include <smmintrin.h>
+#include <wmmintrin.h>
+#define KYTY_CRC32_CLMUL __attribute__((target("pclmul,sse4.1")))
+#endif
+
 namespace Kyty::Math {
 
+static std::atomic_bool g_crypto_cpu_extensions = true;
+
+void CryptoEnableCpuExtensions(bool enabled)
+{
+	g_crypto_cpu_extensions = enabled;
+}
+
+bool CryptoIsCpuExtensionsEnabled()
+{
+	return g_crypto_cpu_extensions.load(std::memory_order_relaxed);
+}
+
 namespace MD5 {
 
 constexpr uint32_t S11 = 7;
@@ -340,34 +364,169 @@ Core::ByteBuffer Hash(const String& str)
 
 namespace CRC32 {
 
-static uint32_t g_crc_table[256]  = {0};
-static bool     g_crc_initialized = false;
-
-uint32_t Hash(const uint8_t* buf, uint32_t length)
+// Slicing-by-8: table k gives the CRC of a byte followed by k zero bytes, so 8 bytes are handled per step
+struct Tables
 {
-	uint32_t crc = 0;
-
-	if (!g_crc_initialized)
+	Tables()
 	{
-		for (int i = 0; i < 256; i++)
+		for (uint32_t i = 0; i < 256; i++)
 		{
-			crc = i;
+			uint32_t crc = i;
 			for (int j = 0; j < 8; j++)
 			{
 				crc = (crc & 1u) != 0u ? (crc >> 1u) ^ 0xEDB88320u : crc >> 1u;
 			}
-			g_crc_table[i] = crc;
-		};
+			t[0][i] = crc;
+		}
+		for (uint32_t i = 0; i < 256; i++)
+		{
+			for (int k = 1; k < 8; k++)
+			{
+				t[k][i] = t[0][t[k - 1][i] & 0xFFu] ^ (t[k - 1][i] >> 8u);
+			}
+		}
+	}
+
+	uint32_t t[8][256] = {};
+};
+
+static const Tables& get_tables()
+{
+	static const Tables tables;
+	return tables;
+}
+
+static uint32_t crc32_sw(uint32_t crc, const uint8_t* buf, uint64_t length)
+{
+	const auto& t = get_tables().t;
+
+	for (; length >= 8; length -= 8, buf += 8)
+	{
+		uint32_t lo = crc ^ (static_cast<uint32_t>(buf[0]) | (static_cast<uint32_t>(buf[1]) << 8u) |
+		                     (static_cast<uint32_t>(buf[2]) << 16u) | (static_cast<uint32_t>(buf[3]) << 24u));
+
+		crc = t[7][lo & 0xFFu] ^ t[6][(lo >> 8u) & 0xFFu] ^ t[5][(lo >> 16u) & 0xFFu] ^ t[4][lo >> 24u] ^ t[3][buf[4]] ^ t[2][buf[5]] ^
+		      t[1][buf[6]] ^ t[0][buf[7]];
+	}
+
+	for (; length != 0; length--)
+	{
+		crc = t[0][(crc ^ *buf++) & 0xFFu] ^ (crc >> 8u);
+	}
+
+	return crc;
+}
+
+static bool crc32_clmul_supported()
+{
+	static const bool supported = []()
+	{
+		uint32_t regs[4] = {};
+#if KYTY_COMPILER == KYTY_COMPILER_MSVC
+		int info[4] = {};
+		__cpuid(info, 1);
+		regs[2] = static_cast<uint32_t>(info[2]);
+#else
+		if (__get_cpuid(1, &regs[0], &regs[1], &regs[2], &regs[3]) == 0)
+		{
+			return false;
+		}
+#endif
+		// PCLMULQDQ and SSE4.1
+		return (regs[2] & (1u << 1u)) != 0 && (regs[2] & (1u << 19u)) != 0;
+	}();
+	return supported;
+}
+
+KYTY_CRC32_CLMUL static __m128i crc32_clmul_fold(__m128i x, __m128i next, __m128i k)
+{
+	return _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x, k, 0x11), next), _mm_clmulepi64_si128(x, k, 0x00));
+}
+
+// Folding with carry-less multiplication ("Fast CRC Computation for Generic Polynomials Using PCLMULQDQ Instruction", Intel),
+// the constants are for the bit-reflected polynomial 0xEDB88320. length is at least 64 and a multiple of 16.
+KYTY_CRC32_CLMUL static uint32_t crc32_clmul(uint32_t crc, const uint8_t* buf, uint64_t length)
+{
+	const __m128i k1k2 = _mm_set_epi64x(0x01c6e41596, 0x0154442bd4);
+	const __m128i k3k4 = _mm_set_epi64x(0x00ccaa009e, 0x01751997d0);
+	const __m128i k5k0 = _mm_set_epi64x(0x0000000000, 0x0163cd6124);
+	const __m128i poly = _mm_set_epi64x(0x01f7011641, 0x01db710641);
+	const __m128i mask = _mm_setr_epi32(~0, 0, ~0, 0);
 
-		g_crc_initialized = true;
+	const auto* src = reinterpret_cast<const __m128i*>(buf);
+
+	__m128i x1 = _mm_xor_si128(_mm_loadu_si128(src + 0), _mm_cvtsi32_si128(static_cast<int>(crc)));
+	__m128i x2 = _mm_loadu_si128(src + 1);
+	__m128i x3 = _mm_loadu_si128(src + 2);
+	__m128i x4 = _mm_loadu_si128(src + 3);
+
+	src += 4;
+	length -= 64;
+
+	// Four independent 128-bit lanes
+	for (; length >= 64; length -= 64, src += 4)
+	{
+		__m128i x5 = _mm_clmulepi64_si128(x1, k1k2, 0x00);
+		__m128i x6 = _mm_clmulepi64_si128(x2, k1k2, 0x00);
+		__m128i x7 = _mm_clmulepi64_si128(x3, k1k2, 0x00);
+		__m128i x8 = _mm_clmulepi64_si128(x4, k1k2, 0x00);
+
+		x1 = _mm_clmulepi64_si128(x1, k1k2, 0x11);
+		x2 = _mm_clmulepi64_si128(x2, k1k2, 0x11);
+		x3 = _mm_clmulepi64_si128(x3, k1k2, 0x11);
+		x4 = _mm_clmulepi64_si128(x4, k1k2, 0x11);
+
+		x1 = _mm_xor_si128(_mm_xor_si128(x1, x5), _mm_loadu_si128(src + 0));
+		x2 = _mm_xor_si128(_mm_xor_si128(x2, x6), _mm_loadu_si128(src + 1));
+		x3 = _mm_xor_si128(_mm_xor_si128(x3, x7), _mm_loadu_si128(src + 2));
+		x4 = _mm_xor_si128(_mm_xor_si128(x4, x8), _mm_loadu_si128(src + 3));
 	}
 
-	crc = 0xFFFFFFFF;
-	while ((length--) != 0u)
+	// Into one lane, then the rest by 16 bytes
+	x1 = crc32_clmul_fold(x1, x2, k3k4);
+	x1 = crc32_clmul_fold(x1, x3, k3k4);
+	x1 = crc32_clmul_fold(x1, x4, k3k4);
+
+	for (; length >= 16; length -= 16, src++)
 	{
-		crc = g_crc_table[(crc ^ *buf++) & 0xFFu] ^ (crc >> 8u);
+		x1 = crc32_clmul_fold(x1, _mm_loadu_si128(src), k3k4);
 	}
 
+	// 128 to 64 bits
+	x2 = _mm_clmulepi64_si128(x1, k3k4, 0x10);
+	x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), x2);
+
+	x2 = _mm_srli_si128(x1, 4);
+	x1 = _mm_and_si128(x1, mask);
+	x1 = _mm_clmulepi64_si128(x1, k5k0, 0x00);
+	x1 = _mm_xor_si128(x1, x2);
+
+	// Barrett reduction to 32 bits
+	x2 = _mm_and_si128(x1, mask);
+	x2 = _mm_clmulepi64_si128(x2, poly, 0x10);
+	x2 = _mm_and_si128(x2, mask);
+	x2 = _mm_clmulepi64_si128(x2, poly, 0x00);
+	x1 = _mm_xor_si128(x1, x2);
+
+	return static_cast<uint32_t>(_mm_extract_epi32(x1, 1));
+}
+
+uint32_t Hash(const uint8_t* buf, uint32_t length)
+{
+	uint32_t crc = 0xFFFFFFFF;
+
+	if (length >= 64 && CryptoIsCpuExtensionsEnabled() && crc32_clmul_supported())
+	{
+		uint32_t folded = length & ~15u;
+
+		crc = crc32_clmul(crc, buf, folded);
+
+		buf += folded;
+		length -= folded;
+	}
+
+	crc = crc32_sw(crc, buf, length);
+
 	return crc ^ 0xFFFFFFFF;
 }
 
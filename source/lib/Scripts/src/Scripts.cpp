@@ -28,6 +28,8 @@ struct HelpFuncList
 
 static thread_local HelpFuncList* g_help_list = nullptr;
 
+static String* g_bytecode_cache_folder = nullptr;
+
 static const luaL_Reg g_loadedlibs[] = {{"_G", luaopen_base},
                                         {LUA_LOADLIBNAME, luaopen_package},
                                         {LUA_COLIBNAME, luaopen_coroutine},
@@ -181,6 +183,84 @@ ScriptError Run()
 	return ScriptError::Ok;
 }
 
+void SetBytecodeCacheFolder(const String& folder)
+{
+	Core::mem_tracker_disable();
+
+	if (g_bytecode_cache_folder == nullptr)
+	{
+		g_bytecode_cache_folder = new String;
+	}
+
+	*g_bytecode_cache_folder = folder.IsEmpty() ? folder : folder.FixDirectorySlash();
+
+	Core::mem_tracker_enable();
+}
+
+static int bytecode_writer(lua_State* /*l*/, const void* p, size_t sz, void* ud)
+{
+	EXIT_IF(sizeof(size_t) > 4 && (static_cast<uint64_t>(sz) >> 32u) > 0);
+	static_cast<Vector<uint8_t>*>(ud)->Add(static_cast<const uint8_t*>(p), static_cast<uint32_t>(sz));
+	return 0;
+}
+
+// Loads the chunk compiled by an earlier run, or compiles the source and saves the chunk
+static ScriptError load_cached(const String& source)
+{
+	if (g_bytecode_cache_folder == nullptr || g_bytecode_cache_folder->IsEmpty())
+	{
+		return LoadString(source);
+	}
+
+	auto utf8 = source.utf8_str();
+
+	uint64_t hash = 14695981039346656037ull;
+	for (uint32_t i = 0; i + 1 < utf8.Size(); i++)
+	{
+		hash ^= static_cast<uint8_t>(utf8.At(i));
+		hash *= 1099511628211ull;
+	}
+
+	String cache_name = *g_bytecode_cache_folder + String::FromPrintf("%016" PRIx64 "_%d.luac", hash, KYTY_BITNESS);
+
+	File cache(cache_name, File::Mode::Read);
+	if (!cache.IsInvalid())
+	{
+		auto buf = cache.ReadWholeBuffer();
+		cache.Close();
+
+		// Mode "b" accepts only binary chunks. A damaged file or one from another Lua version is rejected by the loader.
+		if (luaL_loadbufferx(g_lua_state, reinterpret_cast<const char*>(buf.GetDataConst()), buf.Size(), cache_name.C_Str(), "b") == LUA_OK)
+		{
+			return ScriptError::Ok;
+		}
+		lua_pop(g_lua_state, 1);
+	}
+
+	ScriptError status = LoadString(source);
+
+	if (status == ScriptError::Ok)
+	{
+		Vector<uint8_t> dump;
+#if KYTY_LUA_VER == KYTY_LUA_5_3
+		lua_dump(g_lua_state, bytecode_writer, &dump, 0);
+#else
+		lua_dump(g_lua_state, bytecode_writer, &dump);
+#endif
+		File::CreateDirectories(*g_bytecode_cache_folder);
+
+		File out;
+		out.Create(cache_name);
+		if (!out.IsInvalid())
+		{
+			out.Write(dump.GetDataConst(), dump.Size());
+			out.Close();
+		}
+	}
+
+	return status;
+}
+
 ScriptError RunFile(const String& file_name)
 {
 	lua_init();
@@ -197,9 +277,7 @@ ScriptError RunFile(const String& file_name)
 	String str = f.ReadWholeString();
 	f.Close();
 
-	// TODO(#117): load and run binary files
-
-	ScriptError status = LoadString(str);
+	ScriptError status = load_cached(str);
 
 	if (status != ScriptError::Ok)
 	{
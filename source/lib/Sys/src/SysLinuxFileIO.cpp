@@ -12,7 +12,11 @@
 
 #include "SDL_system.h"
 
+#include <algorithm>
 #include <cerrno>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <unistd.h>
 #include <utime.h>
@@ -277,6 +281,33 @@ sys_file_t* sys_file_open_rw(const String& file_name, sys_file_cache_type_t /*ca
 	return ret;
 }
 
+// A missing file is created, an existing one isn't truncated
+sys_file_t* sys_file_open_or_create(const String& file_name)
+{
+	auto* ret = new sys_file_t;
+
+	String real_name = get_internal_name(file_name);
+
+	int   fd = open(real_name.utf8_str().GetData(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+	FILE* f  = (fd >= 0 ? fdopen(fd, "r+") : nullptr);
+
+	if (f == nullptr)
+	{
+		if (fd >= 0)
+		{
+			close(fd);
+		}
+		ret->type = SYS_FILE_ERROR;
+	} else
+	{
+		ret->type = SYS_FILE_FILE;
+	}
+
+	ret->f = f;
+
+	return ret;
+}
+
 void sys_file_close(sys_file_t* f)
 {
 	[[maybe_unused]] int result = 0;
@@ -303,10 +334,10 @@ uint64_t sys_file_size(sys_file_t& f)
 
 	if (f.type == SYS_FILE_FILE)
 	{
-		uint32_t pos  = ftell(f.f);
-		result        = fseek(f.f, 0, SEEK_END);
-		uint32_t size = ftell(f.f);
-		result        = fseek(f.f, pos, SEEK_SET);
+		off_t pos  = ftello(f.f);
+		result     = fseeko(f.f, 0, SEEK_END);
+		off_t size = ftello(f.f);
+		result     = fseeko(f.f, pos, SEEK_SET);
 		return size;
 	}
 
@@ -336,7 +367,7 @@ bool sys_file_seek(sys_file_t& f, uint64_t offset)
 	bool ok = true;
 	if (f.type == SYS_FILE_FILE)
 	{
-		ok = (fseek(f.f, static_cast<int64_t>(offset), SEEK_SET) == 0);
+		ok = (fseeko(f.f, static_cast<off_t>(offset), SEEK_SET) == 0);
 		//		LARGE_INTEGER s;
 		//		s.QuadPart = offset;
 		//		SetFilePointerEx(f.handle, s, 0, FILE_BEGIN);
@@ -352,7 +383,7 @@ uint64_t sys_file_tell(sys_file_t& f)
 {
 	if (f.type == SYS_FILE_FILE)
 	{
-		return ftell(f.f);
+		return ftello(f.f);
 	}
 
 	if (f.type == SYS_FILE_MEMORY_STAT || f.type == SYS_FILE_MEMORY_DYN)
@@ -450,6 +481,33 @@ bool sys_file_flush(sys_file_t& f)
 	return false;
 }
 
+// Exclusive advisory lock between processes, waits until the lock is taken
+bool sys_file_lock(sys_file_t& f)
+{
+	if (f.type != SYS_FILE_FILE || f.f == nullptr)
+	{
+		return false;
+	}
+
+	int fd     = fileno(f.f);
+	int result = 0;
+
+	do
+	{
+		result = flock(fd, LOCK_EX);
+	} while (result != 0 && errno == EINTR);
+
+	return (result == 0);
+}
+
+void sys_file_unlock(sys_file_t& f)
+{
+	if (f.type == SYS_FILE_FILE && f.f != nullptr)
+	{
+		flock(fileno(f.f), LOCK_UN);
+	}
+}
+
 SysFileTimeStruct sys_file_get_last_access_time_utc(const String& name)
 {
 	SysFileTimeStruct r {};
@@ -656,10 +714,12 @@ bool sys_file_copy_file(const String& /*src*/, const String& /*dst*/)
 	return false;
 }
 
-bool sys_file_move_file(const String& /*src*/, const String& /*dst*/)
+bool sys_file_move_file(const String& src, const String& dst)
 {
-	EXIT("not implemented\n");
-	return false;
+	String real_src = get_internal_name(src);
+	String real_dst = get_internal_name(dst);
+
+	return 0 == rename(real_src.utf8_str().GetData(), real_dst.utf8_str().GetData());
 }
 
 void sys_file_remove_readonly(const String& /*name*/)
@@ -667,6 +727,148 @@ void sys_file_remove_readonly(const String& /*name*/)
 	EXIT("not implemented\n");
 }
 
+void* sys_file_map_r(sys_file_t& f, uint64_t* size)
+{
+	uint64_t map_size = 0;
+
+	void* data = sys_file_map(f, 0, &map_size, SYS_FILE_MAP_READ_ONLY);
+
+	if (data != nullptr)
+	{
+		*size = map_size;
+	}
+
+	return data;
+}
+
+// Maps *size bytes from offset, up to the end of the file if *size is 0. The offset is a multiple of sys_file_map_alignment().
+void* sys_file_map(sys_file_t& f, uint64_t offset, uint64_t* size, sys_file_map_mode_t mode)
+{
+	if (f.type != SYS_FILE_FILE || f.f == nullptr || (offset % sys_file_map_alignment()) != 0)
+	{
+		return nullptr;
+	}
+
+	int fd = fileno(f.f);
+
+	struct stat s {};
+	if (fstat(fd, &s) != 0 || s.st_size <= 0 || offset >= static_cast<uint64_t>(s.st_size))
+	{
+		return nullptr;
+	}
+
+	uint64_t file_size = s.st_size;
+	uint64_t map_size  = (*size == 0 ? file_size - offset : *size);
+
+	// Pages past the end of the file raise SIGBUS
+	if (map_size > file_size - offset)
+	{
+		return nullptr;
+	}
+
+	int prot = (mode == SYS_FILE_MAP_COPY_ON_WRITE ? PROT_READ | PROT_WRITE : PROT_READ);
+
+	void* data = mmap(nullptr, map_size, prot, MAP_PRIVATE, fd, static_cast<off_t>(offset));
+
+	if (data == MAP_FAILED)
+	{
+		return nullptr;
+	}
+
+	*size = map_size;
+
+	return data;
+}
+
+uint64_t sys_file_map_alignment()
+{
+	static const auto alignment = static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+	return alignment;
+}
+
+// A hint only, the pages are read in the background
+void sys_file_prefetch(const void* data, uint64_t size)
+{
+	auto begin = reinterpret_cast<uintptr_t>(data) & ~(sys_file_map_alignment() - 1);
+	auto end   = reinterpret_cast<uintptr_t>(data) + size;
+
+	if (size != 0)
+	{
+		madvise(reinterpret_cast<void*>(begin), end - begin, MADV_WILLNEED);
+	}
+}
+
+void sys_file_unmap(void* data, uint64_t size)
+{
+	munmap(data, size);
+}
+
+// Replaces the pages at vaddr with a copy-on-write view of the file. The pages stay mapped until the range is freed.
+bool sys_file_map_fixed(sys_file_t& f, uint64_t offset, uint64_t size, uint64_t vaddr)
+{
+	if (f.type != SYS_FILE_FILE || f.f == nullptr || size == 0 || ((offset | size | vaddr) & 0xfffu) != 0)
+	{
+		return false;
+	}
+
+	auto* addr = reinterpret_cast<void*>(vaddr);
+
+	if (mmap(addr, size, PROT_READ | PROT_WRITE | PROT_EXEC, MAP_PRIVATE | MAP_FIXED, fileno(f.f), static_cast<off_t>(offset)) ==
+	    MAP_FAILED)
+	{
+		// The old pages may be gone already
+		mmap(addr, size, PROT_READ | PROT_WRITE | PROT_EXEC, MAP_PRIVATE | MAP_FIXED | MAP_ANONYMOUS, -1, 0);
+		return false;
+	}
+
+	return true;
+}
+
+// Doesn't use the file position, so reads of one file can run in parallel
+void sys_file_read_at(void* data, uint64_t size, uint64_t offset, sys_file_t& f, uint64_t* bytes_read)
+{
+	uint64_t total = 0;
+
+	if (f.type == SYS_FILE_FILE && f.f != nullptr)
+	{
+		int fd = fileno(f.f);
+
+		while (total < size)
+		{
+			auto n = pread(fd, static_cast<uint8_t*>(data) + total, size - total, static_cast<off_t>(offset + total));
+			if (n < 0 && errno == EINTR)
+			{
+				continue;
+			}
+			if (n <= 0)
+			{
+				break;
+			}
+			total += n;
+		}
+	} else if (f.type == SYS_FILE_MEMORY_STAT || f.type == SYS_FILE_MEMORY_DYN)
+	{
+		if (offset < f.buf->size)
+		{
+			total = std::min(size, f.buf->size - offset);
+			memcpy(data, f.buf->base + offset, total);
+		}
+	}
+
+	if (bytes_read != nullptr)
+	{
+		*bytes_read = total;
+	}
+}
+
+void sys_file_will_need(sys_file_t& f, uint64_t offset, uint64_t size)
+{
+	if (f.type == SYS_FILE_FILE && f.f != nullptr)
+	{
+		posix_fadvise(fileno(f.f), static_cast<off_t>(offset), static_cast<off_t>(size), POSIX_FADV_WILLNEED);
+	}
+}
+
 } // namespace Kyty
 
 #endif
@@ -0,0 +1,212 @@
+#include "Kyty/Core/Common.h"
+
+#if KYTY_PLATFORM != KYTY_PLATFORM_LINUX
+//#error "KYTY_PLATFORM != KYTY_PLATFORM_LINUX"
+#else
+
+#include "Kyty/Core/DbgAssert.h"
+#include "Kyty/Core/String.h"
+#include "Kyty/Sys/SysNet.h"
+
+#include <arpa/inet.h>
+#include <cerrno>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+namespace Kyty {
+
+static void set_timeouts(int s, uint32_t timeout_ms)
+{
+	struct timeval tv {};
+	tv.tv_sec  = static_cast<time_t>(timeout_ms / 1000);
+	tv.tv_usec = static_cast<suseconds_t>((timeout_ms % 1000) * 1000);
+	setsockopt(s, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+	setsockopt(s, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+}
+
+static bool connect_with_timeout(int s, const struct sockaddr* addr, socklen_t addr_len, uint32_t timeout_ms)
+{
+	int flags = fcntl(s, F_GETFL, 0);
+	if (flags < 0 || fcntl(s, F_SETFL, flags | O_NONBLOCK) != 0)
+	{
+		return false;
+	}
+
+	if (connect(s, addr, addr_len) != 0)
+	{
+		if (errno != EINPROGRESS)
+		{
+			return false;
+		}
+
+		struct pollfd p {};
+		p.fd     = s;
+		p.events = POLLOUT;
+
+		int result = 0;
+		do
+		{
+			result = poll(&p, 1, static_cast<int>(timeout_ms));
+		} while (result < 0 && errno == EINTR);
+
+		int       error     = 0;
+		socklen_t error_len = sizeof(error);
+		if (result <= 0 || getsockopt(s, SOL_SOCKET, SO_ERROR, &error, &error_len) != 0 || error != 0)
+		{
+			return false;
+		}
+	}
+
+	return (fcntl(s, F_SETFL, flags) == 0);
+}
+
+sys_socket_t sys_net_connect(const String& host, uint16_t port, uint32_t timeout_ms)
+{
+	struct addrinfo hints {};
+	hints.ai_family   = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+
+	struct addrinfo* list = nullptr;
+	if (getaddrinfo(host.utf8_str().GetData(), String::FromPrintf("%u", static_cast<uint32_t>(port)).C_Str(), &hints, &list) != 0)
+	{
+		return SYS_SOCKET_INVALID;
+	}
+
+	int s = SYS_SOCKET_INVALID;
+
+	for (auto* a = list; a != nullptr; a = a->ai_next)
+	{
+		s = socket(a->ai_family, a->ai_socktype | SOCK_CLOEXEC, a->ai_protocol);
+		if (s < 0)
+		{
+			continue;
+		}
+
+		if (connect_with_timeout(s, a->ai_addr, a->ai_addrlen, timeout_ms))
+		{
+			break;
+		}
+
+		close(s);
+		s = SYS_SOCKET_INVALID;
+	}
+
+	freeaddrinfo(list);
+
+	if (s != SYS_SOCKET_INVALID)
+	{
+		set_timeouts(s, timeout_ms);
+	}
+
+	return s;
+}
+
+sys_socket_t sys_net_listen(uint16_t* port)
+{
+	EXIT_IF(port == nullptr);
+
+	int s = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (s < 0)
+	{
+		return SYS_SOCKET_INVALID;
+	}
+
+	struct sockaddr_in addr {};
+	addr.sin_family      = AF_INET;
+	addr.sin_port        = htons(*port);
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+	socklen_t addr_len = sizeof(addr);
+
+	if (bind(s, reinterpret_cast<struct sockaddr*>(&addr), addr_len) != 0 || listen(s, SOMAXCONN) != 0 ||
+	    getsockname(s, reinterpret_cast<struct sockaddr*>(&addr), &addr_len) != 0)
+	{
+		close(s);
+		return SYS_SOCKET_INVALID;
+	}
+
+	*port = ntohs(addr.sin_port);
+
+	return s;
+}
+
+sys_socket_t sys_net_accept(sys_socket_t s, uint32_t timeout_ms)
+{
+	struct pollfd p {};
+	p.fd     = s;
+	p.events = POLLIN;
+
+	int result = 0;
+	do
+	{
+		result = poll(&p, 1, static_cast<int>(timeout_ms));
+	} while (result < 0 && errno == EINTR);
+
+	if (result <= 0)
+	{
+		return SYS_SOCKET_INVALID;
+	}
+
+	int c = accept4(s, nullptr, nullptr, SOCK_CLOEXEC);
+	if (c < 0)
+	{
+		return SYS_SOCKET_INVALID;
+	}
+
+	set_timeouts(c, timeout_ms);
+
+	return c;
+}
+
+void sys_net_close(sys_socket_t s)
+{
+	if (s != SYS_SOCKET_INVALID)
+	{
+		close(s);
+	}
+}
+
+bool sys_net_send(sys_socket_t s, const void* data, uint32_t size)
+{
+	const auto* ptr = static_cast<const char*>(data);
+
+	while (size > 0)
+	{
+		// The peer may close the connection, report it instead of raising SIGPIPE
+		auto sent = send(s, ptr, size, MSG_NOSIGNAL);
+		if (sent < 0 && errno == EINTR)
+		{
+			continue;
+		}
+		if (sent <= 0)
+		{
+			return false;
+		}
+		ptr += sent;
+		size -= static_cast<uint32_t>(sent);
+	}
+
+	return true;
+}
+
+int sys_net_recv(sys_socket_t s, void* data, uint32_t size)
+{
+	for (;;)
+	{
+		auto received = recv(s, data, size, 0);
+		if (received < 0 && errno == EINTR)
+		{
+			continue;
+		}
+		return static_cast<int>(received < 0 ? -1 : received);
+	}
+}
+
+} // namespace Kyty
+
+#endif
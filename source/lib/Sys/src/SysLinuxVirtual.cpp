@@ -12,9 +12,14 @@
 #include "cpuinfo.h"
 
 #include <cerrno>
+#include <cstdio>
+#include <cstring>
 #include <map>
+#include <asm/prctl.h>
 #include <pthread.h>
 #include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
 
 // IWYU pragma: no_include <asm/mman-common.h>
 // IWYU pragma: no_include <asm/mman.h>
@@ -270,6 +275,111 @@ bool sys_virtual_alloc_fixed(uint64_t address, uint64_t size, VirtualMemory::Mod
 	return false;
 }
 
+// Transparent huge pages are requested with madvise(), so the range stays an ordinary mapping: protecting a part of it
+// splits the huge page and everything keeps working on 4K pages
+static constexpr uint64_t HUGE_PAGE_SIZE = 0x200000;
+
+uint64_t sys_virtual_large_page_size()
+{
+	static const uint64_t size = []()
+	{
+		uint64_t ret  = 0;
+		FILE*    file = fopen("/sys/kernel/mm/transparent_hugepage/enabled", "r");
+		if (file != nullptr)
+		{
+			char line[128];
+			if (fgets(line, 128, file) != nullptr && strstr(line, "[never]") == nullptr)
+			{
+				ret = HUGE_PAGE_SIZE;
+			}
+			fclose(file);
+		}
+		return ret;
+	}();
+	return size;
+}
+
+bool sys_virtual_large_pages_protectable()
+{
+	return true;
+}
+
+static void advise_huge_pages(uintptr_t addr, uint64_t size)
+{
+	auto start = align_up(addr, HUGE_PAGE_SIZE);
+	auto end   = (addr + size) & ~(HUGE_PAGE_SIZE - 1);
+	if (start < end)
+	{
+		// Failure only means that the range is backed by normal pages
+		madvise(reinterpret_cast<void*>(start), end - start, MADV_HUGEPAGE); // NOLINT
+	}
+}
+
+uint64_t sys_virtual_alloc_aligned_large(uint64_t address, uint64_t size, VirtualMemory::Mode mode, uint64_t alignment)
+{
+	if (sys_virtual_large_page_size() == 0)
+	{
+		return sys_virtual_alloc_aligned(address, size, mode, alignment);
+	}
+
+	auto ret_addr = sys_virtual_alloc_aligned(address, size, mode, (alignment < HUGE_PAGE_SIZE ? HUGE_PAGE_SIZE : alignment));
+
+	if (ret_addr != 0)
+	{
+		advise_huge_pages(ret_addr, size);
+	}
+
+	return ret_addr;
+}
+
+bool sys_virtual_alloc_fixed_large(uint64_t address, uint64_t size, VirtualMemory::Mode mode)
+{
+	if (!sys_virtual_alloc_fixed(address, size, mode))
+	{
+		return false;
+	}
+
+	if (sys_virtual_large_page_size() != 0)
+	{
+		advise_huge_pages(static_cast<uintptr_t>(address), size);
+	}
+
+	return true;
+}
+
+// MAP_NORESERVE keeps the range out of the commit accounting. MADV_NOHUGEPAGE stops THP in 'always' mode from populating a whole
+// huge page on the first touch.
+uint64_t sys_virtual_alloc_lazy(uint64_t address, uint64_t size, VirtualMemory::Mode mode)
+{
+	EXIT_IF(g_allocs == nullptr);
+
+	auto addr    = static_cast<uintptr_t>(address);
+	int  protect = get_protection_flag(mode);
+
+	void* ptr = mmap(reinterpret_cast<void*>(addr), size, protect, MAP_PRIVATE | MAP_ANON | MAP_NORESERVE, -1, 0); // NOLINT
+
+	if (ptr == MAP_FAILED)
+	{
+		return 0;
+	}
+
+	madvise(ptr, size, MADV_NOHUGEPAGE); // NOLINT
+
+	auto ret_addr = reinterpret_cast<uintptr_t>(ptr);
+
+	pthread_mutex_lock(&g_virtual_mutex);
+	(*g_allocs)[ret_addr] = size;
+	uintptr_t page_start  = ret_addr >> 12u;
+	uintptr_t page_end    = (ret_addr + size - 1) >> 12u;
+	for (uintptr_t page = page_start; page <= page_end; page++)
+	{
+		(*g_protects)[page] = protect;
+	}
+	pthread_mutex_unlock(&g_virtual_mutex);
+
+	return ret_addr;
+}
+
 bool sys_virtual_free(uint64_t address)
 {
 	EXIT_IF(g_allocs == nullptr);
@@ -342,6 +452,38 @@ bool sys_virtual_protect(uint64_t address, uint64_t size, VirtualMemory::Mode mo
 	return false;
 }
 
+// The modes are tracked per page, so no syscall is made
+VirtualMemory::Mode sys_virtual_query(uint64_t address, uint64_t size, uint64_t* run_size)
+{
+	EXIT_IF(run_size == nullptr);
+
+	auto addr = static_cast<uintptr_t>(address);
+
+	uintptr_t page_start = addr >> 12u;
+	uintptr_t page_end   = (addr + size - 1) >> 12u;
+	uintptr_t page       = page_start;
+
+	pthread_mutex_lock(&g_virtual_mutex);
+	auto it      = g_protects->find(page_start);
+	int  protect = (it != g_protects->end() ? it->second : PROT_NONE);
+	if (it != g_protects->end())
+	{
+		for (; it != g_protects->end() && page <= page_end && it->first == page && it->second == protect; ++it, page++)
+		{
+		}
+	} else
+	{
+		for (; page <= page_end && g_protects->find(page) == g_protects->end(); page++)
+		{
+		}
+	}
+	pthread_mutex_unlock(&g_virtual_mutex);
+
+	*run_size = (page - page_start) << 12u;
+
+	return get_protection_flag(protect);
+}
+
 bool sys_virtual_flush_instruction_cache(uint64_t /*address*/, uint64_t /*size*/)
 {
 	return true;
@@ -368,6 +510,26 @@ bool sys_virtual_patch_replace(uint64_t vaddr, uint64_t value)
 	return ret;
 }
 
+// The slot is addressed through gs, which is not used on x86-64 Linux
+static thread_local uint64_t g_thread_slot = 0;
+
+bool sys_virtual_thread_slot_alloc(uint8_t* segment_prefix, uint32_t* offset)
+{
+	EXIT_IF(segment_prefix == nullptr || offset == nullptr);
+
+	*segment_prefix = 0x65;
+	*offset         = 0;
+
+	return true;
+}
+
+bool sys_virtual_thread_slot_set(uint64_t value)
+{
+	g_thread_slot = value;
+
+	return syscall(SYS_arch_prctl, ARCH_SET_GS, &g_thread_slot) == 0;
+}
+
 } // namespace Kyty::Core
 
 #endif
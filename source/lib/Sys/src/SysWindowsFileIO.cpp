@@ -288,6 +288,30 @@ sys_file_t* sys_file_open_rw(const String& file_name, sys_file_cache_type_t cach
 	return ret;
 }
 
+// Other processes may open, map and lock the file too. A missing file is created, an existing one isn't truncated.
+sys_file_t* sys_file_open_or_create(const String& file_name)
+{
+	auto* ret = new sys_file_t;
+
+	HANDLE h_file = nullptr;
+	h_file        = CreateFileW(reinterpret_cast<LPCWSTR>(file_name.utf16_str().GetData()),
+	                            static_cast<DWORD>(GENERIC_READ) | static_cast<DWORD>(GENERIC_WRITE),
+	                            FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr, OPEN_ALWAYS,
+	                            FILE_ATTRIBUTE_NORMAL, nullptr);
+
+	if (h_file == KYTY_INVALID_HANDLE_VALUE())
+	{
+		ret->type = SYS_FILE_ERROR;
+	} else
+	{
+		ret->type = SYS_FILE_FILE;
+	}
+
+	ret->handle = h_file;
+
+	return ret;
+}
+
 void sys_file_close(sys_file_t* f)
 {
 	if (f->type == SYS_FILE_FILE)
@@ -435,6 +459,37 @@ bool sys_file_flush(sys_file_t& f)
 	return false;
 }
 
+// Byte range locks are mandatory on Windows, so the lock is taken on a byte far past the end of the file, where it doesn't block the
+// reads of other processes
+static constexpr DWORD SYS_FILE_LOCK_OFFSET_HIGH = 0x7fffffffu;
+
+// Exclusive lock between processes, waits until the lock is taken
+bool sys_file_lock(sys_file_t& f)
+{
+	if (f.type != SYS_FILE_FILE)
+	{
+		return false;
+	}
+
+	OVERLAPPED o {};
+	o.Offset     = 0;
+	o.OffsetHigh = SYS_FILE_LOCK_OFFSET_HIGH;
+
+	return (LockFileEx(f.handle, LOCKFILE_EXCLUSIVE_LOCK, 0, 1, 0, &o) != 0);
+}
+
+void sys_file_unlock(sys_file_t& f)
+{
+	if (f.type == SYS_FILE_FILE)
+	{
+		OVERLAPPED o {};
+		o.Offset     = 0;
+		o.OffsetHigh = SYS_FILE_LOCK_OFFSET_HIGH;
+
+		UnlockFileEx(f.handle, 0, 1, 0, &o);
+	}
+}
+
 SysFileTimeStruct sys_file_get_last_access_time_utc(const String& name)
 {
 	SysFileTimeStruct r {};
@@ -628,7 +683,8 @@ bool sys_file_copy_file(const String& src, const String& dst)
 
 bool sys_file_move_file(const String& src, const String& dst)
 {
-	return MoveFileW(reinterpret_cast<LPCWSTR>(src.utf16_str().GetData()), reinterpret_cast<LPCWSTR>(dst.utf16_str().GetData())) != 0;
+	return MoveFileExW(reinterpret_cast<LPCWSTR>(src.utf16_str().GetData()), reinterpret_cast<LPCWSTR>(dst.utf16_str().GetData()),
+	                   MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
 }
 
 void sys_file_remove_readonly(const String& name)
@@ -638,6 +694,140 @@ void sys_file_remove_readonly(const String& name)
 	                   GetFileAttributesW(reinterpret_cast<LPCWSTR>(s.GetData())) & (~static_cast<DWORD>(FILE_ATTRIBUTE_READONLY)));
 }
 
+void* sys_file_map_r(sys_file_t& f, uint64_t* size)
+{
+	uint64_t map_size = 0;
+
+	void* data = sys_file_map(f, 0, &map_size, SYS_FILE_MAP_READ_ONLY);
+
+	if (data != nullptr)
+	{
+		*size = map_size;
+	}
+
+	return data;
+}
+
+// Maps *size bytes from offset, up to the end of the file if *size is 0. The offset is a multiple of sys_file_map_alignment().
+void* sys_file_map(sys_file_t& f, uint64_t offset, uint64_t* size, sys_file_map_mode_t mode)
+{
+	if (f.type != SYS_FILE_FILE || (offset % sys_file_map_alignment()) != 0)
+	{
+		return nullptr;
+	}
+
+	LARGE_INTEGER s;
+	if (GetFileSizeEx(f.handle, &s) == 0 || s.QuadPart <= 0 || offset >= static_cast<uint64_t>(s.QuadPart))
+	{
+		return nullptr;
+	}
+
+	uint64_t file_size = s.QuadPart;
+	uint64_t map_size  = (*size == 0 ? file_size - offset : *size);
+
+	if (map_size > file_size - offset)
+	{
+		return nullptr;
+	}
+
+	bool   cow     = (mode == SYS_FILE_MAP_COPY_ON_WRITE);
+	HANDLE mapping = CreateFileMappingW(f.handle, nullptr, cow ? PAGE_WRITECOPY : PAGE_READONLY, 0, 0, nullptr);
+
+	if (mapping == nullptr)
+	{
+		return nullptr;
+	}
+
+	void* data = MapViewOfFile(mapping, cow ? FILE_MAP_COPY : FILE_MAP_READ, static_cast<DWORD>(offset >> 32u),
+	                           static_cast<DWORD>(offset & 0xffffffffu), static_cast<SIZE_T>(map_size));
+
+	// The view keeps the mapping alive
+	CloseHandle(mapping);
+
+	if (data == nullptr)
+	{
+		return nullptr;
+	}
+
+	*size = map_size;
+
+	return data;
+}
+
+uint64_t sys_file_map_alignment()
+{
+	static const uint64_t alignment = []()
+	{
+		SYSTEM_INFO info {};
+		GetSystemInfo(&info);
+		return static_cast<uint64_t>(info.dwAllocationGranularity);
+	}();
+	return alignment;
+}
+
+// A hint only, the pages are read in the background
+void sys_file_prefetch(const void* data, uint64_t size)
+{
+	if (size != 0)
+	{
+		WIN32_MEMORY_RANGE_ENTRY range {};
+		range.VirtualAddress = const_cast<void*>(data);
+		range.NumberOfBytes  = static_cast<SIZE_T>(size);
+		PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+	}
+}
+
+void sys_file_unmap(void* data, uint64_t /*size*/)
+{
+	UnmapViewOfFile(data);
+}
+
+bool sys_file_map_fixed(sys_file_t& /*f*/, uint64_t /*offset*/, uint64_t /*size*/, uint64_t /*vaddr*/)
+{
+	// A view can't replace committed memory, the caller reads the file instead
+	return false;
+}
+
+// The file position is moved as well, the caller keeps its own one
+void sys_file_read_at(void* data, uint64_t size, uint64_t offset, sys_file_t& f, uint64_t* bytes_read)
+{
+	uint64_t total = 0;
+
+	if (f.type == SYS_FILE_FILE)
+	{
+		while (total < size)
+		{
+			auto       chunk = static_cast<DWORD>(size - total < 0x40000000u ? size - total : 0x40000000u);
+			DWORD      n     = 0;
+			OVERLAPPED o {};
+			o.Offset     = static_cast<DWORD>((offset + total) & 0xffffffffu);
+			o.OffsetHigh = static_cast<DWORD>((offset + total) >> 32u);
+			if (ReadFile(f.handle, static_cast<uint8_t*>(data) + total, chunk, &n, &o) == 0 || n == 0)
+			{
+				break;
+			}
+			total += n;
+		}
+	} else if (f.type == SYS_FILE_MEMORY_STAT || f.type == SYS_FILE_MEMORY_DYN)
+	{
+		if (offset < f.buf->size)
+		{
+			total = (size < f.buf->size - offset ? size : f.buf->size - offset);
+			std::memcpy(data, f.buf->base + offset, total);
+		}
+	}
+
+	if (bytes_read != nullptr)
+	{
+		*bytes_read = total;
+	}
+}
+
+void sys_file_will_need(sys_file_t& /*f*/, uint64_t /*offset*/, uint64_t /*size*/)
+{
+	// The cache manager detects sequential reads by itself
+}
+
 } // namespace Kyty
 
 #endif
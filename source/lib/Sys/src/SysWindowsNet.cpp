@@ -0,0 +1,215 @@
+#include "Kyty/Core/Common.h"
+
+#if KYTY_PLATFORM != KYTY_PLATFORM_WINDOWS
+//#error "KYTY_PLATFORM != KYTY_PLATFORM_WINDOWS"
+#else
+
+#include "Kyty/Core/DbgAssert.h"
+#include "Kyty/Core/String.h"
+#include "Kyty/Sys/SysNet.h"
+
+// clang-format off
+#include <winsock2.h> // IWYU pragma: keep
+#include <ws2tcpip.h> // IWYU pragma: keep
+// clang-format on
+
+namespace Kyty {
+
+static bool net_init()
+{
+	static bool ok = []()
+	{
+		WSADATA data {};
+		return (WSAStartup(MAKEWORD(2, 2), &data) == 0);
+	}();
+	return ok;
+}
+
+static void set_timeouts(SOCKET s, uint32_t timeout_ms)
+{
+	auto tv = static_cast<DWORD>(timeout_ms);
+	setsockopt(s, SOL_SOCKET, SO_RCVTIMEO, reinterpret_cast<const char*>(&tv), sizeof(tv));
+	setsockopt(s, SOL_SOCKET, SO_SNDTIMEO, reinterpret_cast<const char*>(&tv), sizeof(tv));
+}
+
+static bool connect_with_timeout(SOCKET s, const struct sockaddr* addr, int addr_len, uint32_t timeout_ms)
+{
+	u_long non_blocking = 1;
+	if (ioctlsocket(s, FIONBIO, &non_blocking) != 0)
+	{
+		return false;
+	}
+
+	if (connect(s, addr, addr_len) != 0)
+	{
+		if (WSAGetLastError() != WSAEWOULDBLOCK)
+		{
+			return false;
+		}
+
+		fd_set write_set;
+		fd_set error_set;
+		FD_ZERO(&write_set);
+		FD_ZERO(&error_set);
+		FD_SET(s, &write_set);
+		FD_SET(s, &error_set);
+
+		timeval tv {};
+		tv.tv_sec  = static_cast<long>(timeout_ms / 1000);
+		tv.tv_usec = static_cast<long>((timeout_ms % 1000) * 1000);
+
+		if (select(0, nullptr, &write_set, &error_set, &tv) <= 0 || FD_ISSET(s, &error_set) != 0)
+		{
+			return false;
+		}
+	}
+
+	non_blocking = 0;
+	return (ioctlsocket(s, FIONBIO, &non_blocking) == 0);
+}
+
+sys_socket_t sys_net_connect(const String& host, uint16_t port, uint32_t timeout_ms)
+{
+	if (!net_init())
+	{
+		return SYS_SOCKET_INVALID;
+	}
+
+	ADDRINFOW hints {};
+	hints.ai_family   = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+
+	ADDRINFOW* list = nullptr;
+	if (GetAddrInfoW(reinterpret_cast<LPCWSTR>(host.utf16_str().GetData()),
+	                 reinterpret_cast<LPCWSTR>(String::FromPrintf("%u", static_cast<uint32_t>(port)).utf16_str().GetData()), &hints,
+	                 &list) != 0)
+	{
+		return SYS_SOCKET_INVALID;
+	}
+
+	SOCKET s = INVALID_SOCKET;
+
+	for (auto* a = list; a != nullptr; a = a->ai_next)
+	{
+		s = socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+		if (s == INVALID_SOCKET)
+		{
+			continue;
+		}
+
+		if (connect_with_timeout(s, a->ai_addr, static_cast<int>(a->ai_addrlen), timeout_ms))
+		{
+			break;
+		}
+
+		closesocket(s);
+		s = INVALID_SOCKET;
+	}
+
+	FreeAddrInfoW(list);
+
+	if (s == INVALID_SOCKET)
+	{
+		return SYS_SOCKET_INVALID;
+	}
+
+	set_timeouts(s, timeout_ms);
+
+	return static_cast<sys_socket_t>(s);
+}
+
+sys_socket_t sys_net_listen(uint16_t* port)
+{
+	EXIT_IF(port == nullptr);
+
+	if (!net_init())
+	{
+		return SYS_SOCKET_INVALID;
+	}
+
+	SOCKET s = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+	if (s == INVALID_SOCKET)
+	{
+		return SYS_SOCKET_INVALID;
+	}
+
+	sockaddr_in addr {};
+	addr.sin_family      = AF_INET;
+	addr.sin_port        = htons(*port);
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+	int addr_len = sizeof(addr);
+
+	if (bind(s, reinterpret_cast<sockaddr*>(&addr), addr_len) != 0 || listen(s, SOMAXCONN) != 0 ||
+	    getsockname(s, reinterpret_cast<sockaddr*>(&addr), &addr_len) != 0)
+	{
+		closesocket(s);
+		return SYS_SOCKET_INVALID;
+	}
+
+	*port = ntohs(addr.sin_port);
+
+	return static_cast<sys_socket_t>(s);
+}
+
+sys_socket_t sys_net_accept(sys_socket_t s, uint32_t timeout_ms)
+{
+	fd_set read_set;
+	FD_ZERO(&read_set);
+	FD_SET(static_cast<SOCKET>(s), &read_set);
+
+	timeval tv {};
+	tv.tv_sec  = static_cast<long>(timeout_ms / 1000);
+	tv.tv_usec = static_cast<long>((timeout_ms % 1000) * 1000);
+
+	if (select(0, &read_set, nullptr, nullptr, &tv) <= 0)
+	{
+		return SYS_SOCKET_INVALID;
+	}
+
+	SOCKET c = accept(static_cast<SOCKET>(s), nullptr, nullptr);
+	if (c == INVALID_SOCKET)
+	{
+		return SYS_SOCKET_INVALID;
+	}
+
+	set_timeouts(c, timeout_ms);
+
+	return static_cast<sys_socket_t>(c);
+}
+
+void sys_net_close(sys_socket_t s)
+{
+	if (s != SYS_SOCKET_INVALID)
+	{
+		closesocket(static_cast<SOCKET>(s));
+	}
+}
+
+bool sys_net_send(sys_socket_t s, const void* data, uint32_t size)
+{
+	const auto* ptr = static_cast<const char*>(data);
+
+	while (size > 0)
+	{
+		int sent = send(static_cast<SOCKET>(s), ptr, static_cast<int>(size), 0);
+		if (sent <= 0)
+		{
+			return false;
+		}
+		ptr += sent;
+		size -= static_cast<uint32_t>(sent);
+	}
+
+	return true;
+}
+
+int sys_net_recv(sys_socket_t s, void* data, uint32_t size)
+{
+	int received = recv(static_cast<SOCKET>(s), static_cast<char*>(data), static_cast<int>(size), 0);
+	return (received < 0 ? -1 : received);
+}
+
+} // namespace Kyty
+
+#endif
@@ -110,6 +110,11 @@ static VirtualAlloc2_func_t ResolveVirtualAlloc2()
 	return nullptr;
 }
 
+static constexpr uint64_t SYSTEM_MANAGED_MIN = 0x0000040000u;
+static constexpr uint64_t SYSTEM_MANAGED_MAX = 0x07FFFFBFFFu;
+static constexpr uint64_t USER_MIN           = 0x1000000000u;
+static constexpr uint64_t USER_MAX           = 0xFBFFFFFFFFu;
+
 static uint64_t align_up(uint64_t addr, uint64_t alignment)
 {
 	return (addr + alignment - 1) & ~(alignment - 1);
@@ -123,11 +128,6 @@ uint64_t sys_virtual_alloc_aligned(uint64_t address, uint64_t size, VirtualMemor
 		return 0;
 	}
 
-	static constexpr uint64_t SYSTEM_MANAGED_MIN = 0x0000040000u;
-	static constexpr uint64_t SYSTEM_MANAGED_MAX = 0x07FFFFBFFFu;
-	static constexpr uint64_t USER_MIN           = 0x1000000000u;
-	static constexpr uint64_t USER_MAX           = 0xFBFFFFFFFFu;
-
 	MEM_ADDRESS_REQUIREMENTS req {};
 	MEM_EXTENDED_PARAMETER   param {};
 	req.LowestStartingAddress =
@@ -198,6 +198,107 @@ bool sys_virtual_alloc_fixed(uint64_t address, uint64_t size, VirtualMemory::Mod
 	return true;
 }
 
+// Large pages need SeLockMemoryPrivilege, which has to be granted to the user by policy. Without it every large allocation falls
+// back to normal pages.
+static bool enable_lock_memory_privilege()
+{
+	HANDLE token = nullptr;
+	if (OpenProcessToken(GetCurrentProcess(), TOKEN_ADJUST_PRIVILEGES | TOKEN_QUERY, &token) == 0)
+	{
+		return false;
+	}
+
+	TOKEN_PRIVILEGES tp {};
+	tp.PrivilegeCount           = 1;
+	tp.Privileges[0].Attributes = SE_PRIVILEGE_ENABLED;
+
+	bool ok = (LookupPrivilegeValue(nullptr, SE_LOCK_MEMORY_NAME, &tp.Privileges[0].Luid) != 0 &&
+	           AdjustTokenPrivileges(token, FALSE, &tp, 0, nullptr, nullptr) != 0 && GetLastError() == ERROR_SUCCESS);
+
+	CloseHandle(token);
+
+	return ok;
+}
+
+uint64_t sys_virtual_large_page_size()
+{
+	static const uint64_t size = (enable_lock_memory_privilege() ? static_cast<uint64_t>(GetLargePageMinimum()) : 0);
+	return size;
+}
+
+// Windows large pages can't be protected partially, so 4K-granular protection (e.g. GPU memory write watch) doesn't work on them
+bool sys_virtual_large_pages_protectable()
+{
+	return false;
+}
+
+uint64_t sys_virtual_alloc_aligned_large(uint64_t address, uint64_t size, VirtualMemory::Mode mode, uint64_t alignment)
+{
+	auto page = sys_virtual_large_page_size();
+
+	if (page == 0 || (size & (page - 1)) != 0)
+	{
+		return sys_virtual_alloc_aligned(address, size, mode, alignment);
+	}
+
+	static auto virtual_alloc2 = ResolveVirtualAlloc2();
+
+	EXIT_NOT_IMPLEMENTED(virtual_alloc2 == nullptr);
+
+	MEM_ADDRESS_REQUIREMENTS req {};
+	MEM_EXTENDED_PARAMETER   param {};
+	req.Alignment             = (alignment < page ? page : alignment);
+	req.LowestStartingAddress = reinterpret_cast<PVOID>(address == 0 ? USER_MIN : align_up(address, req.Alignment));
+	req.HighestEndingAddress  = reinterpret_cast<PVOID>(USER_MAX);
+	param.Type                = MemExtendedParameterAddressRequirements;
+	param.Pointer             = &req;
+
+	auto ptr = reinterpret_cast<uintptr_t>(
+	    virtual_alloc2(GetCurrentProcess(), nullptr, size,
+	                   static_cast<DWORD>(MEM_COMMIT) | static_cast<DWORD>(MEM_RESERVE) | static_cast<DWORD>(MEM_LARGE_PAGES),
+	                   get_protection_flag(mode), &param, 1));
+
+	if (ptr == 0)
+	{
+		return sys_virtual_alloc_aligned(address, size, mode, alignment);
+	}
+
+	return ptr;
+}
+
+bool sys_virtual_alloc_fixed_large(uint64_t address, uint64_t size, VirtualMemory::Mode mode)
+{
+	auto page = sys_virtual_large_page_size();
+
+	if (page == 0 || (size & (page - 1)) != 0 || (address & (page - 1)) != 0)
+	{
+		return sys_virtual_alloc_fixed(address, size, mode);
+	}
+
+	auto ptr = reinterpret_cast<uintptr_t>(VirtualAlloc(
+	    reinterpret_cast<LPVOID>(static_cast<uintptr_t>(address)), size,
+	    static_cast<DWORD>(MEM_COMMIT) | static_cast<DWORD>(MEM_RESERVE) | static_cast<DWORD>(MEM_LARGE_PAGES), get_protection_flag(mode)));
+
+	if (ptr == 0)
+	{
+		return sys_virtual_alloc_fixed(address, size, mode);
+	}
+
+	if (ptr != address)
+	{
+		VirtualFree(reinterpret_cast<LPVOID>(ptr), 0, MEM_RELEASE);
+		return false;
+	}
+
+	return true;
+}
+
+// Committed pages take no physical memory until they are touched, only the commit charge
+uint64_t sys_virtual_alloc_lazy(uint64_t address, uint64_t size, VirtualMemory::Mode mode)
+{
+	return sys_virtual_alloc(address, size, mode);
+}
+
 bool sys_virtual_free(uint64_t address)
 {
 	if (VirtualFree(reinterpret_cast<LPVOID>(static_cast<uintptr_t>(address)), 0, MEM_RELEASE) == 0)
@@ -223,6 +324,25 @@ bool sys_virtual_protect(uint64_t address, uint64_t size, VirtualMemory::Mode mo
 	return true;
 }
 
+// A region of VirtualQuery() never crosses an allocation, so VirtualProtect() accepts the whole run
+VirtualMemory::Mode sys_virtual_query(uint64_t address, uint64_t size, uint64_t* run_size)
+{
+	EXIT_IF(run_size == nullptr);
+
+	MEMORY_BASIC_INFORMATION info {};
+	if (VirtualQuery(reinterpret_cast<LPCVOID>(static_cast<uintptr_t>(address)), &info, sizeof(info)) == 0)
+	{
+		*run_size = size;
+		return VirtualMemory::Mode::NoAccess;
+	}
+
+	uint64_t end = reinterpret_cast<uintptr_t>(info.BaseAddress) + info.RegionSize;
+
+	*run_size = (end - address < size ? end - address : size);
+
+	return get_protection_flag(info.Protect);
+}
+
 bool sys_virtual_flush_instruction_cache(uint64_t address, uint64_t size)
 {
 	if (::FlushInstructionCache(GetCurrentProcess(), reinterpret_cast<LPVOID>(static_cast<uintptr_t>(address)), size) == 0)
@@ -254,6 +374,47 @@ bool sys_virtual_patch_replace(uint64_t vaddr, uint64_t value)
 	return ret;
 }
 
+// TEB::TlsSlots, the first 64 TLS indexes are stored directly in the TEB, which is addressed through gs
+constexpr DWORD TEB_TLS_SLOTS_OFFSET = 0x1480;
+constexpr DWORD TEB_TLS_SLOTS_NUM    = 64;
+
+static DWORD g_thread_slot_index = TLS_OUT_OF_INDEXES;
+
+bool sys_virtual_thread_slot_alloc(uint8_t* segment_prefix, uint32_t* offset)
+{
+	EXIT_IF(segment_prefix == nullptr || offset == nullptr);
+
+	if (g_thread_slot_index == TLS_OUT_OF_INDEXES)
+	{
+		DWORD index = TlsAlloc();
+
+		if (index == TLS_OUT_OF_INDEXES)
+		{
+			return false;
+		}
+
+		if (index >= TEB_TLS_SLOTS_NUM)
+		{
+			TlsFree(index);
+			return false;
+		}
+
+		g_thread_slot_index = index;
+	}
+
+	*segment_prefix = 0x65;
+	*offset         = TEB_TLS_SLOTS_OFFSET + g_thread_slot_index * 8;
+
+	return true;
+}
+
+bool sys_virtual_thread_slot_set(uint64_t value)
+{
+	EXIT_IF(g_thread_slot_index == TLS_OUT_OF_INDEXES);
+
+	return TlsSetValue(g_thread_slot_index, reinterpret_cast<void*>(value)) != FALSE;
+}
+
 } // namespace Kyty::Core
 
 #endif
@@ -1,11 +1,36 @@
 #include "Kyty/UnitTest.h"
 
+#include "Kyty/Core/Timer.h"
+
+#include <string>
+
 namespace Kyty::UnitTest {
 
 UT_LINK(CoreCharString);
 UT_LINK(CoreCharString8);
 UT_LINK(CoreMSpace);
 UT_LINK(CoreDateTime);
+UT_LINK(CoreFlatHashmap);
+UT_LINK(CoreSmallVector);
+UT_LINK(CoreStringView8);
+UT_LINK(CoreJobSystem);
+UT_LINK(CoreThreads);
+UT_LINK(CoreCompression);
+UT_LINK(CoreBufferPool);
+UT_LINK(CoreSharedStore);
+UT_LINK(CoreHttp);
+UT_LINK(CoreVirtualMemory);
+UT_LINK(CoreFile);
+UT_LINK(CoreDatabase);
+UT_LINK(MathCrypto);
+UT_LINK(CoreJsonReader);
+UT_LINK(CoreSubsystems);
+UT_LINK(CoreBench);
+UT_LINK(EmulatorShaderParse);
+UT_LINK(EmulatorPthread);
+UT_LINK(EmulatorTile);
+UT_LINK(EmulatorShaderSpirvBinary);
+UT_LINK(MathVectorAndMatrix);
 
 KYTY_SUBSYSTEM_INIT(UnitTest)
 {
@@ -16,6 +41,49 @@ KYTY_SUBSYSTEM_UNEXPECTED_SHUTDOWN(UnitTest) {}
 
 KYTY_SUBSYSTEM_DESTROY(UnitTest) {}
 
+constexpr double BENCH_TIME_MS = 200.0;
+
+void BenchRun(const char* name, uint64_t bytes_per_run, bench_func_t func, void* arg)
+{
+	// Warm up the caches and find how many calls take long enough to time
+	func(arg);
+
+	Core::Timer t;
+	uint64_t    runs = 1;
+	double      ms   = 0.0;
+
+	for (;;)
+	{
+		t.Start();
+		for (uint64_t i = 0; i < runs; i++)
+		{
+			func(arg);
+		}
+		ms = t.GetTimeMs();
+
+		if (ms >= BENCH_TIME_MS)
+		{
+			break;
+		}
+
+		runs = (ms < BENCH_TIME_MS / 100.0 ? runs * 10 : static_cast<uint64_t>(static_cast<double>(runs) * BENCH_TIME_MS / ms) + 1);
+	}
+
+	double ns = ms * 1000000.0 / static_cast<double>(runs);
+
+	testing::Test::RecordProperty(std::string(name) + ".ns", std::to_string(ns));
+
+	if (bytes_per_run != 0)
+	{
+		double mb_s = static_cast<double>(bytes_per_run) * 1000.0 / ns;
+		printf("%-48s %14.1f ns %10.1f MB/s\n", name, ns, mb_s);
+		testing::Test::RecordProperty(std::string(name) + ".mb_s", std::to_string(mb_s));
+	} else
+	{
+		printf("%-48s %14.1f ns\n", name, ns);
+	}
+}
+
 bool unit_test_all()
 {
 	return RUN_ALL_TESTS() == 0;
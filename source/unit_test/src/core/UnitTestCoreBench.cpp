@@ -0,0 +1,217 @@
+#include "Kyty/Core/ByteBuffer.h"
+#include "Kyty/Core/Compression.h"
+#include "Kyty/Core/Hashmap.h"
+#include "Kyty/Core/MSpace.h"
+#include "Kyty/Core/String.h"
+#include "Kyty/Core/String8.h"
+#include "Kyty/Core/Threads.h"
+#include "Kyty/Core/Vector.h"
+#include "Kyty/Math/Rand.h"
+#include "Kyty/UnitTest.h"
+
+#define XXH_INLINE_ALL
+#include <xxhash/xxhash.h>
+
+UT_BEGIN(CoreBench);
+
+using Core::ByteBuffer;
+using Core::Hashmap;
+using Math::Rand;
+
+// Keeps the results alive, so the compiler doesn't drop the work
+static volatile uint64_t g_sink = 0;
+
+static ByteBuffer create_data(uint32_t size)
+{
+	// Runs and noise, compresses about 3:1
+	return UnitTest::CreateData(size, [](uint32_t i) { return (i & 0x40u) != 0 ? (i / 16) & 0xffu : Rand::Uint() & 0x0fu; });
+}
+
+static void bench_containers()
+{
+	Vector<uint64_t> keys;
+	for (uint32_t i = 0; i < 4096; i++)
+	{
+		keys.Add((static_cast<uint64_t>(Rand::Uint()) << 32u) | Rand::Uint());
+	}
+
+	UnitTest::Bench("Hashmap<uint64_t, int> put/find/remove x4096", 0,
+	                [&]()
+	                {
+		                Hashmap<uint64_t, int> m;
+		                for (auto k: keys)
+		                {
+			                m.Put(k, 1);
+		                }
+		                uint64_t found = 0;
+		                for (auto k: keys)
+		                {
+			                found += (m.Find(k) != nullptr ? 1 : 0);
+		                }
+		                for (auto k: keys)
+		                {
+			                m.Remove(k);
+		                }
+		                g_sink = g_sink + found;
+	                });
+
+	UnitTest::Bench("Vector<uint64_t> add x4096", 0,
+	                [&]()
+	                {
+		                Vector<uint64_t> v;
+		                for (auto k: keys)
+		                {
+			                v.Add(k);
+		                }
+		                g_sink = g_sink + v.Size();
+	                });
+
+	UnitTest::Bench("Vector<uint64_t> sort x4096", 0,
+	                [&]()
+	                {
+		                Vector<uint64_t> v = keys;
+		                v.Sort();
+		                g_sink = g_sink + v.At(0);
+	                });
+}
+
+static void bench_strings()
+{
+	String str;
+	for (uint32_t i = 0; i < 256; i++)
+	{
+		str += String::FromPrintf("sceLibFunction%u_%08x,", i, Rand::Uint());
+	}
+	String8 str8 = str.C_Str();
+
+	UnitTest::Bench("String FromPrintf", 0, [&]() { g_sink = g_sink + String::FromPrintf("%s_%u", "sceKernelOpen", 123u).Size(); });
+	UnitTest::Bench("String Hash", str.Size(), [&]() { g_sink = g_sink + str.Hash(); });
+	UnitTest::Bench("String FindIndex", str.Size(), [&]() { g_sink = g_sink + str.FindIndex(U"not found"); });
+	UnitTest::Bench("String Split", str.Size(), [&]() { g_sink = g_sink + str.Split(U",").Size(); });
+	UnitTest::Bench("String ReplaceStr", str.Size(), [&]() { g_sink = g_sink + str.ReplaceStr(U"Function", U"Func").Size(); });
+	UnitTest::Bench("String ToUpper", str.Size(), [&]() { g_sink = g_sink + str.ToUpper().Size(); });
+	UnitTest::Bench("String utf8_str", str.Size(), [&]() { g_sink = g_sink + str.utf8_str().Size(); });
+
+	UnitTest::Bench("String8 FromPrintf", 0, [&]() { g_sink = g_sink + String8::FromPrintf("%s_%u", "sceKernelOpen", 123u).Size(); });
+	UnitTest::Bench("String8 Hash", str8.Size(), [&]() { g_sink = g_sink + str8.Hash(); });
+	UnitTest::Bench("String8 FindIndex", str8.Size(), [&]() { g_sink = g_sink + str8.FindIndex("not found"); });
+	UnitTest::Bench("String8 Split", str8.Size(), [&]() { g_sink = g_sink + str8.Split(',').Size(); });
+	UnitTest::Bench("String8 ReplaceStr", str8.Size(), [&]() { g_sink = g_sink + str8.ReplaceStr("Function", "Func").Size(); });
+}
+
+struct MSpaceBench
+{
+	Core::mspace_t msp = nullptr;
+	uint32_t       ops = 0;
+};
+
+static void mspace_bench_thread(void* arg)
+{
+	auto* b = static_cast<MSpaceBench*>(arg);
+
+	void*    ptrs[64] = {};
+	uint32_t seed     = static_cast<uint32_t>(Core::Thread::GetThreadIdUnique());
+	uint32_t fails    = 0;
+
+	for (uint32_t i = 0; i < b->ops; i++)
+	{
+		seed         = seed * 1103515245u + 12345u;
+		uint32_t idx = (seed >> 16u) & 63u;
+		if (ptrs[idx] != nullptr)
+		{
+			Core::MSpaceFree(b->msp, ptrs[idx]);
+			ptrs[idx] = nullptr;
+		} else
+		{
+			ptrs[idx] = Core::MSpaceMalloc(b->msp, 16 + ((seed >> 8u) & 0x3ffu));
+			fails += (ptrs[idx] == nullptr ? 1 : 0);
+		}
+	}
+
+	for (auto* p: ptrs)
+	{
+		if (p != nullptr)
+		{
+			Core::MSpaceFree(b->msp, p);
+		}
+	}
+
+	EXPECT_EQ(fails, 0u);
+}
+
+static void bench_mspace()
+{
+	size_t size = 16 * 1024 * 1024;
+	auto*  buf  = new uint8_t[size];
+
+	MSpaceBench b;
+	b.msp = Core::MSpaceCreate("bench", buf, size, true, nullptr);
+	b.ops = 10000;
+	ASSERT_NE(b.msp, nullptr);
+
+	for (int threads_num: {1, 4})
+	{
+		auto name = String8::FromPrintf("MSpaceMalloc/Free x%u, %d threads", b.ops, threads_num);
+		UnitTest::Bench(name.c_str(), 0,
+		                [&]()
+		                {
+			                Vector<Core::Thread*> threads;
+			                for (int i = 0; i < threads_num; i++)
+			                {
+				                threads.Add(new Core::Thread(mspace_bench_thread, &b));
+			                }
+			                for (auto* t: threads)
+			                {
+				                t->Join();
+				                delete t;
+			                }
+		                });
+	}
+
+	EXPECT_TRUE(Core::MSpaceDestroy(b.msp));
+	delete[] buf;
+}
+
+static void bench_compression()
+{
+	ByteBuffer src  = create_data(1024 * 1024);
+	uint32_t   size = src.Size();
+
+	ByteBuffer zstd = Core::CompressZstd(src, Core::ZSTD_BEST_SPEED);
+	ByteBuffer zip  = Core::CompressZip(src, Core::ZIP_BEST_SPEED);
+	ByteBuffer lzf  = Core::CompressLzf(src);
+	ByteBuffer lzma = Core::CompressLzma(src);
+
+	UnitTest::Bench("CompressZstd 1 MB, level 1", size, [&]() { g_sink = g_sink + Core::CompressZstd(src, Core::ZSTD_BEST_SPEED).Size(); });
+	UnitTest::Bench("CompressZstd 1 MB, level 3", size, [&]() { g_sink = g_sink + Core::CompressZstd(src).Size(); });
+	UnitTest::Bench("DecompressZstd 1 MB", size, [&]() { g_sink = g_sink + Core::DecompressZstd(zstd).Size(); });
+	UnitTest::Bench("CompressZip 1 MB, level 1", size, [&]() { g_sink = g_sink + Core::CompressZip(src, Core::ZIP_BEST_SPEED).Size(); });
+	UnitTest::Bench("DecompressZip 1 MB", size, [&]() { g_sink = g_sink + Core::DecompressZip(zip).Size(); });
+	UnitTest::Bench("CompressLzf 1 MB", size, [&]() { g_sink = g_sink + Core::CompressLzf(src).Size(); });
+	UnitTest::Bench("DecompressLzf 1 MB", size, [&]() { g_sink = g_sink + Core::DecompressLzf(lzf).Size(); });
+	UnitTest::Bench("DecompressLzma 1 MB", size, [&]() { g_sink = g_sink + Core::DecompressLzma(lzma).Size(); });
+}
+
+// The sizes hashed by the GPU object cache: descriptors, small buffers, textures
+static void bench_xxh64()
+{
+	ByteBuffer  src  = create_data(4 * 1024 * 1024);
+	const auto* data = src.GetDataConst();
+
+	for (uint32_t size: {64u, 4096u, 256u * 1024u, 4u * 1024u * 1024u})
+	{
+		auto name = String8::FromPrintf("XXH64 %u bytes", size);
+		UnitTest::Bench(name.c_str(), size, [&]() { g_sink = g_sink + XXH64(data, size, 0); });
+	}
+}
+
+TEST(Core, DISABLED_Bench)
+{
+	bench_containers();
+	bench_strings();
+	bench_mspace();
+	bench_compression();
+	bench_xxh64();
+}
+
+UT_END();
@@ -0,0 +1,117 @@
+#include "Kyty/Core/BufferPool.h"
+#include "Kyty/Core/ByteBuffer.h"
+#include "Kyty/Core/Compression.h"
+#include "Kyty/UnitTest.h"
+
+UT_BEGIN(CoreBufferPool);
+
+using Core::BufferPoolStats;
+using Core::ByteBuffer;
+using Core::ByteBufferLease;
+
+static ByteBuffer create_data(uint32_t size)
+{
+	return UnitTest::CreateData(size, [](uint32_t i) { return (i / 5) & 0x7f; });
+}
+
+// A released buffer is taken again with its storage
+static void test_lease()
+{
+	BufferPoolStats s0;
+	Core::BufferPoolGetStats(&s0);
+
+	const Core::Byte* data = nullptr;
+	{
+		ByteBufferLease l(10000);
+		EXPECT_TRUE(l->IsEmpty());
+		EXPECT_GE(l->Capacity(), 10000u);
+		l->Resize(10000);
+		data = l->GetDataConst();
+	}
+	{
+		ByteBufferLease l(9000);
+		EXPECT_TRUE(l->IsEmpty());
+		EXPECT_EQ(l->GetDataConst(), data);
+
+		// Another class
+		ByteBufferLease l2(100000);
+		EXPECT_GE(l2->Capacity(), 100000u);
+		EXPECT_NE(l2->GetDataConst(), data);
+	}
+
+	BufferPoolStats s1;
+	Core::BufferPoolGetStats(&s1);
+
+	EXPECT_EQ(s1.leases - s0.leases, 3u);
+	EXPECT_EQ(s1.hits - s0.hits, 1u);
+	EXPECT_EQ(s1.buffers_num - s0.buffers_num, 2u);
+
+	Core::BufferPoolTrim();
+
+	Core::BufferPoolGetStats(&s1);
+	EXPECT_EQ(s1.buffers_num, 0u);
+	EXPECT_EQ(s1.bytes, 0u);
+}
+
+static void test_resize()
+{
+	ByteBuffer b = create_data(100);
+	b.Resize(10);
+	EXPECT_EQ(b.Size(), 10u);
+	b.Resize(200);
+	EXPECT_EQ(b.Size(), 200u);
+	EXPECT_EQ(b.At(9), Core::Byte(1));
+
+	// Copy on write
+	ByteBuffer c = b;
+	c.Resize(5);
+	EXPECT_EQ(b.Size(), 200u);
+	EXPECT_EQ(c.Size(), 5u);
+}
+
+// The overloads which write into a buffer give the same data as the ones which return it
+static void test_compression()
+{
+	ByteBuffer src = create_data(300000);
+
+	ByteBufferLease packed;
+	ByteBufferLease unpacked;
+
+	Core::CompressZstd(reinterpret_cast<const uint8_t*>(src.GetDataConst()), src.Size(), packed.Get());
+	EXPECT_TRUE(*packed == Core::CompressZstd(src));
+	Core::DecompressZstd(reinterpret_cast<const uint8_t*>(packed->GetDataConst()), packed->Size(), unpacked.Get());
+	EXPECT_TRUE(*unpacked == src);
+
+	Core::CompressZip(reinterpret_cast<const uint8_t*>(src.GetDataConst()), src.Size(), packed.Get());
+	EXPECT_TRUE(*packed == Core::CompressZip(src));
+	Core::DecompressZip(reinterpret_cast<const uint8_t*>(packed->GetDataConst()), packed->Size(), unpacked.Get());
+	EXPECT_TRUE(*unpacked == src);
+
+	Core::CompressLzf(reinterpret_cast<const uint8_t*>(src.GetDataConst()), src.Size(), packed.Get());
+	EXPECT_TRUE(*packed == Core::CompressLzf(src));
+	Core::DecompressLzf(reinterpret_cast<const uint8_t*>(packed->GetDataConst()), packed->Size(), unpacked.Get());
+	EXPECT_TRUE(*unpacked == src);
+
+	Core::CompressLzma(reinterpret_cast<const uint8_t*>(src.GetDataConst()), src.Size(), packed.Get());
+	EXPECT_TRUE(*packed == Core::CompressLzma(src));
+	Core::DecompressLzma(reinterpret_cast<const uint8_t*>(packed->GetDataConst()), packed->Size(), unpacked.Get());
+	EXPECT_TRUE(*unpacked == src);
+}
+
+TEST(Core, BufferPool)
+{
+	// The pool itself is never freed
+	Core::BufferPoolTrim();
+
+	UT_MEM_CHECK_INIT();
+
+	test_lease();
+	test_resize();
+	test_compression();
+
+	Core::BufferPoolTrim();
+
+	UT_MEM_CHECK();
+}
+
+UT_END();
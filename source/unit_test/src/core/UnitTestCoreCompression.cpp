@@ -0,0 +1,134 @@
+#include "Kyty/Core/ByteBuffer.h"
+#include "Kyty/Core/Compression.h"
+#include "Kyty/Core/Vector.h"
+#include "Kyty/UnitTest.h"
+
+UT_BEGIN(CoreCompression);
+
+using Core::ByteBuffer;
+using Core::ZstdCompressor;
+using Core::ZstdDecompressor;
+using Core::ZstdDict;
+
+static ByteBuffer create_data(uint32_t size, uint32_t seed)
+{
+	return UnitTest::CreateData(size, [seed](uint32_t i) { return ((i / 7) * 31 + seed) & 0x3f; });
+}
+
+// Chunks of any size give the same data back
+static void test_stream()
+{
+	ByteBuffer src = create_data(3 * 1024 * 1024 + 17, 1);
+
+	for (int workers_num: {0, 2})
+	{
+		ZstdCompressor c(Core::ZSTD_BEST_SPEED, workers_num);
+		ByteBuffer     packed;
+		for (uint32_t pos = 0; pos < src.Size(); pos += 100000)
+		{
+			uint32_t size = (src.Size() - pos < 100000 ? src.Size() - pos : 100000);
+			c.Push(reinterpret_cast<const uint8_t*>(src.GetDataConst()) + pos, size, &packed);
+		}
+		c.Finish(&packed);
+
+		EXPECT_LT(packed.Size(), src.Size());
+		EXPECT_EQ(Core::DecompressZstd(packed), src);
+
+		ZstdDecompressor d;
+		ByteBuffer       unpacked;
+		for (uint32_t pos = 0; pos < packed.Size(); pos += 1000)
+		{
+			uint32_t size = (packed.Size() - pos < 1000 ? packed.Size() - pos : 1000);
+			d.Push(reinterpret_cast<const uint8_t*>(packed.GetDataConst()) + pos, size, &unpacked);
+		}
+		EXPECT_TRUE(d.IsFrameFinished());
+		EXPECT_EQ(unpacked, src);
+	}
+}
+
+static void test_dst()
+{
+	ByteBuffer src    = create_data(100000, 2);
+	ByteBuffer packed = Core::CompressZstd(src);
+
+	uint64_t size = 0;
+	EXPECT_TRUE(Core::GetZstdContentSize(reinterpret_cast<const uint8_t*>(packed.GetDataConst()), packed.Size(), &size));
+	EXPECT_EQ(size, 100000u);
+
+	ByteBuffer dst(static_cast<uint32_t>(size), false);
+	EXPECT_EQ(Core::DecompressZstd(reinterpret_cast<const uint8_t*>(packed.GetDataConst()), packed.Size(),
+	                               reinterpret_cast<uint8_t*>(dst.GetData()), dst.Size()),
+	          100000u);
+	EXPECT_EQ(dst, src);
+
+	// Streamed frames don't have the size
+	ZstdCompressor c;
+	ByteBuffer     streamed;
+	c.Push(src, &streamed);
+	c.Finish(&streamed);
+	EXPECT_FALSE(Core::GetZstdContentSize(reinterpret_cast<const uint8_t*>(streamed.GetDataConst()), streamed.Size(), &size));
+}
+
+static void test_zip_dst()
+{
+	ByteBuffer src    = create_data(100000, 3);
+	ByteBuffer packed = Core::CompressZip(src);
+
+	EXPECT_EQ(Core::DecompressZip(packed), src);
+
+	// dst may be larger than the data
+	ByteBuffer dst(100100, true);
+	EXPECT_EQ(Core::DecompressZip(reinterpret_cast<const uint8_t*>(packed.GetDataConst()), packed.Size(),
+	                              reinterpret_cast<uint8_t*>(dst.GetData()), dst.Size()),
+	          100000u);
+	dst.RemoveAt(100000, 100);
+	EXPECT_EQ(dst, src);
+}
+
+static void test_dict()
+{
+	Vector<ByteBuffer> samples;
+	for (uint32_t i = 0; i < 1000; i++)
+	{
+		samples.Add(create_data(300 + i % 100, i % 5));
+	}
+
+	ZstdDict dict;
+	EXPECT_FALSE(dict.IsValid());
+	EXPECT_TRUE(dict.Train(samples, 4096));
+	EXPECT_TRUE(dict.IsValid());
+	EXPECT_GT(dict.GetData().Size(), 0u);
+
+	ZstdCompressor c(Core::ZSTD_DEFAULT_LEVEL, 0, &dict);
+	ByteBuffer     packed = c.Compress(samples.At(7));
+	EXPECT_LT(packed.Size(), Core::CompressZstd(samples.At(7)).Size());
+
+	// Loaded from the stored data
+	ZstdDict loaded;
+	EXPECT_TRUE(loaded.Load(dict.GetData()));
+	EXPECT_EQ(loaded.GetId(), dict.GetId());
+
+	ZstdDecompressor d(&loaded);
+	ByteBuffer       unpacked;
+	d.Push(packed, &unpacked);
+	EXPECT_EQ(unpacked, samples.At(7));
+
+	ByteBuffer dst(samples.At(7).Size(), false);
+	Core::DecompressZstd(reinterpret_cast<const uint8_t*>(packed.GetDataConst()), packed.Size(), reinterpret_cast<uint8_t*>(dst.GetData()),
+	                     dst.Size(), &dict);
+	EXPECT_EQ(dst, samples.At(7));
+}
+
+TEST(Core, Compression)
+{
+	UT_MEM_CHECK_INIT();
+
+	test_stream();
+	test_dst();
+	test_zip_dst();
+	test_dict();
+
+	UT_MEM_CHECK();
+}
+
+UT_END();
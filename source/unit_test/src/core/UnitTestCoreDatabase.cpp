@@ -0,0 +1,89 @@
+#include "Kyty/Core/Database.h"
+#include "Kyty/UnitTest.h"
+
+UT_BEGIN(CoreDatabase);
+
+using Core::Database::Connection;
+using Core::Database::Statement;
+using Core::Database::Transaction;
+
+static int count_rows(Connection* db)
+{
+	auto* s = db->PrepareCached("select count(*) from t");
+	EXPECT_EQ(s->Step(), Statement::State::Row);
+	int count = s->GetColumnInt(0);
+	s->Reset();
+	return count;
+}
+
+static void test_cache()
+{
+	Connection db;
+	EXPECT_TRUE(db.CreateInMemory());
+	db.Exec("create table t(a INT, b TEXT)");
+
+	const char* sql = "insert into t(a, b) values(:a, :b)";
+
+	auto* insert = db.PrepareCached(sql);
+	EXPECT_EQ(db.PrepareCached(String::FromUtf8(sql)), insert);
+
+	{
+		Transaction transaction(&db);
+		for (int i = 0; i < 1000; i++)
+		{
+			auto* s = db.PrepareCached(sql);
+			EXPECT_EQ(s, insert);
+			s->BindInt(":a", i);
+			if (i % 2 == 0)
+			{
+				s->BindString(":b", "even");
+			}
+			EXPECT_EQ(s->Step(), Statement::State::Done);
+		}
+	}
+
+	EXPECT_FALSE(db.IsError());
+	EXPECT_EQ(count_rows(&db), 1000);
+
+	// The bindings were cleared by the cache
+	auto r = db.Exec("select count(*) from t where b is null");
+	EXPECT_TRUE(r.CheckSize(1, 1));
+	EXPECT_EQ(r.At(0, 0), U"500");
+
+	db.Close();
+}
+
+static void test_rollback()
+{
+	Connection db;
+	EXPECT_TRUE(db.CreateInMemory());
+	db.Exec("create table t(a INT)");
+
+	{
+		Transaction transaction(&db);
+		db.Exec("insert into t(a) values(1)");
+		transaction.Rollback();
+	}
+	EXPECT_EQ(count_rows(&db), 0);
+
+	{
+		Transaction transaction(&db);
+		db.Exec("insert into t(a) values(1)");
+		transaction.Commit();
+	}
+	EXPECT_EQ(count_rows(&db), 1);
+
+	db.Close();
+}
+
+TEST(Core, Database)
+{
+	UT_MEM_CHECK_INIT();
+
+	test_cache();
+	test_rollback();
+
+	UT_MEM_CHECK();
+}
+
+UT_END();
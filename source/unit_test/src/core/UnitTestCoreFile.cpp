@@ -0,0 +1,158 @@
+#include "Kyty/Core/ByteBuffer.h"
+#include "Kyty/Core/File.h"
+#include "Kyty/UnitTest.h"
+
+UT_BEGIN(CoreFile);
+
+using Core::ByteBuffer;
+using Core::File;
+using Core::MappedFile;
+
+static const char* g_file_name = "_unit_test_mapped_file.bin";
+
+static void create_file(uint32_t size)
+{
+	ByteBuffer buf(size, false);
+	auto*      data = buf.GetData();
+	for (uint32_t i = 0; i < size; i++)
+	{
+		data[i] = static_cast<Core::Byte>(i * 7 + i / 256);
+	}
+
+	File f;
+	EXPECT_TRUE(f.Create(String::FromUtf8(g_file_name)));
+	f.Write(buf);
+	f.Close();
+}
+
+static uint8_t expected(uint64_t offset)
+{
+	return static_cast<uint8_t>(offset * 7 + offset / 256);
+}
+
+static void test_read_only()
+{
+	MappedFile m;
+	EXPECT_FALSE(m.IsMapped());
+
+	EXPECT_TRUE(m.Map(String::FromUtf8(g_file_name), MappedFile::Mode::ReadOnly));
+	EXPECT_TRUE(m.IsMapped());
+	EXPECT_EQ(m.GetSize(), 300000u);
+	EXPECT_EQ(m.GetData()[0], expected(0));
+	EXPECT_EQ(m.GetData()[299999], expected(299999));
+
+	m.Prefetch(1000, 1000000);
+
+	// Not aligned
+	EXPECT_TRUE(m.Map(String::FromUtf8(g_file_name), MappedFile::Mode::ReadOnly, 70001, 1000));
+	EXPECT_EQ(m.GetSize(), 1000u);
+	EXPECT_EQ(m.GetData()[0], expected(70001));
+	EXPECT_EQ(m.GetData()[999], expected(71000));
+
+	EXPECT_TRUE(m.Map(String::FromUtf8(g_file_name), MappedFile::Mode::ReadOnly, 299990));
+	EXPECT_EQ(m.GetSize(), 10u);
+	EXPECT_EQ(m.GetData()[9], expected(299999));
+
+	// Outside the file
+	EXPECT_FALSE(m.Map(String::FromUtf8(g_file_name), MappedFile::Mode::ReadOnly, 299990, 11));
+	EXPECT_FALSE(m.Map(String::FromUtf8(g_file_name), MappedFile::Mode::ReadOnly, 300000));
+	EXPECT_FALSE(m.IsMapped());
+
+	m.Unmap();
+	EXPECT_FALSE(m.IsMapped());
+}
+
+static void test_copy_on_write()
+{
+	File f;
+	EXPECT_TRUE(f.Open(String::FromUtf8(g_file_name), File::Mode::Read));
+
+	{
+		MappedFile m;
+		EXPECT_TRUE(m.Map(&f, MappedFile::Mode::CopyOnWrite, 5, 100));
+		EXPECT_EQ(m.GetMode(), MappedFile::Mode::CopyOnWrite);
+		m.GetDataCow()[0] = static_cast<uint8_t>(~expected(5));
+		EXPECT_EQ(m.GetData()[0], static_cast<uint8_t>(~expected(5)));
+	}
+
+	// The file is not changed
+	uint8_t b = 0;
+	f.Seek(5);
+	f.Read(&b, 1);
+	EXPECT_EQ(b, expected(5));
+
+	f.Close();
+}
+
+static void test_buffered()
+{
+	File f;
+	EXPECT_TRUE(f.Open(String::FromUtf8(g_file_name), File::Mode::Read));
+
+	// Small reads across the buffer boundary
+	for (uint64_t offset = 0; offset < File::READ_BUFFER_SIZE + 100; offset += 3)
+	{
+		uint8_t  b[3] = {};
+		uint32_t br   = 0;
+		f.Read(b, 3, &br);
+		EXPECT_EQ(br, 3u);
+		EXPECT_EQ(b[0], expected(offset));
+		EXPECT_EQ(b[2], expected(offset + 2));
+		EXPECT_EQ(f.Tell(), offset + 3);
+	}
+
+	// Backwards inside the buffer, then outside of it
+	for (uint64_t offset: {File::READ_BUFFER_SIZE + 10ull, 7ull, 299999ull})
+	{
+		uint8_t b = 0;
+		EXPECT_TRUE(f.Seek(offset));
+		EXPECT_EQ(f.Tell(), offset);
+		f.Read(&b, 1);
+		EXPECT_EQ(b, expected(offset));
+	}
+	EXPECT_TRUE(f.IsEOF());
+
+	// Larger than the buffer
+	ByteBuffer buf(200000, false);
+	uint64_t   br = 0;
+	EXPECT_TRUE(f.Seek(50));
+	f.Read(buf.GetData(), static_cast<uint64_t>(buf.Size()), &br);
+	EXPECT_EQ(br, 200000u);
+	EXPECT_EQ(static_cast<uint8_t>(buf.At(199999)), expected(200049));
+	EXPECT_EQ(f.Tell(), 200050u);
+
+	f.Close();
+
+	// Lines
+	EXPECT_TRUE(f.Create(String::FromUtf8(g_file_name)));
+	for (int i = 0; i < 10000; i++)
+	{
+		f.Printf("line %d\n", i);
+	}
+	f.Close();
+
+	EXPECT_TRUE(f.Open(String::FromUtf8(g_file_name), File::Mode::Read));
+	for (int i = 0; i < 10000; i++)
+	{
+		EXPECT_EQ(f.ReadLine(), String::FromPrintf("line %d\n", i));
+	}
+	EXPECT_TRUE(f.IsEOF());
+	f.Close();
+}
+
+TEST(Core, File)
+{
+	UT_MEM_CHECK_INIT();
+
+	create_file(300000);
+
+	test_read_only();
+	test_copy_on_write();
+	test_buffered();
+
+	EXPECT_TRUE(File::DeleteFile(String::FromUtf8(g_file_name)));
+
+	UT_MEM_CHECK();
+}
+
+UT_END();
@@ -0,0 +1,157 @@
+#include "Kyty/Core/FlatHashmap.h"
+#include "Kyty/Core/Hashmap.h"
+#include "Kyty/Core/String.h"
+#include "Kyty/Core/Vector.h"
+#include "Kyty/Math/Rand.h"
+#include "Kyty/UnitTest.h"
+
+UT_BEGIN(CoreFlatHashmap);
+
+using Core::FlatHashmap;
+using Core::Hashmap;
+using Math::Rand;
+
+static void test_basic()
+{
+	FlatHashmap<int, String> m;
+
+	EXPECT_EQ(m.Size(), 0u);
+	EXPECT_FALSE(m.Contains(1));
+	EXPECT_EQ(m.Find(1), nullptr);
+	EXPECT_EQ(m.Get(1, U"def"), U"def");
+
+	m.Put(1, U"one");
+	m.Put(2, U"two");
+	m[3] = U"three";
+	EXPECT_EQ(m.Size(), 3u);
+	EXPECT_EQ(m.Get(1), U"one");
+	EXPECT_EQ(m.Get(2), U"two");
+	EXPECT_EQ(m.Get(3), U"three");
+	EXPECT_EQ(m.GetOrPutDef(2, U"xxx"), U"two");
+	EXPECT_EQ(m.GetOrPutDef(4, U"four"), U"four");
+	EXPECT_EQ(m.Size(), 4u);
+
+	m.Put(1, U"ONE");
+	EXPECT_EQ(m.Get(1), U"ONE");
+	EXPECT_EQ(m.Size(), 4u);
+
+	m.Remove(2);
+	m.Remove(5);
+	EXPECT_FALSE(m.Contains(2));
+	EXPECT_EQ(m.Size(), 3u);
+
+	int      sum = 0;
+	uint32_t num = 0;
+	FOR_HASH (m)
+	{
+		sum += m.Key();
+		num++;
+	}
+	EXPECT_EQ(sum, 1 + 3 + 4);
+	EXPECT_EQ(num, 3u);
+
+	m.Clear();
+	EXPECT_EQ(m.Size(), 0u);
+	EXPECT_FALSE(m.Contains(1));
+	m.Start();
+	EXPECT_TRUE(m.End());
+}
+
+// Random operations checked against Hashmap
+static void test_random()
+{
+	FlatHashmap<uint64_t, Vector<int>> m;
+	Hashmap<uint64_t, Vector<int>>     ref;
+
+	for (int i = 0; i < 20000; i++)
+	{
+		auto key = static_cast<uint64_t>(Rand::UintInclusiveRange(0, 2000)) << 12u;
+		int  op  = Rand::IntInclusiveRange(0, 3);
+
+		if (op == 0)
+		{
+			m.Remove(key);
+			ref.Remove(key);
+		} else
+		{
+			m[key].Add(i);
+			ref[key].Add(i);
+		}
+	}
+
+	EXPECT_EQ(m.Size(), ref.Size());
+
+	bool ok = true;
+	FOR_HASH (ref)
+	{
+		const auto* v = m.Find(ref.Key());
+		if (v == nullptr || *v != ref.Value())
+		{
+			ok = false;
+		}
+	}
+	EXPECT_TRUE(ok);
+}
+
+template <class M, class K>
+static void bench(const char* name, const Vector<K>& keys)
+{
+	UnitTest::Bench(name, 0,
+	                [&]()
+	                {
+		                M        m;
+		                uint32_t found = 0;
+		                for (const auto& k: keys)
+		                {
+			                m.Put(k, 1);
+		                }
+		                for (const auto& k: keys)
+		                {
+			                found += (m.Find(k) != nullptr ? 1 : 0);
+		                }
+		                for (const auto& k: keys)
+		                {
+			                m.Remove(k);
+		                }
+		                EXPECT_EQ(found, keys.Size());
+	                });
+}
+
+// Key sets like the ones of GpuMap1 (page-aligned addresses), DescriptorCache (64-bit hashes) and SymbolDatabase (names)
+static void test_bench()
+{
+	Vector<uint64_t> addresses;
+	Vector<uint64_t> hashes;
+	Vector<String>   names;
+
+	for (uint32_t i = 0; i < 4096; i++)
+	{
+		addresses.Add(0x2000000000ULL + static_cast<uint64_t>(i) * 0x10000);
+		hashes.Add((static_cast<uint64_t>(Rand::Uint()) << 32u) | Rand::Uint());
+		names.Add(String::FromPrintf("sceLibFunction%u_%08x", i, Rand::Uint()));
+	}
+
+	bench<Hashmap<uint64_t, int>>("Hashmap put/find/remove x4096, addresses", addresses);
+	bench<FlatHashmap<uint64_t, int>>("FlatHashmap put/find/remove x4096, addresses", addresses);
+	bench<Hashmap<uint64_t, int>>("Hashmap put/find/remove x4096, hashes", hashes);
+	bench<FlatHashmap<uint64_t, int>>("FlatHashmap put/find/remove x4096, hashes", hashes);
+	bench<Hashmap<String, int>>("Hashmap put/find/remove x4096, names", names);
+	bench<FlatHashmap<String, int>>("FlatHashmap put/find/remove x4096, names", names);
+}
+
+TEST(Core, FlatHashmap)
+{
+	UT_MEM_CHECK_INIT();
+
+	test_basic();
+	test_random();
+
+	UT_MEM_CHECK();
+}
+
+TEST(Core, DISABLED_FlatHashmapBench)
+{
+	test_bench();
+}
+
+UT_END();
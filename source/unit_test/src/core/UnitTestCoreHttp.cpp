@@ -0,0 +1,199 @@
+#include "Kyty/Core/ByteBuffer.h"
+#include "Kyty/Core/Http.h"
+#include "Kyty/Core/String.h"
+#include "Kyty/Core/Threads.h"
+#include "Kyty/Sys/SysNet.h"
+#include "Kyty/UnitTest.h"
+
+#include <cstring>
+
+UT_BEGIN(CoreHttp);
+
+using Core::ByteBuffer;
+using Core::HttpUrl;
+
+// Serves the requests one by one: PUT stores the body of the path, GET returns it or 404
+struct TestServer
+{
+	sys_socket_t s        = SYS_SOCKET_INVALID;
+	uint16_t     port     = 0;
+	uint32_t     requests = 0;
+	String       path;
+	ByteBuffer   value;
+};
+
+// The request line and the body, false if the connection is closed before the whole request is received
+static bool test_server_read(sys_socket_t c, String* request_line, ByteBuffer* body)
+{
+	ByteBuffer request;
+	uint32_t   headers_size = 0;
+	uint32_t   body_size    = 0;
+
+	for (;;)
+	{
+		Core::Byte buf[4096];
+		int        received = sys_net_recv(c, buf, sizeof(buf));
+		if (received <= 0)
+		{
+			return false;
+		}
+		request.Add(buf, static_cast<uint32_t>(received));
+
+		if (headers_size == 0)
+		{
+			for (uint32_t i = 0; i + 4 <= request.Size(); i++)
+			{
+				if (std::memcmp(request.GetDataConst() + i, "\r\n\r\n", 4) == 0)
+				{
+					headers_size = i + 4;
+					break;
+				}
+			}
+			if (headers_size == 0)
+			{
+				continue;
+			}
+
+			auto     headers = String::FromUtf8(reinterpret_cast<const char*>(request.GetDataConst()), headers_size);
+			uint32_t length  = headers.FindIndex(U"\r\nContent-Length:");
+			if (headers.IndexValid(length))
+			{
+				body_size = headers.Mid(length + 17, headers.FindIndex(U'\r', length + 17) - length - 17).ToUint32();
+			}
+			*request_line = headers.Left(headers.FindIndex(U'\r'));
+		}
+
+		if (request.Size() >= headers_size + body_size)
+		{
+			body->Clear();
+			body->Add(request.GetDataConst() + headers_size, body_size);
+			return true;
+		}
+	}
+}
+
+static void test_server_run(void* arg)
+{
+	auto* srv = static_cast<TestServer*>(arg);
+
+	for (uint32_t i = 0; i < srv->requests; i++)
+	{
+		auto c = sys_net_accept(srv->s, 10000);
+		if (c == SYS_SOCKET_INVALID)
+		{
+			break;
+		}
+
+		String     request_line;
+		ByteBuffer body;
+
+		if (test_server_read(c, &request_line, &body))
+		{
+			// METHOD path HTTP/1.0
+			auto path = request_line.Mid(request_line.FindIndex(U' ') + 1);
+			path      = path.Left(path.FindIndex(U' '));
+
+			ByteBuffer response_body;
+			int        status = 404;
+
+			if (request_line.StartsWith(U"PUT "))
+			{
+				srv->path  = path;
+				srv->value = body;
+				status     = 200;
+			} else if (request_line.StartsWith(U"GET ") && path == srv->path)
+			{
+				response_body = srv->value;
+				status        = 200;
+			}
+
+			auto header = String::FromPrintf("HTTP/1.0 %d %s\r\nContent-Length: %u\r\n\r\n", status, (status == 200 ? "OK" : "Not Found"),
+			                                 response_body.Size())
+			                  .utf8_str();
+			sys_net_send(c, header.GetData(), header.Size() - 1);
+			sys_net_send(c, response_body.GetDataConst(), response_body.Size());
+		}
+
+		sys_net_close(c);
+	}
+}
+
+static void test_parse_url()
+{
+	HttpUrl u;
+
+	EXPECT_TRUE(Core::HttpParseUrl(U"http://cache.local", &u));
+	EXPECT_EQ(u.host, U"cache.local");
+	EXPECT_EQ(u.port, 80);
+	EXPECT_EQ(u.path, U"/");
+
+	EXPECT_TRUE(Core::HttpParseUrl(U"HTTP://10.0.0.1:8080/kyty/shaders/0123", &u));
+	EXPECT_EQ(u.host, U"10.0.0.1");
+	EXPECT_EQ(u.port, 8080);
+	EXPECT_EQ(u.path, U"/kyty/shaders/0123");
+
+	EXPECT_TRUE(Core::HttpParseUrl(U"http://[::1]:9000/a", &u));
+	EXPECT_EQ(u.host, U"::1");
+	EXPECT_EQ(u.port, 9000);
+	EXPECT_EQ(u.path, U"/a");
+
+	EXPECT_FALSE(Core::HttpParseUrl(U"https://cache.local/", &u));
+	EXPECT_FALSE(Core::HttpParseUrl(U"cache.local/", &u));
+	EXPECT_FALSE(Core::HttpParseUrl(U"http://", &u));
+	EXPECT_FALSE(Core::HttpParseUrl(U"http://cache.local:0/", &u));
+	EXPECT_FALSE(Core::HttpParseUrl(U"http://cache.local:70000/", &u));
+	EXPECT_FALSE(Core::HttpParseUrl(U"http://[::1/", &u));
+}
+
+// Nothing listens on the port, the requests fail without a status
+static void test_no_server()
+{
+	Core::ByteBuffer body;
+	EXPECT_EQ(Core::HttpGet(U"http://127.0.0.1:1/x", &body, 1000), 0);
+	EXPECT_EQ(Core::HttpPut(U"http://127.0.0.1:1/x", "abc", 3, 1000), 0);
+	EXPECT_EQ(Core::HttpGet(U"https://127.0.0.1/x", &body, 1000), 0);
+}
+
+// A value is stored and read back over local connections
+static void test_round_trip()
+{
+	TestServer srv;
+	srv.s        = sys_net_listen(&srv.port);
+	srv.requests = 4;
+
+	ASSERT_NE(srv.s, SYS_SOCKET_INVALID);
+
+	Core::Thread t(test_server_run, &srv);
+
+	auto url   = String::FromPrintf("http://127.0.0.1:%u/kyty/shaders/0123", static_cast<uint32_t>(srv.port));
+	auto value = UnitTest::CreateData(300000, [](uint32_t i) { return (i * 13) & 0xff; });
+
+	EXPECT_EQ(Core::HttpPut(url, value.GetDataConst(), value.Size(), 10000), 200);
+
+	ByteBuffer body;
+	EXPECT_EQ(Core::HttpGet(url, &body, 10000), 200);
+	EXPECT_TRUE(body == value);
+
+	EXPECT_EQ(Core::HttpGet(url + U"4", &body, 10000), 404);
+	EXPECT_TRUE(body.IsEmpty());
+
+	// The body is larger than the caller accepts
+	EXPECT_EQ(Core::HttpGet(url, &body, 10000, value.Size() - 1), 0);
+
+	t.Join();
+
+	sys_net_close(srv.s);
+}
+
+TEST(Core, Http)
+{
+	UT_MEM_CHECK_INIT();
+
+	test_parse_url();
+	test_no_server();
+	test_round_trip();
+
+	UT_MEM_CHECK();
+}
+
+UT_END();
@@ -0,0 +1,101 @@
+#include "Kyty/Core/JobSystem.h"
+#include "Kyty/Core/Threads.h"
+#include "Kyty/Core/Vector.h"
+#include "Kyty/UnitTest.h"
+
+#include <atomic>
+
+UT_BEGIN(CoreJobSystem);
+
+using Core::JobPriority;
+using Core::JobSystem;
+using Core::TaskGroup;
+
+static void test_parallel_for()
+{
+	EXPECT_GE(JobSystem::GetWorkersNum(), 1);
+	EXPECT_FALSE(JobSystem::IsWorkerThread());
+
+	Vector<uint32_t> v;
+	for (int i = 0; i < 10000; i++)
+	{
+		v.Add(0);
+	}
+
+	auto* data = v.GetData();
+	JobSystem::ParallelFor(v.Size(), [data](uint32_t i) { data[i] += i; });
+	JobSystem::ParallelFor(v.Size(), [data](uint32_t i) { data[i] += 1; }, JobPriority::High);
+	JobSystem::ParallelFor(0, [&v](uint32_t /*i*/) { v.Clear(); });
+
+	bool ok = true;
+	for (uint32_t i = 0; i < v.Size(); i++)
+	{
+		ok = ok && v[i] == i + 1;
+	}
+	EXPECT_EQ(v.Size(), 10000u);
+	EXPECT_TRUE(ok);
+}
+
+// Jobs add more jobs to their group, the continuation sees all of them finished
+static void test_group()
+{
+	std::atomic_int sum      = 0;
+	std::atomic_int then_sum = 0;
+
+	TaskGroup g;
+	for (int i = 0; i < 100; i++)
+	{
+		g.Run([&g, &sum]() { g.Run(10, [&sum](uint32_t j) { sum += static_cast<int>(j); }, JobPriority::Low); });
+	}
+	g.Then([&sum, &then_sum]() { then_sum = sum.load(); });
+	g.Wait();
+
+	EXPECT_TRUE(g.IsDone());
+	EXPECT_EQ(sum.load(), 100 * 45);
+	EXPECT_EQ(then_sum.load(), 100 * 45);
+
+	// The group can be reused, a continuation of an idle group runs at once
+	g.Then([&then_sum]() { then_sum = -1; });
+	g.Wait();
+	EXPECT_EQ(then_sum.load(), -1);
+
+	// Nested waits inside the jobs
+	sum = 0;
+	JobSystem::ParallelFor(16, [&sum](uint32_t /*i*/) { JobSystem::ParallelFor(16, [&sum](uint32_t j) { sum += static_cast<int>(j); }); });
+	EXPECT_EQ(sum.load(), 16 * 120);
+}
+
+static void test_submit()
+{
+	Core::Mutex     mutex;
+	Core::CondVar   cond_var;
+	std::atomic_int done = 0;
+
+	for (int i = 0; i < 64; i++)
+	{
+		JobSystem::Submit(
+		    [&]()
+		    {
+			    Core::LockGuard lock(mutex);
+			    done++;
+			    cond_var.Signal();
+		    },
+		    static_cast<JobPriority>(i % Core::JOB_PRIORITIES_NUM));
+	}
+
+	Core::LockGuard lock(mutex);
+	while (done.load() != 64)
+	{
+		cond_var.Wait(&mutex);
+	}
+	EXPECT_EQ(done.load(), 64);
+}
+
+TEST(Core, JobSystem)
+{
+	test_parallel_for();
+	test_group();
+	test_submit();
+}
+
+UT_END();
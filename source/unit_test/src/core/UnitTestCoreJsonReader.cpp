@@ -0,0 +1,156 @@
+#include "Kyty/Core/JsonReader.h"
+#include "Kyty/Core/String8.h"
+#include "Kyty/Core/StringView8.h"
+#include "Kyty/UnitTest.h"
+
+UT_BEGIN(CoreJsonReader);
+
+using Core::JsonSax;
+using Core::JsonSaxHandler;
+using Core::String8;
+using Core::StringView8;
+
+// Writes the events back as compact JSON
+class Printer: public JsonSaxHandler
+{
+public:
+	bool Null() override { return Add("null"); }
+	bool Bool(bool value) override { return Add(value ? "true" : "false"); }
+	bool Int(int64_t value) override { return Add(String8::FromPrintf("%" PRId64, value)); }
+	bool Uint(uint64_t value) override { return Add(String8::FromPrintf("%" PRIu64 "u", value)); }
+	bool Float(double value) override { return Add(String8::FromPrintf("%g", value)); }
+	bool Str(StringView8 value, bool escaped) override
+	{
+		return Add("\"" + (escaped ? JsonSax::Unescape(value) : value.ToString8()) + "\"");
+	}
+	bool Key(StringView8 key, bool /*escaped*/) override
+	{
+		Add("\"" + key.ToString8() + "\":");
+		m_comma = false;
+		return key != "stop";
+	}
+	bool StartObject() override { return Open('{'); }
+	bool EndObject() override { return Close('}'); }
+	bool StartArray() override { return Open('['); }
+	bool EndArray() override { return Close(']'); }
+
+	String8 out;
+
+private:
+	bool Add(const String8& str)
+	{
+		out += (m_comma ? "," : "");
+		out += str;
+		m_comma = true;
+		return true;
+	}
+	bool Open(char c)
+	{
+		Add(String8(c));
+		m_comma = false;
+		return true;
+	}
+	bool Close(char c)
+	{
+		out += c;
+		m_comma = true;
+		return true;
+	}
+
+	bool m_comma = false;
+};
+
+static String8 print(const char* json, bool* ok = nullptr, uint32_t* error_offset = nullptr)
+{
+	Printer p;
+	bool    result = JsonSax::Parse(json, &p, error_offset);
+	if (ok != nullptr)
+	{
+		*ok = result;
+	}
+	return p.out;
+}
+
+static void test_parse()
+{
+	EXPECT_EQ(print(R"( {"a": 1, "b" : [true, false, null, -12, 1.5, 2e3], "c": {}, "d": [], "e": "x\"y"} )"),
+	          String8(R"({"a":1,"b":[true,false,null,-12,1.5,2000],"c":{},"d":[],"e":"x"y"})"));
+
+	EXPECT_EQ(print("[9223372036854775807, -9223372036854775808, 18446744073709551615]"),
+	          String8("[9223372036854775807,-9223372036854775808,18446744073709551615u]"));
+	EXPECT_EQ(print("[18446744073709551616, -9223372036854775809, 1.0, -0, 0.5e-1, 1E+2]"),
+	          String8("[1.84467e+19,-9.22337e+18,1,0,0.05,100]"));
+	EXPECT_EQ(print("[\"\\u0041\\u00e9\\ud83d\\ude00\\n\"]"), String8("[\"A\xc3\xa9\xf0\x9f\x98\x80\n\"]"));
+
+	bool     ok     = true;
+	uint32_t offset = 0;
+
+	print(R"({"a": 1,})", &ok, &offset);
+	EXPECT_FALSE(ok);
+	EXPECT_EQ(offset, 8u);
+
+	print(R"([1, 2] 3)", &ok, &offset);
+	EXPECT_FALSE(ok);
+	EXPECT_EQ(offset, 7u);
+
+	print(R"(["abc)", &ok, &offset);
+	EXPECT_FALSE(ok);
+
+	print("[tru]", &ok);
+	EXPECT_FALSE(ok);
+
+	// Not JSON numbers
+	for (const char* json: {"+1", ".5", "1.", "01", "-01", "-", "1e", "1e+", "1.e5", "-.5", "0x10", "[1.5.5]"})
+	{
+		ok = true;
+		print(json, &ok);
+		EXPECT_FALSE(ok) << json;
+	}
+
+	// Stopped by the handler
+	EXPECT_EQ(print(R"({"a": 1, "stop": 2, "c": 3})", &ok), String8(R"({"a":1,"stop":)"));
+	EXPECT_FALSE(ok);
+
+	String8 deep;
+	for (int i = 0; i < 2000; i++)
+	{
+		deep += (i < 1000 ? '[' : ']');
+	}
+	print(deep.GetDataConst(), &ok);
+	EXPECT_FALSE(ok);
+}
+
+// The views point into the input
+static void test_views()
+{
+	class Keys: public JsonSaxHandler
+	{
+	public:
+		bool Key(StringView8 key, bool /*escaped*/) override
+		{
+			keys.Add(key);
+			return true;
+		}
+		Core::StringViewList8 keys;
+	};
+
+	const char* json = R"({"first": 1, "second": {"third": 2}})";
+
+	Keys k;
+	EXPECT_TRUE(JsonSax::Parse(json, &k));
+	EXPECT_EQ(k.keys.Size(), 3u);
+	EXPECT_EQ(k.keys[0].GetDataConst(), json + 2);
+	EXPECT_TRUE(k.keys[2] == "third");
+}
+
+TEST(Core, JsonReader)
+{
+	UT_MEM_CHECK_INIT();
+
+	test_parse();
+	test_views();
+
+	UT_MEM_CHECK();
+}
+
+UT_END();
@@ -1,4 +1,5 @@
 #include "Kyty/Core/MSpace.h"
+#include "Kyty/Core/Threads.h"
 #include "Kyty/Core/Vector.h"
 #include "Kyty/Math/Rand.h"
 #include "Kyty/UnitTest.h"
@@ -211,6 +212,107 @@ static void test_fill()
 	delete[] buf;
 }
 
+struct TestThread
+{
+	Core::mspace_t m       = nullptr;
+	void**         foreign = nullptr; // allocated by the main thread, freed by this one
+	uint32_t       seed    = 0;
+	bool           ok      = true;
+};
+
+static void test_thread_func(void* arg)
+{
+	auto* t   = static_cast<TestThread*>(arg);
+	auto  rnd = [t]() { return (t->seed = t->seed * 1103515245u + 12345u) >> 8u; };
+
+	for (int i = 0; i < 100; i++)
+	{
+		MSpaceFree(t->m, t->foreign[i]);
+	}
+
+	TestRecord rs[64];
+
+	for (int i = 0; i < 20000; i++)
+	{
+		auto& r = rs[rnd() % 64];
+		if (r.buf != nullptr)
+		{
+			for (uint32_t j = 0; j < r.size; j++)
+			{
+				if (r.buf[j] != r.pattern)
+				{
+					t->ok = false;
+				}
+			}
+			MSpaceFree(t->m, r.buf);
+		}
+		r.size    = (rnd() % 8 == 0 ? rnd() % 2000 : rnd() % 200) + 1;
+		r.pattern = static_cast<uint8_t>(rnd());
+		r.buf     = static_cast<uint8_t*>(MSpaceMalloc(t->m, r.size));
+		if (r.buf == nullptr)
+		{
+			t->ok = false;
+			return;
+		}
+		memset(r.buf, r.pattern, r.size);
+	}
+
+	for (auto& r: rs)
+	{
+		if (r.buf != nullptr)
+		{
+			MSpaceFree(t->m, r.buf);
+		}
+	}
+}
+
+// Small chunks go through the lock-free bins, some of them are freed by another thread
+static void test_threads()
+{
+	constexpr int THREADS_NUM = 4;
+
+	uint32_t s   = 1024 * 1024;
+	auto*    buf = new uint8_t[s];
+
+	auto* m = MSpaceCreate("test", buf, s, true, nullptr);
+	EXPECT_NE(m, nullptr);
+
+	void*      foreign[THREADS_NUM][100];
+	TestThread ts[THREADS_NUM];
+	for (int i = 0; i < THREADS_NUM; i++)
+	{
+		for (auto& p: foreign[i])
+		{
+			p = MSpaceMalloc(m, Rand::UintInclusiveRange(1, 100));
+		}
+		ts[i].m       = m;
+		ts[i].foreign = foreign[i];
+		ts[i].seed    = Rand::Uint();
+	}
+
+	Core::Thread* threads[THREADS_NUM] = {};
+	for (int i = 0; i < THREADS_NUM; i++)
+	{
+		threads[i] = new Core::Thread(test_thread_func, &ts[i]);
+	}
+	for (auto* t: threads)
+	{
+		t->Join();
+		delete t;
+	}
+
+	for (const auto& t: ts)
+	{
+		EXPECT_TRUE(t.ok);
+	}
+
+	// Everything is freed, so the cached chunks must merge back
+	EXPECT_NE(MSpaceMalloc(m, s / 2), nullptr);
+
+	EXPECT_TRUE(MSpaceDestroy(m));
+	delete[] buf;
+}
+
 TEST(Core, MSpace)
 {
 	UT_MEM_CHECK_INIT();
@@ -224,6 +326,8 @@ TEST(Core, MSpace)
 		test_fill();
 	}
 
+	test_threads();
+
 	UT_MEM_CHECK();
 }
 
@@ -0,0 +1,187 @@
+#include "Kyty/Core/ByteBuffer.h"
+#include "Kyty/Core/File.h"
+#include "Kyty/Core/SharedStore.h"
+#include "Kyty/UnitTest.h"
+
+UT_BEGIN(CoreSharedStore);
+
+using Core::ByteBuffer;
+using Core::File;
+using Core::SharedStore;
+
+static const char* g_file_name = "_unit_test_shared_store.bin";
+
+static ByteBuffer create_value(uint32_t size, uint32_t seed)
+{
+	return UnitTest::CreateData(size, [seed](uint32_t i) { return (i * 7 + seed) & 0xff; });
+}
+
+// Two stores of one file stand for two processes
+static void test_shared()
+{
+	String file_name = String::FromUtf8(g_file_name);
+
+	File::DeleteFile(file_name);
+
+	{
+		SharedStore s1;
+		SharedStore s2;
+		ASSERT_TRUE(s1.Open(file_name));
+		ASSERT_TRUE(s2.Open(file_name));
+
+		ByteBuffer value;
+		EXPECT_FALSE(s2.Find(1, &value));
+
+		for (uint32_t i = 0; i < 100; i++)
+		{
+			EXPECT_TRUE(s1.Append(i, create_value(i * 13, i)));
+		}
+		EXPECT_TRUE(s1.Append(1000, nullptr, 0));
+
+		// Appended by the other store
+		EXPECT_TRUE(s2.Find(50, &value));
+		EXPECT_TRUE(value == create_value(50 * 13, 50));
+		EXPECT_TRUE(s2.Find(1000, &value));
+		EXPECT_TRUE(value.IsEmpty());
+		EXPECT_EQ(s2.GetRecordsNum(), 101u);
+
+		// The first record of a key wins
+		EXPECT_FALSE(s2.Append(50, create_value(10, 0)));
+		EXPECT_TRUE(s2.Append(2000, create_value(5000, 1)));
+		EXPECT_FALSE(s1.Append(2000, create_value(10, 0)));
+		EXPECT_TRUE(s1.Find(2000, &value));
+		EXPECT_TRUE(value == create_value(5000, 1));
+	}
+
+	{
+		SharedStore s;
+		ASSERT_TRUE(s.Open(file_name));
+		EXPECT_EQ(s.GetRecordsNum(), 102u);
+
+		ByteBuffer value;
+		for (uint32_t i = 0; i < 100; i++)
+		{
+			EXPECT_TRUE(s.Find(i, &value));
+			EXPECT_TRUE(value == create_value(i * 13, i));
+		}
+		EXPECT_FALSE(s.Find(3000, &value));
+	}
+
+	// Not a store
+	{
+		File f;
+		ASSERT_TRUE(f.Create(file_name));
+		f.Write(create_value(100, 0));
+		f.Close();
+
+		SharedStore s;
+		EXPECT_FALSE(s.Open(file_name));
+		EXPECT_TRUE(s.IsInvalid());
+	}
+
+	EXPECT_TRUE(File::DeleteFile(file_name));
+}
+
+// A newer record replaces a broken one
+static void test_broken()
+{
+	String file_name = String::FromUtf8(g_file_name);
+
+	File::DeleteFile(file_name);
+
+	{
+		SharedStore s;
+		ASSERT_TRUE(s.Open(file_name));
+		EXPECT_TRUE(s.Append(1, create_value(64, 1)));
+		EXPECT_TRUE(s.Append(2, create_value(64, 2)));
+	}
+
+	// The last byte of the value of the key 2
+	{
+		File f;
+		ASSERT_TRUE(f.Open(file_name, File::Mode::ReadWrite));
+		f.Seek(f.Size() - 1);
+		uint8_t b = 0x55;
+		f.Write(&b, 1);
+		f.Close();
+	}
+
+	{
+		SharedStore s;
+		ASSERT_TRUE(s.Open(file_name));
+
+		ByteBuffer value;
+		EXPECT_TRUE(s.Find(1, &value));
+		EXPECT_FALSE(s.Find(2, &value));
+		EXPECT_FALSE(s.Append(1, create_value(10, 0)));
+		EXPECT_TRUE(s.Append(2, create_value(32, 3)));
+		EXPECT_TRUE(s.Find(2, &value));
+		EXPECT_TRUE(value == create_value(32, 3));
+	}
+
+	{
+		SharedStore s;
+		ASSERT_TRUE(s.Open(file_name));
+
+		ByteBuffer value;
+		EXPECT_TRUE(s.Find(2, &value));
+		EXPECT_TRUE(value == create_value(32, 3));
+	}
+
+	EXPECT_TRUE(File::DeleteFile(file_name));
+}
+
+// The file doesn't grow over the limit, the oldest records are dropped
+static void test_compaction()
+{
+	String file_name = String::FromUtf8(g_file_name);
+
+	File::DeleteFile(file_name);
+
+	{
+		SharedStore s1;
+		SharedStore s2;
+		ASSERT_TRUE(s1.Open(file_name, SharedStore::SIZE_MAX_MIN));
+		ASSERT_TRUE(s2.Open(file_name, SharedStore::SIZE_MAX_MIN));
+
+		for (uint32_t i = 0; i < 200; i++)
+		{
+			EXPECT_TRUE(s1.Append(i, create_value(1000, i)));
+		}
+
+		File f;
+		ASSERT_TRUE(f.Open(file_name, File::Mode::Read));
+		EXPECT_LE(f.Size(), SharedStore::SIZE_MAX_MIN);
+		f.Close();
+
+		ByteBuffer value;
+		EXPECT_FALSE(s1.Find(0, &value));
+		EXPECT_TRUE(s1.Find(199, &value));
+		EXPECT_TRUE(value == create_value(1000, 199));
+
+		// The other store indexes the compacted file again
+		EXPECT_FALSE(s2.Find(0, &value));
+		EXPECT_TRUE(s2.Find(199, &value));
+		EXPECT_TRUE(value == create_value(1000, 199));
+		EXPECT_TRUE(s2.Append(0, create_value(1000, 5)));
+		EXPECT_TRUE(s1.Find(0, &value));
+		EXPECT_TRUE(value == create_value(1000, 5));
+
+		EXPECT_FALSE(s1.Append(1000, create_value(SharedStore::SIZE_MAX_MIN / 2, 0)));
+	}
+
+	EXPECT_TRUE(File::DeleteFile(file_name));
+}
+
+TEST(Core, SharedStore)
+{
+	UT_MEM_CHECK_INIT();
+
+	test_shared();
+	test_broken();
+	test_compaction();
+
+	UT_MEM_CHECK();
+}
+
+UT_END();
@@ -0,0 +1,99 @@
+#include "Kyty/Core/SmallVector.h"
+#include "Kyty/Core/String.h"
+#include "Kyty/UnitTest.h"
+
+UT_BEGIN(CoreSmallVector);
+
+using Core::SmallVector;
+
+static void test_int()
+{
+	SmallVector<int, 4> v;
+
+	EXPECT_TRUE(v.IsEmpty());
+	EXPECT_EQ(v.Capacity(), 4u);
+
+	for (int i = 0; i < 4; i++)
+	{
+		v.Add(i);
+	}
+	EXPECT_EQ(v.Size(), 4u);
+	EXPECT_EQ(v.Capacity(), 4u);
+
+	// Switches to the heap
+	v.Add(4);
+	v.Add(v[0]);
+	EXPECT_EQ(v.Size(), 6u);
+	EXPECT_GT(v.Capacity(), 4u);
+	EXPECT_EQ(v[5], 0);
+
+	EXPECT_EQ(v.Find(3), 3u);
+	EXPECT_FALSE(v.IndexValid(v.Find(10)));
+	EXPECT_TRUE(v.Remove(3));
+	EXPECT_FALSE(v.Contains(3));
+	EXPECT_TRUE(v.RemoveAt(0, 2));
+	EXPECT_EQ(v.Size(), 3u);
+	EXPECT_EQ(v[0], 2);
+	EXPECT_EQ(v[1], 4);
+	EXPECT_EQ(v[2], 0);
+
+	v.Sort([](int a, int b) { return a < b; });
+	EXPECT_EQ(v[0], 0);
+	EXPECT_EQ(v[2], 4);
+
+	int sum = 0;
+	for (int i: v)
+	{
+		sum += i;
+	}
+	EXPECT_EQ(sum, 6);
+
+	v.Clear();
+	EXPECT_TRUE(v.IsEmpty());
+}
+
+static void test_string()
+{
+	SmallVector<String, 2> v {U"a", U"b"};
+
+	SmallVector<String, 2> c(v);
+	c.Add(U"c");
+	EXPECT_EQ(v.Size(), 2u);
+	EXPECT_EQ(c.Size(), 3u);
+	EXPECT_EQ(c[2], U"c");
+
+	// Heap buffer is stolen
+	const auto*            data = c.GetDataConst();
+	SmallVector<String, 2> m(std::move(c));
+	EXPECT_EQ(m.GetDataConst(), data);
+	EXPECT_TRUE(c.IsEmpty()); // NOLINT(bugprone-use-after-move,hicpp-invalid-access-moved)
+
+	// Inline elements are moved one by one
+	SmallVector<String, 2> m2(std::move(v));
+	EXPECT_EQ(m2.Size(), 2u);
+	EXPECT_EQ(m2[1], U"b");
+
+	m = m2;
+	EXPECT_EQ(m.Size(), 2u);
+	EXPECT_EQ(m[0], U"a");
+
+	SmallVector<String, 0> h;
+	for (int i = 0; i < 100; i++)
+	{
+		h.Add(String::FromPrintf("%d", i));
+	}
+	EXPECT_EQ(h.Size(), 100u);
+	EXPECT_EQ(h[99], U"99");
+}
+
+TEST(Core, SmallVector)
+{
+	UT_MEM_CHECK_INIT();
+
+	test_int();
+	test_string();
+
+	UT_MEM_CHECK();
+}
+
+UT_END();
@@ -63,6 +63,27 @@ void test_char()
 	EXPECT_EQ(Char::ToLower(U'T'), U't');
 	EXPECT_EQ(Char::ToLower(U'Ц'), U'ц');
 	EXPECT_EQ(Char::ToLower(U'?'), U'?');
+
+	// The inline ASCII path must agree with the tables
+	for (char32_t c = 0; c < 0x80; c++)
+	{
+		const CharProperty& p = Char::GetProperty(c);
+		EXPECT_EQ(Char::IsDecimal(c), p.decimal != 0);
+		EXPECT_EQ(Char::IsAlpha(c), p.alpha != 0);
+		EXPECT_EQ(Char::IsAlphaNum(c), p.alpha != 0 || p.decimal != 0);
+		EXPECT_EQ(Char::IsLower(c), p.lower != 0);
+		EXPECT_EQ(Char::IsUpper(c), p.upper != 0);
+		EXPECT_EQ(Char::IsSpace(c), p.space != 0);
+		EXPECT_EQ(Char::IsHex(c), p.hex != 0);
+		EXPECT_EQ(Char::HexDigit(c), p.hex != 0 ? p.hex_data : -1);
+		EXPECT_EQ(Char::DecimalDigit(c), p.decimal != 0 ? p.hex_data : -1);
+		EXPECT_EQ(Char::ToLower(c), p.upper != 0 ? c + p.case_offset : c);
+		EXPECT_EQ(Char::ToUpper(c), p.lower != 0 ? c + p.case_offset : c);
+	}
+
+	EXPECT_TRUE(!Char::IsAlpha(0x110000));
+	EXPECT_TRUE(!Char::IsSpace(0xffffffff));
+	EXPECT_EQ(Char::ToUpper(0xffffffff), 0xffffffffU);
 }
 
 void test()
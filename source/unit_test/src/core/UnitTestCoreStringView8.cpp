@@ -0,0 +1,70 @@
+#include "Kyty/Core/FlatHashmap.h"
+#include "Kyty/Core/String.h"
+#include "Kyty/Core/String8.h"
+#include "Kyty/Core/StringView8.h"
+#include "Kyty/UnitTest.h"
+
+UT_BEGIN(CoreStringView8);
+
+using Core::StringView8;
+
+static void test_view()
+{
+	const char* path = "/app0/data/file.bin";
+
+	StringView8 v(path);
+	EXPECT_EQ(v.Size(), 19u);
+	EXPECT_TRUE(v.StartsWith("/app0/"));
+	EXPECT_TRUE(v.EndsWith(".bin"));
+	EXPECT_TRUE(v.StartsWith('/'));
+	EXPECT_FALSE(v.EndsWith('/'));
+	EXPECT_TRUE(v.Mid(6, 4) == "data");
+	EXPECT_TRUE(v.Left(5) == "/app0");
+	EXPECT_TRUE(v.RemoveFirst(11) == "file.bin");
+	EXPECT_TRUE(v.Mid(100).IsEmpty());
+	EXPECT_EQ(v.FindIndex('/', 1), 5u);
+	EXPECT_EQ(v.FindLastIndex('/'), 10u);
+	EXPECT_FALSE(v.IndexValid(v.FindIndex('#')));
+
+	auto parts = v.Split('/');
+	EXPECT_EQ(parts.Size(), 3u);
+	EXPECT_TRUE(parts[0] == "app0");
+	EXPECT_TRUE(parts[2] == "file.bin");
+	EXPECT_EQ(parts[2].GetDataConst(), path + 11);
+
+	auto ids = StringView8("name##mod").Split('#', StringView8::SplitType::WithEmptyParts);
+	EXPECT_EQ(ids.Size(), 3u);
+	EXPECT_TRUE(ids[1].IsEmpty());
+	EXPECT_TRUE(ids[2] == "mod");
+
+	EXPECT_EQ(v.ToString8(), path);
+	EXPECT_EQ(v.ToString(), U"/app0/data/file.bin");
+	EXPECT_EQ(StringView8("\xd0\xb0\xd0\xb1").ToString(), U"аб");
+}
+
+static void test_lookup()
+{
+	Core::FlatHashmap<String8, int, Core::StringHash8> m;
+
+	m.Put("/app0/a", 1);
+	m.Put("/app0/b", 2);
+
+	const char* buf = "/app0/b/c";
+
+	const auto* v = m.FindEquivalent(StringView8(buf, 7));
+	ASSERT_NE(v, nullptr);
+	EXPECT_EQ(*v, 2);
+	EXPECT_EQ(m.FindEquivalent(StringView8(buf)), nullptr);
+}
+
+TEST(Core, StringView8)
+{
+	UT_MEM_CHECK_INIT();
+
+	test_view();
+	test_lookup();
+
+	UT_MEM_CHECK();
+}
+
+UT_END();
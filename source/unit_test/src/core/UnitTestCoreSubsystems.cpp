@@ -0,0 +1,153 @@
+#include "Kyty/Core/Subsystems.h"
+#include "Kyty/Core/Threads.h"
+#include "Kyty/UnitTest.h"
+
+#include <cstring>
+
+UT_BEGIN(CoreSubsystems);
+
+using Core::LockGuard;
+using Core::Mutex;
+using Core::Subsystem;
+using Core::SubsystemsList;
+using Core::Thread;
+
+struct TestLog
+{
+	Mutex mutex;
+	char  order[32] = {};
+	int   num       = 0;
+	int   main_id   = 0;
+	bool  off_main  = false;
+};
+
+static TestLog* g_log = nullptr;
+
+class TestSubsystem: public Subsystem
+{
+public:
+	TestSubsystem(const char* id, bool main_only, bool fail = false): m_id(id), m_main_only(main_only), m_fail(fail) {}
+	~TestSubsystem() override = default;
+
+	const char* Id() override { return m_id; }
+
+	void Init(SubsystemsList* /*parent*/) override
+	{
+		// Give the others a chance to run at the same time
+		Thread::Sleep(10);
+
+		LockGuard lock(g_log->mutex);
+		g_log->order[g_log->num++] = m_id[0];
+		if (Thread::GetThreadIdUnique() != g_log->main_id)
+		{
+			EXPECT_FALSE(m_main_only);
+			g_log->off_main = true;
+		}
+		if (m_fail)
+		{
+			KYTY_SUBSYSTEM_FAIL("%s failed", m_id);
+		}
+	}
+
+	void Destroy(SubsystemsList* /*parent*/) override { g_log->order[g_log->num++] = static_cast<char>(m_id[0] - 'a' + 'A'); }
+
+	void UnexpectedShutdown(SubsystemsList* /*parent*/) override {}
+
+	KYTY_CLASS_NO_COPY(TestSubsystem);
+
+private:
+	const char* m_id;
+	bool        m_main_only;
+	bool        m_fail;
+};
+
+static bool before(const char* order, char a, char b)
+{
+	const char* pa = std::strchr(order, a);
+	const char* pb = std::strchr(order, b);
+	return pa != nullptr && pb != nullptr && pa < pb;
+}
+
+static void test_order(int workers_num)
+{
+	TestLog log;
+	log.main_id = Thread::GetThreadIdUnique();
+	g_log       = &log;
+
+	TestSubsystem a("a", true);
+	TestSubsystem b("b", false);
+	TestSubsystem c("c", false);
+	TestSubsystem d("d", false);
+	TestSubsystem e("e", true);
+
+	auto* list = new SubsystemsList;
+	list->Add(&a, {});
+	list->AddConcurrent(&b, {&a});
+	list->AddConcurrent(&c, {&a});
+	list->AddConcurrent(&d, {&b});
+	list->Add(&e, {&c, &d});
+
+	EXPECT_TRUE(list->InitAll(false, workers_num));
+	EXPECT_EQ(log.num, 5);
+	EXPECT_TRUE(before(log.order, 'a', 'b'));
+	EXPECT_TRUE(before(log.order, 'a', 'c'));
+	EXPECT_TRUE(before(log.order, 'b', 'd'));
+	EXPECT_TRUE(before(log.order, 'c', 'e'));
+	EXPECT_TRUE(before(log.order, 'd', 'e'));
+	EXPECT_EQ(log.off_main, workers_num > 0);
+
+	// Reverse of the init order
+	list->DestroyAll();
+	EXPECT_EQ(log.num, 10);
+	for (int i = 0; i < 5; i++)
+	{
+		EXPECT_EQ(log.order[9 - i], log.order[i] - 'a' + 'A');
+	}
+
+	delete list;
+	g_log = nullptr;
+}
+
+static void test_fail()
+{
+	TestLog log;
+	log.main_id = Thread::GetThreadIdUnique();
+	g_log       = &log;
+
+	TestSubsystem a("a", true);
+	TestSubsystem b("b", false, true);
+	TestSubsystem c("c", false);
+	TestSubsystem d("d", true);
+
+	auto* list = new SubsystemsList;
+	list->Add(&a, {});
+	list->AddConcurrent(&b, {&a});
+	list->AddConcurrent(&c, {&a});
+	list->Add(&d, {&b, &c});
+
+	EXPECT_FALSE(list->InitAll(false, 2));
+	EXPECT_STREQ(list->GetFailName(), "b");
+	EXPECT_EQ(std::strchr(log.order, 'd'), nullptr);
+
+	// The failed one is not destroyed
+	list->DestroyAll();
+	EXPECT_EQ(std::strchr(log.order, 'B'), nullptr);
+	EXPECT_NE(std::strchr(log.order, 'A'), nullptr);
+	EXPECT_NE(std::strchr(log.order, 'C'), nullptr);
+
+	delete list;
+	g_log = nullptr;
+}
+
+TEST(Core, Subsystems)
+{
+	UT_MEM_CHECK_INIT();
+
+	test_order(0);
+	test_order(3);
+	test_fail();
+
+	UT_MEM_CHECK();
+}
+
+UT_END();
@@ -0,0 +1,122 @@
+#include "Kyty/Core/Threads.h"
+#include "Kyty/UnitTest.h"
+
+UT_BEGIN(CoreThreads);
+
+using Core::CondVar;
+using Core::LockGuard;
+using Core::Mutex;
+using Core::Thread;
+
+struct TestShared
+{
+	Mutex    mutex;
+	CondVar  cond_var;
+	uint32_t counter  = 0;
+	bool     locked   = false;
+	bool     try_lock = true;
+};
+
+static void test_try_lock_func(void* arg)
+{
+	auto* s = static_cast<TestShared*>(arg);
+
+	s->try_lock = s->mutex.TryLock();
+	if (s->try_lock)
+	{
+		s->mutex.Unlock();
+	}
+}
+
+static void test_recursive()
+{
+	TestShared s;
+
+	s.mutex.Lock();
+	s.mutex.Lock();
+	EXPECT_TRUE(s.mutex.TryLock());
+	s.mutex.Unlock();
+	s.mutex.Unlock();
+
+	// Still locked once
+	Thread t1(test_try_lock_func, &s);
+	t1.Join();
+	EXPECT_FALSE(s.try_lock);
+
+	s.mutex.Unlock();
+
+	Thread t2(test_try_lock_func, &s);
+	t2.Join();
+	EXPECT_TRUE(s.try_lock);
+}
+
+static void test_counter_func(void* arg)
+{
+	auto* s = static_cast<TestShared*>(arg);
+
+	for (int i = 0; i < 100000; i++)
+	{
+		LockGuard lock(s->mutex);
+		s->counter++;
+	}
+}
+
+static void test_contended()
+{
+	constexpr int THREADS_NUM = 4;
+
+	TestShared s;
+
+	Thread* threads[THREADS_NUM] = {};
+	for (auto& t: threads)
+	{
+		t = new Thread(test_counter_func, &s);
+	}
+	for (auto* t: threads)
+	{
+		t->Join();
+		delete t;
+	}
+
+	EXPECT_EQ(s.counter, THREADS_NUM * 100000u);
+}
+
+static void test_signal_func(void* arg)
+{
+	auto* s = static_cast<TestShared*>(arg);
+
+	LockGuard lock(s->mutex);
+	s->locked = true;
+	s->cond_var.Signal();
+}
+
+// The mutex is released while waiting and owned again after the wait
+static void test_cond_var()
+{
+	TestShared s;
+
+	LockGuard lock(s.mutex);
+
+	Thread t(test_signal_func, &s);
+	while (!s.locked)
+	{
+		s.cond_var.Wait(&s.mutex);
+	}
+
+	s.cond_var.WaitFor(&s.mutex, 1000);
+
+	Thread t2(test_try_lock_func, &s);
+	t2.Join();
+	EXPECT_FALSE(s.try_lock);
+
+	t.Join();
+}
+
+TEST(Core, Threads)
+{
+	test_recursive();
+	test_contended();
+	test_cond_var();
+}
+
+UT_END();
@@ -0,0 +1,82 @@
+#include "Kyty/Core/VirtualMemory.h"
+#include "Kyty/UnitTest.h"
+
+UT_BEGIN(CoreVirtualMemory);
+
+namespace VirtualMemory = Core::VirtualMemory;
+
+using VirtualMemory::Mode;
+using VirtualMemory::PatchBatch;
+
+constexpr uint64_t PAGE_SIZE = 0x1000;
+
+static Mode get_mode(uint64_t vaddr)
+{
+	Mode old_mode {};
+	VirtualMemory::Protect(vaddr, PAGE_SIZE, Mode::Read, &old_mode);
+	VirtualMemory::Protect(vaddr, PAGE_SIZE, old_mode);
+	return old_mode;
+}
+
+// Pages: Read, Read, ReadWrite, ExecuteRead, (not added), Read
+static void test_patch_batch()
+{
+	uint64_t base = VirtualMemory::Alloc(0, PAGE_SIZE * 6, Mode::ReadWrite);
+	ASSERT_NE(base, 0u);
+
+	VirtualMemory::Protect(base, PAGE_SIZE * 2, Mode::Read);
+	VirtualMemory::Protect(base + PAGE_SIZE * 3, PAGE_SIZE, Mode::ExecuteRead);
+	VirtualMemory::Protect(base + PAGE_SIZE * 5, PAGE_SIZE, Mode::Read);
+
+	const uint64_t sites[] = {base + 8, base + PAGE_SIZE - 4, base + PAGE_SIZE * 2 + 16, base + PAGE_SIZE * 3 + 32,
+	                          base + PAGE_SIZE * 5};
+
+	{
+		PatchBatch batch;
+		for (auto vaddr: sites)
+		{
+			batch.Add(vaddr, sizeof(uint64_t));
+		}
+		// The same page twice
+		batch.Add(base + 16, sizeof(uint64_t));
+
+		batch.Begin();
+
+		// Two runs of the first three pages (Read and ReadWrite), ExecuteRead, the last page
+		EXPECT_EQ(batch.GetRunsNum(), 4u);
+
+		for (auto vaddr: sites)
+		{
+			EXPECT_TRUE(PatchBatch::Replace(vaddr, vaddr));
+		}
+		EXPECT_FALSE(PatchBatch::Replace(sites[0], sites[0]));
+
+		batch.End();
+		EXPECT_EQ(batch.GetRunsNum(), 0u);
+	}
+
+	for (auto vaddr: sites)
+	{
+		EXPECT_EQ(*reinterpret_cast<uint64_t*>(vaddr), vaddr);
+	}
+
+	EXPECT_EQ(get_mode(base), Mode::Read);
+	EXPECT_EQ(get_mode(base + PAGE_SIZE), Mode::Read);
+	EXPECT_EQ(get_mode(base + PAGE_SIZE * 2), Mode::ReadWrite);
+	EXPECT_EQ(get_mode(base + PAGE_SIZE * 3), Mode::ExecuteRead);
+	EXPECT_EQ(get_mode(base + PAGE_SIZE * 4), Mode::ReadWrite);
+	EXPECT_EQ(get_mode(base + PAGE_SIZE * 5), Mode::Read);
+
+	VirtualMemory::Free(base);
+}
+
+TEST(Core, VirtualMemory)
+{
+	UT_MEM_CHECK_INIT();
+
+	test_patch_batch();
+
+	UT_MEM_CHECK();
+}
+
+UT_END();
@@ -0,0 +1,129 @@
+#include "Kyty/Core/ByteBuffer.h"
+#include "Kyty/Core/String8.h"
+#include "Kyty/Math/Crypto.h"
+#include "Kyty/UnitTest.h"
+
+UT_BEGIN(MathCrypto);
+
+using Core::ByteBuffer;
+
+static ByteBuffer create_data(uint32_t size)
+{
+	return UnitTest::CreateData(size,
+	                            [x = 1u](uint32_t /*i*/) mutable
+	                            {
+		                            x = x * 1103515245u + 12345u;
+		                            return x >> 16u;
+	                            });
+}
+
+static uint32_t crc32_bitwise(const uint8_t* buf, uint32_t length)
+{
+	uint32_t crc = 0xFFFFFFFF;
+	for (uint32_t i = 0; i < length; i++)
+	{
+		crc ^= buf[i];
+		for (int j = 0; j < 8; j++)
+		{
+			crc = (crc & 1u) != 0u ? (crc >> 1u) ^ 0xEDB88320u : crc >> 1u;
+		}
+	}
+	return crc ^ 0xFFFFFFFF;
+}
+
+static void test_crc32()
+{
+	EXPECT_EQ(Math::CRC32::Hash(reinterpret_cast<const uint8_t*>("123456789"), 9), 0xCBF43926u);
+
+	ByteBuffer  buf = create_data(1000);
+	const auto* ptr = reinterpret_cast<const uint8_t*>(buf.GetDataConst());
+
+	for (bool cpu: {true, false})
+	{
+		Math::CryptoEnableCpuExtensions(cpu);
+		for (uint32_t offset = 0; offset < 4; offset++)
+		{
+			for (uint32_t length = 0; length < 300; length++)
+			{
+				EXPECT_EQ(Math::CRC32::Hash(ptr + offset, length), crc32_bitwise(ptr + offset, length));
+			}
+		}
+	}
+	Math::CryptoEnableCpuExtensions(true);
+}
+
+static void test_aes()
+{
+	uint8_t key[32];
+	uint8_t iv[16];
+	for (int i = 0; i < 32; i++)
+	{
+		key[i] = static_cast<uint8_t>(i * 3 + 1);
+	}
+	for (int i = 0; i < 16; i++)
+	{
+		iv[i] = static_cast<uint8_t>(i * 5 + 2);
+	}
+
+	for (uint32_t size: {1u, 16u, 17u, 64u, 100u, 1000u})
+	{
+		ByteBuffer src = create_data(size);
+
+		Math::CryptoEnableCpuExtensions(true);
+		ByteBuffer enc_cpu = Math::AES::Encrypt(src, key, iv, Math::AES::Mode::Cbc256Pkcs7Padding);
+		Math::CryptoEnableCpuExtensions(false);
+		ByteBuffer enc_sw = Math::AES::Encrypt(src, key, iv, Math::AES::Mode::Cbc256Pkcs7Padding);
+		EXPECT_EQ(enc_cpu, enc_sw);
+		EXPECT_EQ(Math::AES::Decrypt(enc_sw, key, iv, Math::AES::Mode::Cbc256Pkcs7Padding), src);
+		Math::CryptoEnableCpuExtensions(true);
+		EXPECT_EQ(Math::AES::Decrypt(enc_sw, key, iv, Math::AES::Mode::Cbc256Pkcs7Padding), src);
+	}
+}
+
+// Keeps the results alive, so the compiler doesn't drop the work
+static volatile uint64_t g_sink = 0;
+
+// Package sized buffers, the table code against AES-NI and PCLMULQDQ
+static void test_bench()
+{
+	constexpr uint32_t SIZE = 64 * 1024 * 1024;
+
+	ByteBuffer  buf     = create_data(SIZE);
+	const auto* ptr     = reinterpret_cast<const uint8_t*>(buf.GetDataConst());
+	uint8_t     key[32] = {};
+
+	ByteBuffer enc = Math::AES::Encrypt(buf, key, nullptr, Math::AES::Mode::Cbc256ZeroPadding);
+
+	for (bool cpu: {false, true})
+	{
+		Math::CryptoEnableCpuExtensions(cpu);
+
+		const char* ext = (cpu ? "cpu" : "table");
+
+		UnitTest::Bench(String8::FromPrintf("CRC32 64 MB, %s", ext).c_str(), SIZE,
+		                [&]() { g_sink = g_sink + Math::CRC32::Hash(ptr, SIZE); });
+		UnitTest::Bench(String8::FromPrintf("AES encrypt 64 MB, %s", ext).c_str(), SIZE,
+		                [&]() { g_sink = g_sink + Math::AES::Encrypt(buf, key, nullptr, Math::AES::Mode::Cbc256ZeroPadding).Size(); });
+		UnitTest::Bench(String8::FromPrintf("AES decrypt 64 MB, %s", ext).c_str(), SIZE,
+		                [&]() { g_sink = g_sink + Math::AES::Decrypt(enc, key, nullptr, Math::AES::Mode::Cbc256ZeroPadding).Size(); });
+	}
+
+	Math::CryptoEnableCpuExtensions(true);
+}
+
+TEST(Math, Crypto)
+{
+	UT_MEM_CHECK_INIT();
+
+	test_crc32();
+	test_aes();
+
+	UT_MEM_CHECK();
+}
+
+TEST(Math, DISABLED_CryptoBench)
+{
+	test_bench();
+}
+
+UT_END();
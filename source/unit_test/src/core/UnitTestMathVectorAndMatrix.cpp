@@ -0,0 +1,139 @@
+#include "Kyty/Core/Vector.h"
+#include "Kyty/Math/MathAll.h"
+#include "Kyty/Math/Rand.h"
+#include "Kyty/UnitTest.h"
+
+UT_BEGIN(MathVectorAndMatrix);
+
+using Math::Rand;
+
+static vec4 rand_vec4()
+{
+	return vec4(Rand::FloatRange(-10.0f, 10.0f), Rand::FloatRange(-10.0f, 10.0f), Rand::FloatRange(-10.0f, 10.0f),
+	            Rand::FloatRange(-10.0f, 10.0f));
+}
+
+static mat4 rand_mat4()
+{
+	return mat4(rand_vec4(), rand_vec4(), rand_vec4(), rand_vec4());
+}
+
+static void expect_near(const vec4& a, const vec4& b)
+{
+	for (int i = 0; i < 4; i++)
+	{
+		EXPECT_NEAR(a[i], b[i], 1e-3f * (1.0f + fabsf(b[i])));
+	}
+}
+
+static void expect_near(const mat4& a, const mat4& b)
+{
+	for (int i = 0; i < 4; i++)
+	{
+		expect_near(a[i], b[i]);
+	}
+}
+
+// Column-major reference: m[column][row]
+static vec4 mul_ref(const mat4& m, const vec4& v)
+{
+	vec4 r(0.0f);
+	for (int row = 0; row < 4; row++)
+	{
+		for (int col = 0; col < 4; col++)
+		{
+			r[row] += m[col][row] * v[col];
+		}
+	}
+	return r;
+}
+
+static void test_vec4()
+{
+	for (int n = 0; n < 100; n++)
+	{
+		vec4 a = rand_vec4();
+		vec4 b = rand_vec4();
+		vec4 c = rand_vec4();
+
+		expect_near(a + b, vec4(a.x + b.x, a.y + b.y, a.z + b.z, a.w + b.w));
+		expect_near(a - b, vec4(a.x - b.x, a.y - b.y, a.z - b.z, a.w - b.w));
+		expect_near(a * b, vec4(a.x * b.x, a.y * b.y, a.z * b.z, a.w * b.w));
+		expect_near(a * 3.0f, vec4(a.x * 3.0f, a.y * 3.0f, a.z * 3.0f, a.w * 3.0f));
+		expect_near(Math::m::fma(a, b, c), vec4(a.x * b.x + c.x, a.y * b.y + c.y, a.z * b.z + c.z, a.w * b.w + c.w));
+		expect_near(Math::m::min(a, b), vec4(fminf(a.x, b.x), fminf(a.y, b.y), fminf(a.z, b.z), fminf(a.w, b.w)));
+		expect_near(Math::m::max(a, b), vec4(fmaxf(a.x, b.x), fmaxf(a.y, b.y), fmaxf(a.z, b.z), fmaxf(a.w, b.w)));
+
+		float d = a.x * b.x + a.y * b.y + a.z * b.z + a.w * b.w;
+		EXPECT_NEAR(Math::m::dot(a, b), d, 1e-3f * (1.0f + fabsf(d)));
+		EXPECT_NEAR(Math::m::dot(Math::m::normalize(a), Math::m::normalize(a)), 1.0f, 1e-5f);
+
+		vec4 e = a;
+		e += b;
+		e *= c;
+		e -= a;
+		expect_near(e, (a + b) * c - a);
+	}
+}
+
+static void test_mat4()
+{
+	for (int n = 0; n < 100; n++)
+	{
+		mat4 m1 = rand_mat4();
+		mat4 m2 = rand_mat4();
+		vec4 v  = rand_vec4();
+
+		expect_near(m1 * v, mul_ref(m1, v));
+		expect_near(v * m1, mul_ref(Math::m::transpose(m1), v));
+		expect_near(m1 * m2, mat4(mul_ref(m1, m2[0]), mul_ref(m1, m2[1]), mul_ref(m1, m2[2]), mul_ref(m1, m2[3])));
+		expect_near((m1 * m2) * v, m1 * (m2 * v));
+
+		mat4 t = Math::m::transpose(m1);
+		for (int i = 0; i < 4; i++)
+		{
+			for (int j = 0; j < 4; j++)
+			{
+				EXPECT_EQ(t[i][j], m1[j][i]);
+			}
+		}
+	}
+}
+
+static void test_transform()
+{
+	mat4 m = Math::m::rotate(0.5f, vec3(0.0f, 1.0f, 0.0f));
+	m[3]   = vec4(1.0f, 2.0f, 3.0f, 1.0f);
+
+	Vector<vec4> v4;
+	Vector<vec3> v3;
+	for (int i = 0; i < 37; i++)
+	{
+		v4.Add(rand_vec4());
+		v3.Add(rand_vec4().Xyz());
+	}
+
+	Vector<vec4> r4 = v4;
+	Vector<vec3> r3 = v3;
+	Math::m::transform(m, r4.GetData(), r4.GetData(), r4.Size());
+	Math::m::transform_points(m, r3.GetData(), r3.GetData(), r3.Size());
+
+	for (uint32_t i = 0; i < v4.Size(); i++)
+	{
+		expect_near(r4[i], mul_ref(m, v4[i]));
+		expect_near(vec4(r3[i], 1.0f), mul_ref(m, vec4(v3[i], 1.0f)));
+	}
+}
+
+TEST(Math, VectorAndMatrix)
+{
+	UT_MEM_CHECK_INIT();
+
+	test_vec4();
+	test_mat4();
+	test_transform();
+
+	UT_MEM_CHECK();
+}
+
+UT_END();
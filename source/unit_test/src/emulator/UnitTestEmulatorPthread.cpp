@@ -0,0 +1,300 @@
+#include "Kyty/Core/String8.h"
+#include "Kyty/Core/Threads.h"
+#include "Kyty/Core/Vector.h"
+#include "Kyty/UnitTest.h"
+
+#include "Emulator/Common.h"
+#include "Emulator/Kernel/Pthread.h"
+#include "Emulator/Libs/Errno.h"
+
+#include <type_traits>
+
+UT_BEGIN(EmulatorPthread);
+
+#ifdef KYTY_EMU_ENABLED
+
+using Libs::LibKernel::PthreadMutex;
+using Libs::LibKernel::PthreadRwlock;
+using Libs::LibKernel::PthreadRwlockattr;
+
+namespace LibKernel = Libs::LibKernel;
+
+static constexpr int      THREADS_MAX = 16;
+static constexpr uint32_t OPS         = 20000;
+
+enum class LockBench
+{
+	SharedMutex,
+	OwnMutex,
+	SharedRwlockRead
+};
+
+struct PthreadBench
+{
+	LockBench     type = LockBench::SharedMutex;
+	PthreadMutex  shared_mutex {};
+	PthreadRwlock shared_rwlock {};
+	PthreadMutex  own_mutex[THREADS_MAX] {};
+};
+
+struct PthreadBenchThread
+{
+	PthreadBench* b     = nullptr;
+	int           index = 0;
+};
+
+static void pthread_bench_thread(void* arg)
+{
+	const auto* t = static_cast<PthreadBenchThread*>(arg);
+	auto*       b = t->b;
+
+	int fails = 0;
+
+	for (uint32_t i = 0; i < OPS; i++)
+	{
+		switch (b->type)
+		{
+			case LockBench::SharedMutex:
+				fails += (LibKernel::PthreadMutexLock(&b->shared_mutex) != 0 ? 1 : 0);
+				fails += (LibKernel::PthreadMutexUnlock(&b->shared_mutex) != 0 ? 1 : 0);
+				break;
+			case LockBench::OwnMutex:
+				fails += (LibKernel::PthreadMutexLock(&b->own_mutex[t->index]) != 0 ? 1 : 0);
+				fails += (LibKernel::PthreadMutexUnlock(&b->own_mutex[t->index]) != 0 ? 1 : 0);
+				break;
+			case LockBench::SharedRwlockRead:
+				fails += (LibKernel::PthreadRwlockRdlock(&b->shared_rwlock) != 0 ? 1 : 0);
+				fails += (LibKernel::PthreadRwlockUnlock(&b->shared_rwlock) != 0 ? 1 : 0);
+				break;
+		}
+	}
+
+	EXPECT_EQ(fails, 0);
+}
+
+// Every lock call goes through the static initializer check, which used to take one global lock
+TEST(Emulator, DISABLED_PthreadBench)
+{
+	if (!LibKernel::PthreadIsInitialized())
+	{
+		GTEST_SKIP();
+	}
+
+	auto* b = new PthreadBench;
+
+	EXPECT_EQ(LibKernel::PthreadMutexInit(&b->shared_mutex, nullptr, nullptr), 0);
+	EXPECT_EQ(LibKernel::PthreadRwlockInit(&b->shared_rwlock, nullptr, nullptr), 0);
+	for (auto& m: b->own_mutex)
+	{
+		EXPECT_EQ(LibKernel::PthreadMutexInit(&m, nullptr, nullptr), 0);
+	}
+
+	static const char* names[] = {"shared mutex", "own mutex", "shared rwlock, read"};
+
+	for (auto type: {LockBench::SharedMutex, LockBench::OwnMutex, LockBench::SharedRwlockRead})
+	{
+		b->type = type;
+
+		for (int threads_num: {1, 8, THREADS_MAX})
+		{
+			auto name = String8::FromPrintf("Pthread lock/unlock x%u, %s, %d threads", OPS, names[static_cast<int>(type)], threads_num);
+			UnitTest::Bench(name.c_str(), 0,
+			                [&]()
+			                {
+				                PthreadBenchThread    args[THREADS_MAX];
+				                Vector<Core::Thread*> threads;
+				                for (int i = 0; i < threads_num; i++)
+				                {
+					                args[i].b     = b;
+					                args[i].index = i;
+					                threads.Add(new Core::Thread(pthread_bench_thread, &args[i]));
+				                }
+				                for (auto* t: threads)
+				                {
+					                t->Join();
+					                delete t;
+				                }
+			                });
+		}
+	}
+
+	EXPECT_EQ(LibKernel::PthreadMutexDestroy(&b->shared_mutex), 0);
+	EXPECT_EQ(LibKernel::PthreadRwlockDestroy(&b->shared_rwlock), 0);
+	for (auto& m: b->own_mutex)
+	{
+		EXPECT_EQ(LibKernel::PthreadMutexDestroy(&m), 0);
+	}
+
+	delete b;
+}
+
+// Runs func on another thread and waits for it
+template <class F>
+static void run_thread(F&& func)
+{
+	Core::Thread t([](void* arg) { (*static_cast<std::remove_reference_t<F>*>(arg))(); }, &func);
+	t.Join();
+}
+
+static void rwlock_init(PthreadRwlock* l)
+{
+	PthreadRwlockattr attr = nullptr;
+	ASSERT_EQ(LibKernel::PthreadRwlockattrInit(&attr), OK);
+	ASSERT_EQ(LibKernel::PthreadRwlockInit(l, &attr, "test"), OK);
+	ASSERT_EQ(LibKernel::PthreadRwlockattrDestroy(&attr), OK);
+}
+
+TEST(Emulator, PthreadRwlockTry)
+{
+	PthreadRwlock l = nullptr;
+	rwlock_init(&l);
+
+	EXPECT_EQ(LibKernel::PthreadRwlockTrywrlock(&l), OK);
+	EXPECT_EQ(LibKernel::PthreadRwlockTrywrlock(&l), LibKernel::KERNEL_ERROR_EDEADLK);
+	EXPECT_EQ(LibKernel::PthreadRwlockWrlock(&l), LibKernel::KERNEL_ERROR_EDEADLK);
+	run_thread(
+	    [&]()
+	    {
+		    EXPECT_EQ(LibKernel::PthreadRwlockTryrdlock(&l), LibKernel::KERNEL_ERROR_EBUSY);
+		    EXPECT_EQ(LibKernel::PthreadRwlockTrywrlock(&l), LibKernel::KERNEL_ERROR_EBUSY);
+		    EXPECT_EQ(LibKernel::PthreadRwlockUnlock(&l), LibKernel::KERNEL_ERROR_EPERM);
+	    });
+	EXPECT_EQ(LibKernel::PthreadRwlockUnlock(&l), OK);
+	EXPECT_EQ(LibKernel::PthreadRwlockUnlock(&l), LibKernel::KERNEL_ERROR_EPERM);
+
+	// Recursive read locks
+	EXPECT_EQ(LibKernel::PthreadRwlockTryrdlock(&l), OK);
+	EXPECT_EQ(LibKernel::PthreadRwlockRdlock(&l), OK);
+	run_thread(
+	    [&]()
+	    {
+		    EXPECT_EQ(LibKernel::PthreadRwlockTryrdlock(&l), OK);
+		    EXPECT_EQ(LibKernel::PthreadRwlockTrywrlock(&l), LibKernel::KERNEL_ERROR_EBUSY);
+		    EXPECT_EQ(LibKernel::PthreadRwlockUnlock(&l), OK);
+	    });
+	EXPECT_EQ(LibKernel::PthreadRwlockUnlock(&l), OK);
+	EXPECT_EQ(LibKernel::PthreadRwlockUnlock(&l), OK);
+	EXPECT_EQ(LibKernel::PthreadRwlockUnlock(&l), LibKernel::KERNEL_ERROR_EPERM);
+
+	EXPECT_EQ(LibKernel::PthreadRwlockDestroy(&l), OK);
+}
+
+// A read lock held in one rwlock doesn't let the thread unlock another one
+TEST(Emulator, PthreadRwlockUnlockNotHeld)
+{
+	PthreadRwlock a = nullptr;
+	PthreadRwlock b = nullptr;
+	rwlock_init(&a);
+	rwlock_init(&b);
+
+	EXPECT_EQ(LibKernel::PthreadRwlockRdlock(&a), OK);
+	EXPECT_EQ(LibKernel::PthreadRwlockUnlock(&b), LibKernel::KERNEL_ERROR_EPERM);
+	EXPECT_EQ(LibKernel::PthreadRwlockTrywrlock(&b), OK);
+	EXPECT_EQ(LibKernel::PthreadRwlockUnlock(&b), OK);
+	EXPECT_EQ(LibKernel::PthreadRwlockUnlock(&a), OK);
+
+	EXPECT_EQ(LibKernel::PthreadRwlockDestroy(&a), OK);
+	EXPECT_EQ(LibKernel::PthreadRwlockDestroy(&b), OK);
+}
+
+TEST(Emulator, PthreadRwlockTimed)
+{
+	PthreadRwlock l = nullptr;
+	rwlock_init(&l);
+
+	// A writer which times out while another one owns the lock leaves it write-locked
+	EXPECT_EQ(LibKernel::PthreadRwlockWrlock(&l), OK);
+	run_thread(
+	    [&]()
+	    {
+		    EXPECT_EQ(LibKernel::PthreadRwlockTimedwrlock(&l, 10000), LibKernel::KERNEL_ERROR_ETIMEDOUT);
+		    EXPECT_EQ(LibKernel::PthreadRwlockTimedrdlock(&l, 10000), LibKernel::KERNEL_ERROR_ETIMEDOUT);
+		    EXPECT_EQ(LibKernel::PthreadRwlockTryrdlock(&l), LibKernel::KERNEL_ERROR_EBUSY);
+		    EXPECT_EQ(LibKernel::PthreadRwlockTrywrlock(&l), LibKernel::KERNEL_ERROR_EBUSY);
+	    });
+	EXPECT_EQ(LibKernel::PthreadRwlockUnlock(&l), OK);
+
+	// A writer which times out while the readers stay lets the new readers in
+	EXPECT_EQ(LibKernel::PthreadRwlockRdlock(&l), OK);
+	run_thread(
+	    [&]()
+	    {
+		    EXPECT_EQ(LibKernel::PthreadRwlockTimedwrlock(&l, 10000), LibKernel::KERNEL_ERROR_ETIMEDOUT);
+		    EXPECT_EQ(LibKernel::PthreadRwlockTryrdlock(&l), OK);
+		    EXPECT_EQ(LibKernel::PthreadRwlockUnlock(&l), OK);
+	    });
+	EXPECT_EQ(LibKernel::PthreadRwlockUnlock(&l), OK);
+
+	EXPECT_EQ(LibKernel::PthreadRwlockTimedwrlock(&l, 10000), OK);
+	EXPECT_EQ(LibKernel::PthreadRwlockUnlock(&l), OK);
+
+	EXPECT_EQ(LibKernel::PthreadRwlockDestroy(&l), OK);
+}
+
+struct RwlockContended
+{
+	PthreadRwlock l      = nullptr;
+	uint32_t      value  = 0; // written only by the writers
+	int           errors = 0;
+};
+
+static void rwlock_contended_thread(void* arg)
+{
+	auto* c = static_cast<RwlockContended*>(arg);
+
+	for (uint32_t i = 0; i < 1000; i++)
+	{
+		if ((i % 4) == 0)
+		{
+			EXPECT_EQ(LibKernel::PthreadRwlockRdlock(&c->l), OK);
+			auto v = c->value;
+			Core::Thread::SleepMicro(1);
+			c->errors += (c->value != v ? 1 : 0);
+			EXPECT_EQ(LibKernel::PthreadRwlockUnlock(&c->l), OK);
+		} else
+		{
+			int result = ((i % 4) == 1 ? LibKernel::PthreadRwlockWrlock(&c->l) : LibKernel::PthreadRwlockTimedwrlock(&c->l, 1000));
+			if (result == LibKernel::KERNEL_ERROR_ETIMEDOUT)
+			{
+				continue;
+			}
+			EXPECT_EQ(result, OK);
+			auto v = c->value;
+			Core::Thread::SleepMicro(1);
+			c->value = v + 1;
+			EXPECT_EQ(LibKernel::PthreadRwlockUnlock(&c->l), OK);
+		}
+	}
+}
+
+// Writers don't lose updates and readers don't see them change, also when the timed writers give up
+TEST(Emulator, PthreadRwlockContended)
+{
+	auto* c = new RwlockContended;
+	rwlock_init(&c->l);
+
+	Vector<Core::Thread*> threads;
+	for (int i = 0; i < 8; i++)
+	{
+		threads.Add(new Core::Thread(rwlock_contended_thread, c));
+	}
+	for (auto* t: threads)
+	{
+		t->Join();
+		delete t;
+	}
+
+	EXPECT_GE(c->value, 8u * 250u);
+	EXPECT_LE(c->value, 8u * 750u);
+	EXPECT_EQ(c->errors, 0);
+
+	EXPECT_EQ(LibKernel::PthreadRwlockTrywrlock(&c->l), OK);
+	EXPECT_EQ(LibKernel::PthreadRwlockUnlock(&c->l), OK);
+	EXPECT_EQ(LibKernel::PthreadRwlockDestroy(&c->l), OK);
+
+	delete c;
+}
+
+#endif // KYTY_EMU_ENABLED
+
+UT_END();
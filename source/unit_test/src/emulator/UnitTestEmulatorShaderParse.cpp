@@ -0,0 +1,86 @@
+#include "Kyty/Core/String8.h"
+#include "Kyty/Core/Vector.h"
+#include "Kyty/UnitTest.h"
+
+#include "Emulator/Common.h"
+#include "Emulator/Graphics/Shader.h"
+#include "Emulator/Graphics/ShaderParse.h"
+
+UT_BEGIN(EmulatorShaderParse);
+
+#ifdef KYTY_EMU_ENABLED
+
+using Libs::Graphics::ShaderCode;
+using Libs::Graphics::ShaderParse;
+using Libs::Graphics::ShaderType;
+
+// Keeps the results alive, so the compiler doesn't drop the work
+static volatile uint64_t g_sink = 0;
+
+// Gen4 compute code: scalar setup, constant loads and a vector ALU body, the mix of a typical decoded shader
+static const uint32_t g_setup[] = {
+    0xBE820301,             // s_mov_b32 s2, s1
+    0xBE8303FF, 0x3f800000, // s_mov_b32 s3, 1.0
+    0x80040201,             // s_add_u32 s4, s1, s2
+    0x8F058204,             // s_lshl_b32 s5, s4, 2
+    0x87060305,             // s_and_b32 s6, s5, s3
+    0xC0840104,             // s_load_dwordx4 s[8:11], s[0:1], 0x4
+    0xBF8C007F,             // s_waitcnt lgkmcnt(0)
+};
+
+static const uint32_t g_body[] = {
+    0x7E000202,             // v_mov_b32 v0, s2
+    0x7E0202FF, 0x40000000, // v_mov_b32 v1, 2.0
+    0x7E040D00,             // v_cvt_f32_u32 v2, v0
+    0x06060501,             // v_add_f32 v3, v1, v2
+    0x10080703,             // v_mul_f32 v4, v3, v3
+};
+
+// The binary info offset in the first instruction lets the parser reserve the instructions
+static Vector<uint32_t> create_shader(uint32_t body_num)
+{
+	Vector<uint32_t> code;
+	code.Add(0xBEEB03FF); // s_mov_b32 vcc_hi, info offset
+	code.Add(0);
+	for (auto dw: g_setup)
+	{
+		code.Add(dw);
+	}
+	for (uint32_t i = 0; i < body_num; i++)
+	{
+		for (auto dw: g_body)
+		{
+			code.Add(dw);
+		}
+	}
+	code.Add(0xBF810000); // s_endpgm
+	code[1] = code.Size() / 2;
+	return code;
+}
+
+TEST(Emulator, DISABLED_ShaderParseBench)
+{
+	// Corpus sizes: a small post-processing shader, a typical material shader, a large uber shader
+	for (uint32_t body_num: {4u, 100u, 1000u})
+	{
+		auto src = create_shader(body_num);
+
+		ShaderCode code;
+		code.SetType(ShaderType::Compute);
+
+		ShaderParse(src.GetDataConst(), &code, false);
+		EXPECT_EQ(code.GetInstructions().Size(), 1 + 7 + body_num * 5 + 1);
+
+		auto name = String8::FromPrintf("ShaderParse %u dwords", src.Size());
+		UnitTest::Bench(name.c_str(), static_cast<uint64_t>(src.Size()) * 4,
+		                [&]()
+		                {
+			                ShaderParse(src.GetDataConst(), &code, false);
+			                g_sink = g_sink + code.GetInstructions().Size();
+		                });
+	}
+}
+
+#endif // KYTY_EMU_ENABLED
+
+UT_END();
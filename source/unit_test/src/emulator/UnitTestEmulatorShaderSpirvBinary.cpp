@@ -0,0 +1,221 @@
+#include "Kyty/Core/ByteBuffer.h"
+#include "Kyty/Core/File.h"
+#include "Kyty/Core/String.h"
+#include "Kyty/Core/String8.h"
+#include "Kyty/Core/Vector.h"
+#include "Kyty/UnitTest.h"
+
+#include "Emulator/Common.h"
+#include "Emulator/Graphics/ShaderSpirvBinary.h"
+
+#include "spirv-tools/libspirv.h"
+
+UT_BEGIN(EmulatorShaderSpirvBinary);
+
+#ifdef KYTY_EMU_ENABLED
+
+using Libs::Graphics::SpirvEncodeBinary;
+
+// Reference binary, same target environment as the fallback in Shader.cpp
+static Vector<uint32_t> assemble(const String8& src)
+{
+	Vector<uint32_t> ret;
+
+	spv_context    context = spvContextCreate(SPV_ENV_VULKAN_1_2);
+	spv_binary     binary  = nullptr;
+	spv_diagnostic diag    = nullptr;
+
+	if (spvTextToBinary(context, src.c_str(), src.Size(), &binary, &diag) == SPV_SUCCESS)
+	{
+		ret.Add(binary->code, static_cast<uint32_t>(binary->wordCount));
+	} else
+	{
+		ADD_FAILURE() << (diag != nullptr ? diag->error : "spvTextToBinary failed");
+	}
+
+	spvBinaryDestroy(binary);
+	spvDiagnosticDestroy(diag);
+	spvContextDestroy(context);
+
+	return ret;
+}
+
+static void test(const char* name, const String8& src)
+{
+	SCOPED_TRACE(name);
+
+	Vector<uint32_t> dst;
+	ASSERT_TRUE(SpirvEncodeBinary(src, &dst));
+
+	auto ref = assemble(src);
+	ASSERT_EQ(dst.Size(), ref.Size());
+
+	for (uint32_t i = 0; i < ref.Size(); i++)
+	{
+		// Word 2 is the generator magic number, it identifies the tool
+		if (i != 2)
+		{
+			EXPECT_EQ(dst.At(i), ref.At(i)) << "word " << i;
+		}
+	}
+}
+
+static String8 read_file(const char* name)
+{
+	Core::File f;
+	if (!f.Open(String::FromUtf8(name), Core::File::Mode::Read))
+	{
+		return "";
+	}
+	auto buf = f.ReadWholeBuffer();
+	f.Close();
+	return String8(reinterpret_cast<const char*>(buf.GetDataConst()), buf.Size());
+}
+
+static const char* g_src_ps = R"(
+               OpCapability Shader
+          %1 = OpExtInstImport "GLSL.std.450"
+               OpMemoryModel Logical GLSL450
+               OpEntryPoint Fragment %main "main" %outColor %inUv
+               OpExecutionMode %main OriginUpperLeft
+               OpDecorate %outColor Location 0
+               OpDecorate %inUv Location 0
+               OpDecorate %tex DescriptorSet 0
+               OpDecorate %tex Binding 1
+       %void = OpTypeVoid
+       %func = OpTypeFunction %void
+       %bool = OpTypeBool
+      %float = OpTypeFloat 32
+       %uint = OpTypeInt 32 0
+        %int = OpTypeInt 32 1
+    %v2float = OpTypeVector %float 2
+    %v4float = OpTypeVector %float 4
+ %_ptr_Output_v4float = OpTypePointer Output %v4float
+  %_ptr_Input_v2float = OpTypePointer Input %v2float
+         %img = OpTypeImage %float 2D 0 0 0 1 Unknown
+     %sampled = OpTypeSampledImage %img
+ %_ptr_UniformConstant_sampled = OpTypePointer UniformConstant %sampled
+   %outColor = OpVariable %_ptr_Output_v4float Output
+       %inUv = OpVariable %_ptr_Input_v2float Input
+        %tex = OpVariable %_ptr_UniformConstant_sampled UniformConstant
+    %float_0 = OpConstant %float 0
+  %float_0_5 = OpConstant %float 0.5
+ %float_n1e10 = OpConstant %float -1e+10
+   %uint_max = OpConstant %uint 4294967295
+     %int_m1 = OpConstant %int -1
+     %uint_1 = OpConstant %uint 0x1
+       %true = OpConstantTrue %bool
+      %black = OpConstantComposite %v4float %float_0 %float_0 %float_0 %float_0
+       %main = OpFunction %void None %func
+      %entry = OpLabel
+         %uv = OpLoad %v2float %inUv
+          %s = OpLoad %sampled %tex
+          %c = OpImageSampleImplicitLod %v4float %s %uv
+          %x = OpCompositeExtract %float %c 0
+          %y = OpExtInst %float %1 FClamp %x %float_0 %float_0_5
+       %cond = OpFOrdLessThan %bool %y %float_0_5
+               OpSelectionMerge %merge None
+               OpBranchConditional %cond %then %merge
+       %then = OpLabel
+         %c2 = OpVectorTimesScalar %v4float %c %y
+               OpStore %outColor %c2
+               OpBranch %merge
+      %merge = OpLabel
+          %u = OpBitcast %uint %x
+         %u2 = OpBitwiseAnd %uint %u %uint_max
+         %i2 = OpBitcast %int %u2
+         %i3 = OpIAdd %int %i2 %int_m1
+               OpReturn
+               OpFunctionEnd
+)";
+
+static const char* g_src_cs = R"(
+; Comments and blank lines are skipped
+
+               OpCapability Shader
+               OpCapability ImageQuery
+               OpMemoryModel Logical GLSL450
+               OpEntryPoint GLCompute %main "main" %gid
+               OpExecutionMode %main LocalSize 64 1 1
+               OpDecorate %gid BuiltIn GlobalInvocationId
+               OpDecorate %_runtimearr_uint ArrayStride 4
+               OpMemberDecorate %Buf 0 Offset 0
+               OpDecorate %Buf BufferBlock
+               OpDecorate %buf DescriptorSet 0
+               OpDecorate %buf Binding 0
+       %void = OpTypeVoid
+          %3 = OpTypeFunction %void
+       %uint = OpTypeInt 32 0
+     %v3uint = OpTypeVector %uint 3
+%_ptr_Input_v3uint = OpTypePointer Input %v3uint
+%_runtimearr_uint = OpTypeRuntimeArray %uint
+        %Buf = OpTypeStruct %_runtimearr_uint
+%_ptr_Uniform_Buf = OpTypePointer Uniform %Buf
+%_ptr_Uniform_uint = OpTypePointer Uniform %uint
+%_ptr_Function_uint = OpTypePointer Function %uint
+        %gid = OpVariable %_ptr_Input_v3uint Input
+        %buf = OpVariable %_ptr_Uniform_Buf Uniform
+     %uint_0 = OpConstant %uint 0
+     %uint_1 = OpConstant %uint 1
+    %uint_16 = OpConstant %uint 16
+       %bool = OpTypeBool
+       %main = OpFunction %void None %3
+          %5 = OpLabel
+          %i = OpVariable %_ptr_Function_uint Function
+               OpStore %i %uint_0
+               OpBranch %head
+       %head = OpLabel
+               OpLoopMerge %exit %cont None
+               OpBranch %body
+       %body = OpLabel
+         %iv = OpLoad %uint %i
+         %lt = OpULessThan %bool %iv %uint_16
+               OpBranchConditional %lt %work %exit
+       %work = OpLabel
+          %g = OpLoad %v3uint %gid
+         %gx = OpCompositeExtract %uint %g 0
+         %p  = OpAccessChain %_ptr_Uniform_uint %buf %uint_0 %gx
+          %v = OpLoad %uint %p
+         %v2 = OpShiftLeftLogical %uint %v %uint_1
+         %v3 = OpBitFieldUExtract %uint %v2 %uint_0 %uint_16
+               OpSwitch %v3 %cont 1 %case1 2 %case1
+      %case1 = OpLabel
+         %a  = OpAtomicIAdd %uint %p %uint_1 %uint_0 %v3
+               OpBranch %cont
+       %cont = OpLabel
+         %n  = OpIAdd %uint %iv %uint_1
+               OpStore %i %n
+               OpBranch %head
+       %exit = OpLabel
+               OpControlBarrier %uint_1 %uint_1 %uint_0
+               OpReturn
+               OpFunctionEnd
+)";
+
+TEST(Emulator, ShaderSpirvBinary)
+{
+	test("ps", g_src_ps);
+	test("cs", g_src_cs);
+
+	Vector<uint32_t> dst;
+	EXPECT_FALSE(SpirvEncodeBinary("OpCapability Shader\nOpNoSuchInstruction\n", &dst));
+	EXPECT_FALSE(SpirvEncodeBinary("OpCapability Kernel\n", &dst));
+}
+
+// The built-in shaders are hand written, they use the same subset as the recompiler
+TEST(Emulator, ShaderSpirvBinaryEmbedded)
+{
+	for (const char* name: {"EmbeddedVs0.spvasm", "EmbeddedPs0.spvasm", "EmbeddedCs0.spvasm", "EmbeddedCs1.spvasm", "EmbeddedCs2.spvasm"})
+	{
+		auto src = read_file(String8::FromPrintf("%s/%s", KYTY_EMBEDDED_SHADERS_DIR, name).c_str());
+		if (src.IsEmpty())
+		{
+			GTEST_SKIP();
+		}
+		test(name, src);
+	}
+}
+
+#endif // KYTY_EMU_ENABLED
+
+UT_END();
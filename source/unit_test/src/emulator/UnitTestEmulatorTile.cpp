@@ -0,0 +1,56 @@
+#include "Kyty/Core/ByteBuffer.h"
+#include "Kyty/Core/String8.h"
+#include "Kyty/UnitTest.h"
+
+#include "Emulator/Common.h"
+#include "Emulator/Graphics/Tile.h"
+
+UT_BEGIN(EmulatorTile);
+
+#ifdef KYTY_EMU_ENABLED
+
+using Libs::Graphics::TileConvertTiledToLinear;
+using Libs::Graphics::TileGetVideoOutSize;
+using Libs::Graphics::TileIsInitialized;
+using Libs::Graphics::TileMode;
+using Libs::Graphics::TileSizeAlign;
+
+// Detiling of the video out buffers, done for every flip
+TEST(Emulator, DISABLED_TileBench)
+{
+	if (!TileIsInitialized())
+	{
+		GTEST_SKIP();
+	}
+
+	struct Size
+	{
+		uint32_t width;
+		uint32_t height;
+	};
+
+	for (auto s: {Size {1280, 720}, Size {1920, 1080}, Size {3840, 2160}})
+	{
+		for (bool neo: {false, true})
+		{
+			TileSizeAlign size;
+			TileGetVideoOutSize(s.width, s.height, s.width, true, neo, &size);
+			ASSERT_NE(size.size, 0u);
+
+			auto src = UnitTest::CreateData(size.size, [](uint32_t i) { return i * 7u; });
+			auto dst = Core::ByteBuffer(s.width * s.height * 4);
+
+			auto name = String8::FromPrintf("TileConvertTiledToLinear %ux%u%s", s.width, s.height, neo ? ", neo" : "");
+			UnitTest::Bench(name.c_str(), static_cast<uint64_t>(s.width) * s.height * 4,
+			                [&]()
+			                {
+				                TileConvertTiledToLinear(dst.GetData(), src.GetDataConst(), TileMode::VideoOutTiled, s.width, s.height,
+				                                         neo);
+			                });
+		}
+	}
+}
+
+#endif // KYTY_EMU_ENABLED
+
+UT_END();